@@ -1,8 +1,12 @@
 //! Anonymization of data sets by removing data elements that identify the
 //! patient, or potentially contribute to identification of the patient.
 
+mod p10_anonymize_transform;
+
 use dcmfx_core::{DataElementTag, DataSet, ValueRepresentation, dictionary};
 
+pub use p10_anonymize_transform::P10AnonymizeTransform;
+
 const IDENTIFYING_DATA_ELEMENTS: [&dictionary::Item; 42] = [
   &dictionary::ACCESSION_NUMBER,
   &dictionary::ADMITTING_DIAGNOSES_CODE_SEQUENCE,
@@ -0,0 +1,396 @@
+//! Anonymization of a stream of DICOM P10 tokens without materializing a data
+//! set.
+
+use dcmfx_core::{
+  DataElementTag, DataElementValue, DataSet, DataSetPath, RcByteSlice,
+  ValueRepresentation, dictionary,
+};
+use dcmfx_p10::{P10Error, P10FilterTransform, P10Token, P10TokenTransform};
+
+use crate::filter_tag;
+
+/// UIDs with these tags identify classes of data rather than instances, and so
+/// are never remapped.
+///
+const CLASS_UID_DATA_ELEMENTS: [&dictionary::Item; 10] = [
+  &dictionary::CODING_SCHEME_UID,
+  &dictionary::IMPLEMENTATION_CLASS_UID,
+  &dictionary::MEDIA_STORAGE_SOP_CLASS_UID,
+  &dictionary::ORIGINAL_SPECIALIZED_SOP_CLASS_UID,
+  &dictionary::REFERENCED_SOP_CLASS_UID,
+  &dictionary::REFERENCED_TRANSFER_SYNTAX_UID_IN_FILE,
+  &dictionary::RELATED_GENERAL_SOP_CLASS_UID,
+  &dictionary::SOP_CLASS_UID,
+  &dictionary::SOP_CLASSES_IN_STUDY,
+  &dictionary::TRANSFER_SYNTAX_UID,
+];
+
+/// The root of UIDs defined by the DICOM standard, e.g. SOP classes and
+/// transfer syntaxes. UIDs under this root are never remapped.
+///
+const DICOM_UID_ROOT: &[u8] = b"1.2.840.10008.";
+
+/// Transform that anonymizes a stream of DICOM P10 tokens in the same way as
+/// [`crate::DataSetAnonymizeExtensions::anonymize()`], without building a data
+/// set. Data elements rejected by [`filter_tag()`] are removed, including whole
+/// sequences, and the UIDs of instances, e.g. the Study, Series, and SOP
+/// Instance UIDs, are replaced with new UIDs.
+///
+/// New UIDs are derived from the original UID and a secret key using a keyed
+/// hash, so the same UID is always given the same new UID by transforms that
+/// use the same key. This keeps references between the anonymized instances of
+/// a study intact, and needs no table of the UIDs seen so far. New UIDs have
+/// the form `2.25.<decimal>`.
+///
+/// Only the values of UI data elements are buffered, so memory use is constant
+/// regardless of the size of the data. Pixel data and all other value bytes are
+/// passed through without being copied, which means this transform can be
+/// placed after a pixel data transcode transform to de-identify and compress in
+/// a single pass.
+///
+pub struct P10AnonymizeTransform {
+  uid_key: (u64, u64),
+  filter_transform: P10FilterTransform,
+  pending_uid: Option<PendingUid>,
+}
+
+/// A UI data element whose value bytes are being gathered so that its UIDs can
+/// be remapped once they're all available.
+///
+struct PendingUid {
+  tag: DataElementTag,
+  vr: ValueRepresentation,
+  path: DataSetPath,
+  data: Vec<u8>,
+}
+
+impl P10AnonymizeTransform {
+  /// Creates a new transform for anonymizing a stream of DICOM P10 tokens.
+  ///
+  /// The key determines the new UIDs that replace the original ones. It should
+  /// be kept secret, and the same key used for all instances that are to keep
+  /// referring to each other after anonymization.
+  ///
+  pub fn new(uid_key: u128) -> Self {
+    Self {
+      uid_key: ((uid_key >> 64) as u64, uid_key as u64),
+      filter_transform: P10FilterTransform::new(Box::new(
+        |tag, vr, _length, _path| filter_tag(tag, vr),
+      )),
+      pending_uid: None,
+    }
+  }
+
+  /// Adds the next token to the anonymize transform and returns the tokens to
+  /// pass on in its place, which may be none.
+  ///
+  /// [`P10TokenTransform::push_token()`] avoids cloning the token and
+  /// allocating the returned vector.
+  ///
+  pub fn add_token(
+    &mut self,
+    token: &P10Token,
+  ) -> Result<Vec<P10Token>, P10Error> {
+    let mut output_tokens = vec![];
+
+    self.push_token(token.clone(), &mut |token| {
+      output_tokens.push(token);
+      Ok::<(), P10Error>(())
+    })?;
+
+    Ok(output_tokens)
+  }
+
+  /// Removes identifying data elements from the File Meta Information and
+  /// remaps its Media Storage SOP Instance UID.
+  ///
+  fn anonymize_file_meta_information(&self, data_set: &mut DataSet) {
+    data_set.retain(|tag, value| filter_tag(tag, value.value_representation()));
+
+    for (tag, value) in data_set.iter_mut() {
+      if value.value_representation() != ValueRepresentation::UniqueIdentifier
+        || !is_remapped_uid_tag(*tag)
+      {
+        continue;
+      }
+
+      if let Ok(bytes) = value.bytes() {
+        *value = DataElementValue::new_binary_unchecked(
+          ValueRepresentation::UniqueIdentifier,
+          self.remap_uids(bytes).into(),
+        );
+      }
+    }
+  }
+
+  /// Remaps each of the UIDs in the bytes of a UI value, returning the new
+  /// bytes padded to an even length.
+  ///
+  fn remap_uids(&self, bytes: &[u8]) -> Vec<u8> {
+    let bytes = bytes.trim_ascii_end();
+    let bytes = bytes.strip_suffix(b"\0").unwrap_or(bytes);
+
+    let mut result = Vec::with_capacity(64);
+
+    for (i, uid) in bytes.split(|c| *c == b'\\').enumerate() {
+      if i > 0 {
+        result.push(b'\\');
+      }
+
+      let uid = uid.trim_ascii();
+
+      if uid.is_empty() || uid.starts_with(DICOM_UID_ROOT) {
+        result.extend_from_slice(uid);
+      } else {
+        let hash = ((siphash_2_4(self.uid_key, uid) as u128) << 64)
+          | siphash_2_4((self.uid_key.1, self.uid_key.0), uid) as u128;
+
+        result.extend_from_slice(b"2.25.");
+        result.extend_from_slice(hash.to_string().as_bytes());
+      }
+    }
+
+    if result.len() % 2 == 1 {
+      result.push(0);
+    }
+
+    result
+  }
+}
+
+impl P10TokenTransform for P10AnonymizeTransform {
+  type Error = P10Error;
+
+  fn push_token<E: From<P10Error>>(
+    &mut self,
+    token: P10Token,
+    sink: &mut impl FnMut(P10Token) -> Result<(), E>,
+  ) -> Result<(), E> {
+    if !self.filter_transform.add_token(&token)? {
+      return Ok(());
+    }
+
+    match token {
+      P10Token::FileMetaInformation { mut data_set } => {
+        self.anonymize_file_meta_information(&mut data_set);
+
+        sink(P10Token::FileMetaInformation { data_set })
+      }
+
+      P10Token::DataElementHeader { tag, vr, path, .. }
+        if vr == ValueRepresentation::UniqueIdentifier
+          && is_remapped_uid_tag(tag) =>
+      {
+        self.pending_uid = Some(PendingUid {
+          tag,
+          vr,
+          path,
+          data: vec![],
+        });
+
+        Ok(())
+      }
+
+      P10Token::DataElementValueBytes {
+        data,
+        bytes_remaining,
+        ..
+      } if self.pending_uid.is_some() => {
+        if let Some(pending_uid) = self.pending_uid.as_mut() {
+          pending_uid.data.extend_from_slice(&data);
+        }
+
+        if bytes_remaining > 0 {
+          return Ok(());
+        }
+
+        let Some(PendingUid {
+          tag,
+          vr,
+          path,
+          data,
+        }) = self.pending_uid.take()
+        else {
+          return Ok(());
+        };
+
+        let data: RcByteSlice = self.remap_uids(&data).into();
+
+        sink(P10Token::DataElementHeader {
+          tag,
+          vr,
+          length: data.len() as u32,
+          path,
+        })?;
+
+        sink(P10Token::DataElementValueBytes {
+          tag,
+          vr,
+          data,
+          bytes_remaining: 0,
+        })
+      }
+
+      token => sink(token),
+    }
+  }
+}
+
+/// Returns whether UIDs with the given tag are remapped.
+///
+fn is_remapped_uid_tag(tag: DataElementTag) -> bool {
+  !CLASS_UID_DATA_ELEMENTS.iter().any(|item| item.tag == tag)
+}
+
+/// Returns the SipHash-2-4 of some bytes with the given key.
+///
+fn siphash_2_4(key: (u64, u64), bytes: &[u8]) -> u64 {
+  let mut v = [
+    key.0 ^ 0x736f6d6570736575,
+    key.1 ^ 0x646f72616e646f6d,
+    key.0 ^ 0x6c7967656e657261,
+    key.1 ^ 0x7465646279746573,
+  ];
+
+  fn round(v: &mut [u64; 4]) {
+    v[0] = v[0].wrapping_add(v[1]);
+    v[1] = v[1].rotate_left(13) ^ v[0];
+    v[0] = v[0].rotate_left(32);
+    v[2] = v[2].wrapping_add(v[3]);
+    v[3] = v[3].rotate_left(16) ^ v[2];
+    v[0] = v[0].wrapping_add(v[3]);
+    v[3] = v[3].rotate_left(21) ^ v[0];
+    v[2] = v[2].wrapping_add(v[1]);
+    v[1] = v[1].rotate_left(17) ^ v[2];
+    v[2] = v[2].rotate_left(32);
+  }
+
+  let mut compress = |m: u64| {
+    v[3] ^= m;
+    round(&mut v);
+    round(&mut v);
+    v[0] ^= m;
+  };
+
+  let mut chunks = bytes.chunks_exact(8);
+  for chunk in chunks.by_ref() {
+    compress(u64::from_le_bytes(chunk.try_into().unwrap()));
+  }
+
+  // The final block holds the remaining bytes and the length of the input
+  let mut last_block = [0u8; 8];
+  last_block[..chunks.remainder().len()].copy_from_slice(chunks.remainder());
+  last_block[7] = bytes.len() as u8;
+  compress(u64::from_le_bytes(last_block));
+
+  v[2] ^= 0xFF;
+  for _ in 0..4 {
+    round(&mut v);
+  }
+
+  v[0] ^ v[1] ^ v[2] ^ v[3]
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn siphash_2_4_test() {
+    // Reference vectors from the SipHash paper, with the key 00 01 02 … 0F and
+    // inputs of the bytes 00 01 02 …
+    let key = (0x0706050403020100, 0x0F0E0D0C0B0A0908);
+
+    assert_eq!(siphash_2_4(key, &[]), 0x726FDB47DD0E0E31);
+    assert_eq!(
+      siphash_2_4(key, &(0..15).collect::<Vec<u8>>()),
+      0xA129CA6149BE45E5
+    );
+  }
+
+  #[test]
+  fn add_token_test() {
+    let mut transform = P10AnonymizeTransform::new(1234);
+
+    let mut add_element = |tag: DataElementTag, vr, data: &[u8]| {
+      let mut tokens = transform
+        .add_token(&P10Token::DataElementHeader {
+          tag,
+          vr,
+          length: data.len() as u32,
+          path: DataSetPath::new_with_data_element(tag),
+        })
+        .unwrap();
+
+      tokens.extend(
+        transform
+          .add_token(&P10Token::DataElementValueBytes {
+            tag,
+            vr,
+            data: data.to_vec().into(),
+            bytes_remaining: 0,
+          })
+          .unwrap(),
+      );
+
+      tokens
+    };
+
+    // Identifying data elements are removed
+    assert!(
+      add_element(
+        dictionary::PATIENT_NAME.tag,
+        ValueRepresentation::PersonName,
+        b"Doe^John",
+      )
+      .is_empty()
+    );
+
+    // Class UIDs are passed through
+    let sop_class_uid = add_element(
+      dictionary::SOP_CLASS_UID.tag,
+      ValueRepresentation::UniqueIdentifier,
+      b"1.2.3.4\0",
+    );
+    assert_eq!(
+      sop_class_uid[1],
+      P10Token::DataElementValueBytes {
+        tag: dictionary::SOP_CLASS_UID.tag,
+        vr: ValueRepresentation::UniqueIdentifier,
+        data: b"1.2.3.4\0".to_vec().into(),
+        bytes_remaining: 0,
+      }
+    );
+
+    // Instance UIDs are remapped consistently
+    let remap = |tokens: Vec<P10Token>| match tokens.as_slice() {
+      [
+        P10Token::DataElementHeader { length, .. },
+        P10Token::DataElementValueBytes { data, .. },
+      ] => {
+        assert_eq!(*length as usize, data.len());
+        assert_eq!(data.len() % 2, 0);
+        String::from_utf8(data.to_vec()).unwrap()
+      }
+
+      _ => panic!("Unexpected tokens: {tokens:?}"),
+    };
+
+    let study_uid = remap(add_element(
+      dictionary::STUDY_INSTANCE_UID.tag,
+      ValueRepresentation::UniqueIdentifier,
+      b"1.2.3.4.5\0",
+    ));
+    let referenced_uids = remap(add_element(
+      dictionary::REFERENCED_SOP_INSTANCE_UID.tag,
+      ValueRepresentation::UniqueIdentifier,
+      b"1.2.3.4.5\\1.2.840.10008.1.2",
+    ));
+
+    assert!(study_uid.starts_with("2.25."));
+    assert_eq!(
+      referenced_uids.trim_end_matches('\0'),
+      format!("{}\\1.2.840.10008.1.2", study_uid.trim_end_matches('\0'))
+    );
+  }
+}
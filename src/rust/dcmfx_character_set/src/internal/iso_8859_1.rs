@@ -1,4 +1,7 @@
-use crate::internal::lookup_table_8bit;
+#[cfg(not(feature = "std"))]
+use alloc::string::String;
+
+use crate::internal::lookup_table_8bit::{self, Utf8LookupTable};
 
 /// Decodes the next codepoint from the given ISO 8859 Part 1 bytes.
 ///
@@ -6,6 +9,16 @@ pub fn decode_next_codepoint(bytes: &[u8]) -> Result<(char, &[u8]), ()> {
   lookup_table_8bit::decode_next_codepoint(bytes, &LOOKUP_TABLE)
 }
 
+/// Decodes ISO 8859 Part 1 bytes to a string. This is faster than decoding
+/// each codepoint with [`decode_next_codepoint()`].
+///
+pub fn decode_bytes(bytes: &[u8]) -> String {
+  lookup_table_8bit::decode_bytes(bytes, &UTF8_LOOKUP_TABLE)
+}
+
+const UTF8_LOOKUP_TABLE: Utf8LookupTable =
+  lookup_table_8bit::utf8_lookup_table(&LOOKUP_TABLE);
+
 const LOOKUP_TABLE: [u16; 256] = [
   0x0000, 0x0001, 0x0002, 0x0003, 0x0004, 0x0005, 0x0006, 0x0007, 0x0008,
   0x0009, 0x000A, 0x000B, 0x000C, 0x000D, 0x000E, 0x000F, 0x0010, 0x0011,
@@ -1,3 +1,6 @@
+#[cfg(not(feature = "std"))]
+use alloc::{string::String, vec::Vec};
+
 use crate::internal::utils;
 
 /// Decodes the next codepoint from the given bytes using an 8-bit lookup table.
@@ -20,3 +23,85 @@ pub fn decode_next_codepoint<'a>(
     _ => Err(()),
   }
 }
+
+/// The UTF-8 bytes for each of the 256 entries in an 8-bit lookup table. Every
+/// 16-bit codepoint encodes to at most three UTF-8 bytes, and the fourth byte
+/// holds the number of bytes used.
+///
+pub type Utf8LookupTable = [[u8; 4]; 256];
+
+/// Converts an 8-bit lookup table of codepoints into a table of the UTF-8
+/// bytes for each codepoint. Invalid codepoints are converted to the
+/// replacement character.
+///
+pub const fn utf8_lookup_table(lookup_table: &[u16; 256]) -> Utf8LookupTable {
+  let mut utf8_lookup_table = [[0; 4]; 256];
+
+  let mut i = 0;
+  while i < 256 {
+    let codepoint = match char::from_u32(lookup_table[i] as u32) {
+      Some(c) => c,
+      None => utils::REPLACEMENT_CHARACTER,
+    };
+
+    let mut bytes = [0; 4];
+    let length = codepoint.encode_utf8(&mut bytes).len();
+
+    utf8_lookup_table[i] = [bytes[0], bytes[1], bytes[2], length as u8];
+
+    i += 1;
+  }
+
+  utf8_lookup_table
+}
+
+/// Decodes bytes to a string using a table created by [`utf8_lookup_table()`].
+/// This is equivalent to calling [`decode_next_codepoint()`] for every byte,
+/// but avoids decoding and re-encoding each codepoint.
+///
+pub fn decode_bytes(
+  bytes: &[u8],
+  utf8_lookup_table: &Utf8LookupTable,
+) -> String {
+  let mut output = Vec::with_capacity(bytes.len() + bytes.len() / 2);
+
+  for byte in bytes {
+    let [b0, b1, b2, length] = utf8_lookup_table[usize::from(*byte)];
+
+    if length == 1 {
+      output.push(b0);
+    } else {
+      output.extend_from_slice(&[b0, b1, b2][..usize::from(length)]);
+    }
+  }
+
+  // This unwrap is safe because the table only holds valid UTF-8 sequences
+  String::from_utf8(output).unwrap()
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn decode_bytes_test() {
+    let lookup_table = core::array::from_fn(|i| match i {
+      0x00..=0x7F => i as u16,
+      0x80 => 0xD800,
+      _ => 0x0400 + i as u16,
+    });
+
+    let utf8_lookup_table = utf8_lookup_table(&lookup_table);
+
+    let bytes: Vec<u8> = (0..=255).collect();
+
+    let mut expected = String::new();
+    let mut remaining = bytes.as_slice();
+    while let Ok((c, rest)) = decode_next_codepoint(remaining, &lookup_table) {
+      expected.push(c);
+      remaining = rest;
+    }
+
+    assert_eq!(decode_bytes(&bytes, &utf8_lookup_table), expected);
+  }
+}
@@ -157,7 +157,19 @@ impl SpecificCharacterSet {
   /// replaced with the U+FFFD character: �.
   ///
   pub fn decode_bytes(&self, bytes: &[u8], string_type: StringType) -> String {
+    if let Some(s) = self.passthrough_str(bytes) {
+      return s.to_string();
+    }
+
     match self.0.as_slice() {
+      // ISO IR 6 is decoded as ISO IR 100, see `iso_ir_6.rs` for details
+      [charset]
+        if *charset == &character_set::ISO_IR_100
+          || *charset == &character_set::ISO_IR_6 =>
+      {
+        internal::iso_8859_1::decode_bytes(bytes)
+      }
+
       [
         CharacterSet::SingleByteWithoutExtensions {
           defined_term,
@@ -192,6 +204,59 @@ impl SpecificCharacterSet {
     }
   }
 
+  /// Returns whether decoding the given bytes with this specific character set
+  /// would return them unchanged. When this is the case the bytes are already
+  /// valid UTF-8 and can be used directly without calling
+  /// [`Self::decode_bytes()`].
+  ///
+  pub fn is_passthrough(&self, bytes: &[u8]) -> bool {
+    self.passthrough_str(bytes).is_some()
+  }
+
+  /// Returns the given bytes as a string if decoding them with this specific
+  /// character set would return them unchanged. This is the case for valid
+  /// UTF-8 when the character set is UTF-8, and for plain ASCII when the
+  /// character set maps ASCII to itself.
+  ///
+  fn passthrough_str<'a>(&self, bytes: &'a [u8]) -> Option<&'a str> {
+    if self.is_utf8() || (self.is_ascii_compatible() && is_plain_ascii(bytes)) {
+      core::str::from_utf8(bytes).ok()
+    } else {
+      None
+    }
+  }
+
+  /// Returns whether this specific character set decodes bytes that are plain
+  /// ASCII, as defined by [`is_plain_ascii()`], to the same characters.
+  ///
+  /// This isn't the case for JIS X 0201, which replaces the backslash and
+  /// tilde characters, or for ISO 2022 character sets that have a multi-byte
+  /// G0 code element.
+  ///
+  fn is_ascii_compatible(&self) -> bool {
+    match self.0.as_slice() {
+      [CharacterSet::SingleByteWithoutExtensions { defined_term, .. }] => {
+        *defined_term != "ISO_IR 13"
+      }
+
+      [CharacterSet::MultiByteWithoutExtensions { .. }] => true,
+
+      [
+        CharacterSet::SingleByteWithExtensions { defined_term, .. },
+        ..,
+      ] => *defined_term != "ISO 2022 IR 13",
+
+      [
+        CharacterSet::MultiByteWithExtensions {
+          code_element_g0, ..
+        },
+        ..,
+      ] => code_element_g0.is_none(),
+
+      _ => false, // grcov-excl-line
+    }
+  }
+
   fn decode_iso_2022_bytes(
     &self,
     mut bytes: &[u8],
@@ -339,6 +404,27 @@ fn update_code_element<'a>(
   }
 }
 
+/// Returns whether the given bytes are plain ASCII, meaning that every byte is
+/// less than 0x7F and none are the ESC character (0x1B) that begins an ISO
+/// 2022 escape sequence. DEL (0x7F) is excluded because the ISO 8859 character
+/// sets decode it to the replacement character.
+///
+fn is_plain_ascii(bytes: &[u8]) -> bool {
+  // Check fixed-size chunks without branching inside each chunk so that the
+  // checks are vectorized, and stop at the first chunk that fails
+  bytes.chunks(32).all(|chunk| {
+    let mut high_bits = 0u8;
+    let mut has_escape = false;
+
+    for byte in chunk {
+      high_bits |= byte | byte.wrapping_add(1);
+      has_escape |= *byte == 0x1B;
+    }
+
+    high_bits & 0x80 == 0 && !has_escape
+  })
+}
+
 /// Replaces all bytes greater than 0x7F with the value 0x3F, i.e. the question
 /// mark character. This can be used to ensure that only valid ISO 646/US-ASCII
 /// bytes are present.
@@ -969,6 +1055,72 @@ mod tests {
     );
   }
 
+  #[test]
+  pub fn decode_bytes_passthrough_test() {
+    let is_passthrough = |specific_character_set: &str, bytes: &[u8]| {
+      SpecificCharacterSet::from_string(specific_character_set)
+        .unwrap()
+        .is_passthrough(bytes)
+    };
+
+    assert!(is_passthrough("ISO_IR 100", b"Doe^John\\Smith^Jane"));
+    assert!(is_passthrough("", b"Hello\r\n"));
+    assert!(is_passthrough(
+      "ISO 2022 IR 6\\ISO 2022 IR 87",
+      b"Yamada^Tarou"
+    ));
+    assert!(is_passthrough("ISO 2022 IR 149", b"Hong^Gildong"));
+    assert!(is_passthrough("GB18030", b"Wang^XiaoDong"));
+    assert!(is_passthrough("ISO_IR 192", "Buc^Jérôme".as_bytes()));
+
+    assert!(!is_passthrough("ISO_IR 100", &[0x4A, 0xE9]));
+    assert!(!is_passthrough("ISO_IR 100", &[0x4A, 0x7F]));
+    assert!(!is_passthrough("ISO_IR 13", b"a\\b~"));
+    assert!(!is_passthrough("ISO 2022 IR 13\\ISO 2022 IR 87", b"abc"));
+    assert!(!is_passthrough(
+      "ISO 2022 IR 6\\ISO 2022 IR 87",
+      &[0x1B, 0x28]
+    ));
+    assert!(!is_passthrough("ISO_IR 192", &[0x41, 0xC0, 0x80]));
+
+    // Check ASCII is decoded the same way with and without the passthrough
+    assert_eq!(
+      decode_bytes("ISO_IR 100", b"Doe^John", StringType::PersonName),
+      "Doe^John"
+    );
+    assert_eq!(
+      decode_bytes("ISO_IR 13", b"a\\b~", StringType::MultiValue),
+      "a\\b\u{203E}"
+    );
+
+    // Check invalid UTF-8 falls back to per-codepoint decoding
+    assert_eq!(
+      decode_bytes("ISO_IR 192", &[0x41, 0xF0, 0x42], StringType::SingleValue),
+      "A\u{FFFD}B"
+    );
+  }
+
+  #[test]
+  pub fn decode_bytes_iso_ir_100_test() {
+    let bytes: Vec<u8> = (0..=255).collect();
+
+    let expected: String = bytes
+      .iter()
+      .map(|byte| {
+        internal::iso_8859_1::decode_next_codepoint(&[*byte])
+          .unwrap()
+          .0
+      })
+      .collect();
+
+    for specific_character_set in ["ISO_IR 6", "ISO_IR 100"] {
+      assert_eq!(
+        decode_bytes(specific_character_set, &bytes, StringType::SingleValue),
+        expected
+      );
+    }
+  }
+
   fn decode_bytes(
     specific_character_set: &str,
     bytes: &[u8],
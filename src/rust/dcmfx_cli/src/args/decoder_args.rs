@@ -2,7 +2,10 @@ use clap::{Args, ValueEnum, builder::PossibleValue};
 
 use dcmfx::pixel_data::{
   PixelDataDecodeConfig,
-  decode::{HighThroughputJpeg2000Decoder, JpegXlDecoder},
+  decode::{
+    HighThroughputJpeg2000Decoder, JpegBaselineDecoder, JpegLosslessDecoder,
+    JpegXlDecoder,
+  },
 };
 
 #[derive(Args, Debug)]
@@ -12,8 +15,9 @@ pub struct DecoderArgs {
     help_heading = "Pixel Data Decoding",
     help = "The library to use for decoding High-Throughput JPEG 2000 pixel \
       data. The OpenJPH library is preferred because it is the fastest \
-      available decoder. However, WASM builds of DCMfx always use OpenJPEG and \
-      so testing that library via the CLI tool is sometimes useful.\n\
+      available decoder. However, WASM builds of DCMfx use OpenJPEG by \
+      default, and so testing that library via the CLI tool is sometimes \
+      useful.\n\
       \n\
       There can be very slight differences in output between decoders when \
       decoding lossy High-Throughput JPEG 2000.",
@@ -34,6 +38,57 @@ pub struct DecoderArgs {
     default_value_t = JpegXlDecoderArg::LibJxl
   )]
   jpeg_xl_decoder: JpegXlDecoderArg,
+
+  #[arg(
+    long,
+    help_heading = "Pixel Data Decoding",
+    help = "The library to use for decoding JPEG Lossless pixel data. The \
+      libjpeg_16bit library is preferred because it is the fastest available \
+      decoder. However, WASM builds of DCMfx always use jpeg-decoder and so \
+      testing that library via the CLI tool is sometimes useful.\n\
+      \n\
+      There should be no difference in output between decoders.",
+    default_value_t = JpegLosslessDecoderArg::LibJpeg16Bit
+  )]
+  jpeg_lossless_decoder: JpegLosslessDecoderArg,
+
+  #[arg(
+    long,
+    help_heading = "Pixel Data Decoding",
+    help = "The library to use for decoding JPEG Baseline 8-bit pixel data. \
+      The libjpeg_8bit library uses SIMD and decodes restart intervals in \
+      parallel, and so is usually the faster decoder. It isn't available in \
+      WASM builds of DCMfx, which always use zune-jpeg.\n\
+      \n\
+      There can be very slight differences in output between decoders.",
+    default_value_t = JpegBaselineDecoderArg::ZuneJpeg
+  )]
+  jpeg_baseline_decoder: JpegBaselineDecoderArg,
+
+  #[arg(
+    long,
+    help_heading = "Pixel Data Decoding",
+    value_name = "PASSES",
+    help = "The maximum number of coding passes to decode in each code-block \
+      of JPEG 2000 and High-Throughput JPEG 2000 pixel data. Decoding fewer \
+      passes skips the least significant bit planes, which is faster and \
+      gives a lower quality image that's useful as a quick preview. For \
+      High-Throughput JPEG 2000, a value of 1 decodes only the cleanup pass. \
+      By default all coding passes are decoded."
+  )]
+  jpeg_2000_coding_passes: Option<u32>,
+
+  #[arg(
+    long,
+    help_heading = "Pixel Data Decoding",
+    help = "Decode lossy JPEG XL pixel data without libjxl's restoration \
+      filters, i.e. Gaborish, the edge-preserving filter, and noise synthesis. \
+      This is faster and gives an image with more visible block edges that's \
+      useful as a quick preview. It has no effect on lossless data, or when \
+      using jxl-oxide.",
+    default_value_t = false
+  )]
+  jpeg_xl_preview: bool,
 }
 
 impl DecoderArgs {
@@ -43,6 +98,12 @@ impl DecoderArgs {
         .high_throughput_jpeg_2000_decoder
         .into(),
       jpeg_xl_decoder: self.jpeg_xl_decoder.into(),
+      jpeg_lossless_decoder: self.jpeg_lossless_decoder.into(),
+      jpeg_baseline_decoder: self.jpeg_baseline_decoder.into(),
+      thread_count: crate::utils::cpu_budget::threads_per_task(),
+      jpeg_2000_coding_passes: self.jpeg_2000_coding_passes.unwrap_or(0),
+      jpeg_xl_preview: self.jpeg_xl_preview,
+      ..PixelDataDecodeConfig::default()
     }
   }
 }
@@ -134,3 +195,85 @@ impl core::fmt::Display for JpegXlDecoderArg {
     }
   }
 }
+
+/// Enum for specifying the decoder to use for JPEG Lossless pixel data.
+///
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum JpegLosslessDecoderArg {
+  LibJpeg16Bit,
+  JpegDecoder,
+}
+
+impl From<JpegLosslessDecoderArg> for JpegLosslessDecoder {
+  fn from(value: JpegLosslessDecoderArg) -> Self {
+    match value {
+      JpegLosslessDecoderArg::LibJpeg16Bit => JpegLosslessDecoder::LibJpeg16Bit,
+      JpegLosslessDecoderArg::JpegDecoder => JpegLosslessDecoder::JpegDecoder,
+    }
+  }
+}
+
+impl ValueEnum for JpegLosslessDecoderArg {
+  fn value_variants<'a>() -> &'a [Self] {
+    &[Self::LibJpeg16Bit, Self::JpegDecoder]
+  }
+
+  fn to_possible_value(&self) -> Option<PossibleValue> {
+    Some(match self {
+      Self::LibJpeg16Bit => PossibleValue::new("libjpeg_16bit")
+        .help("Use libjpeg_16bit for decoding JPEG Lossless pixel data."),
+      Self::JpegDecoder => PossibleValue::new("jpeg-decoder")
+        .help("Use jpeg-decoder for decoding JPEG Lossless pixel data."),
+    })
+  }
+}
+
+impl core::fmt::Display for JpegLosslessDecoderArg {
+  fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+    match self {
+      JpegLosslessDecoderArg::LibJpeg16Bit => write!(f, "libjpeg_16bit"),
+      JpegLosslessDecoderArg::JpegDecoder => write!(f, "jpeg-decoder"),
+    }
+  }
+}
+
+/// Enum for specifying the decoder to use for JPEG Baseline 8-bit pixel data.
+///
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum JpegBaselineDecoderArg {
+  LibJpeg8Bit,
+  ZuneJpeg,
+}
+
+impl From<JpegBaselineDecoderArg> for JpegBaselineDecoder {
+  fn from(value: JpegBaselineDecoderArg) -> Self {
+    match value {
+      JpegBaselineDecoderArg::LibJpeg8Bit => JpegBaselineDecoder::LibJpeg8Bit,
+      JpegBaselineDecoderArg::ZuneJpeg => JpegBaselineDecoder::ZuneJpeg,
+    }
+  }
+}
+
+impl ValueEnum for JpegBaselineDecoderArg {
+  fn value_variants<'a>() -> &'a [Self] {
+    &[Self::LibJpeg8Bit, Self::ZuneJpeg]
+  }
+
+  fn to_possible_value(&self) -> Option<PossibleValue> {
+    Some(match self {
+      Self::LibJpeg8Bit => PossibleValue::new("libjpeg_8bit")
+        .help("Use libjpeg_8bit for decoding JPEG Baseline 8-bit pixel data."),
+      Self::ZuneJpeg => PossibleValue::new("zune-jpeg")
+        .help("Use zune-jpeg for decoding JPEG Baseline 8-bit pixel data."),
+    })
+  }
+}
+
+impl core::fmt::Display for JpegBaselineDecoderArg {
+  fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+    match self {
+      JpegBaselineDecoderArg::LibJpeg8Bit => write!(f, "libjpeg_8bit"),
+      JpegBaselineDecoderArg::ZuneJpeg => write!(f, "zune-jpeg"),
+    }
+  }
+}
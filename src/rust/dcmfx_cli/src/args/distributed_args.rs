@@ -0,0 +1,71 @@
+use std::time::Duration;
+
+use clap::Args;
+
+use crate::utils::work_leases::WorkLeases;
+
+#[derive(Args, Debug)]
+pub struct DistributedArgs {
+  #[arg(
+    long,
+    help_heading = "Distributed",
+    value_name = "URL",
+    help = "Distributes the inputs between workers on different machines that \
+      are given the same inputs and lease prefix. Each input is processed by \
+      the first worker to create a lease object for it under this object URL \
+      or directory, and is skipped by all workers once it's done, including \
+      when the command is rerun. Leases held by workers that stop are taken \
+      over once they expire.\n\
+      \n\
+      Inputs that fail are retried, and their lease is then released so that \
+      another worker can retry them. Each worker continues on with the \
+      remaining inputs and prints its throughput on exit."
+  )]
+  pub lease_prefix: Option<String>,
+
+  #[arg(
+    long,
+    help_heading = "Distributed",
+    help = "The name of this worker recorded in its leases and throughput \
+      report. Defaults to the host name and process ID."
+  )]
+  pub worker_id: Option<String>,
+
+  #[arg(
+    long,
+    help_heading = "Distributed",
+    value_name = "SECONDS",
+    help = "The time after which a lease that hasn't been renewed expires. \
+      Leases are renewed while their input is being processed.",
+    default_value_t = 300
+  )]
+  pub lease_duration: u64,
+
+  #[arg(
+    long,
+    help_heading = "Distributed",
+    help = "The number of times a worker retries an input that fails before \
+      releasing its lease.",
+    default_value_t = 2
+  )]
+  pub retries: usize,
+}
+
+impl DistributedArgs {
+  /// Returns the work leases to distribute inputs with, if a lease prefix was
+  /// specified.
+  ///
+  pub async fn work_leases(&self) -> Option<WorkLeases> {
+    let lease_prefix = self.lease_prefix.as_ref()?;
+
+    Some(
+      WorkLeases::new(
+        lease_prefix,
+        self.worker_id.clone(),
+        Duration::from_secs(self.lease_duration),
+        self.retries,
+      )
+      .await,
+    )
+  }
+}
@@ -11,12 +11,15 @@ use tokio::io::AsyncBufReadExt;
 
 use crate::utils::{
   input_source::InputSource,
+  multipart,
   object_store::{local_path_to_store_and_path, object_url_to_store_and_path},
 };
 
 #[derive(Args, Debug)]
 pub struct BaseInputArgs {
-  #[arg(help = "Input filenames. Specify '-' to read from stdin.")]
+  #[arg(help = "Input filenames. Specify '-' to read from stdin. HTTP URLs \
+    are requested as DICOMweb WADO-RS retrieves, and each part of their \
+    multipart response is processed as a separate input.")]
   pub input_filenames: Vec<PathBuf>,
 
   #[arg(
@@ -112,6 +115,16 @@ fn input_sources_for_input_filename(
     if input_filename_str == "-" {
       yield InputSource::Stdin;
     }
+    // Handle multipart HTTP responses, e.g. DICOMweb WADO-RS retrieves
+    else if multipart::is_http_url(&input_filename_str) {
+      let mut stream =
+        multipart::http_multipart_input_sources(input_filename_str.to_string())
+          .await;
+
+      while let Some(input_source) = stream.next().await {
+        yield input_source;
+      }
+    }
     // Handle object URLs
     else if let Ok((object_store, object_path)) =
       object_url_to_store_and_path(&input_filename_str).await
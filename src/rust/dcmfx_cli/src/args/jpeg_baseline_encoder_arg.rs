@@ -0,0 +1,44 @@
+use clap::{ValueEnum, builder::PossibleValue};
+
+use dcmfx::pixel_data::encode::JpegBaselineEncoder;
+
+/// Enum for specifying the encoder to use for JPEG Baseline 8-bit pixel data.
+///
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum JpegBaselineEncoderArg {
+  JpegEncoder,
+  LibJpeg8Bit,
+}
+
+impl From<JpegBaselineEncoderArg> for JpegBaselineEncoder {
+  fn from(value: JpegBaselineEncoderArg) -> Self {
+    match value {
+      JpegBaselineEncoderArg::JpegEncoder => JpegBaselineEncoder::JpegEncoder,
+      JpegBaselineEncoderArg::LibJpeg8Bit => JpegBaselineEncoder::LibJpeg8Bit,
+    }
+  }
+}
+
+impl ValueEnum for JpegBaselineEncoderArg {
+  fn value_variants<'a>() -> &'a [Self] {
+    &[Self::JpegEncoder, Self::LibJpeg8Bit]
+  }
+
+  fn to_possible_value(&self) -> Option<PossibleValue> {
+    Some(match self {
+      Self::JpegEncoder => PossibleValue::new("jpeg-encoder")
+        .help("Use jpeg-encoder for encoding JPEG Baseline 8-bit pixel data."),
+      Self::LibJpeg8Bit => PossibleValue::new("libjpeg_8bit")
+        .help("Use libjpeg_8bit for encoding JPEG Baseline 8-bit pixel data."),
+    })
+  }
+}
+
+impl core::fmt::Display for JpegBaselineEncoderArg {
+  fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+    match self {
+      JpegBaselineEncoderArg::JpegEncoder => write!(f, "jpeg-encoder"),
+      JpegBaselineEncoderArg::LibJpeg8Bit => write!(f, "libjpeg_8bit"),
+    }
+  }
+}
@@ -0,0 +1,29 @@
+use clap::ValueEnum;
+
+use dcmfx::pixel_data::simd_targets::MaxSimdLevel;
+
+/// Enum for specifying the widest SIMD instruction sets that codecs may use as
+/// a CLI argument.
+///
+#[derive(Debug, Clone, Copy, PartialEq, ValueEnum)]
+pub enum MaxSimdLevelArg {
+  /// Only the SIMD instruction sets that every CPU of the architecture
+  /// supports, i.e. SSE2 on x86_64 and NEON on aarch64.
+  Baseline,
+
+  /// Up to AVX2 on x86_64, which excludes AVX-512.
+  Avx2,
+
+  /// The widest SIMD instruction sets that the CPU supports.
+  Unlimited,
+}
+
+impl From<MaxSimdLevelArg> for MaxSimdLevel {
+  fn from(value: MaxSimdLevelArg) -> Self {
+    match value {
+      MaxSimdLevelArg::Baseline => MaxSimdLevel::Baseline,
+      MaxSimdLevelArg::Avx2 => MaxSimdLevel::Avx2,
+      MaxSimdLevelArg::Unlimited => MaxSimdLevel::Unlimited,
+    }
+  }
+}
@@ -4,8 +4,12 @@ use dcmfx::{
 };
 
 pub mod decoder_args;
+pub mod distributed_args;
 pub mod frame_selection_arg;
 pub mod input_args;
+pub mod jpeg_baseline_encoder_arg;
+#[cfg(feature = "pixel_data_native")]
+pub mod max_simd_level_arg;
 pub mod photometric_interpretation_arg;
 pub mod planar_configuration_arg;
 pub mod standard_color_palette_arg;
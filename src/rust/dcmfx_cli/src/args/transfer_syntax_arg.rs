@@ -21,6 +21,7 @@ pub enum TransferSyntaxArg {
   Jpeg2000LosslessOnly,
   Jpeg2000,
   HighThroughputJpeg2000LosslessOnly,
+  HighThroughputJpeg2000WithRpclOptionsLosslessOnly,
   HighThroughputJpeg2000,
   JpegXlLossless,
   JpegXlJpegRecompression,
@@ -65,6 +66,9 @@ impl TransferSyntaxArg {
       Self::HighThroughputJpeg2000LosslessOnly => {
         Some(&transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY)
       }
+      Self::HighThroughputJpeg2000WithRpclOptionsLosslessOnly => Some(
+        &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY,
+      ),
       Self::HighThroughputJpeg2000 => {
         Some(&transfer_syntax::HIGH_THROUGHPUT_JPEG_2000)
       }
@@ -95,6 +99,7 @@ impl ValueEnum for TransferSyntaxArg {
       Self::Jpeg2000LosslessOnly,
       Self::Jpeg2000,
       Self::HighThroughputJpeg2000LosslessOnly,
+      Self::HighThroughputJpeg2000WithRpclOptionsLosslessOnly,
       Self::HighThroughputJpeg2000,
       Self::JpegXlLossless,
       Self::JpegXlJpegRecompression,
@@ -268,6 +273,22 @@ impl ValueEnum for TransferSyntaxArg {
         )
       }
 
+      Self::HighThroughputJpeg2000WithRpclOptionsLosslessOnly => {
+        PossibleValue::new(
+          "high-throughput-jpeg-2000-with-rpcl-options-lossless-only",
+        )
+        .help(
+          "\n\
+          Lossless image compression using the High-Throughput JPEG 2000 \
+          format, with RPCL progression order, one tile-part per resolution \
+          level, and TLM markers so that reduced resolutions and regions can \
+          be decoded without reading the whole image.\n\
+          \n\
+          Encapsulated: Yes\n\
+          UID: 1.2.840.10008.1.2.4.202",
+        )
+      }
+
       &Self::HighThroughputJpeg2000 => {
         PossibleValue::new("high-throughput-jpeg-2000").help(
           "\n\
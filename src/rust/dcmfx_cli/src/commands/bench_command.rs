@@ -0,0 +1,454 @@
+use std::{
+  collections::BTreeMap,
+  time::{Duration, Instant},
+};
+
+use clap::Args;
+use futures::StreamExt;
+
+use dcmfx::{
+  core::*,
+  p10::*,
+  pixel_data::{
+    codec_stats::{self, CodecStage},
+    decode::HighThroughputJpeg2000Decoder,
+    transforms::*,
+    *,
+  },
+};
+
+use crate::{
+  args::transfer_syntax_arg::TransferSyntaxArg,
+  utils::{self, InputSource},
+};
+
+pub const ABOUT: &str = "Benchmarks transcoding DICOM P10 files into each \
+  supported transfer syntax";
+
+pub const LONG_ABOUT: &str = "Benchmarks transcoding DICOM P10 files into each \
+  supported transfer syntax\n\
+  \n\
+  The pixel data of each input file is encoded into every transfer syntax and \
+  setting in the benchmark, and then decoded again. The results are grouped by \
+  the '(0008,0060) Modality' of the input files, and the following are \
+  reported for each transfer syntax and setting:\n\
+  \n\
+  - The encode and decode speed in megapixels per second. Encode speed is \
+    measured per frame, and decode speed includes any multithreading done by \
+    the decoder.\n\
+  \n\
+  - The compression ratio relative to native pixel data.\n\
+  \n\
+  - The peak memory allocated while transcoding a single frame. This doesn't \
+    include memory allocated internally by codecs written in C and C++.\n\
+  \n\
+  - The average number of busy threads while encoding, which is the CPU time \
+    used divided by the time elapsed.\n\
+  \n\
+  Input files are read into memory before the benchmark starts, so a \
+  representative sample of files should be used rather than a whole archive.";
+
+#[derive(Args)]
+pub struct BenchArgs {
+  #[command(flatten)]
+  input: crate::args::input_args::P10InputArgs,
+
+  #[arg(
+    long,
+    short,
+    help_heading = "Benchmark",
+    help = "Limits the benchmark to the given transfer syntax. This can be \
+      specified multiple times. By default all transfer syntaxes in the \
+      benchmark are run, which are Deflated Image Frame Compression, RLE \
+      Lossless, JPEG-LS, JPEG 2000, High-Throughput JPEG 2000, and JPEG XL."
+  )]
+  transfer_syntax: Vec<TransferSyntaxArg>,
+
+  #[arg(
+    long,
+    short,
+    help_heading = "Benchmark",
+    help = "The compression quality in the range 1-100 used by lossy transfer \
+      syntaxes. JPEG-LS Lossy (Near-Lossless) is also benchmarked at \
+      qualities of 100 and 75, which give the smallest and a larger allowed \
+      error.",
+    default_value_t = 90,
+    value_parser = clap::value_parser!(u8).range(1..=100),
+  )]
+  quality: u8,
+
+  #[command(flatten)]
+  decoder: crate::args::decoder_args::DecoderArgs,
+}
+
+/// A transfer syntax and the settings to encode and decode it with in a
+/// benchmark.
+///
+struct BenchTarget {
+  name: String,
+  transfer_syntax: &'static TransferSyntax,
+  encode_config: PixelDataEncodeConfig,
+  decode_config: PixelDataDecodeConfig,
+}
+
+/// The totals for a single benchmark target over a set of input files.
+///
+#[derive(Default)]
+struct BenchTotals {
+  pixel_count: u64,
+  encoded_pixel_count: u64,
+  encode_time: Duration,
+  decode_time: Duration,
+  native_bytes: u64,
+  encoded_bytes: u64,
+  peak_frame_allocated_bytes: u64,
+  transcode_cpu_time: Duration,
+  transcode_time: Duration,
+  skipped_count: usize,
+}
+
+/// The results of running the benchmark on all input files with a single
+/// modality.
+///
+struct ModalityResults {
+  file_count: usize,
+  frame_count: u64,
+  target_totals: Vec<BenchTotals>,
+}
+
+pub async fn run(args: BenchArgs) -> Result<(), ()> {
+  let targets = bench_targets(&args);
+
+  // Read all input files into memory up front so that reading isn't included
+  // in the timings
+  let read_config = args
+    .input
+    .p10_read_config()
+    .require_dicm_prefix(args.input.ignore_invalid);
+
+  let mut data_sets = vec![];
+  let mut input_sources = args.input.base.input_sources().await;
+  while let Some(input_source) = input_sources.next().await {
+    match read_input_source(&input_source, read_config).await {
+      Ok(data_set) => {
+        if data_set.has(dictionary::PIXEL_DATA.tag) {
+          data_sets.push(data_set);
+        }
+      }
+
+      Err(P10Error::DicmPrefixNotPresent) if args.input.ignore_invalid => (),
+
+      Err(e) => {
+        e.print(&format!("reading \"{input_source}\""));
+        return Err(());
+      }
+    }
+  }
+
+  codec_stats::set_enabled(true);
+
+  let mut modalities: BTreeMap<String, ModalityResults> = BTreeMap::new();
+
+  for data_set in data_sets.iter() {
+    let modality = data_set
+      .get_string(dictionary::MODALITY.tag)
+      .unwrap_or("Unknown")
+      .to_string();
+
+    let results =
+      modalities
+        .entry(modality)
+        .or_insert_with(|| ModalityResults {
+          file_count: 0,
+          frame_count: 0,
+          target_totals: targets
+            .iter()
+            .map(|_| BenchTotals::default())
+            .collect(),
+        });
+
+    results.file_count += 1;
+    results.frame_count += data_set
+      .get_int::<u64>(dictionary::NUMBER_OF_FRAMES.tag)
+      .unwrap_or(1);
+
+    for (target, totals) in targets.iter().zip(results.target_totals.iter_mut())
+    {
+      if bench_data_set(data_set, target, totals).is_none() {
+        totals.skipped_count += 1;
+      }
+    }
+  }
+
+  for (modality, results) in modalities {
+    print_modality_results(&modality, &results, &targets);
+  }
+
+  Ok(())
+}
+
+async fn read_input_source(
+  input_source: &InputSource,
+  read_config: P10ReadConfig,
+) -> Result<DataSet, P10Error> {
+  let mut stream = input_source.open_read_stream().await?;
+
+  DataSet::read_p10_stream_async(&mut stream, Some(read_config)).await
+}
+
+/// Returns the transfer syntaxes and settings to benchmark.
+///
+fn bench_targets(args: &BenchArgs) -> Vec<BenchTarget> {
+  let decode_config = args.decoder.pixel_data_decode_config();
+
+  let mut encode_config = PixelDataEncodeConfig::default();
+  encode_config.set_quality(args.quality);
+
+  let new_target = |transfer_syntax: &'static TransferSyntax,
+                    setting: Option<String>| BenchTarget {
+    name: match setting {
+      Some(setting) => format!("{} ({setting})", transfer_syntax.name),
+      None => transfer_syntax.name.to_string(),
+    },
+    transfer_syntax,
+    encode_config,
+    decode_config,
+  };
+
+  let mut targets = vec![
+    new_target(&transfer_syntax::DEFLATED_IMAGE_FRAME_COMPRESSION, None),
+    new_target(&transfer_syntax::RLE_LOSSLESS, None),
+    new_target(&transfer_syntax::JPEG_LS_LOSSLESS, None),
+  ];
+
+  // The JPEG-LS near-lossless error is derived from the quality
+  for quality in [100, args.quality, 75] {
+    let mut target = new_target(
+      &transfer_syntax::JPEG_LS_LOSSY_NEAR_LOSSLESS,
+      Some(format!("quality {quality}")),
+    );
+    target.encode_config.set_quality(quality);
+    targets.push(target);
+  }
+
+  targets.push(new_target(&transfer_syntax::JPEG_2000_LOSSLESS_ONLY, None));
+
+  // High-Throughput JPEG 2000 is always encoded with OpenJPH, but can be
+  // decoded with either OpenJPH or OpenJPEG
+  for transfer_syntax in [
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000,
+  ] {
+    for (decoder, decoder_name) in [
+      (HighThroughputJpeg2000Decoder::OpenJph, "OpenJPH"),
+      (HighThroughputJpeg2000Decoder::OpenJpeg, "OpenJPEG"),
+    ] {
+      let mut target =
+        new_target(transfer_syntax, Some(format!("{decoder_name} decode")));
+      target.decode_config.high_throughput_jpeg_2000_decoder = decoder;
+      targets.push(target);
+    }
+  }
+
+  for effort in [1, 3, 5, 7, 9] {
+    let mut target = new_target(
+      &transfer_syntax::JPEG_XL_LOSSLESS,
+      Some(format!("effort {effort}")),
+    );
+    target.encode_config.set_effort(effort);
+    targets.push(target);
+  }
+
+  targets.push(new_target(&transfer_syntax::JPEG_XL, None));
+
+  // Restrict to the transfer syntaxes passed on the command line, if any
+  let transfer_syntaxes: Vec<_> = args
+    .transfer_syntax
+    .iter()
+    .filter_map(|arg| arg.as_transfer_syntax())
+    .collect();
+
+  if !transfer_syntaxes.is_empty() {
+    targets
+      .retain(|target| transfer_syntaxes.contains(&target.transfer_syntax));
+  }
+
+  targets
+}
+
+/// Transcodes the pixel data of a data set into a benchmark target and then
+/// decodes it again, adding the results to the target's totals. Returns
+/// `None` if the pixel data couldn't be transcoded or decoded, in which case
+/// the totals are unchanged.
+///
+fn bench_data_set(
+  data_set: &DataSet,
+  target: &BenchTarget,
+  totals: &mut BenchTotals,
+) -> Option<()> {
+  // Transcode into the target transfer syntax
+  let mut transcode_transform = P10PixelDataTranscodeTransform::new(
+    target.transfer_syntax,
+    target.decode_config,
+    target.encode_config,
+    None,
+  );
+  transcode_transform.set_thread_budget(utils::cpu_budget::threads_per_task());
+
+  let mut data_set_builder = DataSetBuilder::new();
+
+  codec_stats::reset();
+  let cpu_time_at_start = process_cpu_time();
+  let transcode_started_at = Instant::now();
+
+  data_set
+    .to_p10_token_stream(&mut |token| {
+      for token in transcode_transform.add_token(&token)? {
+        data_set_builder
+          .add_token(&token)
+          .map_err(P10PixelDataTranscodeTransformError::P10Error)?;
+      }
+
+      Ok::<(), P10PixelDataTranscodeTransformError>(())
+    })
+    .ok()?;
+
+  let transcode_time = transcode_started_at.elapsed();
+  let transcode_cpu_time = process_cpu_time()
+    .zip(cpu_time_at_start)
+    .map(|(end, start)| end.saturating_sub(start));
+  let stats = codec_stats::snapshot();
+
+  let output_data_set = data_set_builder.final_data_set().ok()?;
+
+  // Decode the transcoded pixel data
+  let mut renderer = PixelDataRenderer::from_data_set(&output_data_set).ok()?;
+  renderer.decode_config = target.decode_config;
+
+  let mut frames = output_data_set.get_pixel_data_frames().ok()?;
+
+  let decode_started_at = Instant::now();
+  for frame in frames.iter_mut() {
+    if renderer.image_pixel_module.is_monochrome() {
+      renderer.decode_monochrome_frame(frame).ok()?;
+    } else {
+      renderer.decode_color_frame(frame).ok()?;
+    }
+  }
+  let decode_time = decode_started_at.elapsed();
+
+  let frame_count = frames.len() as u64;
+  let pixel_count =
+    renderer.image_pixel_module.pixel_count() as u64 * frame_count;
+
+  totals.pixel_count += pixel_count;
+  totals.decode_time += decode_time;
+  totals.native_bytes +=
+    renderer.image_pixel_module.frame_size_in_bits().div_ceil(8) * frame_count;
+  totals.encoded_bytes += frames.iter().map(|frame| frame.len()).sum::<u64>();
+  totals.peak_frame_allocated_bytes = totals
+    .peak_frame_allocated_bytes
+    .max(stats.peak_frame_allocated_bytes);
+
+  // Pixel data that was passed through without being encoded, e.g. because it
+  // was already in the target transfer syntax, has no encode time
+  let encode_stats = stats.stage(CodecStage::Encode);
+  if encode_stats.count > 0 {
+    totals.encoded_pixel_count += pixel_count;
+    totals.encode_time += encode_stats.total_time;
+  }
+
+  totals.transcode_time += transcode_time;
+  if let Some(transcode_cpu_time) = transcode_cpu_time {
+    totals.transcode_cpu_time += transcode_cpu_time;
+  }
+
+  Some(())
+}
+
+/// Prints the benchmark results for a single modality.
+///
+fn print_modality_results(
+  modality: &str,
+  results: &ModalityResults,
+  targets: &[BenchTarget],
+) {
+  println!(
+    "{modality}: {} files, {} frames",
+    results.file_count, results.frame_count
+  );
+  println!();
+  println!(
+    "{:>11}  {:>11}  {:>6}  {:>8}  {:>7}  Transfer syntax",
+    "Encode MP/s", "Decode MP/s", "Ratio", "Peak MiB", "Threads"
+  );
+
+  let format_value =
+    |value: Option<f64>, width: usize, precision: usize| match value {
+      Some(value) if value.is_finite() => {
+        format!("{value:>width$.precision$}")
+      }
+      _ => format!("{:>width$}", "-"),
+    };
+
+  for (target, totals) in targets.iter().zip(results.target_totals.iter()) {
+    let megapixels_per_second = |pixel_count: u64, time: Duration| {
+      (pixel_count > 0 && !time.is_zero())
+        .then(|| pixel_count as f64 / 1_000_000.0 / time.as_secs_f64())
+    };
+
+    let encode_speed =
+      megapixels_per_second(totals.encoded_pixel_count, totals.encode_time);
+    let decode_speed =
+      megapixels_per_second(totals.pixel_count, totals.decode_time);
+    let ratio = (totals.encoded_bytes > 0)
+      .then(|| totals.native_bytes as f64 / totals.encoded_bytes as f64);
+    let peak_mib = (totals.pixel_count > 0)
+      .then(|| totals.peak_frame_allocated_bytes as f64 / (1024.0 * 1024.0));
+    // The CPU time is zero on platforms where it isn't available
+    let threads = (!totals.transcode_cpu_time.is_zero()
+      && !totals.transcode_time.is_zero())
+    .then(|| {
+      totals.transcode_cpu_time.as_secs_f64()
+        / totals.transcode_time.as_secs_f64()
+    });
+
+    let mut name = target.name.clone();
+    if totals.skipped_count > 0 {
+      name.push_str(&format!(", {} files skipped", totals.skipped_count));
+    }
+
+    println!(
+      "{}  {}  {}  {}  {}  {name}",
+      format_value(encode_speed, 11, 1),
+      format_value(decode_speed, 11, 1),
+      format_value(ratio, 6, 2),
+      format_value(peak_mib, 8, 1),
+      format_value(threads, 7, 1),
+    );
+  }
+
+  println!();
+}
+
+/// Returns the CPU time used so far by all threads in this process.
+///
+#[cfg(not(windows))]
+fn process_cpu_time() -> Option<Duration> {
+  let mut usage: libc::rusage = unsafe { std::mem::zeroed() };
+  if unsafe { libc::getrusage(libc::RUSAGE_SELF, &mut usage) } != 0 {
+    return None;
+  }
+
+  let to_duration = |time: libc::timeval| {
+    Duration::from_secs(time.tv_sec as u64)
+      + Duration::from_micros(time.tv_usec as u64)
+  };
+
+  Some(to_duration(usage.ru_utime) + to_duration(usage.ru_stime))
+}
+
+#[cfg(windows)]
+fn process_cpu_time() -> Option<Duration> {
+  None
+}
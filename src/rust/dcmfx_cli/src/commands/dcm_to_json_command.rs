@@ -1,4 +1,5 @@
 use std::path::PathBuf;
+use std::sync::{Arc, Mutex};
 
 use clap::Args;
 use tokio::io::AsyncWriteExt;
@@ -117,6 +118,20 @@ pub struct ToJsonArgs {
     value_parser = crate::args::parse_data_element_tag,
   )]
   ignore_invalid_data: Vec<DataElementTag>,
+
+  #[arg(
+    long,
+    value_name = "BYTES",
+    help_heading = "Output",
+    help = "Binary data element values of at least this many bytes are \
+      written to separate files alongside the output DICOM JSON file, and are \
+      referenced in the DICOM JSON with a BulkDataURI rather than being stored \
+      as an InlineBinary. Encapsulated pixel data is always written to a \
+      separate file when this is specified. Bulk data files are named by \
+      appending '.<index>.bin' to the name of the output DICOM JSON file.",
+    conflicts_with = "selected_data_elements"
+  )]
+  bulk_data_threshold: Option<u32>,
 }
 
 enum ToJsonError {
@@ -133,7 +148,10 @@ pub async fn run(args: ToJsonArgs) -> Result<(), ()> {
 
   OutputTarget::set_overwrite(args.overwrite);
 
-  let input_sources = args.input.base.input_sources().await;
+  let input_sources = utils::largest_first(
+    args.input.base.input_sources().await,
+    args.concurrency,
+  );
 
   let selected_binary_data_values = if !args.selected_binary_values.is_empty() {
     Some(args.selected_binary_values.clone())
@@ -210,6 +228,13 @@ async fn input_source_to_json(
     .await
     .map_err(ToJsonError::P10Error)?;
 
+  if args.bulk_data_threshold.is_some() && output_target.is_stdout() {
+    utils::exit_with_error(
+      "Bulk data can't be written when writing DICOM JSON to stdout",
+      "",
+    );
+  }
+
   // Open output stream
   let output_stream_handle = output_target
     .open_write_stream(true)
@@ -229,9 +254,35 @@ async fn input_source_to_json(
     // Create transform for converting P10 tokens into bytes of JSON
     let mut json_transform = P10JsonTransform::new(json_config.clone());
 
+    // If requested, pass large binary values to a queue from which they are
+    // written to bulk data files
+    let bulk_data_events = Arc::new(Mutex::new(vec![]));
+    if let Some(bulk_data_threshold) = args.bulk_data_threshold {
+      let output_file_name = output_target
+        .specified_path()
+        .file_name()
+        .map(|file_name| file_name.to_string_lossy().to_string())
+        .unwrap_or_default();
+
+      json_transform.set_bulk_data_writer(
+        Box::new(BulkDataQueue {
+          uri_prefix: output_file_name,
+          next_index: 0,
+          events: bulk_data_events.clone(),
+        }),
+        bulk_data_threshold,
+      );
+    }
+
+    let mut bulk_data_output = None;
+
     // Get exclusive access to the output stream
     let mut output_stream = output_stream_handle.lock().await;
 
+    // Buffer for the JSON generated by each token, which is reused to avoid
+    // allocating for every token
+    let mut json_buffer = vec![];
+
     let mut is_ended = false;
 
     while !is_ended {
@@ -250,22 +301,28 @@ async fn input_source_to_json(
       // Write the tokens to the JSON transform, directing the resulting JSON to
       // the output stream
       for token in tokens.iter() {
-        let mut cursor = std::io::Cursor::new(vec![]);
+        json_buffer.clear();
 
-        match json_transform.add_token(token, &mut cursor) {
-          Ok(()) => output_stream
-            .write_all(&cursor.into_inner())
-            .await
-            .map_err(|e| {
+        match json_transform.add_token(token, &mut json_buffer) {
+          Ok(()) => {
+            output_stream.write_all(&json_buffer).await.map_err(|e| {
               ToJsonError::P10Error(P10Error::FileError {
                 when: "Writing output file".to_string(),
                 details: e.to_string(),
               })
-            })?,
+            })?
+          }
 
           Err(e) => return Err(ToJsonError::JsonSerializeError(e)),
         };
 
+        write_bulk_data_events(
+          &bulk_data_events,
+          &output_target,
+          &mut bulk_data_output,
+        )
+        .await?;
+
         // When the end token has been written the conversion is complete
         if *token == P10Token::End {
           match output_stream.write_all(b"\n").await {
@@ -336,3 +393,114 @@ async fn input_source_to_json(
       .map_err(ToJsonError::P10Error)
   }
 }
+
+/// An event for a bulk data file, as passed from [`BulkDataQueue`] to
+/// [`write_bulk_data_events()`].
+///
+enum BulkDataEvent {
+  Begin(usize),
+  Data(Vec<u8>),
+  Finish,
+}
+
+/// A bulk data writer that queues the bulk data it receives from the DICOM JSON
+/// transform so that it can then be written to output files asynchronously.
+///
+struct BulkDataQueue {
+  uri_prefix: String,
+  next_index: usize,
+  events: Arc<Mutex<Vec<BulkDataEvent>>>,
+}
+
+impl BulkDataWriter for BulkDataQueue {
+  fn begin(
+    &mut self,
+    _path: &DataSetPath,
+    _vr: ValueRepresentation,
+  ) -> Result<String, std::io::Error> {
+    let index = self.next_index;
+    self.next_index += 1;
+
+    self
+      .events
+      .lock()
+      .unwrap()
+      .push(BulkDataEvent::Begin(index));
+
+    Ok(format!("{}.{index}.bin", self.uri_prefix))
+  }
+
+  fn write(&mut self, data: &[u8]) -> Result<(), std::io::Error> {
+    self
+      .events
+      .lock()
+      .unwrap()
+      .push(BulkDataEvent::Data(data.to_vec()));
+
+    Ok(())
+  }
+
+  fn finish(&mut self) -> Result<(), std::io::Error> {
+    self.events.lock().unwrap().push(BulkDataEvent::Finish);
+
+    Ok(())
+  }
+}
+
+/// Writes queued bulk data events to bulk data files alongside the output
+/// target. The bulk data file currently being written is held in
+/// `bulk_data_output`.
+///
+async fn write_bulk_data_events(
+  bulk_data_events: &Mutex<Vec<BulkDataEvent>>,
+  output_target: &OutputTarget,
+  bulk_data_output: &mut Option<(
+    OutputTarget,
+    Arc<tokio::sync::Mutex<Box<dyn IoAsyncWrite>>>,
+  )>,
+) -> Result<(), ToJsonError> {
+  let events = std::mem::take(&mut *bulk_data_events.lock().unwrap());
+
+  let map_error = |e: std::io::Error| {
+    ToJsonError::P10Error(P10Error::FileError {
+      when: "Writing bulk data file".to_string(),
+      details: e.to_string(),
+    })
+  };
+
+  for event in events {
+    match event {
+      BulkDataEvent::Begin(index) => {
+        let target = output_target.append(&format!(".{index}.bin"));
+        let stream = target
+          .open_write_stream(false)
+          .await
+          .map_err(ToJsonError::P10Error)?;
+
+        *bulk_data_output = Some((target, stream));
+      }
+
+      BulkDataEvent::Data(data) => {
+        if let Some((_, stream)) = bulk_data_output {
+          stream
+            .lock()
+            .await
+            .write_all(&data)
+            .await
+            .map_err(map_error)?;
+        }
+      }
+
+      BulkDataEvent::Finish => {
+        if let Some((target, stream)) = bulk_data_output.take() {
+          target
+            .commit(&mut *stream.lock().await)
+            .await
+            .map_err(ToJsonError::P10Error)?;
+        }
+      }
+    }
+  }
+
+  Ok(())
+}
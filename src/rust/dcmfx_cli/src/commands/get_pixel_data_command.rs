@@ -1,13 +1,14 @@
 use std::path::PathBuf;
 
 use clap::{Args, ValueEnum};
+use futures::StreamExt;
 use tokio::io::AsyncWriteExt;
 
 use dcmfx::{
   core::*,
   p10::*,
   pixel_data::{
-    PixelDataDecodeError, PixelDataFrame, PixelDataRenderer,
+    MonochromeImage, PixelDataDecodeError, PixelDataFrame, PixelDataRenderer,
     iods::{
       CineModule, MultiFrameModule, OverlayPlaneModule,
       voi_lut_module::{VoiLutFunction, VoiWindow},
@@ -30,12 +31,19 @@ use crate::{
       LogLevel, Mp4Codec, Mp4CompressionPreset, Mp4Encoder, Mp4EncoderConfig,
       Mp4PixelFormat, ResizeFilter,
     },
+    stripe_image_encoder::StripeImageEncoder,
+    stripe_image_resizer::StripeImageResizer,
   },
 };
 
 pub const ABOUT: &str = "Extracts pixel data from DICOM P10 files, writing it \
   to image and video files";
 
+/// The number of rows decoded at a time by decoders that support striped
+/// decoding, which bounds the memory used by the decoded frame.
+///
+const ROWS_PER_STRIPE: u16 = 64;
+
 #[derive(Args)]
 pub struct GetPixelDataArgs {
   #[arg(
@@ -46,6 +54,25 @@ pub struct GetPixelDataArgs {
   )]
   concurrency: usize,
 
+  #[arg(
+    long,
+    help = "When selecting frames with --select-frames, the number of \
+      concurrent range requests used to read the selected frames directly from \
+      the input once the location of its pixel data is known. Nearby frames \
+      are read using a single range request.",
+    default_value_t = 8
+  )]
+  range_request_concurrency: usize,
+
+  #[arg(
+    long,
+    help = "When selecting frames with --select-frames, read all the pixel \
+      data that precedes the selected frames rather than reading the selected \
+      frames directly using range requests.",
+    default_value_t = false
+  )]
+  no_range_requests: bool,
+
   #[command(flatten)]
   input: crate::args::input_args::P10InputArgs,
 
@@ -133,7 +160,8 @@ pub struct GetPixelDataArgs {
   #[arg(
     long,
     help_heading = "Output",
-    help = "The filter to use when resizing images.",
+    help = "The filter to use when resizing images. Dimensions that are scaled \
+      down by an integer ratio are always area averaged.",
     default_value_t = ResizeFilter::Lanczos3
   )]
   resize_filter: ResizeFilter,
@@ -342,7 +370,10 @@ pub async fn run(args: GetPixelDataArgs) -> Result<(), ()> {
 
   OutputTarget::set_overwrite(args.overwrite);
 
-  let input_sources = args.input.base.input_sources().await;
+  let input_sources = utils::largest_first(
+    args.input.base.input_sources().await,
+    args.concurrency,
+  );
 
   let result = utils::run_tasks(
     args.concurrency,
@@ -460,6 +491,12 @@ async fn get_pixel_data_from_input_source(
 
   let mut mp4_encoder: Option<Mp4Encoder> = None;
 
+  // Whether to read selected frames directly from the input using range reads
+  // once the location of the pixel data is known
+  let mut use_range_reads = args.select_frames.is_some()
+    && !args.no_range_requests
+    && input_source.supports_range_reads();
+
   loop {
     // Read the next tokens from the input stream
     let tokens = dcmfx::p10::read_tokens_from_stream_async(
@@ -499,6 +536,12 @@ async fn get_pixel_data_from_input_source(
           if let Some(pixel_data_renderer) = pixel_data_renderer {
             pixel_data_renderer.decode_config =
               args.decoder.pixel_data_decode_config();
+
+            // Overlays are rendered before cropping, so the crop can only be
+            // done by the decoder when there are no overlays
+            if !args.render_overlays {
+              pixel_data_renderer.decode_area = args.crop;
+            }
           }
 
           pixel_data_renderer
@@ -530,6 +573,68 @@ async fn get_pixel_data_from_input_source(
       let number_of_frames =
         p10_pixel_data_frame_transform.get_number_of_frames();
 
+      // If the selected frames can be read directly from the input then do so
+      // as soon as the location of the pixel data is known, which avoids
+      // reading the pixel data that precedes them
+      if let Some(frame_selection) = args.select_frames.as_ref()
+        && use_range_reads
+        && let Some(pixel_data_location) = PixelDataLocation::from_token(
+          token,
+          &read_context,
+          &p10_pixel_data_frame_transform,
+        )
+      {
+        use_range_reads = false;
+
+        if let Some(frame_ranges) = pixel_data_location
+          .selected_frame_ranges(
+            frame_selection,
+            number_of_frames,
+            input_source,
+          )
+          .await?
+        {
+          // Close the input stream as no further data is needed from it
+          drop(stream);
+
+          let frame_data = input_source.read_ranges(
+            &frame_ranges
+              .iter()
+              .map(|frame_range| frame_range.range.clone())
+              .collect::<Vec<_>>(),
+            args.range_request_concurrency,
+          );
+          let mut frame_data = std::pin::pin!(frame_data);
+
+          for frame_range in frame_ranges {
+            let data = frame_data
+              .next()
+              .await
+              .unwrap()
+              .map_err(GetPixelDataError::P10Error)?;
+
+            let mut frame = frame_range
+              .into_frame(data)
+              .map_err(GetPixelDataError::DataError)?;
+
+            write_frame(
+              &mut frame,
+              pixel_data_renderer,
+              overlay_plane_module,
+              cine_module_transform.as_ref(),
+              multiframe_module_transform.as_ref(),
+              &mut mp4_encoder,
+              &output_target_base,
+              output_extension,
+              args,
+            )
+            .await?;
+          }
+
+          return finish_mp4_encoder(mp4_encoder).await;
+        }
+      }
+
       // Process available frames
       for frame in frames.iter_mut() {
         let frame_index = frame.index().unwrap();
@@ -543,50 +648,18 @@ async fn get_pixel_data_from_input_source(
         }
 
         if is_frame_selected {
-          if args.format == OutputFormat::Mp4 {
-            let pixel_data_renderer = pixel_data_renderer.as_mut().unwrap();
-
-            let cine_module = cine_module_transform
-              .as_ref()
-              .unwrap()
-              .get_output()
-              .unwrap();
-
-            let multiframe_module = multiframe_module_transform
-              .as_ref()
-              .unwrap()
-              .get_output()
-              .unwrap();
-
-            let output_target = output_target_base.append(".mp4");
-
-            write_frame_to_mp4_file(
-              frame,
-              &mut mp4_encoder,
-              pixel_data_renderer,
-              cine_module,
-              multiframe_module,
-              overlay_plane_module,
-              args,
-              output_target,
-            )
-            .await?;
-          } else {
-            let output_target = output_target_base.append(&format!(
-              ".{:04}{}",
-              frame.index().unwrap(),
-              output_extension
-            ));
-
-            write_frame_to_image_file(
-              frame,
-              pixel_data_renderer,
-              overlay_plane_module,
-              args,
-              output_target,
-            )
-            .await?;
-          }
+          write_frame(
+            frame,
+            pixel_data_renderer,
+            overlay_plane_module,
+            cine_module_transform.as_ref(),
+            multiframe_module_transform.as_ref(),
+            &mut mp4_encoder,
+            &output_target_base,
+            output_extension,
+            args,
+          )
+          .await?;
         }
 
         // If selecting a subset of frames, stop once they're all done
@@ -598,14 +671,273 @@ async fn get_pixel_data_from_input_source(
       }
 
       if *token == P10Token::End {
-        if let Some(mp4_encoder) = mp4_encoder.as_mut() {
-          mp4_encoder
-            .finish()
-            .await
-            .map_err(GetPixelDataError::FFmpegError)?;
+        return finish_mp4_encoder(mp4_encoder).await;
+      }
+    }
+  }
+}
+
+/// Writes a single frame of pixel data to its output, which is either an image
+/// file or the MP4 file that all frames are written to.
+///
+#[allow(clippy::too_many_arguments)]
+async fn write_frame(
+  frame: &mut PixelDataFrame,
+  pixel_data_renderer: &mut Option<PixelDataRenderer>,
+  overlay_plane_module: Option<&OverlayPlaneModule>,
+  cine_module_transform: Option<&P10CustomTypeTransform<CineModule>>,
+  multiframe_module_transform: Option<
+    &P10CustomTypeTransform<MultiFrameModule>,
+  >,
+  mp4_encoder: &mut Option<Mp4Encoder>,
+  output_target_base: &OutputTarget,
+  output_extension: &str,
+  args: &GetPixelDataArgs,
+) -> Result<(), GetPixelDataError> {
+  if args.format == OutputFormat::Mp4 {
+    let pixel_data_renderer = pixel_data_renderer.as_mut().unwrap();
+
+    let cine_module = cine_module_transform.unwrap().get_output().unwrap();
+
+    let multiframe_module =
+      multiframe_module_transform.unwrap().get_output().unwrap();
+
+    let output_target = output_target_base.append(".mp4");
+
+    write_frame_to_mp4_file(
+      frame,
+      mp4_encoder,
+      pixel_data_renderer,
+      cine_module,
+      multiframe_module,
+      overlay_plane_module,
+      args,
+      output_target,
+    )
+    .await
+  } else {
+    let output_target = output_target_base.append(&format!(
+      ".{:04}{}",
+      frame.index().unwrap(),
+      output_extension
+    ));
+
+    write_frame_to_image_file(
+      frame,
+      pixel_data_renderer,
+      overlay_plane_module,
+      args,
+      output_target,
+    )
+    .await
+  }
+}
+
+/// Finishes writing the MP4 file if one is being written.
+///
+async fn finish_mp4_encoder(
+  mut mp4_encoder: Option<Mp4Encoder>,
+) -> Result<(), GetPixelDataError> {
+  if let Some(mp4_encoder) = mp4_encoder.as_mut() {
+    mp4_encoder
+      .finish()
+      .await
+      .map_err(GetPixelDataError::FFmpegError)?;
+  }
+
+  Ok(())
+}
+
+/// The location of the *'(7FE0,0010) Pixel Data'* in DICOM P10 data, which
+/// allows the data for specific frames to be read directly using range reads.
+///
+enum PixelDataLocation {
+  Native {
+    value_offset: u64,
+    value_length: u64,
+    frame_size: u64,
+  },
+
+  Encapsulated {
+    first_item_offset: u64,
+    offset_table: Vec<(u64, Option<u64>)>,
+  },
+}
+
+/// The byte range in DICOM P10 data that holds the data for a single frame of
+/// pixel data.
+///
+struct FrameByteRange {
+  index: usize,
+  range: std::ops::Range<u64>,
+  kind: FrameByteRangeKind,
+}
+
+enum FrameByteRangeKind {
+  Native { bit_offset: usize },
+  Encapsulated { length: Option<u64> },
+}
+
+impl PixelDataLocation {
+  /// Returns the location of the pixel data if it has become known as a result
+  /// of the given token being read. For native pixel data this happens when
+  /// its header is read, and for encapsulated pixel data it happens when its
+  /// Basic Offset Table item is read.
+  ///
+  /// Range reads aren't possible with deflated or big endian transfer syntaxes
+  /// because the pixel data is altered when it's read.
+  ///
+  fn from_token(
+    token: &P10Token,
+    read_context: &P10ReadContext,
+    p10_pixel_data_frame_transform: &P10PixelDataFrameTransform,
+  ) -> Option<Self> {
+    let transfer_syntax = read_context.transfer_syntax();
+    if transfer_syntax.is_deflated || transfer_syntax.endianness.is_big() {
+      return None;
+    }
+
+    // Tokens are read one data element header or value chunk at a time, so
+    // the number of bytes read is the offset of the data that follows this
+    // token
+    match token {
+      P10Token::DataElementHeader { tag, length, .. }
+        if *tag == dictionary::PIXEL_DATA.tag =>
+      {
+        let frame_size =
+          p10_pixel_data_frame_transform.native_pixel_data_frame_size()?;
+
+        Some(Self::Native {
+          value_offset: read_context.bytes_read(),
+          value_length: u64::from(*length),
+          frame_size,
+        })
+      }
+
+      P10Token::DataElementValueBytes {
+        tag,
+        bytes_remaining: 0,
+        ..
+      } if *tag == dictionary::ITEM.tag => {
+        let offset_table = p10_pixel_data_frame_transform.offset_table()?;
+
+        Some(Self::Encapsulated {
+          first_item_offset: read_context.bytes_read(),
+          offset_table,
+        })
+      }
+
+      _ => None,
+    }
+  }
+
+  /// Returns the byte ranges of the selected frames. Returns `None` if the
+  /// frames can't be located, which is the case for encapsulated pixel data
+  /// that has no offset table.
+  ///
+  async fn selected_frame_ranges(
+    &self,
+    frame_selection: &FrameSelection,
+    number_of_frames: usize,
+    input_source: &InputSource,
+  ) -> Result<Option<Vec<FrameByteRange>>, GetPixelDataError> {
+    let mut frame_ranges = vec![];
+
+    match self {
+      Self::Native {
+        value_offset,
+        value_length,
+        frame_size,
+      } => {
+        // Only frames that are wholly present in the pixel data are read
+        let frame_count =
+          number_of_frames.min((value_length * 8 / frame_size) as usize);
+
+        for index in 0..frame_count {
+          if !frame_selection.contains(index, number_of_frames) {
+            continue;
+          }
+
+          let start = index as u64 * frame_size;
+          let end = start + frame_size;
+
+          frame_ranges.push(FrameByteRange {
+            index,
+            range: (value_offset + start / 8)..(value_offset + end.div_ceil(8)),
+            kind: FrameByteRangeKind::Native {
+              bit_offset: (start % 8) as usize,
+            },
+          });
+        }
+      }
+
+      Self::Encapsulated {
+        first_item_offset,
+        offset_table,
+      } => {
+        if offset_table.is_empty() {
+          return Ok(None);
         }
 
-        return Ok(());
+        let mut input_size = None;
+
+        for (index, (offset, length)) in offset_table.iter().enumerate() {
+          if !frame_selection.contains(index, number_of_frames) {
+            continue;
+          }
+
+          // The last frame extends to the end of the pixel data, so read to
+          // the end of the input and stop at its sequence delimitation item
+          let end = match offset_table.get(index + 1) {
+            Some((next_offset, _)) => first_item_offset + next_offset,
+            None => match input_size {
+              Some(input_size) => input_size,
+              None => *input_size.insert(
+                input_source
+                  .size()
+                  .await
+                  .map_err(GetPixelDataError::P10Error)?,
+              ),
+            },
+          };
+
+          let start = first_item_offset + offset;
+          if end < start {
+            return Ok(None);
+          }
+
+          frame_ranges.push(FrameByteRange {
+            index,
+            range: start..end,
+            kind: FrameByteRangeKind::Encapsulated { length: *length },
+          });
+        }
+      }
+    }
+
+    Ok(Some(frame_ranges))
+  }
+}
+
+impl FrameByteRange {
+  /// Converts the data read for this frame's byte range into a frame of pixel
+  /// data.
+  ///
+  fn into_frame(self, data: RcByteSlice) -> Result<PixelDataFrame, DataError> {
+    match self.kind {
+      FrameByteRangeKind::Native { bit_offset } => {
+        let mut frame = PixelDataFrame::new();
+        frame.set_index(self.index);
+        frame.set_bit_offset(bit_offset);
+        frame.push_bytes(data);
+
+        Ok(frame)
+      }
+
+      FrameByteRangeKind::Encapsulated { length } => {
+        P10PixelDataFrameTransform::encapsulated_frame_from_bytes(
+          self.index, &data, length,
+        )
       }
     }
   }
@@ -630,6 +962,60 @@ async fn write_frame_to_image_file(
   } else {
     let pixel_data_renderer = pixel_data_renderer.as_mut().unwrap();
 
+    // Decoding and encoding the frame is done in place so that the runtime
+    // moves the reads and writes of other inputs to other threads in the
+    // meantime
+    let image_buffer = tokio::task::block_in_place(|| {
+      encode_frame_to_image(
+        frame,
+        pixel_data_renderer,
+        overlay_plane_module,
+        args,
+      )
+    })?;
+
+    let output_stream_handle = output_target
+      .open_write_stream(true)
+      .await
+      .map_err(GetPixelDataError::P10Error)?;
+
+    let mut output_stream = output_stream_handle.lock().await;
+
+    output_stream.write_all(&image_buffer).await.map_err(|e| {
+      GetPixelDataError::P10Error(P10Error::FileError {
+        when: "Writing image data".to_string(),
+        details: e.to_string(),
+      })
+    })?;
+
+    output_target
+      .commit(&mut output_stream)
+      .await
+      .map_err(GetPixelDataError::P10Error)?;
+  }
+
+  Ok(())
+}
+
+/// Decodes a frame of pixel data and encodes it into a PNG or JPEG image.
+///
+fn encode_frame_to_image(
+  frame: &mut PixelDataFrame,
+  pixel_data_renderer: &mut PixelDataRenderer,
+  overlay_plane_module: Option<&OverlayPlaneModule>,
+  args: &GetPixelDataArgs,
+) -> Result<Vec<u8>, GetPixelDataError> {
+  let mut image_buffer = vec![];
+
+  // When no alterations other than a resize are made to the decoded image,
+  // its stripes are resized and passed to the image encoder as they are
+  // decoded
+  if overlay_plane_module.is_none()
+    && (args.crop.is_none() || pixel_data_renderer.decode_area.is_some())
+    && args.transform.is_none()
+  {
+    encode_frame_stripes(frame, pixel_data_renderer, args, &mut image_buffer)?;
+  } else {
     let image = frame_to_final_image(
       frame,
       pixel_data_renderer,
@@ -637,7 +1023,7 @@ async fn write_frame_to_image_file(
       args,
     )?;
 
-    let mut image_buffer = std::io::Cursor::new(vec![]);
+    let mut image_buffer = std::io::Cursor::new(&mut image_buffer);
 
     match args.format {
       OutputFormat::Png | OutputFormat::Png16 => image
@@ -653,31 +1039,101 @@ async fn write_frame_to_image_file(
 
       OutputFormat::Raw | OutputFormat::Mp4 => unreachable!(),
     }
+  }
 
-    let output_stream_handle = output_target
-      .open_write_stream(true)
-      .await
-      .map_err(GetPixelDataError::P10Error)?;
+  Ok(image_buffer)
+}
 
-    let mut output_stream = output_stream_handle.lock().await;
+/// Decodes a frame of pixel data in stripes and encodes each stripe into a PNG
+/// or JPEG image as soon as it is decoded, without assembling the whole frame
+/// into an [`image::DynamicImage`] first. If a resize is active then each
+/// stripe is resized before it's encoded.
+///
+fn encode_frame_stripes(
+  frame: &mut PixelDataFrame,
+  pixel_data_renderer: &mut PixelDataRenderer,
+  args: &GetPixelDataArgs,
+  image_buffer: &mut Vec<u8>,
+) -> Result<(), GetPixelDataError> {
+  // When a decode area is set the frame is decoded as a single stripe, so its
+  // height is that of the first stripe
+  let frame_height = if pixel_data_renderer.decode_area.is_some() {
+    None
+  } else {
+    Some(u32::from(pixel_data_renderer.image_pixel_module.rows()))
+  };
 
-    output_stream
-      .write_all(&image_buffer.into_inner())
-      .await
-      .map_err(|e| {
-        GetPixelDataError::P10Error(P10Error::FileError {
-          when: "Writing image data".to_string(),
-          details: e.to_string(),
-        })
-      })?;
+  let mut image_buffer = Some(image_buffer);
+  let mut encoder = None;
+  let mut resizer = None;
+  let mut result = Ok(());
 
-    output_target
-      .commit(&mut output_stream)
-      .await
-      .map_err(GetPixelDataError::P10Error)?;
-  }
+  decode_frame_stripes(frame, pixel_data_renderer, args, &mut |stripe| {
+    if result.is_err() {
+      return;
+    }
 
-  Ok(())
+    if encoder.is_none() {
+      let image_buffer = image_buffer.take().unwrap();
+      let mut width = stripe.width();
+      let mut height = frame_height.unwrap_or(stripe.height());
+      let color_type = stripe.color().into();
+
+      if let Some((new_width, new_height)) = args.new_dimensions(width, height)
+      {
+        resizer = Some(StripeImageResizer::new(
+          width,
+          height,
+          new_width,
+          new_height,
+          args.resize_filter,
+        ));
+
+        (width, height) = (new_width, new_height);
+      }
+
+      let new_encoder = match args.format {
+        OutputFormat::Png | OutputFormat::Png16 => {
+          StripeImageEncoder::new_png(image_buffer, width, height, color_type)
+        }
+
+        OutputFormat::Jpg => StripeImageEncoder::new_jpeg(
+          image_buffer,
+          width,
+          height,
+          color_type,
+          args.jpg_quality,
+        ),
+
+        OutputFormat::Raw | OutputFormat::Mp4 => unreachable!(),
+      };
+
+      match new_encoder {
+        Ok(new_encoder) => encoder = Some(new_encoder),
+        Err(e) => {
+          result = Err(e);
+          return;
+        }
+      }
+    }
+
+    let stripe = match resizer.as_mut() {
+      Some(resizer) => match resizer.resize_stripe(&stripe) {
+        Some(stripe) => stripe,
+        None => return,
+      },
+      None => stripe,
+    };
+
+    result = encoder.as_mut().unwrap().write_stripe(&stripe);
+  })?;
+
+  result.map_err(GetPixelDataError::ImageError)?;
+
+  encoder
+    .unwrap()
+    .finish()
+    .map_err(GetPixelDataError::ImageError)
 }
 
 /// Writes the data for a single frame of pixel data to an output target.
@@ -743,8 +1199,10 @@ fn frame_to_final_image(
       .unwrap();
   }
 
-  // Apply the image crop, if specified
-  if let Some(crop) = args.crop {
+  // Apply the image crop, if specified and not already done by the decoder
+  if let Some(crop) = args.crop
+    && pixel_data_renderer.decode_area.is_none()
+  {
     let (cropped_height, cropped_width) =
       crop.apply(image.height() as u16, image.width() as u16);
 
@@ -761,18 +1219,20 @@ fn frame_to_final_image(
     image.apply_orientation(transform.orientation());
   }
 
-  // Apply the image resize, if specified. Note that no resize is performed here
-  // when outputting to an MP4 because in that case FFmpeg is used to do the
-  // resize, which is faster.
-  if args.format != OutputFormat::Mp4
-    && let Some((new_width, new_height)) =
-      args.new_dimensions(image.width(), image.height())
+  // Apply the image resize, if specified. This is also done for MP4 output so
+  // that FFmpeg is sent the smaller resized frames.
+  if let Some((new_width, new_height)) =
+    args.new_dimensions(image.width(), image.height())
   {
-    image = image.resize_exact(
+    image = StripeImageResizer::new(
+      image.width(),
+      image.height(),
       new_width,
       new_height,
-      args.resize_filter.filter_type(),
-    );
+      args.resize_filter,
+    )
+    .resize_stripe(&image)
+    .unwrap_or(image);
   }
 
   Ok(image)
@@ -788,11 +1248,26 @@ fn frame_to_dynamic_image(
   pixel_data_renderer: &mut PixelDataRenderer,
   args: &GetPixelDataArgs,
 ) -> Result<image::DynamicImage, GetPixelDataError> {
-  if pixel_data_renderer.image_pixel_module.is_monochrome() {
-    let monochrome_image = pixel_data_renderer
-      .decode_monochrome_frame(frame)
-      .map_err(GetPixelDataError::PixelDataDecodeError)?;
+  let mut image = None;
+
+  decode_frame_stripes(frame, pixel_data_renderer, args, &mut |stripe| {
+    image = Some(append_image_rows(image.take(), stripe));
+  })?;
 
+  Ok(image.unwrap())
+}
+
+/// Decodes a raw frame of pixel data and passes it to `on_stripe` as a
+/// sequence of horizontal stripes in the format described by
+/// [`frame_to_dynamic_image()`].
+///
+fn decode_frame_stripes(
+  frame: &mut PixelDataFrame,
+  pixel_data_renderer: &mut PixelDataRenderer,
+  args: &GetPixelDataArgs,
+  on_stripe: &mut dyn FnMut(image::DynamicImage),
+) -> Result<(), GetPixelDataError> {
+  if pixel_data_renderer.image_pixel_module.is_monochrome() {
     // Apply the VOI override if it's set
     if let Some(voi_window_override) = &args.voi_window {
       pixel_data_renderer
@@ -808,56 +1283,138 @@ fn frame_to_dynamic_image(
     // then calculate a VOI Window from the content of the first frame and use
     // it for all subsequent frames.
     else if pixel_data_renderer.grayscale_pipeline.voi_lut().is_empty() {
-      let image = pixel_data_renderer
+      let monochrome_image = pixel_data_renderer
         .decode_monochrome_frame(frame)
         .map_err(GetPixelDataError::PixelDataDecodeError)?;
 
-      if let Some(window) = image.default_voi_window() {
+      if let Some(window) = monochrome_image.default_voi_window() {
         pixel_data_renderer
           .grayscale_pipeline
           .set_voi_window(window);
       }
-    }
-
-    // For HDR outputs, emit a Luma16 buffer. A color palette implies 8-bit
-    // output because looking up a color palette always returns 8-bit values.
-    if args.is_output_hdr() && args.color_palette.is_none() {
-      let image = monochrome_image
-        .to_gray_u16_image(&pixel_data_renderer.grayscale_pipeline);
 
-      Ok(image.into())
-    }
-    // If there is an active color palette then use it and output the
-    // resulting RGB8
-    else if let Some(color_palette) = args.color_palette {
-      let image = pixel_data_renderer.render_monochrome_image(
+      on_stripe(monochrome_image_to_dynamic_image(
         &monochrome_image,
-        Some(color_palette.color_palette()),
-      );
+        pixel_data_renderer,
+        args,
+      ));
 
-      Ok(image.into())
+      return Ok(());
     }
-    // Otherwise, emit a Luma8 image
-    else {
-      let image = monochrome_image
-        .to_gray_u8_image(&pixel_data_renderer.grayscale_pipeline);
 
-      Ok(image.into())
-    }
+    // The VOI is now known, so decode and render the frame in stripes. This
+    // avoids holding the whole decoded frame in memory when the decoder
+    // supports striped decoding.
+    let pixel_data_renderer = &*pixel_data_renderer;
+
+    pixel_data_renderer
+      .decode_monochrome_frame_stripes(
+        frame,
+        ROWS_PER_STRIPE,
+        &mut |stripe, _| {
+          on_stripe(monochrome_image_to_dynamic_image(
+            &stripe,
+            pixel_data_renderer,
+            args,
+          ));
+        },
+      )
+      .map_err(GetPixelDataError::PixelDataDecodeError)
   } else {
-    let image = pixel_data_renderer
-      .decode_color_frame(frame)
-      .map_err(GetPixelDataError::PixelDataDecodeError)?;
-
     // Emit a 16-bit color image if the output format supports HDR and there are
     // more than 8 bits per pixel
-    if args.is_output_hdr()
-      && pixel_data_renderer.image_pixel_module.bits_stored() > 8
-    {
-      Ok(image.into_rgb_u16_image().into())
-    } else {
-      Ok(image.into_rgb_u8_image().into())
+    let is_output_u16 = args.is_output_hdr()
+      && pixel_data_renderer.image_pixel_module.bits_stored() > 8;
+
+    pixel_data_renderer
+      .decode_color_frame_stripes(frame, ROWS_PER_STRIPE, &mut |stripe, _| {
+        on_stripe(if is_output_u16 {
+          stripe.into_rgb_u16_image().into()
+        } else {
+          stripe.into_rgb_u8_image().into()
+        });
+      })
+      .map_err(GetPixelDataError::PixelDataDecodeError)
+  }
+}
+
+/// Applies the grayscale pipeline to a [`MonochromeImage`] to reach final
+/// display values, and then converts it to an [`image::DynamicImage`].
+///
+fn monochrome_image_to_dynamic_image(
+  monochrome_image: &MonochromeImage,
+  pixel_data_renderer: &PixelDataRenderer,
+  args: &GetPixelDataArgs,
+) -> image::DynamicImage {
+  // For HDR outputs, emit a Luma16 buffer. A color palette implies 8-bit
+  // output because looking up a color palette always returns 8-bit values.
+  if args.is_output_hdr() && args.color_palette.is_none() {
+    monochrome_image
+      .to_gray_u16_image_with_threads(
+        &pixel_data_renderer.grayscale_pipeline,
+        pixel_data_renderer.decode_config.thread_count,
+      )
+      .into()
+  }
+  // If there is an active color palette then use it and output the resulting
+  // RGB8
+  else if let Some(color_palette) = args.color_palette {
+    pixel_data_renderer
+      .render_monochrome_image(
+        monochrome_image,
+        Some(color_palette.color_palette()),
+      )
+      .into()
+  }
+  // Otherwise, emit a Luma8 image
+  else {
+    monochrome_image
+      .to_gray_u8_image_with_threads(
+        &pixel_data_renderer.grayscale_pipeline,
+        pixel_data_renderer.decode_config.thread_count,
+      )
+      .into()
+  }
+}
+
+/// Appends the rows of `stripe` to the bottom of `image`, which is used to
+/// assemble images that are decoded in stripes. Both images must have the same
+/// width and pixel format.
+///
+fn append_image_rows(
+  image: Option<image::DynamicImage>,
+  stripe: image::DynamicImage,
+) -> image::DynamicImage {
+  fn append<P: image::Pixel>(
+    image: image::ImageBuffer<P, Vec<P::Subpixel>>,
+    stripe: image::ImageBuffer<P, Vec<P::Subpixel>>,
+  ) -> image::ImageBuffer<P, Vec<P::Subpixel>> {
+    let width = image.width();
+    let height = image.height() + stripe.height();
+
+    let mut data = image.into_raw();
+    data.extend_from_slice(stripe.as_raw());
+
+    image::ImageBuffer::from_raw(width, height, data).unwrap()
+  }
+
+  use image::DynamicImage::*;
+
+  match (image, stripe) {
+    (None, stripe) => stripe,
+    (Some(ImageLuma8(image)), ImageLuma8(stripe)) => {
+      ImageLuma8(append(image, stripe))
+    }
+    (Some(ImageLuma16(image)), ImageLuma16(stripe)) => {
+      ImageLuma16(append(image, stripe))
+    }
+    (Some(ImageRgb8(image)), ImageRgb8(stripe)) => {
+      ImageRgb8(append(image, stripe))
+    }
+    (Some(ImageRgb16(image)), ImageRgb16(stripe)) => {
+      ImageRgb16(append(image, stripe))
     }
+    _ => unreachable!(),
   }
 }
 
@@ -886,11 +1443,10 @@ async fn create_mp4_encoder(
     return Err(GetPixelDataError::OtherError(message));
   }
 
-  // Determine output dimensions. If there is a resize active then it will be
-  // performed by the MP4 encoder.
-  let (output_width, output_height) = args
-    .new_dimensions(first_frame.width(), first_frame.height())
-    .unwrap_or((first_frame.width(), first_frame.height()));
+  // Frames have already been resized, so the output dimensions are those of
+  // the first frame
+  let (output_width, output_height) =
+    (first_frame.width(), first_frame.height());
 
   // Use the Cine Module to determine the frame rate. This can be overridden by
   // a CLI argument if desired. The fallback value is one frame per second.
@@ -930,13 +1486,12 @@ async fn write_frame_to_mp4_file(
     return Ok(());
   }
 
-  // Convert the raw frame into an image ready for MP4 encoding
-  let image = frame_to_final_image(
-    frame,
-    pixel_data_renderer,
-    overlay_plane_module,
-    args,
-  )?;
+  // Convert the raw frame into an image ready for MP4 encoding. This is done
+  // in place so that the runtime moves other tasks to other threads in the
+  // meantime.
+  let image = tokio::task::block_in_place(|| {
+    frame_to_final_image(frame, pixel_data_renderer, overlay_plane_module, args)
+  })?;
 
   // If this is the first frame then the MP4 encoder won't have been created,
   // so create it now
@@ -957,7 +1512,7 @@ async fn write_frame_to_mp4_file(
   mp4_encoder
     .as_mut()
     .unwrap()
-    .add_frame(&image)
+    .add_frame(image)
     .await
     .map_err(GetPixelDataError::FFmpegError)
 }
@@ -1,3 +1,4 @@
+pub mod bench_command;
 pub mod dcm_to_json_command;
 pub mod get_pixel_data_command;
 pub mod json_to_dcm_command;
@@ -5,3 +6,4 @@ pub mod list_command;
 pub mod modify_command;
 pub mod print_command;
 pub mod rewrite_command;
+pub mod serve_command;
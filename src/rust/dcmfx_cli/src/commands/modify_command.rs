@@ -1,6 +1,14 @@
-use std::path::PathBuf;
+use std::{
+  io::{Seek, Write},
+  path::{Path, PathBuf},
+  sync::{
+    Arc, OnceLock,
+    atomic::{AtomicU64, Ordering},
+  },
+};
 
 use clap::Args;
+use tokio::sync::{Mutex, mpsc};
 
 use dcmfx::{
   core::*,
@@ -10,13 +18,14 @@ use dcmfx::{
 
 use crate::{
   args::{
+    jpeg_baseline_encoder_arg::JpegBaselineEncoderArg,
     photometric_interpretation_arg::{
       PhotometricInterpretationColorArg, PhotometricInterpretationMonochromeArg,
     },
     planar_configuration_arg::PlanarConfigurationArg,
     transfer_syntax_arg::TransferSyntaxArg,
   },
-  utils::{self, InputSource, OutputTarget},
+  utils::{self, InputSource, OutputTarget, p10_header::P10Header},
 };
 
 pub const ABOUT: &str = "Modifies the content of DICOM P10 files";
@@ -34,6 +43,9 @@ pub struct ModifyArgs {
   #[command(flatten)]
   input: crate::args::input_args::P10InputArgs,
 
+  #[command(flatten)]
+  distributed: crate::args::distributed_args::DistributedArgs,
+
   #[arg(
     long,
     help_heading = "Input",
@@ -41,13 +53,32 @@ pub struct ModifyArgs {
       with the newly modified version rather than write it to a new file.\n\
       \n\
       If there is an error during in-place modification of a file then it will \
-      not be altered.\n\
+      not be altered, except as described below.\n\
+      \n\
+      When the only modifications are merges and deletions of data elements \
+      that precede the pixel data, only the start of the file is rewritten and \
+      the pixel data is copied across without being re-encoded. The modified \
+      file keeps the permissions, owner, and extended attributes of the \
+      original where possible, but replaces it, so other hard links to the \
+      original aren't modified.\n\
       \n\
       WARNING: modification in-place is a potentially irreversible operation.",
     default_value_t = false
   )]
   in_place: bool,
 
+  #[arg(
+    long,
+    help_heading = "Input",
+    help = "When modifying in place, overwrite the start of the file directly \
+      if the new version of it fits in the space taken by the existing one, \
+      rather than writing a new file. This avoids copying the pixel data, but \
+      an error or interruption part way through the overwrite can leave the \
+      file damaged.",
+    default_value_t = false
+  )]
+  in_place_overwrite_header: bool,
+
   #[arg(
     long,
     short,
@@ -86,6 +117,17 @@ pub struct ModifyArgs {
   )]
   zlib_compression_level: u32,
 
+  #[arg(
+    long,
+    help_heading = "Output",
+    help = "Deflate output to the 'Deflated Explicit VR Little Endian' and \
+      'Deflated Image Frame Compression' transfer syntaxes in independent \
+      blocks that are compressed concurrently. This is faster on machines \
+      with multiple CPU cores, but gives a slightly lower compression ratio.",
+    default_value_t = false
+  )]
+  zlib_parallel: bool,
+
   #[arg(
     long,
     help_heading = "Data Set Content",
@@ -173,6 +215,29 @@ pub struct ModifyArgs {
   )]
   quality: Option<u8>,
 
+  #[arg(
+    long,
+    help_heading = "Transcoding",
+    help = "When transcoding pixel data to 'High-Throughput JPEG 2000', \
+      encodes each frame at the specified number of bits per pixel instead of \
+      at the quality set by --quality. The quantization step size that gives \
+      this is estimated by encoding tiles sampled from each frame, so frame \
+      sizes are close to the target but don't match it exactly."
+  )]
+  target_bits_per_pixel: Option<f32>,
+
+  #[arg(
+    long,
+    help_heading = "Transcoding",
+    help = "When transcoding pixel data to 'JPEG 2000 (Lossy)', quantizes \
+      with fixed step sizes derived from --quality instead of searching for \
+      the code-block truncation points that give the quality. This is much \
+      faster for large frames, but the output quality is less tightly \
+      controlled.",
+    default_value_t = false
+  )]
+  jpeg_2000_fixed_quantization: bool,
+
   #[arg(
     long,
     short,
@@ -194,6 +259,54 @@ pub struct ModifyArgs {
   )]
   effort: Option<u8>,
 
+  #[arg(
+    long,
+    help_heading = "Transcoding",
+    value_name = "MEGAPIXELS_PER_SECOND",
+    help = "When transcoding pixel data to 'JPEG XL Lossless' or 'JPEG XL', \
+      adjusts the effort between files in order to encode frames at the \
+      specified number of megapixels per second. The effort is lowered when \
+      encoding is slower than this, and raised when it is comfortably faster, \
+      within the range set by --adaptive-effort-min and \
+      --adaptive-effort-max. The initial effort is set by --effort.\n\
+      \n\
+      The effort used for each file is recorded in its '(0008,2111) \
+      Derivation Description' data element."
+  )]
+  adaptive_effort_target: Option<f64>,
+
+  #[arg(
+    long,
+    help_heading = "Transcoding",
+    help = "The minimum effort used when --adaptive-effort-target is \
+      specified.",
+    default_value_t = 3,
+    value_parser = clap::value_parser!(u8).range(1..=10),
+  )]
+  adaptive_effort_min: u8,
+
+  #[arg(
+    long,
+    help_heading = "Transcoding",
+    help = "The maximum effort used when --adaptive-effort-target is \
+      specified.",
+    default_value_t = 9,
+    value_parser = clap::value_parser!(u8).range(1..=10),
+  )]
+  adaptive_effort_max: u8,
+
+  #[arg(
+    long,
+    help_heading = "Transcoding",
+    help = "The library to use when transcoding pixel data to 'JPEG Baseline \
+      8-bit' or 'JPEG XL JPEG Recompression'. The libjpeg_8bit library uses \
+      SIMD and optimal Huffman tables, and so is usually faster and produces \
+      smaller output. It isn't available in WASM builds of DCMfx, which always \
+      use jpeg-encoder.",
+    default_value_t = JpegBaselineEncoderArg::JpegEncoder
+  )]
+  jpeg_baseline_encoder: JpegBaselineEncoderArg,
+
   #[arg(
     long,
     help_heading = "Transcoding",
@@ -201,6 +314,10 @@ pub struct ModifyArgs {
       specifies the photometric interpretation to be used by the output DICOM \
       P10 files. This option has no effect on color pixel data.\n\
       \n\
+      When transcoding 'JPEG Extended 12-bit' to itself, a crop whose \
+      top-left corner is aligned to the JPEG's MCUs is applied losslessly \
+      without decoding and re-encoding the pixel data.\n\
+      \n\
       This option is ignored when transcoding between the 'JPEG XL JPEG \
       Recompression' and 'JPEG Baseline 8-bit' transfer syntaxes."
   )]
@@ -240,6 +357,10 @@ pub struct ModifyArgs {
       2. If the output transfer syntax doesn't support 'YBR_FULL_422' then the \
          color image's data will be automatically expanded to 'YBR_FULL'.\n\
       \n\
+      When transcoding 'JPEG Extended 12-bit' to itself, a crop whose \
+      top-left corner is aligned to the JPEG's MCUs is applied losslessly \
+      without decoding and re-encoding the pixel data.\n\
+      \n\
       This option is ignored when transcoding between the 'JPEG XL JPEG \
       Recompression' and 'JPEG Baseline 8-bit' transfer syntaxes."
   )]
@@ -272,11 +393,53 @@ pub struct ModifyArgs {
       rectangle, however if they are zero or negative then they specify an \
       offset from the right and bottom edges of the pixel data respectively.\n\
       \n\
+      When transcoding 'JPEG Extended 12-bit' to itself, a crop whose \
+      top-left corner is aligned to the JPEG's MCUs is applied losslessly \
+      without decoding and re-encoding the pixel data.\n\
+      \n\
       This option is ignored when transcoding between the 'JPEG XL JPEG \
       Recompression' and 'JPEG Baseline 8-bit' transfer syntaxes."
   )]
   crop: Option<CropRect>,
 
+  #[arg(
+    long,
+    help_heading = "Transcoding",
+    help = "When transcoding pixel data to a transfer syntax that uses \
+      encapsulated pixel data, write an Extended Offset Table so that readers \
+      can go directly to any frame. All encoded frames are held in memory \
+      until the last one has been transcoded.",
+    default_value_t = false
+  )]
+  extended_offset_table: bool,
+
+  #[arg(
+    long,
+    help_heading = "Transcoding",
+    help = "When transcoding pixel data to a lossless transfer syntax, decode \
+      every encoded frame and check that it matches the stored values of the \
+      input frame. The transcode fails if any frame doesn't match, including \
+      when the stored values are deliberately changed, e.g. by a color \
+      conversion or crop. Frames are decoded while the next frame is being \
+      encoded.",
+    default_value_t = false
+  )]
+  verify_lossless: bool,
+
+  #[arg(
+    long,
+    help_heading = "Transcoding",
+    value_name = "MIB",
+    help = "When transcoding pixel data, the most memory in MiB to use for \
+      frames being transcoded at once. Reading of the input pauses while this \
+      is used up. By default only the number of frames being transcoded at \
+      once is limited, which uses more memory when frames are large.\n\
+      \n\
+      When --print-stats is specified, the most memory held by each of the \
+      transcode's buffers is printed for each input."
+  )]
+  max_frame_memory: Option<usize>,
+
   #[command(flatten)]
   decoder: crate::args::decoder_args::DecoderArgs,
 }
@@ -287,10 +450,54 @@ impl ModifyArgs {
 
     config.set_quality(self.quality.unwrap_or(90));
     config.set_effort(self.effort.unwrap_or(7));
+    config.set_jpeg_2000_target_bits_per_pixel(self.target_bits_per_pixel);
+    config.set_jpeg_2000_fixed_quantization(self.jpeg_2000_fixed_quantization);
+    config.set_jpeg_baseline_encoder(self.jpeg_baseline_encoder.into());
     config.set_zlib_compression_level(self.zlib_compression_level);
+    config.set_zlib_thread_count(self.zlib_thread_count());
 
     config
   }
+
+  fn p10_write_config(&self) -> P10WriteConfig {
+    P10WriteConfig::default()
+      .implementation_version_name(self.implementation_version_name.clone())
+      .zlib_compression_level(self.zlib_compression_level)
+      .zlib_thread_count(self.zlib_thread_count())
+  }
+
+  /// Returns the adaptive effort shared by all inputs when
+  /// `--adaptive-effort-target` is specified.
+  ///
+  fn adaptive_effort(&self) -> Option<Arc<AdaptiveEffort>> {
+    static ADAPTIVE_EFFORT: OnceLock<Arc<AdaptiveEffort>> = OnceLock::new();
+
+    let target_megapixels_per_second = self.adaptive_effort_target?;
+
+    Some(
+      ADAPTIVE_EFFORT
+        .get_or_init(|| {
+          Arc::new(AdaptiveEffort::new(
+            self.adaptive_effort_min,
+            self.adaptive_effort_max,
+            self.effort.unwrap_or(7),
+            target_megapixels_per_second,
+          ))
+        })
+        .clone(),
+    )
+  }
+
+  /// Returns the number of threads to deflate output with, which is one unless
+  /// `--zlib-parallel` is specified.
+  ///
+  fn zlib_thread_count(&self) -> usize {
+    if self.zlib_parallel {
+      utils::cpu_budget::threads_per_task()
+    } else {
+      1
+    }
+  }
 }
 
 enum ModifyCommandError {
@@ -298,6 +505,18 @@ enum ModifyCommandError {
   P10PixelDataTranscodeTransformError(P10PixelDataTranscodeTransformError),
 }
 
+impl From<P10Error> for ModifyCommandError {
+  fn from(e: P10Error) -> Self {
+    Self::P10Error(e)
+  }
+}
+
+impl From<P10PixelDataTranscodeTransformError> for ModifyCommandError {
+  fn from(e: P10PixelDataTranscodeTransformError) -> Self {
+    Self::P10PixelDataTranscodeTransformError(e)
+  }
+}
+
 pub async fn run(args: ModifyArgs) -> Result<(), ()> {
   if (args.output_filename.is_some() as u8
     + args.output_directory.is_some() as u8
@@ -311,6 +530,24 @@ pub async fn run(args: ModifyArgs) -> Result<(), ()> {
     return Err(());
   }
 
+  if args.in_place_overwrite_header && !args.in_place {
+    eprintln!(
+      "Error: The --in-place-overwrite-header option is only valid when \
+       --in-place is specified"
+    );
+    return Err(());
+  }
+
+  // Modifying an input in place isn't repeatable, so it can't be safely
+  // retried by another worker
+  if args.in_place && args.distributed.lease_prefix.is_some() {
+    eprintln!(
+      "Error: The --in-place option is not valid when --lease-prefix is \
+       specified"
+    );
+    return Err(());
+  }
+
   if args.transfer_syntax.is_none() {
     if args.photometric_interpretation_monochrome.is_some() {
       eprintln!(
@@ -344,6 +581,14 @@ pub async fn run(args: ModifyArgs) -> Result<(), ()> {
       return Err(());
     }
 
+    if args.adaptive_effort_target.is_some() {
+      eprintln!(
+        "Error: The --adaptive-effort-target option is only valid when \
+         --transfer-syntax is specified"
+      );
+      return Err(());
+    }
+
     if args.crop.is_some() {
       eprintln!(
         "Error: The --crop option is only valid when --transfer-syntax is \
@@ -353,6 +598,14 @@ pub async fn run(args: ModifyArgs) -> Result<(), ()> {
     }
   }
 
+  if args
+    .adaptive_effort_target
+    .is_some_and(|target| target <= 0.0)
+  {
+    eprintln!("Error: The --adaptive-effort-target option must be positive");
+    return Err(());
+  }
+
   crate::validate_output_args(
     args.output_filename.as_ref(),
     args.output_directory.as_ref(),
@@ -361,60 +614,74 @@ pub async fn run(args: ModifyArgs) -> Result<(), ()> {
 
   OutputTarget::set_overwrite(args.overwrite || args.in_place);
 
-  let input_sources = args.input.base.input_sources().await;
+  let input_sources = utils::largest_first(
+    args.input.base.input_sources().await,
+    args.concurrency,
+  );
+  let work_leases = args.distributed.work_leases().await;
 
   let result = utils::run_tasks(
     args.concurrency,
     input_sources,
     async |input_source: InputSource| {
       if args.in_place
-        && let InputSource::Stdin = input_source
+        && let InputSource::Stdin | InputSource::HttpPart { .. } = input_source
       {
         crate::utils::exit_with_error(
-          "--in-place can't be used with stdin as an input",
+          "--in-place can't be used with stdin or HTTP URLs as inputs",
           "",
         );
       }
 
-      let output_target = if args.in_place {
-        OutputTarget::new(input_source.specified_path()).await
-      } else if let Some(output_filename) = &args.output_filename {
-        OutputTarget::new(output_filename).await
-      } else {
-        OutputTarget::from_input_source(
-          &input_source,
-          "",
-          &args.output_directory,
-        )
-        .await
-      };
-
-      match modify_input_source(&input_source, output_target, &args).await {
-        Ok(()) => Ok(()),
+      let modify_input = async || {
+        let output_target = if args.in_place {
+          OutputTarget::new(input_source.specified_path()).await
+        } else if let Some(output_filename) = &args.output_filename {
+          OutputTarget::new(output_filename).await
+        } else {
+          OutputTarget::from_input_source(
+            &input_source,
+            "",
+            &args.output_directory,
+          )
+          .await
+        };
 
-        Err(ModifyCommandError::P10Error(P10Error::DicmPrefixNotPresent))
-          if args.input.ignore_invalid =>
-        {
-          Ok(())
+        match modify_input_source(&input_source, output_target, &args).await {
+          Ok(()) => Ok(()),
+
+          Err(ModifyCommandError::P10Error(P10Error::DicmPrefixNotPresent))
+            if args.input.ignore_invalid =>
+          {
+            Ok(())
+          }
+
+          Err(e) => {
+            let task_description = format!("modifying \"{input_source}\"");
+
+            Err(match e {
+              ModifyCommandError::P10Error(e) => e.to_lines(&task_description),
+              ModifyCommandError::P10PixelDataTranscodeTransformError(e) => {
+                e.to_lines(&task_description)
+              }
+            })
+          }
         }
+      };
 
-        Err(e) => {
-          let task_description = format!("modifying \"{input_source}\"");
-
-          Err(match e {
-            ModifyCommandError::P10Error(e) => e.to_lines(&task_description),
-            ModifyCommandError::P10PixelDataTranscodeTransformError(e) => {
-              e.to_lines(&task_description)
-            }
-          })
-        }
+      match &work_leases {
+        Some(work_leases) => work_leases.run(&input_source, modify_input).await,
+        None => modify_input().await,
       }
     },
   )
   .await;
 
   match result {
-    Ok(()) => Ok(()),
+    Ok(()) => match &work_leases {
+      Some(work_leases) => work_leases.finish(),
+      None => Ok(()),
+    },
 
     Err(lines) => {
       error::print_error_lines(&lines);
@@ -444,6 +711,18 @@ async fn modify_input_source(
     );
   }
 
+  // Modify local files in place without rewriting their pixel data when
+  // possible
+  if args.in_place
+    && args.transfer_syntax.is_none()
+    && !args.anonymize
+    && !args.delete_private
+    && let Some(path) = input_source.local_path()
+    && tokio::task::block_in_place(|| modify_header_in_place(&path, args))?
+  {
+    return Ok(());
+  }
+
   // Create an insert transform for merging in another data set, if needed
   let insert_transform = args
     .merge_dicom_json
@@ -478,11 +757,9 @@ async fn modify_input_source(
   };
 
   // Setup write config
-  let write_config = P10WriteConfig::default()
-    .implementation_version_name(args.implementation_version_name.clone())
-    .zlib_compression_level(args.zlib_compression_level);
+  let write_config = args.p10_write_config();
 
-  let mut input_stream = input_source
+  let input_stream = input_source
     .open_read_stream()
     .await
     .map_err(ModifyCommandError::P10Error)?;
@@ -493,12 +770,9 @@ async fn modify_input_source(
     .await
     .map_err(ModifyCommandError::P10Error)?;
 
-  // Get exclusive access to the output stream
-  let mut output_stream = output_stream_handle.lock().await;
-
-  streaming_rewrite(
-    &mut input_stream,
-    &mut *output_stream,
+  let memory_high_water_marks = streaming_rewrite(
+    input_stream,
+    output_stream_handle.clone(),
     write_config,
     insert_transform,
     filter_transform,
@@ -506,206 +780,692 @@ async fn modify_input_source(
   )
   .await?;
 
+  if codec_stats::is_enabled()
+    && let Some(marks) = memory_high_water_marks
+  {
+    print_memory_high_water_marks(input_source, &marks);
+  }
+
   output_target
-    .commit(&mut output_stream)
+    .commit(&mut *output_stream_handle.lock().await)
     .await
     .map_err(ModifyCommandError::P10Error)
 }
 
+/// Prints the most memory held by the buffers of the pixel data transcode of
+/// an input.
+///
+fn print_memory_high_water_marks(
+  input_source: &InputSource,
+  marks: &TranscodeMemoryHighWaterMarks,
+) {
+  const MIB: f64 = 1024.0 * 1024.0;
+
+  eprintln!(
+    "Peak transcode memory for \"{input_source}\": \
+     {:.1} MiB buffered tokens, {:.1} MiB unframed pixel data, \
+     {:.1} MiB in {} frames in flight, {:.1} MiB held output, \
+     {:.1} MiB output tokens",
+    marks.buffered_token_bytes as f64 / MIB,
+    marks.unframed_pixel_data_bytes as f64 / MIB,
+    marks.frame_bytes_in_flight as f64 / MIB,
+    marks.frames_in_flight,
+    marks.held_output_bytes as f64 / MIB,
+    marks.output_token_bytes as f64 / MIB,
+  );
+}
+
+/// The block size that the pixel data of a file is kept aligned to when its
+/// header is rewritten and the pixel data has to be copied. Keeping the same
+/// alignment lets filesystems that support reflinks share the pixel data's
+/// blocks rather than copying them.
+///
+const HEADER_ALIGNMENT: usize = 4096;
+
+/// Counter used to give each temporary file written when modifying a file's
+/// header a unique name.
+///
+static TEMPORARY_FILE_COUNT: AtomicU64 = AtomicU64::new(0);
+
+/// Modifies a local file in place by rewriting only the data elements that
+/// precede its pixel data. Returns false without altering the file when the
+/// requested modifications aren't limited to those data elements, in which
+/// case the whole file needs to be rewritten.
+///
+/// The new header is written to a temporary file, the pixel data and
+/// everything after it is copied across with [`std::io::copy()`], which uses
+/// `copy_file_range` on Linux so the data doesn't pass through userspace, and
+/// the temporary file then replaces the original.
+///
+/// With `--in-place-overwrite-header`, if the new header is no larger than the
+/// existing one then the difference is taken up by a *'(0002,0102) Private
+/// Information'* data element in the File Meta Information and the header is
+/// overwritten in place instead, which isn't atomic.
+///
+fn modify_header_in_place(
+  path: &Path,
+  args: &ModifyArgs,
+) -> Result<bool, ModifyCommandError> {
+  let file_error = |when: &str, e: std::io::Error| P10Error::FileError {
+    when: when.to_string(),
+    details: e.to_string(),
+  };
+
+  let mut file =
+    std::fs::File::open(path).map_err(|e| file_error("Opening file", e))?;
+
+  // Read the data elements that precede the pixel data, and the offset of the
+  // pixel data in the file. Files without pixel data are rewritten in full.
+  let read_config = args
+    .input
+    .p10_read_config()
+    .require_dicm_prefix(args.input.ignore_invalid);
+  let Some(P10Header {
+    mut data_set,
+    preamble: Some(preamble),
+    transfer_syntax,
+    pixel_data_tag,
+    pixel_data_offset,
+    ..
+  }) = P10Header::read(&mut file, read_config)?
+  else {
+    return Ok(false);
+  };
+  let pixel_data_offset = pixel_data_offset as usize;
+
+  // Deflated data can't be partially rewritten
+  if transfer_syntax.is_deflated {
+    return Ok(false);
+  }
+
+  // The modifications must only affect data elements prior to the pixel data
+  let is_before_pixel_data =
+    |tag: &DataElementTag| tag.to_int() < pixel_data_tag.to_int();
+  if !args.deletions.iter().all(is_before_pixel_data)
+    || args
+      .merge_dicom_json
+      .as_ref()
+      .is_some_and(|merge_data_set| {
+        !merge_data_set.tags().iter().all(is_before_pixel_data)
+      })
+  {
+    return Ok(false);
+  }
+
+  for tag in args.deletions.iter() {
+    delete_recursive(&mut data_set, *tag);
+  }
+
+  if let Some(merge_data_set) = &args.merge_dicom_json {
+    data_set.merge(merge_data_set.clone());
+  }
+
+  // Padding from a previous in-place modification is reclaimed, but the
+  // Private Information data element can't be used for padding if it's
+  // already in use by someone else
+  let can_pad = match data_set
+    .get_string(dictionary::PRIVATE_INFORMATION_CREATOR_UID.tag)
+  {
+    Ok(uid) if uid == uids::DCMFX_IMPLEMENTATION_CLASS_UID => {
+      data_set.delete(dictionary::PRIVATE_INFORMATION_CREATOR_UID.tag);
+      data_set.delete(dictionary::PRIVATE_INFORMATION.tag);
+      true
+    }
+    Ok(_) => false,
+    Err(_) => !data_set.has(dictionary::PRIVATE_INFORMATION.tag),
+  };
+
+  let write_config = args.p10_write_config();
+  let header_bytes = |padding: Option<usize>| {
+    let mut data_set = data_set.clone();
+
+    if let Some(padding) = padding {
+      data_set.insert(
+        dictionary::PRIVATE_INFORMATION_CREATOR_UID.tag,
+        DataElementValue::new_unique_identifier(&[
+          uids::DCMFX_IMPLEMENTATION_CLASS_UID,
+        ])
+        .unwrap(),
+      );
+      data_set.insert(
+        dictionary::PRIVATE_INFORMATION.tag,
+        DataElementValue::new_other_byte_string(vec![0; padding]).unwrap(),
+      );
+    }
+
+    let mut bytes = vec![];
+    data_set.to_p10_bytes(
+      &mut |data| {
+        bytes.extend_from_slice(&data);
+        Ok(())
+      },
+      Some(write_config.clone()),
+    )?;
+
+    // Keep the original File Preamble
+    bytes[..preamble.len()].copy_from_slice(&preamble);
+
+    Ok::<_, P10Error>(bytes)
+  };
+
+  let unpadded_header = header_bytes(None)?;
+  let padding_overhead = if can_pad {
+    Some(header_bytes(Some(0))?.len() - unpadded_header.len())
+  } else {
+    None
+  };
+
+  // When overwriting the header directly is allowed, find the padding that
+  // makes the new header the same size as the existing one, if possible
+  let header = if !args.in_place_overwrite_header {
+    None
+  } else if unpadded_header.len() == pixel_data_offset {
+    Some(unpadded_header.clone())
+  } else if let Some(padding_overhead) = padding_overhead
+    && unpadded_header.len() + padding_overhead <= pixel_data_offset
+  {
+    Some(header_bytes(Some(
+      pixel_data_offset - unpadded_header.len() - padding_overhead,
+    ))?)
+  } else {
+    None
+  };
+
+  if let Some(header) = header
+    && header.len() == pixel_data_offset
+  {
+    std::fs::OpenOptions::new()
+      .write(true)
+      .open(path)
+      .and_then(|mut file| {
+        file.write_all(&header)?;
+        file.sync_data()
+      })
+      .map_err(|e| file_error("Writing file header", e))?;
+
+    return Ok(true);
+  }
+
+  // Pad the new header to keep the pixel data's alignment, which also leaves
+  // room for subsequent modifications to be made in place
+  let header = match padding_overhead {
+    Some(padding_overhead) => {
+      let minimum_length = unpadded_header.len() + padding_overhead;
+      let padding = (pixel_data_offset as isize - minimum_length as isize)
+        .rem_euclid(HEADER_ALIGNMENT as isize) as usize;
+
+      header_bytes(Some(padding))?
+    }
+
+    None => unpadded_header,
+  };
+
+  let mut temporary_path = path.as_os_str().to_owned();
+  temporary_path.push(format!(
+    "#{}-{}",
+    std::process::id(),
+    TEMPORARY_FILE_COUNT.fetch_add(1, Ordering::Relaxed)
+  ));
+  let temporary_path = PathBuf::from(temporary_path);
+
+  let result = (|| {
+    let mut output = std::fs::OpenOptions::new()
+      .write(true)
+      .create_new(true)
+      .open(&temporary_path)?;
+    copy_file_attributes(&file, &output)?;
+
+    output.write_all(&header)?;
+
+    file.seek(std::io::SeekFrom::Start(pixel_data_offset as u64))?;
+    std::io::copy(&mut file, &mut output)?;
+    output.sync_all()?;
+
+    std::fs::rename(&temporary_path, path)
+  })();
+
+  if let Err(e) = result {
+    let _ = std::fs::remove_file(&temporary_path);
+    return Err(file_error("Rewriting file", e).into());
+  }
+
+  Ok(true)
+}
+
+/// Copies the permissions of a file onto the file that will replace it, along
+/// with its owner and extended attributes where the current user is allowed to
+/// set them.
+///
+fn copy_file_attributes(
+  file: &std::fs::File,
+  replacement: &std::fs::File,
+) -> std::io::Result<()> {
+  let metadata = file.metadata()?;
+
+  // Changing the owner requires privileges, and changing the group requires
+  // membership of it, so failures are ignored and the replacement keeps the
+  // current user as its owner
+  #[cfg(unix)]
+  {
+    use std::os::unix::fs::MetadataExt;
+
+    let _ = std::os::unix::fs::fchown(
+      replacement,
+      Some(metadata.uid()),
+      Some(metadata.gid()),
+    );
+  }
+
+  #[cfg(target_os = "linux")]
+  copy_extended_attributes(file, replacement);
+
+  // Set permissions last, as changing the owner can clear the setuid and
+  // setgid bits
+  replacement.set_permissions(metadata.permissions())
+}
+
+/// Copies the extended attributes of a file onto another file. Attributes that
+/// can't be read or set, e.g. those in the trusted namespace when not running
+/// as root, are skipped.
+///
+#[cfg(target_os = "linux")]
+fn copy_extended_attributes(file: &std::fs::File, replacement: &std::fs::File) {
+  use std::os::fd::AsRawFd;
+
+  let (fd, replacement_fd) = (file.as_raw_fd(), replacement.as_raw_fd());
+
+  let size = unsafe { libc::flistxattr(fd, std::ptr::null_mut(), 0) };
+  if size <= 0 {
+    return;
+  }
+
+  let mut names = vec![0u8; size as usize];
+  let size = unsafe {
+    libc::flistxattr(fd, names.as_mut_ptr() as *mut libc::c_char, names.len())
+  };
+  if size <= 0 {
+    return;
+  }
+  names.truncate(size as usize);
+
+  // The list is a sequence of nul-terminated attribute names
+  for name in names.split_inclusive(|c| *c == 0) {
+    let name = name.as_ptr() as *const libc::c_char;
+
+    let size = unsafe { libc::fgetxattr(fd, name, std::ptr::null_mut(), 0) };
+    if size < 0 {
+      continue;
+    }
+
+    let mut value = vec![0u8; size as usize];
+    let size = unsafe {
+      libc::fgetxattr(
+        fd,
+        name,
+        value.as_mut_ptr() as *mut libc::c_void,
+        value.len(),
+      )
+    };
+    if size < 0 {
+      continue;
+    }
+
+    unsafe {
+      libc::fsetxattr(
+        replacement_fd,
+        name,
+        value.as_ptr() as *const libc::c_void,
+        size as usize,
+        0,
+      )
+    };
+  }
+}
+
+/// Deletes a data element from a data set and from the items of all the
+/// sequences in it, which matches the deletions made when a file is rewritten
+/// in full.
+///
+fn delete_recursive(data_set: &mut DataSet, tag: DataElementTag) {
+  data_set.delete(tag);
+
+  for (_, value) in data_set.iter_mut() {
+    if let Ok(items) = value.sequence_items_mut() {
+      for item in items.iter_mut() {
+        delete_recursive(item, tag);
+      }
+    }
+  }
+}
+
+/// The number of batches of P10 tokens that can be queued between the stages of
+/// a streaming rewrite.
+///
+const PIPELINE_DEPTH: usize = 4;
+
 /// Rewrites by streaming the tokens of the DICOM P10 straight to the output
 /// file.
 ///
-async fn streaming_rewrite<I: IoAsyncRead, O: IoAsyncWrite>(
-  input_stream: &mut I,
-  output_stream: &mut O,
+/// This is done as a pipeline of three stages connected by bounded channels:
+/// reading tokens from the input stream, passing them through the transforms,
+/// and writing them to the output stream. Reading and writing run on their own
+/// tasks so that the next input is read, and the previous output written, while
+/// frames of pixel data are being transcoded. The bounded channels mean that
+/// reading pauses whenever the transforms block, e.g. when the transcode's
+/// memory budget is used up.
+///
+/// Returns the memory high-water marks of the pixel data transcode, if there
+/// was one.
+///
+async fn streaming_rewrite(
+  input_stream: Box<dyn IoAsyncRead + Send>,
+  output_stream_handle: Arc<Mutex<Box<dyn IoAsyncWrite>>>,
   write_config: P10WriteConfig,
   mut insert_transform: Option<P10InsertTransform>,
   mut filter_transform: Option<P10FilterTransform>,
   args: &ModifyArgs,
-) -> Result<(), ModifyCommandError> {
-  // Create read and write contexts
+) -> Result<Option<TranscodeMemoryHighWaterMarks>, ModifyCommandError> {
   let read_config = args
     .input
     .p10_read_config()
     .max_token_size(256 * 1024)
     .require_dicm_prefix(args.input.ignore_invalid);
 
-  let mut p10_read_context = P10ReadContext::new(Some(read_config));
-  let mut p10_write_context = P10WriteContext::new(Some(write_config));
+  let (input_sender, mut input_receiver) = mpsc::channel(PIPELINE_DEPTH);
+  let (output_sender, output_receiver) = mpsc::channel(PIPELINE_DEPTH);
+
+  let reader =
+    tokio::spawn(read_tokens_stage(input_stream, read_config, input_sender));
+  let writer = tokio::spawn(write_tokens_stage(
+    output_stream_handle,
+    write_config,
+    output_receiver,
+  ));
 
   let mut pixel_data_transcode_transform = None;
+  let mut memory_high_water_marks = None;
+
+  // Pass tokens from the reader through the transforms and on to the writer.
+  // Transforms can block while waiting for frames to be transcoded, which is
+  // done in place so that the runtime moves the reader and writer tasks to
+  // other threads in the meantime.
+  let mut transform_result = Ok(());
+  while let Some(tokens) = input_receiver.recv().await {
+    let tokens = match tokio::task::block_in_place(|| {
+      transform_tokens(
+        tokens,
+        &mut pixel_data_transcode_transform,
+        &mut insert_transform,
+        &mut filter_transform,
+        args,
+      )
+    }) {
+      Ok(tokens) => tokens,
+      Err(e) => {
+        transform_result = Err(e);
+        break;
+      }
+    };
+
+    if let Some(transcode_transform) = &pixel_data_transcode_transform {
+      memory_high_water_marks =
+        Some(transcode_transform.memory_high_water_marks());
+    }
+
+    // Stop if the writer has ended, which happens when it errors
+    if output_sender.send(tokens).await.is_err() {
+      break;
+    }
+  }
+
+  // Close the channels so the reader and writer stop if the pipeline ended
+  // early, then wait for them. A read error takes precedence as it may have
+  // caused later errors.
+  drop(input_receiver);
+  drop(output_sender);
+  reader.abort();
+
+  let read_result = match reader.await {
+    Ok(result) => result,
+    Err(e) if e.is_cancelled() => Ok(()),
+    Err(e) => std::panic::resume_unwind(e.into_panic()),
+  };
+
+  let write_result = match writer.await {
+    Ok(result) => result,
+    Err(e) => std::panic::resume_unwind(e.into_panic()),
+  };
+
+  read_result.map_err(ModifyCommandError::P10Error)?;
+  transform_result?;
+  write_result.map_err(ModifyCommandError::P10Error)?;
+
+  Ok(memory_high_water_marks)
+}
+
+/// The first stage of a streaming rewrite, which reads batches of P10 tokens
+/// from the input stream and sends them on until the end token is read.
+///
+async fn read_tokens_stage(
+  mut input_stream: Box<dyn IoAsyncRead + Send>,
+  read_config: P10ReadConfig,
+  sender: mpsc::Sender<Vec<P10Token>>,
+) -> Result<(), P10Error> {
+  let mut p10_read_context = P10ReadContext::new(Some(read_config));
 
-  // Stream P10 tokens from the input stream to the output stream
   loop {
-    // Read the next P10 tokens from the input stream
-    let mut tokens = dcmfx::p10::read_tokens_from_stream_async(
-      input_stream,
+    let span = trace_events::span("p10_read");
+    let tokens = dcmfx::p10::read_tokens_from_stream_async(
+      &mut input_stream,
       &mut p10_read_context,
       None,
     )
-    .await
-    .map_err(ModifyCommandError::P10Error)?;
+    .await?;
+    drop(span.arg("tokens", tokens.len()));
 
-    // If transcoding is active, setup a pixel data transcode transform when the
-    // File Meta Information token is received
-    if let Some(transfer_syntax_arg) = args.transfer_syntax {
-      for token in tokens.iter() {
-        let P10Token::FileMetaInformation { data_set } = token else {
-          continue;
-        };
+    let ended = tokens.last() == Some(&P10Token::End);
 
-        let input_transfer_syntax = data_set
-          .get_transfer_syntax()
-          .unwrap_or(&transfer_syntax::IMPLICIT_VR_LITTLE_ENDIAN);
-        let output_transfer_syntax = transfer_syntax_arg
-          .as_transfer_syntax()
-          .unwrap_or(input_transfer_syntax);
-
-        let photometric_interpretation_monochrome_arg =
-          args.photometric_interpretation_monochrome;
-        let photometric_interpretation_color_arg =
-          args.photometric_interpretation_color;
-
-        let image_data_functions =
-          TranscodeImageDataFunctions::standard_behavior(
-            output_transfer_syntax,
-            Rc::new(move |image_pixel_module| {
-              photometric_interpretation_monochrome_arg.and_then(|arg| {
-                arg.as_photometric_interpretation(
-                  image_pixel_module.pixel_representation(),
-                )
-              })
-            }),
-            Rc::new(move |_image_pixel_module| {
-              photometric_interpretation_color_arg
-                .and_then(|arg| arg.as_photometric_interpretation())
-            }),
-            args.planar_configuration.map(|a| a.into()),
-            args.crop,
-            args.quality.is_some(),
-          );
-
-        pixel_data_transcode_transform =
-          Some(P10PixelDataTranscodeTransform::new(
-            output_transfer_syntax,
-            args.decoder.pixel_data_decode_config(),
-            args.pixel_data_encode_config(),
-            Some(image_data_functions),
-          ));
-      }
+    if sender.send(tokens).await.is_err() || ended {
+      return Ok(());
     }
+  }
+}
 
-    // Pass tokens through the pixel data transcode transform if one is active
-    if let Some(transcode_transform) = pixel_data_transcode_transform.as_mut() {
-      let mut new_tokens = vec![];
+/// The last stage of a streaming rewrite, which writes batches of P10 tokens to
+/// the output stream until the end token is written. The output stream is held
+/// for the whole write so that output to stdout isn't interleaved.
+///
+async fn write_tokens_stage(
+  output_stream_handle: Arc<Mutex<Box<dyn IoAsyncWrite>>>,
+  write_config: P10WriteConfig,
+  mut receiver: mpsc::Receiver<Vec<P10Token>>,
+) -> Result<(), P10Error> {
+  let mut output_stream = output_stream_handle.lock().await;
+  let mut p10_write_context = P10WriteContext::new(Some(write_config));
 
-      for token in tokens.iter() {
-        new_tokens.extend(
-          transcode_transform
-            .add_token(token)
-            .map_err(ModifyCommandError::P10PixelDataTranscodeTransformError)?,
-        );
-      }
+  while let Some(tokens) = receiver.recv().await {
+    let span = trace_events::span("p10_write").arg("tokens", tokens.len());
+    let ended = dcmfx::p10::write_tokens_to_stream_async(
+      &tokens,
+      &mut *output_stream,
+      &mut p10_write_context,
+    )
+    .await?;
+    drop(span);
 
-      // If the pixel data transcode transform is inactive then there is no
-      // pixel data in this DICOM to be transcoded. However, some transcodes not
-      // involving encapsulated pixel data are still possible, specifically
-      // those between any of the four transfer syntaxes listed below. These are
-      // done by updating the transfer syntax in the File Meta Information
-      // token.
-      if !transcode_transform.is_active() {
-        let directly_transcodable_transfer_syntaxes = [
-          &transfer_syntax::IMPLICIT_VR_LITTLE_ENDIAN,
-          &transfer_syntax::EXPLICIT_VR_LITTLE_ENDIAN,
-          &transfer_syntax::EXPLICIT_VR_BIG_ENDIAN,
-          &transfer_syntax::DEFLATED_EXPLICIT_VR_LITTLE_ENDIAN,
-        ];
-
-        let mut output_transfer_syntax =
-          transcode_transform.output_transfer_syntax();
-
-        // An output transfer syntax that has encapsulated pixel data is not
-        // relevant as this DICOM does not contain pixel data, so automatically
-        // drop down to Explicit VR Little Endian
-        if output_transfer_syntax.is_encapsulated {
-          output_transfer_syntax = &transfer_syntax::EXPLICIT_VR_LITTLE_ENDIAN;
-        }
+    // Stop when the end token is written
+    if ended {
+      break;
+    }
+  }
 
-        if !directly_transcodable_transfer_syntaxes
-          .contains(&transcode_transform.input_transfer_syntax())
-          || !directly_transcodable_transfer_syntaxes
-            .contains(&output_transfer_syntax)
-        {
-          return Err(ModifyCommandError::P10PixelDataTranscodeTransformError(
-            P10PixelDataTranscodeTransformError::NotSupported {
-              details: format!(
-                "Transcoding from '{}' to '{}' is not supported",
-                transcode_transform.input_transfer_syntax().name,
-                output_transfer_syntax.name
-              ),
-            },
-          ));
-        }
+  Ok(())
+}
 
-        // Set the new transfer syntax in the File Meta Information token
-        for token in &mut new_tokens {
-          token.change_transfer_syntax(output_transfer_syntax)
-        }
+/// Passes a batch of P10 tokens through the pixel data transcode, insert, and
+/// filter transforms of a streaming rewrite. The pixel data transcode
+/// transform is created when the File Meta Information token is received.
+///
+fn transform_tokens(
+  mut tokens: Vec<P10Token>,
+  pixel_data_transcode_transform: &mut Option<P10PixelDataTranscodeTransform>,
+  insert_transform: &mut Option<P10InsertTransform>,
+  filter_transform: &mut Option<P10FilterTransform>,
+  args: &ModifyArgs,
+) -> Result<Vec<P10Token>, ModifyCommandError> {
+  // If transcoding is active, setup a pixel data transcode transform when the
+  // File Meta Information token is received
+  if let Some(transfer_syntax_arg) = args.transfer_syntax {
+    for token in tokens.iter() {
+      let P10Token::FileMetaInformation { data_set } = token else {
+        continue;
+      };
+
+      let input_transfer_syntax = data_set
+        .get_transfer_syntax()
+        .unwrap_or(&transfer_syntax::IMPLICIT_VR_LITTLE_ENDIAN);
+      let output_transfer_syntax = transfer_syntax_arg
+        .as_transfer_syntax()
+        .unwrap_or(input_transfer_syntax);
+
+      let photometric_interpretation_monochrome_arg =
+        args.photometric_interpretation_monochrome;
+      let photometric_interpretation_color_arg =
+        args.photometric_interpretation_color;
+
+      let image_data_functions = TranscodeImageDataFunctions::standard_behavior(
+        output_transfer_syntax,
+        Rc::new(move |image_pixel_module| {
+          photometric_interpretation_monochrome_arg.and_then(|arg| {
+            arg.as_photometric_interpretation(
+              image_pixel_module.pixel_representation(),
+            )
+          })
+        }),
+        Rc::new(move |_image_pixel_module| {
+          photometric_interpretation_color_arg
+            .and_then(|arg| arg.as_photometric_interpretation())
+        }),
+        args.planar_configuration.map(|a| a.into()),
+        args.crop,
+        args.quality.is_some(),
+      );
 
-        // Clear the pixel data transcode transform as it's now inactive
-        pixel_data_transcode_transform = None;
+      let mut transcode_transform = P10PixelDataTranscodeTransform::new(
+        output_transfer_syntax,
+        args.decoder.pixel_data_decode_config(),
+        args.pixel_data_encode_config(),
+        Some(image_data_functions),
+      );
+      transcode_transform
+        .set_write_extended_offset_table(args.extended_offset_table);
+      transcode_transform.set_verify_lossless(args.verify_lossless);
+      transcode_transform
+        .set_thread_budget_fn(utils::cpu_budget::threads_per_task);
+      if let Some(numa_node) = utils::cpu_budget::next_numa_node() {
+        transcode_transform.set_numa_node(numa_node);
+      }
+      if let Some(adaptive_effort) = args.adaptive_effort() {
+        transcode_transform.set_adaptive_effort(adaptive_effort);
       }
+      if let Some(max_frame_memory) = args.max_frame_memory {
+        transcode_transform
+          .set_max_bytes_in_flight(max_frame_memory.max(1) * 1024 * 1024);
+      }
+
+      *pixel_data_transcode_transform = Some(transcode_transform);
+    }
+  }
+
+  // Pass tokens through the pixel data transcode transform if one is active
+  if let Some(transcode_transform) = pixel_data_transcode_transform.as_mut() {
+    let mut new_tokens = Vec::with_capacity(tokens.len());
 
-      tokens = new_tokens
+    for token in tokens {
+      transcode_transform.push_token(token, &mut |token| {
+        new_tokens.push(token);
+        Ok::<(), ModifyCommandError>(())
+      })?;
     }
 
-    // Pass tokens through the insert transform if one is specified
-    let tokens = if let Some(insert_transform) = insert_transform.as_mut() {
-      let mut new_tokens = vec![];
+    // If the pixel data transcode transform is inactive then there is no
+    // pixel data in this DICOM to be transcoded. However, some transcodes not
+    // involving encapsulated pixel data are still possible, specifically
+    // those between any of the four transfer syntaxes listed below. These are
+    // done by updating the transfer syntax in the File Meta Information
+    // token.
+    if !transcode_transform.is_active() {
+      let directly_transcodable_transfer_syntaxes = [
+        &transfer_syntax::IMPLICIT_VR_LITTLE_ENDIAN,
+        &transfer_syntax::EXPLICIT_VR_LITTLE_ENDIAN,
+        &transfer_syntax::EXPLICIT_VR_BIG_ENDIAN,
+        &transfer_syntax::DEFLATED_EXPLICIT_VR_LITTLE_ENDIAN,
+      ];
+
+      let mut output_transfer_syntax =
+        transcode_transform.output_transfer_syntax();
+
+      // An output transfer syntax that has encapsulated pixel data is not
+      // relevant as this DICOM does not contain pixel data, so automatically
+      // drop down to Explicit VR Little Endian
+      if output_transfer_syntax.is_encapsulated {
+        output_transfer_syntax = &transfer_syntax::EXPLICIT_VR_LITTLE_ENDIAN;
+      }
 
-      for token in tokens.iter() {
-        new_tokens.extend(
-          insert_transform
-            .add_token(token)
-            .map_err(ModifyCommandError::P10Error)?,
-        );
+      if !directly_transcodable_transfer_syntaxes
+        .contains(&transcode_transform.input_transfer_syntax())
+        || !directly_transcodable_transfer_syntaxes
+          .contains(&output_transfer_syntax)
+      {
+        return Err(ModifyCommandError::P10PixelDataTranscodeTransformError(
+          P10PixelDataTranscodeTransformError::NotSupported {
+            details: format!(
+              "Transcoding from '{}' to '{}' is not supported",
+              transcode_transform.input_transfer_syntax().name,
+              output_transfer_syntax.name
+            ),
+          },
+        ));
       }
 
-      Ok(new_tokens)
-    } else {
-      Ok(tokens)
-    }?;
-
-    // Pass tokens through the filter transform if one is specified
-    let tokens = if let Some(filter_transform) = filter_transform.as_mut() {
-      tokens.into_iter().try_fold(vec![], |mut acc, token| {
-        if filter_transform
-          .add_token(&token)
-          .map_err(ModifyCommandError::P10Error)?
-        {
-          acc.push(token);
-        }
+      // Set the new transfer syntax in the File Meta Information token
+      for token in &mut new_tokens {
+        token.change_transfer_syntax(output_transfer_syntax)
+      }
 
-        Ok(acc)
+      // Clear the pixel data transcode transform as it's now inactive
+      *pixel_data_transcode_transform = None;
+    }
+
+    tokens = new_tokens
+  }
+
+  // Pass tokens through the insert and filter transforms if they're specified.
+  // Tokens are pushed through both transforms in turn without being cloned.
+  let mut output_tokens = Vec::with_capacity(tokens.len());
+
+  let mut filter_sink = |token: P10Token| match filter_transform.as_mut() {
+    Some(filter_transform) => {
+      filter_transform.push_token(token, &mut |token| {
+        output_tokens.push(token);
+        Ok::<(), ModifyCommandError>(())
       })
-    } else {
-      Ok(tokens)
-    }?;
+    }
 
-    // Write tokens to the output stream
-    let ended = dcmfx::p10::write_tokens_to_stream_async(
-      &tokens,
-      &mut *output_stream,
-      &mut p10_write_context,
-    )
-    .await
-    .map_err(ModifyCommandError::P10Error)?;
+    None => {
+      output_tokens.push(token);
+      Ok(())
+    }
+  };
 
-    // Stop when the end token is received
-    if ended {
-      break;
+  for token in tokens {
+    match insert_transform.as_mut() {
+      Some(insert_transform) => {
+        insert_transform.push_token(token, &mut filter_sink)?
+      }
+      None => filter_sink(token)?,
     }
   }
 
-  Ok(())
+  Ok(output_tokens)
 }
@@ -1,10 +1,13 @@
-use std::path::PathBuf;
+use std::{
+  io::{Seek, Write},
+  path::{Path, PathBuf},
+};
 
 use clap::Args;
 
 use dcmfx::{core::*, p10::*};
 
-use crate::utils::{self, InputSource, OutputTarget};
+use crate::utils::{self, InputSource, OutputTarget, p10_header::P10Header};
 
 pub const ABOUT: &str = "Rewrites DICOM P10 files to correct and recover their \
   data";
@@ -21,7 +24,10 @@ pub const LONG_ABOUT: &str = "Rewrites DICOM P10 files in order to standardize \
   \n\
   Each DICOM file must be fully read into memory to be rewritten. DICOM \
   streaming is not supported for rewrites due to reordering corrections that \
-  may be needed.";
+  may be needed. The exception is when a local file is rewritten to a local \
+  file and its pixel data is the last data element, in which case only the \
+  data elements prior to the pixel data are read into memory, and the pixel \
+  data is copied directly from the input file to the output file.";
 
 #[derive(Args)]
 pub struct RewriteArgs {
@@ -36,6 +42,9 @@ pub struct RewriteArgs {
   #[command(flatten)]
   input: crate::args::input_args::P10InputArgs,
 
+  #[command(flatten)]
+  distributed: crate::args::distributed_args::DistributedArgs,
+
   #[arg(
     long,
     help_heading = "Input",
@@ -118,52 +127,68 @@ pub async fn run(args: RewriteArgs) -> Result<(), ()> {
 
   OutputTarget::set_overwrite(args.overwrite || args.in_place);
 
-  let input_sources = args.input.base.input_sources().await;
+  let input_sources = utils::largest_first(
+    args.input.base.input_sources().await,
+    args.concurrency,
+  );
+  let work_leases = args.distributed.work_leases().await;
 
   let result = utils::run_tasks(
     args.concurrency,
     input_sources,
     async |input_source: InputSource| {
       if args.in_place
-        && let InputSource::Stdin = input_source
+        && let InputSource::Stdin | InputSource::HttpPart { .. } = input_source
       {
         crate::utils::exit_with_error(
-          "--in-place can't be used with stdin as an input",
+          "--in-place can't be used with stdin or HTTP URLs as inputs",
           "",
         );
       }
 
-      let output_target = if args.in_place {
-        OutputTarget::new(input_source.specified_path()).await
-      } else if let Some(output_filename) = &args.output_filename {
-        OutputTarget::new(output_filename).await
-      } else {
-        OutputTarget::from_input_source(
-          &input_source,
-          "",
-          &args.output_directory,
-        )
-        .await
-      };
-
-      match rewrite_input_source(&input_source, output_target, &args).await {
-        Ok(()) => Ok(()),
-
-        Err(P10Error::DicmPrefixNotPresent) if args.input.ignore_invalid => {
-          Ok(())
+      let rewrite_input = async || {
+        let output_target = if args.in_place {
+          OutputTarget::new(input_source.specified_path()).await
+        } else if let Some(output_filename) = &args.output_filename {
+          OutputTarget::new(output_filename).await
+        } else {
+          OutputTarget::from_input_source(
+            &input_source,
+            "",
+            &args.output_directory,
+          )
+          .await
+        };
+
+        match rewrite_input_source(&input_source, output_target, &args).await {
+          Ok(()) => Ok(()),
+
+          Err(P10Error::DicmPrefixNotPresent) if args.input.ignore_invalid => {
+            Ok(())
+          }
+
+          Err(e) => {
+            let task_description = format!("rewriting \"{input_source}\"");
+            Err(e.to_lines(&task_description))
+          }
         }
+      };
 
-        Err(e) => {
-          let task_description = format!("rewriting \"{input_source}\"");
-          Err(e.to_lines(&task_description))
+      match &work_leases {
+        Some(work_leases) => {
+          work_leases.run(&input_source, rewrite_input).await
         }
+        None => rewrite_input().await,
       }
     },
   )
   .await;
 
   match result {
-    Ok(()) => Ok(()),
+    Ok(()) => match &work_leases {
+      Some(work_leases) => work_leases.finish(),
+      None => Ok(()),
+    },
 
     Err(lines) => {
       error::print_error_lines(&lines);
@@ -200,6 +225,29 @@ async fn rewrite_input_source(
     .require_dicm_prefix(args.input.ignore_invalid)
     .require_ordered_data_elements(false);
 
+  // Setup write config
+  let write_config = P10WriteConfig::default()
+    .implementation_version_name(args.implementation_version_name.clone());
+
+  // Rewrite local files without reading their pixel data into memory when
+  // possible
+  if let Some(input_path) = input_source.local_path()
+    && let Some(output_path) = output_target.local_path()
+  {
+    output_target.check_overwrite().await;
+
+    if tokio::task::block_in_place(|| {
+      rewrite_with_pixel_data_passthrough(
+        &input_path,
+        &output_path,
+        read_config,
+        &write_config,
+      )
+    })? {
+      return Ok(());
+    }
+  }
+
   // Open input stream
   let mut input_stream = input_source.open_read_stream().await?;
 
@@ -227,13 +275,98 @@ async fn rewrite_input_source(
   // Get exclusive access to the output stream
   let mut output_stream = output_stream_handle.lock().await;
 
-  // Setup write config
-  let write_config = P10WriteConfig::default()
-    .implementation_version_name(args.implementation_version_name.clone());
-
   // Write P10 output
   ds.write_p10_stream_async(&mut *output_stream, Some(write_config))
     .await?;
 
   output_target.commit(&mut output_stream).await
 }
+
+/// Rewrites a local file to a local file without passing its pixel data
+/// through a P10 read and write context. The data elements prior to the pixel
+/// data are read and rewritten as normal, and the bytes of the pixel data are
+/// then copied from the input file with [`std::io::copy()`], which uses
+/// `copy_file_range` on Linux so they don't pass through userspace.
+///
+/// Returns false if this isn't possible, in which case a full rewrite is
+/// needed. This is the case when the pixel data isn't the last data element,
+/// the transfer syntax is deflated or big endian, or any of the data prior to
+/// the pixel data is invalid or out of order.
+///
+fn rewrite_with_pixel_data_passthrough(
+  input_path: &Path,
+  output_path: &Path,
+  read_config: P10ReadConfig,
+  write_config: &P10WriteConfig,
+) -> Result<bool, P10Error> {
+  let file_error = |when: &str, e: std::io::Error| P10Error::FileError {
+    when: when.to_string(),
+    details: e.to_string(),
+  };
+
+  let mut input = std::fs::File::open(input_path)
+    .map_err(|e| file_error("Opening input file", e))?;
+
+  // Errors reading the header are left to the full rewrite to report or
+  // recover from
+  let Ok(Some(header)) = P10Header::read(&mut input, read_config) else {
+    return Ok(false);
+  };
+
+  if header.transfer_syntax.is_deflated
+    || header.transfer_syntax.endianness.is_big()
+    || header
+      .data_set
+      .tags()
+      .iter()
+      .any(|tag| tag.to_int() >= header.pixel_data_tag.to_int())
+  {
+    return Ok(false);
+  }
+
+  // The pixel data must run to the end of the input file
+  let input_length = input
+    .metadata()
+    .map_err(|e| file_error("Reading input file metadata", e))?
+    .len();
+  match header.pixel_data_end(&mut input) {
+    Ok(end) if end == input_length => (),
+    _ => return Ok(false),
+  }
+
+  let mut header_bytes = vec![];
+  header.data_set.to_p10_bytes(
+    &mut |bytes| {
+      header_bytes.extend_from_slice(&bytes);
+      Ok(())
+    },
+    Some(write_config.clone()),
+  )?;
+
+  // Write to a temporary file that replaces the output file once complete, as
+  // the output file may be the input file
+  let mut temporary_path = output_path.as_os_str().to_owned();
+  temporary_path.push(".dcmfx-rewrite");
+  let temporary_path = PathBuf::from(temporary_path);
+
+  let result = (|| {
+    if let Some(parent) = output_path.parent() {
+      std::fs::create_dir_all(parent)?;
+    }
+
+    let mut output = std::fs::File::create(&temporary_path)?;
+    output.write_all(&header_bytes)?;
+
+    input.seek(std::io::SeekFrom::Start(header.pixel_data_offset))?;
+    std::io::copy(&mut input, &mut output)?;
+
+    std::fs::rename(&temporary_path, output_path)
+  })();
+
+  if let Err(e) = result {
+    let _ = std::fs::remove_file(&temporary_path);
+    return Err(file_error("Writing output file", e));
+  }
+
+  Ok(true)
+}
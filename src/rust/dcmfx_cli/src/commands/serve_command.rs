@@ -0,0 +1,152 @@
+use std::net::SocketAddr;
+use std::panic::AssertUnwindSafe;
+
+use clap::{Args, Parser, Subcommand};
+use futures::{FutureExt, StreamExt, stream::FuturesUnordered};
+use tokio::{
+  io::{AsyncBufReadExt, AsyncWriteExt, BufReader},
+  net::{TcpListener, TcpStream},
+  sync::Mutex,
+};
+
+use crate::commands::{
+  dcm_to_json_command, get_pixel_data_command, modify_command,
+};
+use crate::utils;
+
+pub const ABOUT: &str = "Runs a long-lived server that processes jobs sent to \
+  it over TCP, avoiding the cost of starting a new process for each job";
+
+pub const LONG_ABOUT: &str = "Runs a long-lived server that processes jobs \
+  sent to it over TCP, avoiding the cost of starting a new process for each \
+  job. Codec initialization and the shared worker pool are then paid for once \
+  rather than on every invocation.
+
+Each job is a single line containing a JSON array of the arguments for one of \
+  the 'get-pixel-data', 'modify', or 'dcm-to-json' commands, e.g. \
+  [\"modify\", \"input.dcm\", \"--output-filename\", \"output.dcm\", \
+  \"--transfer-syntax\", \"jpeg-xl\"].
+
+Jobs on a connection are run in order, and when each one completes a single \
+  line of JSON is sent back that is either {\"success\":true} or \
+  {\"success\":false,\"error\":\"...\"}. Jobs from different connections are \
+  queued and run one at a time, with each job using the whole thread budget. \
+  Output that a job would write to stdout or stderr is written to the server's \
+  stdout and stderr.";
+
+#[derive(Args)]
+pub struct ServeArgs {
+  #[arg(
+    long,
+    help = "The address to listen on for connections. Use port 0 to listen on \
+      any free port. The address being listened on is printed to stdout once \
+      the server is ready.",
+    default_value = "127.0.0.1:7468"
+  )]
+  address: SocketAddr,
+}
+
+/// A job sent to the server, which is the arguments for one of the commands
+/// that can be run as a job.
+///
+#[derive(Parser)]
+#[command(name = "dcmfx", no_binary_name = true)]
+struct Job {
+  #[command(subcommand)]
+  command: JobCommand,
+}
+
+#[derive(Subcommand)]
+enum JobCommand {
+  GetPixelData(get_pixel_data_command::GetPixelDataArgs),
+  Modify(modify_command::ModifyArgs),
+  DcmToJson(dcm_to_json_command::ToJsonArgs),
+}
+
+pub async fn run(args: ServeArgs) -> Result<(), ()> {
+  let listener = match TcpListener::bind(args.address).await {
+    Ok(listener) => listener,
+    Err(e) => utils::exit_with_error(
+      &format!("Failed listening on '{}'", args.address),
+      e,
+    ),
+  };
+
+  match listener.local_addr() {
+    Ok(address) => println!("Listening on {address}"),
+    Err(e) => utils::exit_with_error("Failed getting listen address", e),
+  }
+
+  // Errors in a job's arguments end that job rather than the server
+  utils::set_exit_ends_job(true);
+
+  let job_lock = Mutex::new(());
+  let mut connections = FuturesUnordered::new();
+
+  loop {
+    tokio::select! {
+      accepted = listener.accept() => match accepted {
+        Ok((stream, _)) => {
+          connections.push(handle_connection(stream, &job_lock));
+        }
+        Err(e) => eprintln!("Failed accepting connection: {e}"),
+      },
+
+      Some(()) = connections.next(), if !connections.is_empty() => (),
+    }
+  }
+}
+
+/// Runs the jobs received on a connection in order, sending back the result of
+/// each one as it completes, until the connection is closed.
+///
+async fn handle_connection(stream: TcpStream, job_lock: &Mutex<()>) {
+  let (reader, mut writer) = stream.into_split();
+  let mut lines = BufReader::new(reader).lines();
+
+  while let Ok(Some(line)) = lines.next_line().await {
+    if line.trim().is_empty() {
+      continue;
+    }
+
+    let response = match run_job(&line, job_lock).await {
+      Ok(()) => serde_json::json!({ "success": true }),
+      Err(error) => serde_json::json!({ "success": false, "error": error }),
+    };
+
+    if writer
+      .write_all(format!("{response}\n").as_bytes())
+      .await
+      .is_err()
+    {
+      break;
+    }
+  }
+}
+
+/// Parses and runs a single job. Jobs are run one at a time because commands
+/// set global options such as whether output files are overwritten.
+///
+async fn run_job(line: &str, job_lock: &Mutex<()>) -> Result<(), String> {
+  let args: Vec<String> =
+    serde_json::from_str(line).map_err(|e| format!("Invalid job: {e}"))?;
+
+  let job = Job::try_parse_from(args).map_err(|e| e.to_string())?;
+
+  let _job_guard = job_lock.lock().await;
+
+  let result = AssertUnwindSafe(async {
+    match job.command {
+      JobCommand::GetPixelData(args) => get_pixel_data_command::run(args).await,
+      JobCommand::Modify(args) => modify_command::run(args).await,
+      JobCommand::DcmToJson(args) => dcm_to_json_command::run(args).await,
+    }
+  })
+  .catch_unwind()
+  .await;
+
+  match result {
+    Ok(Ok(())) => Ok(()),
+    _ => Err("Job failed, details were written to stderr".to_string()),
+  }
+}
@@ -6,13 +6,27 @@ mod utils;
 
 use std::path::PathBuf;
 
-use clap::{Parser, Subcommand};
+use clap::{CommandFactory, Parser, Subcommand, error::ErrorKind};
+use dcmfx::pixel_data::codec_stats::{self, CountingAllocator};
+#[cfg(feature = "pixel_data_native")]
+use dcmfx::pixel_data::simd_targets;
+use dcmfx::pixel_data::trace_events;
+
+#[cfg(feature = "pixel_data_native")]
+use args::max_simd_level_arg::MaxSimdLevelArg;
 
 use commands::{
-  dcm_to_json_command, get_pixel_data_command, json_to_dcm_command,
-  list_command, modify_command, print_command, rewrite_command,
+  bench_command, dcm_to_json_command, get_pixel_data_command,
+  json_to_dcm_command, list_command, modify_command, print_command,
+  rewrite_command, serve_command,
 };
 
+/// Counts allocations made while transcoding frames of pixel data so they can
+/// be included in the output of `--print-stats`.
+///
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
+
 #[derive(Parser)]
 #[command(
   name = "dcmfx",
@@ -23,14 +37,61 @@ use commands::{
 )]
 struct Cli {
   #[command(subcommand)]
-  command: Commands,
+  command: Option<Commands>,
 
   #[arg(
     long,
     default_value_t = false,
-    help = "Write timing and memory stats to stderr on exit"
+    help = "Write timing, memory, and codec stats to stderr on exit"
   )]
   print_stats: bool,
+
+  #[arg(
+    long,
+    value_name = "FILE",
+    help = "Record a timeline of the reading, transcoding, and writing done \
+      on each thread, and write it on exit to the given file in the Chrome \
+      trace event format. It can be viewed with Perfetto or chrome://tracing."
+  )]
+  trace: Option<PathBuf>,
+
+  #[arg(
+    long,
+    default_value_t = {num_cpus::get()},
+    help = "The total number of threads to use for processing. This budget is \
+      shared between input files processed concurrently, and the frames and \
+      codecs used for each of them."
+  )]
+  threads: usize,
+
+  #[arg(
+    long,
+    default_value_t = false,
+    help = "On machines with more than one NUMA node, e.g. multi-socket \
+      servers, split the thread budget evenly between the nodes and process \
+      each input file on a single node, with its threads bound to that \
+      node's CPUs. This avoids frames being decoded on one node and encoded \
+      on another, and keeps their memory local to the node."
+  )]
+  numa: bool,
+
+  #[cfg(feature = "pixel_data_native")]
+  #[arg(
+    long,
+    value_enum,
+    help = "The widest SIMD instruction sets that codecs may use. By default \
+      codecs use the widest ones the CPU supports."
+  )]
+  max_simd_level: Option<MaxSimdLevelArg>,
+
+  #[cfg(feature = "pixel_data_native")]
+  #[arg(
+    long,
+    default_value_t = false,
+    help = "Print the SIMD instruction set each codec uses on this CPU, then \
+      exit"
+  )]
+  print_codec_capabilities: bool,
 }
 
 #[derive(Subcommand)]
@@ -58,15 +119,55 @@ enum Commands {
     long_about = rewrite_command::LONG_ABOUT
   )]
   Rewrite(rewrite_command::RewriteArgs),
+
+  #[command(
+    about = serve_command::ABOUT,
+    long_about = serve_command::LONG_ABOUT
+  )]
+  Serve(serve_command::ServeArgs),
+
+  #[command(
+    about = bench_command::ABOUT,
+    long_about = bench_command::LONG_ABOUT
+  )]
+  Bench(bench_command::BenchArgs),
 }
 
 #[tokio::main(flavor = "multi_thread")]
 async fn main() {
   let cli = Cli::parse();
 
+  #[cfg(feature = "pixel_data_native")]
+  {
+    if let Some(max_simd_level) = cli.max_simd_level {
+      simd_targets::set_max_simd_level(max_simd_level.into());
+    }
+
+    if cli.print_codec_capabilities {
+      print_codec_capabilities();
+      return;
+    }
+  }
+
+  let Some(command) = cli.command else {
+    Cli::command()
+      .error(ErrorKind::MissingSubcommand, "A subcommand is required")
+      .exit();
+  };
+
   let started_at = std::time::Instant::now();
 
-  let r = match cli.command {
+  if cli.print_stats {
+    codec_stats::set_enabled(true);
+  }
+
+  if cli.trace.is_some() {
+    trace_events::set_enabled(true);
+  }
+
+  utils::cpu_budget::init(cli.threads, cli.numa);
+
+  let r = match command {
     Commands::GetPixelData(args) => get_pixel_data_command::run(args).await,
     Commands::Modify(args) => modify_command::run(args).await,
     Commands::Print(args) => print_command::run(args).await,
@@ -74,6 +175,8 @@ async fn main() {
     Commands::DcmToJson(args) => dcm_to_json_command::run(args).await,
     Commands::List(args) => list_command::run(args).await,
     Commands::Rewrite(args) => rewrite_command::run(args).await,
+    Commands::Serve(args) => serve_command::run(args).await,
+    Commands::Bench(args) => bench_command::run(args).await,
   };
 
   if cli.print_stats {
@@ -89,6 +192,18 @@ async fn main() {
 
     #[cfg(not(windows))]
     eprintln!("Peak memory usage: {peak_memory_mb:.0} MiB");
+
+    let codec_stats = codec_stats::snapshot();
+    if codec_stats.frame_count > 0 {
+      eprint!("{codec_stats}");
+    }
+  }
+
+  if let Some(trace) = cli.trace
+    && let Err(e) =
+      std::fs::write(&trace, trace_events::take_chrome_trace_json())
+  {
+    eprintln!("Error writing trace to \"{}\": {e}", trace.display());
   }
 
   if r.is_err() {
@@ -96,6 +211,18 @@ async fn main() {
   }
 }
 
+/// Prints the SIMD level cap and the SIMD instruction set that each codec uses
+/// on this CPU.
+///
+#[cfg(feature = "pixel_data_native")]
+fn print_codec_capabilities() {
+  println!("Max SIMD level: {:?}", simd_targets::max_simd_level());
+
+  for target in simd_targets::codec_simd_targets() {
+    println!("  {:<20}{}", target.codec, target.target);
+  }
+}
+
 #[cfg(not(windows))]
 fn get_peak_memory_usage() -> libc::c_long {
   let mut usage: libc::rusage = unsafe { std::mem::zeroed() };
@@ -0,0 +1,109 @@
+//! Shares a fixed budget of threads between the input files that are processed
+//! concurrently and the parallel work done for each of them, e.g. transcoding
+//! frames on worker threads and the threads used by codecs.
+//!
+//! Without this, every file in flight would size its own parallel work to the
+//! whole machine, which badly oversubscribes the CPU when many files are
+//! processed at once.
+//!
+//! On machines with more than one NUMA node the budget can optionally be split
+//! into one shard per node. Each node then gets its own worker pool, and each
+//! input is assigned to a node in turn so that all of its frames are decoded
+//! and encoded on that node.
+
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+static THREAD_BUDGET: AtomicUsize = AtomicUsize::new(1);
+
+static ACTIVE_TASK_COUNT: AtomicUsize = AtomicUsize::new(0);
+
+/// The number of NUMA nodes that inputs are shared between, which is zero when
+/// inputs aren't assigned to NUMA nodes.
+///
+static NUMA_NODE_COUNT: AtomicUsize = AtomicUsize::new(0);
+
+static NEXT_NUMA_NODE: AtomicUsize = AtomicUsize::new(0);
+
+/// Sets the total number of threads to use. When the `pixel_data_parallel`
+/// feature is enabled this also creates the worker pool that parallel work
+/// inside codecs and image conversions, including libjxl's, runs on.
+///
+/// If `numa` is true and there is more than one NUMA node then the threads are
+/// split evenly between the nodes, with a worker pool for each node, and
+/// inputs are assigned to nodes by [`next_numa_node()`].
+///
+pub fn init(thread_budget: usize, numa: bool) {
+  let thread_budget = thread_budget.max(1);
+
+  THREAD_BUDGET.store(thread_budget, Ordering::Relaxed);
+
+  let numa_node_count = if numa {
+    dcmfx::pixel_data::numa::node_count()
+  } else {
+    1
+  };
+
+  if numa_node_count > 1 {
+    NUMA_NODE_COUNT.store(numa_node_count, Ordering::Relaxed);
+  }
+
+  #[cfg(feature = "pixel_data_parallel")]
+  {
+    use dcmfx::pixel_data::worker_pool::{self, WorkerPool};
+    use std::sync::Arc;
+
+    if numa_node_count > 1 {
+      let threads_per_node = (thread_budget / numa_node_count).max(1);
+
+      worker_pool::set_shared_per_node(
+        (0..numa_node_count)
+          .map(|node| Arc::new(WorkerPool::new_on_node(threads_per_node, node)))
+          .collect(),
+      );
+    } else {
+      worker_pool::set_shared(Some(Arc::new(WorkerPool::new(thread_budget))));
+    }
+  }
+}
+
+/// Returns the NUMA node that the next input should be processed on, cycling
+/// through the nodes in turn. Returns `None` unless inputs are being assigned
+/// to NUMA nodes, see [`init()`].
+///
+pub fn next_numa_node() -> Option<usize> {
+  let numa_node_count = NUMA_NODE_COUNT.load(Ordering::Relaxed);
+  if numa_node_count == 0 {
+    return None;
+  }
+
+  Some(NEXT_NUMA_NODE.fetch_add(1, Ordering::Relaxed) % numa_node_count)
+}
+
+/// Marks the start of a task that processes a single input. The task is
+/// counted as active until the returned guard is dropped.
+///
+pub fn start_task() -> ActiveTask {
+  ACTIVE_TASK_COUNT.fetch_add(1, Ordering::Relaxed);
+
+  ActiveTask
+}
+
+/// Returns the number of threads the parallel work for a single input should
+/// use, which is an even share of the thread budget between the tasks that are
+/// currently active. This is at least one.
+///
+pub fn threads_per_task() -> usize {
+  let active_task_count = ACTIVE_TASK_COUNT.load(Ordering::Relaxed).max(1);
+
+  (THREAD_BUDGET.load(Ordering::Relaxed) / active_task_count).max(1)
+}
+
+/// A task that is counted as active by [`threads_per_task()`].
+///
+pub struct ActiveTask;
+
+impl Drop for ActiveTask {
+  fn drop(&mut self) {
+    ACTIVE_TASK_COUNT.fetch_sub(1, Ordering::Relaxed);
+  }
+}
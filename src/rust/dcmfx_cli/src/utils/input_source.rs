@@ -1,10 +1,28 @@
-use std::{path::PathBuf, sync::Arc};
+use std::{
+  ops::Range,
+  path::PathBuf,
+  sync::{Arc, Mutex},
+};
 
+use bytes::Bytes;
+use futures::{Stream, StreamExt, TryStreamExt};
 use object_store::{
   ObjectStore, ObjectStoreExt, path::Path as ObjectStorePath,
 };
 
-use dcmfx::p10::P10Error;
+use tokio::sync::mpsc;
+
+use dcmfx::{core::RcByteSlice, p10::P10Error};
+
+/// The largest gap between two byte ranges for which they are read using a
+/// single range request. See [`InputSource::read_ranges()`].
+///
+const MAX_RANGE_REQUEST_GAP: u64 = 1024 * 1024;
+
+/// The size beyond which byte ranges are not combined into a single range
+/// request. See [`InputSource::read_ranges()`].
+///
+const MAX_RANGE_REQUEST_SIZE: u64 = 16 * 1024 * 1024;
 
 /// Defines an input source for a CLI command that abstracts over the different
 /// locations input can come from.
@@ -20,6 +38,17 @@ pub enum InputSource {
     object_path: ObjectStorePath,
     specified_path: PathBuf,
   },
+
+  /// An input source that reads a part of a `multipart/related` HTTP
+  /// response, e.g. one instance of a DICOMweb WADO-RS retrieve. The part's
+  /// data is received as the response downloads, and can only be read once.
+  /// See [`crate::utils::multipart`].
+  HttpPart {
+    url: Arc<str>,
+    index: usize,
+    data: Arc<Mutex<Option<mpsc::Receiver<std::io::Result<Bytes>>>>>,
+    specified_path: PathBuf,
+  },
 }
 
 impl core::fmt::Display for InputSource {
@@ -29,6 +58,9 @@ impl core::fmt::Display for InputSource {
       InputSource::Object { specified_path, .. } => {
         write!(f, "{}", specified_path.display())
       }
+      InputSource::HttpPart { url, index, .. } => {
+        write!(f, "{url} (part {index})")
+      }
     }
   }
 }
@@ -41,6 +73,23 @@ impl InputSource {
     match self {
       InputSource::Stdin => PathBuf::from("-"),
       InputSource::Object { specified_path, .. } => specified_path.clone(),
+      InputSource::HttpPart { specified_path, .. } => specified_path.clone(),
+    }
+  }
+
+  /// Returns the path on the local filesystem of this input source, if it is
+  /// a local file.
+  ///
+  pub fn local_path(&self) -> Option<PathBuf> {
+    match self {
+      InputSource::Stdin | InputSource::HttpPart { .. } => None,
+      InputSource::Object {
+        object_store,
+        object_path,
+        ..
+      } => {
+        crate::utils::object_store::local_file_path(object_store, object_path)
+      }
     }
   }
 
@@ -48,7 +97,7 @@ impl InputSource {
   ///
   pub async fn open_read_stream(
     &self,
-  ) -> Result<Box<dyn dcmfx::p10::IoAsyncRead>, P10Error> {
+  ) -> Result<Box<dyn dcmfx::p10::IoAsyncRead + Send>, P10Error> {
     match self {
       InputSource::Stdin => Ok(Box::new(tokio::io::stdin())),
 
@@ -57,6 +106,22 @@ impl InputSource {
         object_path,
         ..
       } => {
+        // Read local files using io_uring when it's available
+        #[cfg(target_os = "linux")]
+        if let Some(path) = self.local_path()
+          && crate::utils::io_uring::is_available()
+        {
+          let stream =
+            crate::utils::io_uring::open_file(&path)
+              .await
+              .map_err(|e| P10Error::FileError {
+                when: "Opening read stream".to_string(),
+                details: e.to_string(),
+              })?;
+
+          return Ok(Box::new(stream));
+        }
+
         let get_result =
           object_store.get(&object_path.clone()).await.map_err(|e| {
             P10Error::FileError {
@@ -71,6 +136,145 @@ impl InputSource {
 
         Ok(Box::new(stream))
       }
+
+      InputSource::HttpPart { data, .. } => {
+        let Some(receiver) = data.lock().unwrap().take() else {
+          return Err(P10Error::FileError {
+            when: "Opening read stream".to_string(),
+            details: "Multipart part has already been read".to_string(),
+          });
+        };
+
+        let stream = futures::stream::unfold(receiver, |mut receiver| async {
+          receiver.recv().await.map(|chunk| (chunk, receiver))
+        });
+
+        Ok(Box::new(tokio_util::io::StreamReader::new(Box::pin(
+          stream,
+        ))))
+      }
+    }
+  }
+  /// Returns whether this input source supports reading specific byte ranges
+  /// with [`Self::read_ranges()`].
+  ///
+  pub fn supports_range_reads(&self) -> bool {
+    matches!(self, InputSource::Object { .. })
+  }
+
+  /// Returns the total size of the input source in bytes.
+  ///
+  pub async fn size(&self) -> Result<u64, P10Error> {
+    match self {
+      InputSource::Stdin => Err(P10Error::FileError {
+        when: "Getting input size".to_string(),
+        details: "Size of stdin is not known".to_string(),
+      }),
+
+      InputSource::HttpPart { .. } => Err(P10Error::FileError {
+        when: "Getting input size".to_string(),
+        details: "Size of multipart part is not known".to_string(),
+      }),
+
+      InputSource::Object {
+        object_store,
+        object_path,
+        ..
+      } => object_store
+        .head(object_path)
+        .await
+        .map(|object_meta| object_meta.size)
+        .map_err(|e| P10Error::FileError {
+          when: "Getting input size".to_string(),
+          details: e.to_string(),
+        }),
+    }
+  }
+
+  /// Reads the given byte ranges from the input source using range requests,
+  /// returning a stream of their data in the same order as the ranges. Up to
+  /// `concurrency` range requests are run at once, and nearby ranges are
+  /// combined into a single range request.
+  ///
+  /// Only input sources for which [`Self::supports_range_reads()`] is true
+  /// can be read in this way.
+  ///
+  pub fn read_ranges(
+    &self,
+    ranges: &[Range<u64>],
+    concurrency: usize,
+  ) -> impl Stream<Item = Result<RcByteSlice, P10Error>> + use<> {
+    let requests = crate::utils::object_store::coalesce_ranges(
+      ranges,
+      MAX_RANGE_REQUEST_GAP,
+      MAX_RANGE_REQUEST_SIZE,
+    );
+
+    let input_source = self.clone();
+
+    futures::stream::iter(requests)
+      .map(move |(request, request_ranges)| {
+        let input_source = input_source.clone();
+
+        async move {
+          let data = input_source.read_range(request.clone()).await?;
+
+          // Split the request's data into the ranges it contains
+          let slices = request_ranges.into_iter().map(move |range| {
+            Ok(data.slice(
+              (range.start - request.start) as usize,
+              (range.end - request.start) as usize,
+            ))
+          });
+
+          Ok::<_, P10Error>(futures::stream::iter(slices))
+        }
+      })
+      .buffered(concurrency.max(1))
+      .try_flatten()
+  }
+
+  /// Reads a single byte range from the input source.
+  ///
+  async fn read_range(
+    &self,
+    range: Range<u64>,
+  ) -> Result<RcByteSlice, P10Error> {
+    match self {
+      InputSource::Stdin | InputSource::HttpPart { .. } => {
+        Err(P10Error::FileError {
+          when: "Reading byte range".to_string(),
+          details: format!("Byte ranges can't be read from {self}"),
+        })
+      }
+
+      InputSource::Object {
+        object_store,
+        object_path,
+        ..
+      } => {
+        let bytes = object_store
+          .get_range(object_path, range.clone())
+          .await
+          .map_err(|e| P10Error::FileError {
+            when: "Reading byte range".to_string(),
+            details: e.to_string(),
+          })?;
+
+        // Short reads happen when the range extends past the end of the object
+        if bytes.len() as u64 != range.end - range.start {
+          return Err(P10Error::FileError {
+            when: "Reading byte range".to_string(),
+            details: format!(
+              "Expected {} bytes but received {} bytes",
+              range.end - range.start,
+              bytes.len()
+            ),
+          });
+        }
+
+        Ok(RcByteSlice::from_owner(bytes))
+      }
     }
   }
 }
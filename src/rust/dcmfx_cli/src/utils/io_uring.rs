@@ -0,0 +1,660 @@
+//! Local file I/O using Linux's io_uring interface.
+//!
+//! A single worker thread owns an io_uring and services open, read, write,
+//! close, and rename operations sent to it by any number of async tasks. All
+//! operations that are pending when the worker wakes are submitted to the
+//! kernel with one system call, so when many small files are being read or
+//! written concurrently their opens, reads, writes, and closes are batched
+//! together rather than each costing a system call on a blocking thread.
+//!
+//! Reads and writes go through a fixed set of buffers that are registered with
+//! the kernel once and then reused across all files.
+
+use std::{
+  collections::VecDeque,
+  ffi::CString,
+  os::{fd::RawFd, unix::ffi::OsStrExt},
+  path::{Path, PathBuf},
+  pin::Pin,
+  sync::{
+    LazyLock,
+    atomic::{AtomicBool, AtomicU64, Ordering},
+    mpsc,
+  },
+};
+
+use futures::Stream;
+use io_uring::{IoUring, opcode, squeue, types};
+use tokio::sync::oneshot;
+
+use super::output_target::PartAsyncWrite;
+
+/// The size of each registered buffer. This is also the size of each read,
+/// and the size of the parts that output files are written in.
+///
+const BUFFER_SIZE: usize = 256 * 1024;
+
+/// The number of registered buffers, which limits how many reads and writes
+/// can be in flight at once.
+///
+const BUFFER_COUNT: usize = 64;
+
+/// The number of submission queue entries in the io_uring, which limits how
+/// many operations can be in flight at once.
+///
+const RING_ENTRIES: u32 = 256;
+
+/// The user data of the read on the eventfd used to wake the worker.
+///
+const WAKE_USER_DATA: u64 = u64::MAX;
+
+/// The io_uring worker, or `None` if io_uring isn't available, e.g. because
+/// the kernel doesn't support it or it's been disabled.
+///
+static WORKER: LazyLock<Option<WorkerHandle>> =
+  LazyLock::new(|| start_worker().ok());
+
+/// Set when the io_uring worker has stopped because of an error. From then on
+/// io_uring is reported as unavailable so that callers fall back to Tokio's
+/// file I/O.
+///
+static WORKER_FAILED: AtomicBool = AtomicBool::new(false);
+
+/// Counter used to give each temporary output file a unique name.
+///
+static TEMPORARY_FILE_COUNT: AtomicU64 = AtomicU64::new(0);
+
+/// Returns whether io_uring is available for reading and writing local files.
+///
+pub fn is_available() -> bool {
+  WORKER.is_some() && !WORKER_FAILED.load(Ordering::Acquire)
+}
+
+/// Opens a local file and returns an async read stream for its content.
+///
+pub async fn open_file(
+  path: &Path,
+) -> std::io::Result<impl tokio::io::AsyncRead + Send + Unpin + use<>> {
+  let file = File::open(path, libc::O_RDONLY).await?;
+
+  type Chunk = std::io::Result<std::io::Cursor<Vec<u8>>>;
+
+  let chunks: Pin<Box<dyn Stream<Item = Chunk> + Send>> =
+    Box::pin(async_stream::try_stream! {
+      let mut offset = 0;
+
+      loop {
+        let data = file.read_at(offset, BUFFER_SIZE).await?;
+        if data.is_empty() {
+          break;
+        }
+
+        offset += data.len() as u64;
+
+        yield std::io::Cursor::new(data);
+      }
+
+      file.close().await?;
+    });
+
+  Ok(tokio_util::io::StreamReader::new(chunks))
+}
+
+/// Creates a local file and returns an async write stream for it. Content is
+/// written to a temporary file alongside the final one that is renamed into
+/// place when the stream is shut down, so an incomplete file is never left at
+/// the final path. Missing parent directories are created.
+///
+pub async fn create_file(path: &Path) -> std::io::Result<PartAsyncWrite> {
+  let mut temporary_path = path.as_os_str().to_owned();
+  temporary_path.push(format!(
+    "#{}-{}",
+    std::process::id(),
+    TEMPORARY_FILE_COUNT.fetch_add(1, Ordering::Relaxed)
+  ));
+  let temporary_path = PathBuf::from(temporary_path);
+
+  let flags = libc::O_WRONLY | libc::O_CREAT | libc::O_TRUNC;
+
+  let file = match File::open(&temporary_path, flags).await {
+    Err(e) if e.kind() == std::io::ErrorKind::NotFound => {
+      if let Some(parent) = path.parent() {
+        tokio::fs::create_dir_all(parent).await?;
+      }
+
+      File::open(&temporary_path, flags).await?
+    }
+
+    result => result?,
+  };
+
+  let path = path.to_path_buf();
+
+  Ok(PartAsyncWrite::new(BUFFER_SIZE, |mut rx| async move {
+    let cleanup_path = temporary_path.clone();
+
+    let result = async move {
+      let mut offset = 0;
+
+      while let Some(data) = rx.recv().await {
+        match data {
+          Some(data) => {
+            if !data.is_empty() {
+              let length = data.len() as u64;
+              file.write_at(offset, data).await?;
+              offset += length;
+            }
+          }
+
+          None => {
+            file.close().await?;
+            return rename(&temporary_path, &path).await;
+          }
+        }
+      }
+
+      // The channel was closed before a `None` was received to indicate the
+      // end of the parts, so the write was abandoned
+      Err(std::io::Error::other("Write aborted"))
+    }
+    .await;
+
+    if result.is_err() {
+      let _ = tokio::fs::remove_file(&cleanup_path).await;
+    }
+
+    result
+  }))
+}
+
+/// A file opened through the io_uring worker. The file descriptor is closed
+/// on drop if [`File::close()`] wasn't called.
+///
+struct File {
+  fd: RawFd,
+  closed: bool,
+}
+
+impl File {
+  async fn open(path: &Path, flags: i32) -> std::io::Result<Self> {
+    let path = path_to_c_string(path)?;
+
+    let fd = submit(|reply| Operation::Open { path, flags, reply }).await?;
+
+    Ok(Self { fd, closed: false })
+  }
+
+  async fn read_at(
+    &self,
+    offset: u64,
+    length: usize,
+  ) -> std::io::Result<Vec<u8>> {
+    let fd = self.fd;
+
+    submit(|reply| Operation::Read {
+      fd,
+      offset,
+      length,
+      reply,
+    })
+    .await
+  }
+
+  async fn write_at(&self, offset: u64, data: Vec<u8>) -> std::io::Result<()> {
+    let fd = self.fd;
+
+    submit(|reply| Operation::Write {
+      fd,
+      offset,
+      data,
+      reply,
+    })
+    .await
+  }
+
+  async fn close(mut self) -> std::io::Result<()> {
+    let fd = self.fd;
+    self.closed = true;
+
+    submit(|reply| Operation::Close { fd, reply }).await
+  }
+}
+
+impl Drop for File {
+  fn drop(&mut self) {
+    if !self.closed {
+      unsafe { libc::close(self.fd) };
+    }
+  }
+}
+
+async fn rename(from: &Path, to: &Path) -> std::io::Result<()> {
+  let from = path_to_c_string(from)?;
+  let to = path_to_c_string(to)?;
+
+  submit(|reply| Operation::Rename { from, to, reply }).await
+}
+
+fn path_to_c_string(path: &Path) -> std::io::Result<CString> {
+  CString::new(path.as_os_str().as_bytes())
+    .map_err(|e| std::io::Error::new(std::io::ErrorKind::InvalidInput, e))
+}
+
+/// Sends an operation to the io_uring worker and waits for its result.
+///
+async fn submit<T>(
+  operation: impl FnOnce(Reply<T>) -> Operation,
+) -> std::io::Result<T> {
+  let Some(worker) = WORKER.as_ref().filter(|_| is_available()) else {
+    return Err(std::io::Error::from(std::io::ErrorKind::Unsupported));
+  };
+
+  let (reply, result) = oneshot::channel();
+
+  worker
+    .operations
+    .send(operation(reply))
+    .map_err(|_| std::io::Error::other("io_uring worker ended"))?;
+
+  // Wake the worker so it submits the new operation
+  let value = 1u64;
+  unsafe {
+    libc::write(
+      worker.wake_fd,
+      &value as *const u64 as *const libc::c_void,
+      std::mem::size_of::<u64>(),
+    )
+  };
+
+  result
+    .await
+    .map_err(|_| std::io::Error::other("io_uring worker ended"))?
+}
+
+type Reply<T> = oneshot::Sender<std::io::Result<T>>;
+
+/// An operation performed by the io_uring worker.
+///
+enum Operation {
+  Open {
+    path: CString,
+    flags: i32,
+    reply: Reply<RawFd>,
+  },
+  Read {
+    fd: RawFd,
+    offset: u64,
+    length: usize,
+    reply: Reply<Vec<u8>>,
+  },
+  Write {
+    fd: RawFd,
+    offset: u64,
+    data: Vec<u8>,
+    reply: Reply<()>,
+  },
+  Close {
+    fd: RawFd,
+    reply: Reply<()>,
+  },
+  Rename {
+    from: CString,
+    to: CString,
+    reply: Reply<()>,
+  },
+}
+
+impl Operation {
+  fn needs_buffer(&self) -> bool {
+    matches!(self, Self::Read { .. } | Self::Write { .. })
+  }
+}
+
+struct WorkerHandle {
+  operations: mpsc::Sender<Operation>,
+  wake_fd: RawFd,
+}
+
+/// Creates the io_uring and registers its buffers, then starts the worker
+/// thread that services operations on it.
+///
+fn start_worker() -> std::io::Result<WorkerHandle> {
+  let ring = IoUring::new(RING_ENTRIES)?;
+
+  let mut buffers: Vec<Box<[u8]>> = (0..BUFFER_COUNT)
+    .map(|_| vec![0u8; BUFFER_SIZE].into_boxed_slice())
+    .collect();
+
+  let iovecs: Vec<libc::iovec> = buffers
+    .iter_mut()
+    .map(|buffer| libc::iovec {
+      iov_base: buffer.as_mut_ptr() as *mut libc::c_void,
+      iov_len: buffer.len(),
+    })
+    .collect();
+
+  // The buffers are heap allocations owned by the worker for as long as the
+  // io_uring exists, so their addresses remain valid
+  unsafe { ring.submitter().register_buffers(&iovecs)? };
+
+  let wake_fd = unsafe { libc::eventfd(0, libc::EFD_CLOEXEC) };
+  if wake_fd < 0 {
+    return Err(std::io::Error::last_os_error());
+  }
+
+  let (tx, rx) = mpsc::channel();
+
+  let worker = Worker {
+    ring,
+    buffers,
+    free_buffers: (0..BUFFER_COUNT).collect(),
+    operations: rx,
+    waiting: VecDeque::new(),
+    in_flight: vec![],
+    free_slots: vec![],
+    wake_fd,
+    wake_value: Box::new(0),
+  };
+
+  std::thread::Builder::new()
+    .name("io_uring".to_string())
+    .spawn(move || worker.run())?;
+
+  Ok(WorkerHandle {
+    operations: tx,
+    wake_fd,
+  })
+}
+
+/// An operation that has been submitted to the io_uring, along with the index
+/// of the registered buffer it's using, and for writes how many bytes have
+/// been written so far.
+///
+struct InFlightOperation {
+  operation: Operation,
+  buffer_index: Option<usize>,
+  written: usize,
+}
+
+struct Worker {
+  ring: IoUring,
+
+  buffers: Vec<Box<[u8]>>,
+  free_buffers: Vec<usize>,
+
+  operations: mpsc::Receiver<Operation>,
+
+  // Operations that are waiting for a free buffer or a free ring entry
+  waiting: VecDeque<Operation>,
+
+  // Submitted operations, indexed by the user data of their ring entry
+  in_flight: Vec<Option<InFlightOperation>>,
+  free_slots: Vec<usize>,
+
+  wake_fd: RawFd,
+  wake_value: Box<u64>,
+}
+
+impl Worker {
+  fn run(mut self) {
+    self.push_wake_read();
+
+    loop {
+      // Gather newly received operations behind the ones already waiting
+      self.waiting.extend(self.operations.try_iter());
+
+      // Start as many waiting operations as there are resources for
+      while let Some(operation) = self.waiting.front() {
+        let in_flight_count = self.in_flight.len() - self.free_slots.len();
+
+        if in_flight_count >= RING_ENTRIES as usize - 1
+          || (operation.needs_buffer() && self.free_buffers.is_empty())
+        {
+          break;
+        }
+
+        let operation = self.waiting.pop_front().unwrap();
+        self.start(operation);
+      }
+
+      // Submit all new entries with a single system call, and wait for at
+      // least one to complete
+      if let Err(e) = self.ring.submit_and_wait(1)
+        && e.kind() != std::io::ErrorKind::Interrupted
+      {
+        eprintln!("io_uring submit failed: {e}");
+        self.fail(e);
+        return;
+      }
+
+      let completions: Vec<(u64, i32)> = self
+        .ring
+        .completion()
+        .map(|entry| (entry.user_data(), entry.result()))
+        .collect();
+
+      for (user_data, result) in completions {
+        if user_data == WAKE_USER_DATA {
+          self.push_wake_read();
+        } else {
+          self.complete(user_data as usize, result);
+        }
+      }
+    }
+  }
+
+  /// Marks the worker as failed so that no further operations are sent to it,
+  /// then replies to all operations that are waiting or in flight with the
+  /// given error.
+  ///
+  fn fail(mut self, error: std::io::Error) {
+    WORKER_FAILED.store(true, Ordering::Release);
+
+    // Operations sent after this point have their reply dropped along with
+    // the channel, which their senders see as the worker having ended
+    self.waiting.extend(self.operations.try_iter());
+
+    let operations = self
+      .waiting
+      .drain(..)
+      .chain(self.in_flight.drain(..).flatten().map(|op| op.operation));
+
+    for operation in operations {
+      let error = std::io::Error::new(error.kind(), error.to_string());
+
+      match operation {
+        Operation::Open { reply, .. } => {
+          let _ = reply.send(Err(error));
+        }
+        Operation::Read { reply, .. } => {
+          let _ = reply.send(Err(error));
+        }
+        Operation::Write { reply, .. }
+        | Operation::Close { reply, .. }
+        | Operation::Rename { reply, .. } => {
+          let _ = reply.send(Err(error));
+        }
+      }
+    }
+
+    // In-flight reads may still be written into the registered buffers and
+    // the eventfd value until the kernel has torn down the io_uring, which
+    // happens asynchronously after it's dropped, so they're leaked rather
+    // than freed
+    std::mem::forget(std::mem::take(&mut self.buffers));
+    Box::leak(std::mem::take(&mut self.wake_value));
+  }
+
+  /// Assigns an operation a slot and a buffer if it needs one, and pushes its
+  /// entry onto the submission queue.
+  ///
+  fn start(&mut self, operation: Operation) {
+    let buffer_index = if operation.needs_buffer() {
+      self.free_buffers.pop()
+    } else {
+      None
+    };
+
+    let in_flight_operation = Some(InFlightOperation {
+      operation,
+      buffer_index,
+      written: 0,
+    });
+
+    let slot = match self.free_slots.pop() {
+      Some(slot) => {
+        self.in_flight[slot] = in_flight_operation;
+        slot
+      }
+
+      None => {
+        self.in_flight.push(in_flight_operation);
+        self.in_flight.len() - 1
+      }
+    };
+
+    self.push_entry(slot);
+  }
+
+  /// Pushes the submission queue entry for the in-flight operation in the
+  /// given slot. For writes, the next part of the data is first copied into
+  /// the operation's registered buffer.
+  ///
+  fn push_entry(&mut self, slot: usize) {
+    let in_flight_operation = self.in_flight[slot].as_ref().unwrap();
+    let buffer_index = in_flight_operation.buffer_index.unwrap_or(0);
+    let buffer = &mut self.buffers[buffer_index];
+
+    let entry = match &in_flight_operation.operation {
+      Operation::Open { path, flags, .. } => {
+        opcode::OpenAt::new(types::Fd(libc::AT_FDCWD), path.as_ptr())
+          .flags(*flags | libc::O_CLOEXEC)
+          .mode(0o644)
+          .build()
+      }
+
+      Operation::Read {
+        fd, offset, length, ..
+      } => opcode::ReadFixed::new(
+        types::Fd(*fd),
+        buffer.as_mut_ptr(),
+        (*length).min(BUFFER_SIZE) as u32,
+        buffer_index as u16,
+      )
+      .offset(*offset)
+      .build(),
+
+      Operation::Write {
+        fd, offset, data, ..
+      } => {
+        let written = in_flight_operation.written;
+        let length = (data.len() - written).min(BUFFER_SIZE);
+
+        buffer[..length].copy_from_slice(&data[written..written + length]);
+
+        opcode::WriteFixed::new(
+          types::Fd(*fd),
+          buffer.as_ptr(),
+          length as u32,
+          buffer_index as u16,
+        )
+        .offset(*offset + written as u64)
+        .build()
+      }
+
+      Operation::Close { fd, .. } => opcode::Close::new(types::Fd(*fd)).build(),
+
+      Operation::Rename { from, to, .. } => opcode::RenameAt::new(
+        types::Fd(libc::AT_FDCWD),
+        from.as_ptr(),
+        types::Fd(libc::AT_FDCWD),
+        to.as_ptr(),
+      )
+      .build(),
+    };
+
+    self.push(entry.user_data(slot as u64));
+  }
+
+  /// Pushes a read on the eventfd that completes when new operations are sent
+  /// to the worker.
+  ///
+  fn push_wake_read(&mut self) {
+    let entry = opcode::Read::new(
+      types::Fd(self.wake_fd),
+      &mut *self.wake_value as *mut u64 as *mut u8,
+      std::mem::size_of::<u64>() as u32,
+    )
+    .build()
+    .user_data(WAKE_USER_DATA);
+
+    self.push(entry);
+  }
+
+  fn push(&mut self, entry: squeue::Entry) {
+    // The memory referenced by entries is owned by the worker until their
+    // completion is received. If the submission queue is full then submit
+    // its entries to make room.
+    while unsafe { self.ring.submission().push(&entry) }.is_err() {
+      let _ = self.ring.submit();
+    }
+  }
+
+  /// Handles the completion of the in-flight operation in the given slot.
+  /// Partial writes are resubmitted for the remaining data, and all other
+  /// operations send their result back.
+  ///
+  fn complete(&mut self, slot: usize, result: i32) {
+    let mut in_flight_operation = self.in_flight[slot].take().unwrap();
+
+    if let Operation::Write { data, .. } = &in_flight_operation.operation
+      && result > 0
+      && in_flight_operation.written + (result as usize) < data.len()
+    {
+      in_flight_operation.written += result as usize;
+      self.in_flight[slot] = Some(in_flight_operation);
+      self.push_entry(slot);
+      return;
+    }
+
+    self.free_slots.push(slot);
+
+    let result = if result < 0 {
+      Err(std::io::Error::from_raw_os_error(-result))
+    } else {
+      Ok(result as usize)
+    };
+
+    match in_flight_operation.operation {
+      Operation::Open { reply, .. } => {
+        // Close the file if the task that opened it has gone away
+        if let Err(Ok(fd)) = reply.send(result.map(|fd| fd as RawFd)) {
+          unsafe { libc::close(fd) };
+        }
+      }
+
+      Operation::Read { reply, .. } => {
+        let buffer = &self.buffers[in_flight_operation.buffer_index.unwrap()];
+        let _ = reply.send(result.map(|length| buffer[..length].to_vec()));
+      }
+
+      Operation::Write { reply, .. } => {
+        let _ = reply.send(result.and_then(|length| {
+          if length == 0 {
+            Err(std::io::Error::from(std::io::ErrorKind::WriteZero))
+          } else {
+            Ok(())
+          }
+        }));
+      }
+
+      Operation::Close { reply, .. } | Operation::Rename { reply, .. } => {
+        let _ = reply.send(result.map(|_| ()));
+      }
+    }
+
+    if let Some(buffer_index) = in_flight_operation.buffer_index {
+      self.free_buffers.push(buffer_index);
+    }
+  }
+}
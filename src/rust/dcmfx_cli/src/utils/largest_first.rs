@@ -0,0 +1,158 @@
+//! Reorders inputs so that the largest are processed first.
+//!
+//! Inputs are otherwise processed in the order they're listed, so a few very
+//! large inputs near the end of a batch can leave most of the machine idle
+//! while they finish. Starting the largest inputs first means the batch ends
+//! on small inputs instead, and the threads freed up as inputs finish go to
+//! the large inputs still in flight, see [`super::cpu_budget`].
+
+use std::{cmp::Ordering, collections::BinaryHeap, pin::Pin};
+
+use futures::{Stream, StreamExt};
+
+use crate::utils::InputSource;
+
+/// The maximum number of inputs that are read ahead of the one being started
+/// and ordered by size. Inputs further ahead than this are only ordered
+/// amongst themselves.
+///
+const WINDOW_SIZE: usize = 10_000;
+
+/// The number of input sizes that are requested at once.
+///
+const SIZE_REQUEST_CONCURRENCY: usize = 32;
+
+/// Returns the passed inputs reordered so that the largest are first. The
+/// inputs are read ahead and their sizes requested, which is a metadata
+/// request for objects in an object store, up to [`WINDOW_SIZE`] inputs at a
+/// time. Inputs of the same size keep their order.
+///
+/// Inputs that don't have a known size, i.e. stdin and the parts of HTTP
+/// multipart responses, are passed through as soon as they arrive because
+/// they can only be read in the order they're received.
+///
+/// When `task_count` is one the order of the inputs doesn't affect how long
+/// they take to process, so they're passed through unchanged.
+///
+pub fn largest_first(
+  inputs: Pin<Box<dyn Stream<Item = InputSource> + Send>>,
+  task_count: usize,
+) -> Pin<Box<dyn Stream<Item = InputSource> + Send>> {
+  if task_count <= 1 {
+    return inputs;
+  }
+
+  let mut sized_inputs = inputs
+    .enumerate()
+    .map(|(index, input_source)| async move {
+      let size = match input_source {
+        InputSource::Object { .. } => input_source.size().await.ok(),
+        InputSource::Stdin | InputSource::HttpPart { .. } => None,
+      };
+
+      (index, size, input_source)
+    })
+    .buffer_unordered(SIZE_REQUEST_CONCURRENCY);
+
+  Box::pin(async_stream::stream! {
+    let mut queue = BinaryHeap::new();
+    let mut is_exhausted = false;
+
+    loop {
+      while !is_exhausted && queue.len() < WINDOW_SIZE {
+        match sized_inputs.next().await {
+          Some((index, Some(size), input_source)) => {
+            queue.push(QueuedInput { size, index, input_source });
+          }
+
+          Some((_, None, input_source)) => yield input_source,
+
+          None => is_exhausted = true,
+        }
+      }
+
+      match queue.pop() {
+        Some(queued_input) => yield queued_input.input_source,
+        None => break,
+      }
+    }
+  })
+}
+
+/// An input waiting to be started, ordered so that larger inputs come first,
+/// and then inputs that were listed earlier.
+///
+struct QueuedInput {
+  size: u64,
+  index: usize,
+  input_source: InputSource,
+}
+
+impl Ord for QueuedInput {
+  fn cmp(&self, other: &Self) -> Ordering {
+    self
+      .size
+      .cmp(&other.size)
+      .then_with(|| other.index.cmp(&self.index))
+  }
+}
+
+impl PartialOrd for QueuedInput {
+  fn partial_cmp(&self, other: &Self) -> Option<Ordering> {
+    Some(self.cmp(other))
+  }
+}
+
+impl PartialEq for QueuedInput {
+  fn eq(&self, other: &Self) -> bool {
+    self.cmp(other) == Ordering::Equal
+  }
+}
+
+impl Eq for QueuedInput {}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  use std::{path::PathBuf, sync::Arc};
+
+  use object_store::{ObjectStoreExt, memory::InMemory, path::Path};
+
+  #[tokio::test]
+  async fn largest_first_order() {
+    let object_store = Arc::new(InMemory::new());
+
+    let mut inputs = vec![];
+    for (name, size) in [("a", 10), ("b", 30), ("c", 20), ("d", 30)] {
+      let object_path = Path::from(name);
+
+      object_store
+        .put(&object_path, vec![0u8; size].into())
+        .await
+        .unwrap();
+
+      inputs.push(InputSource::Object {
+        object_store: object_store.clone(),
+        object_path,
+        specified_path: PathBuf::from(name),
+      });
+    }
+
+    let names = |inputs: Vec<InputSource>| {
+      inputs.iter().map(|i| i.to_string()).collect::<Vec<_>>()
+    };
+
+    let stream = futures::stream::iter(inputs.clone()).boxed();
+    assert_eq!(
+      names(largest_first(stream, 4).collect::<Vec<_>>().await),
+      ["b", "d", "c", "a"]
+    );
+
+    let stream = futures::stream::iter(inputs).boxed();
+    assert_eq!(
+      names(largest_first(stream, 1).collect::<Vec<_>>().await),
+      ["a", "b", "c", "d"]
+    );
+  }
+}
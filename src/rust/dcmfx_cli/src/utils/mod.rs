@@ -1,17 +1,31 @@
+pub mod cpu_budget;
 pub mod input_source;
+#[cfg(target_os = "linux")]
+pub mod io_uring;
+pub mod largest_first;
 pub mod mp4_encoder;
+pub mod multipart;
 pub mod object_store;
 pub mod output_target;
+pub mod p10_header;
+pub mod stripe_image_encoder;
+pub mod stripe_image_resizer;
+pub mod work_leases;
 
 pub use input_source::InputSource;
+pub use largest_first::largest_first;
 pub use output_target::OutputTarget;
 
 use std::path::{Component, Path, PathBuf};
 
 use futures::{TryStreamExt, stream::StreamExt};
 
+static EXIT_ENDS_JOB: std::sync::atomic::AtomicBool =
+  std::sync::atomic::AtomicBool::new(false);
+
 /// Runs tasks concurrently up to the specified task count, passing each item
-/// from the given stream to the provided async body function.
+/// from the given stream to the provided async body function. Each running
+/// task is counted as active by [`cpu_budget::threads_per_task()`].
 ///
 /// Returns an error as soon as any of the tasks return an error.
 ///
@@ -24,7 +38,10 @@ where
   InputStream: futures::stream::Stream<Item = Item>,
 {
   inputs
-    .map(async |i| body_func(i).await)
+    .map(async |i| {
+      let _active_task = cpu_budget::start_task();
+      body_func(i).await
+    })
     .buffer_unordered(task_count.max(1))
     .try_collect::<()>()
     .await
@@ -64,7 +81,16 @@ pub fn normalize_path<P: AsRef<Path>>(input: P) -> PathBuf {
   normalized_path
 }
 
-/// Exits the process with an error message and non-zero exit code.
+/// Sets whether [`exit_with_error()`] ends the current job rather than the
+/// whole process. This is used by `dcmfx serve`, which catches the unwind and
+/// reports the job as failed.
+///
+pub fn set_exit_ends_job(exit_ends_job: bool) {
+  EXIT_ENDS_JOB.store(exit_ends_job, std::sync::atomic::Ordering::Relaxed);
+}
+
+/// Exits the process with an error message and non-zero exit code, or ends the
+/// current job if [`set_exit_ends_job()`] is enabled.
 ///
 pub fn exit_with_error<E: std::fmt::Display>(message: &str, details: E) -> ! {
   let mut lines = vec![];
@@ -86,5 +112,9 @@ pub fn exit_with_error<E: std::fmt::Display>(message: &str, details: E) -> ! {
     );
   }
 
+  if EXIT_ENDS_JOB.load(std::sync::atomic::Ordering::Relaxed) {
+    std::panic::resume_unwind(Box::new(()));
+  }
+
   std::process::exit(1);
 }
@@ -2,15 +2,26 @@ use std::process::ExitStatus;
 
 use crate::utils::output_target::OutputTarget;
 use clap::ValueEnum;
-use tokio::{io::AsyncWriteExt, task::JoinHandle};
+use tokio::{io::AsyncWriteExt, sync::mpsc, task::JoinHandle};
 
 /// Converts a stream of RGB or Luma frames to a fragmented MP4 video stream.
 ///
+/// Frames are written to FFmpeg by a separate task that is fed through a
+/// bounded queue, so the next frame can be decoded and rendered while FFmpeg
+/// reads and encodes the previous ones.
+///
 pub struct Mp4Encoder {
-  ffmpeg_stdin: Option<tokio::process::ChildStdin>,
+  frame_sender: Option<mpsc::Sender<image::DynamicImage>>,
+  frame_writer_join_handle: Option<JoinHandle<Result<(), String>>>,
   join_handle: Option<JoinHandle<Result<ExitStatus, String>>>,
 }
 
+/// The maximum number of frames that can be queued for writing to FFmpeg.
+/// Adding a frame waits when the queue is full, which limits memory use when
+/// frames are rendered faster than they can be encoded.
+///
+const FRAME_QUEUE_SIZE: usize = 4;
+
 impl Mp4Encoder {
   /// Initializes MP4 encoding to the specified output target.
   ///
@@ -111,7 +122,7 @@ impl Mp4Encoder {
         .map_err(|e| e.to_string())?;
 
     // Access the FFmpeg stdin/stdout streams
-    let ffmpeg_stdin = ffmpeg_child_process
+    let mut ffmpeg_stdin = ffmpeg_child_process
       .stdin
       .take()
       .expect("Failed to open FFmpeg stdin");
@@ -140,8 +151,25 @@ impl Mp4Encoder {
       ffmpeg_child_process.wait().await.map_err(|e| e.to_string())
     });
 
+    // Spawn an async task that writes queued frames to FFmpeg stdin, and
+    // closes it once the queue is closed
+    let (frame_sender, mut frame_receiver) =
+      mpsc::channel::<image::DynamicImage>(FRAME_QUEUE_SIZE);
+
+    let frame_writer_join_handle = tokio::spawn(async move {
+      while let Some(frame_image) = frame_receiver.recv().await {
+        ffmpeg_stdin
+          .write_all(frame_image.as_bytes())
+          .await
+          .map_err(|e| e.to_string())?;
+      }
+
+      ffmpeg_stdin.shutdown().await.map_err(|e| e.to_string())
+    });
+
     Ok(Self {
-      ffmpeg_stdin: Some(ffmpeg_stdin),
+      frame_sender: Some(frame_sender),
+      frame_writer_join_handle: Some(frame_writer_join_handle),
       join_handle: Some(join_handle),
     })
   }
@@ -174,36 +202,46 @@ impl Mp4Encoder {
       })
   }
 
-  /// Writes the next frame of video.
+  /// Queues the next frame of video to be written to FFmpeg. This waits if
+  /// the queue of frames is full.
   ///
   pub async fn add_frame(
     &mut self,
-    frame_image: &image::DynamicImage,
+    frame_image: image::DynamicImage,
   ) -> Result<(), String> {
-    let Some(ffmpeg_stdin) = &mut self.ffmpeg_stdin else {
+    let Some(frame_sender) = &self.frame_sender else {
       panic!("FFmpeg stdin stream has been closed for writing");
     };
 
-    ffmpeg_stdin
-      .write_all(frame_image.as_bytes())
-      .await
-      .map_err(|e| e.to_string())?;
+    // Sending only fails if the frame writer task has stopped because of an
+    // error, so return that error
+    if frame_sender.send(frame_image).await.is_err() {
+      self.finish_writing_frames().await?;
+    }
 
     Ok(())
   }
 
+  /// Closes the queue of frames and waits for the queued frames to be written
+  /// to FFmpeg, after which FFmpeg stdin is closed.
+  ///
+  async fn finish_writing_frames(&mut self) -> Result<(), String> {
+    self.frame_sender.take();
+
+    let Some(frame_writer_join_handle) = self.frame_writer_join_handle.take()
+    else {
+      return Err("FFmpeg stdin stream has been closed".to_string());
+    };
+
+    frame_writer_join_handle.await.map_err(|e| e.to_string())?
+  }
+
   /// Completes encoding once all frames have been written by waiting for the
   /// FFMpeg process to complete and for all data to be written to the output
   /// target.
   ///
   pub async fn finish(&mut self) -> Result<(), String> {
-    self
-      .ffmpeg_stdin
-      .take()
-      .expect("FFmpeg stdin stream missing")
-      .shutdown()
-      .await
-      .map_err(|e| e.to_string())?;
+    self.finish_writing_frames().await?;
 
     let join_handle =
       self.join_handle.take().expect("FFmpeg join handle missing");
@@ -472,15 +510,6 @@ impl ResizeFilter {
       Self::Lanczos3 => "lanczos",
     }
   }
-
-  pub fn filter_type(&self) -> image::imageops::FilterType {
-    match self {
-      Self::Bilinear => image::imageops::FilterType::Triangle,
-      Self::Bicubic => image::imageops::FilterType::CatmullRom,
-      Self::Gaussian => image::imageops::FilterType::Gaussian,
-      Self::Lanczos3 => image::imageops::FilterType::Lanczos3,
-    }
-  }
 }
 
 impl core::fmt::Display for ResizeFilter {
@@ -0,0 +1,517 @@
+//! Reads the parts of a `multipart/related` HTTP response as input sources,
+//! e.g. the instances returned by a DICOMweb WADO-RS retrieve.
+//!
+//! The response is parsed incrementally as it arrives, and each part is made
+//! available as an input source as soon as its headers have been read, so
+//! parts are processed while the rest of the response is still downloading.
+//! The data of each part is passed on as slices of the chunks received from
+//! the HTTP response, without being copied or written to disk.
+
+use std::{path::PathBuf, pin::Pin, sync::Arc};
+
+use bytes::{Bytes, BytesMut};
+use futures::{Stream, StreamExt};
+use memchr::memmem;
+use tokio::sync::mpsc;
+
+use crate::utils::InputSource;
+
+/// The number of received chunks of a part's data that are buffered while
+/// waiting for the part to be read.
+///
+const PART_CHUNK_BUFFER_SIZE: usize = 16;
+
+/// The largest size of a part's headers.
+///
+const MAX_HEADERS_SIZE: usize = 64 * 1024;
+
+/// Returns whether an input filename is an HTTP URL, which is read as a
+/// `multipart/related` response.
+///
+pub fn is_http_url(input_filename: &str) -> bool {
+  input_filename.starts_with("http://")
+    || input_filename.starts_with("https://")
+}
+
+/// Requests the given URL and returns a stream of input sources for the parts
+/// of its `multipart/related` response. The request asks for DICOM parts, as
+/// is done for a DICOMweb WADO-RS retrieve.
+///
+/// Exits with an error if the request fails or the response isn't multipart.
+///
+pub async fn http_multipart_input_sources(
+  url: String,
+) -> Pin<Box<dyn Stream<Item = InputSource> + Send>> {
+  let response = reqwest::Client::new()
+    .get(&url)
+    .header("Accept", "multipart/related; type=\"application/dicom\"")
+    .send()
+    .await
+    .and_then(|response| response.error_for_status());
+
+  let response = match response {
+    Ok(response) => response,
+    Err(e) => {
+      crate::utils::exit_with_error(&format!("Requesting \"{url}\" failed"), e)
+    }
+  };
+
+  let content_type = response
+    .headers()
+    .get(reqwest::header::CONTENT_TYPE)
+    .and_then(|value| value.to_str().ok())
+    .unwrap_or("");
+
+  let Some(boundary) = multipart_boundary(content_type) else {
+    crate::utils::exit_with_error(
+      &format!("Response from \"{url}\" is not multipart"),
+      format!("Content type is \"{content_type}\""),
+    );
+  };
+
+  // Name the parts after the last segment of the URL's path
+  let name = url
+    .split(['?', '#'])
+    .next()
+    .unwrap_or("")
+    .trim_end_matches('/')
+    .rsplit('/')
+    .next()
+    .unwrap_or("")
+    .to_string();
+
+  let url: Arc<str> = url.into();
+  let (parts_sender, mut parts_receiver) = mpsc::channel(1);
+
+  tokio::spawn(read_parts(
+    Box::pin(response.bytes_stream()),
+    MultipartParser::new(&boundary),
+    url.clone(),
+    name,
+    parts_sender,
+  ));
+
+  Box::pin(async_stream::stream! {
+    while let Some(part) = parts_receiver.recv().await {
+      match part {
+        Ok(input_source) => yield input_source,
+        Err(e) => crate::utils::exit_with_error(
+          &format!("Reading multipart response from \"{url}\" failed"),
+          e,
+        ),
+      }
+    }
+  })
+}
+
+/// Reads a multipart response and sends an input source for each of its parts,
+/// followed by the part's data.
+///
+/// An error that occurs while a part is being read is passed on to the part's
+/// reader. Errors that occur between parts are sent in place of a part.
+///
+async fn read_parts(
+  mut body: impl Stream<Item = reqwest::Result<Bytes>> + Unpin,
+  mut parser: MultipartParser,
+  url: Arc<str>,
+  name: String,
+  parts_sender: mpsc::Sender<Result<InputSource, String>>,
+) {
+  let mut part_sender: Option<PartSender> = None;
+  let mut part_count = 0;
+
+  let result = async {
+    while let Some(chunk) = body.next().await {
+      let chunk = chunk.map_err(|e| e.to_string())?;
+
+      for event in parser.push(chunk)? {
+        match event {
+          MultipartEvent::PartStart => {
+            part_count += 1;
+
+            let (sender, receiver) = mpsc::channel(PART_CHUNK_BUFFER_SIZE);
+            part_sender = Some(sender);
+
+            let input_source = InputSource::HttpPart {
+              url: url.clone(),
+              index: part_count,
+              data: Arc::new(std::sync::Mutex::new(Some(receiver))),
+              specified_path: PathBuf::from(format!("{name}-{part_count:04}")),
+            };
+
+            if parts_sender.send(Ok(input_source)).await.is_err() {
+              return Ok(());
+            }
+          }
+
+          // Parts whose reader has gone away are skipped
+          MultipartEvent::PartData(data) => {
+            if let Some(sender) = &part_sender
+              && sender.send(Ok(data)).await.is_err()
+            {
+              part_sender = None;
+            }
+          }
+
+          MultipartEvent::PartEnd => part_sender = None,
+        }
+      }
+    }
+
+    parser.finish()
+  }
+  .await;
+
+  if let Err(e) = result {
+    match part_sender {
+      Some(sender) => {
+        let _ = sender.send(Err(std::io::Error::other(e))).await;
+      }
+
+      None => {
+        let _ = parts_sender.send(Err(e)).await;
+      }
+    }
+  }
+}
+
+type PartSender = mpsc::Sender<std::io::Result<Bytes>>;
+
+/// Returns the boundary parameter of a `multipart/*` content type.
+///
+fn multipart_boundary(content_type: &str) -> Option<String> {
+  let mut params = content_type.split(';');
+
+  let media_type = params.next()?.trim();
+  if !media_type.to_ascii_lowercase().starts_with("multipart/") {
+    return None;
+  }
+
+  params.find_map(|param| {
+    let (name, value) = param.split_once('=')?;
+    if !name.trim().eq_ignore_ascii_case("boundary") {
+      return None;
+    }
+
+    let value = value.trim();
+    let value = value
+      .strip_prefix('"')
+      .and_then(|value| value.strip_suffix('"'))
+      .unwrap_or(value);
+
+    (!value.is_empty()).then(|| value.to_string())
+  })
+}
+
+/// An event produced by a [`MultipartParser`].
+///
+#[derive(Clone, Debug, PartialEq)]
+enum MultipartEvent {
+  /// The headers of a new part have been read. Part headers aren't needed for
+  /// DICOM parts, so they are skipped.
+  PartStart,
+
+  /// Data for the current part.
+  PartData(Bytes),
+
+  /// The end of the current part.
+  PartEnd,
+}
+
+/// An incremental parser for `multipart/*` bodies, as defined by RFC 2046.
+///
+/// Delimiters are found with a SIMD substring search. The data of each part is
+/// returned as slices of the chunks passed to [`Self::push()`]. The only data
+/// that's copied is up to one delimiter's length at the end of a chunk when a
+/// delimiter may straddle two chunks, and the chunk that completes a delimiter
+/// line or part headers that were split across chunks.
+///
+struct MultipartParser {
+  /// The delimiter that comes before each part and the final delimiter, which
+  /// is a CRLF followed by "--" and the boundary
+  finder: memmem::Finder<'static>,
+
+  state: MultipartParserState,
+
+  /// Data received in a state other than [`MultipartParserState::Body`] that
+  /// hasn't been parsed yet
+  pending: Bytes,
+
+  /// The end of the data received in [`MultipartParserState::Body`], which
+  /// could be the start of a delimiter
+  tail: Bytes,
+}
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+enum MultipartParserState {
+  /// Searching for the next delimiter. The data is part of a part's body when
+  /// `in_part` is true, and is the preamble otherwise.
+  Body { in_part: bool },
+
+  /// Reading what follows a delimiter, which is "--" for the final delimiter
+  /// or otherwise a CRLF followed by the next part's headers
+  AfterDelimiter,
+
+  /// Reading a part's headers, up to the blank line that ends them
+  Headers,
+
+  /// The final delimiter has been read, and the rest of the data is ignored
+  Epilogue,
+}
+
+impl MultipartParser {
+  fn new(boundary: &str) -> Self {
+    let delimiter = format!("\r\n--{boundary}").into_bytes();
+
+    Self {
+      finder: memmem::Finder::new(&delimiter).into_owned(),
+      state: MultipartParserState::Body { in_part: false },
+
+      // The first delimiter is usually at the very start of the body and so
+      // isn't preceded by a CRLF
+      pending: Bytes::from_static(b"\r\n"),
+
+      tail: Bytes::new(),
+    }
+  }
+
+  /// Parses the next chunk of a multipart body.
+  ///
+  fn push(&mut self, chunk: Bytes) -> Result<Vec<MultipartEvent>, String> {
+    let mut events = vec![];
+
+    let mut data = if self.pending.is_empty() {
+      chunk
+    } else {
+      let mut joined = BytesMut::from(&self.pending[..]);
+      joined.extend_from_slice(&chunk);
+      self.pending = Bytes::new();
+      joined.freeze()
+    };
+
+    let delimiter_len = self.finder.needle().len();
+
+    loop {
+      match self.state {
+        MultipartParserState::Body { in_part } => {
+          let emit = |events: &mut Vec<MultipartEvent>, data: Bytes| {
+            if in_part && !data.is_empty() {
+              events.push(MultipartEvent::PartData(data));
+            }
+          };
+
+          // Check for a delimiter that starts in the tail of the previous
+          // chunk
+          if !self.tail.is_empty() {
+            let tail = core::mem::take(&mut self.tail);
+            let head = data.slice(..data.len().min(delimiter_len - 1));
+
+            let mut joined = BytesMut::from(&tail[..]);
+            joined.extend_from_slice(&head);
+
+            if let Some(offset) = self.finder.find(&joined) {
+              emit(&mut events, tail.slice(..offset));
+              data = data.slice(offset + delimiter_len - tail.len()..);
+              self.end_body(in_part, &mut events);
+              continue;
+            }
+
+            // If there isn't yet enough data to rule out a delimiter then
+            // keep the end of it for the next chunk
+            if head.len() < delimiter_len - 1 {
+              let keep = joined.len().min(delimiter_len - 1);
+              let joined = joined.freeze();
+
+              emit(&mut events, joined.slice(..joined.len() - keep));
+              self.tail = joined.slice(joined.len() - keep..);
+              break;
+            }
+
+            emit(&mut events, tail);
+          }
+
+          match self.finder.find(&data) {
+            Some(offset) => {
+              emit(&mut events, data.slice(..offset));
+              data = data.slice(offset + delimiter_len..);
+              self.end_body(in_part, &mut events);
+            }
+
+            None => {
+              let keep = data.len().min(delimiter_len - 1);
+
+              emit(&mut events, data.slice(..data.len() - keep));
+              self.tail = data.slice(data.len() - keep..);
+              break;
+            }
+          }
+        }
+
+        MultipartParserState::AfterDelimiter => {
+          // Skip any transport padding
+          let padding = data
+            .iter()
+            .take_while(|b| **b == b' ' || **b == b'\t')
+            .count();
+          data = data.slice(padding..);
+
+          if data.len() < 2 {
+            self.pending = data;
+            break;
+          }
+
+          if data.starts_with(b"--") {
+            self.state = MultipartParserState::Epilogue;
+          } else if data.starts_with(b"\r\n") {
+            self.state = MultipartParserState::Headers;
+          } else {
+            return Err("Multipart delimiter is not followed by a CRLF".into());
+          }
+        }
+
+        // The headers start with the CRLF that ends the delimiter line, so
+        // they always end with the first CRLF CRLF, including when there are
+        // no headers
+        MultipartParserState::Headers => {
+          match memmem::find(&data, b"\r\n\r\n") {
+            Some(offset) => {
+              data = data.slice(offset + 4..);
+
+              events.push(MultipartEvent::PartStart);
+              self.state = MultipartParserState::Body { in_part: true };
+            }
+
+            None => {
+              if data.len() > MAX_HEADERS_SIZE {
+                return Err("Multipart part headers are too large".into());
+              }
+
+              self.pending = data;
+              break;
+            }
+          }
+        }
+
+        MultipartParserState::Epilogue => break,
+      }
+    }
+
+    Ok(events)
+  }
+
+  /// Checks that the multipart body was complete once all of it has been
+  /// pushed.
+  ///
+  fn finish(&self) -> Result<(), String> {
+    if self.state == MultipartParserState::Epilogue {
+      Ok(())
+    } else {
+      Err("Multipart body ended before its final delimiter".into())
+    }
+  }
+
+  fn end_body(&mut self, in_part: bool, events: &mut Vec<MultipartEvent>) {
+    if in_part {
+      events.push(MultipartEvent::PartEnd);
+    }
+
+    self.state = MultipartParserState::AfterDelimiter;
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  const BODY: &[u8] = b"preamble\r\n\
+    --abc\r\n\
+    Content-Type: application/dicom\r\n\
+    \r\n\
+    first\r\n-part\r\n--ab\r\n\
+    --abc  \r\n\
+    \r\n\
+    second part\r\n\
+    --abc--\r\n\
+    epilogue";
+
+  /// Parses a multipart body pushed in chunks of the given size, and returns
+  /// the data of each part.
+  ///
+  fn parse(body: &[u8], chunk_size: usize) -> Result<Vec<Vec<u8>>, String> {
+    let mut parser = MultipartParser::new("abc");
+    let mut parts: Vec<Vec<u8>> = vec![];
+    let mut in_part = false;
+
+    for chunk in body.chunks(chunk_size) {
+      for event in parser.push(Bytes::copy_from_slice(chunk))? {
+        match event {
+          MultipartEvent::PartStart => {
+            assert!(!in_part);
+            in_part = true;
+            parts.push(vec![]);
+          }
+
+          MultipartEvent::PartData(data) => {
+            assert!(in_part);
+            parts.last_mut().unwrap().extend_from_slice(&data);
+          }
+
+          MultipartEvent::PartEnd => {
+            assert!(in_part);
+            in_part = false;
+          }
+        }
+      }
+    }
+
+    parser.finish()?;
+
+    Ok(parts)
+  }
+
+  #[test]
+  fn parses_parts_split_across_chunks() {
+    for chunk_size in 1..=BODY.len() {
+      assert_eq!(
+        parse(BODY, chunk_size),
+        Ok(vec![
+          b"first\r\n-part\r\n--ab".to_vec(),
+          b"second part".to_vec()
+        ]),
+        "chunk size {chunk_size}"
+      );
+    }
+  }
+
+  #[test]
+  fn parses_body_without_preamble() {
+    assert_eq!(
+      parse(b"--abc\r\n\r\ndata\r\n--abc--", 4),
+      Ok(vec![b"data".to_vec()])
+    );
+  }
+
+  #[test]
+  fn rejects_truncated_body() {
+    assert_eq!(
+      parse(b"--abc\r\n\r\ndata", 4),
+      Err("Multipart body ended before its final delimiter".to_string())
+    );
+  }
+
+  #[test]
+  fn multipart_boundary_parameter() {
+    assert_eq!(
+      multipart_boundary(
+        "multipart/related; type=\"application/dicom\"; boundary=\"a b\""
+      ),
+      Some("a b".to_string())
+    );
+    assert_eq!(
+      multipart_boundary("Multipart/Related;boundary=xyz"),
+      Some("xyz".to_string())
+    );
+    assert_eq!(multipart_boundary("application/dicom"), None);
+    assert_eq!(multipart_boundary("multipart/related"), None);
+  }
+}
@@ -2,6 +2,7 @@ use object_store::{
   ObjectStore, aws::AmazonS3Builder, path::Path as ObjectStorePath,
 };
 use std::collections::HashMap;
+use std::ops::Range;
 use std::sync::{Arc, LazyLock};
 use tokio::sync::Mutex;
 
@@ -75,6 +76,58 @@ pub async fn local_path_to_store_and_path<P: AsRef<std::path::Path>>(
     .unwrap()
 }
 
+/// Returns the path on the local filesystem of an object if its store is the
+/// local filesystem, which allows local files to be accessed directly rather
+/// than through the object store.
+///
+pub fn local_file_path(
+  object_store: &Arc<dyn ObjectStore>,
+  object_path: &ObjectStorePath,
+) -> Option<std::path::PathBuf> {
+  if !Arc::ptr_eq(object_store, &LOCAL_FILE_SYSTEM) {
+    return None;
+  }
+
+  // Object paths for local files on Windows start with the drive letter
+  if cfg!(windows) {
+    Some(std::path::PathBuf::from(object_path.as_ref()))
+  } else {
+    Some(std::path::PathBuf::from(format!("/{object_path}")))
+  }
+}
+
+/// Coalesces byte ranges that are to be read from an object into fewer range
+/// requests. Consecutive ranges are merged into the same request when the gap
+/// between them is at most `max_gap` bytes and the request doesn't grow beyond
+/// `max_request_size` bytes, which trades a small amount of unneeded data for
+/// fewer round trips while still allowing large reads to run in parallel.
+///
+/// Each returned request is paired with the ranges it contains, and the order
+/// of the input ranges is preserved.
+///
+pub fn coalesce_ranges(
+  ranges: &[Range<u64>],
+  max_gap: u64,
+  max_request_size: u64,
+) -> Vec<(Range<u64>, Vec<Range<u64>>)> {
+  let mut requests: Vec<(Range<u64>, Vec<Range<u64>>)> = vec![];
+
+  for range in ranges {
+    if let Some((request, request_ranges)) = requests.last_mut()
+      && range.start >= request.start
+      && range.start <= request.end.saturating_add(max_gap)
+      && range.end.max(request.end) - request.start <= max_request_size
+    {
+      request.end = request.end.max(range.end);
+      request_ranges.push(range.clone());
+    } else {
+      requests.push((range.clone(), vec![range.clone()]));
+    }
+  }
+
+  requests
+}
+
 #[derive(Clone, Copy, Hash, Eq, PartialEq)]
 enum ObjectStoreScheme {
   File,
@@ -86,6 +139,9 @@ enum ObjectStoreScheme {
 type StoreCacheHash =
   HashMap<(ObjectStoreScheme, String), Arc<dyn ObjectStore>>;
 
+static LOCAL_FILE_SYSTEM: LazyLock<Arc<dyn ObjectStore>> =
+  LazyLock::new(|| Arc::new(object_store::local::LocalFileSystem::new()));
+
 static STORE_CACHE: LazyLock<Arc<Mutex<StoreCacheHash>>> =
   LazyLock::new(|| Arc::new(Mutex::new(HashMap::new())));
 
@@ -102,10 +158,7 @@ async fn get_cached_store(
   }
 
   let store = match scheme {
-    ObjectStoreScheme::File => {
-      Arc::new(object_store::local::LocalFileSystem::new())
-        as Arc<dyn ObjectStore>
-    }
+    ObjectStoreScheme::File => LOCAL_FILE_SYSTEM.clone(),
 
     ObjectStoreScheme::AmazonS3 => {
       let mut builder = AmazonS3Builder::from_env().with_bucket_name(host);
@@ -157,6 +157,47 @@ impl OutputTarget {
     }
   }
 
+  /// Returns the path on the local filesystem of this output target, if it is
+  /// a local file.
+  ///
+  pub fn local_path(&self) -> Option<PathBuf> {
+    match self {
+      Self::StdOut => None,
+      Self::Object {
+        object_store,
+        object_path,
+        ..
+      } => {
+        crate::utils::object_store::local_file_path(object_store, object_path)
+      }
+    }
+  }
+
+  /// Exits with an error if this output target already exists and overwriting
+  /// is not enabled. See [`Self::set_overwrite()`].
+  ///
+  pub async fn check_overwrite(&self) {
+    let Self::Object {
+      specified_path,
+      object_store,
+      object_path,
+    } = self
+    else {
+      return;
+    };
+
+    if !Self::overwrite() && object_store.head(object_path).await.is_ok() {
+      crate::utils::exit_with_error(
+        &format!(
+          "Output file \"{}\" already exists.\n\nHint: Specify \
+           --overwrite to automatically overwrite existing files",
+          specified_path.display()
+        ),
+        "",
+      );
+    }
+  }
+
   /// Opens an async write stream for this output target. Once the write is
   /// complete the client must call [`OutputTarget::commit()`] to finalize the
   /// write.
@@ -173,21 +214,27 @@ impl OutputTarget {
         object_store,
         object_path,
       } => {
-        if !Self::overwrite() && object_store.head(object_path).await.is_ok() {
-          crate::utils::exit_with_error(
-            &format!(
-              "Output file \"{}\" already exists.\n\nHint: Specify \
-               --overwrite to automatically overwrite existing files",
-              specified_path.display()
-            ),
-            "",
-          );
-        }
+        self.check_overwrite().await;
 
         if log_write_to_stdout {
           println!("Writing \"{}\" …", specified_path.display());
         }
 
+        // Write local files using io_uring when it's available
+        #[cfg(target_os = "linux")]
+        if let Some(path) = self.local_path()
+          && crate::utils::io_uring::is_available()
+        {
+          let writer = crate::utils::io_uring::create_file(&path)
+            .await
+            .map_err(|e| P10Error::FileError {
+              when: "Creating output file".to_string(),
+              details: e.to_string(),
+            })?;
+
+          return Ok(Arc::new(Mutex::new(Box::new(writer))));
+        }
+
         // Start a multipart upload to the object store
         let multipart_upload = object_store
           .put_multipart(object_path)
@@ -198,7 +245,8 @@ impl OutputTarget {
           })?;
 
         // Create an async write stream that uploads multipart data
-        let writer = Box::new(MultipartUploadAsyncWrite::new(multipart_upload));
+        let writer =
+          Box::new(PartAsyncWrite::new_multipart_upload(multipart_upload));
 
         Ok(Arc::new(Mutex::new(writer)))
       }
@@ -234,94 +282,152 @@ impl OutputTarget {
 static GLOBAL_STDOUT: LazyLock<Arc<Mutex<Box<dyn dcmfx::p10::IoAsyncWrite>>>> =
   LazyLock::new(|| Arc::new(Mutex::new(Box::new(BufWriter::new(stdout())))));
 
-/// Makes an [`object_store::MultipartUpload`] usable as a
-/// [`tokio::io::AsyncWrite`] stream by buffering data into parts of at least
-/// 5 MiB before sending them.
+/// Makes a task that writes parts of data usable as a
+/// [`tokio::io::AsyncWrite`] stream by buffering data into parts of at least a
+/// minimum size before sending them to the task.
 ///
-struct MultipartUploadAsyncWrite {
-  // Sender for complete parts ready to be uploaded. Parts are always at least
-  // 5 MiB in size, except for the final part. Sending `None` indicates that all
-  // parts have been written.
+pub struct PartAsyncWrite {
+  // Sender for complete parts ready to be written. Parts are always at least
+  // the minimum part size, except for the final part. Sending `None` indicates
+  // that all parts have been written.
   tx: Option<mpsc::UnboundedSender<Option<Vec<u8>>>>,
 
-  // Join handle for the task that's uploading the complete parts.
-  join_handle: JoinHandle<object_store::Result<bool>>,
+  // Join handle for the task that's writing the complete parts.
+  join_handle: JoinHandle<std::io::Result<()>>,
 
   // The current part being buffered and that will be sent via the channel once
-  // it reaches 5 MiB in size.
+  // it reaches the minimum part size.
   current_part: Vec<u8>,
+  minimum_part_size: usize,
 }
 
 const MINIMUM_PART_SIZE: usize = 5 * 1024 * 1024;
 
-impl MultipartUploadAsyncWrite {
-  fn new(mut multipart_upload: Box<dyn MultipartUpload>) -> Self {
-    let (tx, mut rx) = mpsc::unbounded_channel::<Option<Vec<u8>>>();
+impl PartAsyncWrite {
+  /// Creates a new part writer that spawns a task running the passed function,
+  /// which receives parts until a `None` indicates that all parts have been
+  /// sent. If the channel closes before a `None` is received then the write
+  /// was abandoned and should be cleaned up.
+  ///
+  pub fn new<F>(
+    minimum_part_size: usize,
+    write_parts: impl FnOnce(mpsc::UnboundedReceiver<Option<Vec<u8>>>) -> F,
+  ) -> Self
+  where
+    F: Future<Output = std::io::Result<()>> + Send + 'static,
+  {
+    let (tx, rx) = mpsc::unbounded_channel::<Option<Vec<u8>>>();
+
+    Self {
+      tx: Some(tx),
+      join_handle: tokio::spawn(write_parts(rx)),
+      current_part: vec![],
+      minimum_part_size,
+    }
+  }
 
-    // Spawn a task that puts received parts for the multipart upload as they
-    // are received.
-    let join_handle = tokio::spawn(async move {
+  /// Creates a part writer for an [`object_store::MultipartUpload`] that puts
+  /// parts of at least 5 MiB.
+  ///
+  fn new_multipart_upload(
+    mut multipart_upload: Box<dyn MultipartUpload>,
+  ) -> Self {
+    Self::new(MINIMUM_PART_SIZE, |mut rx| async move {
+      // Put received parts for the multipart upload as they are received
       while let Some(data) = rx.recv().await {
         match data {
           Some(data) => {
             if !data.is_empty() {
-              multipart_upload.put_part(PutPayload::from(data)).await?;
+              multipart_upload
+                .put_part(PutPayload::from(data))
+                .await
+                .map_err(std::io::Error::other)?;
             }
           }
 
           None => {
-            multipart_upload.complete().await?;
-            return Ok(true);
+            multipart_upload
+              .complete()
+              .await
+              .map_err(std::io::Error::other)?;
+
+            return Ok(());
           }
         }
       }
 
       // The channel was closed before a `None` was received to indicate the
       // end of the parts, so abort the upload
-      multipart_upload.abort().await?;
+      multipart_upload
+        .abort()
+        .await
+        .map_err(std::io::Error::other)?;
 
-      Ok(false)
-    });
+      Err(std::io::Error::other("Multipart upload aborted"))
+    })
+  }
 
-    Self {
-      tx: Some(tx),
-      join_handle,
-      current_part: vec![],
+  /// Adds data to the current part buffer, and sends the part to be written
+  /// once it reaches the minimum part size.
+  ///
+  fn buffer_data<'a>(
+    &mut self,
+    bufs: impl Iterator<Item = &'a [u8]>,
+  ) -> std::io::Result<usize> {
+    // Error if the stream has been shutdown
+    let Some(tx) = self.tx.as_mut() else {
+      return Err(std::io::Error::from(std::io::ErrorKind::BrokenPipe));
+    };
+
+    // Add data to the current part buffer
+    let length = self.current_part.len();
+    for buf in bufs {
+      self.current_part.extend_from_slice(buf);
+    }
+    let length = self.current_part.len() - length;
+
+    // Buffer until the minimum part size is reached
+    if self.current_part.len() < self.minimum_part_size {
+      return Ok(length);
+    }
+
+    // Send the current part to be written
+    match tx.send(Some(std::mem::take(&mut self.current_part))) {
+      Ok(()) => Ok(length),
+      Err(_) => Err(std::io::Error::new(
+        std::io::ErrorKind::BrokenPipe,
+        "Part write task ended unexpectedly",
+      )),
     }
   }
 }
 
-impl tokio::io::AsyncWrite for MultipartUploadAsyncWrite {
+impl tokio::io::AsyncWrite for PartAsyncWrite {
   fn poll_write(
     self: Pin<&mut Self>,
     _cx: &mut Context<'_>,
     buf: &[u8],
   ) -> Poll<std::io::Result<usize>> {
-    let this = self.get_mut();
+    Poll::Ready(self.get_mut().buffer_data(std::iter::once(buf)))
+  }
 
-    // Error if the stream has been shutdown
-    let Some(tx) = this.tx.as_mut() else {
-      return Poll::Ready(Err(std::io::Error::from(
-        std::io::ErrorKind::BrokenPipe,
-      )));
-    };
+  // Vectored writes are accepted in full so that each chunk of P10 bytes, e.g.
+  // a pixel data fragment, is copied once directly into the part buffer
+  fn poll_write_vectored(
+    self: Pin<&mut Self>,
+    _cx: &mut Context<'_>,
+    bufs: &[std::io::IoSlice<'_>],
+  ) -> Poll<std::io::Result<usize>> {
+    let this = self.get_mut();
 
-    // Add data to the current part buffer
-    this.current_part.extend_from_slice(buf);
+    let total_length = bufs.iter().map(|buf| buf.len()).sum();
+    this.current_part.reserve(total_length);
 
-    // Buffer until the minimum part size is reached
-    if this.current_part.len() < MINIMUM_PART_SIZE {
-      return Poll::Ready(Ok(buf.len()));
-    }
+    Poll::Ready(this.buffer_data(bufs.iter().map(|buf| &buf[..])))
+  }
 
-    // Send the current part for upload
-    match tx.send(Some(std::mem::take(&mut this.current_part))) {
-      Ok(()) => Poll::Ready(Ok(buf.len())),
-      Err(_) => Poll::Ready(Err(std::io::Error::new(
-        std::io::ErrorKind::BrokenPipe,
-        "Multipart uploadtask ended unexpectedly",
-      ))),
-    }
+  fn is_write_vectored(&self) -> bool {
+    true
   }
 
   fn poll_flush(
@@ -338,7 +444,7 @@ impl tokio::io::AsyncWrite for MultipartUploadAsyncWrite {
     let this = self.get_mut();
 
     if let Some(tx) = this.tx.as_mut() {
-      // Send the last part, and also a None to complete the upload
+      // Send the last part, and also a None to complete the write
       let _ = tx.send(Some(std::mem::take(&mut this.current_part)));
       let _ = tx.send(None);
 
@@ -347,18 +453,12 @@ impl tokio::io::AsyncWrite for MultipartUploadAsyncWrite {
     }
 
     match futures::Future::poll(Pin::new(&mut this.join_handle), cx) {
-      Poll::Ready(Ok(Ok(true))) => Poll::Ready(Ok(())),
+      Poll::Ready(Ok(result)) => Poll::Ready(result),
 
-      Poll::Ready(Ok(Ok(false))) => {
-        Poll::Ready(Err(std::io::Error::other("Multipart upload aborted")))
+      Poll::Ready(Err(_)) => {
+        Poll::Ready(Err(std::io::Error::other("Part write task panicked")))
       }
 
-      Poll::Ready(Ok(Err(e))) => Poll::Ready(Err(std::io::Error::other(e))),
-
-      Poll::Ready(Err(_)) => Poll::Ready(Err(std::io::Error::other(
-        "Multipart upload task panicked",
-      ))),
-
       Poll::Pending => Poll::Pending,
     }
   }
@@ -0,0 +1,169 @@
+use std::{
+  fs::File,
+  io::{Read, Seek, SeekFrom},
+};
+
+use dcmfx::{core::*, p10::*};
+
+/// The header of a DICOM P10 file, which is all of its data elements prior to
+/// the pixel data, along with the location of the pixel data in the file.
+///
+/// This allows a file's header to be rewritten without its pixel data being
+/// passed through a P10 read and write context.
+///
+pub struct P10Header {
+  /// The File Meta Information and the data elements prior to the pixel data.
+  pub data_set: DataSet,
+
+  /// The File Preamble, if the file has one.
+  pub preamble: Option<[u8; 128]>,
+
+  pub transfer_syntax: &'static TransferSyntax,
+
+  /// The tag of the pixel data, which is one of *'(7FE0,0008) Float Pixel
+  /// Data'*, *'(7FE0,0009) Double Float Pixel Data'*, or *'(7FE0,0010) Pixel
+  /// Data'*.
+  pub pixel_data_tag: DataElementTag,
+
+  /// The offset in the file of the pixel data's data element header.
+  pub pixel_data_offset: u64,
+
+  /// The offset in the file of the pixel data's value.
+  pub pixel_data_value_offset: u64,
+
+  /// The length of the pixel data's value, or `None` for encapsulated pixel
+  /// data, which has an undefined length.
+  pub pixel_data_length: Option<u32>,
+}
+
+impl P10Header {
+  /// Reads the header of a DICOM P10 file. The file is read up to the start of
+  /// the pixel data at the root of the main data set. Returns `None` if the
+  /// file has no pixel data.
+  ///
+  pub fn read(
+    file: &mut File,
+    read_config: P10ReadConfig,
+  ) -> Result<Option<Self>, P10Error> {
+    let mut context = P10ReadContext::new(Some(read_config));
+    let mut data_set_builder = DataSetBuilder::new();
+
+    let pixel_data_tags = [
+      dictionary::FLOAT_PIXEL_DATA.tag,
+      dictionary::DOUBLE_FLOAT_PIXEL_DATA.tag,
+      dictionary::PIXEL_DATA.tag,
+    ];
+
+    loop {
+      let offset = context.bytes_read();
+
+      let tokens = match context.read_tokens() {
+        Ok(tokens) => tokens,
+
+        Err(P10Error::DataRequired { .. }) => {
+          let mut buffer = vec![0u8; 64 * 1024];
+          let length =
+            file.read(&mut buffer).map_err(|e| P10Error::FileError {
+              when: "Reading file".to_string(),
+              details: e.to_string(),
+            })?;
+          buffer.truncate(length);
+
+          context.write_bytes(buffer.into(), length == 0)?;
+          continue;
+        }
+
+        Err(e) => return Err(e),
+      };
+
+      for token in tokens.iter() {
+        let (pixel_data_tag, pixel_data_length) = match token {
+          P10Token::DataElementHeader {
+            tag, length, path, ..
+          } if path.is_root() && pixel_data_tags.contains(tag) => {
+            (*tag, Some(*length))
+          }
+
+          P10Token::SequenceStart { tag, path, .. }
+            if path.is_root() && pixel_data_tags.contains(tag) =>
+          {
+            (*tag, None)
+          }
+
+          P10Token::End => return Ok(None),
+
+          _ => {
+            data_set_builder.add_token(token)?;
+            continue;
+          }
+        };
+
+        let preamble = data_set_builder.file_preamble().ok().copied();
+
+        data_set_builder.add_token(&P10Token::End)?;
+        let Ok(data_set) = data_set_builder.final_data_set() else {
+          return Ok(None);
+        };
+
+        let transfer_syntax =
+          TransferSyntax::from_uid(context.transfer_syntax().uid)
+            .unwrap_or(&transfer_syntax::IMPLICIT_VR_LITTLE_ENDIAN);
+
+        return Ok(Some(Self {
+          data_set,
+          preamble,
+          transfer_syntax,
+          pixel_data_tag,
+          pixel_data_offset: offset,
+          pixel_data_value_offset: context.bytes_read(),
+          pixel_data_length,
+        }));
+      }
+    }
+  }
+
+  /// Returns the offset in the file of the end of the pixel data. For
+  /// encapsulated pixel data this reads the header of each of its items in
+  /// order to find the sequence delimitation item, but doesn't read the items'
+  /// data. The transfer syntax must be little endian.
+  ///
+  pub fn pixel_data_end(&self, file: &mut File) -> std::io::Result<u64> {
+    if let Some(length) = self.pixel_data_length {
+      return Ok(self.pixel_data_value_offset + u64::from(length));
+    }
+
+    let mut offset = self.pixel_data_value_offset;
+
+    loop {
+      let mut item_header = [0u8; 8];
+      file.seek(SeekFrom::Start(offset))?;
+      file.read_exact(&mut item_header)?;
+
+      let group = u16::from_le_bytes([item_header[0], item_header[1]]);
+      let element = u16::from_le_bytes([item_header[2], item_header[3]]);
+      let length = u32::from_le_bytes([
+        item_header[4],
+        item_header[5],
+        item_header[6],
+        item_header[7],
+      ]);
+
+      offset += item_header.len() as u64;
+
+      match (group, element) {
+        (0xFFFE, 0xE000) if length != 0xFFFF_FFFF => {
+          offset += u64::from(length);
+        }
+
+        (0xFFFE, 0xE0DD) => return Ok(offset),
+
+        _ => {
+          return Err(std::io::Error::new(
+            std::io::ErrorKind::InvalidData,
+            "Invalid encapsulated pixel data item",
+          ));
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,222 @@
+use std::io::Write;
+
+use image::{
+  DynamicImage, ExtendedColorType, ImageError, ImageFormat,
+  error::{
+    EncodingError, ImageFormatHint, UnsupportedError, UnsupportedErrorKind,
+  },
+};
+
+/// Encodes a PNG or JPEG image from a sequence of horizontal stripes, as
+/// produced by decoding a frame in stripes. This avoids assembling the whole
+/// frame into an [`image::DynamicImage`] before it is encoded.
+///
+/// PNG images are compressed as each stripe is written, so only the encoded
+/// data is held in memory. JPEG images are encoded once all stripes have been
+/// written because the JPEG encoder requires the whole image.
+///
+pub struct StripeImageEncoder<W: Write> {
+  width: u32,
+  height: u32,
+  rows_written: u32,
+  state: EncoderState<W>,
+}
+
+enum EncoderState<W: Write> {
+  Png(png::StreamWriter<'static, W>),
+  Jpeg {
+    writer: W,
+    quality: u8,
+    color_type: ExtendedColorType,
+    data: Vec<u8>,
+  },
+}
+
+impl<W: Write> StripeImageEncoder<W> {
+  /// Creates a new PNG encoder for an image of the given size. The color type
+  /// must be one of L8, L16, Rgb8, or Rgb16.
+  ///
+  pub fn new_png(
+    writer: W,
+    width: u32,
+    height: u32,
+    color_type: ExtendedColorType,
+  ) -> Result<Self, ImageError> {
+    let (png_color_type, bit_depth) = match color_type {
+      ExtendedColorType::L8 => {
+        (png::ColorType::Grayscale, png::BitDepth::Eight)
+      }
+      ExtendedColorType::L16 => {
+        (png::ColorType::Grayscale, png::BitDepth::Sixteen)
+      }
+      ExtendedColorType::Rgb8 => (png::ColorType::Rgb, png::BitDepth::Eight),
+      ExtendedColorType::Rgb16 => (png::ColorType::Rgb, png::BitDepth::Sixteen),
+      _ => return Err(unsupported_color_type(ImageFormat::Png, color_type)),
+    };
+
+    let mut encoder = png::Encoder::new(writer, width, height);
+    encoder.set_color(png_color_type);
+    encoder.set_depth(bit_depth);
+
+    let stream_writer = encoder
+      .write_header()
+      .and_then(|writer| writer.into_stream_writer())
+      .map_err(png_error)?;
+
+    Ok(Self {
+      width,
+      height,
+      rows_written: 0,
+      state: EncoderState::Png(stream_writer),
+    })
+  }
+
+  /// Creates a new JPEG encoder for an image of the given size. The color type
+  /// must be either L8 or Rgb8.
+  ///
+  pub fn new_jpeg(
+    writer: W,
+    width: u32,
+    height: u32,
+    color_type: ExtendedColorType,
+    quality: u8,
+  ) -> Result<Self, ImageError> {
+    if color_type != ExtendedColorType::L8
+      && color_type != ExtendedColorType::Rgb8
+    {
+      return Err(unsupported_color_type(ImageFormat::Jpeg, color_type));
+    }
+
+    let data_size = width as usize
+      * height as usize
+      * usize::from(color_type.channel_count());
+
+    Ok(Self {
+      width,
+      height,
+      rows_written: 0,
+      state: EncoderState::Jpeg {
+        writer,
+        quality,
+        color_type,
+        data: Vec::with_capacity(data_size),
+      },
+    })
+  }
+
+  /// Writes the next stripe of the image. The stripe must have the same width
+  /// and color type as the image being encoded, and must not extend past the
+  /// bottom of the image.
+  ///
+  pub fn write_stripe(
+    &mut self,
+    stripe: &DynamicImage,
+  ) -> Result<(), ImageError> {
+    if stripe.width() != self.width
+      || self.rows_written + stripe.height() > self.height
+    {
+      return Err(ImageError::Parameter(
+        image::error::ParameterError::from_kind(
+          image::error::ParameterErrorKind::DimensionMismatch,
+        ),
+      ));
+    }
+
+    match &mut self.state {
+      EncoderState::Png(stream_writer) => {
+        let result = match stripe {
+          DynamicImage::ImageLuma8(stripe) => {
+            stream_writer.write_all(stripe.as_raw())
+          }
+          DynamicImage::ImageRgb8(stripe) => {
+            stream_writer.write_all(stripe.as_raw())
+          }
+
+          // 16-bit PNG samples are big endian
+          DynamicImage::ImageLuma16(stripe) => {
+            stream_writer.write_all(&to_be_bytes(stripe.as_raw()))
+          }
+          DynamicImage::ImageRgb16(stripe) => {
+            stream_writer.write_all(&to_be_bytes(stripe.as_raw()))
+          }
+
+          _ => {
+            return Err(unsupported_color_type(
+              ImageFormat::Png,
+              stripe.color().into(),
+            ));
+          }
+        };
+
+        result.map_err(ImageError::IoError)?;
+      }
+
+      EncoderState::Jpeg {
+        color_type, data, ..
+      } => {
+        if ExtendedColorType::from(stripe.color()) != *color_type {
+          return Err(unsupported_color_type(
+            ImageFormat::Jpeg,
+            stripe.color().into(),
+          ));
+        }
+
+        data.extend_from_slice(stripe.as_bytes());
+      }
+    }
+
+    self.rows_written += stripe.height();
+
+    Ok(())
+  }
+
+  /// Completes encoding of the image. All of its rows must have been written.
+  ///
+  pub fn finish(self) -> Result<(), ImageError> {
+    if self.rows_written != self.height {
+      return Err(ImageError::Parameter(
+        image::error::ParameterError::from_kind(
+          image::error::ParameterErrorKind::DimensionMismatch,
+        ),
+      ));
+    }
+
+    match self.state {
+      EncoderState::Png(stream_writer) => {
+        stream_writer.finish().map_err(png_error)
+      }
+
+      EncoderState::Jpeg {
+        writer,
+        quality,
+        color_type,
+        data,
+      } => image::codecs::jpeg::JpegEncoder::new_with_quality(writer, quality)
+        .encode(&data, self.width, self.height, color_type),
+    }
+  }
+}
+
+fn to_be_bytes(data: &[u16]) -> Vec<u8> {
+  data.iter().flat_map(|value| value.to_be_bytes()).collect()
+}
+
+fn png_error(error: png::EncodingError) -> ImageError {
+  match error {
+    png::EncodingError::IoError(e) => ImageError::IoError(e),
+    e => ImageError::Encoding(EncodingError::new(
+      ImageFormatHint::Exact(ImageFormat::Png),
+      e,
+    )),
+  }
+}
+
+fn unsupported_color_type(
+  format: ImageFormat,
+  color_type: ExtendedColorType,
+) -> ImageError {
+  ImageError::Unsupported(UnsupportedError::from_format_and_kind(
+    ImageFormatHint::Exact(format),
+    UnsupportedErrorKind::Color(color_type),
+  ))
+}
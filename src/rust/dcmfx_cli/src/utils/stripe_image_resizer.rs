@@ -0,0 +1,307 @@
+use std::collections::VecDeque;
+
+use image::{DynamicImage, ImageBuffer, Pixel};
+
+use super::mp4_encoder::ResizeFilter;
+
+/// Resizes an image that arrives as a sequence of horizontal stripes, as
+/// produced by decoding a frame in stripes. Each row of the resized image is
+/// emitted as soon as the input rows it depends on have arrived, so only the
+/// handful of rows covered by the vertical filter are held in memory.
+///
+/// The resize is separable. Each input row is first resized horizontally as it
+/// arrives, and output rows are then formed from these rows. When a dimension
+/// is scaled down by an integer ratio its pixels are area averaged, i.e. a box
+/// filter is used, and otherwise the passed filter is used with the same
+/// weights as [`image::imageops::resize()`]. The inner loops are plain
+/// multiply-adds over `f32` rows, which the compiler vectorizes.
+///
+/// Stripes must be L8, L16, Rgb8, or Rgb16 images with the width of the input
+/// image, and the emitted stripes are of the same type.
+///
+pub struct StripeImageResizer {
+  input_width: u32,
+  output_width: u32,
+  output_height: u32,
+
+  horizontal_taps: Vec<FilterTaps>,
+  vertical_taps: Vec<FilterTaps>,
+
+  /// Input rows that have been resized horizontally and are still needed by
+  /// output rows that haven't been emitted.
+  rows: VecDeque<Vec<f32>>,
+  first_row_index: usize,
+
+  output_rows_emitted: usize,
+}
+
+/// The range of input pixels that contribute to one output pixel, and the
+/// weight of each of them.
+///
+struct FilterTaps {
+  start: usize,
+  weights: Vec<f32>,
+}
+
+impl StripeImageResizer {
+  /// Creates a new resizer from the given input size to the given output size.
+  ///
+  pub fn new(
+    input_width: u32,
+    input_height: u32,
+    output_width: u32,
+    output_height: u32,
+    filter: ResizeFilter,
+  ) -> Self {
+    Self {
+      input_width,
+      output_width,
+      output_height,
+      horizontal_taps: filter_taps(input_width, output_width, filter),
+      vertical_taps: filter_taps(input_height, output_height, filter),
+      rows: VecDeque::new(),
+      first_row_index: 0,
+      output_rows_emitted: 0,
+    }
+  }
+
+  /// Adds the next stripe of the input image, and returns the rows of the
+  /// resized image that are now complete. Returns `None` if no rows are
+  /// complete yet.
+  ///
+  pub fn resize_stripe(
+    &mut self,
+    stripe: &DynamicImage,
+  ) -> Option<DynamicImage> {
+    match stripe {
+      DynamicImage::ImageLuma8(stripe) => self
+        .resize_image::<_, 1>(stripe)
+        .map(DynamicImage::ImageLuma8),
+      DynamicImage::ImageLuma16(stripe) => self
+        .resize_image::<_, 1>(stripe)
+        .map(DynamicImage::ImageLuma16),
+      DynamicImage::ImageRgb8(stripe) => self
+        .resize_image::<_, 3>(stripe)
+        .map(DynamicImage::ImageRgb8),
+      DynamicImage::ImageRgb16(stripe) => self
+        .resize_image::<_, 3>(stripe)
+        .map(DynamicImage::ImageRgb16),
+      _ => unreachable!(),
+    }
+  }
+
+  fn resize_image<P: Pixel, const CHANNELS: usize>(
+    &mut self,
+    stripe: &ImageBuffer<P, Vec<P::Subpixel>>,
+  ) -> Option<ImageBuffer<P, Vec<P::Subpixel>>>
+  where
+    P::Subpixel: Sample,
+  {
+    let data = self.resize_rows::<P::Subpixel, CHANNELS>(stripe.as_raw());
+    if data.is_empty() {
+      return None;
+    }
+
+    let height = data.len() / (self.output_width as usize * CHANNELS);
+
+    ImageBuffer::from_raw(self.output_width, height as u32, data)
+  }
+
+  /// Resizes the rows of a stripe horizontally, and then emits all output
+  /// rows whose input rows have now arrived.
+  ///
+  fn resize_rows<T: Sample, const CHANNELS: usize>(
+    &mut self,
+    data: &[T],
+  ) -> Vec<T> {
+    let input_row_length = self.input_width as usize * CHANNELS;
+    let output_row_length = self.output_width as usize * CHANNELS;
+
+    for input_row in data.chunks_exact(input_row_length) {
+      let mut row = vec![0.0f32; output_row_length];
+
+      for (output_pixel, taps) in row
+        .chunks_exact_mut(CHANNELS)
+        .zip(self.horizontal_taps.iter())
+      {
+        let input_pixels =
+          &input_row[taps.start * CHANNELS..][..taps.weights.len() * CHANNELS];
+
+        for (input_pixel, weight) in
+          input_pixels.chunks_exact(CHANNELS).zip(taps.weights.iter())
+        {
+          for i in 0..CHANNELS {
+            output_pixel[i] += weight * input_pixel[i].to_f32();
+          }
+        }
+      }
+
+      self.rows.push_back(row);
+    }
+
+    let mut output = vec![];
+    let mut sums = vec![0.0f32; output_row_length];
+
+    while let Some(taps) = self.vertical_taps.get(self.output_rows_emitted) {
+      if taps.start + taps.weights.len()
+        > self.first_row_index + self.rows.len()
+      {
+        break;
+      }
+
+      sums.fill(0.0);
+
+      for (i, weight) in taps.weights.iter().enumerate() {
+        let row = &self.rows[taps.start + i - self.first_row_index];
+
+        for (sum, value) in sums.iter_mut().zip(row.iter()) {
+          *sum += weight * value;
+        }
+      }
+
+      output.extend(sums.iter().map(|sum| T::from_f32(*sum)));
+      self.output_rows_emitted += 1;
+
+      // Drop the rows that no later output row needs
+      if let Some(next_taps) = self.vertical_taps.get(self.output_rows_emitted)
+      {
+        while self.first_row_index < next_taps.start && !self.rows.is_empty() {
+          self.rows.pop_front();
+          self.first_row_index += 1;
+        }
+      }
+    }
+
+    output
+  }
+}
+
+/// Returns the filter taps for resizing a dimension from the input size to the
+/// output size.
+///
+fn filter_taps(
+  input_size: u32,
+  output_size: u32,
+  filter: ResizeFilter,
+) -> Vec<FilterTaps> {
+  let input_size = input_size as usize;
+  let output_size = output_size as usize;
+
+  // Area average when scaling down by an integer ratio
+  if output_size > 0
+    && output_size <= input_size
+    && input_size % output_size == 0
+  {
+    let ratio = input_size / output_size;
+    let weight = 1.0 / ratio as f32;
+
+    return (0..output_size)
+      .map(|i| FilterTaps {
+        start: i * ratio,
+        weights: vec![weight; ratio],
+      })
+      .collect();
+  }
+
+  let (kernel, support) = filter_kernel(filter);
+
+  let ratio = input_size as f32 / output_size as f32;
+  let scale = ratio.max(1.0);
+  let input_support = support * scale;
+
+  (0..output_size)
+    .map(|i| {
+      let center = (i as f32 + 0.5) * ratio;
+
+      let start = ((center - input_support).floor() as i64)
+        .clamp(0, input_size as i64 - 1) as usize;
+      let end = ((center + input_support).ceil() as i64)
+        .clamp(start as i64 + 1, input_size as i64) as usize;
+
+      let mut weights: Vec<f32> = (start..end)
+        .map(|j| kernel((j as f32 - (center - 0.5)) / scale))
+        .collect();
+
+      let total: f32 = weights.iter().sum();
+      for weight in weights.iter_mut() {
+        *weight /= total;
+      }
+
+      FilterTaps { start, weights }
+    })
+    .collect()
+}
+
+/// Returns the kernel function for a resize filter, and its support, which
+/// match those used by [`image::imageops::FilterType`].
+///
+fn filter_kernel(filter: ResizeFilter) -> (fn(f32) -> f32, f32) {
+  fn sinc(x: f32) -> f32 {
+    if x == 0.0 {
+      1.0
+    } else {
+      let a = x * core::f32::consts::PI;
+      a.sin() / a
+    }
+  }
+
+  match filter {
+    ResizeFilter::Bilinear => (|x| (1.0 - x.abs()).max(0.0), 1.0),
+
+    // Catmull-Rom spline, i.e. a cubic B-spline with B = 0 and C = 0.5
+    ResizeFilter::Bicubic => (
+      |x| {
+        let a = x.abs();
+        if a < 1.0 {
+          1.5 * a * a * a - 2.5 * a * a + 1.0
+        } else if a < 2.0 {
+          -0.5 * a * a * a + 2.5 * a * a - 4.0 * a + 2.0
+        } else {
+          0.0
+        }
+      },
+      2.0,
+    ),
+
+    // Normal distribution with a standard deviation of 0.5
+    ResizeFilter::Gaussian => (|x| (-2.0 * x * x).exp(), 3.0),
+
+    ResizeFilter::Lanczos3 => (
+      |x| {
+        if x.abs() < 3.0 {
+          sinc(x) * sinc(x / 3.0)
+        } else {
+          0.0
+        }
+      },
+      3.0,
+    ),
+  }
+}
+
+/// A sample type that can be resized.
+///
+trait Sample: Copy {
+  fn to_f32(self) -> f32;
+  fn from_f32(value: f32) -> Self;
+}
+
+impl Sample for u8 {
+  fn to_f32(self) -> f32 {
+    f32::from(self)
+  }
+
+  fn from_f32(value: f32) -> Self {
+    value.round().clamp(0.0, 255.0) as u8
+  }
+}
+
+impl Sample for u16 {
+  fn to_f32(self) -> f32 {
+    f32::from(self)
+  }
+
+  fn from_f32(value: f32) -> Self {
+    value.round().clamp(0.0, 65535.0) as u16
+  }
+}
@@ -0,0 +1,824 @@
+//! Distributes the inputs of a command between workers running on different
+//! machines using lease objects in an object store. No coordinator is needed:
+//! every worker is given the same inputs, and an input is processed by the
+//! first worker to create its lease object. Once processed, a done marker is
+//! written so that the input is skipped by all workers from then on, including
+//! when the command is rerun after an interruption.
+//!
+//! Leases expire if they aren't renewed, so inputs held by a worker that stops
+//! are taken over by another worker. A lease is renewed in the background for
+//! as long as its input is being processed, and is released if processing
+//! fails so that another worker can retry it.
+//!
+//! Each renewal is a conditional update on the version of the lease written by
+//! this worker, so a worker that stalls for longer than the lease duration
+//! finds out that its lease was taken over the next time it renews. It then
+//! stops processing the input, and leaves the done marker and the lease to the
+//! worker that took it over.
+//!
+//! The object store must support conditional creates, which S3, GCS, Azure,
+//! and the local filesystem all do. Where the store doesn't support
+//! conditional updates, expired leases are taken over by replacing them, and
+//! leases are renewed by checking they're unchanged and then replacing them.
+//! Object stores don't have conditional deletes, so a lease is also checked
+//! to be unchanged before it's deleted. In these cases two workers can rarely
+//! both process an input. Outputs are written in full from their input every
+//! time, so processing an input twice gives the same output. Modifying files
+//! in place doesn't have this property, and isn't supported with leases.
+
+use std::{
+  path::PathBuf,
+  sync::{
+    Arc,
+    atomic::{AtomicU64, Ordering},
+  },
+  time::{Duration, Instant, SystemTime, UNIX_EPOCH},
+};
+
+use object_store::{
+  ObjectStore, ObjectStoreExt, PutMode, PutOptions, PutPayload, PutResult,
+  UpdateVersion, path::Path as ObjectStorePath,
+};
+
+use dcmfx::core::error;
+
+use crate::utils::{
+  InputSource,
+  object_store::{local_path_to_store_and_path, object_url_to_store_and_path},
+};
+
+/// The lease objects for a distributed run of a command, along with this
+/// worker's throughput.
+///
+pub struct WorkLeases {
+  object_store: Arc<dyn ObjectStore>,
+  prefix: ObjectStorePath,
+  worker_id: String,
+  lease_duration: Duration,
+  retries: usize,
+
+  started_at: Instant,
+  completed_count: AtomicU64,
+  completed_bytes: AtomicU64,
+  skipped_count: AtomicU64,
+  failed_count: AtomicU64,
+}
+
+/// The result of trying to acquire the lease for an input.
+///
+enum LeaseState {
+  /// The lease was acquired by this worker, and is renewed until dropped.
+  Acquired(Lease),
+
+  /// The lease is held by another worker.
+  Held,
+
+  /// The input has already been processed.
+  Done,
+}
+
+/// A lease held by this worker. The lease is renewed in the background until
+/// it's lost to another worker, or this is dropped.
+///
+struct Lease {
+  holder: Arc<LeaseHolder>,
+  renewal: tokio::task::JoinHandle<()>,
+}
+
+impl Lease {
+  /// Waits until the lease is lost to another worker.
+  ///
+  async fn lost(&mut self) {
+    let _ = (&mut self.renewal).await;
+  }
+
+  /// Stops renewing the lease in the background, and then renews it one last
+  /// time to check that it's still held by this worker. Returns whether it
+  /// is.
+  ///
+  async fn confirm(&self) -> bool {
+    // Holding the version stops the renewal between attempts rather than
+    // part way through one
+    {
+      let _version = self.holder.version.lock().await;
+      self.renewal.abort();
+    }
+
+    !matches!(self.holder.renew().await, Renewal::Lost)
+  }
+}
+
+impl Drop for Lease {
+  fn drop(&mut self) {
+    self.renewal.abort();
+  }
+}
+
+/// The lease object for an input held by this worker, along with the version
+/// of it that was last written, which is shared with the task that renews it.
+///
+struct LeaseHolder {
+  object_store: Arc<dyn ObjectStore>,
+  path: ObjectStorePath,
+  worker_id: String,
+  input: String,
+  lease_duration: Duration,
+  version: tokio::sync::Mutex<UpdateVersion>,
+}
+
+/// The result of renewing a lease.
+///
+enum Renewal {
+  Renewed,
+
+  /// The lease was changed or deleted by another worker.
+  Lost,
+
+  /// The renewal failed, and can be tried again.
+  Failed,
+}
+
+impl LeaseHolder {
+  /// Renews the lease, which fails if it has been changed since it was last
+  /// written by this worker.
+  ///
+  async fn renew(&self) -> Renewal {
+    let mut version = self.version.lock().await;
+
+    let lease_data = PutPayload::from(lease_data(
+      &self.worker_id,
+      &self.input,
+      self.lease_duration,
+    ));
+
+    let options = PutOptions {
+      mode: PutMode::Update(version.clone()),
+      ..Default::default()
+    };
+
+    let result = match self
+      .object_store
+      .put_opts(&self.path, lease_data.clone(), options)
+      .await
+    {
+      // Stores without conditional updates have the lease replaced if it's
+      // unchanged
+      Err(object_store::Error::NotImplemented) => {
+        match self.is_unchanged(&version).await {
+          Ok(true) => self.object_store.put(&self.path, lease_data).await,
+          Ok(false) => return Renewal::Lost,
+          Err(_) => return Renewal::Failed,
+        }
+      }
+
+      result => result,
+    };
+
+    match result {
+      Ok(put_result) => {
+        *version = update_version(put_result);
+        Renewal::Renewed
+      }
+
+      Err(
+        object_store::Error::Precondition { .. }
+        | object_store::Error::NotFound { .. },
+      ) => Renewal::Lost,
+
+      Err(_) => Renewal::Failed,
+    }
+  }
+
+  /// Deletes the lease if it's unchanged since it was last written by this
+  /// worker.
+  ///
+  async fn release(&self) {
+    let version = self.version.lock().await;
+
+    if let Ok(true) = self.is_unchanged(&version).await {
+      let _ = self.object_store.delete(&self.path).await;
+    }
+  }
+
+  /// Returns whether the lease object is the version last written by this
+  /// worker. If the store doesn't report versions then the worker recorded in
+  /// the lease is checked instead.
+  ///
+  async fn is_unchanged(
+    &self,
+    version: &UpdateVersion,
+  ) -> Result<bool, object_store::Error> {
+    if version.e_tag.is_none() && version.version.is_none() {
+      let lease = match self.object_store.get(&self.path).await {
+        Ok(lease) => lease.bytes().await?,
+        Err(object_store::Error::NotFound { .. }) => return Ok(false),
+        Err(e) => return Err(e),
+      };
+
+      return Ok(lease_worker_id(&lease).as_deref() == Some(&self.worker_id));
+    }
+
+    match self.object_store.head(&self.path).await {
+      Ok(meta) => {
+        Ok(meta.e_tag == version.e_tag && meta.version == version.version)
+      }
+      Err(object_store::Error::NotFound { .. }) => Ok(false),
+      Err(e) => Err(e),
+    }
+  }
+}
+
+impl WorkLeases {
+  /// Creates the leases for a distributed run that stores its lease objects
+  /// under the given object URL or local directory.
+  ///
+  pub async fn new(
+    prefix: &str,
+    worker_id: Option<String>,
+    lease_duration: Duration,
+    retries: usize,
+  ) -> Self {
+    let (object_store, prefix) =
+      match object_url_to_store_and_path(prefix).await {
+        Ok(store_and_path) => store_and_path,
+        Err(()) => local_path_to_store_and_path(PathBuf::from(prefix)).await,
+      };
+
+    let worker_id = worker_id.unwrap_or_else(|| {
+      let host_name =
+        std::env::var("HOSTNAME").unwrap_or_else(|_| "worker".to_string());
+
+      format!("{host_name}-{}", std::process::id())
+    });
+
+    Self::with_object_store(
+      object_store,
+      prefix,
+      worker_id,
+      lease_duration,
+      retries,
+    )
+  }
+
+  /// Creates the leases for a distributed run that stores its lease objects
+  /// under the given path in an object store.
+  ///
+  fn with_object_store(
+    object_store: Arc<dyn ObjectStore>,
+    prefix: ObjectStorePath,
+    worker_id: String,
+    lease_duration: Duration,
+    retries: usize,
+  ) -> Self {
+    Self {
+      object_store,
+      prefix,
+      worker_id,
+      lease_duration: lease_duration.max(Duration::from_secs(3)),
+      retries,
+      started_at: Instant::now(),
+      completed_count: AtomicU64::new(0),
+      completed_bytes: AtomicU64::new(0),
+      skipped_count: AtomicU64::new(0),
+      failed_count: AtomicU64::new(0),
+    }
+  }
+
+  /// Runs the passed function for an input if this worker acquires its lease,
+  /// retrying it on failure up to the configured number of times, and then
+  /// marks the input as done.
+  ///
+  /// If the input still fails then its lease is released so that another
+  /// worker can retry it, and the error is printed and counted rather than
+  /// returned so that this worker carries on with the remaining inputs. See
+  /// [`Self::finish()`].
+  ///
+  pub async fn run<E: AsRef<[String]>>(
+    &self,
+    input_source: &InputSource,
+    f: impl AsyncFn() -> Result<(), E>,
+  ) -> Result<(), E> {
+    // Stdin can't be shared between workers
+    let InputSource::Object { .. } = input_source else {
+      return f().await;
+    };
+
+    let key = lease_key(input_source);
+
+    let mut lease = match self.acquire(&key, input_source).await {
+      Ok(LeaseState::Acquired(lease)) => lease,
+
+      Ok(LeaseState::Held | LeaseState::Done) => {
+        self.skipped_count.fetch_add(1, Ordering::Relaxed);
+        return Ok(());
+      }
+
+      Err(e) => crate::utils::exit_with_error(
+        &format!("Acquiring the lease for \"{input_source}\" failed"),
+        e,
+      ),
+    };
+
+    let process = async {
+      let mut result = f().await;
+      for _ in 0..self.retries {
+        if result.is_ok() {
+          break;
+        }
+
+        result = f().await;
+      }
+
+      result
+    };
+
+    // Stop processing the input if the lease is lost, and leave its outcome
+    // to the worker that took it over
+    let result = tokio::select! {
+      result = process => Some(result),
+      () = lease.lost() => None,
+    };
+
+    let Some(result) = result else {
+      self.lease_lost(input_source);
+      return Ok(());
+    };
+
+    if !lease.confirm().await {
+      self.lease_lost(input_source);
+      return Ok(());
+    }
+
+    match result {
+      Ok(()) => {
+        self
+          .put(&self.done_path(&key), "")
+          .await
+          .unwrap_or_else(|e| {
+            crate::utils::exit_with_error(
+              &format!("Marking \"{input_source}\" as done failed"),
+              e,
+            )
+          });
+
+        lease.holder.release().await;
+
+        let size = input_source.size().await.unwrap_or(0);
+        self.completed_count.fetch_add(1, Ordering::Relaxed);
+        self.completed_bytes.fetch_add(size, Ordering::Relaxed);
+      }
+
+      Err(lines) => {
+        lease.holder.release().await;
+
+        error::print_error_lines(lines.as_ref());
+        self.failed_count.fetch_add(1, Ordering::Relaxed);
+      }
+    }
+
+    Ok(())
+  }
+
+  /// Reports that the lease for an input was lost to another worker while it
+  /// was being processed. The input is counted as skipped because the other
+  /// worker processes it.
+  ///
+  fn lease_lost(&self, input_source: &InputSource) {
+    eprintln!(
+      "Worker \"{}\": lease for \"{input_source}\" was taken over by another \
+       worker",
+      self.worker_id
+    );
+
+    self.skipped_count.fetch_add(1, Ordering::Relaxed);
+  }
+
+  /// Prints this worker's throughput to stderr, and returns an error if any
+  /// inputs failed.
+  ///
+  pub fn finish(&self) -> Result<(), ()> {
+    const MIB: f64 = 1024.0 * 1024.0;
+
+    let seconds = self.started_at.elapsed().as_secs_f64().max(1e-9);
+    let completed_count = self.completed_count.load(Ordering::Relaxed);
+    let completed_bytes = self.completed_bytes.load(Ordering::Relaxed) as f64;
+    let failed_count = self.failed_count.load(Ordering::Relaxed);
+
+    eprintln!(
+      "Worker \"{}\": {completed_count} inputs ({:.1} MiB) in {seconds:.1} \
+       seconds, {:.2} inputs/s, {:.1} MiB/s, {} skipped, {failed_count} failed",
+      self.worker_id,
+      completed_bytes / MIB,
+      completed_count as f64 / seconds,
+      completed_bytes / MIB / seconds,
+      self.skipped_count.load(Ordering::Relaxed),
+    );
+
+    if failed_count > 0 { Err(()) } else { Ok(()) }
+  }
+
+  /// Tries to acquire the lease for an input.
+  ///
+  async fn acquire(
+    &self,
+    key: &str,
+    input_source: &InputSource,
+  ) -> Result<LeaseState, object_store::Error> {
+    if self.object_store.head(&self.done_path(key)).await.is_ok() {
+      return Ok(LeaseState::Done);
+    }
+
+    let lease_path = self.lease_path(key);
+    let lease_data = self.lease_data(input_source);
+
+    match self
+      .put_opts(&lease_path, &lease_data, PutMode::Create)
+      .await
+    {
+      Ok(put_result) => {
+        return self
+          .acquired(key, lease_path, input_source, put_result)
+          .await;
+      }
+      Err(object_store::Error::AlreadyExists { .. }) => (),
+      Err(e) => return Err(e),
+    }
+
+    // Check whether the existing lease has expired
+    let existing = self.object_store.get(&lease_path).await?;
+    let update_version = UpdateVersion {
+      e_tag: existing.meta.e_tag.clone(),
+      version: existing.meta.version.clone(),
+    };
+
+    if !is_lease_expired(&existing.bytes().await?) {
+      return Ok(LeaseState::Held);
+    }
+
+    // Take over the expired lease, which fails if another worker has renewed
+    // or taken it over in the meantime
+    let mode = PutMode::Update(update_version);
+    match self.put_opts(&lease_path, &lease_data, mode).await {
+      Ok(put_result) => {
+        self
+          .acquired(key, lease_path, input_source, put_result)
+          .await
+      }
+
+      Err(
+        object_store::Error::Precondition { .. }
+        | object_store::Error::AlreadyExists { .. },
+      ) => Ok(LeaseState::Held),
+
+      // Stores without conditional updates have the expired lease replaced
+      Err(object_store::Error::NotImplemented) => {
+        self.object_store.delete(&lease_path).await?;
+
+        match self
+          .put_opts(&lease_path, &lease_data, PutMode::Create)
+          .await
+        {
+          Ok(put_result) => {
+            self
+              .acquired(key, lease_path, input_source, put_result)
+              .await
+          }
+          Err(object_store::Error::AlreadyExists { .. }) => {
+            Ok(LeaseState::Held)
+          }
+          Err(e) => Err(e),
+        }
+      }
+
+      Err(e) => Err(e),
+    }
+  }
+
+  /// Starts renewing a lease that has been written by this worker, unless the
+  /// input is now done. Another worker can finish the input between the check
+  /// of its done marker and the lease being acquired.
+  ///
+  async fn acquired(
+    &self,
+    key: &str,
+    lease_path: ObjectStorePath,
+    input_source: &InputSource,
+    put_result: PutResult,
+  ) -> Result<LeaseState, object_store::Error> {
+    let lease = self.renew(lease_path, input_source, put_result);
+
+    if self.object_store.head(&self.done_path(key)).await.is_ok() {
+      lease.holder.release().await;
+      return Ok(LeaseState::Done);
+    }
+
+    Ok(LeaseState::Acquired(lease))
+  }
+
+  /// Starts renewing a lease that has been acquired. Renewals happen at a
+  /// third of the lease duration so that a single failed renewal doesn't lose
+  /// the lease. The renewal task ends if the lease is lost.
+  ///
+  fn renew(
+    &self,
+    lease_path: ObjectStorePath,
+    input_source: &InputSource,
+    put_result: PutResult,
+  ) -> Lease {
+    let holder = Arc::new(LeaseHolder {
+      object_store: self.object_store.clone(),
+      path: lease_path,
+      worker_id: self.worker_id.clone(),
+      input: input_source.to_string(),
+      lease_duration: self.lease_duration,
+      version: tokio::sync::Mutex::new(update_version(put_result)),
+    });
+
+    let renewal = tokio::spawn({
+      let holder = holder.clone();
+
+      async move {
+        loop {
+          tokio::time::sleep(holder.lease_duration / 3).await;
+
+          if let Renewal::Lost = holder.renew().await {
+            break;
+          }
+        }
+      }
+    });
+
+    Lease { holder, renewal }
+  }
+
+  fn lease_data(&self, input_source: &InputSource) -> String {
+    lease_data(
+      &self.worker_id,
+      &input_source.to_string(),
+      self.lease_duration,
+    )
+  }
+
+  fn lease_path(&self, key: &str) -> ObjectStorePath {
+    self.prefix.child("leases").child(key)
+  }
+
+  fn done_path(&self, key: &str) -> ObjectStorePath {
+    self.prefix.child("done").child(key)
+  }
+
+  async fn put(
+    &self,
+    path: &ObjectStorePath,
+    data: &str,
+  ) -> Result<(), object_store::Error> {
+    self
+      .put_opts(path, data, PutMode::Overwrite)
+      .await
+      .map(|_| ())
+  }
+
+  async fn put_opts(
+    &self,
+    path: &ObjectStorePath,
+    data: &str,
+    mode: PutMode,
+  ) -> Result<PutResult, object_store::Error> {
+    let options = PutOptions {
+      mode,
+      ..Default::default()
+    };
+
+    self
+      .object_store
+      .put_opts(path, PutPayload::from(data.to_string()), options)
+      .await
+  }
+}
+
+/// Returns the version of an object to make a conditional update to after it
+/// has been written.
+///
+fn update_version(put_result: PutResult) -> UpdateVersion {
+  UpdateVersion {
+    e_tag: put_result.e_tag,
+    version: put_result.version,
+  }
+}
+
+/// Returns the name of the lease and done marker objects for an input, which
+/// is a hash of the input's path.
+///
+fn lease_key(input_source: &InputSource) -> String {
+  // 64-bit FNV-1a
+  let mut hash = 0xcbf2_9ce4_8422_2325u64;
+  for byte in input_source.to_string().bytes() {
+    hash ^= u64::from(byte);
+    hash = hash.wrapping_mul(0x0100_0000_01b3);
+  }
+
+  format!("{hash:016x}")
+}
+
+/// Returns the content of a lease object, which records the worker holding the
+/// lease, the input it's for, and when it expires.
+///
+fn lease_data(
+  worker_id: &str,
+  input: &str,
+  lease_duration: Duration,
+) -> String {
+  serde_json::json!({
+    "worker_id": worker_id,
+    "input": input,
+    "expires_at": (unix_time() + lease_duration).as_secs(),
+  })
+  .to_string()
+}
+
+/// Returns the worker recorded in the content of a lease object.
+///
+fn lease_worker_id(lease_data: &[u8]) -> Option<String> {
+  let lease = serde_json::from_slice::<serde_json::Value>(lease_data).ok()?;
+
+  Some(lease.get("worker_id")?.as_str()?.to_string())
+}
+
+/// Returns whether the content of a lease object shows that it has expired.
+/// Leases that can't be read are treated as expired.
+///
+fn is_lease_expired(lease_data: &[u8]) -> bool {
+  let expires_at = serde_json::from_slice::<serde_json::Value>(lease_data)
+    .ok()
+    .and_then(|lease| lease.get("expires_at")?.as_u64());
+
+  match expires_at {
+    Some(expires_at) => expires_at <= unix_time().as_secs(),
+    None => true,
+  }
+}
+
+fn unix_time() -> Duration {
+  SystemTime::now()
+    .duration_since(UNIX_EPOCH)
+    .unwrap_or_default()
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  use std::path::PathBuf;
+
+  use object_store::memory::InMemory;
+
+  #[test]
+  fn lease_expiry() {
+    let lease = lease_data("a", "b", Duration::from_secs(60));
+    assert!(!is_lease_expired(lease.as_bytes()));
+
+    let lease = lease_data("a", "b", Duration::ZERO);
+    assert!(is_lease_expired(lease.as_bytes()));
+
+    assert!(is_lease_expired(b"not json"));
+  }
+
+  fn test_work_leases(object_store: Arc<InMemory>) -> WorkLeases {
+    WorkLeases::with_object_store(
+      object_store,
+      ObjectStorePath::from("distributed"),
+      "a".to_string(),
+      Duration::from_secs(60),
+      0,
+    )
+  }
+
+  fn test_input_source(object_store: Arc<InMemory>) -> InputSource {
+    InputSource::Object {
+      object_store,
+      object_path: ObjectStorePath::from("input.dcm"),
+      specified_path: PathBuf::from("input.dcm"),
+    }
+  }
+
+  async fn lease_worker(
+    object_store: &InMemory,
+    path: &ObjectStorePath,
+  ) -> Option<String> {
+    let lease = object_store.get(path).await.ok()?.bytes().await.ok()?;
+
+    lease_worker_id(&lease)
+  }
+
+  #[tokio::test]
+  async fn lease_renewal_and_release() {
+    let object_store = Arc::new(InMemory::new());
+    let work_leases = test_work_leases(object_store.clone());
+    let input_source = test_input_source(object_store.clone());
+    let key = lease_key(&input_source);
+    let lease_path = work_leases.lease_path(&key);
+
+    let Ok(LeaseState::Acquired(lease)) =
+      work_leases.acquire(&key, &input_source).await
+    else {
+      panic!("Lease not acquired");
+    };
+
+    assert!(matches!(lease.holder.renew().await, Renewal::Renewed));
+
+    lease.holder.release().await;
+    assert_eq!(lease_worker(&object_store, &lease_path).await, None);
+  }
+
+  #[tokio::test]
+  async fn lease_lost_to_another_worker() {
+    let object_store = Arc::new(InMemory::new());
+    let work_leases = test_work_leases(object_store.clone());
+    let input_source = test_input_source(object_store.clone());
+    let key = lease_key(&input_source);
+    let lease_path = work_leases.lease_path(&key);
+
+    let Ok(LeaseState::Acquired(lease)) =
+      work_leases.acquire(&key, &input_source).await
+    else {
+      panic!("Lease not acquired");
+    };
+
+    let other_lease = lease_data("b", "input.dcm", Duration::from_secs(60));
+    object_store
+      .put(&lease_path, other_lease.into())
+      .await
+      .unwrap();
+
+    assert!(matches!(lease.holder.renew().await, Renewal::Lost));
+    assert!(!lease.confirm().await);
+
+    lease.holder.release().await;
+    assert_eq!(
+      lease_worker(&object_store, &lease_path).await.as_deref(),
+      Some("b")
+    );
+  }
+
+  #[tokio::test]
+  async fn run_stops_when_lease_lost() {
+    let object_store = Arc::new(InMemory::new());
+    let work_leases = test_work_leases(object_store.clone());
+    let input_source = test_input_source(object_store.clone());
+    let key = lease_key(&input_source);
+    let lease_path = work_leases.lease_path(&key);
+
+    let result = work_leases
+      .run(&input_source, async || {
+        let other_lease = lease_data("b", "input.dcm", Duration::from_secs(60));
+        object_store
+          .put(&lease_path, other_lease.into())
+          .await
+          .unwrap();
+
+        Ok::<(), Vec<String>>(())
+      })
+      .await;
+
+    assert!(result.is_ok());
+    assert!(
+      object_store
+        .head(&work_leases.done_path(&key))
+        .await
+        .is_err()
+    );
+    assert_eq!(
+      lease_worker(&object_store, &lease_path).await.as_deref(),
+      Some("b")
+    );
+    assert_eq!(work_leases.skipped_count.load(Ordering::Relaxed), 1);
+    assert_eq!(work_leases.completed_count.load(Ordering::Relaxed), 0);
+  }
+
+  #[tokio::test]
+  async fn lease_acquired_after_input_done() {
+    let object_store = Arc::new(InMemory::new());
+    let work_leases = test_work_leases(object_store.clone());
+    let input_source = test_input_source(object_store.clone());
+    let key = lease_key(&input_source);
+    let lease_path = work_leases.lease_path(&key);
+
+    // Another worker finishes the input after the done marker is checked but
+    // before the lease is written
+    let put_result = work_leases
+      .put_opts(&lease_path, "", PutMode::Create)
+      .await
+      .unwrap();
+    work_leases
+      .put(&work_leases.done_path(&key), "")
+      .await
+      .unwrap();
+
+    let state = work_leases
+      .acquired(&key, lease_path.clone(), &input_source, put_result)
+      .await;
+
+    assert!(matches!(state, Ok(LeaseState::Done)));
+    assert!(object_store.head(&lease_path).await.is_err());
+  }
+}
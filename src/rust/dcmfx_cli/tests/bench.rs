@@ -0,0 +1,27 @@
+mod utils;
+
+use utils::{dcmfx_cli, get_stdout};
+
+#[test]
+fn with_single_transfer_syntax() {
+  let assert = dcmfx_cli()
+    .arg("bench")
+    .arg("../../../test/assets/pydicom/test_files/CT_small.dcm")
+    .arg("../../../test/assets/pydicom/test_files/MR_small.dcm")
+    .arg("--transfer-syntax")
+    .arg("rle-lossless")
+    .assert()
+    .success();
+
+  let stdout = get_stdout(assert);
+  let lines: Vec<_> = stdout.lines().collect();
+
+  assert!(lines.contains(&"CT: 1 files, 1 frames"));
+  assert!(lines.contains(&"MR: 1 files, 1 frames"));
+
+  let result_lines: Vec<_> = lines
+    .iter()
+    .filter(|line| line.ends_with("  RLE Lossless"))
+    .collect();
+  assert_eq!(result_lines.len(), 2);
+}
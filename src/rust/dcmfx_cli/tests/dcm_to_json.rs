@@ -194,6 +194,102 @@ fn with_output_directory() {
   );
 }
 
+#[test]
+fn with_http_multipart_input() {
+  let dicom_files = [
+    "../../../test/assets/pydicom/test_files/SC_rgb_small_odd.dcm",
+    "../../../test/assets/pydicom/test_files/SC_rgb_small_odd_jpeg.dcm",
+  ];
+
+  // Serve the files as a WADO-RS style multipart/related response
+  let mut body = vec![];
+  for dicom_file in dicom_files {
+    body.extend_from_slice(
+      b"--dcmfx-test\r\nContent-Type: application/dicom\r\n\r\n",
+    );
+    body.extend_from_slice(&std::fs::read(dicom_file).unwrap());
+    body.extend_from_slice(b"\r\n");
+  }
+  body.extend_from_slice(b"--dcmfx-test--\r\n");
+
+  let listener = std::net::TcpListener::bind("127.0.0.1:0").unwrap();
+  let url = format!("http://{}/studies/1.2.3", listener.local_addr().unwrap());
+
+  let server = std::thread::spawn(move || {
+    use std::io::{BufRead, Write};
+
+    let (stream, _) = listener.accept().unwrap();
+    let mut reader = std::io::BufReader::new(&stream);
+
+    let mut line = String::new();
+    while reader.read_line(&mut line).unwrap() > 2 {
+      line.clear();
+    }
+
+    write!(
+      &stream,
+      "HTTP/1.1 200 OK\r\n\
+       Content-Type: multipart/related; type=\"application/dicom\"; \
+       boundary=dcmfx-test\r\n\
+       Content-Length: {}\r\n\
+       Connection: close\r\n\r\n",
+      body.len()
+    )
+    .unwrap();
+    (&stream).write_all(&body).unwrap();
+  });
+
+  let output_directory = create_temp_dir();
+  let output_files = [
+    output_directory.path().join("1.2.3-0001.json"),
+    output_directory.path().join("1.2.3-0002.json"),
+  ];
+
+  dcmfx_cli()
+    .arg("dcm-to-json")
+    .arg(&url)
+    .arg("--pretty")
+    .arg("--output-directory")
+    .arg(output_directory.path())
+    .arg("--concurrency")
+    .arg("1")
+    .assert()
+    .success()
+    .stdout(format!(
+      "Writing \"{}\" …\nWriting \"{}\" …\n",
+      output_files[0].display(),
+      output_files[1].display()
+    ));
+
+  server.join().unwrap();
+
+  // The output is the same as when converting the files directly
+  let expected_directory = create_temp_dir();
+  dcmfx_cli()
+    .arg("dcm-to-json")
+    .args(dicom_files)
+    .arg("--pretty")
+    .arg("--output-directory")
+    .arg(expected_directory.path())
+    .assert()
+    .success();
+
+  for (output_file, dicom_file) in output_files.iter().zip(dicom_files) {
+    let expected_file = expected_directory.path().join(format!(
+      "{}.json",
+      std::path::Path::new(dicom_file)
+        .file_name()
+        .unwrap()
+        .display()
+    ));
+
+    assert_eq!(
+      std::fs::read_to_string(output_file).unwrap(),
+      std::fs::read_to_string(expected_file).unwrap()
+    );
+  }
+}
+
 #[test]
 fn with_multiple_inputs() {
   let (input_path_0, output_path_0, _temp_dir_0) = prepare_temp_files(
@@ -1096,6 +1096,78 @@ fn with_selected_frames() {
   }
 }
 
+#[test]
+fn with_selected_frames_read_using_range_requests() {
+  let test_cases = [
+    (
+      "../../../test/assets/pydicom/test_files/rtdose.dcm",
+      "3..5",
+      "bin",
+    ),
+    (
+      "../../../test/assets/pydicom/test_files/rtdose.dcm",
+      "-1",
+      "png",
+    ),
+    (
+      "../../../test/assets/pydicom/test_files/SC_rgb_rle_2frame.dcm",
+      "0",
+      "bin",
+    ),
+    (
+      "../../../test/assets/pydicom/test_files/SC_rgb_rle_2frame.dcm",
+      "1",
+      "png",
+    ),
+  ];
+
+  for (input_file, select_frames, extension) in test_cases {
+    let format = if extension == "png" { "png" } else { "raw" };
+
+    let mut output_files = vec![];
+
+    // Extract the selected frames with and without range requests
+    for no_range_requests in [false, true] {
+      let output_directory = create_temp_dir();
+
+      let mut cmd = dcmfx_cli();
+      cmd
+        .arg("get-pixel-data")
+        .arg(input_file)
+        .arg("--output-directory")
+        .arg(output_directory.path())
+        .arg("--format")
+        .arg(format)
+        .arg(format!("--select-frames={select_frames}"));
+
+      if no_range_requests {
+        cmd.arg("--no-range-requests");
+      }
+
+      cmd.assert().success();
+
+      let mut files = std::fs::read_dir(output_directory.path())
+        .unwrap()
+        .map(|entry| {
+          let path = entry.unwrap().path();
+          assert_eq!(path.extension().unwrap(), extension);
+
+          (
+            path.file_name().unwrap().to_owned(),
+            std::fs::read(path).unwrap(),
+          )
+        })
+        .collect::<Vec<_>>();
+      files.sort();
+
+      output_files.push(files);
+    }
+
+    assert!(!output_files[0].is_empty());
+    assert_eq!(output_files[0], output_files[1]);
+  }
+}
+
 #[tokio::test]
 #[ignore]
 async fn with_s3_input_and_output() {
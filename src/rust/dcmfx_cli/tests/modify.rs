@@ -90,6 +90,100 @@ fn modify_in_place() {
   assert_snapshot!("modify_in_place_after", get_stdout(assert));
 }
 
+#[test]
+fn modify_in_place_header_only() {
+  let input_file = "../../../test/assets/pydicom/test_files/CT_small.dcm";
+  let temp_file = create_temp_file();
+
+  std::fs::copy(input_file, temp_file.path()).unwrap();
+
+  #[cfg(unix)]
+  {
+    use std::os::unix::fs::PermissionsExt;
+
+    std::fs::set_permissions(
+      temp_file.path(),
+      std::fs::Permissions::from_mode(0o640),
+    )
+    .unwrap();
+  }
+
+  let modify_in_place = |tag: &str, overwrite_header: bool| {
+    let mut command = dcmfx_cli();
+    command
+      .arg("modify")
+      .arg(temp_file.path())
+      .arg("--in-place")
+      .arg("--delete")
+      .arg(tag);
+
+    if overwrite_header {
+      command.arg("--in-place-overwrite-header");
+    }
+
+    command.assert().success();
+
+    std::fs::read(temp_file.path()).unwrap()
+  };
+
+  // The first modification grows the header, and the second then fits in the
+  // padding left by the first so it's overwritten directly
+  let first_output = modify_in_place("00100010", false);
+  #[cfg(unix)]
+  let inode = std::os::unix::fs::MetadataExt::ino(
+    &std::fs::metadata(temp_file.path()).unwrap(),
+  );
+  let second_output = modify_in_place("00080050", true);
+  assert_eq!(first_output.len(), second_output.len());
+  #[cfg(unix)]
+  assert_eq!(
+    std::os::unix::fs::MetadataExt::ino(
+      &std::fs::metadata(temp_file.path()).unwrap()
+    ),
+    inode
+  );
+
+  // Deletions also apply to data elements in sequence items
+  let third_output = modify_in_place("00100022", false);
+  assert_eq!(first_output.len(), third_output.len());
+
+  // The file's permissions are kept when it's replaced
+  #[cfg(unix)]
+  {
+    use std::os::unix::fs::PermissionsExt;
+
+    assert_eq!(
+      std::fs::metadata(temp_file.path())
+        .unwrap()
+        .permissions()
+        .mode()
+        & 0o777,
+      0o640
+    );
+  }
+
+  // The pixel data at the end of the file is unchanged
+  let input = std::fs::read(input_file).unwrap();
+  let tail_length = 30_000;
+  assert_eq!(
+    input[input.len() - tail_length..],
+    third_output[third_output.len() - tail_length..]
+  );
+
+  let assert = dcmfx_cli()
+    .arg("print")
+    .arg(temp_file.path())
+    .assert()
+    .success();
+
+  let stdout = get_stdout(assert);
+  assert!(!stdout.contains("Patient's Name"));
+  assert!(!stdout.contains("Accession Number"));
+  assert!(!stdout.contains("Type of Patient ID"));
+  assert!(stdout.contains("Other Patient IDs Sequence"));
+  assert!(stdout.contains("Pixel Data"));
+}
+
 #[tokio::test]
 #[ignore]
 async fn modify_in_place_on_s3() {
@@ -199,6 +293,37 @@ fn errors_on_effort_without_transfer_syntax() {
   );
 }
 
+#[test]
+fn errors_on_in_place_with_lease_prefix() {
+  let assert = dcmfx_cli()
+    .arg("modify")
+    .arg("--lease-prefix")
+    .arg("leases")
+    .arg("--in-place")
+    .arg("tmp.dcm")
+    .assert()
+    .failure();
+
+  assert_snapshot!("errors_on_in_place_with_lease_prefix", get_stderr(assert));
+}
+
+#[test]
+fn errors_on_in_place_overwrite_header_without_in_place() {
+  let assert = dcmfx_cli()
+    .arg("modify")
+    .arg("--in-place-overwrite-header")
+    .arg("--output-filename")
+    .arg("out.dcm")
+    .arg("tmp.dcm")
+    .assert()
+    .failure();
+
+  assert_snapshot!(
+    "errors_on_in_place_overwrite_header_without_in_place",
+    get_stderr(assert)
+  );
+}
+
 #[test]
 fn merge_dicom_json() {
   let temp_dir = create_temp_dir();
@@ -43,6 +43,42 @@ fn rewrite() {
   assert_snapshot!("rewrite_after", get_stdout(assert));
 }
 
+#[test]
+fn rewrite_with_pixel_data_passthrough() {
+  let temp_dir = create_temp_dir();
+
+  for input_file in [
+    "../../../test/assets/pydicom/test_files/CT_small.dcm",
+    "../../../test/assets/pydicom/test_files/SC_rgb_jpeg_dcmtk.dcm",
+  ] {
+    let output_file = temp_dir.path().join("output.dcm");
+
+    // Rewriting to a local file copies the pixel data directly, which must
+    // give the same result as a full rewrite to stdout
+    dcmfx_cli()
+      .arg("rewrite")
+      .arg(input_file)
+      .arg("--output-filename")
+      .arg(&output_file)
+      .arg("--overwrite")
+      .assert()
+      .success();
+
+    let assert = dcmfx_cli()
+      .arg("rewrite")
+      .arg(input_file)
+      .arg("--output-filename")
+      .arg("-")
+      .assert()
+      .success();
+
+    assert_eq!(
+      std::fs::read(&output_file).unwrap(),
+      assert.get_output().stdout
+    );
+  }
+}
+
 #[test]
 fn rewrite_in_place() {
   let input_file = "../../../test/assets/fo-dicom/CR-MONO1-10-chest.dcm";
@@ -107,6 +143,39 @@ async fn rewrite_in_place_on_s3() {
   assert_snapshot!("rewrite_in_place_after", get_stdout(assert));
 }
 
+#[test]
+fn rewrite_with_lease_prefix() {
+  let temp_dir = create_temp_dir();
+  let input_file = "../../../test/assets/fo-dicom/CT-MONO2-16-ankle.dcm";
+  let output_directory = temp_dir.path().join("output");
+  let lease_prefix = temp_dir.path().join("leases");
+
+  let rewrite = || {
+    dcmfx_cli()
+      .arg("rewrite")
+      .arg(input_file)
+      .arg("--output-directory")
+      .arg(&output_directory)
+      .arg("--lease-prefix")
+      .arg(&lease_prefix)
+      .arg("--worker-id")
+      .arg("test")
+      .assert()
+      .success()
+  };
+
+  let assert = rewrite();
+  assert!(get_stderr(assert).starts_with("Worker \"test\": 1 inputs"));
+  assert!(output_directory.join("CT-MONO2-16-ankle.dcm").exists());
+
+  // Inputs that are done are skipped when run again
+  std::fs::remove_dir_all(&output_directory).unwrap();
+
+  let assert = rewrite().stdout("");
+  assert!(get_stderr(assert).contains("1 skipped, 0 failed"));
+  assert!(!output_directory.join("CT-MONO2-16-ankle.dcm").exists());
+}
+
 #[test]
 fn errors_on_missing_file() {
   let assert = dcmfx_cli()
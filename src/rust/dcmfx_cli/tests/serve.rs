@@ -0,0 +1,77 @@
+mod utils;
+
+use std::io::{BufRead, BufReader, Write};
+use std::net::TcpStream;
+use std::process::{Command, Stdio};
+
+use utils::create_temp_dir;
+
+#[test]
+fn with_multiple_jobs() {
+  let mut server = Command::new(assert_cmd::cargo::cargo_bin!("dcmfx_cli"))
+    .arg("serve")
+    .arg("--address")
+    .arg("127.0.0.1:0")
+    .stdout(Stdio::piped())
+    .stderr(Stdio::null())
+    .spawn()
+    .unwrap();
+
+  // Read the address the server is listening on
+  let mut server_stdout = BufReader::new(server.stdout.take().unwrap());
+  let mut line = String::new();
+  server_stdout.read_line(&mut line).unwrap();
+  let address = line.trim().strip_prefix("Listening on ").unwrap();
+
+  let stream = TcpStream::connect(address).unwrap();
+  let mut responses = BufReader::new(stream.try_clone().unwrap()).lines();
+  let mut send_job = |args: serde_json::Value| {
+    writeln!(&stream, "{args}").unwrap();
+    let response = responses.next().unwrap().unwrap();
+    serde_json::from_str::<serde_json::Value>(&response).unwrap()
+  };
+
+  let temp_dir = create_temp_dir();
+  let output_path = temp_dir.path().join("output.json");
+  let input_path =
+    "../../../test/assets/pydicom/test_files/SC_rgb_small_odd.dcm";
+
+  assert_eq!(
+    send_job(serde_json::json!([
+      "dcm-to-json",
+      input_path,
+      "--output-filename",
+      output_path,
+    ])),
+    serde_json::json!({ "success": true })
+  );
+  assert!(output_path.is_file());
+
+  // Invalid jobs are reported as failed without stopping the server
+  assert_eq!(
+    send_job(serde_json::json!(["print", input_path]))["success"],
+    false
+  );
+  assert_eq!(
+    send_job(serde_json::json!(["dcm-to-json", "missing.dcm"])),
+    serde_json::json!({
+      "success": false,
+      "error": "Job failed, details were written to stderr",
+    })
+  );
+
+  std::fs::remove_file(&output_path).unwrap();
+  assert_eq!(
+    send_job(serde_json::json!([
+      "dcm-to-json",
+      input_path,
+      "--output-filename",
+      output_path,
+    ])),
+    serde_json::json!({ "success": true })
+  );
+  assert!(output_path.is_file());
+
+  server.kill().unwrap();
+  server.wait().unwrap();
+}
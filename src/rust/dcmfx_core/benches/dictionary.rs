@@ -0,0 +1,112 @@
+//! Benchmarks lookups in the data element dictionary, reporting the average
+//! time taken by [`dictionary::find()`], [`dictionary::tag_name()`], and
+//! [`dictionary::uid_name()`] for a mix of tags and UIDs that are and aren't in
+//! the dictionary.
+//!
+//! Run with `cargo bench -p dcmfx_core --bench dictionary`.
+
+use std::hint::black_box;
+use std::time::{Duration, Instant};
+
+use dcmfx_core::{DataElementTag, dictionary};
+
+/// The minimum time to spend running each benchmark, after one warm up run.
+const MIN_DURATION: Duration = Duration::from_secs(1);
+
+fn main() {
+  let tags = [
+    dictionary::PATIENT_NAME.tag,
+    dictionary::STUDY_INSTANCE_UID.tag,
+    dictionary::TRANSFER_SYNTAX_UID.tag,
+    dictionary::PIXEL_DATA.tag,
+    dictionary::ROWS.tag,
+    dictionary::ITEM.tag,
+    DataElementTag::new(0x0020, 0x3105),
+    DataElementTag::new(0x6002, 0x3000),
+    DataElementTag::new(0x0029, 0x0010),
+    DataElementTag::new(0x1234, 0x5678),
+  ];
+
+  let private_tags = [
+    (
+      DataElementTag::new(0x0029, 0x1160),
+      "SIEMENS MEDCOM HEADER2",
+    ),
+    (
+      DataElementTag::new(0x0019, 0x1010),
+      "SPI-P-XSB-VISUB Release 1",
+    ),
+    (
+      DataElementTag::new(0x0043, 0x1001),
+      "UNKNOWN PRIVATE CREATOR",
+    ),
+  ];
+
+  let uids = [
+    "1.2.840.10008.1.2.1",
+    "1.2.840.10008.1.2.4.50",
+    "1.2.840.10008.5.1.4.1.1.2",
+    "1.2.840.10008.5.1.4.1.1.77.1.6",
+    "1.2.3.4.5.6.7.8.9",
+  ];
+
+  println!("{:<12} {:>14}", "Lookup", "ns/lookup");
+
+  bench("find", tags.len(), || {
+    for tag in tags {
+      let _ = black_box(dictionary::find(black_box(tag), None));
+    }
+  });
+
+  // Reads only the VRs of the item found, as done when inferring VRs while
+  // reading implicit VR data sets
+  bench("find_vrs", tags.len(), || {
+    for tag in tags {
+      black_box(dictionary::find(black_box(tag), None).map(|item| item.vrs));
+    }
+  });
+
+  bench("find_private", private_tags.len(), || {
+    for (tag, private_creator) in private_tags {
+      let _ = black_box(dictionary::find(
+        black_box(tag),
+        Some(black_box(private_creator)),
+      ));
+    }
+  });
+
+  bench("tag_name", tags.len(), || {
+    for tag in tags {
+      black_box(dictionary::tag_name(black_box(tag), None));
+    }
+  });
+
+  bench("uid_name", uids.len(), || {
+    for uid in uids {
+      let _ = black_box(dictionary::uid_name(black_box(uid)));
+    }
+  });
+}
+
+/// Runs a benchmark for at least [`MIN_DURATION`] and prints the average time
+/// taken per lookup. Each call to `f` performs `lookup_count` lookups.
+///
+fn bench(name: &str, lookup_count: usize, mut f: impl FnMut()) {
+  f();
+
+  let start = Instant::now();
+  let mut iterations = 0u64;
+
+  while start.elapsed() < MIN_DURATION {
+    for _ in 0..1000 {
+      f();
+    }
+
+    iterations += 1000;
+  }
+
+  let nanoseconds = start.elapsed().as_nanos() as f64
+    / (iterations as f64 * lookup_count as f64);
+
+  println!("{name:<12} {nanoseconds:>14.1}");
+}
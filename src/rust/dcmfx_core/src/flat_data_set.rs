@@ -0,0 +1,651 @@
+//! An immutable DICOM data set stored in a flat layout, which is faster to
+//! build, look up, and iterate than a [`DataSet`] in read-heavy workloads.
+
+#[cfg(not(feature = "std"))]
+use alloc::{vec, vec::Vec};
+
+use crate::{
+  DataElementTag, DataElementValue, DataError, DataSet, DataSetPath,
+};
+
+/// An immutable data set in which the data elements of the root data set and
+/// of every nested sequence item are stored in shared arrays, rather than in a
+/// separate map for each data set.
+///
+/// Each data set's data elements occupy a contiguous range of those arrays,
+/// sorted by tag. The tags are held in their own array apart from the values,
+/// so looking up a tag is a binary search over densely packed tags, and
+/// iterating a data set reads its tags and values sequentially rather than
+/// following a pointer for each data element.
+///
+/// A flat data set is built from a [`DataSet`], or in a single pass with a
+/// [`FlatDataSetWriter`], e.g. from a stream of DICOM P10 tokens. Values are
+/// read through [`FlatDataSetRef`], which is returned by [`Self::root()`] for
+/// the root data set and when reading sequence items.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct FlatDataSet {
+  tags: Vec<DataElementTag>,
+  values: Vec<FlatValue>,
+
+  /// The range of data elements in each data set. The root data set is last.
+  data_sets: Vec<(u32, u32)>,
+
+  /// The indices in `data_sets` of the items of every sequence, with the items
+  /// of each sequence stored contiguously.
+  sequence_items: Vec<u32>,
+}
+
+/// The value of a data element in a [`FlatDataSet`].
+///
+#[derive(Clone, Debug, PartialEq)]
+enum FlatValue {
+  Value(DataElementValue),
+
+  /// A sequence, holding the range of its items in `sequence_items`.
+  Sequence(u32, u32),
+}
+
+impl FlatDataSet {
+  /// Returns the root data set.
+  ///
+  pub fn root(&self) -> FlatDataSetRef<'_> {
+    FlatDataSetRef {
+      flat_data_set: self,
+      range: self.data_sets.last().copied().unwrap_or_default(),
+    }
+  }
+
+  /// Converts a data set to a flat data set.
+  ///
+  pub fn from_data_set(data_set: &DataSet) -> Self {
+    let mut writer = FlatDataSetWriter::new();
+    writer.insert_data_set(data_set);
+    writer.finish()
+  }
+
+  /// Converts a flat data set back to a [`DataSet`].
+  ///
+  pub fn to_data_set(&self) -> DataSet {
+    self.root().to_data_set()
+  }
+}
+
+impl From<&DataSet> for FlatDataSet {
+  fn from(data_set: &DataSet) -> Self {
+    Self::from_data_set(data_set)
+  }
+}
+
+impl From<&FlatDataSet> for DataSet {
+  fn from(flat_data_set: &FlatDataSet) -> Self {
+    flat_data_set.to_data_set()
+  }
+}
+
+/// A reference to one of the data sets in a [`FlatDataSet`], either its root
+/// data set or a sequence item.
+///
+#[derive(Clone, Copy, Debug)]
+pub struct FlatDataSetRef<'a> {
+  flat_data_set: &'a FlatDataSet,
+  range: (u32, u32),
+}
+
+/// A reference to the value of a data element in a [`FlatDataSet`].
+///
+#[derive(Clone, Copy, Debug)]
+pub enum FlatDataElementValue<'a> {
+  /// A data element value that isn't a sequence.
+  Value(&'a DataElementValue),
+
+  /// A sequence of data sets.
+  Sequence(FlatSequence<'a>),
+}
+
+/// A reference to the items of a sequence in a [`FlatDataSet`].
+///
+#[derive(Clone, Copy, Debug)]
+pub struct FlatSequence<'a> {
+  flat_data_set: &'a FlatDataSet,
+  range: (u32, u32),
+}
+
+impl<'a> FlatDataSetRef<'a> {
+  fn tags(&self) -> &'a [DataElementTag] {
+    &self.flat_data_set.tags[self.range.0 as usize..self.range.1 as usize]
+  }
+
+  fn values(&self) -> &'a [FlatValue] {
+    &self.flat_data_set.values[self.range.0 as usize..self.range.1 as usize]
+  }
+
+  fn value_ref(&self, value: &'a FlatValue) -> FlatDataElementValue<'a> {
+    match value {
+      FlatValue::Value(value) => FlatDataElementValue::Value(value),
+      FlatValue::Sequence(start, end) => {
+        FlatDataElementValue::Sequence(FlatSequence {
+          flat_data_set: self.flat_data_set,
+          range: (*start, *end),
+        })
+      }
+    }
+  }
+
+  /// Returns the number of data elements in the data set.
+  ///
+  pub fn size(&self) -> usize {
+    (self.range.1 - self.range.0) as usize
+  }
+
+  /// Returns whether the data set is empty and contains no data elements.
+  ///
+  pub fn is_empty(&self) -> bool {
+    self.size() == 0
+  }
+
+  /// Returns whether a data element with the specified tag exists in the data
+  /// set.
+  ///
+  pub fn has(&self, tag: DataElementTag) -> bool {
+    self.tags().binary_search(&tag).is_ok()
+  }
+
+  /// Returns the value of the data element with the specified tag, if it's
+  /// present.
+  ///
+  pub fn get(&self, tag: DataElementTag) -> Option<FlatDataElementValue<'a>> {
+    let index = self.tags().binary_search(&tag).ok()?;
+
+    Some(self.value_ref(&self.values()[index]))
+  }
+
+  /// Returns the data element value for the specified tag in the data set. If
+  /// the data element is a sequence then an error is returned, and its items
+  /// should be read with [`Self::get_sequence_items()`].
+  ///
+  pub fn get_value(
+    &self,
+    tag: DataElementTag,
+  ) -> Result<&'a DataElementValue, DataError> {
+    match self.get(tag) {
+      Some(FlatDataElementValue::Value(value)) => Ok(value),
+      Some(FlatDataElementValue::Sequence(..)) => Err(
+        DataError::new_value_not_present()
+          .with_path(&DataSetPath::new_with_data_element(tag)),
+      ),
+      None => Err(
+        DataError::new_tag_not_present()
+          .with_path(&DataSetPath::new_with_data_element(tag)),
+      ),
+    }
+  }
+
+  /// Returns the singular string value for a data element in the data set. If
+  /// the data element with the specified tag does not hold exactly one string
+  /// value then an error is returned.
+  ///
+  pub fn get_string(&self, tag: DataElementTag) -> Result<&'a str, DataError> {
+    self
+      .get_value(tag)?
+      .get_string()
+      .map_err(|e| e.with_path(&DataSetPath::new_with_data_element(tag)))
+  }
+
+  /// Returns the sequence items for a data element in the data set. If the
+  /// data element with the specified tag is not a sequence then an error is
+  /// returned.
+  ///
+  pub fn get_sequence_items(
+    &self,
+    tag: DataElementTag,
+  ) -> Result<FlatSequence<'a>, DataError> {
+    match self.get(tag) {
+      Some(FlatDataElementValue::Sequence(sequence)) => Ok(sequence),
+      Some(FlatDataElementValue::Value(..)) => Err(
+        DataError::new_value_not_present()
+          .with_path(&DataSetPath::new_with_data_element(tag)),
+      ),
+      None => Err(
+        DataError::new_tag_not_present()
+          .with_path(&DataSetPath::new_with_data_element(tag)),
+      ),
+    }
+  }
+
+  /// Returns an iterator over the data set's elements, sorted by tag.
+  ///
+  pub fn iter(
+    &self,
+  ) -> impl ExactSizeIterator<Item = (DataElementTag, FlatDataElementValue<'a>)>
+  {
+    let data_set = *self;
+
+    self
+      .tags()
+      .iter()
+      .zip(self.values())
+      .map(move |(tag, value)| (*tag, data_set.value_ref(value)))
+  }
+
+  /// Converts the data set to a [`DataSet`].
+  ///
+  pub fn to_data_set(&self) -> DataSet {
+    self
+      .iter()
+      .map(|(tag, value)| {
+        let value = match value {
+          FlatDataElementValue::Value(value) => value.clone(),
+          FlatDataElementValue::Sequence(sequence) => {
+            DataElementValue::new_sequence(
+              sequence.iter().map(|item| item.to_data_set()).collect(),
+            )
+          }
+        };
+
+        (tag, value)
+      })
+      .collect()
+  }
+}
+
+impl<'a> FlatSequence<'a> {
+  /// Returns the number of items in the sequence.
+  ///
+  pub fn len(&self) -> usize {
+    (self.range.1 - self.range.0) as usize
+  }
+
+  /// Returns whether the sequence has no items.
+  ///
+  pub fn is_empty(&self) -> bool {
+    self.len() == 0
+  }
+
+  /// Returns the sequence item at the given index.
+  ///
+  pub fn get(&self, index: usize) -> Option<FlatDataSetRef<'a>> {
+    let data_set_index = *self
+      .flat_data_set
+      .sequence_items
+      .get(self.range.0 as usize..self.range.1 as usize)?
+      .get(index)?;
+
+    Some(FlatDataSetRef {
+      flat_data_set: self.flat_data_set,
+      range: self.flat_data_set.data_sets[data_set_index as usize],
+    })
+  }
+
+  /// Returns an iterator over the sequence's items.
+  ///
+  pub fn iter(&self) -> impl ExactSizeIterator<Item = FlatDataSetRef<'a>> {
+    let flat_data_set = self.flat_data_set;
+
+    flat_data_set.sequence_items[self.range.0 as usize..self.range.1 as usize]
+      .iter()
+      .map(move |index| FlatDataSetRef {
+        flat_data_set,
+        range: flat_data_set.data_sets[*index as usize],
+      })
+  }
+}
+
+/// Builds a [`FlatDataSet`] in a single pass. Data elements are inserted into
+/// the current data set, which starts as the root data set, and sequences and
+/// their items are opened and closed around the data elements they contain.
+///
+/// Each data set's data elements are gathered until it's closed, and are then
+/// sorted by tag and moved into the flat data set's arrays. Data elements that
+/// are inserted in tag order, as they are when read from DICOM P10 data, don't
+/// need to be reordered. If a tag is inserted more than once into the same
+/// data set then its last value is kept.
+///
+#[derive(Debug)]
+pub struct FlatDataSetWriter {
+  flat_data_set: FlatDataSet,
+  location: Vec<WriterLocation>,
+}
+
+#[derive(Debug)]
+enum WriterLocation {
+  DataSet {
+    elements: Vec<(DataElementTag, FlatValue)>,
+  },
+  Sequence {
+    tag: DataElementTag,
+    items: Vec<u32>,
+  },
+}
+
+impl Default for FlatDataSetWriter {
+  fn default() -> Self {
+    Self::new()
+  }
+}
+
+impl FlatDataSetWriter {
+  /// Creates a new writer with an empty root data set.
+  ///
+  pub fn new() -> Self {
+    Self {
+      flat_data_set: FlatDataSet {
+        tags: vec![],
+        values: vec![],
+        data_sets: vec![],
+        sequence_items: vec![],
+      },
+      location: vec![WriterLocation::DataSet { elements: vec![] }],
+    }
+  }
+
+  /// Returns whether the writer is in a sequence, i.e. a sequence has been
+  /// started and no item is currently open in it.
+  ///
+  pub fn is_in_sequence(&self) -> bool {
+    matches!(self.location.last(), Some(WriterLocation::Sequence { .. }))
+  }
+
+  /// Inserts a data element into the current data set. Sequence values are
+  /// stored in the flat layout along with all their nested data sets.
+  ///
+  /// # Panics
+  ///
+  /// Panics if the writer is in a sequence rather than a data set.
+  ///
+  pub fn insert(&mut self, tag: DataElementTag, value: &DataElementValue) {
+    match value.sequence_items() {
+      Ok(items) => {
+        self.begin_sequence(tag);
+
+        for item in items {
+          self.begin_item();
+          self.insert_data_set(item);
+          self.end_item();
+        }
+
+        self.end_sequence();
+      }
+
+      Err(_) => self.push_element(tag, FlatValue::Value(value.clone())),
+    }
+  }
+
+  /// Inserts all the data elements of a data set into the current data set.
+  ///
+  /// # Panics
+  ///
+  /// Panics if the writer is in a sequence rather than a data set.
+  ///
+  pub fn insert_data_set(&mut self, data_set: &DataSet) {
+    for (tag, value) in data_set.iter() {
+      self.insert(*tag, value);
+    }
+  }
+
+  /// Starts a sequence in the current data set. Its items are then added with
+  /// [`Self::begin_item()`] and [`Self::end_item()`].
+  ///
+  /// # Panics
+  ///
+  /// Panics if the writer is in a sequence rather than a data set.
+  ///
+  pub fn begin_sequence(&mut self, tag: DataElementTag) {
+    assert!(!self.is_in_sequence(), "Sequence started inside a sequence");
+
+    self
+      .location
+      .push(WriterLocation::Sequence { tag, items: vec![] });
+  }
+
+  /// Ends the current sequence, and inserts it into the data set it was
+  /// started in.
+  ///
+  /// # Panics
+  ///
+  /// Panics if the writer isn't in a sequence.
+  ///
+  pub fn end_sequence(&mut self) {
+    let Some(WriterLocation::Sequence { tag, items }) = self.location.pop()
+    else {
+      panic!("Sequence ended outside of a sequence");
+    };
+
+    let sequence_items = &mut self.flat_data_set.sequence_items;
+    let start = sequence_items.len() as u32;
+    sequence_items.extend(items);
+    let end = sequence_items.len() as u32;
+
+    self.push_element(tag, FlatValue::Sequence(start, end));
+  }
+
+  /// Starts a new item in the current sequence.
+  ///
+  /// # Panics
+  ///
+  /// Panics if the writer isn't in a sequence.
+  ///
+  pub fn begin_item(&mut self) {
+    assert!(self.is_in_sequence(), "Item started outside of a sequence");
+
+    self
+      .location
+      .push(WriterLocation::DataSet { elements: vec![] });
+  }
+
+  /// Ends the current item and adds it to its sequence.
+  ///
+  /// # Panics
+  ///
+  /// Panics if the writer isn't in a sequence item.
+  ///
+  pub fn end_item(&mut self) {
+    assert!(
+      self.location.len() > 1 && !self.is_in_sequence(),
+      "Item ended outside of an item"
+    );
+
+    let Some(WriterLocation::DataSet { elements }) = self.location.pop() else {
+      unreachable!();
+    };
+
+    let index = self.write_data_set(elements);
+
+    if let Some(WriterLocation::Sequence { items, .. }) =
+      self.location.last_mut()
+    {
+      items.push(index);
+    }
+  }
+
+  /// Returns the flat data set, closing any sequences and items that are still
+  /// open.
+  ///
+  pub fn finish(mut self) -> FlatDataSet {
+    while self.location.len() > 1 {
+      if self.is_in_sequence() {
+        self.end_sequence();
+      } else {
+        self.end_item();
+      }
+    }
+
+    if let Some(WriterLocation::DataSet { elements }) = self.location.pop() {
+      self.write_data_set(elements);
+    }
+
+    self.flat_data_set
+  }
+
+  fn push_element(&mut self, tag: DataElementTag, value: FlatValue) {
+    match self.location.last_mut() {
+      Some(WriterLocation::DataSet { elements }) => elements.push((tag, value)),
+      _ => panic!("Data element inserted into a sequence"),
+    }
+  }
+
+  /// Sorts a data set's data elements by tag and moves them to the end of the
+  /// flat data set's arrays. Returns the index of the data set.
+  ///
+  fn write_data_set(
+    &mut self,
+    mut elements: Vec<(DataElementTag, FlatValue)>,
+  ) -> u32 {
+    if !elements.is_sorted_by(|a, b| a.0 < b.0) {
+      elements.sort_by_key(|(tag, _)| *tag);
+
+      // Keep the last value inserted for each tag
+      elements.dedup_by(|next, kept| {
+        if next.0 == kept.0 {
+          core::mem::swap(next, kept);
+          true
+        } else {
+          false
+        }
+      });
+    }
+
+    let flat_data_set = &mut self.flat_data_set;
+
+    let start = flat_data_set.tags.len() as u32;
+
+    flat_data_set.tags.reserve(elements.len());
+    flat_data_set.values.reserve(elements.len());
+    for (tag, value) in elements {
+      flat_data_set.tags.push(tag);
+      flat_data_set.values.push(value);
+    }
+
+    let end = flat_data_set.tags.len() as u32;
+
+    flat_data_set.data_sets.push((start, end));
+
+    flat_data_set.data_sets.len() as u32 - 1
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[cfg(not(feature = "std"))]
+  use alloc::vec;
+
+  use crate::{ValueRepresentation, dictionary};
+
+  fn test_data_set() -> DataSet {
+    let mut item = DataSet::new();
+    item
+      .insert_string_value(&dictionary::CODE_VALUE, &["123"])
+      .unwrap();
+
+    let mut data_set = DataSet::new();
+    data_set
+      .insert_string_value(&dictionary::PATIENT_ID, &["ID"])
+      .unwrap();
+    data_set
+      .insert_string_value(&dictionary::MODALITY, &["CT"])
+      .unwrap();
+    data_set.insert(
+      dictionary::ANATOMIC_REGION_SEQUENCE.tag,
+      DataElementValue::new_sequence(vec![item.clone(), DataSet::new()]),
+    );
+    data_set.insert(
+      dictionary::REFERENCED_IMAGE_SEQUENCE.tag,
+      DataElementValue::new_sequence(vec![]),
+    );
+
+    data_set
+  }
+
+  #[test]
+  fn round_trip() {
+    let data_set = test_data_set();
+    let flat_data_set = FlatDataSet::from_data_set(&data_set);
+
+    assert_eq!(flat_data_set.to_data_set(), data_set);
+    assert_eq!(flat_data_set.root().size(), 4);
+    assert_eq!(
+      flat_data_set
+        .root()
+        .iter()
+        .map(|(tag, _)| tag)
+        .collect::<Vec<_>>(),
+      data_set.tags()
+    );
+  }
+
+  #[test]
+  fn lookup() {
+    let flat_data_set = FlatDataSet::from_data_set(&test_data_set());
+    let root = flat_data_set.root();
+
+    assert_eq!(root.get_string(dictionary::MODALITY.tag), Ok("CT"));
+    assert!(!root.has(dictionary::ROWS.tag));
+    assert_eq!(
+      root.get_value(dictionary::ROWS.tag),
+      Err(
+        DataError::new_tag_not_present()
+          .with_path(&DataSetPath::new_with_data_element(dictionary::ROWS.tag))
+      )
+    );
+    assert!(
+      root
+        .get_value(dictionary::ANATOMIC_REGION_SEQUENCE.tag)
+        .is_err()
+    );
+
+    let items = root
+      .get_sequence_items(dictionary::ANATOMIC_REGION_SEQUENCE.tag)
+      .unwrap();
+    assert_eq!(items.len(), 2);
+    assert_eq!(
+      items.get(0).unwrap().get_string(dictionary::CODE_VALUE.tag),
+      Ok("123")
+    );
+    assert!(items.get(1).unwrap().is_empty());
+    assert!(items.get(2).is_none());
+  }
+
+  #[test]
+  fn writer_sorts_elements() {
+    let value = |s: &str| DataElementValue::new_short_string(&[s]).unwrap();
+
+    let mut writer = FlatDataSetWriter::new();
+    writer.insert(dictionary::MODALITY.tag, &value("MR"));
+    writer.begin_sequence(dictionary::ANATOMIC_REGION_SEQUENCE.tag);
+    writer.begin_item();
+    writer.insert(dictionary::CODE_MEANING.tag, &value("1"));
+    writer.insert(dictionary::CODE_VALUE.tag, &value("2"));
+    writer.end_item();
+    writer.end_sequence();
+    writer.insert(dictionary::MODALITY.tag, &value("CT"));
+    writer.insert(
+      dictionary::PATIENT_ID.tag,
+      &DataElementValue::new_binary_unchecked(
+        ValueRepresentation::LongString,
+        b"ID".to_vec().into(),
+      ),
+    );
+
+    let flat_data_set = writer.finish();
+    let data_set = flat_data_set.to_data_set();
+
+    assert_eq!(data_set.get_string(dictionary::MODALITY.tag), Ok("CT"));
+    assert_eq!(
+      data_set
+        .get_sequence_items(dictionary::ANATOMIC_REGION_SEQUENCE.tag)
+        .unwrap()[0]
+        .tags(),
+      vec![dictionary::CODE_VALUE.tag, dictionary::CODE_MEANING.tag]
+    );
+    assert_eq!(
+      flat_data_set
+        .root()
+        .iter()
+        .map(|(tag, _)| tag)
+        .collect::<Vec<_>>(),
+      data_set.tags()
+    );
+  }
+}
@@ -15,6 +15,7 @@ pub mod data_set;
 pub mod data_set_path;
 pub mod dictionary;
 pub mod error;
+pub mod flat_data_set;
 pub mod iod_module;
 pub mod iods;
 pub mod transfer_syntax;
@@ -36,6 +37,7 @@ pub use data_set::DataSet;
 pub use data_set::print::DataSetPrintOptions;
 pub use data_set_path::DataSetPath;
 pub use error::DcmfxError;
+pub use flat_data_set::{FlatDataSet, FlatDataSetRef, FlatDataSetWriter};
 pub use iod_module::IodModule;
 pub use transfer_syntax::TransferSyntax;
 pub use utils::{Rc, RcByteSlice};
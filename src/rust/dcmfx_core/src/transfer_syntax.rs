@@ -735,6 +735,15 @@ impl TransferSyntax {
       || self == &HIGH_THROUGHPUT_JPEG_2000
   }
 
+  /// Returns whether this transfer syntax is one of the three JPEG XL transfer
+  /// syntaxes.
+  ///
+  pub fn is_jpeg_xl(&self) -> bool {
+    self == &JPEG_XL_LOSSLESS
+      || self == &JPEG_XL_JPEG_RECOMPRESSION
+      || self == &JPEG_XL
+  }
+
   /// Returns whether this transfer syntax supports the `PALETTE_COLOR`
   /// photometric interpretation.
   ///
@@ -7,19 +7,38 @@ pub type Rc<T> = std::sync::Arc<T>;
 #[cfg(not(feature = "std"))]
 pub type Rc<T> = alloc::rc::Rc<T>;
 
-/// A reference counted byte slice holds an `Rc<Vec<u8>>` to a shareable buffer,
-/// along with a range that specifies the part of that buffer that this slice
-/// refers to.
+/// A reference counted byte slice holds a reference counted pointer to a
+/// shareable buffer, along with a range that specifies the part of that buffer
+/// that this slice refers to. The buffer is usually an `Rc<Vec<u8>>`, but can
+/// also be owned by something else, e.g. a memory mapped file, see
+/// [`RcByteSlice::from_owner()`].
 ///
 /// This type is used widely to avoid copying buffers wherever possible, and in
 /// most cases can be used like a `&[u8]` would be.
 ///
 #[derive(Clone)]
 pub struct RcByteSlice {
-  data: Rc<Vec<u8>>,
+  data: RcByteSliceData,
   range: core::ops::Range<usize>,
 }
 
+/// The buffer referred to by a reference counted byte slice.
+///
+#[derive(Clone)]
+enum RcByteSliceData {
+  Vec(Rc<Vec<u8>>),
+  Owner(Rc<dyn AsRef<[u8]> + Send + Sync>),
+}
+
+impl RcByteSliceData {
+  fn as_slice(&self) -> &[u8] {
+    match self {
+      Self::Vec(data) => data.as_slice(),
+      Self::Owner(owner) => (**owner).as_ref(),
+    }
+  }
+}
+
 impl RcByteSlice {
   /// Creates a new referenced counted byte slice from a `Vec<u8>`.
   ///
@@ -27,7 +46,23 @@ impl RcByteSlice {
     let range = 0..data.len();
 
     Self {
-      data: Rc::new(data),
+      data: RcByteSliceData::Vec(Rc::new(data)),
+      range,
+    }
+  }
+
+  /// Creates a new reference counted byte slice that refers to all the bytes
+  /// of a buffer which is owned by something other than a `Vec<u8>`, such as a
+  /// memory mapped file. The owner is kept alive until the last slice that
+  /// refers to it is dropped.
+  ///
+  /// The bytes returned by the owner must not change while it is alive.
+  ///
+  pub fn from_owner<T: AsRef<[u8]> + Send + Sync + 'static>(owner: T) -> Self {
+    let range = 0..owner.as_ref().len();
+
+    Self {
+      data: RcByteSliceData::Owner(Rc::new(owner)),
       range,
     }
   }
@@ -36,7 +71,7 @@ impl RcByteSlice {
   ///
   pub fn empty() -> Self {
     Self {
-      data: Rc::new(vec![]),
+      data: RcByteSliceData::Vec(Rc::new(vec![])),
       range: 0..0,
     }
   }
@@ -74,21 +109,24 @@ impl RcByteSlice {
   /// Avoids a copy when possible.
   ///
   /// This function copies data if there are multiple references to the
-  /// underlying buffer, or its slice bounds do not cover the whole buffer.
+  /// underlying buffer, its slice bounds do not cover the whole buffer, or the
+  /// buffer is not owned by a `Vec<u8>`.
   ///
   pub fn into_vec(self) -> Vec<u8> {
-    if self.range == (0..self.data.len()) {
-      match Rc::try_unwrap(self.data) {
-        Ok(data) => data,
-        Err(data_rc) => data_rc[self.range.clone()].to_vec(),
+    match self.data {
+      RcByteSliceData::Vec(data) if self.range == (0..data.len()) => {
+        match Rc::try_unwrap(data) {
+          Ok(data) => data,
+          Err(data_rc) => data_rc[self.range].to_vec(),
+        }
       }
-    } else {
-      self.as_slice().to_vec()
+
+      data => data.as_slice()[self.range].to_vec(),
     }
   }
 
   fn as_slice(&self) -> &[u8] {
-    &self.data[self.range.clone()]
+    &self.data.as_slice()[self.range.clone()]
   }
 }
 
@@ -151,6 +189,17 @@ mod tests {
   #[cfg(not(feature = "std"))]
   use alloc::string::ToString;
 
+  #[test]
+  fn rc_byte_slice_from_owner_test() {
+    let bytes: &'static [u8] = &[1, 2, 3, 4, 5];
+
+    let slice = RcByteSlice::from_owner(bytes);
+    assert_eq!(*slice, [1, 2, 3, 4, 5]);
+    assert_eq!(*slice.slice(1, 4).drop(1), [3, 4]);
+    assert_eq!(slice.take(2).into_vec(), vec![1, 2]);
+    assert_eq!(slice, RcByteSlice::from_vec(vec![1, 2, 3, 4, 5]));
+  }
+
   #[test]
   fn inspect_u8_slice_test() {
     assert_eq!(
@@ -455,8 +455,8 @@ impl ValueRepresentation {
       | ValueRepresentation::OtherWordString
       | ValueRepresentation::SignedShort
       | ValueRepresentation::UnsignedShort => {
-        for i in 0..(bytes.len() / 2) {
-          bytes.swap(i * 2, i * 2 + 1);
+        for chunk in bytes.as_chunks_mut::<2>().0 {
+          *chunk = u16::from_ne_bytes(*chunk).swap_bytes().to_ne_bytes();
         }
       }
 
@@ -465,9 +465,8 @@ impl ValueRepresentation {
       | ValueRepresentation::OtherLongString
       | ValueRepresentation::SignedLong
       | ValueRepresentation::UnsignedLong => {
-        for i in 0..(bytes.len() / 4) {
-          bytes.swap(i * 4, i * 4 + 3);
-          bytes.swap(i * 4 + 1, i * 4 + 2);
+        for chunk in bytes.as_chunks_mut::<4>().0 {
+          *chunk = u32::from_ne_bytes(*chunk).swap_bytes().to_ne_bytes();
         }
       }
 
@@ -476,11 +475,8 @@ impl ValueRepresentation {
       | ValueRepresentation::OtherVeryLongString
       | ValueRepresentation::SignedVeryLong
       | ValueRepresentation::UnsignedVeryLong => {
-        for i in 0..(bytes.len() / 8) {
-          bytes.swap(i * 8, i * 8 + 7);
-          bytes.swap(i * 8 + 1, i * 8 + 6);
-          bytes.swap(i * 8 + 2, i * 8 + 5);
-          bytes.swap(i * 8 + 3, i * 8 + 4);
+        for chunk in bytes.as_chunks_mut::<8>().0 {
+          *chunk = u64::from_ne_bytes(*chunk).swap_bytes().to_ne_bytes();
         }
       }
 
@@ -0,0 +1,68 @@
+//! Benchmarks reading DICOM JSON into a data set, which is what `json-to-dcm`
+//! spends most of its time doing, reporting the throughput in MiB per second.
+//!
+//! For comparison, the time taken to only parse the same JSON into a tree of
+//! `serde_json::Value`s is also reported. This is the cost that reading DICOM
+//! JSON without building an intermediate JSON tree avoids.
+//!
+//! Run with `cargo bench -p dcmfx_json --bench from_json`.
+
+use std::hint::black_box;
+use std::time::{Duration, Instant};
+
+use dcmfx_core::DataSet;
+use dcmfx_json::DataSetJsonExtensions;
+
+/// The DICOM JSON files to benchmark. The first is mostly nested sequences of
+/// string values, and the second is mostly InlineBinary pixel data.
+const TEST_FILES: [&str; 2] = [
+  concat!(
+    env!("CARGO_MANIFEST_DIR"),
+    "/../../../test/assets/pydicom/test_files/test-SR.dcm.json"
+  ),
+  concat!(
+    env!("CARGO_MANIFEST_DIR"),
+    "/../../../test/assets/other/xa_modality_anon.dcm.json"
+  ),
+];
+
+/// The minimum time to spend running each benchmark, after one warm up run.
+const MIN_DURATION: Duration = Duration::from_secs(1);
+
+fn main() {
+  println!("{:<24} {:<18} {:>10}", "File", "Parser", "MiB/s");
+
+  for test_file in TEST_FILES {
+    let json = std::fs::read_to_string(test_file).unwrap();
+    let name = test_file.rsplit('/').next().unwrap();
+
+    bench(name, "from_json", &json, |json| {
+      black_box(DataSet::from_json(json).unwrap());
+    });
+
+    bench(name, "serde_json::Value", &json, |json| {
+      black_box(serde_json::from_str::<serde_json::Value>(json).unwrap());
+    });
+  }
+}
+
+/// Runs a benchmark for at least [`MIN_DURATION`] and prints its throughput.
+///
+fn bench(file: &str, parser: &str, json: &str, mut f: impl FnMut(&str)) {
+  f(json);
+
+  let mut iterations = 0u64;
+  let start = Instant::now();
+
+  while start.elapsed() < MIN_DURATION {
+    f(json);
+    iterations += 1;
+  }
+
+  let seconds = start.elapsed().as_secs_f64() / iterations as f64;
+
+  println!(
+    "{file:<24} {parser:<18} {:>10.1}",
+    json.len() as f64 / seconds / (1024.0 * 1024.0)
+  );
+}
@@ -1,3 +1,16 @@
+//! Reads DICOM JSON into a data set.
+//!
+//! The JSON is deserialized straight into data elements as it is parsed using
+//! serde's seed and visitor APIs, rather than first being parsed into a tree
+//! of `serde_json::Value`s that is then converted. This avoids allocating a
+//! map entry, a string, and a value for every part of the input, which is
+//! most of the cost of reading large DICOM JSON files.
+//!
+//! String values are appended directly into the bytes of their data element,
+//! sequences are read item by item, and InlineBinary values are Base64 decoded
+//! straight from the input using SIMD. The remaining value types are small and
+//! are read via a `serde_json::Value`.
+
 #[cfg(not(feature = "std"))]
 use alloc::{
   format,
@@ -6,8 +19,13 @@ use alloc::{
   vec::Vec,
 };
 
-use base64::prelude::*;
+use core::fmt;
+
 use byteorder::ByteOrder;
+use serde::de::{
+  self, DeserializeSeed, Deserializer, IgnoredAny, MapAccess, SeqAccess,
+  Visitor,
+};
 
 use dcmfx_core::{
   DataElementTag, DataElementValue, DataSet, DataSetPath, RcByteSlice,
@@ -16,204 +34,642 @@ use dcmfx_core::{
 
 use crate::json_error::JsonDeserializeError;
 
-/// Converts DICOM JSON into a data set. This is used to read the root data set
-/// and also recursively when reading sequences.
+/// Converts DICOM JSON into a data set.
 ///
 pub fn convert_json_to_data_set(
-  data_set_json: serde_json::Value,
-  path: &mut DataSetPath,
+  json: &str,
 ) -> Result<DataSet, JsonDeserializeError> {
-  let raw_map = if let serde_json::Value::Object(map) = data_set_json {
-    map
-  } else {
-    return Err(JsonDeserializeError::JsonInvalid {
-      details: "Data set is not an object".to_string(),
-      path: path.clone(),
-    });
-  };
+  let mut path = DataSetPath::new();
+  let mut error = None;
 
-  let mut data_set = DataSet::new();
-  let mut transfer_syntax: Option<&'static TransferSyntax> = None;
+  let mut deserializer = serde_json::Deserializer::from_str(json);
 
-  for (raw_tag, raw_value) in raw_map.into_iter() {
-    // Parse the data element tag
-    let tag = match DataElementTag::from_hex_string(&raw_tag) {
-      Ok(tag) => tag,
-      Err(()) => {
-        return Err(JsonDeserializeError::JsonInvalid {
-          details: format!("Invalid data set tag: {raw_tag}"),
-          path: path.clone(),
-        });
+  let result = DataSetSeed {
+    context: Context {
+      path: &mut path,
+      error: &mut error,
+    },
+  }
+  .deserialize(&mut deserializer)
+  .and_then(|data_set| deserializer.end().map(|()| data_set));
+
+  result.map_err(|e| {
+    // Errors in the DICOM JSON content are stored in the context. Errors where
+    // the JSON doesn't have the expected structure are reported with the
+    // details from serde, and anything else is invalid JSON.
+    if let Some(error) = error {
+      error
+    } else if e.is_data() {
+      JsonDeserializeError::JsonInvalid {
+        details: e.to_string(),
+        path,
       }
-    };
+    } else {
+      JsonDeserializeError::JsonInvalid {
+        details: "Input is not valid JSON".to_string(),
+        path: DataSetPath::new(),
+      }
+    }
+  })
+}
 
-    path.add_data_element(tag).unwrap();
+/// The state shared by the seeds and visitors that read DICOM JSON. Serde
+/// errors can only carry a message, so errors in the DICOM JSON content are
+/// stored here and returned once deserialization has stopped.
+///
+struct Context<'a> {
+  path: &'a mut DataSetPath,
+  error: &'a mut Option<JsonDeserializeError>,
+}
 
-    // Parse the data element value
-    let value =
-      convert_json_to_data_element(raw_value, tag, &transfer_syntax, path)?;
+impl Context<'_> {
+  fn reborrow(&mut self) -> Context<'_> {
+    Context {
+      path: &mut *self.path,
+      error: &mut *self.error,
+    }
+  }
 
-    // Add data element to the final data set
-    data_set.insert(tag, value);
+  /// Records an error at the current path and returns a serde error that
+  /// stops deserialization.
+  ///
+  fn invalid<E: de::Error>(&mut self, details: String) -> E {
+    self.fail(JsonDeserializeError::JsonInvalid {
+      details,
+      path: self.path.clone(),
+    })
+  }
 
-    // Look up the transfer syntax if this is the relevant tag
-    if tag == dictionary::TRANSFER_SYNTAX_UID.tag
-      && let Ok(ts) = data_set.get_transfer_syntax()
-    {
-      transfer_syntax = Some(ts);
+  fn fail<E: de::Error>(&mut self, error: JsonDeserializeError) -> E {
+    *self.error = Some(error);
+    E::custom("invalid DICOM JSON")
+  }
+
+  fn lift<T, E: de::Error>(
+    &mut self,
+    result: Result<T, JsonDeserializeError>,
+  ) -> Result<T, E> {
+    result.map_err(|e| self.fail(e))
+  }
+
+  /// Converts the result of deserializing a buffered `serde_json::Value`.
+  ///
+  fn lift_buffered<T, E: de::Error>(
+    &mut self,
+    result: Result<T, serde_json::Error>,
+  ) -> Result<T, E> {
+    result.map_err(|e| {
+      if self.error.is_some() {
+        E::custom(e)
+      } else {
+        self.invalid(e.to_string())
+      }
+    })
+  }
+}
+
+/// Reads a data set. This is used to read the root data set and also
+/// recursively when reading sequence items.
+///
+struct DataSetSeed<'a> {
+  context: Context<'a>,
+}
+
+impl<'de> DeserializeSeed<'de> for DataSetSeed<'_> {
+  type Value = DataSet;
+
+  fn deserialize<D: Deserializer<'de>>(
+    self,
+    deserializer: D,
+  ) -> Result<DataSet, D::Error> {
+    deserializer.deserialize_map(self)
+  }
+}
+
+impl<'de> Visitor<'de> for DataSetSeed<'_> {
+  type Value = DataSet;
+
+  fn expecting(&self, f: &mut fmt::Formatter) -> fmt::Result {
+    f.write_str("a data set object")
+  }
+
+  fn visit_map<A: MapAccess<'de>>(
+    mut self,
+    mut map: A,
+  ) -> Result<DataSet, A::Error> {
+    let mut data_set = DataSet::new();
+    let mut transfer_syntax: Option<&'static TransferSyntax> = None;
+    let mut deferred_pixel_data: Option<serde_json::Value> = None;
+
+    while let Some(tag) = map.next_key_seed(DataElementTagSeed {
+      context: self.context.reborrow(),
+    })? {
+      self.context.path.add_data_element(tag).unwrap();
+
+      // How InlineBinary pixel data is read depends on the transfer syntax, so
+      // if the transfer syntax isn't known yet then buffer the pixel data and
+      // read it at the end of the data set
+      if tag == dictionary::PIXEL_DATA.tag && transfer_syntax.is_none() {
+        deferred_pixel_data = Some(map.next_value()?);
+        self.context.path.pop().unwrap();
+        continue;
+      }
+
+      // Parse the data element value
+      let value = map.next_value_seed(DataElementSeed {
+        context: self.context.reborrow(),
+        tag,
+        transfer_syntax,
+      })?;
+
+      // Add data element to the final data set
+      data_set.insert(tag, value);
+
+      // Look up the transfer syntax if this is the relevant tag
+      if tag == dictionary::TRANSFER_SYNTAX_UID.tag
+        && let Ok(ts) = data_set.get_transfer_syntax()
+      {
+        transfer_syntax = Some(ts);
+      }
+
+      self.context.path.pop().unwrap();
+    }
+
+    if let Some(pixel_data) = deferred_pixel_data {
+      let tag = dictionary::PIXEL_DATA.tag;
+      self.context.path.add_data_element(tag).unwrap();
+
+      let value = DataElementSeed {
+        context: self.context.reborrow(),
+        tag,
+        transfer_syntax: data_set.get_transfer_syntax().ok(),
+      }
+      .deserialize(pixel_data);
+      let value = self.context.lift_buffered(value)?;
+
+      data_set.insert(tag, value);
+
+      self.context.path.pop().unwrap();
     }
 
-    path.pop().unwrap();
+    Ok(data_set)
+  }
+}
+
+/// Reads a data element tag from a data set's property name.
+///
+struct DataElementTagSeed<'a> {
+  context: Context<'a>,
+}
+
+impl<'de> DeserializeSeed<'de> for DataElementTagSeed<'_> {
+  type Value = DataElementTag;
+
+  fn deserialize<D: Deserializer<'de>>(
+    self,
+    deserializer: D,
+  ) -> Result<DataElementTag, D::Error> {
+    deserializer.deserialize_str(self)
   }
+}
+
+impl<'de> Visitor<'de> for DataElementTagSeed<'_> {
+  type Value = DataElementTag;
+
+  fn expecting(&self, f: &mut fmt::Formatter) -> fmt::Result {
+    f.write_str("a data element tag")
+  }
+
+  fn visit_str<E: de::Error>(
+    mut self,
+    raw_tag: &str,
+  ) -> Result<DataElementTag, E> {
+    DataElementTag::from_hex_string(raw_tag).map_err(|()| {
+      self
+        .context
+        .invalid(format!("Invalid data set tag: {raw_tag}"))
+    })
+  }
+}
 
-  Ok(data_set)
+/// The properties of a DICOM JSON data element.
+///
+#[derive(serde::Deserialize)]
+#[serde(field_identifier)]
+enum DataElementProperty {
+  #[serde(rename = "vr")]
+  Vr,
+  Value,
+  InlineBinary,
+  #[serde(rename = "BulkDataURI")]
+  BulkDataUri,
+  #[serde(other)]
+  Other,
 }
 
-/// Converts a single DICOM JSON data element value to a native data element
-/// value.
+/// Reads a single DICOM JSON data element into a native data element value.
 ///
-fn convert_json_to_data_element(
-  json: serde_json::Value,
+struct DataElementSeed<'a> {
+  context: Context<'a>,
   tag: DataElementTag,
-  transfer_syntax: &Option<&'static TransferSyntax>,
-  path: &mut DataSetPath,
-) -> Result<DataElementValue, JsonDeserializeError> {
-  let mut raw_value = if let serde_json::Value::Object(map) = json {
-    map
-  } else {
-    return Err(JsonDeserializeError::JsonInvalid {
-      details: "Data element is not an object".to_string(),
-      path: path.clone(),
-    });
-  };
+  transfer_syntax: Option<&'static TransferSyntax>,
+}
 
-  // Read the VR for this value
-  let vr = read_dicom_json_vr(&raw_value, path)?;
+impl<'de> DeserializeSeed<'de> for DataElementSeed<'_> {
+  type Value = DataElementValue;
 
-  // To read the data element value, first look for a "Value" property, then
-  // look for an "InlineBinary" property, then finally look for a "BulkDataURI"
-  // property (which is not supported and generates an error)
-  if let Some(value) = raw_value.remove("Value") {
-    read_dicom_json_primitive_value(tag, vr, value, path)
-  } else if let Some(inline_binary) = raw_value.remove("InlineBinary") {
-    read_dicom_json_inline_binary_value(
-      inline_binary,
-      tag,
-      vr,
-      transfer_syntax,
-      path,
-    )
-  } else if raw_value.contains_key("BulkDataURI") {
-    Err(JsonDeserializeError::JsonInvalid {
-      details: "BulkDataURI values are not supported".to_string(),
-      path: path.clone(),
-    })
-  } else {
-    // No value is present, so fall back to an empty value
-    if vr == ValueRepresentation::Sequence {
-      Ok(DataElementValue::new_sequence(vec![]))
-    } else {
-      Ok(DataElementValue::new_binary_unchecked(
+  fn deserialize<D: Deserializer<'de>>(
+    self,
+    deserializer: D,
+  ) -> Result<DataElementValue, D::Error> {
+    deserializer.deserialize_map(self)
+  }
+}
+
+impl<'de> Visitor<'de> for DataElementSeed<'_> {
+  type Value = DataElementValue;
+
+  fn expecting(&self, f: &mut fmt::Formatter) -> fmt::Result {
+    f.write_str("a data element object")
+  }
+
+  fn visit_map<A: MapAccess<'de>>(
+    mut self,
+    mut map: A,
+  ) -> Result<DataElementValue, A::Error> {
+    let mut vr = None;
+    let mut value = None;
+    let mut inline_binary = None;
+    let mut has_bulk_data_uri = false;
+
+    // Values that occur before the VR are buffered and read once it is known
+    let mut deferred_value: Option<serde_json::Value> = None;
+    let mut deferred_inline_binary: Option<serde_json::Value> = None;
+
+    while let Some(property) = map.next_key::<DataElementProperty>()? {
+      match (property, vr) {
+        (DataElementProperty::Vr, _) => {
+          vr = Some(map.next_value_seed(VrSeed {
+            context: self.context.reborrow(),
+          })?);
+        }
+
+        (DataElementProperty::Value, Some(vr)) => {
+          value = Some(map.next_value_seed(ValueSeed {
+            context: self.context.reborrow(),
+            tag: self.tag,
+            vr,
+          })?);
+        }
+
+        (DataElementProperty::Value, None) => {
+          deferred_value = Some(map.next_value()?);
+        }
+
+        (DataElementProperty::InlineBinary, Some(vr)) => {
+          inline_binary = Some(map.next_value_seed(InlineBinarySeed {
+            context: self.context.reborrow(),
+            tag: self.tag,
+            vr,
+            transfer_syntax: self.transfer_syntax,
+          })?);
+        }
+
+        (DataElementProperty::InlineBinary, None) => {
+          deferred_inline_binary = Some(map.next_value()?);
+        }
+
+        (DataElementProperty::BulkDataUri, _) => {
+          map.next_value::<IgnoredAny>()?;
+          has_bulk_data_uri = true;
+        }
+
+        (DataElementProperty::Other, _) => {
+          map.next_value::<IgnoredAny>()?;
+        }
+      }
+    }
+
+    let Some(vr) = vr else {
+      return Err(self.context.invalid("VR is missing".to_string()));
+    };
+
+    // To read the data element value, first look for a "Value" property, then
+    // look for an "InlineBinary" property, then finally look for a
+    // "BulkDataURI" property (which is not supported and generates an error)
+    if let Some(deferred_value) = deferred_value {
+      let result = ValueSeed {
+        context: self.context.reborrow(),
+        tag: self.tag,
+        vr,
+      }
+      .deserialize(deferred_value);
+
+      value = Some(self.context.lift_buffered(result)?);
+    }
+
+    if let Some(value) = value {
+      return Ok(value);
+    }
+
+    if let Some(deferred_inline_binary) = deferred_inline_binary {
+      let result = InlineBinarySeed {
+        context: self.context.reborrow(),
+        tag: self.tag,
         vr,
-        RcByteSlice::empty(),
-      ))
+        transfer_syntax: self.transfer_syntax,
+      }
+      .deserialize(deferred_inline_binary);
+
+      inline_binary = Some(self.context.lift_buffered(result)?);
+    }
+
+    if let Some(inline_binary) = inline_binary {
+      Ok(inline_binary)
+    } else if has_bulk_data_uri {
+      Err(
+        self
+          .context
+          .invalid("BulkDataURI values are not supported".to_string()),
+      )
+    } else {
+      // No value is present, so fall back to an empty value
+      if vr == ValueRepresentation::Sequence {
+        Ok(DataElementValue::new_sequence(vec![]))
+      } else {
+        Ok(DataElementValue::new_binary_unchecked(
+          vr,
+          RcByteSlice::empty(),
+        ))
+      }
     }
   }
 }
 
 /// Reads a native value representation from a DICOM JSON "vr" property.
 ///
-fn read_dicom_json_vr(
-  raw_value: &serde_json::Map<String, serde_json::Value>,
-  path: &mut DataSetPath,
-) -> Result<ValueRepresentation, JsonDeserializeError> {
-  // Read the VR
-  let raw_vr = if let Some(raw_vr) = raw_value.get("vr") {
-    raw_vr
-  } else {
-    return Err(JsonDeserializeError::JsonInvalid {
-      details: "VR is missing".to_string(),
-      path: path.clone(),
-    });
-  };
+struct VrSeed<'a> {
+  context: Context<'a>,
+}
 
-  // Get the VR string value
-  let vr_string = if let Some(s) = raw_vr.as_str() {
-    s
-  } else {
-    return Err(JsonDeserializeError::JsonInvalid {
-      details: "VR is not a string".to_string(),
-      path: path.clone(),
-    });
-  };
+impl<'de> DeserializeSeed<'de> for VrSeed<'_> {
+  type Value = ValueRepresentation;
 
-  // Convert to a native VR
-  if let Ok(vr) = ValueRepresentation::from_bytes(vr_string.as_bytes()) {
-    Ok(vr)
-  } else {
-    Err(JsonDeserializeError::JsonInvalid {
-      details: format!("VR is invalid: {vr_string}"),
-      path: path.clone(),
-    })
+  fn deserialize<D: Deserializer<'de>>(
+    self,
+    deserializer: D,
+  ) -> Result<ValueRepresentation, D::Error> {
+    deserializer.deserialize_str(self)
+  }
+}
+
+impl<'de> Visitor<'de> for VrSeed<'_> {
+  type Value = ValueRepresentation;
+
+  fn expecting(&self, f: &mut fmt::Formatter) -> fmt::Result {
+    f.write_str("a VR string")
+  }
+
+  fn visit_str<E: de::Error>(
+    mut self,
+    vr_string: &str,
+  ) -> Result<ValueRepresentation, E> {
+    ValueRepresentation::from_bytes(vr_string.as_bytes())
+      .map_err(|_| self.context.invalid(format!("VR is invalid: {vr_string}")))
   }
 }
 
 /// Reads a data element value from a DICOM JSON "Value" property.
 ///
-fn read_dicom_json_primitive_value(
+struct ValueSeed<'a> {
+  context: Context<'a>,
   tag: DataElementTag,
   vr: ValueRepresentation,
-  value: serde_json::Value,
-  path: &mut DataSetPath,
-) -> Result<DataElementValue, JsonDeserializeError> {
-  match vr {
-    ValueRepresentation::AgeString
-    | ValueRepresentation::ApplicationEntity
-    | ValueRepresentation::CodeString
-    | ValueRepresentation::Date
-    | ValueRepresentation::DateTime
-    | ValueRepresentation::LongString
-    | ValueRepresentation::LongText
-    | ValueRepresentation::ShortString
-    | ValueRepresentation::ShortText
-    | ValueRepresentation::Time
-    | ValueRepresentation::UnlimitedCharacters
-    | ValueRepresentation::UnlimitedText
-    | ValueRepresentation::UniqueIdentifier
-    | ValueRepresentation::UniversalResourceIdentifier => {
-      let strings = if let Ok(strings) =
-        serde_json::from_value::<Vec<Option<String>>>(value)
-      {
-        strings
-      } else {
-        return Err(JsonDeserializeError::JsonInvalid {
-          details: "String value is invalid".to_string(),
-          path: path.clone(),
-        });
-      };
+}
+
+impl<'de> DeserializeSeed<'de> for ValueSeed<'_> {
+  type Value = DataElementValue;
+
+  fn deserialize<D: Deserializer<'de>>(
+    mut self,
+    deserializer: D,
+  ) -> Result<DataElementValue, D::Error> {
+    match self.vr {
+      ValueRepresentation::AgeString
+      | ValueRepresentation::ApplicationEntity
+      | ValueRepresentation::CodeString
+      | ValueRepresentation::Date
+      | ValueRepresentation::DateTime
+      | ValueRepresentation::LongString
+      | ValueRepresentation::LongText
+      | ValueRepresentation::ShortString
+      | ValueRepresentation::ShortText
+      | ValueRepresentation::Time
+      | ValueRepresentation::UnlimitedCharacters
+      | ValueRepresentation::UnlimitedText
+      | ValueRepresentation::UniqueIdentifier
+      | ValueRepresentation::UniversalResourceIdentifier => {
+        deserializer.deserialize_seq(StringValuesVisitor { vr: self.vr })
+      }
 
-      let mut bytes = Vec::with_capacity(
-        strings
-          .iter()
-          .map(|s| s.as_ref().map(|s| s.len()).unwrap_or(0) + 1)
-          .sum(),
-      );
+      ValueRepresentation::Sequence => {
+        deserializer.deserialize_seq(SequenceVisitor {
+          context: self.context,
+        })
+      }
 
-      for (i, s) in strings.iter().enumerate() {
-        if let Some(s) = s {
-          bytes.extend_from_slice(s.as_bytes());
-        }
+      _ => {
+        let value = de::Deserialize::deserialize(deserializer)?;
 
-        if i + 1 != strings.len() {
-          bytes.push(b'\\');
-        }
+        let result = read_dicom_json_primitive_value(
+          self.tag,
+          self.vr,
+          value,
+          self.context.path,
+        );
+
+        self.context.lift(result)
       }
+    }
+  }
+}
+
+/// Reads the strings in a DICOM JSON "Value" property into the bytes of a
+/// string data element value.
+///
+struct StringValuesVisitor {
+  vr: ValueRepresentation,
+}
 
-      vr.pad_bytes_to_even_length(&mut bytes);
+impl<'de> Visitor<'de> for StringValuesVisitor {
+  type Value = DataElementValue;
 
-      Ok(DataElementValue::new_binary_unchecked(vr, bytes.into()))
+  fn expecting(&self, f: &mut fmt::Formatter) -> fmt::Result {
+    f.write_str("an array of strings")
+  }
+
+  fn visit_seq<A: SeqAccess<'de>>(
+    self,
+    mut seq: A,
+  ) -> Result<DataElementValue, A::Error> {
+    let mut bytes = Vec::new();
+    let mut is_first = true;
+
+    while seq
+      .next_element_seed(StringValueSeed {
+        bytes: &mut bytes,
+        is_first,
+      })?
+      .is_some()
+    {
+      is_first = false;
+    }
+
+    self.vr.pad_bytes_to_even_length(&mut bytes);
+
+    Ok(DataElementValue::new_binary_unchecked(
+      self.vr,
+      bytes.into(),
+    ))
+  }
+}
+
+/// Appends a single string, which may be null, to the bytes of a string data
+/// element value.
+///
+struct StringValueSeed<'a> {
+  bytes: &'a mut Vec<u8>,
+  is_first: bool,
+}
+
+impl<'de> DeserializeSeed<'de> for StringValueSeed<'_> {
+  type Value = ();
+
+  fn deserialize<D: Deserializer<'de>>(
+    self,
+    deserializer: D,
+  ) -> Result<(), D::Error> {
+    deserializer.deserialize_any(self)
+  }
+}
+
+impl<'de> Visitor<'de> for StringValueSeed<'_> {
+  type Value = ();
+
+  fn expecting(&self, f: &mut fmt::Formatter) -> fmt::Result {
+    f.write_str("a string or null")
+  }
+
+  fn visit_str<E: de::Error>(self, s: &str) -> Result<(), E> {
+    if !self.is_first {
+      self.bytes.push(b'\\');
+    }
+
+    self.bytes.extend_from_slice(s.as_bytes());
+
+    Ok(())
+  }
+
+  fn visit_unit<E: de::Error>(self) -> Result<(), E> {
+    if !self.is_first {
+      self.bytes.push(b'\\');
     }
 
+    Ok(())
+  }
+}
+
+/// Reads the items of a DICOM JSON sequence.
+///
+struct SequenceVisitor<'a> {
+  context: Context<'a>,
+}
+
+impl<'de> Visitor<'de> for SequenceVisitor<'_> {
+  type Value = DataElementValue;
+
+  fn expecting(&self, f: &mut fmt::Formatter) -> fmt::Result {
+    f.write_str("an array of sequence items")
+  }
+
+  fn visit_seq<A: SeqAccess<'de>>(
+    mut self,
+    mut seq: A,
+  ) -> Result<DataElementValue, A::Error> {
+    let mut items = vec![];
+
+    loop {
+      self.context.path.add_sequence_item(items.len()).unwrap();
+
+      let Some(item) = seq.next_element_seed(DataSetSeed {
+        context: self.context.reborrow(),
+      })?
+      else {
+        self.context.path.pop().unwrap();
+        break;
+      };
+
+      items.push(item);
+
+      self.context.path.pop().unwrap();
+    }
+
+    Ok(DataElementValue::new_sequence(items))
+  }
+}
+
+/// Reads a data element value from a DICOM JSON "InlineBinary" property.
+///
+struct InlineBinarySeed<'a> {
+  context: Context<'a>,
+  tag: DataElementTag,
+  vr: ValueRepresentation,
+  transfer_syntax: Option<&'static TransferSyntax>,
+}
+
+impl<'de> DeserializeSeed<'de> for InlineBinarySeed<'_> {
+  type Value = DataElementValue;
+
+  fn deserialize<D: Deserializer<'de>>(
+    self,
+    deserializer: D,
+  ) -> Result<DataElementValue, D::Error> {
+    deserializer.deserialize_str(self)
+  }
+}
+
+impl<'de> Visitor<'de> for InlineBinarySeed<'_> {
+  type Value = DataElementValue;
+
+  fn expecting(&self, f: &mut fmt::Formatter) -> fmt::Result {
+    f.write_str("an InlineBinary string")
+  }
+
+  fn visit_str<E: de::Error>(
+    mut self,
+    inline_binary: &str,
+  ) -> Result<DataElementValue, E> {
+    let result = read_dicom_json_inline_binary_value(
+      inline_binary,
+      self.tag,
+      self.vr,
+      self.transfer_syntax,
+      self.context.path,
+    );
+
+    self.context.lift(result)
+  }
+}
+
+/// Reads a data element value from a DICOM JSON "Value" property.
+///
+fn read_dicom_json_primitive_value(
+  tag: DataElementTag,
+  vr: ValueRepresentation,
+  value: serde_json::Value,
+  path: &DataSetPath,
+) -> Result<DataElementValue, JsonDeserializeError> {
+  match vr {
     ValueRepresentation::DecimalString => {
       if let Ok(floats) = serde_json::from_value::<Vec<f64>>(value) {
         let bytes =
@@ -511,28 +967,6 @@ fn read_dicom_json_primitive_value(
       Ok(DataElementValue::new_binary_unchecked(vr, bytes.into()))
     }
 
-    ValueRepresentation::Sequence => {
-      let raw_items = if let Ok(items) = serde_json::from_value::<Vec<_>>(value)
-      {
-        items
-      } else {
-        return Err(JsonDeserializeError::JsonInvalid {
-          details: "Sequence value is invalid".to_string(),
-          path: path.clone(),
-        });
-      };
-
-      let mut final_items = vec![];
-
-      for (i, item) in raw_items.into_iter().enumerate() {
-        path.add_sequence_item(i).unwrap();
-        final_items.push(convert_json_to_data_set(item, path)?);
-        path.pop().unwrap();
-      }
-
-      Ok(DataElementValue::new_sequence(final_items))
-    }
-
     _ => Err(JsonDeserializeError::JsonInvalid {
       details: format!("Invalid 'Value' data element with VR '{vr}'"),
       path: path.clone(),
@@ -586,7 +1020,7 @@ struct PersonNameVariants {
 ///
 fn read_dicom_json_person_name_value(
   value: serde_json::Value,
-  path: &mut DataSetPath,
+  path: &DataSetPath,
 ) -> Result<DataElementValue, JsonDeserializeError> {
   let person_name_variants: Vec<PersonNameVariants> =
     serde_json::from_value(value).map_err(|_| {
@@ -625,34 +1059,26 @@ fn read_dicom_json_person_name_value(
 /// Reads a data element value from a DICOM JSON "InlineBinary" property.
 ///
 fn read_dicom_json_inline_binary_value(
-  inline_binary: serde_json::Value,
+  inline_binary: &str,
   tag: DataElementTag,
   vr: ValueRepresentation,
-  transfer_syntax: &Option<&'static TransferSyntax>,
-  path: &mut DataSetPath,
+  transfer_syntax: Option<&'static TransferSyntax>,
+  path: &DataSetPath,
 ) -> Result<DataElementValue, JsonDeserializeError> {
-  let inline_binary = if let serde_json::Value::String(s) = inline_binary {
-    s
-  } else {
-    return Err(JsonDeserializeError::JsonInvalid {
-      details: "InlineBinary is not a string".to_string(),
-      path: path.clone(),
-    });
-  };
-
-  let bytes = if let Ok(data) = BASE64_STANDARD.decode(inline_binary) {
-    data
-  } else {
-    return Err(JsonDeserializeError::JsonInvalid {
-      details: "InlineBinary is not valid Base64".to_string(),
-      path: path.clone(),
-    });
-  };
+  let bytes =
+    if let Ok(data) = base64_simd::STANDARD.decode_to_vec(inline_binary) {
+      data
+    } else {
+      return Err(JsonDeserializeError::JsonInvalid {
+        details: "InlineBinary is not valid Base64".to_string(),
+        path: path.clone(),
+      });
+    };
 
   // Look at the tag and the transfer syntax to see if this inline binary holds
   // encapsulated pixel data.
   if tag == dictionary::PIXEL_DATA.tag
-    && transfer_syntax.as_ref().map(|ts| ts.is_encapsulated) == Some(true)
+    && transfer_syntax.map(|ts| ts.is_encapsulated) == Some(true)
   {
     read_encapsulated_pixel_data_items(&bytes, vr).map_err(|_| {
       JsonDeserializeError::JsonInvalid {
@@ -8,22 +8,19 @@
 extern crate alloc;
 
 #[cfg(not(feature = "std"))]
-use alloc::{
-  string::{String, ToString},
-  vec::Vec,
-};
+use alloc::{string::String, vec::Vec};
 
 mod internal;
 mod json_config;
 mod json_error;
 mod transforms;
 
-use dcmfx_core::{DataSet, DataSetPath};
+use dcmfx_core::DataSet;
 use dcmfx_p10::{DataSetP10Extensions, P10Token};
 
 pub use json_config::DicomJsonConfig;
 pub use json_error::{JsonDeserializeError, JsonSerializeError};
-pub use transforms::p10_json_transform::P10JsonTransform;
+pub use transforms::p10_json_transform::{BulkDataWriter, P10JsonTransform};
 
 /// Adds functions to [`DataSet`] for converting to and from DICOM JSON.
 ///
@@ -108,25 +105,16 @@ impl DataSetJsonExtensions for DataSet {
   }
 
   fn from_json(json: &str) -> Result<Self, JsonDeserializeError> {
-    let json_value = serde_json::from_str(json).map_err(|_| {
-      JsonDeserializeError::JsonInvalid {
-        details: "Input is not valid JSON".to_string(),
-        path: DataSetPath::new(),
-      }
-    })?;
-
-    internal::json_to_data_set::convert_json_to_data_set(
-      json_value,
-      &mut DataSetPath::new(),
-    )
+    internal::json_to_data_set::convert_json_to_data_set(json)
   }
 }
 
 #[cfg(test)]
 mod tests {
   use dcmfx_core::{
-    DataElementTag, DataElementValue, PersonNameComponents, RcByteSlice,
-    StructuredPersonName, ValueRepresentation, dictionary, transfer_syntax,
+    DataElementTag, DataElementValue, DataSetPath, PersonNameComponents,
+    RcByteSlice, StructuredPersonName, ValueRepresentation, dictionary,
+    transfer_syntax,
   };
 
   use super::*;
@@ -192,6 +180,138 @@ mod tests {
     );
   }
 
+  #[test]
+  fn large_inline_binary_round_trip_test() {
+    // Large enough to be Base64 encoded in multiple chunks
+    let bytes: Vec<u8> =
+      (0..100_001).map(|i| (i * 7 + i / 256) as u8).collect();
+
+    let ds: DataSet = [(
+      dictionary::PIXEL_DATA.tag,
+      DataElementValue::new_binary_unchecked(
+        ValueRepresentation::OtherByteString,
+        RcByteSlice::from(bytes),
+      ),
+    )]
+    .into_iter()
+    .collect();
+
+    let json = ds.to_json(JSON_CONFIG).unwrap();
+
+    assert_eq!(DataSet::from_json(&json).unwrap(), ds);
+  }
+
+  #[test]
+  fn json_to_data_set_property_order_test() {
+    // Values before their VR, and pixel data before the transfer syntax
+    let json = r#"{
+      "7FE00010": {
+        "InlineBinary": "/v8A4AAAAAD+/wDgBAAAAAECAwQ=",
+        "vr": "OB"
+      },
+      "00100010": { "Value": [{ "Alphabetic": "Doe^Jane" }], "vr": "PN" },
+      "00020010": { "Value": ["1.2.840.10008.1.2.5"], "vr": "UI" }
+    }"#;
+
+    let ds = DataSet::from_json(json).unwrap();
+
+    assert_eq!(
+      ds.get_value(dictionary::PATIENT_NAME.tag).unwrap().bytes(),
+      Ok(&RcByteSlice::from(b"Doe^Jane".to_vec()))
+    );
+
+    assert_eq!(
+      ds.get_value(dictionary::PIXEL_DATA.tag)
+        .unwrap()
+        .encapsulated_pixel_data(),
+      Ok(&vec![
+        RcByteSlice::empty(),
+        RcByteSlice::from(vec![1, 2, 3, 4])
+      ])
+    );
+  }
+
+  #[cfg(feature = "std")]
+  #[test]
+  fn bulk_data_writer_test() {
+    use std::sync::{Arc, Mutex};
+
+    #[derive(Default)]
+    struct TestBulkDataWriter {
+      values: Arc<Mutex<Vec<(String, Vec<u8>)>>>,
+    }
+
+    impl BulkDataWriter for TestBulkDataWriter {
+      fn begin(
+        &mut self,
+        path: &DataSetPath,
+        _vr: ValueRepresentation,
+      ) -> Result<String, dcmfx_p10::IoError> {
+        let uri = format!("bulk/{path}");
+        self.values.lock().unwrap().push((uri.clone(), vec![]));
+
+        Ok(uri)
+      }
+
+      fn write(&mut self, data: &[u8]) -> Result<(), dcmfx_p10::IoError> {
+        let mut values = self.values.lock().unwrap();
+        values.last_mut().unwrap().1.extend_from_slice(data);
+
+        Ok(())
+      }
+
+      fn finish(&mut self) -> Result<(), dcmfx_p10::IoError> {
+        Ok(())
+      }
+    }
+
+    let large_value: Vec<u8> = (0..1000).map(|i| i as u8).collect();
+
+    let ds: DataSet = [
+      (
+        dictionary::ENCAPSULATED_DOCUMENT.tag,
+        DataElementValue::new_binary_unchecked(
+          ValueRepresentation::OtherByteString,
+          RcByteSlice::from(vec![1, 2, 3, 4]),
+        ),
+      ),
+      (
+        dictionary::PIXEL_DATA.tag,
+        DataElementValue::new_binary_unchecked(
+          ValueRepresentation::OtherByteString,
+          RcByteSlice::from(large_value.clone()),
+        ),
+      ),
+    ]
+    .into_iter()
+    .collect();
+
+    let bulk_data_writer = TestBulkDataWriter::default();
+    let values = bulk_data_writer.values.clone();
+
+    let mut json_transform = P10JsonTransform::new(JSON_CONFIG);
+    json_transform.set_bulk_data_writer(Box::new(bulk_data_writer), 100);
+
+    let mut json = vec![];
+    ds.to_p10_token_stream(&mut |token: P10Token| {
+      json_transform.add_token(&token, &mut json)
+    })
+    .unwrap();
+
+    assert_eq!(
+      serde_json::from_slice::<serde_json::Value>(&json).unwrap(),
+      serde_json::json!({
+        "00420011": { "vr": "OB", "InlineBinary": "AQIDBA==" },
+        "7FE00010": { "vr": "OB", "BulkDataURI": "bulk/7FE00010" }
+      })
+    );
+
+    assert_eq!(
+      *values.lock().unwrap(),
+      vec![("bulk/7FE00010".to_string(), large_value)]
+    );
+  }
+
   /// Returns pairs of data sets and their corresponding DICOM JSON string.
   /// These are used to test conversion both to and from DICOM JSON.
   ///
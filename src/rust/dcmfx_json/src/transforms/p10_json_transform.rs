@@ -6,6 +6,7 @@ use std::io::Write;
 
 #[cfg(not(feature = "std"))]
 use alloc::{
+  boxed::Box,
   format,
   string::{String, ToString},
   vec,
@@ -24,6 +25,40 @@ use dcmfx_p10::{P10Error, P10Token};
 use crate::DicomJsonConfig;
 use crate::json_error::JsonSerializeError;
 
+/// Binary data is Base64 encoded in chunks of this many bytes, which is a
+/// multiple of three, so that the encoded output is written in bounded pieces
+/// rather than all at once.
+///
+const BASE64_CHUNK_SIZE: usize = 48 * 1024;
+
+/// Receives the values of binary data elements that are stored outside of the
+/// DICOM JSON and referenced with a `BulkDataURI`, rather than being included
+/// as an `InlineBinary`. See [`P10JsonTransform::set_bulk_data_writer()`].
+///
+/// Encapsulated pixel data is passed to the bulk data writer in the same form
+/// as the `InlineBinary` extension enabled by
+/// [`DicomJsonConfig::store_encapsulated_pixel_data`], i.e. as the items
+/// exactly as they appear in DICOM P10 data.
+///
+pub trait BulkDataWriter {
+  /// Starts a new bulk data value for the data element at the given path, and
+  /// returns the URI to store in the DICOM JSON for it.
+  ///
+  fn begin(
+    &mut self,
+    path: &DataSetPath,
+    vr: ValueRepresentation,
+  ) -> Result<String, dcmfx_p10::IoError>;
+
+  /// Writes the next bytes of the current bulk data value.
+  ///
+  fn write(&mut self, data: &[u8]) -> Result<(), dcmfx_p10::IoError>;
+
+  /// Completes the current bulk data value.
+  ///
+  fn finish(&mut self) -> Result<(), dcmfx_p10::IoError>;
+}
+
 /// Transform that converts a stream of DICOM P10 tokens to the DICOM JSON
 /// model.
 ///
@@ -51,6 +86,17 @@ pub struct P10JsonTransform {
   /// conversion.
   pending_base64_input: Vec<u8>,
 
+  /// Buffer that chunks of Base64 output are encoded into before being written
+  /// to the output stream. This is reused to avoid allocating for every chunk.
+  base64_output: Vec<u8>,
+
+  /// The writer for binary values that are stored as bulk data, and the minimum
+  /// length of the values to store this way.
+  bulk_data_writer: Option<(Box<dyn BulkDataWriter + Send>, u32)>,
+
+  /// Whether value bytes are currently being passed to the bulk data writer.
+  in_bulk_data: bool,
+
   /// The data set path to where JSON serialization is currently up to. This is
   /// used to provide precise location information when an error occurs.
   data_set_path: DataSetPath,
@@ -71,11 +117,31 @@ impl P10JsonTransform {
       ignore_data_element_value_bytes: false,
       in_encapsulated_pixel_data: false,
       pending_base64_input: vec![],
+      base64_output: vec![],
+      bulk_data_writer: None,
+      in_bulk_data: false,
       data_set_path: DataSetPath::new(),
       sequence_item_counts: Vec::new(),
     }
   }
 
+  /// Sets a writer that receives the values of binary data elements that are at
+  /// least `threshold` bytes in length, which are then referenced in the DICOM
+  /// JSON with a `BulkDataURI` instead of being included as an
+  /// `InlineBinary`. This keeps the DICOM JSON for data sets with large
+  /// binary values, such as multi-frame pixel data, small.
+  ///
+  /// Encapsulated pixel data is always passed to the bulk data writer because
+  /// its length isn't known up front.
+  ///
+  pub fn set_bulk_data_writer(
+    &mut self,
+    bulk_data_writer: Box<dyn BulkDataWriter + Send>,
+    threshold: u32,
+  ) {
+    self.bulk_data_writer = Some((bulk_data_writer, threshold));
+  }
+
   /// Adds the next DICOM P10 token to this JSON transform. Bytes of JSON data
   /// are written to the provided `stream` as they become available.
   ///
@@ -106,14 +172,14 @@ impl P10JsonTransform {
       P10Token::DataElementHeader {
         tag, vr, length, ..
       } => {
-        self
-          .write_data_element_header(*tag, *vr, *length, stream)
-          .map_err(JsonSerializeError::IOError)?;
-
         self
           .data_set_path
           .add_data_element(*tag)
-          .map_err(|_| token_stream_invalid_error())
+          .map_err(|_| token_stream_invalid_error())?;
+
+        self
+          .write_data_element_header(*tag, *vr, *length, stream)
+          .map_err(JsonSerializeError::IOError)
       }
 
       P10Token::DataElementValueBytes {
@@ -140,14 +206,14 @@ impl P10JsonTransform {
       }
 
       P10Token::SequenceStart { tag, vr, .. } => {
-        self.write_sequence_start(*tag, *vr, stream)?;
-
-        self.sequence_item_counts.push(0);
-
         self
           .data_set_path
           .add_data_element(*tag)
-          .map_err(|_| token_stream_invalid_error())
+          .map_err(|_| token_stream_invalid_error())?;
+
+        self.sequence_item_counts.push(0);
+
+        self.write_sequence_start(*tag, *vr, stream)
       }
 
       P10Token::SequenceDelimiter { .. } => {
@@ -334,7 +400,8 @@ impl P10JsonTransform {
       return Ok(());
     }
 
-    // The following VRs use InlineBinary in the output
+    // The following VRs use InlineBinary in the output, or BulkDataURI if the
+    // value is large enough to be stored as bulk data
     if vr == ValueRepresentation::OtherByteString
       || vr == ValueRepresentation::OtherDoubleString
       || vr == ValueRepresentation::OtherFloatString
@@ -343,6 +410,12 @@ impl P10JsonTransform {
       || vr == ValueRepresentation::OtherWordString
       || vr == ValueRepresentation::Unknown
     {
+      if let Some((_, threshold)) = self.bulk_data_writer
+        && length >= threshold
+      {
+        return self.write_bulk_data_uri(vr, stream);
+      }
+
       if self.config.pretty_print {
         stream.write_all(b",\n")?;
         self.write_indent(stream, 1)?;
@@ -383,6 +456,25 @@ impl P10JsonTransform {
       return Ok(());
     }
 
+    // Pass bulk data straight through to the bulk data writer
+    if self.in_bulk_data {
+      if let Some((bulk_data_writer, _)) = self.bulk_data_writer.as_mut() {
+        bulk_data_writer
+          .write(data)
+          .map_err(JsonSerializeError::IOError)?;
+
+        if bytes_remaining == 0 && !self.in_encapsulated_pixel_data {
+          bulk_data_writer
+            .finish()
+            .map_err(JsonSerializeError::IOError)?;
+
+          self.in_bulk_data = false;
+        }
+      }
+
+      return Ok(());
+    }
+
     // The following VRs are streamed out directly as Base64
     if vr == ValueRepresentation::OtherByteString
       || vr == ValueRepresentation::OtherDoubleString
@@ -567,26 +659,24 @@ impl P10JsonTransform {
         let mut json = *b"\"vr\": \"__\"";
         json[7..9].copy_from_slice(&vr.to_bytes());
         stream.write_all(json.as_slice())?;
-
-        if self.should_emit_binary_value(tag) {
-          stream.write_all(b",\n")?;
-          self.write_indent(stream, 1)?;
-          stream.write_all(b"\"InlineBinary\": \"")?;
-        }
-
-        Ok(())
       } else {
         let mut json = *br#""________":{"vr":"__""#;
         json[1..9].copy_from_slice(&tag.to_hex_digits());
         json[18..20].copy_from_slice(&vr.to_bytes());
 
         stream.write_all(json.as_slice())?;
+      }
 
-        if self.should_emit_binary_value(tag) {
-          stream.write_all(br#","InlineBinary":""#)?;
-        }
-
+      if !self.should_emit_binary_value(tag) {
         Ok(())
+      } else if self.bulk_data_writer.is_some() {
+        self.write_bulk_data_uri(vr, stream)
+      } else if self.config.pretty_print {
+        stream.write_all(b",\n")?;
+        self.write_indent(stream, 1)?;
+        stream.write_all(b"\"InlineBinary\": \"")
+      } else {
+        stream.write_all(br#","InlineBinary":""#)
       }
     }
     .map_err(JsonSerializeError::IOError)
@@ -599,6 +689,16 @@ impl P10JsonTransform {
     if self.in_encapsulated_pixel_data {
       self.in_encapsulated_pixel_data = false;
 
+      if self.in_bulk_data {
+        self.in_bulk_data = false;
+
+        if let Some((bulk_data_writer, _)) = self.bulk_data_writer.as_mut() {
+          bulk_data_writer.finish()?;
+        }
+
+        return Ok(());
+      }
+
       if self.should_emit_binary_value(self.current_data_element.0) {
         self.write_base64(&[], true, stream)?;
 
@@ -688,6 +788,14 @@ impl P10JsonTransform {
     let mut bytes = [0xFE, 0xFF, 0x00, 0xE0, 0x00, 0x00, 0x00, 0x00];
     bytes[4..8].copy_from_slice(length.to_le_bytes().as_slice());
 
+    if self.in_bulk_data
+      && let Some((bulk_data_writer, _)) = self.bulk_data_writer.as_mut()
+    {
+      return bulk_data_writer
+        .write(bytes.as_slice())
+        .map_err(JsonSerializeError::IOError);
+    }
+
     self
       .write_base64(bytes.as_slice(), false, stream)
       .map_err(JsonSerializeError::IOError)
@@ -706,53 +814,100 @@ impl P10JsonTransform {
 
   fn write_base64<S: dcmfx_p10::IoWrite>(
     &mut self,
-    input: &[u8],
+    mut input: &[u8],
     finish: bool,
     stream: &mut S,
   ) -> Result<(), dcmfx_p10::IoError> {
-    // If there's still insufficient data to encode with this new data then
-    // accumulate the bytes and wait till next time
-    if self.pending_base64_input.len() + input.len() < 3 && !finish {
-      self.pending_base64_input.extend_from_slice(input);
-      return Ok(());
+    // Bytes must be fed to the Base64 encoder in lots of 3, so first complete
+    // any bytes left over from the previous call into a lot of 3 and encode
+    // them. If these are the final bytes then all remaining bytes are encoded
+    // and the encoder adds any required Base64 padding.
+    if !self.pending_base64_input.is_empty() {
+      let count = (3 - self.pending_base64_input.len()).min(input.len());
+      self.pending_base64_input.extend_from_slice(&input[..count]);
+      input = &input[count..];
+
+      if self.pending_base64_input.len() < 3 && !finish {
+        return Ok(());
+      }
+
+      let pending_base64_input =
+        core::mem::take(&mut self.pending_base64_input);
+      self.write_base64_chunk(&pending_base64_input, stream)?;
+
+      // Keep the allocation for next time
+      self.pending_base64_input = pending_base64_input;
+      self.pending_base64_input.clear();
     }
 
-    // Calculate how many of the input bytes to consume. Bytes must be fed to
-    // the Base64 encoder in lots of 3, and any leftover saved till next time.
-    // If these are the final bytes then all remaining bytes are encoded and the
-    // encoder will add any required Base64 padding.
+    // Encode whole lots of 3 bytes in bounded chunks directly from the input,
+    // and save off any leftover bytes for next time
     let input_bytes_consumed = if finish {
       input.len()
     } else {
-      (self.pending_base64_input.len() + input.len()) / 3 * 3
-        - self.pending_base64_input.len()
+      input.len() / 3 * 3
     };
 
-    // Base64 encode the bytes and output to the stream
-    #[cfg(feature = "std")]
-    {
-      let mut encoder =
-        base64::write::EncoderWriter::new(stream, &BASE64_STANDARD);
-      encoder.write_all(&self.pending_base64_input)?;
-      encoder.write_all(&input[0..input_bytes_consumed])?;
-      encoder.finish()?;
+    for chunk in input[..input_bytes_consumed].chunks(BASE64_CHUNK_SIZE) {
+      self.write_base64_chunk(chunk, stream)?;
     }
 
-    #[cfg(not(feature = "std"))]
-    {
-      self
-        .pending_base64_input
-        .extend_from_slice(&input[0..input_bytes_consumed]);
+    self
+      .pending_base64_input
+      .extend_from_slice(&input[input_bytes_consumed..]);
 
-      stream.write_all(
-        base64::prelude::BASE64_STANDARD
-          .encode(&self.pending_base64_input)
-          .as_bytes(),
-      )?;
+    Ok(())
+  }
+
+  /// Base64 encodes a chunk of data and writes it to the output stream. Only
+  /// the final chunk of a value may have a length that isn't a multiple of
+  /// three, as it's the only one that can have Base64 padding.
+  ///
+  fn write_base64_chunk<S: dcmfx_p10::IoWrite>(
+    &mut self,
+    input: &[u8],
+    stream: &mut S,
+  ) -> Result<(), dcmfx_p10::IoError> {
+    let encoded_len = base64::encoded_len(input.len(), true).unwrap();
+    self.base64_output.resize(encoded_len, 0);
+
+    let encoded_len = BASE64_STANDARD
+      .encode_slice(input, &mut self.base64_output)
+      .unwrap();
+
+    stream.write_all(&self.base64_output[..encoded_len])
+  }
+
+  /// Writes a `BulkDataURI` for the current data element, which completes its
+  /// JSON, and starts passing its value bytes to the bulk data writer.
+  ///
+  fn write_bulk_data_uri<S: dcmfx_p10::IoWrite>(
+    &mut self,
+    vr: ValueRepresentation,
+    stream: &mut S,
+  ) -> Result<(), dcmfx_p10::IoError> {
+    let Some((bulk_data_writer, _)) = self.bulk_data_writer.as_mut() else {
+      return Ok(());
+    };
+
+    let uri = bulk_data_writer.begin(&self.data_set_path, vr)?;
+    let uri = serde_json::to_string(&uri).unwrap();
+
+    if self.config.pretty_print {
+      stream.write_all(b",\n")?;
+      self.write_indent(stream, 1)?;
+      stream.write_all(b"\"BulkDataURI\": ")?;
+      stream.write_all(uri.as_bytes())?;
+      stream.write_all(b"\n")?;
+      self.write_indent(stream, 0)?;
+      stream.write_all(b"}")?;
+    } else {
+      stream.write_all(br#","BulkDataURI":"#)?;
+      stream.write_all(uri.as_bytes())?;
+      stream.write_all(b"}")?;
     }
 
-    // Save off unencoded bytes for next time
-    self.pending_base64_input = input[input_bytes_consumed..].to_vec();
+    self.in_bulk_data = true;
 
     Ok(())
   }
@@ -0,0 +1,153 @@
+//! Benchmarks passing the DICOM P10 tokens of a large multi-frame file through
+//! a chain of a filter transform and an insert transform into a write context,
+//! reporting the throughput in MiB per second and the average time per token.
+//!
+//! The `add_token` chain uses the transforms' `add_token()` functions, which
+//! clone each token and return the resulting tokens in a new vector. The
+//! `push_token` chain uses [`P10TokenTransform::push_token()`], which moves
+//! tokens through the chain of sinks.
+//!
+//! Run with `cargo bench -p dcmfx_p10 --bench transforms`.
+
+use std::hint::black_box;
+use std::time::{Duration, Instant};
+
+use dcmfx_core::{DataElementValue, DataSet, dictionary};
+use dcmfx_p10::{
+  P10Error, P10FilterTransform, P10InsertTransform, P10ReadConfig,
+  P10ReadContext, P10Token, P10TokenTransform, P10WriteContext,
+};
+
+const TEST_FILE: &str = concat!(
+  env!("CARGO_MANIFEST_DIR"),
+  "/../../../test/assets/other/xa_modality_anon.dcm"
+);
+
+/// The minimum time to spend running each benchmark, after one warm up run.
+const MIN_DURATION: Duration = Duration::from_secs(1);
+
+fn main() {
+  // Use a small maximum token size so that the pixel data is split across
+  // many tokens, as happens when streaming files much larger than this one
+  let tokens = read_tokens(P10ReadConfig::default().max_token_size(16 * 1024));
+  let byte_count = std::fs::metadata(TEST_FILE).unwrap().len();
+
+  println!(
+    "{:<12} {:>8} {:>10} {:>10}",
+    "Chain", "Tokens", "MiB/s", "ns/token"
+  );
+
+  bench("add_token", &tokens, byte_count, |tokens| {
+    let (mut filter_transform, mut insert_transform) = transforms();
+    let mut write_context = P10WriteContext::new(None);
+
+    for token in tokens.iter() {
+      if !filter_transform.add_token(token).unwrap() {
+        continue;
+      }
+
+      for token in insert_transform.add_token(token).unwrap() {
+        write_context.write_token(&token).unwrap();
+        black_box(write_context.read_bytes());
+      }
+    }
+  });
+
+  bench("push_token", &tokens, byte_count, |tokens| {
+    let (mut filter_transform, mut insert_transform) = transforms();
+    let mut write_context = P10WriteContext::new(None);
+
+    for token in tokens {
+      filter_transform
+        .push_token(token, &mut |token| {
+          insert_transform.push_token(token, &mut |token| {
+            write_context.write_token(&token)?;
+            black_box(write_context.read_bytes());
+            Ok::<(), P10Error>(())
+          })
+        })
+        .unwrap();
+    }
+  });
+}
+
+/// Reads all the DICOM P10 tokens in the test file.
+///
+fn read_tokens(config: P10ReadConfig) -> Vec<P10Token> {
+  let mut stream = std::fs::File::open(TEST_FILE).unwrap();
+  let mut context = P10ReadContext::new(Some(config));
+  let mut tokens = vec![];
+
+  loop {
+    let new_tokens =
+      dcmfx_p10::read_tokens_from_stream(&mut stream, &mut context, None)
+        .unwrap();
+
+    let is_ended = new_tokens.last() == Some(&P10Token::End);
+    tokens.extend(new_tokens);
+
+    if is_ended {
+      return tokens;
+    }
+  }
+}
+
+/// Returns the transforms to chain, which remove private data elements and
+/// replace the patient's ID and sex.
+///
+fn transforms() -> (P10FilterTransform, P10InsertTransform) {
+  let filter_transform =
+    P10FilterTransform::new(Box::new(|tag, _vr, _length, _path| {
+      !tag.is_private()
+    }));
+
+  let mut data_elements_to_insert = DataSet::new();
+  data_elements_to_insert.insert(
+    dictionary::PATIENT_ID.tag,
+    DataElementValue::new_long_string(&["ANONYMOUS"]).unwrap(),
+  );
+  data_elements_to_insert.insert(
+    dictionary::PATIENT_SEX.tag,
+    DataElementValue::new_code_string(&["O"]).unwrap(),
+  );
+
+  (
+    filter_transform,
+    P10InsertTransform::new(data_elements_to_insert),
+  )
+}
+
+/// Runs a benchmark for at least [`MIN_DURATION`] and prints its throughput.
+/// Each call to `f` passes a copy of the tokens through a chain of transforms.
+/// The time taken to copy the tokens isn't included.
+///
+fn bench(
+  name: &str,
+  tokens: &[P10Token],
+  byte_count: u64,
+  mut f: impl FnMut(Vec<P10Token>),
+) {
+  f(tokens.to_vec());
+
+  let mut elapsed = Duration::ZERO;
+  let mut iterations = 0u64;
+
+  while elapsed < MIN_DURATION {
+    let tokens = tokens.to_vec();
+
+    let start = Instant::now();
+    f(tokens);
+    elapsed += start.elapsed();
+
+    iterations += 1;
+  }
+
+  let seconds = elapsed.as_secs_f64() / iterations as f64;
+
+  println!(
+    "{name:<12} {:>8} {:>10.1} {:>10.1}",
+    tokens.len(),
+    byte_count as f64 / seconds / (1024.0 * 1024.0),
+    seconds * 1e9 / tokens.len() as f64
+  );
+}
@@ -490,7 +490,7 @@ impl DataSetBuilder {
 /// Takes the tag, VR, and final bytes for a new data element and returns the
 /// `DataElementValue` for it to insert into the active data set.
 ///
-fn build_final_data_element_value(
+pub(crate) fn build_final_data_element_value(
   tag: DataElementTag,
   vr: ValueRepresentation,
   value_bytes: &[RcByteSlice],
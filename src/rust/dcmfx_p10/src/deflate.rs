@@ -0,0 +1,203 @@
+//! Deflates data as a sequence of independently compressed blocks, which allows
+//! the blocks to be compressed concurrently, as done by pigz.
+//!
+//! Each block is compressed without reference to the data before it, and every
+//! block other than the last ends with a sync flush so that it finishes on a
+//! byte boundary. Concatenating the compressed blocks in order therefore gives
+//! a single raw deflate stream that any inflater can read. The cost is a
+//! slightly lower compression ratio, because matches can't refer back into the
+//! previous block.
+
+#[cfg(not(feature = "std"))]
+use alloc::{vec, vec::Vec};
+
+/// The size of the blocks that data is split into by [`deflate_blocks()`].
+/// This is large enough that the loss of the previous block's data as a
+/// dictionary has little effect on the compression ratio.
+///
+pub const DEFLATE_BLOCK_SIZE: usize = 256 * 1024;
+
+/// Deflates a single block of data into raw deflate data without a zlib
+/// header. If `is_last` is false then the output ends with a sync flush so
+/// that further blocks can be appended to it, and if it's true then the output
+/// ends the deflate stream.
+///
+/// The compression level ranges from 0, meaning no compression, through to 9.
+///
+pub fn deflate_block(
+  data: &[u8],
+  compression_level: u32,
+  is_last: bool,
+) -> Result<Vec<u8>, flate2::CompressError> {
+  let mut compressor =
+    flate2::Compress::new(flate2::Compression::new(compression_level), false);
+
+  let flush = if is_last {
+    flate2::FlushCompress::Finish
+  } else {
+    flate2::FlushCompress::Sync
+  };
+
+  // Incompressible data deflates to slightly more than its original size
+  let mut output = Vec::with_capacity(data.len() + data.len() / 64 + 64);
+
+  loop {
+    let input = &data[compressor.total_in() as usize..];
+
+    let status = compressor.compress_vec(input, &mut output, flush)?;
+
+    // A sync flush is complete once all input has been consumed and the
+    // compressor didn't fill the output, and a finish is complete at the end
+    // of the stream
+    let is_complete = if is_last {
+      status == flate2::Status::StreamEnd
+    } else {
+      compressor.total_in() as usize == data.len()
+        && output.len() < output.capacity()
+    };
+
+    if is_complete {
+      return Ok(output);
+    }
+
+    output.reserve(64 * 1024);
+  }
+}
+
+/// Deflates data by splitting it into blocks of [`DEFLATE_BLOCK_SIZE`] bytes
+/// and deflating each block with [`deflate_block()`]. The blocks are
+/// compressed concurrently on up to `thread_count` threads, including the
+/// calling thread, when the `std` feature is enabled.
+///
+/// The returned compressed blocks are in the same order as the input data. If
+/// `is_last` is true then the final block ends the deflate stream, and one
+/// block is always returned in this case, even if `data` is empty.
+///
+pub fn deflate_blocks(
+  data: &[u8],
+  compression_level: u32,
+  is_last: bool,
+  thread_count: usize,
+) -> Result<Vec<Vec<u8>>, flate2::CompressError> {
+  let mut blocks: Vec<&[u8]> = data.chunks(DEFLATE_BLOCK_SIZE).collect();
+  if blocks.is_empty() {
+    if !is_last {
+      return Ok(vec![]);
+    }
+
+    blocks.push(&[]);
+  }
+
+  let last_index = blocks.len() - 1;
+  let deflate = |(i, block): (usize, &[u8])| {
+    deflate_block(block, compression_level, is_last && i == last_index)
+  };
+
+  #[cfg(feature = "std")]
+  if thread_count > 1 && blocks.len() > 1 {
+    let blocks_per_thread = blocks.len().div_ceil(thread_count);
+
+    let groups: Vec<_> = blocks
+      .iter()
+      .copied()
+      .enumerate()
+      .collect::<Vec<_>>()
+      .chunks(blocks_per_thread)
+      .map(|group| group.to_vec())
+      .collect();
+
+    return std::thread::scope(|scope| {
+      let mut groups = groups.into_iter();
+      let first_group = groups.next().unwrap_or_default();
+
+      let handles: Vec<_> = groups
+        .map(|group| {
+          scope.spawn(move || {
+            group
+              .into_iter()
+              .map(deflate)
+              .collect::<Result<Vec<_>, _>>()
+          })
+        })
+        .collect();
+
+      let mut output = first_group
+        .into_iter()
+        .map(deflate)
+        .collect::<Result<Vec<_>, _>>()?;
+
+      for handle in handles {
+        output.extend(handle.join().unwrap()?);
+      }
+
+      Ok(output)
+    });
+  }
+
+  #[cfg(not(feature = "std"))]
+  let _ = thread_count;
+
+  blocks.into_iter().enumerate().map(deflate).collect()
+}
+
+#[cfg(test)]
+mod tests {
+  #[cfg(not(feature = "std"))]
+  use alloc::vec::Vec;
+
+  use super::*;
+
+  fn inflate(data: &[u8]) -> Vec<u8> {
+    let mut decompressor = flate2::Decompress::new(false);
+    let mut output = Vec::with_capacity(4 * 1024 * 1024);
+
+    let status = decompressor
+      .decompress_vec(data, &mut output, flate2::FlushDecompress::Finish)
+      .unwrap();
+
+    assert_eq!(status, flate2::Status::StreamEnd);
+    assert_eq!(decompressor.total_in() as usize, data.len());
+
+    output
+  }
+
+  #[test]
+  fn deflate_blocks_round_trip() {
+    let data: Vec<u8> = (0..(DEFLATE_BLOCK_SIZE * 5 + 1234))
+      .map(|i| ((i * 7) % 251) as u8 ^ (i >> 12) as u8)
+      .collect();
+
+    for thread_count in [1, 3] {
+      for compression_level in [0, 1, 6, 9] {
+        let blocks =
+          deflate_blocks(&data, compression_level, true, thread_count).unwrap();
+        assert_eq!(blocks.len(), 6);
+
+        assert_eq!(inflate(&blocks.concat()), data);
+      }
+    }
+  }
+
+  #[test]
+  fn deflate_blocks_appended_round_trip() {
+    let data: Vec<u8> = (0..(DEFLATE_BLOCK_SIZE * 2 + 10))
+      .map(|i| (i % 13) as u8)
+      .collect();
+
+    let (first, second) = data.split_at(DEFLATE_BLOCK_SIZE + 5);
+
+    let mut deflated = deflate_blocks(first, 6, false, 2).unwrap().concat();
+    deflated.extend(deflate_blocks(second, 6, true, 2).unwrap().concat());
+
+    assert_eq!(inflate(&deflated), data);
+  }
+
+  #[test]
+  fn deflate_blocks_empty() {
+    assert!(deflate_blocks(&[], 6, false, 1).unwrap().is_empty());
+
+    let blocks = deflate_blocks(&[], 6, true, 1).unwrap();
+    assert_eq!(blocks.len(), 1);
+    assert_eq!(inflate(&blocks[0]), Vec::<u8>::new());
+  }
+}
@@ -0,0 +1,324 @@
+//! A flat data set builder materializes a stream of DICOM P10 tokens into a
+//! [`FlatDataSet`] in a single pass.
+//!
+//! This is an alternative to [`crate::DataSetBuilder`] for read-heavy
+//! workloads that look up and iterate the data set many times once it's built.
+
+#[cfg(not(feature = "std"))]
+use alloc::{
+  boxed::Box,
+  format,
+  string::{String, ToString},
+  vec,
+  vec::Vec,
+};
+
+use dcmfx_core::{
+  DataElementTag, DataElementValue, DataSet, FlatDataSet, FlatDataSetWriter,
+  RcByteSlice, ValueRepresentation, dictionary,
+};
+
+use crate::data_set_builder::build_final_data_element_value;
+use crate::{P10Error, P10Token};
+
+/// A data set builder that can be fed a stream of DICOM P10 tokens and
+/// materialize them into a [`FlatDataSet`].
+///
+#[derive(Debug)]
+pub struct FlatDataSetBuilder {
+  file_preamble: Option<Box<[u8; 128]>>,
+  file_meta_information: Option<DataSet>,
+  writer: FlatDataSetWriter,
+  location: Vec<BuilderLocation>,
+  pending_data_element: Option<PendingDataElement>,
+  is_complete: bool,
+}
+
+/// Tracks where in the data set the builder is currently at. The data elements
+/// themselves are held by the [`FlatDataSetWriter`].
+///
+#[derive(Debug)]
+enum BuilderLocation {
+  RootDataSet,
+  Sequence {
+    tag: DataElementTag,
+  },
+  SequenceItem,
+  EncapsulatedPixelDataSequence {
+    vr: ValueRepresentation,
+    items: Vec<RcByteSlice>,
+  },
+}
+
+/// A data element for which a `DataElementHeader` token has been received, but
+/// one or more of its `DataElementValueBytes` tokens are still pending.
+///
+#[derive(Debug)]
+struct PendingDataElement {
+  tag: DataElementTag,
+  vr: ValueRepresentation,
+  data: Vec<RcByteSlice>,
+}
+
+impl Default for FlatDataSetBuilder {
+  fn default() -> Self {
+    Self::new()
+  }
+}
+
+impl FlatDataSetBuilder {
+  /// Creates a new flat data set builder that can be given DICOM P10 tokens to
+  /// be materialized into a [`FlatDataSet`].
+  ///
+  pub fn new() -> Self {
+    Self {
+      file_preamble: None,
+      file_meta_information: None,
+      writer: FlatDataSetWriter::new(),
+      location: vec![BuilderLocation::RootDataSet],
+      pending_data_element: None,
+      is_complete: false,
+    }
+  }
+
+  /// Returns whether the builder is complete, i.e. whether it has received the
+  /// final [`P10Token::End`] token signalling the end of the incoming DICOM P10
+  /// tokens.
+  ///
+  pub fn is_complete(&self) -> bool {
+    self.is_complete
+  }
+
+  /// Returns the File Preamble read by the builder, or an error if it has not
+  /// yet been read. The File Preamble is always 128 bytes in size.
+  ///
+  #[allow(clippy::result_unit_err)]
+  pub fn file_preamble(&self) -> Result<&[u8; 128], ()> {
+    match &self.file_preamble {
+      Some(preamble) => Ok(preamble),
+      None => Err(()),
+    }
+  }
+
+  /// Returns the final flat data set constructed from the DICOM P10 tokens the
+  /// builder has been fed, including the File Meta Information, or an error if
+  /// it has not yet been fully read. The built data set can only be taken once.
+  ///
+  #[allow(clippy::result_unit_err)]
+  pub fn final_data_set(&mut self) -> Result<FlatDataSet, ()> {
+    if !self.is_complete {
+      return Err(());
+    }
+
+    let mut writer =
+      core::mem::replace(&mut self.writer, FlatDataSetWriter::new());
+
+    // The File Meta Information is inserted last so that it takes precedence
+    // over any group 0x0002 data elements in the main data set, as happens
+    // with DataSetBuilder
+    if let Some(file_meta_information) = self.file_meta_information.take() {
+      writer.insert_data_set(&file_meta_information);
+    }
+
+    Ok(writer.finish())
+  }
+
+  /// Adds a new DICOM P10 token to the builder, checking that the tokens being
+  /// received are in a valid order.
+  ///
+  pub fn add_token(&mut self, token: &P10Token) -> Result<(), P10Error> {
+    if self.is_complete {
+      return Err(P10Error::TokenStreamInvalid {
+        when: "Building flat data set".to_string(),
+        details: "Token received after the token stream has ended".to_string(),
+        token: token.clone(),
+      });
+    }
+
+    if let Some(pending_data_element) = self.pending_data_element.as_mut() {
+      let P10Token::DataElementValueBytes {
+        data,
+        bytes_remaining,
+        ..
+      } = token
+      else {
+        return self.unexpected_token_error(token);
+      };
+
+      pending_data_element.data.push(data.clone());
+
+      if *bytes_remaining == 0
+        && let Some(PendingDataElement { tag, vr, data }) =
+          self.pending_data_element.take()
+      {
+        let value = build_final_data_element_value(tag, vr, &data);
+
+        match self.location.last_mut() {
+          Some(BuilderLocation::EncapsulatedPixelDataSequence {
+            items,
+            ..
+          }) => {
+            if let Ok(bytes) = value.bytes() {
+              items.push(bytes.clone());
+            }
+          }
+
+          _ => self.writer.insert(tag, &value),
+        }
+      }
+
+      return Ok(());
+    }
+
+    match (token, self.location.last()) {
+      (P10Token::FilePreambleAndDICMPrefix { preamble }, _) => {
+        self.file_preamble = Some(preamble.clone());
+        Ok(())
+      }
+
+      (P10Token::FileMetaInformation { data_set }, _) => {
+        self.file_meta_information = Some(data_set.clone());
+        Ok(())
+      }
+
+      (
+        P10Token::SequenceItemStart { .. },
+        Some(BuilderLocation::Sequence { .. }),
+      ) => {
+        self.writer.begin_item();
+        self.location.push(BuilderLocation::SequenceItem);
+        Ok(())
+      }
+
+      (
+        P10Token::SequenceDelimiter { .. },
+        Some(BuilderLocation::Sequence { .. }),
+      ) => {
+        self.writer.end_sequence();
+        self.location.pop();
+        Ok(())
+      }
+
+      (
+        P10Token::PixelDataItem { .. },
+        Some(BuilderLocation::EncapsulatedPixelDataSequence { .. }),
+      ) => {
+        self.pending_data_element = Some(PendingDataElement {
+          tag: dictionary::ITEM.tag,
+          vr: ValueRepresentation::OtherByteString,
+          data: vec![],
+        });
+        Ok(())
+      }
+
+      (
+        P10Token::SequenceDelimiter { .. },
+        Some(BuilderLocation::EncapsulatedPixelDataSequence { .. }),
+      ) => {
+        if let Some(BuilderLocation::EncapsulatedPixelDataSequence {
+          vr,
+          items,
+        }) = self.location.pop()
+        {
+          self.writer.insert(
+            dictionary::PIXEL_DATA.tag,
+            &DataElementValue::new_encapsulated_pixel_data_unchecked(vr, items),
+          );
+        }
+        Ok(())
+      }
+
+      (
+        P10Token::DataElementHeader { tag, vr, .. },
+        Some(BuilderLocation::RootDataSet | BuilderLocation::SequenceItem),
+      ) => {
+        self.pending_data_element = Some(PendingDataElement {
+          tag: *tag,
+          vr: *vr,
+          data: vec![],
+        });
+        Ok(())
+      }
+
+      (
+        P10Token::SequenceStart { tag, vr, .. },
+        Some(BuilderLocation::RootDataSet | BuilderLocation::SequenceItem),
+      ) => {
+        match vr {
+          ValueRepresentation::OtherByteString
+          | ValueRepresentation::OtherWordString => {
+            self.location.push(
+              BuilderLocation::EncapsulatedPixelDataSequence {
+                vr: *vr,
+                items: vec![],
+              },
+            );
+          }
+
+          _ => {
+            self.writer.begin_sequence(*tag);
+            self.location.push(BuilderLocation::Sequence { tag: *tag });
+          }
+        }
+        Ok(())
+      }
+
+      (
+        P10Token::SequenceItemDelimiter,
+        Some(BuilderLocation::SequenceItem),
+      ) => {
+        self.writer.end_item();
+        self.location.pop();
+        Ok(())
+      }
+
+      (P10Token::End, Some(BuilderLocation::RootDataSet)) => {
+        self.is_complete = true;
+        Ok(())
+      }
+
+      (token, _) => self.unexpected_token_error(token),
+    }
+  }
+
+  /// Adds multiple DICOM P10 tokens to the builder.
+  ///
+  pub fn add_tokens(&mut self, tokens: &[P10Token]) -> Result<(), P10Error> {
+    for token in tokens {
+      self.add_token(token)?;
+    }
+
+    Ok(())
+  }
+
+  /// The error returned when an unexpected DICOM P10 token is received.
+  ///
+  fn unexpected_token_error(&self, token: &P10Token) -> Result<(), P10Error> {
+    Err(P10Error::TokenStreamInvalid {
+      when: "Building flat data set".to_string(),
+      details: format!(
+        "Received unexpected P10 token at location: {}",
+        location_to_string(&self.location),
+      ),
+      token: token.clone(),
+    })
+  }
+}
+
+/// Converts a builder location to a human-readable string for error reporting
+/// and debugging purposes.
+///
+fn location_to_string(location: &[BuilderLocation]) -> String {
+  location
+    .iter()
+    .map(|item| match item {
+      BuilderLocation::RootDataSet => "RootDataSet".to_string(),
+      BuilderLocation::Sequence { tag } => format!("Sequence{tag}"),
+      BuilderLocation::SequenceItem => "SequenceItem".to_string(),
+      BuilderLocation::EncapsulatedPixelDataSequence { .. } => {
+        "EncapsulatedPixelDataSequence".to_string()
+      }
+    })
+    .collect::<Vec<_>>()
+    .join(".")
+}
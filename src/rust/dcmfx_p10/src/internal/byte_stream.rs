@@ -175,6 +175,59 @@ impl ByteStream {
     }
   }
 
+  /// Discards up to the given number of bytes from a byte stream, and returns
+  /// the number of bytes that were discarded. Unlike [`Self::read()`], the
+  /// bytes don't all need to be available, and no data is copied.
+  ///
+  /// An error is returned if there are no bytes available to discard.
+  ///
+  pub fn skip(
+    &mut self,
+    max_byte_count: usize,
+  ) -> Result<usize, ByteStreamError> {
+    if max_byte_count == 0 {
+      return Ok(0);
+    }
+
+    // Inflate at most one chunk at a time because the bytes are being
+    // discarded, so there's no need to hold more than that in memory
+    self.inflate_up_to_read_size(core::cmp::min(
+      max_byte_count,
+      ZLIB_INFLATE_CHUNK_SIZE,
+    ))?;
+
+    if self.bytes_queue_size == 0 {
+      if self.is_writing_finished {
+        return Err(ByteStreamError::DataEnd);
+      } else {
+        return Err(ByteStreamError::DataRequired);
+      }
+    }
+
+    let mut byte_count = 0;
+
+    while byte_count < max_byte_count {
+      let Some(queue_item) = self.bytes_queue.front_mut() else {
+        break;
+      };
+
+      let count = core::cmp::min(queue_item.len(), max_byte_count - byte_count);
+      *queue_item = queue_item.drop(count);
+
+      // If the chunk was fully consumed then remove it from the queue
+      if queue_item.is_empty() {
+        self.bytes_queue.pop_front();
+      }
+
+      byte_count += count;
+    }
+
+    self.bytes_queue_size -= byte_count as u64;
+    self.bytes_read += byte_count as u64;
+
+    Ok(byte_count)
+  }
+
   /// Peeks at the next bytes that will be read out of a byte stream without
   /// actually consuming them.
   ///
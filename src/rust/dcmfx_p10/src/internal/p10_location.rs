@@ -544,6 +544,18 @@ impl P10Location {
       .is_utf8()
   }
 
+  /// Returns whether decoding encoded string bytes using the currently active
+  /// specific character set would leave them unchanged, in which case they
+  /// don't need to be passed to [`Self::decode_string_bytes()`].
+  ///
+  pub fn is_string_decode_passthrough(&self, value_bytes: &[u8]) -> bool {
+    value_bytes.len() % 2 == 0
+      && self
+        .active_clarifying_data_elements()
+        .specific_character_set
+        .is_passthrough(value_bytes)
+  }
+
   /// Decodes encoded string bytes using the currently active specific character
   /// set and returns their UTF-8 bytes.
   ///
@@ -10,6 +10,8 @@ extern crate alloc;
 use alloc::{boxed::Box, string::ToString, vec, vec::Vec};
 
 pub mod data_set_builder;
+pub mod deflate;
+pub mod flat_data_set_builder;
 pub mod p10_error;
 pub mod p10_read;
 pub mod p10_read_config;
@@ -21,6 +23,8 @@ pub mod uids;
 
 mod internal;
 mod io;
+#[cfg(feature = "std")]
+mod mapped_file;
 
 #[cfg(feature = "std")]
 use std::path::Path;
@@ -30,15 +34,22 @@ pub use io::{IoError, IoRead, IoWrite};
 #[cfg(feature = "async")]
 pub use io::{IoAsyncRead, IoAsyncWrite};
 
-use dcmfx_core::{DataElementTag, DataSet, DataSetPath, RcByteSlice};
+#[cfg(feature = "std")]
+pub use mapped_file::MappedFile;
+
+use dcmfx_core::{
+  DataElementTag, DataSet, DataSetPath, FlatDataSet, RcByteSlice,
+};
 
 pub use data_set_builder::DataSetBuilder;
+pub use flat_data_set_builder::FlatDataSetBuilder;
 pub use p10_error::P10Error;
 pub use p10_read::P10ReadContext;
 pub use p10_read_config::P10ReadConfig;
 pub use p10_token::P10Token;
 pub use p10_write::P10WriteContext;
 pub use p10_write_config::P10WriteConfig;
+pub use transforms::P10TokenTransform;
 pub use transforms::p10_custom_type_transform::{
   P10CustomTypeTransform, P10CustomTypeTransformError,
 };
@@ -144,6 +155,33 @@ pub fn read_file_returning_builder_on_error<P: AsRef<Path>>(
   }
 }
 
+/// Reads DICOM P10 data from a memory mapped file into a data set. The values
+/// of data elements in the returned data set, including pixel data fragments,
+/// refer directly to the mapping rather than to copies of its bytes wherever
+/// possible, and the file stays mapped until the last of them is dropped.
+///
+/// This is intended for large local files, e.g. whole slide images, that are
+/// accessed selectively, as only the parts of the file that are used are read
+/// from disk. The file must not be modified while it is mapped, see
+/// [`MappedFile`].
+///
+#[cfg(feature = "std")]
+pub fn read_file_mapped<P: AsRef<Path>>(
+  filename: P,
+  config: Option<P10ReadConfig>,
+) -> Result<DataSet, P10Error> {
+  let mapped_file =
+    MappedFile::open(filename).map_err(|e| P10Error::FileError {
+      when: "Mapping file".to_string(),
+      details: e.to_string(),
+    })?;
+
+  match read_bytes(mapped_file.into_rc_byte_slice(), config) {
+    Ok(data_set) => Ok(data_set),
+    Err((e, _)) => Err(e),
+  }
+}
+
 /// Reads DICOM P10 data from a file into an in-memory data set. In the case of
 /// an error occurring during the read both the error and the data set builder
 /// at the time of the error are returned.
@@ -199,6 +237,45 @@ pub fn read_stream<S: IoRead>(
   }
 }
 
+/// Reads DICOM P10 data from a file into an in-memory [`FlatDataSet`], which
+/// is laid out for fast lookups and iteration but can't be modified.
+///
+#[cfg(feature = "std")]
+pub fn read_file_flat<P: AsRef<Path>>(
+  filename: P,
+  config: Option<P10ReadConfig>,
+) -> Result<FlatDataSet, P10Error> {
+  let mut file =
+    std::fs::File::open(filename).map_err(|e| P10Error::FileError {
+      when: "Opening file".to_string(),
+      details: e.to_string(),
+    })?;
+
+  read_stream_flat(&mut file, config)
+}
+
+/// Reads DICOM P10 data from a read stream into an in-memory [`FlatDataSet`]
+/// in a single pass. This will attempt to consume all data available in the
+/// read stream.
+///
+pub fn read_stream_flat<S: IoRead>(
+  stream: &mut S,
+  config: Option<P10ReadConfig>,
+) -> Result<FlatDataSet, P10Error> {
+  let mut context = P10ReadContext::new(config);
+  let mut builder = FlatDataSetBuilder::new();
+
+  loop {
+    let tokens = read_tokens_from_stream(stream, &mut context, None)?;
+
+    builder.add_tokens(&tokens)?;
+
+    if let Ok(final_data_set) = builder.final_data_set() {
+      return Ok(final_data_set);
+    }
+  }
+}
+
 /// Reads DICOM P10 data from a read stream into an in-memory data set. This
 /// will attempt to consume all data available in the read stream.
 ///
@@ -373,7 +450,8 @@ pub fn read_bytes(
 /// Reads DICOM P10 data from a file into an in-memory data set. Only the
 /// specified data elements at the root of the main data set are read, if
 /// present. The file will only be read up to the point required to return the
-/// requested data elements.
+/// requested data elements. The values of other data elements are skipped
+/// without being copied or decoded.
 ///
 #[cfg(feature = "std")]
 pub fn read_file_partial<P: AsRef<Path>>(
@@ -394,7 +472,8 @@ pub fn read_file_partial<P: AsRef<Path>>(
 /// Reads DICOM P10 data from a file into an in-memory data set. Only the
 /// specified data elements at the root of the main data set are read, if
 /// present. The file will only be read up to the point required to return the
-/// requested data elements.
+/// requested data elements. The values of other data elements are skipped
+/// without being copied or decoded.
 ///
 #[cfg(feature = "async")]
 pub async fn read_file_partial_async<P: AsRef<Path>>(
@@ -415,7 +494,8 @@ pub async fn read_file_partial_async<P: AsRef<Path>>(
 /// Reads DICOM P10 data from a stream into an in-memory data set. Only the
 /// specified data elements at the root of the main data set are read, if
 /// present. The stream will only be read up to the point required to return the
-/// requested data elements.
+/// requested data elements. The values of other data elements are skipped
+/// without being copied or decoded.
 ///
 pub fn read_stream_partial<S: IoRead>(
   stream: &mut S,
@@ -426,7 +506,10 @@ pub fn read_stream_partial<S: IoRead>(
     read_stream_partial_prepare(tags);
 
   let mut context = P10ReadContext::new(config);
+  context.select_root_data_elements(tags);
+
   let mut data_set_builder = DataSetBuilder::new();
+  let mut is_reading_largest_tag = false;
   let mut is_done = false;
 
   while !is_done {
@@ -437,6 +520,7 @@ pub fn read_stream_partial<S: IoRead>(
       largest_tag,
       &mut filter,
       &mut data_set_builder,
+      &mut is_reading_largest_tag,
       &mut is_done,
       &mut chunk_size,
     )?;
@@ -448,7 +532,8 @@ pub fn read_stream_partial<S: IoRead>(
 /// Reads DICOM P10 data from a stream into an in-memory data set. Only the
 /// specified data elements at the root of the main data set are read, if
 /// present. The stream will only be read up to the point required to return the
-/// requested data elements.
+/// requested data elements. The values of other data elements are skipped
+/// without being copied or decoded.
 ///
 #[cfg(feature = "async")]
 pub async fn read_stream_partial_async<I: IoAsyncRead>(
@@ -460,7 +545,10 @@ pub async fn read_stream_partial_async<I: IoAsyncRead>(
     read_stream_partial_prepare(tags);
 
   let mut context = P10ReadContext::new(config);
+  context.select_root_data_elements(tags);
+
   let mut data_set_builder = DataSetBuilder::new();
+  let mut is_reading_largest_tag = false;
   let mut is_done = false;
 
   while !is_done {
@@ -472,6 +560,7 @@ pub async fn read_stream_partial_async<I: IoAsyncRead>(
       largest_tag,
       &mut filter,
       &mut data_set_builder,
+      &mut is_reading_largest_tag,
       &mut is_done,
       &mut chunk_size,
     )?;
@@ -509,6 +598,7 @@ fn read_stream_partial_process_tokens(
   largest_tag: DataElementTag,
   filter: &mut P10FilterTransform,
   data_set_builder: &mut DataSetBuilder,
+  is_reading_largest_tag: &mut bool,
   is_done: &mut bool,
   chunk_size: &mut Option<usize>,
 ) -> Result<(), P10Error> {
@@ -524,6 +614,20 @@ fn read_stream_partial_process_tokens(
           *is_done = true;
           break;
         }
+
+        *is_reading_largest_tag = *tag == largest_tag
+          && path.is_root()
+          && matches!(token, P10Token::DataElementHeader { .. });
+      }
+
+      // Stop as soon as the value of the largest tag has been read, rather
+      // than waiting for the next data element's header, which may require
+      // more data to be read
+      P10Token::DataElementValueBytes {
+        bytes_remaining: 0, ..
+      } if *is_reading_largest_tag => {
+        *is_done = true;
+        break;
       }
 
       P10Token::End => {
@@ -669,6 +773,14 @@ pub fn write_tokens_to_stream<S: IoWrite>(
   }
 
   let p10_bytes = context.read_bytes();
+
+  #[cfg(feature = "std")]
+  write_all_vectored(stream, &p10_bytes).map_err(|e| P10Error::FileError {
+    when: "Writing to output stream".to_string(),
+    details: e.to_string(),
+  })?;
+
+  #[cfg(not(feature = "std"))]
   for bytes in p10_bytes.iter() {
     stream.write_all(bytes).map_err(|e| P10Error::FileError {
       when: "Writing to output stream".to_string(),
@@ -705,15 +817,13 @@ pub async fn write_tokens_to_stream_async<S: IoAsyncWrite>(
   }
 
   let p10_bytes = context.read_bytes();
-  for bytes in p10_bytes.iter() {
-    stream
-      .write_all(bytes)
-      .await
-      .map_err(|e| P10Error::FileError {
-        when: "Writing to output stream".to_string(),
-        details: e.to_string(),
-      })?;
-  }
+
+  write_all_vectored_async(stream, &p10_bytes)
+    .await
+    .map_err(|e| P10Error::FileError {
+      when: "Writing to output stream".to_string(),
+      details: e.to_string(),
+    })?;
 
   if tokens.last() == Some(&P10Token::End) {
     stream.flush().await.map_err(|e| P10Error::FileError {
@@ -727,6 +837,63 @@ pub async fn write_tokens_to_stream_async<S: IoAsyncWrite>(
   }
 }
 
+/// Writes all of the given byte slices to a stream using vectored writes, so
+/// that the stream is given the slices as they are, e.g. pixel data fragments
+/// straight from a codec, rather than them first being copied into one buffer.
+///
+#[cfg(feature = "std")]
+fn write_all_vectored<S: IoWrite>(
+  stream: &mut S,
+  slices: &[RcByteSlice],
+) -> std::io::Result<()> {
+  let mut io_slices: Vec<std::io::IoSlice> = slices
+    .iter()
+    .filter(|bytes| !bytes.is_empty())
+    .map(|bytes| std::io::IoSlice::new(bytes))
+    .collect();
+  let mut io_slices = io_slices.as_mut_slice();
+
+  while !io_slices.is_empty() {
+    match stream.write_vectored(io_slices) {
+      Ok(0) => return Err(std::io::ErrorKind::WriteZero.into()),
+      Ok(n) => std::io::IoSlice::advance_slices(&mut io_slices, n),
+      Err(e) if e.kind() == std::io::ErrorKind::Interrupted => (),
+      Err(e) => return Err(e),
+    }
+  }
+
+  Ok(())
+}
+
+/// Writes all of the given byte slices to an async stream using vectored
+/// writes. See [`write_all_vectored()`].
+///
+#[cfg(feature = "async")]
+async fn write_all_vectored_async<S: IoAsyncWrite>(
+  stream: &mut S,
+  slices: &[RcByteSlice],
+) -> std::io::Result<()> {
+  use tokio::io::AsyncWriteExt;
+
+  let mut io_slices: Vec<std::io::IoSlice> = slices
+    .iter()
+    .filter(|bytes| !bytes.is_empty())
+    .map(|bytes| std::io::IoSlice::new(bytes))
+    .collect();
+  let mut io_slices = io_slices.as_mut_slice();
+
+  while !io_slices.is_empty() {
+    match stream.write_vectored(io_slices).await {
+      Ok(0) => return Err(std::io::ErrorKind::WriteZero.into()),
+      Ok(n) => std::io::IoSlice::advance_slices(&mut io_slices, n),
+      Err(e) if e.kind() == std::io::ErrorKind::Interrupted => (),
+      Err(e) => return Err(e),
+    }
+  }
+
+  Ok(())
+}
+
 /// Rewrites a DICOM P10 file to a new DICOM P10 file. Rewriting may correct
 /// issues in the input DICOM P10 file.
 ///
@@ -1175,4 +1342,96 @@ mod tests {
       vec![dictionary::ROWS.tag, dictionary::COLUMNS.tag]
     );
   }
+
+  #[test]
+  fn read_file_partial_matches_full_read_test() {
+    let tags = [
+      dictionary::SOP_INSTANCE_UID.tag,
+      dictionary::REFERENCED_IMAGE_SEQUENCE.tag,
+      dictionary::PATIENT_NAME.tag,
+      dictionary::CONTENT_SEQUENCE.tag,
+      dictionary::ROWS.tag,
+    ];
+
+    for filename in [
+      "CT_small.dcm",
+      "ExplVR_BigEnd.dcm",
+      "MR_small_implicit.dcm",
+      "nested_priv_SQ.dcm",
+      "test-SR.dcm",
+    ] {
+      let path = format!("../../../test/assets/pydicom/test_files/{filename}");
+
+      let mut expected = read_file(&path, None).unwrap();
+      expected.retain(|tag, _| tags.contains(&tag));
+
+      assert_eq!(read_file_partial(&path, &tags, None).unwrap(), expected);
+    }
+  }
+
+  #[test]
+  fn write_tokens_to_stream_vectored_test() {
+    // A stream that accepts at most three bytes per write, so that vectored
+    // writes are split part way through slices
+    struct ShortWriter(Vec<u8>);
+
+    impl std::io::Write for ShortWriter {
+      fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+        self.write_vectored(&[std::io::IoSlice::new(buf)])
+      }
+
+      fn write_vectored(
+        &mut self,
+        bufs: &[std::io::IoSlice<'_>],
+      ) -> std::io::Result<usize> {
+        let bytes: Vec<u8> =
+          bufs.iter().flat_map(|b| b.iter()).copied().collect();
+        let length = bytes.len().min(3);
+        self.0.extend_from_slice(&bytes[..length]);
+        Ok(length)
+      }
+
+      fn flush(&mut self) -> std::io::Result<()> {
+        Ok(())
+      }
+    }
+
+    let path = "../../../test/assets/pydicom/test_files/693_J2KI.dcm";
+    let data_set = read_file(path, None).unwrap();
+
+    let mut expected = vec![];
+    write_stream(&mut expected, &data_set, None).unwrap();
+
+    let mut stream = ShortWriter(vec![]);
+    let mut context = P10WriteContext::new(None);
+    p10_write::data_set_to_tokens(
+      &data_set,
+      &DataSetPath::new(),
+      &mut |token| {
+        write_tokens_to_stream(&[token], &mut stream, &mut context).map(|_| ())
+      },
+    )
+    .unwrap();
+
+    assert_eq!(stream.0, expected);
+  }
+
+  #[test]
+  fn read_file_flat_matches_full_read_test() {
+    for filename in [
+      "693_J2KI.dcm",
+      "CT_small.dcm",
+      "ExplVR_BigEnd.dcm",
+      "MR_small_implicit.dcm",
+      "nested_priv_SQ.dcm",
+      "test-SR.dcm",
+    ] {
+      let path = format!("../../../test/assets/pydicom/test_files/{filename}");
+
+      assert_eq!(
+        read_file_flat(&path, None).unwrap().to_data_set(),
+        read_file(&path, None).unwrap()
+      );
+    }
+  }
 }
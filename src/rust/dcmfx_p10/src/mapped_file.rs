@@ -0,0 +1,148 @@
+//! Read-only memory mapping of a whole file, which is the buffer behind the
+//! [`RcByteSlice`]s in data sets read with [`crate::read_file_mapped()`].
+//!
+//! On platforms without support for memory mapping the file is read into memory
+//! instead.
+
+use std::path::Path;
+
+use dcmfx_core::RcByteSlice;
+
+/// A read-only memory mapping of the full contents of a file. The mapping is
+/// unmapped when this value is dropped.
+///
+/// The file must not be truncated or modified while it is mapped. On Unix,
+/// reading from a mapping of a file that has been truncated raises `SIGBUS`.
+///
+pub struct MappedFile {
+  #[cfg(all(unix, target_pointer_width = "64"))]
+  address: *mut core::ffi::c_void,
+
+  #[cfg(not(all(unix, target_pointer_width = "64")))]
+  data: Vec<u8>,
+
+  len: usize,
+}
+
+// The mapping is read-only and is never changed or unmapped while it is shared,
+// so it can be read from any thread.
+unsafe impl Send for MappedFile {}
+unsafe impl Sync for MappedFile {}
+
+impl MappedFile {
+  /// Maps the full contents of the given file into memory.
+  ///
+  #[cfg(all(unix, target_pointer_width = "64"))]
+  pub fn open<P: AsRef<Path>>(filename: P) -> Result<Self, std::io::Error> {
+    use std::os::fd::AsRawFd;
+
+    let file = std::fs::File::open(filename)?;
+
+    let len = usize::try_from(file.metadata()?.len()).map_err(|_| {
+      std::io::Error::new(std::io::ErrorKind::InvalidData, "File too large")
+    })?;
+
+    // Zero-length mappings aren't allowed, so empty files are never mapped
+    if len == 0 {
+      return Ok(Self {
+        address: core::ptr::null_mut(),
+        len,
+      });
+    }
+
+    let address = unsafe {
+      libc::mmap(
+        core::ptr::null_mut(),
+        len,
+        libc::PROT_READ,
+        libc::MAP_PRIVATE,
+        file.as_raw_fd(),
+        0,
+      )
+    };
+
+    if address == libc::MAP_FAILED {
+      return Err(std::io::Error::last_os_error());
+    }
+
+    // The whole file is read front to back by a P10 read, so ask for it to be
+    // read ahead. This is only a hint, so any error is ignored.
+    unsafe { libc::madvise(address, len, libc::MADV_SEQUENTIAL) };
+
+    Ok(Self { address, len })
+  }
+
+  /// Reads the full contents of the given file into memory.
+  ///
+  #[cfg(not(all(unix, target_pointer_width = "64")))]
+  pub fn open<P: AsRef<Path>>(filename: P) -> Result<Self, std::io::Error> {
+    let data = std::fs::read(filename)?;
+    let len = data.len();
+
+    Ok(Self { data, len })
+  }
+
+  /// Returns the size of the mapped file in bytes.
+  ///
+  pub fn len(&self) -> usize {
+    self.len
+  }
+
+  /// Returns whether the mapped file is empty.
+  ///
+  pub fn is_empty(&self) -> bool {
+    self.len == 0
+  }
+
+  /// Converts this mapped file into a reference counted byte slice that refers
+  /// to all of its bytes. Slices of it don't copy any data, and the mapping is
+  /// unmapped when the last slice that refers to it is dropped.
+  ///
+  pub fn into_rc_byte_slice(self) -> RcByteSlice {
+    RcByteSlice::from_owner(self)
+  }
+}
+
+impl AsRef<[u8]> for MappedFile {
+  #[cfg(all(unix, target_pointer_width = "64"))]
+  fn as_ref(&self) -> &[u8] {
+    if self.len == 0 {
+      &[]
+    } else {
+      unsafe {
+        core::slice::from_raw_parts(self.address as *const u8, self.len)
+      }
+    }
+  }
+
+  #[cfg(not(all(unix, target_pointer_width = "64")))]
+  fn as_ref(&self) -> &[u8] {
+    &self.data
+  }
+}
+
+#[cfg(all(unix, target_pointer_width = "64"))]
+impl Drop for MappedFile {
+  fn drop(&mut self) {
+    if self.len != 0 {
+      unsafe { libc::munmap(self.address, self.len) };
+    }
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn open_test() {
+    let path = std::env::temp_dir().join("dcmfx_p10_mapped_file_test");
+    std::fs::write(&path, [1, 2, 3, 4]).unwrap();
+
+    let bytes = MappedFile::open(&path).unwrap().into_rc_byte_slice();
+    std::fs::remove_file(&path).unwrap();
+
+    assert_eq!(*bytes, [1, 2, 3, 4]);
+    assert_eq!(*bytes.slice(1, 3), [2, 3]);
+  }
+}
@@ -21,6 +21,7 @@ use dcmfx_core::{
 use crate::internal::p10_location::P10Location;
 use crate::{
   P10Error, P10FilterTransform, P10InsertTransform, P10Token, P10WriteConfig,
+  deflate,
   internal::{
     data_element_header::{DataElementHeader, ValueLengthSize},
     value_length::ValueLength,
@@ -33,6 +34,19 @@ use crate::{
 ///
 const ZLIB_DEFLATE_CHUNK_SIZE: usize = 64 * 1024;
 
+/// The compressor used for data that follows the File Meta Information when
+/// writing a deflated transfer syntax.
+///
+enum ZlibCompressor {
+  /// All data is compressed as a single deflate stream.
+  Stream(flate2::Compress),
+
+  /// Data is buffered and then compressed as independent blocks on multiple
+  /// threads, see [`crate::deflate`]. Holds the data that hasn't yet been
+  /// compressed.
+  Blocks(Vec<u8>),
+}
+
 /// A write context holds the current state of an in-progress DICOM P10 write.
 /// DICOM P10 tokens are written to a write context with
 /// [`Self::write_token()`], and output P10 bytes are returned by
@@ -44,7 +58,7 @@ pub struct P10WriteContext {
   p10_total_byte_count: u64,
   is_ended: bool,
   transfer_syntax: &'static TransferSyntax,
-  zlib_stream: Option<flate2::Compress>,
+  zlib_compressor: Option<ZlibCompressor>,
   location: P10Location,
   path: DataSetPath,
 }
@@ -59,7 +73,7 @@ impl P10WriteContext {
       p10_total_byte_count: 0,
       is_ended: false,
       transfer_syntax: &transfer_syntax::IMPLICIT_VR_LITTLE_ENDIAN,
-      zlib_stream: None,
+      zlib_compressor: None,
       location: P10Location::new(),
       path: DataSetPath::new(),
     }
@@ -108,10 +122,14 @@ impl P10WriteContext {
         // If this is a deflated transfer syntax then start a zlib compressor
         // and exclude the zlib header
         if new_transfer_syntax.is_deflated {
-          self.zlib_stream = Some(flate2::Compress::new(
-            flate2::Compression::new(self.config.zlib_compression_level),
-            false,
-          ));
+          self.zlib_compressor = Some(if self.config.zlib_thread_count > 1 {
+            ZlibCompressor::Blocks(vec![])
+          } else {
+            ZlibCompressor::Stream(flate2::Compress::new(
+              flate2::Compression::new(self.config.zlib_compression_level),
+              false,
+            ))
+          });
         }
 
         self.transfer_syntax = new_transfer_syntax;
@@ -126,8 +144,8 @@ impl P10WriteContext {
       // When the end token is received, update the flag on the write context
       // and flush all remaining data out of the zlib stream if one is in use
       P10Token::End => {
-        if let Some(zlib_stream) = self.zlib_stream.as_mut() {
-          loop {
+        match self.zlib_compressor.take() {
+          Some(ZlibCompressor::Stream(mut zlib_stream)) => loop {
             let mut output = vec![0u8; ZLIB_DEFLATE_CHUNK_SIZE];
 
             let total_out = zlib_stream.total_out();
@@ -155,9 +173,13 @@ impl P10WriteContext {
             if status == flate2::Status::StreamEnd {
               break;
             }
+          },
+
+          Some(ZlibCompressor::Blocks(data)) => {
+            self.write_deflated_blocks(&data, true)?
           }
 
-          self.zlib_stream = None;
+          None => (),
         }
 
         self.is_ended = true;
@@ -233,43 +255,65 @@ impl P10WriteContext {
         }
         .map_err(map_to_p10_token_stream_error)?;
 
-        // If a zlib stream is active then pass the P10 bytes through it
-        if let Some(zlib_stream) = self.zlib_stream.as_mut() {
-          let mut token_bytes_remaining = &token_bytes[..];
-
-          while !token_bytes_remaining.is_empty() {
-            let mut output = vec![0u8; ZLIB_DEFLATE_CHUNK_SIZE];
+        // If a zlib compressor is active then pass the P10 bytes through it
+        match self.zlib_compressor.as_mut() {
+          Some(ZlibCompressor::Stream(zlib_stream)) => {
+            let mut token_bytes_remaining = &token_bytes[..];
+
+            while !token_bytes_remaining.is_empty() {
+              let mut output = vec![0u8; ZLIB_DEFLATE_CHUNK_SIZE];
+
+              // Add bytes to the zlib compressor and read back any compressed
+              // data
+              let total_in = zlib_stream.total_in();
+              let total_out = zlib_stream.total_out();
+              zlib_stream
+                .compress(
+                  token_bytes_remaining,
+                  &mut output,
+                  flate2::FlushCompress::None,
+                )
+                .unwrap();
+              output
+                .resize((zlib_stream.total_out() - total_out) as usize, 0u8);
+
+              if !output.is_empty() {
+                self.p10_total_byte_count += output.len() as u64;
+                self.p10_bytes.push(output.into());
+              }
 
-            // Add bytes to the zlib compressor and read back any compressed
-            // data
-            let total_in = zlib_stream.total_in();
-            let total_out = zlib_stream.total_out();
-            zlib_stream
-              .compress(
-                token_bytes_remaining,
-                &mut output,
-                flate2::FlushCompress::None,
-              )
-              .unwrap();
-            output.resize((zlib_stream.total_out() - total_out) as usize, 0u8);
+              let input_bytes_consumed =
+                (zlib_stream.total_in() - total_in) as usize;
+              if input_bytes_consumed == 0 {
+                panic!("zlib compressor did not consume any bytes");
+              }
 
-            if !output.is_empty() {
-              self.p10_total_byte_count += output.len() as u64;
-              self.p10_bytes.push(output.into());
+              token_bytes_remaining =
+                &token_bytes_remaining[input_bytes_consumed..];
             }
+          }
+
+          Some(ZlibCompressor::Blocks(data)) => {
+            data.extend_from_slice(&token_bytes);
+
+            // Compress whole blocks once there's at least one for each thread
+            let batch_size =
+              self.config.zlib_thread_count * deflate::DEFLATE_BLOCK_SIZE;
 
-            let input_bytes_consumed =
-              (zlib_stream.total_in() - total_in) as usize;
-            if input_bytes_consumed == 0 {
-              panic!("zlib compressor did not consume any bytes");
+            if data.len() >= batch_size {
+              let length =
+                data.len() - data.len() % deflate::DEFLATE_BLOCK_SIZE;
+              let remainder = data.split_off(length);
+              let batch = core::mem::replace(data, remainder);
+
+              self.write_deflated_blocks(&batch, false)?;
             }
+          }
 
-            token_bytes_remaining =
-              &token_bytes_remaining[input_bytes_consumed..];
+          None => {
+            self.p10_total_byte_count += token_bytes.len() as u64;
+            self.p10_bytes.push(token_bytes);
           }
-        } else {
-          self.p10_total_byte_count += token_bytes.len() as u64;
-          self.p10_bytes.push(token_bytes);
         }
 
         Ok(())
@@ -277,6 +321,38 @@ impl P10WriteContext {
     }
   }
 
+  /// Deflates data as independent blocks that are compressed concurrently, and
+  /// adds the compressed blocks to the output P10 bytes. If `is_last` is true
+  /// then the deflate stream is ended.
+  ///
+  fn write_deflated_blocks(
+    &mut self,
+    data: &[u8],
+    is_last: bool,
+  ) -> Result<(), P10Error> {
+    let blocks = deflate::deflate_blocks(
+      data,
+      self.config.zlib_compression_level,
+      is_last,
+      self.config.zlib_thread_count,
+    )
+    .map_err(|error| P10Error::DataInvalid {
+      when: "Performing zlib compression".to_string(),
+      details: error.message().unwrap_or("<unknown>").to_string(),
+      path: self.path.clone(),
+      offset: self.p10_total_byte_count,
+    })?;
+
+    for block in blocks {
+      if !block.is_empty() {
+        self.p10_total_byte_count += block.len() as u64;
+        self.p10_bytes.push(block.into());
+      }
+    }
+
+    Ok(())
+  }
+
   /// Converts a single DICOM P10 token to raw DICOM P10 bytes.
   ///
   fn token_to_bytes(&self, token: &P10Token) -> Result<RcByteSlice, P10Error> {
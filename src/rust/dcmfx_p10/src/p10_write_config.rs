@@ -10,6 +10,7 @@ pub struct P10WriteConfig {
   pub(crate) implementation_class_uid: String,
   pub(crate) implementation_version_name: String,
   pub(crate) zlib_compression_level: u32,
+  pub(crate) zlib_thread_count: usize,
 }
 
 impl Default for P10WriteConfig {
@@ -20,6 +21,7 @@ impl Default for P10WriteConfig {
       implementation_version_name: uids::DCMFX_IMPLEMENTATION_VERSION_NAME
         .to_string(),
       zlib_compression_level: 6,
+      zlib_thread_count: 1,
     }
   }
 }
@@ -59,4 +61,20 @@ impl P10WriteConfig {
     self.zlib_compression_level = value.clamp(0, 9);
     self
   }
+
+  /// The number of threads to use for zlib compression when the transfer
+  /// syntax being used is deflated.
+  ///
+  /// With more than one thread, data is deflated in independent blocks that
+  /// are compressed concurrently, see [`crate::deflate`]. This is faster, but
+  /// gives a slightly lower compression ratio. A value of one compresses all
+  /// data as a single stream on the calling thread. Threads are only used when
+  /// the `std` feature is enabled.
+  ///
+  /// Default: 1.
+  ///
+  pub fn zlib_thread_count(mut self, value: usize) -> Self {
+    self.zlib_thread_count = value.max(1);
+    self
+  }
 }
@@ -6,3 +6,35 @@ pub mod p10_custom_type_transform;
 pub mod p10_filter_transform;
 pub mod p10_insert_transform;
 pub mod p10_print_transform;
+
+use crate::P10Token;
+
+/// A transform of a stream of DICOM P10 tokens that pushes the tokens it
+/// outputs into a sink provided by the caller, rather than returning them in a
+/// new vector for every token added.
+///
+/// Tokens are added by value, so tokens that pass through a transform unchanged
+/// are moved into the sink without being cloned, and their data is never
+/// copied. Transforms are chained by nesting their sinks, e.g. a filter
+/// transform whose sink adds tokens to an insert transform whose sink writes
+/// them to a [`crate::P10WriteContext`], which avoids allocating between the
+/// stages of the chain.
+///
+/// The sink's error type `E` is that of the whole chain, and a transform's own
+/// errors are converted into it.
+///
+pub trait P10TokenTransform {
+  /// The type of error that can occur when adding a token to this transform.
+  ///
+  type Error;
+
+  /// Adds the next token to this transform, passing the resulting tokens to
+  /// the sink in order. There may be no resulting tokens, e.g. when this
+  /// transform removes or buffers the token.
+  ///
+  fn push_token<E: From<Self::Error>>(
+    &mut self,
+    token: P10Token,
+    sink: &mut impl FnMut(P10Token) -> Result<(), E>,
+  ) -> Result<(), E>;
+}
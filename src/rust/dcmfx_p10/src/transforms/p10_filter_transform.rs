@@ -3,7 +3,7 @@ use alloc::{boxed::Box, string::ToString, vec, vec::Vec};
 
 use dcmfx_core::{DataElementTag, DataSetPath, ValueRepresentation};
 
-use crate::{P10Error, P10Token};
+use crate::{P10Error, P10Token, P10TokenTransform};
 
 /// Transform that applies a data element filter to a stream of DICOM P10
 /// tokens. Incoming data elements are passed to a predicate function that
@@ -140,3 +140,22 @@ impl P10FilterTransform {
     }
   }
 }
+
+impl P10TokenTransform for P10FilterTransform {
+  type Error = P10Error;
+
+  /// Adds the next token to the P10 filter transform and passes it to the sink
+  /// if it's included in the filtered token stream.
+  ///
+  fn push_token<E: From<P10Error>>(
+    &mut self,
+    token: P10Token,
+    sink: &mut impl FnMut(P10Token) -> Result<(), E>,
+  ) -> Result<(), E> {
+    if self.add_token(&token)? {
+      sink(token)
+    } else {
+      Ok(())
+    }
+  }
+}
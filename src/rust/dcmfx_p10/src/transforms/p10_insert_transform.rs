@@ -5,7 +5,9 @@ use dcmfx_core::{
   DataElementTag, DataElementValue, DataSet, DataSetPath, IodModule,
 };
 
-use crate::{P10Error, P10FilterTransform, P10Token, p10_token};
+use crate::{
+  P10Error, P10FilterTransform, P10Token, P10TokenTransform, p10_token,
+};
 
 /// Transform that inserts data elements into a stream of DICOM P10 tokens. If
 /// the incoming stream of DICOM P10 tokens already contains a data element
@@ -66,31 +68,85 @@ impl P10InsertTransform {
   /// Adds the next available token to this transform and returns the resulting
   /// tokens.
   ///
+  /// [`P10TokenTransform::push_token()`] avoids cloning the token and
+  /// allocating the returned vector.
+  ///
   pub fn add_token(
     &mut self,
     token: &P10Token,
   ) -> Result<Vec<P10Token>, P10Error> {
+    let mut output_tokens = vec![];
+
+    self.push_token(token.clone(), &mut |token| {
+      output_tokens.push(token);
+      Ok::<(), P10Error>(())
+    })?;
+
+    Ok(output_tokens)
+  }
+
+  /// If there are any remaining data elements for this transform to insert,
+  /// appends them to the given vector.
+  ///
+  /// This happens automatically when a [`P10Token::End`] token is received, but
+  /// in some circumstances may need to be triggered manually.
+  ///
+  pub fn flush(&mut self, output_tokens: &mut Vec<P10Token>) {
+    self
+      .flush_to_sink(&mut |token| {
+        output_tokens.push(token);
+        Ok::<(), ()>(())
+      })
+      .unwrap();
+  }
+
+  /// If there are any remaining data elements for this transform to insert,
+  /// passes their tokens to the sink.
+  ///
+  fn flush_to_sink<E>(
+    &mut self,
+    sink: &mut impl FnMut(P10Token) -> Result<(), E>,
+  ) -> Result<(), E> {
+    while let Some((tag, value)) = self.data_elements_to_insert.pop() {
+      p10_token::data_element_to_tokens(
+        tag,
+        &value,
+        &DataSetPath::new_with_data_element(tag),
+        sink,
+      )?;
+    }
+
+    Ok(())
+  }
+}
+
+impl P10TokenTransform for P10InsertTransform {
+  type Error = P10Error;
+
+  fn push_token<E: From<P10Error>>(
+    &mut self,
+    token: P10Token,
+    sink: &mut impl FnMut(P10Token) -> Result<(), E>,
+  ) -> Result<(), E> {
     // If there are no more data elements to be inserted then pass the token
     // straight through
     if self.data_elements_to_insert.is_empty() {
-      return Ok(vec![token.clone()]);
+      return sink(token);
     }
 
     let is_at_root = self.filter_transform.is_at_root();
 
     // Pass the token through the filter transform
-    if !self.filter_transform.add_token(token)? {
-      return Ok(vec![]);
+    if !self.filter_transform.add_token(&token)? {
+      return Ok(());
     }
 
     // Data element insertion is only supported in the root data set, so if the
     // stream is not at the root data set then there's nothing to do
     if !is_at_root {
-      return Ok(vec![token.clone()]);
+      return sink(token);
     }
 
-    let mut output_tokens = vec![];
-
     match &token {
       // If this token is the start of a new data element, and there are data
       // elements still to be inserted, then insert any that should appear prior
@@ -114,63 +170,23 @@ impl P10InsertTransform {
               token: token.clone(),
             })?;
 
-          self.append_data_element_tokens(
-            data_element,
+          p10_token::data_element_to_tokens(
+            data_element.0,
+            &data_element.1,
             &path,
-            &mut output_tokens,
-          );
+            sink,
+          )?;
         }
-
-        output_tokens.push(token.clone());
       }
 
       // If this token is the end of the P10 tokens and there are still data
       // elements to be inserted then insert them now prior to the end
-      P10Token::End => {
-        self.flush(&mut output_tokens);
-        output_tokens.push(P10Token::End);
-      }
+      P10Token::End => self.flush_to_sink(sink)?,
 
-      _ => output_tokens.push(token.clone()),
+      _ => (),
     };
 
-    Ok(output_tokens)
-  }
-
-  /// If there are any remaining data elements for this transform to insert,
-  /// appends them to the given vector.
-  ///
-  /// This happens automatically when a [`P10Token::End`] token is received, but
-  /// in some circumstances may need to be triggered manually.
-  ///
-  pub fn flush(&mut self, output_tokens: &mut Vec<P10Token>) {
-    while let Some(data_element) = self.data_elements_to_insert.pop() {
-      let tag = data_element.0;
-
-      self.append_data_element_tokens(
-        data_element,
-        &DataSetPath::new_with_data_element(tag),
-        output_tokens,
-      );
-    }
-  }
-
-  fn append_data_element_tokens(
-    &self,
-    data_element: (DataElementTag, DataElementValue),
-    path: &DataSetPath,
-    output_tokens: &mut Vec<P10Token>,
-  ) {
-    p10_token::data_element_to_tokens::<()>(
-      data_element.0,
-      &data_element.1,
-      path,
-      &mut |token: P10Token| {
-        output_tokens.push(token);
-        Ok(())
-      },
-    )
-    .unwrap();
+    sink(token)
   }
 }
 
@@ -252,6 +268,58 @@ mod tests {
     );
   }
 
+  #[test]
+  fn push_token_through_chain_test() {
+    let mut filter_transform =
+      P10FilterTransform::new(Box::new(|tag, _vr, _length, _path| {
+        tag != DataElementTag::new(2, 0)
+      }));
+
+    let mut insert_transform = P10InsertTransform::new(
+      vec![(
+        DataElementTag::new(1, 0),
+        DataElementValue::new_long_text("01").unwrap(),
+      )]
+      .into_iter()
+      .collect(),
+    );
+
+    let input_tokens: Vec<P10Token> = vec![
+      tokens_for_tag(DataElementTag::new(0, 0), b"10"),
+      tokens_for_tag(DataElementTag::new(2, 0), b"12"),
+      tokens_for_tag(DataElementTag::new(3, 0), b"13"),
+      vec![P10Token::End],
+    ]
+    .into_iter()
+    .flatten()
+    .collect();
+
+    let mut output_tokens = vec![];
+    for token in input_tokens {
+      filter_transform
+        .push_token(token, &mut |token| {
+          insert_transform.push_token(token, &mut |token| {
+            output_tokens.push(token);
+            Ok::<(), P10Error>(())
+          })
+        })
+        .unwrap();
+    }
+
+    assert_eq!(
+      output_tokens,
+      vec![
+        tokens_for_tag(DataElementTag::new(0, 0), b"10"),
+        tokens_for_tag(DataElementTag::new(1, 0), b"01"),
+        tokens_for_tag(DataElementTag::new(3, 0), b"13"),
+        vec![P10Token::End],
+      ]
+      .into_iter()
+      .flatten()
+      .collect::<Vec<P10Token>>()
+    );
+  }
+
   fn tokens_for_tag(tag: DataElementTag, value_bytes: &[u8]) -> Vec<P10Token> {
     vec![
       P10Token::DataElementHeader {
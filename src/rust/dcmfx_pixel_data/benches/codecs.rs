@@ -0,0 +1,722 @@
+//! Benchmarks the decode and encode of pixel data by each of the vendored
+//! codecs on images representative of common modalities, reporting the
+//! throughput in megapixels per second, the compression ratio, and the peak
+//! resident set size. JPEG XL is benchmarked with each of its encode profiles,
+//! which shows the trade-off between decode speed and size.
+//!
+//! Run with `cargo bench -p dcmfx_pixel_data --bench codecs`. Arguments that
+//! don't start with `--` filter the benchmarks to those whose image or codec
+//! name contains one of them, e.g. `cargo bench --bench codecs -- charls CT`.
+//!
+//! Frames are encoded and decoded on a single thread unless `--threads=<n>` is
+//! passed, where zero uses one thread per CPU core. Comparing runs with
+//! `--threads=1` and `--threads=0` shows how much each codec gains from
+//! multiple threads at each image size.
+//!
+//! The allocation and first touch of a large frame buffer is also benchmarked,
+//! with and without huge pages, see [`dcmfx_pixel_data::FrameBufferPool`].
+//!
+//! The transcode of a multi-frame data set is benchmarked with and without
+//! lossless verification, which shows the cost of
+//! [`P10PixelDataTranscodeTransform::set_verify_lossless()`].
+
+use std::time::{Duration, Instant};
+
+use dcmfx_core::{
+  DataSet, IodModule, TransferSyntax, dictionary, transfer_syntax,
+};
+use dcmfx_p10::DataSetP10Extensions;
+use dcmfx_pixel_data::{
+  ColorImage, ColorSpace, DataSetPixelDataExtensions, FrameBufferPool,
+  MonochromeImage, PixelDataDecodeConfig, PixelDataEncodeConfig,
+  PixelDataFrame, decode,
+  decode::{HighThroughputJpeg2000Decoder, JpegBaselineDecoder, JpegXlDecoder},
+  encode,
+  encode::{JpegBaselineEncoder, JpegXlEncodeProfile},
+  iods::image_pixel_module::{
+    BitsAllocated, ImagePixelModule, PhotometricInterpretation,
+    PixelRepresentation, PlanarConfiguration, SamplesPerPixel,
+  },
+  transforms::P10PixelDataTranscodeTransform,
+};
+
+const TEST_ASSETS: &str =
+  concat!(env!("CARGO_MANIFEST_DIR"), "/../../../test/assets");
+
+/// The minimum time to spend running each benchmark, after one warm up run.
+const MIN_DURATION: Duration = Duration::from_secs(1);
+
+fn main() {
+  let filters: Vec<String> = std::env::args()
+    .skip(1)
+    .filter(|arg| !arg.starts_with("--"))
+    .collect();
+
+  let is_selected = |names: &[&str]| {
+    filters.is_empty()
+      || filters
+        .iter()
+        .any(|f| names.iter().any(|n| n.contains(f.as_str())))
+  };
+
+  println!(
+    "{:<24} {:<24} {:<11} {:>10} {:>7} {:>14}",
+    "Image", "Codec", "Operation", "MPixel/s", "Ratio", "Peak RSS (MiB)"
+  );
+
+  for image in images() {
+    for codec in codecs() {
+      if !is_selected(&[image.name, codec.name]) {
+        continue;
+      }
+
+      bench_codec(&image, &codec);
+    }
+  }
+
+  if is_selected(&["libjxl", "US 320x240 JPEG"]) {
+    bench_jpeg_xl_jpeg_recompression();
+  }
+
+  if is_selected(&["frame buffer", "WSI 16384x16384"]) {
+    bench_frame_buffer_allocation();
+  }
+
+  if is_selected(&["charls", "XA 8x512x512 16-bit"]) {
+    bench_transcode_verify();
+  }
+}
+
+/// Returns the number of threads to encode and decode each frame with, which
+/// is set with `--threads=<n>` and defaults to one.
+///
+fn thread_count() -> usize {
+  std::env::args()
+    .find_map(|arg| arg.strip_prefix("--threads=")?.parse().ok())
+    .unwrap_or(1)
+}
+
+/// An image to benchmark the codecs with.
+///
+struct Image {
+  name: &'static str,
+  image_pixel_module: ImagePixelModule,
+  data: ImageData,
+}
+
+enum ImageData {
+  Monochrome(MonochromeImage),
+  Color(ColorImage),
+}
+
+/// The images benchmarked, which are made from the test assets by scaling
+/// their values to the desired bits stored and tiling them to the desired
+/// size.
+///
+fn images() -> Vec<Image> {
+  vec![
+    monochrome_image(
+      "CT 512x512 16-bit",
+      "fo-dicom/CT-MONO2-16-ankle.dcm",
+      512,
+      512,
+      16,
+    ),
+    monochrome_image(
+      "CT 512x512 12-bit",
+      "fo-dicom/CT-MONO2-16-ankle.dcm",
+      512,
+      512,
+      12,
+    ),
+    monochrome_image(
+      "MR 256x128 16-bit",
+      "fo-dicom/mr_brucker.dcm",
+      256,
+      128,
+      16,
+    ),
+    monochrome_image(
+      "MG 2048x2560 16-bit",
+      "fo-dicom/CR-MONO1-10-chest.dcm",
+      2048,
+      2560,
+      16,
+    ),
+    monochrome_image(
+      "DX 2048x2560 12-bit",
+      "fo-dicom/CR-MONO1-10-chest.dcm",
+      2048,
+      2560,
+      12,
+    ),
+    color_image(
+      "US 640x480 RGB",
+      "pydicom/test_files/examples_rgb_color.dcm",
+      640,
+      480,
+    ),
+    color_image(
+      "WSI tile 512x512 RGB",
+      "other/ultrasound_jpeg_xl.dcm",
+      512,
+      512,
+    ),
+  ]
+}
+
+/// A codec to benchmark, which is invoked through the transfer syntax and
+/// the encode and decode configs that select it.
+///
+struct Codec {
+  name: &'static str,
+  transfer_syntax: &'static TransferSyntax,
+  encode_config: PixelDataEncodeConfig,
+  decode_config: PixelDataDecodeConfig,
+}
+
+fn codecs() -> Vec<Codec> {
+  let decode_config = PixelDataDecodeConfig {
+    thread_count: thread_count(),
+    ..PixelDataDecodeConfig::default()
+  };
+
+  let openjpeg_decode_config = PixelDataDecodeConfig {
+    high_throughput_jpeg_2000_decoder: HighThroughputJpeg2000Decoder::OpenJpeg,
+    ..decode_config
+  };
+
+  let libjxl_decode_config = PixelDataDecodeConfig {
+    jpeg_xl_decoder: JpegXlDecoder::LibJxl,
+    ..decode_config
+  };
+
+  let libjpeg_8bit_decode_config = PixelDataDecodeConfig {
+    jpeg_baseline_decoder: JpegBaselineDecoder::LibJpeg8Bit,
+    ..decode_config
+  };
+
+  let libjpeg_8bit_encode_config = {
+    let mut encode_config = encode_config();
+    encode_config.set_jpeg_baseline_encoder(JpegBaselineEncoder::LibJpeg8Bit);
+    encode_config
+  };
+
+  let libjxl_encode_config = |profile| {
+    let mut encode_config = encode_config();
+    encode_config.set_jpeg_xl_encode_profile(profile);
+    encode_config
+  };
+
+  let encode_config = encode_config();
+
+  vec![
+    Codec {
+      name: "charls",
+      transfer_syntax: &transfer_syntax::JPEG_LS_LOSSLESS,
+      encode_config,
+      decode_config,
+    },
+    Codec {
+      name: "charls near-lossless",
+      transfer_syntax: &transfer_syntax::JPEG_LS_LOSSY_NEAR_LOSSLESS,
+      encode_config,
+      decode_config,
+    },
+    Codec {
+      name: "openjph",
+      transfer_syntax:
+        &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      encode_config,
+      decode_config,
+    },
+    Codec {
+      name: "openjph lossy",
+      transfer_syntax: &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000,
+      encode_config,
+      decode_config,
+    },
+    Codec {
+      name: "openjpeg",
+      transfer_syntax: &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
+      encode_config,
+      decode_config,
+    },
+    Codec {
+      name: "openjpeg lossy",
+      transfer_syntax: &transfer_syntax::JPEG_2000,
+      encode_config,
+      decode_config,
+    },
+    Codec {
+      name: "openjpeg htj2k",
+      transfer_syntax:
+        &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      encode_config,
+      decode_config: openjpeg_decode_config,
+    },
+    Codec {
+      name: "libjxl",
+      transfer_syntax: &transfer_syntax::JPEG_XL_LOSSLESS,
+      encode_config,
+      decode_config: libjxl_decode_config,
+    },
+    Codec {
+      name: "libjxl fast-decode",
+      transfer_syntax: &transfer_syntax::JPEG_XL_LOSSLESS,
+      encode_config: libjxl_encode_config(JpegXlEncodeProfile::FastDecode),
+      decode_config: libjxl_decode_config,
+    },
+    Codec {
+      name: "libjxl max-ratio",
+      transfer_syntax: &transfer_syntax::JPEG_XL_LOSSLESS,
+      encode_config: libjxl_encode_config(JpegXlEncodeProfile::MaxRatio),
+      decode_config: libjxl_decode_config,
+    },
+    Codec {
+      name: "libjxl medical",
+      transfer_syntax: &transfer_syntax::JPEG_XL_LOSSLESS,
+      encode_config: libjxl_encode_config(JpegXlEncodeProfile::Medical),
+      decode_config: libjxl_decode_config,
+    },
+    Codec {
+      name: "libjxl lossy",
+      transfer_syntax: &transfer_syntax::JPEG_XL,
+      encode_config,
+      decode_config: libjxl_decode_config,
+    },
+    Codec {
+      name: "libjxl lossy fast-decode",
+      transfer_syntax: &transfer_syntax::JPEG_XL,
+      encode_config: libjxl_encode_config(JpegXlEncodeProfile::FastDecode),
+      decode_config: libjxl_decode_config,
+    },
+    Codec {
+      name: "libjxl lossy max-ratio",
+      transfer_syntax: &transfer_syntax::JPEG_XL,
+      encode_config: libjxl_encode_config(JpegXlEncodeProfile::MaxRatio),
+      decode_config: libjxl_decode_config,
+    },
+    Codec {
+      name: "libjxl lossy medical",
+      transfer_syntax: &transfer_syntax::JPEG_XL,
+      encode_config: libjxl_encode_config(JpegXlEncodeProfile::Medical),
+      decode_config: libjxl_decode_config,
+    },
+    Codec {
+      name: "rle",
+      transfer_syntax: &transfer_syntax::RLE_LOSSLESS,
+      encode_config,
+      decode_config,
+    },
+    Codec {
+      name: "jpeg-encoder/zune-jpeg",
+      transfer_syntax: &transfer_syntax::JPEG_BASELINE_8BIT,
+      encode_config,
+      decode_config,
+    },
+    Codec {
+      name: "libjpeg_8bit",
+      transfer_syntax: &transfer_syntax::JPEG_BASELINE_8BIT,
+      encode_config: libjpeg_8bit_encode_config,
+      decode_config: libjpeg_8bit_decode_config,
+    },
+    Codec {
+      name: "libjpeg_12bit",
+      transfer_syntax: &transfer_syntax::JPEG_EXTENDED_12BIT,
+      encode_config,
+      decode_config,
+    },
+  ]
+}
+
+fn encode_config() -> PixelDataEncodeConfig {
+  let mut encode_config = PixelDataEncodeConfig::default();
+  encode_config.set_thread_count(thread_count());
+  encode_config
+}
+
+/// Benchmarks encoding the image with the codec, and then decoding the result.
+/// Images the codec doesn't support are skipped.
+///
+fn bench_codec(image: &Image, codec: &Codec) {
+  let encode_config = &codec.encode_config;
+
+  let Ok(output_image_pixel_module) = encode::encode_image_pixel_module(
+    image.image_pixel_module.clone(),
+    codec.transfer_syntax,
+    encode_config,
+  ) else {
+    return;
+  };
+
+  let encode_frame = || match &image.data {
+    ImageData::Monochrome(data) => encode::encode_monochrome(
+      data,
+      &output_image_pixel_module,
+      codec.transfer_syntax,
+      encode_config,
+    ),
+    ImageData::Color(data) => encode::encode_color(
+      data,
+      &output_image_pixel_module,
+      codec.transfer_syntax,
+      encode_config,
+    ),
+  };
+
+  let Ok(encoded_frame) = encode_frame() else {
+    return;
+  };
+
+  let pixel_count = image.image_pixel_module.pixel_count();
+
+  let ratio = image.image_pixel_module.frame_size_in_bytes() as f64
+    / encoded_frame.len() as f64;
+
+  // Codecs that are only being benchmarked for their decoder share an encoder
+  // with another codec, so their encode isn't reported again
+  if codec.name != "openjpeg htj2k" {
+    report(
+      image.name,
+      codec.name,
+      "encode",
+      pixel_count,
+      Some(ratio),
+      || {
+        encode_frame().unwrap();
+      },
+    );
+  }
+
+  report(image.name, codec.name, "decode", pixel_count, None, || {
+    let mut frame = encoded_frame.clone();
+    decode_frame(
+      &mut frame,
+      image,
+      &output_image_pixel_module,
+      codec.transfer_syntax,
+      &codec.decode_config,
+    );
+  });
+}
+
+fn decode_frame(
+  frame: &mut PixelDataFrame,
+  image: &Image,
+  image_pixel_module: &ImagePixelModule,
+  transfer_syntax: &'static TransferSyntax,
+  decode_config: &PixelDataDecodeConfig,
+) {
+  match image.data {
+    ImageData::Monochrome(_) => {
+      decode::decode_monochrome(
+        frame,
+        transfer_syntax,
+        image_pixel_module,
+        decode_config,
+      )
+      .unwrap();
+    }
+
+    ImageData::Color(_) => {
+      decode::decode_color(
+        frame,
+        transfer_syntax,
+        image_pixel_module,
+        decode_config,
+      )
+      .unwrap();
+    }
+  }
+}
+
+/// Benchmarks lossless recompression of JPEG Baseline 8-bit data into JPEG XL,
+/// and the reconstruction of the original JPEG data from it, using libjxl.
+///
+fn bench_jpeg_xl_jpeg_recompression() {
+  let name = "US 320x240 JPEG";
+  let jpeg_data_set =
+    read_data_set("pydicom/test_files/examples_ybr_color.dcm");
+  let pixel_count = ImagePixelModule::from_data_set(&jpeg_data_set)
+    .unwrap()
+    .pixel_count();
+
+  let transcode = |data_set: &DataSet, transfer_syntax| {
+    let decode_config = PixelDataDecodeConfig {
+      thread_count: thread_count(),
+      ..PixelDataDecodeConfig::default()
+    };
+
+    data_set
+      .transcode_pixel_data(
+        transfer_syntax,
+        decode_config,
+        encode_config(),
+        None,
+      )
+      .unwrap()
+      .unwrap()
+  };
+
+  let jpeg_xl_data_set =
+    transcode(&jpeg_data_set, &transfer_syntax::JPEG_XL_JPEG_RECOMPRESSION);
+
+  report(name, "libjxl", "recompress", pixel_count, None, || {
+    transcode(&jpeg_data_set, &transfer_syntax::JPEG_XL_JPEG_RECOMPRESSION);
+  });
+
+  report(name, "libjxl", "reconstruct", pixel_count, None, || {
+    transcode(&jpeg_xl_data_set, &transfer_syntax::JPEG_BASELINE_8BIT);
+  });
+}
+
+/// Benchmarks taking a zeroed buffer for a 16384x16384 RGB frame from a new
+/// frame buffer pool, which allocates it and faults in all of its pages, with
+/// normal pages and with huge pages.
+///
+fn bench_frame_buffer_allocation() {
+  let name = "WSI 16384x16384";
+  let pixel_count = 16384 * 16384;
+
+  for (operation, huge_page_threshold) in
+    [("alloc", None), ("alloc huge", Some(0))]
+  {
+    report(name, "frame buffer", operation, pixel_count, None, || {
+      let mut pool = FrameBufferPool::default();
+      pool.set_huge_page_threshold(huge_page_threshold);
+
+      let buffer: Vec<u8> = pool.take(pixel_count * 3);
+      std::hint::black_box(buffer);
+    });
+  }
+}
+
+/// Benchmarks transcoding a multi-frame data set to JPEG-LS Lossless with and
+/// without lossless verification. Verification decodes each transcoded frame
+/// again, which on a single thread is overlapped with the transcode of the
+/// next frame.
+///
+fn bench_transcode_verify() {
+  let name = "XA 8x512x512 16-bit";
+  let data_set = read_data_set("other/xa_modality_anon.dcm");
+  let pixel_count = ImagePixelModule::from_data_set(&data_set)
+    .unwrap()
+    .pixel_count()
+    * data_set
+      .get_int::<usize>(dictionary::NUMBER_OF_FRAMES.tag)
+      .unwrap();
+
+  let decode_config = PixelDataDecodeConfig {
+    thread_count: thread_count(),
+    ..PixelDataDecodeConfig::default()
+  };
+
+  for (operation, verify_lossless) in [("transcode", false), ("verify", true)] {
+    report(name, "charls", operation, pixel_count, None, || {
+      let mut transcode_transform = P10PixelDataTranscodeTransform::new(
+        &transfer_syntax::JPEG_LS_LOSSLESS,
+        decode_config,
+        encode_config(),
+        None,
+      );
+      transcode_transform.set_verify_lossless(verify_lossless);
+
+      data_set
+        .to_p10_token_stream(&mut |token| {
+          std::hint::black_box(transcode_transform.add_token(&token)?);
+          Ok::<(), _>(())
+        })
+        .unwrap();
+    });
+  }
+}
+
+/// Runs a benchmark once to warm up, then repeatedly for at least
+/// [`MIN_DURATION`], and prints its throughput, the compression ratio if one is
+/// passed, and the peak resident set size while it ran.
+///
+fn report(
+  image_name: &str,
+  codec_name: &str,
+  operation: &str,
+  pixel_count: usize,
+  ratio: Option<f64>,
+  mut f: impl FnMut(),
+) {
+  reset_peak_rss();
+
+  f();
+
+  let start = Instant::now();
+  let mut iterations = 0;
+  while iterations == 0 || start.elapsed() < MIN_DURATION {
+    f();
+    iterations += 1;
+  }
+
+  let mpixels_per_second = (pixel_count * iterations) as f64
+    / start.elapsed().as_secs_f64()
+    / 1_000_000.0;
+
+  let peak_rss = match peak_rss() {
+    Some(peak_rss) => format!("{:.1}", peak_rss as f64 / (1024.0 * 1024.0)),
+    None => "-".to_string(),
+  };
+
+  let ratio = match ratio {
+    Some(ratio) => format!("{ratio:.2}"),
+    None => "-".to_string(),
+  };
+
+  println!(
+    "{image_name:<24} {codec_name:<24} {operation:<11} \
+     {mpixels_per_second:>10.1} {ratio:>7} {peak_rss:>14}"
+  );
+}
+
+/// Resets the peak resident set size of this process so that it can be
+/// measured for each benchmark. This is only supported on Linux.
+///
+fn reset_peak_rss() {
+  let _ = std::fs::write("/proc/self/clear_refs", "5");
+}
+
+/// Returns the peak resident set size of this process in bytes since it was
+/// last reset. This is only supported on Linux.
+///
+fn peak_rss() -> Option<u64> {
+  let status = std::fs::read_to_string("/proc/self/status").ok()?;
+  let line = status.lines().find(|line| line.starts_with("VmHWM:"))?;
+  let kib: u64 = line.split_whitespace().nth(1)?.parse().ok()?;
+
+  Some(kib * 1024)
+}
+
+fn read_data_set(path: &str) -> DataSet {
+  dcmfx_p10::read_file(format!("{TEST_ASSETS}/{path}"), None).unwrap()
+}
+
+/// Returns the first frame of the given test asset as a monochrome image of
+/// the given size and bits stored.
+///
+fn monochrome_image(
+  name: &'static str,
+  path: &str,
+  width: u16,
+  height: u16,
+  bits_stored: u16,
+) -> Image {
+  let data_set = read_data_set(path);
+  let source = data_set
+    .get_pixel_data_monochrome_images()
+    .unwrap()
+    .remove(0);
+
+  // Scale the stored values to the range of the new bits stored
+  let values = source.to_stored_values();
+  let (min, max) = source.min_max_values().unwrap();
+  let max_value = (1u64 << bits_stored) - 1;
+  let scale = max_value as f64 / ((max - min).max(1) as f64);
+
+  let data = tile(
+    usize::from(source.width()),
+    usize::from(source.height()),
+    usize::from(width),
+    usize::from(height),
+    1,
+    |i| ((values[i] - min) as f64 * scale).round() as u16,
+  );
+
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    height,
+    width,
+    BitsAllocated::Sixteen,
+    bits_stored,
+  )
+  .unwrap();
+
+  Image {
+    name,
+    image_pixel_module,
+    data: ImageData::Monochrome(
+      MonochromeImage::new_u16(width, height, data, bits_stored, false)
+        .unwrap(),
+    ),
+  }
+}
+
+/// Returns the first frame of the given test asset as an 8-bit RGB image of
+/// the given size.
+///
+fn color_image(
+  name: &'static str,
+  path: &str,
+  width: u16,
+  height: u16,
+) -> Image {
+  let data_set = read_data_set(path);
+  let source = data_set.get_pixel_data_color_images().unwrap().remove(0);
+
+  let (source_width, source_height) =
+    (usize::from(source.width()), usize::from(source.height()));
+  let samples = source.into_rgb_u8_image().into_raw();
+
+  let data = tile(
+    source_width,
+    source_height,
+    usize::from(width),
+    usize::from(height),
+    3,
+    |i| samples[i],
+  );
+
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::Three {
+      planar_configuration: PlanarConfiguration::Interleaved,
+    },
+    PhotometricInterpretation::Rgb,
+    height,
+    width,
+    BitsAllocated::Eight,
+    8,
+  )
+  .unwrap();
+
+  Image {
+    name,
+    image_pixel_module,
+    data: ImageData::Color(
+      ColorImage::new_u8(width, height, data, ColorSpace::Rgb, 8).unwrap(),
+    ),
+  }
+}
+
+/// Creates image data of the given size by repeating an image of a different
+/// size, reading its samples with the passed function.
+///
+fn tile<T>(
+  source_width: usize,
+  source_height: usize,
+  width: usize,
+  height: usize,
+  samples_per_pixel: usize,
+  sample: impl Fn(usize) -> T,
+) -> Vec<T> {
+  let mut data = Vec::with_capacity(width * height * samples_per_pixel);
+
+  for y in 0..height {
+    for x in 0..width {
+      let pixel = (y % source_height) * source_width + x % source_width;
+      for s in 0..samples_per_pixel {
+        data.push(sample(pixel * samples_per_pixel + s));
+      }
+    }
+  }
+
+  data
+}
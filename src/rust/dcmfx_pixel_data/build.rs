@@ -1,15 +1,26 @@
 fn main() {
+  // Set when OpenJPH is built, which is always the case for native targets,
+  // and on WASM when a C++ sysroot is available, see wasm_cxx_sysroot()
+  println!("cargo::rustc-check-cfg=cfg(dcmfx_openjph)");
+
   if !cfg!(feature = "native") {
     return;
   }
 
+  build_libjpeg_8bit();
   build_libjpeg_12bit();
+  build_libjpeg_16bit();
   build_openjpeg();
 
-  if !std::env::var("TARGET").unwrap().contains("wasm") {
+  let is_wasm = std::env::var("TARGET").unwrap().contains("wasm");
+
+  if !is_wasm || wasm_cxx_sysroot().is_some() {
+    build_openjph();
+  }
+
+  if !is_wasm {
     build_charls();
     build_libjxl();
-    build_openjph();
 
     // Link the C++ standard library statically on windows-gnu targets
     if std::env::var("TARGET").unwrap().contains("windows-gnu") {
@@ -18,6 +29,10 @@ fn main() {
     }
   }
 
+  // Built last so it follows the libraries that use it on the linker command
+  // line
+  build_pixel_kernels();
+
   // Re-run build if any of the header files change
   let header_files: Vec<_> = glob::glob("vendor/**/*.h*")
     .unwrap()
@@ -32,80 +47,191 @@ fn main() {
   println!("cargo::rustc-link-search=native={out_dir}");
 }
 
-fn build_libjpeg_12bit() {
+fn build_pixel_kernels() {
+  // The YBR to RGB kernels must not fuse multiplies and adds so that their
+  // output matches the conversion in Rust exactly
   compile(
-    &[
-      "vendor/libjpeg_12bit_6b/libjpeg_12bit_interface.c",
-      "vendor/libjpeg_12bit_6b/src/jaricom.c",
-      "vendor/libjpeg_12bit_6b/src/jcapimin.c",
-      "vendor/libjpeg_12bit_6b/src/jcapistd.c",
-      "vendor/libjpeg_12bit_6b/src/jcarith.c",
-      "vendor/libjpeg_12bit_6b/src/jccoefct.c",
-      "vendor/libjpeg_12bit_6b/src/jccolor.c",
-      "vendor/libjpeg_12bit_6b/src/jcdctmgr.c",
-      "vendor/libjpeg_12bit_6b/src/jcdiffct.c",
-      "vendor/libjpeg_12bit_6b/src/jchuff.c",
-      "vendor/libjpeg_12bit_6b/src/jcinit.c",
-      "vendor/libjpeg_12bit_6b/src/jclhuff.c",
-      "vendor/libjpeg_12bit_6b/src/jclossls.c",
-      "vendor/libjpeg_12bit_6b/src/jclossy.c",
-      "vendor/libjpeg_12bit_6b/src/jcmainct.c",
-      "vendor/libjpeg_12bit_6b/src/jcmarker.c",
-      "vendor/libjpeg_12bit_6b/src/jcmaster.c",
-      "vendor/libjpeg_12bit_6b/src/jcodec.c",
-      "vendor/libjpeg_12bit_6b/src/jcomapi.c",
-      "vendor/libjpeg_12bit_6b/src/jcparam.c",
-      "vendor/libjpeg_12bit_6b/src/jcphuff.c",
-      "vendor/libjpeg_12bit_6b/src/jcpred.c",
-      "vendor/libjpeg_12bit_6b/src/jcprepct.c",
-      "vendor/libjpeg_12bit_6b/src/jcsample.c",
-      "vendor/libjpeg_12bit_6b/src/jcscale.c",
-      "vendor/libjpeg_12bit_6b/src/jcshuff.c",
-      "vendor/libjpeg_12bit_6b/src/jctrans.c",
-      "vendor/libjpeg_12bit_6b/src/jdapimin.c",
-      "vendor/libjpeg_12bit_6b/src/jdapistd.c",
-      "vendor/libjpeg_12bit_6b/src/jdarith.c",
-      "vendor/libjpeg_12bit_6b/src/jdcoefct.c",
-      "vendor/libjpeg_12bit_6b/src/jdcolor.c",
-      "vendor/libjpeg_12bit_6b/src/jddctmgr.c",
-      "vendor/libjpeg_12bit_6b/src/jddiffct.c",
-      "vendor/libjpeg_12bit_6b/src/jdhuff.c",
-      "vendor/libjpeg_12bit_6b/src/jdinput.c",
-      "vendor/libjpeg_12bit_6b/src/jdlhuff.c",
-      "vendor/libjpeg_12bit_6b/src/jdlossls.c",
-      "vendor/libjpeg_12bit_6b/src/jdlossy.c",
-      "vendor/libjpeg_12bit_6b/src/jdmainct.c",
-      "vendor/libjpeg_12bit_6b/src/jdmarker.c",
-      "vendor/libjpeg_12bit_6b/src/jdmaster.c",
-      "vendor/libjpeg_12bit_6b/src/jdmerge.c",
-      "vendor/libjpeg_12bit_6b/src/jdphuff.c",
-      "vendor/libjpeg_12bit_6b/src/jdpostct.c",
-      "vendor/libjpeg_12bit_6b/src/jdpred.c",
-      "vendor/libjpeg_12bit_6b/src/jdsample.c",
-      "vendor/libjpeg_12bit_6b/src/jdscale.c",
-      "vendor/libjpeg_12bit_6b/src/jdshuff.c",
-      "vendor/libjpeg_12bit_6b/src/jerror.c",
-      "vendor/libjpeg_12bit_6b/src/jfdctflt.c",
-      "vendor/libjpeg_12bit_6b/src/jfdctfst.c",
-      "vendor/libjpeg_12bit_6b/src/jfdctint.c",
-      "vendor/libjpeg_12bit_6b/src/jidctflt.c",
-      "vendor/libjpeg_12bit_6b/src/jidctfst.c",
-      "vendor/libjpeg_12bit_6b/src/jidctint.c",
-      "vendor/libjpeg_12bit_6b/src/jidctred.c",
-      "vendor/libjpeg_12bit_6b/src/jmemmgr.c",
-      "vendor/libjpeg_12bit_6b/src/jmemnobs.c",
-      "vendor/libjpeg_12bit_6b/src/jquant1.c",
-      "vendor/libjpeg_12bit_6b/src/jquant2.c",
-      "vendor/libjpeg_12bit_6b/src/jutils.c",
-    ],
-    &["vendor/libjpeg_12bit_6b"],
+    &["vendor/pixel_kernels/pixel_kernels.c"],
+    &["vendor/codec_simd_level"],
+    &[],
+    &[BuildFlag::NoFloatContraction],
+    "dcmfx_pixel_data_pixel_kernels",
+  );
+}
+
+/// Builds the libjpeg sources with 8-bit samples, which is used to decode JPEG
+/// Baseline. All of its external symbols are renamed, see jnames8.h, so it can
+/// be linked alongside the 12-bit build.
+///
+fn build_libjpeg_8bit() {
+  build_libjpeg(
+    "vendor/libjpeg_12bit_6b/libjpeg_8bit_interface.c",
+    &[("LIBJPEG_8BIT", "1")],
     &[],
+    "dcmfx_pixel_data_libjpeg_8bit",
+  );
+}
+
+/// Builds the libjpeg sources with 12-bit samples.
+///
+/// On x86_64 they are also built for x86-64-v3 with all external symbols
+/// renamed, see jnames12v3.h, and the baseline build's entry points forward
+/// to it when the CPU supports it. This lets the compiler use AVX2, FMA, and
+/// BMI2 throughout the scalar code, not just in the SIMD routines in
+/// jsimd12.c. Float contraction is disabled in the x86-64-v3 build so that
+/// its output is identical to the baseline build's.
+///
+fn build_libjpeg_12bit() {
+  let is_x86_64 = std::env::var("CARGO_CFG_TARGET_ARCH").unwrap() == "x86_64";
+
+  let defines: &[(&str, &str)] = if is_x86_64 {
+    &[("LIBJPEG_12BIT_DISPATCH", "1")]
+  } else {
+    &[]
+  };
+
+  build_libjpeg(
+    "vendor/libjpeg_12bit_6b/libjpeg_12bit_interface.c",
+    defines,
     &[],
     "dcmfx_pixel_data_libjpeg_12bit",
   );
+
+  // Built directly after the baseline build so it follows it on the linker
+  // command line
+  if is_x86_64 {
+    build_libjpeg(
+      "vendor/libjpeg_12bit_6b/libjpeg_12bit_interface.c",
+      &[("LIBJPEG_12BIT_X86_64_V3", "1")],
+      &[
+        BuildFlag::ArchitectureX86_64V3,
+        BuildFlag::NoFloatContraction,
+      ],
+      "dcmfx_pixel_data_libjpeg_12bit_x86_64_v3",
+    );
+  }
+}
+
+/// Builds the libjpeg sources a second time with 16-bit samples, which is
+/// only supported for lossless JPEG. All of its external symbols are renamed,
+/// see jnames16.h, so it can be linked alongside the 12-bit build.
+///
+fn build_libjpeg_16bit() {
+  build_libjpeg(
+    "vendor/libjpeg_12bit_6b/libjpeg_16bit_interface.c",
+    &[("LIBJPEG_16BIT", "1")],
+    &[],
+    "dcmfx_pixel_data_libjpeg_16bit",
+  );
+}
+
+fn build_libjpeg(
+  interface_file: &str,
+  defines: &[(&str, &str)],
+  build_flags: &[BuildFlag],
+  output: &str,
+) {
+  let mut src_files = vec![interface_file];
+  src_files.extend([
+    "vendor/libjpeg_12bit_6b/src/jaricom.c",
+    "vendor/libjpeg_12bit_6b/src/jcapimin.c",
+    "vendor/libjpeg_12bit_6b/src/jcapistd.c",
+    "vendor/libjpeg_12bit_6b/src/jcarith.c",
+    "vendor/libjpeg_12bit_6b/src/jccoefct.c",
+    "vendor/libjpeg_12bit_6b/src/jccolor.c",
+    "vendor/libjpeg_12bit_6b/src/jcdctmgr.c",
+    "vendor/libjpeg_12bit_6b/src/jcdiffct.c",
+    "vendor/libjpeg_12bit_6b/src/jchuff.c",
+    "vendor/libjpeg_12bit_6b/src/jcinit.c",
+    "vendor/libjpeg_12bit_6b/src/jclhuff.c",
+    "vendor/libjpeg_12bit_6b/src/jclossls.c",
+    "vendor/libjpeg_12bit_6b/src/jclossy.c",
+    "vendor/libjpeg_12bit_6b/src/jcmainct.c",
+    "vendor/libjpeg_12bit_6b/src/jcmarker.c",
+    "vendor/libjpeg_12bit_6b/src/jcmaster.c",
+    "vendor/libjpeg_12bit_6b/src/jcodec.c",
+    "vendor/libjpeg_12bit_6b/src/jcomapi.c",
+    "vendor/libjpeg_12bit_6b/src/jcparam.c",
+    "vendor/libjpeg_12bit_6b/src/jcphuff.c",
+    "vendor/libjpeg_12bit_6b/src/jcpred.c",
+    "vendor/libjpeg_12bit_6b/src/jcprepct.c",
+    "vendor/libjpeg_12bit_6b/src/jcsample.c",
+    "vendor/libjpeg_12bit_6b/src/jcscale.c",
+    "vendor/libjpeg_12bit_6b/src/jcshuff.c",
+    "vendor/libjpeg_12bit_6b/src/jctrans.c",
+    "vendor/libjpeg_12bit_6b/src/jdapimin.c",
+    "vendor/libjpeg_12bit_6b/src/jdapistd.c",
+    "vendor/libjpeg_12bit_6b/src/jdarith.c",
+    "vendor/libjpeg_12bit_6b/src/jdcoefct.c",
+    "vendor/libjpeg_12bit_6b/src/jdcolor.c",
+    "vendor/libjpeg_12bit_6b/src/jddctmgr.c",
+    "vendor/libjpeg_12bit_6b/src/jddiffct.c",
+    "vendor/libjpeg_12bit_6b/src/jdhuff.c",
+    "vendor/libjpeg_12bit_6b/src/jdinput.c",
+    "vendor/libjpeg_12bit_6b/src/jdlhuff.c",
+    "vendor/libjpeg_12bit_6b/src/jdlossls.c",
+    "vendor/libjpeg_12bit_6b/src/jdlossy.c",
+    "vendor/libjpeg_12bit_6b/src/jdmainct.c",
+    "vendor/libjpeg_12bit_6b/src/jdmarker.c",
+    "vendor/libjpeg_12bit_6b/src/jdmaster.c",
+    "vendor/libjpeg_12bit_6b/src/jdmerge.c",
+    "vendor/libjpeg_12bit_6b/src/jdphuff.c",
+    "vendor/libjpeg_12bit_6b/src/jdpostct.c",
+    "vendor/libjpeg_12bit_6b/src/jdpred.c",
+    "vendor/libjpeg_12bit_6b/src/jdsample.c",
+    "vendor/libjpeg_12bit_6b/src/jdscale.c",
+    "vendor/libjpeg_12bit_6b/src/jdshuff.c",
+    "vendor/libjpeg_12bit_6b/src/jdtrans.c",
+    "vendor/libjpeg_12bit_6b/src/jerror.c",
+    "vendor/libjpeg_12bit_6b/src/jfdctflt.c",
+    "vendor/libjpeg_12bit_6b/src/jfdctfst.c",
+    "vendor/libjpeg_12bit_6b/src/jfdctint.c",
+    "vendor/libjpeg_12bit_6b/src/jidctflt.c",
+    "vendor/libjpeg_12bit_6b/src/jidctfst.c",
+    "vendor/libjpeg_12bit_6b/src/jidctint.c",
+    "vendor/libjpeg_12bit_6b/src/jidctred.c",
+    "vendor/libjpeg_12bit_6b/src/jmemmgr.c",
+    "vendor/libjpeg_12bit_6b/src/jmemnobs.c",
+    "vendor/libjpeg_12bit_6b/src/jquant1.c",
+    "vendor/libjpeg_12bit_6b/src/jquant2.c",
+    "vendor/libjpeg_12bit_6b/src/jsimd12.c",
+    "vendor/libjpeg_12bit_6b/src/jutils.c",
+  ]);
+
+  compile(
+    &src_files,
+    &[
+      "vendor/libjpeg_12bit_6b",
+      "vendor/codec_allocator",
+      "vendor/codec_cancel",
+      "vendor/codec_simd_level",
+    ],
+    defines,
+    build_flags,
+    output,
+  );
 }
 
 fn build_openjpeg() {
+  let mut defines = vec![("OPJ_STATIC", "1")];
+
+  // Select the mutex and thread implementation used by OpenJPEG's thread pool.
+  // Without one of these OpenJPEG has no thread support, which is what's
+  // wanted on WASM.
+  let target = std::env::var("TARGET").unwrap();
+  if target.contains("windows") {
+    defines.push(("MUTEX_win32", "1"));
+  } else if !target.contains("wasm") {
+    defines.push(("MUTEX_pthread", "1"));
+  }
+
+  // On x86_64 the DWT is also built with AVX2 and AVX-512 enabled, and the
+  // fastest variant the CPU supports is selected at runtime
+  let is_x86_64 = std::env::var("CARGO_CFG_TARGET_ARCH").unwrap() == "x86_64";
+  if is_x86_64 {
+    defines.push(("OPJ_DWT_RUNTIME_DISPATCH", "1"));
+  }
+
   compile(
     &[
       "vendor/openjpeg_2.5.4/openjpeg_interface.c",
@@ -127,17 +253,40 @@ fn build_openjpeg() {
       "vendor/openjpeg_2.5.4/src/pi.c",
       "vendor/openjpeg_2.5.4/src/sparse_array.c",
       "vendor/openjpeg_2.5.4/src/t1.c",
-      "vendor/openjpeg_2.5.4/src/t1_ht_generate_luts.c",
       "vendor/openjpeg_2.5.4/src/t2.c",
       "vendor/openjpeg_2.5.4/src/tcd.c",
       "vendor/openjpeg_2.5.4/src/tgt.c",
       "vendor/openjpeg_2.5.4/src/thread.c",
     ],
-    &["vendor/openjpeg_2.5.4/src"],
-    &[("OPJ_STATIC", "1")],
+    &[
+      "vendor/openjpeg_2.5.4/src",
+      "vendor/codec_allocator",
+      "vendor/codec_cancel",
+      "vendor/codec_simd_level",
+      "vendor/pixel_kernels",
+    ],
+    &defines,
     &[],
     "dcmfx_pixel_data_openjpeg",
   );
+
+  if is_x86_64 {
+    compile(
+      &["vendor/openjpeg_2.5.4/src/dwt_avx2.c"],
+      &["vendor/openjpeg_2.5.4/src"],
+      &[("OPJ_STATIC", "1")],
+      &[BuildFlag::ArchitectureAVX2],
+      "dcmfx_pixel_data_openjpeg_avx2",
+    );
+
+    compile(
+      &["vendor/openjpeg_2.5.4/src/dwt_avx512.c"],
+      &["vendor/openjpeg_2.5.4/src"],
+      &[("OPJ_STATIC", "1")],
+      &[BuildFlag::ArchitectureAVX512],
+      "dcmfx_pixel_data_openjpeg_avx512",
+    );
+  }
 }
 
 fn build_charls() {
@@ -153,14 +302,34 @@ fn build_charls() {
       "vendor/charls_2.4.4/src/validate_spiff_header.cpp",
       "vendor/charls_2.4.4/src/version.cpp",
     ],
-    &["vendor/charls_2.4.4/include"],
+    &[
+      "vendor/charls_2.4.4/include",
+      "vendor/codec_batch",
+      "vendor/codec_cancel",
+    ],
     &[("CHARLS_STATIC", "1")],
     &[],
     "dcmfx_pixel_data_charls",
   );
 }
 
+/// Highway compiles libjxl's SIMD code for every target attainable on the
+/// architecture and dispatches to the best one the CPU supports at runtime.
+/// On x86_64 that covers SSE2 through AVX-512 (AVX3, AVX3_ZEN4, AVX3_SPR), and
+/// on aarch64 Linux it covers NEON, SVE and SVE2. AVX3_DL (Ice Lake and later)
+/// is opt-in, so it's enabled here. It must be set the same way for libjxl and
+/// Highway itself.
+const HIGHWAY_TARGETS_DEFINE: (&str, &str) = ("HWY_WANT_AVX3_DL", "1");
+
 fn build_libjxl() {
+  // libjxl's color management system is built on lcms. Without it, a stand-in
+  // is used that fails conversions libjxl can't do itself.
+  let cms_source = if cfg!(feature = "lcms") {
+    "vendor/libjxl_0.11.1/lib/jxl/cms/jxl_cms.cc"
+  } else {
+    "vendor/libjxl_0.11.1/libjxl_no_cms.cpp"
+  };
+
   compile(
     &[
       "vendor/libjxl_0.11.1/lib/jxl/ac_strategy.cc",
@@ -170,7 +339,7 @@ fn build_libjxl() {
       "vendor/libjxl_0.11.1/lib/jxl/box_content_decoder.cc",
       "vendor/libjxl_0.11.1/lib/jxl/butteraugli/butteraugli.cc",
       "vendor/libjxl_0.11.1/lib/jxl/chroma_from_luma.cc",
-      "vendor/libjxl_0.11.1/lib/jxl/cms/jxl_cms.cc",
+      cms_source,
       "vendor/libjxl_0.11.1/lib/jxl/coeff_order.cc",
       "vendor/libjxl_0.11.1/lib/jxl/color_encoding_internal.cc",
       "vendor/libjxl_0.11.1/lib/jxl/compressed_dc.cc",
@@ -299,6 +468,10 @@ fn build_libjxl() {
       "vendor/libjxl_0.11.1/libjxl_interface.cpp",
     ],
     &[
+      "vendor/codec_allocator",
+      "vendor/codec_batch",
+      "vendor/codec_cancel",
+      "vendor/codec_simd_level",
       "vendor/libjxl_0.11.1",
       "vendor/libjxl_0.11.1/build/lib/include",
       "vendor/libjxl_0.11.1/lib/include",
@@ -311,6 +484,7 @@ fn build_libjxl() {
       ("JXL_THREADS_STATIC_DEFINE", "1"),
       ("JXL_CMS_STATIC_DEFINE", "1"),
       ("CMS_NO_REGISTER_KEYWORD", "1"),
+      HIGHWAY_TARGETS_DEFINE,
     ],
     &[],
     "dcmfx_pixel_data_libjxl",
@@ -368,11 +542,15 @@ fn build_libjxl() {
       "vendor/libjxl_0.11.1/third_party/highway/hwy/timer.cc",
     ],
     &["vendor/libjxl_0.11.1/third_party/highway"],
-    &[],
+    &[HIGHWAY_TARGETS_DEFINE],
     &[],
     "dcmfx_pixel_data_libjxl_highway",
   );
 
+  if !cfg!(feature = "lcms") {
+    return;
+  }
+
   compile(
     &[
       "vendor/libjxl_0.11.1/third_party/lcms/src/cmsalpha.c",
@@ -435,15 +613,31 @@ fn build_openjph() {
       "vendor/openjph_0.30.1/src/transform/ojph_colour.cpp",
       "vendor/openjph_0.30.1/src/transform/ojph_transform.cpp",
     ],
-    &["vendor/openjph_0.30.1/src/openjph"],
+    &[
+      "vendor/openjph_0.30.1/src/openjph",
+      "vendor/codec_batch",
+      "vendor/codec_cancel",
+      "vendor/codec_simd_level",
+      "vendor/pixel_kernels",
+    ],
     &[],
     &[],
     "dcmfx_pixel_data_openjph",
   );
 
+  println!("cargo::rustc-cfg=dcmfx_openjph");
+
+  // Link the C++ runtime from the sysroot on WASM
+  if let Some(sysroot) = wasm_cxx_sysroot() {
+    println!("cargo::rustc-link-search=native={sysroot}/lib");
+    println!("cargo::rustc-link-lib=static=c++");
+    println!("cargo::rustc-link-lib=static=c++abi");
+    println!("cargo::rustc-link-lib=static=unwind");
+  }
+
   compile(
     &["vendor/openjph_0.30.1/src/others/ojph_mem_c.c"],
-    &[],
+    &["vendor/codec_allocator"],
     &[],
     &[],
     "dcmfx_pixel_data_openjph_c",
@@ -464,6 +658,25 @@ fn build_openjph() {
     );
   }
 
+  // NEON is part of the aarch64 baseline, so these need no extra flags
+  if matches!(
+    std::env::var("CARGO_CFG_TARGET_ARCH").unwrap().as_str(),
+    "aarch64" | "arm64ec"
+  ) {
+    compile(
+      &[
+        "vendor/openjph_0.30.1/src/codestream/ojph_codestream_neon.cpp",
+        "vendor/openjph_0.30.1/src/coding/ojph_block_decoder_neon.cpp",
+        "vendor/openjph_0.30.1/src/transform/ojph_colour_neon.cpp",
+        "vendor/openjph_0.30.1/src/transform/ojph_transform_neon.cpp",
+      ],
+      &["vendor/openjph_0.30.1/src/openjph"],
+      &[],
+      &[],
+      "dcmfx_pixel_data_openjph_neon",
+    );
+  }
+
   if std::env::var("CARGO_CFG_TARGET_ARCH").unwrap() == "x86_64" {
     compile(
       &[
@@ -564,6 +777,15 @@ fn compile(
     if is_msvc() {
       build.flag("/EHsc");
     }
+
+    // On WASM, C++ is built against the headers of the C++ sysroot. There are
+    // no threads, and exceptions use WASM's native exception handling
+    if let Some(sysroot) = wasm_cxx_sysroot() {
+      build.flag("-isystem");
+      build.flag(format!("{sysroot}/include/c++/v1"));
+      build.flag("-fwasm-exceptions");
+      build.define("DCMFX_NO_THREADS", "1");
+    }
   }
 
   // Disable warnings
@@ -585,6 +807,15 @@ fn compile(
     build.opt_level(3);
   }
 
+  // On WASM, match the target features that the Rust code is built with so
+  // the codecs are vectorized with SIMD128 when it's enabled, and can be linked
+  // into a build that uses shared memory and atomics for web worker threads
+  if std::env::var("CARGO_CFG_TARGET_ARCH").unwrap() == "wasm32" {
+    for flag in wasm_target_feature_flags() {
+      build.flag(flag);
+    }
+  }
+
   // Add build flags
   for build_flag in build_flags {
     for flag in build_flag.compiler_flags() {
@@ -626,6 +857,8 @@ enum BuildFlag {
   ArchitectureSSE,
   ArchitectureSSE2,
   ArchitectureSSSE3,
+  ArchitectureX86_64V3,
+  NoFloatContraction,
 }
 
 impl BuildFlag {
@@ -638,6 +871,8 @@ impl BuildFlag {
         Self::ArchitectureSSE => &[],
         Self::ArchitectureSSE2 => &[],
         Self::ArchitectureSSSE3 => &["/arch:AVX"],
+        Self::ArchitectureX86_64V3 => &["/arch:AVX2"],
+        Self::NoFloatContraction => &["/fp:precise"],
       }
     } else {
       match self {
@@ -647,11 +882,58 @@ impl BuildFlag {
         Self::ArchitectureSSE => &["-msse"],
         Self::ArchitectureSSE2 => &["-msse2"],
         Self::ArchitectureSSSE3 => &["-mssse3"],
+        Self::ArchitectureX86_64V3 => &["-march=x86-64-v3"],
+        Self::NoFloatContraction => &["-ffp-contract=off"],
       }
     }
   }
 }
 
+/// Returns the compiler flags for the WASM target features enabled on the Rust
+/// side, e.g. with `RUSTFLAGS="-C target-feature=+simd128"`.
+///
+fn wasm_target_feature_flags() -> Vec<&'static str> {
+  let target_features =
+    std::env::var("CARGO_CFG_TARGET_FEATURE").unwrap_or_default();
+  let has_feature =
+    |feature: &str| target_features.split(',').any(|f| f == feature);
+
+  let mut flags = vec![];
+
+  if has_feature("simd128") {
+    flags.push("-msimd128");
+  }
+
+  // Shared memory requires that every object file is built with atomics and
+  // bulk memory enabled
+  if has_feature("atomics") {
+    flags.extend(["-matomics", "-mbulk-memory"]);
+  }
+
+  flags
+}
+
+/// Returns the C++ sysroot to build C++ codecs against when targeting WASM.
+/// This is read from the `DCMFX_WASM_CXX_SYSROOT` environment variable, and
+/// must contain libc++ headers in `include/c++/v1`, and static libc++,
+/// libc++abi and libunwind libraries for wasm32 built with
+/// `-fwasm-exceptions` in `lib`. When it isn't set, C++ codecs aren't built
+/// for WASM.
+///
+/// The libraries are linked statically. Code using them needs a WASM runtime
+/// that supports the exception handling proposal, which all current browsers
+/// do.
+///
+fn wasm_cxx_sysroot() -> Option<String> {
+  if !std::env::var("TARGET").unwrap().contains("wasm") {
+    return None;
+  }
+
+  println!("cargo:rerun-if-env-changed=DCMFX_WASM_CXX_SYSROOT");
+
+  std::env::var("DCMFX_WASM_CXX_SYSROOT").ok()
+}
+
 fn is_msvc() -> bool {
   std::env::var("TARGET").unwrap().contains("msvc")
 }
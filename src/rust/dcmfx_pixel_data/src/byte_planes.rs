@@ -0,0 +1,118 @@
+//! Conversions between three-byte pixels and three separate planes of bytes,
+//! which is how RLE Lossless stores 8-bit color data.
+//!
+//! When the `native` feature is enabled these use the SIMD kernels in
+//! pixel_kernels, as the compiler doesn't vectorize three-way byte shuffles
+//! for the x86_64 baseline instruction set.
+
+/// Interleaves three planes of bytes into three-byte pixels. Each plane must
+/// hold one byte for each pixel in `output`.
+///
+pub(crate) fn interleave3(planes: [&[u8]; 3], output: &mut [u8]) {
+  let count = output.len() / 3;
+  assert!(planes.iter().all(|plane| plane.len() == count));
+
+  #[cfg(feature = "native")]
+  unsafe {
+    ffi::pixel_kernels_interleave3_u8(
+      planes[0].as_ptr(),
+      planes[1].as_ptr(),
+      planes[2].as_ptr(),
+      output.as_mut_ptr(),
+      count,
+    );
+  }
+
+  #[cfg(not(feature = "native"))]
+  {
+    let [plane_0, plane_1, plane_2] = planes;
+    for (i, pixel) in output.as_chunks_mut::<3>().0.iter_mut().enumerate() {
+      *pixel = [plane_0[i], plane_1[i], plane_2[i]];
+    }
+  }
+}
+
+/// Splits three-byte pixels into three planes of bytes. Each plane must have
+/// room for one byte for each pixel in `input`.
+///
+pub(crate) fn deinterleave3(input: &[u8], planes: [&mut [u8]; 3]) {
+  let count = input.len() / 3;
+  assert!(planes.iter().all(|plane| plane.len() == count));
+
+  #[cfg(feature = "native")]
+  {
+    let [plane_0, plane_1, plane_2] = planes;
+
+    unsafe {
+      ffi::pixel_kernels_deinterleave3_u8(
+        input.as_ptr(),
+        plane_0.as_mut_ptr(),
+        plane_1.as_mut_ptr(),
+        plane_2.as_mut_ptr(),
+        count,
+      );
+    }
+  }
+
+  #[cfg(not(feature = "native"))]
+  {
+    let [plane_0, plane_1, plane_2] = planes;
+    for (i, pixel) in input.as_chunks::<3>().0.iter().enumerate() {
+      [plane_0[i], plane_1[i], plane_2[i]] = *pixel;
+    }
+  }
+}
+
+#[cfg(feature = "native")]
+mod ffi {
+  unsafe extern "C" {
+    pub fn pixel_kernels_interleave3_u8(
+      src0: *const u8,
+      src1: *const u8,
+      src2: *const u8,
+      dst: *mut u8,
+      count: usize,
+    );
+
+    pub fn pixel_kernels_deinterleave3_u8(
+      src: *const u8,
+      dst0: *mut u8,
+      dst1: *mut u8,
+      dst2: *mut u8,
+      count: usize,
+    );
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  #[cfg(not(feature = "std"))]
+  use alloc::{vec, vec::Vec};
+
+  use super::*;
+
+  #[test]
+  fn interleave3_round_trip() {
+    for count in [0, 1, 15, 16, 17, 100] {
+      let planes: [Vec<u8>; 3] = core::array::from_fn(|c| {
+        (0..count).map(|i| (i * 3 + c * 101) as u8).collect()
+      });
+
+      let mut pixels = vec![0u8; count * 3];
+      interleave3(
+        [&planes[0], &planes[1], &planes[2]].map(Vec::as_slice),
+        &mut pixels,
+      );
+
+      for (i, pixel) in pixels.chunks_exact(3).enumerate() {
+        assert_eq!(pixel, [planes[0][i], planes[1][i], planes[2][i]]);
+      }
+
+      let mut output: [Vec<u8>; 3] = core::array::from_fn(|_| vec![0; count]);
+      let [plane_0, plane_1, plane_2] = &mut output;
+      deinterleave3(&pixels, [plane_0, plane_1, plane_2]);
+
+      assert_eq!(output, planes);
+    }
+  }
+}
@@ -0,0 +1,740 @@
+//! Real-time playback of multi-frame cines, e.g. ultrasound and angiography,
+//! at the frame rate given by their Cine Module.
+//!
+//! Frames are decoded ahead of when they're shown on worker threads, and held
+//! in a ring buffer until their time to be shown comes. The number of frames
+//! decoded ahead adapts to how long frames take to decode. When decoding can't
+//! keep up with the frame rate, frames are decoded at a reduced resolution,
+//! and frames that aren't ready in time are dropped rather than holding up
+//! playback.
+
+use std::collections::VecDeque;
+use std::sync::{Arc, Condvar, Mutex, MutexGuard};
+use std::thread::JoinHandle;
+use std::time::{Duration, Instant};
+
+use crate::{
+  DecodedFrame, FrameBufferPool, PixelDataDecodeError, PixelDataFrameIndex,
+  PixelDataRenderer,
+  iods::{
+    CineModule, MultiFrameModule, cine_module::PreferredPlaybackSequencing,
+  },
+};
+
+/// Configuration for a [`CinePlayer`].
+///
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct CinePlayerConfig {
+  /// The number of worker threads that decode frames ahead. Zero uses the
+  /// number of available CPUs, up to four. Defaults to zero.
+  ///
+  pub thread_count: usize,
+
+  /// The most frames that are decoded ahead of the frame being shown. The
+  /// look-ahead adapts between two and this value based on how long frames
+  /// take to decode. Defaults to 16.
+  ///
+  pub max_look_ahead: usize,
+
+  /// The most resolution levels that decodes are reduced by when decoding
+  /// can't keep up with the frame rate, see
+  /// [`PixelDataRenderer::resolution_reduction`]. Zero always decodes at the
+  /// renderer's resolution. Defaults to 2.
+  ///
+  pub max_resolution_reduction: u32,
+
+  /// The frame rate used when the Cine Module doesn't specify one. Defaults
+  /// to 30.
+  ///
+  pub default_frame_rate: f64,
+}
+
+impl Default for CinePlayerConfig {
+  fn default() -> Self {
+    Self {
+      thread_count: 0,
+      max_look_ahead: 16,
+      max_resolution_reduction: 2,
+      default_frame_rate: 30.0,
+    }
+  }
+}
+
+/// A frame returned by [`CinePlayer::next_frame()`] for display.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct CineFrame {
+  /// The index of the frame in the data set.
+  pub frame_index: usize,
+
+  /// The resolution reduction the frame was decoded with, in addition to the
+  /// renderer's own. Transfer syntaxes that don't support reduced resolution
+  /// decodes are always decoded at full resolution, so the dimensions of the
+  /// decoded image should be used when displaying it.
+  pub resolution_reduction: u32,
+
+  /// The decoded frame, which is rendered with
+  /// [`PixelDataRenderer::render_decoded_frame()`].
+  pub decoded_frame: DecodedFrame,
+}
+
+/// Statistics on the playback of a [`CinePlayer`].
+///
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub struct CinePlaybackStats {
+  /// The number of frames returned for display.
+  pub shown_count: u64,
+
+  /// The number of frames whose time to be shown passed without them being
+  /// shown, usually because they hadn't been decoded in time.
+  pub dropped_count: u64,
+
+  /// The number of frames currently being decoded ahead.
+  pub look_ahead: usize,
+
+  /// The resolution reduction that frames are currently being decoded with.
+  pub resolution_reduction: u32,
+
+  /// The mean time taken to decode a frame at the current resolution
+  /// reduction.
+  pub mean_decode_time: Option<Duration>,
+}
+
+/// Plays back the frames of a multi-frame cine in real time.
+///
+/// The viewer calls [`Self::next_frame()`] on every display refresh, and shows
+/// the frame it returns, if any. Playback starts once the first frame has been
+/// decoded, and then follows the frame times in the Cine Module, looping or
+/// sweeping as given by its Preferred Playback Sequencing, and skipping frames
+/// that are trimmed off by its Start Trim and Stop Trim.
+///
+/// Worker threads stop when the player is dropped.
+///
+pub struct CinePlayer {
+  shared: Arc<Shared>,
+  workers: Vec<JoinHandle<()>>,
+
+  /// The position being shown, and when the next position is due
+  clock: Option<(u64, Instant)>,
+
+  /// The last position whose frame was returned for display
+  last_shown_position: Option<u64>,
+}
+
+/// State shared between a cine player and its worker threads.
+///
+struct Shared {
+  renderer: PixelDataRenderer,
+  frames: PixelDataFrameIndex,
+
+  /// The frames to play and how long each is shown for. Playback positions
+  /// count up forever, and position `p` shows entry `p % sequence.len()`.
+  sequence: Vec<(usize, Duration)>,
+
+  /// The mean of the durations in the sequence
+  frame_duration: Duration,
+
+  config: CinePlayerConfig,
+  worker_count: usize,
+
+  state: Mutex<State>,
+  condvar: Condvar,
+}
+
+struct State {
+  /// The frames being decoded and waiting to be shown, in order of position
+  ring: VecDeque<Slot>,
+
+  display_position: u64,
+  next_decode_position: u64,
+
+  look_ahead: usize,
+  resolution_reduction: u32,
+
+  /// The mean time taken to decode a frame at the current resolution
+  /// reduction, and the number of decodes it's taken from
+  decode_time: Option<Duration>,
+  decode_count: usize,
+
+  /// The number of frames dropped in a row because they weren't decoded in
+  /// time
+  missed_in_row: usize,
+
+  shown_count: u64,
+  dropped_count: u64,
+
+  stopped: bool,
+}
+
+struct Slot {
+  position: u64,
+  resolution_reduction: u32,
+  result: Option<Result<DecodedFrame, PixelDataDecodeError>>,
+}
+
+impl CinePlayer {
+  /// Creates a player for the frames in a frame index, and starts decoding
+  /// frames ahead on worker threads.
+  ///
+  /// Frames are decoded with the passed renderer, and each frame is decoded at
+  /// most [`CinePlayerConfig::max_resolution_reduction`] levels below the
+  /// renderer's [`PixelDataRenderer::resolution_reduction`].
+  ///
+  pub fn new(
+    renderer: PixelDataRenderer,
+    frames: PixelDataFrameIndex,
+    cine_module: &CineModule,
+    multi_frame_module: &MultiFrameModule,
+    config: CinePlayerConfig,
+  ) -> Self {
+    let sequence = cine_sequence(
+      cine_module,
+      multi_frame_module,
+      frames.len(),
+      config.default_frame_rate,
+    );
+
+    let frame_duration = if sequence.is_empty() {
+      Duration::ZERO
+    } else {
+      sequence
+        .iter()
+        .map(|(_, duration)| *duration)
+        .sum::<Duration>()
+        / sequence.len() as u32
+    };
+
+    let worker_count = if config.thread_count == 0 {
+      std::thread::available_parallelism().map_or(1, |n| n.get().min(4))
+    } else {
+      config.thread_count
+    };
+
+    let shared = Arc::new(Shared {
+      renderer,
+      frames,
+      sequence,
+      frame_duration,
+      config,
+      worker_count,
+      state: Mutex::new(State {
+        ring: VecDeque::new(),
+        display_position: 0,
+        next_decode_position: 0,
+        look_ahead: worker_count.clamp(2, config.max_look_ahead.max(2)),
+        resolution_reduction: 0,
+        decode_time: None,
+        decode_count: 0,
+        missed_in_row: 0,
+        shown_count: 0,
+        dropped_count: 0,
+        stopped: false,
+      }),
+      condvar: Condvar::new(),
+    });
+
+    let workers = if shared.sequence.is_empty() {
+      vec![]
+    } else {
+      (0..worker_count)
+        .map(|_| {
+          let shared = shared.clone();
+          std::thread::spawn(move || {
+            FrameBufferPool::default().scope(|| decode_worker(&shared))
+          })
+        })
+        .collect()
+    };
+
+    Self {
+      shared,
+      workers,
+      clock: None,
+      last_shown_position: None,
+    }
+  }
+
+  /// Returns the frame to show at the given time, or `None` if the frame
+  /// already returned should stay on display. This never waits for a frame to
+  /// be decoded. Frames that aren't decoded by the time they're due are
+  /// dropped, and playback carries on from the next frame that's due.
+  ///
+  /// Errors decoding a frame are returned at the time the frame is due, after
+  /// which playback carries on.
+  ///
+  pub fn next_frame(
+    &mut self,
+    now: Instant,
+  ) -> Option<Result<CineFrame, PixelDataDecodeError>> {
+    let shared = &self.shared;
+    let mut state = shared.lock_state();
+
+    let position = match self.clock.as_mut() {
+      // Playback starts once the first frame has been decoded
+      None => {
+        if !state.ring.front().is_some_and(|slot| slot.result.is_some()) {
+          return None;
+        }
+
+        self.clock = Some((0, now + shared.entry(0).1));
+        0
+      }
+
+      Some((position, next_due)) => {
+        // Restart the clock if it has fallen well behind, e.g. because the
+        // viewer stopped calling this function for a while
+        if now > *next_due + Duration::from_secs(1) {
+          *next_due = now;
+        }
+
+        while now >= *next_due {
+          if self.last_shown_position != Some(*position) {
+            state.record_drop(*position);
+          }
+
+          *position += 1;
+          *next_due += shared.entry(*position).1;
+        }
+
+        *position
+      }
+    };
+
+    if position != state.display_position {
+      state.display_position = position;
+
+      while state.ring.front().is_some_and(|s| s.position < position) {
+        state.ring.pop_front();
+      }
+
+      shared.adapt(&mut state);
+      shared.condvar.notify_all();
+    }
+
+    if self.last_shown_position == Some(position) {
+      return None;
+    }
+
+    let slot = state.ring.front()?;
+    if slot.position != position || slot.result.is_none() {
+      return None;
+    }
+
+    let resolution_reduction = slot.resolution_reduction;
+    let result = state.ring.pop_front()?.result?;
+
+    state.shown_count += 1;
+    state.missed_in_row = 0;
+    self.last_shown_position = Some(position);
+
+    Some(result.map(|decoded_frame| CineFrame {
+      frame_index: shared.entry(position).0,
+      resolution_reduction,
+      decoded_frame,
+    }))
+  }
+
+  /// Returns statistics on playback so far.
+  ///
+  pub fn stats(&self) -> CinePlaybackStats {
+    let state = self.shared.lock_state();
+
+    CinePlaybackStats {
+      shown_count: state.shown_count,
+      dropped_count: state.dropped_count,
+      look_ahead: state.look_ahead,
+      resolution_reduction: state.resolution_reduction,
+      mean_decode_time: state.decode_time,
+    }
+  }
+}
+
+impl Drop for CinePlayer {
+  fn drop(&mut self) {
+    self.shared.lock_state().stopped = true;
+    self.shared.condvar.notify_all();
+
+    for worker in self.workers.drain(..) {
+      let _ = worker.join();
+    }
+  }
+}
+
+impl Shared {
+  fn lock_state(&self) -> MutexGuard<'_, State> {
+    self.state.lock().unwrap()
+  }
+
+  /// Returns the frame index and duration for a playback position.
+  ///
+  fn entry(&self, position: u64) -> (usize, Duration) {
+    self.sequence[(position % self.sequence.len() as u64) as usize]
+  }
+
+  /// Updates the look-ahead and resolution reduction from the mean decode
+  /// time.
+  ///
+  fn adapt(&self, state: &mut State) {
+    let Some(decode_time) = state.decode_time else {
+      return;
+    };
+
+    let (look_ahead, resolution_reduction) = adapted_playback_settings(
+      decode_time,
+      self.frame_duration,
+      self.worker_count,
+      state.resolution_reduction,
+      state.missed_in_row,
+      &self.config,
+    );
+
+    state.look_ahead = look_ahead;
+
+    // Wait for a few decodes at the new resolution reduction before changing
+    // it again
+    if resolution_reduction != state.resolution_reduction
+      && state.decode_count >= self.worker_count * 2
+    {
+      state.resolution_reduction = resolution_reduction;
+      state.decode_time = None;
+      state.decode_count = 0;
+      state.missed_in_row = 0;
+    }
+  }
+}
+
+impl State {
+  /// Records that the frame at a position wasn't shown before its time
+  /// passed. This is a miss if the frame hadn't been decoded in time, rather
+  /// than the viewer not asking for it in time.
+  ///
+  fn record_drop(&mut self, position: u64) {
+    self.dropped_count += 1;
+
+    let was_decoded = self
+      .ring
+      .iter()
+      .any(|slot| slot.position == position && slot.result.is_some());
+
+    if !was_decoded {
+      self.missed_in_row += 1;
+    }
+  }
+}
+
+/// Decodes frames ahead of the display position until the player is dropped.
+///
+fn decode_worker(shared: &Shared) {
+  loop {
+    let (position, resolution_reduction) = {
+      let mut state = shared.lock_state();
+
+      loop {
+        if state.stopped {
+          return;
+        }
+
+        // Frames whose time has passed are skipped rather than decoded late
+        state.next_decode_position =
+          state.next_decode_position.max(state.display_position);
+
+        if state.next_decode_position
+          < state.display_position + state.look_ahead as u64
+        {
+          break;
+        }
+
+        state = shared.condvar.wait(state).unwrap();
+      }
+
+      let position = state.next_decode_position;
+      let resolution_reduction = state.resolution_reduction;
+
+      state.next_decode_position += 1;
+      state.ring.push_back(Slot {
+        position,
+        resolution_reduction,
+        result: None,
+      });
+
+      (position, resolution_reduction)
+    };
+
+    let start = Instant::now();
+    let result = decode_frame(shared, position, resolution_reduction);
+    let decode_time = start.elapsed();
+
+    let mut state = shared.lock_state();
+
+    // The slot is gone if the frame's time passed while it was being decoded
+    if let Some(slot) = state.ring.iter_mut().find(|s| s.position == position) {
+      slot.result = Some(result);
+    }
+
+    if resolution_reduction == state.resolution_reduction {
+      state.decode_time = Some(match state.decode_time {
+        Some(mean) => (mean * 3 + decode_time) / 4,
+        None => decode_time,
+      });
+      state.decode_count += 1;
+
+      shared.adapt(&mut state);
+      shared.condvar.notify_all();
+    }
+  }
+}
+
+fn decode_frame(
+  shared: &Shared,
+  position: u64,
+  resolution_reduction: u32,
+) -> Result<DecodedFrame, PixelDataDecodeError> {
+  let frame_index = shared.entry(position).0;
+
+  let Some(mut frame) = shared.frames.get_frame(frame_index) else {
+    return Err(PixelDataDecodeError::DataInvalid {
+      details: format!("Frame {frame_index} is not present"),
+    });
+  };
+
+  let renderer = PixelDataRenderer {
+    resolution_reduction: shared.renderer.resolution_reduction
+      + resolution_reduction,
+    ..shared.renderer.clone()
+  };
+
+  #[cfg(feature = "parallel")]
+  {
+    use crate::worker_pool::{Priority, with_priority};
+
+    with_priority(Priority::Interactive, || renderer.decode_frame(&mut frame))
+  }
+
+  #[cfg(not(feature = "parallel"))]
+  renderer.decode_frame(&mut frame)
+}
+
+/// Returns the frames to play back and how long each is shown for, taking into
+/// account the trims and preferred playback sequencing in the Cine Module.
+/// Sweeping plays the frames forwards and then backwards, without repeating
+/// the first and last frames.
+///
+fn cine_sequence(
+  cine_module: &CineModule,
+  multi_frame_module: &MultiFrameModule,
+  frame_count: usize,
+  default_frame_rate: f64,
+) -> Vec<(usize, Duration)> {
+  let mut frame_indices: Vec<_> = (0..frame_count)
+    .filter(|i| !cine_module.is_frame_trimmed(*i))
+    .collect();
+
+  if cine_module.preferred_playback_sequencing
+    == Some(PreferredPlaybackSequencing::Sweeping)
+    && frame_indices.len() > 2
+  {
+    let len = frame_indices.len();
+    frame_indices.extend((1..len - 1).rev().map(|i| frame_indices[i]));
+  }
+
+  let default_duration =
+    Duration::from_secs_f64(1.0 / default_frame_rate.max(1.0));
+
+  frame_indices
+    .into_iter()
+    .map(|i| {
+      let duration = cine_module
+        .frame_duration(i, multi_frame_module)
+        .filter(|duration| !duration.is_zero())
+        .unwrap_or(default_duration);
+
+      (i, duration)
+    })
+    .collect()
+}
+
+/// Returns the look-ahead and resolution reduction to use for playback, given
+/// the mean time taken to decode a frame at the current resolution reduction.
+///
+/// The look-ahead covers the frames due while a frame is being decoded, twice
+/// over. The resolution reduction is increased when the worker threads are
+/// busy for more than 90% of the time, or when several frames in a row are
+/// dropped, and is decreased when they are busy for less than 20% of the time.
+/// Each level of reduction roughly quarters the decode time, so this leaves
+/// headroom after decreasing it.
+///
+fn adapted_playback_settings(
+  decode_time: Duration,
+  frame_duration: Duration,
+  worker_count: usize,
+  resolution_reduction: u32,
+  missed_in_row: usize,
+  config: &CinePlayerConfig,
+) -> (usize, u32) {
+  let frame_duration = frame_duration.as_secs_f64().max(1e-6);
+  let decode_time = decode_time.as_secs_f64();
+
+  let frames_per_decode = (decode_time / frame_duration).ceil() as usize;
+  let look_ahead = (frames_per_decode * 2 + worker_count)
+    .clamp(2, config.max_look_ahead.max(2));
+
+  let load = decode_time / (frame_duration * worker_count as f64);
+
+  let resolution_reduction = if (load > 0.9 || missed_in_row >= 3)
+    && resolution_reduction < config.max_resolution_reduction
+  {
+    resolution_reduction + 1
+  } else if load < 0.2 && resolution_reduction > 0 {
+    resolution_reduction - 1
+  } else {
+    resolution_reduction
+  };
+
+  (look_ahead, resolution_reduction)
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  fn cine_module(
+    frame_time: Option<f64>,
+    start_trim: Option<usize>,
+    stop_trim: Option<usize>,
+    preferred_playback_sequencing: Option<PreferredPlaybackSequencing>,
+  ) -> CineModule {
+    CineModule {
+      preferred_playback_sequencing,
+      frame_time,
+      frame_time_vector: None,
+      start_trim,
+      stop_trim,
+      recommended_display_frame_rate: None,
+      cine_rate: None,
+      frame_delay: None,
+      image_trigger_delay: None,
+      effective_duration: None,
+      actual_frame_duration: None,
+    }
+  }
+
+  fn multi_frame_module() -> MultiFrameModule {
+    MultiFrameModule {
+      number_of_frames: Some(5),
+      frame_increment_pointer: None,
+      stereo_pairs_present: None,
+      encapsulated_pixel_data_value_total_length: None,
+    }
+  }
+
+  #[test]
+  fn cine_sequence_looping_with_trims() {
+    let sequence = cine_sequence(
+      &cine_module(Some(20.0), Some(2), Some(4), None),
+      &multi_frame_module(),
+      5,
+      30.0,
+    );
+
+    let frame_time = Duration::from_millis(20);
+    assert_eq!(
+      sequence,
+      vec![(1, frame_time), (2, frame_time), (3, frame_time)]
+    );
+  }
+
+  #[test]
+  fn cine_sequence_sweeping() {
+    let sequence = cine_sequence(
+      &cine_module(
+        None,
+        None,
+        None,
+        Some(PreferredPlaybackSequencing::Sweeping),
+      ),
+      &multi_frame_module(),
+      4,
+      25.0,
+    );
+
+    let frame_indices: Vec<_> = sequence.iter().map(|(i, _)| *i).collect();
+    assert_eq!(frame_indices, vec![0, 1, 2, 3, 2, 1]);
+    assert!(
+      sequence
+        .iter()
+        .all(|(_, d)| *d == Duration::from_millis(40))
+    );
+  }
+
+  #[test]
+  fn adapted_playback_settings_follow_decode_time() {
+    let config = CinePlayerConfig::default();
+    let frame_duration = Duration::from_millis(20);
+
+    // Fast decodes keep a short look-ahead at full resolution
+    assert_eq!(
+      adapted_playback_settings(
+        Duration::from_millis(5),
+        frame_duration,
+        2,
+        0,
+        0,
+        &config
+      ),
+      (4, 0)
+    );
+
+    // Decodes that can't keep up reduce the resolution, and decode further
+    // ahead
+    assert_eq!(
+      adapted_playback_settings(
+        Duration::from_millis(50),
+        frame_duration,
+        2,
+        0,
+        0,
+        &config
+      ),
+      (8, 1)
+    );
+
+    // Dropped frames also reduce the resolution
+    assert_eq!(
+      adapted_playback_settings(
+        Duration::from_millis(20),
+        frame_duration,
+        2,
+        0,
+        3,
+        &config
+      ),
+      (4, 1)
+    );
+
+    // Plenty of headroom increases the resolution
+    assert_eq!(
+      adapted_playback_settings(
+        Duration::from_millis(2),
+        frame_duration,
+        2,
+        1,
+        0,
+        &config
+      ),
+      (4, 0)
+    );
+
+    // The resolution reduction and look-ahead are limited by the config
+    assert_eq!(
+      adapted_playback_settings(
+        Duration::from_millis(500),
+        frame_duration,
+        2,
+        2,
+        0,
+        &config
+      ),
+      (16, 2)
+    );
+  }
+}
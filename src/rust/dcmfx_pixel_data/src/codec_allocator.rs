@@ -0,0 +1,499 @@
+//! Routes the memory allocations made by the vendored codec libraries through
+//! a single allocator.
+//!
+//! OpenJPEG, OpenJPH, libjpeg, and libjxl call the C functions defined in this
+//! module instead of `malloc()` and `free()`, and these pass the allocations on
+//! to the allocator set with [`set_codec_allocator()`], or to the system
+//! allocator if none is set. This allows applications to serve codec
+//! allocations from their own allocator, e.g. from per-thread arenas that avoid
+//! contention on the system allocator when many frames are being transcoded at
+//! once.
+//!
+//! CharLS allocates through the C++ standard library and so isn't covered.
+//!
+//! Decodes can also be given a memory budget with [`run_with_memory_budget()`],
+//! which bounds what codecs allocate while decoding, e.g. so that a frame whose
+//! header claims huge dimensions fails quickly rather than exhausting memory.
+//!
+//! When `std` isn't available, e.g. on WASM, allocations always go to Rust's
+//! global allocator, with small allocations served from pools of freed blocks,
+//! see [`release_pooled_memory()`].
+
+#[cfg(feature = "std")]
+use std::sync::{
+  Arc,
+  atomic::{AtomicBool, AtomicPtr, AtomicUsize, Ordering},
+};
+
+use core::alloc::Layout;
+use core::ffi::c_void;
+
+#[cfg(not(feature = "std"))]
+pub use crate::no_std_allocator::release_pooled_memory;
+
+/// An allocator that the vendored codec libraries allocate their memory
+/// through.
+///
+/// Codecs allocate from their own worker threads as well as from the thread
+/// that called them, and memory is often freed on a different thread to the
+/// one that allocated it. Some codecs also keep state allocated between
+/// frames, so an arena allocator must not reuse memory that hasn't been
+/// deallocated, e.g. by only resetting each arena once all of its allocations
+/// have been freed.
+///
+#[cfg(feature = "std")]
+pub trait CodecAllocator: Send + Sync {
+  /// Allocates memory with the given layout, returning null on failure.
+  ///
+  fn allocate(&self, layout: Layout) -> *mut u8;
+
+  /// Deallocates memory previously returned by [`Self::allocate()`] with the
+  /// same layout.
+  ///
+  /// # Safety
+  ///
+  /// `ptr` must have been returned by a call to [`Self::allocate()`] on this
+  /// allocator with the same layout, and not already have been deallocated.
+  ///
+  unsafe fn deallocate(&self, ptr: *mut u8, layout: Layout);
+}
+
+/// The allocator currently in use, or null to use the system allocator. It
+/// points to a leaked box so that it can be read without taking a lock.
+///
+#[cfg(feature = "std")]
+static CODEC_ALLOCATOR: AtomicPtr<Arc<dyn CodecAllocator>> =
+  AtomicPtr::new(core::ptr::null_mut());
+
+/// Sets the allocator that the vendored codec libraries allocate memory
+/// through. Passing `None` returns to using the system allocator.
+///
+/// Memory that was allocated before this call continues to be freed through
+/// the allocator that allocated it, so a replaced allocator is never dropped.
+/// This function is intended to be called once at startup.
+///
+#[cfg(feature = "std")]
+pub fn set_codec_allocator(allocator: Option<Arc<dyn CodecAllocator>>) {
+  let ptr = match allocator {
+    Some(allocator) => Box::into_raw(Box::new(allocator)),
+    None => core::ptr::null_mut(),
+  };
+
+  CODEC_ALLOCATOR.store(ptr, Ordering::Release);
+}
+
+/// A limit on the memory that codecs allocate during a decode, including on
+/// their worker threads. Allocations made during the decode are charged to
+/// the budget until they're freed, even if that's after the decode has
+/// returned, e.g. for state that a codec keeps for later frames.
+///
+#[cfg(feature = "std")]
+#[derive(Debug)]
+pub(crate) struct MemoryBudget {
+  limit: usize,
+  used: AtomicUsize,
+  exceeded: AtomicBool,
+}
+
+#[cfg(feature = "std")]
+impl MemoryBudget {
+  /// Charges `size` bytes to the budget, returning false without charging
+  /// anything if that would exceed its limit.
+  ///
+  fn try_charge(&self, size: usize) -> bool {
+    let charged =
+      self
+        .used
+        .fetch_update(Ordering::Relaxed, Ordering::Relaxed, |used| {
+          used.checked_add(size).filter(|used| *used <= self.limit)
+        });
+
+    if charged.is_err() {
+      self.exceeded.store(true, Ordering::Relaxed);
+    }
+
+    charged.is_ok()
+  }
+
+  /// Returns `size` bytes that were charged to the budget.
+  ///
+  fn release(&self, size: usize) {
+    self.used.fetch_sub(size, Ordering::Relaxed);
+  }
+
+  /// Returns whether an allocation has failed because it would have exceeded
+  /// the budget.
+  ///
+  pub fn is_exceeded(&self) -> bool {
+    self.exceeded.load(Ordering::Relaxed)
+  }
+}
+
+/// Runs `decode` with a budget of `budget` bytes for the memory that the
+/// vendored codecs allocate while running it.
+///
+/// Allocations that would exceed the budget fail, which makes the codec's
+/// decode fail, and the decode is also stopped at its next cancellation check,
+/// see [`crate::codec_cancellation`]. When this happens
+/// [`PixelDataDecodeError::MemoryBudgetExceeded`] is returned.
+///
+/// Memory allocated by CharLS, the pure Rust decoders, and the output buffers
+/// allocated in Rust isn't charged to the budget.
+///
+/// [`PixelDataDecodeError::MemoryBudgetExceeded`]:
+///   crate::PixelDataDecodeError::MemoryBudgetExceeded
+///
+#[cfg(feature = "std")]
+pub fn run_with_memory_budget<T>(
+  budget: usize,
+  decode: impl FnOnce() -> Result<T, crate::PixelDataDecodeError>,
+) -> Result<T, crate::PixelDataDecodeError> {
+  let memory_budget = Arc::new(MemoryBudget {
+    limit: budget,
+    used: AtomicUsize::new(0),
+    exceeded: AtomicBool::new(false),
+  });
+
+  let result =
+    crate::codec_cancellation::enter_memory_budget(&memory_budget, decode);
+
+  if memory_budget.is_exceeded() {
+    return Err(crate::PixelDataDecodeError::MemoryBudgetExceeded { budget });
+  }
+
+  result
+}
+
+/// The default alignment of allocations, which matches what `malloc()` returns
+/// on 64-bit platforms.
+///
+const DEFAULT_ALIGNMENT: usize = 16;
+
+/// Stored immediately before each allocation returned to a codec, and holds
+/// what's needed to free it.
+///
+#[repr(C)]
+struct AllocationHeader {
+  /// The layout of the whole allocation, including the header and the padding
+  /// before it.
+  layout: Layout,
+
+  /// The offset from the start of the allocation to the memory returned to
+  /// the codec.
+  offset: usize,
+
+  /// The allocation's size as requested by the codec.
+  size: usize,
+
+  /// The allocator that made the allocation, or null for the default
+  /// allocator.
+  #[cfg(feature = "std")]
+  allocator: *const Arc<dyn CodecAllocator>,
+
+  /// The memory budget the allocation is charged to, or null if there isn't
+  /// one. The allocation holds a strong reference to the budget's [`Arc`].
+  #[cfg(feature = "std")]
+  memory_budget: *const MemoryBudget,
+}
+
+/// Allocates memory for a codec with the given size and alignment, preceded by
+/// an [`AllocationHeader`]. If `zeroed` is set then the memory returned to the
+/// codec is zeroed.
+///
+fn allocate(size: usize, alignment: usize, zeroed: bool) -> *mut c_void {
+  let alignment = alignment.max(core::mem::align_of::<AllocationHeader>());
+  let offset =
+    core::mem::size_of::<AllocationHeader>().next_multiple_of(alignment);
+
+  let Some(layout) = offset
+    .checked_add(size)
+    .and_then(|total_size| Layout::from_size_align(total_size, alignment).ok())
+  else {
+    return core::ptr::null_mut();
+  };
+
+  #[cfg(feature = "std")]
+  let memory_budget = crate::codec_cancellation::current_memory_budget();
+
+  #[cfg(feature = "std")]
+  if !memory_budget.is_null()
+    && !unsafe { (*memory_budget).try_charge(layout.size()) }
+  {
+    return core::ptr::null_mut();
+  }
+
+  #[cfg(feature = "std")]
+  let allocator: *const Arc<dyn CodecAllocator> =
+    CODEC_ALLOCATOR.load(Ordering::Acquire);
+
+  #[cfg(feature = "std")]
+  let base = if allocator.is_null() {
+    unsafe {
+      if zeroed {
+        std::alloc::alloc_zeroed(layout)
+      } else {
+        std::alloc::alloc(layout)
+      }
+    }
+  } else {
+    let base = unsafe { (*allocator).allocate(layout) };
+    if zeroed && !base.is_null() {
+      unsafe { core::ptr::write_bytes(base.add(offset), 0, size) };
+    }
+
+    base
+  };
+
+  #[cfg(not(feature = "std"))]
+  let base = crate::no_std_allocator::pool_alloc(layout, zeroed);
+
+  if base.is_null() {
+    #[cfg(feature = "std")]
+    if !memory_budget.is_null() {
+      unsafe { (*memory_budget).release(layout.size()) };
+    }
+
+    return core::ptr::null_mut();
+  }
+
+  #[cfg(feature = "std")]
+  if !memory_budget.is_null() {
+    unsafe { Arc::increment_strong_count(memory_budget) };
+  }
+
+  unsafe {
+    let ptr = base.add(offset);
+
+    (ptr as *mut AllocationHeader)
+      .sub(1)
+      .write(AllocationHeader {
+        layout,
+        offset,
+        size,
+        #[cfg(feature = "std")]
+        allocator,
+        #[cfg(feature = "std")]
+        memory_budget,
+      });
+
+    ptr as *mut c_void
+  }
+}
+
+/// Returns the header that precedes an allocation made by [`allocate()`].
+///
+unsafe fn allocation_header(ptr: *mut c_void) -> *mut AllocationHeader {
+  unsafe { (ptr as *mut AllocationHeader).sub(1) }
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn dcmfx_codec_malloc(size: usize) -> *mut c_void {
+  allocate(size, DEFAULT_ALIGNMENT, false)
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn dcmfx_codec_aligned_malloc(
+  alignment: usize,
+  size: usize,
+) -> *mut c_void {
+  if !alignment.is_power_of_two() {
+    return core::ptr::null_mut();
+  }
+
+  allocate(size, alignment, false)
+}
+
+#[unsafe(no_mangle)]
+pub extern "C" fn dcmfx_codec_calloc(count: usize, size: usize) -> *mut c_void {
+  let Some(total_size) = count.checked_mul(size) else {
+    return core::ptr::null_mut();
+  };
+
+  allocate(total_size, DEFAULT_ALIGNMENT, true)
+}
+
+/// Resizes an allocation, keeping its alignment. Allocators don't provide
+/// in-place growth, so the contents are always moved to a new allocation.
+///
+/// # Safety
+///
+/// `ptr` must be null or have been returned by one of the allocation functions
+/// in this module, and not already have been freed.
+///
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn dcmfx_codec_realloc(
+  ptr: *mut c_void,
+  new_size: usize,
+) -> *mut c_void {
+  if ptr.is_null() {
+    return dcmfx_codec_malloc(new_size);
+  }
+
+  let (size, alignment) = unsafe {
+    let header = &*allocation_header(ptr);
+    (header.size, header.layout.align())
+  };
+
+  let new_ptr = allocate(new_size, alignment, false);
+  if new_ptr.is_null() {
+    return new_ptr;
+  }
+
+  unsafe {
+    core::ptr::copy_nonoverlapping(
+      ptr as *const u8,
+      new_ptr as *mut u8,
+      size.min(new_size),
+    )
+  };
+
+  unsafe { dcmfx_codec_free(ptr) };
+
+  new_ptr
+}
+
+/// Frees an allocation.
+///
+/// # Safety
+///
+/// `ptr` must be null or have been returned by one of the allocation functions
+/// in this module, and not already have been freed.
+///
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn dcmfx_codec_free(ptr: *mut c_void) {
+  if ptr.is_null() {
+    return;
+  }
+
+  unsafe {
+    let header = allocation_header(ptr).read();
+    let base = (ptr as *mut u8).sub(header.offset);
+
+    #[cfg(feature = "std")]
+    if header.allocator.is_null() {
+      std::alloc::dealloc(base, header.layout);
+    } else {
+      (*header.allocator).deallocate(base, header.layout);
+    }
+
+    #[cfg(feature = "std")]
+    if !header.memory_budget.is_null() {
+      (*header.memory_budget).release(header.layout.size());
+      Arc::decrement_strong_count(header.memory_budget);
+    }
+
+    #[cfg(not(feature = "std"))]
+    crate::no_std_allocator::pool_dealloc(base, header.layout);
+  }
+}
+
+#[cfg(all(test, feature = "std"))]
+mod tests {
+  use super::*;
+
+  use std::sync::atomic::AtomicUsize;
+
+  #[test]
+  fn allocations_are_aligned_and_resizable() {
+    for alignment in [16, 32, 64, 4096] {
+      let ptr = dcmfx_codec_aligned_malloc(alignment, 100);
+      assert_eq!(ptr as usize % alignment, 0);
+
+      unsafe { core::ptr::write_bytes(ptr as *mut u8, 7, 100) };
+
+      let ptr = unsafe { dcmfx_codec_realloc(ptr, 1000) };
+      assert_eq!(ptr as usize % alignment, 0);
+      assert!(
+        unsafe { core::slice::from_raw_parts(ptr as *const u8, 100) }
+          .iter()
+          .all(|b| *b == 7)
+      );
+
+      unsafe { dcmfx_codec_free(ptr) };
+    }
+
+    let ptr = dcmfx_codec_calloc(10, 10);
+    assert!(
+      unsafe { core::slice::from_raw_parts(ptr as *const u8, 100) }
+        .iter()
+        .all(|b| *b == 0)
+    );
+    unsafe { dcmfx_codec_free(ptr) };
+
+    assert!(dcmfx_codec_calloc(usize::MAX, 2).is_null());
+    assert!(dcmfx_codec_aligned_malloc(24, 10).is_null());
+  }
+
+  #[test]
+  fn memory_budget() {
+    let mut ptrs = vec![];
+
+    let result = run_with_memory_budget(10_000, || {
+      ptrs.push(dcmfx_codec_malloc(4_000));
+      ptrs.push(dcmfx_codec_malloc(4_000));
+      assert!(dcmfx_codec_malloc(4_000).is_null());
+
+      Ok(())
+    });
+
+    assert_eq!(
+      result,
+      Err(crate::PixelDataDecodeError::MemoryBudgetExceeded { budget: 10_000 })
+    );
+
+    // Freed memory is returned to the budget
+    let result = run_with_memory_budget(10_000, || {
+      for _ in 0..10 {
+        let ptr = dcmfx_codec_malloc(4_000);
+        assert!(!ptr.is_null());
+        unsafe { dcmfx_codec_free(ptr) };
+      }
+
+      Ok(())
+    });
+
+    assert_eq!(result, Ok(()));
+
+    for ptr in ptrs {
+      assert!(!ptr.is_null());
+      unsafe { dcmfx_codec_free(ptr) };
+    }
+  }
+
+  #[test]
+  fn custom_allocator() {
+    struct CountingAllocator(AtomicUsize);
+
+    impl CodecAllocator for CountingAllocator {
+      fn allocate(&self, layout: Layout) -> *mut u8 {
+        self.0.fetch_add(1, Ordering::Relaxed);
+        unsafe { std::alloc::alloc(layout) }
+      }
+
+      unsafe fn deallocate(&self, ptr: *mut u8, layout: Layout) {
+        self.0.fetch_sub(1, Ordering::Relaxed);
+        unsafe { std::alloc::dealloc(ptr, layout) }
+      }
+    }
+
+    let allocator = Arc::new(CountingAllocator(AtomicUsize::new(0)));
+
+    // Memory allocated before the allocator is set is freed with the system
+    // allocator. Other tests may allocate through the custom allocator while
+    // it's set, so only allocations made here are checked.
+    let system_ptr = dcmfx_codec_malloc(10);
+
+    set_codec_allocator(Some(allocator.clone()));
+    let ptr = dcmfx_codec_malloc(10);
+    set_codec_allocator(None);
+
+    assert!(allocator.0.load(Ordering::Relaxed) >= 1);
+    assert!(!unsafe { (*allocation_header(ptr)).allocator.is_null() });
+    assert!(unsafe { (*allocation_header(system_ptr)).allocator.is_null() });
+
+    unsafe {
+      dcmfx_codec_free(system_ptr);
+      dcmfx_codec_free(ptr);
+    }
+  }
+}
@@ -0,0 +1,539 @@
+//! Cancellation of frame decodes that are in progress, either explicitly or
+//! when a deadline passes.
+//!
+//! [`run_cancellable()`] runs a decode with a [`CancellationToken`], which is
+//! made current on the calling thread for the duration of the decode. The
+//! vendored codecs check the current token from inside their decode loops and
+//! stop soon after it's cancelled:
+//!
+//! - OpenJPEG checks before each tile's tier-1 decode, before each code-block,
+//!   and before each tile's inverse wavelet transform.
+//! - OpenJPH checks before each row it pulls from the codestream, and before
+//!   each code-block task run on its thread pool.
+//! - libjxl checks before each task run on its parallel runner, and between
+//!   decoder events.
+//! - CharLS, libjpeg_8bit, libjpeg_12bit, and libjpeg_16bit check before each
+//!   row or row of MCUs.
+//!
+//! Batch decodes also stop starting new frames once their token is cancelled.
+//! Codecs that decode on worker threads make the token current on them, and the
+//! token is also passed to the threads that libjpeg_8bit and libjpeg_12bit
+//! decode restart intervals on.
+//!
+//! A decode that exceeds its memory budget, see
+//! [`crate::codec_allocator::run_with_memory_budget()`], is stopped in the same
+//! way.
+//!
+//! The pure Rust decoders, e.g. jxl-oxide, don't check the token, so a decode
+//! with them only stops at its end, where [`run_cancellable()`] discards the
+//! result.
+//!
+//! The token is made current on a thread rather than being passed to each
+//! codec function so that it reaches the codecs without changing the signature
+//! of every decode function between them and the caller.
+//!
+//! The same is done for the preview settings of a decode, i.e. the maximum
+//! number of JPEG 2000 coding passes to decode in each code-block, see
+//! [`crate::PixelDataDecodeConfig::jpeg_2000_coding_passes`], and whether
+//! JPEG XL is decoded without restoration filters, see
+//! [`crate::PixelDataDecodeConfig::jpeg_xl_preview`].
+
+#[cfg(feature = "std")]
+use std::{
+  cell::Cell,
+  sync::{
+    Arc,
+    atomic::{AtomicBool, Ordering},
+  },
+  time::{Duration, Instant},
+};
+
+use core::ffi::{c_int, c_uint, c_void};
+
+#[cfg(feature = "std")]
+use crate::{
+  PixelDataDecodeConfig, PixelDataDecodeError, codec_allocator::MemoryBudget,
+};
+
+/// A token used to stop decodes that are in progress. Clones of a token share
+/// its state, so cancelling any of them cancels all of them.
+///
+/// A token is cancelled when [`Self::cancel()`] is called on it or one of its
+/// clones, or when its deadline passes, if it has one.
+///
+#[cfg(feature = "std")]
+#[derive(Clone, Debug, Default)]
+pub struct CancellationToken {
+  state: Arc<TokenState>,
+}
+
+#[cfg(feature = "std")]
+#[derive(Debug, Default)]
+struct TokenState {
+  cancelled: AtomicBool,
+  deadline: Option<Instant>,
+}
+
+#[cfg(feature = "std")]
+impl TokenState {
+  fn is_cancelled(&self) -> bool {
+    if self.cancelled.load(Ordering::Relaxed) {
+      return true;
+    }
+
+    // Once the deadline has passed the flag is set so that later checks don't
+    // need to read the clock
+    if let Some(deadline) = self.deadline
+      && Instant::now() >= deadline
+    {
+      self.cancelled.store(true, Ordering::Relaxed);
+      return true;
+    }
+
+    false
+  }
+}
+
+#[cfg(feature = "std")]
+impl CancellationToken {
+  /// Creates a new token that's only cancelled by [`Self::cancel()`].
+  ///
+  pub fn new() -> Self {
+    Self::default()
+  }
+
+  /// Creates a new token that's cancelled once `deadline` is reached, or by
+  /// [`Self::cancel()`].
+  ///
+  pub fn with_deadline(deadline: Instant) -> Self {
+    Self {
+      state: Arc::new(TokenState {
+        cancelled: AtomicBool::new(false),
+        deadline: Some(deadline),
+      }),
+    }
+  }
+
+  /// Creates a new token that's cancelled once `timeout` has elapsed from now,
+  /// or by [`Self::cancel()`].
+  ///
+  pub fn with_timeout(timeout: Duration) -> Self {
+    Self::with_deadline(Instant::now() + timeout)
+  }
+
+  /// Cancels this token and all of its clones. Decodes using it stop at their
+  /// next check and return [`PixelDataDecodeError::Cancelled`].
+  ///
+  pub fn cancel(&self) {
+    self.state.cancelled.store(true, Ordering::Relaxed);
+  }
+
+  /// Returns whether this token has been cancelled or its deadline has passed.
+  ///
+  pub fn is_cancelled(&self) -> bool {
+    self.state.is_cancelled()
+  }
+}
+
+/// What's current on a thread for the decode it's running, which is what the
+/// vendored codecs see as their cancellation token. Either pointer may be
+/// null.
+///
+#[cfg(feature = "std")]
+pub(crate) struct DecodeContext {
+  token: *const TokenState,
+  memory_budget: *const MemoryBudget,
+
+  /// The maximum number of coding passes to decode in each JPEG 2000
+  /// code-block, with zero decoding all of them.
+  max_coding_passes: u32,
+
+  /// Whether JPEG XL is decoded by libjxl without its restoration filters.
+  jpeg_xl_preview: bool,
+}
+
+#[cfg(feature = "std")]
+impl DecodeContext {
+  fn is_cancelled(&self) -> bool {
+    (!self.token.is_null() && unsafe { (*self.token).is_cancelled() })
+      || (!self.memory_budget.is_null()
+        && unsafe { (*self.memory_budget).is_exceeded() })
+  }
+}
+
+#[cfg(feature = "std")]
+std::thread_local! {
+  /// The decode context that's current on this thread, or null if there isn't
+  /// one.
+  ///
+  static CURRENT_CONTEXT: Cell<*const DecodeContext> =
+    const { Cell::new(core::ptr::null()) };
+}
+
+/// Runs `decode` with `token` current on the calling thread, so that the codecs
+/// it calls stop early when the token is cancelled.
+///
+/// Returns [`PixelDataDecodeError::Cancelled`] without calling `decode` if the
+/// token is already cancelled, and also if it's cancelled by the time `decode`
+/// returns, in which case the result of `decode` is discarded as it may be
+/// a failure caused by the cancellation.
+///
+#[cfg(feature = "std")]
+pub fn run_cancellable<T>(
+  token: &CancellationToken,
+  decode: impl FnOnce() -> Result<T, PixelDataDecodeError>,
+) -> Result<T, PixelDataDecodeError> {
+  if token.is_cancelled() {
+    return Err(PixelDataDecodeError::Cancelled);
+  }
+
+  let context = DecodeContext {
+    token: Arc::as_ptr(&token.state),
+    memory_budget: current_memory_budget(),
+    max_coding_passes: current_max_coding_passes(),
+    jpeg_xl_preview: current_jpeg_xl_preview(),
+  };
+
+  let result = CurrentContext(&context).enter(decode);
+
+  if token.is_cancelled() {
+    return Err(PixelDataDecodeError::Cancelled);
+  }
+
+  result
+}
+
+/// Calls `f` with `memory_budget` current on the calling thread, along with
+/// the cancellation token that's already current, if any.
+///
+#[cfg(feature = "std")]
+pub(crate) fn enter_memory_budget<T>(
+  memory_budget: &Arc<MemoryBudget>,
+  f: impl FnOnce() -> T,
+) -> T {
+  let current = CURRENT_CONTEXT.get();
+
+  let context = DecodeContext {
+    token: if current.is_null() {
+      core::ptr::null()
+    } else {
+      unsafe { (*current).token }
+    },
+    memory_budget: Arc::as_ptr(memory_budget),
+    max_coding_passes: current_max_coding_passes(),
+    jpeg_xl_preview: current_jpeg_xl_preview(),
+  };
+
+  CurrentContext(&context).enter(f)
+}
+
+/// Makes the preview settings of a decode config current on the calling thread
+/// until it's dropped, along with the cancellation token and memory budget that
+/// are already current, if any. See
+/// [`crate::PixelDataDecodeConfig::jpeg_2000_coding_passes`] and
+/// [`crate::PixelDataDecodeConfig::jpeg_xl_preview`].
+///
+#[cfg(feature = "std")]
+pub(crate) struct PreviewScope {
+  _context: Box<DecodeContext>,
+  previous: *const DecodeContext,
+}
+
+#[cfg(feature = "std")]
+impl PreviewScope {
+  /// Enters a new scope, or returns `None` if the decode config doesn't ask
+  /// for a preview, in which case whatever is already current is left in
+  /// place.
+  ///
+  pub fn enter(decode_config: &PixelDataDecodeConfig) -> Option<Self> {
+    let max_coding_passes = decode_config.jpeg_2000_coding_passes;
+    let jpeg_xl_preview = decode_config.jpeg_xl_preview;
+
+    if max_coding_passes == 0 && !jpeg_xl_preview {
+      return None;
+    }
+
+    let previous = CURRENT_CONTEXT.get();
+
+    let context = Box::new(DecodeContext {
+      token: if previous.is_null() {
+        core::ptr::null()
+      } else {
+        unsafe { (*previous).token }
+      },
+      memory_budget: current_memory_budget(),
+      max_coding_passes,
+      jpeg_xl_preview,
+    });
+
+    CURRENT_CONTEXT.set(&*context);
+
+    Some(Self {
+      _context: context,
+      previous,
+    })
+  }
+}
+
+#[cfg(feature = "std")]
+impl Drop for PreviewScope {
+  fn drop(&mut self) {
+    CURRENT_CONTEXT.set(self.previous);
+  }
+}
+
+/// Returns the maximum number of JPEG 2000 coding passes to decode that's
+/// current on the calling thread, with zero decoding all of them.
+///
+#[cfg(feature = "std")]
+fn current_max_coding_passes() -> u32 {
+  let current = CURRENT_CONTEXT.get();
+  if current.is_null() {
+    return 0;
+  }
+
+  unsafe { (*current).max_coding_passes }
+}
+
+/// Returns whether JPEG XL is decoded without restoration filters on the
+/// calling thread.
+///
+#[cfg(feature = "std")]
+pub(crate) fn current_jpeg_xl_preview() -> bool {
+  let current = CURRENT_CONTEXT.get();
+  if current.is_null() {
+    return false;
+  }
+
+  unsafe { (*current).jpeg_xl_preview }
+}
+
+/// Returns the memory budget that's current on the calling thread, or null if
+/// there isn't one. A non-null budget is owned by an [`Arc`].
+///
+#[cfg(feature = "std")]
+pub(crate) fn current_memory_budget() -> *const MemoryBudget {
+  let current = CURRENT_CONTEXT.get();
+  if current.is_null() {
+    return core::ptr::null();
+  }
+
+  unsafe { (*current).memory_budget }
+}
+
+/// The decode context that's current on a thread, which is passed to worker
+/// threads that decode on its behalf. It must only be used while the thread it
+/// came from is still in its decode, which is the case for worker threads that
+/// are joined before a decode returns.
+///
+#[cfg(feature = "std")]
+#[derive(Clone, Copy)]
+pub(crate) struct CurrentContext(*const DecodeContext);
+
+#[cfg(feature = "std")]
+unsafe impl Send for CurrentContext {}
+
+#[cfg(feature = "std")]
+unsafe impl Sync for CurrentContext {}
+
+#[cfg(feature = "std")]
+impl CurrentContext {
+  /// Returns the decode context that's current on the calling thread.
+  ///
+  pub fn get() -> Self {
+    Self(CURRENT_CONTEXT.get())
+  }
+
+  /// Calls `f` with this decode context current on the calling thread, and
+  /// then restores the previous one.
+  ///
+  pub fn enter<T>(self, f: impl FnOnce() -> T) -> T {
+    struct Restore(*const DecodeContext);
+
+    impl Drop for Restore {
+      fn drop(&mut self) {
+        CURRENT_CONTEXT.set(self.0);
+      }
+    }
+
+    let _restore = Restore(CURRENT_CONTEXT.replace(self.0));
+
+    f()
+  }
+}
+
+/// Returns the decode context that's current on the calling thread to the
+/// vendored codecs. See `codec_cancel.h`.
+///
+#[unsafe(no_mangle)]
+pub extern "C" fn dcmfx_codec_cancel_token() -> *const c_void {
+  #[cfg(feature = "std")]
+  {
+    CURRENT_CONTEXT.get().cast()
+  }
+
+  #[cfg(not(feature = "std"))]
+  {
+    core::ptr::null()
+  }
+}
+
+/// Makes a decode context current on the calling thread for the vendored
+/// codecs. See `codec_cancel.h`.
+///
+#[unsafe(no_mangle)]
+pub extern "C" fn dcmfx_codec_set_cancel_token(token: *const c_void) {
+  #[cfg(feature = "std")]
+  CURRENT_CONTEXT.set(token.cast());
+
+  #[cfg(not(feature = "std"))]
+  let _ = token;
+}
+
+/// Returns whether a decode context used by the vendored codecs has been
+/// cancelled, or has exceeded its memory budget. See `codec_cancel.h`.
+///
+/// # Safety
+///
+/// `token` must be null or have been returned by [`dcmfx_codec_cancel_token()`]
+/// on a thread that's still in its decode.
+///
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn dcmfx_codec_is_cancelled(
+  token: *const c_void,
+) -> c_int {
+  #[cfg(feature = "std")]
+  {
+    let context = token.cast::<DecodeContext>();
+
+    (!context.is_null() && unsafe { (*context).is_cancelled() }).into()
+  }
+
+  #[cfg(not(feature = "std"))]
+  {
+    let _ = token;
+    0
+  }
+}
+
+/// Returns the maximum number of coding passes to decode in each JPEG 2000
+/// code-block for a decode context used by the vendored codecs, with zero
+/// decoding all of them. See `codec_cancel.h`.
+///
+/// # Safety
+///
+/// `token` must be null or have been returned by [`dcmfx_codec_cancel_token()`]
+/// on a thread that's still in its decode.
+///
+#[unsafe(no_mangle)]
+pub unsafe extern "C" fn dcmfx_codec_max_coding_passes(
+  token: *const c_void,
+) -> c_uint {
+  #[cfg(feature = "std")]
+  {
+    let context = token.cast::<DecodeContext>();
+
+    if context.is_null() {
+      0
+    } else {
+      unsafe { (*context).max_coding_passes }
+    }
+  }
+
+  #[cfg(not(feature = "std"))]
+  {
+    let _ = token;
+    0
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn cancelled_token_stops_decode() {
+    let token = CancellationToken::new();
+    token.clone().cancel();
+
+    let result = run_cancellable(&token, || -> Result<(), _> {
+      panic!("decode should not be called")
+    });
+
+    assert_eq!(result, Err(PixelDataDecodeError::Cancelled));
+  }
+
+  #[test]
+  fn token_is_current_during_decode() {
+    let token = CancellationToken::new();
+
+    let result = run_cancellable(&token, || {
+      let current = dcmfx_codec_cancel_token();
+      assert!(!current.is_null());
+      assert_eq!(unsafe { dcmfx_codec_is_cancelled(current) }, 0);
+
+      token.cancel();
+      assert_eq!(unsafe { dcmfx_codec_is_cancelled(current) }, 1);
+
+      Ok(())
+    });
+
+    assert_eq!(result, Err(PixelDataDecodeError::Cancelled));
+    assert!(dcmfx_codec_cancel_token().is_null());
+  }
+
+  #[test]
+  fn max_coding_passes_is_current_during_decode() {
+    let token = CancellationToken::new();
+
+    let scope = PreviewScope::enter(&PixelDataDecodeConfig {
+      jpeg_2000_coding_passes: 1,
+      ..PixelDataDecodeConfig::default()
+    });
+    assert!(PreviewScope::enter(&PixelDataDecodeConfig::default()).is_none());
+
+    let result = run_cancellable(&token, || {
+      let current = dcmfx_codec_cancel_token();
+      assert_eq!(unsafe { dcmfx_codec_max_coding_passes(current) }, 1);
+
+      Ok(())
+    });
+
+    assert_eq!(result, Ok(()));
+    assert!(!current_jpeg_xl_preview());
+
+    drop(scope);
+    assert_eq!(
+      unsafe { dcmfx_codec_max_coding_passes(dcmfx_codec_cancel_token()) },
+      0
+    );
+  }
+
+  #[test]
+  fn jpeg_xl_preview_is_current_in_scope() {
+    let scope = PreviewScope::enter(&PixelDataDecodeConfig {
+      jpeg_xl_preview: true,
+      ..PixelDataDecodeConfig::default()
+    });
+
+    let result = run_cancellable(&CancellationToken::new(), || {
+      assert!(current_jpeg_xl_preview());
+      Ok(())
+    });
+
+    assert_eq!(result, Ok(()));
+
+    drop(scope);
+    assert!(!current_jpeg_xl_preview());
+  }
+
+  #[test]
+  fn deadline_cancels_token() {
+    let token = CancellationToken::with_timeout(Duration::ZERO);
+    assert!(token.is_cancelled());
+
+    let token = CancellationToken::with_timeout(Duration::from_secs(3600));
+    assert!(!token.is_cancelled());
+    assert_eq!(run_cancellable(&token, || Ok(1)), Ok(1));
+  }
+}
@@ -0,0 +1,579 @@
+//! Opt-in statistics on the time and memory spent in each stage of decoding,
+//! processing, and encoding frames of pixel data.
+//!
+//! Statistics are only collected after [`set_enabled()`] has been called, and
+//! cost a single relaxed atomic load per stage when they aren't. They are
+//! gathered process-wide from all threads, and are read with [`snapshot()`],
+//! which can be printed, or exported in the Prometheus text format with
+//! [`CodecStats::to_prometheus()`].
+//!
+//! The following are collected:
+//!
+//! - The time spent decoding, processing, and encoding each frame transcoded
+//!   by [`crate::transforms::P10PixelDataTranscodeTransform`], along with the
+//!   number of bytes in each frame before and after transcoding.
+//!
+//! - The time spent parsing headers, entropy decoding, and repacking decoded
+//!   samples into the output buffer, for the decoders that report these
+//!   stages, which are currently OpenJPH and libjxl.
+//!
+//! - The number of allocations and the peak number of bytes allocated while
+//!   transcoding each frame, when [`CountingAllocator`] is installed as the
+//!   global allocator. Only allocations made through the Rust global allocator
+//!   are counted, which doesn't include the internal allocations of codecs
+//!   written in C and C++.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::cell::Cell;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::time::{Duration, Instant};
+
+/// A stage in the transcoding of a frame of pixel data.
+///
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum CodecStage {
+  /// Decoding a frame, including all decoder stages listed below.
+  Decode,
+
+  /// Parsing the headers of encoded data and preparing to decode it.
+  HeaderParse,
+
+  /// Entropy decoding and inverse transforms.
+  EntropyDecode,
+
+  /// Packing and interleaving decoded samples into the output buffer.
+  Repack,
+
+  /// Color conversion, cropping, and other processing of decoded images.
+  ImageProcessing,
+
+  /// Encoding a frame.
+  Encode,
+
+  /// Decoding an encoded frame again to check that it matches the image it
+  /// was encoded from, see
+  /// [`crate::transforms::P10PixelDataTranscodeTransform::set_verify_lossless()`].
+  /// The decoder stages it runs are also included in the stages above.
+  Verify,
+}
+
+impl CodecStage {
+  /// All codec stages, in the order they're reported.
+  ///
+  pub const ALL: [CodecStage; 7] = [
+    Self::Decode,
+    Self::HeaderParse,
+    Self::EntropyDecode,
+    Self::Repack,
+    Self::ImageProcessing,
+    Self::Encode,
+    Self::Verify,
+  ];
+
+  /// Returns the name of this stage in snake case.
+  ///
+  pub fn name(&self) -> &'static str {
+    match self {
+      Self::Decode => "decode",
+      Self::HeaderParse => "header_parse",
+      Self::EntropyDecode => "entropy_decode",
+      Self::Repack => "repack",
+      Self::ImageProcessing => "image_processing",
+      Self::Encode => "encode",
+      Self::Verify => "verify",
+    }
+  }
+}
+
+impl core::fmt::Display for CodecStage {
+  fn fmt(&self, f: &mut core::fmt::Formatter) -> core::fmt::Result {
+    let s = match self {
+      Self::Decode => "Decode",
+      Self::HeaderParse => "Header parse",
+      Self::EntropyDecode => "Entropy decode",
+      Self::Repack => "Repack",
+      Self::ImageProcessing => "Image processing",
+      Self::Encode => "Encode",
+      Self::Verify => "Verify",
+    };
+
+    f.write_str(s)
+  }
+}
+
+/// The number of buckets in each duration histogram. Bucket `i` counts
+/// durations of at most 2^i microseconds, and the last bucket counts all
+/// longer durations.
+///
+pub const HISTOGRAM_BUCKET_COUNT: usize = 26;
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+
+static STAGES: [StageCounters; CodecStage::ALL.len()] =
+  [const { StageCounters::new() }; CodecStage::ALL.len()];
+
+static FRAME_COUNT: AtomicU64 = AtomicU64::new(0);
+static BYTES_IN: AtomicU64 = AtomicU64::new(0);
+static BYTES_OUT: AtomicU64 = AtomicU64::new(0);
+static ALLOCATION_COUNT: AtomicU64 = AtomicU64::new(0);
+static PEAK_FRAME_ALLOCATED_BYTES: AtomicU64 = AtomicU64::new(0);
+
+struct StageCounters {
+  count: AtomicU64,
+  total_nanoseconds: AtomicU64,
+  buckets: [AtomicU64; HISTOGRAM_BUCKET_COUNT],
+}
+
+impl StageCounters {
+  const fn new() -> Self {
+    Self {
+      count: AtomicU64::new(0),
+      total_nanoseconds: AtomicU64::new(0),
+      buckets: [const { AtomicU64::new(0) }; HISTOGRAM_BUCKET_COUNT],
+    }
+  }
+}
+
+/// Enables or disables the collection of codec statistics. Statistics that
+/// have already been collected are kept, see [`reset()`].
+///
+pub fn set_enabled(enabled: bool) {
+  ENABLED.store(enabled, Ordering::Relaxed);
+}
+
+/// Returns whether codec statistics are being collected.
+///
+#[inline]
+pub fn is_enabled() -> bool {
+  ENABLED.load(Ordering::Relaxed)
+}
+
+/// Clears all collected codec statistics.
+///
+pub fn reset() {
+  for stage in STAGES.iter() {
+    stage.count.store(0, Ordering::Relaxed);
+    stage.total_nanoseconds.store(0, Ordering::Relaxed);
+
+    for bucket in stage.buckets.iter() {
+      bucket.store(0, Ordering::Relaxed);
+    }
+  }
+
+  FRAME_COUNT.store(0, Ordering::Relaxed);
+  BYTES_IN.store(0, Ordering::Relaxed);
+  BYTES_OUT.store(0, Ordering::Relaxed);
+  ALLOCATION_COUNT.store(0, Ordering::Relaxed);
+  PEAK_FRAME_ALLOCATED_BYTES.store(0, Ordering::Relaxed);
+}
+
+/// Returns the codec statistics collected so far.
+///
+pub fn snapshot() -> CodecStats {
+  let stages = CodecStage::ALL.map(|stage| {
+    let counters = &STAGES[stage as usize];
+
+    StageStats {
+      stage,
+      count: counters.count.load(Ordering::Relaxed),
+      total_time: Duration::from_nanos(
+        counters.total_nanoseconds.load(Ordering::Relaxed),
+      ),
+      histogram: core::array::from_fn(|i| {
+        counters.buckets[i].load(Ordering::Relaxed)
+      }),
+    }
+  });
+
+  CodecStats {
+    frame_count: FRAME_COUNT.load(Ordering::Relaxed),
+    bytes_in: BYTES_IN.load(Ordering::Relaxed),
+    bytes_out: BYTES_OUT.load(Ordering::Relaxed),
+    allocation_count: ALLOCATION_COUNT.load(Ordering::Relaxed),
+    peak_frame_allocated_bytes: PEAK_FRAME_ALLOCATED_BYTES
+      .load(Ordering::Relaxed),
+    stages,
+  }
+}
+
+/// Records time spent in a codec stage.
+///
+pub(crate) fn record_stage(stage: CodecStage, duration: Duration) {
+  let nanoseconds = duration.as_nanos().min(u128::from(u64::MAX)) as u64;
+
+  let counters = &STAGES[stage as usize];
+  counters.count.fetch_add(1, Ordering::Relaxed);
+  counters
+    .total_nanoseconds
+    .fetch_add(nanoseconds, Ordering::Relaxed);
+  counters.buckets[histogram_bucket(nanoseconds)]
+    .fetch_add(1, Ordering::Relaxed);
+}
+
+/// Runs the passed function and records the time it took in the given stage,
+/// if statistics are enabled. It is also recorded as a span named after the
+/// stage if [`crate::trace_events`] are enabled.
+///
+pub(crate) fn time_stage<T>(stage: CodecStage, f: impl FnOnce() -> T) -> T {
+  let is_tracing = crate::trace_events::is_enabled();
+  if !is_enabled() && !is_tracing {
+    return f();
+  }
+
+  let _span = is_tracing.then(|| crate::trace_events::span(stage.name()));
+
+  let started_at = Instant::now();
+  let result = f();
+
+  if is_enabled() {
+    record_stage(stage, started_at.elapsed());
+  }
+
+  result
+}
+
+/// Returns the histogram bucket for a duration in nanoseconds.
+///
+fn histogram_bucket(nanoseconds: u64) -> usize {
+  let microseconds = nanoseconds.div_ceil(1000);
+  if microseconds <= 1 {
+    return 0;
+  }
+
+  // The smallest i where microseconds <= 2^i
+  let i = (u64::BITS - (microseconds - 1).leading_zeros()) as usize;
+
+  i.min(HISTOGRAM_BUCKET_COUNT - 1)
+}
+
+/// Tracks a frame being transcoded on the current thread, and records its
+/// size and allocations when it's finished.
+///
+pub(crate) struct FrameStats {
+  allocation_count: u64,
+  allocated_bytes: isize,
+}
+
+impl FrameStats {
+  /// Starts tracking a frame being transcoded on the current thread. Returns
+  /// `None` if statistics aren't enabled.
+  ///
+  pub fn start() -> Option<Self> {
+    if !is_enabled() {
+      return None;
+    }
+
+    let allocated_bytes = THREAD_ALLOCATED_BYTES.get();
+    THREAD_PEAK_ALLOCATED_BYTES.set(allocated_bytes);
+
+    Some(Self {
+      allocation_count: THREAD_ALLOCATION_COUNT.get(),
+      allocated_bytes,
+    })
+  }
+
+  /// Records a transcoded frame along with its size before and after being
+  /// transcoded.
+  ///
+  pub fn finish(self, bytes_in: usize, bytes_out: usize) {
+    FRAME_COUNT.fetch_add(1, Ordering::Relaxed);
+    BYTES_IN.fetch_add(bytes_in as u64, Ordering::Relaxed);
+    BYTES_OUT.fetch_add(bytes_out as u64, Ordering::Relaxed);
+
+    ALLOCATION_COUNT.fetch_add(
+      THREAD_ALLOCATION_COUNT.get() - self.allocation_count,
+      Ordering::Relaxed,
+    );
+
+    let peak_bytes = THREAD_PEAK_ALLOCATED_BYTES.get() - self.allocated_bytes;
+    PEAK_FRAME_ALLOCATED_BYTES
+      .fetch_max(peak_bytes.max(0) as u64, Ordering::Relaxed);
+  }
+}
+
+/// Codec statistics returned by [`snapshot()`].
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct CodecStats {
+  /// The number of frames transcoded.
+  pub frame_count: u64,
+
+  /// The total size of the frames before being transcoded.
+  pub bytes_in: u64,
+
+  /// The total size of the frames after being transcoded.
+  pub bytes_out: u64,
+
+  /// The number of allocations made while transcoding frames. This is zero
+  /// unless [`CountingAllocator`] is the global allocator.
+  pub allocation_count: u64,
+
+  /// The largest number of bytes that were allocated at once while
+  /// transcoding a single frame. This is zero unless [`CountingAllocator`] is
+  /// the global allocator.
+  pub peak_frame_allocated_bytes: u64,
+
+  /// The statistics for each codec stage, in the order of [`CodecStage::ALL`].
+  pub stages: [StageStats; CodecStage::ALL.len()],
+}
+
+/// The statistics for a single codec stage.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct StageStats {
+  pub stage: CodecStage,
+
+  /// The number of times this stage was run.
+  pub count: u64,
+
+  /// The total time spent in this stage.
+  pub total_time: Duration,
+
+  /// Histogram of the time taken by each run of this stage, see
+  /// [`HISTOGRAM_BUCKET_COUNT`].
+  pub histogram: [u64; HISTOGRAM_BUCKET_COUNT],
+}
+
+impl StageStats {
+  /// Returns the upper bound of a histogram bucket, or `None` for the last
+  /// bucket, which is unbounded.
+  ///
+  pub fn histogram_bucket_bound(index: usize) -> Option<Duration> {
+    if index + 1 >= HISTOGRAM_BUCKET_COUNT {
+      return None;
+    }
+
+    Some(Duration::from_micros(1 << index))
+  }
+}
+
+impl CodecStats {
+  /// Returns the statistics for a codec stage.
+  ///
+  pub fn stage(&self, stage: CodecStage) -> &StageStats {
+    &self.stages[stage as usize]
+  }
+
+  /// Formats these statistics in the Prometheus text exposition format. Every
+  /// metric name is prefixed with `dcmfx_pixel_data_`.
+  ///
+  pub fn to_prometheus(&self) -> String {
+    use core::fmt::Write;
+
+    let mut s = String::new();
+
+    let counters = [
+      ("frames_total", "Frames transcoded", self.frame_count),
+      ("bytes_in_total", "Bytes of frame data in", self.bytes_in),
+      ("bytes_out_total", "Bytes of frame data out", self.bytes_out),
+      (
+        "allocations_total",
+        "Allocations made while transcoding frames",
+        self.allocation_count,
+      ),
+    ];
+
+    for (name, help, value) in counters {
+      let name = format!("dcmfx_pixel_data_{name}");
+      writeln!(s, "# HELP {name} {help}.").unwrap();
+      writeln!(s, "# TYPE {name} counter").unwrap();
+      writeln!(s, "{name} {value}").unwrap();
+    }
+
+    let name = "dcmfx_pixel_data_peak_frame_allocated_bytes";
+    writeln!(s, "# HELP {name} Peak bytes allocated for a single frame.")
+      .unwrap();
+    writeln!(s, "# TYPE {name} gauge").unwrap();
+    writeln!(s, "{name} {}", self.peak_frame_allocated_bytes).unwrap();
+
+    let name = "dcmfx_pixel_data_stage_duration_seconds";
+    writeln!(s, "# HELP {name} Time spent in each codec stage.").unwrap();
+    writeln!(s, "# TYPE {name} histogram").unwrap();
+
+    for stage in self.stages.iter() {
+      let label = stage.stage.name();
+
+      let mut cumulative_count = 0;
+      for (i, count) in stage.histogram.iter().enumerate() {
+        cumulative_count += count;
+
+        let le = match StageStats::histogram_bucket_bound(i) {
+          Some(bound) => bound.as_secs_f64().to_string(),
+          None => "+Inf".to_string(),
+        };
+
+        writeln!(
+          s,
+          "{name}_bucket{{stage=\"{label}\",le=\"{le}\"}} {cumulative_count}"
+        )
+        .unwrap();
+      }
+
+      writeln!(
+        s,
+        "{name}_sum{{stage=\"{label}\"}} {}",
+        stage.total_time.as_secs_f64()
+      )
+      .unwrap();
+      writeln!(s, "{name}_count{{stage=\"{label}\"}} {}", stage.count).unwrap();
+    }
+
+    s
+  }
+}
+
+impl core::fmt::Display for CodecStats {
+  fn fmt(&self, f: &mut core::fmt::Formatter) -> core::fmt::Result {
+    const MIB: f64 = 1024.0 * 1024.0;
+
+    writeln!(f, "Frames:            {}", self.frame_count)?;
+    writeln!(
+      f,
+      "Bytes in:          {:.1} MiB",
+      self.bytes_in as f64 / MIB
+    )?;
+    writeln!(
+      f,
+      "Bytes out:         {:.1} MiB",
+      self.bytes_out as f64 / MIB
+    )?;
+    writeln!(f, "Allocations:       {}", self.allocation_count)?;
+    writeln!(
+      f,
+      "Peak frame memory: {:.1} MiB",
+      self.peak_frame_allocated_bytes as f64 / MIB
+    )?;
+
+    for stage in self.stages.iter().filter(|stage| stage.count > 0) {
+      writeln!(
+        f,
+        "{:<19}{:.3} seconds over {} runs",
+        format!("{}:", stage.stage),
+        stage.total_time.as_secs_f64(),
+        stage.count
+      )?;
+    }
+
+    Ok(())
+  }
+}
+
+thread_local! {
+  static THREAD_ALLOCATION_COUNT: Cell<u64> = const { Cell::new(0) };
+  static THREAD_ALLOCATED_BYTES: Cell<isize> = const { Cell::new(0) };
+  static THREAD_PEAK_ALLOCATED_BYTES: Cell<isize> = const { Cell::new(0) };
+}
+
+/// Global allocator that counts the allocations made on each thread so that
+/// the allocations made while transcoding a frame can be reported. It passes
+/// all allocations through to the system allocator, and only counts them
+/// while statistics are enabled.
+///
+/// To use it, install it as the global allocator of the application:
+///
+/// ```ignore
+/// #[global_allocator]
+/// static ALLOCATOR: CountingAllocator = CountingAllocator;
+/// ```
+///
+/// Memory that is freed on a different thread to the one that allocated it is
+/// subtracted from the freeing thread's count, so per-frame peaks are
+/// approximate when data is handed between threads.
+///
+pub struct CountingAllocator;
+
+impl CountingAllocator {
+  #[inline]
+  fn record_allocation(size: usize) {
+    if !is_enabled() {
+      return;
+    }
+
+    // Accessing thread locals can fail while a thread is being torn down, in
+    // which case the allocation isn't counted
+    let _ =
+      THREAD_ALLOCATION_COUNT.try_with(|count| count.set(count.get() + 1));
+    let _ = THREAD_ALLOCATED_BYTES.try_with(|bytes| {
+      let allocated_bytes = bytes.get().wrapping_add(size as isize);
+      bytes.set(allocated_bytes);
+
+      let _ = THREAD_PEAK_ALLOCATED_BYTES
+        .try_with(|peak| peak.set(peak.get().max(allocated_bytes)));
+    });
+  }
+
+  #[inline]
+  fn record_deallocation(size: usize) {
+    if !is_enabled() {
+      return;
+    }
+
+    let _ = THREAD_ALLOCATED_BYTES
+      .try_with(|bytes| bytes.set(bytes.get().wrapping_sub(size as isize)));
+  }
+}
+
+unsafe impl GlobalAlloc for CountingAllocator {
+  unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+    let ptr = unsafe { System.alloc(layout) };
+    if !ptr.is_null() {
+      Self::record_allocation(layout.size());
+    }
+
+    ptr
+  }
+
+  unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+    let ptr = unsafe { System.alloc_zeroed(layout) };
+    if !ptr.is_null() {
+      Self::record_allocation(layout.size());
+    }
+
+    ptr
+  }
+
+  unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+    unsafe { System.dealloc(ptr, layout) };
+    Self::record_deallocation(layout.size());
+  }
+
+  unsafe fn realloc(
+    &self,
+    ptr: *mut u8,
+    layout: Layout,
+    new_size: usize,
+  ) -> *mut u8 {
+    let new_ptr = unsafe { System.realloc(ptr, layout, new_size) };
+    if !new_ptr.is_null() {
+      Self::record_deallocation(layout.size());
+      Self::record_allocation(new_size);
+    }
+
+    new_ptr
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn histogram_buckets() {
+    assert_eq!(histogram_bucket(0), 0);
+    assert_eq!(histogram_bucket(1000), 0);
+    assert_eq!(histogram_bucket(1001), 1);
+    assert_eq!(histogram_bucket(2000), 1);
+    assert_eq!(histogram_bucket(3000), 2);
+    assert_eq!(histogram_bucket(1_000_000), 10);
+    assert_eq!(histogram_bucket(u64::MAX), HISTOGRAM_BUCKET_COUNT - 1);
+
+    assert_eq!(
+      StageStats::histogram_bucket_bound(10),
+      Some(Duration::from_micros(1024))
+    );
+    assert_eq!(
+      StageStats::histogram_bucket_bound(HISTOGRAM_BUCKET_COUNT - 1),
+      None
+    );
+  }
+}
@@ -0,0 +1,118 @@
+//! Chooses the number of threads a codec uses to encode or decode a frame.
+//!
+//! Coding a frame on multiple threads has a fixed cost, e.g. waking worker
+//! threads and splitting the frame into parts, that's only repaid once the
+//! frame is large enough. Where that happens depends on the codec, so each one
+//! has a crossover point in samples below which frames are coded on the
+//! calling thread. At and above it the configured thread count is passed to
+//! the codec unchanged, and so a thread count of zero keeps each codec's own
+//! default.
+//!
+//! The crossover points are estimates from each codec's cost per sample and
+//! haven't been measured. To measure them, set the codec's crossover point to
+//! zero and compare the `codecs` bench run with `--threads=1` and
+//! `--threads=0` on a machine with several CPU cores, which shows the image
+//! sizes at which multiple threads start to be faster.
+
+use dcmfx_core::{TransferSyntax, transfer_syntax};
+
+/// A codec that's able to use multiple threads to encode or decode a single
+/// frame.
+///
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub(crate) enum FrameCodec {
+  RleLossless,
+  Charls,
+  LibJpeg8Bit,
+  LibJpeg12Bit,
+  OpenJpeg,
+  OpenJph,
+  LibJxl,
+}
+
+impl FrameCodec {
+  /// Returns the codec used to encode frames into the given transfer syntax,
+  /// or `None` if its encoder doesn't use multiple threads.
+  ///
+  pub fn for_encode(transfer_syntax: &TransferSyntax) -> Option<Self> {
+    use transfer_syntax::*;
+
+    match transfer_syntax {
+      &RLE_LOSSLESS => Some(Self::RleLossless),
+
+      &JPEG_2000 | &JPEG_2000_LOSSLESS_ONLY => Some(Self::OpenJpeg),
+
+      &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
+      | &HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY
+      | &HIGH_THROUGHPUT_JPEG_2000 => Some(Self::OpenJph),
+
+      &JPEG_XL_LOSSLESS | &JPEG_XL | &JPEG_XL_JPEG_RECOMPRESSION => {
+        Some(Self::LibJxl)
+      }
+
+      _ => None,
+    }
+  }
+
+  /// The estimated number of samples at which coding a frame on multiple
+  /// threads becomes faster than coding it on the calling thread.
+  ///
+  /// Codecs that spend longer on each sample reach this point sooner. CharLS,
+  /// libjpeg_8bit, and libjpeg_12bit split frames at restart intervals, and
+  /// RLE Lossless splits them into segments that are decoded very quickly, so
+  /// they need more samples before the split pays for itself. libjpeg_8bit is
+  /// the fastest of these per sample.
+  ///
+  const fn crossover_sample_count(self) -> usize {
+    match self {
+      Self::RleLossless => 1 << 20,
+      Self::Charls => 1 << 18,
+      Self::LibJpeg8Bit => 1 << 19,
+      Self::LibJpeg12Bit => 1 << 18,
+      Self::OpenJpeg => 1 << 16,
+      Self::OpenJph => 1 << 18,
+      Self::LibJxl => 1 << 18,
+    }
+  }
+}
+
+/// Returns the number of threads for `codec` to use for a frame with
+/// `sample_count` samples, given the configured `thread_count`.
+///
+/// Frames below the codec's crossover point return one, i.e. the calling
+/// thread. Larger frames return `thread_count` unchanged, where zero is the
+/// codec's default. This is always either one or the same other value, which
+/// lets codecs that keep idle worker threads for each thread count reuse them.
+///
+pub(crate) fn frame_thread_count(
+  codec: FrameCodec,
+  sample_count: usize,
+  thread_count: usize,
+) -> usize {
+  if sample_count < codec.crossover_sample_count() {
+    return 1;
+  }
+
+  thread_count
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn small_frames_use_calling_thread() {
+    assert_eq!(frame_thread_count(FrameCodec::LibJxl, 256 * 256, 0), 1);
+    assert_eq!(frame_thread_count(FrameCodec::LibJxl, 256 * 256, 8), 1);
+    assert_eq!(frame_thread_count(FrameCodec::OpenJpeg, 256 * 256, 8), 8);
+  }
+
+  #[test]
+  fn large_frames_use_thread_count() {
+    let sample_count = 4096 * 4096 * 3;
+
+    assert_eq!(frame_thread_count(FrameCodec::OpenJph, sample_count, 1), 1);
+    assert_eq!(frame_thread_count(FrameCodec::OpenJph, sample_count, 6), 6);
+    assert_eq!(frame_thread_count(FrameCodec::OpenJph, sample_count, 0), 0);
+  }
+}
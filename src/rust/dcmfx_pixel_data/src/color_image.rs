@@ -1,12 +1,16 @@
 #[cfg(not(feature = "std"))]
-use alloc::vec::Vec;
+use alloc::{vec, vec::Vec};
 
 use dcmfx_core::Rc;
 
 use crate::{
+  frame_buffer_pool::{self, PoolElement},
   iods::{PaletteColorLookupTableModule, image_pixel_module::BitsAllocated},
+  row_parallel::{self, MaybeSend, MaybeSync},
+  sample_lut::{LutSample, SampleLut},
   transforms::CropRect,
   utils::udiv_round,
+  ybr_conversion::{self, ybr_to_rgb},
 };
 
 /// A color image that stores an RGB, YBR, or palette color for each pixel.
@@ -238,6 +242,12 @@ impl ColorImage {
     &self.data
   }
 
+  /// Consumes this color image and returns its internal data.
+  ///
+  pub fn into_data(self) -> ColorImageData {
+    self.data
+  }
+
   /// Returns the total number of pixels in this color image.
   ///
   pub fn pixel_count(&self) -> usize {
@@ -316,54 +326,69 @@ impl ColorImage {
   /// color space.
   ///
   pub fn convert_to_rgb_color_space(&mut self) {
+    self.convert_to_rgb_color_space_with_threads(1);
+  }
+
+  /// The same as [`Self::convert_to_rgb_color_space()`], but bands of rows are
+  /// converted concurrently on up to `thread_count` threads. See
+  /// [`crate::MonochromeImage::to_gray_u8_image_with_threads()`] for details.
+  ///
+  pub fn convert_to_rgb_color_space_with_threads(
+    &mut self,
+    thread_count: usize,
+  ) {
     let max_storable_value = f64::from(self.max_storable_value());
     let scale = 1.0 / max_storable_value;
+    let row_size = usize::from(self.width) * 3;
 
     match &mut self.data {
       ColorImageData::U8 { data, color_space } if color_space.is_ybr() => {
-        for pixel in data.chunks_exact_mut(3) {
-          let y: f64 = pixel[0].into();
-          let cb: f64 = pixel[1].into();
-          let cr: f64 = pixel[2].into();
+        // 8-bit data always has a max storable value that fits in a u8
+        let max_storable_value = max_storable_value as u32;
 
-          let rgb = ybr_to_rgb(y * scale, cb * scale, cr * scale);
-
-          pixel[0] = (rgb[0] * max_storable_value).round() as u8;
-          pixel[1] = (rgb[1] * max_storable_value).round() as u8;
-          pixel[2] = (rgb[2] * max_storable_value).round() as u8;
-        }
+        row_parallel::for_each_band_mut(data, row_size, thread_count, |data| {
+          ybr_conversion::ybr_to_rgb_u8_in_place(
+            data,
+            max_storable_value,
+            max_storable_value,
+          );
+        });
 
         *color_space = ColorSpace::Rgb;
       }
 
       ColorImageData::U16 { data, color_space } if color_space.is_ybr() => {
-        for pixel in data.chunks_exact_mut(3) {
-          let y: f64 = pixel[0].into();
-          let cb: f64 = pixel[1].into();
-          let cr: f64 = pixel[2].into();
+        row_parallel::for_each_band_mut(data, row_size, thread_count, |data| {
+          for pixel in data.chunks_exact_mut(3) {
+            let y: f64 = pixel[0].into();
+            let cb: f64 = pixel[1].into();
+            let cr: f64 = pixel[2].into();
 
-          let rgb = ybr_to_rgb(y * scale, cb * scale, cr * scale);
+            let rgb = ybr_to_rgb(y * scale, cb * scale, cr * scale);
 
-          pixel[0] = (rgb[0] * max_storable_value).round() as u16;
-          pixel[1] = (rgb[1] * max_storable_value).round() as u16;
-          pixel[2] = (rgb[2] * max_storable_value).round() as u16;
-        }
+            pixel[0] = (rgb[0] * max_storable_value).round() as u16;
+            pixel[1] = (rgb[1] * max_storable_value).round() as u16;
+            pixel[2] = (rgb[2] * max_storable_value).round() as u16;
+          }
+        });
 
         *color_space = ColorSpace::Rgb;
       }
 
       ColorImageData::U32 { data, color_space } if color_space.is_ybr() => {
-        for pixel in data.chunks_exact_mut(3) {
-          let y: f64 = pixel[0].into();
-          let cb: f64 = pixel[1].into();
-          let cr: f64 = pixel[2].into();
+        row_parallel::for_each_band_mut(data, row_size, thread_count, |data| {
+          for pixel in data.chunks_exact_mut(3) {
+            let y: f64 = pixel[0].into();
+            let cb: f64 = pixel[1].into();
+            let cr: f64 = pixel[2].into();
 
-          let rgb = ybr_to_rgb(y * scale, cb * scale, cr * scale);
+            let rgb = ybr_to_rgb(y * scale, cb * scale, cr * scale);
 
-          pixel[0] = (rgb[0] * max_storable_value).round() as u32;
-          pixel[1] = (rgb[1] * max_storable_value).round() as u32;
-          pixel[2] = (rgb[2] * max_storable_value).round() as u32;
-        }
+            pixel[0] = (rgb[0] * max_storable_value).round() as u32;
+            pixel[1] = (rgb[1] * max_storable_value).round() as u32;
+            pixel[2] = (rgb[2] * max_storable_value).round() as u32;
+          }
+        });
 
         *color_space = ColorSpace::Rgb;
       }
@@ -377,52 +402,101 @@ impl ColorImage {
   /// on the bits per entry of the underlying lookup tables.
   ///
   pub fn convert_palette_color_to_rgb(&mut self) {
+    self.convert_palette_color_to_rgb_with_threads(1);
+  }
+
+  /// The same as [`Self::convert_palette_color_to_rgb()`], but bands of rows
+  /// are converted concurrently on up to `thread_count` threads. See
+  /// [`crate::MonochromeImage::to_gray_u8_image_with_threads()`] for details.
+  ///
+  pub fn convert_palette_color_to_rgb_with_threads(
+    &mut self,
+    thread_count: usize,
+  ) {
     fn sample_color_palette<T>(
       data: &[T],
+      width: usize,
       palette: &PaletteColorLookupTableModule,
+      thread_count: usize,
     ) -> ColorImageData
     where
-      T: Copy,
+      T: LutSample + MaybeSync,
       i64: From<T>,
     {
       if palette.bits_per_entry() <= 8 {
-        let mut rgb_data = Vec::with_capacity(data.len() * 3);
-
-        for index in data {
-          let pixel = palette.lookup(i64::from(*index));
-          rgb_data.push(pixel[0] as u8);
-          rgb_data.push(pixel[1] as u8);
-          rgb_data.push(pixel[2] as u8);
-        }
-
         ColorImageData::U8 {
-          data: rgb_data,
+          data: apply_palette(data, width, thread_count, |index| {
+            palette.lookup(index).map(|value| value as u8)
+          }),
           color_space: ColorSpace::Rgb,
         }
       } else {
-        let mut rgb_data = Vec::with_capacity(data.len() * 3);
-
-        for index in data {
-          let pixel = palette.lookup(i64::from(*index));
-          rgb_data.extend_from_slice(&pixel);
-        }
-
         ColorImageData::U16 {
-          data: rgb_data,
+          data: apply_palette(data, width, thread_count, |index| {
+            palette.lookup(index)
+          }),
           color_space: ColorSpace::Rgb,
         }
       }
     }
 
+    fn apply_palette<T, U>(
+      data: &[T],
+      width: usize,
+      thread_count: usize,
+      index_to_rgb: impl Fn(i64) -> [U; 3] + MaybeSync,
+    ) -> Vec<U>
+    where
+      T: LutSample + MaybeSync,
+      U: Copy + Default + MaybeSend + MaybeSync,
+      i64: From<T>,
+    {
+      let mut rgb_data = vec![U::default(); data.len() * 3];
+
+      // When there are enough pixels, the red, green, and blue lookup tables
+      // are first flattened into a single table that has an RGB color for
+      // every possible index, which is then applied in one pass
+      if data.len() >= T::VALUE_COUNT / 4 {
+        let lut = SampleLut::new::<T>(index_to_rgb);
+        let lut = &lut;
+
+        row_parallel::for_each_band_zip(
+          data,
+          width,
+          &mut rgb_data,
+          width * 3,
+          thread_count,
+          |data, rgb_data| lut.apply_interleaved(data, rgb_data),
+        );
+      } else {
+        row_parallel::for_each_band_zip(
+          data,
+          width,
+          &mut rgb_data,
+          width * 3,
+          thread_count,
+          |data, rgb_data| {
+            for (index, rgb) in data.iter().zip(rgb_data.chunks_exact_mut(3)) {
+              rgb.copy_from_slice(&index_to_rgb(i64::from(*index)));
+            }
+          },
+        );
+      }
+
+      rgb_data
+    }
+
+    let width = usize::from(self.width);
+
     match &self.data {
       ColorImageData::PaletteU8 { data, palette } => {
         self.bits_stored = palette.bits_per_entry();
-        self.data = sample_color_palette(data, palette);
+        self.data = sample_color_palette(data, width, palette, thread_count);
       }
 
       ColorImageData::PaletteU16 { data, palette } => {
         self.bits_stored = palette.bits_per_entry();
-        self.data = sample_color_palette(data, palette);
+        self.data = sample_color_palette(data, width, palette, thread_count);
       }
 
       _ => (),
@@ -433,22 +507,36 @@ impl ColorImage {
   /// color space.
   ///
   pub fn convert_to_ybr_color_space(&mut self) {
+    self.convert_to_ybr_color_space_with_threads(1);
+  }
+
+  /// The same as [`Self::convert_to_ybr_color_space()`], but bands of rows are
+  /// converted concurrently on up to `thread_count` threads. See
+  /// [`crate::MonochromeImage::to_gray_u8_image_with_threads()`] for details.
+  ///
+  pub fn convert_to_ybr_color_space_with_threads(
+    &mut self,
+    thread_count: usize,
+  ) {
     let max_storable_value = f64::from(self.max_storable_value());
     let scale = 1.0 / max_storable_value;
+    let row_size = usize::from(self.width) * 3;
 
     match &mut self.data {
       ColorImageData::U8 { data, color_space } if color_space.is_rgb() => {
-        for pixel in data.chunks_exact_mut(3) {
-          let r: f64 = pixel[0].into();
-          let g: f64 = pixel[1].into();
-          let b: f64 = pixel[2].into();
+        row_parallel::for_each_band_mut(data, row_size, thread_count, |data| {
+          for pixel in data.chunks_exact_mut(3) {
+            let r: f64 = pixel[0].into();
+            let g: f64 = pixel[1].into();
+            let b: f64 = pixel[2].into();
 
-          let ybr = rgb_to_ybr(r * scale, g * scale, b * scale);
+            let ybr = rgb_to_ybr(r * scale, g * scale, b * scale);
 
-          pixel[0] = (ybr[0] * max_storable_value).round() as u8;
-          pixel[1] = (ybr[1] * max_storable_value).round() as u8;
-          pixel[2] = (ybr[2] * max_storable_value).round() as u8;
-        }
+            pixel[0] = (ybr[0] * max_storable_value).round() as u8;
+            pixel[1] = (ybr[1] * max_storable_value).round() as u8;
+            pixel[2] = (ybr[2] * max_storable_value).round() as u8;
+          }
+        });
 
         *color_space = ColorSpace::Ybr { is_422: false };
       }
@@ -458,17 +546,19 @@ impl ColorImage {
       }
 
       ColorImageData::U16 { data, color_space } if color_space.is_rgb() => {
-        for pixel in data.chunks_exact_mut(3) {
-          let r: f64 = pixel[0].into();
-          let g: f64 = pixel[1].into();
-          let b: f64 = pixel[2].into();
+        row_parallel::for_each_band_mut(data, row_size, thread_count, |data| {
+          for pixel in data.chunks_exact_mut(3) {
+            let r: f64 = pixel[0].into();
+            let g: f64 = pixel[1].into();
+            let b: f64 = pixel[2].into();
 
-          let ybr = rgb_to_ybr(r * scale, g * scale, b * scale);
+            let ybr = rgb_to_ybr(r * scale, g * scale, b * scale);
 
-          pixel[0] = (ybr[0] * max_storable_value).round() as u16;
-          pixel[1] = (ybr[1] * max_storable_value).round() as u16;
-          pixel[2] = (ybr[2] * max_storable_value).round() as u16;
-        }
+            pixel[0] = (ybr[0] * max_storable_value).round() as u16;
+            pixel[1] = (ybr[1] * max_storable_value).round() as u16;
+            pixel[2] = (ybr[2] * max_storable_value).round() as u16;
+          }
+        });
 
         *color_space = ColorSpace::Ybr { is_422: false };
       }
@@ -478,17 +568,19 @@ impl ColorImage {
       }
 
       ColorImageData::U32 { data, color_space } if color_space.is_rgb() => {
-        for pixel in data.chunks_exact_mut(3) {
-          let r: f64 = pixel[0].into();
-          let g: f64 = pixel[1].into();
-          let b: f64 = pixel[2].into();
+        row_parallel::for_each_band_mut(data, row_size, thread_count, |data| {
+          for pixel in data.chunks_exact_mut(3) {
+            let r: f64 = pixel[0].into();
+            let g: f64 = pixel[1].into();
+            let b: f64 = pixel[2].into();
 
-          let ybr = rgb_to_ybr(r * scale, g * scale, b * scale);
+            let ybr = rgb_to_ybr(r * scale, g * scale, b * scale);
 
-          pixel[0] = (ybr[0] * max_storable_value).round() as u32;
-          pixel[1] = (ybr[1] * max_storable_value).round() as u32;
-          pixel[2] = (ybr[2] * max_storable_value).round() as u32;
-        }
+            pixel[0] = (ybr[0] * max_storable_value).round() as u32;
+            pixel[1] = (ybr[1] * max_storable_value).round() as u32;
+            pixel[2] = (ybr[2] * max_storable_value).round() as u32;
+          }
+        });
 
         *color_space = ColorSpace::Ybr { is_422: false };
       }
@@ -561,6 +653,18 @@ impl ColorImage {
   /// Crops this color image to the specified rectangle.
   ///
   pub fn crop(&mut self, crop_rect: &CropRect) {
+    self.crop_with_threads(crop_rect, 1);
+  }
+
+  /// The same as [`Self::crop()`], but bands of rows are copied concurrently
+  /// on up to `thread_count` threads. See
+  /// [`crate::MonochromeImage::to_gray_u8_image_with_threads()`] for details.
+  ///
+  pub fn crop_with_threads(
+    &mut self,
+    crop_rect: &CropRect,
+    thread_count: usize,
+  ) {
     let left = crop_rect.left;
     let top = crop_rect.top;
     let (height, width) = crop_rect.apply(self.height(), self.width());
@@ -569,7 +673,8 @@ impl ColorImage {
       return;
     }
 
-    fn crop<T: Clone>(
+    #[allow(clippy::too_many_arguments)]
+    fn crop<T: Copy + Default + MaybeSend + MaybeSync>(
       data: &mut Vec<T>,
       original_width: u16,
       left: u16,
@@ -577,16 +682,32 @@ impl ColorImage {
       width: u16,
       height: u16,
       samples_per_pixel: usize,
+      thread_count: usize,
     ) {
-      let mut new_data = Vec::with_capacity(
-        width as usize * height as usize * samples_per_pixel,
-      );
-
-      for row in top..top + height {
-        let start = (row as usize * original_width as usize + left as usize)
-          * samples_per_pixel;
-        let end = start + width as usize * samples_per_pixel;
-        new_data.extend_from_slice(&data[start..end]);
+      let original_row_size = usize::from(original_width) * samples_per_pixel;
+      let row_size = usize::from(width) * samples_per_pixel;
+
+      let mut new_data = vec![T::default(); row_size * usize::from(height)];
+
+      if !new_data.is_empty() {
+        let start = usize::from(top) * original_row_size
+          + usize::from(left) * samples_per_pixel;
+
+        row_parallel::for_each_band_zip(
+          &data[start..],
+          original_row_size,
+          &mut new_data,
+          row_size,
+          thread_count,
+          |data, new_data| {
+            for (row, new_row) in data
+              .chunks(original_row_size)
+              .zip(new_data.chunks_exact_mut(row_size))
+            {
+              new_row.copy_from_slice(&row[..row_size]);
+            }
+          },
+        );
       }
 
       *data = new_data;
@@ -594,19 +715,19 @@ impl ColorImage {
 
     match &mut self.data {
       ColorImageData::U8 { data, .. } => {
-        crop(data, self.width, left, top, width, height, 3)
+        crop(data, self.width, left, top, width, height, 3, thread_count)
       }
       ColorImageData::U16 { data, .. } => {
-        crop(data, self.width, left, top, width, height, 3)
+        crop(data, self.width, left, top, width, height, 3, thread_count)
       }
       ColorImageData::U32 { data, .. } => {
-        crop(data, self.width, left, top, width, height, 3);
+        crop(data, self.width, left, top, width, height, 3, thread_count);
       }
       ColorImageData::PaletteU8 { data, .. } => {
-        crop(data, self.width, left, top, width, height, 1);
+        crop(data, self.width, left, top, width, height, 1, thread_count);
       }
       ColorImageData::PaletteU16 { data, .. } => {
-        crop(data, self.width, left, top, width, height, 1);
+        crop(data, self.width, left, top, width, height, 1, thread_count);
       }
     }
 
@@ -635,7 +756,8 @@ impl ColorImage {
       .unwrap(),
 
       _ => {
-        let mut rgb_pixels = Vec::with_capacity(self.pixel_count() * 3);
+        let mut rgb_pixels =
+          frame_buffer_pool::vec_with_capacity(self.pixel_count() * 3);
 
         fn unsigned_data_to_rgb_pixels<T>(
           data: Vec<T>,
@@ -643,16 +765,16 @@ impl ColorImage {
           rgb_pixels: &mut Vec<u8>,
           max_storable_value: u32,
         ) where
-          T: Copy + Into<f64> + Into<u64>,
+          T: PoolElement + Into<f64> + Into<u64>,
           u64: From<T>,
         {
           match color_space {
             ColorSpace::Rgb => {
               let max_storable_value: u64 = max_storable_value.into();
 
-              for value in data {
+              for value in data.iter() {
                 rgb_pixels.push(
-                  udiv_round(u64::from(value) * 255, max_storable_value)
+                  udiv_round(u64::from(*value) * 255, max_storable_value)
                     .min(255) as u8,
                 );
               }
@@ -677,9 +799,27 @@ impl ColorImage {
               }
             }
           }
+
+          frame_buffer_pool::recycle(data);
         }
 
         match self.data {
+          ColorImageData::U8 {
+            data,
+            color_space: ColorSpace::Ybr { .. },
+          } => {
+            rgb_pixels.resize(data.len(), 0);
+
+            ybr_conversion::ybr_to_rgb_u8(
+              &data,
+              &mut rgb_pixels,
+              max_storable_value,
+              255,
+            );
+
+            frame_buffer_pool::recycle(data);
+          }
+
           ColorImageData::U8 { data, color_space } => {
             unsigned_data_to_rgb_pixels(
               data,
@@ -708,17 +848,21 @@ impl ColorImage {
           }
 
           ColorImageData::PaletteU8 { data, palette } => {
-            for pixel in data {
-              let rgb = palette.lookup_normalized_u8(pixel.into());
+            for pixel in data.iter() {
+              let rgb = palette.lookup_normalized_u8((*pixel).into());
               rgb_pixels.extend_from_slice(&rgb);
             }
+
+            frame_buffer_pool::recycle(data);
           }
 
           ColorImageData::PaletteU16 { data, palette } => {
-            for pixel in data {
-              let rgb = palette.lookup_normalized_u8(pixel.into());
+            for pixel in data.iter() {
+              let rgb = palette.lookup_normalized_u8((*pixel).into());
               rgb_pixels.extend_from_slice(&rgb);
             }
+
+            frame_buffer_pool::recycle(data);
           }
         }
 
@@ -948,16 +1092,6 @@ impl ColorImage {
   }
 }
 
-/// Converts a YBR color into RGB.
-///
-fn ybr_to_rgb(y: f64, cb: f64, cr: f64) -> [f64; 3] {
-  let r = y + 1.402 * (cr - 0.5);
-  let g = y - 0.3441362862 * (cb - 0.5) - 0.7141362862 * (cr - 0.5);
-  let b = y + 1.772 * (cb - 0.5);
-
-  [r.clamp(0.0, 1.0), g.clamp(0.0, 1.0), b.clamp(0.0, 1.0)]
-}
-
 /// Converts a YBR color into RGB.
 ///
 fn rgb_to_ybr(r: f64, g: f64, b: f64) -> [f64; 3] {
@@ -0,0 +1,147 @@
+//! Decoding of a batch of whole frames in a single call into a native codec,
+//! see `vendor/codec_batch/codec_batch.h`. This saves a round trip through the
+//! FFI and the setup of a decoder for every frame, and lets the codec decode
+//! the frames of the batch concurrently on its own threads.
+
+use crate::{
+  PixelDataDecodeError,
+  frame_buffer_pool::{self, PoolElement},
+};
+
+/// A frame in a batch decode, which matches `codec_batch_frame` in
+/// `codec_batch.h`. The output buffer is allocated by the caller and must be
+/// the exact size of the decoded frame.
+///
+#[repr(C)]
+pub struct BatchFrame {
+  input_data: *const core::ffi::c_void,
+  input_data_size: usize,
+  output_buffer: *mut core::ffi::c_void,
+  output_buffer_size: usize,
+  result: usize,
+  error: [core::ffi::c_char; 200],
+}
+
+impl BatchFrame {
+  /// Creates a frame that decodes the passed data into an output buffer of
+  /// `output_buffer_size` bytes. Both must remain valid until the batch has
+  /// been decoded.
+  ///
+  pub fn new(
+    data: &[u8],
+    output_buffer: *mut core::ffi::c_void,
+    output_buffer_size: usize,
+  ) -> Self {
+    Self {
+      input_data: data.as_ptr() as *const core::ffi::c_void,
+      input_data_size: data.len(),
+      output_buffer,
+      output_buffer_size,
+      result: 0,
+      error: [0; 200],
+    }
+  }
+
+  /// Returns the result of decoding this frame, reading its error message on
+  /// error. The name of the codec is used as the start of the error message.
+  ///
+  pub fn result(&self, codec_name: &str) -> Result<(), PixelDataDecodeError> {
+    if self.result != 0 {
+      let error = unsafe { core::ffi::CStr::from_ptr(self.error.as_ptr()) }
+        .to_str()
+        .unwrap_or("<invalid error>");
+
+      return Err(PixelDataDecodeError::DataInvalid {
+        details: format!("{codec_name} decode failed with '{error}'"),
+      });
+    }
+
+    Ok(())
+  }
+}
+
+/// Decodes a batch of frames that each decode to `sample_count` samples.
+/// `decode` is passed the frames of the batch and must decode all of them in a
+/// single call into the codec. The decoded samples of each frame are returned
+/// in the same order as the input frames.
+///
+pub fn decode_batch<T: PoolElement>(
+  frames: &[&[u8]],
+  sample_count: usize,
+  codec_name: &str,
+  decode: impl FnOnce(&mut [BatchFrame]),
+) -> Vec<Result<Vec<T>, PixelDataDecodeError>> {
+  let mut output_buffers: Vec<Vec<T>> = frames
+    .iter()
+    .map(|_| frame_buffer_pool::zeroed_vec(sample_count))
+    .collect();
+
+  let mut batch_frames: Vec<_> = frames
+    .iter()
+    .zip(output_buffers.iter_mut())
+    .map(|(data, output_buffer)| {
+      BatchFrame::new(
+        data,
+        output_buffer.as_mut_ptr() as *mut core::ffi::c_void,
+        core::mem::size_of_val(output_buffer.as_slice()),
+      )
+    })
+    .collect();
+
+  if !batch_frames.is_empty() {
+    decode(&mut batch_frames);
+  }
+
+  batch_frames
+    .iter()
+    .zip(output_buffers)
+    .map(|(frame, output_buffer)| {
+      frame.result(codec_name).map(|()| output_buffer)
+    })
+    .collect()
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn decode_batch_returns_results_in_order() {
+    let frames: [&[u8]; 3] = [&[1], &[2], &[3]];
+
+    let results = decode_batch::<u16>(&frames, 2, "Test", |batch_frames| {
+      for frame in batch_frames.iter_mut() {
+        let input = unsafe { *(frame.input_data as *const u8) };
+
+        if input == 2 {
+          frame.result = 1;
+          frame.error[..4].copy_from_slice(&[98, 97, 100, 0]);
+        } else {
+          let output = unsafe {
+            core::slice::from_raw_parts_mut(frame.output_buffer as *mut u16, 2)
+          };
+          output.fill(input.into());
+        }
+      }
+    });
+
+    assert_eq!(
+      results,
+      vec![
+        Ok(vec![1, 1]),
+        Err(PixelDataDecodeError::DataInvalid {
+          details: "Test decode failed with 'bad'".to_string()
+        }),
+        Ok(vec![3, 3]),
+      ]
+    );
+  }
+
+  #[test]
+  fn decode_batch_of_no_frames() {
+    let results =
+      decode_batch::<u8>(&[], 1, "Test", |_| panic!("Empty batch decoded"));
+
+    assert!(results.is_empty());
+  }
+}
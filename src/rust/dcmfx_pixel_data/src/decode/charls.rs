@@ -1,12 +1,14 @@
-#[cfg(not(feature = "std"))]
-use alloc::{format, vec, vec::Vec};
+use std::cell::RefCell;
 
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError,
+  decode::{OutputLut, batch},
+  frame_buffer_pool::{self, PoolElement},
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
     PixelRepresentation,
   },
+  transforms::CropRect,
 };
 
 /// Returns the photometric interpretation used by data decoded using CharLS.
@@ -32,14 +34,18 @@ pub fn decode_photometric_interpretation(
   }
 }
 
-/// Decodes monochrome pixel data using CharLS.
+/// Decodes the part of monochrome pixel data inside the decode area using
+/// CharLS. Data that has restart intervals is decoded on up to `thread_count`
+/// threads, with each restart interval decoded separately.
 ///
 pub fn decode_monochrome(
   image_pixel_module: &ImagePixelModule,
   data: &[u8],
+  decode_area: &CropRect,
+  thread_count: usize,
 ) -> Result<MonochromeImage, PixelDataDecodeError> {
-  let width = image_pixel_module.columns();
-  let height = image_pixel_module.rows();
+  let (height, width) =
+    decode_area.apply(image_pixel_module.rows(), image_pixel_module.columns());
   let bits_stored = image_pixel_module.bits_stored();
   let is_monochrome1 = image_pixel_module
     .photometric_interpretation()
@@ -58,7 +64,7 @@ pub fn decode_monochrome(
       },
       BitsAllocated::Eight,
     ) => {
-      let pixels = decode(data, image_pixel_module)?;
+      let pixels = decode(data, image_pixel_module, decode_area, thread_count)?;
       MonochromeImage::new_u8(
         width,
         height,
@@ -78,7 +84,7 @@ pub fn decode_monochrome(
       },
       BitsAllocated::Sixteen,
     ) => {
-      let pixels = decode(data, image_pixel_module)?;
+      let pixels = decode(data, image_pixel_module, decode_area, thread_count)?;
       MonochromeImage::new_u16(
         width,
         height,
@@ -102,14 +108,50 @@ pub fn decode_monochrome(
   }
 }
 
-/// Decodes color pixel data using CharLS.
+/// Decodes the part of monochrome pixel data inside the decode area using
+/// CharLS in the same way as [`decode_monochrome()`], but has CharLS write each
+/// pixel as its entry in the output LUT rather than as a decoded sample.
+///
+pub fn decode_monochrome_lut(
+  image_pixel_module: &ImagePixelModule,
+  data: &[u8],
+  decode_area: &CropRect,
+  thread_count: usize,
+  output_lut: &OutputLut,
+) -> Result<Vec<u8>, PixelDataDecodeError> {
+  if image_pixel_module.pixel_representation() != PixelRepresentation::Unsigned
+  {
+    return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+      details: format!(
+        "JPEG-LS monochrome decode not supported for photometric \
+         interpretation '{}', bits allocated '{}'",
+        image_pixel_module.photometric_interpretation(),
+        u8::from(image_pixel_module.bits_allocated())
+      ),
+    });
+  }
+
+  decode_with_output_lut(
+    data,
+    image_pixel_module,
+    decode_area,
+    thread_count,
+    Some(output_lut),
+  )
+}
+
+/// Decodes the part of color pixel data inside the decode area using CharLS.
+/// Data that has restart intervals is decoded on up to `thread_count` threads,
+/// with each restart interval decoded separately.
 ///
 pub fn decode_color(
   image_pixel_module: &ImagePixelModule,
   data: &[u8],
+  decode_area: &CropRect,
+  thread_count: usize,
 ) -> Result<ColorImage, PixelDataDecodeError> {
-  let width = image_pixel_module.columns();
-  let height = image_pixel_module.rows();
+  let (height, width) =
+    decode_area.apply(image_pixel_module.rows(), image_pixel_module.columns());
   let bits_stored = image_pixel_module.bits_stored();
 
   let color_space = if image_pixel_module.photometric_interpretation().is_rgb()
@@ -127,7 +169,7 @@ pub fn decode_color(
       PhotometricInterpretation::Rgb | PhotometricInterpretation::YbrFull,
       BitsAllocated::Eight,
     ) => {
-      let pixels = decode(data, image_pixel_module)?;
+      let pixels = decode(data, image_pixel_module, decode_area, thread_count)?;
       ColorImage::new_u8(width, height, pixels, color_space, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
     }
@@ -136,7 +178,7 @@ pub fn decode_color(
       PhotometricInterpretation::PaletteColor { palette },
       BitsAllocated::Eight,
     ) => {
-      let pixels = decode(data, image_pixel_module)?;
+      let pixels = decode(data, image_pixel_module, decode_area, thread_count)?;
       ColorImage::new_palette8(
         width,
         height,
@@ -151,7 +193,7 @@ pub fn decode_color(
       PhotometricInterpretation::Rgb | PhotometricInterpretation::YbrFull,
       BitsAllocated::Sixteen,
     ) => {
-      let pixels = decode(data, image_pixel_module)?;
+      let pixels = decode(data, image_pixel_module, decode_area, thread_count)?;
       ColorImage::new_u16(width, height, pixels, color_space, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
     }
@@ -160,7 +202,7 @@ pub fn decode_color(
       PhotometricInterpretation::PaletteColor { palette },
       BitsAllocated::Sixteen,
     ) => {
-      let pixels = decode(data, image_pixel_module)?;
+      let pixels = decode(data, image_pixel_module, decode_area, thread_count)?;
       ColorImage::new_palette16(
         width,
         height,
@@ -184,64 +226,440 @@ pub fn decode_color(
   }
 }
 
-fn decode<T: Clone + Default>(
-  data: &[u8],
+/// Decodes a batch of whole frames of monochrome pixel data using CharLS in a
+/// single call. The frames are shared out between up to `thread_count` threads,
+/// which each create one decoder and reuse it for every frame they decode. The
+/// results are returned in the same order as the frames.
+///
+pub fn decode_monochrome_batch(
   image_pixel_module: &ImagePixelModule,
-) -> Result<Vec<T>, PixelDataDecodeError> {
+  frames: &[&[u8]],
+  thread_count: usize,
+) -> Vec<Result<MonochromeImage, PixelDataDecodeError>> {
   let width = image_pixel_module.columns();
   let height = image_pixel_module.rows();
+  let bits_stored = image_pixel_module.bits_stored();
+  let is_monochrome1 = image_pixel_module
+    .photometric_interpretation()
+    .is_monochrome1();
+
+  match (
+    image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      }
+      | PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      BitsAllocated::Eight,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        MonochromeImage::new_u8(
+          width,
+          height,
+          pixels?,
+          bits_stored,
+          is_monochrome1,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      }
+      | PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      BitsAllocated::Sixteen,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        MonochromeImage::new_u16(
+          width,
+          height,
+          pixels?,
+          bits_stored,
+          is_monochrome1,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (photometric_interpretation, bits_allocated) => {
+      let error = PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "JPEG-LS monochrome decode not supported for photometric \
+           interpretation '{}', bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated)
+        ),
+      };
+
+      frames.iter().map(|_| Err(error.clone())).collect()
+    }
+  }
+}
+
+/// Decodes a batch of whole frames of color pixel data using CharLS in a single
+/// call, in the same way as [`decode_monochrome_batch()`].
+///
+pub fn decode_color_batch(
+  image_pixel_module: &ImagePixelModule,
+  frames: &[&[u8]],
+  thread_count: usize,
+) -> Vec<Result<ColorImage, PixelDataDecodeError>> {
+  let width = image_pixel_module.columns();
+  let height = image_pixel_module.rows();
+  let bits_stored = image_pixel_module.bits_stored();
+
+  let color_space = if image_pixel_module.photometric_interpretation().is_rgb()
+  {
+    ColorSpace::Rgb
+  } else {
+    ColorSpace::Ybr { is_422: false }
+  };
+
+  match (
+    image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      PhotometricInterpretation::Rgb | PhotometricInterpretation::YbrFull,
+      BitsAllocated::Eight,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        ColorImage::new_u8(width, height, pixels?, color_space, bits_stored)
+          .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::PaletteColor { palette },
+      BitsAllocated::Eight,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        ColorImage::new_palette8(
+          width,
+          height,
+          pixels?,
+          palette.clone(),
+          bits_stored,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::Rgb | PhotometricInterpretation::YbrFull,
+      BitsAllocated::Sixteen,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        ColorImage::new_u16(width, height, pixels?, color_space, bits_stored)
+          .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::PaletteColor { palette },
+      BitsAllocated::Sixteen,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        ColorImage::new_palette16(
+          width,
+          height,
+          pixels?,
+          palette.clone(),
+          bits_stored,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (photometric_interpretation, bits_allocated) => {
+      let error = PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "JPEG-LS color decode not supported for photometric interpretation \
+           '{}', bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated)
+        ),
+      };
+
+      frames.iter().map(|_| Err(error.clone())).collect()
+    }
+  }
+}
+
+/// Decodes a batch of whole JPEG-LS frames into newly allocated buffers of
+/// samples with a single call into CharLS.
+///
+fn decode_batch<T: PoolElement>(
+  image_pixel_module: &ImagePixelModule,
+  frames: &[&[u8]],
+  thread_count: usize,
+) -> Vec<Result<Vec<T>, PixelDataDecodeError>> {
   let samples_per_pixel = u8::from(image_pixel_module.samples_per_pixel());
   let bits_allocated = u8::from(image_pixel_module.bits_allocated());
-  let mut error_buffer = [0 as core::ffi::c_char; 256];
-
-  // Allocate output buffer
-  let mut output_buffer = vec![
-    T::default();
-    image_pixel_module.pixel_count()
-      * usize::from(samples_per_pixel)
-  ];
-
-  let result = unsafe {
-    ffi::charls_decode(
-      data.as_ptr() as *mut core::ffi::c_void,
-      data.len(),
-      width.into(),
-      height.into(),
-      samples_per_pixel.into(),
-      bits_allocated.into(),
-      output_buffer.as_mut_ptr() as *mut core::ffi::c_void,
-      output_buffer.len() * core::mem::size_of::<T>(),
-      error_buffer.as_mut_ptr(),
-      error_buffer.len(),
-    )
-  };
+  let sample_count =
+    image_pixel_module.pixel_count() * usize::from(samples_per_pixel);
 
-  if result != 0 {
-    let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
-      .to_str()
-      .unwrap_or("<invalid error>");
+  batch::decode_batch(
+    frames,
+    sample_count,
+    "JPEG-LS pixel data",
+    |batch_frames| unsafe {
+      ffi::charls_decode_batch(
+        batch_frames.as_mut_ptr(),
+        batch_frames.len(),
+        image_pixel_module.columns().into(),
+        image_pixel_module.rows().into(),
+        samples_per_pixel.into(),
+        bits_allocated.into(),
+        thread_count,
+      )
+    },
+  )
+}
 
-    return Err(PixelDataDecodeError::DataInvalid {
-      details: format!("JPEG-LS pixel data decode failed with '{error}'"),
-    });
+/// A reusable CharLS JPEG-LS decoder. Creating a decoder has a cost, so a
+/// single decoder is kept per thread and reused for every frame decoded on
+/// that thread.
+///
+pub struct CharlsDecoder {
+  handle: *mut ffi::CharlsJpeglsDecoder,
+}
+
+impl CharlsDecoder {
+  /// Creates a new CharLS decoder.
+  ///
+  pub fn new() -> Result<Self, PixelDataDecodeError> {
+    let handle = unsafe { ffi::charls_decoder_create() };
+    if handle.is_null() {
+      return Err(PixelDataDecodeError::DataInvalid {
+        details: "JPEG-LS decoder creation failed".to_string(),
+      });
+    }
+
+    Ok(Self { handle })
   }
 
-  Ok(output_buffer)
+  /// Decodes the part of a JPEG-LS frame inside the decode area into a newly
+  /// allocated buffer of samples. Restart intervals are decoded concurrently on
+  /// up to `thread_count` threads, where zero uses one thread per CPU core.
+  ///
+  /// If an output LUT is given then the buffer holds each pixel's entry in the
+  /// LUT rather than its samples, and `T` must be `u8`.
+  ///
+  pub fn decode<T: PoolElement>(
+    &mut self,
+    data: &[u8],
+    image_pixel_module: &ImagePixelModule,
+    decode_area: &CropRect,
+    thread_count: usize,
+    output_lut: Option<&OutputLut>,
+  ) -> Result<Vec<T>, PixelDataDecodeError> {
+    let (height, width) = decode_area
+      .apply(image_pixel_module.rows(), image_pixel_module.columns());
+    let row_length = usize::from(width)
+      * match output_lut {
+        Some(output_lut) => output_lut.entry_size(),
+        None => usize::from(u8::from(image_pixel_module.samples_per_pixel())),
+      };
+
+    let mut output_buffer =
+      frame_buffer_pool::zeroed_vec(usize::from(height) * row_length);
+
+    self.decode_into(
+      data,
+      image_pixel_module,
+      decode_area,
+      thread_count,
+      output_lut,
+      &mut output_buffer,
+      row_length,
+    )?;
+
+    Ok(output_buffer)
+  }
+
+  /// Decodes the part of a JPEG-LS frame inside the decode area into an
+  /// existing buffer, with the start of each decoded row placed
+  /// `output_stride` samples after the start of the previous one. This lets
+  /// a frame be decoded straight into part of a larger image. Only the restart
+  /// intervals that intersect the decode area are decoded.
+  ///
+  /// Color frames that store their components in separate scans are decoded
+  /// in full and then have the decode area copied into the output buffer.
+  ///
+  /// If an output LUT is given then each pixel is written as its entry in the
+  /// LUT rather than as its samples, which only works for monochrome frames.
+  ///
+  #[allow(clippy::too_many_arguments)]
+  pub fn decode_into<T>(
+    &mut self,
+    data: &[u8],
+    image_pixel_module: &ImagePixelModule,
+    decode_area: &CropRect,
+    thread_count: usize,
+    output_lut: Option<&OutputLut>,
+    output_buffer: &mut [T],
+    output_stride: usize,
+  ) -> Result<(), PixelDataDecodeError> {
+    let width = image_pixel_module.columns();
+    let height = image_pixel_module.rows();
+    let samples_per_pixel = u8::from(image_pixel_module.samples_per_pixel());
+    let bits_allocated = u8::from(image_pixel_module.bits_allocated());
+    let (region_height, region_width) = decode_area.apply(height, width);
+    let mut error_buffer = [0 as core::ffi::c_char; 256];
+
+    let result = unsafe {
+      ffi::charls_decode(
+        self.handle,
+        data.as_ptr() as *mut core::ffi::c_void,
+        data.len(),
+        width.into(),
+        height.into(),
+        samples_per_pixel.into(),
+        bits_allocated.into(),
+        decode_area.left.into(),
+        decode_area.top.into(),
+        region_width.into(),
+        region_height.into(),
+        thread_count,
+        output_lut.map_or(core::ptr::null(), |lut| lut.as_ptr()),
+        output_lut.map_or(0, |lut| lut.entry_size()),
+        output_buffer.as_mut_ptr() as *mut core::ffi::c_void,
+        core::mem::size_of_val(output_buffer),
+        output_stride * core::mem::size_of::<T>(),
+        error_buffer.as_mut_ptr(),
+        error_buffer.len(),
+      )
+    };
+
+    if result != 0 {
+      let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
+        .to_str()
+        .unwrap_or("<invalid error>");
+
+      return Err(PixelDataDecodeError::DataInvalid {
+        details: format!("JPEG-LS pixel data decode failed with '{error}'"),
+      });
+    }
+
+    Ok(())
+  }
+}
+
+impl Drop for CharlsDecoder {
+  fn drop(&mut self) {
+    unsafe { ffi::charls_decoder_destroy(self.handle) };
+  }
+}
+
+// SAFETY: The CharLS decoder has no thread affinity, it just can't be used from
+// multiple threads at the same time, which `&mut self` on decode prevents.
+unsafe impl Send for CharlsDecoder {}
+
+std::thread_local! {
+  static DECODER: RefCell<Option<CharlsDecoder>> = const { RefCell::new(None) };
+}
+
+/// Decodes using this thread's CharLS decoder, creating it if needed.
+///
+fn decode<T: PoolElement>(
+  data: &[u8],
+  image_pixel_module: &ImagePixelModule,
+  decode_area: &CropRect,
+  thread_count: usize,
+) -> Result<Vec<T>, PixelDataDecodeError> {
+  decode_with_output_lut(
+    data,
+    image_pixel_module,
+    decode_area,
+    thread_count,
+    None,
+  )
+}
+
+/// Decodes using this thread's CharLS decoder in the same way as [`decode()`],
+/// writing each pixel through the output LUT if one is given.
+///
+fn decode_with_output_lut<T: PoolElement>(
+  data: &[u8],
+  image_pixel_module: &ImagePixelModule,
+  decode_area: &CropRect,
+  thread_count: usize,
+  output_lut: Option<&OutputLut>,
+) -> Result<Vec<T>, PixelDataDecodeError> {
+  DECODER.with_borrow_mut(|decoder| {
+    let decoder = match decoder {
+      Some(decoder) => decoder,
+      None => decoder.insert(CharlsDecoder::new()?),
+    };
+
+    decoder.decode(
+      data,
+      image_pixel_module,
+      decode_area,
+      thread_count,
+      output_lut,
+    )
+  })
 }
 
 mod ffi {
+  use crate::decode::batch::BatchFrame;
+
+  #[repr(C)]
+  pub struct CharlsJpeglsDecoder {
+    _private: [u8; 0],
+  }
+
   unsafe extern "C" {
+    pub fn charls_decoder_create() -> *mut CharlsJpeglsDecoder;
+
+    pub fn charls_decoder_destroy(decoder: *mut CharlsJpeglsDecoder);
+
     pub fn charls_decode(
+      decoder: *mut CharlsJpeglsDecoder,
       input_data: *const core::ffi::c_void,
       input_data_size: usize,
       width: usize,
       height: usize,
       samples_per_pixel: usize,
       bits_allocated: usize,
+      region_left: usize,
+      region_top: usize,
+      region_width: usize,
+      region_height: usize,
+      thread_count: usize,
+      output_lut: *const u8,
+      output_lut_entry_size: usize,
       output_buffer: *mut core::ffi::c_void,
       output_buffer_size: usize,
+      output_stride: usize,
       error_buffer: *mut core::ffi::c_char,
       error_buffer_size: usize,
     ) -> usize;
+
+    pub fn charls_decode_batch(
+      frames: *mut BatchFrame,
+      frame_count: usize,
+      width: usize,
+      height: usize,
+      samples_per_pixel: usize,
+      bits_allocated: usize,
+      thread_count: usize,
+    );
   }
 }
@@ -0,0 +1,103 @@
+//! Decoding of frames with a decoder provided by the application, e.g. one
+//! that decodes High-Throughput JPEG 2000 or JPEG Baseline on a GPU.
+//!
+//! An external decoder is registered with [`set_external_decoder()`], and is
+//! then used in place of the built-in decoders for the transfer syntaxes and
+//! images it reports that it supports. Batches of frames are passed to it in a
+//! single call, see [`crate::decode::decode_monochrome_frames()`], which lets
+//! it work on all of their code-blocks or MCUs at once.
+
+use std::sync::{
+  Arc,
+  atomic::{AtomicPtr, Ordering},
+};
+
+use dcmfx_core::TransferSyntax;
+
+use crate::{
+  ColorImage, MonochromeImage, PixelDataDecodeError, iods::ImagePixelModule,
+};
+
+/// A decoder for frames of pixel data that's provided by the application.
+///
+/// Frames are passed to an external decoder as the complete data of each
+/// frame, and it must decode them at full resolution. Decode areas are cropped
+/// from its output, and when a reduced resolution is requested the built-in
+/// decoders are used instead.
+///
+/// The returned images are always in host memory. A decoder that also keeps
+/// its output on a device for rendering must manage that itself, e.g. keyed on
+/// the frame data that it was passed.
+///
+pub trait ExternalDecoder: Send + Sync {
+  /// Returns whether this decoder decodes frames in the given transfer syntax
+  /// that have the given Image Pixel Module. When this returns false the
+  /// built-in decoders are used.
+  ///
+  fn supports(
+    &self,
+    transfer_syntax: &'static TransferSyntax,
+    image_pixel_module: &ImagePixelModule,
+  ) -> bool;
+
+  /// Decodes a batch of frames of monochrome pixel data, returning the result
+  /// for each frame in the same order as the frames.
+  ///
+  fn decode_monochrome_frames(
+    &self,
+    frames: &[&[u8]],
+    transfer_syntax: &'static TransferSyntax,
+    image_pixel_module: &ImagePixelModule,
+  ) -> Vec<Result<MonochromeImage, PixelDataDecodeError>>;
+
+  /// Decodes a batch of frames of color pixel data, returning the result for
+  /// each frame in the same order as the frames.
+  ///
+  fn decode_color_frames(
+    &self,
+    frames: &[&[u8]],
+    transfer_syntax: &'static TransferSyntax,
+    image_pixel_module: &ImagePixelModule,
+  ) -> Vec<Result<ColorImage, PixelDataDecodeError>>;
+}
+
+/// The external decoder currently in use, or null if there isn't one. It
+/// points to a leaked box so that it can be read without taking a lock.
+///
+static EXTERNAL_DECODER: AtomicPtr<Arc<dyn ExternalDecoder>> =
+  AtomicPtr::new(core::ptr::null_mut());
+
+/// Sets the external decoder that's used in place of the built-in decoders for
+/// the frames it supports. Passing `None` returns to only using the built-in
+/// decoders.
+///
+/// A replaced decoder is never dropped, as decodes on other threads may still
+/// be using it. This function is intended to be called once at startup.
+///
+pub fn set_external_decoder(decoder: Option<Arc<dyn ExternalDecoder>>) {
+  let ptr = match decoder {
+    Some(decoder) => Box::into_raw(Box::new(decoder)),
+    None => core::ptr::null_mut(),
+  };
+
+  EXTERNAL_DECODER.store(ptr, Ordering::Release);
+}
+
+/// Returns the external decoder to use for frames in the given transfer syntax
+/// that have the given Image Pixel Module, if there is one.
+///
+pub(crate) fn decoder_for(
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+) -> Option<&'static dyn ExternalDecoder> {
+  let decoder = EXTERNAL_DECODER.load(Ordering::Acquire);
+  if decoder.is_null() {
+    return None;
+  }
+
+  let decoder: &'static dyn ExternalDecoder = unsafe { &**decoder };
+
+  decoder
+    .supports(transfer_syntax, image_pixel_module)
+    .then_some(decoder)
+}
@@ -0,0 +1,202 @@
+//! Decoding of a frame of pixel data that is given its data incrementally as
+//! it arrives, e.g. while it's being downloaded from object storage.
+
+use dcmfx_core::{RcByteSlice, TransferSyntax};
+
+use crate::{
+  ColorImage, MonochromeImage, PixelDataDecodeConfig, PixelDataDecodeError,
+  PixelDataFrame, iods::ImagePixelModule,
+};
+
+#[cfg(all(feature = "native", feature = "std"))]
+use super::JpegXlDecoder;
+#[cfg(feature = "native")]
+use super::libjpeg_12bit;
+#[cfg(all(feature = "native", feature = "std"))]
+use super::libjxl;
+
+/// Decodes a frame of pixel data that is pushed to it in pieces as the data
+/// arrives, rather than waiting for the whole frame to be available. This
+/// overlaps the time spent waiting on the network with decoding, which reduces
+/// the time to decode frames read from cloud-hosted studies.
+///
+/// 12-bit JPEG decoded with libjpeg_12bit and JPEG XL decoded with libjxl are
+/// decoded as each piece of data is pushed, with the decoder suspending when
+/// it reaches the end of the data received so far. Other transfer syntaxes and
+/// decoders hold on to the pushed data and decode the whole frame when
+/// [`Self::finish_monochrome()`] or [`Self::finish_color()`] is called.
+///
+/// Pushed data is held until the decode completes, and is read in place
+/// rather than being combined into a single buffer.
+///
+pub struct IncrementalDecoder {
+  // Declared ahead of `frame` so that it's dropped before the data it reads
+  session: Option<Session>,
+  frame: PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: ImagePixelModule,
+  decode_config: PixelDataDecodeConfig,
+}
+
+/// A decoder that decodes pushed data as it arrives.
+///
+/// The libjxl session reads pushed data in place, and the data is owned by the
+/// [`IncrementalDecoder`]'s frame, hence the `'static` lifetime. The data is
+/// reference counted and never released or moved while the session exists.
+///
+enum Session {
+  #[cfg(feature = "native")]
+  LibJpeg12Bit(libjpeg_12bit::DecodeSession),
+  #[cfg(all(feature = "native", feature = "std"))]
+  LibJxl(libjxl::DecodeSession<'static>),
+}
+
+impl IncrementalDecoder {
+  /// Creates a new incremental decoder for a frame of pixel data in the given
+  /// transfer syntax. Whether the frame is monochrome or color is determined
+  /// by the image pixel module.
+  ///
+  pub fn new(
+    transfer_syntax: &'static TransferSyntax,
+    image_pixel_module: &ImagePixelModule,
+    decode_config: &PixelDataDecodeConfig,
+  ) -> Result<Self, PixelDataDecodeError> {
+    Ok(Self {
+      session: Self::new_session(
+        transfer_syntax,
+        image_pixel_module,
+        decode_config,
+      )?,
+      frame: PixelDataFrame::new(),
+      transfer_syntax,
+      image_pixel_module: image_pixel_module.clone(),
+      decode_config: *decode_config,
+    })
+  }
+
+  #[allow(unused_variables)]
+  fn new_session(
+    transfer_syntax: &'static TransferSyntax,
+    image_pixel_module: &ImagePixelModule,
+    decode_config: &PixelDataDecodeConfig,
+  ) -> Result<Option<Session>, PixelDataDecodeError> {
+    #[cfg(feature = "native")]
+    use dcmfx_core::transfer_syntax::*;
+
+    let is_monochrome = image_pixel_module.is_monochrome();
+
+    match transfer_syntax {
+      #[cfg(feature = "native")]
+      &JPEG_EXTENDED_12BIT => {
+        let session = if is_monochrome {
+          libjpeg_12bit::DecodeSession::new_monochrome(image_pixel_module)?
+        } else {
+          libjpeg_12bit::DecodeSession::new_color(image_pixel_module)?
+        };
+
+        Ok(Some(Session::LibJpeg12Bit(session)))
+      }
+
+      #[cfg(all(feature = "native", feature = "std"))]
+      &JPEG_XL_LOSSLESS | &JPEG_XL_JPEG_RECOMPRESSION | &JPEG_XL
+        if decode_config.jpeg_xl_decoder == JpegXlDecoder::LibJxl =>
+      {
+        let thread_count = decode_config.thread_count;
+
+        let session = if is_monochrome {
+          libjxl::DecodeSession::new_monochrome(
+            image_pixel_module,
+            thread_count,
+            false,
+          )?
+        } else {
+          libjxl::DecodeSession::new_color(
+            image_pixel_module,
+            thread_count,
+            false,
+          )?
+        };
+
+        Ok(Some(Session::LibJxl(session)))
+      }
+
+      _ => Ok(None),
+    }
+  }
+
+  /// Pushes the next piece of the frame's data. If the frame is being decoded
+  /// as its data arrives then the new data is decoded before this returns,
+  /// and any error in the data is returned immediately.
+  ///
+  pub fn push(
+    &mut self,
+    data: RcByteSlice,
+  ) -> Result<(), PixelDataDecodeError> {
+    // SAFETY: the data is reference counted and held in `self.frame`, which
+    // outlives the session
+    #[allow(unused_variables)]
+    let bytes: &'static [u8] =
+      unsafe { core::slice::from_raw_parts(data.as_ptr(), data.len()) };
+
+    self.frame.push_bytes(data);
+
+    match &mut self.session {
+      #[cfg(feature = "native")]
+      Some(Session::LibJpeg12Bit(session)) => session.push(bytes),
+
+      #[cfg(all(feature = "native", feature = "std"))]
+      Some(Session::LibJxl(session)) => session.push(bytes),
+
+      _ => Ok(()),
+    }
+  }
+
+  /// Marks the end of the frame's data and returns the decoded monochrome
+  /// image.
+  ///
+  pub fn finish_monochrome(
+    mut self,
+  ) -> Result<MonochromeImage, PixelDataDecodeError> {
+    match self.session.take() {
+      #[cfg(feature = "native")]
+      Some(Session::LibJpeg12Bit(session)) => {
+        session.finish_monochrome(&self.image_pixel_module)
+      }
+
+      #[cfg(all(feature = "native", feature = "std"))]
+      Some(Session::LibJxl(session)) => {
+        session.finish_monochrome(&self.image_pixel_module)
+      }
+
+      _ => super::decode_monochrome(
+        &mut self.frame,
+        self.transfer_syntax,
+        &self.image_pixel_module,
+        &self.decode_config,
+      ),
+    }
+  }
+
+  /// Marks the end of the frame's data and returns the decoded color image.
+  ///
+  pub fn finish_color(mut self) -> Result<ColorImage, PixelDataDecodeError> {
+    match self.session.take() {
+      #[cfg(feature = "native")]
+      Some(Session::LibJpeg12Bit(session)) => {
+        session.finish_color(&self.image_pixel_module)
+      }
+
+      #[cfg(all(feature = "native", feature = "std"))]
+      Some(Session::LibJxl(session)) => {
+        session.finish_color(&self.image_pixel_module)
+      }
+
+      _ => super::decode_color(
+        &mut self.frame,
+        self.transfer_syntax,
+        &self.image_pixel_module,
+        &self.decode_config,
+      ),
+    }
+  }
+}
@@ -5,6 +5,8 @@ use crate::{
   PixelDataDecodeError, iods::image_pixel_module::PhotometricInterpretation,
 };
 
+use super::probe::is_high_throughput_cap;
+
 /// Returns the photometric interpretation used by decoded JPEG 2000 pixel data.
 ///
 pub fn decode_photometric_interpretation(
@@ -29,3 +31,88 @@ pub fn decode_photometric_interpretation(
     }),
   }
 }
+
+/// Returns whether a JPEG 2000 codestream only uses High-Throughput (HT)
+/// codeblocks, which allows it to be decoded by OpenJPH. This is the case when
+/// its CAP marker segment declares use of JPEG 2000 Part 15 and its Ccap15
+/// value says that all codeblocks are HT codeblocks.
+///
+/// Codestreams stored in the JPEG 2000 Part 1 transfer syntaxes are usually
+/// made of MQ-coded codeblocks, but may use HT codeblocks.
+///
+pub fn is_high_throughput_codestream(data: &[u8]) -> bool {
+  const SOC: u16 = 0xFF4F;
+  const CAP: u16 = 0xFF50;
+  const SOT: u16 = 0xFF90;
+
+  let read_u16 = |offset: usize| -> Option<u16> {
+    Some(u16::from_be_bytes(
+      data.get(offset..offset + 2)?.try_into().ok()?,
+    ))
+  };
+
+  if read_u16(0) != Some(SOC) {
+    return false;
+  }
+
+  // Search the main header for the CAP marker segment
+  let mut offset = 2;
+  while let Some(marker) = read_u16(offset) {
+    if marker == SOT {
+      break;
+    }
+
+    let Some(segment_length) = read_u16(offset + 2) else {
+      break;
+    };
+
+    if marker == CAP {
+      return data
+        .get(offset + 4..offset + 2 + usize::from(segment_length))
+        .is_some_and(is_high_throughput_cap);
+    }
+
+    offset += 2 + usize::from(segment_length);
+  }
+
+  false
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn detect_high_throughput_codestream() {
+    let main_header = |cap: &[u8]| {
+      let mut data = vec![0xFF, 0x4F];
+
+      // Empty COM marker segment
+      data.extend_from_slice(&[0xFF, 0x64, 0x00, 0x04, 0x00, 0x01]);
+      data.extend_from_slice(cap);
+      data.extend_from_slice(&[0xFF, 0x90]);
+
+      data
+    };
+
+    // HT-only codeblocks
+    assert!(is_high_throughput_codestream(&main_header(&[
+      0xFF, 0x50, 0x00, 0x08, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00
+    ])));
+
+    // Mixed HT and MQ codeblocks
+    assert!(!is_high_throughput_codestream(&main_header(&[
+      0xFF, 0x50, 0x00, 0x08, 0x00, 0x02, 0x00, 0x00, 0xC0, 0x00
+    ])));
+
+    // Part 2 capabilities declared before Part 15
+    assert!(is_high_throughput_codestream(&main_header(&[
+      0xFF, 0x50, 0x00, 0x0A, 0x40, 0x02, 0x00, 0x00, 0x12, 0x34, 0x00, 0x00
+    ])));
+
+    // No CAP marker segment
+    assert!(!is_high_throughput_codestream(&main_header(&[])));
+
+    assert!(!is_high_throughput_codestream(&[]));
+  }
+}
@@ -0,0 +1,414 @@
+//! Index of the tile-parts in a JPEG 2000 codestream, used to avoid passing
+//! data to a decoder that it won't use when decoding a reduced resolution or a
+//! region of a frame.
+
+#[cfg(not(feature = "std"))]
+use alloc::{vec, vec::Vec};
+
+const SOC: u16 = 0xFF4F;
+const SOT: u16 = 0xFF90;
+const SIZ: u16 = 0xFF51;
+const COD: u16 = 0xFF52;
+const COC: u16 = 0xFF53;
+const TLM: u16 = 0xFF55;
+const PPM: u16 = 0xFF60;
+const EOC: u16 = 0xFFD9;
+
+/// Progression orders where all of a tile's data for one resolution level
+/// comes before the data for the next resolution level.
+const PROGRESSION_ORDER_RLCP: u8 = 1;
+const PROGRESSION_ORDER_RPCL: u8 = 2;
+
+/// The location of a single tile-part in a JPEG 2000 codestream.
+///
+#[derive(Clone, Copy, Debug, PartialEq)]
+struct TilePart {
+  tile_index: u16,
+  tile_part_index: u8,
+  offset: usize,
+  length: usize,
+}
+
+/// Index of the tile-parts in a JPEG 2000 codestream. The index is built from
+/// the codestream's TLM marker segments when they're present, and otherwise by
+/// stepping through the SOT marker segments of its tile-parts.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct Jpeg2000Index {
+  main_header_length: usize,
+  image_offset: (u32, u32),
+  tile_offset: (u32, u32),
+  tile_size: (u32, u32),
+  tiles_across: u32,
+  tile_parts: Vec<TilePart>,
+
+  /// Whether each tile is divided into one tile-part per resolution level, in
+  /// which case tile-part N holds the data for resolution level N.
+  has_resolution_tile_parts: bool,
+
+  /// The number of wavelet decompositions, i.e. one less than the number of
+  /// resolution levels.
+  decomposition_count: u8,
+}
+
+impl Jpeg2000Index {
+  /// Builds the index for a JPEG 2000 codestream. Returns `None` if the
+  /// codestream is malformed or uses features that prevent tile-parts from
+  /// being selected independently.
+  ///
+  pub fn new(data: &[u8]) -> Option<Self> {
+    if read_u16(data, 0)? != SOC {
+      return None;
+    }
+
+    let mut image_offset = None;
+    let mut tile_offset = (0, 0);
+    let mut tile_size = (0, 0);
+    let mut tiles_across = 0;
+    let mut progression_order = None;
+    let mut decomposition_count = 0;
+    let mut has_coc = false;
+    let mut tlm_lengths: Option<Vec<(Option<u16>, usize)>> = None;
+
+    // Read the main header's marker segments
+    let mut offset = 2;
+    loop {
+      let marker = read_u16(data, offset)?;
+      if marker == SOT {
+        break;
+      }
+
+      let segment_length = usize::from(read_u16(data, offset + 2)?);
+      let segment = data.get(offset + 4..offset + 2 + segment_length)?;
+
+      match marker {
+        SIZ => {
+          let image_extent = (read_u32(segment, 2)?, read_u32(segment, 6)?);
+          image_offset = Some((read_u32(segment, 10)?, read_u32(segment, 14)?));
+          tile_size = (read_u32(segment, 18)?, read_u32(segment, 22)?);
+          tile_offset = (read_u32(segment, 26)?, read_u32(segment, 30)?);
+
+          if tile_size.0 == 0 || tile_size.1 == 0 {
+            return None;
+          }
+
+          tiles_across =
+            (image_extent.0.checked_sub(tile_offset.0)?).div_ceil(tile_size.0);
+        }
+
+        COD => {
+          progression_order = Some(*segment.get(1)?);
+          decomposition_count = *segment.get(5)?;
+        }
+
+        COC => has_coc = true,
+
+        TLM => {
+          let stlm = *segment.get(1)?;
+          let tile_index_size = usize::from((stlm >> 4) & 0x3);
+          let length_size = if stlm & 0x40 == 0 { 2 } else { 4 };
+
+          let lengths = tlm_lengths.get_or_insert_with(Vec::new);
+
+          let mut entries = segment.get(2..)?;
+          while !entries.is_empty() {
+            let tile_index = match tile_index_size {
+              0 => None,
+              1 => Some(u16::from(*entries.first()?)),
+              2 => Some(read_u16(entries, 0)?),
+              _ => return None,
+            };
+
+            let length = if length_size == 2 {
+              usize::from(read_u16(entries, tile_index_size)?)
+            } else {
+              read_u32(entries, tile_index_size)? as usize
+            };
+
+            lengths.push((tile_index, length));
+            entries = entries.get(tile_index_size + length_size..)?;
+          }
+        }
+
+        // Packed packet headers in the main header are shared by all
+        // tile-parts, so tile-parts can't be left out
+        PPM => return None,
+
+        _ => (),
+      }
+
+      offset += 2 + segment_length;
+    }
+
+    let main_header_length = offset;
+
+    // Locate the tile-parts, using the TLM marker segments if present
+    let mut tile_parts = vec![];
+    let mut tlm_lengths = tlm_lengths.unwrap_or_default().into_iter();
+    while read_u16(data, offset)? == SOT {
+      let tile_index = read_u16(data, offset + 4)?;
+      let tile_part_index = *data.get(offset + 10)?;
+
+      let length = match tlm_lengths.next() {
+        Some((tlm_tile_index, length)) => {
+          if tlm_tile_index.is_some_and(|i| i != tile_index) {
+            return None;
+          }
+
+          length
+        }
+
+        None => match read_u32(data, offset + 6)? as usize {
+          0 => data.len().checked_sub(offset + 2)?,
+          length => length,
+        },
+      };
+
+      if length < 14 || offset + length > data.len() {
+        return None;
+      }
+
+      tile_parts.push(TilePart {
+        tile_index,
+        tile_part_index,
+        offset,
+        length,
+      });
+
+      offset += length;
+    }
+
+    if read_u16(data, offset)? != EOC {
+      return None;
+    }
+
+    // Tile-parts hold a single resolution level each when every tile has one
+    // tile-part per resolution level, a resolution-major progression order is
+    // used, and there are no COC markers that could give components different
+    // numbers of resolution levels
+    let has_resolution_tile_parts = !has_coc
+      && matches!(
+        progression_order,
+        Some(PROGRESSION_ORDER_RLCP | PROGRESSION_ORDER_RPCL)
+      )
+      && tile_parts.iter().all(|tile_part| {
+        data[tile_part.offset + 11] == decomposition_count + 1
+      });
+
+    Some(Self {
+      main_header_length,
+      image_offset: image_offset?,
+      tile_offset,
+      tile_size,
+      tiles_across,
+      tile_parts,
+      has_resolution_tile_parts,
+      decomposition_count,
+    })
+  }
+
+  /// Returns a copy of the codestream that only has the tile-parts needed to
+  /// decode the given area of the image at the given resolution reduction. The
+  /// area is in full resolution image coordinates, and is specified as
+  /// `(left, top, right, bottom)` with the right and bottom edges exclusive.
+  ///
+  /// Tiles that don't intersect the area are left out, and when tiles are
+  /// divided into one tile-part per resolution level the tile-parts for the
+  /// resolution levels that aren't decoded are left out too. TLM markers are
+  /// removed from the returned codestream as they no longer apply.
+  ///
+  /// Returns `None` if all of the tile-parts are needed.
+  ///
+  pub fn select(
+    &self,
+    data: &[u8],
+    area: (u32, u32, u32, u32),
+    resolution_reduction: u32,
+  ) -> Option<Vec<u8>> {
+    // Determine the last tile-part needed for each tile
+    let last_tile_part_index = if self.has_resolution_tile_parts {
+      u32::from(self.decomposition_count).saturating_sub(resolution_reduction)
+    } else {
+      u32::from(u8::MAX)
+    };
+
+    // Convert the area to reference grid coordinates
+    let area = (
+      self.image_offset.0.saturating_add(area.0),
+      self.image_offset.1.saturating_add(area.1),
+      self.image_offset.0.saturating_add(area.2),
+      self.image_offset.1.saturating_add(area.3),
+    );
+
+    let is_needed = |tile_part: &TilePart| {
+      let tile_x = u32::from(tile_part.tile_index) % self.tiles_across;
+      let tile_y = u32::from(tile_part.tile_index) / self.tiles_across;
+
+      let tile_left = self.tile_offset.0 + tile_x * self.tile_size.0;
+      let tile_top = self.tile_offset.1 + tile_y * self.tile_size.1;
+
+      u32::from(tile_part.tile_part_index) <= last_tile_part_index
+        && tile_left < area.2
+        && tile_left.saturating_add(self.tile_size.0) > area.0
+        && tile_top < area.3
+        && tile_top.saturating_add(self.tile_size.1) > area.1
+    };
+
+    if self.tile_parts.iter().all(is_needed) {
+      return None;
+    }
+
+    let mut output = Vec::with_capacity(data.len());
+
+    // Copy the main header without its TLM marker segments
+    let mut offset = 2;
+    output.extend_from_slice(&data[0..2]);
+    while offset < self.main_header_length {
+      let segment_length = usize::from(read_u16(data, offset + 2)?) + 2;
+
+      if read_u16(data, offset)? != TLM {
+        output.extend_from_slice(&data[offset..offset + segment_length]);
+      }
+
+      offset += segment_length;
+    }
+
+    // Copy the needed tile-parts, updating the number of tile-parts in each
+    // tile when later tile-parts have been left out
+    for tile_part in self.tile_parts.iter().filter(|t| is_needed(t)) {
+      let start = output.len();
+      output.extend_from_slice(
+        &data[tile_part.offset..tile_part.offset + tile_part.length],
+      );
+
+      if self.has_resolution_tile_parts {
+        let tile_part_count = output[start + 11];
+        output[start + 11] =
+          tile_part_count.min(last_tile_part_index as u8 + 1);
+      }
+    }
+
+    output.extend_from_slice(&EOC.to_be_bytes());
+
+    Some(output)
+  }
+}
+
+fn read_u16(data: &[u8], offset: usize) -> Option<u16> {
+  Some(u16::from_be_bytes(
+    data.get(offset..offset + 2)?.try_into().ok()?,
+  ))
+}
+
+fn read_u32(data: &[u8], offset: usize) -> Option<u32> {
+  Some(u32::from_be_bytes(
+    data.get(offset..offset + 4)?.try_into().ok()?,
+  ))
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  /// Builds a codestream for a 64x32 image made of two 32x32 tiles that each
+  /// have one tile-part per resolution level. The payload of each tile-part is
+  /// a single byte holding its tile and tile-part index.
+  ///
+  fn create_codestream(include_tlm: bool) -> Vec<u8> {
+    let mut data = vec![];
+    data.extend_from_slice(&SOC.to_be_bytes());
+
+    // SIZ, with one component
+    data.extend_from_slice(&SIZ.to_be_bytes());
+    data.extend_from_slice(&41u16.to_be_bytes());
+    data.extend_from_slice(&0u16.to_be_bytes());
+    for value in [64u32, 32, 0, 0, 32, 32, 0, 0] {
+      data.extend_from_slice(&value.to_be_bytes());
+    }
+    data.extend_from_slice(&[0, 1, 0x07, 1, 1]);
+
+    // COD, with RPCL progression and one decomposition
+    data.extend_from_slice(&COD.to_be_bytes());
+    data.extend_from_slice(&12u16.to_be_bytes());
+    data.extend_from_slice(&[
+      0,
+      PROGRESSION_ORDER_RPCL,
+      0,
+      1,
+      0,
+      1,
+      4,
+      4,
+      0,
+      0,
+    ]);
+
+    let tile_parts = [(0u16, 0u8), (0, 1), (1, 0), (1, 1)];
+
+    if include_tlm {
+      data.extend_from_slice(&TLM.to_be_bytes());
+      data.extend_from_slice(&(4u16 + 4 * 4).to_be_bytes());
+      data.extend_from_slice(&[0, 0x20]);
+      for (tile_index, _) in tile_parts {
+        data.extend_from_slice(&tile_index.to_be_bytes());
+        data.extend_from_slice(&15u16.to_be_bytes());
+      }
+    }
+
+    for (tile_index, tile_part_index) in tile_parts {
+      data.extend_from_slice(&SOT.to_be_bytes());
+      data.extend_from_slice(&10u16.to_be_bytes());
+      data.extend_from_slice(&tile_index.to_be_bytes());
+      data.extend_from_slice(&15u32.to_be_bytes());
+      data.extend_from_slice(&[tile_part_index, 2, 0xFF, 0x93]);
+      data.push((tile_index as u8) << 4 | tile_part_index);
+    }
+
+    data.extend_from_slice(&EOC.to_be_bytes());
+
+    data
+  }
+
+  /// Returns the payload bytes of the tile-parts in a codestream created by
+  /// [`create_codestream()`], along with their TNsot values.
+  ///
+  fn tile_part_payloads(data: &[u8]) -> Vec<(u8, u8)> {
+    let index = Jpeg2000Index::new(data).unwrap();
+
+    index
+      .tile_parts
+      .iter()
+      .map(|t| (data[t.offset + t.length - 1], data[t.offset + 11]))
+      .collect()
+  }
+
+  #[test]
+  fn select_tile_parts() {
+    for include_tlm in [false, true] {
+      let data = create_codestream(include_tlm);
+
+      let index = Jpeg2000Index::new(&data).unwrap();
+      assert!(index.has_resolution_tile_parts);
+      assert_eq!(index.tile_parts.len(), 4);
+
+      // The whole image at full resolution needs everything
+      assert_eq!(index.select(&data, (0, 0, 64, 32), 0), None);
+
+      // An area inside the second tile only needs that tile
+      let selected = index.select(&data, (40, 8, 50, 16), 0).unwrap();
+      assert_eq!(tile_part_payloads(&selected), vec![(0x10, 2), (0x11, 2)]);
+
+      // A resolution reduction of one only needs the first tile-parts
+      let selected = index.select(&data, (0, 0, 64, 32), 1).unwrap();
+      assert_eq!(tile_part_payloads(&selected), vec![(0x00, 1), (0x10, 1)]);
+    }
+  }
+
+  #[test]
+  fn reject_malformed_codestream() {
+    let data = create_codestream(true);
+
+    assert_eq!(Jpeg2000Index::new(&data[1..]), None);
+    assert_eq!(Jpeg2000Index::new(&data[..data.len() - 2]), None);
+  }
+}
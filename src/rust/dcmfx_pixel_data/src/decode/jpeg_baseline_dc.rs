@@ -0,0 +1,784 @@
+//! Decoding of only the DC coefficients of JPEG Baseline 8-bit pixel data,
+//! which gives a 1:8 scale image for a small fraction of the cost of a full
+//! decode. This is used when rendering thumbnails.
+//!
+//! The AC coefficients still have to be Huffman decoded to find where each
+//! block ends, but they aren't dequantized and no IDCT or upsampling is done.
+
+#[cfg(not(feature = "std"))]
+use alloc::{string::ToString, vec, vec::Vec};
+
+use crate::{
+  ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError,
+  iods::image_pixel_module::{
+    BitsAllocated, ImagePixelModule, PhotometricInterpretation,
+    PixelRepresentation,
+  },
+};
+
+const SOI: u8 = 0xD8;
+const SOS: u8 = 0xDA;
+const DQT: u8 = 0xDB;
+const DHT: u8 = 0xC4;
+const DRI: u8 = 0xDD;
+const APP14: u8 = 0xEE;
+const RST0: u8 = 0xD0;
+const RST7: u8 = 0xD7;
+
+/// Huffman coded SOF markers for the sequential process.
+const SOF_BASELINE: u8 = 0xC0;
+const SOF_EXTENDED: u8 = 0xC1;
+
+/// The number of bits looked up in a single step when decoding a Huffman code.
+/// Longer codes are decoded one bit length at a time.
+const HUFFMAN_LOOKUP_BITS: u32 = 9;
+
+/// Decodes the DC coefficients of monochrome JPEG Baseline 8-bit pixel data
+/// into a 1:8 scale [`MonochromeImage`].
+///
+/// Returns `None` if the data can't be decoded this way, e.g. because it's
+/// progressive or isn't a single scan, in which case it needs to be decoded in
+/// full.
+///
+pub fn decode_monochrome(
+  image_pixel_module: &ImagePixelModule,
+  data: &[u8],
+) -> Option<Result<MonochromeImage, PixelDataDecodeError>> {
+  if !matches!(
+    (
+      image_pixel_module.photometric_interpretation(),
+      image_pixel_module.bits_allocated(),
+    ),
+    (
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      } | PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      BitsAllocated::Eight,
+    )
+  ) {
+    return None;
+  }
+
+  let jpeg = DcJpeg::new(data, image_pixel_module)?;
+  if jpeg.components.len() != 1 {
+    return None;
+  }
+
+  Some(jpeg.decode().and_then(|(width, height, pixels)| {
+    MonochromeImage::new_u8(
+      width,
+      height,
+      pixels,
+      image_pixel_module.bits_stored(),
+      image_pixel_module
+        .photometric_interpretation()
+        .is_monochrome1(),
+    )
+    .map_err(PixelDataDecodeError::ImageCreationFailed)
+  }))
+}
+
+/// Decodes the DC coefficients of color JPEG Baseline 8-bit pixel data into a
+/// 1:8 scale [`ColorImage`]. See [`decode_monochrome()`] for details.
+///
+pub fn decode_color(
+  image_pixel_module: &ImagePixelModule,
+  data: &[u8],
+) -> Option<Result<ColorImage, PixelDataDecodeError>> {
+  if !matches!(
+    (
+      image_pixel_module.photometric_interpretation(),
+      image_pixel_module.bits_allocated(),
+    ),
+    (
+      PhotometricInterpretation::Rgb | PhotometricInterpretation::YbrFull422,
+      BitsAllocated::Eight,
+    )
+  ) {
+    return None;
+  }
+
+  let jpeg = DcJpeg::new(data, image_pixel_module)?;
+  if jpeg.components.len() != 3 {
+    return None;
+  }
+
+  // The color space is taken from the JPEG data in the same way as libjpeg,
+  // because the photometric interpretation isn't always reliable
+  let color_space = if jpeg.is_rgb() {
+    ColorSpace::Rgb
+  } else {
+    ColorSpace::Ybr { is_422: false }
+  };
+
+  Some(jpeg.decode().and_then(|(width, height, pixels)| {
+    ColorImage::new_u8(
+      width,
+      height,
+      pixels,
+      color_space,
+      image_pixel_module.bits_stored(),
+    )
+    .map_err(PixelDataDecodeError::ImageCreationFailed)
+  }))
+}
+
+/// The headers of a sequential JPEG image with a single scan, which are all
+/// that's needed to decode its DC coefficients.
+///
+struct DcJpeg<'a> {
+  width: u16,
+  height: u16,
+  components: Vec<Component>,
+  dc_quantizers: [i32; 4],
+  dc_tables: [Option<HuffmanTable>; 4],
+  ac_tables: [Option<HuffmanTable>; 4],
+  restart_interval: usize,
+  adobe_transform: Option<u8>,
+
+  /// The entropy coded data of the scan, up to the end of the data.
+  scan_data: &'a [u8],
+}
+
+#[derive(Clone, Copy)]
+struct Component {
+  id: u8,
+  h: usize,
+  v: usize,
+  quantizer: usize,
+  dc_table: usize,
+  ac_table: usize,
+}
+
+impl<'a> DcJpeg<'a> {
+  /// Reads the marker segments of a JPEG image up to and including its SOS
+  /// marker segment. Returns `None` if the image is malformed, its dimensions
+  /// don't match the Image Pixel Module, or it uses features that prevent only
+  /// its DC coefficients being decoded in a single pass, i.e. progressive,
+  /// hierarchical, or arithmetic coding, or more than one scan.
+  ///
+  fn new(
+    data: &'a [u8],
+    image_pixel_module: &ImagePixelModule,
+  ) -> Option<Self> {
+    if data.get(0..2)? != [0xFF, SOI] {
+      return None;
+    }
+
+    let mut jpeg = Self {
+      width: 0,
+      height: 0,
+      components: vec![],
+      dc_quantizers: [0; 4],
+      dc_tables: [None, None, None, None],
+      ac_tables: [None, None, None, None],
+      restart_interval: 0,
+      adobe_transform: None,
+      scan_data: &[],
+    };
+
+    let mut offset = 2;
+    loop {
+      let marker = read_marker(data, &mut offset)?;
+
+      // TEM and RSTn markers don't have a marker segment
+      if marker == 0x01 || (RST0..=RST7).contains(&marker) {
+        continue;
+      }
+
+      let segment_length = usize::from(read_u16(data, offset)?);
+      let segment = data.get(offset + 2..offset + segment_length)?;
+      offset += segment_length;
+
+      match marker {
+        SOF_BASELINE | SOF_EXTENDED => jpeg.read_sof(segment)?,
+
+        // Progressive, lossless, hierarchical, and arithmetic coding aren't
+        // supported
+        0xC2 | 0xC3 | 0xC5..=0xC7 | 0xC9..=0xCB | 0xCD..=0xCF => return None,
+
+        DHT => jpeg.read_dht(segment)?,
+        DQT => jpeg.read_dqt(segment)?,
+        DRI => jpeg.restart_interval = usize::from(read_u16(segment, 0)?),
+
+        APP14 if segment.starts_with(b"Adobe") => {
+          jpeg.adobe_transform = Some(*segment.get(11)?);
+        }
+
+        SOS => {
+          jpeg.read_sos(segment)?;
+          jpeg.scan_data = &data[offset..];
+          break;
+        }
+
+        _ => (),
+      }
+    }
+
+    if jpeg.width != image_pixel_module.columns()
+      || jpeg.height != image_pixel_module.rows()
+    {
+      return None;
+    }
+
+    Some(jpeg)
+  }
+
+  fn read_sof(&mut self, segment: &[u8]) -> Option<()> {
+    // Only 8-bit precision is supported, and a height of zero means it's
+    // defined later by a DNL marker segment, which isn't supported
+    if *segment.first()? != 8 {
+      return None;
+    }
+
+    self.height = read_u16(segment, 1)?;
+    self.width = read_u16(segment, 3)?;
+    if self.width == 0 || self.height == 0 {
+      return None;
+    }
+
+    let component_count = usize::from(*segment.get(5)?);
+    if component_count != 1 && component_count != 3 {
+      return None;
+    }
+
+    self.components = (0..component_count)
+      .map(|i| {
+        let bytes = segment.get(6 + i * 3..9 + i * 3)?;
+
+        let h = usize::from(bytes[1] >> 4);
+        let v = usize::from(bytes[1] & 0xF);
+        if !(1..=4).contains(&h) || !(1..=4).contains(&v) || bytes[2] > 3 {
+          return None;
+        }
+
+        Some(Component {
+          id: bytes[0],
+          h,
+          v,
+          quantizer: usize::from(bytes[2]),
+          dc_table: 0,
+          ac_table: 0,
+        })
+      })
+      .collect::<Option<Vec<_>>>()?;
+
+    Some(())
+  }
+
+  fn read_dht(&mut self, mut segment: &[u8]) -> Option<()> {
+    while let Some((&class_and_id, rest)) = segment.split_first() {
+      let counts: &[u8; 16] = rest.get(0..16)?.try_into().ok()?;
+      let symbol_count = counts.iter().map(|c| usize::from(*c)).sum::<usize>();
+      let symbols = rest.get(16..16 + symbol_count)?;
+
+      let table = HuffmanTable::new(counts, symbols)?;
+      let id = usize::from(class_and_id & 0xF);
+      match class_and_id >> 4 {
+        0 => *self.dc_tables.get_mut(id)? = Some(table),
+        1 => *self.ac_tables.get_mut(id)? = Some(table),
+        _ => return None,
+      }
+
+      segment = &rest[16 + symbol_count..];
+    }
+
+    Some(())
+  }
+
+  fn read_dqt(&mut self, mut segment: &[u8]) -> Option<()> {
+    while let Some((&precision_and_id, rest)) = segment.split_first() {
+      let id = usize::from(precision_and_id & 0xF);
+
+      // Only the first value is needed, as it's the DC quantizer
+      let (quantizer, table_length) = match precision_and_id >> 4 {
+        0 => (i32::from(*rest.first()?), 64),
+        1 => (i32::from(read_u16(rest, 0)?), 128),
+        _ => return None,
+      };
+
+      *self.dc_quantizers.get_mut(id)? = quantizer;
+      segment = rest.get(table_length..)?;
+    }
+
+    Some(())
+  }
+
+  fn read_sos(&mut self, segment: &[u8]) -> Option<()> {
+    // All components need to be in this scan, otherwise there are further
+    // scans after it
+    let component_count = usize::from(*segment.first()?);
+    if component_count != self.components.len() {
+      return None;
+    }
+
+    let mut components = Vec::with_capacity(component_count);
+    for i in 0..component_count {
+      let bytes = segment.get(1 + i * 2..3 + i * 2)?;
+
+      let mut component = *self.components.iter().find(|c| c.id == bytes[0])?;
+      component.dc_table = usize::from(bytes[1] >> 4);
+      component.ac_table = usize::from(bytes[1] & 0xF);
+
+      if self.dc_tables.get(component.dc_table)?.is_none()
+        || self.ac_tables.get(component.ac_table)?.is_none()
+      {
+        return None;
+      }
+
+      components.push(component);
+    }
+
+    // Check the spectral selection and successive approximation are those of
+    // a sequential scan
+    if segment.get(1 + component_count * 2..4 + component_count * 2)?
+      != [0, 63, 0]
+    {
+      return None;
+    }
+
+    // Components are decoded in the order they appear in the scan
+    self.components = components;
+
+    Some(())
+  }
+
+  /// Returns whether the components hold RGB rather than YCbCr, using the
+  /// same rules as libjpeg, i.e. an Adobe marker segment with no transform, or
+  /// component IDs of 'R', 'G', and 'B'.
+  ///
+  fn is_rgb(&self) -> bool {
+    match self.adobe_transform {
+      Some(transform) => transform == 0,
+      None => self.components.iter().map(|c| c.id).eq(*b"RGB"),
+    }
+  }
+
+  /// Decodes the DC coefficient of every block in the scan and returns the
+  /// resulting 1:8 scale image's width, height, and interleaved samples.
+  ///
+  fn decode(&self) -> Result<(u16, u16, Vec<u8>), PixelDataDecodeError> {
+    let max_h = self.components.iter().map(|c| c.h).max().unwrap_or(1);
+    let max_v = self.components.iter().map(|c| c.v).max().unwrap_or(1);
+
+    let width = usize::from(self.width);
+    let height = usize::from(self.height);
+
+    // A scan with a single component isn't interleaved and has one block per
+    // MCU, and its blocks only cover the component's own dimensions
+    let (mcus_x, mcus_y, block_layout) = if self.components.len() == 1 {
+      (width.div_ceil(8), height.div_ceil(8), vec![(1, 1)])
+    } else {
+      (
+        width.div_ceil(8 * max_h),
+        height.div_ceil(8 * max_v),
+        self.components.iter().map(|c| (c.h, c.v)).collect(),
+      )
+    };
+
+    // The DC sample of each block, for each component
+    let mut planes: Vec<Vec<u8>> = block_layout
+      .iter()
+      .map(|(h, v)| vec![0; mcus_x * h * mcus_y * v])
+      .collect();
+
+    let mut reader = BitReader::new(self.scan_data);
+    let mut predictors = [0i32; 3];
+
+    let invalid_data = || PixelDataDecodeError::DataInvalid {
+      details: "JPEG entropy coded data is invalid".to_string(),
+    };
+
+    for mcu in 0..mcus_x * mcus_y {
+      if self.restart_interval > 0
+        && mcu > 0
+        && mcu.is_multiple_of(self.restart_interval)
+      {
+        reader.restart();
+        predictors = [0; 3];
+      }
+
+      let (mcu_x, mcu_y) = (mcu % mcus_x, mcu / mcus_x);
+
+      for (i, component) in self.components.iter().enumerate() {
+        let (h, v) = block_layout[i];
+        let stride = mcus_x * h;
+
+        let dc_table = self.dc_tables[component.dc_table].as_ref().unwrap();
+        let ac_table = self.ac_tables[component.ac_table].as_ref().unwrap();
+        let quantizer = self.dc_quantizers[component.quantizer];
+
+        for y in 0..v {
+          for x in 0..h {
+            predictors[i] += reader
+              .decode_block_dc(dc_table, ac_table)
+              .ok_or_else(invalid_data)?;
+
+            // A block with only a DC coefficient is a constant value, which is
+            // the 1x1 IDCT as done by libjpeg's jidctred.c
+            let sample = ((predictors[i] * quantizer + 4) >> 3) + 128;
+
+            planes[i][(mcu_y * v + y) * stride + mcu_x * h + x] =
+              sample.clamp(0, 255) as u8;
+          }
+        }
+      }
+    }
+
+    // Assemble the output image, replicating the samples of subsampled
+    // components
+    let output_width = width.div_ceil(8);
+    let output_height = height.div_ceil(8);
+    let component_count = self.components.len();
+
+    let mut pixels = vec![0; output_width * output_height * component_count];
+
+    for (i, plane) in planes.iter().enumerate() {
+      let (h, v) = block_layout[i];
+      let stride = mcus_x * h;
+      let (scale_h, scale_v) = if component_count == 1 {
+        (1, 1)
+      } else {
+        (max_h, max_v)
+      };
+
+      for y in 0..output_height {
+        let row = &plane[(y * v / scale_v) * stride..];
+        let output_row = &mut pixels[y * output_width * component_count..];
+
+        for x in 0..output_width {
+          output_row[x * component_count + i] = row[x * h / scale_h];
+        }
+      }
+    }
+
+    Ok((output_width as u16, output_height as u16, pixels))
+  }
+}
+
+/// A Huffman table that decodes codes of up to [`HUFFMAN_LOOKUP_BITS`] in a
+/// single lookup, and longer codes using the canonical code ranges of each bit
+/// length as described in ITU T.81 F.2.2.3.
+///
+struct HuffmanTable {
+  /// The code length and symbol for each value of the next
+  /// [`HUFFMAN_LOOKUP_BITS`] bits, packed as `(length << 8) | symbol`. Zero
+  /// means the code is longer than the lookup.
+  lookup: [u16; 1 << HUFFMAN_LOOKUP_BITS],
+
+  /// The largest code of each length, or -1 if there are none.
+  max_codes: [i32; 17],
+
+  /// The offset to add to a code of each length to get its symbol's index.
+  symbol_offsets: [i32; 17],
+
+  symbols: Vec<u8>,
+}
+
+impl HuffmanTable {
+  fn new(counts: &[u8; 16], symbols: &[u8]) -> Option<Self> {
+    let mut table = Self {
+      lookup: [0; 1 << HUFFMAN_LOOKUP_BITS],
+      max_codes: [-1; 17],
+      symbol_offsets: [0; 17],
+      symbols: symbols.to_vec(),
+    };
+
+    let mut code = 0u32;
+    let mut index = 0usize;
+
+    for length in 1..=16 {
+      let count = u32::from(counts[length as usize - 1]);
+
+      table.symbol_offsets[length as usize] = index as i32 - code as i32;
+
+      for _ in 0..count {
+        if length <= HUFFMAN_LOOKUP_BITS {
+          let shift = HUFFMAN_LOOKUP_BITS - length;
+          let entry = ((length as u16) << 8) | u16::from(symbols[index]);
+
+          let start = (code << shift) as usize;
+          table.lookup[start..start + (1 << shift)].fill(entry);
+        }
+
+        code += 1;
+        index += 1;
+      }
+
+      if count > 0 {
+        table.max_codes[length as usize] = code as i32 - 1;
+      }
+
+      // Codes of this length must not run out of bits
+      if code > 1 << length {
+        return None;
+      }
+
+      code <<= 1;
+    }
+
+    Some(table)
+  }
+}
+
+/// Reads bits from entropy coded data, removing stuffed zero bytes. Reaching
+/// a marker or the end of the data gives zero bits.
+///
+struct BitReader<'a> {
+  data: &'a [u8],
+  offset: usize,
+
+  /// Buffered bits, aligned to the most significant bit.
+  bits: u64,
+  bit_count: u32,
+}
+
+impl<'a> BitReader<'a> {
+  fn new(data: &'a [u8]) -> Self {
+    Self {
+      data,
+      offset: 0,
+      bits: 0,
+      bit_count: 0,
+    }
+  }
+
+  fn fill(&mut self) {
+    while self.bit_count <= 56 {
+      let mut byte = 0;
+
+      if let Some(&b) = self.data.get(self.offset) {
+        if b != 0xFF {
+          byte = b;
+          self.offset += 1;
+        } else if self.data.get(self.offset + 1) == Some(&0) {
+          byte = 0xFF;
+          self.offset += 2;
+        }
+      }
+
+      self.bits |= u64::from(byte) << (56 - self.bit_count);
+      self.bit_count += 8;
+    }
+  }
+
+  fn peek(&self, count: u32) -> u32 {
+    (self.bits >> (64 - count)) as u32
+  }
+
+  fn consume(&mut self, count: u32) {
+    self.bits <<= count;
+    self.bit_count -= count;
+  }
+
+  /// Discards the buffered bits and moves past the RSTn marker that ends the
+  /// current restart interval.
+  ///
+  fn restart(&mut self) {
+    self.bits = 0;
+    self.bit_count = 0;
+
+    if self.data.get(self.offset) == Some(&0xFF)
+      && self
+        .data
+        .get(self.offset + 1)
+        .is_some_and(|m| (RST0..=RST7).contains(m))
+    {
+      self.offset += 2;
+    }
+  }
+
+  fn decode_huffman(&mut self, table: &HuffmanTable) -> Option<u8> {
+    self.fill();
+
+    let entry = table.lookup[self.peek(HUFFMAN_LOOKUP_BITS) as usize];
+    if entry != 0 {
+      self.consume(u32::from(entry >> 8));
+      return Some(entry as u8);
+    }
+
+    for length in HUFFMAN_LOOKUP_BITS + 1..=16 {
+      let code = self.peek(length) as i32;
+      if code <= table.max_codes[length as usize] {
+        self.consume(length);
+
+        let index = code + table.symbol_offsets[length as usize];
+        return table.symbols.get(index as usize).copied();
+      }
+    }
+
+    None
+  }
+
+  /// Decodes a block and returns its DC difference. The AC coefficients are
+  /// skipped over without being stored.
+  ///
+  fn decode_block_dc(
+    &mut self,
+    dc_table: &HuffmanTable,
+    ac_table: &HuffmanTable,
+  ) -> Option<i32> {
+    let size = u32::from(self.decode_huffman(dc_table)?);
+    if size > 11 {
+      return None;
+    }
+
+    // At least 41 bits are buffered after decoding a Huffman code, which is
+    // enough for the bits that follow it
+
+    let mut dc_difference = 0;
+    if size > 0 {
+      let value = self.peek(size) as i32;
+      self.consume(size);
+
+      dc_difference = if value < 1 << (size - 1) {
+        value - (1 << size) + 1
+      } else {
+        value
+      };
+    }
+
+    let mut k = 1;
+    while k < 64 {
+      let symbol = self.decode_huffman(ac_table)?;
+      let run = u32::from(symbol >> 4);
+      let size = u32::from(symbol & 0xF);
+
+      if size == 0 {
+        if run != 15 {
+          break;
+        }
+
+        k += 16;
+      } else {
+        self.consume(size);
+
+        k += run + 1;
+      }
+    }
+
+    Some(dc_difference)
+  }
+}
+
+/// Reads the next marker, skipping any fill bytes before it.
+///
+fn read_marker(data: &[u8], offset: &mut usize) -> Option<u8> {
+  if *data.get(*offset)? != 0xFF {
+    return None;
+  }
+
+  while *data.get(*offset)? == 0xFF {
+    *offset += 1;
+  }
+
+  let marker = data[*offset];
+  *offset += 1;
+
+  Some(marker)
+}
+
+fn read_u16(data: &[u8], offset: usize) -> Option<u16> {
+  Some(u16::from_be_bytes(
+    data.get(offset..offset + 2)?.try_into().ok()?,
+  ))
+}
+
+#[cfg(test)]
+mod tests {
+  #[cfg(not(feature = "std"))]
+  use alloc::vec;
+
+  use super::*;
+  use crate::iods::image_pixel_module::SamplesPerPixel;
+
+  /// Builds a JPEG image for a 16x8 single component image, i.e. two blocks.
+  /// The DC Huffman table has the codes '00' for size 0 and '01' for size 4,
+  /// and the AC Huffman table has the single code '0' for EOB. The DC
+  /// quantizer is 2.
+  ///
+  fn create_image(restart_interval: u16, entropy_coded_data: &[u8]) -> Vec<u8> {
+    let mut data = vec![0xFF, SOI];
+
+    // DQT
+    data.extend_from_slice(&[0xFF, DQT, 0, 67, 0]);
+    data.extend_from_slice(&[2; 64]);
+
+    // SOF0, with one component
+    data.extend_from_slice(&[0xFF, SOF_BASELINE, 0, 11, 8, 0, 8, 0, 16, 1]);
+    data.extend_from_slice(&[1, 0x11, 0]);
+
+    // DHT, with DC and AC tables
+    data.extend_from_slice(&[0xFF, DHT, 0, 39, 0x00, 0, 2]);
+    data.extend_from_slice(&[0; 14]);
+    data.extend_from_slice(&[0x00, 0x04, 0x10, 1]);
+    data.extend_from_slice(&[0; 15]);
+    data.push(0x00);
+
+    // DRI
+    if restart_interval > 0 {
+      data.extend_from_slice(&[0xFF, DRI, 0, 4]);
+      data.extend_from_slice(&restart_interval.to_be_bytes());
+    }
+
+    // SOS
+    data.extend_from_slice(&[0xFF, SOS, 0, 8, 1, 1, 0x00, 0, 63, 0]);
+
+    data.extend_from_slice(entropy_coded_data);
+    data.extend_from_slice(&[0xFF, 0xD9]);
+
+    data
+  }
+
+  fn image_pixel_module() -> ImagePixelModule {
+    ImagePixelModule::new_basic(
+      SamplesPerPixel::One,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      8,
+      16,
+      BitsAllocated::Eight,
+      8,
+    )
+    .unwrap()
+  }
+
+  #[test]
+  fn decode_dc_coefficients() {
+    // DC differences of 13 and -13, each followed by EOB
+    let data = create_image(0, &[0b0111_0100, 0b1001_0011]);
+
+    assert_eq!(
+      decode_monochrome(&image_pixel_module(), &data)
+        .unwrap()
+        .unwrap(),
+      MonochromeImage::new_u8(2, 1, vec![131, 128], 8, false).unwrap()
+    );
+  }
+
+  #[test]
+  fn decode_dc_coefficients_with_restart_interval() {
+    // The DC predictor is reset at the start of the second restart interval
+    let data = create_image(1, &[0b0111_0101, 0xFF, RST0, 0b0100_1001]);
+
+    assert_eq!(
+      decode_monochrome(&image_pixel_module(), &data)
+        .unwrap()
+        .unwrap(),
+      MonochromeImage::new_u8(2, 1, vec![131, 125], 8, false).unwrap()
+    );
+  }
+
+  #[test]
+  fn reject_unsupported_image() {
+    let mut data = create_image(0, &[0b0111_0100, 0b1001_0011]);
+
+    // Progressive
+    let sof = data.iter().position(|b| *b == SOF_BASELINE).unwrap();
+    data[sof] = 0xC2;
+    assert!(decode_monochrome(&image_pixel_module(), &data).is_none());
+  }
+}
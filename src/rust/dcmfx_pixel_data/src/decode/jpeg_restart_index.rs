@@ -0,0 +1,384 @@
+//! Index of the restart intervals in a JPEG image, used to decode a frame's
+//! restart intervals concurrently.
+
+#[cfg(not(feature = "std"))]
+use alloc::{vec, vec::Vec};
+
+use core::ops::Range;
+
+const SOI: u8 = 0xD8;
+const EOI: u8 = 0xD9;
+const SOS: u8 = 0xDA;
+const DRI: u8 = 0xDD;
+const RST0: u8 = 0xD0;
+const RST7: u8 = 0xD7;
+
+/// Huffman coded SOF markers for the sequential and lossless processes.
+const SOF_BASELINE: u8 = 0xC0;
+const SOF_EXTENDED: u8 = 0xC1;
+const SOF_LOSSLESS: u8 = 0xC3;
+
+/// Index of the restart intervals in a JPEG image that has a single scan and a
+/// restart interval that spans a whole number of MCU rows, which means each
+/// restart interval decodes to a horizontal stripe of the image that doesn't
+/// depend on any of the other stripes.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct JpegRestartIndex {
+  /// The length of the data up to the end of the SOS marker segment.
+  header_length: usize,
+
+  /// The offset of the number of lines in the SOF marker segment.
+  height_offset: usize,
+
+  width: u16,
+  height: u16,
+  rows_per_interval: usize,
+
+  /// The range of the entropy coded data of each restart interval, which
+  /// excludes the restart markers between them.
+  intervals: Vec<Range<usize>>,
+}
+
+impl JpegRestartIndex {
+  /// Builds the index for a JPEG image. Returns `None` if the image is
+  /// malformed, doesn't have restart intervals, or uses features that prevent
+  /// its restart intervals from being decoded independently.
+  ///
+  pub fn new(data: &[u8]) -> Option<Self> {
+    if data.get(0..2)? != [0xFF, SOI] {
+      return None;
+    }
+
+    let mut frame = None;
+    let mut restart_interval = 0;
+
+    // Read the marker segments up to and including the SOS marker segment
+    let mut offset = 2;
+    let header_length = loop {
+      let marker = read_marker(data, &mut offset)?;
+      let segment_length = usize::from(read_u16(data, offset)?);
+      let segment = data.get(offset + 2..offset + segment_length)?;
+
+      match marker {
+        SOF_BASELINE | SOF_EXTENDED | SOF_LOSSLESS => {
+          frame = Some((offset + 3, Frame::new(segment, marker)?));
+        }
+
+        // Progressive, hierarchical, and arithmetic coding aren't supported
+        0xC2 | 0xC5..=0xC7 | 0xC9..=0xCB | 0xCD..=0xCF => return None,
+
+        DRI => restart_interval = usize::from(read_u16(segment, 0)?),
+
+        SOS => {
+          // All components need to be in this scan, otherwise there are
+          // further scans after it
+          let (_, frame) = frame.as_ref()?;
+          if usize::from(*segment.first()?) != frame.components.len() {
+            return None;
+          }
+
+          break offset + segment_length;
+        }
+
+        _ => (),
+      }
+
+      offset += segment_length;
+    };
+
+    let (height_offset, frame) = frame?;
+    let rows_per_interval = frame.rows_per_interval(restart_interval)?;
+
+    // Locate the restart markers in the entropy coded data, which must be in
+    // sequence and be followed by the EOI marker
+    let mut intervals = vec![];
+    let mut interval_start = header_length;
+    let mut offset = header_length;
+    loop {
+      offset += data.get(offset..)?.iter().position(|b| *b == 0xFF)?;
+      let marker_start = offset;
+
+      let marker = read_marker(data, &mut offset)?;
+      match marker {
+        0x00 => (),
+
+        RST0..=RST7 => {
+          if marker - RST0 != (intervals.len() % 8) as u8 {
+            return None;
+          }
+
+          intervals.push(interval_start..marker_start);
+          interval_start = offset;
+        }
+
+        EOI => {
+          intervals.push(interval_start..marker_start);
+          break;
+        }
+
+        _ => return None,
+      }
+    }
+
+    if intervals.len() != usize::from(frame.height).div_ceil(rows_per_interval)
+    {
+      return None;
+    }
+
+    Some(Self {
+      header_length,
+      height_offset,
+      width: frame.width,
+      height: frame.height,
+      rows_per_interval,
+      intervals,
+    })
+  }
+
+  /// Returns the width of the image.
+  ///
+  pub fn width(&self) -> u16 {
+    self.width
+  }
+
+  /// Returns the height of the image.
+  ///
+  pub fn height(&self) -> u16 {
+    self.height
+  }
+
+  /// Returns the number of rows of the image in each restart interval. The
+  /// last restart interval may have fewer rows.
+  ///
+  pub fn rows_per_interval(&self) -> usize {
+    self.rows_per_interval
+  }
+
+  /// Returns the number of restart intervals in the image.
+  ///
+  pub fn interval_count(&self) -> usize {
+    self.intervals.len()
+  }
+
+  /// Returns a complete JPEG image made from a run of consecutive restart
+  /// intervals, which decodes to the rows of the image that they cover. The
+  /// frame's height is changed to the number of rows in the restart
+  /// intervals, and they are renumbered to start from the first restart
+  /// marker.
+  ///
+  pub fn stripe(&self, data: &[u8], intervals: Range<usize>) -> Vec<u8> {
+    let first_row = intervals.start * self.rows_per_interval;
+    let row_count = (intervals.len() * self.rows_per_interval)
+      .min(usize::from(self.height) - first_row);
+
+    let entropy_coded_data_length: usize = self.intervals[intervals.clone()]
+      .iter()
+      .map(|i| i.len())
+      .sum();
+
+    let mut stripe = Vec::with_capacity(
+      self.header_length + entropy_coded_data_length + intervals.len() * 2 + 2,
+    );
+
+    stripe.extend_from_slice(&data[0..self.header_length]);
+    stripe[self.height_offset..self.height_offset + 2]
+      .copy_from_slice(&(row_count as u16).to_be_bytes());
+
+    for (i, interval) in self.intervals[intervals].iter().enumerate() {
+      if i > 0 {
+        stripe.extend_from_slice(&[0xFF, RST0 + ((i - 1) % 8) as u8]);
+      }
+
+      stripe.extend_from_slice(&data[interval.clone()]);
+    }
+
+    stripe.extend_from_slice(&[0xFF, EOI]);
+
+    stripe
+  }
+}
+
+/// The details of a frame read from its SOF marker segment.
+///
+struct Frame {
+  is_lossless: bool,
+  width: u16,
+  height: u16,
+
+  /// The horizontal and vertical sampling factors of each component.
+  components: Vec<(u8, u8)>,
+}
+
+impl Frame {
+  fn new(segment: &[u8], marker: u8) -> Option<Self> {
+    let height = read_u16(segment, 1)?;
+    let width = read_u16(segment, 3)?;
+    let component_count = usize::from(*segment.get(5)?);
+
+    // A height of zero means it's set by a DNL marker after the scan
+    if width == 0 || height == 0 || component_count == 0 {
+      return None;
+    }
+
+    let components = segment
+      .get(6..6 + component_count * 3)?
+      .chunks_exact(3)
+      .map(|c| (c[1] >> 4, c[1] & 0xF))
+      .collect();
+
+    Some(Self {
+      is_lossless: marker == SOF_LOSSLESS,
+      width,
+      height,
+      components,
+    })
+  }
+
+  /// Returns the number of rows of the image in each restart interval, or
+  /// `None` if restart intervals don't span a whole number of MCU rows.
+  ///
+  fn rows_per_interval(&self, restart_interval: usize) -> Option<usize> {
+    if restart_interval == 0 {
+      return None;
+    }
+
+    let data_unit_size = if self.is_lossless { 1 } else { 8 };
+
+    // A scan with a single component has one data unit in each MCU regardless
+    // of its sampling factors
+    let (mcu_width, mcu_height) = if self.components.len() == 1 {
+      (data_unit_size, data_unit_size)
+    } else {
+      let max_h = self.components.iter().map(|c| c.0).max()?;
+      let max_v = self.components.iter().map(|c| c.1).max()?;
+
+      // Vertically subsampled components are upsampled using the rows either
+      // side of each row, which crosses into neighboring restart intervals
+      if self.components.iter().any(|c| c.1 != max_v) {
+        return None;
+      }
+
+      (
+        usize::from(max_h) * data_unit_size,
+        usize::from(max_v) * data_unit_size,
+      )
+    };
+
+    if mcu_width == 0 || mcu_height == 0 {
+      return None;
+    }
+
+    let mcus_per_row = usize::from(self.width).div_ceil(mcu_width);
+    if !restart_interval.is_multiple_of(mcus_per_row) {
+      return None;
+    }
+
+    Some(restart_interval / mcus_per_row * mcu_height)
+  }
+}
+
+/// Reads the marker at the given offset, skipping any fill bytes before it,
+/// and moves the offset past it.
+///
+fn read_marker(data: &[u8], offset: &mut usize) -> Option<u8> {
+  if *data.get(*offset)? != 0xFF {
+    return None;
+  }
+
+  loop {
+    *offset += 1;
+
+    let marker = *data.get(*offset)?;
+    if marker != 0xFF {
+      *offset += 1;
+      return Some(marker);
+    }
+  }
+}
+
+fn read_u16(data: &[u8], offset: usize) -> Option<u16> {
+  Some(u16::from_be_bytes(
+    data.get(offset..offset + 2)?.try_into().ok()?,
+  ))
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  /// Builds a JPEG image for a 16x20 single component image with a restart
+  /// interval of two MCUs, i.e. one MCU row. The entropy coded data of each
+  /// restart interval is a single byte holding its index, followed by a
+  /// stuffed 0xFF byte.
+  ///
+  fn create_image() -> Vec<u8> {
+    let mut data = vec![0xFF, SOI];
+
+    // SOF1, with one component
+    data.extend_from_slice(&[0xFF, SOF_EXTENDED, 0, 11, 12]);
+    data.extend_from_slice(&20u16.to_be_bytes());
+    data.extend_from_slice(&16u16.to_be_bytes());
+    data.extend_from_slice(&[1, 1, 0x11, 0]);
+
+    // DRI
+    data.extend_from_slice(&[0xFF, DRI, 0, 4, 0, 2]);
+
+    // SOS
+    data.extend_from_slice(&[0xFF, SOS, 0, 8, 1, 1, 0, 0, 63, 0]);
+
+    for i in 0..3u8 {
+      if i > 0 {
+        data.extend_from_slice(&[0xFF, RST0 + i - 1]);
+      }
+
+      data.extend_from_slice(&[i, 0xFF, 0x00]);
+    }
+
+    data.extend_from_slice(&[0xFF, EOI]);
+
+    data
+  }
+
+  #[test]
+  fn index_restart_intervals() {
+    let data = create_image();
+
+    let index = JpegRestartIndex::new(&data).unwrap();
+    assert_eq!(index.width(), 16);
+    assert_eq!(index.height(), 20);
+    assert_eq!(index.rows_per_interval(), 8);
+    assert_eq!(index.interval_count(), 3);
+
+    // The whole image is unchanged
+    assert_eq!(index.stripe(&data, 0..3), data);
+
+    // A stripe of the last two restart intervals has the rows they cover,
+    // and its restart markers are renumbered
+    let stripe = index.stripe(&data, 1..3);
+    assert_eq!(&stripe[7..9], &12u16.to_be_bytes());
+    assert_eq!(
+      &stripe[index.header_length..],
+      &[1, 0xFF, 0x00, 0xFF, RST0, 2, 0xFF, 0x00, 0xFF, EOI]
+    );
+  }
+
+  #[test]
+  fn reject_unsupported_image() {
+    let data = create_image();
+
+    // Restart markers out of sequence
+    let mut invalid = data.clone();
+    let rst = invalid.len() - 6;
+    invalid[rst] = RST0 + 3;
+    assert_eq!(JpegRestartIndex::new(&invalid), None);
+
+    // Restart interval that doesn't span whole MCU rows
+    let mut invalid = data.clone();
+    invalid[20] = 3;
+    assert_eq!(JpegRestartIndex::new(&invalid), None);
+
+    // Missing EOI marker
+    assert_eq!(JpegRestartIndex::new(&data[..data.len() - 2]), None);
+  }
+}
@@ -5,6 +5,7 @@ use jxl_oxide::{FrameBufferSample, JxlImage, Render, image::BitDepth};
 
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError,
+  frame_buffer_pool,
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
     PixelRepresentation,
@@ -41,8 +42,9 @@ pub fn decode_monochrome(
       BitsAllocated::Eight,
       BitDepth::IntegerSample { bits_per_sample },
     ) if bits_per_sample <= 8 => {
-      let mut buffer = vec![0u8; image_pixel_module.pixel_count()];
-      render_samples(&jxl_render, &mut buffer)?;
+      let mut buffer =
+        frame_buffer_pool::zeroed_vec(image_pixel_module.pixel_count());
+      render_integer_samples(&jxl_render, &mut buffer, bits_per_sample)?;
 
       MonochromeImage::new_u8(
         width,
@@ -63,8 +65,9 @@ pub fn decode_monochrome(
       BitsAllocated::Sixteen,
       BitDepth::IntegerSample { bits_per_sample },
     ) if bits_per_sample <= 16 => {
-      let mut buffer = vec![0u16; image_pixel_module.pixel_count()];
-      render_samples(&jxl_render, &mut buffer)?;
+      let mut buffer =
+        frame_buffer_pool::zeroed_vec(image_pixel_module.pixel_count());
+      render_integer_samples(&jxl_render, &mut buffer, bits_per_sample)?;
 
       MonochromeImage::new_u16(
         width,
@@ -112,10 +115,11 @@ pub fn decode_color(
       | PhotometricInterpretation::YbrRct
       | PhotometricInterpretation::Xyb,
       BitsAllocated::Eight,
-      BitDepth::IntegerSample { bits_per_sample: 8 },
-    ) => {
-      let mut buffer = vec![0u8; image_pixel_module.pixel_count() * 3];
-      render_samples(&jxl_render, &mut buffer)?;
+      BitDepth::IntegerSample { bits_per_sample },
+    ) if bits_per_sample <= 8 => {
+      let mut buffer =
+        frame_buffer_pool::zeroed_vec(image_pixel_module.pixel_count() * 3);
+      render_integer_samples(&jxl_render, &mut buffer, bits_per_sample)?;
 
       ColorImage::new_u8(width, height, buffer, ColorSpace::Rgb, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
@@ -127,12 +131,11 @@ pub fn decode_color(
       | PhotometricInterpretation::YbrRct
       | PhotometricInterpretation::Xyb,
       BitsAllocated::Sixteen,
-      BitDepth::IntegerSample {
-        bits_per_sample: 16,
-      },
-    ) => {
-      let mut buffer = vec![0u16; image_pixel_module.pixel_count() * 3];
-      render_samples(&jxl_render, &mut buffer)?;
+      BitDepth::IntegerSample { bits_per_sample },
+    ) if bits_per_sample <= 16 => {
+      let mut buffer =
+        frame_buffer_pool::zeroed_vec(image_pixel_module.pixel_count() * 3);
+      render_integer_samples(&jxl_render, &mut buffer, bits_per_sample)?;
 
       ColorImage::new_u16(width, height, buffer, ColorSpace::Rgb, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
@@ -193,6 +196,56 @@ fn decode(
   Ok((image, render))
 }
 
+/// Renders integer samples that have the passed bit depth. Samples that fill
+/// the output sample type are rendered directly. Samples with fewer bits, e.g.
+/// 12-bit data encoded from 16-bit samples, are rendered as floats normalized
+/// to their bit depth and then scaled back to their original integer values.
+///
+fn render_integer_samples<Sample: FrameBufferSample + IntegerSample>(
+  jxl_render: &Render,
+  buffer: &mut [Sample],
+  bits_per_sample: u32,
+) -> Result<(), PixelDataDecodeError> {
+  if bits_per_sample == Sample::BITS {
+    return render_samples(jxl_render, buffer);
+  }
+
+  let mut samples = vec![0f32; buffer.len()];
+  render_samples(jxl_render, &mut samples)?;
+
+  let max_value = ((1u32 << bits_per_sample) - 1) as f32;
+
+  for (sample, value) in buffer.iter_mut().zip(samples) {
+    *sample = Sample::from_scaled(value.clamp(0.0, 1.0) * max_value + 0.5);
+  }
+
+  Ok(())
+}
+
+/// Integer sample types that [`render_integer_samples()`] can output.
+///
+trait IntegerSample {
+  const BITS: u32;
+
+  fn from_scaled(value: f32) -> Self;
+}
+
+impl IntegerSample for u8 {
+  const BITS: u32 = 8;
+
+  fn from_scaled(value: f32) -> Self {
+    value as u8
+  }
+}
+
+impl IntegerSample for u16 {
+  const BITS: u32 = 16;
+
+  fn from_scaled(value: f32) -> Self {
+    value as u16
+  }
+}
+
 fn render_samples<Sample: FrameBufferSample>(
   jxl_render: &Render,
   buffer: &mut [Sample],
@@ -3,12 +3,19 @@ use alloc::{format, vec, vec::Vec};
 
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError,
+  frame_buffer_pool,
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
     PixelRepresentation,
   },
 };
 
+#[cfg(feature = "std")]
+use std::cell::RefCell;
+
+#[cfg(feature = "std")]
+use super::jpeg_restart_index::JpegRestartIndex;
+
 /// Returns the photometric interpretation used by data decoded using
 /// libjpeg_12bit.
 ///
@@ -31,12 +38,570 @@ pub fn decode_photometric_interpretation(
   }
 }
 
-/// Decodes monochrome pixel data using libjpeg_12bit.
+/// Decodes monochrome pixel data using libjpeg_12bit. The JPEG data is passed
+/// as a list of fragments that are read in turn, so the fragments of
+/// encapsulated pixel data don't need to be combined first.
+///
+/// When the JPEG data has restart intervals that span whole MCU rows, runs of
+/// restart intervals are decoded concurrently on up to `thread_count`
+/// threads. A `thread_count` of zero uses all available CPU cores.
+///
+/// Each level of `resolution_reduction` halves the width and height of the
+/// decoded image, up to a maximum of three levels, i.e. 1:8 scale. Reduced
+/// images are produced by libjpeg's reduced-size IDCTs, which skip most of the
+/// IDCT and upsampling work.
 ///
 pub fn decode_monochrome(
   image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  resolution_reduction: u32,
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  check_monochrome(image_pixel_module)?;
+
+  let scale_denom = scale_denom(resolution_reduction);
+
+  #[cfg(feature = "std")]
+  if let Some(pixels) = decode_restart_intervals(
+    image_pixel_module,
+    fragments,
+    thread_count,
+    scale_denom,
+  )? {
+    return monochrome_image(image_pixel_module, scale_denom, pixels);
+  }
+
+  let mut session = DecodeSession::new(image_pixel_module, scale_denom)?;
+
+  for fragment in fragments {
+    session.push(fragment)?;
+  }
+
+  session.finish_monochrome(image_pixel_module)
+}
+
+/// Decodes color pixel data using libjpeg_12bit. The JPEG data, thread count,
+/// and resolution reduction are handled in the same way as for
+/// [`decode_monochrome()`].
+///
+pub fn decode_color(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  resolution_reduction: u32,
+) -> Result<ColorImage, PixelDataDecodeError> {
+  check_color(image_pixel_module)?;
+
+  let scale_denom = scale_denom(resolution_reduction);
+
+  #[cfg(feature = "std")]
+  if let Some(pixels) = decode_restart_intervals(
+    image_pixel_module,
+    fragments,
+    thread_count,
+    scale_denom,
+  )? {
+    return color_image(image_pixel_module, scale_denom, pixels);
+  }
+
+  let mut session = DecodeSession::new(image_pixel_module, scale_denom)?;
+
+  for fragment in fragments {
+    session.push(fragment)?;
+  }
+
+  session.finish_color(image_pixel_module)
+}
+
+/// A decode of 12-bit JPEG data that is given its data incrementally. Each
+/// piece of data is decoded as soon as it's pushed, and libjpeg_12bit
+/// suspends when it reaches the end of the data pushed so far.
+///
+/// Pushed data is read in place. When libjpeg_12bit suspends, the bytes it
+/// will read again on resuming are copied into the session, so pushed data
+/// doesn't need to outlive the call to [`Self::push()`].
+///
+pub struct DecodeSession {
+  session: *mut core::ffi::c_void,
+  output_buffer: Vec<u16>,
+  scale_denom: usize,
+}
+
+impl DecodeSession {
+  /// Creates a session for decoding monochrome pixel data.
+  ///
+  pub fn new_monochrome(
+    image_pixel_module: &ImagePixelModule,
+  ) -> Result<Self, PixelDataDecodeError> {
+    check_monochrome(image_pixel_module)?;
+
+    Self::new(image_pixel_module, 1)
+  }
+
+  /// Creates a session for decoding color pixel data.
+  ///
+  pub fn new_color(
+    image_pixel_module: &ImagePixelModule,
+  ) -> Result<Self, PixelDataDecodeError> {
+    check_color(image_pixel_module)?;
+
+    Self::new(image_pixel_module, 1)
+  }
+
+  /// Creates a session that decodes at `1 / scale_denom` of the full width and
+  /// height, see [`scale_denom()`].
+  ///
+  fn new(
+    image_pixel_module: &ImagePixelModule,
+    scale_denom: usize,
+  ) -> Result<Self, PixelDataDecodeError> {
+    // Allocate output buffer
+    let (width, height) = scaled_size(image_pixel_module, scale_denom);
+    let mut output_buffer =
+      vec![
+        0u16;
+        usize::from(width)
+          * usize::from(height)
+          * usize::from(u8::from(image_pixel_module.samples_per_pixel()))
+      ];
+
+    let session = create_session(
+      image_pixel_module.columns().into(),
+      image_pixel_module.rows().into(),
+      u8::from(image_pixel_module.samples_per_pixel()).into(),
+      is_ybr_color_space(image_pixel_module),
+      scale_denom,
+      &mut output_buffer,
+    )?;
+
+    Ok(Self {
+      session,
+      output_buffer,
+      scale_denom,
+    })
+  }
+
+  /// Pushes the next piece of JPEG data and decodes as much of it as
+  /// possible.
+  ///
+  pub fn push(&mut self, data: &[u8]) -> Result<(), PixelDataDecodeError> {
+    let mut error_message = [0 as core::ffi::c_char; 200];
+
+    let result = unsafe {
+      ffi::libjpeg_12bit_decode_session_push(
+        self.session,
+        data.as_ptr() as *const core::ffi::c_void,
+        data.len(),
+        error_message.as_mut_ptr(),
+      )
+    };
+
+    check_result(result, &error_message)
+  }
+
+  /// Marks the end of the JPEG data and returns the decoded monochrome image.
+  ///
+  pub fn finish_monochrome(
+    self,
+    image_pixel_module: &ImagePixelModule,
+  ) -> Result<MonochromeImage, PixelDataDecodeError> {
+    let scale_denom = self.scale_denom;
+
+    monochrome_image(image_pixel_module, scale_denom, self.finish()?)
+  }
+
+  /// Marks the end of the JPEG data and returns the decoded color image.
+  ///
+  pub fn finish_color(
+    self,
+    image_pixel_module: &ImagePixelModule,
+  ) -> Result<ColorImage, PixelDataDecodeError> {
+    let scale_denom = self.scale_denom;
+
+    color_image(image_pixel_module, scale_denom, self.finish()?)
+  }
+
+  fn finish(mut self) -> Result<Vec<u16>, PixelDataDecodeError> {
+    let mut error_message = [0 as core::ffi::c_char; 200];
+
+    let result = unsafe {
+      ffi::libjpeg_12bit_decode_session_finish(
+        self.session,
+        error_message.as_mut_ptr(),
+      )
+    };
+
+    check_result(result, &error_message)?;
+
+    Ok(core::mem::take(&mut self.output_buffer))
+  }
+}
+
+impl Drop for DecodeSession {
+  fn drop(&mut self) {
+    release_session(self.session);
+  }
+}
+
+/// A decode session that isn't in use. One is kept per thread so that the
+/// next decode on that thread can reset it rather than create a new one, see
+/// [`create_session()`].
+///
+#[cfg(feature = "std")]
+struct SpareSession(*mut core::ffi::c_void);
+
+#[cfg(feature = "std")]
+impl Drop for SpareSession {
+  fn drop(&mut self) {
+    unsafe { ffi::libjpeg_12bit_decode_session_destroy(self.0) };
+  }
+}
+
+#[cfg(feature = "std")]
+std::thread_local! {
+  static SPARE_SESSION: RefCell<Option<SpareSession>> =
+    const { RefCell::new(None) };
+}
+
+/// Creates a decode session for an image with the given properties that
+/// decodes into the passed output buffer.
+///
+/// If this thread has a spare session then it's reset and used instead. This
+/// keeps libjpeg_12bit's decompress object and its allocations from the
+/// previous frame, and the Huffman tables derived for decoding aren't
+/// recomputed when the new frame defines the same Huffman tables, which the
+/// frames of multi-frame pixel data almost always do.
+///
+fn create_session(
+  width: usize,
+  height: usize,
+  samples_per_pixel: usize,
+  is_ybr_color_space: bool,
+  scale_denom: usize,
+  output_buffer: &mut [u16],
+) -> Result<*mut core::ffi::c_void, PixelDataDecodeError> {
+  let mut error_message = [0 as core::ffi::c_char; 200];
+
+  #[cfg(feature = "std")]
+  if let Some(spare_session) = SPARE_SESSION.with_borrow_mut(Option::take) {
+    let session = core::mem::ManuallyDrop::new(spare_session).0;
+
+    let result = unsafe {
+      ffi::libjpeg_12bit_decode_session_reset(
+        session,
+        width,
+        height,
+        samples_per_pixel,
+        is_ybr_color_space.into(),
+        scale_denom,
+        output_buffer.as_mut_ptr(),
+        output_buffer.len(),
+        error_message.as_mut_ptr(),
+      )
+    };
+
+    if let Err(e) = check_result(result, &error_message) {
+      release_session(session);
+      return Err(e);
+    }
+
+    return Ok(session);
+  }
+
+  let mut session = core::ptr::null_mut();
+
+  let result = unsafe {
+    ffi::libjpeg_12bit_decode_session_create(
+      width,
+      height,
+      samples_per_pixel,
+      is_ybr_color_space.into(),
+      scale_denom,
+      output_buffer.as_mut_ptr(),
+      output_buffer.len(),
+      &mut session,
+      error_message.as_mut_ptr(),
+    )
+  };
+
+  check_result(result, &error_message)?;
+
+  Ok(session)
+}
+
+/// Releases a decode session from [`create_session()`], in any state. It
+/// becomes this thread's spare session if there isn't one already, and is
+/// otherwise destroyed.
+///
+fn release_session(session: *mut core::ffi::c_void) {
+  #[cfg(feature = "std")]
+  {
+    let is_spare = SPARE_SESSION.try_with(|spare_session| {
+      let mut spare_session = spare_session.borrow_mut();
+      if spare_session.is_some() {
+        return false;
+      }
+
+      *spare_session = Some(SpareSession(session));
+      true
+    });
+
+    if let Ok(true) = is_spare {
+      return;
+    }
+  }
+
+  unsafe { ffi::libjpeg_12bit_decode_session_destroy(session) };
+}
+
+/// Decodes JPEG data by splitting its restart intervals into one run of
+/// consecutive restart intervals per thread, each of which is decoded on its
+/// own thread as a separate JPEG image directly into its rows of the output.
+///
+/// Returns `None` if the JPEG data isn't decoded this way, either because only
+/// one thread is to be used or because its restart intervals can't be decoded
+/// independently, in which case it's decoded as a whole instead.
+///
+#[cfg(feature = "std")]
+fn decode_restart_intervals(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  scale_denom: usize,
+) -> Result<Option<Vec<u16>>, PixelDataDecodeError> {
+  let thread_count = if thread_count == 0 {
+    std::thread::available_parallelism().map_or(1, |n| n.get())
+  } else {
+    thread_count
+  };
+
+  if thread_count <= 1 {
+    return Ok(None);
+  }
+
+  let data = match fragments {
+    [fragment] => std::borrow::Cow::Borrowed(*fragment),
+    _ => std::borrow::Cow::Owned(fragments.concat()),
+  };
+
+  let Some(index) = JpegRestartIndex::new(&data) else {
+    return Ok(None);
+  };
+
+  // Leave reporting of an unexpected image size to the full decode
+  if index.width() != image_pixel_module.columns()
+    || index.height() != image_pixel_module.rows()
+  {
+    return Ok(None);
+  }
+
+  let intervals_per_thread = index.interval_count().div_ceil(thread_count);
+  if intervals_per_thread == index.interval_count() {
+    return Ok(None);
+  }
+
+  // Stripes other than the last must scale to a whole number of rows
+  let rows_per_interval = index.rows_per_interval();
+  if rows_per_interval % scale_denom != 0 {
+    return Ok(None);
+  }
+
+  let columns = usize::from(image_pixel_module.columns());
+  let rows = usize::from(image_pixel_module.rows());
+  let samples_per_pixel =
+    usize::from(u8::from(image_pixel_module.samples_per_pixel()));
+  let is_ybr_color_space = is_ybr_color_space(image_pixel_module);
+
+  let (scaled_columns, scaled_rows) =
+    scaled_size(image_pixel_module, scale_denom);
+  let scaled_row_size = usize::from(scaled_columns) * samples_per_pixel;
+
+  let mut output_buffer =
+    frame_buffer_pool::zeroed_vec(usize::from(scaled_rows) * scaled_row_size);
+
+  let stripe_size =
+    intervals_per_thread * rows_per_interval / scale_denom * scaled_row_size;
+
+  let decode_stripe = |i: usize, output: &mut [u16]| {
+    let first_interval = i * intervals_per_thread;
+    let end_interval =
+      (first_interval + intervals_per_thread).min(index.interval_count());
+
+    let stripe = index.stripe(&data, first_interval..end_interval);
+
+    let first_row = first_interval * rows_per_interval;
+    let end_row = (end_interval * rows_per_interval).min(rows);
+
+    decode_into(
+      &stripe,
+      columns,
+      end_row - first_row,
+      samples_per_pixel,
+      is_ybr_color_space,
+      scale_denom,
+      output,
+    )
+  };
+
+  // Decode the first stripe on this thread and the rest on new threads, which
+  // use this thread's cancellation token and memory budget
+  let decode_context = crate::codec_cancellation::CurrentContext::get();
+
+  std::thread::scope(|scope| {
+    let mut stripes = output_buffer.chunks_mut(stripe_size).enumerate();
+    let (_, first_stripe) = stripes.next().unwrap();
+
+    let threads: Vec<_> = stripes
+      .map(|(i, output)| {
+        scope.spawn(move || decode_context.enter(|| decode_stripe(i, output)))
+      })
+      .collect();
+
+    let result = decode_stripe(0, first_stripe);
+
+    threads
+      .into_iter()
+      .map(|thread| thread.join().unwrap())
+      .fold(result, Result::and)
+  })?;
+
+  Ok(Some(output_buffer))
+}
+
+/// Decodes a complete JPEG image into the given output buffer, at
+/// `1 / scale_denom` of its full `width` and `height`.
+///
+#[cfg(feature = "std")]
+fn decode_into(
   data: &[u8],
+  width: usize,
+  height: usize,
+  samples_per_pixel: usize,
+  is_ybr_color_space: bool,
+  scale_denom: usize,
+  output_buffer: &mut [u16],
+) -> Result<(), PixelDataDecodeError> {
+  let session = create_session(
+    width,
+    height,
+    samples_per_pixel,
+    is_ybr_color_space,
+    scale_denom,
+    output_buffer,
+  )?;
+
+  let mut error_message = [0 as core::ffi::c_char; 200];
+
+  let result = unsafe {
+    let mut result = ffi::libjpeg_12bit_decode_session_push(
+      session,
+      data.as_ptr() as *const core::ffi::c_void,
+      data.len(),
+      error_message.as_mut_ptr(),
+    );
+
+    if result == 0 {
+      result = ffi::libjpeg_12bit_decode_session_finish(
+        session,
+        error_message.as_mut_ptr(),
+      );
+    }
+
+    result
+  };
+
+  release_session(session);
+
+  check_result(result, &error_message)
+}
+
+/// Returns whether libjpeg_12bit's output is in the YBR color space for the
+/// given Image Pixel Module.
+///
+fn is_ybr_color_space(image_pixel_module: &ImagePixelModule) -> bool {
+  image_pixel_module
+    .photometric_interpretation()
+    .is_ybr_full()
+    || image_pixel_module
+      .photometric_interpretation()
+      .is_ybr_full_422()
+}
+
+/// Returns the scale denominator that libjpeg_12bit decodes at for a
+/// resolution reduction. libjpeg's reduced-size IDCTs go down to 1:8 scale, so
+/// resolution reductions beyond three levels are decoded at 1:8.
+///
+fn scale_denom(resolution_reduction: u32) -> usize {
+  1 << resolution_reduction.min(3)
+}
+
+/// Returns the width and height of an image decoded at `1 / scale_denom` of
+/// its full size, which libjpeg rounds up.
+///
+fn scaled_size(
+  image_pixel_module: &ImagePixelModule,
+  scale_denom: usize,
+) -> (u16, u16) {
+  let scale = |x: u16| usize::from(x).div_ceil(scale_denom) as u16;
+
+  (
+    scale(image_pixel_module.columns()),
+    scale(image_pixel_module.rows()),
+  )
+}
+
+/// Creates the monochrome image for decoded pixels.
+///
+fn monochrome_image(
+  image_pixel_module: &ImagePixelModule,
+  scale_denom: usize,
+  pixels: Vec<u16>,
 ) -> Result<MonochromeImage, PixelDataDecodeError> {
+  let (width, height) = scaled_size(image_pixel_module, scale_denom);
+
+  MonochromeImage::new_u16(
+    width,
+    height,
+    pixels,
+    image_pixel_module.bits_stored(),
+    image_pixel_module
+      .photometric_interpretation()
+      .is_monochrome1(),
+  )
+  .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Creates the color image for decoded pixels.
+///
+fn color_image(
+  image_pixel_module: &ImagePixelModule,
+  scale_denom: usize,
+  pixels: Vec<u16>,
+) -> Result<ColorImage, PixelDataDecodeError> {
+  let (width, height) = scaled_size(image_pixel_module, scale_denom);
+
+  let color_space = match image_pixel_module.photometric_interpretation() {
+    PhotometricInterpretation::YbrFull => ColorSpace::Ybr { is_422: false },
+    PhotometricInterpretation::YbrFull422 => ColorSpace::Ybr { is_422: true },
+    _ => ColorSpace::Rgb,
+  };
+
+  ColorImage::new_u16(
+    width,
+    height,
+    pixels,
+    color_space,
+    image_pixel_module.bits_stored(),
+  )
+  .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Checks that monochrome pixel data with the given Image Pixel Module can be
+/// decoded using libjpeg_12bit.
+///
+fn check_monochrome(
+  image_pixel_module: &ImagePixelModule,
+) -> Result<(), PixelDataDecodeError> {
   match (
     image_pixel_module.photometric_interpretation(),
     image_pixel_module.bits_allocated(),
@@ -49,19 +614,7 @@ pub fn decode_monochrome(
         pixel_representation: PixelRepresentation::Unsigned,
       },
       BitsAllocated::Sixteen,
-    ) => {
-      let pixels = decode(image_pixel_module, data)?;
-      MonochromeImage::new_u16(
-        image_pixel_module.columns(),
-        image_pixel_module.rows(),
-        pixels,
-        image_pixel_module.bits_stored(),
-        image_pixel_module
-          .photometric_interpretation()
-          .is_monochrome1(),
-      )
-      .map_err(PixelDataDecodeError::ImageCreationFailed)
-    }
+    ) => Ok(()),
 
     (photometric_interpretation, bits_allocated) => {
       Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
@@ -76,12 +629,12 @@ pub fn decode_monochrome(
   }
 }
 
-/// Decodes color pixel data using libjpeg_12bit.
+/// Checks that color pixel data with the given Image Pixel Module can be
+/// decoded using libjpeg_12bit.
 ///
-pub fn decode_color(
+fn check_color(
   image_pixel_module: &ImagePixelModule,
-  data: &[u8],
-) -> Result<ColorImage, PixelDataDecodeError> {
+) -> Result<(), PixelDataDecodeError> {
   match (
     image_pixel_module.photometric_interpretation(),
     image_pixel_module.bits_allocated(),
@@ -91,26 +644,7 @@ pub fn decode_color(
       | PhotometricInterpretation::YbrFull
       | PhotometricInterpretation::YbrFull422,
       BitsAllocated::Sixteen,
-    ) => {
-      let color_space = match image_pixel_module.photometric_interpretation() {
-        PhotometricInterpretation::YbrFull => ColorSpace::Ybr { is_422: false },
-        PhotometricInterpretation::YbrFull422 => {
-          ColorSpace::Ybr { is_422: true }
-        }
-        _ => ColorSpace::Rgb,
-      };
-
-      let pixels = decode(image_pixel_module, data)?;
-
-      ColorImage::new_u16(
-        image_pixel_module.columns(),
-        image_pixel_module.rows(),
-        pixels,
-        color_space,
-        image_pixel_module.bits_stored(),
-      )
-      .map_err(PixelDataDecodeError::ImageCreationFailed)
-    }
+    ) => Ok(()),
 
     (photometric_interpretation, bits_allocated) => {
       Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
@@ -125,44 +659,13 @@ pub fn decode_color(
   }
 }
 
-fn decode(
-  image_pixel_module: &ImagePixelModule,
-  data: &[u8],
-) -> Result<Vec<u16>, PixelDataDecodeError> {
-  // Determine whether the output wil be in the YBR color space
-  let is_ybr_color_space = image_pixel_module
-    .photometric_interpretation()
-    .is_ybr_full()
-    || image_pixel_module
-      .photometric_interpretation()
-      .is_ybr_full_422();
-
-  let mut error_message = [0 as core::ffi::c_char; 200];
-
-  // Allocate output buffer
-  let mut output_buffer =
-    vec![
-      0u16;
-      image_pixel_module.pixel_count()
-        * usize::from(u8::from(image_pixel_module.samples_per_pixel()))
-    ];
-
-  // Make FFI call into libjpeg_12bit to perform the decompression
-  let result = unsafe {
-    ffi::libjpeg_12bit_decode(
-      data.as_ptr() as *const core::ffi::c_void,
-      data.len(),
-      image_pixel_module.columns().into(),
-      image_pixel_module.rows().into(),
-      u8::from(image_pixel_module.samples_per_pixel()).into(),
-      is_ybr_color_space.into(),
-      output_buffer.as_mut_ptr(),
-      output_buffer.len(),
-      error_message.as_mut_ptr(),
-    )
-  };
-
-  // On error, read the error message string
+/// Converts the result of a call into libjpeg_12bit into a [`Result`], reading
+/// the error message string on error.
+///
+fn check_result(
+  result: usize,
+  error_message: &[core::ffi::c_char],
+) -> Result<(), PixelDataDecodeError> {
   if result != 0 {
     let error_c_str =
       unsafe { core::ffi::CStr::from_ptr(error_message.as_ptr()) };
@@ -173,21 +676,49 @@ fn decode(
     });
   }
 
-  Ok(output_buffer)
+  Ok(())
 }
 
 mod ffi {
   unsafe extern "C" {
-    pub fn libjpeg_12bit_decode(
-      input_data: *const core::ffi::c_void,
-      input_data_size: usize,
+    pub fn libjpeg_12bit_decode_session_create(
       width: usize,
       height: usize,
       samples_per_pixel: usize,
       is_ybr_color_space: usize,
+      scale_denom: usize,
       output_buffer: *mut u16,
       output_buffer_size: usize,
+      session: *mut *mut core::ffi::c_void,
       error_message: *mut core::ffi::c_char,
     ) -> usize;
+
+    pub fn libjpeg_12bit_decode_session_reset(
+      session: *mut core::ffi::c_void,
+      width: usize,
+      height: usize,
+      samples_per_pixel: usize,
+      is_ybr_color_space: usize,
+      scale_denom: usize,
+      output_buffer: *mut u16,
+      output_buffer_size: usize,
+      error_message: *mut core::ffi::c_char,
+    ) -> usize;
+
+    pub fn libjpeg_12bit_decode_session_push(
+      session: *mut core::ffi::c_void,
+      data: *const core::ffi::c_void,
+      size: usize,
+      error_message: *mut core::ffi::c_char,
+    ) -> usize;
+
+    pub fn libjpeg_12bit_decode_session_finish(
+      session: *mut core::ffi::c_void,
+      error_message: *mut core::ffi::c_char,
+    ) -> usize;
+
+    pub fn libjpeg_12bit_decode_session_destroy(
+      session: *mut core::ffi::c_void,
+    );
   }
 }
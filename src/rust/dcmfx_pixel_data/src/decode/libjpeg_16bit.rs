@@ -0,0 +1,226 @@
+#[cfg(not(feature = "std"))]
+use alloc::{borrow::Cow, format, vec, vec::Vec};
+#[cfg(feature = "std")]
+use std::borrow::Cow;
+
+use crate::{
+  ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError,
+  iods::image_pixel_module::{
+    BitsAllocated, ImagePixelModule, PhotometricInterpretation,
+    PixelRepresentation,
+  },
+};
+
+/// Decodes monochrome JPEG Lossless pixel data using libjpeg_16bit, which is
+/// libjpeg's lossless codec built with 16-bit samples. The JPEG data is passed
+/// as a list of fragments, which are combined if there is more than one.
+///
+pub fn decode_monochrome(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  let (is_monochrome1, pixel_representation) =
+    match image_pixel_module.photometric_interpretation() {
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation,
+      } => (true, *pixel_representation),
+
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation,
+      } => (false, *pixel_representation),
+
+      photometric_interpretation => {
+        return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+          details: format!(
+            "JPEG Lossless monochrome decode not supported for photometric \
+             interpretation '{photometric_interpretation}'"
+          ),
+        });
+      }
+    };
+
+  let pixels = decode(image_pixel_module, fragments)?;
+
+  let width = image_pixel_module.columns();
+  let height = image_pixel_module.rows();
+  let bits_stored = image_pixel_module.bits_stored();
+
+  match (image_pixel_module.bits_allocated(), pixel_representation) {
+    (BitsAllocated::Eight, PixelRepresentation::Unsigned) => {
+      MonochromeImage::new_u8(
+        width,
+        height,
+        pixels.into_iter().map(|p| p as u8).collect(),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (BitsAllocated::Eight, PixelRepresentation::Signed) => {
+      MonochromeImage::new_i8(
+        width,
+        height,
+        pixels.into_iter().map(|p| p as u8 as i8).collect(),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (_, PixelRepresentation::Unsigned) => MonochromeImage::new_u16(
+      width,
+      height,
+      pixels,
+      bits_stored,
+      is_monochrome1,
+    ),
+
+    (_, PixelRepresentation::Signed) => MonochromeImage::new_i16(
+      width,
+      height,
+      bytemuck::cast_slice(&pixels).to_vec(),
+      bits_stored,
+      is_monochrome1,
+    ),
+  }
+  .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Decodes color JPEG Lossless pixel data using libjpeg_16bit. Components are
+/// output as stored without any color conversion, so YBR_FULL data is returned
+/// as RGB, which matches jpeg-decoder.
+///
+pub fn decode_color(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+) -> Result<ColorImage, PixelDataDecodeError> {
+  let width = image_pixel_module.columns();
+  let height = image_pixel_module.rows();
+  let bits_stored = image_pixel_module.bits_stored();
+  let is_8bit = image_pixel_module.bits_allocated() == BitsAllocated::Eight;
+
+  match image_pixel_module.photometric_interpretation() {
+    PhotometricInterpretation::PaletteColor { palette } => {
+      let pixels = decode(image_pixel_module, fragments)?;
+
+      if is_8bit {
+        ColorImage::new_palette8(
+          width,
+          height,
+          pixels.into_iter().map(|p| p as u8).collect(),
+          palette.clone(),
+          bits_stored,
+        )
+      } else {
+        ColorImage::new_palette16(
+          width,
+          height,
+          pixels,
+          palette.clone(),
+          bits_stored,
+        )
+      }
+    }
+
+    PhotometricInterpretation::Rgb | PhotometricInterpretation::YbrFull => {
+      let pixels = decode(image_pixel_module, fragments)?;
+
+      if is_8bit {
+        ColorImage::new_u8(
+          width,
+          height,
+          pixels.into_iter().map(|p| p as u8).collect(),
+          ColorSpace::Rgb,
+          bits_stored,
+        )
+      } else {
+        ColorImage::new_u16(width, height, pixels, ColorSpace::Rgb, bits_stored)
+      }
+    }
+
+    photometric_interpretation => {
+      return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "JPEG Lossless color decode not supported for photometric \
+           interpretation '{photometric_interpretation}'"
+        ),
+      });
+    }
+  }
+  .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Decodes JPEG Lossless data into 16-bit samples, with the components of each
+/// pixel interleaved.
+///
+fn decode(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+) -> Result<Vec<u16>, PixelDataDecodeError> {
+  match image_pixel_module.bits_allocated() {
+    BitsAllocated::Eight | BitsAllocated::Sixteen => (),
+
+    bits_allocated => {
+      return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "JPEG Lossless decode not supported for bits allocated '{}'",
+          u8::from(bits_allocated)
+        ),
+      });
+    }
+  }
+
+  let data = match fragments {
+    [fragment] => Cow::Borrowed(*fragment),
+    _ => Cow::Owned(fragments.concat()),
+  };
+
+  let samples_per_pixel =
+    usize::from(u8::from(image_pixel_module.samples_per_pixel()));
+
+  let mut output_buffer =
+    vec![0u16; image_pixel_module.pixel_count() * samples_per_pixel];
+
+  let mut error_message = [0 as core::ffi::c_char; 200];
+
+  let result = unsafe {
+    ffi::libjpeg_16bit_decode(
+      data.as_ptr(),
+      data.len(),
+      image_pixel_module.columns().into(),
+      image_pixel_module.rows().into(),
+      samples_per_pixel,
+      output_buffer.as_mut_ptr(),
+      output_buffer.len(),
+      error_message.as_mut_ptr(),
+    )
+  };
+
+  if result != 0 {
+    let error_c_str =
+      unsafe { core::ffi::CStr::from_ptr(error_message.as_ptr()) };
+    let error_str = error_c_str.to_str().unwrap_or("<invalid error>");
+
+    return Err(PixelDataDecodeError::DataInvalid {
+      details: format!(
+        "JPEG Lossless pixel data decode failed with '{error_str}'"
+      ),
+    });
+  }
+
+  Ok(output_buffer)
+}
+
+mod ffi {
+  unsafe extern "C" {
+    pub fn libjpeg_16bit_decode(
+      data: *const u8,
+      data_size: usize,
+      width: usize,
+      height: usize,
+      samples_per_pixel: usize,
+      output_buffer: *mut u16,
+      output_buffer_size: usize,
+      error_message: *mut core::ffi::c_char,
+    ) -> usize;
+  }
+}
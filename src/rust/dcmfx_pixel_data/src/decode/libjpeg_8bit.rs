@@ -0,0 +1,589 @@
+#[cfg(not(feature = "std"))]
+use alloc::{borrow::Cow, format, vec, vec::Vec};
+#[cfg(feature = "std")]
+use std::borrow::Cow;
+
+use crate::{
+  ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError,
+  PlanarYbrImage, frame_buffer_pool,
+  iods::image_pixel_module::{
+    BitsAllocated, ImagePixelModule, PhotometricInterpretation,
+    PixelRepresentation,
+  },
+};
+
+#[cfg(feature = "std")]
+use super::jpeg_restart_index::JpegRestartIndex;
+
+/// Decodes monochrome JPEG Baseline pixel data using libjpeg_8bit, which is
+/// libjpeg built with 8-bit samples and the same SIMD IDCT, color conversion,
+/// and upsampling routines as libjpeg_12bit. The JPEG data is passed as a list
+/// of fragments, which are combined if there is more than one.
+///
+/// When the JPEG data has restart intervals that span whole MCU rows, runs of
+/// restart intervals are decoded concurrently on up to `thread_count`
+/// threads. A `thread_count` of zero uses all available CPU cores.
+///
+/// Each level of `resolution_reduction` halves the width and height of the
+/// decoded image, up to a maximum of three levels, i.e. 1:8 scale.
+///
+pub fn decode_monochrome(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  resolution_reduction: u32,
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  match (
+    image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      }
+      | PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      BitsAllocated::Eight,
+    ) => (),
+
+    (photometric_interpretation, bits_allocated) => {
+      return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "JPEG 8-bit monochrome decode not supported for photometric \
+           interpretation '{}', bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated)
+        ),
+      });
+    }
+  }
+
+  let scale_denom = scale_denom(resolution_reduction);
+  let decoded = decode(
+    image_pixel_module,
+    fragments,
+    thread_count,
+    scale_denom,
+    false,
+  )?;
+
+  let (width, height) = scaled_size(image_pixel_module, scale_denom);
+
+  MonochromeImage::new_u8(
+    width,
+    height,
+    decoded.pixels,
+    image_pixel_module.bits_stored(),
+    image_pixel_module
+      .photometric_interpretation()
+      .is_monochrome1(),
+  )
+  .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Decodes color JPEG Baseline pixel data using libjpeg_8bit. The JPEG data,
+/// thread count, and resolution reduction are handled in the same way as for
+/// [`decode_monochrome()`].
+///
+/// Data with a YBR photometric interpretation is output as YBR, which skips
+/// libjpeg's color conversion.
+///
+pub fn decode_color(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  resolution_reduction: u32,
+) -> Result<ColorImage, PixelDataDecodeError> {
+  match (
+    image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      PhotometricInterpretation::Rgb | PhotometricInterpretation::YbrFull422,
+      BitsAllocated::Eight,
+    ) => (),
+
+    (photometric_interpretation, bits_allocated) => {
+      return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "JPEG 8-bit color decode not supported for photometric \
+           interpretation '{}', bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated)
+        ),
+      });
+    }
+  }
+
+  let scale_denom = scale_denom(resolution_reduction);
+  let decoded = decode(
+    image_pixel_module,
+    fragments,
+    thread_count,
+    scale_denom,
+    false,
+  )?;
+
+  // As for zune-jpeg, whether the data is YBR 4:2:2 is taken from the JPEG's
+  // sampling factors because the photometric interpretation isn't always
+  // reliable
+  let color_space = if decoded.is_ybr {
+    ColorSpace::Ybr {
+      is_422: decoded.is_422,
+    }
+  } else {
+    ColorSpace::Rgb
+  };
+
+  let (width, height) = scaled_size(image_pixel_module, scale_denom);
+
+  ColorImage::new_u8(
+    width,
+    height,
+    decoded.pixels,
+    color_space,
+    image_pixel_module.bits_stored(),
+  )
+  .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Decodes only the luma of YBR JPEG Baseline pixel data using libjpeg_8bit,
+/// which skips the IDCT, upsampling, and color conversion of the chroma
+/// components, and so costs about the same as a monochrome decode. The luma is
+/// returned as a MONOCHROME2 image. The JPEG data and thread count are handled
+/// in the same way as for [`decode_monochrome()`].
+///
+/// Returns `None` if the JPEG data doesn't store YCbCr, e.g. because it stores
+/// RGB, in which case it should be decoded with [`decode_color()`] instead.
+///
+pub fn decode_luma(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+) -> Result<Option<MonochromeImage>, PixelDataDecodeError> {
+  match (
+    image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (PhotometricInterpretation::YbrFull422, BitsAllocated::Eight) => (),
+
+    (photometric_interpretation, bits_allocated) => {
+      return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "JPEG 8-bit luma decode not supported for photometric \
+           interpretation '{}', bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated)
+        ),
+      });
+    }
+  }
+
+  let decoded = decode(image_pixel_module, fragments, thread_count, 1, true)?;
+
+  if !decoded.is_ybr {
+    return Ok(None);
+  }
+
+  MonochromeImage::new_u8(
+    image_pixel_module.columns(),
+    image_pixel_module.rows(),
+    decoded.pixels,
+    image_pixel_module.bits_stored(),
+    false,
+  )
+  .map(Some)
+  .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Decodes YBR JPEG Baseline pixel data using libjpeg_8bit into separate Y,
+/// Cb, and Cr planes at the resolution they're stored at, which skips chroma
+/// upsampling and color conversion.
+///
+/// Returns `None` if the JPEG data doesn't store YCbCr, e.g. because it stores
+/// RGB, in which case it should be decoded with [`decode_color()`] instead.
+///
+pub fn decode_ybr_planar(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+) -> Result<Option<PlanarYbrImage>, PixelDataDecodeError> {
+  let data = match fragments {
+    [fragment] => Cow::Borrowed(*fragment),
+    _ => Cow::Owned(fragments.concat()),
+  };
+
+  let mut planes: Vec<Vec<u8>> = Vec::with_capacity(3);
+  let mut is_ybr = 0;
+  let mut chroma_width = 0;
+  let mut chroma_height = 0;
+  let mut error_message = [0 as core::ffi::c_char; 200];
+
+  let result = unsafe {
+    ffi::libjpeg_8bit_decode_ybr_planar(
+      data.as_ptr(),
+      data.len(),
+      image_pixel_module.columns().into(),
+      image_pixel_module.rows().into(),
+      &mut is_ybr,
+      &mut chroma_width,
+      &mut chroma_height,
+      plane_buffer_callback,
+      &mut planes as *mut Vec<Vec<u8>> as *mut core::ffi::c_void,
+      error_message.as_mut_ptr(),
+    )
+  };
+
+  if result != 0 {
+    let error_c_str =
+      unsafe { core::ffi::CStr::from_ptr(error_message.as_ptr()) };
+    let error_str = error_c_str.to_str().unwrap_or("<invalid error>");
+
+    return Err(PixelDataDecodeError::DataInvalid {
+      details: format!("JPEG 8-bit planar decode failed with '{error_str}'"),
+    });
+  }
+
+  if is_ybr == 0 {
+    return Ok(None);
+  }
+
+  let [y, cb, cr]: [Vec<u8>; 3] = planes.try_into().unwrap();
+
+  PlanarYbrImage::new_u8(
+    image_pixel_module.columns(),
+    image_pixel_module.rows(),
+    chroma_width as u16,
+    chroma_height as u16,
+    y,
+    cb,
+    cr,
+    image_pixel_module.bits_stored(),
+  )
+  .map(Some)
+  .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// This function is passed as a callback to
+/// [`ffi::libjpeg_8bit_decode_ybr_planar()`], and is called once for each
+/// plane. It adds a new plane of the requested size and returns a pointer to
+/// it.
+///
+extern "C" fn plane_buffer_callback(
+  size: usize,
+  context: *mut core::ffi::c_void,
+) -> *mut core::ffi::c_void {
+  unsafe {
+    let planes = &mut *(context as *mut Vec<Vec<u8>>);
+
+    let mut plane = frame_buffer_pool::zeroed_vec(size);
+    let plane_ptr = plane.as_mut_ptr();
+    planes.push(plane);
+
+    plane_ptr as *mut core::ffi::c_void
+  }
+}
+
+/// Pixels decoded by libjpeg_8bit, along with the color space they're in. For
+/// a luma only decode `is_ybr` is whether the luma was decoded.
+///
+struct DecodedPixels {
+  pixels: Vec<u8>,
+  is_ybr: bool,
+  is_422: bool,
+}
+
+fn decode(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  scale_denom: usize,
+  is_luma_only: bool,
+) -> Result<DecodedPixels, PixelDataDecodeError> {
+  let data = match fragments {
+    [fragment] => Cow::Borrowed(*fragment),
+    _ => Cow::Owned(fragments.concat()),
+  };
+
+  #[cfg(feature = "std")]
+  if let Some(decoded) = decode_restart_intervals(
+    image_pixel_module,
+    &data,
+    thread_count,
+    scale_denom,
+    is_luma_only,
+  )? {
+    return Ok(decoded);
+  }
+
+  #[cfg(not(feature = "std"))]
+  let _ = thread_count;
+
+  let samples_per_pixel =
+    usize::from(u8::from(image_pixel_module.samples_per_pixel()));
+  let output_samples_per_pixel =
+    if is_luma_only { 1 } else { samples_per_pixel };
+
+  let (width, height) = scaled_size(image_pixel_module, scale_denom);
+  let mut pixels =
+    vec![
+      0u8;
+      usize::from(width) * usize::from(height) * output_samples_per_pixel
+    ];
+
+  let (is_ybr, is_422) = decode_into(
+    &data,
+    image_pixel_module.columns().into(),
+    image_pixel_module.rows().into(),
+    samples_per_pixel,
+    is_ybr_color_space(image_pixel_module),
+    is_luma_only,
+    scale_denom,
+    &mut pixels,
+  )?;
+
+  Ok(DecodedPixels {
+    pixels,
+    is_ybr,
+    is_422,
+  })
+}
+
+/// Decodes JPEG data by splitting its restart intervals into one run of
+/// consecutive restart intervals per thread, each of which is decoded on its
+/// own thread as a separate JPEG image directly into its rows of the output.
+/// This is the same as is done for libjpeg_12bit.
+///
+/// Returns `None` if the JPEG data isn't decoded this way, either because only
+/// one thread is to be used or because its restart intervals can't be decoded
+/// independently, in which case it's decoded as a whole instead.
+///
+#[cfg(feature = "std")]
+fn decode_restart_intervals(
+  image_pixel_module: &ImagePixelModule,
+  data: &[u8],
+  thread_count: usize,
+  scale_denom: usize,
+  is_luma_only: bool,
+) -> Result<Option<DecodedPixels>, PixelDataDecodeError> {
+  let thread_count = if thread_count == 0 {
+    std::thread::available_parallelism().map_or(1, |n| n.get())
+  } else {
+    thread_count
+  };
+
+  if thread_count <= 1 {
+    return Ok(None);
+  }
+
+  let Some(index) = JpegRestartIndex::new(data) else {
+    return Ok(None);
+  };
+
+  // Leave reporting of an unexpected image size to the full decode
+  if index.width() != image_pixel_module.columns()
+    || index.height() != image_pixel_module.rows()
+  {
+    return Ok(None);
+  }
+
+  let intervals_per_thread = index.interval_count().div_ceil(thread_count);
+  if intervals_per_thread == index.interval_count() {
+    return Ok(None);
+  }
+
+  // Stripes other than the last must scale to a whole number of rows
+  let rows_per_interval = index.rows_per_interval();
+  if rows_per_interval % scale_denom != 0 {
+    return Ok(None);
+  }
+
+  let columns = usize::from(image_pixel_module.columns());
+  let rows = usize::from(image_pixel_module.rows());
+  let samples_per_pixel =
+    usize::from(u8::from(image_pixel_module.samples_per_pixel()));
+  let is_ybr_color_space = is_ybr_color_space(image_pixel_module);
+  let output_samples_per_pixel =
+    if is_luma_only { 1 } else { samples_per_pixel };
+
+  let (scaled_columns, scaled_rows) =
+    scaled_size(image_pixel_module, scale_denom);
+  let scaled_row_size = usize::from(scaled_columns) * output_samples_per_pixel;
+
+  let mut pixels = crate::frame_buffer_pool::zeroed_vec(
+    usize::from(scaled_rows) * scaled_row_size,
+  );
+
+  let stripe_size =
+    intervals_per_thread * rows_per_interval / scale_denom * scaled_row_size;
+
+  let decode_stripe = |i: usize, output: &mut [u8]| {
+    let first_interval = i * intervals_per_thread;
+    let end_interval =
+      (first_interval + intervals_per_thread).min(index.interval_count());
+
+    let stripe = index.stripe(data, first_interval..end_interval);
+
+    let first_row = first_interval * rows_per_interval;
+    let end_row = (end_interval * rows_per_interval).min(rows);
+
+    decode_into(
+      &stripe,
+      columns,
+      end_row - first_row,
+      samples_per_pixel,
+      is_ybr_color_space,
+      is_luma_only,
+      scale_denom,
+      output,
+    )
+  };
+
+  // Decode the first stripe on this thread and the rest on new threads, which
+  // use this thread's cancellation token and memory budget
+  let decode_context = crate::codec_cancellation::CurrentContext::get();
+
+  let (is_ybr, is_422) = std::thread::scope(|scope| {
+    let mut stripes = pixels.chunks_mut(stripe_size).enumerate();
+    let (_, first_stripe) = stripes.next().unwrap();
+
+    let threads: Vec<_> = stripes
+      .map(|(i, output)| {
+        scope.spawn(move || decode_context.enter(|| decode_stripe(i, output)))
+      })
+      .collect();
+
+    let result = decode_stripe(0, first_stripe);
+
+    threads
+      .into_iter()
+      .map(|thread| thread.join().unwrap())
+      .try_fold(result?, |flags, stripe_result| stripe_result.map(|_| flags))
+  })?;
+
+  Ok(Some(DecodedPixels {
+    pixels,
+    is_ybr,
+    is_422,
+  }))
+}
+
+/// Decodes a complete JPEG image into the given output buffer, at
+/// `1 / scale_denom` of its full `width` and `height`. Returns whether the
+/// output is YBR, and whether the JPEG's chroma is subsampled as 4:2:2.
+///
+/// When `is_luma_only` is set the output has one sample per pixel, and nothing
+/// is decoded if the data isn't YBR.
+///
+#[allow(clippy::too_many_arguments)]
+fn decode_into(
+  data: &[u8],
+  width: usize,
+  height: usize,
+  samples_per_pixel: usize,
+  is_ybr_color_space: bool,
+  is_luma_only: bool,
+  scale_denom: usize,
+  output_buffer: &mut [u8],
+) -> Result<(bool, bool), PixelDataDecodeError> {
+  let mut error_message = [0 as core::ffi::c_char; 200];
+  let mut is_ybr = 0;
+  let mut is_422 = 0;
+
+  let result = unsafe {
+    ffi::libjpeg_8bit_decode(
+      data.as_ptr(),
+      data.len(),
+      width,
+      height,
+      samples_per_pixel,
+      is_ybr_color_space.into(),
+      is_luma_only.into(),
+      scale_denom,
+      output_buffer.as_mut_ptr(),
+      output_buffer.len(),
+      &mut is_ybr,
+      &mut is_422,
+      error_message.as_mut_ptr(),
+    )
+  };
+
+  if result != 0 {
+    let error_c_str =
+      unsafe { core::ffi::CStr::from_ptr(error_message.as_ptr()) };
+    let error_str = error_c_str.to_str().unwrap_or("<invalid error>");
+
+    return Err(PixelDataDecodeError::DataInvalid {
+      details: format!("JPEG 8-bit decode failed with '{error_str}'"),
+    });
+  }
+
+  Ok((is_ybr != 0, is_422 != 0))
+}
+
+/// Returns whether YBR output is requested from libjpeg_8bit for the given
+/// Image Pixel Module.
+///
+fn is_ybr_color_space(image_pixel_module: &ImagePixelModule) -> bool {
+  image_pixel_module
+    .photometric_interpretation()
+    .is_ybr_full_422()
+}
+
+/// Returns the scale denominator that libjpeg_8bit decodes at for a
+/// resolution reduction, which is at most 1:8 scale.
+///
+fn scale_denom(resolution_reduction: u32) -> usize {
+  1 << resolution_reduction.min(3)
+}
+
+/// Returns the width and height of an image decoded at `1 / scale_denom` of
+/// its full size, which libjpeg rounds up.
+///
+fn scaled_size(
+  image_pixel_module: &ImagePixelModule,
+  scale_denom: usize,
+) -> (u16, u16) {
+  let scale = |x: u16| usize::from(x).div_ceil(scale_denom) as u16;
+
+  (
+    scale(image_pixel_module.columns()),
+    scale(image_pixel_module.rows()),
+  )
+}
+
+mod ffi {
+  unsafe extern "C" {
+    pub fn libjpeg_8bit_decode(
+      data: *const u8,
+      data_size: usize,
+      width: usize,
+      height: usize,
+      samples_per_pixel: usize,
+      is_ybr_color_space: usize,
+      is_luma_only: usize,
+      scale_denom: usize,
+      output_buffer: *mut u8,
+      output_buffer_size: usize,
+      is_ybr: *mut usize,
+      is_422: *mut usize,
+      error_message: *mut core::ffi::c_char,
+    ) -> usize;
+
+    pub fn libjpeg_8bit_decode_ybr_planar(
+      data: *const u8,
+      data_size: usize,
+      width: usize,
+      height: usize,
+      is_ybr: *mut usize,
+      chroma_width: *mut usize,
+      chroma_height: *mut usize,
+      output_buffer_callback: extern "C" fn(
+        usize,
+        *mut core::ffi::c_void,
+      ) -> *mut core::ffi::c_void,
+      output_buffer_context: *mut core::ffi::c_void,
+      error_message: *mut core::ffi::c_char,
+    ) -> usize;
+  }
+}
@@ -1,168 +1,1387 @@
+use core::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError,
+  codec_cancellation::current_jpeg_xl_preview,
+  decode::batch::BatchFrame,
+  frame_buffer_pool,
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
-    PixelRepresentation,
   },
+  libjxl_thread_pool::HeldParallelRunner,
+  transforms::CropRect,
 };
 
-/// Decodes monochrome pixel data using libjxl.
+/// Decodes monochrome pixel data using libjxl. The JPEG XL data is passed as a
+/// list of fragments that are given to libjxl in turn, so the fragments of
+/// encapsulated pixel data don't need to be combined first.
 ///
 pub fn decode_monochrome(
   image_pixel_module: &ImagePixelModule,
-  data: &[u8],
+  fragments: &[&[u8]],
+  thread_count: usize,
 ) -> Result<MonochromeImage, PixelDataDecodeError> {
-  let width = image_pixel_module.columns();
-  let height = image_pixel_module.rows();
-  let bits_stored = image_pixel_module.bits_stored();
-  let is_monochrome1 = image_pixel_module
-    .photometric_interpretation()
-    .is_monochrome1();
+  let mut session =
+    DecodeSession::new_monochrome(image_pixel_module, thread_count, false)?;
 
-  match (
-    image_pixel_module.photometric_interpretation(),
-    image_pixel_module.bits_allocated(),
-  ) {
-    (
-      PhotometricInterpretation::Monochrome1 {
-        pixel_representation: PixelRepresentation::Unsigned,
-      }
-      | PhotometricInterpretation::Monochrome2 {
-        pixel_representation: PixelRepresentation::Unsigned,
-      },
-      BitsAllocated::Eight,
-    ) => {
-      let buffer = decode::<u8>(image_pixel_module, data)?;
-
-      MonochromeImage::new_u8(
-        width,
-        height,
-        buffer,
-        bits_stored,
-        is_monochrome1,
-      )
-      .map_err(PixelDataDecodeError::ImageCreationFailed)
+  for fragment in fragments {
+    session.push(fragment)?;
+  }
+
+  session.finish_monochrome(image_pixel_module)
+}
+
+/// Decodes monochrome pixel data using libjxl, passing a preview of the image
+/// to `on_preview` once the DC (LF) pass has been decoded. The preview is 1:8
+/// scale upsampled to full resolution.
+///
+/// Whether there is a preview depends on how the data was encoded, see
+/// [`crate::PixelDataEncodeConfig::jpeg_xl_progressive()`].
+///
+pub fn decode_monochrome_progressive(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  on_preview: &mut dyn FnMut(MonochromeImage),
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  let mut session =
+    DecodeSession::new_monochrome(image_pixel_module, thread_count, true)?;
+
+  let mut on_progression = |output_buffer: &OutputBuffer| {
+    if let Ok(image) = monochrome_image(
+      image_pixel_module,
+      image_pixel_module.columns(),
+      image_pixel_module.rows(),
+      output_buffer.clone(),
+    ) {
+      on_preview(image);
     }
 
-    (
-      PhotometricInterpretation::Monochrome1 {
-        pixel_representation: PixelRepresentation::Unsigned,
-      }
-      | PhotometricInterpretation::Monochrome2 {
-        pixel_representation: PixelRepresentation::Unsigned,
-      },
-      BitsAllocated::Sixteen,
-    ) => {
-      let buffer = decode::<u16>(image_pixel_module, data)?;
-
-      MonochromeImage::new_u16(
-        width,
-        height,
-        buffer,
-        bits_stored,
-        is_monochrome1,
-      )
-      .map_err(PixelDataDecodeError::ImageCreationFailed)
+    false
+  };
+
+  for fragment in fragments {
+    session.push_with_progression(fragment, Some(&mut on_progression))?;
+  }
+
+  session.finish_monochrome(image_pixel_module)
+}
+
+/// Decodes monochrome pixel data using libjxl, stopping as soon as the DC (LF)
+/// pass has been decoded and returning it upsampled to full resolution. This
+/// skips decoding the AC passes, which is most of the work, and is intended for
+/// rendering thumbnails that are 1:8 scale or smaller. libjxl's restoration
+/// filters are also skipped as they make no visible difference at this scale.
+///
+/// Data that doesn't have a DC preview, see
+/// [`crate::PixelDataEncodeConfig::jpeg_xl_progressive()`], is decoded in full.
+///
+pub fn decode_monochrome_dc(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  DecodeSession::check_monochrome(image_pixel_module)?;
+
+  let mut session =
+    DecodeSession::new(image_pixel_module, thread_count, true, true, None)?;
+
+  for fragment in fragments {
+    session.push_with_progression(fragment, Some(&mut |_| true))?;
+  }
+
+  session.finish_monochrome(image_pixel_module)
+}
+
+/// Decodes the part of monochrome pixel data inside a decode area using
+/// libjxl. Decoded pixels are written straight into an image the size of the
+/// decode area, and no more data is given to libjxl once all of them have been
+/// decoded.
+///
+/// libjxl can't skip the groups of a frame that are outside the decode area, so
+/// this only avoids decoding the groups that are stored after the last group
+/// the decode area needs. For a viewport over the middle of a frame that's
+/// most of its groups when the data was encoded centre-first, see
+/// [`crate::PixelDataEncodeConfig::jpeg_xl_center_first()`].
+///
+pub fn decode_monochrome_region(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  decode_area: &CropRect,
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  DecodeSession::check_monochrome(image_pixel_module)?;
+
+  match decode_region(image_pixel_module, fragments, thread_count, decode_area)?
+  {
+    Some((width, height, output_buffer)) => {
+      monochrome_image(image_pixel_module, width, height, output_buffer)
     }
 
-    (photometric_interpretation, bits_allocated) => {
-      Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
-        details: format!(
-          "JPEG XL monochrome decode with libjxl not supported for photometric \
-           interpretation '{}', bits allocated '{}'",
-          photometric_interpretation,
-          u8::from(bits_allocated),
-        ),
-      })
+    None => {
+      let mut image =
+        decode_monochrome(image_pixel_module, fragments, thread_count)?;
+
+      image.crop_with_threads(decode_area, thread_count);
+
+      Ok(image)
     }
   }
 }
 
-/// Decodes color pixel data using libjxl.
+/// Decodes monochrome pixel data using libjxl, passing runs of decoded stored
+/// values straight to `on_pixels` instead of creating a [`MonochromeImage`].
+/// See [`DecodeSession::new_monochrome_image_out()`] for details.
+///
+pub fn decode_monochrome_image_out(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  on_pixels: ImageOutFn,
+) -> Result<(), PixelDataDecodeError> {
+  let mut session = DecodeSession::new_monochrome_image_out(
+    image_pixel_module,
+    thread_count,
+    on_pixels,
+  )?;
+
+  for fragment in fragments {
+    session.push(fragment)?;
+  }
+
+  session.finish_image_out()
+}
+
+/// Decodes color pixel data using libjxl. The JPEG XL data is passed as a list
+/// of fragments in the same way as for [`decode_monochrome()`].
 ///
 pub fn decode_color(
   image_pixel_module: &ImagePixelModule,
-  data: &[u8],
+  fragments: &[&[u8]],
+  thread_count: usize,
 ) -> Result<ColorImage, PixelDataDecodeError> {
-  let width = image_pixel_module.columns();
-  let height = image_pixel_module.rows();
-  let bits_stored = image_pixel_module.bits_stored();
+  let mut session =
+    DecodeSession::new_color(image_pixel_module, thread_count, false)?;
 
-  match (
-    image_pixel_module.photometric_interpretation(),
-    image_pixel_module.bits_allocated(),
-  ) {
-    (
-      PhotometricInterpretation::Rgb
-      | PhotometricInterpretation::YbrFull422
-      | PhotometricInterpretation::YbrRct
-      | PhotometricInterpretation::Xyb,
-      BitsAllocated::Eight,
-    ) => {
-      let buffer = decode::<u8>(image_pixel_module, data)?;
+  for fragment in fragments {
+    session.push(fragment)?;
+  }
 
-      ColorImage::new_u8(width, height, buffer, ColorSpace::Rgb, bits_stored)
-        .map_err(PixelDataDecodeError::ImageCreationFailed)
+  session.finish_color(image_pixel_module)
+}
+
+/// Decodes a batch of whole frames of monochrome pixel data using libjxl in a
+/// single call. The frames are shared out between up to `thread_count`
+/// threads, which take their decoders and parallel runners from libjxl's idle
+/// pools and so reuse them across frames. The results are returned in the same
+/// order as the frames.
+///
+/// Batches are always decoded on libjxl's own threads rather than on an
+/// application's thread pool, see [`crate::libjxl_thread_pool`].
+///
+pub fn decode_monochrome_batch(
+  image_pixel_module: &ImagePixelModule,
+  frames: &[&[u8]],
+  thread_count: usize,
+) -> Vec<Result<MonochromeImage, PixelDataDecodeError>> {
+  if let Err(e) = DecodeSession::check_monochrome(image_pixel_module) {
+    return frames.iter().map(|_| Err(e.clone())).collect();
+  }
+
+  decode_batch(image_pixel_module, frames, thread_count)
+    .into_iter()
+    .map(|output_buffer| {
+      monochrome_image(
+        image_pixel_module,
+        image_pixel_module.columns(),
+        image_pixel_module.rows(),
+        output_buffer?,
+      )
+    })
+    .collect()
+}
+
+/// Decodes a batch of whole frames of color pixel data using libjxl in a single
+/// call, in the same way as [`decode_monochrome_batch()`].
+///
+pub fn decode_color_batch(
+  image_pixel_module: &ImagePixelModule,
+  frames: &[&[u8]],
+  thread_count: usize,
+) -> Vec<Result<ColorImage, PixelDataDecodeError>> {
+  if let Err(e) = DecodeSession::check_color(image_pixel_module) {
+    return frames.iter().map(|_| Err(e.clone())).collect();
+  }
+
+  decode_batch(image_pixel_module, frames, thread_count)
+    .into_iter()
+    .map(|output_buffer| {
+      color_image(
+        image_pixel_module,
+        image_pixel_module.columns(),
+        image_pixel_module.rows(),
+        output_buffer?,
+      )
+    })
+    .collect()
+}
+
+/// Decodes color pixel data using libjxl, passing a preview of the image to
+/// `on_preview` once the DC (LF) pass has been decoded. See
+/// [`decode_monochrome_progressive()`] for details.
+///
+pub fn decode_color_progressive(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  on_preview: &mut dyn FnMut(ColorImage),
+) -> Result<ColorImage, PixelDataDecodeError> {
+  let mut session =
+    DecodeSession::new_color(image_pixel_module, thread_count, true)?;
+
+  let mut on_progression = |output_buffer: &OutputBuffer| {
+    if let Ok(image) = color_image(
+      image_pixel_module,
+      image_pixel_module.columns(),
+      image_pixel_module.rows(),
+      output_buffer.clone(),
+    ) {
+      on_preview(image);
     }
 
-    (
-      PhotometricInterpretation::Rgb
-      | PhotometricInterpretation::YbrFull422
-      | PhotometricInterpretation::YbrRct
-      | PhotometricInterpretation::Xyb,
-      BitsAllocated::Sixteen,
-    ) => {
-      let buffer = decode::<u16>(image_pixel_module, data)?;
+    false
+  };
 
-      ColorImage::new_u16(width, height, buffer, ColorSpace::Rgb, bits_stored)
-        .map_err(PixelDataDecodeError::ImageCreationFailed)
+  for fragment in fragments {
+    session.push_with_progression(fragment, Some(&mut on_progression))?;
+  }
+
+  session.finish_color(image_pixel_module)
+}
+
+/// Decodes color pixel data using libjxl, stopping as soon as the DC (LF) pass
+/// has been decoded. See [`decode_monochrome_dc()`] for details.
+///
+pub fn decode_color_dc(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+) -> Result<ColorImage, PixelDataDecodeError> {
+  DecodeSession::check_color(image_pixel_module)?;
+
+  let mut session =
+    DecodeSession::new(image_pixel_module, thread_count, true, true, None)?;
+
+  for fragment in fragments {
+    session.push_with_progression(fragment, Some(&mut |_| true))?;
+  }
+
+  session.finish_color(image_pixel_module)
+}
+
+/// Decodes the part of color pixel data inside a decode area using libjxl. See
+/// [`decode_monochrome_region()`] for details.
+///
+pub fn decode_color_region(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  decode_area: &CropRect,
+) -> Result<ColorImage, PixelDataDecodeError> {
+  DecodeSession::check_color(image_pixel_module)?;
+
+  match decode_region(image_pixel_module, fragments, thread_count, decode_area)?
+  {
+    Some((width, height, output_buffer)) => {
+      color_image(image_pixel_module, width, height, output_buffer)
     }
 
-    (photometric_interpretation, bits_allocated) => {
-      Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
-        details: format!(
-          "JPEG XL color decode with libjxl not supported for photometric \
-           interpretation '{}', bits allocated '{}'",
-          photometric_interpretation,
-          u8::from(bits_allocated),
-        ),
-      })
+    None => {
+      let mut image =
+        decode_color(image_pixel_module, fragments, thread_count)?;
+
+      image.crop_with_threads(decode_area, thread_count);
+
+      Ok(image)
     }
   }
 }
 
-fn decode<T: Clone + Default>(
+/// Decodes monochrome pixel data using libjxl, passing the decoded image to
+/// `on_stripe` as horizontal stripes of `rows_per_stripe` rows along with the
+/// index of each stripe's first row. The last stripe holds any remaining rows.
+///
+/// Decoded pixels are passed from libjxl's streaming render pipeline straight
+/// into the stripes, and the data is given to libjxl a piece at a time, so only
+/// the stripes that the groups decoded so far have written into are held in
+/// memory. For data with its groups in scanline order this is a few stripes,
+/// which means the memory used doesn't grow with the height of the image.
+///
+/// libjxl can't render any lossy group until it has decoded every DC (LF)
+/// group. Lossy frames over 2048 pixels wide or high that libjxl encoded a
+/// section at a time store each DC group next to its AC groups, so all their
+/// stripes are completed at the end of the data.
+///
+pub fn decode_monochrome_stripes(
   image_pixel_module: &ImagePixelModule,
-  data: &[u8],
-) -> Result<Vec<T>, PixelDataDecodeError> {
-  let mut error_message = [0 as core::ffi::c_char; 200];
+  fragments: &[&[u8]],
+  thread_count: usize,
+  rows_per_stripe: u16,
+  on_stripe: &mut dyn FnMut(MonochromeImage, u16),
+) -> Result<(), PixelDataDecodeError> {
+  DecodeSession::check_monochrome(image_pixel_module)?;
+
+  decode_stripes(
+    image_pixel_module,
+    fragments,
+    thread_count,
+    rows_per_stripe,
+    &mut |output_buffer, height, first_row| {
+      on_stripe(
+        monochrome_image(
+          image_pixel_module,
+          image_pixel_module.columns(),
+          height,
+          output_buffer,
+        )?,
+        first_row,
+      );
+
+      Ok(())
+    },
+  )
+}
+
+/// Decodes color pixel data using libjxl, passing the decoded image to
+/// `on_stripe` as horizontal stripes. See [`decode_monochrome_stripes()`] for
+/// details.
+///
+pub fn decode_color_stripes(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  rows_per_stripe: u16,
+  on_stripe: &mut dyn FnMut(ColorImage, u16),
+) -> Result<(), PixelDataDecodeError> {
+  DecodeSession::check_color(image_pixel_module)?;
+
+  decode_stripes(
+    image_pixel_module,
+    fragments,
+    thread_count,
+    rows_per_stripe,
+    &mut |output_buffer, height, first_row| {
+      on_stripe(
+        color_image(
+          image_pixel_module,
+          image_pixel_module.columns(),
+          height,
+          output_buffer,
+        )?,
+        first_row,
+      );
+
+      Ok(())
+    },
+  )
+}
+
+/// A decode of JPEG XL data that is given its data incrementally. Each piece
+/// of data is decoded as far as possible as soon as it's pushed, and libjxl
+/// suspends when it reaches the end of the data pushed so far.
+///
+/// libjxl reads pushed data in place, so it must outlive the session.
+///
+pub struct DecodeSession<'a> {
+  session: *mut core::ffi::c_void,
+  output_buffer: OutputBuffer,
+  _parallel_runner: HeldParallelRunner,
+  _image_out: Option<Box<ImageOutContext<'a>>>,
+  data: core::marker::PhantomData<&'a [u8]>,
+}
 
-  // Allocate output buffer
-  let mut output_buffer =
-    vec![
-      T::default();
+/// A run of consecutive decoded pixels from one row of an image. The samples
+/// of color pixels are interleaved.
+///
+pub enum PixelRun<'a> {
+  U8(&'a [u8]),
+  I8(&'a [i8]),
+  U16(&'a [u16]),
+  I16(&'a [i16]),
+}
+
+/// The function that decoded pixels are passed to when decoding straight to
+/// an output, see [`DecodeSession::new_monochrome_image_out()`]. It's passed
+/// the column and row of the first pixel in the run, and the run itself.
+///
+pub type ImageOutFn<'a> = &'a (dyn Fn(usize, usize, PixelRun) + Sync);
+
+/// The context passed to [`image_out_callback()`].
+///
+struct ImageOutContext<'a> {
+  bits_allocated: BitsAllocated,
+  is_signed: bool,
+  samples_per_pixel: usize,
+  on_pixels: ImageOutFn<'a>,
+}
+
+/// The buffer that libjxl writes decoded samples into. Signed and 32-bit
+/// samples are unfolded from the codestream's samples by libjxl_interface.cpp
+/// as they're written.
+///
+#[derive(Clone)]
+enum OutputBuffer {
+  U8(Vec<u8>),
+  I8(Vec<i8>),
+  U16(Vec<u16>),
+  I16(Vec<i16>),
+  U32(Vec<u32>),
+  I32(Vec<i32>),
+}
+
+impl OutputBuffer {
+  /// Allocates an output buffer for samples with the passed bits allocated and
+  /// signedness.
+  ///
+  fn new(
+    bits_allocated: BitsAllocated,
+    is_signed: bool,
+    sample_count: usize,
+  ) -> Self {
+    match (bits_allocated, is_signed) {
+      (BitsAllocated::Sixteen, false) => {
+        Self::U16(frame_buffer_pool::zeroed_vec(sample_count))
+      }
+      (BitsAllocated::Sixteen, true) => {
+        Self::I16(frame_buffer_pool::zeroed_vec(sample_count))
+      }
+      (BitsAllocated::ThirtyTwo, false) => {
+        Self::U32(frame_buffer_pool::zeroed_vec(sample_count))
+      }
+      (BitsAllocated::ThirtyTwo, true) => {
+        Self::I32(frame_buffer_pool::zeroed_vec(sample_count))
+      }
+      (_, true) => Self::I8(frame_buffer_pool::zeroed_vec(sample_count)),
+      (_, false) => Self::U8(frame_buffer_pool::zeroed_vec(sample_count)),
+    }
+  }
+
+  /// Returns a pointer to the buffer and its size in bytes, for passing to
+  /// libjxl.
+  ///
+  fn as_mut_ptr_and_size(&mut self) -> (*mut core::ffi::c_void, usize) {
+    fn raw<T>(buffer: &mut [T]) -> (*mut core::ffi::c_void, usize) {
+      (
+        buffer.as_mut_ptr() as *mut core::ffi::c_void,
+        core::mem::size_of_val(buffer),
+      )
+    }
+
+    match self {
+      Self::U8(buffer) => raw(buffer),
+      Self::I8(buffer) => raw(buffer),
+      Self::U16(buffer) => raw(buffer),
+      Self::I16(buffer) => raw(buffer),
+      Self::U32(buffer) => raw(buffer),
+      Self::I32(buffer) => raw(buffer),
+    }
+  }
+}
+
+impl<'a> DecodeSession<'a> {
+  /// Creates a session for decoding monochrome pixel data. Progressive
+  /// sessions flush a preview to the output buffer each time a progressive
+  /// pass is decoded, see [`Self::push_with_progression()`].
+  ///
+  pub fn new_monochrome(
+    image_pixel_module: &ImagePixelModule,
+    thread_count: usize,
+    progressive: bool,
+  ) -> Result<Self, PixelDataDecodeError> {
+    Self::check_monochrome(image_pixel_module)?;
+
+    Self::new(
+      image_pixel_module,
+      thread_count,
+      progressive,
+      current_jpeg_xl_preview(),
+      None,
+    )
+  }
+
+  /// Creates a session for decoding monochrome pixel data that passes decoded
+  /// pixels to `on_pixels` rather than writing them into an output buffer.
+  /// libjxl calls `on_pixels` from its worker threads as it decodes each group
+  /// of pixels, so runs of pixels are passed concurrently and in no particular
+  /// order. The session is finished with [`Self::finish_image_out()`].
+  ///
+  pub fn new_monochrome_image_out(
+    image_pixel_module: &ImagePixelModule,
+    thread_count: usize,
+    on_pixels: ImageOutFn<'a>,
+  ) -> Result<Self, PixelDataDecodeError> {
+    Self::check_monochrome(image_pixel_module)?;
+
+    Self::new_image_out(image_pixel_module, thread_count, on_pixels)
+  }
+
+  /// Creates a session for decoding color pixel data that passes decoded
+  /// pixels to `on_pixels`. See [`Self::new_monochrome_image_out()`] for
+  /// details.
+  ///
+  pub fn new_color_image_out(
+    image_pixel_module: &ImagePixelModule,
+    thread_count: usize,
+    on_pixels: ImageOutFn<'a>,
+  ) -> Result<Self, PixelDataDecodeError> {
+    Self::check_color(image_pixel_module)?;
+
+    Self::new_image_out(image_pixel_module, thread_count, on_pixels)
+  }
+
+  fn new_image_out(
+    image_pixel_module: &ImagePixelModule,
+    thread_count: usize,
+    on_pixels: ImageOutFn<'a>,
+  ) -> Result<Self, PixelDataDecodeError> {
+    if image_pixel_module.bits_allocated() == BitsAllocated::ThirtyTwo {
+      return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: "JPEG XL decode with libjxl to an image out function does \
+          not support 32-bit samples"
+          .to_string(),
+      });
+    }
+
+    Self::new(
+      image_pixel_module,
+      thread_count,
+      false,
+      current_jpeg_xl_preview(),
+      Some(on_pixels),
+    )
+  }
+
+  fn check_monochrome(
+    image_pixel_module: &ImagePixelModule,
+  ) -> Result<(), PixelDataDecodeError> {
+    match (
+      image_pixel_module.photometric_interpretation(),
+      image_pixel_module.bits_allocated(),
+    ) {
+      (
+        PhotometricInterpretation::Monochrome1 { .. }
+        | PhotometricInterpretation::Monochrome2 { .. },
+        BitsAllocated::Eight
+        | BitsAllocated::Sixteen
+        | BitsAllocated::ThirtyTwo,
+      ) => Ok(()),
+
+      (photometric_interpretation, bits_allocated) => {
+        Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+          details: format!(
+            "JPEG XL monochrome decode with libjxl not supported for \
+             photometric interpretation '{}', bits allocated '{}'",
+            photometric_interpretation,
+            u8::from(bits_allocated),
+          ),
+        })
+      }
+    }
+  }
+
+  /// Creates a session for decoding color pixel data.
+  ///
+  pub fn new_color(
+    image_pixel_module: &ImagePixelModule,
+    thread_count: usize,
+    progressive: bool,
+  ) -> Result<Self, PixelDataDecodeError> {
+    Self::check_color(image_pixel_module)?;
+
+    Self::new(
+      image_pixel_module,
+      thread_count,
+      progressive,
+      current_jpeg_xl_preview(),
+      None,
+    )
+  }
+
+  fn check_color(
+    image_pixel_module: &ImagePixelModule,
+  ) -> Result<(), PixelDataDecodeError> {
+    match (
+      image_pixel_module.photometric_interpretation(),
+      image_pixel_module.bits_allocated(),
+    ) {
+      (
+        PhotometricInterpretation::Rgb
+        | PhotometricInterpretation::YbrFull422
+        | PhotometricInterpretation::YbrRct
+        | PhotometricInterpretation::Xyb,
+        BitsAllocated::Eight | BitsAllocated::Sixteen,
+      ) => Ok(()),
+
+      (photometric_interpretation, bits_allocated) => {
+        Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+          details: format!(
+            "JPEG XL color decode with libjxl not supported for photometric \
+             interpretation '{}', bits allocated '{}'",
+            photometric_interpretation,
+            u8::from(bits_allocated),
+          ),
+        })
+      }
+    }
+  }
+
+  /// Creates a session. When `preview` is set, libjxl skips its restoration
+  /// filters, see [`crate::PixelDataDecodeConfig::jpeg_xl_preview`].
+  ///
+  fn new(
+    image_pixel_module: &ImagePixelModule,
+    thread_count: usize,
+    progressive: bool,
+    preview: bool,
+    on_pixels: Option<ImageOutFn<'a>>,
+  ) -> Result<Self, PixelDataDecodeError> {
+    let mut error_message = [0 as core::ffi::c_char; 200];
+
+    let bits_allocated = image_pixel_module.bits_allocated();
+    let is_signed = image_pixel_module.pixel_representation().is_signed();
+
+    // Allocate output buffer, which isn't needed when decoded pixels are
+    // passed to an image out function
+    let sample_count = if on_pixels.is_some() {
+      0
+    } else {
       image_pixel_module.pixel_count()
         * usize::from(u8::from(image_pixel_module.samples_per_pixel()))
-    ];
-
-  // Make FFI call into libjxl to perform the decompression
-  let result = unsafe {
-    ffi::libjxl_decode(
-      data.as_ptr() as *const core::ffi::c_void,
-      data.len(),
-      image_pixel_module.columns().into(),
-      image_pixel_module.rows().into(),
-      u8::from(image_pixel_module.samples_per_pixel()).into(),
-      u8::from(image_pixel_module.bits_allocated()).into(),
-      output_buffer.as_mut_ptr() as *mut core::ffi::c_void,
-      output_buffer.len()
-        * usize::from(u8::from(image_pixel_module.bits_allocated()) / 8),
-      error_message.as_mut_ptr(),
-      error_message.len(),
+    };
+    let mut output_buffer =
+      OutputBuffer::new(bits_allocated, is_signed, sample_count);
+
+    let mut image_out = on_pixels.map(|on_pixels| {
+      Box::new(ImageOutContext {
+        bits_allocated,
+        is_signed,
+        samples_per_pixel: usize::from(u8::from(
+          image_pixel_module.samples_per_pixel(),
+        )),
+        on_pixels,
+      })
+    });
+
+    let (image_out_callback, image_out_context) = match image_out.as_mut() {
+      Some(context) => (
+        Some(
+          image_out_callback
+            as extern "C" fn(
+              *mut core::ffi::c_void,
+              usize,
+              usize,
+              usize,
+              *const core::ffi::c_void,
+            ),
+        ),
+        context.as_mut() as *mut ImageOutContext as *mut core::ffi::c_void,
+      ),
+      None => (None, core::ptr::null_mut()),
+    };
+
+    let (output_buffer_ptr, output_buffer_size) =
+      output_buffer.as_mut_ptr_and_size();
+
+    let parallel_runner = HeldParallelRunner::new();
+    let mut session = core::ptr::null_mut();
+
+    // Make FFI call into libjxl to create the decoder
+    let result = unsafe {
+      ffi::libjxl_decode_session_create(
+        image_pixel_module.columns().into(),
+        image_pixel_module.rows().into(),
+        u8::from(image_pixel_module.samples_per_pixel()).into(),
+        u8::from(bits_allocated).into(),
+        is_signed.into(),
+        progressive.into(),
+        preview.into(),
+        thread_count,
+        parallel_runner.runner(),
+        parallel_runner.opaque(),
+        output_buffer_ptr,
+        output_buffer_size,
+        image_out_callback,
+        image_out_context,
+        &mut session,
+        error_message.as_mut_ptr(),
+        error_message.len(),
+      )
+    };
+
+    check_result(result, &error_message)?;
+
+    Ok(Self {
+      session,
+      output_buffer,
+      _parallel_runner: parallel_runner,
+      _image_out: image_out,
+      data: core::marker::PhantomData,
+    })
+  }
+
+  /// Pushes the next piece of JPEG XL data and decodes as much of it as
+  /// possible.
+  ///
+  pub fn push(&mut self, data: &'a [u8]) -> Result<(), PixelDataDecodeError> {
+    self.push_with_progression(data, None)
+  }
+
+  /// Pushes the next piece of JPEG XL data and decodes as much of it as
+  /// possible. For progressive sessions, `on_progression` is passed the output
+  /// buffer each time a preview has been flushed to it. If it returns true then
+  /// decoding stops, and the preview is kept as the decoded image.
+  ///
+  fn push_with_progression(
+    &mut self,
+    data: &'a [u8],
+    on_progression: Option<&mut dyn FnMut(&OutputBuffer) -> bool>,
+  ) -> Result<(), PixelDataDecodeError> {
+    let mut error_message = [0 as core::ffi::c_char; 200];
+
+    let mut context = on_progression.map(|on_progression| ProgressionContext {
+      output_buffer: &self.output_buffer,
+      on_progression,
+    });
+
+    let (callback, context_ptr) = match context.as_mut() {
+      Some(context) => (
+        Some(
+          progression_callback
+            as extern "C" fn(*mut core::ffi::c_void) -> usize,
+        ),
+        context as *mut ProgressionContext as *mut core::ffi::c_void,
+      ),
+      None => (None, core::ptr::null_mut()),
+    };
+
+    let result = unsafe {
+      ffi::libjxl_decode_session_push(
+        self.session,
+        data.as_ptr() as *const core::ffi::c_void,
+        data.len(),
+        callback,
+        context_ptr,
+        error_message.as_mut_ptr(),
+        error_message.len(),
+      )
+    };
+
+    check_result(result, &error_message)
+  }
+
+  /// Marks the end of the JPEG XL data and returns the decoded monochrome
+  /// image.
+  ///
+  pub fn finish_monochrome(
+    self,
+    image_pixel_module: &ImagePixelModule,
+  ) -> Result<MonochromeImage, PixelDataDecodeError> {
+    monochrome_image(
+      image_pixel_module,
+      image_pixel_module.columns(),
+      image_pixel_module.rows(),
+      self.finish()?,
     )
+  }
+
+  /// Marks the end of the JPEG XL data and returns the decoded color image.
+  ///
+  pub fn finish_color(
+    self,
+    image_pixel_module: &ImagePixelModule,
+  ) -> Result<ColorImage, PixelDataDecodeError> {
+    color_image(
+      image_pixel_module,
+      image_pixel_module.columns(),
+      image_pixel_module.rows(),
+      self.finish()?,
+    )
+  }
+
+  /// Marks the end of the JPEG XL data for a session that passes decoded
+  /// pixels to an image out function, and checks the image is complete.
+  ///
+  pub fn finish_image_out(self) -> Result<(), PixelDataDecodeError> {
+    self.finish().map(|_| ())
+  }
+
+  fn finish(mut self) -> Result<OutputBuffer, PixelDataDecodeError> {
+    let mut error_message = [0 as core::ffi::c_char; 200];
+
+    let result = unsafe {
+      ffi::libjxl_decode_session_finish(
+        self.session,
+        None,
+        core::ptr::null_mut(),
+        error_message.as_mut_ptr(),
+        error_message.len(),
+      )
+    };
+
+    check_result(result, &error_message)?;
+
+    if crate::codec_stats::is_enabled() {
+      self.record_stage_times();
+    }
+
+    Ok(core::mem::replace(
+      &mut self.output_buffer,
+      OutputBuffer::U8(vec![]),
+    ))
+  }
+
+  /// Adds the time libjxl spent parsing headers and decoding the image to the
+  /// codec stats.
+  ///
+  fn record_stage_times(&self) {
+    use crate::codec_stats::{CodecStage, record_stage};
+    use std::time::Duration;
+
+    let mut header_parse_time = 0;
+    let mut decode_time = 0;
+
+    unsafe {
+      ffi::libjxl_decode_session_stage_times(
+        self.session,
+        &mut header_parse_time,
+        &mut decode_time,
+      )
+    };
+
+    record_stage(
+      CodecStage::HeaderParse,
+      Duration::from_nanos(header_parse_time),
+    );
+    record_stage(CodecStage::EntropyDecode, Duration::from_nanos(decode_time));
+  }
+}
+
+impl Drop for DecodeSession<'_> {
+  fn drop(&mut self) {
+    unsafe { ffi::libjxl_decode_session_destroy(self.session) };
+  }
+}
+
+/// Decodes the pixels inside a decode area into an output buffer the size of
+/// the decode area, stopping once all of them have been decoded. Returns the
+/// width and height of the decode area along with the output buffer, or `None`
+/// if the whole frame needs to be decoded and then cropped.
+///
+fn decode_region(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  decode_area: &CropRect,
+) -> Result<Option<(u16, u16, OutputBuffer)>, PixelDataDecodeError> {
+  /// The amount of data given to libjxl at a time, after which it's checked
+  /// whether the decode area is complete.
+  const PUSH_SIZE: usize = 256 * 1024;
+
+  let (height, width) =
+    decode_area.apply(image_pixel_module.rows(), image_pixel_module.columns());
+
+  // Image out functions don't support 32-bit samples, and there's nothing to
+  // gain when the decode area covers the whole frame
+  if width == 0
+    || height == 0
+    || (width, height)
+      == (image_pixel_module.columns(), image_pixel_module.rows())
+    || image_pixel_module.bits_allocated() == BitsAllocated::ThirtyTwo
+  {
+    return Ok(None);
+  }
+
+  let left = usize::from(decode_area.left);
+  let top = usize::from(decode_area.top);
+  let width = usize::from(width);
+  let height = usize::from(height);
+  let samples_per_pixel =
+    usize::from(u8::from(image_pixel_module.samples_per_pixel()));
+
+  let mut output_buffer = OutputBuffer::new(
+    image_pixel_module.bits_allocated(),
+    image_pixel_module.pixel_representation().is_signed(),
+    width * height * samples_per_pixel,
+  );
+
+  let (output_ptr, output_size) = output_buffer.as_mut_ptr_and_size();
+  let output = RegionOutput(output_ptr as *mut u8);
+  let pixel_size = output_size / (width * height);
+
+  let remaining_pixels = AtomicUsize::new(width * height);
+
+  let on_pixels = |x: usize, y: usize, pixels: PixelRun| {
+    if y < top || y >= top + height {
+      return;
+    }
+
+    let pixels = pixels.as_bytes();
+    let start = x.max(left);
+    let end = (x + pixels.len() / pixel_size).min(left + width);
+    if start >= end {
+      return;
+    }
+
+    // Each pixel is decoded once, so concurrent calls write to separate parts
+    // of the output buffer
+    unsafe {
+      core::ptr::copy_nonoverlapping(
+        pixels.as_ptr().add((start - x) * pixel_size),
+        output
+          .ptr()
+          .add(((y - top) * width + start - left) * pixel_size),
+        (end - start) * pixel_size,
+      );
+    }
+
+    remaining_pixels.fetch_sub(end - start, Ordering::Relaxed);
+  };
+
+  let mut session = if image_pixel_module.is_monochrome() {
+    DecodeSession::new_monochrome_image_out(
+      image_pixel_module,
+      thread_count,
+      &on_pixels,
+    )?
+  } else {
+    DecodeSession::new_color_image_out(
+      image_pixel_module,
+      thread_count,
+      &on_pixels,
+    )?
+  };
+
+  for data in fragments
+    .iter()
+    .flat_map(|fragment| fragment.chunks(PUSH_SIZE))
+  {
+    session.push(data)?;
+
+    if remaining_pixels.load(Ordering::Relaxed) == 0 {
+      break;
+    }
+  }
+
+  // The session is only finished if the data ran out before the decode area was
+  // complete, in which case finishing it reports the truncated data
+  if remaining_pixels.load(Ordering::Relaxed) == 0 {
+    drop(session);
+  } else {
+    session.finish_image_out()?;
+  }
+
+  Ok(Some((width as u16, height as u16, output_buffer)))
+}
+
+/// A stripe of [`decode_stripes()`] that's being written into by libjxl. It's
+/// complete once no pixels remain.
+///
+struct Stripe {
+  output_buffer: OutputBuffer,
+  remaining_pixels: AtomicUsize,
+}
+
+/// Decodes the image in stripes of `rows_per_stripe` rows, passing each one to
+/// `on_stripe` in order once all its pixels have been decoded, along with its
+/// height and the index of its first row. Stripes are allocated when libjxl
+/// first writes into them.
+///
+fn decode_stripes(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  rows_per_stripe: u16,
+  on_stripe: &mut dyn FnMut(
+    OutputBuffer,
+    u16,
+    u16,
+  ) -> Result<(), PixelDataDecodeError>,
+) -> Result<(), PixelDataDecodeError> {
+  /// The amount of data given to libjxl at a time, after which the stripes
+  /// that are complete are passed on.
+  const PUSH_SIZE: usize = 1024 * 1024;
+
+  let width = usize::from(image_pixel_module.columns());
+  let height = usize::from(image_pixel_module.rows());
+  let rows_per_stripe = usize::from(rows_per_stripe.max(1));
+  let samples_per_pixel =
+    usize::from(u8::from(image_pixel_module.samples_per_pixel()));
+  let bits_allocated = image_pixel_module.bits_allocated();
+  let is_signed = image_pixel_module.pixel_representation().is_signed();
+  let pixel_size = samples_per_pixel
+    * if bits_allocated == BitsAllocated::Sixteen {
+      2
+    } else {
+      1
+    };
+
+  let stripe_height =
+    |index: usize| rows_per_stripe.min(height - index * rows_per_stripe);
+
+  let stripes: Mutex<Vec<Option<Box<Stripe>>>> = Mutex::new(
+    (0..height.div_ceil(rows_per_stripe))
+      .map(|_| None)
+      .collect(),
+  );
+
+  let on_pixels = |x: usize, y: usize, pixels: PixelRun| {
+    let index = y / rows_per_stripe;
+
+    // Get the stripe's buffer, allocating it if this is the first run of
+    // pixels written into it. The stripe isn't removed while libjxl is
+    // running, so its buffer can be written to after the lock is released.
+    let (output, remaining_pixels) = {
+      let mut stripes = stripes.lock().unwrap();
+
+      let stripe = stripes[index].get_or_insert_with(|| {
+        let pixel_count = width * stripe_height(index);
+
+        Box::new(Stripe {
+          output_buffer: OutputBuffer::new(
+            bits_allocated,
+            is_signed,
+            pixel_count * samples_per_pixel,
+          ),
+          remaining_pixels: AtomicUsize::new(pixel_count),
+        })
+      });
+
+      let (output_ptr, _) = stripe.output_buffer.as_mut_ptr_and_size();
+
+      (
+        RegionOutput(output_ptr as *mut u8),
+        &raw const stripe.remaining_pixels,
+      )
+    };
+
+    let pixels = pixels.as_bytes();
+    let pixel_count = pixels.len() / pixel_size;
+    let row = y - index * rows_per_stripe;
+
+    unsafe {
+      core::ptr::copy_nonoverlapping(
+        pixels.as_ptr(),
+        output.ptr().add((row * width + x) * pixel_size),
+        pixels.len(),
+      );
+
+      (*remaining_pixels).fetch_sub(pixel_count, Ordering::Relaxed);
+    }
+  };
+
+  let mut session = if image_pixel_module.is_monochrome() {
+    DecodeSession::new_monochrome_image_out(
+      image_pixel_module,
+      thread_count,
+      &on_pixels,
+    )?
+  } else {
+    DecodeSession::new_color_image_out(
+      image_pixel_module,
+      thread_count,
+      &on_pixels,
+    )?
   };
 
-  // On error, read the error message string
+  let mut next_stripe = 0;
+
+  // Passes on the complete stripes that follow the last one passed on. This is
+  // only called while libjxl isn't running.
+  let mut emit_complete_stripes =
+    |next_stripe: &mut usize| -> Result<(), PixelDataDecodeError> {
+      loop {
+        let stripe = {
+          let mut stripes = stripes.lock().unwrap();
+
+          let Some(slot) = stripes.get_mut(*next_stripe) else {
+            return Ok(());
+          };
+
+          let is_complete = slot.as_ref().is_some_and(|stripe| {
+            stripe.remaining_pixels.load(Ordering::Relaxed) == 0
+          });
+          if !is_complete {
+            return Ok(());
+          }
+
+          slot.take().unwrap()
+        };
+
+        on_stripe(
+          stripe.output_buffer,
+          stripe_height(*next_stripe) as u16,
+          (*next_stripe * rows_per_stripe) as u16,
+        )?;
+
+        *next_stripe += 1;
+      }
+    };
+
+  for data in fragments
+    .iter()
+    .flat_map(|fragment| fragment.chunks(PUSH_SIZE))
+  {
+    session.push(data)?;
+    emit_complete_stripes(&mut next_stripe)?;
+  }
+
+  session.finish_image_out()?;
+  emit_complete_stripes(&mut next_stripe)?;
+
+  if next_stripe * rows_per_stripe < height {
+    return Err(PixelDataDecodeError::DataInvalid {
+      details: "JPEG XL decode with libjxl did not output every pixel"
+        .to_string(),
+    });
+  }
+
+  Ok(())
+}
+
+/// The output buffer of [`decode_region()`] and [`Stripe`], which image out
+/// functions write into concurrently.
+///
+struct RegionOutput(*mut u8);
+
+unsafe impl Sync for RegionOutput {}
+
+impl RegionOutput {
+  fn ptr(&self) -> *mut u8 {
+    self.0
+  }
+}
+
+impl PixelRun<'_> {
+  /// Returns the bytes of the samples in this run.
+  ///
+  fn as_bytes(&self) -> &[u8] {
+    fn bytes<T>(samples: &[T]) -> &[u8] {
+      unsafe {
+        core::slice::from_raw_parts(
+          samples.as_ptr() as *const u8,
+          core::mem::size_of_val(samples),
+        )
+      }
+    }
+
+    match self {
+      Self::U8(samples) => samples,
+      Self::I8(samples) => bytes(samples),
+      Self::U16(samples) => bytes(samples),
+      Self::I16(samples) => bytes(samples),
+    }
+  }
+}
+
+/// Decodes a batch of whole JPEG XL frames into newly allocated output buffers
+/// with a single call into libjxl.
+///
+fn decode_batch(
+  image_pixel_module: &ImagePixelModule,
+  frames: &[&[u8]],
+  thread_count: usize,
+) -> Vec<Result<OutputBuffer, PixelDataDecodeError>> {
+  let bits_allocated = image_pixel_module.bits_allocated();
+  let is_signed = image_pixel_module.pixel_representation().is_signed();
+  let sample_count = image_pixel_module.pixel_count()
+    * usize::from(u8::from(image_pixel_module.samples_per_pixel()));
+
+  let mut output_buffers: Vec<_> = frames
+    .iter()
+    .map(|_| OutputBuffer::new(bits_allocated, is_signed, sample_count))
+    .collect();
+
+  let mut batch_frames: Vec<_> = frames
+    .iter()
+    .zip(output_buffers.iter_mut())
+    .map(|(data, output_buffer)| {
+      let (output_buffer_ptr, output_buffer_size) =
+        output_buffer.as_mut_ptr_and_size();
+
+      BatchFrame::new(data, output_buffer_ptr, output_buffer_size)
+    })
+    .collect();
+
+  if !batch_frames.is_empty() {
+    unsafe {
+      ffi::libjxl_decode_batch(
+        batch_frames.as_mut_ptr(),
+        batch_frames.len(),
+        image_pixel_module.columns().into(),
+        image_pixel_module.rows().into(),
+        u8::from(image_pixel_module.samples_per_pixel()).into(),
+        u8::from(bits_allocated).into(),
+        is_signed.into(),
+        thread_count,
+      )
+    };
+  }
+
+  batch_frames
+    .iter()
+    .zip(output_buffers)
+    .map(|(frame, output_buffer)| {
+      frame.result("libjxl").map(|()| output_buffer)
+    })
+    .collect()
+}
+
+/// Creates a [`MonochromeImage`] from the samples decoded by libjxl.
+///
+fn monochrome_image(
+  image_pixel_module: &ImagePixelModule,
+  width: u16,
+  height: u16,
+  output_buffer: OutputBuffer,
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  let bits_stored = image_pixel_module.bits_stored();
+  let is_monochrome1 = image_pixel_module
+    .photometric_interpretation()
+    .is_monochrome1();
+
+  match output_buffer {
+    OutputBuffer::U8(buffer) => MonochromeImage::new_u8(
+      width,
+      height,
+      buffer,
+      bits_stored,
+      is_monochrome1,
+    ),
+    OutputBuffer::I8(buffer) => MonochromeImage::new_i8(
+      width,
+      height,
+      buffer,
+      bits_stored,
+      is_monochrome1,
+    ),
+    OutputBuffer::U16(buffer) => MonochromeImage::new_u16(
+      width,
+      height,
+      buffer,
+      bits_stored,
+      is_monochrome1,
+    ),
+    OutputBuffer::I16(buffer) => MonochromeImage::new_i16(
+      width,
+      height,
+      buffer,
+      bits_stored,
+      is_monochrome1,
+    ),
+    OutputBuffer::U32(buffer) => MonochromeImage::new_u32(
+      width,
+      height,
+      buffer,
+      bits_stored,
+      is_monochrome1,
+    ),
+    OutputBuffer::I32(buffer) => MonochromeImage::new_i32(
+      width,
+      height,
+      buffer,
+      bits_stored,
+      is_monochrome1,
+    ),
+  }
+  .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Creates a [`ColorImage`] from the samples decoded by libjxl.
+///
+fn color_image(
+  image_pixel_module: &ImagePixelModule,
+  width: u16,
+  height: u16,
+  output_buffer: OutputBuffer,
+) -> Result<ColorImage, PixelDataDecodeError> {
+  let bits_stored = image_pixel_module.bits_stored();
+
+  match output_buffer {
+    OutputBuffer::U8(buffer) => {
+      ColorImage::new_u8(width, height, buffer, ColorSpace::Rgb, bits_stored)
+    }
+    OutputBuffer::U16(buffer) => {
+      ColorImage::new_u16(width, height, buffer, ColorSpace::Rgb, bits_stored)
+    }
+    _ => Err("Color image samples must be 8-bit or 16-bit unsigned"),
+  }
+  .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// The context passed to [`progression_callback()`] while data is pushed to a
+/// progressive session.
+///
+struct ProgressionContext<'b> {
+  output_buffer: *const OutputBuffer,
+  on_progression: &'b mut dyn FnMut(&OutputBuffer) -> bool,
+}
+
+/// This function is passed as a callback to
+/// [`ffi::libjxl_decode_session_create()`] and is called by libjxl's worker
+/// threads with each run of decoded pixels.
+///
+extern "C" fn image_out_callback(
+  context: *mut core::ffi::c_void,
+  x: usize,
+  y: usize,
+  num_pixels: usize,
+  pixels: *const core::ffi::c_void,
+) {
+  unsafe {
+    let context = &*(context as *const ImageOutContext);
+    let sample_count = num_pixels * context.samples_per_pixel;
+
+    let pixels = match (context.bits_allocated, context.is_signed) {
+      (BitsAllocated::Sixteen, false) => PixelRun::U16(
+        core::slice::from_raw_parts(pixels as *const u16, sample_count),
+      ),
+      (BitsAllocated::Sixteen, true) => PixelRun::I16(
+        core::slice::from_raw_parts(pixels as *const i16, sample_count),
+      ),
+      (_, true) => PixelRun::I8(core::slice::from_raw_parts(
+        pixels as *const i8,
+        sample_count,
+      )),
+      (_, false) => PixelRun::U8(core::slice::from_raw_parts(
+        pixels as *const u8,
+        sample_count,
+      )),
+    };
+
+    (context.on_pixels)(x, y, pixels);
+  }
+}
+
+/// This function is passed as a callback to
+/// [`ffi::libjxl_decode_session_push()`] and is called each time libjxl has
+/// flushed a preview to the output buffer. Returns non-zero to stop decoding.
+///
+extern "C" fn progression_callback(context: *mut core::ffi::c_void) -> usize {
+  unsafe {
+    let context = &mut *(context as *mut ProgressionContext);
+
+    (context.on_progression)(&*context.output_buffer).into()
+  }
+}
+
+/// Converts the result of a call into libjxl into a [`Result`], reading the
+/// error message string on error.
+///
+fn check_result(
+  result: usize,
+  error_message: &[core::ffi::c_char],
+) -> Result<(), PixelDataDecodeError> {
   if result != 0 {
     let error_c_str =
       unsafe { core::ffi::CStr::from_ptr(error_message.as_ptr()) };
@@ -173,22 +1392,81 @@ fn decode<T: Clone + Default>(
     });
   }
 
-  Ok(output_buffer)
+  Ok(())
 }
 
 mod ffi {
+  use crate::decode::batch::BatchFrame;
+  use crate::libjxl_thread_pool::ffi::JxlParallelRunner;
+
   unsafe extern "C" {
-    pub fn libjxl_decode(
-      input_data: *const core::ffi::c_void,
-      input_data_size: usize,
+    pub fn libjxl_decode_session_create(
       width: usize,
       height: usize,
       samples_per_pixel: usize,
       bits_allocated: usize,
+      is_signed: usize,
+      progressive: usize,
+      preview: usize,
+      thread_count: usize,
+      custom_runner: Option<JxlParallelRunner>,
+      custom_runner_opaque: *mut core::ffi::c_void,
       output_buffer: *mut core::ffi::c_void,
       output_buffer_size: usize,
+      image_out_callback: Option<
+        extern "C" fn(
+          *mut core::ffi::c_void,
+          usize,
+          usize,
+          usize,
+          *const core::ffi::c_void,
+        ),
+      >,
+      image_out_context: *mut core::ffi::c_void,
+      session: *mut *mut core::ffi::c_void,
+      error_buffer: *mut core::ffi::c_char,
+      error_buffer_size: usize,
+    ) -> usize;
+
+    pub fn libjxl_decode_session_push(
+      session: *mut core::ffi::c_void,
+      data: *const core::ffi::c_void,
+      size: usize,
+      progression_callback: Option<
+        extern "C" fn(*mut core::ffi::c_void) -> usize,
+      >,
+      progression_context: *mut core::ffi::c_void,
       error_buffer: *mut core::ffi::c_char,
       error_buffer_size: usize,
     ) -> usize;
+
+    pub fn libjxl_decode_session_finish(
+      session: *mut core::ffi::c_void,
+      progression_callback: Option<
+        extern "C" fn(*mut core::ffi::c_void) -> usize,
+      >,
+      progression_context: *mut core::ffi::c_void,
+      error_buffer: *mut core::ffi::c_char,
+      error_buffer_size: usize,
+    ) -> usize;
+
+    pub fn libjxl_decode_session_stage_times(
+      session: *const core::ffi::c_void,
+      header_parse_time: *mut u64,
+      decode_time: *mut u64,
+    );
+
+    pub fn libjxl_decode_session_destroy(session: *mut core::ffi::c_void);
+
+    pub fn libjxl_decode_batch(
+      frames: *mut BatchFrame,
+      frame_count: usize,
+      width: usize,
+      height: usize,
+      samples_per_pixel: usize,
+      bits_allocated: usize,
+      is_signed: usize,
+      thread_count: usize,
+    );
   }
 }
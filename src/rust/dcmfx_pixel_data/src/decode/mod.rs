@@ -9,36 +9,77 @@ use alloc::{
 use dcmfx_core::{DcmfxError, TransferSyntax, transfer_syntax};
 
 use crate::{
-  ColorImage, MonochromeImage, PixelDataFrame,
+  ColorImage, MonochromeImage, PixelDataFrame, PlanarYbrImage,
+  SampleStatistics,
+  codec_threads::{self, FrameCodec},
+  color_image::ColorImageData,
   iods::{ImagePixelModule, image_pixel_module::PhotometricInterpretation},
+  transforms::CropRect,
 };
 
+#[cfg(feature = "std")]
+use crate::codec_cancellation::PreviewScope;
+
+#[cfg(all(feature = "native", feature = "std"))]
+mod batch;
 #[cfg(all(feature = "native", feature = "std"))]
 mod charls;
+#[cfg(feature = "std")]
+pub mod external;
+mod incremental;
 #[cfg(feature = "native")]
 mod jpeg_2000;
+#[cfg(feature = "native")]
+mod jpeg_2000_index;
+mod jpeg_baseline_dc;
 mod jpeg_decoder;
+#[cfg(all(feature = "native", feature = "std"))]
+mod jpeg_restart_index;
 mod jpeg_xl;
 mod jxl_oxide;
 #[cfg(feature = "native")]
 mod libjpeg_12bit;
+#[cfg(feature = "native")]
+mod libjpeg_16bit;
+#[cfg(feature = "native")]
+mod libjpeg_8bit;
 #[cfg(all(feature = "native", feature = "std"))]
 mod libjxl;
 mod native;
 #[cfg(feature = "native")]
 mod openjpeg;
-#[cfg(all(feature = "native", feature = "std"))]
+#[cfg(dcmfx_openjph)]
 mod openjph;
+#[cfg(feature = "native")]
+mod output_lut;
+mod probe;
+mod region;
 mod rle_lossless;
 mod zune_jpeg;
 
+#[cfg(feature = "std")]
+pub use external::{ExternalDecoder, set_external_decoder};
+pub use incremental::IncrementalDecoder;
+#[cfg(all(feature = "native", feature = "std"))]
+pub(crate) use libjxl::PixelRun;
+#[cfg(feature = "native")]
+pub(crate) use output_lut::{LutPixels, OutputLut};
+pub use probe::{FrameProbe, probe_frame};
+pub use region::RegionDecoder;
+
 /// Configuration used when decoding pixel data.
 ///
 #[derive(Clone, Copy, Debug, PartialEq)]
 pub struct PixelDataDecodeConfig {
   /// The library to use for decoding High-Throughput JPEG 2000 pixel data.
   /// Defaults to [`HighThroughputJpeg2000Decoder::OpenJph`] except on WASM
-  /// where it defaults to [`HighThroughputJpeg2000Decoder::OpenJpeg`].
+  /// where it defaults to [`HighThroughputJpeg2000Decoder::OpenJpeg`]. WASM
+  /// builds include OpenJPH when they're given a C++ sysroot with
+  /// `DCMFX_WASM_CXX_SYSROOT`, and it can then be selected here.
+  ///
+  /// When this is [`HighThroughputJpeg2000Decoder::OpenJph`], JPEG 2000 Part 1
+  /// frames that only use HT codeblocks are also decoded with OpenJPH. All
+  /// other JPEG 2000 Part 1 frames are decoded with OpenJPEG.
   ///
   pub high_throughput_jpeg_2000_decoder: HighThroughputJpeg2000Decoder,
 
@@ -47,6 +88,105 @@ pub struct PixelDataDecodeConfig {
   /// [`JpegXlDecoder::JxlOxide`].
   ///
   pub jpeg_xl_decoder: JpegXlDecoder,
+
+  /// The library to use for decoding JPEG Lossless pixel data. Defaults to
+  /// [`JpegLosslessDecoder::LibJpeg16Bit`] except on WASM where it defaults to
+  /// [`JpegLosslessDecoder::JpegDecoder`].
+  ///
+  /// libjpeg_16bit is libjpeg's lossless codec built with 16-bit samples, and
+  /// has a fast path for the first-order prediction used by JPEG Lossless SV1.
+  /// There is no difference in output between decoders.
+  ///
+  pub jpeg_lossless_decoder: JpegLosslessDecoder,
+
+  /// The library to use for decoding JPEG Baseline 8-bit pixel data. Defaults
+  /// to [`JpegBaselineDecoder::ZuneJpeg`].
+  ///
+  /// libjpeg_8bit is libjpeg built with 8-bit samples and the SIMD IDCT, color
+  /// conversion, and upsampling routines also used by libjpeg_12bit. It
+  /// decodes runs of restart intervals concurrently in the same way as
+  /// libjpeg_12bit, leaves YBR data as YBR rather than converting it to RGB,
+  /// and decodes reduced resolutions with libjpeg's reduced-size IDCTs. Its
+  /// output can differ very slightly from zune-jpeg's for lossy data.
+  ///
+  pub jpeg_baseline_decoder: JpegBaselineDecoder,
+
+  /// The maximum number of threads a decoder may use to decode a single frame.
+  /// A value of one decodes on the calling thread, and zero uses the decoder's
+  /// default, which is one thread per CPU core for libjxl, CharLS,
+  /// libjpeg_8bit, and libjpeg_12bit, and the calling thread for OpenJPEG and
+  /// OpenJPH. This is used when decoding JPEG XL with libjxl, JPEG-LS with
+  /// CharLS, 8-bit and 12-bit JPEG with libjpeg_8bit and libjpeg_12bit, JPEG
+  /// 2000 with OpenJPEG, and High-Throughput JPEG 2000 with OpenJPEG or
+  /// OpenJPH. It is ignored on WASM. Defaults to 0.
+  ///
+  /// Frames that are too small for a decoder to benefit from multiple threads
+  /// are decoded on the calling thread, as waking worker threads would take
+  /// longer than it saves. The size at which this changes is different for
+  /// each decoder, e.g. it's larger for OpenJPH than for OpenJPEG because
+  /// OpenJPH is much faster per sample.
+  ///
+  /// When the `parallel` feature is enabled, the segments of large RLE
+  /// Lossless frames are also decoded concurrently on this many threads, with
+  /// zero using one thread per CPU core.
+  ///
+  /// CharLS decodes each of a frame's restart intervals separately, and so
+  /// only uses multiple threads for JPEG-LS data that has restart intervals,
+  /// see [`crate::PixelDataEncodeConfig::jpeg_ls_restart_interval()`].
+  ///
+  /// libjpeg_8bit and libjpeg_12bit decode runs of restart intervals
+  /// concurrently when the JPEG data has restart intervals that span whole MCU
+  /// rows, see [`crate::PixelDataEncodeConfig::jpeg_12bit_restart_interval()`].
+  ///
+  /// OpenJPH decodes the codeblocks in each row of codeblocks in parallel, on
+  /// worker threads that are reused across frames.
+  ///
+  /// libjxl's threads are reused across frames, and can be replaced by an
+  /// application's own thread pool, see [`crate::libjxl_thread_pool`].
+  ///
+  /// When the `parallel` feature is enabled, large frames are also cropped and
+  /// rendered by [`crate::PixelDataRenderer`] on this many threads, with zero
+  /// using one thread per CPU core.
+  ///
+  pub thread_count: usize,
+
+  /// The maximum number of quality layers to decode from JPEG 2000 pixel data,
+  /// with zero decoding all of them. Decoding fewer layers is faster and gives
+  /// a lower quality image, e.g. for a preview of a frame that was encoded
+  /// with quality layers, see
+  /// [`crate::PixelDataEncodeConfig::jpeg_2000_quality_layers()`]. This is
+  /// used by OpenJPEG, and is ignored by OpenJPH because High-Throughput JPEG
+  /// 2000 codestreams have a single quality layer. Defaults to 0.
+  ///
+  pub jpeg_2000_quality_layers: u32,
+
+  /// The maximum number of coding passes to decode in each code-block of JPEG
+  /// 2000 and High-Throughput JPEG 2000 pixel data, with zero decoding all of
+  /// them. Later coding passes refine less significant bit planes, so
+  /// decoding fewer of them is faster and gives a lower quality image, e.g.
+  /// for a quick preview of a frame.
+  ///
+  /// For High-Throughput JPEG 2000, a value of one decodes only the cleanup
+  /// pass and skips the SigProp and MagRef refinement passes. For JPEG 2000
+  /// Part 1, each bit plane is coded in up to three passes, so the number of
+  /// bit planes decoded is about a third of this value. This is used by both
+  /// OpenJPEG and OpenJPH. Defaults to 0.
+  ///
+  pub jpeg_2000_coding_passes: u32,
+
+  /// Whether to decode lossy JPEG XL pixel data without libjxl's restoration
+  /// filters, i.e. Gaborish, the edge-preserving filter (EPF), and noise
+  /// synthesis. This is faster and gives an image with more visible block
+  /// edges and ringing, e.g. for a quick preview of a frame. It has no effect
+  /// on lossless data, or on data encoded with
+  /// [`crate::encode::JpegXlEncodeProfile::FastDecode`], which doesn't use
+  /// these filters. This is ignored by jxl-oxide. Defaults to false.
+  ///
+  /// Thumbnails rendered from only the DC (LF) pass of JPEG XL data always
+  /// skip the restoration filters, see
+  /// [`crate::PixelDataRenderer::render_thumbnail()`].
+  ///
+  pub jpeg_xl_preview: bool,
 }
 
 impl Default for PixelDataDecodeConfig {
@@ -55,6 +195,12 @@ impl Default for PixelDataDecodeConfig {
     Self {
       high_throughput_jpeg_2000_decoder: HighThroughputJpeg2000Decoder::OpenJph,
       jpeg_xl_decoder: JpegXlDecoder::LibJxl,
+      jpeg_lossless_decoder: JpegLosslessDecoder::LibJpeg16Bit,
+      jpeg_baseline_decoder: JpegBaselineDecoder::ZuneJpeg,
+      thread_count: 0,
+      jpeg_2000_quality_layers: 0,
+      jpeg_2000_coding_passes: 0,
+      jpeg_xl_preview: false,
     }
   }
 
@@ -64,6 +210,12 @@ impl Default for PixelDataDecodeConfig {
       high_throughput_jpeg_2000_decoder:
         HighThroughputJpeg2000Decoder::OpenJpeg,
       jpeg_xl_decoder: JpegXlDecoder::JxlOxide,
+      jpeg_lossless_decoder: JpegLosslessDecoder::JpegDecoder,
+      jpeg_baseline_decoder: JpegBaselineDecoder::ZuneJpeg,
+      thread_count: 0,
+      jpeg_2000_quality_layers: 0,
+      jpeg_2000_coding_passes: 0,
+      jpeg_xl_preview: false,
     }
   }
 }
@@ -98,6 +250,36 @@ impl core::fmt::Display for JpegXlDecoder {
   }
 }
 
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum JpegLosslessDecoder {
+  LibJpeg16Bit,
+  JpegDecoder,
+}
+
+impl core::fmt::Display for JpegLosslessDecoder {
+  fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+    match self {
+      Self::LibJpeg16Bit => f.write_str("libjpeg_16bit"),
+      Self::JpegDecoder => f.write_str("jpeg-decoder"),
+    }
+  }
+}
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum JpegBaselineDecoder {
+  LibJpeg8Bit,
+  ZuneJpeg,
+}
+
+impl core::fmt::Display for JpegBaselineDecoder {
+  fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+    match self {
+      Self::LibJpeg8Bit => f.write_str("libjpeg_8bit"),
+      Self::ZuneJpeg => f.write_str("zune-jpeg"),
+    }
+  }
+}
+
 /// Errors that can occur when decoding frames of image data in a specific
 /// transfer syntax.
 ///
@@ -126,6 +308,18 @@ pub enum PixelDataDecodeError {
   /// The decoder requested in the decoding config is not available because it
   /// wasn't part of the build.
   DecoderNotAvailable { name: String },
+
+  /// The decode was stopped part way through because its
+  /// [`CancellationToken`](crate::codec_cancellation::CancellationToken) was
+  /// cancelled or its deadline passed.
+  Cancelled,
+
+  /// The decode was stopped because the memory allocated by its codec exceeded
+  /// the budget given to [`run_with_memory_budget()`].
+  ///
+  /// [`run_with_memory_budget()`]:
+  ///   crate::codec_allocator::run_with_memory_budget
+  MemoryBudgetExceeded { budget: usize },
 }
 
 impl PixelDataDecodeError {
@@ -143,6 +337,8 @@ impl PixelDataDecodeError {
       Self::DataInvalid { .. } => "Data invalid".to_string(),
       Self::ImageCreationFailed { .. } => "Image creation failed".to_string(),
       Self::DecoderNotAvailable { .. } => "Decoder not available".to_string(),
+      Self::Cancelled => "Decode cancelled".to_string(),
+      Self::MemoryBudgetExceeded { .. } => "Memory budget exceeded".to_string(),
     }
   }
 }
@@ -169,6 +365,10 @@ impl core::fmt::Display for PixelDataDecodeError {
       Self::DecoderNotAvailable { name } => {
         write!(f, "Decoder '{name}' not available")
       }
+      Self::Cancelled => write!(f, "Decode cancelled"),
+      Self::MemoryBudgetExceeded { budget } => {
+        write!(f, "Decode exceeded its memory budget of {budget} bytes")
+      }
     }
   }
 }
@@ -195,6 +395,10 @@ impl DcmfxError for PixelDataDecodeError {
       Self::DecoderNotAvailable { name } => {
         lines.push(format!("  Name: {name}"));
       }
+      Self::Cancelled => (),
+      Self::MemoryBudgetExceeded { budget } => {
+        lines.push(format!("  Budget: {budget} bytes"));
+      }
     }
 
     lines
@@ -279,12 +483,155 @@ pub fn decode_monochrome(
   image_pixel_module: &ImagePixelModule,
   decode_config: &PixelDataDecodeConfig,
 ) -> Result<MonochromeImage, PixelDataDecodeError> {
+  decode_monochrome_reduced(
+    frame,
+    transfer_syntax,
+    image_pixel_module,
+    decode_config,
+    0,
+  )
+}
+
+/// Decodes a frame of monochrome pixel data into a [`MonochromeImage`] at a
+/// reduced resolution, which is useful for generating thumbnails and previews.
+/// Each level of resolution reduction halves the width and height of the
+/// decoded image, and the finest resolution levels are skipped entirely by the
+/// decoder, which makes decoding faster and use less memory.
+///
+/// Only JPEG 2000, High-Throughput JPEG 2000, 12-bit JPEG, and JPEG Baseline
+/// 8-bit support resolution reduction. Other transfer syntaxes return the full
+/// resolution image. For JPEG 2000 the reduction is limited to the number of
+/// wavelet decompositions in the data, and for 12-bit JPEG it's limited to
+/// three levels, i.e. 1:8 scale, so callers must check the dimensions of the
+/// returned image.
+///
+/// JPEG Baseline 8-bit with a reduction of three or more levels decodes only
+/// the DC coefficient of each block, which gives a 1:8 scale image without
+/// any dequantization or IDCTs. Smaller reductions, and progressive JPEG data,
+/// return the full resolution image.
+///
+pub fn decode_monochrome_reduced(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  resolution_reduction: u32,
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  decode_monochrome_region(
+    frame,
+    transfer_syntax,
+    image_pixel_module,
+    decode_config,
+    &CropRect::default(),
+    resolution_reduction,
+  )
+}
+
+/// Decodes the part of a frame of monochrome pixel data inside a decode area
+/// into a [`MonochromeImage`], optionally at a reduced resolution. The decode
+/// area is specified in full resolution coordinates, and resolution reduction
+/// works the same as for [`decode_monochrome_reduced()`].
+///
+/// JPEG 2000 and High-Throughput JPEG 2000 decoded with OpenJPEG only decode
+/// the tiles and code-blocks that intersect the decode area, which makes
+/// rendering a small region of a large frame much faster. JPEG-LS writes only
+/// the decode area into the output image, and doesn't decode restart intervals
+/// that are outside it. JPEG XL decoded with libjxl stops reading data once
+/// every pixel in the decode area has been decoded, which skips most of the
+/// frame for a viewport over its middle when it was encoded centre-first, see
+/// [`crate::PixelDataEncodeConfig::jpeg_xl_center_first()`]. Other transfer
+/// syntaxes and decoders decode the whole frame and then crop it.
+///
+/// For all JPEG 2000 decoders, tiles that don't intersect the decode area are
+/// left out of the codestream before it's decoded, as are the tile-parts of
+/// resolution levels that aren't needed when the codestream has one tile-part
+/// per resolution level, e.g. High-Throughput JPEG 2000 with RPCL Options.
+///
+/// Frames at full resolution that are supported by the external decoder set
+/// with [`set_external_decoder()`] are decoded whole by it and then cropped.
+///
+pub fn decode_monochrome_region(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  decode_area: &CropRect,
+  resolution_reduction: u32,
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  #[cfg(feature = "std")]
+  let _preview_scope = PreviewScope::enter(decode_config);
+
+  #[cfg(feature = "std")]
+  if resolution_reduction == 0
+    && let Some(decoder) =
+      external::decoder_for(transfer_syntax, image_pixel_module)
+  {
+    let mut results = decode_frames_batch(
+      core::slice::from_mut(frame),
+      transfer_syntax,
+      image_pixel_module,
+      |data| {
+        decoder.decode_monochrome_frames(
+          data,
+          transfer_syntax,
+          image_pixel_module,
+        )
+      },
+    );
+
+    let mut image = results
+      .pop()
+      .expect("External decoder returned no result")?;
+    image.crop_with_threads(decode_area, decode_config.thread_count);
+
+    return Ok(image);
+  }
+
   let frame_bit_offset = frame.bit_offset();
-  let data = frame.combine_chunks();
+  let fragments = decode_fragments(
+    frame,
+    transfer_syntax,
+    image_pixel_module,
+    decode_config,
+    decode_area,
+    resolution_reduction,
+  );
+
+  check_frame_dimensions(&fragments, transfer_syntax, image_pixel_module)?;
+
+  // Leave out the JPEG 2000 tile-parts that aren't needed for the decode area
+  // and resolution
+  #[cfg(feature = "native")]
+  let selected_data = (transfer_syntax.is_jpeg_2000() && fragments.len() == 1)
+    .then(|| {
+      select_jpeg_2000_tile_parts(
+        fragments[0],
+        image_pixel_module,
+        decode_area,
+        resolution_reduction,
+      )
+    })
+    .flatten();
+  #[cfg(feature = "native")]
+  let fragments = match selected_data.as_deref() {
+    Some(data) => vec![data],
+    None => fragments,
+  };
+
+  let decode_config = &frame_decode_config(
+    decode_config,
+    transfer_syntax,
+    image_pixel_module,
+    &fragments,
+    decode_area,
+    resolution_reduction,
+  );
+
+  let data = fragments.first().copied().unwrap_or_default();
 
   use transfer_syntax::*;
 
-  match transfer_syntax {
+  let mut image = match transfer_syntax {
     &IMPLICIT_VR_LITTLE_ENDIAN
     | &EXPLICIT_VR_LITTLE_ENDIAN
     | &ENCAPSULATED_UNCOMPRESSED_EXPLICIT_VR_LITTLE_ENDIAN
@@ -293,46 +640,174 @@ pub fn decode_monochrome(
       native::decode_monochrome(image_pixel_module, data, frame_bit_offset)
     }
 
-    &RLE_LOSSLESS => rle_lossless::decode_monochrome(image_pixel_module, data),
+    &RLE_LOSSLESS => rle_lossless::decode_monochrome(
+      image_pixel_module,
+      data,
+      decode_config.thread_count,
+    ),
 
     &JPEG_BASELINE_8BIT => {
-      zune_jpeg::decode_monochrome(image_pixel_module, data)
+      // At 1:8 scale or smaller only the DC coefficients are needed
+      if resolution_reduction >= 3
+        && let Some(image) =
+          jpeg_baseline_dc::decode_monochrome(image_pixel_module, data)
+      {
+        let mut image = image?;
+
+        image.crop_with_threads(
+          &reduced_decode_area(
+            decode_area,
+            image_pixel_module,
+            image.width(),
+            image.height(),
+          ),
+          decode_config.thread_count,
+        );
+
+        return Ok(image);
+      }
+
+      match decode_config.jpeg_baseline_decoder {
+        #[cfg(feature = "native")]
+        JpegBaselineDecoder::LibJpeg8Bit => {
+          let mut image = libjpeg_8bit::decode_monochrome(
+            image_pixel_module,
+            &fragments,
+            decode_config.thread_count,
+            resolution_reduction,
+          )?;
+
+          image.crop_with_threads(
+            &reduced_decode_area(
+              decode_area,
+              image_pixel_module,
+              image.width(),
+              image.height(),
+            ),
+            decode_config.thread_count,
+          );
+
+          return Ok(image);
+        }
+
+        JpegBaselineDecoder::ZuneJpeg => {
+          zune_jpeg::decode_monochrome(image_pixel_module, data)
+        }
+
+        #[cfg(not(feature = "native"))]
+        decoder => Err(PixelDataDecodeError::DecoderNotAvailable {
+          name: decoder.to_string(),
+        }),
+      }
     }
 
     #[cfg(feature = "native")]
     &JPEG_EXTENDED_12BIT => {
-      libjpeg_12bit::decode_monochrome(image_pixel_module, data)
+      let mut image = libjpeg_12bit::decode_monochrome(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+        resolution_reduction,
+      )?;
+
+      image.crop_with_threads(
+        &reduced_decode_area(
+          decode_area,
+          image_pixel_module,
+          image.width(),
+          image.height(),
+        ),
+        decode_config.thread_count,
+      );
+
+      return Ok(image);
     }
 
     &JPEG_LOSSLESS_NON_HIERARCHICAL | &JPEG_LOSSLESS_NON_HIERARCHICAL_SV1 => {
-      jpeg_decoder::decode_monochrome(image_pixel_module, data)
+      match decode_config.jpeg_lossless_decoder {
+        #[cfg(feature = "native")]
+        JpegLosslessDecoder::LibJpeg16Bit => {
+          libjpeg_16bit::decode_monochrome(image_pixel_module, &fragments)
+        }
+
+        JpegLosslessDecoder::JpegDecoder => {
+          jpeg_decoder::decode_monochrome(image_pixel_module, data)
+        }
+
+        #[cfg(not(feature = "native"))]
+        decoder => Err(PixelDataDecodeError::DecoderNotAvailable {
+          name: decoder.to_string(),
+        }),
+      }
     }
 
     #[cfg(all(feature = "native", feature = "std"))]
     &JPEG_LS_LOSSLESS | &JPEG_LS_LOSSY_NEAR_LOSSLESS => {
-      charls::decode_monochrome(image_pixel_module, data)
+      return charls::decode_monochrome(
+        image_pixel_module,
+        data,
+        decode_area,
+        decode_config.thread_count,
+      );
     }
 
     #[cfg(feature = "native")]
-    &JPEG_2000 | &JPEG_2000_LOSSLESS_ONLY => {
-      openjpeg::decode_monochrome(image_pixel_module, data)
+    &JPEG_2000 | &JPEG_2000_LOSSLESS_ONLY
+      if !is_openjph(transfer_syntax, decode_config, data) =>
+    {
+      return openjpeg::decode_monochrome(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+        Some(decode_area),
+        resolution_reduction,
+        decode_config.jpeg_2000_quality_layers,
+      );
     }
 
+    // JPEG 2000 Part 1 pixel data that only uses HT codeblocks is decoded in
+    // the same way as High-Throughput JPEG 2000
     #[cfg(feature = "native")]
-    &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
+    &JPEG_2000
+    | &JPEG_2000_LOSSLESS_ONLY
+    | &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
     | &HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY
     | &HIGH_THROUGHPUT_JPEG_2000 => {
-      #[cfg(feature = "std")]
+      #[cfg(dcmfx_openjph)]
       if decode_config.high_throughput_jpeg_2000_decoder
         == HighThroughputJpeg2000Decoder::OpenJph
       {
-        return openjph::decode_monochrome(image_pixel_module, data);
+        // Code-blocks that don't affect the decode area are skipped, and the
+        // rest of the decoded image is then cropped away
+        let mut image = openjph::decode_monochrome(
+          image_pixel_module,
+          &fragments,
+          resolution_reduction,
+          decode_config.thread_count,
+          Some(decode_area),
+        )?;
+
+        image.crop(&reduced_decode_area(
+          decode_area,
+          image_pixel_module,
+          image.width(),
+          image.height(),
+        ));
+
+        return Ok(image);
       }
 
       if decode_config.high_throughput_jpeg_2000_decoder
         == HighThroughputJpeg2000Decoder::OpenJpeg
       {
-        return openjpeg::decode_monochrome(image_pixel_module, data);
+        return openjpeg::decode_monochrome(
+          image_pixel_module,
+          &fragments,
+          decode_config.thread_count,
+          Some(decode_area),
+          resolution_reduction,
+          decode_config.jpeg_2000_quality_layers,
+        );
       }
 
       Err(PixelDataDecodeError::DecoderNotAvailable {
@@ -343,11 +818,20 @@ pub fn decode_monochrome(
     &JPEG_XL_LOSSLESS | &JPEG_XL_JPEG_RECOMPRESSION | &JPEG_XL => {
       #[cfg(all(feature = "native", feature = "std"))]
       if decode_config.jpeg_xl_decoder == JpegXlDecoder::LibJxl {
-        return libjxl::decode_monochrome(image_pixel_module, data);
+        return libjxl::decode_monochrome_region(
+          image_pixel_module,
+          &fragments,
+          decode_config.thread_count,
+          decode_area,
+        );
       }
 
       if decode_config.jpeg_xl_decoder == JpegXlDecoder::JxlOxide {
-        return jxl_oxide::decode_monochrome(image_pixel_module, data);
+        let mut image = jxl_oxide::decode_monochrome(image_pixel_module, data)?;
+
+        image.crop_with_threads(decode_area, decode_config.thread_count);
+
+        return Ok(image);
       }
 
       Err(PixelDataDecodeError::DecoderNotAvailable {
@@ -364,7 +848,12 @@ pub fn decode_monochrome(
     _ => {
       Err(PixelDataDecodeError::TransferSyntaxNotSupported { transfer_syntax })
     }
-  }
+  }?;
+
+  // The remaining decoders always decode the whole image at full resolution
+  image.crop_with_threads(decode_area, decode_config.thread_count);
+
+  Ok(image)
 }
 
 /// Decodes a frame of color pixel data into a [`ColorImage`].
@@ -375,55 +864,290 @@ pub fn decode_color(
   image_pixel_module: &ImagePixelModule,
   decode_config: &PixelDataDecodeConfig,
 ) -> Result<ColorImage, PixelDataDecodeError> {
-  let data = frame.combine_chunks();
+  decode_color_reduced(
+    frame,
+    transfer_syntax,
+    image_pixel_module,
+    decode_config,
+    0,
+  )
+}
+
+/// Decodes a frame of color pixel data into a [`ColorImage`] at a reduced
+/// resolution. See [`decode_monochrome_reduced()`] for details.
+///
+pub fn decode_color_reduced(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  resolution_reduction: u32,
+) -> Result<ColorImage, PixelDataDecodeError> {
+  decode_color_region(
+    frame,
+    transfer_syntax,
+    image_pixel_module,
+    decode_config,
+    &CropRect::default(),
+    resolution_reduction,
+  )
+}
+
+/// Decodes the part of a frame of color pixel data inside a decode area into a
+/// [`ColorImage`], optionally at a reduced resolution. See
+/// [`decode_monochrome_region()`] for details.
+///
+pub fn decode_color_region(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  decode_area: &CropRect,
+  resolution_reduction: u32,
+) -> Result<ColorImage, PixelDataDecodeError> {
+  #[cfg(feature = "std")]
+  let _preview_scope = PreviewScope::enter(decode_config);
+
+  #[cfg(feature = "std")]
+  if resolution_reduction == 0
+    && let Some(decoder) =
+      external::decoder_for(transfer_syntax, image_pixel_module)
+  {
+    let mut results = decode_frames_batch(
+      core::slice::from_mut(frame),
+      transfer_syntax,
+      image_pixel_module,
+      |data| {
+        decoder.decode_color_frames(data, transfer_syntax, image_pixel_module)
+      },
+    );
+
+    let mut image = results
+      .pop()
+      .expect("External decoder returned no result")?;
+    image.crop_with_threads(decode_area, decode_config.thread_count);
+
+    return Ok(image);
+  }
+
+  let fragments = decode_fragments(
+    frame,
+    transfer_syntax,
+    image_pixel_module,
+    decode_config,
+    decode_area,
+    resolution_reduction,
+  );
+
+  check_frame_dimensions(&fragments, transfer_syntax, image_pixel_module)?;
+
+  // Leave out the JPEG 2000 tile-parts that aren't needed for the decode area
+  // and resolution
+  #[cfg(feature = "native")]
+  let selected_data = (transfer_syntax.is_jpeg_2000() && fragments.len() == 1)
+    .then(|| {
+      select_jpeg_2000_tile_parts(
+        fragments[0],
+        image_pixel_module,
+        decode_area,
+        resolution_reduction,
+      )
+    })
+    .flatten();
+  #[cfg(feature = "native")]
+  let fragments = match selected_data.as_deref() {
+    Some(data) => vec![data],
+    None => fragments,
+  };
+
+  let decode_config = &frame_decode_config(
+    decode_config,
+    transfer_syntax,
+    image_pixel_module,
+    &fragments,
+    decode_area,
+    resolution_reduction,
+  );
+
+  let data = fragments.first().copied().unwrap_or_default();
 
   use transfer_syntax::*;
 
-  match transfer_syntax {
+  let mut image = match transfer_syntax {
     &IMPLICIT_VR_LITTLE_ENDIAN
     | &EXPLICIT_VR_LITTLE_ENDIAN
     | &ENCAPSULATED_UNCOMPRESSED_EXPLICIT_VR_LITTLE_ENDIAN
     | &DEFLATED_EXPLICIT_VR_LITTLE_ENDIAN
     | &EXPLICIT_VR_BIG_ENDIAN => native::decode_color(image_pixel_module, data),
 
-    &RLE_LOSSLESS => rle_lossless::decode_color(image_pixel_module, data),
+    &RLE_LOSSLESS => rle_lossless::decode_color(
+      image_pixel_module,
+      data,
+      decode_config.thread_count,
+    ),
+
+    &JPEG_BASELINE_8BIT => {
+      // At 1:8 scale or smaller only the DC coefficients are needed
+      if resolution_reduction >= 3
+        && let Some(image) =
+          jpeg_baseline_dc::decode_color(image_pixel_module, data)
+      {
+        let mut image = image?;
+
+        image.crop_with_threads(
+          &reduced_decode_area(
+            decode_area,
+            image_pixel_module,
+            image.width(),
+            image.height(),
+          ),
+          decode_config.thread_count,
+        );
+
+        return Ok(image);
+      }
 
-    &JPEG_BASELINE_8BIT => zune_jpeg::decode_color(image_pixel_module, data),
+      match decode_config.jpeg_baseline_decoder {
+        #[cfg(feature = "native")]
+        JpegBaselineDecoder::LibJpeg8Bit => {
+          let mut image = libjpeg_8bit::decode_color(
+            image_pixel_module,
+            &fragments,
+            decode_config.thread_count,
+            resolution_reduction,
+          )?;
+
+          image.crop_with_threads(
+            &reduced_decode_area(
+              decode_area,
+              image_pixel_module,
+              image.width(),
+              image.height(),
+            ),
+            decode_config.thread_count,
+          );
+
+          return Ok(image);
+        }
+
+        JpegBaselineDecoder::ZuneJpeg => {
+          zune_jpeg::decode_color(image_pixel_module, data)
+        }
+
+        #[cfg(not(feature = "native"))]
+        decoder => Err(PixelDataDecodeError::DecoderNotAvailable {
+          name: decoder.to_string(),
+        }),
+      }
+    }
 
     #[cfg(feature = "native")]
     &JPEG_EXTENDED_12BIT => {
-      libjpeg_12bit::decode_color(image_pixel_module, data)
+      let mut image = libjpeg_12bit::decode_color(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+        resolution_reduction,
+      )?;
+
+      image.crop_with_threads(
+        &reduced_decode_area(
+          decode_area,
+          image_pixel_module,
+          image.width(),
+          image.height(),
+        ),
+        decode_config.thread_count,
+      );
+
+      return Ok(image);
     }
 
     &JPEG_LOSSLESS_NON_HIERARCHICAL | &JPEG_LOSSLESS_NON_HIERARCHICAL_SV1 => {
-      jpeg_decoder::decode_color(image_pixel_module, data)
+      match decode_config.jpeg_lossless_decoder {
+        #[cfg(feature = "native")]
+        JpegLosslessDecoder::LibJpeg16Bit => {
+          libjpeg_16bit::decode_color(image_pixel_module, &fragments)
+        }
+
+        JpegLosslessDecoder::JpegDecoder => {
+          jpeg_decoder::decode_color(image_pixel_module, data)
+        }
+
+        #[cfg(not(feature = "native"))]
+        decoder => Err(PixelDataDecodeError::DecoderNotAvailable {
+          name: decoder.to_string(),
+        }),
+      }
     }
 
     #[cfg(all(feature = "native", feature = "std"))]
     &JPEG_LS_LOSSLESS | &JPEG_LS_LOSSY_NEAR_LOSSLESS => {
-      charls::decode_color(image_pixel_module, data)
+      return charls::decode_color(
+        image_pixel_module,
+        data,
+        decode_area,
+        decode_config.thread_count,
+      );
     }
 
     #[cfg(feature = "native")]
-    &JPEG_2000 | &JPEG_2000_LOSSLESS_ONLY => {
-      openjpeg::decode_color(image_pixel_module, data)
+    &JPEG_2000 | &JPEG_2000_LOSSLESS_ONLY
+      if !is_openjph(transfer_syntax, decode_config, data) =>
+    {
+      return openjpeg::decode_color(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+        Some(decode_area),
+        resolution_reduction,
+        decode_config.jpeg_2000_quality_layers,
+      );
     }
 
+    // JPEG 2000 Part 1 pixel data that only uses HT codeblocks is decoded in
+    // the same way as High-Throughput JPEG 2000
     #[cfg(feature = "native")]
-    &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
+    &JPEG_2000
+    | &JPEG_2000_LOSSLESS_ONLY
+    | &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
     | &HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY
     | &HIGH_THROUGHPUT_JPEG_2000 => {
-      #[cfg(feature = "std")]
+      #[cfg(dcmfx_openjph)]
       if decode_config.high_throughput_jpeg_2000_decoder
         == HighThroughputJpeg2000Decoder::OpenJph
       {
-        return openjph::decode_color(image_pixel_module, data);
+        // Code-blocks that don't affect the decode area are skipped, and the
+        // rest of the decoded image is then cropped away
+        let mut image = openjph::decode_color(
+          image_pixel_module,
+          &fragments,
+          resolution_reduction,
+          decode_config.thread_count,
+          Some(decode_area),
+        )?;
+
+        image.crop(&reduced_decode_area(
+          decode_area,
+          image_pixel_module,
+          image.width(),
+          image.height(),
+        ));
+
+        return Ok(image);
       }
 
       if decode_config.high_throughput_jpeg_2000_decoder
         == HighThroughputJpeg2000Decoder::OpenJpeg
       {
-        return openjpeg::decode_color(image_pixel_module, data);
+        return openjpeg::decode_color(
+          image_pixel_module,
+          &fragments,
+          decode_config.thread_count,
+          Some(decode_area),
+          resolution_reduction,
+          decode_config.jpeg_2000_quality_layers,
+        );
       }
 
       Err(PixelDataDecodeError::DecoderNotAvailable {
@@ -434,11 +1158,20 @@ pub fn decode_color(
     &JPEG_XL_LOSSLESS | &JPEG_XL_JPEG_RECOMPRESSION | &JPEG_XL => {
       #[cfg(all(feature = "native", feature = "std"))]
       if decode_config.jpeg_xl_decoder == JpegXlDecoder::LibJxl {
-        return libjxl::decode_color(image_pixel_module, data);
+        return libjxl::decode_color_region(
+          image_pixel_module,
+          &fragments,
+          decode_config.thread_count,
+          decode_area,
+        );
       }
 
       if decode_config.jpeg_xl_decoder == JpegXlDecoder::JxlOxide {
-        return jxl_oxide::decode_color(image_pixel_module, data);
+        let mut image = jxl_oxide::decode_color(image_pixel_module, data)?;
+
+        image.crop_with_threads(decode_area, decode_config.thread_count);
+
+        return Ok(image);
       }
 
       Err(PixelDataDecodeError::DecoderNotAvailable {
@@ -454,6 +1187,1451 @@ pub fn decode_color(
     _ => {
       Err(PixelDataDecodeError::TransferSyntaxNotSupported { transfer_syntax })
     }
+  }?;
+
+  // The remaining decoders always decode the whole image at full resolution
+  image.crop_with_threads(decode_area, decode_config.thread_count);
+
+  Ok(image)
+}
+
+/// Decodes a batch of frames of monochrome pixel data into [`MonochromeImage`]s.
+/// The result for each frame is returned in the same order as the frames.
+///
+/// JPEG-LS decoded with CharLS, High-Throughput JPEG 2000 decoded with OpenJPH,
+/// and JPEG XL decoded with libjxl decode the whole batch in a single call into
+/// the codec. The frames are decoded concurrently on up to
+/// [`PixelDataDecodeConfig::thread_count`] threads, with zero using one thread
+/// per CPU core, and each thread sets up its decoder once and reuses it for
+/// every frame it decodes. This is faster than decoding each frame in turn for
+/// batches of small frames, e.g. thumbnails or the tiles of a whole slide
+/// image. Other transfer syntaxes and decoders decode each frame in turn with
+/// [`decode_monochrome()`].
+///
+/// When an external decoder that supports the frames has been set with
+/// [`set_external_decoder()`], the whole batch is passed to it instead.
+///
+pub fn decode_monochrome_frames(
+  frames: &mut [PixelDataFrame],
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+) -> Vec<Result<MonochromeImage, PixelDataDecodeError>> {
+  #[cfg(feature = "std")]
+  if let Some(decoder) =
+    external::decoder_for(transfer_syntax, image_pixel_module)
+  {
+    return decode_frames_batch(
+      frames,
+      transfer_syntax,
+      image_pixel_module,
+      |data| {
+        decoder.decode_monochrome_frames(
+          data,
+          transfer_syntax,
+          image_pixel_module,
+        )
+      },
+    );
+  }
+
+  #[cfg(all(feature = "native", feature = "std"))]
+  {
+    let thread_count = decode_config.thread_count;
+
+    match batch_decoder(transfer_syntax, decode_config) {
+      Some(BatchDecoder::Charls) => {
+        return decode_frames_batch(
+          frames,
+          transfer_syntax,
+          image_pixel_module,
+          |data| {
+            charls::decode_monochrome_batch(
+              image_pixel_module,
+              data,
+              thread_count,
+            )
+          },
+        );
+      }
+
+      Some(BatchDecoder::OpenJph) => {
+        return decode_frames_batch(
+          frames,
+          transfer_syntax,
+          image_pixel_module,
+          |data| {
+            openjph::decode_monochrome_batch(
+              image_pixel_module,
+              data,
+              thread_count,
+            )
+          },
+        );
+      }
+
+      Some(BatchDecoder::LibJxl) => {
+        return decode_frames_batch(
+          frames,
+          transfer_syntax,
+          image_pixel_module,
+          |data| {
+            libjxl::decode_monochrome_batch(
+              image_pixel_module,
+              data,
+              thread_count,
+            )
+          },
+        );
+      }
+
+      None => (),
+    }
+  }
+
+  frames
+    .iter_mut()
+    .map(|frame| {
+      decode_monochrome(
+        frame,
+        transfer_syntax,
+        image_pixel_module,
+        decode_config,
+      )
+    })
+    .collect()
+}
+
+/// Decodes a batch of frames of color pixel data into [`ColorImage`]s. See
+/// [`decode_monochrome_frames()`] for details.
+///
+pub fn decode_color_frames(
+  frames: &mut [PixelDataFrame],
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+) -> Vec<Result<ColorImage, PixelDataDecodeError>> {
+  #[cfg(feature = "std")]
+  if let Some(decoder) =
+    external::decoder_for(transfer_syntax, image_pixel_module)
+  {
+    return decode_frames_batch(
+      frames,
+      transfer_syntax,
+      image_pixel_module,
+      |data| {
+        decoder.decode_color_frames(data, transfer_syntax, image_pixel_module)
+      },
+    );
+  }
+
+  #[cfg(all(feature = "native", feature = "std"))]
+  {
+    let thread_count = decode_config.thread_count;
+
+    match batch_decoder(transfer_syntax, decode_config) {
+      Some(BatchDecoder::Charls) => {
+        return decode_frames_batch(
+          frames,
+          transfer_syntax,
+          image_pixel_module,
+          |data| {
+            charls::decode_color_batch(image_pixel_module, data, thread_count)
+          },
+        );
+      }
+
+      Some(BatchDecoder::OpenJph) => {
+        return decode_frames_batch(
+          frames,
+          transfer_syntax,
+          image_pixel_module,
+          |data| {
+            openjph::decode_color_batch(image_pixel_module, data, thread_count)
+          },
+        );
+      }
+
+      Some(BatchDecoder::LibJxl) => {
+        return decode_frames_batch(
+          frames,
+          transfer_syntax,
+          image_pixel_module,
+          |data| {
+            libjxl::decode_color_batch(image_pixel_module, data, thread_count)
+          },
+        );
+      }
+
+      None => (),
+    }
+  }
+
+  frames
+    .iter_mut()
+    .map(|frame| {
+      decode_color(frame, transfer_syntax, image_pixel_module, decode_config)
+    })
+    .collect()
+}
+
+/// The codecs that can decode a batch of frames in a single call, see
+/// [`decode_monochrome_frames()`].
+///
+#[cfg(all(feature = "native", feature = "std"))]
+enum BatchDecoder {
+  Charls,
+  OpenJph,
+  LibJxl,
+}
+
+/// Returns the codec that decodes a batch of frames in the given transfer
+/// syntax in a single call, if there is one. JPEG 2000 Part 1 isn't batched as
+/// whether each of its frames is decoded with OpenJPH depends on the frame's
+/// codeblocks, see [`is_openjph()`].
+///
+#[cfg(all(feature = "native", feature = "std"))]
+fn batch_decoder(
+  transfer_syntax: &'static TransferSyntax,
+  decode_config: &PixelDataDecodeConfig,
+) -> Option<BatchDecoder> {
+  use transfer_syntax::*;
+
+  match transfer_syntax {
+    &JPEG_LS_LOSSLESS | &JPEG_LS_LOSSY_NEAR_LOSSLESS => {
+      Some(BatchDecoder::Charls)
+    }
+
+    &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
+    | &HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY
+    | &HIGH_THROUGHPUT_JPEG_2000
+      if decode_config.high_throughput_jpeg_2000_decoder
+        == HighThroughputJpeg2000Decoder::OpenJph =>
+    {
+      Some(BatchDecoder::OpenJph)
+    }
+
+    &JPEG_XL_LOSSLESS | &JPEG_XL_JPEG_RECOMPRESSION | &JPEG_XL
+      if decode_config.jpeg_xl_decoder == JpegXlDecoder::LibJxl =>
+    {
+      Some(BatchDecoder::LibJxl)
+    }
+
+    _ => None,
+  }
+}
+
+/// Decodes a batch of frames with a single call to `decode_batch`, which is
+/// passed the combined data of each frame. Frames whose header dimensions
+/// don't match the Image Pixel Module are rejected up front and left out of
+/// the batch, see [`check_frame_dimensions()`].
+///
+#[cfg(feature = "std")]
+fn decode_frames_batch<T>(
+  frames: &mut [PixelDataFrame],
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_batch: impl FnOnce(&[&[u8]]) -> Vec<Result<T, PixelDataDecodeError>>,
+) -> Vec<Result<T, PixelDataDecodeError>> {
+  let data: Vec<&[u8]> = frames
+    .iter_mut()
+    .map(|frame| frame.combine_chunks())
+    .collect();
+
+  let checks: Vec<_> = data
+    .iter()
+    .map(|data| {
+      check_frame_dimensions(&[*data], transfer_syntax, image_pixel_module)
+    })
+    .collect();
+
+  let batch_data: Vec<&[u8]> = data
+    .iter()
+    .zip(checks.iter())
+    .filter(|(_, check)| check.is_ok())
+    .map(|(data, _)| *data)
+    .collect();
+
+  let mut results = decode_batch(&batch_data).into_iter();
+
+  checks
+    .into_iter()
+    .map(|check| {
+      check.and_then(|()| {
+        results
+          .next()
+          .expect("Batch decode returned too few results")
+      })
+    })
+    .collect()
+}
+
+/// Returns a copy of a JPEG 2000 codestream that only has the tile-parts needed
+/// to decode the given area at the given resolution reduction, or `None` if the
+/// whole codestream is needed. This avoids having the decoder read and skip
+/// over tiles and resolution levels that it won't output.
+///
+#[cfg(feature = "native")]
+fn select_jpeg_2000_tile_parts(
+  data: &[u8],
+  image_pixel_module: &ImagePixelModule,
+  decode_area: &CropRect,
+  resolution_reduction: u32,
+) -> Option<Vec<u8>> {
+  let rows = image_pixel_module.rows();
+  let columns = image_pixel_module.columns();
+
+  let (area_height, area_width) = decode_area.apply(rows, columns);
+  if resolution_reduction == 0 && area_width == columns && area_height == rows {
+    return None;
+  }
+
+  let left = u32::from(decode_area.left);
+  let top = u32::from(decode_area.top);
+
+  jpeg_2000_index::Jpeg2000Index::new(data)?.select(
+    data,
+    (
+      left,
+      top,
+      left + u32::from(area_width),
+      top + u32::from(area_height),
+    ),
+    resolution_reduction,
+  )
+}
+
+/// Returns the crop rect that selects a decode area from an image that was
+/// decoded in full, but possibly at a reduced resolution. The number of
+/// resolution levels that were skipped is determined from the dimensions of
+/// the decoded image.
+///
+fn reduced_decode_area(
+  decode_area: &CropRect,
+  image_pixel_module: &ImagePixelModule,
+  width: u16,
+  height: u16,
+) -> CropRect {
+  let rows = image_pixel_module.rows();
+  let columns = image_pixel_module.columns();
+
+  let resolution_reduction = (0..16)
+    .find(|r| {
+      columns.div_ceil(1 << r) == width && rows.div_ceil(1 << r) == height
+    })
+    .unwrap_or(0);
+
+  let (area_height, area_width) = decode_area.apply(rows, columns);
+
+  // Map the edges of the decode area onto the reduced resolution grid in the
+  // same way as JPEG 2000 does
+  let scale = |x: u16| -> u16 {
+    (u32::from(x).div_ceil(1 << resolution_reduction)) as u16
+  };
+
+  let left = scale(decode_area.left);
+  let top = scale(decode_area.top);
+  let right = scale(decode_area.left.saturating_add(area_width));
+  let bottom = scale(decode_area.top.saturating_add(area_height));
+
+  CropRect {
+    left,
+    top,
+    width_or_right: Some(i32::from(right.saturating_sub(left).max(1))),
+    height_or_bottom: Some(i32::from(bottom.saturating_sub(top).max(1))),
+  }
+}
+
+/// Decodes a frame of monochrome pixel data, passing the result to `on_stripe`
+/// as a sequence of horizontal stripes along with the index of each stripe's
+/// first row. Resolution reduction works the same as for
+/// [`decode_monochrome_reduced()`].
+///
+/// High-Throughput JPEG 2000 decoded with OpenJPH is streamed in stripes of
+/// `rows_per_stripe` rows, with the last stripe holding any remaining rows.
+/// Only one stripe is held in memory at a time, which greatly reduces the
+/// memory needed to process very large frames. JPEG XL decoded with libjxl at
+/// full resolution is streamed in the same way, holding only the stripes that
+/// libjxl's streaming render pipeline is writing into, and no full frame
+/// buffer.
+///
+/// JPEG 2000 decoded with OpenJPEG is decoded one band of rows at a time, and
+/// OpenJPEG only holds the code-blocks and wavelet data for the current band.
+/// Bands are passed on in stripes of at most `rows_per_stripe` rows, and for a
+/// frame with multiple tiles each band spans whole rows of tiles.
+///
+/// Other transfer syntaxes and decoders decode the whole frame and pass
+/// it as a single stripe, so callers must handle stripes of any height.
+///
+pub fn decode_monochrome_stripes(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  resolution_reduction: u32,
+  rows_per_stripe: u16,
+  on_stripe: &mut dyn FnMut(MonochromeImage, u16),
+) -> Result<(), PixelDataDecodeError> {
+  #[cfg(feature = "std")]
+  let _preview_scope = PreviewScope::enter(decode_config);
+
+  #[cfg(feature = "native")]
+  {
+    let fragments = frame_fragments(frame);
+
+    #[cfg(dcmfx_openjph)]
+    if is_openjph(
+      transfer_syntax,
+      decode_config,
+      fragments.first().copied().unwrap_or_default(),
+    ) {
+      return openjph::decode_monochrome_stripes(
+        image_pixel_module,
+        &fragments,
+        resolution_reduction,
+        decode_config.thread_count,
+        rows_per_stripe,
+        on_stripe,
+      );
+    }
+
+    if is_openjpeg(transfer_syntax, decode_config, &fragments) {
+      return openjpeg::decode_monochrome_stripes(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+        resolution_reduction,
+        decode_config.jpeg_2000_quality_layers,
+        rows_per_stripe,
+        on_stripe,
+      );
+    }
+
+    #[cfg(feature = "std")]
+    if transfer_syntax.is_jpeg_xl()
+      && decode_config.jpeg_xl_decoder == JpegXlDecoder::LibJxl
+      && resolution_reduction == 0
+      && image_pixel_module.bits_allocated()
+        != crate::iods::image_pixel_module::BitsAllocated::ThirtyTwo
+    {
+      return libjxl::decode_monochrome_stripes(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+        rows_per_stripe,
+        on_stripe,
+      );
+    }
+  }
+
+  #[cfg(not(feature = "native"))]
+  let _ = rows_per_stripe;
+
+  on_stripe(
+    decode_monochrome_reduced(
+      frame,
+      transfer_syntax,
+      image_pixel_module,
+      decode_config,
+      resolution_reduction,
+    )?,
+    0,
+  );
+
+  Ok(())
+}
+
+/// Decodes a frame of color pixel data, passing the result to `on_stripe` as a
+/// sequence of horizontal stripes. See [`decode_monochrome_stripes()`] for
+/// details.
+///
+pub fn decode_color_stripes(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  resolution_reduction: u32,
+  rows_per_stripe: u16,
+  on_stripe: &mut dyn FnMut(ColorImage, u16),
+) -> Result<(), PixelDataDecodeError> {
+  #[cfg(feature = "std")]
+  let _preview_scope = PreviewScope::enter(decode_config);
+
+  #[cfg(feature = "native")]
+  {
+    let fragments = frame_fragments(frame);
+
+    #[cfg(dcmfx_openjph)]
+    if is_openjph(
+      transfer_syntax,
+      decode_config,
+      fragments.first().copied().unwrap_or_default(),
+    ) {
+      return openjph::decode_color_stripes(
+        image_pixel_module,
+        &fragments,
+        resolution_reduction,
+        decode_config.thread_count,
+        rows_per_stripe,
+        on_stripe,
+      );
+    }
+
+    if is_openjpeg(transfer_syntax, decode_config, &fragments) {
+      return openjpeg::decode_color_stripes(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+        resolution_reduction,
+        decode_config.jpeg_2000_quality_layers,
+        rows_per_stripe,
+        on_stripe,
+      );
+    }
+
+    #[cfg(feature = "std")]
+    if transfer_syntax.is_jpeg_xl()
+      && decode_config.jpeg_xl_decoder == JpegXlDecoder::LibJxl
+      && resolution_reduction == 0
+      && image_pixel_module.bits_allocated()
+        != crate::iods::image_pixel_module::BitsAllocated::ThirtyTwo
+    {
+      return libjxl::decode_color_stripes(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+        rows_per_stripe,
+        on_stripe,
+      );
+    }
+  }
+
+  #[cfg(not(feature = "native"))]
+  let _ = rows_per_stripe;
+
+  on_stripe(
+    decode_color_reduced(
+      frame,
+      transfer_syntax,
+      image_pixel_module,
+      decode_config,
+      resolution_reduction,
+    )?,
+    0,
+  );
+
+  Ok(())
+}
+
+/// Decodes a frame of monochrome pixel data into a [`MonochromeImage`],
+/// passing lower quality previews of the image to `on_preview` as they become
+/// available. This allows a first paint of the frame long before it's fully
+/// decoded.
+///
+/// Only lossy JPEG XL decoded with libjxl produces previews. A preview is made
+/// once the DC (LF) pass has been decoded, which is 1:8 scale, and is upsampled
+/// to full resolution. JPEG XL that wasn't encoded progressively, see
+/// [`crate::PixelDataEncodeConfig::jpeg_xl_progressive()`], may not have a
+/// preview. Other transfer syntaxes and decoders don't produce any previews,
+/// and decode the frame in the same way as [`decode_monochrome()`].
+///
+pub fn decode_monochrome_progressive(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  on_preview: &mut dyn FnMut(MonochromeImage),
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  #[cfg(all(feature = "native", feature = "std"))]
+  if transfer_syntax.is_jpeg_xl()
+    && decode_config.jpeg_xl_decoder == JpegXlDecoder::LibJxl
+  {
+    return libjxl::decode_monochrome_progressive(
+      image_pixel_module,
+      &frame_fragments(frame),
+      decode_config.thread_count,
+      on_preview,
+    );
+  }
+
+  #[cfg(not(all(feature = "native", feature = "std")))]
+  let _ = on_preview;
+
+  decode_monochrome(frame, transfer_syntax, image_pixel_module, decode_config)
+}
+
+/// Decodes a frame of color pixel data into a [`ColorImage`], passing lower
+/// quality previews of the image to `on_preview` as they become available. See
+/// [`decode_monochrome_progressive()`] for details.
+///
+pub fn decode_color_progressive(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  on_preview: &mut dyn FnMut(ColorImage),
+) -> Result<ColorImage, PixelDataDecodeError> {
+  #[cfg(all(feature = "native", feature = "std"))]
+  if transfer_syntax.is_jpeg_xl()
+    && decode_config.jpeg_xl_decoder == JpegXlDecoder::LibJxl
+  {
+    return libjxl::decode_color_progressive(
+      image_pixel_module,
+      &frame_fragments(frame),
+      decode_config.thread_count,
+      on_preview,
+    );
+  }
+
+  #[cfg(not(all(feature = "native", feature = "std")))]
+  let _ = on_preview;
+
+  decode_color(frame, transfer_syntax, image_pixel_module, decode_config)
+}
+
+/// Decodes a frame of monochrome JPEG XL pixel data with libjxl, passing runs
+/// of decoded stored values straight to `on_pixels` along with the column and
+/// row of the first pixel in the run, without creating a [`MonochromeImage`].
+/// `on_pixels` is called concurrently from libjxl's worker threads, and runs
+/// are passed in no particular order.
+///
+/// Returns `None` if the frame isn't JPEG XL or isn't decoded with libjxl.
+///
+#[cfg(all(feature = "native", feature = "std"))]
+pub(crate) fn decode_monochrome_jpeg_xl_image_out(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  on_pixels: &(dyn Fn(usize, usize, PixelRun) + Sync),
+) -> Option<Result<(), PixelDataDecodeError>> {
+  if !transfer_syntax.is_jpeg_xl()
+    || decode_config.jpeg_xl_decoder != JpegXlDecoder::LibJxl
+  {
+    return None;
+  }
+
+  Some(libjxl::decode_monochrome_image_out(
+    image_pixel_module,
+    &frame_fragments(frame),
+    decode_config.thread_count,
+    on_pixels,
+  ))
+}
+
+/// Decodes only the DC (LF) pass of a frame of monochrome JPEG XL pixel data
+/// with libjxl, which is 1:8 scale and is returned upsampled to full
+/// resolution. Frames without a DC preview are decoded in full.
+///
+/// Returns `None` if the frame isn't JPEG XL or isn't decoded with libjxl.
+///
+#[cfg(all(feature = "native", feature = "std"))]
+pub(crate) fn decode_monochrome_jpeg_xl_dc(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+) -> Option<Result<MonochromeImage, PixelDataDecodeError>> {
+  if !transfer_syntax.is_jpeg_xl()
+    || decode_config.jpeg_xl_decoder != JpegXlDecoder::LibJxl
+  {
+    return None;
+  }
+
+  Some(libjxl::decode_monochrome_dc(
+    image_pixel_module,
+    &frame_fragments(frame),
+    decode_config.thread_count,
+  ))
+}
+
+/// Decodes only the DC (LF) pass of a frame of color JPEG XL pixel data with
+/// libjxl. See [`decode_monochrome_jpeg_xl_dc()`] for details.
+///
+#[cfg(all(feature = "native", feature = "std"))]
+pub(crate) fn decode_color_jpeg_xl_dc(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+) -> Option<Result<ColorImage, PixelDataDecodeError>> {
+  if !transfer_syntax.is_jpeg_xl()
+    || decode_config.jpeg_xl_decoder != JpegXlDecoder::LibJxl
+  {
+    return None;
+  }
+
+  Some(libjxl::decode_color_dc(
+    image_pixel_module,
+    &frame_fragments(frame),
+    decode_config.thread_count,
+  ))
+}
+
+/// Decodes the part of a frame of monochrome pixel data inside a decode area,
+/// optionally at a reduced resolution, with the decoder writing each pixel as
+/// its entry in the output LUT rather than as a decoded sample. The decode
+/// area and resolution reduction work the same as for
+/// [`decode_monochrome_region()`]. The pixels are returned along with the width
+/// and height of the decoded area.
+///
+/// This avoids creating a [`MonochromeImage`] for the frame and then making a
+/// second pass over it, which is how display pixels are otherwise produced.
+///
+/// Returns `None` if the frame isn't JPEG-LS or JPEG 2000, whose decoders are
+/// the ones that can write through an output LUT.
+///
+#[cfg(feature = "native")]
+pub(crate) fn decode_monochrome_lut(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  decode_area: &CropRect,
+  resolution_reduction: u32,
+  output_lut: &OutputLut,
+) -> Option<Result<LutPixels, PixelDataDecodeError>> {
+  #[cfg(feature = "std")]
+  let _preview_scope = PreviewScope::enter(decode_config);
+
+  let is_jpeg_ls = cfg!(feature = "std")
+    && matches!(
+      transfer_syntax,
+      &transfer_syntax::JPEG_LS_LOSSLESS
+        | &transfer_syntax::JPEG_LS_LOSSY_NEAR_LOSSLESS
+    );
+
+  if !is_jpeg_ls && !transfer_syntax.is_jpeg_2000() {
+    return None;
+  }
+
+  let fragments = decode_fragments(
+    frame,
+    transfer_syntax,
+    image_pixel_module,
+    decode_config,
+    decode_area,
+    resolution_reduction,
+  );
+
+  if let Err(e) =
+    check_frame_dimensions(&fragments, transfer_syntax, image_pixel_module)
+  {
+    return Some(Err(e));
+  }
+
+  // Leave out the JPEG 2000 tile-parts that aren't needed for the decode area
+  // and resolution
+  let selected_data = (transfer_syntax.is_jpeg_2000() && fragments.len() == 1)
+    .then(|| {
+      select_jpeg_2000_tile_parts(
+        fragments[0],
+        image_pixel_module,
+        decode_area,
+        resolution_reduction,
+      )
+    })
+    .flatten();
+  let fragments = match selected_data.as_deref() {
+    Some(data) => vec![data],
+    None => fragments,
+  };
+
+  let decode_config = &frame_decode_config(
+    decode_config,
+    transfer_syntax,
+    image_pixel_module,
+    &fragments,
+    decode_area,
+    resolution_reduction,
+  );
+
+  #[cfg(feature = "std")]
+  if is_jpeg_ls {
+    let (height, width) = decode_area
+      .apply(image_pixel_module.rows(), image_pixel_module.columns());
+
+    return Some(
+      charls::decode_monochrome_lut(
+        image_pixel_module,
+        fragments.first().copied().unwrap_or_default(),
+        decode_area,
+        decode_config.thread_count,
+        output_lut,
+      )
+      .map(|pixels| (pixels, width, height)),
+    );
+  }
+
+  if is_openjpeg(transfer_syntax, decode_config, &fragments) {
+    return Some(openjpeg::decode_monochrome_lut(
+      image_pixel_module,
+      &fragments,
+      decode_config.thread_count,
+      Some(decode_area),
+      resolution_reduction,
+      decode_config.jpeg_2000_quality_layers,
+      output_lut,
+    ));
+  }
+
+  #[cfg(dcmfx_openjph)]
+  if decode_config.high_throughput_jpeg_2000_decoder
+    == HighThroughputJpeg2000Decoder::OpenJph
+  {
+    let result = openjph::decode_monochrome_lut(
+      image_pixel_module,
+      &fragments,
+      resolution_reduction,
+      decode_config.thread_count,
+      output_lut,
+    );
+
+    // OpenJPH decodes the whole frame, so crop the decode area out of it
+    return Some(result.map(|(pixels, width, height)| {
+      let area =
+        reduced_decode_area(decode_area, image_pixel_module, width, height);
+
+      crop_pixels(pixels, width, height, output_lut.entry_size(), &area)
+    }));
+  }
+
+  None
+}
+
+/// Crops rows of pixels that are `pixel_size` bytes in size to the given crop
+/// rect, in place, and returns them along with their new width and height.
+///
+#[cfg(dcmfx_openjph)]
+fn crop_pixels(
+  mut pixels: Vec<u8>,
+  width: u16,
+  height: u16,
+  pixel_size: usize,
+  crop_rect: &CropRect,
+) -> LutPixels {
+  let (crop_height, crop_width) = crop_rect.apply(height, width);
+  if crop_width == width && crop_height == height {
+    return (pixels, width, height);
+  }
+
+  let row_size = usize::from(width) * pixel_size;
+  let crop_row_size = usize::from(crop_width) * pixel_size;
+  let left = usize::from(crop_rect.left) * pixel_size;
+
+  for y in 0..usize::from(crop_height) {
+    let start = (usize::from(crop_rect.top) + y) * row_size + left;
+    pixels.copy_within(start..start + crop_row_size, y * crop_row_size);
+  }
+
+  pixels.truncate(usize::from(crop_height) * crop_row_size);
+
+  (pixels, crop_width, crop_height)
+}
+
+/// Returns whether a frame of pixel data in the given transfer syntax is
+/// decoded with OpenJPEG. Only the first fragment of the frame is checked for
+/// HT codeblocks, as that's where the main header of a JPEG 2000 codestream is.
+///
+#[cfg(feature = "native")]
+fn is_openjpeg(
+  transfer_syntax: &'static TransferSyntax,
+  decode_config: &PixelDataDecodeConfig,
+  fragments: &[&[u8]],
+) -> bool {
+  use transfer_syntax::*;
+
+  match transfer_syntax {
+    &JPEG_2000 | &JPEG_2000_LOSSLESS_ONLY => !is_openjph(
+      transfer_syntax,
+      decode_config,
+      fragments.first().copied().unwrap_or_default(),
+    ),
+
+    &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
+    | &HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY
+    | &HIGH_THROUGHPUT_JPEG_2000 => {
+      decode_config.high_throughput_jpeg_2000_decoder
+        == HighThroughputJpeg2000Decoder::OpenJpeg
+    }
+
+    _ => false,
+  }
+}
+
+/// Returns the fragments of a frame as byte slices.
+///
+#[cfg(feature = "native")]
+fn frame_fragments(frame: &PixelDataFrame) -> Vec<&[u8]> {
+  frame.chunks().iter().map(|chunk| &**chunk).collect()
+}
+
+/// Checks the dimensions in the main header of a frame of compressed pixel data
+/// against the Image Pixel Module, which rejects a mismatched frame before its
+/// decoder allocates any buffers for it. Frames whose header can't be read by
+/// [`probe_frame()`] are left for their decoder to report on.
+///
+fn check_frame_dimensions(
+  fragments: &[&[u8]],
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+) -> Result<(), PixelDataDecodeError> {
+  let Some(Ok(probe)) = fragments
+    .first()
+    .map(|data| probe_frame(data, transfer_syntax))
+  else {
+    return Ok(());
+  };
+
+  let columns = u32::from(image_pixel_module.columns());
+  let rows = u32::from(image_pixel_module.rows());
+
+  // A JPEG height of zero is defined later on by a DNL marker segment
+  if probe.width == columns && (probe.height == rows || probe.height == 0) {
+    return Ok(());
+  }
+
+  Err(PixelDataDecodeError::DataInvalid {
+    details: format!(
+      "Frame header has dimensions {}x{} but the Image Pixel Module has \
+       dimensions {}x{}",
+      probe.width, probe.height, columns, rows
+    ),
+  })
+}
+
+/// Returns the data of a frame in the form it's passed to its decoder. The
+/// fragments of a multi-fragment frame are returned as-is when the decoder
+/// reads a list of fragments, which is the case for the JPEG 2000, JPEG XL
+/// (when using libjxl) and 12-bit JPEG decoders. Otherwise the fragments are
+/// combined and returned as a single fragment.
+///
+/// JPEG 2000 fragments are also combined when tile-parts are going to be left
+/// out of the codestream for the decode area or resolution reduction, see
+/// [`select_jpeg_2000_tile_parts()`].
+///
+fn decode_fragments<'a>(
+  frame: &'a mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  decode_area: &CropRect,
+  resolution_reduction: u32,
+) -> Vec<&'a [u8]> {
+  #[cfg(feature = "native")]
+  if frame.chunks().len() > 1 {
+    use transfer_syntax::*;
+
+    let reads_fragments = match transfer_syntax {
+      &JPEG_EXTENDED_12BIT => true,
+
+      &JPEG_XL_LOSSLESS | &JPEG_XL_JPEG_RECOMPRESSION | &JPEG_XL => {
+        cfg!(feature = "std")
+          && decode_config.jpeg_xl_decoder == JpegXlDecoder::LibJxl
+      }
+
+      _ if transfer_syntax.is_jpeg_2000() => {
+        let rows = image_pixel_module.rows();
+        let columns = image_pixel_module.columns();
+
+        resolution_reduction == 0
+          && decode_area.apply(rows, columns) == (rows, columns)
+      }
+
+      _ => false,
+    };
+
+    if reads_fragments {
+      return frame_fragments(frame);
+    }
+  }
+
+  #[cfg(not(feature = "native"))]
+  let _ = (
+    transfer_syntax,
+    image_pixel_module,
+    decode_config,
+    decode_area,
+    resolution_reduction,
+  );
+
+  vec![frame.combine_chunks()]
+}
+
+/// Returns `decode_config` with its thread count replaced by the number of
+/// threads to decode a frame with, which depends on the codec and the number
+/// of samples it decodes, see [`crate::codec_threads`]. Decoders that don't
+/// use multiple threads are given the thread count unchanged.
+///
+#[cfg_attr(not(feature = "native"), allow(unused_variables))]
+fn frame_decode_config(
+  decode_config: &PixelDataDecodeConfig,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  decode_area: &CropRect,
+  resolution_reduction: u32,
+) -> PixelDataDecodeConfig {
+  use transfer_syntax::*;
+
+  let codec = match transfer_syntax {
+    &RLE_LOSSLESS => FrameCodec::RleLossless,
+
+    &JPEG_BASELINE_8BIT
+      if decode_config.jpeg_baseline_decoder
+        == JpegBaselineDecoder::LibJpeg8Bit =>
+    {
+      FrameCodec::LibJpeg8Bit
+    }
+
+    &JPEG_EXTENDED_12BIT => FrameCodec::LibJpeg12Bit,
+
+    &JPEG_LS_LOSSLESS | &JPEG_LS_LOSSY_NEAR_LOSSLESS => FrameCodec::Charls,
+
+    &JPEG_XL_LOSSLESS | &JPEG_XL_JPEG_RECOMPRESSION | &JPEG_XL
+      if decode_config.jpeg_xl_decoder == JpegXlDecoder::LibJxl =>
+    {
+      FrameCodec::LibJxl
+    }
+
+    #[cfg(feature = "native")]
+    _ if is_openjph(
+      transfer_syntax,
+      decode_config,
+      fragments.first().copied().unwrap_or_default(),
+    ) =>
+    {
+      FrameCodec::OpenJph
+    }
+
+    #[cfg(feature = "native")]
+    _ if is_openjpeg(transfer_syntax, decode_config, fragments) => {
+      FrameCodec::OpenJpeg
+    }
+
+    _ => return *decode_config,
+  };
+
+  // Only CharLS, OpenJPEG and libjxl skip the parts of a frame outside the
+  // decode area, the other decoders always decode the whole frame
+  let decoded_area = match codec {
+    FrameCodec::Charls | FrameCodec::OpenJpeg | FrameCodec::LibJxl => {
+      *decode_area
+    }
+    _ => CropRect::default(),
+  };
+
+  let (rows, columns) =
+    decoded_area.apply(image_pixel_module.rows(), image_pixel_module.columns());
+
+  let resolution_reduction = resolution_reduction.min(16);
+  let sample_count = (usize::from(rows) >> resolution_reduction)
+    * (usize::from(columns) >> resolution_reduction)
+    * usize::from(u8::from(image_pixel_module.samples_per_pixel()));
+
+  PixelDataDecodeConfig {
+    thread_count: codec_threads::frame_thread_count(
+      codec,
+      sample_count,
+      decode_config.thread_count,
+    ),
+    ..*decode_config
+  }
+}
+
+/// Returns whether a frame of pixel data in the given transfer syntax is
+/// decoded with OpenJPH. This is the case for High-Throughput JPEG 2000 when
+/// OpenJPH is the configured decoder, and also for JPEG 2000 Part 1 frames that
+/// only use HT codeblocks, as these are decoded much faster by OpenJPH than by
+/// OpenJPEG.
+///
+#[cfg(feature = "native")]
+fn is_openjph(
+  transfer_syntax: &'static TransferSyntax,
+  decode_config: &PixelDataDecodeConfig,
+  data: &[u8],
+) -> bool {
+  use transfer_syntax::*;
+
+  if !cfg!(dcmfx_openjph)
+    || decode_config.high_throughput_jpeg_2000_decoder
+      != HighThroughputJpeg2000Decoder::OpenJph
+  {
+    return false;
+  }
+
+  match transfer_syntax {
+    &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
+    | &HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY
+    | &HIGH_THROUGHPUT_JPEG_2000 => true,
+
+    &JPEG_2000 | &JPEG_2000_LOSSLESS_ONLY => {
+      jpeg_2000::is_high_throughput_codestream(data)
+    }
+
+    _ => false,
+  }
+}
+
+/// Decodes a frame of monochrome pixel data into a [`MonochromeImage`] in the
+/// same way as [`decode_monochrome()`], and also returns the statistics of its
+/// stored values, i.e. their minimum and maximum, and a coarse histogram if
+/// `include_histogram` is set. These are what's needed to set a default VOI
+/// window or run an auto-window heuristic.
+///
+/// JPEG 2000 and High-Throughput JPEG 2000 data with 8 or 16 bits allocated
+/// gathers the statistics in the decoder as it writes its output, which saves
+/// a further pass over the decoded image. Other frames have their statistics
+/// computed from the decoded image with [`SampleStatistics::from_image()`].
+///
+pub fn decode_monochrome_with_statistics(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+  include_histogram: bool,
+) -> Result<(MonochromeImage, SampleStatistics), PixelDataDecodeError> {
+  #[cfg(feature = "std")]
+  let _preview_scope = PreviewScope::enter(decode_config);
+
+  #[cfg(feature = "std")]
+  let has_external_decoder =
+    external::decoder_for(transfer_syntax, image_pixel_module).is_some();
+  #[cfg(not(feature = "std"))]
+  let has_external_decoder = false;
+
+  #[cfg(feature = "native")]
+  if !has_external_decoder && image_pixel_module.is_monochrome() {
+    let fragments = frame_fragments(frame);
+
+    check_frame_dimensions(&fragments, transfer_syntax, image_pixel_module)?;
+
+    let decode_config = &frame_decode_config(
+      decode_config,
+      transfer_syntax,
+      image_pixel_module,
+      &fragments,
+      &CropRect::default(),
+      0,
+    );
+
+    #[cfg(dcmfx_openjph)]
+    if is_openjph(
+      transfer_syntax,
+      decode_config,
+      fragments.first().copied().unwrap_or_default(),
+    ) {
+      return openjph::decode_monochrome_with_statistics(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+        include_histogram,
+      );
+    }
+
+    if is_openjpeg(transfer_syntax, decode_config, &fragments) {
+      return openjpeg::decode_monochrome_with_statistics(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+        decode_config.jpeg_2000_quality_layers,
+        include_histogram,
+      );
+    }
+  }
+
+  #[cfg(not(feature = "native"))]
+  let _ = has_external_decoder;
+
+  let image = decode_monochrome(
+    frame,
+    transfer_syntax,
+    image_pixel_module,
+    decode_config,
+  )?;
+
+  let statistics = SampleStatistics::from_image(&image, include_histogram);
+
+  Ok((image, statistics))
+}
+
+/// Decodes a frame of color pixel data into raw samples that use a planar
+/// configuration of [`Separate`], i.e. all samples for the
+/// first channel, followed by all samples for the second channel, and so on.
+/// Samples are in native byte order. Palette color data has a single channel
+/// containing the palette indices.
+///
+/// This is useful for callers that want planar data, or only need a single
+/// channel. When decoding JPEG 2000 with OpenJPEG, or High-Throughput JPEG 2000
+/// with OpenJPH, the decoder writes the planes directly, skipping the
+/// interleaved [`ColorImage`] and its allocation. Other transfer syntaxes are
+/// decoded with [`decode_color()`] and then split into planes.
+///
+/// [`Separate`]: crate::iods::image_pixel_module::PlanarConfiguration::Separate
+///
+pub fn decode_color_planar(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+) -> Result<Vec<u8>, PixelDataDecodeError> {
+  #[cfg(feature = "std")]
+  let _preview_scope = PreviewScope::enter(decode_config);
+
+  #[cfg(feature = "native")]
+  {
+    let fragments = frame_fragments(frame);
+
+    if is_openjpeg(transfer_syntax, decode_config, &fragments) {
+      return openjpeg::decode_color_planar(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+      );
+    }
+
+    #[cfg(dcmfx_openjph)]
+    if is_openjph(
+      transfer_syntax,
+      decode_config,
+      fragments.first().copied().unwrap_or_default(),
+    ) {
+      return openjph::decode_color_planar(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+      );
+    }
+  }
+
+  let image =
+    decode_color(frame, transfer_syntax, image_pixel_module, decode_config)?;
+
+  Ok(color_image_to_planar_bytes(&image))
+}
+
+/// Decodes a frame of YBR color pixel data into a [`PlanarYbrImage`], which
+/// has separate Y, Cb, and Cr planes at the resolution they're stored at. This
+/// is for renderers that do chroma upsampling and YBR to RGB conversion
+/// themselves, e.g. in a shader, and it skips that work and the full resolution
+/// interleaved image on the CPU.
+///
+/// The following frames are decoded straight into planes:
+///
+/// - Native YBR_FULL_422 data with 8 bits allocated, which is split into
+///   planes and keeps its half width chroma.
+/// - JPEG Baseline data, which is decoded with libjpeg_8bit's raw data output
+///   and keeps its chroma subsampling.
+/// - JPEG 2000 data that uses the irreversible color transform and is decoded
+///   with OpenJPEG, which skips the inverse color transform. JPEG 2000 doesn't
+///   subsample this data, so its chroma planes are at full resolution.
+///
+/// Other frames are decoded with [`decode_color()`] and then split into planes
+/// by [`PlanarYbrImage::from_color_image()`], which converts RGB to YBR.
+///
+pub fn decode_color_planar_ybr(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+) -> Result<PlanarYbrImage, PixelDataDecodeError> {
+  #[cfg(feature = "std")]
+  let _preview_scope = PreviewScope::enter(decode_config);
+
+  if !transfer_syntax.is_encapsulated
+    && let Some(image) = native::decode_ybr_full_422_planar(
+      image_pixel_module,
+      frame.combine_chunks(),
+    )
+  {
+    return image;
+  }
+
+  #[cfg(feature = "native")]
+  {
+    let fragments = frame_fragments(frame);
+
+    check_frame_dimensions(&fragments, transfer_syntax, image_pixel_module)?;
+
+    let photometric_interpretation =
+      image_pixel_module.photometric_interpretation();
+
+    let image = if transfer_syntax == &transfer_syntax::JPEG_BASELINE_8BIT
+      && photometric_interpretation.is_ybr_full_422()
+    {
+      libjpeg_8bit::decode_ybr_planar(image_pixel_module, &fragments)?
+    } else if photometric_interpretation.is_ybr_ict()
+      && is_openjpeg(transfer_syntax, decode_config, &fragments)
+    {
+      openjpeg::decode_ybr_planar(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+      )?
+    } else {
+      None
+    };
+
+    if let Some(image) = image {
+      return Ok(image);
+    }
+  }
+
+  let image =
+    decode_color(frame, transfer_syntax, image_pixel_module, decode_config)?;
+
+  PlanarYbrImage::from_color_image(image)
+    .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Decodes only the luma of a frame of color pixel data into a MONOCHROME2
+/// [`MonochromeImage`], e.g. for a grayscale preview or thumbnail of a color
+/// frame.
+///
+/// Where the codec stores the luma separately from the chroma the chroma isn't
+/// decoded, which brings the cost of the decode close to that of a monochrome
+/// frame. This is the case for:
+///
+/// - JPEG Baseline YBR data decoded with zune-jpeg or libjpeg_8bit.
+/// - JPEG 2000 data that uses the irreversible or reversible color transform
+///   decoded with OpenJPEG. For the reversible color transform the luma is
+///   `(R + 2G + B) / 4`.
+///
+/// Other data is decoded in full with [`decode_color()`] and its luma is then
+/// taken from the YBR form of the decoded image, converting from RGB or
+/// palette color first where needed.
+///
+pub fn decode_color_luma(
+  frame: &mut PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+  decode_config: &PixelDataDecodeConfig,
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  #[cfg(feature = "std")]
+  let _preview_scope = PreviewScope::enter(decode_config);
+
+  let photometric_interpretation =
+    image_pixel_module.photometric_interpretation();
+
+  let is_jpeg_baseline_ybr = transfer_syntax
+    == &transfer_syntax::JPEG_BASELINE_8BIT
+    && photometric_interpretation.is_ybr_full_422();
+
+  #[cfg(feature = "native")]
+  {
+    let fragments = frame_fragments(frame);
+
+    check_frame_dimensions(&fragments, transfer_syntax, image_pixel_module)?;
+
+    let image = if is_jpeg_baseline_ybr
+      && decode_config.jpeg_baseline_decoder == JpegBaselineDecoder::LibJpeg8Bit
+    {
+      libjpeg_8bit::decode_luma(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+      )?
+    } else if (photometric_interpretation.is_ybr_ict()
+      || photometric_interpretation.is_ybr_rct())
+      && is_openjpeg(transfer_syntax, decode_config, &fragments)
+    {
+      openjpeg::decode_luma(
+        image_pixel_module,
+        &fragments,
+        decode_config.thread_count,
+      )?
+    } else {
+      None
+    };
+
+    if let Some(image) = image {
+      return Ok(image);
+    }
+  }
+
+  if is_jpeg_baseline_ybr
+    && decode_config.jpeg_baseline_decoder == JpegBaselineDecoder::ZuneJpeg
+  {
+    return zune_jpeg::decode_luma(image_pixel_module, frame.combine_chunks());
+  }
+
+  let image =
+    decode_color(frame, transfer_syntax, image_pixel_module, decode_config)?;
+
+  color_image_to_luma(image, decode_config.thread_count)
+}
+
+/// Returns the luma of a [`ColorImage`] as a MONOCHROME2 image.
+///
+fn color_image_to_luma(
+  mut image: ColorImage,
+  thread_count: usize,
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  if image.is_palette_color() {
+    image.convert_palette_color_to_rgb_with_threads(thread_count);
+  }
+
+  image.convert_to_ybr_color_space_with_threads(thread_count);
+
+  let width = image.width();
+  let height = image.height();
+  let bits_stored = image.bits_stored();
+
+  fn luma<T: Copy>(data: &[T]) -> Vec<T> {
+    data.iter().step_by(3).copied().collect()
+  }
+
+  match image.into_data() {
+    ColorImageData::U8 { data, .. } => {
+      MonochromeImage::new_u8(width, height, luma(&data), bits_stored, false)
+    }
+    ColorImageData::U16 { data, .. } => {
+      MonochromeImage::new_u16(width, height, luma(&data), bits_stored, false)
+    }
+    ColorImageData::U32 { data, .. } => {
+      MonochromeImage::new_u32(width, height, luma(&data), bits_stored, false)
+    }
+    ColorImageData::PaletteU8 { .. } | ColorImageData::PaletteU16 { .. } => {
+      Err("Palette color image was not converted to RGB")
+    }
+  }
+  .map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Splits the samples of a [`ColorImage`] into separate planes of native byte
+/// order samples.
+///
+fn color_image_to_planar_bytes(image: &ColorImage) -> Vec<u8> {
+  fn split<T: Copy, const N: usize>(
+    data: &[T],
+    to_ne_bytes: fn(T) -> [u8; N],
+  ) -> Vec<u8> {
+    let pixel_count = data.len() / 3;
+    let mut planes = vec![0u8; data.len() * N];
+
+    for (channel, plane) in planes.chunks_exact_mut(pixel_count * N).enumerate()
+    {
+      for (sample, output) in data
+        .iter()
+        .skip(channel)
+        .step_by(3)
+        .zip(plane.chunks_exact_mut(N))
+      {
+        output.copy_from_slice(&to_ne_bytes(*sample));
+      }
+    }
+
+    planes
+  }
+
+  match image.data() {
+    ColorImageData::U8 { data, .. } => split(data, u8::to_ne_bytes),
+    ColorImageData::U16 { data, .. } => split(data, u16::to_ne_bytes),
+    ColorImageData::U32 { data, .. } => split(data, u32::to_ne_bytes),
+    ColorImageData::PaletteU8 { data, .. } => data.clone(),
+    ColorImageData::PaletteU16 { data, .. } => {
+      data.iter().flat_map(|index| index.to_ne_bytes()).collect()
+    }
   }
 }
 
@@ -1,12 +1,14 @@
 #[cfg(not(feature = "std"))]
-use alloc::{format, string::ToString, vec};
+use alloc::{format, string::ToString};
 
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError,
+  PlanarYbrImage, frame_buffer_pool,
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
     PixelRepresentation, PlanarConfiguration, SamplesPerPixel,
   },
+  sample_unpacking, ybr_conversion,
 };
 
 /// Returns the photometric interpretation used by decoded native pixel data.
@@ -66,11 +68,7 @@ pub fn decode_monochrome(
           let mut data = data.to_vec();
 
           if data_bit_offset > 0 {
-            for i in 0..data.len() {
-              let next_byte = data.get(i + 1).unwrap_or(&0);
-              data[i] = (data[i] >> data_bit_offset)
-                | (next_byte << (8 - data_bit_offset));
-            }
+            sample_unpacking::remove_bit_offset(&mut data, data_bit_offset);
 
             // It's possible there will be an unneeded trailing byte after
             // adjusting for the bit offset, so remove it if present
@@ -95,21 +93,10 @@ pub fn decode_monochrome(
         }
 
         (PixelRepresentation::Signed, BitsAllocated::Eight) => {
-          let mut pixels = vec![0; pixel_count];
+          let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count);
 
           if image_pixel_module.has_unused_high_bits() {
-            let threshold = 2i8.pow(u32::from(bits_stored) - 1);
-
-            for i in 0..pixel_count {
-              let mut pixel = data[i] as i8;
-
-              if pixel >= threshold {
-                pixel -= threshold;
-                pixel -= threshold;
-              }
-
-              pixels[i] = pixel;
-            }
+            sample_unpacking::sign_extend_i8(data, bits_stored, &mut pixels);
           } else {
             pixels.copy_from_slice(&bytemuck::cast_slice(data)[..pixel_count]);
           }
@@ -136,22 +123,10 @@ pub fn decode_monochrome(
         }
 
         (PixelRepresentation::Signed, BitsAllocated::Sixteen) => {
-          let mut pixels = vec![0; pixel_count];
+          let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count);
 
           if image_pixel_module.has_unused_high_bits() {
-            let threshold = 2i16.pow(u32::from(bits_stored) - 1);
-
-            for i in 0..pixel_count {
-              let mut pixel =
-                i16::from_le_bytes([data[i * 2], data[i * 2 + 1]]);
-
-              if pixel >= threshold {
-                pixel -= threshold;
-                pixel -= threshold;
-              }
-
-              pixels[i] = pixel;
-            }
+            sample_unpacking::sign_extend_i16(data, bits_stored, &mut pixels);
           } else {
             #[cfg(target_endian = "little")]
             unsafe {
@@ -179,7 +154,7 @@ pub fn decode_monochrome(
         }
 
         (PixelRepresentation::Unsigned, BitsAllocated::Sixteen) => {
-          let mut pixels = vec![0; pixel_count];
+          let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count);
 
           #[cfg(target_endian = "little")]
           unsafe {
@@ -206,26 +181,10 @@ pub fn decode_monochrome(
         }
 
         (PixelRepresentation::Signed, BitsAllocated::ThirtyTwo) => {
-          let mut pixels = vec![0; pixel_count];
+          let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count);
 
           if image_pixel_module.has_unused_high_bits() {
-            let threshold = 2i32.pow(u32::from(bits_stored) - 1);
-
-            for i in 0..pixel_count {
-              let mut pixel = i32::from_le_bytes([
-                data[i * 4],
-                data[i * 4 + 1],
-                data[i * 4 + 2],
-                data[i * 4 + 3],
-              ]);
-
-              if pixel >= threshold {
-                pixel -= threshold;
-                pixel -= threshold;
-              }
-
-              pixels[i] = pixel;
-            }
+            sample_unpacking::sign_extend_i32(data, bits_stored, &mut pixels);
           } else {
             #[cfg(target_endian = "little")]
             unsafe {
@@ -258,7 +217,7 @@ pub fn decode_monochrome(
         }
 
         (PixelRepresentation::Unsigned, BitsAllocated::ThirtyTwo) => {
-          let mut pixels = vec![0u32; pixel_count];
+          let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count);
 
           #[cfg(target_endian = "little")]
           unsafe {
@@ -339,7 +298,7 @@ pub fn decode_color(
         PhotometricInterpretation::PaletteColor { palette },
         BitsAllocated::Sixteen,
       ) => {
-        let mut pixels = vec![0u16; pixel_count];
+        let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count);
 
         #[cfg(target_endian = "little")]
         unsafe {
@@ -404,7 +363,7 @@ pub fn decode_color(
           }
 
           (PlanarConfiguration::Interleaved, BitsAllocated::Sixteen) => {
-            let mut pixels = vec![0u16; pixel_count * 3];
+            let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
 
             #[cfg(target_endian = "little")]
             unsafe {
@@ -425,7 +384,7 @@ pub fn decode_color(
           }
 
           (PlanarConfiguration::Interleaved, BitsAllocated::ThirtyTwo) => {
-            let mut pixels = vec![0u32; pixel_count * 3];
+            let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
 
             #[cfg(target_endian = "little")]
             unsafe {
@@ -451,7 +410,7 @@ pub fn decode_color(
           }
 
           (PlanarConfiguration::Separate, BitsAllocated::Eight) => {
-            let mut pixels = vec![0u8; pixel_count * 3];
+            let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
 
             for i in 0..pixel_count {
               pixels[i * 3] = data[i];
@@ -464,7 +423,7 @@ pub fn decode_color(
           }
 
           (PlanarConfiguration::Separate, BitsAllocated::Sixteen) => {
-            let mut pixels = vec![0u16; pixel_count * 3];
+            let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
 
             for i in 0..pixel_count {
               pixels[i * 3] =
@@ -486,7 +445,7 @@ pub fn decode_color(
           }
 
           (PlanarConfiguration::Separate, BitsAllocated::ThirtyTwo) => {
-            let mut pixels = vec![0u32; pixel_count * 3];
+            let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
 
             for i in 0..pixel_count {
               pixels[i * 3] = u32::from_le_bytes([
@@ -530,28 +489,19 @@ pub fn decode_color(
           }
 
           (PlanarConfiguration::Interleaved, BitsAllocated::Eight) => {
-            let mut pixels = vec![0u8; pixel_count * 3];
-
-            for i in 0..(pixel_count / 2) {
-              let y0 = data[i * 4];
-              let y1 = data[i * 4 + 1];
-              let cb = data[i * 4 + 2];
-              let cr = data[i * 4 + 3];
+            let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
 
-              pixels[i * 6] = y0;
-              pixels[i * 6 + 1] = cb;
-              pixels[i * 6 + 2] = cr;
-              pixels[i * 6 + 3] = y1;
-              pixels[i * 6 + 4] = cb;
-              pixels[i * 6 + 5] = cr;
-            }
+            ybr_conversion::upsample_ybr_422_u8(
+              &data[..(pixel_count / 2) * 4],
+              &mut pixels,
+            );
 
             ColorImage::new_u8(width, height, pixels, color_space, bits_stored)
               .map_err(PixelDataDecodeError::ImageCreationFailed)
           }
 
           (PlanarConfiguration::Interleaved, BitsAllocated::Sixteen) => {
-            let mut pixels = vec![0u16; pixel_count * 3];
+            let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
 
             for i in 0..(pixel_count / 2) {
               let y0 = u16::from_le_bytes([data[i * 8], data[i * 8 + 1]]);
@@ -572,7 +522,7 @@ pub fn decode_color(
           }
 
           (PlanarConfiguration::Interleaved, BitsAllocated::ThirtyTwo) => {
-            let mut pixels = vec![0u32; pixel_count * 3];
+            let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
 
             for i in 0..(pixel_count / 2) {
               let y0 = u32::from_le_bytes([
@@ -613,7 +563,7 @@ pub fn decode_color(
           }
 
           (PlanarConfiguration::Separate, BitsAllocated::Eight) => {
-            let mut pixels = vec![0u8; pixel_count * 3];
+            let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
 
             for i in 0..(pixel_count / 2) {
               let y0 = data[i * 2];
@@ -634,7 +584,7 @@ pub fn decode_color(
           }
 
           (PlanarConfiguration::Separate, BitsAllocated::Sixteen) => {
-            let mut pixels = vec![0u16; pixel_count * 3];
+            let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
 
             for i in 0..(pixel_count / 2) {
               let y0 = u16::from_le_bytes([data[i * 4], data[i * 4 + 1]]);
@@ -661,7 +611,7 @@ pub fn decode_color(
           }
 
           (PlanarConfiguration::Separate, BitsAllocated::ThirtyTwo) => {
-            let mut pixels = vec![0u32; pixel_count * 3];
+            let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
 
             for i in 0..(pixel_count / 2) {
               let y0 = u32::from_le_bytes([
@@ -714,6 +664,64 @@ pub fn decode_color(
   }
 }
 
+/// Decodes native [`PhotometricInterpretation::YbrFull422`] pixel data with 8
+/// bits allocated and interleaved samples into separate Y, Cb, and Cr planes,
+/// where the Cb and Cr planes keep their half width.
+///
+/// Returns `None` for any other pixel data, which is decoded with
+/// [`decode_color()`] instead.
+///
+pub fn decode_ybr_full_422_planar(
+  image_pixel_module: &ImagePixelModule,
+  data: &[u8],
+) -> Option<Result<PlanarYbrImage, PixelDataDecodeError>> {
+  let width = image_pixel_module.columns();
+  let height = image_pixel_module.rows();
+
+  if !image_pixel_module
+    .photometric_interpretation()
+    .is_ybr_full_422()
+    || image_pixel_module.bits_allocated() != BitsAllocated::Eight
+    || image_pixel_module.planar_configuration()
+      != PlanarConfiguration::Interleaved
+    || width % 2 != 0
+  {
+    return None;
+  }
+
+  if let Err(e) = validate_data_length(image_pixel_module, data) {
+    return Some(Err(e));
+  }
+
+  // Each pair of pixels is stored as Y0, Y1, Cb, Cr
+  let pair_count = image_pixel_module.pixel_count() / 2;
+
+  let mut y = frame_buffer_pool::zeroed_vec(pair_count * 2);
+  let mut cb = frame_buffer_pool::zeroed_vec(pair_count);
+  let mut cr = frame_buffer_pool::zeroed_vec(pair_count);
+
+  for (i, samples) in data[..pair_count * 4].chunks_exact(4).enumerate() {
+    y[i * 2] = samples[0];
+    y[i * 2 + 1] = samples[1];
+    cb[i] = samples[2];
+    cr[i] = samples[3];
+  }
+
+  Some(
+    PlanarYbrImage::new_u8(
+      width,
+      height,
+      width / 2,
+      height,
+      y,
+      cb,
+      cr,
+      image_pixel_module.bits_stored(),
+    )
+    .map_err(PixelDataDecodeError::ImageCreationFailed),
+  )
+}
+
 /// Validates the length of the supplied pixel data.
 ///
 fn validate_data_length(
@@ -742,7 +750,7 @@ mod tests {
   use super::*;
 
   #[cfg(not(feature = "std"))]
-  use alloc::vec::Vec;
+  use alloc::{vec, vec::Vec};
 
   use crate::iods::image_pixel_module::PixelRepresentation;
 
@@ -3,20 +3,88 @@ use alloc::{format, string::ToString, vec, vec::Vec};
 
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError,
+  PlanarYbrImage,
+  decode::{LutPixels, OutputLut},
+  frame_buffer_pool::{self, PoolElement},
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
-    PixelRepresentation,
+    PixelRepresentation, PlanarConfiguration,
   },
+  sample_statistics::{FusedSampleStatistics, SampleStatistics},
+  transforms::CropRect,
 };
 
-/// Decodes monochrome pixel data using OpenJPEG.
+/// Decodes monochrome pixel data using OpenJPEG. If a decode area is specified
+/// then only that part of the image is decoded, and if a resolution reduction
+/// is specified then that many of the finest resolution levels are skipped.
+/// A non-zero number of quality layers decodes only that many of the first
+/// quality layers.
+///
+/// The JPEG 2000 data is passed as a list of fragments that OpenJPEG reads in
+/// turn, so the fragments of encapsulated pixel data don't need to be combined
+/// first. Data in a single fragment is read without being copied into an
+/// intermediate buffer.
 ///
 pub fn decode_monochrome(
   image_pixel_module: &ImagePixelModule,
-  data: &[u8],
+  fragments: &[&[u8]],
+  thread_count: usize,
+  decode_area: Option<&CropRect>,
+  resolution_reduction: u32,
+  quality_layers: u32,
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  monochrome_image(
+    image_pixel_module,
+    Source::Fragments {
+      fragments,
+      thread_count,
+      quality_layers,
+    },
+    decode_area,
+    resolution_reduction,
+    None,
+  )
+}
+
+/// Decodes monochrome pixel data using OpenJPEG in the same way as
+/// [`decode_monochrome()`], and returns the statistics of the decoded samples
+/// along with the image. The statistics are gathered as OpenJPEG's output is
+/// copied into the image, so no further pass over the image is needed.
+///
+pub fn decode_monochrome_with_statistics(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  quality_layers: u32,
+  include_histogram: bool,
+) -> Result<(MonochromeImage, SampleStatistics), PixelDataDecodeError> {
+  let mut statistics =
+    FusedSampleStatistics::new(image_pixel_module, include_histogram);
+
+  let image = monochrome_image(
+    image_pixel_module,
+    Source::Fragments {
+      fragments,
+      thread_count,
+      quality_layers,
+    },
+    None,
+    0,
+    Some(&mut statistics),
+  )?;
+
+  let statistics = statistics.finish(&image);
+
+  Ok((image, statistics))
+}
+
+fn monochrome_image(
+  image_pixel_module: &ImagePixelModule,
+  source: Source,
+  decode_area: Option<&CropRect>,
+  resolution_reduction: u32,
+  statistics: Option<&mut FusedSampleStatistics>,
 ) -> Result<MonochromeImage, PixelDataDecodeError> {
-  let width = image_pixel_module.columns();
-  let height = image_pixel_module.rows();
   let bits_stored = image_pixel_module.bits_stored();
   let is_monochrome1 = image_pixel_module
     .photometric_interpretation()
@@ -35,7 +103,13 @@ pub fn decode_monochrome(
       },
       BitsAllocated::Eight,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        source,
+        decode_area,
+        resolution_reduction,
+        statistics,
+      )?;
       MonochromeImage::new_u8(
         width,
         height,
@@ -55,7 +129,13 @@ pub fn decode_monochrome(
       },
       BitsAllocated::Eight,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        source,
+        decode_area,
+        resolution_reduction,
+        statistics,
+      )?;
       MonochromeImage::new_i8(
         width,
         height,
@@ -75,7 +155,13 @@ pub fn decode_monochrome(
       },
       BitsAllocated::Sixteen,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        source,
+        decode_area,
+        resolution_reduction,
+        statistics,
+      )?;
       MonochromeImage::new_u16(
         width,
         height,
@@ -95,7 +181,13 @@ pub fn decode_monochrome(
       },
       BitsAllocated::Sixteen,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        source,
+        decode_area,
+        resolution_reduction,
+        statistics,
+      )?;
       MonochromeImage::new_i16(
         width,
         height,
@@ -115,7 +207,13 @@ pub fn decode_monochrome(
       },
       BitsAllocated::ThirtyTwo,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        source,
+        decode_area,
+        resolution_reduction,
+        statistics,
+      )?;
       MonochromeImage::new_u32(
         width,
         height,
@@ -135,7 +233,13 @@ pub fn decode_monochrome(
       },
       BitsAllocated::ThirtyTwo,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        source,
+        decode_area,
+        resolution_reduction,
+        statistics,
+      )?;
       MonochromeImage::new_i32(
         width,
         height,
@@ -159,14 +263,35 @@ pub fn decode_monochrome(
   }
 }
 
-/// Decodes color pixel data using OpenJPEG.
+/// Decodes color pixel data using OpenJPEG. See [`decode_monochrome()`] for
+/// details of the decode area, resolution reduction, and quality layers.
 ///
 pub fn decode_color(
   image_pixel_module: &ImagePixelModule,
-  data: &[u8],
+  fragments: &[&[u8]],
+  thread_count: usize,
+  decode_area: Option<&CropRect>,
+  resolution_reduction: u32,
+  quality_layers: u32,
+) -> Result<ColorImage, PixelDataDecodeError> {
+  color_image(
+    image_pixel_module,
+    Source::Fragments {
+      fragments,
+      thread_count,
+      quality_layers,
+    },
+    decode_area,
+    resolution_reduction,
+  )
+}
+
+fn color_image(
+  image_pixel_module: &ImagePixelModule,
+  source: Source,
+  decode_area: Option<&CropRect>,
+  resolution_reduction: u32,
 ) -> Result<ColorImage, PixelDataDecodeError> {
-  let width = image_pixel_module.columns();
-  let height = image_pixel_module.rows();
   let bits_stored = image_pixel_module.bits_stored();
 
   let color_space = if image_pixel_module.photometric_interpretation()
@@ -185,7 +310,13 @@ pub fn decode_color(
       PhotometricInterpretation::PaletteColor { palette },
       BitsAllocated::Eight,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        source,
+        decode_area,
+        resolution_reduction,
+        None,
+      )?;
       ColorImage::new_palette8(
         width,
         height,
@@ -200,7 +331,13 @@ pub fn decode_color(
       PhotometricInterpretation::PaletteColor { palette },
       BitsAllocated::Sixteen,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        source,
+        decode_area,
+        resolution_reduction,
+        None,
+      )?;
       ColorImage::new_palette16(
         width,
         height,
@@ -218,7 +355,13 @@ pub fn decode_color(
       | PhotometricInterpretation::YbrRct,
       BitsAllocated::Eight,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        source,
+        decode_area,
+        resolution_reduction,
+        None,
+      )?;
       ColorImage::new_u8(width, height, pixels, color_space, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
     }
@@ -230,7 +373,13 @@ pub fn decode_color(
       | PhotometricInterpretation::YbrRct,
       BitsAllocated::Sixteen,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        source,
+        decode_area,
+        resolution_reduction,
+        None,
+      )?;
       ColorImage::new_u16(width, height, pixels, color_space, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
     }
@@ -242,7 +391,13 @@ pub fn decode_color(
       | PhotometricInterpretation::YbrRct,
       BitsAllocated::ThirtyTwo,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        source,
+        decode_area,
+        resolution_reduction,
+        None,
+      )?;
       ColorImage::new_u32(width, height, pixels, color_space, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
     }
@@ -260,40 +415,864 @@ pub fn decode_color(
   }
 }
 
-fn decode<T: Clone + Default + bytemuck::Pod>(
+/// Decodes color pixel data using OpenJPEG, returning the raw samples with a
+/// planar configuration of [`PlanarConfiguration::Separate`]. Samples are in
+/// native byte order. OpenJPEG decodes each component into its own plane, so
+/// this avoids the interleaving copy done by [`decode_color()`].
+///
+pub fn decode_color_planar(
   image_pixel_module: &ImagePixelModule,
-  data: &[u8],
-) -> Result<Vec<T>, PixelDataDecodeError> {
-  let samples_per_pixel = u8::from(image_pixel_module.samples_per_pixel());
-  let bits_allocated = u8::from(image_pixel_module.bits_allocated()).max(8);
-  let mut pixel_representation =
-    u8::from(image_pixel_module.pixel_representation()) as usize;
+  fragments: &[&[u8]],
+  thread_count: usize,
+) -> Result<Vec<u8>, PixelDataDecodeError> {
+  match (
+    &image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      PhotometricInterpretation::PaletteColor { .. },
+      BitsAllocated::Eight | BitsAllocated::Sixteen,
+    )
+    | (
+      PhotometricInterpretation::Rgb
+      | PhotometricInterpretation::YbrFull
+      | PhotometricInterpretation::YbrIct
+      | PhotometricInterpretation::YbrRct,
+      BitsAllocated::Eight | BitsAllocated::Sixteen | BitsAllocated::ThirtyTwo,
+    ) => {
+      let mut output_buffer: Vec<u8> = vec![];
+
+      decode_into(
+        image_pixel_module,
+        Source::Fragments {
+          fragments,
+          thread_count,
+          quality_layers: 0,
+        },
+        PlanarConfiguration::Separate,
+        None,
+        0,
+        None,
+        None,
+        &mut output_buffer,
+      )?;
+
+      Ok(output_buffer)
+    }
+
+    (photometric_interpretation, bits_allocated) => {
+      Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "OpenJPEG planar color decode not supported with photometric \
+           interpretation '{}' and bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated)
+        ),
+      })
+    }
+  }
+}
+
+/// Decodes JPEG 2000 pixel data that uses the irreversible color transform
+/// into separate Y, Cb, and Cr planes using OpenJPEG, which skips its inverse
+/// color transform. JPEG 2000 doesn't subsample the components of this data,
+/// so all three planes are at full resolution.
+///
+/// Returns `None` if the data doesn't use the irreversible color transform, in
+/// which case it should be decoded with [`decode_color()`] instead.
+///
+pub fn decode_ybr_planar(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+) -> Result<Option<PlanarYbrImage>, PixelDataDecodeError> {
+  let width = image_pixel_module.columns();
+  let height = image_pixel_module.rows();
+  let bits_stored = image_pixel_module.bits_stored();
+
+  match image_pixel_module.bits_allocated() {
+    BitsAllocated::Eight => {
+      let Some([y, cb, cr]) =
+        decode_ybr_planes::<u8>(image_pixel_module, fragments, thread_count)?
+      else {
+        return Ok(None);
+      };
+
+      PlanarYbrImage::new_u8(
+        width,
+        height,
+        width,
+        height,
+        y,
+        cb,
+        cr,
+        bits_stored,
+      )
+      .map(Some)
+      .map_err(PixelDataDecodeError::ImageCreationFailed)
+    }
+
+    BitsAllocated::Sixteen => {
+      let Some([y, cb, cr]) =
+        decode_ybr_planes::<u16>(image_pixel_module, fragments, thread_count)?
+      else {
+        return Ok(None);
+      };
+
+      PlanarYbrImage::new_u16(
+        width,
+        height,
+        width,
+        height,
+        y,
+        cb,
+        cr,
+        bits_stored,
+      )
+      .map(Some)
+      .map_err(PixelDataDecodeError::ImageCreationFailed)
+    }
+
+    bits_allocated => Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+      details: format!(
+        "OpenJPEG planar YBR decode not supported with bits allocated '{}'",
+        u8::from(bits_allocated)
+      ),
+    }),
+  }
+}
+
+fn decode_ybr_planes<T: PoolElement + bytemuck::Pod>(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+) -> Result<Option<[Vec<T>; 3]>, PixelDataDecodeError> {
+  let input_fragments = input_fragments(fragments);
+  let mut output_buffer: Vec<T> = vec![];
+  let mut is_ybr = 0;
   let mut error_buffer = [0 as core::ffi::c_char; 256];
 
-  // Allocate output buffer
-  let mut output_buffer: Vec<T> = vec![
-    T::default();
-    image_pixel_module.pixel_count()
-      * usize::from(samples_per_pixel)
-  ];
+  let result = unsafe {
+    ffi::openjpeg_decode_ybr_planar(
+      input_fragments.as_ptr(),
+      input_fragments.len(),
+      image_pixel_module.columns().into(),
+      image_pixel_module.rows().into(),
+      u8::from(image_pixel_module.bits_allocated()).into(),
+      thread_count,
+      &mut is_ybr,
+      output_buffer_callback::<T>,
+      &mut output_buffer as *mut Vec<T> as *mut core::ffi::c_void,
+      error_buffer.as_mut_ptr(),
+      error_buffer.len(),
+    )
+  };
+
+  if result != 0 {
+    let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
+      .to_str()
+      .unwrap_or("<invalid error>");
+
+    return Err(PixelDataDecodeError::DataInvalid {
+      details: format!("OpenJPEG decode failed with '{error}'"),
+    });
+  }
+
+  if is_ybr == 0 {
+    return Ok(None);
+  }
+
+  // OpenJPEG writes the planes one after the other into a single buffer
+  let plane_size = output_buffer.len() / 3;
+  let cr = output_buffer.split_off(plane_size * 2);
+  let cb = output_buffer.split_off(plane_size);
+
+  Ok(Some([output_buffer, cb, cr]))
+}
+
+/// Decodes only the luma of JPEG 2000 pixel data that uses the irreversible or
+/// reversible color transform using OpenJPEG. The chroma components aren't
+/// decoded, and so this costs about the same as a monochrome decode. The luma
+/// is returned as a MONOCHROME2 image.
+///
+/// For the reversible color transform the luma is `(R + 2G + B) / 4`, which is
+/// close to but not the same as the luma of the irreversible color transform.
+///
+/// Returns `None` if the data doesn't use a color transform, in which case it
+/// should be decoded with [`decode_color()`] instead.
+///
+pub fn decode_luma(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+) -> Result<Option<MonochromeImage>, PixelDataDecodeError> {
+  let width = image_pixel_module.columns();
+  let height = image_pixel_module.rows();
+  let bits_stored = image_pixel_module.bits_stored();
+
+  match image_pixel_module.bits_allocated() {
+    BitsAllocated::Eight => {
+      let Some(luma) =
+        decode_luma_plane::<u8>(image_pixel_module, fragments, thread_count)?
+      else {
+        return Ok(None);
+      };
+
+      MonochromeImage::new_u8(width, height, luma, bits_stored, false)
+        .map(Some)
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+    }
+
+    BitsAllocated::Sixteen => {
+      let Some(luma) =
+        decode_luma_plane::<u16>(image_pixel_module, fragments, thread_count)?
+      else {
+        return Ok(None);
+      };
+
+      MonochromeImage::new_u16(width, height, luma, bits_stored, false)
+        .map(Some)
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+    }
+
+    bits_allocated => Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+      details: format!(
+        "OpenJPEG luma decode not supported with bits allocated '{}'",
+        u8::from(bits_allocated)
+      ),
+    }),
+  }
+}
+
+fn decode_luma_plane<T: PoolElement + bytemuck::Pod>(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+) -> Result<Option<Vec<T>>, PixelDataDecodeError> {
+  let input_fragments = input_fragments(fragments);
+  let mut output_buffer: Vec<T> = vec![];
+  let mut is_ybr = 0;
+  let mut error_buffer = [0 as core::ffi::c_char; 256];
 
-  // Make FFI call into openjpeg to perform the decompression
   let result = unsafe {
-    ffi::openjpeg_decode(
-      data.as_ptr() as *const core::ffi::c_void,
-      data.len(),
+    ffi::openjpeg_decode_luma(
+      input_fragments.as_ptr(),
+      input_fragments.len(),
       image_pixel_module.columns().into(),
       image_pixel_module.rows().into(),
-      samples_per_pixel.into(),
-      bits_allocated.into(),
-      &mut pixel_representation,
-      output_buffer.as_mut_ptr() as *mut core::ffi::c_void,
-      output_buffer.len() * core::mem::size_of::<T>(),
+      u8::from(image_pixel_module.bits_allocated()).into(),
+      thread_count,
+      &mut is_ybr,
+      output_buffer_callback::<T>,
+      &mut output_buffer as *mut Vec<T> as *mut core::ffi::c_void,
       error_buffer.as_mut_ptr(),
       error_buffer.len(),
     )
   };
 
+  if result != 0 {
+    let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
+      .to_str()
+      .unwrap_or("<invalid error>");
+
+    return Err(PixelDataDecodeError::DataInvalid {
+      details: format!("OpenJPEG decode failed with '{error}'"),
+    });
+  }
+
+  if is_ybr == 0 {
+    return Ok(None);
+  }
+
+  Ok(Some(output_buffer))
+}
+
+/// Decodes monochrome pixel data using OpenJPEG in the same way as
+/// [`decode_monochrome()`], but writes each pixel as its entry in the output
+/// LUT rather than as a decoded sample. The pixels are returned along with the
+/// width and height of the decoded area.
+///
+pub fn decode_monochrome_lut(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  decode_area: Option<&CropRect>,
+  resolution_reduction: u32,
+  quality_layers: u32,
+  output_lut: &OutputLut,
+) -> Result<LutPixels, PixelDataDecodeError> {
+  let mut output_buffer = vec![];
+
+  let (width, height) = decode_into(
+    image_pixel_module,
+    Source::Fragments {
+      fragments,
+      thread_count,
+      quality_layers,
+    },
+    PlanarConfiguration::Interleaved,
+    decode_area,
+    resolution_reduction,
+    Some(output_lut),
+    None,
+    &mut output_buffer,
+  )?;
+
+  Ok((output_buffer, width, height))
+}
+
+/// Decodes monochrome pixel data using OpenJPEG, passing the decoded image to
+/// `on_stripe` as horizontal stripes of at most `rows_per_stripe` rows along
+/// with the index of each stripe's first row. See [`decode_monochrome()`] for
+/// details of the resolution reduction and quality layers.
+///
+/// The image is decoded one band of rows at a time, so OpenJPEG only holds the
+/// code-blocks and wavelet data for the current band rather than for the whole
+/// image. For a codestream with multiple tiles each band spans whole rows of
+/// tiles, and is then passed on in stripes of `rows_per_stripe` rows.
+///
+pub fn decode_monochrome_stripes(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  resolution_reduction: u32,
+  quality_layers: u32,
+  rows_per_stripe: u16,
+  on_stripe: &mut dyn FnMut(MonochromeImage, u16),
+) -> Result<(), PixelDataDecodeError> {
+  decode_rows(
+    image_pixel_module,
+    fragments,
+    thread_count,
+    resolution_reduction,
+    quality_layers,
+    rows_per_stripe,
+    &mut |rows, width, row_count, first_row| {
+      on_stripe(
+        new_monochrome_image(image_pixel_module, width, row_count, rows)?,
+        first_row,
+      );
+
+      Ok(())
+    },
+  )
+}
+
+/// Decodes color pixel data using OpenJPEG, passing the decoded image to
+/// `on_stripe` as horizontal stripes. See [`decode_monochrome_stripes()`] for
+/// details.
+///
+pub fn decode_color_stripes(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  resolution_reduction: u32,
+  quality_layers: u32,
+  rows_per_stripe: u16,
+  on_stripe: &mut dyn FnMut(ColorImage, u16),
+) -> Result<(), PixelDataDecodeError> {
+  decode_rows(
+    image_pixel_module,
+    fragments,
+    thread_count,
+    resolution_reduction,
+    quality_layers,
+    rows_per_stripe,
+    &mut |rows, width, row_count, first_row| {
+      on_stripe(
+        new_color_image(image_pixel_module, width, row_count, rows)?,
+        first_row,
+      );
+
+      Ok(())
+    },
+  )
+}
+
+/// A JPEG 2000 codestream held open by OpenJPEG so that areas of it can be
+/// decoded repeatedly, e.g. as a viewport pans and zooms over a large frame,
+/// without the codestream's main header being read and validated each time.
+///
+/// When the codestream has a single tile, the one OpenJPEG decoder is reused
+/// for every decode at the same resolution reduction. The tile's data is then
+/// only read once, and code-blocks that were decoded for a previous area and
+/// are still inside the new area are not decoded again. OpenJPEG doesn't allow
+/// a decoder to be reused for a codestream with multiple tiles, so it's opened
+/// again for each decode, and relies on any TLM marker segments to seek
+/// straight to the tiles that intersect the area.
+///
+/// OpenJPEG reads the JPEG 2000 data in place, so it must outlive the
+/// codestream.
+///
+pub struct Codestream<'a> {
+  handle: *mut ffi::OpenjpegCodestream,
+  data: core::marker::PhantomData<&'a [u8]>,
+}
+
+impl<'a> Codestream<'a> {
+  /// Opens the JPEG 2000 codestream held in the passed fragments and reads its
+  /// main header. Decodes are done on up to `thread_count` threads, and a
+  /// non-zero number of quality layers decodes only that many of the first
+  /// quality layers.
+  ///
+  pub fn open(
+    image_pixel_module: &ImagePixelModule,
+    fragments: &[&'a [u8]],
+    thread_count: usize,
+    quality_layers: u32,
+  ) -> Result<Self, PixelDataDecodeError> {
+    let samples_per_pixel = u8::from(image_pixel_module.samples_per_pixel());
+    let bits_allocated = u8::from(image_pixel_module.bits_allocated()).max(8);
+    let mut error_buffer = [0 as core::ffi::c_char; 256];
+
+    let input_fragments = input_fragments(fragments);
+
+    let handle = unsafe {
+      ffi::openjpeg_codestream_open(
+        input_fragments.as_ptr(),
+        input_fragments.len(),
+        image_pixel_module.columns().into(),
+        image_pixel_module.rows().into(),
+        samples_per_pixel.into(),
+        bits_allocated.into(),
+        thread_count,
+        quality_layers as usize,
+        error_buffer.as_mut_ptr(),
+        error_buffer.len(),
+      )
+    };
+
+    if handle.is_null() {
+      let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
+        .to_str()
+        .unwrap_or("<invalid error>");
+
+      return Err(PixelDataDecodeError::DataInvalid {
+        details: format!("OpenJPEG decode failed with '{error}'"),
+      });
+    }
+
+    Ok(Self {
+      handle,
+      data: core::marker::PhantomData,
+    })
+  }
+
+  /// Decodes the part of the codestream inside the decode area into a
+  /// [`MonochromeImage`]. See [`decode_monochrome()`] for details.
+  ///
+  pub fn decode_monochrome(
+    &mut self,
+    image_pixel_module: &ImagePixelModule,
+    decode_area: &CropRect,
+    resolution_reduction: u32,
+  ) -> Result<MonochromeImage, PixelDataDecodeError> {
+    monochrome_image(
+      image_pixel_module,
+      Source::Codestream(self),
+      Some(decode_area),
+      resolution_reduction,
+      None,
+    )
+  }
+
+  /// Decodes the part of the codestream inside the decode area into a
+  /// [`ColorImage`]. See [`decode_color()`] for details.
+  ///
+  pub fn decode_color(
+    &mut self,
+    image_pixel_module: &ImagePixelModule,
+    decode_area: &CropRect,
+    resolution_reduction: u32,
+  ) -> Result<ColorImage, PixelDataDecodeError> {
+    color_image(
+      image_pixel_module,
+      Source::Codestream(self),
+      Some(decode_area),
+      resolution_reduction,
+    )
+  }
+}
+
+impl Drop for Codestream<'_> {
+  fn drop(&mut self) {
+    unsafe { ffi::openjpeg_codestream_free(self.handle) };
+  }
+}
+
+// SAFETY: The OpenJPEG codestream has no thread affinity, it just can't be used
+// from multiple threads at the same time, which `&mut self` on decode prevents.
+unsafe impl Send for Codestream<'_> {}
+
+/// Creates a [`MonochromeImage`] from decoded samples in native byte order.
+///
+fn new_monochrome_image(
+  image_pixel_module: &ImagePixelModule,
+  width: u16,
+  height: u16,
+  data: &[u8],
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  let bits_stored = image_pixel_module.bits_stored();
+  let is_monochrome1 = image_pixel_module
+    .photometric_interpretation()
+    .is_monochrome1();
+
+  let image = match (
+    image_pixel_module.is_monochrome(),
+    image_pixel_module.pixel_representation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (true, PixelRepresentation::Unsigned, BitsAllocated::Eight) => {
+      MonochromeImage::new_u8(
+        width,
+        height,
+        data.to_vec(),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (true, PixelRepresentation::Signed, BitsAllocated::Eight) => {
+      MonochromeImage::new_i8(
+        width,
+        height,
+        samples_from_bytes(data),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (true, PixelRepresentation::Unsigned, BitsAllocated::Sixteen) => {
+      MonochromeImage::new_u16(
+        width,
+        height,
+        samples_from_bytes(data),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (true, PixelRepresentation::Signed, BitsAllocated::Sixteen) => {
+      MonochromeImage::new_i16(
+        width,
+        height,
+        samples_from_bytes(data),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (true, PixelRepresentation::Unsigned, BitsAllocated::ThirtyTwo) => {
+      MonochromeImage::new_u32(
+        width,
+        height,
+        samples_from_bytes(data),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (true, PixelRepresentation::Signed, BitsAllocated::ThirtyTwo) => {
+      MonochromeImage::new_i32(
+        width,
+        height,
+        samples_from_bytes(data),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (_, _, bits_allocated) => {
+      return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "OpenJPEG monochrome decode not supported with photometric \
+           interpretation '{}' and bits allocated '{}'",
+          image_pixel_module.photometric_interpretation(),
+          u8::from(bits_allocated),
+        ),
+      });
+    }
+  };
+
+  image.map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Creates a [`ColorImage`] from decoded samples in native byte order.
+///
+fn new_color_image(
+  image_pixel_module: &ImagePixelModule,
+  width: u16,
+  height: u16,
+  data: &[u8],
+) -> Result<ColorImage, PixelDataDecodeError> {
+  let bits_stored = image_pixel_module.bits_stored();
+
+  let color_space = if image_pixel_module.photometric_interpretation()
+    == &PhotometricInterpretation::YbrFull
+  {
+    ColorSpace::Ybr { is_422: false }
+  } else {
+    ColorSpace::Rgb
+  };
+
+  let image = match (
+    &image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      PhotometricInterpretation::PaletteColor { palette },
+      BitsAllocated::Eight,
+    ) => ColorImage::new_palette8(
+      width,
+      height,
+      data.to_vec(),
+      palette.clone(),
+      bits_stored,
+    ),
+
+    (
+      PhotometricInterpretation::PaletteColor { palette },
+      BitsAllocated::Sixteen,
+    ) => ColorImage::new_palette16(
+      width,
+      height,
+      samples_from_bytes(data),
+      palette.clone(),
+      bits_stored,
+    ),
+
+    (
+      PhotometricInterpretation::Rgb
+      | PhotometricInterpretation::YbrFull
+      | PhotometricInterpretation::YbrIct
+      | PhotometricInterpretation::YbrRct,
+      BitsAllocated::Eight,
+    ) => {
+      ColorImage::new_u8(width, height, data.to_vec(), color_space, bits_stored)
+    }
+
+    (
+      PhotometricInterpretation::Rgb
+      | PhotometricInterpretation::YbrFull
+      | PhotometricInterpretation::YbrIct
+      | PhotometricInterpretation::YbrRct,
+      BitsAllocated::Sixteen,
+    ) => ColorImage::new_u16(
+      width,
+      height,
+      samples_from_bytes(data),
+      color_space,
+      bits_stored,
+    ),
+
+    (
+      PhotometricInterpretation::Rgb
+      | PhotometricInterpretation::YbrFull
+      | PhotometricInterpretation::YbrIct
+      | PhotometricInterpretation::YbrRct,
+      BitsAllocated::ThirtyTwo,
+    ) => ColorImage::new_u32(
+      width,
+      height,
+      samples_from_bytes(data),
+      color_space,
+      bits_stored,
+    ),
+
+    (photometric_interpretation, bits_allocated) => {
+      return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "OpenJPEG color decode not supported with photometric \
+           interpretation '{}' and bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated)
+        ),
+      });
+    }
+  };
+
+  image.map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Copies decoded samples in native byte order into a new vector.
+///
+fn samples_from_bytes<T: Clone + Default + bytemuck::Pod>(
+  data: &[u8],
+) -> Vec<T> {
+  let mut samples = vec![T::default(); data.len() / core::mem::size_of::<T>()];
+  bytemuck::cast_slice_mut(&mut samples).copy_from_slice(data);
+  samples
+}
+
+/// The JPEG 2000 data that OpenJPEG decodes.
+///
+enum Source<'a, 'b> {
+  /// Fragments of JPEG 2000 data that are opened for a single decode.
+  Fragments {
+    fragments: &'a [&'a [u8]],
+    thread_count: usize,
+    quality_layers: u32,
+  },
+
+  /// A codestream that's held open across decodes.
+  Codestream(&'a mut Codestream<'b>),
+}
+
+/// Returns the list of fragments passed to OpenJPEG, which reads the data of
+/// each fragment in place.
+///
+fn input_fragments(fragments: &[&[u8]]) -> Vec<ffi::InputFragment> {
+  fragments
+    .iter()
+    .map(|fragment| ffi::InputFragment {
+      data: fragment.as_ptr(),
+      size: fragment.len(),
+    })
+    .collect()
+}
+
+fn decode<T: PoolElement + bytemuck::Pod>(
+  image_pixel_module: &ImagePixelModule,
+  source: Source,
+  decode_area: Option<&CropRect>,
+  resolution_reduction: u32,
+  statistics: Option<&mut FusedSampleStatistics>,
+) -> Result<(Vec<T>, u16, u16), PixelDataDecodeError> {
+  let mut output_buffer: Vec<T> = vec![];
+
+  let (width, height) = decode_into(
+    image_pixel_module,
+    source,
+    PlanarConfiguration::Interleaved,
+    decode_area,
+    resolution_reduction,
+    None,
+    statistics,
+    &mut output_buffer,
+  )?;
+
+  Ok((output_buffer, width, height))
+}
+
+/// Decodes the image into the output buffer, writing each pixel through the
+/// output LUT if one is given, in which case `T` must be `u8`. Statistics of
+/// the decoded samples are gathered into `statistics` if it's set.
+///
+#[allow(clippy::too_many_arguments)]
+fn decode_into<T: PoolElement + bytemuck::Pod>(
+  image_pixel_module: &ImagePixelModule,
+  source: Source,
+  planar_configuration: PlanarConfiguration,
+  decode_area: Option<&CropRect>,
+  resolution_reduction: u32,
+  output_lut: Option<&OutputLut>,
+  mut statistics: Option<&mut FusedSampleStatistics>,
+  output_buffer: &mut Vec<T>,
+) -> Result<(u16, u16), PixelDataDecodeError> {
+  let samples_per_pixel = u8::from(image_pixel_module.samples_per_pixel());
+  let bits_allocated = u8::from(image_pixel_module.bits_allocated()).max(8);
+  let mut pixel_representation =
+    u8::from(image_pixel_module.pixel_representation()) as usize;
+  let planar_configuration = match planar_configuration {
+    PlanarConfiguration::Interleaved => 0,
+    PlanarConfiguration::Separate => 1,
+  };
+  let mut error_buffer = [0 as core::ffi::c_char; 256];
+
+  // Resolve the area to decode, which defaults to the whole image
+  let (area_left, area_top, area_height, area_width) = match decode_area {
+    Some(decode_area) => {
+      let (height, width) = decode_area
+        .apply(image_pixel_module.rows(), image_pixel_module.columns());
+
+      (decode_area.left, decode_area.top, height, width)
+    }
+    None => (
+      0,
+      0,
+      image_pixel_module.rows(),
+      image_pixel_module.columns(),
+    ),
+  };
+
+  let mut width = 0;
+  let mut height = 0;
+
+  let output_lut_ptr = output_lut.map_or(core::ptr::null(), |lut| lut.as_ptr());
+  let output_lut_entry_size = output_lut.map_or(0, |lut| lut.entry_size());
+  let output_buffer_context =
+    output_buffer as *mut Vec<T> as *mut core::ffi::c_void;
+
+  // Statistics are gathered as 32-bit signed values, which can't hold every
+  // unsigned 32-bit sample, so those are left to be computed from the image
+  let statistics_ptr = match statistics.as_deref_mut() {
+    Some(statistics) if bits_allocated != 32 => statistics.as_mut_ptr(),
+    _ => core::ptr::null_mut(),
+  };
+
+  // Make FFI call into openjpeg to perform the decompression
+  let result = match source {
+    Source::Fragments {
+      fragments,
+      thread_count,
+      quality_layers,
+    } => {
+      let input_fragments = input_fragments(fragments);
+
+      unsafe {
+        ffi::openjpeg_decode(
+          input_fragments.as_ptr(),
+          input_fragments.len(),
+          image_pixel_module.columns().into(),
+          image_pixel_module.rows().into(),
+          samples_per_pixel.into(),
+          bits_allocated.into(),
+          planar_configuration,
+          &mut pixel_representation,
+          thread_count,
+          resolution_reduction as usize,
+          quality_layers as usize,
+          area_left.into(),
+          area_top.into(),
+          area_width.into(),
+          area_height.into(),
+          output_lut_ptr,
+          output_lut_entry_size,
+          image_pixel_module.bits_stored().into(),
+          statistics_ptr,
+          &mut width,
+          &mut height,
+          output_buffer_callback::<T>,
+          output_buffer_context,
+          error_buffer.as_mut_ptr(),
+          error_buffer.len(),
+        )
+      }
+    }
+
+    Source::Codestream(codestream) => unsafe {
+      ffi::openjpeg_codestream_decode(
+        codestream.handle,
+        planar_configuration,
+        &mut pixel_representation,
+        resolution_reduction as usize,
+        area_left.into(),
+        area_top.into(),
+        area_width.into(),
+        area_height.into(),
+        output_lut_ptr,
+        output_lut_entry_size,
+        image_pixel_module.bits_stored().into(),
+        &mut width,
+        &mut height,
+        output_buffer_callback::<T>,
+        output_buffer_context,
+        error_buffer.as_mut_ptr(),
+        error_buffer.len(),
+      )
+    },
+  };
+
   // On error, read the error message string
   if result != 0 {
     let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
@@ -315,8 +1294,12 @@ fn decode<T: Clone + Default + bytemuck::Pod>(
     {
       convert_unsigned_values_to_signed_values(
         image_pixel_module,
-        bytemuck::cast_slice_mut(&mut output_buffer),
+        bytemuck::cast_slice_mut(output_buffer.as_mut_slice()),
       );
+
+      if let Some(statistics) = statistics {
+        statistics.invalidate();
+      }
     } else {
       return Err(PixelDataDecodeError::DataInvalid {
         details:
@@ -327,7 +1310,159 @@ fn decode<T: Clone + Default + bytemuck::Pod>(
     }
   }
 
-  Ok(output_buffer)
+  Ok((width as u16, height as u16))
+}
+
+/// This function is passed as a callback to [`ffi::openjpeg_decode()`] and is
+/// called once the size of the decoded image is known in order to allocate the
+/// output buffer. A pointer to its base address is returned.
+///
+extern "C" fn output_buffer_callback<T: PoolElement>(
+  size: usize,
+  context: *mut core::ffi::c_void,
+) -> *mut core::ffi::c_void {
+  unsafe {
+    let output_buffer = &mut *(context as *mut Vec<T>);
+    let len = size / core::mem::size_of::<T>();
+
+    // The first time the output buffer is sized it's taken from the active
+    // frame buffer pool, if there is one
+    if output_buffer.capacity() == 0 {
+      *output_buffer = frame_buffer_pool::zeroed_vec(len);
+    } else {
+      output_buffer.resize(len, T::default());
+    }
+
+    output_buffer.as_mut_ptr() as *mut core::ffi::c_void
+  }
+}
+
+/// Callback that receives chunks of decoded rows from [`decode_rows()`]. It is
+/// passed the decoded samples, the width of the image, the number of rows in
+/// the chunk, and the index of the chunk's first row.
+///
+type OnRows<'a> =
+  dyn FnMut(&[u8], u16, u16, u16) -> Result<(), PixelDataDecodeError> + 'a;
+
+/// Context passed through [`ffi::openjpeg_decode_rows()`] to
+/// [`output_rows_callback()`].
+///
+struct OutputRowsContext<'a, 'b> {
+  on_rows: &'a mut OnRows<'b>,
+  width: usize,
+  bytes_per_pixel: usize,
+  error: Option<PixelDataDecodeError>,
+}
+
+/// Decodes JPEG 2000 data in chunks of rows that are passed to `on_rows` as
+/// they are decoded. Unsigned data is reinterpreted as signed data by OpenJPEG
+/// when the pixel representation is signed.
+///
+fn decode_rows(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  resolution_reduction: u32,
+  quality_layers: u32,
+  rows_per_chunk: u16,
+  on_rows: &mut OnRows,
+) -> Result<(), PixelDataDecodeError> {
+  let samples_per_pixel = u8::from(image_pixel_module.samples_per_pixel());
+  let bits_allocated = u8::from(image_pixel_module.bits_allocated()).max(8);
+  let pixel_representation =
+    u8::from(image_pixel_module.pixel_representation()) as usize;
+  let mut error_buffer = [0 as core::ffi::c_char; 256];
+
+  let mut context = OutputRowsContext {
+    on_rows,
+    width: 0,
+    bytes_per_pixel: usize::from(samples_per_pixel)
+      * usize::from(bits_allocated / 8),
+    error: None,
+  };
+
+  // The width is written by OpenJPEG before the first chunk of rows is passed
+  // to the callback, so derive both pointers from the same place
+  let context_ptr = &mut context as *mut OutputRowsContext;
+  let mut height = 0;
+
+  let input_fragments = input_fragments(fragments);
+
+  // Make FFI call into openjpeg to perform the decompression
+  let result = unsafe {
+    ffi::openjpeg_decode_rows(
+      input_fragments.as_ptr(),
+      input_fragments.len(),
+      image_pixel_module.columns().into(),
+      image_pixel_module.rows().into(),
+      samples_per_pixel.into(),
+      bits_allocated.into(),
+      image_pixel_module.bits_stored().into(),
+      pixel_representation,
+      thread_count,
+      resolution_reduction as usize,
+      quality_layers as usize,
+      rows_per_chunk.into(),
+      &raw mut (*context_ptr).width,
+      &mut height,
+      output_rows_callback,
+      context_ptr as *mut core::ffi::c_void,
+      error_buffer.as_mut_ptr(),
+      error_buffer.len(),
+    )
+  };
+
+  // Errors returned by the callback take precedence
+  if let Some(error) = context.error {
+    return Err(error);
+  }
+
+  // On error, read the error message string
+  if result != 0 {
+    let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
+      .to_str()
+      .unwrap_or("<invalid error>");
+
+    return Err(PixelDataDecodeError::DataInvalid {
+      details: format!("OpenJPEG decode failed with '{error}'"),
+    });
+  }
+
+  Ok(())
+}
+
+/// This function is passed as a callback to [`ffi::openjpeg_decode_rows()`]
+/// and forwards each chunk of decoded rows to the `on_rows` callback held in
+/// the [`OutputRowsContext`]. Returns non-zero to stop decoding if that
+/// callback returns an error.
+///
+extern "C" fn output_rows_callback(
+  data: *const core::ffi::c_void,
+  first_row: usize,
+  row_count: usize,
+  context: *mut core::ffi::c_void,
+) -> i32 {
+  let context = unsafe { &mut *(context as *mut OutputRowsContext) };
+
+  let rows = unsafe {
+    core::slice::from_raw_parts(
+      data as *const u8,
+      context.width * context.bytes_per_pixel * row_count,
+    )
+  };
+
+  match (context.on_rows)(
+    rows,
+    context.width as u16,
+    row_count as u16,
+    first_row as u16,
+  ) {
+    Ok(()) => 0,
+    Err(e) => {
+      context.error = Some(e);
+      1
+    }
+  }
 }
 
 /// Converts unsigned values to signed two's complement values based on the
@@ -380,17 +1515,145 @@ fn convert_unsigned_values_to_signed_values(
 }
 
 mod ffi {
+  use crate::sample_statistics::PixelKernelsStats;
+
+  #[repr(C)]
+  pub struct InputFragment {
+    pub data: *const u8,
+    pub size: usize,
+  }
+
+  #[repr(C)]
+  pub struct OpenjpegCodestream {
+    _private: [u8; 0],
+  }
+
   unsafe extern "C" {
     pub fn openjpeg_decode(
-      input_data: *const core::ffi::c_void,
-      input_data_size: usize,
+      input_fragments: *const InputFragment,
+      input_fragment_count: usize,
+      width: usize,
+      height: usize,
+      samples_per_pixel: usize,
+      bits_allocated: usize,
+      planar_configuration: usize,
+      pixel_representation: *mut usize,
+      thread_count: usize,
+      resolution_reduction: usize,
+      quality_layers: usize,
+      area_left: usize,
+      area_top: usize,
+      area_width: usize,
+      area_height: usize,
+      output_lut: *const u8,
+      output_lut_entry_size: usize,
+      bits_stored: usize,
+      stats: *mut PixelKernelsStats,
+      output_width: *mut usize,
+      output_height: *mut usize,
+      output_buffer_callback: extern "C" fn(
+        usize,
+        *mut core::ffi::c_void,
+      ) -> *mut core::ffi::c_void,
+      output_buffer_context: *mut core::ffi::c_void,
+      error_buffer: *mut core::ffi::c_char,
+      error_buffer_size: usize,
+    ) -> usize;
+
+    pub fn openjpeg_decode_ybr_planar(
+      input_fragments: *const InputFragment,
+      input_fragment_count: usize,
+      width: usize,
+      height: usize,
+      bits_allocated: usize,
+      thread_count: usize,
+      is_ybr: *mut usize,
+      output_buffer_callback: extern "C" fn(
+        usize,
+        *mut core::ffi::c_void,
+      ) -> *mut core::ffi::c_void,
+      output_buffer_context: *mut core::ffi::c_void,
+      error_buffer: *mut core::ffi::c_char,
+      error_buffer_size: usize,
+    ) -> usize;
+
+    pub fn openjpeg_decode_luma(
+      input_fragments: *const InputFragment,
+      input_fragment_count: usize,
+      width: usize,
+      height: usize,
+      bits_allocated: usize,
+      thread_count: usize,
+      is_ybr: *mut usize,
+      output_buffer_callback: extern "C" fn(
+        usize,
+        *mut core::ffi::c_void,
+      ) -> *mut core::ffi::c_void,
+      output_buffer_context: *mut core::ffi::c_void,
+      error_buffer: *mut core::ffi::c_char,
+      error_buffer_size: usize,
+    ) -> usize;
+
+    pub fn openjpeg_codestream_open(
+      input_fragments: *const InputFragment,
+      input_fragment_count: usize,
       width: usize,
       height: usize,
       samples_per_pixel: usize,
       bits_allocated: usize,
+      thread_count: usize,
+      quality_layers: usize,
+      error_buffer: *mut core::ffi::c_char,
+      error_buffer_size: usize,
+    ) -> *mut OpenjpegCodestream;
+
+    pub fn openjpeg_codestream_free(codestream: *mut OpenjpegCodestream);
+
+    pub fn openjpeg_codestream_decode(
+      codestream: *mut OpenjpegCodestream,
+      planar_configuration: usize,
       pixel_representation: *mut usize,
-      output_data: *mut core::ffi::c_void,
-      output_data_size: usize,
+      resolution_reduction: usize,
+      area_left: usize,
+      area_top: usize,
+      area_width: usize,
+      area_height: usize,
+      output_lut: *const u8,
+      output_lut_entry_size: usize,
+      bits_stored: usize,
+      output_width: *mut usize,
+      output_height: *mut usize,
+      output_buffer_callback: extern "C" fn(
+        usize,
+        *mut core::ffi::c_void,
+      ) -> *mut core::ffi::c_void,
+      output_buffer_context: *mut core::ffi::c_void,
+      error_buffer: *mut core::ffi::c_char,
+      error_buffer_size: usize,
+    ) -> usize;
+
+    pub fn openjpeg_decode_rows(
+      input_fragments: *const InputFragment,
+      input_fragment_count: usize,
+      width: usize,
+      height: usize,
+      samples_per_pixel: usize,
+      bits_allocated: usize,
+      bits_stored: usize,
+      pixel_representation: usize,
+      thread_count: usize,
+      resolution_reduction: usize,
+      quality_layers: usize,
+      rows_per_chunk: usize,
+      output_width: *mut usize,
+      output_height: *mut usize,
+      output_rows_callback: extern "C" fn(
+        *const core::ffi::c_void,
+        usize,
+        usize,
+        *mut core::ffi::c_void,
+      ) -> i32,
+      output_rows_context: *mut core::ffi::c_void,
       error_buffer: *mut core::ffi::c_char,
       error_buffer_size: usize,
     ) -> usize;
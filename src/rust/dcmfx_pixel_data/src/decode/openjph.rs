@@ -1,22 +1,86 @@
 #[cfg(not(feature = "std"))]
 use alloc::{format, string::ToString, vec, vec::Vec};
 
+#[cfg(feature = "std")]
+use crate::decode::batch;
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError,
+  decode::{LutPixels, OutputLut},
+  frame_buffer_pool::{self, PoolElement},
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
-    PixelRepresentation,
+    PixelRepresentation, PlanarConfiguration,
   },
+  sample_statistics::{FusedSampleStatistics, SampleStatistics},
+  transforms::CropRect,
 };
 
-/// Decodes monochrome pixel data using OpenJPH.
+/// Decodes monochrome pixel data using OpenJPH. Each level of resolution
+/// reduction halves the width and height of the returned image, see
+/// [`decode()`].
+///
+/// The HTJ2K data is passed as a list of fragments that OpenJPH reads in turn,
+/// so the fragments of encapsulated pixel data don't need to be combined first.
+///
+/// If a decode area is given then code-blocks and tiles that don't affect it
+/// aren't decoded. The returned image still covers the whole frame, but only
+/// its pixels inside the decode area are valid.
 ///
 pub fn decode_monochrome(
   image_pixel_module: &ImagePixelModule,
-  data: &[u8],
+  fragments: &[&[u8]],
+  resolution_reduction: u32,
+  thread_count: usize,
+  decode_area: Option<&CropRect>,
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  monochrome_image(
+    image_pixel_module,
+    fragments,
+    resolution_reduction,
+    thread_count,
+    decode_area,
+    None,
+  )
+}
+
+/// Decodes monochrome pixel data using OpenJPH in the same way as
+/// [`decode_monochrome()`], and returns the statistics of the decoded samples
+/// along with the image. The statistics are gathered as each decoded line is
+/// written into the image, so no further pass over the image is needed. Tiles
+/// that are decoded concurrently gather their own statistics, which are then
+/// merged.
+///
+pub fn decode_monochrome_with_statistics(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+  include_histogram: bool,
+) -> Result<(MonochromeImage, SampleStatistics), PixelDataDecodeError> {
+  let mut statistics =
+    FusedSampleStatistics::new(image_pixel_module, include_histogram);
+
+  let image = monochrome_image(
+    image_pixel_module,
+    fragments,
+    0,
+    thread_count,
+    None,
+    Some(&mut statistics),
+  )?;
+
+  let statistics = statistics.finish(&image);
+
+  Ok((image, statistics))
+}
+
+fn monochrome_image(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  resolution_reduction: u32,
+  thread_count: usize,
+  decode_area: Option<&CropRect>,
+  statistics: Option<&mut FusedSampleStatistics>,
 ) -> Result<MonochromeImage, PixelDataDecodeError> {
-  let width = image_pixel_module.columns();
-  let height = image_pixel_module.rows();
   let bits_stored = image_pixel_module.bits_stored();
   let is_monochrome1 = image_pixel_module
     .photometric_interpretation()
@@ -35,7 +99,16 @@ pub fn decode_monochrome(
       },
       BitsAllocated::Eight,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode_with_output_lut(
+        image_pixel_module,
+        fragments,
+        resolution_reduction,
+        thread_count,
+        decode_area,
+        PlanarConfiguration::Interleaved,
+        None,
+        statistics,
+      )?;
       MonochromeImage::new_u8(
         width,
         height,
@@ -55,7 +128,16 @@ pub fn decode_monochrome(
       },
       BitsAllocated::Eight,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode_with_output_lut(
+        image_pixel_module,
+        fragments,
+        resolution_reduction,
+        thread_count,
+        decode_area,
+        PlanarConfiguration::Interleaved,
+        None,
+        statistics,
+      )?;
       MonochromeImage::new_i8(
         width,
         height,
@@ -75,7 +157,16 @@ pub fn decode_monochrome(
       },
       BitsAllocated::Sixteen,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode_with_output_lut(
+        image_pixel_module,
+        fragments,
+        resolution_reduction,
+        thread_count,
+        decode_area,
+        PlanarConfiguration::Interleaved,
+        None,
+        statistics,
+      )?;
       MonochromeImage::new_u16(
         width,
         height,
@@ -95,7 +186,16 @@ pub fn decode_monochrome(
       },
       BitsAllocated::Sixteen,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode_with_output_lut(
+        image_pixel_module,
+        fragments,
+        resolution_reduction,
+        thread_count,
+        decode_area,
+        PlanarConfiguration::Interleaved,
+        None,
+        statistics,
+      )?;
       MonochromeImage::new_i16(
         width,
         height,
@@ -115,7 +215,16 @@ pub fn decode_monochrome(
       },
       BitsAllocated::ThirtyTwo,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode_with_output_lut(
+        image_pixel_module,
+        fragments,
+        resolution_reduction,
+        thread_count,
+        decode_area,
+        PlanarConfiguration::Interleaved,
+        None,
+        statistics,
+      )?;
       MonochromeImage::new_u32(
         width,
         height,
@@ -135,7 +244,16 @@ pub fn decode_monochrome(
       },
       BitsAllocated::ThirtyTwo,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode_with_output_lut(
+        image_pixel_module,
+        fragments,
+        resolution_reduction,
+        thread_count,
+        decode_area,
+        PlanarConfiguration::Interleaved,
+        None,
+        statistics,
+      )?;
       MonochromeImage::new_i32(
         width,
         height,
@@ -159,14 +277,17 @@ pub fn decode_monochrome(
   }
 }
 
-/// Decodes color pixel data using OpenJPH.
+/// Decodes color pixel data using OpenJPH. Each level of resolution reduction
+/// halves the width and height of the returned image, see [`decode()`]. A
+/// decode area is handled as for [`decode_monochrome()`].
 ///
 pub fn decode_color(
   image_pixel_module: &ImagePixelModule,
-  data: &[u8],
+  fragments: &[&[u8]],
+  resolution_reduction: u32,
+  thread_count: usize,
+  decode_area: Option<&CropRect>,
 ) -> Result<ColorImage, PixelDataDecodeError> {
-  let width = image_pixel_module.columns();
-  let height = image_pixel_module.rows();
   let bits_stored = image_pixel_module.bits_stored();
 
   let color_space = if image_pixel_module.photometric_interpretation()
@@ -185,7 +306,13 @@ pub fn decode_color(
       PhotometricInterpretation::PaletteColor { palette },
       BitsAllocated::Eight,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        fragments,
+        resolution_reduction,
+        thread_count,
+        decode_area,
+      )?;
       ColorImage::new_palette8(
         width,
         height,
@@ -200,7 +327,13 @@ pub fn decode_color(
       PhotometricInterpretation::PaletteColor { palette },
       BitsAllocated::Sixteen,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        fragments,
+        resolution_reduction,
+        thread_count,
+        decode_area,
+      )?;
       ColorImage::new_palette16(
         width,
         height,
@@ -218,7 +351,13 @@ pub fn decode_color(
       | PhotometricInterpretation::YbrRct,
       BitsAllocated::Eight,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        fragments,
+        resolution_reduction,
+        thread_count,
+        decode_area,
+      )?;
       ColorImage::new_u8(width, height, pixels, color_space, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
     }
@@ -230,7 +369,13 @@ pub fn decode_color(
       | PhotometricInterpretation::YbrRct,
       BitsAllocated::Sixteen,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        fragments,
+        resolution_reduction,
+        thread_count,
+        decode_area,
+      )?;
       ColorImage::new_u16(width, height, pixels, color_space, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
     }
@@ -242,7 +387,13 @@ pub fn decode_color(
       | PhotometricInterpretation::YbrRct,
       BitsAllocated::ThirtyTwo,
     ) => {
-      let pixels = decode(image_pixel_module, data)?;
+      let (pixels, width, height) = decode(
+        image_pixel_module,
+        fragments,
+        resolution_reduction,
+        thread_count,
+        decode_area,
+      )?;
       ColorImage::new_u32(width, height, pixels, color_space, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
     }
@@ -260,37 +411,736 @@ pub fn decode_color(
   }
 }
 
-fn decode<T: Clone + Default + bytemuck::Pod>(
+/// Decodes a batch of whole frames of monochrome pixel data using OpenJPH in a
+/// single call. The frames are shared out between up to `thread_count`
+/// threads, which each reuse one cached codestream for every frame they decode.
+/// The results are returned in the same order as the frames.
+///
+#[cfg(feature = "std")]
+pub fn decode_monochrome_batch(
+  image_pixel_module: &ImagePixelModule,
+  frames: &[&[u8]],
+  thread_count: usize,
+) -> Vec<Result<MonochromeImage, PixelDataDecodeError>> {
+  let width = image_pixel_module.columns();
+  let height = image_pixel_module.rows();
+  let bits_stored = image_pixel_module.bits_stored();
+  let is_monochrome1 = image_pixel_module
+    .photometric_interpretation()
+    .is_monochrome1();
+
+  match (
+    image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      }
+      | PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      BitsAllocated::Eight,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        MonochromeImage::new_u8(
+          width,
+          height,
+          pixels?,
+          bits_stored,
+          is_monochrome1,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation: PixelRepresentation::Signed,
+      }
+      | PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Signed,
+      },
+      BitsAllocated::Eight,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        MonochromeImage::new_i8(
+          width,
+          height,
+          pixels?,
+          bits_stored,
+          is_monochrome1,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      }
+      | PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      BitsAllocated::Sixteen,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        MonochromeImage::new_u16(
+          width,
+          height,
+          pixels?,
+          bits_stored,
+          is_monochrome1,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation: PixelRepresentation::Signed,
+      }
+      | PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Signed,
+      },
+      BitsAllocated::Sixteen,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        MonochromeImage::new_i16(
+          width,
+          height,
+          pixels?,
+          bits_stored,
+          is_monochrome1,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      }
+      | PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      BitsAllocated::ThirtyTwo,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        MonochromeImage::new_u32(
+          width,
+          height,
+          pixels?,
+          bits_stored,
+          is_monochrome1,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation: PixelRepresentation::Signed,
+      }
+      | PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Signed,
+      },
+      BitsAllocated::ThirtyTwo,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        MonochromeImage::new_i32(
+          width,
+          height,
+          pixels?,
+          bits_stored,
+          is_monochrome1,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (photometric_interpretation, bits_allocated) => {
+      let error = PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "OpenJPH monochrome decode not supported with photometric \
+           interpretation '{}' and bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated),
+        ),
+      };
+
+      frames.iter().map(|_| Err(error.clone())).collect()
+    }
+  }
+}
+
+/// Decodes a batch of whole frames of color pixel data using OpenJPH in a
+/// single call, in the same way as [`decode_monochrome_batch()`].
+///
+#[cfg(feature = "std")]
+pub fn decode_color_batch(
   image_pixel_module: &ImagePixelModule,
+  frames: &[&[u8]],
+  thread_count: usize,
+) -> Vec<Result<ColorImage, PixelDataDecodeError>> {
+  let width = image_pixel_module.columns();
+  let height = image_pixel_module.rows();
+  let bits_stored = image_pixel_module.bits_stored();
+
+  let color_space = if image_pixel_module.photometric_interpretation()
+    == &PhotometricInterpretation::YbrFull
+  {
+    ColorSpace::Ybr { is_422: false }
+  } else {
+    ColorSpace::Rgb
+  };
+
+  match (
+    &image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      PhotometricInterpretation::PaletteColor { palette },
+      BitsAllocated::Eight,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        ColorImage::new_palette8(
+          width,
+          height,
+          pixels?,
+          palette.clone(),
+          bits_stored,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::PaletteColor { palette },
+      BitsAllocated::Sixteen,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        ColorImage::new_palette16(
+          width,
+          height,
+          pixels?,
+          palette.clone(),
+          bits_stored,
+        )
+        .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::Rgb
+      | PhotometricInterpretation::YbrFull
+      | PhotometricInterpretation::YbrIct
+      | PhotometricInterpretation::YbrRct,
+      BitsAllocated::Eight,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        ColorImage::new_u8(width, height, pixels?, color_space, bits_stored)
+          .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::Rgb
+      | PhotometricInterpretation::YbrFull
+      | PhotometricInterpretation::YbrIct
+      | PhotometricInterpretation::YbrRct,
+      BitsAllocated::Sixteen,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        ColorImage::new_u16(width, height, pixels?, color_space, bits_stored)
+          .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (
+      PhotometricInterpretation::Rgb
+      | PhotometricInterpretation::YbrFull
+      | PhotometricInterpretation::YbrIct
+      | PhotometricInterpretation::YbrRct,
+      BitsAllocated::ThirtyTwo,
+    ) => decode_batch(image_pixel_module, frames, thread_count)
+      .into_iter()
+      .map(|pixels| {
+        ColorImage::new_u32(width, height, pixels?, color_space, bits_stored)
+          .map_err(PixelDataDecodeError::ImageCreationFailed)
+      })
+      .collect(),
+
+    (photometric_interpretation, bits_allocated) => {
+      let error = PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "OpenJPH color decode not supported with photometric interpretation \
+           '{}' and bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated)
+        ),
+      };
+
+      frames.iter().map(|_| Err(error.clone())).collect()
+    }
+  }
+}
+
+/// Decodes monochrome pixel data using OpenJPH in the same way as
+/// [`decode_monochrome()`], but writes each pixel as its entry in the output
+/// LUT rather than as a decoded sample. The pixels are returned along with the
+/// width and height of the decoded image.
+///
+pub fn decode_monochrome_lut(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  resolution_reduction: u32,
+  thread_count: usize,
+  output_lut: &OutputLut,
+) -> Result<LutPixels, PixelDataDecodeError> {
+  decode_with_output_lut(
+    image_pixel_module,
+    fragments,
+    resolution_reduction,
+    thread_count,
+    None,
+    PlanarConfiguration::Interleaved,
+    Some(output_lut),
+    None,
+  )
+}
+
+/// Decodes monochrome pixel data using OpenJPH, passing the decoded image to
+/// `on_stripe` as horizontal stripes of `rows_per_stripe` rows along with the
+/// index of each stripe's first row. The last stripe holds any remaining rows.
+/// Only one stripe is held in memory at a time, so the memory used doesn't
+/// grow with the height of the image.
+///
+pub fn decode_monochrome_stripes(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  resolution_reduction: u32,
+  thread_count: usize,
+  rows_per_stripe: u16,
+  on_stripe: &mut dyn FnMut(MonochromeImage, u16),
+) -> Result<(), PixelDataDecodeError> {
+  decode_rows(
+    image_pixel_module,
+    fragments,
+    resolution_reduction,
+    thread_count,
+    rows_per_stripe,
+    &mut |rows, width, row_count, first_row| {
+      on_stripe(
+        new_monochrome_image(image_pixel_module, width, row_count, rows)?,
+        first_row,
+      );
+
+      Ok(())
+    },
+  )
+}
+
+/// Decodes color pixel data using OpenJPH, passing the decoded image to
+/// `on_stripe` as horizontal stripes. See [`decode_monochrome_stripes()`] for
+/// details.
+///
+pub fn decode_color_stripes(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  resolution_reduction: u32,
+  thread_count: usize,
+  rows_per_stripe: u16,
+  on_stripe: &mut dyn FnMut(ColorImage, u16),
+) -> Result<(), PixelDataDecodeError> {
+  decode_rows(
+    image_pixel_module,
+    fragments,
+    resolution_reduction,
+    thread_count,
+    rows_per_stripe,
+    &mut |rows, width, row_count, first_row| {
+      on_stripe(
+        new_color_image(image_pixel_module, width, row_count, rows)?,
+        first_row,
+      );
+
+      Ok(())
+    },
+  )
+}
+
+/// Creates a [`MonochromeImage`] from decoded samples in native byte order.
+///
+fn new_monochrome_image(
+  image_pixel_module: &ImagePixelModule,
+  width: u16,
+  height: u16,
   data: &[u8],
-) -> Result<Vec<T>, PixelDataDecodeError> {
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  let bits_stored = image_pixel_module.bits_stored();
+  let is_monochrome1 = image_pixel_module
+    .photometric_interpretation()
+    .is_monochrome1();
+
+  let image = match (
+    image_pixel_module.is_monochrome(),
+    image_pixel_module.pixel_representation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (true, PixelRepresentation::Unsigned, BitsAllocated::Eight) => {
+      MonochromeImage::new_u8(
+        width,
+        height,
+        data.to_vec(),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (true, PixelRepresentation::Signed, BitsAllocated::Eight) => {
+      MonochromeImage::new_i8(
+        width,
+        height,
+        samples_from_bytes(data),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (true, PixelRepresentation::Unsigned, BitsAllocated::Sixteen) => {
+      MonochromeImage::new_u16(
+        width,
+        height,
+        samples_from_bytes(data),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (true, PixelRepresentation::Signed, BitsAllocated::Sixteen) => {
+      MonochromeImage::new_i16(
+        width,
+        height,
+        samples_from_bytes(data),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (true, PixelRepresentation::Unsigned, BitsAllocated::ThirtyTwo) => {
+      MonochromeImage::new_u32(
+        width,
+        height,
+        samples_from_bytes(data),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (true, PixelRepresentation::Signed, BitsAllocated::ThirtyTwo) => {
+      MonochromeImage::new_i32(
+        width,
+        height,
+        samples_from_bytes(data),
+        bits_stored,
+        is_monochrome1,
+      )
+    }
+
+    (_, _, bits_allocated) => {
+      return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "OpenJPH monochrome decode not supported with photometric \
+           interpretation '{}' and bits allocated '{}'",
+          image_pixel_module.photometric_interpretation(),
+          u8::from(bits_allocated),
+        ),
+      });
+    }
+  };
+
+  image.map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Creates a [`ColorImage`] from decoded samples in native byte order.
+///
+fn new_color_image(
+  image_pixel_module: &ImagePixelModule,
+  width: u16,
+  height: u16,
+  data: &[u8],
+) -> Result<ColorImage, PixelDataDecodeError> {
+  let bits_stored = image_pixel_module.bits_stored();
+
+  let color_space = if image_pixel_module.photometric_interpretation()
+    == &PhotometricInterpretation::YbrFull
+  {
+    ColorSpace::Ybr { is_422: false }
+  } else {
+    ColorSpace::Rgb
+  };
+
+  let image = match (
+    &image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      PhotometricInterpretation::PaletteColor { palette },
+      BitsAllocated::Eight,
+    ) => ColorImage::new_palette8(
+      width,
+      height,
+      data.to_vec(),
+      palette.clone(),
+      bits_stored,
+    ),
+
+    (
+      PhotometricInterpretation::PaletteColor { palette },
+      BitsAllocated::Sixteen,
+    ) => ColorImage::new_palette16(
+      width,
+      height,
+      samples_from_bytes(data),
+      palette.clone(),
+      bits_stored,
+    ),
+
+    (
+      PhotometricInterpretation::Rgb
+      | PhotometricInterpretation::YbrFull
+      | PhotometricInterpretation::YbrIct
+      | PhotometricInterpretation::YbrRct,
+      BitsAllocated::Eight,
+    ) => {
+      ColorImage::new_u8(width, height, data.to_vec(), color_space, bits_stored)
+    }
+
+    (
+      PhotometricInterpretation::Rgb
+      | PhotometricInterpretation::YbrFull
+      | PhotometricInterpretation::YbrIct
+      | PhotometricInterpretation::YbrRct,
+      BitsAllocated::Sixteen,
+    ) => ColorImage::new_u16(
+      width,
+      height,
+      samples_from_bytes(data),
+      color_space,
+      bits_stored,
+    ),
+
+    (
+      PhotometricInterpretation::Rgb
+      | PhotometricInterpretation::YbrFull
+      | PhotometricInterpretation::YbrIct
+      | PhotometricInterpretation::YbrRct,
+      BitsAllocated::ThirtyTwo,
+    ) => ColorImage::new_u32(
+      width,
+      height,
+      samples_from_bytes(data),
+      color_space,
+      bits_stored,
+    ),
+
+    (photometric_interpretation, bits_allocated) => {
+      return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "OpenJPH color decode not supported with photometric interpretation \
+           '{}' and bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated)
+        ),
+      });
+    }
+  };
+
+  image.map_err(PixelDataDecodeError::ImageCreationFailed)
+}
+
+/// Decodes color pixel data using OpenJPH, returning the raw samples with a
+/// planar configuration of [`PlanarConfiguration::Separate`]. Samples are in
+/// native byte order. Each decoded line is packed straight into its plane, and
+/// when the codestream has no color transform its components are decoded one
+/// after another, so no interleaving is done.
+///
+pub fn decode_color_planar(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  thread_count: usize,
+) -> Result<Vec<u8>, PixelDataDecodeError> {
+  match (
+    &image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      PhotometricInterpretation::PaletteColor { .. },
+      BitsAllocated::Eight | BitsAllocated::Sixteen,
+    )
+    | (
+      PhotometricInterpretation::Rgb
+      | PhotometricInterpretation::YbrFull
+      | PhotometricInterpretation::YbrIct
+      | PhotometricInterpretation::YbrRct,
+      BitsAllocated::Eight | BitsAllocated::Sixteen | BitsAllocated::ThirtyTwo,
+    ) => {
+      let (samples, _, _) = decode_with_output_lut::<u8>(
+        image_pixel_module,
+        fragments,
+        0,
+        thread_count,
+        None,
+        PlanarConfiguration::Separate,
+        None,
+        None,
+      )?;
+
+      Ok(samples)
+    }
+
+    (photometric_interpretation, bits_allocated) => {
+      Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "OpenJPH planar color decode not supported with photometric \
+           interpretation '{}' and bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated),
+        ),
+      })
+    }
+  }
+}
+
+/// Decodes HTJ2K data, skipping the given number of the finest resolution
+/// levels. The number of levels skipped is limited to the number of wavelet
+/// decompositions in the data. Returns the decoded samples along with the width
+/// and height of the decoded image. Only samples inside the decode area, if one
+/// is given, are valid.
+///
+fn decode<T: PoolElement + bytemuck::Pod>(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  resolution_reduction: u32,
+  thread_count: usize,
+  decode_area: Option<&CropRect>,
+) -> Result<(Vec<T>, u16, u16), PixelDataDecodeError> {
+  decode_with_output_lut(
+    image_pixel_module,
+    fragments,
+    resolution_reduction,
+    thread_count,
+    decode_area,
+    PlanarConfiguration::Interleaved,
+    None,
+    None,
+  )
+}
+
+/// Decodes the image, writing each pixel through the output LUT if one is
+/// given, in which case `T` must be `u8`. Statistics of the decoded samples are
+/// gathered into `statistics` if it's set, which requires that no decode area
+/// is given. Samples are written as separate planes when the planar
+/// configuration is [`PlanarConfiguration::Separate`], which can't be combined
+/// with an output LUT or statistics.
+///
+#[allow(clippy::too_many_arguments)]
+fn decode_with_output_lut<T: PoolElement + bytemuck::Pod>(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  resolution_reduction: u32,
+  thread_count: usize,
+  decode_area: Option<&CropRect>,
+  planar_configuration: PlanarConfiguration,
+  output_lut: Option<&OutputLut>,
+  statistics: Option<&mut FusedSampleStatistics>,
+) -> Result<(Vec<T>, u16, u16), PixelDataDecodeError> {
   let samples_per_pixel = u8::from(image_pixel_module.samples_per_pixel());
   let bits_allocated = u8::from(image_pixel_module.bits_allocated()).max(8);
   let bits_stored = image_pixel_module.bits_stored();
   let pixel_representation =
     u8::from(image_pixel_module.pixel_representation()) as usize;
+  let planar_configuration = match planar_configuration {
+    PlanarConfiguration::Interleaved => 0,
+    PlanarConfiguration::Separate => 1,
+  };
   let mut error_buffer = [0 as core::ffi::c_char; 256];
 
-  // Allocate output buffer
-  let mut output_buffer: Vec<T> = vec![
-    T::default();
-    image_pixel_module.pixel_count()
-      * usize::from(samples_per_pixel)
-  ];
+  let mut output_buffer: Vec<T> = vec![];
+  let mut width = 0;
+  let mut height = 0;
+
+  let input_fragments: Vec<_> = fragments
+    .iter()
+    .map(|fragment| ffi::InputFragment {
+      data: fragment.as_ptr(),
+      size: fragment.len(),
+    })
+    .collect();
+
+  // Pass the decode area as the left, top, right, and bottom edges of the
+  // region of the full resolution image that's needed
+  let decode_window = decode_area.map(|decode_area| {
+    let rows = image_pixel_module.rows();
+    let columns = image_pixel_module.columns();
+    let (area_height, area_width) = decode_area.apply(rows, columns);
+
+    let left = usize::from(decode_area.left);
+    let top = usize::from(decode_area.top);
+
+    [
+      left,
+      top,
+      left + usize::from(area_width),
+      top + usize::from(area_height),
+    ]
+  });
+
+  let mut stage_times = ffi::StageTimes::default();
+
+  // Statistics are gathered as 32-bit signed values, which can't hold every
+  // unsigned 32-bit sample, so those are left to be computed from the image
+  let statistics_ptr = match statistics {
+    Some(statistics) if bits_allocated != 32 => statistics.as_mut_ptr(),
+    _ => core::ptr::null_mut(),
+  };
 
   // Make FFI call into OpenJPH to perform the decompression
   let result = unsafe {
     ffi::openjph_decode(
-      data.as_ptr() as *const core::ffi::c_void,
-      data.len(),
+      input_fragments.as_ptr(),
+      input_fragments.len(),
       image_pixel_module.columns().into(),
       image_pixel_module.rows().into(),
       samples_per_pixel.into(),
       bits_allocated.into(),
       bits_stored.into(),
       pixel_representation,
-      output_buffer.as_mut_ptr() as *mut core::ffi::c_void,
-      output_buffer.len() * core::mem::size_of::<T>(),
+      planar_configuration,
+      resolution_reduction as usize,
+      thread_count,
+      decode_window
+        .as_ref()
+        .map_or(core::ptr::null(), |window| window.as_ptr()),
+      output_lut.map_or(core::ptr::null(), |lut| lut.as_ptr()),
+      output_lut.map_or(0, |lut| lut.entry_size()),
+      statistics_ptr,
+      &mut width,
+      &mut height,
+      output_buffer_callback::<T>,
+      &mut output_buffer as *mut Vec<T> as *mut core::ffi::c_void,
+      stage_times.as_mut_ptr_if_enabled(),
       error_buffer.as_mut_ptr(),
       error_buffer.len(),
     )
@@ -307,24 +1157,334 @@ fn decode<T: Clone + Default + bytemuck::Pod>(
     });
   }
 
-  Ok(output_buffer)
+  stage_times.record();
+
+  Ok((output_buffer, width as u16, height as u16))
+}
+
+/// Decodes a batch of whole HTJ2K frames at full resolution into newly
+/// allocated buffers of samples with a single call into OpenJPH.
+///
+#[cfg(feature = "std")]
+fn decode_batch<T: PoolElement>(
+  image_pixel_module: &ImagePixelModule,
+  frames: &[&[u8]],
+  thread_count: usize,
+) -> Vec<Result<Vec<T>, PixelDataDecodeError>> {
+  let samples_per_pixel = u8::from(image_pixel_module.samples_per_pixel());
+  let bits_allocated = u8::from(image_pixel_module.bits_allocated()).max(8);
+  let bits_stored = image_pixel_module.bits_stored();
+  let pixel_representation =
+    u8::from(image_pixel_module.pixel_representation()) as usize;
+  let sample_count =
+    image_pixel_module.pixel_count() * usize::from(samples_per_pixel);
+
+  batch::decode_batch(frames, sample_count, "OpenJPH", |batch_frames| unsafe {
+    ffi::openjph_decode_batch(
+      batch_frames.as_mut_ptr(),
+      batch_frames.len(),
+      image_pixel_module.columns().into(),
+      image_pixel_module.rows().into(),
+      samples_per_pixel.into(),
+      bits_allocated.into(),
+      bits_stored.into(),
+      pixel_representation,
+      thread_count,
+    )
+  })
+}
+
+/// Copies decoded samples in native byte order into a new vector.
+///
+fn samples_from_bytes<T: Clone + Default + bytemuck::Pod>(
+  data: &[u8],
+) -> Vec<T> {
+  let mut samples = vec![T::default(); data.len() / core::mem::size_of::<T>()];
+  bytemuck::cast_slice_mut(&mut samples).copy_from_slice(data);
+  samples
+}
+
+/// Callback that receives chunks of decoded rows from [`decode_rows()`]. It is
+/// passed the decoded samples, the width of the image, the number of rows in
+/// the chunk, and the index of the chunk's first row.
+///
+type OnRows<'a> =
+  dyn FnMut(&[u8], u16, u16, u16) -> Result<(), PixelDataDecodeError> + 'a;
+
+/// Context passed through [`ffi::openjph_decode_rows()`] to
+/// [`output_rows_callback()`].
+///
+struct OutputRowsContext<'a, 'b> {
+  on_rows: &'a mut OnRows<'b>,
+  width: usize,
+  bytes_per_pixel: usize,
+  error: Option<PixelDataDecodeError>,
+}
+
+/// Decodes HTJ2K data in chunks of rows that are passed to `on_rows` as they
+/// are decoded, skipping the given number of the finest resolution levels.
+/// Only one chunk of decoded rows is held in memory at a time.
+///
+fn decode_rows(
+  image_pixel_module: &ImagePixelModule,
+  fragments: &[&[u8]],
+  resolution_reduction: u32,
+  thread_count: usize,
+  rows_per_chunk: u16,
+  on_rows: &mut OnRows,
+) -> Result<(), PixelDataDecodeError> {
+  let samples_per_pixel = u8::from(image_pixel_module.samples_per_pixel());
+  let bits_allocated = u8::from(image_pixel_module.bits_allocated()).max(8);
+  let bits_stored = image_pixel_module.bits_stored();
+  let pixel_representation =
+    u8::from(image_pixel_module.pixel_representation()) as usize;
+  let mut error_buffer = [0 as core::ffi::c_char; 256];
+
+  let mut context = OutputRowsContext {
+    on_rows,
+    width: 0,
+    bytes_per_pixel: usize::from(samples_per_pixel)
+      * usize::from(bits_allocated / 8),
+    error: None,
+  };
+
+  // The width is written by OpenJPH before the first chunk of rows is passed
+  // to the callback, so derive both pointers from the same place
+  let context_ptr = &mut context as *mut OutputRowsContext;
+  let mut height = 0;
+
+  let input_fragments: Vec<_> = fragments
+    .iter()
+    .map(|fragment| ffi::InputFragment {
+      data: fragment.as_ptr(),
+      size: fragment.len(),
+    })
+    .collect();
+
+  let mut stage_times = ffi::StageTimes::default();
+
+  // Make FFI call into OpenJPH to perform the decompression
+  let result = unsafe {
+    ffi::openjph_decode_rows(
+      input_fragments.as_ptr(),
+      input_fragments.len(),
+      image_pixel_module.columns().into(),
+      image_pixel_module.rows().into(),
+      samples_per_pixel.into(),
+      bits_allocated.into(),
+      bits_stored.into(),
+      pixel_representation,
+      resolution_reduction as usize,
+      rows_per_chunk.into(),
+      thread_count,
+      &raw mut (*context_ptr).width,
+      &mut height,
+      output_rows_callback,
+      context_ptr as *mut core::ffi::c_void,
+      stage_times.as_mut_ptr_if_enabled(),
+      error_buffer.as_mut_ptr(),
+      error_buffer.len(),
+    )
+  };
+
+  // Errors returned by the callback take precedence
+  if let Some(error) = context.error {
+    return Err(error);
+  }
+
+  // On error, read the error message string
+  if result != 0 {
+    let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
+      .to_str()
+      .unwrap_or("<invalid error>");
+
+    return Err(PixelDataDecodeError::DataInvalid {
+      details: format!("OpenJPH decode failed with '{error}'"),
+    });
+  }
+
+  stage_times.record();
+
+  Ok(())
+}
+
+/// This function is passed as a callback to [`ffi::openjph_decode_rows()`] and
+/// forwards each chunk of decoded rows to the `on_rows` callback held in the
+/// [`OutputRowsContext`]. Returns non-zero to stop decoding if that callback
+/// returns an error.
+///
+extern "C" fn output_rows_callback(
+  data: *const core::ffi::c_void,
+  first_row: usize,
+  row_count: usize,
+  context: *mut core::ffi::c_void,
+) -> i32 {
+  let context = unsafe { &mut *(context as *mut OutputRowsContext) };
+
+  let rows = unsafe {
+    core::slice::from_raw_parts(
+      data as *const u8,
+      context.width * context.bytes_per_pixel * row_count,
+    )
+  };
+
+  match (context.on_rows)(
+    rows,
+    context.width as u16,
+    row_count as u16,
+    first_row as u16,
+  ) {
+    Ok(()) => 0,
+    Err(e) => {
+      context.error = Some(e);
+      1
+    }
+  }
+}
+
+/// This function is passed as a callback to [`ffi::openjph_decode()`] and is
+/// called once the size of the decoded image is known in order to allocate the
+/// output buffer. A pointer to its base address is returned.
+///
+extern "C" fn output_buffer_callback<T: PoolElement>(
+  size: usize,
+  context: *mut core::ffi::c_void,
+) -> *mut core::ffi::c_void {
+  unsafe {
+    let output_buffer = &mut *(context as *mut Vec<T>);
+    let len = size / core::mem::size_of::<T>();
+
+    // The first time the output buffer is sized it's taken from the active
+    // frame buffer pool, if there is one
+    if output_buffer.capacity() == 0 {
+      *output_buffer = frame_buffer_pool::zeroed_vec(len);
+    } else {
+      output_buffer.resize(len, T::default());
+    }
+
+    output_buffer.as_mut_ptr() as *mut core::ffi::c_void
+  }
+}
+
+impl ffi::StageTimes {
+  /// Returns a pointer for OpenJPH to write the time spent in each decode stage
+  /// to, or null if codec stats aren't being collected.
+  ///
+  fn as_mut_ptr_if_enabled(&mut self) -> *mut Self {
+    #[cfg(feature = "std")]
+    if crate::codec_stats::is_enabled() {
+      return self;
+    }
+
+    core::ptr::null_mut()
+  }
+
+  /// Adds the stage times written by OpenJPH to the codec stats.
+  ///
+  fn record(&self) {
+    #[cfg(feature = "std")]
+    if crate::codec_stats::is_enabled() {
+      use crate::codec_stats::{CodecStage, record_stage};
+      use std::time::Duration;
+
+      record_stage(
+        CodecStage::HeaderParse,
+        Duration::from_nanos(self.header_parse),
+      );
+      record_stage(
+        CodecStage::EntropyDecode,
+        Duration::from_nanos(self.entropy_decode),
+      );
+      record_stage(CodecStage::Repack, Duration::from_nanos(self.repack));
+    }
+  }
 }
 
 mod ffi {
+  #[cfg(feature = "std")]
+  use crate::decode::batch::BatchFrame;
+  use crate::sample_statistics::PixelKernelsStats;
+
+  #[repr(C)]
+  pub struct InputFragment {
+    pub data: *const u8,
+    pub size: usize,
+  }
+
+  #[repr(C)]
+  #[derive(Default)]
+  pub struct StageTimes {
+    pub header_parse: u64,
+    pub entropy_decode: u64,
+    pub repack: u64,
+  }
+
   unsafe extern "C" {
     pub fn openjph_decode(
-      input_data: *const core::ffi::c_void,
-      input_data_size: usize,
+      input_fragments: *const InputFragment,
+      input_fragment_count: usize,
       width: usize,
       height: usize,
       samples_per_pixel: usize,
       bits_allocated: usize,
       bits_stored: usize,
       pixel_representation: usize,
-      output_data: *mut core::ffi::c_void,
-      output_data_size: usize,
+      planar_configuration: usize,
+      resolution_reduction: usize,
+      thread_count: usize,
+      decode_window: *const usize,
+      output_lut: *const u8,
+      output_lut_entry_size: usize,
+      stats: *mut PixelKernelsStats,
+      output_width: *mut usize,
+      output_height: *mut usize,
+      output_buffer_callback: extern "C" fn(
+        usize,
+        *mut core::ffi::c_void,
+      ) -> *mut core::ffi::c_void,
+      output_buffer_context: *mut core::ffi::c_void,
+      stage_times: *mut StageTimes,
       error_buffer: *mut core::ffi::c_char,
       error_buffer_size: usize,
     ) -> usize;
+
+    pub fn openjph_decode_rows(
+      input_fragments: *const InputFragment,
+      input_fragment_count: usize,
+      width: usize,
+      height: usize,
+      samples_per_pixel: usize,
+      bits_allocated: usize,
+      bits_stored: usize,
+      pixel_representation: usize,
+      resolution_reduction: usize,
+      rows_per_chunk: usize,
+      thread_count: usize,
+      output_width: *mut usize,
+      output_height: *mut usize,
+      output_rows_callback: extern "C" fn(
+        *const core::ffi::c_void,
+        usize,
+        usize,
+        *mut core::ffi::c_void,
+      ) -> i32,
+      output_rows_context: *mut core::ffi::c_void,
+      stage_times: *mut StageTimes,
+      error_buffer: *mut core::ffi::c_char,
+      error_buffer_size: usize,
+    ) -> usize;
+
+    #[cfg(feature = "std")]
+    pub fn openjph_decode_batch(
+      frames: *mut BatchFrame,
+      frame_count: usize,
+      width: usize,
+      height: usize,
+      samples_per_pixel: usize,
+      bits_allocated: usize,
+      bits_stored: usize,
+      pixel_representation: usize,
+      thread_count: usize,
+    );
   }
 }
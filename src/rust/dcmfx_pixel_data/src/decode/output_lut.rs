@@ -0,0 +1,87 @@
+#[cfg(not(feature = "std"))]
+use alloc::vec::Vec;
+
+use crate::sample_lut::SampleLut;
+
+/// A lookup table that a decoder writes monochrome pixels through in place of
+/// their decoded samples, which lets a frame be decoded straight into display
+/// pixels in a single pass, without first creating a [`MonochromeImage`].
+///
+/// The table has an entry for every value of an 8-bit or 16-bit sample, and is
+/// indexed by the bits of each decoded sample, which is how the samples would
+/// otherwise be written to the output buffer.
+///
+/// [`MonochromeImage`]: crate::MonochromeImage
+///
+pub(crate) struct OutputLut {
+  entries: Vec<u8>,
+  entry_size: usize,
+}
+
+/// Pixels that a decoder wrote through an [`OutputLut`], along with their width
+/// and height.
+///
+pub(crate) type LutPixels = (Vec<u8>, u16, u16);
+
+impl OutputLut {
+  /// Creates an output LUT from a [`SampleLut`] with entries of `N` bytes. The
+  /// sample LUT must have been created for the sample type of the pixel data
+  /// being decoded.
+  ///
+  pub fn from_sample_lut<const N: usize>(
+    sample_lut: &SampleLut<[u8; N]>,
+  ) -> Self {
+    Self {
+      entries: sample_lut.entries().as_flattened().to_vec(),
+      entry_size: N,
+    }
+  }
+
+  /// Returns a pointer to the table's entries, for passing to a decoder.
+  ///
+  pub fn as_ptr(&self) -> *const u8 {
+    self.entries.as_ptr()
+  }
+
+  /// Returns the size in bytes of each of the table's entries.
+  ///
+  pub fn entry_size(&self) -> usize {
+    self.entry_size
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn from_8_bit_unsigned_sample_lut() {
+    let lut =
+      OutputLut::from_sample_lut(&SampleLut::new::<u8>(|stored_value| {
+        [stored_value as u8]
+      }));
+
+    assert_eq!(lut.entry_size(), 1);
+    assert_eq!(lut.entries, (0..=255).collect::<Vec<u8>>());
+  }
+
+  #[test]
+  fn from_16_bit_signed_sample_lut() {
+    let lut =
+      OutputLut::from_sample_lut(&SampleLut::new::<i16>(|stored_value| {
+        (stored_value as i32).to_le_bytes()
+      }));
+
+    assert_eq!(lut.entry_size(), 4);
+    assert_eq!(lut.entries.len(), 65536 * 4);
+    assert_eq!(
+      &lut.entries[0x7FFF * 4..0x8000 * 4],
+      &32767i32.to_le_bytes()
+    );
+    assert_eq!(
+      &lut.entries[0x8000 * 4..0x8001 * 4],
+      &(-32768i32).to_le_bytes()
+    );
+    assert_eq!(&lut.entries[0xFFFF * 4..], &(-1i32).to_le_bytes());
+  }
+}
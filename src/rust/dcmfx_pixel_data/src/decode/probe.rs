@@ -0,0 +1,464 @@
+//! Reads the properties of a frame of compressed pixel data from its main
+//! header, without decoding it. This is used to check a frame against its
+//! Image Pixel Module before any buffers are allocated for its decode, and lets
+//! callers choose a decode strategy, e.g. how many resolution levels are worth
+//! decoding, based on how the frame was encoded.
+
+#[cfg(not(feature = "std"))]
+use alloc::{format, string::ToString};
+
+use dcmfx_core::{TransferSyntax, transfer_syntax};
+
+use crate::PixelDataDecodeError;
+
+/// The properties of a frame of compressed pixel data that are read from its
+/// main header by [`probe_frame()`].
+///
+/// Properties that a codec doesn't have, such as tiles and quality layers for
+/// JPEG, are reported as one.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct FrameProbe {
+  /// The width of the frame in pixels.
+  pub width: u32,
+
+  /// The height of the frame in pixels. This is zero for JPEG data that
+  /// defines its height in a DNL marker segment after the first scan.
+  pub height: u32,
+
+  /// The number of components, i.e. samples per pixel. For JPEG XL this is the
+  /// number of color channels and doesn't include extra channels.
+  pub components: u16,
+
+  /// The number of bits per sample. For JPEG 2000 this is the bit depth of the
+  /// first component.
+  pub bit_depth: u8,
+
+  /// Whether samples are signed. Only JPEG 2000 stores signed samples.
+  pub is_signed: bool,
+
+  /// The number of tiles in a JPEG 2000 codestream.
+  pub tile_count: u32,
+
+  /// The number of resolution levels in a JPEG 2000 codestream, which is one
+  /// more than its number of wavelet decompositions.
+  pub resolution_levels: u8,
+
+  /// The number of quality layers in a JPEG 2000 codestream.
+  pub quality_layers: u16,
+
+  /// Whether a JPEG 2000 codestream only uses High-Throughput (HT) codeblocks,
+  /// as declared in its CAP marker segment.
+  pub is_high_throughput: bool,
+}
+
+/// Reads the properties of a frame of compressed pixel data from its main
+/// header. Only the start of the frame's data is needed, so for a frame split
+/// across several fragments it's enough to pass the first fragment.
+///
+/// Supports the JPEG, JPEG-LS, JPEG 2000, and High-Throughput JPEG 2000
+/// transfer syntaxes. The JPEG XL transfer syntaxes require the `native` and
+/// `std` features, since their headers are read by libjxl.
+///
+pub fn probe_frame(
+  data: &[u8],
+  transfer_syntax: &'static TransferSyntax,
+) -> Result<FrameProbe, PixelDataDecodeError> {
+  use transfer_syntax::*;
+
+  match transfer_syntax {
+    &JPEG_BASELINE_8BIT
+    | &JPEG_EXTENDED_12BIT
+    | &JPEG_LOSSLESS_NON_HIERARCHICAL
+    | &JPEG_LOSSLESS_NON_HIERARCHICAL_SV1
+    | &JPEG_LS_LOSSLESS
+    | &JPEG_LS_LOSSY_NEAR_LOSSLESS => probe_jpeg(data),
+
+    ts if ts.is_jpeg_2000() => probe_jpeg_2000(data),
+
+    #[cfg(all(feature = "native", feature = "std"))]
+    ts if ts.is_jpeg_xl() => probe_jpeg_xl(data),
+
+    #[cfg(not(all(feature = "native", feature = "std")))]
+    ts if ts.is_jpeg_xl() => Err(PixelDataDecodeError::DecoderNotAvailable {
+      name: "libjxl".to_string(),
+    }),
+
+    _ => {
+      Err(PixelDataDecodeError::TransferSyntaxNotSupported { transfer_syntax })
+    }
+  }
+}
+
+/// Reads the frame header of JPEG or JPEG-LS data, which is the first SOFn
+/// marker segment.
+///
+fn probe_jpeg(data: &[u8]) -> Result<FrameProbe, PixelDataDecodeError> {
+  const SOI: u8 = 0xD8;
+  const SOS: u8 = 0xDA;
+  const EOI: u8 = 0xD9;
+  const SOF55: u8 = 0xF7;
+
+  let invalid = |details: &str| PixelDataDecodeError::DataInvalid {
+    details: format!("JPEG header is invalid: {details}"),
+  };
+
+  if data.get(0..2) != Some(&[0xFF, SOI]) {
+    return Err(invalid("missing SOI marker"));
+  }
+
+  let mut offset = 2;
+  loop {
+    // Markers may be preceded by any number of 0xFF fill bytes
+    while data
+      .get(offset..offset + 2)
+      .is_some_and(|m| m == [0xFF, 0xFF])
+    {
+      offset += 1;
+    }
+
+    let marker = match data.get(offset..offset + 2) {
+      Some(&[0xFF, marker]) => marker,
+      Some(_) => return Err(invalid("expected a marker")),
+      None => return Err(invalid("no frame header")),
+    };
+
+    // Markers without a segment
+    if marker == 0x01 || (0xD0..=0xD7).contains(&marker) {
+      offset += 2;
+      continue;
+    }
+
+    if marker == SOS || marker == EOI {
+      return Err(invalid("no frame header before the first scan"));
+    }
+
+    let segment_length = read_u16(data, offset + 2)
+      .map(usize::from)
+      .ok_or_else(|| invalid("truncated marker segment"))?;
+
+    // SOF0-SOF15 other than DHT, JPG, and DAC, as well as JPEG-LS's SOF55
+    let is_frame_header = matches!(marker, 0xC0..=0xCF)
+      && !matches!(marker, 0xC4 | 0xC8 | 0xCC)
+      || marker == SOF55;
+
+    if is_frame_header {
+      let segment = data
+        .get(offset + 4..offset + 2 + segment_length)
+        .filter(|segment| segment.len() >= 6)
+        .ok_or_else(|| invalid("truncated frame header"))?;
+
+      return Ok(FrameProbe {
+        width: read_u16(segment, 3).unwrap().into(),
+        height: read_u16(segment, 1).unwrap().into(),
+        components: segment[5].into(),
+        bit_depth: segment[0],
+        is_signed: false,
+        tile_count: 1,
+        resolution_levels: 1,
+        quality_layers: 1,
+        is_high_throughput: false,
+      });
+    }
+
+    offset += 2 + segment_length;
+  }
+}
+
+/// Reads the SIZ, COD, and CAP marker segments in the main header of a JPEG
+/// 2000 codestream.
+///
+fn probe_jpeg_2000(data: &[u8]) -> Result<FrameProbe, PixelDataDecodeError> {
+  const SOC: u16 = 0xFF4F;
+  const SIZ: u16 = 0xFF51;
+  const CAP: u16 = 0xFF50;
+  const COD: u16 = 0xFF52;
+  const SOT: u16 = 0xFF90;
+
+  let invalid = |details: &str| PixelDataDecodeError::DataInvalid {
+    details: format!("JPEG 2000 main header is invalid: {details}"),
+  };
+
+  if read_u16(data, 0) != Some(SOC) {
+    return Err(invalid("missing SOC marker"));
+  }
+
+  let mut probe = None;
+  let mut coding_style = None;
+  let mut is_high_throughput = false;
+
+  let mut offset = 2;
+  loop {
+    let marker = read_u16(data, offset)
+      .ok_or_else(|| invalid("main header is truncated"))?;
+    if marker == SOT {
+      break;
+    }
+
+    let segment_length = read_u16(data, offset + 2)
+      .map(usize::from)
+      .ok_or_else(|| invalid("truncated marker segment"))?;
+    let segment = data
+      .get(offset + 4..offset + 2 + segment_length)
+      .ok_or_else(|| invalid("truncated marker segment"))?;
+
+    match marker {
+      SIZ => {
+        let siz = read_siz(segment);
+        probe =
+          Some(siz.ok_or_else(|| invalid("malformed SIZ marker segment"))?);
+      }
+
+      COD => {
+        let malformed_cod = || invalid("malformed COD marker segment");
+        let layers = read_u16(segment, 2).ok_or_else(malformed_cod)?;
+        let decompositions = *segment.get(5).ok_or_else(malformed_cod)?;
+        coding_style = Some((layers, decompositions.saturating_add(1)));
+      }
+
+      CAP => is_high_throughput = is_high_throughput_cap(segment),
+
+      _ => (),
+    }
+
+    offset += 2 + segment_length;
+  }
+
+  let mut probe = probe.ok_or_else(|| invalid("no SIZ marker segment"))?;
+  (probe.quality_layers, probe.resolution_levels) =
+    coding_style.ok_or_else(|| invalid("no COD marker segment"))?;
+  probe.is_high_throughput = is_high_throughput;
+
+  Ok(probe)
+}
+
+/// Reads the image and tile sizes and the first component's depth from the
+/// body of a SIZ marker segment.
+///
+fn read_siz(segment: &[u8]) -> Option<FrameProbe> {
+  let (xsiz, ysiz) = (read_u32(segment, 2)?, read_u32(segment, 6)?);
+  let (xosiz, yosiz) = (read_u32(segment, 10)?, read_u32(segment, 14)?);
+  let (xtsiz, ytsiz) = (read_u32(segment, 18)?, read_u32(segment, 22)?);
+  let (xtosiz, ytosiz) = (read_u32(segment, 26)?, read_u32(segment, 30)?);
+  let components = read_u16(segment, 34)?;
+  let ssiz = *segment.get(36)?;
+
+  if xtsiz == 0 || ytsiz == 0 {
+    return None;
+  }
+
+  let tiles_across = xsiz.checked_sub(xtosiz)?.div_ceil(xtsiz);
+  let tiles_down = ysiz.checked_sub(ytosiz)?.div_ceil(ytsiz);
+
+  Some(FrameProbe {
+    width: xsiz.checked_sub(xosiz)?,
+    height: ysiz.checked_sub(yosiz)?,
+    components,
+    bit_depth: (ssiz & 0x7F) + 1,
+    is_signed: ssiz & 0x80 != 0,
+    tile_count: tiles_across.checked_mul(tiles_down)?,
+    resolution_levels: 1,
+    quality_layers: 1,
+    is_high_throughput: false,
+  })
+}
+
+/// Returns whether the body of a JPEG 2000 CAP marker segment declares use of
+/// JPEG 2000 Part 15 and has a Ccap15 value that says all codeblocks are HT
+/// codeblocks.
+///
+pub(crate) fn is_high_throughput_cap(segment: &[u8]) -> bool {
+  // Bit of Pcap that indicates use of Part 15, and the bits of Ccap15 that
+  // specify the types of codeblocks used. Zero in these bits means that only HT
+  // codeblocks are used.
+  const PCAP_PART_15: u32 = 1 << (32 - 15);
+  const CCAP15_HT_TYPE_MASK: u16 = 0xC000;
+
+  let Some(pcap) = read_u32(segment, 0) else {
+    return false;
+  };
+
+  if pcap & PCAP_PART_15 == 0 {
+    return false;
+  }
+
+  // There is one Ccap value for each bit set in Pcap, in order from the most
+  // significant bit
+  let ccap_index = (pcap >> (32 - 14)).count_ones() as usize;
+
+  read_u16(segment, 4 + ccap_index * 2)
+    .is_some_and(|ccap15| ccap15 & CCAP15_HT_TYPE_MASK == 0)
+}
+
+/// Reads the basic info in the header of JPEG XL data using libjxl.
+///
+#[cfg(all(feature = "native", feature = "std"))]
+fn probe_jpeg_xl(data: &[u8]) -> Result<FrameProbe, PixelDataDecodeError> {
+  let mut width = 0;
+  let mut height = 0;
+  let mut color_channels = 0;
+  let mut bits_per_sample = 0;
+  let mut error_buffer = [0 as core::ffi::c_char; 256];
+
+  let result = unsafe {
+    ffi::libjxl_probe(
+      data.as_ptr() as *const core::ffi::c_void,
+      data.len(),
+      &mut width,
+      &mut height,
+      &mut color_channels,
+      &mut bits_per_sample,
+      error_buffer.as_mut_ptr(),
+      error_buffer.len(),
+    )
+  };
+
+  if result != 0 {
+    let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
+      .to_str()
+      .unwrap_or("<invalid error>");
+
+    return Err(PixelDataDecodeError::DataInvalid {
+      details: format!("JPEG XL header is invalid: {error}"),
+    });
+  }
+
+  Ok(FrameProbe {
+    width,
+    height,
+    components: color_channels as u16,
+    bit_depth: bits_per_sample as u8,
+    is_signed: false,
+    tile_count: 1,
+    resolution_levels: 1,
+    quality_layers: 1,
+    is_high_throughput: false,
+  })
+}
+
+fn read_u16(data: &[u8], offset: usize) -> Option<u16> {
+  Some(u16::from_be_bytes(
+    data.get(offset..offset + 2)?.try_into().ok()?,
+  ))
+}
+
+fn read_u32(data: &[u8], offset: usize) -> Option<u32> {
+  Some(u32::from_be_bytes(
+    data.get(offset..offset + 4)?.try_into().ok()?,
+  ))
+}
+
+#[cfg(all(feature = "native", feature = "std"))]
+mod ffi {
+  unsafe extern "C" {
+    pub fn libjxl_probe(
+      data: *const core::ffi::c_void,
+      data_size: usize,
+      width: *mut u32,
+      height: *mut u32,
+      color_channels: *mut u32,
+      bits_per_sample: *mut u32,
+      error_buffer: *mut core::ffi::c_char,
+      error_buffer_size: usize,
+    ) -> usize;
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  #[cfg(not(feature = "std"))]
+  use alloc::vec;
+
+  use super::*;
+
+  #[test]
+  fn probe_jpeg_frame_header() {
+    let mut data = vec![0xFF, 0xD8];
+
+    // APP0 marker segment followed by fill bytes
+    data.extend_from_slice(&[0xFF, 0xE0, 0x00, 0x04, 0x00, 0x00, 0xFF]);
+
+    // SOF3 with 16-bit precision, 640 x 480, and 3 components
+    data.extend_from_slice(&[0xFF, 0xC3, 0x00, 0x11, 16, 0x01, 0xE0, 0x02]);
+    data.extend_from_slice(&[0x80, 3, 1, 0x11, 0, 2, 0x11, 0, 3, 0x11, 0]);
+
+    let probe =
+      probe_frame(&data, &transfer_syntax::JPEG_LOSSLESS_NON_HIERARCHICAL)
+        .unwrap();
+
+    assert_eq!((probe.width, probe.height), (640, 480));
+    assert_eq!(probe.components, 3);
+    assert_eq!(probe.bit_depth, 16);
+    assert_eq!(probe.tile_count, 1);
+
+    // Data that ends before the frame header
+    assert!(matches!(
+      probe_frame(&data[..10], &transfer_syntax::JPEG_BASELINE_8BIT),
+      Err(PixelDataDecodeError::DataInvalid { .. })
+    ));
+
+    // A scan before the frame header
+    assert!(matches!(
+      probe_jpeg(&[0xFF, 0xD8, 0xFF, 0xDA, 0x00, 0x02]),
+      Err(PixelDataDecodeError::DataInvalid { .. })
+    ));
+  }
+
+  #[test]
+  fn probe_jpeg_2000_main_header() {
+    let mut data = vec![0xFF, 0x4F];
+
+    // SIZ for a 100 x 50 image with 32 x 32 tiles and one signed 12-bit
+    // component
+    data.extend_from_slice(&[0xFF, 0x51, 0x00, 0x29, 0x00, 0x00]);
+    for value in [100u32, 50, 0, 0, 32, 32, 0, 0] {
+      data.extend_from_slice(&value.to_be_bytes());
+    }
+    data.extend_from_slice(&[0x00, 0x01, 0x8B, 0x01, 0x01]);
+
+    // HT-only CAP
+    data.extend_from_slice(&[0xFF, 0x50, 0x00, 0x08, 0x00, 0x02, 0x00, 0x00]);
+    data.extend_from_slice(&[0x00, 0x00]);
+
+    // COD with 3 quality layers and 5 decompositions
+    data.extend_from_slice(&[0xFF, 0x52, 0x00, 0x0C, 0x00, 0x02, 0x00, 0x03]);
+    data.extend_from_slice(&[0x00, 0x05, 0x04, 0x04, 0x00, 0x01]);
+
+    data.extend_from_slice(&[0xFF, 0x90]);
+
+    let probe =
+      probe_frame(&data, &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000).unwrap();
+
+    assert_eq!(
+      probe,
+      FrameProbe {
+        width: 100,
+        height: 50,
+        components: 1,
+        bit_depth: 12,
+        is_signed: true,
+        tile_count: 8,
+        resolution_levels: 6,
+        quality_layers: 3,
+        is_high_throughput: true,
+      }
+    );
+
+    // Truncated main header
+    assert!(probe_jpeg_2000(&data[..data.len() - 2]).is_err());
+    assert!(probe_jpeg_2000(&data[..30]).is_err());
+
+    // Not a JPEG 2000 codestream
+    assert!(probe_jpeg_2000(&data[1..]).is_err());
+  }
+
+  #[test]
+  fn probe_unsupported_transfer_syntax() {
+    assert_eq!(
+      probe_frame(&[], &transfer_syntax::RLE_LOSSLESS),
+      Err(PixelDataDecodeError::TransferSyntaxNotSupported {
+        transfer_syntax: &transfer_syntax::RLE_LOSSLESS
+      })
+    );
+  }
+}
@@ -0,0 +1,146 @@
+//! Decoding of many regions of one frame of pixel data, e.g. as a viewport pans
+//! and zooms over a large frame.
+
+#[cfg(all(feature = "native", not(feature = "std")))]
+use alloc::vec::Vec;
+
+use dcmfx_core::TransferSyntax;
+
+use crate::{
+  ColorImage, MonochromeImage, PixelDataDecodeConfig, PixelDataDecodeError,
+  PixelDataFrame, iods::ImagePixelModule, transforms::CropRect,
+};
+
+#[cfg(feature = "native")]
+use super::openjpeg;
+
+/// Decodes regions of a frame of pixel data, optionally at a reduced
+/// resolution, in the same way as [`super::decode_monochrome_region()`] and
+/// [`super::decode_color_region()`], but keeps the frame's decoder state
+/// between decodes so that each region is cheaper to decode than the first.
+///
+/// JPEG 2000 and High-Throughput JPEG 2000 decoded with OpenJPEG keep the
+/// codestream open, so its main header is only read once. When it has a
+/// single tile, the tile's data is also only read once, and code-blocks that
+/// are shared by consecutive regions at the same resolution are only decoded
+/// once. OpenJPEG reads the frame's fragments in place rather than them being
+/// combined into a single buffer. Other transfer syntaxes and decoders decode
+/// each region from scratch.
+///
+pub struct RegionDecoder {
+  // Declared ahead of `frame` so that it's dropped before the data it reads
+  #[cfg(feature = "native")]
+  codestream: Option<openjpeg::Codestream<'static>>,
+  frame: PixelDataFrame,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: ImagePixelModule,
+  decode_config: PixelDataDecodeConfig,
+}
+
+impl RegionDecoder {
+  /// Creates a new region decoder for a frame of pixel data in the given
+  /// transfer syntax. Any JPEG 2000 codestream is opened and its main header
+  /// read straight away, so errors in it are returned here.
+  ///
+  pub fn new(
+    frame: PixelDataFrame,
+    transfer_syntax: &'static TransferSyntax,
+    image_pixel_module: &ImagePixelModule,
+    decode_config: &PixelDataDecodeConfig,
+  ) -> Result<Self, PixelDataDecodeError> {
+    #[cfg(feature = "native")]
+    let codestream = {
+      // SAFETY: the data is reference counted and held in `frame`, which
+      // outlives the codestream
+      let fragments: Vec<&'static [u8]> = frame
+        .chunks()
+        .iter()
+        .map(|chunk| unsafe {
+          core::slice::from_raw_parts(chunk.as_ptr(), chunk.len())
+        })
+        .collect();
+
+      if super::is_openjpeg(transfer_syntax, decode_config, &fragments) {
+        super::check_frame_dimensions(
+          &fragments,
+          transfer_syntax,
+          image_pixel_module,
+        )?;
+
+        Some(openjpeg::Codestream::open(
+          image_pixel_module,
+          &fragments,
+          decode_config.thread_count,
+          decode_config.jpeg_2000_quality_layers,
+        )?)
+      } else {
+        None
+      }
+    };
+
+    Ok(Self {
+      #[cfg(feature = "native")]
+      codestream,
+      frame,
+      transfer_syntax,
+      image_pixel_module: image_pixel_module.clone(),
+      decode_config: *decode_config,
+    })
+  }
+
+  /// Decodes the part of the frame inside a decode area into a
+  /// [`MonochromeImage`], optionally at a reduced resolution. See
+  /// [`super::decode_monochrome_region()`] for details.
+  ///
+  pub fn decode_monochrome(
+    &mut self,
+    decode_area: &CropRect,
+    resolution_reduction: u32,
+  ) -> Result<MonochromeImage, PixelDataDecodeError> {
+    #[cfg(feature = "native")]
+    if let Some(codestream) = self.codestream.as_mut() {
+      return codestream.decode_monochrome(
+        &self.image_pixel_module,
+        decode_area,
+        resolution_reduction,
+      );
+    }
+
+    super::decode_monochrome_region(
+      &mut self.frame,
+      self.transfer_syntax,
+      &self.image_pixel_module,
+      &self.decode_config,
+      decode_area,
+      resolution_reduction,
+    )
+  }
+
+  /// Decodes the part of the frame inside a decode area into a [`ColorImage`],
+  /// optionally at a reduced resolution. See
+  /// [`super::decode_color_region()`] for details.
+  ///
+  pub fn decode_color(
+    &mut self,
+    decode_area: &CropRect,
+    resolution_reduction: u32,
+  ) -> Result<ColorImage, PixelDataDecodeError> {
+    #[cfg(feature = "native")]
+    if let Some(codestream) = self.codestream.as_mut() {
+      return codestream.decode_color(
+        &self.image_pixel_module,
+        decode_area,
+        resolution_reduction,
+      );
+    }
+
+    super::decode_color_region(
+      &mut self.frame,
+      self.transfer_syntax,
+      &self.image_pixel_module,
+      &self.decode_config,
+      decode_area,
+      resolution_reduction,
+    )
+  }
+}
@@ -4,11 +4,13 @@ use alloc::{format, string::ToString, vec, vec::Vec};
 use byteorder::ByteOrder;
 
 use crate::{
-  ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError,
+  ColorImage, ColorSpace, MonochromeImage, PixelDataDecodeError, byte_planes,
+  frame_buffer_pool,
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
     PixelRepresentation,
   },
+  row_parallel,
 };
 
 /// Returns the photometric interpretation used by decoded RLE Lossless pixel
@@ -37,9 +39,12 @@ pub fn decode_photometric_interpretation(
 /// [`PhotometricInterpretation::Monochrome1`] or
 /// [`PhotometricInterpretation::Monochrome2`] photometric interpretations.
 ///
+/// The RLE segments are decoded concurrently on up to `thread_count` threads.
+///
 pub fn decode_monochrome(
   image_pixel_module: &ImagePixelModule,
   data: &[u8],
+  thread_count: usize,
 ) -> Result<MonochromeImage, PixelDataDecodeError> {
   let expected_segment_length =
     if image_pixel_module.bits_allocated() == BitsAllocated::One {
@@ -48,7 +53,8 @@ pub fn decode_monochrome(
       image_pixel_module.pixel_count()
     };
 
-  let mut segments = decode_rle_segments(data, expected_segment_length)?;
+  let mut segments =
+    decode_rle_segments(data, expected_segment_length, thread_count)?;
 
   let width = image_pixel_module.columns();
   let height = image_pixel_module.rows();
@@ -101,12 +107,11 @@ pub fn decode_monochrome(
 
       if image_pixel_module.has_unused_high_bits() {
         let threshold = 2i8.pow(image_pixel_module.bits_stored() as u32 - 1);
+        let offset = threshold.wrapping_mul(2);
 
         for pixel in pixels.iter_mut() {
-          if *pixel >= threshold {
-            *pixel -= threshold;
-            *pixel -= threshold;
-          }
+          *pixel =
+            pixel.wrapping_sub(if *pixel >= threshold { offset } else { 0 });
         }
       }
 
@@ -151,22 +156,19 @@ pub fn decode_monochrome(
       BitsAllocated::Sixteen,
       [segment_0, segment_1],
     ) => {
-      let mut pixels = vec![0i16; pixel_count];
+      let mut pixels = frame_buffer_pool::zeroed_vec::<i16>(pixel_count);
+      combine_be16(
+        [segment_0, segment_1].map(Vec::as_slice),
+        bytemuck::cast_slice_mut(&mut pixels),
+      );
 
       if image_pixel_module.has_unused_high_bits() {
         let threshold = 2i16.pow(image_pixel_module.bits_stored() as u32 - 1);
+        let offset = threshold.wrapping_mul(2);
 
-        for i in 0..pixel_count {
-          pixels[i] = i16::from_be_bytes([segment_0[i], segment_1[i]]);
-
-          if pixels[i] >= threshold {
-            pixels[i] -= threshold;
-            pixels[i] -= threshold;
-          }
-        }
-      } else {
-        for i in 0..pixel_count {
-          pixels[i] = i16::from_be_bytes([segment_0[i], segment_1[i]]);
+        for pixel in pixels.iter_mut() {
+          *pixel =
+            pixel.wrapping_sub(if *pixel >= threshold { offset } else { 0 });
         }
       }
 
@@ -190,11 +192,8 @@ pub fn decode_monochrome(
       BitsAllocated::Sixteen,
       [segment_0, segment_1],
     ) => {
-      let mut pixels = vec![0u16; pixel_count];
-
-      for i in 0..pixel_count {
-        pixels[i] = u16::from_be_bytes([segment_0[i], segment_1[i]]);
-      }
+      let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count);
+      combine_be16([segment_0, segment_1].map(Vec::as_slice), &mut pixels);
 
       MonochromeImage::new_u16(
         width,
@@ -216,32 +215,19 @@ pub fn decode_monochrome(
       BitsAllocated::ThirtyTwo,
       [segment_0, segment_1, segment_2, segment_3],
     ) => {
-      let mut pixels = vec![0i32; pixel_count];
+      let mut pixels = frame_buffer_pool::zeroed_vec::<i32>(pixel_count);
+      combine_be32(
+        [segment_0, segment_1, segment_2, segment_3].map(Vec::as_slice),
+        bytemuck::cast_slice_mut(&mut pixels),
+      );
 
       if image_pixel_module.has_unused_high_bits() {
         let threshold = 2i32.pow(image_pixel_module.bits_stored() as u32 - 1);
+        let offset = threshold.wrapping_mul(2);
 
-        for i in 0..pixel_count {
-          pixels[i] = i32::from_be_bytes([
-            segment_0[i],
-            segment_1[i],
-            segment_2[i],
-            segment_3[i],
-          ]);
-
-          if pixels[i] >= threshold {
-            pixels[i] -= threshold;
-            pixels[i] -= threshold;
-          }
-        }
-      } else {
-        for i in 0..pixel_count {
-          pixels[i] = i32::from_be_bytes([
-            segment_0[i],
-            segment_1[i],
-            segment_2[i],
-            segment_3[i],
-          ]);
+        for pixel in pixels.iter_mut() {
+          *pixel =
+            pixel.wrapping_sub(if *pixel >= threshold { offset } else { 0 });
         }
       }
 
@@ -265,16 +251,11 @@ pub fn decode_monochrome(
       BitsAllocated::ThirtyTwo,
       [segment_0, segment_1, segment_2, segment_3],
     ) => {
-      let mut pixels = vec![0u32; pixel_count];
-
-      for i in 0..pixel_count {
-        pixels[i] = u32::from_be_bytes([
-          segment_0[i],
-          segment_1[i],
-          segment_2[i],
-          segment_3[i],
-        ]);
-      }
+      let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count);
+      combine_be32(
+        [segment_0, segment_1, segment_2, segment_3].map(Vec::as_slice),
+        &mut pixels,
+      );
 
       MonochromeImage::new_u32(
         width,
@@ -304,9 +285,12 @@ pub fn decode_monochrome(
 /// [`PhotometricInterpretation::Rgb`] or
 /// [`PhotometricInterpretation::YbrFull`] photometric interpretations.
 ///
+/// The RLE segments are decoded concurrently on up to `thread_count` threads.
+///
 pub fn decode_color(
   image_pixel_module: &ImagePixelModule,
   data: &[u8],
+  thread_count: usize,
 ) -> Result<ColorImage, PixelDataDecodeError> {
   let width = image_pixel_module.columns();
   let height = image_pixel_module.rows();
@@ -318,7 +302,7 @@ pub fn decode_color(
     _ => ColorSpace::Rgb,
   };
 
-  let mut segments = decode_rle_segments(data, pixel_count)?;
+  let mut segments = decode_rle_segments(data, pixel_count, thread_count)?;
 
   match (
     &image_pixel_module.photometric_interpretation(),
@@ -346,11 +330,8 @@ pub fn decode_color(
       BitsAllocated::Sixteen,
       [segment_0, segment_1],
     ) => {
-      let mut pixels = vec![0u16; pixel_count];
-
-      for i in 0..pixel_count {
-        pixels[i] = u16::from_be_bytes([segment_0[i], segment_1[i]]);
-      }
+      let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count);
+      combine_be16([segment_0, segment_1].map(Vec::as_slice), &mut pixels);
 
       ColorImage::new_palette16(
         width,
@@ -367,13 +348,11 @@ pub fn decode_color(
       BitsAllocated::Eight,
       [red_segment, green_segment, blue_segment],
     ) => {
-      let mut pixels = vec![0u8; pixel_count * 3];
-
-      for i in 0..pixel_count {
-        pixels[i * 3] = red_segment[i];
-        pixels[i * 3 + 1] = green_segment[i];
-        pixels[i * 3 + 2] = blue_segment[i];
-      }
+      let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
+      byte_planes::interleave3(
+        [red_segment, green_segment, blue_segment].map(Vec::as_slice),
+        &mut pixels,
+      );
 
       ColorImage::new_u8(width, height, pixels, color_space, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
@@ -391,16 +370,19 @@ pub fn decode_color(
         blue_segment_1,
       ],
     ) => {
-      let mut pixels = vec![0u16; pixel_count * 3];
-
-      for i in 0..pixel_count {
-        pixels[i * 3] =
-          u16::from_be_bytes([red_segment_0[i], red_segment_1[i]]);
-        pixels[i * 3 + 1] =
-          u16::from_be_bytes([green_segment_0[i], green_segment_1[i]]);
-        pixels[i * 3 + 2] =
-          u16::from_be_bytes([blue_segment_0[i], blue_segment_1[i]]);
-      }
+      let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
+      combine_be16x3(
+        [
+          red_segment_0,
+          red_segment_1,
+          green_segment_0,
+          green_segment_1,
+          blue_segment_0,
+          blue_segment_1,
+        ]
+        .map(Vec::as_slice),
+        &mut pixels,
+      );
 
       ColorImage::new_u16(width, height, pixels, color_space, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
@@ -424,28 +406,25 @@ pub fn decode_color(
         blue_segment_3,
       ],
     ) => {
-      let mut pixels = vec![0u32; pixel_count * 3];
-
-      for i in 0..pixel_count {
-        pixels[i * 3] = u32::from_be_bytes([
-          red_segment_0[i],
-          red_segment_1[i],
-          red_segment_2[i],
-          red_segment_3[i],
-        ]);
-        pixels[i * 3 + 1] = u32::from_be_bytes([
-          green_segment_0[i],
-          green_segment_1[i],
-          green_segment_2[i],
-          green_segment_3[i],
-        ]);
-        pixels[i * 3 + 2] = u32::from_be_bytes([
-          blue_segment_0[i],
-          blue_segment_1[i],
-          blue_segment_2[i],
-          blue_segment_3[i],
-        ]);
-      }
+      let mut pixels = frame_buffer_pool::zeroed_vec(pixel_count * 3);
+      combine_be32x3(
+        [
+          red_segment_0,
+          red_segment_1,
+          red_segment_2,
+          red_segment_3,
+          green_segment_0,
+          green_segment_1,
+          green_segment_2,
+          green_segment_3,
+          blue_segment_0,
+          blue_segment_1,
+          blue_segment_2,
+          blue_segment_3,
+        ]
+        .map(Vec::as_slice),
+        &mut pixels,
+      );
 
       ColorImage::new_u32(width, height, pixels, color_space, bits_stored)
         .map_err(PixelDataDecodeError::ImageCreationFailed)
@@ -465,13 +444,16 @@ pub fn decode_color(
   }
 }
 
-/// Decodes all RLE segments defined in RLE Lossless data.
+/// Decodes all RLE segments defined in RLE Lossless data. The segments are
+/// independent of each other, and are decoded concurrently on up to
+/// `thread_count` threads.
 ///
 /// Ref: PS3.5 G.
 ///
 fn decode_rle_segments(
   data: &[u8],
   expected_length: usize,
+  thread_count: usize,
 ) -> Result<Vec<Vec<u8>>, PixelDataDecodeError> {
   // Check there is a complete RLE Lossless header
   if data.len() < 64 {
@@ -498,9 +480,8 @@ fn decode_rle_segments(
     &mut segment_offsets,
   );
 
+  // Find the RLE data for each segment, paired with the result of decoding it
   let mut segments = Vec::with_capacity(number_of_segments);
-
-  // Decode all the segments
   for i in 0..number_of_segments {
     let segment_offset = segment_offsets[i] as usize;
 
@@ -511,14 +492,7 @@ fn decode_rle_segments(
     };
 
     if let Some(rle_data) = data.get(segment_offset..next_segment_offset) {
-      match decode_rle_segment(rle_data, expected_length) {
-        Ok(segment) => segments.push(segment),
-        Err(()) => {
-          return Err(PixelDataDecodeError::DataInvalid {
-            details: format!("RLE Lossless data segment {i} is invalid"),
-          });
-        }
-      }
+      segments.push((rle_data, Ok(Vec::new())));
     } else {
       return Err(PixelDataDecodeError::DataInvalid {
         details: format!(
@@ -529,63 +503,166 @@ fn decode_rle_segments(
     }
   }
 
-  Ok(segments)
+  // Decode all the segments
+  row_parallel::for_each_item_mut(
+    &mut segments,
+    expected_length,
+    thread_count,
+    |(rle_data, segment)| {
+      *segment = decode_rle_segment(rle_data, expected_length)
+    },
+  );
+
+  segments
+    .into_iter()
+    .enumerate()
+    .map(|(i, (_, segment))| {
+      segment.map_err(|()| PixelDataDecodeError::DataInvalid {
+        details: format!("RLE Lossless data segment {i} is invalid"),
+      })
+    })
+    .collect()
+}
+
+/// Combines segments holding the high and low bytes of 16-bit values. The
+/// segments are truncated to the output length up front so that the loop has
+/// no bounds checks and is vectorized into byte unpacks.
+///
+fn combine_be16(segments: [&[u8]; 2], output: &mut [u16]) {
+  let [segment_0, segment_1] = segments.map(|segment| &segment[..output.len()]);
+
+  for (i, value) in output.iter_mut().enumerate() {
+    *value = u16::from_be_bytes([segment_0[i], segment_1[i]]);
+  }
+}
+
+/// Combines segments holding the bytes of 32-bit values, from most to least
+/// significant. See [`combine_be16()`].
+///
+fn combine_be32(segments: [&[u8]; 4], output: &mut [u32]) {
+  let [segment_0, segment_1, segment_2, segment_3] =
+    segments.map(|segment| &segment[..output.len()]);
+
+  for (i, value) in output.iter_mut().enumerate() {
+    *value = u32::from_be_bytes([
+      segment_0[i],
+      segment_1[i],
+      segment_2[i],
+      segment_3[i],
+    ]);
+  }
+}
+
+/// Combines the six segments of 16-bit three-sample pixel data into pixels.
+/// See [`combine_be16()`].
+///
+fn combine_be16x3(segments: [&[u8]; 6], output: &mut [u16]) {
+  let pixels = output.as_chunks_mut::<3>().0;
+  let [r0, r1, g0, g1, b0, b1] =
+    segments.map(|segment| &segment[..pixels.len()]);
+
+  for (i, pixel) in pixels.iter_mut().enumerate() {
+    *pixel = [
+      u16::from_be_bytes([r0[i], r1[i]]),
+      u16::from_be_bytes([g0[i], g1[i]]),
+      u16::from_be_bytes([b0[i], b1[i]]),
+    ];
+  }
 }
 
+/// Combines the twelve segments of 32-bit three-sample pixel data into pixels.
+/// See [`combine_be16()`].
+///
+fn combine_be32x3(segments: [&[u8]; 12], output: &mut [u32]) {
+  let pixels = output.as_chunks_mut::<3>().0;
+  let s = segments.map(|segment| &segment[..pixels.len()]);
+
+  for (i, pixel) in pixels.iter_mut().enumerate() {
+    *pixel = core::array::from_fn(|c| {
+      u32::from_be_bytes([
+        s[c * 4][i],
+        s[c * 4 + 1][i],
+        s[c * 4 + 2][i],
+        s[c * 4 + 3][i],
+      ])
+    });
+  }
+}
+
+/// The longest run that can be stored in a single PackBits control byte.
+///
+const MAX_RUN_LENGTH: usize = 128;
+
+/// Decodes a single RLE segment, which is PackBits encoded, into an output
+/// buffer that's allocated at its expected length up front.
+///
+/// When there is room in both the input and output, literal and replicate runs
+/// always write [`MAX_RUN_LENGTH`] bytes. These fixed size copies and fills
+/// compile to a few vector moves rather than calls to `memcpy()` and
+/// `memset()` for each run, which matters because most runs are short. Any
+/// bytes written past the end of a run are then overwritten by the runs that
+/// follow it.
+///
 fn decode_rle_segment(
   mut rle_data: &[u8],
   expected_length: usize,
 ) -> Result<Vec<u8>, ()> {
-  let mut result = Vec::with_capacity(expected_length);
+  let mut result = vec![0u8; expected_length];
+  let mut offset = 0;
 
-  loop {
-    if result.len() == expected_length {
-      return Ok(result);
-    } else if rle_data.len() < 2 {
+  while offset < expected_length {
+    if rle_data.len() < 2 {
       // Fill with zeros if there was insufficient data. In well-formed data
       // this will never happen, but this fallback behavior improves
-      // compatibility with bad/corrupted pixel data.
-      result.resize(expected_length, 0);
+      // compatibility with bad/corrupted pixel data. This also clears any
+      // bytes written past the end of the last run.
+      result[offset..].fill(0);
 
       return Ok(result);
     }
 
     let n = rle_data[0];
+    let remaining = expected_length - offset;
 
     // Values up to 127 indicate that the next N+1 bytes should be output
     // literally
     if n <= 127 {
       let length = usize::from(n) + 1;
 
-      if let Some(slice) = rle_data.get(1..(1 + length)) {
-        // Check expected length won't be exceeded
-        if result.len() + length > expected_length {
-          return Err(());
-        }
+      // Check expected length won't be exceeded
+      if length > remaining || rle_data.len() < 1 + length {
+        return Err(());
+      }
 
-        result.extend_from_slice(slice);
-        rle_data = &rle_data[(1 + length)..];
+      if remaining >= MAX_RUN_LENGTH && rle_data.len() > MAX_RUN_LENGTH {
+        result[offset..(offset + MAX_RUN_LENGTH)]
+          .copy_from_slice(&rle_data[1..(1 + MAX_RUN_LENGTH)]);
       } else {
-        return Err(());
+        result[offset..(offset + length)]
+          .copy_from_slice(&rle_data[1..(1 + length)]);
       }
+
+      offset += length;
+      rle_data = &rle_data[(1 + length)..];
     }
     // Values greater than 128 indicate that the next byte should be repeated
     // 257 - N times
     else if n > 128 {
       let repeated_byte = rle_data[1];
 
-      let mut length = 257 - usize::from(n);
-
       // Check expected length won't be exceeded. In well-formed data the
       // expected length should never be exceeded, but it's detected and
       // corrected in order to improve compatibility with bad/corrupted pixel
       // data.
-      length = length.min(expected_length - result.len());
+      let length = (257 - usize::from(n)).min(remaining);
 
-      for _ in 0..length {
-        result.push(repeated_byte);
+      if remaining >= MAX_RUN_LENGTH {
+        result[offset..(offset + MAX_RUN_LENGTH)].fill(repeated_byte);
+      } else {
+        result[offset..(offset + length)].fill(repeated_byte);
       }
 
+      offset += length;
       rle_data = &rle_data[2..];
     }
     // A value of 128 is a no-op and is ignored
@@ -593,4 +670,51 @@ fn decode_rle_segment(
       rle_data = &rle_data[1..];
     }
   }
+
+  Ok(result)
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn decode_literal_and_replicate_runs() {
+    assert_eq!(
+      decode_rle_segment(&[3, 1, 2, 3, 4, 254, 5, 128, 1, 6, 7], 9),
+      Ok(vec![1, 2, 3, 4, 5, 5, 5, 6, 7])
+    );
+  }
+
+  #[test]
+  fn decode_long_runs() {
+    let mut rle_data = vec![127];
+    rle_data.extend(0..128);
+    rle_data.extend([129, 9, 2, 1, 2, 3, 255, 4]);
+
+    let mut expected: Vec<u8> = (0..128).collect();
+    expected.extend([9; 128]);
+    expected.extend([1, 2, 3, 4, 4]);
+
+    assert_eq!(decode_rle_segment(&rle_data, expected.len()), Ok(expected));
+  }
+
+  #[test]
+  fn decode_short_runs_followed_by_missing_data() {
+    let mut expected = vec![0; 300];
+    expected[..6].copy_from_slice(&[1, 2, 3, 3, 3, 3]);
+
+    assert_eq!(decode_rle_segment(&[1, 1, 2, 253, 3], 300), Ok(expected));
+  }
+
+  #[test]
+  fn decode_replicate_run_is_truncated() {
+    assert_eq!(decode_rle_segment(&[254, 7], 2), Ok(vec![7, 7]));
+  }
+
+  #[test]
+  fn decode_literal_run_past_expected_length() {
+    assert_eq!(decode_rle_segment(&[2, 1, 2, 3], 2), Err(()));
+    assert_eq!(decode_rle_segment(&[2, 1, 2], 3), Err(()));
+  }
 }
@@ -143,6 +143,48 @@ pub fn decode_color(
   }
 }
 
+/// Decodes only the luma of YBR JPEG pixel data using zune-jpeg, which outputs
+/// the Y component of YCbCr data without upsampling or color converting the
+/// chroma. The luma is returned as a MONOCHROME2 image.
+///
+pub fn decode_luma(
+  image_pixel_module: &ImagePixelModule,
+  data: &[u8],
+) -> Result<MonochromeImage, PixelDataDecodeError> {
+  match (
+    image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (PhotometricInterpretation::YbrFull422, BitsAllocated::Eight) => {
+      let (pixels, _) = decode(
+        image_pixel_module,
+        data,
+        zune_core::colorspace::ColorSpace::Luma,
+      )?;
+
+      MonochromeImage::new_u8(
+        image_pixel_module.columns(),
+        image_pixel_module.rows(),
+        pixels,
+        image_pixel_module.bits_stored(),
+        false,
+      )
+      .map_err(PixelDataDecodeError::ImageCreationFailed)
+    }
+
+    (photometric_interpretation, bits_allocated) => {
+      Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "JPEG luma decode not supported for photometric interpretation \
+           '{}', bits allocated '{}'",
+          photometric_interpretation,
+          u8::from(bits_allocated)
+        ),
+      })
+    }
+  }
+}
+
 fn decode(
   image_pixel_module: &ImagePixelModule,
   data: &[u8],
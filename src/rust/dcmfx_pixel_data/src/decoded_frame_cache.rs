@@ -0,0 +1,430 @@
+//! A cache of decoded frames of pixel data, used by viewers that render the
+//! same frames repeatedly, e.g. when scrolling back and forth through a stack.
+
+#[cfg(not(feature = "std"))]
+use alloc::{string::String, vec::Vec};
+
+use dcmfx_core::Rc;
+
+use crate::{
+  ColorImage, MonochromeImage, PixelDataDecodeConfig, PixelDataFrame,
+  PixelDataRenderer, iods::image_pixel_module::BitsAllocated,
+  transforms::CropRect,
+};
+
+/// A frame of pixel data decoded to stored values and held in a
+/// [`DecodedFrameCache`]. The grayscale pipeline and any color palette are
+/// applied when the frame is rendered, so changing the VOI window doesn't
+/// invalidate cached frames.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub enum DecodedFrame {
+  Monochrome(Rc<MonochromeImage>),
+  Color(Rc<ColorImage>),
+}
+
+impl DecodedFrame {
+  /// Returns the number of bytes used by this decoded frame's stored values.
+  ///
+  pub fn size_in_bytes(&self) -> usize {
+    let (pixel_count, samples_per_pixel, bits_allocated) = match self {
+      Self::Monochrome(image) => {
+        (image.pixel_count(), 1, image.bits_allocated())
+      }
+
+      Self::Color(image) => (
+        image.pixel_count(),
+        usize::from(image.samples_per_pixel()),
+        image.bits_allocated(),
+      ),
+    };
+
+    let bits_per_sample = match bits_allocated {
+      BitsAllocated::One => 1,
+      BitsAllocated::Eight => 8,
+      BitsAllocated::Sixteen => 16,
+      BitsAllocated::ThirtyTwo => 32,
+    };
+
+    (pixel_count * samples_per_pixel * bits_per_sample).div_ceil(8)
+  }
+}
+
+/// Identifies a decoded frame in a [`DecodedFrameCache`]. The decode settings
+/// are part of the key because they change the decoded stored values, e.g. a
+/// frame decoded at a reduced resolution for a thumbnail is a different cache
+/// entry to the same frame decoded at full resolution.
+///
+/// Keys are usually created with [`PixelDataRenderer::decoded_frame_key()`].
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct DecodedFrameKey {
+  pub sop_instance_uid: String,
+  pub frame_index: usize,
+  pub decode_config: PixelDataDecodeConfig,
+  pub resolution_reduction: u32,
+  pub decode_area: Option<CropRect>,
+}
+
+/// A least recently used cache of decoded frames of pixel data that holds up
+/// to a maximum number of bytes of stored values.
+///
+/// The cache also tracks the direction in which frames are being accessed, so
+/// that the frames a viewer is about to scroll to can be decoded ahead of time
+/// with [`Self::prefetch_next()`], or with [`Self::prefetch_in_background()`]
+/// when threads are available.
+///
+#[derive(Clone, Debug)]
+pub struct DecodedFrameCache {
+  max_size_in_bytes: usize,
+  size_in_bytes: usize,
+
+  // Entries are ordered from least to most recently used. Caches hold tens to
+  // hundreds of large frames, so a linear search is cheap relative to decoding
+  // and avoids needing a hash map, which isn't available on no_std targets.
+  entries: Vec<(DecodedFrameKey, DecodedFrame)>,
+
+  last_accessed_key: Option<DecodedFrameKey>,
+  scroll_direction: isize,
+
+  #[cfg(feature = "std")]
+  disk_cache: Option<std::sync::Arc<crate::DecodedFrameDiskCache>>,
+}
+
+impl DecodedFrameCache {
+  /// Creates a new decoded frame cache that holds up to the given number of
+  /// bytes of decoded stored values.
+  ///
+  pub fn new(max_size_in_bytes: usize) -> Self {
+    Self {
+      max_size_in_bytes,
+      size_in_bytes: 0,
+      entries: Vec::new(),
+      last_accessed_key: None,
+      scroll_direction: 1,
+      #[cfg(feature = "std")]
+      disk_cache: None,
+    }
+  }
+
+  /// Sets a disk cache to use as a second tier behind this cache. Frames
+  /// missing from this cache are looked for in the disk cache, and frames
+  /// inserted into this cache are also written to the disk cache, so that
+  /// they survive eviction and restarts without being decoded again.
+  ///
+  #[cfg(feature = "std")]
+  pub fn set_disk_cache(
+    &mut self,
+    disk_cache: Option<std::sync::Arc<crate::DecodedFrameDiskCache>>,
+  ) {
+    self.disk_cache = disk_cache;
+  }
+
+  /// Returns the maximum number of bytes of decoded stored values that this
+  /// cache holds.
+  ///
+  pub fn max_size_in_bytes(&self) -> usize {
+    self.max_size_in_bytes
+  }
+
+  /// Returns the number of bytes of decoded stored values currently held in
+  /// this cache.
+  ///
+  pub fn size_in_bytes(&self) -> usize {
+    self.size_in_bytes
+  }
+
+  /// Returns the number of decoded frames currently held in this cache.
+  ///
+  pub fn len(&self) -> usize {
+    self.entries.len()
+  }
+
+  /// Returns whether this cache holds no decoded frames.
+  ///
+  pub fn is_empty(&self) -> bool {
+    self.entries.is_empty()
+  }
+
+  /// Returns whether this cache holds the decoded frame with the given key.
+  /// This doesn't count as a use of the frame.
+  ///
+  pub fn contains(&self, key: &DecodedFrameKey) -> bool {
+    self.entries.iter().any(|(k, _)| k == key)
+  }
+
+  /// Returns the decoded frame with the given key if it's in this cache, or
+  /// in its disk cache, marking it as the most recently used frame. The access
+  /// also updates the scroll direction used when prefetching.
+  ///
+  pub fn get(&mut self, key: &DecodedFrameKey) -> Option<DecodedFrame> {
+    self.record_access(key);
+
+    let Some(index) = self.entries.iter().position(|(k, _)| k == key) else {
+      #[cfg(feature = "std")]
+      if let Some(frame) = self.disk_cache.as_ref().and_then(|c| c.get(key)) {
+        self.insert_in_memory(key.clone(), frame.clone());
+        return Some(frame);
+      }
+
+      return None;
+    };
+
+    let entry = self.entries.remove(index);
+    let frame = entry.1.clone();
+    self.entries.push(entry);
+
+    Some(frame)
+  }
+
+  /// Adds a decoded frame to this cache as its most recently used frame,
+  /// replacing any frame with the same key. The least recently used frames
+  /// are evicted until the cache is within its maximum size. A frame larger
+  /// than the maximum size is not cached in memory.
+  ///
+  /// The frame is also written to the disk cache if there is one and it
+  /// doesn't already hold the frame.
+  ///
+  pub fn insert(&mut self, key: DecodedFrameKey, frame: DecodedFrame) {
+    #[cfg(feature = "std")]
+    if let Some(disk_cache) = &self.disk_cache
+      && !disk_cache.contains(&key)
+    {
+      disk_cache.insert(&key, &frame);
+    }
+
+    self.insert_in_memory(key, frame);
+  }
+
+  fn insert_in_memory(&mut self, key: DecodedFrameKey, frame: DecodedFrame) {
+    self.remove(&key);
+
+    let frame_size = frame.size_in_bytes();
+    if frame_size > self.max_size_in_bytes {
+      return;
+    }
+
+    while self.size_in_bytes + frame_size > self.max_size_in_bytes {
+      let (_, evicted_frame) = self.entries.remove(0);
+      self.size_in_bytes -= evicted_frame.size_in_bytes();
+    }
+
+    self.size_in_bytes += frame_size;
+    self.entries.push((key, frame));
+  }
+
+  /// Removes the decoded frame with the given key from this cache, returning
+  /// it if it was present.
+  ///
+  pub fn remove(&mut self, key: &DecodedFrameKey) -> Option<DecodedFrame> {
+    let index = self.entries.iter().position(|(k, _)| k == key)?;
+
+    let (_, frame) = self.entries.remove(index);
+    self.size_in_bytes -= frame.size_in_bytes();
+
+    Some(frame)
+  }
+
+  /// Removes all decoded frames from this cache.
+  ///
+  pub fn clear(&mut self) {
+    self.entries.clear();
+    self.size_in_bytes = 0;
+  }
+
+  /// Returns the indices of up to `count` frames that follow the most recently
+  /// accessed frame in the current scroll direction and aren't in this cache.
+  /// The indices are in the order the frames will be reached, and are all less
+  /// than `number_of_frames`.
+  ///
+  /// Returns no indices if no frame has been accessed yet.
+  ///
+  pub fn frames_to_prefetch(
+    &self,
+    number_of_frames: usize,
+    count: usize,
+  ) -> Vec<usize> {
+    let Some(last_accessed_key) = &self.last_accessed_key else {
+      return Vec::new();
+    };
+
+    let mut key = last_accessed_key.clone();
+
+    (1..=count)
+      .filter_map(|offset| {
+        last_accessed_key
+          .frame_index
+          .checked_add_signed(self.scroll_direction * offset as isize)
+      })
+      .take_while(|frame_index| *frame_index < number_of_frames)
+      .filter(|frame_index| {
+        key.frame_index = *frame_index;
+        !self.contains(&key)
+      })
+      .collect()
+  }
+
+  /// Decodes the next frame to prefetch, if there is one, and adds it to this
+  /// cache. The frames considered are those returned by
+  /// [`Self::frames_to_prefetch()`], and `get_frame` is called to get the
+  /// pixel data for a frame index. Returns whether a frame was decoded.
+  ///
+  /// Only a single frame is decoded per call so that this can be called from
+  /// an idle callback on single-threaded targets such as WASM, e.g. with
+  /// `requestIdleCallback()`, which is rescheduled until this returns false.
+  ///
+  /// Frames that fail to decode are skipped. The error is reported when the
+  /// frame is rendered.
+  ///
+  pub fn prefetch_next(
+    &mut self,
+    renderer: &PixelDataRenderer,
+    number_of_frames: usize,
+    count: usize,
+    mut get_frame: impl FnMut(usize) -> Option<PixelDataFrame>,
+  ) -> bool {
+    let Some(last_accessed_key) = &self.last_accessed_key else {
+      return false;
+    };
+    let sop_instance_uid = last_accessed_key.sop_instance_uid.clone();
+
+    for frame_index in self.frames_to_prefetch(number_of_frames, count) {
+      let Some(mut frame) = get_frame(frame_index) else {
+        continue;
+      };
+
+      let key = renderer.decoded_frame_key(&sop_instance_uid, frame_index);
+
+      if let Ok(decoded_frame) = renderer.decode_frame(&mut frame) {
+        self.insert(key, decoded_frame);
+        return true;
+      }
+    }
+
+    false
+  }
+
+  /// Decodes frames on a background thread and adds them to the cache as they
+  /// complete. The frames are usually those returned by
+  /// [`Self::frames_to_prefetch()`], and are decoded in the order given. The
+  /// cache is only locked while adding each decoded frame, so frames can be
+  /// rendered from it while prefetching is in progress.
+  ///
+  /// Frames that fail to decode are skipped. The error is reported when the
+  /// frame is rendered.
+  ///
+  #[cfg(feature = "std")]
+  pub fn prefetch_in_background(
+    cache: &std::sync::Arc<std::sync::Mutex<Self>>,
+    renderer: &PixelDataRenderer,
+    sop_instance_uid: &str,
+    frames: Vec<PixelDataFrame>,
+  ) -> std::thread::JoinHandle<()> {
+    let cache = cache.clone();
+    let renderer = renderer.clone();
+    let sop_instance_uid = sop_instance_uid.to_string();
+
+    std::thread::spawn(move || {
+      for mut frame in frames {
+        let Some(frame_index) = frame.index() else {
+          continue;
+        };
+
+        let key = renderer.decoded_frame_key(&sop_instance_uid, frame_index);
+
+        // Skip frames that were decoded by a render since prefetching started
+        if cache.lock().unwrap().contains(&key) {
+          continue;
+        }
+
+        if let Ok(decoded_frame) = renderer.decode_frame(&mut frame) {
+          cache.lock().unwrap().insert(key, decoded_frame);
+        }
+      }
+    })
+  }
+
+  /// Updates the scroll direction following an access of the frame with the
+  /// given key.
+  ///
+  fn record_access(&mut self, key: &DecodedFrameKey) {
+    if let Some(last_accessed_key) = &self.last_accessed_key
+      && last_accessed_key.sop_instance_uid == key.sop_instance_uid
+      && last_accessed_key.frame_index != key.frame_index
+    {
+      self.scroll_direction = if key.frame_index > last_accessed_key.frame_index
+      {
+        1
+      } else {
+        -1
+      };
+    }
+
+    self.last_accessed_key = Some(key.clone());
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[cfg(not(feature = "std"))]
+  use alloc::{string::ToString, vec};
+
+  fn key(frame_index: usize) -> DecodedFrameKey {
+    DecodedFrameKey {
+      sop_instance_uid: "1.2.3".to_string(),
+      frame_index,
+      decode_config: PixelDataDecodeConfig::default(),
+      resolution_reduction: 0,
+      decode_area: None,
+    }
+  }
+
+  fn frame() -> DecodedFrame {
+    DecodedFrame::Monochrome(Rc::new(
+      MonochromeImage::new_u16(10, 10, vec![0; 100], 16, false).unwrap(),
+    ))
+  }
+
+  #[test]
+  fn evicts_least_recently_used_frames() {
+    let mut cache = DecodedFrameCache::new(600);
+
+    cache.insert(key(0), frame());
+    cache.insert(key(1), frame());
+    cache.insert(key(2), frame());
+    assert_eq!(cache.size_in_bytes(), 600);
+
+    // Using frame 0 makes frame 1 the least recently used
+    assert!(cache.get(&key(0)).is_some());
+
+    cache.insert(key(3), frame());
+    assert_eq!(cache.len(), 3);
+    assert!(cache.contains(&key(0)));
+    assert!(!cache.contains(&key(1)));
+    assert!(cache.contains(&key(2)));
+    assert!(cache.contains(&key(3)));
+
+    // Frames that don't fit are never cached
+    let mut small_cache = DecodedFrameCache::new(100);
+    small_cache.insert(key(0), frame());
+    assert!(small_cache.is_empty());
+  }
+
+  #[test]
+  fn frames_to_prefetch_follows_scroll_direction() {
+    let mut cache = DecodedFrameCache::new(10_000);
+    assert_eq!(cache.frames_to_prefetch(10, 3), Vec::<usize>::new());
+
+    cache.get(&key(4));
+    cache.insert(key(6), frame());
+    assert_eq!(cache.frames_to_prefetch(10, 3), vec![5, 7]);
+
+    cache.get(&key(3));
+    assert_eq!(cache.frames_to_prefetch(10, 5), vec![2, 1, 0]);
+
+    cache.get(&key(8));
+    assert_eq!(cache.frames_to_prefetch(10, 3), vec![9]);
+  }
+}
@@ -0,0 +1,759 @@
+//! A persistent on-disk cache of decoded frames of pixel data, used by viewer
+//! backends that serve the same studies repeatedly, so that frames only have
+//! to go through a slow decoder such as JPEG 2000 or JPEG-LS once.
+
+use std::io::{Read, Write};
+use std::path::{Path, PathBuf};
+use std::sync::Mutex;
+use std::time::SystemTime;
+
+use dcmfx_core::Rc;
+
+use crate::{
+  ColorImage, ColorImageData, ColorSpace, DecodedFrame, DecodedFrameKey,
+  MonochromeImage, MonochromeImageData,
+};
+
+/// The format that frames are stored in by a [`DecodedFrameDiskCache`].
+///
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum DiskCacheFormat {
+  /// Stored values are written as-is. This is the fastest to read back, but
+  /// uses the most disk space.
+  Uncompressed,
+
+  /// Stored values are compressed with fast deflate compression, which
+  /// typically halves the disk space used and is still far faster to read
+  /// back than decoding JPEG 2000 or JPEG-LS.
+  Deflate,
+}
+
+impl DiskCacheFormat {
+  fn name(&self) -> &'static str {
+    match self {
+      Self::Uncompressed => "uncompressed",
+      Self::Deflate => "deflate",
+    }
+  }
+}
+
+/// A least recently used cache of decoded frames stored as files in a
+/// directory, which holds up to a maximum number of bytes of files. Entries
+/// are keyed by their [`DecodedFrameKey`] and the cache's format, and persist
+/// across restarts. On startup the existing files are ordered by when they
+/// were last used.
+///
+/// Frames are decoded stored values, so the grayscale pipeline and any color
+/// palette are applied when a frame read from the cache is rendered. Palette
+/// color frames aren't cached.
+///
+/// This is usually used as the second tier of a [`crate::DecodedFrameCache`],
+/// see [`crate::DecodedFrameCache::set_disk_cache()`]. It can be shared
+/// between threads.
+///
+#[derive(Debug)]
+pub struct DecodedFrameDiskCache {
+  directory: PathBuf,
+  format: DiskCacheFormat,
+  max_size_in_bytes: u64,
+
+  // Entries are ordered from least to most recently used
+  index: Mutex<DiskCacheIndex>,
+}
+
+#[derive(Debug)]
+struct DiskCacheIndex {
+  entries: Vec<(String, u64)>,
+  size_in_bytes: u64,
+}
+
+/// The first bytes of every cache file.
+///
+const MAGIC: &[u8; 8] = b"DCMFXDF1";
+
+/// The extension of cache files. Files being written have a further
+/// extension of `.tmp` until they're complete.
+///
+const FILE_EXTENSION: &str = "frame";
+
+impl DecodedFrameDiskCache {
+  /// Opens a disk cache in the given directory, creating the directory if it
+  /// doesn't exist, which holds up to the given number of bytes of files.
+  /// Files already in the directory are kept, and the least recently used are
+  /// evicted if they exceed the maximum size.
+  ///
+  pub fn open(
+    directory: impl AsRef<Path>,
+    max_size_in_bytes: u64,
+    format: DiskCacheFormat,
+  ) -> std::io::Result<Self> {
+    let directory = directory.as_ref().to_path_buf();
+    std::fs::create_dir_all(&directory)?;
+
+    let mut entries = vec![];
+
+    for dir_entry in std::fs::read_dir(&directory)? {
+      let dir_entry = dir_entry?;
+      let path = dir_entry.path();
+
+      // Remove incomplete files left behind by an earlier process
+      if path.extension().is_some_and(|e| e == "tmp") {
+        let _ = std::fs::remove_file(&path);
+        continue;
+      }
+
+      if path.extension().is_none_or(|e| e != FILE_EXTENSION) {
+        continue;
+      }
+
+      let metadata = dir_entry.metadata()?;
+      let last_used = metadata.modified().unwrap_or(SystemTime::UNIX_EPOCH);
+      let file_name = dir_entry.file_name().to_string_lossy().to_string();
+
+      entries.push((last_used, file_name, metadata.len()));
+    }
+
+    entries.sort();
+
+    let cache = Self {
+      directory,
+      format,
+      max_size_in_bytes,
+      index: Mutex::new(DiskCacheIndex {
+        size_in_bytes: entries.iter().map(|(_, _, size)| size).sum(),
+        entries: entries
+          .into_iter()
+          .map(|(_, file_name, size)| (file_name, size))
+          .collect(),
+      }),
+    };
+
+    cache.evict(&mut cache.index.lock().unwrap(), 0);
+
+    Ok(cache)
+  }
+
+  /// Returns the format that frames are stored in.
+  ///
+  pub fn format(&self) -> DiskCacheFormat {
+    self.format
+  }
+
+  /// Returns the number of bytes of files currently held in this cache.
+  ///
+  pub fn size_in_bytes(&self) -> u64 {
+    self.index.lock().unwrap().size_in_bytes
+  }
+
+  /// Returns the number of frames currently held in this cache.
+  ///
+  pub fn len(&self) -> usize {
+    self.index.lock().unwrap().entries.len()
+  }
+
+  /// Returns whether this cache holds no frames.
+  ///
+  pub fn is_empty(&self) -> bool {
+    self.len() == 0
+  }
+
+  /// Returns the decoded frame with the given key if it's in this cache,
+  /// marking it as the most recently used frame. Files that can't be read are
+  /// removed from the cache.
+  ///
+  pub fn get(&self, key: &DecodedFrameKey) -> Option<DecodedFrame> {
+    let key_string = key_string(key, self.format);
+    let file_name = file_name(&key_string);
+
+    {
+      let mut index = self.index.lock().unwrap();
+      let position = index
+        .entries
+        .iter()
+        .position(|(name, _)| *name == file_name)?;
+
+      let entry = index.entries.remove(position);
+      index.entries.push(entry);
+    }
+
+    let path = self.directory.join(&file_name);
+
+    match read_frame(&path, &key_string) {
+      Some(frame) => {
+        // Record the use so the order is kept across restarts
+        if let Ok(file) = std::fs::File::options().write(true).open(&path) {
+          let _ = file.set_modified(SystemTime::now());
+        }
+
+        Some(frame)
+      }
+
+      None => {
+        self.remove_file(&file_name);
+        None
+      }
+    }
+  }
+
+  /// Adds a decoded frame to this cache as its most recently used frame,
+  /// replacing any frame with the same key. The least recently used frames
+  /// are evicted until the cache is within its maximum size. Frames that
+  /// can't be cached, or that are larger than the maximum size, are ignored,
+  /// as are errors writing the file.
+  ///
+  pub fn insert(&self, key: &DecodedFrameKey, frame: &DecodedFrame) {
+    let key_string = key_string(key, self.format);
+    let file_name = file_name(&key_string);
+
+    let Some(data) = serialize_frame(&key_string, frame, self.format) else {
+      return;
+    };
+
+    let size = data.len() as u64;
+    if size > self.max_size_in_bytes {
+      return;
+    }
+
+    // Write to a temporary file first so a partial file is never read
+    let path = self.directory.join(&file_name);
+    let temp_path = self
+      .directory
+      .join(format!("{file_name}.{}.tmp", std::process::id()));
+
+    let result = std::fs::write(&temp_path, &data)
+      .and_then(|_| std::fs::rename(&temp_path, &path));
+
+    if result.is_err() {
+      let _ = std::fs::remove_file(&temp_path);
+      return;
+    }
+
+    let mut index = self.index.lock().unwrap();
+
+    if let Some(position) = index
+      .entries
+      .iter()
+      .position(|(name, _)| *name == file_name)
+    {
+      let (_, old_size) = index.entries.remove(position);
+      index.size_in_bytes -= old_size;
+    }
+
+    self.evict(&mut index, size);
+
+    index.entries.push((file_name, size));
+    index.size_in_bytes += size;
+  }
+
+  /// Returns whether this cache holds the decoded frame with the given key.
+  /// This doesn't count as a use of the frame.
+  ///
+  pub fn contains(&self, key: &DecodedFrameKey) -> bool {
+    let file_name = file_name(&key_string(key, self.format));
+
+    self
+      .index
+      .lock()
+      .unwrap()
+      .entries
+      .iter()
+      .any(|(name, _)| *name == file_name)
+  }
+
+  /// Evicts the least recently used files until the given number of bytes
+  /// can be added without exceeding the maximum size.
+  ///
+  fn evict(&self, index: &mut DiskCacheIndex, incoming_size: u64) {
+    while !index.entries.is_empty()
+      && index.size_in_bytes + incoming_size > self.max_size_in_bytes
+    {
+      let (file_name, size) = index.entries.remove(0);
+      index.size_in_bytes -= size;
+
+      let _ = std::fs::remove_file(self.directory.join(file_name));
+    }
+  }
+
+  /// Removes a file from this cache.
+  ///
+  fn remove_file(&self, file_name: &str) {
+    let mut index = self.index.lock().unwrap();
+
+    if let Some(position) =
+      index.entries.iter().position(|(name, _)| name == file_name)
+    {
+      let (_, size) = index.entries.remove(position);
+      index.size_in_bytes -= size;
+    }
+
+    let _ = std::fs::remove_file(self.directory.join(file_name));
+  }
+}
+
+/// Returns the string that identifies a cache entry, which is stored in its
+/// file and checked when it's read in order to detect hash collisions.
+///
+fn key_string(key: &DecodedFrameKey, format: DiskCacheFormat) -> String {
+  format!(
+    "{}\n{}\n{:?}\n{}\n{:?}\n{}",
+    key.sop_instance_uid,
+    key.frame_index,
+    key.decode_config,
+    key.resolution_reduction,
+    key.decode_area,
+    format.name()
+  )
+}
+
+/// Returns the name of the file for a cache entry, which is the 64-bit FNV-1a
+/// hash of its key string.
+///
+fn file_name(key_string: &str) -> String {
+  let hash = key_string
+    .bytes()
+    .fold(0xcbf2_9ce4_8422_2325u64, |hash, b| {
+      (hash ^ u64::from(b)).wrapping_mul(0x0100_0000_01b3)
+    });
+
+  format!("{hash:016x}.{FILE_EXTENSION}")
+}
+
+/// The type of stored values in a cache file.
+///
+#[derive(Clone, Copy, PartialEq)]
+#[repr(u8)]
+enum SampleType {
+  Bitmap = 0,
+  MonochromeI8 = 1,
+  MonochromeU8 = 2,
+  MonochromeI16 = 3,
+  MonochromeU16 = 4,
+  MonochromeI32 = 5,
+  MonochromeU32 = 6,
+  ColorU8 = 7,
+  ColorU16 = 8,
+  ColorU32 = 9,
+}
+
+impl SampleType {
+  const ALL: [Self; 10] = [
+    Self::Bitmap,
+    Self::MonochromeI8,
+    Self::MonochromeU8,
+    Self::MonochromeI16,
+    Self::MonochromeU16,
+    Self::MonochromeI32,
+    Self::MonochromeU32,
+    Self::ColorU8,
+    Self::ColorU16,
+    Self::ColorU32,
+  ];
+}
+
+/// Serializes a decoded frame into the contents of a cache file. Returns
+/// `None` for palette color frames.
+///
+/// The file holds [`MAGIC`], the length and bytes of the key string, the
+/// sample type, width, height, bits stored, a flags byte, the color space,
+/// the format, and then the stored values in little endian.
+///
+fn serialize_frame(
+  key_string: &str,
+  frame: &DecodedFrame,
+  format: DiskCacheFormat,
+) -> Option<Vec<u8>> {
+  let mut flags = 0u8;
+  let mut color_space = 0u8;
+
+  let (sample_type, width, height, bits_stored, samples) = match frame {
+    DecodedFrame::Monochrome(image) => {
+      if image.is_monochrome1() {
+        flags |= 2;
+      }
+
+      let (sample_type, samples) = match image.data() {
+        MonochromeImageData::Bitmap { data, is_signed } => {
+          if *is_signed {
+            flags |= 1;
+          }
+          (SampleType::Bitmap, data.clone())
+        }
+        MonochromeImageData::I8(data) => {
+          (SampleType::MonochromeI8, to_le_bytes(data))
+        }
+        MonochromeImageData::U8(data) => {
+          (SampleType::MonochromeU8, data.clone())
+        }
+        MonochromeImageData::I16(data) => {
+          (SampleType::MonochromeI16, to_le_bytes(data))
+        }
+        MonochromeImageData::U16(data) => {
+          (SampleType::MonochromeU16, to_le_bytes(data))
+        }
+        MonochromeImageData::I32(data) => {
+          (SampleType::MonochromeI32, to_le_bytes(data))
+        }
+        MonochromeImageData::U32(data) => {
+          (SampleType::MonochromeU32, to_le_bytes(data))
+        }
+      };
+
+      (
+        sample_type,
+        image.width(),
+        image.height(),
+        image.bits_stored(),
+        samples,
+      )
+    }
+
+    DecodedFrame::Color(image) => {
+      let (sample_type, samples, space) = match image.data() {
+        ColorImageData::U8 { data, color_space } => {
+          (SampleType::ColorU8, data.clone(), *color_space)
+        }
+        ColorImageData::U16 { data, color_space } => {
+          (SampleType::ColorU16, to_le_bytes(data), *color_space)
+        }
+        ColorImageData::U32 { data, color_space } => {
+          (SampleType::ColorU32, to_le_bytes(data), *color_space)
+        }
+        ColorImageData::PaletteU8 { .. }
+        | ColorImageData::PaletteU16 { .. } => return None,
+      };
+
+      color_space = match space {
+        ColorSpace::Rgb => 0,
+        ColorSpace::Ybr { is_422: false } => 1,
+        ColorSpace::Ybr { is_422: true } => 2,
+      };
+
+      (
+        sample_type,
+        image.width(),
+        image.height(),
+        image.bits_stored(),
+        samples,
+      )
+    }
+  };
+
+  let mut data = Vec::with_capacity(samples.len() + key_string.len() + 32);
+  data.extend_from_slice(MAGIC);
+  data.extend_from_slice(&(key_string.len() as u32).to_le_bytes());
+  data.extend_from_slice(key_string.as_bytes());
+  data.push(sample_type as u8);
+  data.extend_from_slice(&width.to_le_bytes());
+  data.extend_from_slice(&height.to_le_bytes());
+  data.extend_from_slice(&bits_stored.to_le_bytes());
+  data.push(flags);
+  data.push(color_space);
+
+  match format {
+    DiskCacheFormat::Uncompressed => {
+      data.push(0);
+      data.extend_from_slice(&samples);
+    }
+
+    DiskCacheFormat::Deflate => {
+      data.push(1);
+
+      let mut encoder =
+        flate2::write::DeflateEncoder::new(data, flate2::Compression::fast());
+      encoder.write_all(&samples).ok()?;
+      data = encoder.finish().ok()?;
+    }
+  }
+
+  Some(data)
+}
+
+/// Reads a decoded frame from a cache file, checking that it's for the given
+/// key string. Returns `None` if the file can't be read or is invalid.
+///
+fn read_frame(path: &Path, key_string: &str) -> Option<DecodedFrame> {
+  let data = std::fs::read(path).ok()?;
+
+  let (magic, data) = data.split_at_checked(MAGIC.len())?;
+  if magic != MAGIC {
+    return None;
+  }
+
+  let (key_length, data) = data.split_at_checked(4)?;
+  let key_length = u32::from_le_bytes(key_length.try_into().ok()?) as usize;
+
+  let (stored_key, data) = data.split_at_checked(key_length)?;
+  if stored_key != key_string.as_bytes() {
+    return None;
+  }
+
+  let (header, data) = data.split_at_checked(10)?;
+  let sample_type = *SampleType::ALL.get(usize::from(header[0]))?;
+  let width = u16::from_le_bytes([header[1], header[2]]);
+  let height = u16::from_le_bytes([header[3], header[4]]);
+  let bits_stored = u16::from_le_bytes([header[5], header[6]]);
+  let flags = header[7];
+  let color_space = match header[8] {
+    0 => ColorSpace::Rgb,
+    1 => ColorSpace::Ybr { is_422: false },
+    2 => ColorSpace::Ybr { is_422: true },
+    _ => return None,
+  };
+
+  let samples = match header[9] {
+    0 => data.to_vec(),
+    1 => {
+      let mut samples = vec![];
+      flate2::read::DeflateDecoder::new(data)
+        .read_to_end(&mut samples)
+        .ok()?;
+      samples
+    }
+    _ => return None,
+  };
+
+  let is_signed = flags & 1 != 0;
+  let is_monochrome1 = flags & 2 != 0;
+
+  let monochrome = |image: Result<MonochromeImage, &'static str>| {
+    Some(DecodedFrame::Monochrome(Rc::new(image.ok()?)))
+  };
+  let color = |image: Result<ColorImage, &'static str>| {
+    Some(DecodedFrame::Color(Rc::new(image.ok()?)))
+  };
+
+  match sample_type {
+    SampleType::Bitmap => monochrome(MonochromeImage::new_bitmap(
+      width,
+      height,
+      samples,
+      is_signed,
+      is_monochrome1,
+    )),
+    SampleType::MonochromeI8 => monochrome(MonochromeImage::new_i8(
+      width,
+      height,
+      from_le_bytes(&samples)?,
+      bits_stored,
+      is_monochrome1,
+    )),
+    SampleType::MonochromeU8 => monochrome(MonochromeImage::new_u8(
+      width,
+      height,
+      samples,
+      bits_stored,
+      is_monochrome1,
+    )),
+    SampleType::MonochromeI16 => monochrome(MonochromeImage::new_i16(
+      width,
+      height,
+      from_le_bytes(&samples)?,
+      bits_stored,
+      is_monochrome1,
+    )),
+    SampleType::MonochromeU16 => monochrome(MonochromeImage::new_u16(
+      width,
+      height,
+      from_le_bytes(&samples)?,
+      bits_stored,
+      is_monochrome1,
+    )),
+    SampleType::MonochromeI32 => monochrome(MonochromeImage::new_i32(
+      width,
+      height,
+      from_le_bytes(&samples)?,
+      bits_stored,
+      is_monochrome1,
+    )),
+    SampleType::MonochromeU32 => monochrome(MonochromeImage::new_u32(
+      width,
+      height,
+      from_le_bytes(&samples)?,
+      bits_stored,
+      is_monochrome1,
+    )),
+    SampleType::ColorU8 => color(ColorImage::new_u8(
+      width,
+      height,
+      samples,
+      color_space,
+      bits_stored,
+    )),
+    SampleType::ColorU16 => color(ColorImage::new_u16(
+      width,
+      height,
+      from_le_bytes(&samples)?,
+      color_space,
+      bits_stored,
+    )),
+    SampleType::ColorU32 => color(ColorImage::new_u32(
+      width,
+      height,
+      from_le_bytes(&samples)?,
+      color_space,
+      bits_stored,
+    )),
+  }
+}
+
+/// A stored value type that can be converted to and from little endian bytes.
+///
+trait LeBytes: Sized + Copy {
+  const SIZE: usize;
+
+  fn write_le_bytes(self, output: &mut Vec<u8>);
+  fn from_le_slice(bytes: &[u8]) -> Self;
+}
+
+macro_rules! impl_le_bytes {
+  ($type:ty) => {
+    impl LeBytes for $type {
+      const SIZE: usize = core::mem::size_of::<$type>();
+
+      fn write_le_bytes(self, output: &mut Vec<u8>) {
+        output.extend_from_slice(&self.to_le_bytes());
+      }
+
+      fn from_le_slice(bytes: &[u8]) -> Self {
+        Self::from_le_bytes(bytes.try_into().unwrap())
+      }
+    }
+  };
+}
+
+impl_le_bytes!(i8);
+impl_le_bytes!(i16);
+impl_le_bytes!(u16);
+impl_le_bytes!(i32);
+impl_le_bytes!(u32);
+
+fn to_le_bytes<T: LeBytes>(values: &[T]) -> Vec<u8> {
+  let mut bytes = Vec::with_capacity(values.len() * T::SIZE);
+  for value in values {
+    value.write_le_bytes(&mut bytes);
+  }
+
+  bytes
+}
+
+fn from_le_bytes<T: LeBytes>(bytes: &[u8]) -> Option<Vec<T>> {
+  if bytes.len() % T::SIZE != 0 {
+    return None;
+  }
+
+  Some(bytes.chunks_exact(T::SIZE).map(T::from_le_slice).collect())
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  use crate::PixelDataDecodeConfig;
+
+  fn key(frame_index: usize) -> DecodedFrameKey {
+    DecodedFrameKey {
+      sop_instance_uid: "1.2.3".to_string(),
+      frame_index,
+      decode_config: PixelDataDecodeConfig::default(),
+      resolution_reduction: 0,
+      decode_area: None,
+    }
+  }
+
+  fn temp_directory(name: &str) -> PathBuf {
+    let directory = std::env::temp_dir().join(format!(
+      "dcmfx_decoded_frame_disk_cache_{name}_{}",
+      std::process::id()
+    ));
+    let _ = std::fs::remove_dir_all(&directory);
+
+    directory
+  }
+
+  #[test]
+  fn round_trips_frames() {
+    let directory = temp_directory("round_trip");
+
+    for format in [DiskCacheFormat::Uncompressed, DiskCacheFormat::Deflate] {
+      let cache =
+        DecodedFrameDiskCache::open(&directory, 1_000_000, format).unwrap();
+
+      let monochrome = DecodedFrame::Monochrome(Rc::new(
+        MonochromeImage::new_i16(
+          4,
+          2,
+          vec![-3, 0, 1, 2, 3, 4, 5, 600],
+          12,
+          true,
+        )
+        .unwrap(),
+      ));
+      let color = DecodedFrame::Color(Rc::new(
+        ColorImage::new_u16(
+          2,
+          1,
+          vec![1, 2, 3, 4, 5, 6],
+          ColorSpace::Ybr { is_422: true },
+          10,
+        )
+        .unwrap(),
+      ));
+
+      cache.insert(&key(0), &monochrome);
+      cache.insert(&key(1), &color);
+
+      assert_eq!(cache.get(&key(0)), Some(monochrome));
+      assert_eq!(cache.get(&key(1)), Some(color));
+      assert_eq!(cache.get(&key(2)), None);
+    }
+
+    std::fs::remove_dir_all(&directory).unwrap();
+  }
+
+  #[test]
+  fn evicts_least_recently_used_frames_and_persists() {
+    let directory = temp_directory("evict");
+
+    let frame = DecodedFrame::Monochrome(Rc::new(
+      MonochromeImage::new_u8(10, 10, vec![7; 100], 8, false).unwrap(),
+    ));
+
+    // Size the cache to hold exactly three frames
+    let format = DiskCacheFormat::Uncompressed;
+    let max_size = serialize_frame(&key_string(&key(0), format), &frame, format)
+      .unwrap()
+      .len() as u64
+      * 3;
+
+    {
+      let cache =
+        DecodedFrameDiskCache::open(&directory, max_size, format).unwrap();
+
+      for i in 0..3 {
+        cache.insert(&key(i), &frame);
+      }
+      assert_eq!(cache.len(), 3);
+
+      // Using frame 0 makes frame 1 the least recently used
+      assert!(cache.get(&key(0)).is_some());
+      cache.insert(&key(3), &frame);
+
+      assert_eq!(cache.len(), 3);
+      assert!(cache.contains(&key(0)));
+      assert!(!cache.contains(&key(1)));
+      assert_eq!(cache.size_in_bytes(), max_size);
+    }
+
+    // Entries are still present when the cache is reopened
+    let cache = DecodedFrameDiskCache::open(
+      &directory,
+      500,
+      DiskCacheFormat::Uncompressed,
+    )
+    .unwrap();
+    assert_eq!(cache.len(), 3);
+    assert_eq!(cache.get(&key(3)), Some(frame));
+
+    std::fs::remove_dir_all(&directory).unwrap();
+  }
+}
@@ -0,0 +1,202 @@
+use std::sync::Mutex;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::time::Duration;
+
+/// The number of frames whose encode throughput is averaged before the effort
+/// is adjusted.
+///
+const ADJUSTMENT_FRAME_COUNT: u32 = 16;
+
+/// How far above the target the measured throughput has to be before the
+/// effort is raised. This stops the effort oscillating between two levels
+/// when the target lies between them.
+///
+const RAISE_EFFORT_HEADROOM: f64 = 1.5;
+
+/// Chooses the effort used to encode pixel data so that a target encode
+/// throughput is met, within configured bounds on the effort.
+///
+/// Transcodes take their effort from [`Self::effort()`] when they start, and
+/// report the time taken to encode each frame with [`Self::record_frame()`].
+/// After every few frames the measured throughput is compared with the
+/// target, and the effort is lowered by one if the target was missed, or
+/// raised by one if it was comfortably exceeded.
+///
+/// Throughput is measured in megapixels per second of encode time, which
+/// makes it independent of frame size and of how many frames are encoded
+/// concurrently. Pipelines that queue work for encoding can also report their
+/// queue depth with [`Self::set_queue_depth()`], and the effort is then lowered
+/// whenever the queue is over its limit, and only raised when the queue is
+/// at most half full.
+///
+/// A single instance is intended to be shared by all concurrent transcodes,
+/// see [`P10PixelDataTranscodeTransform::set_adaptive_effort()`].
+///
+/// [`P10PixelDataTranscodeTransform::set_adaptive_effort()`]:
+///   crate::transforms::P10PixelDataTranscodeTransform::set_adaptive_effort
+///
+#[derive(Debug)]
+pub struct AdaptiveEffort {
+  min_effort: u8,
+  max_effort: u8,
+  target_megapixels_per_second: f64,
+  queue_depth: AtomicUsize,
+  queue_depth_limit: Option<usize>,
+  state: Mutex<AdaptiveEffortState>,
+}
+
+#[derive(Debug)]
+struct AdaptiveEffortState {
+  effort: u8,
+  frame_count: u32,
+  pixel_count: u64,
+  encode_time: Duration,
+}
+
+impl AdaptiveEffort {
+  /// Creates a new adaptive effort that keeps the effort in the range
+  /// `min_effort..=max_effort`, starting at `initial_effort`, and aims for
+  /// frames to be encoded at the given number of megapixels per second.
+  ///
+  pub fn new(
+    min_effort: u8,
+    max_effort: u8,
+    initial_effort: u8,
+    target_megapixels_per_second: f64,
+  ) -> Self {
+    let min_effort = min_effort.clamp(1, 10);
+    let max_effort = max_effort.clamp(min_effort, 10);
+
+    Self {
+      min_effort,
+      max_effort,
+      target_megapixels_per_second,
+      queue_depth: AtomicUsize::new(0),
+      queue_depth_limit: None,
+      state: Mutex::new(AdaptiveEffortState {
+        effort: initial_effort.clamp(min_effort, max_effort),
+        frame_count: 0,
+        pixel_count: 0,
+        encode_time: Duration::ZERO,
+      }),
+    }
+  }
+
+  /// Sets the queue depth above which the effort is lowered regardless of the
+  /// measured throughput. By default the queue depth isn't considered.
+  ///
+  pub fn set_queue_depth_limit(&mut self, queue_depth_limit: Option<usize>) {
+    self.queue_depth_limit = queue_depth_limit;
+  }
+
+  /// Sets the number of items currently queued for encoding, e.g. the number
+  /// of input files waiting to be transcoded.
+  ///
+  pub fn set_queue_depth(&self, queue_depth: usize) {
+    self.queue_depth.store(queue_depth, Ordering::Relaxed);
+  }
+
+  /// Returns the effort that new transcodes should use.
+  ///
+  pub fn effort(&self) -> u8 {
+    self.state.lock().unwrap().effort
+  }
+
+  /// Records the time taken to encode a frame with the given number of
+  /// pixels, and adjusts the effort if enough frames have now been recorded.
+  ///
+  pub fn record_frame(&self, pixel_count: usize, encode_time: Duration) {
+    let mut state = self.state.lock().unwrap();
+
+    state.frame_count += 1;
+    state.pixel_count += pixel_count as u64;
+    state.encode_time += encode_time;
+
+    if state.frame_count < ADJUSTMENT_FRAME_COUNT {
+      return;
+    }
+
+    let megapixels_per_second = state.pixel_count as f64
+      / 1_000_000.0
+      / state.encode_time.as_secs_f64().max(f64::EPSILON);
+
+    let queue_depth = self.queue_depth.load(Ordering::Relaxed);
+    let (is_queue_over_limit, is_queue_under_half) =
+      match self.queue_depth_limit {
+        Some(limit) => (queue_depth > limit, queue_depth <= limit / 2),
+        None => (false, true),
+      };
+
+    if megapixels_per_second < self.target_megapixels_per_second
+      || is_queue_over_limit
+    {
+      state.effort = state.effort.saturating_sub(1).max(self.min_effort);
+    } else if megapixels_per_second
+      >= self.target_megapixels_per_second * RAISE_EFFORT_HEADROOM
+      && is_queue_under_half
+    {
+      state.effort = (state.effort + 1).min(self.max_effort);
+    }
+
+    state.frame_count = 0;
+    state.pixel_count = 0;
+    state.encode_time = Duration::ZERO;
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  fn record_frames(
+    adaptive_effort: &AdaptiveEffort,
+    megapixels_per_second: f64,
+  ) {
+    for _ in 0..ADJUSTMENT_FRAME_COUNT {
+      adaptive_effort.record_frame(
+        1_000_000,
+        Duration::from_secs_f64(1.0 / megapixels_per_second),
+      );
+    }
+  }
+
+  #[test]
+  fn adjusts_effort_to_meet_target() {
+    let adaptive_effort = AdaptiveEffort::new(5, 8, 7, 10.0);
+
+    // Too slow, so the effort drops until it reaches the minimum
+    record_frames(&adaptive_effort, 5.0);
+    assert_eq!(adaptive_effort.effort(), 6);
+    record_frames(&adaptive_effort, 5.0);
+    record_frames(&adaptive_effort, 5.0);
+    assert_eq!(adaptive_effort.effort(), 5);
+
+    // Close to the target, so the effort stays the same
+    record_frames(&adaptive_effort, 12.0);
+    assert_eq!(adaptive_effort.effort(), 5);
+
+    // Comfortably fast, so the effort rises until it reaches the maximum
+    for _ in 0..5 {
+      record_frames(&adaptive_effort, 20.0);
+    }
+    assert_eq!(adaptive_effort.effort(), 8);
+  }
+
+  #[test]
+  fn lowers_effort_when_queue_is_over_limit() {
+    let mut adaptive_effort = AdaptiveEffort::new(1, 10, 7, 10.0);
+    adaptive_effort.set_queue_depth_limit(Some(100));
+
+    adaptive_effort.set_queue_depth(101);
+    record_frames(&adaptive_effort, 20.0);
+    assert_eq!(adaptive_effort.effort(), 6);
+
+    adaptive_effort.set_queue_depth(60);
+    record_frames(&adaptive_effort, 20.0);
+    assert_eq!(adaptive_effort.effort(), 6);
+
+    adaptive_effort.set_queue_depth(10);
+    record_frames(&adaptive_effort, 20.0);
+    assert_eq!(adaptive_effort.effort(), 7);
+  }
+}
@@ -1,12 +1,11 @@
-#[cfg(not(feature = "std"))]
-use alloc::{boxed::Box, string::ToString, vec, vec::Vec};
+use std::cell::RefCell;
 
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataEncodeError,
   color_image::ColorImageData,
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
-    PixelRepresentation, PlanarConfiguration,
+    PixelRepresentation, PlanarConfiguration, SamplesPerPixel,
   },
   monochrome_image::MonochromeImageData,
 };
@@ -38,12 +37,15 @@ pub fn encode_image_pixel_module(
   Ok(image_pixel_module)
 }
 
-/// Encodes a [`MonochromeImage`] into JPEG-LS raw bytes using CharLS.
+/// Encodes a [`MonochromeImage`] into JPEG-LS raw bytes using CharLS. A
+/// non-zero `restart_interval` writes a restart marker after every
+/// `restart_interval` rows.
 ///
 pub fn encode_monochrome(
   image: &MonochromeImage,
   image_pixel_module: &ImagePixelModule,
   quality: Option<u8>,
+  restart_interval: u32,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
   let width = image.width();
   let height = image.height();
@@ -62,9 +64,14 @@ pub fn encode_monochrome(
         pixel_representation: PixelRepresentation::Unsigned,
       },
       BitsAllocated::Eight,
-    ) if image_pixel_module.bits_stored() >= 2 => {
-      encode(data, width, height, image_pixel_module, quality)
-    }
+    ) if image_pixel_module.bits_stored() >= 2 => encode(
+      data,
+      width,
+      height,
+      image_pixel_module,
+      quality,
+      restart_interval,
+    ),
 
     (
       MonochromeImageData::U16(data),
@@ -81,6 +88,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      restart_interval,
     ),
 
     _ => Err(PixelDataEncodeError::NotSupported {
@@ -91,12 +99,15 @@ pub fn encode_monochrome(
   }
 }
 
-/// Encodes a [`ColorImage`] into JPEG-LS raw bytes using CharLS.
+/// Encodes a [`ColorImage`] into JPEG-LS raw bytes using CharLS. A non-zero
+/// `restart_interval` writes a restart marker after every `restart_interval`
+/// rows.
 ///
 pub fn encode_color(
   image: &ColorImage,
   image_pixel_module: &ImagePixelModule,
   quality: Option<u8>,
+  restart_interval: u32,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
   let width = image.width();
   let height = image.height();
@@ -126,9 +137,14 @@ pub fn encode_color(
       ColorImageData::PaletteU8 { data, .. },
       PhotometricInterpretation::PaletteColor { .. },
       None,
-    ) if image_pixel_module.bits_stored() >= 2 => {
-      encode(data, width, height, image_pixel_module, quality)
-    }
+    ) if image_pixel_module.bits_stored() >= 2 => encode(
+      data,
+      width,
+      height,
+      image_pixel_module,
+      quality,
+      restart_interval,
+    ),
 
     (
       ColorImageData::U16 {
@@ -156,6 +172,7 @@ pub fn encode_color(
       height,
       image_pixel_module,
       quality,
+      restart_interval,
     ),
 
     _ => Err(PixelDataEncodeError::NotSupported {
@@ -166,17 +183,103 @@ pub fn encode_color(
   }
 }
 
+/// A reusable CharLS JPEG-LS encoder. Creating an encoder has a cost, so a
+/// single encoder is kept per thread and reused for every frame encoded on
+/// that thread.
+///
+pub struct CharlsEncoder {
+  handle: *mut ffi::CharlsJpeglsEncoder,
+}
+
+impl CharlsEncoder {
+  /// Creates a new CharLS encoder.
+  ///
+  pub fn new() -> Result<Self, PixelDataEncodeError> {
+    let handle = unsafe { ffi::charls_encoder_create() };
+    if handle.is_null() {
+      return Err(PixelDataEncodeError::OtherError {
+        name: "CharLS encode failed".to_string(),
+        details: "Encoder creation failed".to_string(),
+      });
+    }
+
+    Ok(Self { handle })
+  }
+
+  /// Encodes raw samples into JPEG-LS. A `near_lossless` value of zero
+  /// performs a lossless encode, and a `restart_interval` of zero writes no
+  /// restart markers.
+  ///
+  pub fn encode(
+    &mut self,
+    data: &[u8],
+    width: u16,
+    height: u16,
+    image_pixel_module: &ImagePixelModule,
+    near_lossless: u8,
+    restart_interval: u32,
+  ) -> Result<Vec<u8>, PixelDataEncodeError> {
+    let mut output_data = vec![];
+
+    let mut error_buffer = [0 as core::ffi::c_char; 256];
+
+    let result = unsafe {
+      ffi::charls_encode(
+        self.handle,
+        data.as_ptr() as *const core::ffi::c_void,
+        width.into(),
+        height.into(),
+        u8::from(image_pixel_module.samples_per_pixel()).into(),
+        u8::from(image_pixel_module.bits_allocated()).into(),
+        near_lossless.into(),
+        restart_interval as usize,
+        interleave_mode(image_pixel_module),
+        append_output_data,
+        &mut output_data as *mut Vec<u8> as *mut core::ffi::c_void,
+        error_buffer.as_mut_ptr(),
+        error_buffer.len(),
+      )
+    };
+
+    if result != 0 {
+      let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
+        .to_str()
+        .unwrap_or("<invalid error>");
+
+      return Err(PixelDataEncodeError::OtherError {
+        name: "CharLS encode failed".to_string(),
+        details: error.to_string(),
+      });
+    }
+
+    Ok(output_data)
+  }
+}
+
+impl Drop for CharlsEncoder {
+  fn drop(&mut self) {
+    unsafe { ffi::charls_encoder_destroy(self.handle) };
+  }
+}
+
+// SAFETY: The CharLS encoder has no thread affinity, it just can't be used from
+// multiple threads at the same time, which `&mut self` on encode prevents.
+unsafe impl Send for CharlsEncoder {}
+
+std::thread_local! {
+  static ENCODER: RefCell<Option<CharlsEncoder>> = const { RefCell::new(None) };
+}
+
+/// Encodes using this thread's CharLS encoder, creating it if needed.
+///
 fn encode(
   data: &[u8],
   width: u16,
   height: u16,
   image_pixel_module: &ImagePixelModule,
   quality: Option<u8>,
+  restart_interval: u32,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
-  let mut output_buffer = vec![];
-
-  let mut error_buffer = [0 as core::ffi::c_char; 256];
-
   let near_lossless: u8 = if let Some(quality) = quality {
     // Determine the maximum near_lossless value
     let max_near_lossless =
@@ -191,66 +294,86 @@ fn encode(
     0
   };
 
-  let bytes_written = unsafe {
-    ffi::charls_encode(
-      data.as_ptr() as *const core::ffi::c_void,
-      width.into(),
-      height.into(),
-      u8::from(image_pixel_module.samples_per_pixel()).into(),
-      u8::from(image_pixel_module.bits_allocated()).into(),
-      near_lossless.into(),
-      output_buffer_allocate,
-      &mut output_buffer as *mut Vec<u8> as *mut core::ffi::c_void,
-      error_buffer.as_mut_ptr(),
-      error_buffer.len(),
-    )
-  };
+  ENCODER.with_borrow_mut(|encoder| {
+    let encoder = match encoder {
+      Some(encoder) => encoder,
+      None => encoder.insert(CharlsEncoder::new()?),
+    };
 
-  if bytes_written == 0 {
-    let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
-      .to_str()
-      .unwrap_or("<invalid error>");
+    encoder.encode(
+      data,
+      width,
+      height,
+      image_pixel_module,
+      near_lossless,
+      restart_interval,
+    )
+  })
+}
 
-    return Err(PixelDataEncodeError::OtherError {
-      name: "CharLS encode failed".to_string(),
-      details: error.to_string(),
-    });
+/// Returns the CharLS interleave mode to encode with, which is 0 for none, 1
+/// for line, and 2 for sample. Color samples are always pixel interleaved,
+/// which CharLS reads as-is for the line and sample interleave modes, so no
+/// separate planes need to be made. 8-bit color is sample interleaved because
+/// CharLS has a codec optimized for it, and other bit depths are line
+/// interleaved, which codes each line of a component with the single component
+/// codecs and is faster for them.
+///
+fn interleave_mode(image_pixel_module: &ImagePixelModule) -> usize {
+  match (
+    image_pixel_module.samples_per_pixel(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (SamplesPerPixel::One, _) => 0,
+    (SamplesPerPixel::Three { .. }, BitsAllocated::Eight) => 2,
+    (SamplesPerPixel::Three { .. }, _) => 1,
   }
-
-  output_buffer.truncate(bytes_written as usize);
-
-  Ok(output_buffer)
 }
 
 /// This function is passed as a callback to [`ffi::charls_encode()`] and
-/// is then called to allocate output data.
+/// is then called with output data as it becomes available so it can be
+/// accumulated in a [`Vec<u8>`].
 ///
-extern "C" fn output_buffer_allocate(
+extern "C" fn append_output_data(
+  data: *const core::ffi::c_void,
   len: usize,
   context: *mut core::ffi::c_void,
-) -> *mut core::ffi::c_void {
+) {
   unsafe {
-    let output_buffer = &mut *(context as *mut Vec<u8>);
+    let output_data = &mut *(context as *mut Vec<u8>);
 
-    output_buffer.resize(len, 0);
-    output_buffer.as_mut_ptr() as *mut core::ffi::c_void
+    (*output_data)
+      .extend_from_slice(core::slice::from_raw_parts(data as *const u8, len));
   }
 }
 
 mod ffi {
+  #[repr(C)]
+  pub struct CharlsJpeglsEncoder {
+    _private: [u8; 0],
+  }
+
   unsafe extern "C" {
+    pub fn charls_encoder_create() -> *mut CharlsJpeglsEncoder;
+
+    pub fn charls_encoder_destroy(encoder: *mut CharlsJpeglsEncoder);
+
     pub fn charls_encode(
+      encoder: *mut CharlsJpeglsEncoder,
       input_data: *const core::ffi::c_void,
       width: usize,
       height: usize,
       samples_per_pixel: usize,
       bits_allocated: usize,
       near_lossless: usize,
-      output_buffer_allocate: extern "C" fn(
+      restart_interval: usize,
+      interleave_mode: usize,
+      output_data_callback: extern "C" fn(
+        *const core::ffi::c_void,
         usize,
         *mut core::ffi::c_void,
-      ) -> *mut core::ffi::c_void,
-      output_buffer_context: *mut core::ffi::c_void,
+      ),
+      output_data_context: *mut core::ffi::c_void,
       error_buffer: *mut core::ffi::c_char,
       error_buffer_size: usize,
     ) -> usize;
@@ -36,3 +36,19 @@ pub fn encode_image_pixel_module(
 
   Ok(image_pixel_module)
 }
+
+/// Converts a quality value in the range 1-100 to a quantization step size
+/// value for lossy compression, relative to the range of the samples. This
+/// equation was inspired by the publication 'Parameterization of the Quality
+/// Factor for the High-Throughput JPEG 2000' by Ahar et al.
+///
+#[cfg(any(feature = "native", dcmfx_openjph))]
+pub fn quality_to_quantization_step_size(quality: u8) -> f32 {
+  let ratio = 25.0;
+
+  if quality >= 50 {
+    (1.0 - f32::from(quality - 50) / 100.0) / ratio
+  } else {
+    (50.0 / f32::from(quality)) / ratio
+  }
+}
@@ -1,9 +1,12 @@
 #[cfg(not(feature = "std"))]
 use alloc::{boxed::Box, string::ToString, vec, vec::Vec};
 
+#[cfg(feature = "std")]
+use std::cell::RefCell;
+
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataEncodeConfig,
-  PixelDataEncodeError,
+  PixelDataEncodeError, PixelDataFrame,
   color_image::ColorImageData,
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
@@ -39,10 +42,11 @@ pub fn encode_monochrome(
   image: &MonochromeImage,
   image_pixel_module: &ImagePixelModule,
   encode_config: &PixelDataEncodeConfig,
-) -> Result<Vec<u8>, PixelDataEncodeError> {
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
   let width = image.width();
   let height = image.height();
   let quality = encode_config.quality;
+  let restart_interval = encode_config.jpeg_12bit_restart_interval();
 
   match (
     image.data(),
@@ -64,6 +68,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      restart_interval,
     ),
 
     _ => Err(PixelDataEncodeError::NotSupported {
@@ -81,10 +86,11 @@ pub fn encode_color(
   image: &ColorImage,
   image_pixel_module: &ImagePixelModule,
   encode_config: &PixelDataEncodeConfig,
-) -> Result<Vec<u8>, PixelDataEncodeError> {
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
   let width = image.width();
   let height = image.height();
   let quality = encode_config.quality;
+  let restart_interval = encode_config.jpeg_12bit_restart_interval();
 
   match (
     image.data(),
@@ -116,6 +122,7 @@ pub fn encode_color(
       height,
       image_pixel_module,
       quality,
+      restart_interval,
     ),
 
     _ => Err(PixelDataEncodeError::NotSupported {
@@ -132,8 +139,9 @@ fn encode(
   height: u16,
   image_pixel_module: &ImagePixelModule,
   quality: u8,
-) -> Result<Vec<u8>, PixelDataEncodeError> {
-  let mut output_buffer = vec![];
+  restart_interval: u32,
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
+  let mut output_chunks: Vec<Vec<u8>> = vec![];
   let mut error_buffer = [0 as core::ffi::c_char; 256];
 
   let color_space = match image_pixel_module.photometric_interpretation() {
@@ -155,8 +163,9 @@ fn encode(
       _ => unreachable!(),
     };
 
-  let result = unsafe {
+  let mut encode_with = |encoder: &mut Encoder| unsafe {
     ffi::libjpeg_12bit_encode(
+      encoder.0,
       data.as_ptr(),
       width.into(),
       height.into(),
@@ -164,12 +173,84 @@ fn encode(
       photometric_interpretation,
       color_space,
       quality.into(),
-      output_data_callback,
-      &mut output_buffer as *mut Vec<u8> as *mut core::ffi::c_void,
+      restart_interval as usize,
+      output_chunk_callback,
+      &mut output_chunks as *mut Vec<Vec<u8>> as *mut core::ffi::c_void,
       error_buffer.as_mut_ptr(),
     )
   };
 
+  #[cfg(feature = "std")]
+  let result = ENCODER.with_borrow_mut(|encoder| {
+    let encoder = match encoder {
+      Some(encoder) => encoder,
+      None => encoder.insert(Encoder::new()?),
+    };
+
+    Ok::<_, PixelDataEncodeError>(encode_with(encoder))
+  })?;
+
+  #[cfg(not(feature = "std"))]
+  let result = encode_with(&mut Encoder::new()?);
+
+  check_result(result, &error_buffer)?;
+
+  // The output chunks become the chunks of the frame, so the compressed data
+  // is never copied into a single contiguous buffer. The first chunk is sized
+  // from the image so the output is usually in just one chunk.
+  let mut frame = PixelDataFrame::new();
+  for chunk in output_chunks {
+    if !chunk.is_empty() {
+      frame.push_bytes(chunk.into());
+    }
+  }
+
+  Ok(frame)
+}
+
+/// A reusable libjpeg_12bit encoder. Its compress object and permanent
+/// allocations, which include the quantization and Huffman tables, are kept
+/// between frames, so a single encoder is kept per thread and reused for every
+/// frame encoded on that thread.
+///
+/// The Huffman tables are optimized for each frame, so the tables derived
+/// from them for encoding are always recomputed.
+///
+struct Encoder(*mut core::ffi::c_void);
+
+impl Encoder {
+  fn new() -> Result<Self, PixelDataEncodeError> {
+    let mut encoder = core::ptr::null_mut();
+    let mut error_buffer = [0 as core::ffi::c_char; 256];
+
+    let result = unsafe {
+      ffi::libjpeg_12bit_encoder_create(&mut encoder, error_buffer.as_mut_ptr())
+    };
+
+    check_result(result, &error_buffer)?;
+
+    Ok(Self(encoder))
+  }
+}
+
+impl Drop for Encoder {
+  fn drop(&mut self) {
+    unsafe { ffi::libjpeg_12bit_encoder_destroy(self.0) };
+  }
+}
+
+#[cfg(feature = "std")]
+std::thread_local! {
+  static ENCODER: RefCell<Option<Encoder>> = const { RefCell::new(None) };
+}
+
+/// Converts the result of a call into libjpeg_12bit into a [`Result`], reading
+/// the error message string on error.
+///
+fn check_result(
+  result: usize,
+  error_buffer: &[core::ffi::c_char],
+) -> Result<(), PixelDataEncodeError> {
   if result != 0 {
     let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
       .to_str()
@@ -181,27 +262,55 @@ fn encode(
     });
   }
 
-  Ok(output_buffer)
+  Ok(())
 }
 
-/// This function is passed as a callback to [`ffi::libjpeg_12bit_encode()`] and
-/// is then called to receive output data.
+/// This function is passed as a callback to [`ffi::libjpeg_12bit_encode()`].
+/// Each call sets the number of bytes libjpeg_12bit wrote into the most recent
+/// chunk, and then adds a new chunk with the requested capacity and returns a
+/// pointer to it. A capacity of zero means encoding is complete.
 ///
-extern "C" fn output_data_callback(
-  data: *const u8,
-  len: usize,
+extern "C" fn output_chunk_callback(
+  chunk_size: usize,
+  next_chunk_capacity: usize,
   context: *mut core::ffi::c_void,
-) {
+) -> *mut core::ffi::c_void {
   unsafe {
-    let output_buffer = &mut *(context as *mut Vec<u8>);
+    let output_chunks = &mut *(context as *mut Vec<Vec<u8>>);
+
+    // libjpeg_12bit has initialized the first `chunk_size` bytes of the last
+    // chunk
+    if let Some(chunk) = output_chunks.last_mut() {
+      chunk.set_len(chunk_size);
+    }
 
-    output_buffer.extend_from_slice(core::slice::from_raw_parts(data, len));
+    if next_chunk_capacity == 0 {
+      if let Some(chunk) = output_chunks.last_mut() {
+        chunk.shrink_to_fit();
+      }
+
+      return core::ptr::null_mut();
+    }
+
+    let mut chunk = Vec::with_capacity(next_chunk_capacity);
+    let chunk_ptr = chunk.as_mut_ptr();
+    output_chunks.push(chunk);
+
+    chunk_ptr as *mut core::ffi::c_void
   }
 }
 
 mod ffi {
   unsafe extern "C" {
+    pub fn libjpeg_12bit_encoder_create(
+      encoder: *mut *mut core::ffi::c_void,
+      error_message: *mut core::ffi::c_char,
+    ) -> usize;
+
+    pub fn libjpeg_12bit_encoder_destroy(encoder: *mut core::ffi::c_void);
+
     pub fn libjpeg_12bit_encode(
+      encoder: *mut core::ffi::c_void,
       input_data: *const u16,
       width: usize,
       height: usize,
@@ -209,12 +318,13 @@ mod ffi {
       photometric_interpretation: usize,
       color_space: usize,
       quality: usize,
-      output_data_callback: extern "C" fn(
-        *const u8,
+      restart_interval: usize,
+      output_chunk_callback: extern "C" fn(
+        usize,
         usize,
         *mut core::ffi::c_void,
-      ),
-      output_buffer_context: *mut core::ffi::c_void,
+      ) -> *mut core::ffi::c_void,
+      output_chunk_context: *mut core::ffi::c_void,
       error_message: *mut core::ffi::c_char,
     ) -> usize;
   }
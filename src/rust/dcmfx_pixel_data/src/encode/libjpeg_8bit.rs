@@ -0,0 +1,215 @@
+#[cfg(not(feature = "std"))]
+use alloc::{boxed::Box, string::ToString, vec, vec::Vec};
+
+use crate::{
+  ColorImage, ColorSpace, MonochromeImage, PixelDataEncodeConfig,
+  PixelDataEncodeError, PixelDataFrame,
+  color_image::ColorImageData,
+  iods::image_pixel_module::{
+    BitsAllocated, ImagePixelModule, PhotometricInterpretation,
+    PixelRepresentation,
+  },
+  monochrome_image::MonochromeImageData,
+};
+
+/// Encodes a [`MonochromeImage`] into JPEG Baseline (Process 1) raw bytes using
+/// libjpeg_8bit.
+///
+pub fn encode_monochrome(
+  image: &MonochromeImage,
+  image_pixel_module: &ImagePixelModule,
+  encode_config: &PixelDataEncodeConfig,
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
+  match (
+    image.data(),
+    image.is_monochrome1(),
+    image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      MonochromeImageData::U8(data),
+      true,
+      PhotometricInterpretation::Monochrome1 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      BitsAllocated::Eight,
+    )
+    | (
+      MonochromeImageData::U8(data),
+      false,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      BitsAllocated::Eight,
+    ) => encode(
+      data,
+      image.width(),
+      image.height(),
+      image_pixel_module,
+      encode_config.quality,
+    ),
+
+    _ => Err(PixelDataEncodeError::NotSupported {
+      image_pixel_module: Box::new(image_pixel_module.clone()),
+      input_bits_allocated: image.bits_allocated(),
+      input_color_space: None,
+    }),
+  }
+}
+
+/// Encodes a [`ColorImage`] into JPEG Baseline (Process 1) raw bytes using
+/// libjpeg_8bit.
+///
+pub fn encode_color(
+  image: &ColorImage,
+  image_pixel_module: &ImagePixelModule,
+  encode_config: &PixelDataEncodeConfig,
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
+  match (
+    image.data(),
+    image_pixel_module.photometric_interpretation(),
+    image_pixel_module.bits_allocated(),
+  ) {
+    (
+      ColorImageData::U8 {
+        data,
+        color_space: ColorSpace::Rgb,
+      },
+      PhotometricInterpretation::Rgb,
+      BitsAllocated::Eight,
+    )
+    | (
+      ColorImageData::U8 {
+        data,
+        color_space: ColorSpace::Ybr { is_422: true },
+      },
+      PhotometricInterpretation::YbrFull422,
+      BitsAllocated::Eight,
+    ) => encode(
+      data,
+      image.width(),
+      image.height(),
+      image_pixel_module,
+      encode_config.quality,
+    ),
+
+    _ => Err(PixelDataEncodeError::NotSupported {
+      image_pixel_module: Box::new(image_pixel_module.clone()),
+      input_bits_allocated: image.bits_allocated(),
+      input_color_space: Some(image.color_space()),
+    }),
+  }
+}
+
+fn encode(
+  data: &[u8],
+  width: u16,
+  height: u16,
+  image_pixel_module: &ImagePixelModule,
+  quality: u8,
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
+  let mut output_chunks: Vec<Vec<u8>> = vec![];
+  let mut error_buffer = [0 as core::ffi::c_char; 256];
+
+  let (photometric_interpretation, color_space) =
+    match image_pixel_module.photometric_interpretation() {
+      PhotometricInterpretation::Monochrome1 { .. } => (1, 1),
+      PhotometricInterpretation::Monochrome2 { .. } => (2, 1),
+      PhotometricInterpretation::Rgb => (3, 2),
+      PhotometricInterpretation::YbrFull422 => (5, 3),
+      _ => unreachable!(),
+    };
+
+  let result = unsafe {
+    ffi::libjpeg_8bit_encode(
+      data.as_ptr(),
+      width.into(),
+      height.into(),
+      u8::from(image_pixel_module.samples_per_pixel()).into(),
+      photometric_interpretation,
+      color_space,
+      quality.into(),
+      output_chunk_callback,
+      &mut output_chunks as *mut Vec<Vec<u8>> as *mut core::ffi::c_void,
+      error_buffer.as_mut_ptr(),
+    )
+  };
+
+  if result != 0 {
+    let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
+      .to_str()
+      .unwrap_or("<invalid error>");
+
+    return Err(PixelDataEncodeError::OtherError {
+      name: "libjpeg_8bit encode failed".to_string(),
+      details: error.to_string(),
+    });
+  }
+
+  // The output chunks become the chunks of the frame, so the compressed data
+  // is never copied into a single contiguous buffer
+  let mut frame = PixelDataFrame::new();
+  for chunk in output_chunks {
+    if !chunk.is_empty() {
+      frame.push_bytes(chunk.into());
+    }
+  }
+
+  Ok(frame)
+}
+
+/// This function is passed as a callback to [`ffi::libjpeg_8bit_encode()`].
+/// Each call sets the number of bytes libjpeg_8bit wrote into the most recent
+/// chunk, and then adds a new chunk with the requested capacity and returns a
+/// pointer to it. A capacity of zero means encoding is complete.
+///
+extern "C" fn output_chunk_callback(
+  chunk_size: usize,
+  next_chunk_capacity: usize,
+  context: *mut core::ffi::c_void,
+) -> *mut core::ffi::c_void {
+  unsafe {
+    let output_chunks = &mut *(context as *mut Vec<Vec<u8>>);
+
+    // libjpeg_8bit has initialized the first `chunk_size` bytes of the last
+    // chunk
+    if let Some(chunk) = output_chunks.last_mut() {
+      chunk.set_len(chunk_size);
+    }
+
+    if next_chunk_capacity == 0 {
+      if let Some(chunk) = output_chunks.last_mut() {
+        chunk.shrink_to_fit();
+      }
+
+      return core::ptr::null_mut();
+    }
+
+    let mut chunk = Vec::with_capacity(next_chunk_capacity);
+    let chunk_ptr = chunk.as_mut_ptr();
+    output_chunks.push(chunk);
+
+    chunk_ptr as *mut core::ffi::c_void
+  }
+}
+
+mod ffi {
+  unsafe extern "C" {
+    pub fn libjpeg_8bit_encode(
+      input_data: *const u8,
+      width: usize,
+      height: usize,
+      samples_per_pixel: usize,
+      photometric_interpretation: usize,
+      color_space: usize,
+      quality: usize,
+      output_chunk_callback: extern "C" fn(
+        usize,
+        usize,
+        *mut core::ffi::c_void,
+      ) -> *mut core::ffi::c_void,
+      output_chunk_context: *mut core::ffi::c_void,
+      error_message: *mut core::ffi::c_char,
+    ) -> usize;
+  }
+}
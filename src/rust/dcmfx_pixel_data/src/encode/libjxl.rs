@@ -1,14 +1,16 @@
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataEncodeError,
+  PixelDataFrame,
   color_image::ColorImageData,
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
     PixelRepresentation, PlanarConfiguration,
   },
+  libjxl_thread_pool::with_parallel_runner,
   monochrome_image::MonochromeImageData,
 };
 
-use super::PixelDataEncodeConfig;
+use super::{JpegXlEncodeProfile, PixelDataEncodeConfig};
 
 /// Returns the Image Pixel Module resulting from encoding using libjxl.
 ///
@@ -44,87 +46,115 @@ pub fn encode_image_pixel_module(
   Ok(image_pixel_module)
 }
 
-/// Encodes a [`MonochromeImage`] into JPEG XL raw bytes using libjxl.
+/// Encodes a [`MonochromeImage`] into a JPEG XL frame using libjxl.
+///
+/// Signed samples, and 32-bit samples whose values fit in 16 bits, are folded
+/// into the unsigned samples that libjxl encodes by libjxl_interface.cpp as it
+/// passes them to libjxl.
 ///
 pub fn encode_monochrome(
   image: &MonochromeImage,
   image_pixel_module: &ImagePixelModule,
   encode_config: &PixelDataEncodeConfig,
   lossless: bool,
-) -> Result<Vec<u8>, PixelDataEncodeError> {
-  let width = image.width();
-  let height = image.height();
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
+  let not_supported = || PixelDataEncodeError::NotSupported {
+    image_pixel_module: Box::new(image_pixel_module.clone()),
+    input_bits_allocated: image.bits_allocated(),
+    input_color_space: None,
+  };
 
-  match (
+  if !image_pixel_module.is_monochrome()
+    || image.is_monochrome1()
+      != image_pixel_module
+        .photometric_interpretation()
+        .is_monochrome1()
+  {
+    return Err(not_supported());
+  }
+
+  let (data, bits_per_sample): (&[u8], usize) = match (
     image.data(),
-    image.is_monochrome1(),
-    image_pixel_module.photometric_interpretation(),
+    image_pixel_module.pixel_representation(),
     image_pixel_module.bits_allocated(),
   ) {
     (
       MonochromeImageData::U8(data),
-      true,
-      PhotometricInterpretation::Monochrome1 {
-        pixel_representation: PixelRepresentation::Unsigned,
-      },
+      PixelRepresentation::Unsigned,
       BitsAllocated::Eight,
-    )
-    | (
-      MonochromeImageData::U8(data),
-      false,
-      PhotometricInterpretation::Monochrome2 {
-        pixel_representation: PixelRepresentation::Unsigned,
-      },
+    ) => (data, bits_per_sample(data, image_pixel_module)),
+
+    (
+      MonochromeImageData::I8(data),
+      PixelRepresentation::Signed,
       BitsAllocated::Eight,
-    ) => encode(
-      data,
-      width,
-      height,
-      image_pixel_module,
-      encode_config,
-      lossless,
+    ) => (
+      bytemuck::cast_slice(data),
+      bits_per_sample(data, image_pixel_module),
     ),
 
     (
       MonochromeImageData::U16(data),
-      true,
-      PhotometricInterpretation::Monochrome1 {
-        pixel_representation: PixelRepresentation::Unsigned,
-      },
+      PixelRepresentation::Unsigned,
       BitsAllocated::Sixteen,
-    )
-    | (
-      MonochromeImageData::U16(data),
-      false,
-      PhotometricInterpretation::Monochrome2 {
-        pixel_representation: PixelRepresentation::Unsigned,
-      },
+    ) => (
+      bytemuck::cast_slice(data),
+      bits_per_sample(data, image_pixel_module),
+    ),
+
+    (
+      MonochromeImageData::I16(data),
+      PixelRepresentation::Signed,
       BitsAllocated::Sixteen,
-    ) => encode(
+    ) => (
       bytemuck::cast_slice(data),
-      width,
-      height,
-      image_pixel_module,
-      encode_config,
-      lossless,
+      bits_per_sample(data, image_pixel_module),
     ),
 
-    _ => Err(PixelDataEncodeError::NotSupported {
-      image_pixel_module: Box::new(image_pixel_module.clone()),
-      input_bits_allocated: image.bits_allocated(),
-      input_color_space: None,
-    }),
+    (
+      MonochromeImageData::U32(data),
+      PixelRepresentation::Unsigned,
+      BitsAllocated::ThirtyTwo,
+    ) => (
+      bytemuck::cast_slice(data),
+      bits_per_sample(data, image_pixel_module),
+    ),
+
+    (
+      MonochromeImageData::I32(data),
+      PixelRepresentation::Signed,
+      BitsAllocated::ThirtyTwo,
+    ) => (
+      bytemuck::cast_slice(data),
+      bits_per_sample(data, image_pixel_module),
+    ),
+
+    _ => return Err(not_supported()),
+  };
+
+  if bits_per_sample > 16 {
+    return Err(not_supported());
   }
+
+  encode(
+    data,
+    bits_per_sample,
+    image.width(),
+    image.height(),
+    image_pixel_module,
+    encode_config,
+    lossless,
+  )
 }
 
-/// Encodes a [`ColorImage`] into JPEG XL raw bytes using libjxl.
+/// Encodes a [`ColorImage`] into a JPEG XL frame using libjxl.
 ///
 pub fn encode_color(
   image: &ColorImage,
   image_pixel_module: &ImagePixelModule,
   encode_config: &PixelDataEncodeConfig,
   lossless: bool,
-) -> Result<Vec<u8>, PixelDataEncodeError> {
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
   let width = image.width();
   let height = image.height();
 
@@ -153,6 +183,7 @@ pub fn encode_color(
       false,
     ) => encode(
       data,
+      bits_per_sample(data, image_pixel_module),
       width,
       height,
       image_pixel_module,
@@ -179,6 +210,7 @@ pub fn encode_color(
       false,
     ) => encode(
       bytemuck::cast_slice(data),
+      bits_per_sample(data, image_pixel_module),
       width,
       height,
       image_pixel_module,
@@ -194,19 +226,74 @@ pub fn encode_color(
   }
 }
 
+/// Returns the number of bits per sample to encode with. This is the bits
+/// stored when all samples fit in it, e.g. for 12-bit CT data held in 16-bit
+/// samples, which means libjxl doesn't spend time and MA tree context on high
+/// bits that are always zero. Otherwise it is the bits allocated.
+///
+/// libjxl takes at most 16 bits per sample, so 32-bit samples are encoded with
+/// 16 bits when their values fit, and otherwise 32 is returned and they can't
+/// be encoded. libjxl also requires 16-bit input samples to have more than 8
+/// bits per sample, so 16-bit data with eight or fewer bits stored is encoded
+/// with 9 bits.
+///
+fn bits_per_sample<T: Copy + Into<i64>>(
+  data: &[T],
+  image_pixel_module: &ImagePixelModule,
+) -> usize {
+  let bits_allocated: usize =
+    u8::from(image_pixel_module.bits_allocated()).into();
+  let max_bits = bits_allocated.min(16);
+  let bits_stored = usize::from(image_pixel_module.bits_stored())
+    .max(if bits_allocated > 8 { 9 } else { 1 });
+
+  if bits_stored >= bits_allocated && bits_allocated <= max_bits {
+    return bits_allocated;
+  }
+
+  // Find the bits needed to hold every sample. Negative samples are inverted
+  // so that their sign extension bits are clear, and then need a sign bit.
+  let used_bits = data.iter().fold(0i64, |bits, sample| {
+    let sample: i64 = (*sample).into();
+    bits | (sample ^ (sample >> 63))
+  });
+  let needed_bits = (64 - used_bits.leading_zeros()) as usize
+    + usize::from(image_pixel_module.pixel_representation().is_signed());
+
+  if needed_bits <= bits_stored.min(max_bits) {
+    bits_stored.min(max_bits)
+  } else if bits_allocated <= max_bits {
+    bits_allocated
+  } else if needed_bits <= max_bits {
+    max_bits
+  } else {
+    bits_allocated
+  }
+}
+
 fn encode(
   data: &[u8],
+  bits_per_sample: usize,
   width: u16,
   height: u16,
   image_pixel_module: &ImagePixelModule,
   encode_config: &PixelDataEncodeConfig,
   lossless: bool,
-) -> Result<Vec<u8>, PixelDataEncodeError> {
-  let mut output_data = Vec::with_capacity(256 * 1024);
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
+  let mut output_chunks: Vec<Vec<u8>> = vec![];
 
   let mut error_buffer = [0 as ::core::ffi::c_char; 256];
 
-  let result = unsafe {
+  // libjxl passes lossless frames encoded at effort 1 to its fast lossless
+  // encoder, which handles all the 8-bit and 16-bit grayscale and RGB data
+  // that's encoded here
+  let effort = if lossless && encode_config.jpeg_xl_fast_lossless {
+    1
+  } else {
+    encode_config.effort
+  };
+
+  let result = with_parallel_runner(|runner, runner_opaque| unsafe {
     ffi::libjxl_encode(
       data.as_ptr() as *const core::ffi::c_void,
       data.len(),
@@ -214,16 +301,24 @@ fn encode(
       height.into(),
       u8::from(image_pixel_module.samples_per_pixel()).into(),
       u8::from(image_pixel_module.bits_allocated()).into(),
+      bits_per_sample,
+      image_pixel_module.pixel_representation().is_signed().into(),
       image_pixel_module.is_color().into(),
       lossless.into(),
       encode_config.quality.into(),
-      encode_config.effort.into(),
-      output_data_callback,
-      &mut output_data as *mut Vec<u8> as *mut core::ffi::c_void,
+      effort.into(),
+      encode_config.jpeg_xl_progressive.into(),
+      encode_profile(encode_config.jpeg_xl_encode_profile),
+      encode_config.jpeg_xl_center_first.into(),
+      encode_config.thread_count,
+      runner,
+      runner_opaque,
+      output_chunk_callback,
+      &mut output_chunks as *mut Vec<Vec<u8>> as *mut core::ffi::c_void,
       error_buffer.as_mut_ptr(),
       error_buffer.len(),
     )
-  };
+  });
 
   if result != 0 {
     let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
@@ -236,26 +331,67 @@ fn encode(
     });
   }
 
-  Ok(output_data)
+  // The output chunks become the chunks of the frame, so the compressed data
+  // is never copied into a single contiguous buffer
+  let mut frame = PixelDataFrame::new();
+  for chunk in output_chunks {
+    if !chunk.is_empty() {
+      frame.push_bytes(chunk.into());
+    }
+  }
+
+  Ok(frame)
 }
 
-/// This function is passed as a callback to [`ffi::libjxl_encode()`] and
-/// is then called when the size of the output buffer needs to be changed. A
-/// pointer to its base address is returned.
+/// Returns the value that selects an encode profile in
+/// [`ffi::libjxl_encode()`].
 ///
-extern "C" fn output_data_callback(
-  new_len: usize,
+fn encode_profile(profile: JpegXlEncodeProfile) -> usize {
+  match profile {
+    JpegXlEncodeProfile::Balanced => 0,
+    JpegXlEncodeProfile::FastDecode => 1,
+    JpegXlEncodeProfile::MaxRatio => 2,
+    JpegXlEncodeProfile::Medical => 3,
+  }
+}
+
+/// This function is passed as a callback to [`ffi::libjxl_encode()`]. Each
+/// call sets the number of bytes libjxl wrote into the most recent chunk, and
+/// then adds a new chunk with the requested capacity and returns a pointer to
+/// it. A capacity of zero means encoding is complete.
+///
+extern "C" fn output_chunk_callback(
+  chunk_size: usize,
+  next_chunk_capacity: usize,
   context: *mut core::ffi::c_void,
 ) -> *mut core::ffi::c_void {
   unsafe {
-    let output_data = &mut *(context as *mut Vec<u8>);
+    let output_chunks = &mut *(context as *mut Vec<Vec<u8>>);
+
+    // libjxl has initialized the first `chunk_size` bytes of the last chunk
+    if let Some(chunk) = output_chunks.last_mut() {
+      chunk.set_len(chunk_size);
+    }
+
+    if next_chunk_capacity == 0 {
+      if let Some(chunk) = output_chunks.last_mut() {
+        chunk.shrink_to_fit();
+      }
 
-    output_data.resize(new_len, 0);
-    output_data.as_mut_ptr() as *mut core::ffi::c_void
+      return core::ptr::null_mut();
+    }
+
+    let mut chunk = Vec::with_capacity(next_chunk_capacity);
+    let chunk_ptr = chunk.as_mut_ptr();
+    output_chunks.push(chunk);
+
+    chunk_ptr as *mut core::ffi::c_void
   }
 }
 
 mod ffi {
+  use crate::libjxl_thread_pool::ffi::JxlParallelRunner;
+
   unsafe extern "C" {
     pub fn libjxl_encode(
       input_data: *const core::ffi::c_void,
@@ -264,15 +400,24 @@ mod ffi {
       height: usize,
       samples_per_pixel: usize,
       bits_allocated: usize,
+      bits_per_sample: usize,
+      is_signed: usize,
       is_color: usize,
       lossless: usize,
       quality: usize,
       effort: usize,
-      output_data_callback: extern "C" fn(
+      progressive: usize,
+      encode_profile: usize,
+      center_first: usize,
+      thread_count: usize,
+      custom_runner: Option<JxlParallelRunner>,
+      custom_runner_opaque: *mut core::ffi::c_void,
+      output_chunk_callback: extern "C" fn(
+        usize,
         usize,
         *mut core::ffi::c_void,
       ) -> *mut core::ffi::c_void,
-      output_data_context: *mut core::ffi::c_void,
+      output_chunk_context: *mut core::ffi::c_void,
       error_buffer: *const core::ffi::c_char,
       error_buffer_size: usize,
     ) -> usize;
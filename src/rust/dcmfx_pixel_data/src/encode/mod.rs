@@ -8,26 +8,47 @@ use alloc::{
 };
 
 use dcmfx_core::{DcmfxError, TransferSyntax, transfer_syntax};
+use dcmfx_p10::deflate;
 
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataFrame,
+  codec_threads::{self, FrameCodec},
   iods::image_pixel_module::{BitsAllocated, ImagePixelModule},
 };
 
+#[cfg(feature = "std")]
+mod adaptive_effort;
 #[cfg(all(feature = "native", feature = "std"))]
 mod charls;
 mod jpeg_2000;
 mod jpeg_encoder;
 #[cfg(feature = "native")]
 mod libjpeg_12bit;
+#[cfg(feature = "native")]
+mod libjpeg_8bit;
 #[cfg(all(feature = "native", feature = "std"))]
 mod libjxl;
 mod native;
 #[cfg(feature = "native")]
 mod openjpeg;
-#[cfg(all(feature = "native", feature = "std"))]
+#[cfg(dcmfx_openjph)]
 mod openjph;
 mod rle_lossless;
+#[cfg(feature = "std")]
+mod transfer_syntax_selection;
+
+#[cfg(feature = "std")]
+pub use adaptive_effort::AdaptiveEffort;
+#[cfg(feature = "std")]
+pub use transfer_syntax_selection::{
+  TransferSyntaxSelection, TransferSyntaxSelectionPolicy, TrialEncodeResult,
+};
+
+/// The maximum number of quality layers before the final quality layer when
+/// encoding JPEG 2000, see
+/// [`PixelDataEncodeConfig::jpeg_2000_quality_layers()`].
+///
+const MAX_JPEG_2000_QUALITY_LAYERS: usize = 15;
 
 /// Configuration used when encoding pixel data.
 ///
@@ -36,6 +57,25 @@ pub struct PixelDataEncodeConfig {
   quality: u8,
   effort: u8,
   zlib_compression_level: u32,
+  zlib_thread_count: usize,
+  thread_count: usize,
+  jpeg_2000_tile_size: u32,
+  jpeg_2000_block_size: u32,
+  jpeg_2000_precinct_size: u32,
+  jpeg_2000_rpcl_options: bool,
+  jpeg_2000_progression_order: Jpeg2000ProgressionOrder,
+  jpeg_2000_packet_length_markers: bool,
+  jpeg_2000_quality_layers: [u8; MAX_JPEG_2000_QUALITY_LAYERS],
+  jpeg_2000_quality_layer_count: u8,
+  jpeg_2000_target_bits_per_pixel: Option<f32>,
+  jpeg_2000_fixed_quantization: bool,
+  jpeg_xl_progressive: bool,
+  jpeg_xl_fast_lossless: bool,
+  jpeg_xl_encode_profile: JpegXlEncodeProfile,
+  jpeg_xl_center_first: bool,
+  jpeg_ls_restart_interval: u32,
+  jpeg_12bit_restart_interval: u32,
+  jpeg_baseline_encoder: JpegBaselineEncoder,
 }
 
 impl Default for PixelDataEncodeConfig {
@@ -44,6 +84,25 @@ impl Default for PixelDataEncodeConfig {
       quality: 90,
       effort: 7,
       zlib_compression_level: 6,
+      zlib_thread_count: 1,
+      thread_count: 0,
+      jpeg_2000_tile_size: 0,
+      jpeg_2000_block_size: 64,
+      jpeg_2000_precinct_size: 0,
+      jpeg_2000_rpcl_options: false,
+      jpeg_2000_progression_order: Jpeg2000ProgressionOrder::Lrcp,
+      jpeg_2000_packet_length_markers: false,
+      jpeg_2000_quality_layers: [0; MAX_JPEG_2000_QUALITY_LAYERS],
+      jpeg_2000_quality_layer_count: 0,
+      jpeg_2000_target_bits_per_pixel: None,
+      jpeg_2000_fixed_quantization: false,
+      jpeg_xl_progressive: false,
+      jpeg_xl_fast_lossless: false,
+      jpeg_xl_encode_profile: JpegXlEncodeProfile::Balanced,
+      jpeg_xl_center_first: false,
+      jpeg_ls_restart_interval: 0,
+      jpeg_12bit_restart_interval: 0,
+      jpeg_baseline_encoder: JpegBaselineEncoder::JpegEncoder,
     }
   }
 }
@@ -115,6 +174,627 @@ impl PixelDataEncodeConfig {
   pub fn set_zlib_compression_level(&mut self, compression_level: u32) {
     self.zlib_compression_level = compression_level.clamp(0, 9);
   }
+
+  /// Returns the number of threads used to deflate each frame when encoding
+  /// pixel data into the 'Deflated Image Frame Compression' transfer syntax.
+  ///
+  /// With more than one thread, frames are deflated in independent blocks that
+  /// are compressed concurrently when the `parallel` feature is enabled, see
+  /// [`dcmfx_p10::deflate`]. This is faster, but gives a slightly lower
+  /// compression ratio. A value of one deflates each frame as a single stream.
+  ///
+  /// Default: 1.
+  ///
+  pub fn zlib_thread_count(&self) -> usize {
+    self.zlib_thread_count
+  }
+
+  /// Sets the number of threads used to deflate each frame when encoding pixel
+  /// data into the 'Deflated Image Frame Compression' transfer syntax.
+  ///
+  pub fn set_zlib_thread_count(&mut self, thread_count: usize) {
+    self.zlib_thread_count = thread_count.max(1);
+  }
+
+  /// Returns the maximum number of threads an encoder may use to encode a
+  /// single frame. A value of one encodes on the calling thread, and zero uses
+  /// the encoder's default, which is one thread per CPU core for libjxl and the
+  /// calling thread for OpenJPEG. Frames that are too small for an encoder to
+  /// benefit from multiple threads are encoded on the calling thread.
+  ///
+  /// The thread count is used by the following transfer syntaxes:
+  ///
+  /// - JPEG 2000 Lossless Only
+  /// - JPEG 2000
+  /// - High-Throughput JPEG 2000 Lossless Only
+  /// - High-Throughput JPEG 2000 with RPCL Options (Lossless Only)
+  /// - High-Throughput JPEG 2000
+  /// - JPEG XL Lossless
+  /// - JPEG XL
+  /// - RLE Lossless
+  ///
+  /// When the `parallel` feature is enabled, the segments of large RLE Lossless
+  /// frames are encoded concurrently, with zero using one thread per CPU core.
+  ///
+  /// When a frame is divided into more than one tile, see
+  /// [`Self::jpeg_2000_tile_size()`], OpenJPEG and OpenJPH encode the tiles
+  /// concurrently, and for OpenJPH zero uses one thread per CPU core. OpenJPH
+  /// only uses multiple threads when encoding into more than one tile.
+  ///
+  /// libjxl's threads are reused across frames, and can be replaced by an
+  /// application's own thread pool, see [`crate::libjxl_thread_pool`]. The
+  /// thread count is ignored on WASM.
+  ///
+  /// Default: 0.
+  ///
+  pub fn thread_count(&self) -> usize {
+    self.thread_count
+  }
+
+  /// Sets the maximum number of threads an encoder may use to encode a single
+  /// frame.
+  ///
+  pub fn set_thread_count(&mut self, thread_count: usize) {
+    self.thread_count = thread_count;
+  }
+
+  /// Returns the width and height of the square tiles that frames are divided
+  /// into when encoding JPEG 2000. Tiles are encoded independently, which
+  /// allows them to be encoded concurrently on multiple threads, see
+  /// [`Self::thread_count()`]. A value of zero encodes each frame as a single
+  /// tile.
+  ///
+  /// The tile size is used by the following transfer syntaxes:
+  ///
+  /// - JPEG 2000 Lossless Only
+  /// - JPEG 2000
+  /// - High-Throughput JPEG 2000 Lossless Only
+  /// - High-Throughput JPEG 2000 with RPCL Options (Lossless Only)
+  /// - High-Throughput JPEG 2000
+  ///
+  /// Default: 0.
+  ///
+  pub fn jpeg_2000_tile_size(&self) -> u32 {
+    self.jpeg_2000_tile_size
+  }
+
+  /// Sets the width and height of the square tiles that frames are divided
+  /// into when encoding JPEG 2000.
+  ///
+  pub fn set_jpeg_2000_tile_size(&mut self, tile_size: u32) {
+    self.jpeg_2000_tile_size = tile_size;
+  }
+
+  /// Returns the width and height of the square codeblocks used when encoding
+  /// JPEG 2000. This is a power of two in the range 4-64.
+  ///
+  /// The block size is used by the following transfer syntaxes:
+  ///
+  /// - JPEG 2000 Lossless Only
+  /// - JPEG 2000
+  /// - High-Throughput JPEG 2000 Lossless Only
+  /// - High-Throughput JPEG 2000 with RPCL Options (Lossless Only)
+  /// - High-Throughput JPEG 2000
+  ///
+  /// Default: 64.
+  ///
+  pub fn jpeg_2000_block_size(&self) -> u32 {
+    self.jpeg_2000_block_size
+  }
+
+  /// Sets the width and height of the square codeblocks used when encoding
+  /// JPEG 2000. The value is rounded down to a power of two
+  /// and clamped to the range 4-64.
+  ///
+  pub fn set_jpeg_2000_block_size(&mut self, block_size: u32) {
+    self.jpeg_2000_block_size = prev_power_of_two(block_size.clamp(4, 64));
+  }
+
+  /// Returns the width and height of the square precincts used at every
+  /// resolution level when encoding JPEG 2000. A value of zero uses the
+  /// maximum precinct size, which gives one precinct per resolution level in
+  /// each tile.
+  ///
+  /// The precinct size is used by the following transfer syntaxes:
+  ///
+  /// - JPEG 2000 Lossless Only
+  /// - JPEG 2000
+  /// - High-Throughput JPEG 2000 Lossless Only
+  /// - High-Throughput JPEG 2000 with RPCL Options (Lossless Only)
+  /// - High-Throughput JPEG 2000
+  ///
+  /// Default: 0.
+  ///
+  pub fn jpeg_2000_precinct_size(&self) -> u32 {
+    self.jpeg_2000_precinct_size
+  }
+
+  /// Sets the width and height of the square precincts used when encoding
+  /// JPEG 2000. Non-zero values are rounded down to a power
+  /// of two and clamped to the range 2-32768.
+  ///
+  pub fn set_jpeg_2000_precinct_size(&mut self, precinct_size: u32) {
+    self.jpeg_2000_precinct_size = if precinct_size == 0 {
+      0
+    } else {
+      prev_power_of_two(precinct_size.clamp(2, 32768))
+    };
+  }
+
+  /// Returns whether High-Throughput JPEG 2000 is encoded using RPCL
+  /// progression order, with each tile divided into one tile-part per
+  /// resolution level, and with TLM markers that give the length of every
+  /// tile-part. This lets decoders locate the data for a resolution level or
+  /// tile without parsing the whole codestream, which speeds up decoding of
+  /// thumbnails and regions.
+  ///
+  /// This is always enabled for the 'High-Throughput JPEG 2000 with RPCL
+  /// Options (Lossless Only)' transfer syntax, and is optional for these
+  /// transfer syntaxes:
+  ///
+  /// - High-Throughput JPEG 2000 Lossless Only
+  /// - High-Throughput JPEG 2000
+  ///
+  /// Default: false.
+  ///
+  pub fn jpeg_2000_rpcl_options(&self) -> bool {
+    self.jpeg_2000_rpcl_options
+  }
+
+  /// Sets whether High-Throughput JPEG 2000 is encoded using RPCL progression
+  /// order, resolution level tile-parts, and TLM markers.
+  ///
+  pub fn set_jpeg_2000_rpcl_options(&mut self, rpcl_options: bool) {
+    self.jpeg_2000_rpcl_options = rpcl_options;
+  }
+
+  /// Returns the order that the packets of each tile are stored in when
+  /// encoding JPEG 2000, see [`Jpeg2000ProgressionOrder`].
+  ///
+  /// The progression order is used by the following transfer syntaxes:
+  ///
+  /// - JPEG 2000 Lossless Only
+  /// - JPEG 2000
+  ///
+  /// High-Throughput JPEG 2000 is always encoded in RPCL progression order.
+  ///
+  /// Default: [`Jpeg2000ProgressionOrder::Lrcp`].
+  ///
+  pub fn jpeg_2000_progression_order(&self) -> Jpeg2000ProgressionOrder {
+    self.jpeg_2000_progression_order
+  }
+
+  /// Sets the order that the packets of each tile are stored in when encoding
+  /// JPEG 2000.
+  ///
+  pub fn set_jpeg_2000_progression_order(
+    &mut self,
+    progression_order: Jpeg2000ProgressionOrder,
+  ) {
+    self.jpeg_2000_progression_order = progression_order;
+  }
+
+  /// Returns whether JPEG 2000 is encoded with TLM markers that give the
+  /// length of every tile-part, and PLT markers that give the length of every
+  /// packet. When decoding a region or a reduced resolution, OpenJPEG uses the
+  /// packet lengths to skip over the packets it doesn't need without parsing
+  /// their headers. The markers make the encoded data slightly larger.
+  ///
+  /// The packet length markers are used by the following transfer syntaxes:
+  ///
+  /// - JPEG 2000 Lossless Only
+  /// - JPEG 2000
+  ///
+  /// Default: false.
+  ///
+  pub fn jpeg_2000_packet_length_markers(&self) -> bool {
+    self.jpeg_2000_packet_length_markers
+  }
+
+  /// Sets whether JPEG 2000 is encoded with TLM and PLT markers.
+  ///
+  pub fn set_jpeg_2000_packet_length_markers(
+    &mut self,
+    packet_length_markers: bool,
+  ) {
+    self.jpeg_2000_packet_length_markers = packet_length_markers;
+  }
+
+  /// Returns the qualities of the quality layers that come before the final
+  /// quality layer when encoding JPEG 2000. Each quality is in the range 1-100
+  /// in the same way as [`Self::quality()`], and they're in increasing order.
+  ///
+  /// A decoder can show a lower quality image from the first layers of a frame
+  /// while the rest of it is still being received, and each later layer
+  /// refines it, see [`crate::PixelDataDecodeConfig::jpeg_2000_quality_layers`].
+  /// The final layer is lossless for JPEG 2000 Lossless Only, and has the
+  /// quality given by [`Self::quality()`] for JPEG 2000, in which case any
+  /// layers with a quality that isn't lower than that are left out. LRCP
+  /// progression order stores all of each layer's packets before those of the
+  /// next layer, which suits progressive delivery.
+  ///
+  /// The quality layers are used by the following transfer syntaxes:
+  ///
+  /// - JPEG 2000 Lossless Only
+  /// - JPEG 2000
+  ///
+  /// Default: none, which encodes a single quality layer.
+  ///
+  pub fn jpeg_2000_quality_layers(&self) -> &[u8] {
+    &self.jpeg_2000_quality_layers
+      [..usize::from(self.jpeg_2000_quality_layer_count)]
+  }
+
+  /// Sets the qualities of the quality layers that come before the final
+  /// quality layer when encoding JPEG 2000. The qualities are clamped to the
+  /// range 1-100 and sorted, duplicates are removed, and up to 15 of the lowest
+  /// qualities are kept.
+  ///
+  pub fn set_jpeg_2000_quality_layers(&mut self, qualities: &[u8]) {
+    let mut layers = [0; MAX_JPEG_2000_QUALITY_LAYERS];
+    let mut layer_count = 0;
+
+    let mut qualities: Vec<u8> = qualities
+      .iter()
+      .map(|quality| (*quality).clamp(1, 100))
+      .collect();
+    qualities.sort_unstable();
+    qualities.dedup();
+
+    for quality in qualities.into_iter().take(MAX_JPEG_2000_QUALITY_LAYERS) {
+      layers[layer_count] = quality;
+      layer_count += 1;
+    }
+
+    self.jpeg_2000_quality_layers = layers;
+    self.jpeg_2000_quality_layer_count = layer_count as u8;
+  }
+
+  /// Returns the number of bits per pixel that lossy High-Throughput JPEG 2000
+  /// is encoded at, which gives each frame a predictable size. When set, this
+  /// is used instead of [`Self::quality()`].
+  ///
+  /// The quantization step size that gives the target is estimated by
+  /// encoding tiles sampled from the frame at a few step sizes, after which
+  /// the frame is encoded once. The size of the encoded frame is typically
+  /// within a few percent of the target. The bits per pixel is the total for
+  /// all samples of a pixel, e.g. a target of 1.0 for a 512x512 frame gives
+  /// around 32 KiB of encoded data whether the frame is grayscale or RGB.
+  ///
+  /// The target bits per pixel is used by the High-Throughput JPEG 2000
+  /// transfer syntax.
+  ///
+  /// Default: none.
+  ///
+  pub fn jpeg_2000_target_bits_per_pixel(&self) -> Option<f32> {
+    self.jpeg_2000_target_bits_per_pixel
+  }
+
+  /// Sets the number of bits per pixel that lossy High-Throughput JPEG 2000 is
+  /// encoded at. Values that aren't positive are treated as none.
+  ///
+  pub fn set_jpeg_2000_target_bits_per_pixel(
+    &mut self,
+    target_bits_per_pixel: Option<f32>,
+  ) {
+    self.jpeg_2000_target_bits_per_pixel =
+      target_bits_per_pixel.filter(|bits_per_pixel| *bits_per_pixel > 0.0);
+  }
+
+  /// Returns whether lossy JPEG 2000 is encoded with fixed quantization step
+  /// sizes derived from [`Self::quality()`], rather than by searching for the
+  /// code-block truncation points that give the PSNR for the quality. Every
+  /// coding pass is kept and OpenJPEG's rate allocation is skipped, which is
+  /// much faster for large frames, but the PSNR of the output isn't targeted
+  /// and [`Self::jpeg_2000_quality_layers()`] is ignored.
+  ///
+  /// The step sizes for a quality are the same as those used by lossy
+  /// High-Throughput JPEG 2000, which is always encoded this way.
+  ///
+  /// Fixed quantization is used by the JPEG 2000 transfer syntax.
+  ///
+  /// Default: false.
+  ///
+  pub fn jpeg_2000_fixed_quantization(&self) -> bool {
+    self.jpeg_2000_fixed_quantization
+  }
+
+  /// Sets whether lossy JPEG 2000 is encoded with fixed quantization step
+  /// sizes.
+  ///
+  pub fn set_jpeg_2000_fixed_quantization(&mut self, fixed_quantization: bool) {
+    self.jpeg_2000_fixed_quantization = fixed_quantization;
+  }
+
+  /// Returns whether lossy JPEG XL is encoded progressively, with the DC (LF)
+  /// image stored progressively and followed by the AC passes. This lets a low
+  /// resolution preview of each frame be decoded from the start of its data,
+  /// see [`crate::decode::decode_monochrome_progressive()`], and makes the
+  /// encoded data slightly larger.
+  ///
+  /// This is used by the JPEG XL transfer syntax. Lossless JPEG XL is never
+  /// encoded progressively because libjxl doesn't produce previews when
+  /// decoding it.
+  ///
+  /// Default: false.
+  ///
+  pub fn jpeg_xl_progressive(&self) -> bool {
+    self.jpeg_xl_progressive
+  }
+
+  /// Sets whether JPEG XL is encoded progressively.
+  ///
+  pub fn set_jpeg_xl_progressive(&mut self, progressive: bool) {
+    self.jpeg_xl_progressive = progressive;
+  }
+
+  /// Returns whether lossless JPEG XL is encoded with libjxl's fast lossless
+  /// encoder, which is many times faster than its full lossless encoder at the
+  /// cost of a worse compression ratio. This suits high-volume ingestion where
+  /// throughput matters more than storage size.
+  ///
+  /// When enabled, lossless encodes ignore [`Self::effort()`] and use libjxl's
+  /// lowest effort, which is the one that selects the fast lossless encoder. It
+  /// encodes 8-bit and 16-bit grayscale and RGB frames and uses the same
+  /// threads as the full encoder, see [`Self::thread_count()`].
+  ///
+  /// This is used by the JPEG XL Lossless transfer syntax.
+  ///
+  /// Default: false.
+  ///
+  pub fn jpeg_xl_fast_lossless(&self) -> bool {
+    self.jpeg_xl_fast_lossless
+  }
+
+  /// Sets whether lossless JPEG XL is encoded with libjxl's fast lossless
+  /// encoder.
+  ///
+  pub fn set_jpeg_xl_fast_lossless(&mut self, fast_lossless: bool) {
+    self.jpeg_xl_fast_lossless = fast_lossless;
+  }
+
+  /// Returns the profile that JPEG XL is encoded with, which trades the size
+  /// of the encoded data against how fast it decodes. See
+  /// [`JpegXlEncodeProfile`] for details.
+  ///
+  /// The profile is used by the following transfer syntaxes:
+  ///
+  /// - JPEG XL Lossless
+  /// - JPEG XL
+  ///
+  /// Default: [`JpegXlEncodeProfile::Balanced`].
+  ///
+  pub fn jpeg_xl_encode_profile(&self) -> JpegXlEncodeProfile {
+    self.jpeg_xl_encode_profile
+  }
+
+  /// Sets the profile that JPEG XL is encoded with.
+  ///
+  pub fn set_jpeg_xl_encode_profile(&mut self, profile: JpegXlEncodeProfile) {
+    self.jpeg_xl_encode_profile = profile;
+  }
+
+  /// Returns whether JPEG XL is encoded with its groups of pixels stored in
+  /// order of distance from the centre of the image, rather than in scanline
+  /// order. This puts the groups in the middle of a frame at the start of its
+  /// data, so a viewport over them can be decoded without reading the rest of
+  /// the data, see [`crate::decode::decode_monochrome_region()`].
+  ///
+  /// Large frames are normally encoded by libjxl a section at a time, which
+  /// always stores groups in scanline order, so enabling this makes libjxl
+  /// hold the whole frame in memory while it's encoded.
+  ///
+  /// The group order is used by the following transfer syntaxes:
+  ///
+  /// - JPEG XL Lossless
+  /// - JPEG XL
+  ///
+  /// Default: false.
+  ///
+  pub fn jpeg_xl_center_first(&self) -> bool {
+    self.jpeg_xl_center_first
+  }
+
+  /// Sets whether JPEG XL is encoded with its groups stored centre-first.
+  ///
+  pub fn set_jpeg_xl_center_first(&mut self, center_first: bool) {
+    self.jpeg_xl_center_first = center_first;
+  }
+
+  /// Returns the number of rows in each restart interval when encoding
+  /// JPEG-LS. The coding process restarts after each restart interval, which
+  /// lets the restart intervals in a frame be decoded concurrently on
+  /// multiple threads, see [`crate::PixelDataDecodeConfig::thread_count`]. A
+  /// value of zero writes no restart intervals.
+  ///
+  /// Shorter restart intervals allow more threads to be used when decoding, at
+  /// the cost of slightly larger encoded data. Restart intervals are only
+  /// decoded concurrently when all of a frame's samples are in a single scan,
+  /// i.e. for single channel images.
+  ///
+  /// The restart interval is used by the following transfer syntaxes:
+  ///
+  /// - JPEG-LS Lossless
+  /// - JPEG-LS Lossy (Near-Lossless)
+  ///
+  /// Default: 0.
+  ///
+  pub fn jpeg_ls_restart_interval(&self) -> u32 {
+    self.jpeg_ls_restart_interval
+  }
+
+  /// Sets the number of rows in each restart interval when encoding JPEG-LS.
+  ///
+  pub fn set_jpeg_ls_restart_interval(&mut self, restart_interval: u32) {
+    self.jpeg_ls_restart_interval = restart_interval;
+  }
+
+  /// Returns the number of MCU rows in each restart interval when encoding
+  /// 12-bit JPEG. Each restart interval is coded independently of the others,
+  /// which lets the restart intervals in a frame be decoded concurrently on
+  /// multiple threads, see [`crate::PixelDataDecodeConfig::thread_count`]. A
+  /// value of zero writes no restart intervals.
+  ///
+  /// The restart interval is used by the following transfer syntaxes:
+  ///
+  /// - JPEG Extended 12-bit
+  ///
+  /// Default: 0.
+  ///
+  pub fn jpeg_12bit_restart_interval(&self) -> u32 {
+    self.jpeg_12bit_restart_interval
+  }
+
+  /// Sets the number of MCU rows in each restart interval when encoding 12-bit
+  /// JPEG.
+  ///
+  pub fn set_jpeg_12bit_restart_interval(&mut self, restart_interval: u32) {
+    self.jpeg_12bit_restart_interval = restart_interval;
+  }
+
+  /// Returns the encoder used for JPEG Baseline 8-bit, see
+  /// [`JpegBaselineEncoder`]. This is also the encoder used to create the
+  /// JPEG data that's recompressed by JPEG XL JPEG Recompression.
+  ///
+  /// Default: [`JpegBaselineEncoder::JpegEncoder`].
+  ///
+  pub fn jpeg_baseline_encoder(&self) -> JpegBaselineEncoder {
+    self.jpeg_baseline_encoder
+  }
+
+  /// Sets the encoder used for JPEG Baseline 8-bit.
+  ///
+  pub fn set_jpeg_baseline_encoder(&mut self, encoder: JpegBaselineEncoder) {
+    self.jpeg_baseline_encoder = encoder;
+  }
+}
+
+/// The encoders that can be used for JPEG Baseline 8-bit.
+///
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub enum JpegBaselineEncoder {
+  /// The pure Rust `jpeg-encoder` crate. This is available in all builds.
+  #[default]
+  JpegEncoder,
+
+  /// An 8-bit build of the vendored libjpeg, which uses SIMD for its forward
+  /// DCT and RGB to YCbCr color conversion, and optimal Huffman tables. It's
+  /// faster than `jpeg-encoder` and its output is usually smaller.
+  ///
+  /// This is only available when the `native` feature is enabled, and
+  /// `jpeg-encoder` is used in its place otherwise.
+  LibJpeg8Bit,
+}
+
+impl core::fmt::Display for JpegBaselineEncoder {
+  fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+    match self {
+      Self::JpegEncoder => f.write_str("jpeg-encoder"),
+      Self::LibJpeg8Bit => f.write_str("libjpeg_8bit"),
+    }
+  }
+}
+
+/// The orders that the packets of a JPEG 2000 tile can be stored in. Each
+/// packet holds one quality layer (L) of one resolution level (R) of one
+/// component (C) for one precinct (P), and the order is named by the nesting of
+/// those loops, outermost first.
+///
+/// Orders that start with the resolution level let a reduced resolution decode
+/// stop reading early, and orders that start with the precinct keep the data
+/// for each area of the image together, which suits region decodes.
+///
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub enum Jpeg2000ProgressionOrder {
+  /// Layer-resolution-component-precinct order.
+  #[default]
+  Lrcp,
+
+  /// Resolution-layer-component-precinct order.
+  Rlcp,
+
+  /// Resolution-precinct-component-layer order.
+  Rpcl,
+
+  /// Precinct-component-resolution-layer order.
+  Pcrl,
+
+  /// Component-precinct-resolution-layer order.
+  Cprl,
+}
+
+impl core::fmt::Display for Jpeg2000ProgressionOrder {
+  fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+    match self {
+      Self::Lrcp => f.write_str("LRCP"),
+      Self::Rlcp => f.write_str("RLCP"),
+      Self::Rpcl => f.write_str("RPCL"),
+      Self::Pcrl => f.write_str("PCRL"),
+      Self::Cprl => f.write_str("CPRL"),
+    }
+  }
+}
+
+/// The profiles that JPEG XL can be encoded with, which trade the size of the
+/// encoded data against how fast it decodes. Data that is written once and
+/// then read many times, e.g. by viewers of an archive, may be worth encoding
+/// for faster decodes at the cost of larger files.
+///
+/// Each profile sets libjxl's decoding speed, modular group size, modular
+/// predictor, and MA tree learning percentage. The decoding speed applies to
+/// lossy (VarDCT) data, and the modular settings apply to lossless data.
+/// [`JpegXlEncodeProfile::FastDecode`] also turns off the restoration filters
+/// that are otherwise run on lossy data when it's decoded. The
+/// [`JpegXlEncodeProfile::Medical`] profile instead trades size for encode
+/// speed by turning off one of libjxl's encoder heuristics. The profile is
+/// ignored by lossless encodes that use libjxl's fast lossless encoder, see
+/// [`PixelDataEncodeConfig::jpeg_xl_fast_lossless()`].
+///
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
+pub enum JpegXlEncodeProfile {
+  /// Encodes for the fastest decode. Lossy data uses libjxl's fastest decoding
+  /// speed with the Gaborish and edge-preserving (EPF) restoration filters
+  /// turned off, so decoders don't run them, at the cost of more visible block
+  /// edges and ringing at low qualities. Lossless data uses 256x256 modular
+  /// groups, the gradient predictor, and no MA tree learning, which libjxl
+  /// decodes with a specialized fast path. Lossless files are noticeably
+  /// larger.
+  FastDecode,
+
+  /// Uses libjxl's default settings, which balance size and decode speed.
+  #[default]
+  Balanced,
+
+  /// Encodes for the smallest size. Lossy data uses libjxl's slowest decoding
+  /// speed, and lossless data uses 1024x1024 modular groups, tries every
+  /// predictor, and learns the MA tree from all pixels. Lossless encodes are
+  /// much slower, particularly at a high [`PixelDataEncodeConfig::effort()`].
+  MaxRatio,
+
+  /// Encodes faster by skipping libjxl's search for repeated patches, such as
+  /// the glyphs of text, which medical images rarely have. At the default
+  /// effort this takes around 40% off the encode time of a 512x512 CT frame
+  /// with no change in size. Images with burned-in text and graphics, e.g.
+  /// ultrasound, encode to files that are a few percent larger.
+  Medical,
+}
+
+impl core::fmt::Display for JpegXlEncodeProfile {
+  fn fmt(&self, f: &mut core::fmt::Formatter<'_>) -> core::fmt::Result {
+    match self {
+      Self::FastDecode => f.write_str("fast-decode"),
+      Self::Balanced => f.write_str("balanced"),
+      Self::MaxRatio => f.write_str("max-ratio"),
+      Self::Medical => f.write_str("medical"),
+    }
+  }
+}
+
+/// Returns the largest power of two that is less than or equal to `value`,
+/// which must be non-zero.
+///
+fn prev_power_of_two(value: u32) -> u32 {
+  1 << (31 - value.leading_zeros())
 }
 
 /// Errors that can occur when encoding frames of image data into a specific
@@ -292,12 +972,13 @@ pub fn encode_image_pixel_module(
       Some(encode_config.quality),
     ),
 
-    #[cfg(all(feature = "native", feature = "std"))]
-    &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY => {
+    #[cfg(dcmfx_openjph)]
+    &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
+    | &HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY => {
       jpeg_2000::encode_image_pixel_module(image_pixel_module.clone(), None)
     }
 
-    #[cfg(all(feature = "native", feature = "std"))]
+    #[cfg(dcmfx_openjph)]
     &HIGH_THROUGHPUT_JPEG_2000 => jpeg_2000::encode_image_pixel_module(
       image_pixel_module.clone(),
       Some(encode_config.quality),
@@ -340,6 +1021,9 @@ pub fn encode_monochrome(
 ) -> Result<PixelDataFrame, PixelDataEncodeError> {
   use transfer_syntax::*;
 
+  let encode_config =
+    &frame_encode_config(encode_config, transfer_syntax, image_pixel_module);
+
   match transfer_syntax {
     &IMPLICIT_VR_LITTLE_ENDIAN
     | &EXPLICIT_VR_LITTLE_ENDIAN
@@ -349,89 +1033,113 @@ pub fn encode_monochrome(
       native::encode_monochrome(image, image_pixel_module)
     }
 
-    &RLE_LOSSLESS => rle_lossless::encode_monochrome(image, image_pixel_module)
-      .map(PixelDataFrame::new_from_bytes),
+    &RLE_LOSSLESS => rle_lossless::encode_monochrome(
+      image,
+      image_pixel_module,
+      encode_config.thread_count,
+    )
+    .map(PixelDataFrame::new_from_bytes),
 
     &JPEG_BASELINE_8BIT => {
-      jpeg_encoder::encode_monochrome(image, image_pixel_module, encode_config)
-        .map(PixelDataFrame::new_from_bytes)
+      encode_jpeg_baseline_monochrome(image, image_pixel_module, encode_config)
     }
 
     #[cfg(feature = "native")]
     &JPEG_EXTENDED_12BIT => {
       libjpeg_12bit::encode_monochrome(image, image_pixel_module, encode_config)
-        .map(PixelDataFrame::new_from_bytes)
     }
 
     #[cfg(all(feature = "native", feature = "std"))]
-    &JPEG_LS_LOSSLESS => {
-      charls::encode_monochrome(image, image_pixel_module, None)
-        .map(PixelDataFrame::new_from_bytes)
-    }
+    &JPEG_LS_LOSSLESS => charls::encode_monochrome(
+      image,
+      image_pixel_module,
+      None,
+      encode_config.jpeg_ls_restart_interval,
+    )
+    .map(PixelDataFrame::new_from_bytes),
 
     #[cfg(all(feature = "native", feature = "std"))]
     &JPEG_LS_LOSSY_NEAR_LOSSLESS => charls::encode_monochrome(
       image,
       image_pixel_module,
       Some(encode_config.quality()),
+      encode_config.jpeg_ls_restart_interval,
     )
     .map(PixelDataFrame::new_from_bytes),
 
     #[cfg(feature = "native")]
-    &JPEG_2000_LOSSLESS_ONLY => {
-      openjpeg::encode_monochrome(image, image_pixel_module, None)
-        .map(PixelDataFrame::new_from_bytes)
-    }
+    &JPEG_2000_LOSSLESS_ONLY => openjpeg::encode_monochrome(
+      image,
+      image_pixel_module,
+      None,
+      encode_config,
+    )
+    .map(PixelDataFrame::new_from_bytes),
 
     #[cfg(feature = "native")]
     &JPEG_2000 => openjpeg::encode_monochrome(
       image,
       image_pixel_module,
       Some(encode_config.quality),
+      encode_config,
     )
     .map(PixelDataFrame::new_from_bytes),
 
-    #[cfg(all(feature = "native", feature = "std"))]
+    #[cfg(dcmfx_openjph)]
     &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY => {
-      openjph::encode_monochrome(image, image_pixel_module, None)
-        .map(PixelDataFrame::new_from_bytes)
+      openjph::encode_monochrome(image, image_pixel_module, None, encode_config)
     }
 
-    #[cfg(all(feature = "native", feature = "std"))]
+    #[cfg(dcmfx_openjph)]
+    &HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY => {
+      let mut encode_config = *encode_config;
+      encode_config.set_jpeg_2000_rpcl_options(true);
+
+      openjph::encode_monochrome(
+        image,
+        image_pixel_module,
+        None,
+        &encode_config,
+      )
+    }
+
+    #[cfg(dcmfx_openjph)]
     &HIGH_THROUGHPUT_JPEG_2000 => openjph::encode_monochrome(
       image,
       image_pixel_module,
       Some(encode_config.quality),
-    )
-    .map(PixelDataFrame::new_from_bytes),
+      encode_config,
+    ),
 
     #[cfg(all(feature = "native", feature = "std"))]
     &JPEG_XL_LOSSLESS => {
       libjxl::encode_monochrome(image, image_pixel_module, encode_config, true)
-        .map(PixelDataFrame::new_from_bytes)
     }
 
     #[cfg(all(feature = "native", feature = "std"))]
     &JPEG_XL => {
       libjxl::encode_monochrome(image, image_pixel_module, encode_config, false)
-        .map(PixelDataFrame::new_from_bytes)
     }
 
     #[cfg(all(feature = "native", feature = "std"))]
     &JPEG_XL_JPEG_RECOMPRESSION => {
-      let jpeg_data = jpeg_encoder::encode_monochrome(
+      let mut jpeg_data = encode_jpeg_baseline_monochrome(
         image,
         image_pixel_module,
         encode_config,
       )?;
 
-      crate::jpeg_xl_jpeg_recompression::recompress_jpeg_to_jpeg_xl(&jpeg_data)
-        .map(PixelDataFrame::new_from_bytes)
+      crate::jpeg_xl_jpeg_recompression::recompress_jpeg_to_jpeg_xl(
+        jpeg_data.combine_chunks(),
+        encode_config.thread_count,
+      )
+      .map(PixelDataFrame::new_from_bytes)
     }
 
     &DEFLATED_IMAGE_FRAME_COMPRESSION => deflate_frame_data(
       native::encode_monochrome(image, image_pixel_module)?,
       encode_config.zlib_compression_level,
+      encode_config.zlib_thread_count,
     ),
 
     _ => {
@@ -450,6 +1158,9 @@ pub fn encode_color(
 ) -> Result<PixelDataFrame, PixelDataEncodeError> {
   use transfer_syntax::*;
 
+  let encode_config =
+    &frame_encode_config(encode_config, transfer_syntax, image_pixel_module);
+
   match transfer_syntax {
     &IMPLICIT_VR_LITTLE_ENDIAN
     | &EXPLICIT_VR_LITTLE_ENDIAN
@@ -460,35 +1171,43 @@ pub fn encode_color(
         .map(PixelDataFrame::new_from_bytes)
     }
 
-    &RLE_LOSSLESS => rle_lossless::encode_color(image, image_pixel_module)
-      .map(PixelDataFrame::new_from_bytes),
+    &RLE_LOSSLESS => rle_lossless::encode_color(
+      image,
+      image_pixel_module,
+      encode_config.thread_count,
+    )
+    .map(PixelDataFrame::new_from_bytes),
 
     &JPEG_BASELINE_8BIT => {
-      jpeg_encoder::encode_color(image, image_pixel_module, encode_config)
-        .map(PixelDataFrame::new_from_bytes)
+      encode_jpeg_baseline_color(image, image_pixel_module, encode_config)
     }
 
     #[cfg(feature = "native")]
     &JPEG_EXTENDED_12BIT => {
       libjpeg_12bit::encode_color(image, image_pixel_module, encode_config)
-        .map(PixelDataFrame::new_from_bytes)
     }
 
     #[cfg(all(feature = "native", feature = "std"))]
-    &JPEG_LS_LOSSLESS => charls::encode_color(image, image_pixel_module, None)
-      .map(PixelDataFrame::new_from_bytes),
+    &JPEG_LS_LOSSLESS => charls::encode_color(
+      image,
+      image_pixel_module,
+      None,
+      encode_config.jpeg_ls_restart_interval,
+    )
+    .map(PixelDataFrame::new_from_bytes),
 
     #[cfg(all(feature = "native", feature = "std"))]
     &JPEG_LS_LOSSY_NEAR_LOSSLESS => charls::encode_color(
       image,
       image_pixel_module,
       Some(encode_config.quality()),
+      encode_config.jpeg_ls_restart_interval,
     )
     .map(PixelDataFrame::new_from_bytes),
 
     #[cfg(feature = "native")]
     &JPEG_2000_LOSSLESS_ONLY => {
-      openjpeg::encode_color(image, image_pixel_module, None)
+      openjpeg::encode_color(image, image_pixel_module, None, encode_config)
         .map(PixelDataFrame::new_from_bytes)
     }
 
@@ -497,49 +1216,62 @@ pub fn encode_color(
       image,
       image_pixel_module,
       Some(encode_config.quality),
+      encode_config,
     )
     .map(PixelDataFrame::new_from_bytes),
 
-    #[cfg(all(feature = "native", feature = "std"))]
+    #[cfg(dcmfx_openjph)]
     &HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY => {
-      openjph::encode_color(image, image_pixel_module, None)
-        .map(PixelDataFrame::new_from_bytes)
+      openjph::encode_color(image, image_pixel_module, None, encode_config)
     }
 
-    #[cfg(all(feature = "native", feature = "std"))]
+    #[cfg(dcmfx_openjph)]
+    &HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY => {
+      let mut encode_config = *encode_config;
+      encode_config.set_jpeg_2000_rpcl_options(true);
+
+      openjph::encode_color(image, image_pixel_module, None, &encode_config)
+    }
+
+    #[cfg(dcmfx_openjph)]
     &HIGH_THROUGHPUT_JPEG_2000 => openjph::encode_color(
       image,
       image_pixel_module,
       Some(encode_config.quality),
-    )
-    .map(PixelDataFrame::new_from_bytes),
+      encode_config,
+    ),
 
     #[cfg(all(feature = "native", feature = "std"))]
     &JPEG_XL_LOSSLESS => {
       libjxl::encode_color(image, image_pixel_module, encode_config, true)
-        .map(PixelDataFrame::new_from_bytes)
     }
 
     #[cfg(all(feature = "native", feature = "std"))]
     &JPEG_XL => {
       libjxl::encode_color(image, image_pixel_module, encode_config, false)
-        .map(PixelDataFrame::new_from_bytes)
     }
 
     #[cfg(all(feature = "native", feature = "std"))]
     &JPEG_XL_JPEG_RECOMPRESSION => {
-      let jpeg_data =
-        jpeg_encoder::encode_color(image, image_pixel_module, encode_config)?;
-
-      crate::jpeg_xl_jpeg_recompression::recompress_jpeg_to_jpeg_xl(&jpeg_data)
-        .map(PixelDataFrame::new_from_bytes)
+      let mut jpeg_data =
+        encode_jpeg_baseline_color(image, image_pixel_module, encode_config)?;
+
+      crate::jpeg_xl_jpeg_recompression::recompress_jpeg_to_jpeg_xl(
+        jpeg_data.combine_chunks(),
+        encode_config.thread_count,
+      )
+      .map(PixelDataFrame::new_from_bytes)
     }
 
     &DEFLATED_IMAGE_FRAME_COMPRESSION => {
       let frame = native::encode_color(image, image_pixel_module)
         .map(PixelDataFrame::new_from_bytes)?;
 
-      deflate_frame_data(frame, encode_config.zlib_compression_level)
+      deflate_frame_data(
+        frame,
+        encode_config.zlib_compression_level,
+        encode_config.zlib_thread_count,
+      )
     }
 
     _ => {
@@ -548,56 +1280,126 @@ pub fn encode_color(
   }
 }
 
+/// Returns `encode_config` with its thread count replaced by the number of
+/// threads to encode a frame with, which depends on the codec and the number
+/// of samples in the frame, see [`crate::codec_threads`]. Encoders that don't
+/// use multiple threads are given the thread count unchanged.
+///
+/// Encodes a [`MonochromeImage`] into JPEG Baseline 8-bit using the encoder
+/// selected by [`PixelDataEncodeConfig::jpeg_baseline_encoder()`].
+///
+fn encode_jpeg_baseline_monochrome(
+  image: &MonochromeImage,
+  image_pixel_module: &ImagePixelModule,
+  encode_config: &PixelDataEncodeConfig,
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
+  #[cfg(feature = "native")]
+  if encode_config.jpeg_baseline_encoder == JpegBaselineEncoder::LibJpeg8Bit {
+    return libjpeg_8bit::encode_monochrome(
+      image,
+      image_pixel_module,
+      encode_config,
+    );
+  }
+
+  jpeg_encoder::encode_monochrome(image, image_pixel_module, encode_config)
+    .map(PixelDataFrame::new_from_bytes)
+}
+
+/// Encodes a [`ColorImage`] into JPEG Baseline 8-bit using the encoder selected
+/// by [`PixelDataEncodeConfig::jpeg_baseline_encoder()`].
+///
+fn encode_jpeg_baseline_color(
+  image: &ColorImage,
+  image_pixel_module: &ImagePixelModule,
+  encode_config: &PixelDataEncodeConfig,
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
+  #[cfg(feature = "native")]
+  if encode_config.jpeg_baseline_encoder == JpegBaselineEncoder::LibJpeg8Bit {
+    return libjpeg_8bit::encode_color(
+      image,
+      image_pixel_module,
+      encode_config,
+    );
+  }
+
+  jpeg_encoder::encode_color(image, image_pixel_module, encode_config)
+    .map(PixelDataFrame::new_from_bytes)
+}
+
+fn frame_encode_config(
+  encode_config: &PixelDataEncodeConfig,
+  transfer_syntax: &'static TransferSyntax,
+  image_pixel_module: &ImagePixelModule,
+) -> PixelDataEncodeConfig {
+  let mut encode_config = *encode_config;
+
+  if let Some(codec) = FrameCodec::for_encode(transfer_syntax) {
+    let sample_count = image_pixel_module.pixel_count()
+      * usize::from(u8::from(image_pixel_module.samples_per_pixel()));
+
+    encode_config.thread_count = codec_threads::frame_thread_count(
+      codec,
+      sample_count,
+      encode_config.thread_count,
+    );
+  }
+
+  encode_config
+}
+
 /// Deflates raw data for a single frame. This is used by the 'Deflated Image
 /// Frame Compression' transfer syntax.
 ///
+/// When the thread count is more than one, the frame is deflated as
+/// independent blocks that are compressed concurrently, see
+/// [`dcmfx_p10::deflate`]. Otherwise it's deflated as a single block.
+///
 fn deflate_frame_data(
   mut frame: PixelDataFrame,
   compression_level: u32,
+  thread_count: usize,
 ) -> Result<PixelDataFrame, PixelDataEncodeError> {
-  let mut input = frame.combine_chunks();
+  let input = frame.combine_chunks();
+
+  let block_size = if thread_count > 1 {
+    deflate::DEFLATE_BLOCK_SIZE
+  } else {
+    input.len().max(1)
+  };
+
+  let block_count = input.len().div_ceil(block_size).max(1);
+
+  let mut blocks: Vec<_> = (0..block_count)
+    .map(|i| {
+      let start = (i * block_size).min(input.len());
+      let end = (start + block_size).min(input.len());
+
+      (&input[start..end], i == block_count - 1, Ok(vec![]))
+    })
+    .collect();
+
+  crate::row_parallel::for_each_item_mut(
+    &mut blocks,
+    block_size,
+    thread_count,
+    |(data, is_last, output)| {
+      *output = deflate::deflate_block(data, compression_level, *is_last);
+    },
+  );
 
   let mut deflated_frame = PixelDataFrame::new();
 
-  let compression_level = flate2::Compression::new(compression_level);
-  let mut compressor = flate2::Compress::new(compression_level, false);
+  for (_, _, output) in blocks {
+    let output = output.map_err(|e| PixelDataEncodeError::OtherError {
+      name: "Deflate failed".to_string(),
+      details: e.to_string(),
+    })?;
 
-  // Loop around compressing into 256KiB output chunks until all data is
-  // deflated
-  loop {
-    let flush = if input.is_empty() {
-      flate2::FlushCompress::Finish
-    } else {
-      flate2::FlushCompress::None
-    };
-
-    let initial_total_in = compressor.total_in();
-    let initial_total_out = compressor.total_out();
-
-    let mut output_buffer = vec![0u8; 256 * 1024];
-    let status = compressor
-      .compress(input, &mut output_buffer, flush)
-      .map_err(|e| PixelDataEncodeError::OtherError {
-        name: "Deflate failed".to_string(),
-        details: e.to_string(),
-      })?;
-
-    // Set size of the output chunk
-    output_buffer
-      .truncate((compressor.total_out() - initial_total_out) as usize);
-
-    // Add the output buffer to the deflated frame if it has content
-    if !output_buffer.is_empty() {
-      output_buffer.shrink_to_fit();
-      deflated_frame.push_bytes(output_buffer.into());
-    }
-
-    if status == flate2::Status::StreamEnd {
-      return Ok(deflated_frame);
+    if !output.is_empty() {
+      deflated_frame.push_bytes(output.into());
     }
-
-    // Slice off input bytes that have been consumed by the compressor
-    let input_bytes_read = (compressor.total_in() - initial_total_in) as usize;
-    input = &input[input_bytes_read..];
   }
+
+  Ok(deflated_frame)
 }
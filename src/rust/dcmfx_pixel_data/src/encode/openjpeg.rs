@@ -1,5 +1,5 @@
 #[cfg(not(feature = "std"))]
-use alloc::{boxed::Box, string::ToString, vec::Vec};
+use alloc::{boxed::Box, string::ToString, vec, vec::Vec};
 
 use crate::{
   ColorImage, ColorSpace, MonochromeImage, PixelDataEncodeError,
@@ -11,6 +11,11 @@ use crate::{
   monochrome_image::MonochromeImageData,
 };
 
+use super::{
+  Jpeg2000ProgressionOrder, PixelDataEncodeConfig,
+  jpeg_2000::quality_to_quantization_step_size,
+};
+
 // The OpenJPEG library only seems to support bits stored of 2..=30. 1-bit and
 // 31-bit data (even unsigned 31-bit data), didn't encode/decode correctly.
 const OPENJPEG_BITS_STORED_RANGE: core::ops::RangeInclusive<u16> = 2..=30;
@@ -21,6 +26,7 @@ pub fn encode_monochrome(
   image: &MonochromeImage,
   image_pixel_module: &ImagePixelModule,
   quality: Option<u8>,
+  encode_config: &PixelDataEncodeConfig,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
   if !OPENJPEG_BITS_STORED_RANGE.contains(&image_pixel_module.bits_stored()) {
     return Err(PixelDataEncodeError::NotSupported {
@@ -60,6 +66,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     (
@@ -77,7 +84,14 @@ pub fn encode_monochrome(
         pixel_representation: PixelRepresentation::Unsigned,
       },
       BitsAllocated::Eight,
-    ) => encode(data, width, height, image_pixel_module, quality),
+    ) => encode(
+      data,
+      width,
+      height,
+      image_pixel_module,
+      quality,
+      encode_config,
+    ),
 
     (
       MonochromeImageData::I16(data),
@@ -100,6 +114,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     (
@@ -123,6 +138,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     (
@@ -146,6 +162,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     (
@@ -169,6 +186,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     _ => Err(PixelDataEncodeError::NotSupported {
@@ -185,6 +203,7 @@ pub fn encode_color(
   image: &ColorImage,
   image_pixel_module: &ImagePixelModule,
   quality: Option<u8>,
+  encode_config: &PixelDataEncodeConfig,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
   if !OPENJPEG_BITS_STORED_RANGE.contains(&image_pixel_module.bits_stored()) {
     return Err(PixelDataEncodeError::NotSupported {
@@ -244,7 +263,14 @@ pub fn encode_color(
       PhotometricInterpretation::PaletteColor { .. },
       BitsAllocated::Eight,
       None,
-    ) => encode(data, width, height, image_pixel_module, quality),
+    ) => encode(
+      data,
+      width,
+      height,
+      image_pixel_module,
+      quality,
+      encode_config,
+    ),
 
     (
       ColorImageData::U16 {
@@ -293,6 +319,7 @@ pub fn encode_color(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     (
@@ -336,6 +363,7 @@ pub fn encode_color(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     _ => Err(PixelDataEncodeError::NotSupported {
@@ -352,6 +380,7 @@ fn encode(
   height: u16,
   image_pixel_module: &ImagePixelModule,
   quality: Option<u8>,
+  encode_config: &PixelDataEncodeConfig,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
   let mut output_data = Vec::with_capacity(512 * 1024);
 
@@ -366,14 +395,38 @@ fn encode(
       _ => 0,
     };
 
-  let tcp_distoratio = if let Some(quality) = quality {
-    quality_to_psnr(quality, image_pixel_module.bits_stored())
+  let bits_stored = image_pixel_module.bits_stored();
+
+  // With fixed quantization a lossy encode is a single layer that keeps all
+  // coding passes, so it has no PSNR and is made lossy by its quantization
+  // step size instead
+  let quantization_step_size = match quality {
+    Some(quality) if encode_config.jpeg_2000_fixed_quantization() => {
+      quality_to_quantization_step_size(quality)
+    }
+    _ => 0.0,
+  };
+
+  // Determine the PSNR of each quality layer. The final layer is lossless when
+  // there's no quality, and has a PSNR of zero.
+  let tcp_distoratios: Vec<f32> = if quantization_step_size > 0.0 {
+    vec![0.0]
   } else {
-    0.0
+    let mut tcp_distoratios: Vec<f32> = encode_config
+      .jpeg_2000_quality_layers()
+      .iter()
+      .filter(|layer_quality| quality.is_none_or(|q| **layer_quality < q))
+      .map(|layer_quality| quality_to_psnr(*layer_quality, bits_stored))
+      .collect();
+    tcp_distoratios.push(
+      quality.map_or(0.0, |quality| quality_to_psnr(quality, bits_stored)),
+    );
+    tcp_distoratios
   };
 
-  let result = unsafe {
+  let result = with_encode_context(|context| unsafe {
     ffi::openjpeg_encode(
+      context,
       data.as_ptr() as *const core::ffi::c_void,
       width.into(),
       height.into(),
@@ -382,13 +435,21 @@ fn encode(
       image_pixel_module.bits_stored().into(),
       u8::from(image_pixel_module.pixel_representation()).into(),
       color_photometric_interpretation,
-      tcp_distoratio,
-      append_output_data,
+      tcp_distoratios.as_ptr(),
+      tcp_distoratios.len(),
+      quantization_step_size,
+      encode_config.jpeg_2000_tile_size() as usize,
+      encode_config.jpeg_2000_block_size() as usize,
+      encode_config.jpeg_2000_precinct_size() as usize,
+      progression_order(encode_config.jpeg_2000_progression_order()),
+      encode_config.jpeg_2000_packet_length_markers().into(),
+      encode_config.thread_count(),
+      write_output_data,
       &mut output_data as *mut Vec<u8> as *mut core::ffi::c_void,
       error_buffer.as_mut_ptr(),
       error_buffer.len(),
     )
-  };
+  });
 
   if result != 0 {
     let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
@@ -404,6 +465,74 @@ fn encode(
   Ok(output_data)
 }
 
+/// An OpenJPEG encode context, which holds the image that frames are copied
+/// into for encoding. Creating the image has a cost, so a single context is
+/// kept per thread and its image is reused for every frame of the same size
+/// that's encoded on that thread.
+///
+#[cfg(feature = "std")]
+struct OpenJpegEncodeContext {
+  handle: *mut ffi::OpenJpegEncodeContext,
+}
+
+#[cfg(feature = "std")]
+impl Drop for OpenJpegEncodeContext {
+  fn drop(&mut self) {
+    unsafe { ffi::openjpeg_encode_context_free(self.handle) };
+  }
+}
+
+#[cfg(feature = "std")]
+std::thread_local! {
+  static ENCODE_CONTEXT: core::cell::RefCell<Option<OpenJpegEncodeContext>> =
+    const { core::cell::RefCell::new(None) };
+}
+
+/// Calls the passed function with this thread's OpenJPEG encode context,
+/// creating it if needed. The context is null if it couldn't be created, in
+/// which case the encode allocates a new image.
+///
+#[cfg(feature = "std")]
+fn with_encode_context<R>(
+  f: impl FnOnce(*mut ffi::OpenJpegEncodeContext) -> R,
+) -> R {
+  ENCODE_CONTEXT.with_borrow_mut(|context| {
+    if context.is_none() {
+      let handle = unsafe { ffi::openjpeg_encode_context_create() };
+      if !handle.is_null() {
+        *context = Some(OpenJpegEncodeContext { handle });
+      }
+    }
+
+    f(context
+      .as_ref()
+      .map_or(core::ptr::null_mut(), |context| context.handle))
+  })
+}
+
+/// Calls the passed function without an OpenJPEG encode context, because
+/// `no_std` builds have no thread local storage to keep one in.
+///
+#[cfg(not(feature = "std"))]
+fn with_encode_context<R>(
+  f: impl FnOnce(*mut ffi::OpenJpegEncodeContext) -> R,
+) -> R {
+  f(core::ptr::null_mut())
+}
+
+/// Returns the value of OpenJPEG's `OPJ_PROG_ORDER` enum for a progression
+/// order.
+///
+fn progression_order(progression_order: Jpeg2000ProgressionOrder) -> usize {
+  match progression_order {
+    Jpeg2000ProgressionOrder::Lrcp => 0,
+    Jpeg2000ProgressionOrder::Rlcp => 1,
+    Jpeg2000ProgressionOrder::Rpcl => 2,
+    Jpeg2000ProgressionOrder::Pcrl => 3,
+    Jpeg2000ProgressionOrder::Cprl => 4,
+  }
+}
+
 /// Converts a quality value in the range 1-100 to a PSNR value for lossy
 /// compression. The value depends on the bits stored value because higher bit
 /// depths need higher PSNR values to maintain similar error characteristics.
@@ -421,23 +550,47 @@ fn quality_to_psnr(quality: u8, bits_stored: u16) -> f32 {
 
 /// This function is passed as a callback to [`ffi::openjpeg_encode()`] and
 /// is then called with output data as it becomes available so it can be
-/// accumulated in a [`Vec<u8>`].
+/// accumulated in a [`Vec<u8>`]. Data is written before the end of the output
+/// when OpenJPEG fills in its TLM marker once all tile-parts are written.
 ///
-extern "C" fn append_output_data(
+extern "C" fn write_output_data(
   data: *const u8,
   len: usize,
+  offset: usize,
   context: *mut core::ffi::c_void,
 ) {
   unsafe {
     let output_data = &mut *(context as *mut Vec<u8>);
+    let data = core::slice::from_raw_parts(data, len);
+
+    if offset == output_data.len() {
+      output_data.extend_from_slice(data);
+    } else {
+      let end = offset + len;
+      if end > output_data.len() {
+        output_data.resize(end, 0);
+      }
 
-    (*output_data).extend_from_slice(core::slice::from_raw_parts(data, len));
+      output_data[offset..end].copy_from_slice(data);
+    }
   }
 }
 
 mod ffi {
+  #[repr(C)]
+  pub struct OpenJpegEncodeContext {
+    _private: [u8; 0],
+  }
+
   unsafe extern "C" {
+    #[cfg(feature = "std")]
+    pub fn openjpeg_encode_context_create() -> *mut OpenJpegEncodeContext;
+
+    #[cfg(feature = "std")]
+    pub fn openjpeg_encode_context_free(context: *mut OpenJpegEncodeContext);
+
     pub fn openjpeg_encode(
+      context: *mut OpenJpegEncodeContext,
       input_data: *const core::ffi::c_void,
       width: usize,
       height: usize,
@@ -446,10 +599,19 @@ mod ffi {
       bits_stored: usize,
       pixel_representation: usize,
       color_photometric_interpretation: usize,
-      tcp_distoratio: f32,
+      tcp_distoratios: *const f32,
+      layer_count: usize,
+      quantization_step: f32,
+      tile_size: usize,
+      block_size: usize,
+      precinct_size: usize,
+      progression_order: usize,
+      packet_length_markers: usize,
+      thread_count: usize,
       output_data_callback: extern "C" fn(
         *const u8,
         usize,
+        usize,
         *mut core::ffi::c_void,
       ),
       output_data_context: *mut core::ffi::c_void,
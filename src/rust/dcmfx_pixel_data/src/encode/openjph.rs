@@ -1,6 +1,13 @@
+#[cfg(not(feature = "std"))]
+use alloc::{boxed::Box, string::ToString, vec, vec::Vec};
+#[cfg(not(feature = "std"))]
+use num_traits::Float;
+
 use crate::{
-  ColorImage, ColorSpace, MonochromeImage, PixelDataEncodeError,
+  ColorImage, ColorSpace, MonochromeImage, PixelDataEncodeConfig,
+  PixelDataEncodeError, PixelDataFrame,
   color_image::ColorImageData,
+  encode::jpeg_2000::quality_to_quantization_step_size,
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
     PixelRepresentation,
@@ -15,7 +22,8 @@ pub fn encode_monochrome(
   image: &MonochromeImage,
   image_pixel_module: &ImagePixelModule,
   quality: Option<u8>,
-) -> Result<Vec<u8>, PixelDataEncodeError> {
+  encode_config: &PixelDataEncodeConfig,
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
   let width = image.width();
   let height = image.height();
 
@@ -46,6 +54,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     (
@@ -63,7 +72,14 @@ pub fn encode_monochrome(
         pixel_representation: PixelRepresentation::Unsigned,
       },
       BitsAllocated::Eight,
-    ) => encode(data, width, height, image_pixel_module, quality),
+    ) => encode(
+      data,
+      width,
+      height,
+      image_pixel_module,
+      quality,
+      encode_config,
+    ),
 
     (
       MonochromeImageData::I16(data),
@@ -86,6 +102,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     (
@@ -109,6 +126,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     (
@@ -132,6 +150,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     (
@@ -155,6 +174,7 @@ pub fn encode_monochrome(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     _ => Err(PixelDataEncodeError::NotSupported {
@@ -172,7 +192,8 @@ pub fn encode_color(
   image: &ColorImage,
   image_pixel_module: &ImagePixelModule,
   quality: Option<u8>,
-) -> Result<Vec<u8>, PixelDataEncodeError> {
+  encode_config: &PixelDataEncodeConfig,
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
   let width = image.width();
   let height = image.height();
 
@@ -223,7 +244,14 @@ pub fn encode_color(
       PhotometricInterpretation::PaletteColor { .. },
       BitsAllocated::Eight,
       None,
-    ) => encode(data, width, height, image_pixel_module, quality),
+    ) => encode(
+      data,
+      width,
+      height,
+      image_pixel_module,
+      quality,
+      encode_config,
+    ),
 
     (
       ColorImageData::U16 {
@@ -272,6 +300,7 @@ pub fn encode_color(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     (
@@ -315,6 +344,7 @@ pub fn encode_color(
       height,
       image_pixel_module,
       quality,
+      encode_config,
     ),
 
     _ => Err(PixelDataEncodeError::NotSupported {
@@ -325,20 +355,72 @@ pub fn encode_color(
   }
 }
 
+#[cfg(feature = "std")]
 static ENCODE_INITIALIZE_ONCE_LOCK: std::sync::OnceLock<()> =
   std::sync::OnceLock::new();
 
+/// Whether OpenJPH's encoder has been initialized. Builds without `std` are
+/// single-threaded, so this doesn't need to block other threads.
+///
+#[cfg(not(feature = "std"))]
+static IS_ENCODE_INITIALIZED: core::sync::atomic::AtomicBool =
+  core::sync::atomic::AtomicBool::new(false);
+
 fn encode(
   data: &[u8],
   width: u16,
   height: u16,
   image_pixel_module: &ImagePixelModule,
   quality: Option<u8>,
-) -> Result<Vec<u8>, PixelDataEncodeError> {
+  encode_config: &PixelDataEncodeConfig,
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
+  #[cfg(feature = "std")]
   ENCODE_INITIALIZE_ONCE_LOCK
     .get_or_init(|| unsafe { ffi::openjph_encode_initialize() });
 
-  let mut output_data = Vec::with_capacity(512 * 1024);
+  #[cfg(not(feature = "std"))]
+  if !IS_ENCODE_INITIALIZED.swap(true, core::sync::atomic::Ordering::Relaxed) {
+    unsafe { ffi::openjph_encode_initialize() };
+  }
+
+  let quantization_step_size =
+    match (quality, encode_config.jpeg_2000_target_bits_per_pixel()) {
+      (Some(_), Some(target_bits_per_pixel)) => {
+        rate_controlled_quantization_step_size(
+          data,
+          width,
+          height,
+          image_pixel_module,
+          target_bits_per_pixel.into(),
+          encode_config,
+        )?
+      }
+      (Some(quality), None) => quality_to_quantization_step_size(quality),
+      (None, _) => 0.0,
+    };
+
+  encode_with_quantization_step_size(
+    data,
+    width,
+    height,
+    image_pixel_module,
+    quantization_step_size,
+    encode_config,
+  )
+}
+
+/// Encodes raw pixel data using OpenJPH with the given quantization step size.
+/// A step size of zero encodes losslessly.
+///
+fn encode_with_quantization_step_size(
+  data: &[u8],
+  width: u16,
+  height: u16,
+  image_pixel_module: &ImagePixelModule,
+  quantization_step_size: f32,
+  encode_config: &PixelDataEncodeConfig,
+) -> Result<PixelDataFrame, PixelDataEncodeError> {
+  let mut output_chunks: Vec<Vec<u8>> = vec![];
 
   let mut error_buffer = [0 as core::ffi::c_char; 256];
 
@@ -351,12 +433,6 @@ fn encode(
       _ => 0,
     };
 
-  let quantization_step_size = if let Some(quality) = quality {
-    quality_to_quantization_step_size(quality)
-  } else {
-    0.0
-  };
-
   let result = unsafe {
     ffi::openjph_encode(
       data.as_ptr() as *const core::ffi::c_void,
@@ -368,8 +444,13 @@ fn encode(
       u8::from(image_pixel_module.pixel_representation()).into(),
       color_photometric_interpretation,
       quantization_step_size,
-      append_output_data,
-      &mut output_data as *mut Vec<u8> as *mut core::ffi::c_void,
+      encode_config.jpeg_2000_tile_size() as usize,
+      encode_config.jpeg_2000_block_size() as usize,
+      encode_config.jpeg_2000_precinct_size() as usize,
+      encode_config.jpeg_2000_rpcl_options().into(),
+      encode_config.thread_count(),
+      output_chunk_callback,
+      &mut output_chunks as *mut Vec<Vec<u8>> as *mut core::ffi::c_void,
       error_buffer.as_mut_ptr(),
       error_buffer.len(),
     )
@@ -386,38 +467,219 @@ fn encode(
     });
   }
 
-  Ok(output_data)
+  // The output chunks become the chunks of the frame, so the compressed data
+  // is never copied into a single contiguous buffer
+  let mut frame = PixelDataFrame::new();
+  for chunk in output_chunks {
+    if !chunk.is_empty() {
+      frame.push_bytes(chunk.into());
+    }
+  }
+
+  Ok(frame)
 }
 
-/// Converts a quality value in the range 1-100 to a quantization step size
-/// value for lossy compression. This equation was inspired by the publication
-/// 'Parameterization of the Quality Factor for the High-Throughput JPEG 2000'
-/// by Ahar et al.
+/// The width and height of the tiles sampled from a frame when estimating the
+/// quantization step size that gives a target bits per pixel.
+///
+const RATE_CONTROL_TILE_SIZE: usize = 128;
+
+/// The number of tiles sampled across and down a frame when estimating the
+/// quantization step size that gives a target bits per pixel.
+///
+const RATE_CONTROL_GRID_SIZE: usize = 4;
+
+/// The quantization step sizes that the sampled tiles are first encoded at.
+/// These span the step sizes given by qualities of roughly 100 down to 50.
+///
+const RATE_CONTROL_INITIAL_STEP_SIZES: [f32; 2] = [0.004, 0.04];
+
+/// The number of further encodes of the sampled tiles made to refine the
+/// estimated quantization step size.
 ///
-fn quality_to_quantization_step_size(quality: u8) -> f32 {
-  let ratio = 25.0;
+const RATE_CONTROL_REFINEMENT_COUNT: usize = 2;
+
+/// The range that estimated quantization step sizes are clamped to.
+///
+const RATE_CONTROL_STEP_SIZE_RANGE: core::ops::RangeInclusive<f32> =
+  0.0005..=4.0;
+
+/// Returns the quantization step size estimated to encode the raw pixel data
+/// at the target bits per pixel.
+///
+/// Tiles sampled on a grid across the frame are gathered into a smaller
+/// image that is representative of the frame's content, and this is encoded
+/// at a few step sizes. The frame itself is then only encoded once.
+///
+fn rate_controlled_quantization_step_size(
+  data: &[u8],
+  width: u16,
+  height: u16,
+  image_pixel_module: &ImagePixelModule,
+  target_bits_per_pixel: f64,
+  encode_config: &PixelDataEncodeConfig,
+) -> Result<f32, PixelDataEncodeError> {
+  let pixel_size =
+    usize::from(u8::from(image_pixel_module.samples_per_pixel()))
+      * usize::from(u8::from(image_pixel_module.bits_allocated()))
+      / 8;
+
+  let (sample, sample_width, sample_height) =
+    sample_tiles(data, width.into(), height.into(), pixel_size);
+
+  // The sample is a single tile, so there is nothing for threads to do
+  let mut sample_encode_config = *encode_config;
+  sample_encode_config.set_jpeg_2000_tile_size(0);
+  sample_encode_config.set_thread_count(1);
 
-  if quality >= 50 {
-    (1.0 - f32::from(quality - 50) / 100.0) / ratio
-  } else {
-    (50.0 / f32::from(quality)) / ratio
+  let sample_pixel_count = (sample_width * sample_height) as f64;
+
+  estimate_quantization_step_size(target_bits_per_pixel, |step_size| {
+    let frame = encode_with_quantization_step_size(
+      &sample,
+      sample_width as u16,
+      sample_height as u16,
+      image_pixel_module,
+      step_size,
+      &sample_encode_config,
+    )?;
+
+    Ok(frame.len() as f64 * 8.0 / sample_pixel_count)
+  })
+}
+
+/// Gathers tiles sampled on a grid across raw pixel data into a single image,
+/// and returns it along with its width and height. Dimensions that are too
+/// small to sample are taken whole.
+///
+fn sample_tiles(
+  data: &[u8],
+  width: usize,
+  height: usize,
+  pixel_size: usize,
+) -> (Vec<u8>, usize, usize) {
+  let tile_offsets = |size: usize| -> (Vec<usize>, usize) {
+    if size < RATE_CONTROL_TILE_SIZE * RATE_CONTROL_GRID_SIZE {
+      return (vec![0], size);
+    }
+
+    let cell_size = size / RATE_CONTROL_GRID_SIZE;
+    let offsets = (0..RATE_CONTROL_GRID_SIZE)
+      .map(|i| i * cell_size + (cell_size - RATE_CONTROL_TILE_SIZE) / 2)
+      .collect();
+
+    (offsets, RATE_CONTROL_TILE_SIZE)
+  };
+
+  let (column_offsets, tile_width) = tile_offsets(width);
+  let (row_offsets, tile_height) = tile_offsets(height);
+
+  let sample_width = column_offsets.len() * tile_width;
+  let sample_height = row_offsets.len() * tile_height;
+
+  let mut sample =
+    Vec::with_capacity(sample_width * sample_height * pixel_size);
+
+  for row_offset in row_offsets {
+    for row in row_offset..row_offset + tile_height {
+      for column_offset in &column_offsets {
+        let start = (row * width + column_offset) * pixel_size;
+        sample.extend_from_slice(&data[start..start + tile_width * pixel_size]);
+      }
+    }
+  }
+
+  (sample, sample_width, sample_height)
+}
+
+/// Estimates the quantization step size that gives the target bits per pixel,
+/// using the passed function to measure the bits per pixel at a step size.
+///
+/// Over the range of interest the bits per pixel is close to linear in the
+/// logarithm of the step size, so the estimate is made by the secant method
+/// on the log of the step size, starting from two initial step sizes.
+///
+fn estimate_quantization_step_size(
+  target_bits_per_pixel: f64,
+  mut bits_per_pixel_at: impl FnMut(f32) -> Result<f64, PixelDataEncodeError>,
+) -> Result<f32, PixelDataEncodeError> {
+  let log_step_size_range = f64::from(*RATE_CONTROL_STEP_SIZE_RANGE.start())
+    .log2()
+    ..=f64::from(*RATE_CONTROL_STEP_SIZE_RANGE.end()).log2();
+
+  let mut points = [(0.0, 0.0); 2];
+  for (point, step_size) in
+    points.iter_mut().zip(RATE_CONTROL_INITIAL_STEP_SIZES)
+  {
+    *point = (f64::from(step_size).log2(), bits_per_pixel_at(step_size)?);
+  }
+
+  let secant = |points: &[(f64, f64); 2]| {
+    let [(x0, y0), (x1, y1)] = *points;
+
+    // A flat curve means the step size makes no difference to the size, e.g.
+    // because the frame is constant, so keep the smaller step size
+    if (y1 - y0).abs() < f64::EPSILON {
+      return x0.min(x1);
+    }
+
+    (x0 + (target_bits_per_pixel - y0) * (x1 - x0) / (y1 - y0))
+      .clamp(*log_step_size_range.start(), *log_step_size_range.end())
+  };
+
+  for _ in 0..RATE_CONTROL_REFINEMENT_COUNT {
+    let x = secant(&points);
+    let y = bits_per_pixel_at(x.exp2() as f32)?;
+
+    // Replace the point furthest from the target
+    let furthest = if (points[0].1 - target_bits_per_pixel).abs()
+      > (points[1].1 - target_bits_per_pixel).abs()
+    {
+      0
+    } else {
+      1
+    };
+    points[furthest] = (x, y);
+
+    if (y - target_bits_per_pixel).abs() < target_bits_per_pixel * 0.01 {
+      return Ok(x.exp2() as f32);
+    }
   }
+
+  Ok(secant(&points).exp2() as f32)
 }
 
-/// This function is passed as a callback to [`ffi::openjph_encode()`] and
-/// is then called with output data as it becomes available so it can be
-/// accumulated in a [`Vec<u8>`].
+/// This function is passed as a callback to [`ffi::openjph_encode()`]. Each
+/// call sets the number of bytes OpenJPH wrote into the most recent chunk, and
+/// then adds a new chunk with the requested capacity and returns a pointer to
+/// it. A capacity of zero means encoding is complete.
 ///
-extern "C" fn append_output_data(
-  data: *const core::ffi::c_void,
-  len: usize,
+extern "C" fn output_chunk_callback(
+  chunk_size: usize,
+  next_chunk_capacity: usize,
   context: *mut core::ffi::c_void,
-) {
+) -> *mut core::ffi::c_void {
   unsafe {
-    let output_data = &mut *(context as *mut Vec<u8>);
+    let output_chunks = &mut *(context as *mut Vec<Vec<u8>>);
+
+    // OpenJPH has initialized the first `chunk_size` bytes of the last chunk
+    if let Some(chunk) = output_chunks.last_mut() {
+      chunk.set_len(chunk_size);
+    }
+
+    if next_chunk_capacity == 0 {
+      if let Some(chunk) = output_chunks.last_mut() {
+        chunk.shrink_to_fit();
+      }
+
+      return core::ptr::null_mut();
+    }
+
+    let mut chunk = Vec::with_capacity(next_chunk_capacity);
+    let chunk_ptr = chunk.as_mut_ptr();
+    output_chunks.push(chunk);
 
-    (*output_data)
-      .extend_from_slice(core::slice::from_raw_parts(data as *const u8, len));
+    chunk_ptr as *mut core::ffi::c_void
   }
 }
 
@@ -435,14 +697,57 @@ mod ffi {
       pixel_representation: usize,
       color_photometric_interpretation: usize,
       quantization_step_size: f32,
-      output_data_callback: extern "C" fn(
-        *const core::ffi::c_void,
+      tile_size: usize,
+      block_size: usize,
+      precinct_size: usize,
+      rpcl_options: usize,
+      thread_count: usize,
+      output_chunk_callback: extern "C" fn(
+        usize,
         usize,
         *mut core::ffi::c_void,
-      ),
-      output_data_context: *mut core::ffi::c_void,
+      ) -> *mut core::ffi::c_void,
+      output_chunk_context: *mut core::ffi::c_void,
       error_buffer: *mut core::ffi::c_char,
       error_buffer_size: usize,
     ) -> usize;
   }
 }
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn estimate_quantization_step_size_test() {
+    // A curve that's linear in the log of the step size gives the exact step
+    // size after a single secant step
+    let linear = |step_size: f32| Ok(2.0 - f64::from(step_size / 0.01).log2());
+    let step_size = estimate_quantization_step_size(3.0, linear).unwrap();
+    assert!((step_size - 0.005).abs() < 1e-5);
+
+    // A curve that flattens out at low rates is still estimated closely
+    let curved = |step_size: f32| {
+      let x = f64::from(step_size).log2();
+      Ok((-1.5 * x - 4.0).exp2().ln_1p())
+    };
+    let step_size = estimate_quantization_step_size(0.5, curved).unwrap();
+    assert!((curved(step_size).unwrap() - 0.5).abs() < 0.05);
+
+    // Step sizes are clamped to the supported range
+    let step_size = estimate_quantization_step_size(100.0, linear).unwrap();
+    assert!((step_size - RATE_CONTROL_STEP_SIZE_RANGE.start()).abs() < 1e-7);
+  }
+
+  #[test]
+  fn sample_tiles_test() {
+    let data: Vec<u8> = (0..1024 * 8).map(|i| (i % 251) as u8).collect();
+
+    let (sample, width, height) = sample_tiles(&data, 1024, 8, 1);
+    assert_eq!((width, height), (512, 8));
+    assert_eq!(sample.len(), 512 * 8);
+    assert_eq!(sample[0], data[64]);
+    assert_eq!(sample[128], data[256 + 64]);
+    assert_eq!(sample[512], data[1024 + 64]);
+  }
+}
@@ -2,13 +2,14 @@
 use alloc::{boxed::Box, string::ToString, vec, vec::Vec};
 
 use crate::{
-  ColorImage, ColorSpace, MonochromeImage, PixelDataEncodeError,
+  ColorImage, ColorSpace, MonochromeImage, PixelDataEncodeError, byte_planes,
   color_image::ColorImageData,
   iods::image_pixel_module::{
     BitsAllocated, ImagePixelModule, PhotometricInterpretation,
     PixelRepresentation, PlanarConfiguration,
   },
   monochrome_image::MonochromeImageData,
+  row_parallel,
 };
 
 /// Returns the Image Pixel Module resulting from encoding as RLE Lossless pixel
@@ -32,13 +33,14 @@ pub fn encode_image_pixel_module(
   Ok(image_pixel_module)
 }
 
-/// Encodes a [`MonochromeImage`] into RLE Lossless raw bytes.
+/// Encodes a [`MonochromeImage`] into RLE Lossless raw bytes. The RLE segments
+/// are encoded concurrently on up to `thread_count` threads.
 ///
 pub fn encode_monochrome(
   image: &MonochromeImage,
   image_pixel_module: &ImagePixelModule,
+  thread_count: usize,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
-  let pixel_count = image.pixel_count();
   let row_size = usize::from(image.width());
 
   match (
@@ -70,7 +72,7 @@ pub fn encode_monochrome(
         data.len()
       };
 
-      encode_segments(&[segment_0], row_size)
+      encode_segments(&[segment_0], row_size, thread_count)
     }
 
     (
@@ -93,7 +95,7 @@ pub fn encode_monochrome(
     ) => {
       let segment_0 = bytemuck::cast_slice(data).to_vec();
 
-      encode_segments(&[segment_0], row_size)
+      encode_segments(&[segment_0], row_size, thread_count)
     }
 
     (
@@ -114,15 +116,13 @@ pub fn encode_monochrome(
       },
       BitsAllocated::Eight,
     ) => {
-      let mut segment_0 = vec![0; pixel_count];
-
       let mask = (1 << image.bits_stored()) - 1;
+      let segment_0: Vec<u8> = data
+        .iter()
+        .map(|value| (i16::from(*value) & mask) as u8)
+        .collect();
 
-      for i in 0..pixel_count {
-        segment_0[i] = (i16::from(data[i]) & mask) as u8;
-      }
-
-      encode_segments(&[segment_0], row_size)
+      encode_segments(&[segment_0], row_size, thread_count)
     }
 
     (
@@ -145,7 +145,7 @@ pub fn encode_monochrome(
     ) => {
       let segment_0 = data.to_vec();
 
-      encode_segments(&[segment_0], row_size)
+      encode_segments(&[segment_0], row_size, thread_count)
     }
 
     (
@@ -166,17 +166,9 @@ pub fn encode_monochrome(
       },
       BitsAllocated::Sixteen,
     ) => {
-      let mut segment_0 = vec![0; pixel_count];
-      let mut segment_1 = vec![0; pixel_count];
-
-      for i in 0..pixel_count {
-        let [a, b] = data[i].to_be_bytes();
+      let segments = split_be16(data, |value| value as u16);
 
-        segment_0[i] = a;
-        segment_1[i] = b;
-      }
-
-      encode_segments(&[segment_0, segment_1], row_size)
+      encode_segments(&segments, row_size, thread_count)
     }
 
     (
@@ -197,19 +189,10 @@ pub fn encode_monochrome(
       },
       BitsAllocated::Sixteen,
     ) => {
-      let mut segment_0 = vec![0; pixel_count];
-      let mut segment_1 = vec![0; pixel_count];
-
       let mask = (1 << image.bits_stored()) - 1;
+      let segments = split_be16(data, |value| (i32::from(value) & mask) as u16);
 
-      for i in 0..pixel_count {
-        let [a, b] = ((i32::from(data[i]) & mask) as u16).to_be_bytes();
-
-        segment_0[i] = a;
-        segment_1[i] = b;
-      }
-
-      encode_segments(&[segment_0, segment_1], row_size)
+      encode_segments(&segments, row_size, thread_count)
     }
 
     (
@@ -230,17 +213,9 @@ pub fn encode_monochrome(
       },
       BitsAllocated::Sixteen,
     ) => {
-      let mut segment_0 = vec![0; pixel_count];
-      let mut segment_1 = vec![0; pixel_count];
-
-      for i in 0..pixel_count {
-        let [a, b] = data[i].to_be_bytes();
-
-        segment_0[i] = a;
-        segment_1[i] = b;
-      }
+      let segments = split_be16(data, |value| value);
 
-      encode_segments(&[segment_0, segment_1], row_size)
+      encode_segments(&segments, row_size, thread_count)
     }
 
     (
@@ -261,21 +236,9 @@ pub fn encode_monochrome(
       },
       BitsAllocated::ThirtyTwo,
     ) => {
-      let mut segment_0 = vec![0; pixel_count];
-      let mut segment_1 = vec![0; pixel_count];
-      let mut segment_2 = vec![0; pixel_count];
-      let mut segment_3 = vec![0; pixel_count];
-
-      for i in 0..pixel_count {
-        let [a, b, c, d] = data[i].to_be_bytes();
-
-        segment_0[i] = a;
-        segment_1[i] = b;
-        segment_2[i] = c;
-        segment_3[i] = d;
-      }
+      let segments = split_be32(data, |value| value as u32);
 
-      encode_segments(&[segment_0, segment_1, segment_2, segment_3], row_size)
+      encode_segments(&segments, row_size, thread_count)
     }
 
     (
@@ -296,23 +259,10 @@ pub fn encode_monochrome(
       },
       BitsAllocated::ThirtyTwo,
     ) => {
-      let mut segment_0 = vec![0; pixel_count];
-      let mut segment_1 = vec![0; pixel_count];
-      let mut segment_2 = vec![0; pixel_count];
-      let mut segment_3 = vec![0; pixel_count];
-
       let mask = (1 << image.bits_stored()) - 1;
+      let segments = split_be32(data, |value| (i64::from(value) & mask) as u32);
 
-      for i in 0..pixel_count {
-        let [a, b, c, d] = ((i64::from(data[i]) & mask) as u32).to_be_bytes();
-
-        segment_0[i] = a;
-        segment_1[i] = b;
-        segment_2[i] = c;
-        segment_3[i] = d;
-      }
-
-      encode_segments(&[segment_0, segment_1, segment_2, segment_3], row_size)
+      encode_segments(&segments, row_size, thread_count)
     }
 
     (
@@ -333,21 +283,9 @@ pub fn encode_monochrome(
       },
       BitsAllocated::ThirtyTwo,
     ) => {
-      let mut segment_0 = vec![0; pixel_count];
-      let mut segment_1 = vec![0; pixel_count];
-      let mut segment_2 = vec![0; pixel_count];
-      let mut segment_3 = vec![0; pixel_count];
-
-      for (i, pixel) in data.iter().enumerate().take(pixel_count) {
-        let [a, b, c, d] = pixel.to_be_bytes();
-
-        segment_0[i] = a;
-        segment_1[i] = b;
-        segment_2[i] = c;
-        segment_3[i] = d;
-      }
+      let segments = split_be32(data, |value| value);
 
-      encode_segments(&[segment_0, segment_1, segment_2, segment_3], row_size)
+      encode_segments(&segments, row_size, thread_count)
     }
 
     _ => Err(PixelDataEncodeError::NotSupported {
@@ -358,11 +296,13 @@ pub fn encode_monochrome(
   }
 }
 
-/// Encodes a [`MonochromeImage`] into RLE Lossless raw bytes.
+/// Encodes a [`ColorImage`] into RLE Lossless raw bytes. The RLE segments are
+/// encoded concurrently on up to `thread_count` threads.
 ///
 pub fn encode_color(
   image: &ColorImage,
   image_pixel_module: &ImagePixelModule,
+  thread_count: usize,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
   let row_size = usize::from(image.width());
   let pixel_count = image.pixel_count();
@@ -379,7 +319,7 @@ pub fn encode_color(
     ) => {
       let segment_0 = data.to_vec();
 
-      encode_segments(&[segment_0], row_size)
+      encode_segments(&[segment_0], row_size, thread_count)
     }
 
     (
@@ -387,17 +327,9 @@ pub fn encode_color(
       PhotometricInterpretation::PaletteColor { .. },
       BitsAllocated::Sixteen,
     ) => {
-      let mut segment_0 = vec![0; pixel_count];
-      let mut segment_1 = vec![0; pixel_count];
-
-      for i in 0..pixel_count {
-        let [a, b] = data[i].to_be_bytes();
+      let segments = split_be16(data, |value| value);
 
-        segment_0[i] = a;
-        segment_1[i] = b;
-      }
-
-      encode_segments(&[segment_0, segment_1], row_size)
+      encode_segments(&segments, row_size, thread_count)
     }
 
     (
@@ -416,17 +348,12 @@ pub fn encode_color(
       PhotometricInterpretation::YbrFull,
       BitsAllocated::Eight,
     ) => {
-      let mut segment_0 = vec![0; pixel_count];
-      let mut segment_1 = vec![0; pixel_count];
-      let mut segment_2 = vec![0; pixel_count];
-
-      for i in 0..pixel_count {
-        segment_0[i] = data[i * 3];
-        segment_1[i] = data[i * 3 + 1];
-        segment_2[i] = data[i * 3 + 2];
-      }
+      let mut segments: [Vec<u8>; 3] =
+        core::array::from_fn(|_| vec![0; pixel_count]);
+      let [segment_0, segment_1, segment_2] = &mut segments;
+      byte_planes::deinterleave3(data, [segment_0, segment_1, segment_2]);
 
-      encode_segments(&[segment_0, segment_1, segment_2], row_size)
+      encode_segments(&segments, row_size, thread_count)
     }
 
     (
@@ -445,33 +372,9 @@ pub fn encode_color(
       PhotometricInterpretation::YbrFull,
       BitsAllocated::Sixteen,
     ) => {
-      let mut segment_0 = vec![0; pixel_count];
-      let mut segment_1 = vec![0; pixel_count];
-      let mut segment_2 = vec![0; pixel_count];
-      let mut segment_3 = vec![0; pixel_count];
-      let mut segment_4 = vec![0; pixel_count];
-      let mut segment_5 = vec![0; pixel_count];
-
-      for i in 0..pixel_count {
-        let [a, b] = data[i * 3].to_be_bytes();
-        segment_0[i] = a;
-        segment_1[i] = b;
-
-        let [a, b] = data[i * 3 + 1].to_be_bytes();
-        segment_2[i] = a;
-        segment_3[i] = b;
-
-        let [a, b] = data[i * 3 + 2].to_be_bytes();
-        segment_4[i] = a;
-        segment_5[i] = b;
-      }
+      let segments = split_be16x3(data);
 
-      encode_segments(
-        &[
-          segment_0, segment_1, segment_2, segment_3, segment_4, segment_5,
-        ],
-        row_size,
-      )
+      encode_segments(&segments, row_size, thread_count)
     }
 
     (
@@ -490,46 +393,9 @@ pub fn encode_color(
       PhotometricInterpretation::YbrFull,
       BitsAllocated::ThirtyTwo,
     ) => {
-      let mut segment_0 = vec![0; pixel_count];
-      let mut segment_1 = vec![0; pixel_count];
-      let mut segment_2 = vec![0; pixel_count];
-      let mut segment_3 = vec![0; pixel_count];
-      let mut segment_4 = vec![0; pixel_count];
-      let mut segment_5 = vec![0; pixel_count];
-      let mut segment_6 = vec![0; pixel_count];
-      let mut segment_7 = vec![0; pixel_count];
-      let mut segment_8 = vec![0; pixel_count];
-      let mut segment_9 = vec![0; pixel_count];
-      let mut segment_10 = vec![0; pixel_count];
-      let mut segment_11 = vec![0; pixel_count];
-
-      for i in 0..pixel_count {
-        let [a, b, c, d] = data[i * 3].to_be_bytes();
-        segment_0[i] = a;
-        segment_1[i] = b;
-        segment_2[i] = c;
-        segment_3[i] = d;
-
-        let [a, b, c, d] = data[i * 3 + 1].to_be_bytes();
-        segment_4[i] = a;
-        segment_5[i] = b;
-        segment_6[i] = c;
-        segment_7[i] = d;
-
-        let [a, b, c, d] = data[i * 3 + 2].to_be_bytes();
-        segment_8[i] = a;
-        segment_9[i] = b;
-        segment_10[i] = c;
-        segment_11[i] = d;
-      }
+      let segments = split_be32x3(data);
 
-      encode_segments(
-        &[
-          segment_0, segment_1, segment_2, segment_3, segment_4, segment_5,
-          segment_6, segment_7, segment_8, segment_9, segment_10, segment_11,
-        ],
-        row_size,
-      )
+      encode_segments(&segments, row_size, thread_count)
     }
 
     _ => Err(PixelDataEncodeError::NotSupported {
@@ -544,7 +410,8 @@ pub fn encode_color(
 /// has the given size.
 ///
 /// The returned data includes the RLE Lossless header that specifies the number
-/// of segments and their size.
+/// of segments and their size. The segments are independent of each other, and
+/// are encoded concurrently on up to `thread_count` threads.
 ///
 /// Ref: PS3.5 G.3.1, PS3.5 G.4, PS3.5 G.5.
 ///
@@ -552,6 +419,7 @@ pub fn encode_color(
 fn encode_segments(
   segments: &[Vec<u8>],
   row_size: usize,
+  thread_count: usize,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
   // The maximum number of segments allowed by RLE Lossless is 15
   if segments.len() > 15 {
@@ -561,17 +429,31 @@ fn encode_segments(
     });
   }
 
-  let mut encoded_segments = Vec::with_capacity(segments.len());
-  let mut total_segment_length = 0;
-
-  // RLE encode all segments
   for segment in segments {
-    let data = encode_segment(segment, row_size)?;
-
-    total_segment_length += data.len();
-    encoded_segments.push(data);
+    validate_segment_length(segment, row_size)?;
   }
 
+  // RLE encode all segments
+  let mut encoded_segments: Vec<_> = segments
+    .iter()
+    .map(|segment| (segment.as_slice(), Vec::new()))
+    .collect();
+
+  row_parallel::for_each_item_mut(
+    &mut encoded_segments,
+    row_size,
+    thread_count,
+    |(segment, output)| *output = encode_rows(segment, row_size),
+  );
+
+  let encoded_segments: Vec<_> = encoded_segments
+    .into_iter()
+    .map(|(_, output)| output)
+    .collect();
+
+  let total_segment_length: usize =
+    encoded_segments.iter().map(|segment| segment.len()).sum();
+
   // Check total output size doesn't exceed a u32
   if 64 + total_segment_length > u32::MAX as usize {
     return Err(PixelDataEncodeError::OtherError {
@@ -626,8 +508,17 @@ fn encode_segment(
   data: &[u8],
   row_size: usize,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
-  let mut output = Vec::with_capacity(data.len());
+  validate_segment_length(data, row_size)?;
 
+  Ok(encode_rows(data, row_size))
+}
+
+/// Checks that a segment's data is made up of whole rows of the given size.
+///
+fn validate_segment_length(
+  data: &[u8],
+  row_size: usize,
+) -> Result<(), PixelDataEncodeError> {
   if row_size == 0 || !data.len().is_multiple_of(row_size) {
     return Err(PixelDataEncodeError::OtherError {
       name: "RLE Lossless encode failed".to_string(),
@@ -636,13 +527,102 @@ fn encode_segment(
     });
   }
 
+  Ok(())
+}
+
+/// RLE encodes each row of a segment's data, which must have been checked with
+/// [`validate_segment_length()`].
+///
+fn encode_rows(data: &[u8], row_size: usize) -> Vec<u8> {
+  let mut output = Vec::with_capacity(data.len());
+
   for row in data.chunks_exact(row_size) {
     encode_row(row, &mut output)
   }
 
   output.shrink_to_fit();
 
-  Ok(output)
+  output
+}
+
+/// Splits 16-bit values into two segments holding their high and low bytes.
+/// The segments are sliced to the data's length up front so that the loop has
+/// no bounds checks and is vectorized into byte shuffles.
+///
+fn split_be16<T: Copy>(data: &[T], to_u16: impl Fn(T) -> u16) -> [Vec<u8>; 2] {
+  let mut segments: [Vec<u8>; 2] =
+    core::array::from_fn(|_| vec![0; data.len()]);
+  let [segment_0, segment_1] = segments
+    .each_mut()
+    .map(|segment| &mut segment[..data.len()]);
+
+  for (i, value) in data.iter().enumerate() {
+    [segment_0[i], segment_1[i]] = to_u16(*value).to_be_bytes();
+  }
+
+  segments
+}
+
+/// Splits 32-bit values into four segments holding their bytes, from most to
+/// least significant. See [`split_be16()`].
+///
+fn split_be32<T: Copy>(data: &[T], to_u32: impl Fn(T) -> u32) -> [Vec<u8>; 4] {
+  let mut segments: [Vec<u8>; 4] =
+    core::array::from_fn(|_| vec![0; data.len()]);
+  let [segment_0, segment_1, segment_2, segment_3] = segments
+    .each_mut()
+    .map(|segment| &mut segment[..data.len()]);
+
+  for (i, value) in data.iter().enumerate() {
+    [segment_0[i], segment_1[i], segment_2[i], segment_3[i]] =
+      to_u32(*value).to_be_bytes();
+  }
+
+  segments
+}
+
+/// Splits 16-bit three-sample pixels into six segments, which hold the high
+/// and low bytes of each sample in turn. See [`split_be16()`].
+///
+fn split_be16x3(data: &[u16]) -> [Vec<u8>; 6] {
+  let pixels = data.as_chunks::<3>().0;
+
+  let mut segments: [Vec<u8>; 6] =
+    core::array::from_fn(|_| vec![0; pixels.len()]);
+  let [r0, r1, g0, g1, b0, b1] = segments
+    .each_mut()
+    .map(|segment| &mut segment[..pixels.len()]);
+
+  for (i, [r, g, b]) in pixels.iter().enumerate() {
+    [r0[i], r1[i]] = r.to_be_bytes();
+    [g0[i], g1[i]] = g.to_be_bytes();
+    [b0[i], b1[i]] = b.to_be_bytes();
+  }
+
+  segments
+}
+
+/// Splits 32-bit three-sample pixels into twelve segments, which hold the
+/// bytes of each sample in turn. See [`split_be16()`].
+///
+fn split_be32x3(data: &[u32]) -> [Vec<u8>; 12] {
+  let pixels = data.as_chunks::<3>().0;
+
+  let mut segments: [Vec<u8>; 12] =
+    core::array::from_fn(|_| vec![0; pixels.len()]);
+  let s = segments
+    .each_mut()
+    .map(|segment| &mut segment[..pixels.len()]);
+
+  for (i, pixel) in pixels.iter().enumerate() {
+    for (c, sample) in pixel.iter().enumerate() {
+      for (b, byte) in sample.to_be_bytes().into_iter().enumerate() {
+        s[c * 4 + b][i] = byte;
+      }
+    }
+  }
+
+  segments
 }
 
 /// RLE encodes the data for a single row.
@@ -744,7 +724,7 @@ mod tests {
   #[test]
   fn odd_length_segment_adds_padding_byte() {
     assert_eq!(
-      encode_segments(&[vec![1, 2]], 2),
+      encode_segments(&[vec![1, 2]], 2, 1),
       Ok(vec![
         1, 0, 0, 0, 64, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
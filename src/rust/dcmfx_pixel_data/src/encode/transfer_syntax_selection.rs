@@ -0,0 +1,416 @@
+use std::time::Instant;
+
+use dcmfx_core::TransferSyntax;
+
+use crate::{
+  ColorImage, MonochromeImage, PixelDataEncodeConfig, PixelDataEncodeError,
+  PixelDataFrame, iods::image_pixel_module::ImagePixelModule,
+  transforms::CropRect,
+};
+
+/// The width and height of the tiles that are trial encoded.
+///
+const TILE_SIZE: u16 = 256;
+
+/// The number of tiles across and down the image that are trial encoded, i.e.
+/// up to this number squared tiles are encoded with each candidate.
+///
+const TILE_GRID_SIZE: u16 = 2;
+
+/// Selects the transfer syntax to encode pixel data into from a list of
+/// candidates, by trial encoding tiles sampled from the first frame with each
+/// candidate and comparing the compression ratio and encode speed of each
+/// under a [`TransferSyntaxSelectionPolicy`].
+///
+/// Tiles are spread evenly across the frame so that the trial sees a
+/// representative mix of its content, and are kept small so that the trial
+/// costs a fraction of the time taken to encode the frame itself.
+///
+/// Candidates that can't encode the image, e.g. because its bit depth isn't
+/// supported by the codec, or whose codec isn't available in this build, are
+/// skipped.
+///
+/// See [`P10PixelDataTranscodeTransform::set_transfer_syntax_selection()`].
+///
+/// [`P10PixelDataTranscodeTransform::set_transfer_syntax_selection()`]:
+///   crate::transforms::P10PixelDataTranscodeTransform::set_transfer_syntax_selection
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct TransferSyntaxSelection {
+  candidates: Vec<&'static TransferSyntax>,
+  policy: TransferSyntaxSelectionPolicy,
+}
+
+/// How a [`TransferSyntaxSelection`] weighs compression ratio against encode
+/// speed when choosing between candidates.
+///
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum TransferSyntaxSelectionPolicy {
+  /// Selects the candidate with the highest compression ratio.
+  SmallestOutput,
+
+  /// Selects the candidate that encodes the most megapixels per second.
+  FastestEncode,
+
+  /// Selects the candidate with the highest compression ratio out of those
+  /// that encode at least the given number of megapixels per second. If no
+  /// candidate is that fast then the fastest candidate is selected.
+  SmallestOutputAtSpeed { min_megapixels_per_second: f64 },
+}
+
+/// The result of trial encoding tiles with a candidate transfer syntax.
+///
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct TrialEncodeResult {
+  pub transfer_syntax: &'static TransferSyntax,
+  pub compression_ratio: f64,
+  pub megapixels_per_second: f64,
+}
+
+impl TransferSyntaxSelection {
+  /// Creates a new transfer syntax selection that chooses between the given
+  /// candidates using the given policy. When candidates are otherwise equal
+  /// the one listed first is selected.
+  ///
+  pub fn new(
+    candidates: Vec<&'static TransferSyntax>,
+    policy: TransferSyntaxSelectionPolicy,
+  ) -> Self {
+    Self { candidates, policy }
+  }
+
+  /// Returns the candidate transfer syntaxes.
+  ///
+  pub fn candidates(&self) -> &[&'static TransferSyntax] {
+    &self.candidates
+  }
+
+  /// Returns the policy used to choose between the candidates.
+  ///
+  pub fn policy(&self) -> TransferSyntaxSelectionPolicy {
+    self.policy
+  }
+
+  /// Trial encodes tiles of a monochrome image with each candidate, and
+  /// returns the selected transfer syntax. Returns `None` if no candidate was
+  /// able to encode the image.
+  ///
+  pub fn select_for_monochrome_image(
+    &self,
+    image: &MonochromeImage,
+    image_pixel_module: &ImagePixelModule,
+    encode_config: &PixelDataEncodeConfig,
+  ) -> Option<&'static TransferSyntax> {
+    let tiles: Vec<_> = sample_tiles(image.width(), image.height())
+      .iter()
+      .map(|crop_rect| {
+        let mut tile = image.clone();
+        tile.crop(crop_rect);
+        tile
+      })
+      .collect();
+
+    let results = self.trial_encode(
+      &tiles,
+      |tile| (tile.height(), tile.width()),
+      image_pixel_module,
+      encode_config,
+      |tile, image_pixel_module, transfer_syntax| {
+        super::encode_monochrome(
+          tile,
+          image_pixel_module,
+          transfer_syntax,
+          encode_config,
+        )
+      },
+    );
+
+    self.select(&results)
+  }
+
+  /// Trial encodes tiles of a color image with each candidate, and returns
+  /// the selected transfer syntax. Returns `None` if no candidate was able to
+  /// encode the image.
+  ///
+  pub fn select_for_color_image(
+    &self,
+    image: &ColorImage,
+    image_pixel_module: &ImagePixelModule,
+    encode_config: &PixelDataEncodeConfig,
+  ) -> Option<&'static TransferSyntax> {
+    let tiles: Vec<_> = sample_tiles(image.width(), image.height())
+      .iter()
+      .map(|crop_rect| {
+        let mut tile = image.clone();
+        tile.crop(crop_rect);
+        tile
+      })
+      .collect();
+
+    let results = self.trial_encode(
+      &tiles,
+      |tile| (tile.height(), tile.width()),
+      image_pixel_module,
+      encode_config,
+      |tile, image_pixel_module, transfer_syntax| {
+        super::encode_color(
+          tile,
+          image_pixel_module,
+          transfer_syntax,
+          encode_config,
+        )
+      },
+    );
+
+    self.select(&results)
+  }
+
+  /// Encodes tiles of an image with each candidate using the passed encode
+  /// function, and returns the results for the candidates that encoded every
+  /// tile successfully.
+  ///
+  fn trial_encode<T>(
+    &self,
+    tiles: &[T],
+    tile_dimensions: impl Fn(&T) -> (u16, u16),
+    image_pixel_module: &ImagePixelModule,
+    encode_config: &PixelDataEncodeConfig,
+    encode_tile: impl Fn(
+      &T,
+      &ImagePixelModule,
+      &'static TransferSyntax,
+    ) -> Result<PixelDataFrame, PixelDataEncodeError>,
+  ) -> Vec<TrialEncodeResult> {
+    let mut results = Vec::with_capacity(self.candidates.len());
+
+    'candidates: for transfer_syntax in self.candidates.iter().copied() {
+      let mut input_size = 0;
+      let mut output_size = 0;
+      let mut pixel_count = 0;
+      let mut encode_seconds = 0.0;
+
+      for tile in tiles {
+        let (rows, columns) = tile_dimensions(tile);
+
+        let mut tile_image_pixel_module = image_pixel_module.clone();
+        if tile_image_pixel_module
+          .set_dimensions(rows, columns)
+          .is_err()
+        {
+          continue 'candidates;
+        }
+
+        let Ok(output_image_pixel_module) = super::encode_image_pixel_module(
+          tile_image_pixel_module.clone(),
+          transfer_syntax,
+          encode_config,
+        ) else {
+          continue 'candidates;
+        };
+
+        let encode_start = Instant::now();
+        let Ok(frame) =
+          encode_tile(tile, &output_image_pixel_module, transfer_syntax)
+        else {
+          continue 'candidates;
+        };
+        encode_seconds += encode_start.elapsed().as_secs_f64();
+
+        input_size += tile_image_pixel_module.frame_size_in_bytes() as u64;
+        output_size += frame.len();
+        pixel_count += tile_image_pixel_module.pixel_count() as u64;
+      }
+
+      results.push(TrialEncodeResult {
+        transfer_syntax,
+        compression_ratio: input_size as f64 / output_size.max(1) as f64,
+        megapixels_per_second: pixel_count as f64
+          / 1_000_000.0
+          / encode_seconds.max(f64::EPSILON),
+      });
+    }
+
+    results
+  }
+
+  /// Selects a transfer syntax from the results of trial encodes according to
+  /// this selection's policy. Results earlier in the list win ties.
+  ///
+  pub fn select(
+    &self,
+    results: &[TrialEncodeResult],
+  ) -> Option<&'static TransferSyntax> {
+    let compression_ratio = |r: &TrialEncodeResult| r.compression_ratio;
+    let megapixels_per_second = |r: &TrialEncodeResult| r.megapixels_per_second;
+
+    match self.policy {
+      TransferSyntaxSelectionPolicy::SmallestOutput => {
+        best_result(results.iter(), compression_ratio)
+      }
+
+      TransferSyntaxSelectionPolicy::FastestEncode => {
+        best_result(results.iter(), megapixels_per_second)
+      }
+
+      TransferSyntaxSelectionPolicy::SmallestOutputAtSpeed {
+        min_megapixels_per_second,
+      } => best_result(
+        results
+          .iter()
+          .filter(|r| r.megapixels_per_second >= min_megapixels_per_second),
+        compression_ratio,
+      )
+      .or_else(|| best_result(results.iter(), megapixels_per_second)),
+    }
+  }
+}
+
+/// Returns the transfer syntax of the result with the highest value for the
+/// given key. The earliest result wins ties.
+///
+fn best_result<'a>(
+  results: impl Iterator<Item = &'a TrialEncodeResult>,
+  key: impl Fn(&TrialEncodeResult) -> f64,
+) -> Option<&'static TransferSyntax> {
+  results
+    .fold(
+      None,
+      |best: Option<&TrialEncodeResult>, result| match best {
+        Some(best) if key(best) >= key(result) => Some(best),
+        _ => Some(result),
+      },
+    )
+    .map(|result| result.transfer_syntax)
+}
+
+/// Returns the tiles to trial encode for an image of the given size. These
+/// are laid out on a grid with each tile centered in its grid cell. Images no
+/// larger than a single tile are trial encoded whole.
+///
+fn sample_tiles(width: u16, height: u16) -> Vec<CropRect> {
+  let tile_positions = |size: u16| -> Vec<(u16, u16)> {
+    if size <= TILE_SIZE {
+      return vec![(0, size)];
+    }
+
+    let cell_count = TILE_GRID_SIZE.min(size / TILE_SIZE);
+    let cell_size = size / cell_count;
+
+    (0..cell_count)
+      .map(|i| {
+        // Tiles start on an even column so that horizontally subsampled color
+        // data is never split
+        let offset = i * cell_size + (cell_size - TILE_SIZE) / 2;
+        (offset & !1, TILE_SIZE)
+      })
+      .collect()
+  };
+
+  let mut tiles = vec![];
+
+  for (top, height) in tile_positions(height) {
+    for (left, width) in tile_positions(width) {
+      tiles.push(CropRect {
+        left,
+        top,
+        width_or_right: Some(width.into()),
+        height_or_bottom: Some(height.into()),
+      });
+    }
+  }
+
+  tiles
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  use dcmfx_core::transfer_syntax;
+
+  fn results() -> [TrialEncodeResult; 3] {
+    [
+      TrialEncodeResult {
+        transfer_syntax:
+          &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+        compression_ratio: 2.5,
+        megapixels_per_second: 200.0,
+      },
+      TrialEncodeResult {
+        transfer_syntax: &transfer_syntax::JPEG_XL_LOSSLESS,
+        compression_ratio: 3.0,
+        megapixels_per_second: 20.0,
+      },
+      TrialEncodeResult {
+        transfer_syntax: &transfer_syntax::JPEG_LS_LOSSLESS,
+        compression_ratio: 2.8,
+        megapixels_per_second: 80.0,
+      },
+    ]
+  }
+
+  fn select(policy: TransferSyntaxSelectionPolicy) -> &'static TransferSyntax {
+    TransferSyntaxSelection::new(vec![], policy)
+      .select(&results())
+      .unwrap()
+  }
+
+  #[test]
+  fn select_test() {
+    assert_eq!(
+      select(TransferSyntaxSelectionPolicy::SmallestOutput),
+      &transfer_syntax::JPEG_XL_LOSSLESS
+    );
+
+    assert_eq!(
+      select(TransferSyntaxSelectionPolicy::FastestEncode),
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
+    );
+
+    assert_eq!(
+      select(TransferSyntaxSelectionPolicy::SmallestOutputAtSpeed {
+        min_megapixels_per_second: 50.0
+      }),
+      &transfer_syntax::JPEG_LS_LOSSLESS
+    );
+
+    assert_eq!(
+      select(TransferSyntaxSelectionPolicy::SmallestOutputAtSpeed {
+        min_megapixels_per_second: 500.0
+      }),
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
+    );
+
+    assert_eq!(
+      TransferSyntaxSelection::new(
+        vec![],
+        TransferSyntaxSelectionPolicy::SmallestOutput
+      )
+      .select(&[]),
+      None
+    );
+  }
+
+  #[test]
+  fn sample_tiles_test() {
+    assert_eq!(
+      sample_tiles(100, 50),
+      vec![CropRect {
+        left: 0,
+        top: 0,
+        width_or_right: Some(100),
+        height_or_bottom: Some(50),
+      }]
+    );
+
+    let tiles = sample_tiles(1024, 300);
+    assert_eq!(tiles.len(), 2);
+    assert_eq!((tiles[0].left, tiles[0].top), (128, 22));
+    assert_eq!((tiles[1].left, tiles[1].top), (640, 22));
+
+    for tile in sample_tiles(4000, 3000) {
+      assert_eq!(tile.left % 2, 0);
+      assert_eq!(tile.apply(3000, 4000), (TILE_SIZE, TILE_SIZE));
+    }
+  }
+}
@@ -0,0 +1,593 @@
+//! Reuses the buffers that decoded frames and rendered images are stored in
+//! across frames, so that decoding a multi-frame image doesn't allocate new
+//! buffers for every frame.
+//!
+//! A [`FrameBufferPool`] is made active on the current thread for the duration
+//! of a call to [`FrameBufferPool::scope()`]. While it's active, decoders take
+//! their output buffers from it, and buffers that are finished with part way
+//! through decoding and rendering are returned to it. Buffers are only reused
+//! by a later frame when their capacity is large enough, which is always the
+//! case in steady state as the frames of a multi-frame image are the same
+//! size.
+//!
+//! Buffers of at least [`FrameBufferPool::DEFAULT_HUGE_PAGE_THRESHOLD`] bytes
+//! that the pool allocates are backed by transparent huge pages on Linux,
+//! which cuts the TLB misses and page faults caused by first touching and
+//! then working through the very large frames of whole slide images and
+//! tomosynthesis. Buffers can also be allocated and faulted in ahead of time
+//! on a background thread with [`FrameBufferPool::prefault()`].
+
+#[cfg(not(feature = "std"))]
+use alloc::{vec, vec::Vec};
+
+#[cfg(feature = "std")]
+use core::{any::Any, any::TypeId, cell::RefCell};
+#[cfg(feature = "std")]
+use std::thread::JoinHandle;
+
+use crate::{ColorImage, MonochromeImage};
+#[cfg(feature = "std")]
+use crate::{ColorImageData, MonochromeImageData};
+
+/// A type of value that can be stored in the buffers of a [`FrameBufferPool`].
+///
+pub trait PoolElement: Copy + Default + 'static {
+  /// Returns the pool's buffers for this type of value.
+  ///
+  #[cfg(feature = "std")]
+  fn buffers(pool: &mut FrameBufferPool) -> &mut Vec<Vec<Self>>;
+}
+
+macro_rules! impl_pool_element {
+  ($type:ty, $field:ident) => {
+    impl PoolElement for $type {
+      #[cfg(feature = "std")]
+      fn buffers(pool: &mut FrameBufferPool) -> &mut Vec<Vec<Self>> {
+        &mut pool.$field
+      }
+    }
+  };
+}
+
+impl_pool_element!(u8, u8_buffers);
+impl_pool_element!(i8, i8_buffers);
+impl_pool_element!(u16, u16_buffers);
+impl_pool_element!(i16, i16_buffers);
+impl_pool_element!(u32, u32_buffers);
+impl_pool_element!(i32, i32_buffers);
+
+/// A pool of buffers that are reused across the frames being decoded and
+/// rendered on a thread. It holds a limited number of buffers for each type
+/// of value, and when it's full the smallest buffers are the ones dropped.
+///
+/// Decoded images and rendered images that the caller is finished with can be
+/// returned to the pool with [`Self::recycle_monochrome_image()`],
+/// [`Self::recycle_color_image()`], and [`Self::recycle_rgb_image()`], which
+/// makes their buffers available to the next frame.
+///
+#[cfg(feature = "std")]
+#[derive(Debug)]
+pub struct FrameBufferPool {
+  max_buffers_per_type: usize,
+
+  u8_buffers: Vec<Vec<u8>>,
+  i8_buffers: Vec<Vec<i8>>,
+  u16_buffers: Vec<Vec<u16>>,
+  i16_buffers: Vec<Vec<i16>>,
+  u32_buffers: Vec<Vec<u32>>,
+  i32_buffers: Vec<Vec<i32>>,
+
+  huge_page_threshold: Option<usize>,
+
+  /// Buffers being allocated and faulted in on background threads by
+  /// [`Self::prefault()`], along with their type and capacity.
+  prefaulting_buffers: Vec<(TypeId, usize, JoinHandle<Box<dyn Any + Send>>)>,
+}
+
+#[cfg(feature = "std")]
+impl Default for FrameBufferPool {
+  fn default() -> Self {
+    Self::new(Self::DEFAULT_MAX_BUFFERS_PER_TYPE)
+  }
+}
+
+#[cfg(feature = "std")]
+impl FrameBufferPool {
+  /// The default maximum number of buffers held for each type of value. This
+  /// covers the decoded image, the intermediate images created when it's
+  /// converted or rendered, and the rendered image.
+  ///
+  pub const DEFAULT_MAX_BUFFERS_PER_TYPE: usize = 4;
+
+  /// The default size in bytes at and above which new buffers are backed by
+  /// huge pages, see [`Self::set_huge_page_threshold()`].
+  ///
+  pub const DEFAULT_HUGE_PAGE_THRESHOLD: usize = 16 * 1024 * 1024;
+
+  /// Creates a new empty pool that holds up to the given number of buffers
+  /// for each type of value.
+  ///
+  pub fn new(max_buffers_per_type: usize) -> Self {
+    Self {
+      max_buffers_per_type,
+      u8_buffers: vec![],
+      i8_buffers: vec![],
+      u16_buffers: vec![],
+      i16_buffers: vec![],
+      u32_buffers: vec![],
+      i32_buffers: vec![],
+      huge_page_threshold: Some(Self::DEFAULT_HUGE_PAGE_THRESHOLD),
+      prefaulting_buffers: vec![],
+    }
+  }
+
+  /// Sets the size in bytes at and above which buffers allocated by the pool
+  /// are backed by transparent huge pages. `None` never uses huge pages.
+  ///
+  /// Huge pages are requested with `madvise(MADV_HUGEPAGE)` before the buffer
+  /// is first touched, and so are used when the system's transparent huge
+  /// page setting is `always` or `madvise`. This has no effect on platforms
+  /// other than Linux.
+  ///
+  /// Default: [`Self::DEFAULT_HUGE_PAGE_THRESHOLD`].
+  ///
+  pub fn set_huge_page_threshold(
+    &mut self,
+    huge_page_threshold: Option<usize>,
+  ) {
+    self.huge_page_threshold = huge_page_threshold;
+  }
+
+  /// Starts allocating a buffer with the given capacity on a background
+  /// thread, which writes to each of its pages so they are faulted in before
+  /// the buffer is needed. The buffer is added to the pool once it's ready,
+  /// and a call to [`Self::take()`] or [`Self::take_with_capacity()`] that
+  /// needs it waits for it.
+  ///
+  /// This is useful when the size of upcoming frames is known ahead of
+  /// decoding them, e.g. once the Image Pixel Module has been read.
+  ///
+  pub fn prefault<T: PoolElement + Send>(&mut self, capacity: usize) {
+    let huge_page_threshold = self.huge_page_threshold;
+
+    let handle = std::thread::spawn(move || {
+      let mut buffer = allocate::<T>(capacity, huge_page_threshold);
+
+      // Touch one value in every page of the buffer's capacity
+      let spare_capacity = buffer.spare_capacity_mut();
+      let step = (PAGE_SIZE / core::mem::size_of::<T>().max(1)).max(1);
+      for i in (0..spare_capacity.len()).step_by(step) {
+        spare_capacity[i].write(T::default());
+      }
+
+      Box::new(buffer) as Box<dyn Any + Send>
+    });
+
+    self
+      .prefaulting_buffers
+      .push((TypeId::of::<T>(), capacity, handle));
+  }
+
+  /// Returns the number of buffers currently held by the pool.
+  ///
+  pub fn buffer_count(&self) -> usize {
+    self.u8_buffers.len()
+      + self.i8_buffers.len()
+      + self.u16_buffers.len()
+      + self.i16_buffers.len()
+      + self.u32_buffers.len()
+      + self.i32_buffers.len()
+  }
+
+  /// Makes this pool active on the current thread while `f` runs, so that
+  /// decoding and rendering done by `f` takes buffers from it and returns
+  /// finished-with buffers to it. Any pool that was already active is
+  /// restored when `f` returns.
+  ///
+  pub fn scope<R>(&mut self, f: impl FnOnce() -> R) -> R {
+    /// Moves the pool back out of the thread-local when the scope ends, even
+    /// if `f` panics.
+    ///
+    struct ScopeGuard<'a> {
+      pool: &'a mut FrameBufferPool,
+      previous_pool: Option<FrameBufferPool>,
+    }
+
+    impl Drop for ScopeGuard<'_> {
+      fn drop(&mut self) {
+        let previous_pool = self.previous_pool.take();
+
+        if let Some(pool) = ACTIVE_POOL.with(|p| p.replace(previous_pool)) {
+          *self.pool = pool;
+        }
+      }
+    }
+
+    let pool = core::mem::replace(self, Self::new(0));
+    let previous_pool = ACTIVE_POOL.with(|p| p.replace(Some(pool)));
+
+    let _guard = ScopeGuard {
+      pool: self,
+      previous_pool,
+    };
+
+    f()
+  }
+
+  /// Takes a buffer of the given length from the pool, with all values set to
+  /// their default. The smallest buffer with enough capacity is used, and a
+  /// new buffer is allocated if there isn't one.
+  ///
+  pub fn take<T: PoolElement>(&mut self, len: usize) -> Vec<T> {
+    let mut buffer = self.take_with_capacity(len);
+    buffer.resize(len, T::default());
+    buffer
+  }
+
+  /// Takes an empty buffer with at least the given capacity from the pool.
+  /// The smallest buffer with enough capacity is used, and a new buffer is
+  /// allocated if there isn't one.
+  ///
+  pub fn take_with_capacity<T: PoolElement>(
+    &mut self,
+    capacity: usize,
+  ) -> Vec<T> {
+    if !self.prefaulting_buffers.is_empty() {
+      self.receive_prefaulted_buffers::<T>(capacity);
+    }
+
+    let huge_page_threshold = self.huge_page_threshold;
+    let buffers = T::buffers(self);
+
+    let best_fit = buffers
+      .iter()
+      .enumerate()
+      .filter(|(_, buffer)| buffer.capacity() >= capacity)
+      .min_by_key(|(_, buffer)| buffer.capacity())
+      .map(|(i, _)| i);
+
+    match best_fit {
+      Some(i) => {
+        let mut buffer = buffers.swap_remove(i);
+        buffer.clear();
+        buffer
+      }
+      None => allocate(capacity, huge_page_threshold),
+    }
+  }
+
+  /// Adds the buffers of type `T` that have finished being prefaulted to the
+  /// pool, waiting for any that are large enough for the given capacity.
+  ///
+  fn receive_prefaulted_buffers<T: PoolElement>(&mut self, capacity: usize) {
+    let mut i = 0;
+
+    while i < self.prefaulting_buffers.len() {
+      let (type_id, buffer_capacity, handle) = &self.prefaulting_buffers[i];
+
+      if *type_id != TypeId::of::<T>()
+        || (*buffer_capacity < capacity && !handle.is_finished())
+      {
+        i += 1;
+        continue;
+      }
+
+      let (_, _, handle) = self.prefaulting_buffers.swap_remove(i);
+
+      if let Ok(buffer) = handle.join()
+        && let Ok(buffer) = buffer.downcast::<Vec<T>>()
+      {
+        self.recycle(*buffer);
+      }
+    }
+  }
+
+  /// Returns a buffer to the pool so it can be reused. If the pool is full
+  /// then the smallest of its buffers and the passed buffer is dropped.
+  ///
+  pub fn recycle<T: PoolElement>(&mut self, buffer: Vec<T>) {
+    if buffer.capacity() == 0 {
+      return;
+    }
+
+    let max_buffers_per_type = self.max_buffers_per_type;
+    let buffers = T::buffers(self);
+
+    if buffers.len() < max_buffers_per_type {
+      buffers.push(buffer);
+      return;
+    }
+
+    let smallest = buffers
+      .iter_mut()
+      .min_by_key(|b| b.capacity())
+      .filter(|b| b.capacity() < buffer.capacity());
+
+    if let Some(smallest) = smallest {
+      *smallest = buffer;
+    }
+  }
+
+  /// Returns the buffer of a decoded monochrome image to the pool.
+  ///
+  pub fn recycle_monochrome_image(&mut self, image: MonochromeImage) {
+    match image.into_data() {
+      MonochromeImageData::Bitmap { data, .. } => self.recycle(data),
+      MonochromeImageData::I8(data) => self.recycle(data),
+      MonochromeImageData::U8(data) => self.recycle(data),
+      MonochromeImageData::I16(data) => self.recycle(data),
+      MonochromeImageData::U16(data) => self.recycle(data),
+      MonochromeImageData::I32(data) => self.recycle(data),
+      MonochromeImageData::U32(data) => self.recycle(data),
+    }
+  }
+
+  /// Returns the buffer of a decoded color image to the pool.
+  ///
+  pub fn recycle_color_image(&mut self, image: ColorImage) {
+    match image.into_data() {
+      ColorImageData::U8 { data, .. } => self.recycle(data),
+      ColorImageData::U16 { data, .. } => self.recycle(data),
+      ColorImageData::U32 { data, .. } => self.recycle(data),
+      ColorImageData::PaletteU8 { data, .. } => self.recycle(data),
+      ColorImageData::PaletteU16 { data, .. } => self.recycle(data),
+    }
+  }
+
+  /// Returns the buffer of a rendered RGB image to the pool.
+  ///
+  pub fn recycle_rgb_image(&mut self, image: image::RgbImage) {
+    self.recycle(image.into_raw());
+  }
+}
+
+/// The size of the pages that are touched when prefaulting a buffer.
+///
+#[cfg(feature = "std")]
+const PAGE_SIZE: usize = 4096;
+
+/// Allocates an empty buffer with the given capacity, requesting that it's
+/// backed by huge pages if it's at least the threshold size.
+///
+#[cfg(feature = "std")]
+fn allocate<T>(capacity: usize, huge_page_threshold: Option<usize>) -> Vec<T> {
+  let buffer = Vec::with_capacity(capacity);
+
+  #[cfg(target_os = "linux")]
+  {
+    let size = capacity * core::mem::size_of::<T>();
+    if huge_page_threshold.is_some_and(|threshold| size >= threshold) {
+      advise_huge_pages(buffer.as_ptr() as usize, size);
+    }
+  }
+
+  #[cfg(not(target_os = "linux"))]
+  let _ = huge_page_threshold;
+
+  buffer
+}
+
+/// Asks the kernel to back the 2 MiB aligned regions of the given memory with
+/// transparent huge pages. This must be done before the memory is first
+/// touched. Failure is ignored, as the memory is then just backed by normal
+/// pages.
+///
+#[cfg(all(feature = "std", target_os = "linux"))]
+fn advise_huge_pages(address: usize, size: usize) {
+  const HUGE_PAGE_SIZE: usize = 2 * 1024 * 1024;
+  const MADV_HUGEPAGE: i32 = 14;
+
+  unsafe extern "C" {
+    fn madvise(addr: *mut core::ffi::c_void, length: usize, advice: i32)
+    -> i32;
+  }
+
+  let start = address.next_multiple_of(HUGE_PAGE_SIZE);
+  let end = (address + size) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+  if start < end {
+    unsafe {
+      madvise(start as *mut core::ffi::c_void, end - start, MADV_HUGEPAGE);
+    }
+  }
+}
+
+#[cfg(feature = "std")]
+std::thread_local! {
+  /// The pool that's active on this thread, if any.
+  static ACTIVE_POOL: RefCell<Option<FrameBufferPool>> =
+    const { RefCell::new(None) };
+}
+
+/// Calls `f` with the pool that's active on this thread, if there is one.
+///
+#[cfg(feature = "std")]
+fn with_active_pool<R>(f: impl FnOnce(Option<&mut FrameBufferPool>) -> R) -> R {
+  ACTIVE_POOL.with(|pool| match pool.try_borrow_mut() {
+    Ok(mut pool) => f(pool.as_mut()),
+    Err(_) => f(None),
+  })
+}
+
+/// Returns a buffer of the given length with all values set to their default,
+/// taking it from the active pool if there is one.
+///
+pub(crate) fn zeroed_vec<T: PoolElement>(len: usize) -> Vec<T> {
+  #[cfg(feature = "std")]
+  {
+    with_active_pool(|pool| match pool {
+      Some(pool) => pool.take(len),
+      None => vec![T::default(); len],
+    })
+  }
+
+  #[cfg(not(feature = "std"))]
+  vec![T::default(); len]
+}
+
+/// Returns an empty buffer with at least the given capacity, taking it from
+/// the active pool if there is one.
+///
+pub(crate) fn vec_with_capacity<T: PoolElement>(capacity: usize) -> Vec<T> {
+  #[cfg(feature = "std")]
+  {
+    with_active_pool(|pool| match pool {
+      Some(pool) => pool.take_with_capacity(capacity),
+      None => Vec::with_capacity(capacity),
+    })
+  }
+
+  #[cfg(not(feature = "std"))]
+  Vec::with_capacity(capacity)
+}
+
+/// Returns a buffer that's no longer needed to the active pool, or drops it if
+/// there isn't one.
+///
+pub(crate) fn recycle<T: PoolElement>(buffer: Vec<T>) {
+  #[cfg(feature = "std")]
+  with_active_pool(|pool| {
+    if let Some(pool) = pool {
+      pool.recycle(buffer);
+    }
+  });
+
+  #[cfg(not(feature = "std"))]
+  drop(buffer);
+}
+
+/// Returns the buffer of a decoded monochrome image to the active pool, or
+/// drops it if there isn't one.
+///
+pub(crate) fn recycle_monochrome_image(image: MonochromeImage) {
+  #[cfg(feature = "std")]
+  with_active_pool(|pool| {
+    if let Some(pool) = pool {
+      pool.recycle_monochrome_image(image);
+    }
+  });
+
+  #[cfg(not(feature = "std"))]
+  drop(image);
+}
+
+/// Returns the buffer of a decoded color image to the active pool, or drops it
+/// if there isn't one.
+///
+pub(crate) fn recycle_color_image(image: ColorImage) {
+  #[cfg(feature = "std")]
+  with_active_pool(|pool| {
+    if let Some(pool) = pool {
+      pool.recycle_color_image(image);
+    }
+  });
+
+  #[cfg(not(feature = "std"))]
+  drop(image);
+}
+
+#[cfg(all(test, feature = "std"))]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn buffers_are_reused() {
+    let mut pool = FrameBufferPool::default();
+
+    let buffer: Vec<u16> = pool.take(100);
+    let ptr = buffer.as_ptr();
+    pool.recycle(buffer);
+    assert_eq!(pool.buffer_count(), 1);
+
+    // A smaller buffer reuses the recycled buffer, and is zeroed
+    let buffer: Vec<u16> = pool.take(50);
+    assert_eq!(buffer.as_ptr(), ptr);
+    assert!(buffer.iter().all(|v| *v == 0));
+    pool.recycle(buffer);
+
+    // A larger buffer is allocated
+    let buffer: Vec<u16> = pool.take(200);
+    assert_ne!(buffer.as_ptr(), ptr);
+    assert_eq!(pool.buffer_count(), 1);
+
+    // Buffers of a different type aren't reused
+    let buffer: Vec<u8> = pool.take(100);
+    assert_eq!(buffer.len(), 100);
+    assert_eq!(pool.buffer_count(), 1);
+  }
+
+  #[test]
+  fn smallest_buffers_are_dropped_when_full() {
+    let mut pool = FrameBufferPool::new(2);
+
+    pool.recycle(Vec::<u8>::with_capacity(10));
+    pool.recycle(Vec::<u8>::with_capacity(30));
+    pool.recycle(Vec::<u8>::with_capacity(20));
+    pool.recycle(Vec::<u8>::with_capacity(5));
+
+    let mut capacities: Vec<_> =
+      pool.u8_buffers.iter().map(|b| b.capacity()).collect();
+    capacities.sort();
+
+    assert_eq!(capacities, vec![20, 30]);
+  }
+
+  #[test]
+  fn scope_activates_pool() {
+    let mut pool = FrameBufferPool::default();
+
+    let ptr = pool.scope(|| {
+      let buffer: Vec<i16> = zeroed_vec(100);
+      let ptr = buffer.as_ptr();
+      recycle(buffer);
+
+      // Nested scopes use their own pool
+      FrameBufferPool::default().scope(|| {
+        let buffer: Vec<i16> = zeroed_vec(100);
+        assert_ne!(buffer.as_ptr(), ptr);
+      });
+
+      let buffer: Vec<i16> = vec_with_capacity(100);
+      assert_eq!(buffer.as_ptr(), ptr);
+      recycle(buffer);
+
+      ptr
+    });
+
+    assert_eq!(pool.buffer_count(), 1);
+
+    // Outside of a scope buffers aren't taken from or returned to the pool
+    recycle(zeroed_vec::<i16>(100));
+    let buffer: Vec<i16> = pool.take(100);
+    assert_eq!(buffer.as_ptr(), ptr);
+  }
+
+  #[test]
+  fn large_buffers_are_allocated() {
+    let mut pool = FrameBufferPool::default();
+    pool.set_huge_page_threshold(Some(1024 * 1024));
+
+    let buffer: Vec<u16> = pool.take(4 * 1024 * 1024);
+    assert_eq!(buffer.len(), 4 * 1024 * 1024);
+    assert!(buffer.iter().all(|v| *v == 0));
+  }
+
+  #[test]
+  fn prefaulted_buffers_are_used() {
+    let mut pool = FrameBufferPool::default();
+
+    pool.prefault::<u16>(1000);
+    pool.prefault::<u8>(10);
+
+    let buffer: Vec<u16> = pool.take(1000);
+    assert!(buffer.capacity() >= 1000);
+    assert!(buffer.iter().all(|v| *v == 0));
+    pool.recycle(buffer);
+    assert_eq!(pool.buffer_count(), 1);
+
+    // The u8 buffer is only waited for when it's needed
+    let buffer: Vec<u8> = pool.take(10);
+    assert_eq!(buffer.len(), 10);
+    assert!(pool.prefaulting_buffers.is_empty());
+  }
+}
@@ -9,12 +9,14 @@ use dcmfx_core::{
 };
 
 use crate::{
-  StoredValueOutputCache,
+  StandardColorPalette, StoredValueOutputCache,
   dictionary::SOP_CLASS_UID,
   iods::{
     ModalityLutModule, SoftcopyPresentationLutModule, VoiLutModule,
-    voi_lut_module::VoiWindow,
+    softcopy_presentation_lut_module::PresentationLutShape,
+    voi_lut_module::{VoiLutFunction, VoiWindow},
   },
+  sample_lut::{LutSample, SampleLut},
 };
 
 /// The grayscale pipeline consists of the Modality LUT, the VOI LUT, and the
@@ -46,6 +48,22 @@ pub struct GrayscalePipeline {
   // Internal caches used when the stored value range has <= 2^16 items
   output_cache_u8: RefCell<Option<StoredValueOutputCache<u8>>>,
   output_cache_u16: RefCell<Option<StoredValueOutputCache<u16>>>,
+
+  // Internal cache of the whole pipeline and a color palette compiled into a
+  // single table of RGB colors, which is shared by all frames rendered with
+  // the same sample type and color palette
+  output_lut_rgb_u8: RefCell<Option<OutputLutRgbU8>>,
+}
+
+/// A [`SampleLut`] that maps samples to `u8` RGB colors, along with the inputs
+/// it was built for.
+///
+#[derive(Clone, Debug, PartialEq)]
+struct OutputLutRgbU8 {
+  sample_type: core::any::TypeId,
+  monochrome1_offset: Option<i64>,
+  color_palette: Option<StandardColorPalette>,
+  lut: SampleLut<[u8; 3]>,
 }
 
 impl GrayscalePipeline {
@@ -116,6 +134,7 @@ impl GrayscalePipeline {
 
       output_cache_u8: RefCell::new(None),
       output_cache_u16: RefCell::new(None),
+      output_lut_rgb_u8: RefCell::new(None),
     })
   }
 
@@ -149,6 +168,7 @@ impl GrayscalePipeline {
     // Clear caches
     *self.output_cache_u8.get_mut() = None;
     *self.output_cache_u16.get_mut() = None;
+    *self.output_lut_rgb_u8.get_mut() = None;
   }
 
   /// Takes a stored value from pixel data and passes in through the Modality
@@ -156,39 +176,34 @@ impl GrayscalePipeline {
   /// final Presentation Value (P-Value).
   ///
   pub fn apply(&self, stored_value: i64) -> f32 {
-    let mut x = if self.apply_modality_lut {
-      self.modality_lut_module.apply_to_stored_value(stored_value)
-    } else {
-      stored_value as f32
-    };
-
-    x = if self.voi_lut_module.is_empty() {
-      let start = self.modality_lut_output_range.start();
-      let end = self.modality_lut_output_range.end();
-
-      // Normalize value inside the input range
-      ((x - start) / (end - start)).clamp(0.0, 1.0)
-    } else {
-      self.voi_lut_module.apply(x)
-    };
-
-    self.softcopy_presentation_lut_module.apply(x)
+    self.stages().apply(stored_value)
   }
 
   /// The same as [`Self::apply()`] but the normalized final Presentation Value
   /// (P-Value) is converted to a `u8`.
   ///
   pub fn apply_u8(&self, stored_value: i64) -> u8 {
-    (self.apply(stored_value) * 255.0).round().clamp(0.0, 255.0) as u8
+    self.stages().apply_u8(stored_value)
   }
 
   /// The same as [`Self::apply()`] but the normalized final Presentation Value
   /// (P-Value) is converted to a `u16`.
   ///
   pub fn apply_u16(&self, stored_value: i64) -> u16 {
-    (self.apply(stored_value) * 65535.0)
-      .round()
-      .clamp(0.0, 65535.0) as u16
+    self.stages().apply_u16(stored_value)
+  }
+
+  /// Returns the stages of this grayscale pipeline without its caches, which
+  /// unlike the pipeline itself can be shared between threads.
+  ///
+  pub(crate) fn stages(&self) -> GrayscalePipelineStages<'_> {
+    GrayscalePipelineStages {
+      modality_lut_module: &self.modality_lut_module,
+      modality_lut_output_range: &self.modality_lut_output_range,
+      voi_lut_module: &self.voi_lut_module,
+      softcopy_presentation_lut_module: &self.softcopy_presentation_lut_module,
+      apply_modality_lut: self.apply_modality_lut,
+    }
   }
 
   /// Returns the cache for converting a pixel data stored value into a final
@@ -231,6 +246,137 @@ impl GrayscalePipeline {
     self.output_cache_u16.borrow()
   }
 
+  /// Returns a lookup table that converts samples of type `S` straight to `u8`
+  /// RGB colors by passing them through this grayscale pipeline and then the
+  /// color palette, if one is specified. When `monochrome1_offset` is set, each
+  /// stored value is first inverted by subtracting it from the offset.
+  ///
+  /// The table is built on first use and then reused until the sample type,
+  /// MONOCHROME1 offset, color palette, or VOI window changes.
+  ///
+  pub(crate) fn output_lut_rgb_u8<S: LutSample + 'static>(
+    &self,
+    monochrome1_offset: Option<i64>,
+    color_palette: Option<&StandardColorPalette>,
+  ) -> Option<Ref<'_, SampleLut<[u8; 3]>>> {
+    let sample_type = core::any::TypeId::of::<S>();
+
+    let is_match = |output_lut: &OutputLutRgbU8| {
+      output_lut.sample_type == sample_type
+        && output_lut.monochrome1_offset == monochrome1_offset
+        && output_lut.color_palette.as_ref() == color_palette
+    };
+
+    if let Ok(mut output_lut) = self.output_lut_rgb_u8.try_borrow_mut()
+      && !output_lut.as_ref().is_some_and(is_match)
+    {
+      let output_cache = self.output_cache_u8();
+
+      let lut = SampleLut::new::<S>(|mut stored_value| {
+        if let Some(offset) = monochrome1_offset {
+          stored_value = offset - stored_value;
+        }
+
+        let gray = match &*output_cache {
+          Some(output_cache) => output_cache.get(stored_value),
+          None => self.apply_u8(stored_value),
+        };
+
+        match color_palette {
+          Some(color_palette) => color_palette.lookup(gray),
+          None => [gray, gray, gray],
+        }
+      });
+
+      *output_lut = Some(OutputLutRgbU8 {
+        sample_type,
+        monochrome1_offset,
+        color_palette: color_palette.cloned(),
+        lut,
+      });
+    }
+
+    Ref::filter_map(self.output_lut_rgb_u8.borrow(), |output_lut| {
+      output_lut
+        .as_ref()
+        .filter(|output_lut| is_match(output_lut))
+        .map(|output_lut| &output_lut.lut)
+    })
+    .ok()
+  }
+
+  /// Returns a kernel that applies this grayscale pipeline to whole rows of
+  /// stored values at once. This is only available when none of the pipeline's
+  /// stages use a lookup table, i.e. the Modality LUT is a rescale or identity,
+  /// the VOI LUT is empty or a window, and the Softcopy Presentation LUT is a
+  /// shape.
+  ///
+  /// The kernel's output is identical to that of [`Self::apply_u8()`] and
+  /// [`Self::apply_u16()`].
+  ///
+  pub(crate) fn window_kernel(&self) -> Option<GrayscaleWindowKernel> {
+    let rescale = if self.apply_modality_lut {
+      match self.modality_lut_module {
+        ModalityLutModule::LookupTable { .. } => return None,
+
+        ModalityLutModule::Rescale {
+          rescale_intercept,
+          rescale_slope,
+          ..
+        } => Some((rescale_intercept, rescale_slope)),
+
+        ModalityLutModule::Identity => None,
+      }
+    } else {
+      None
+    };
+
+    let function = if self.voi_lut_module.is_empty() {
+      let start = *self.modality_lut_output_range.start();
+      let end = *self.modality_lut_output_range.end();
+
+      WindowKernelFunction::Normalize {
+        start,
+        size: end - start,
+      }
+    } else if let (None, Some(window)) = (
+      self.voi_lut_module.luts().first(),
+      self.voi_lut_module.windows().first(),
+    ) {
+      let (function, center, one_over_width) = window.compute_parameters();
+
+      match function {
+        VoiLutFunction::Linear | VoiLutFunction::LinearExact => {
+          WindowKernelFunction::Linear {
+            center,
+            one_over_width,
+          }
+        }
+
+        VoiLutFunction::Sigmoid => WindowKernelFunction::Sigmoid {
+          center,
+          one_over_width,
+        },
+      }
+    } else {
+      return None;
+    };
+
+    let invert = match &self.softcopy_presentation_lut_module {
+      SoftcopyPresentationLutModule::LookupTable { .. } => return None,
+
+      SoftcopyPresentationLutModule::Shape { shape } => {
+        *shape == PresentationLutShape::Inverse
+      }
+    };
+
+    Some(GrayscaleWindowKernel {
+      rescale,
+      function,
+      invert,
+    })
+  }
+
   /// Controls whether the stored value range will be cached. Caching only
   /// occurs when the range of stored values has <= 2^16 items.
   ///
@@ -239,6 +385,218 @@ impl GrayscalePipeline {
   }
 }
 
+/// The stages of a [`GrayscalePipeline`], borrowed from it. See
+/// [`GrayscalePipeline::stages()`].
+///
+#[derive(Clone, Copy, Debug)]
+pub(crate) struct GrayscalePipelineStages<'a> {
+  modality_lut_module: &'a ModalityLutModule,
+  modality_lut_output_range: &'a core::ops::RangeInclusive<f32>,
+  voi_lut_module: &'a VoiLutModule,
+  softcopy_presentation_lut_module: &'a SoftcopyPresentationLutModule,
+  apply_modality_lut: bool,
+}
+
+impl GrayscalePipelineStages<'_> {
+  /// See [`GrayscalePipeline::apply()`].
+  ///
+  pub fn apply(&self, stored_value: i64) -> f32 {
+    let mut x = if self.apply_modality_lut {
+      self.modality_lut_module.apply_to_stored_value(stored_value)
+    } else {
+      stored_value as f32
+    };
+
+    x = if self.voi_lut_module.is_empty() {
+      let start = self.modality_lut_output_range.start();
+      let end = self.modality_lut_output_range.end();
+
+      // Normalize value inside the input range
+      ((x - start) / (end - start)).clamp(0.0, 1.0)
+    } else {
+      self.voi_lut_module.apply(x)
+    };
+
+    self.softcopy_presentation_lut_module.apply(x)
+  }
+
+  /// See [`GrayscalePipeline::apply_u8()`].
+  ///
+  pub fn apply_u8(&self, stored_value: i64) -> u8 {
+    (self.apply(stored_value) * 255.0).round().clamp(0.0, 255.0) as u8
+  }
+
+  /// See [`GrayscalePipeline::apply_u16()`].
+  ///
+  pub fn apply_u16(&self, stored_value: i64) -> u16 {
+    (self.apply(stored_value) * 65535.0)
+      .round()
+      .clamp(0.0, 65535.0) as u16
+  }
+}
+
+/// Applies a [`GrayscalePipeline`] that doesn't use any lookup tables to whole
+/// rows of stored values. The pipeline's stages are resolved once up front so
+/// that the per-value work is a short sequence of arithmetic with no branches
+/// or table lookups, which the compiler is able to vectorize.
+///
+/// This is used in place of [`GrayscalePipeline::apply_u8()`] and
+/// [`GrayscalePipeline::apply_u16()`] when the stored value range is too large
+/// to be cached, e.g. for 32-bit data.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub(crate) struct GrayscaleWindowKernel {
+  rescale: Option<(f32, f32)>,
+  function: WindowKernelFunction,
+  invert: bool,
+}
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+enum WindowKernelFunction {
+  Normalize { start: f32, size: f32 },
+  Linear { center: f32, one_over_width: f32 },
+  Sigmoid { center: f32, one_over_width: f32 },
+}
+
+/// An integer type that a [`GrayscaleWindowKernel`] can output Presentation
+/// Values (P-Values) as.
+///
+pub(crate) trait WindowKernelOutput: Copy {
+  /// Converts a normalized P-Value to this type, the same way as
+  /// [`GrayscalePipeline::apply_u8()`] and [`GrayscalePipeline::apply_u16()`].
+  ///
+  fn from_p_value(p: f32) -> Self;
+}
+
+impl WindowKernelOutput for u8 {
+  #[inline(always)]
+  fn from_p_value(p: f32) -> Self {
+    round_non_negative(p * 255.0).clamp(0.0, 255.0) as u8
+  }
+}
+
+impl WindowKernelOutput for u16 {
+  #[inline(always)]
+  fn from_p_value(p: f32) -> Self {
+    round_non_negative(p * 65535.0).clamp(0.0, 65535.0) as u16
+  }
+}
+
+impl GrayscaleWindowKernel {
+  /// Converts input values to Presentation Values (P-Values). Each input value
+  /// is converted to its stored value by `stored_value`.
+  ///
+  pub fn apply<T: Copy, U: WindowKernelOutput>(
+    &self,
+    input: &[T],
+    output: &mut [U],
+    stored_value: impl Fn(T) -> f32,
+  ) {
+    self.apply_rescale(input, output, stored_value, U::from_p_value);
+  }
+
+  // The following functions each resolve one stage of the pipeline outside of
+  // the innermost loop, so that a separate loop is compiled for each
+  // combination of stages.
+
+  #[inline(always)]
+  fn apply_rescale<T: Copy, U>(
+    &self,
+    input: &[T],
+    output: &mut [U],
+    stored_value: impl Fn(T) -> f32,
+    narrow: impl Fn(f32) -> U,
+  ) {
+    match self.rescale {
+      Some((intercept, slope)) => self.apply_function(
+        input,
+        output,
+        |v| intercept + slope * stored_value(v),
+        narrow,
+      ),
+
+      None => self.apply_function(input, output, stored_value, narrow),
+    }
+  }
+
+  #[inline(always)]
+  fn apply_function<T: Copy, U>(
+    &self,
+    input: &[T],
+    output: &mut [U],
+    modality_value: impl Fn(T) -> f32,
+    narrow: impl Fn(f32) -> U,
+  ) {
+    match self.function {
+      WindowKernelFunction::Normalize { start, size } => self
+        .apply_presentation(
+          input,
+          output,
+          |v| ((modality_value(v) - start) / size).clamp(0.0, 1.0),
+          narrow,
+        ),
+
+      WindowKernelFunction::Linear {
+        center,
+        one_over_width,
+      } => self.apply_presentation(
+        input,
+        output,
+        |v| {
+          (0.5 + (modality_value(v) - center) * one_over_width).clamp(0.0, 1.0)
+        },
+        narrow,
+      ),
+
+      WindowKernelFunction::Sigmoid {
+        center,
+        one_over_width,
+      } => self.apply_presentation(
+        input,
+        output,
+        |v| {
+          let x = modality_value(v) - center;
+          1.0 / (1.0 + f32::exp(-4.0 * x * one_over_width))
+        },
+        narrow,
+      ),
+    }
+  }
+
+  #[inline(always)]
+  fn apply_presentation<T: Copy, U>(
+    &self,
+    input: &[T],
+    output: &mut [U],
+    voi_value: impl Fn(T) -> f32,
+    narrow: impl Fn(f32) -> U,
+  ) {
+    if self.invert {
+      for (o, v) in output.iter_mut().zip(input) {
+        *o = narrow(1.0 - voi_value(*v));
+      }
+    } else {
+      for (o, v) in output.iter_mut().zip(input) {
+        *o = narrow(voi_value(*v));
+      }
+    }
+  }
+}
+
+/// Rounds half away from zero, the same as [`f32::round()`], for values that
+/// are non-negative. Negative values round towards zero, which doesn't affect
+/// the result once clamped to an unsigned range.
+///
+/// Unlike [`f32::round()`] this doesn't need a call into libm on targets
+/// without a rounding instruction, which allows it to be vectorized.
+///
+#[inline(always)]
+fn round_non_negative(x: f32) -> f32 {
+  let t = (x as i32) as f32;
+
+  if x - t >= 0.5 { t + 1.0 } else { t }
+}
+
 #[cfg(test)]
 mod tests {
   use super::*;
@@ -307,4 +665,70 @@ mod tests {
     assert_eq!(pipeline.apply(50), 0.5);
     assert_eq!(pipeline.apply(0), 1.0);
   }
+
+  #[test]
+  fn test_window_kernel_matches_apply() {
+    let stored_values: Vec<i64> = (-70000..70000)
+      .step_by(7)
+      .chain([i64::from(i32::MIN), i64::from(i32::MAX), u32::MAX.into()])
+      .collect();
+
+    let voi_lut_functions =
+      [None, Some("LINEAR"), Some("LINEAR_EXACT"), Some("SIGMOID")];
+
+    for rescale in [None, Some((-1024.0, 1.0)), Some((0.5, 0.37))] {
+      for voi_lut_function in voi_lut_functions {
+        for presentation_lut_shape in ["IDENTITY", "INVERSE"] {
+          let mut data_set = DataSet::new();
+
+          if let Some((intercept, slope)) = rescale {
+            data_set
+              .insert_float_value(&RESCALE_INTERCEPT, &[intercept])
+              .unwrap();
+            data_set
+              .insert_float_value(&RESCALE_SLOPE, &[slope])
+              .unwrap();
+          }
+
+          if let Some(voi_lut_function) = voi_lut_function {
+            data_set
+              .insert_float_value(&WINDOW_CENTER, &[40.0])
+              .unwrap();
+            data_set
+              .insert_float_value(&WINDOW_WIDTH, &[400.0])
+              .unwrap();
+            data_set
+              .insert_string_value(&VOILUT_FUNCTION, &[voi_lut_function])
+              .unwrap();
+          }
+
+          data_set
+            .insert_string_value(
+              &PRESENTATION_LUT_SHAPE,
+              &[presentation_lut_shape],
+            )
+            .unwrap();
+
+          let pipeline = GrayscalePipeline::from_data_set(
+            &data_set,
+            i64::from(i32::MIN)..=u32::MAX.into(),
+          )
+          .unwrap();
+
+          let kernel = pipeline.window_kernel().unwrap();
+
+          let mut output_u8 = vec![0u8; stored_values.len()];
+          kernel.apply(&stored_values, &mut output_u8, |v| v as f32);
+
+          let mut output_u16 = vec![0u16; stored_values.len()];
+          kernel.apply(&stored_values, &mut output_u16, |v| v as f32);
+
+          for (i, stored_value) in stored_values.iter().enumerate() {
+            assert_eq!(output_u8[i], pipeline.apply_u8(*stored_value));
+            assert_eq!(output_u16[i], pipeline.apply_u16(*stored_value));
+          }
+        }
+      }
+    }
+  }
 }
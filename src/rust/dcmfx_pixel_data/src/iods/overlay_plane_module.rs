@@ -5,6 +5,7 @@ use dcmfx_core::{
   DataElementTag, DataError, DataSet, DataSetPath, IodModule, RcByteSlice,
   ValueRepresentation, dictionary,
 };
+use num_traits::AsPrimitive;
 
 /// The attributes of the Overlay Plane Module, which describe a set of overlays
 /// where each overlay is a bitmap that can be rendered on top of pixel data.
@@ -146,6 +147,30 @@ impl OverlayPlaneModule {
     Ok(())
   }
 
+  /// Renders all overlays onto an RGB 8-bit image using the default overlay
+  /// colors, where the image's top left pixel is at the given offset from the
+  /// top left of the frame.
+  ///
+  pub(crate) fn render_to_rgb8_image_with_offset(
+    &self,
+    rgb_image: &mut image::RgbImage,
+    frame_index: usize,
+    offset: [i32; 2],
+  ) {
+    let (width, height) = rgb_image.dimensions();
+
+    for (overlay, color) in self.iter().zip(Self::DEFAULT_COLORS) {
+      overlay.render_to_rgb_image_with_offset(
+        width,
+        height,
+        rgb_image.as_mut(),
+        frame_index,
+        color,
+        offset,
+      );
+    }
+  }
+
   /// The default set of colors used to render overlays. The maximum number of
   /// overlays allowed is 16.
   ///
@@ -336,7 +361,40 @@ impl OverlayPlane {
     frame_index: usize,
     color: image::Rgb<T>,
   ) where
-    T: Copy + Into<f64> + num_traits::FromPrimitive,
+    T: Copy + AsPrimitive<u32>,
+    u32: AsPrimitive<T>,
+  {
+    self.render_to_rgb_image_with_offset(
+      width,
+      height,
+      rgb_data,
+      frame_index,
+      color,
+      [0, 0],
+    );
+  }
+
+  /// Renders this overlay onto an RGB image using the specified color, where
+  /// the RGB image's top left pixel is at the given offset from the top left
+  /// of the frame, e.g. because only part of the frame was decoded.
+  ///
+  /// The overlay is rendered a row at a time. Each overlay row is unpacked
+  /// from its 1-bit data into a mask, the masks are combined into the opacity
+  /// of each pixel in the row, and the row is then blended with the overlay
+  /// color in a single pass. These loops are written so the compiler
+  /// vectorizes them.
+  ///
+  pub(crate) fn render_to_rgb_image_with_offset<T>(
+    &self,
+    width: u32,
+    height: u32,
+    rgb_data: &mut [T],
+    frame_index: usize,
+    color: image::Rgb<T>,
+    offset: [i32; 2],
+  ) where
+    T: Copy + AsPrimitive<u32>,
+    u32: AsPrimitive<T>,
   {
     // Check whether there is overlay data for this frame based on its index
     if (frame_index + 1) < self.image_frame_origin
@@ -346,74 +404,176 @@ impl OverlayPlane {
       return;
     }
 
+    let width = width as usize;
+    let height = height as usize;
+    let overlay_columns = usize::from(self.overlay_columns);
+
     // Get the data for this frame
     let overlay_data_offset = usize::from(self.overlay_rows)
-      * usize::from(self.overlay_columns)
+      * overlay_columns
       * ((frame_index + 1) - self.image_frame_origin);
 
+    // The position in the image of the overlay's top left pixel
+    let origin_x = i64::from(self.overlay_origin[0] - 1 - offset[0]);
+    let origin_y = i64::from(self.overlay_origin[1] - 1 - offset[1]);
+
+    // The columns and rows of the image that the overlay covers
+    let left = origin_x.clamp(0, width as i64) as usize;
+    let right =
+      (origin_x + overlay_columns as i64).clamp(0, width as i64) as usize;
+    let top = origin_y.clamp(0, height as i64) as usize;
+    let bottom = (origin_y + i64::from(self.overlay_rows))
+      .clamp(0, height as i64) as usize;
+
+    if left >= right || top >= bottom {
+      return;
+    }
+
+    // Masks for the overlay in three consecutive image rows, held in a ring.
+    // Each has a zero on either side so that the 3x3 kernel below can read one
+    // pixel past either edge of the image.
+    let mask_size = width + 2;
+    let mut masks = vec![0u8; mask_size * 3];
+    let mut mask_is_set = [false; 3];
+
+    let unpack_mask_row = |y: usize, masks: &mut [u8], is_set: &mut bool| {
+      let mask = &mut masks[(y % 3) * mask_size..][..mask_size];
+      mask.fill(0);
+
+      *is_set = y >= top && y < bottom;
+      if *is_set {
+        let bit_offset = overlay_data_offset
+          + (y as i64 - origin_y) as usize * overlay_columns
+          + (left as i64 - origin_x) as usize;
+
+        unpack_bits(
+          &self.overlay_data,
+          bit_offset,
+          &mut mask[1 + left..][..right - left],
+        );
+      }
+    };
+
     // Alphas that apply some blurring over a 3x3 area where the overlay is
-    // present to make it have a less blocky appearance
-    let alphas = [
-      1.0 / 8.0,
-      1.0 / 4.0,
-      1.0 / 8.0,
-      1.0 / 4.0,
-      1.0,
-      1.0 / 4.0,
-      1.0 / 8.0,
-      1.0 / 4.0,
-      1.0 / 8.0,
+    // present to make it have a less blocky appearance. Blending the same
+    // color repeatedly multiplies the transparencies, so each pixel's
+    // transparency is the product of one minus the alphas of the set pixels
+    // around it.
+    let alphas: [[f32; 3]; 3] = [
+      [1.0 / 8.0, 1.0 / 4.0, 1.0 / 8.0],
+      [1.0 / 4.0, 1.0, 1.0 / 4.0],
+      [1.0 / 8.0, 1.0 / 4.0, 1.0 / 8.0],
     ];
 
-    for y in 0..self.overlay_rows {
-      let pt_y = self.overlay_origin[1] + i32::from(y) - 1;
-      if pt_y < 0 || pt_y as u32 >= height {
+    let color: [u32; 3] = color.0.map(|c| c.as_());
+    let mut transparencies = vec![0f32; width];
+
+    // Pixels in the first row and column of the image aren't drawn to
+    let first_row = top.saturating_sub(1).max(1);
+    let last_row = (bottom + 1).min(height);
+
+    unpack_mask_row(
+      first_row - 1,
+      &mut masks,
+      &mut mask_is_set[(first_row - 1) % 3],
+    );
+    unpack_mask_row(first_row, &mut masks, &mut mask_is_set[first_row % 3]);
+
+    for y in first_row..last_row {
+      unpack_mask_row(y + 1, &mut masks, &mut mask_is_set[(y + 1) % 3]);
+
+      // Skip rows that have no overlay pixels near them
+      if mask_is_set == [false; 3] {
         continue;
       }
 
-      for x in 0..self.overlay_columns {
-        let pt_x = self.overlay_origin[0] + i32::from(x) - 1;
-        if pt_x < 0 || pt_x as u32 >= width {
-          continue;
-        }
+      transparencies.fill(1.0);
 
-        // Check whether this pixel in the overlay bitmap is set
-        let data_offset = overlay_data_offset
-          + usize::from(y) * usize::from(self.overlay_columns)
-          + usize::from(x);
-        let byte = self.overlay_data[data_offset / 8];
-        if (byte >> (data_offset % 8)) & 1 == 0 {
+      for (dy, alphas) in alphas.iter().enumerate() {
+        let source_y = y + dy - 1;
+        if !mask_is_set[source_y % 3] {
           continue;
         }
 
-        // This pixel is set in the overlay so draw it into the RGB image. Use
-        // a 3x3 kernel to achieve a smoothed result.
-        for (i, alpha) in alphas.iter().enumerate() {
-          let pixel_x = pt_x + i as i32 % 3 - 1;
-          let pixel_y = pt_y + i as i32 / 3 - 1;
+        let mask = &masks[(source_y % 3) * mask_size..][..mask_size];
 
-          if pixel_x > 0
-            && pixel_x < width as i32
-            && pixel_y > 0
-            && pixel_y < height as i32
+        for (dx, alpha) in alphas.iter().enumerate() {
+          for (transparency, m) in
+            transparencies.iter_mut().zip(&mask[2 - dx..][..width])
           {
-            let offset =
-              (pixel_y as usize * width as usize + pixel_x as usize) * 3;
-            let rgb = &mut rgb_data[offset..(offset + 3)];
+            *transparency *= 1.0 - alpha * f32::from(*m);
+          }
+        }
+      }
 
-            for (i, c) in rgb.iter_mut().enumerate() {
-              let a = Into::<f64>::into(color.0[i]);
-              let b = Into::<f64>::into(*c);
+      // Blend the overlay color into this row of the image using 8-bit fixed
+      // point transparencies
+      let row = &mut rgb_data[y * width * 3..][..width * 3];
 
-              *c = T::from_f64(a * alpha + b * (1.0 - alpha)).unwrap();
-            }
-          }
+      for (pixel, transparency) in row.as_chunks_mut::<3>().0[1..]
+        .iter_mut()
+        .zip(&transparencies[1..])
+      {
+        let t = (transparency * 256.0) as u32;
+
+        for (c, overlay) in pixel.iter_mut().zip(color) {
+          *c = ((overlay * (256 - t) + (*c).as_() * t) >> 8).as_();
         }
       }
     }
   }
 }
 
+/// Unpacks bits of overlay data, least significant bit first, into a mask that
+/// holds one for each set bit and zero for each clear bit. `bit_offset` is the
+/// index of the first bit to unpack.
+///
+fn unpack_bits(data: &[u8], bit_offset: usize, mask: &mut [u8]) {
+  // Unpack single bits until the next bit is at the start of a byte
+  let leading_count = ((8 - bit_offset % 8) % 8).min(mask.len());
+  let (leading, mask) = mask.split_at_mut(leading_count);
+
+  for (i, m) in leading.iter_mut().enumerate() {
+    let bit = bit_offset + i;
+    *m = (data[bit / 8] >> (bit % 8)) & 1;
+  }
+
+  // Unpack whole bytes into eight mask values at a time
+  let data = &data[(bit_offset + leading_count) / 8..];
+  let (chunks, trailing) = mask.as_chunks_mut::<8>();
+
+  for (chunk, byte) in chunks.iter_mut().zip(data) {
+    *chunk = BIT_MASKS[usize::from(*byte)].to_le_bytes();
+  }
+
+  // Unpack the remaining bits
+  if let Some(byte) = data.get(chunks.len()) {
+    for (i, m) in trailing.iter_mut().enumerate() {
+      *m = (byte >> i) & 1;
+    }
+  }
+}
+
+/// The mask values for each possible byte of overlay data, where byte `i` of
+/// each entry is the value of bit `i`.
+///
+const BIT_MASKS: [u64; 256] = {
+  let mut table = [0u64; 256];
+
+  let mut i = 0;
+  while i < 256 {
+    let mut bit = 0;
+    while bit < 8 {
+      table[i] |= ((i as u64 >> bit) & 1) << (bit * 8);
+      bit += 1;
+    }
+
+    i += 1;
+  }
+
+  table
+};
+
 /// Specifies the type of an overlay.
 ///
 /// Ref: PS3.3 C.9.2.1.1
@@ -487,3 +647,26 @@ impl OverlaySubtype {
     }
   }
 }
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn unpack_bits_test() {
+    let data = [0b1010_0110, 0b1111_0000, 0b0101_1100, 0b1000_0001];
+
+    for bit_offset in 0..12 {
+      for count in 0..=(32 - bit_offset) {
+        let mut mask = vec![0xFF; count];
+        unpack_bits(&data, bit_offset, &mut mask);
+
+        let expected: Vec<u8> = (bit_offset..bit_offset + count)
+          .map(|bit| (data[bit / 8] >> (bit % 8)) & 1)
+          .collect();
+
+        assert_eq!(mask, expected);
+      }
+    }
+  }
+}
@@ -244,6 +244,14 @@ impl VoiWindow {
     }
   }
 
+  /// Returns the function, precomputed center, and precomputed one over the
+  /// width that [`Self::compute()`] uses, for use by windowing kernels that
+  /// process many values at once.
+  ///
+  pub(crate) fn compute_parameters(&self) -> (VoiLutFunction, f32, f32) {
+    (self.function, self.center, self.one_over_width)
+  }
+
   /// Applies this VOI window to an input value, into an output range of 0-1.
   ///
   pub fn compute(&self, x: f32) -> f32 {
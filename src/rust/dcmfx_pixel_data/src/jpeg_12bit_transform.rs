@@ -0,0 +1,172 @@
+//! Lossless crops, flips, and rotations of 12-bit JPEG data, as used by the
+//! 'JPEG Extended (Process 2 & 4)' transfer syntax. These rearrange the JPEG's
+//! DCT coefficients rather than decoding and re-encoding it, so they are fast
+//! and add no further loss.
+
+#[cfg(not(feature = "std"))]
+use alloc::{string::ToString, vec, vec::Vec};
+
+use crate::{PixelDataEncodeError, transforms::CropRect};
+
+/// A lossless transform of 12-bit JPEG data, applied after any crop.
+///
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub enum Jpeg12BitTransform {
+  /// No transform, only the crop is applied.
+  #[default]
+  None,
+
+  /// Mirrors the image left to right.
+  FlipHorizontal,
+
+  /// Mirrors the image top to bottom.
+  FlipVertical,
+
+  /// Mirrors the image across its top-left to bottom-right diagonal.
+  Transpose,
+
+  /// Mirrors the image across its top-right to bottom-left diagonal.
+  Transverse,
+
+  /// Rotates the image 90 degrees clockwise.
+  Rotate90,
+
+  /// Rotates the image 180 degrees.
+  Rotate180,
+
+  /// Rotates the image 270 degrees clockwise.
+  Rotate270,
+}
+
+/// Crops and then transforms 12-bit JPEG data by operating directly on its DCT
+/// coefficients, and returns the resulting JPEG data. `columns` and `rows` are
+/// the dimensions of the JPEG image, and are used to resolve the crop rect.
+///
+/// The top-left corner of the crop must lie on an iMCU boundary, which is a
+/// multiple of 8 or 16 pixels depending on the JPEG's chroma subsampling. For a
+/// transform that flips an axis, which includes all the rotations, the crop
+/// must also be a whole number of iMCUs along that axis. An error is returned
+/// if the crop doesn't meet these requirements.
+///
+/// Transforms that transpose the image also swap its chroma subsampling, e.g.
+/// horizontally subsampled chroma becomes vertically subsampled, which can't be
+/// stored with the `YBR_FULL_422` photometric interpretation.
+///
+pub fn transform_jpeg_12bit(
+  jpeg_data: &[u8],
+  columns: u16,
+  rows: u16,
+  crop_rect: &CropRect,
+  transform: Jpeg12BitTransform,
+) -> Result<Vec<u8>, PixelDataEncodeError> {
+  let (crop_height, crop_width) = crop_rect.apply(rows, columns);
+
+  let mut output_chunks: Vec<Vec<u8>> = vec![];
+  let mut error_buffer = [0 as core::ffi::c_char; 256];
+
+  let result = unsafe {
+    ffi::libjpeg_12bit_transform(
+      jpeg_data.as_ptr(),
+      jpeg_data.len(),
+      crop_rect.left.into(),
+      crop_rect.top.into(),
+      crop_width.into(),
+      crop_height.into(),
+      transform as usize,
+      output_chunk_callback,
+      &mut output_chunks as *mut Vec<Vec<u8>> as *mut core::ffi::c_void,
+      error_buffer.as_mut_ptr(),
+    )
+  };
+
+  if result != 0 {
+    let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
+      .to_str()
+      .unwrap_or("<invalid error>");
+
+    return Err(PixelDataEncodeError::OtherError {
+      name: "libjpeg_12bit transform failed".to_string(),
+      details: error.to_string(),
+    });
+  }
+
+  // The first chunk is sized to the input JPEG so the output is almost always
+  // in a single chunk that can be returned without copying
+  if output_chunks.len() == 1 {
+    Ok(output_chunks.pop().unwrap())
+  } else {
+    Ok(output_chunks.concat())
+  }
+}
+
+/// This function is passed as a callback to
+/// [`ffi::libjpeg_12bit_transform()`]. Each call sets the number of bytes
+/// libjpeg_12bit wrote into the most recent chunk, and then adds a new chunk
+/// with the requested capacity and returns a pointer to it. A capacity of zero
+/// means the output is complete.
+///
+extern "C" fn output_chunk_callback(
+  chunk_size: usize,
+  next_chunk_capacity: usize,
+  context: *mut core::ffi::c_void,
+) -> *mut core::ffi::c_void {
+  unsafe {
+    let output_chunks = &mut *(context as *mut Vec<Vec<u8>>);
+
+    // libjpeg_12bit has initialized the first `chunk_size` bytes of the last
+    // chunk
+    if let Some(chunk) = output_chunks.last_mut() {
+      chunk.set_len(chunk_size);
+    }
+
+    if next_chunk_capacity == 0 {
+      return core::ptr::null_mut();
+    }
+
+    let mut chunk = Vec::with_capacity(next_chunk_capacity);
+    let chunk_ptr = chunk.as_mut_ptr();
+    output_chunks.push(chunk);
+
+    chunk_ptr as *mut core::ffi::c_void
+  }
+}
+
+mod ffi {
+  unsafe extern "C" {
+    pub fn libjpeg_12bit_transform(
+      data: *const u8,
+      data_size: usize,
+      crop_left: usize,
+      crop_top: usize,
+      crop_width: usize,
+      crop_height: usize,
+      transform: usize,
+      output_chunk_callback: extern "C" fn(
+        usize,
+        usize,
+        *mut core::ffi::c_void,
+      ) -> *mut core::ffi::c_void,
+      output_chunk_context: *mut core::ffi::c_void,
+      error_message: *mut core::ffi::c_char,
+    ) -> usize;
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn reject_invalid_data() {
+    assert!(
+      transform_jpeg_12bit(
+        &[0xFF, 0xD8, 0xFF, 0xD9],
+        16,
+        16,
+        &CropRect::default(),
+        Jpeg12BitTransform::None
+      )
+      .is_err()
+    );
+  }
+}
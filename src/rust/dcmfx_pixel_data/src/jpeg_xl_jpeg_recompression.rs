@@ -1,29 +1,38 @@
-#[cfg(not(feature = "std"))]
-use alloc::{string::ToString, vec::Vec};
+//! Lossless recompression of JPEG Baseline 8-bit data into JPEG XL, and
+//! reconstruction of the original JPEG data from the JPEG XL data.
 
-use crate::PixelDataEncodeError;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+use crate::{PixelDataEncodeError, libjxl_thread_pool::with_parallel_runner};
 
 /// Recompresses JPEG Baseline 8-bit data into JPEG XL data such that the
 /// original JPEG is exactly preserved but is smaller in size. This is much
 /// faster than a full recompression into JPEG XL and avoids a reduction in
 /// image quality whilst also reducing size.
 ///
+/// `thread_count` is the number of threads libjxl uses for the frame, where
+/// zero uses all available cores and one disables multithreading.
+///
 pub fn recompress_jpeg_to_jpeg_xl(
   jpeg_data: &[u8],
+  thread_count: usize,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
-  let mut output_data = Vec::with_capacity(jpeg_data.len());
+  let mut output_chunks: Vec<Vec<u8>> = vec![];
   let mut error_buffer = [0 as ::core::ffi::c_char; 256];
 
-  let result = unsafe {
+  let result = with_parallel_runner(|runner, runner_opaque| unsafe {
     ffi::libjxl_recompress_jpeg(
       jpeg_data.as_ptr() as *const core::ffi::c_void,
       jpeg_data.len(),
-      output_data_callback,
-      &mut output_data as *mut Vec<u8> as *mut core::ffi::c_void,
+      thread_count,
+      runner,
+      runner_opaque,
+      output_chunk_callback,
+      &mut output_chunks as *mut Vec<Vec<u8>> as *mut core::ffi::c_void,
       error_buffer.as_mut_ptr(),
       error_buffer.len(),
     )
-  };
+  });
 
   if result != 0 {
     let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
@@ -36,28 +45,42 @@ pub fn recompress_jpeg_to_jpeg_xl(
     });
   }
 
-  Ok(output_data)
+  // The first chunk is sized to the input JPEG so the output is almost always
+  // in a single chunk that can be returned without copying
+  if output_chunks.len() == 1 {
+    Ok(output_chunks.pop().unwrap())
+  } else {
+    Ok(output_chunks.concat())
+  }
 }
 
 /// Reconstructs the original JPEG data from the recompressed data in JPEG XL.
+/// The JPEG bitstream is rebuilt exactly from the data stored in the JPEG XL
+/// container, without decoding pixels or re-encoding them as JPEG.
+///
+/// `thread_count` has the same meaning as for
+/// [`recompress_jpeg_to_jpeg_xl()`].
 ///
 pub fn reconstruct_jpeg_from_jpeg_xl(
   jpeg_xl_data: &[u8],
+  thread_count: usize,
 ) -> Result<Vec<u8>, PixelDataEncodeError> {
-  let mut output_data =
-    Vec::with_capacity(jpeg_xl_data.len() + jpeg_xl_data.len() / 3);
+  let mut output_chunks: Vec<Vec<u8>> = vec![];
   let mut error_buffer = [0 as ::core::ffi::c_char; 256];
 
-  let result = unsafe {
+  let result = with_parallel_runner(|runner, runner_opaque| unsafe {
     ffi::libjxl_reconstruct_jpeg(
       jpeg_xl_data.as_ptr() as *const core::ffi::c_void,
       jpeg_xl_data.len(),
-      output_data_callback,
-      &mut output_data as *mut Vec<u8> as *mut core::ffi::c_void,
+      thread_count,
+      runner,
+      runner_opaque,
+      output_chunk_callback,
+      &mut output_chunks as *mut Vec<Vec<u8>> as *mut core::ffi::c_void,
       error_buffer.as_mut_ptr(),
       error_buffer.len(),
     )
-  };
+  });
 
   if result != 0 {
     let error = unsafe { core::ffi::CStr::from_ptr(error_buffer.as_ptr()) }
@@ -70,31 +93,145 @@ pub fn reconstruct_jpeg_from_jpeg_xl(
     });
   }
 
-  Ok(output_data)
+  // The first chunk is sized so that the reconstructed JPEG almost always fits
+  // in it, in which case it's returned without copying
+  if output_chunks.len() == 1 {
+    Ok(output_chunks.pop().unwrap())
+  } else {
+    Ok(output_chunks.concat())
+  }
+}
+
+/// Recompresses a batch of JPEG Baseline 8-bit frames into JPEG XL using
+/// [`recompress_jpeg_to_jpeg_xl()`]. Frames are recompressed concurrently, and
+/// the libjxl encoders are reused between frames rather than being created
+/// afresh for each one. The results are returned in the same order as the
+/// input frames.
+///
+/// `thread_count` is the total number of threads to use across the batch,
+/// where zero uses all available cores.
+///
+pub fn recompress_jpegs_to_jpeg_xl(
+  jpeg_frames: &[&[u8]],
+  thread_count: usize,
+) -> Vec<Result<Vec<u8>, PixelDataEncodeError>> {
+  run_batch(jpeg_frames, thread_count, recompress_jpeg_to_jpeg_xl)
 }
 
-extern "C" fn output_data_callback(
-  new_len: usize,
+/// Reconstructs the original JPEG data for a batch of frames recompressed into
+/// JPEG XL using [`reconstruct_jpeg_from_jpeg_xl()`]. Frames are reconstructed
+/// concurrently and the results are returned in the same order as the input
+/// frames.
+///
+/// `thread_count` has the same meaning as for
+/// [`recompress_jpegs_to_jpeg_xl()`].
+///
+pub fn reconstruct_jpegs_from_jpeg_xl(
+  jpeg_xl_frames: &[&[u8]],
+  thread_count: usize,
+) -> Vec<Result<Vec<u8>, PixelDataEncodeError>> {
+  run_batch(jpeg_xl_frames, thread_count, reconstruct_jpeg_from_jpeg_xl)
+}
+
+/// Runs `f` on each of the given frames using a set of worker threads that
+/// each pull the next unprocessed frame. The available threads are split
+/// between the workers and the libjxl parallel runner used inside each frame.
+///
+fn run_batch(
+  frames: &[&[u8]],
+  thread_count: usize,
+  f: fn(&[u8], usize) -> Result<Vec<u8>, PixelDataEncodeError>,
+) -> Vec<Result<Vec<u8>, PixelDataEncodeError>> {
+  let total_threads = if thread_count == 0 {
+    std::thread::available_parallelism().map_or(1, |n| n.get())
+  } else {
+    thread_count
+  };
+
+  let worker_count = total_threads.min(frames.len());
+  if worker_count <= 1 {
+    return frames.iter().map(|frame| f(frame, total_threads)).collect();
+  }
+
+  let frame_thread_count = (total_threads / worker_count).max(1);
+  let next_frame = AtomicUsize::new(0);
+
+  let mut results: Vec<_> = std::thread::scope(|scope| {
+    let workers: Vec<_> = (0..worker_count)
+      .map(|_| {
+        scope.spawn(|| {
+          let mut results = vec![];
+
+          loop {
+            let index = next_frame.fetch_add(1, Ordering::Relaxed);
+            if index >= frames.len() {
+              break;
+            }
+
+            results.push((index, f(frames[index], frame_thread_count)));
+          }
+
+          results
+        })
+      })
+      .collect();
+
+    workers
+      .into_iter()
+      .flat_map(|worker| worker.join().unwrap())
+      .collect()
+  });
+
+  results.sort_unstable_by_key(|(index, _)| *index);
+  results.into_iter().map(|(_, result)| result).collect()
+}
+
+/// Output chunk callback for JPEG recompression and reconstruction. Each call
+/// sets the number of bytes libjxl wrote into the most recent chunk, and then
+/// adds a new chunk with the requested capacity and returns a pointer to it. A
+/// capacity of zero means the output is complete.
+///
+extern "C" fn output_chunk_callback(
+  chunk_size: usize,
+  next_chunk_capacity: usize,
   context: *mut core::ffi::c_void,
 ) -> *mut core::ffi::c_void {
   unsafe {
-    let output_data = &mut *(context as *mut Vec<u8>);
+    let output_chunks = &mut *(context as *mut Vec<Vec<u8>>);
+
+    // libjxl has initialized the first `chunk_size` bytes of the last chunk
+    if let Some(chunk) = output_chunks.last_mut() {
+      chunk.set_len(chunk_size);
+    }
+
+    if next_chunk_capacity == 0 {
+      return core::ptr::null_mut();
+    }
 
-    output_data.resize(new_len, 0);
-    output_data.as_mut_ptr() as *mut core::ffi::c_void
+    let mut chunk = Vec::with_capacity(next_chunk_capacity);
+    let chunk_ptr = chunk.as_mut_ptr();
+    output_chunks.push(chunk);
+
+    chunk_ptr as *mut core::ffi::c_void
   }
 }
 
 mod ffi {
+  use crate::libjxl_thread_pool::ffi::JxlParallelRunner;
+
   unsafe extern "C" {
     pub fn libjxl_recompress_jpeg(
       jpeg_data: *const core::ffi::c_void,
       jpeg_data_size: usize,
-      output_data_callback: extern "C" fn(
+      thread_count: usize,
+      custom_runner: Option<JxlParallelRunner>,
+      custom_runner_opaque: *mut core::ffi::c_void,
+      output_chunk_callback: extern "C" fn(
+        usize,
         usize,
         *mut core::ffi::c_void,
       ) -> *mut core::ffi::c_void,
-      output_data_context: *mut core::ffi::c_void,
+      output_chunk_context: *mut core::ffi::c_void,
       error_buffer: *const core::ffi::c_char,
       error_buffer_size: usize,
     ) -> usize;
@@ -102,13 +239,33 @@ mod ffi {
     pub fn libjxl_reconstruct_jpeg(
       jpeg_xl_data: *const core::ffi::c_void,
       jpeg_xl_data_size: usize,
-      output_data_callback: extern "C" fn(
+      thread_count: usize,
+      custom_runner: Option<JxlParallelRunner>,
+      custom_runner_opaque: *mut core::ffi::c_void,
+      output_chunk_callback: extern "C" fn(
+        usize,
         usize,
         *mut core::ffi::c_void,
       ) -> *mut core::ffi::c_void,
-      output_data_context: *mut core::ffi::c_void,
+      output_chunk_context: *mut core::ffi::c_void,
       error_buffer: *const core::ffi::c_char,
       error_buffer_size: usize,
     ) -> usize;
   }
 }
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn recompress_batch_returns_results_in_order() {
+    assert!(recompress_jpegs_to_jpeg_xl(&[], 0).is_empty());
+
+    let frames: Vec<&[u8]> = vec![&[0, 1, 2], &[], &[3, 4], &[5]];
+    let results = recompress_jpegs_to_jpeg_xl(&frames, 4);
+
+    assert_eq!(results.len(), frames.len());
+    assert!(results.iter().all(|result| result.is_err()));
+  }
+}
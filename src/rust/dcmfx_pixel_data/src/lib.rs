@@ -11,32 +11,97 @@ use alloc::{vec, vec::Vec};
 #[cfg(not(feature = "std"))]
 mod no_std_allocator;
 
+mod byte_planes;
+#[cfg(feature = "std")]
+mod cine_player;
+#[cfg(feature = "native")]
+pub mod codec_allocator;
+#[cfg(feature = "native")]
+pub mod codec_cancellation;
+#[cfg(feature = "std")]
+pub mod codec_stats;
+mod codec_threads;
 mod color_image;
 pub mod decode;
+mod decoded_frame_cache;
+#[cfg(feature = "std")]
+mod decoded_frame_disk_cache;
 pub mod encode;
+pub mod frame_buffer_pool;
 mod grayscale_pipeline;
 pub mod iods;
+#[cfg(feature = "native")]
+pub mod jpeg_12bit_transform;
 #[cfg(all(feature = "native", feature = "std"))]
-mod jpeg_xl_jpeg_recompression;
+pub mod jpeg_xl_jpeg_recompression;
+#[cfg(all(feature = "native", feature = "std"))]
+pub mod libjxl_thread_pool;
 mod lookup_table;
 mod monochrome_image;
+#[cfg(feature = "std")]
+pub mod numa;
 mod pixel_data_frame;
+mod pixel_data_frame_index;
 mod pixel_data_renderer;
+mod planar_ybr_image;
+mod row_parallel;
+mod sample_lut;
+mod sample_statistics;
+mod sample_unpacking;
+#[cfg(feature = "native")]
+pub mod simd_targets;
 pub mod standard_color_palettes;
 mod stored_value_output_cache;
+#[cfg(feature = "std")]
+pub mod trace_events;
 pub mod transforms;
 mod utils;
-
-pub use color_image::{ColorImage, ColorSpace};
+#[cfg(feature = "std")]
+mod volume_decoder;
+#[cfg(feature = "std")]
+mod whole_slide_image;
+#[cfg(feature = "std")]
+pub mod whole_slide_image_pyramid;
+#[cfg(feature = "parallel")]
+pub mod worker_pool;
+mod ybr_conversion;
+
+#[cfg(feature = "std")]
+pub use cine_player::{
+  CineFrame, CinePlaybackStats, CinePlayer, CinePlayerConfig,
+};
+pub use color_image::{ColorImage, ColorImageData, ColorSpace};
 pub use decode::{PixelDataDecodeConfig, PixelDataDecodeError};
+pub use decoded_frame_cache::{
+  DecodedFrame, DecodedFrameCache, DecodedFrameKey,
+};
+#[cfg(feature = "std")]
+pub use decoded_frame_disk_cache::{DecodedFrameDiskCache, DiskCacheFormat};
+#[cfg(feature = "std")]
+pub use encode::AdaptiveEffort;
 pub use encode::{PixelDataEncodeConfig, PixelDataEncodeError};
+#[cfg(feature = "std")]
+pub use encode::{
+  TransferSyntaxSelection, TransferSyntaxSelectionPolicy, TrialEncodeResult,
+};
+#[cfg(feature = "std")]
+pub use frame_buffer_pool::FrameBufferPool;
 pub use grayscale_pipeline::GrayscalePipeline;
 pub use lookup_table::LookupTable;
 pub use monochrome_image::{MonochromeImage, MonochromeImageData};
 pub use pixel_data_frame::PixelDataFrame;
+pub use pixel_data_frame_index::PixelDataFrameIndex;
 pub use pixel_data_renderer::PixelDataRenderer;
+pub use planar_ybr_image::{PlanarYbrImage, PlanarYbrImageData};
+pub use sample_statistics::{SampleHistogram, SampleStatistics};
 pub use standard_color_palettes::StandardColorPalette;
 pub use stored_value_output_cache::StoredValueOutputCache;
+#[cfg(feature = "std")]
+pub use volume_decoder::{Volume, VolumeDecoder, VolumeSample};
+#[cfg(feature = "std")]
+pub use whole_slide_image::{
+  TileLayout, WholeSlideImage, WholeSlideImageLevel,
+};
 
 use transforms::{
   P10PixelDataFrameTransform, P10PixelDataFrameTransformError,
@@ -0,0 +1,231 @@
+//! Controls the threads used by libjxl when encoding and decoding JPEG XL.
+//!
+//! By default libjxl runs on worker threads that are created the first time
+//! they're needed and then reused by later frames. The number of worker threads
+//! is set by [`crate::PixelDataDecodeConfig::thread_count`] and
+//! [`crate::PixelDataEncodeConfig::thread_count()`].
+//!
+//! Applications that already have a thread pool, e.g. a work-stealing pool,
+//! can have libjxl run on it instead by calling [`set_thread_pool()`]. The
+//! tasks run on such a thread pool are recorded in [`crate::trace_events`].
+
+use std::sync::{Arc, RwLock};
+
+/// A thread pool that libjxl can run its parallel work on.
+///
+pub trait ThreadPool: Send + Sync {
+  /// Returns the number of threads in the pool. All thread IDs passed to tasks
+  /// by [`Self::run()`] must be less than this value.
+  ///
+  fn thread_count(&self) -> usize;
+
+  /// Runs `task` once for every value in `range`, potentially in parallel,
+  /// and returns once they have all completed.
+  ///
+  /// The second argument passed to `task` is the ID of the thread running it.
+  /// Tasks that run at the same time must be given different thread IDs
+  /// because libjxl uses them to index per-thread working memory.
+  ///
+  fn run(
+    &self,
+    range: core::ops::Range<u32>,
+    task: &(dyn Fn(u32, usize) + Sync),
+  );
+}
+
+static THREAD_POOL: RwLock<Option<Arc<dyn ThreadPool>>> = RwLock::new(None);
+
+/// Sets the thread pool that libjxl runs on for all subsequent encodes and
+/// decodes. Passing `None` returns to using libjxl's own worker threads.
+///
+pub fn set_thread_pool(thread_pool: Option<Arc<dyn ThreadPool>>) {
+  *THREAD_POOL.write().unwrap() = thread_pool;
+}
+
+/// Calls `f` with the parallel runner function and opaque pointer to pass to
+/// libjxl. These are null when no thread pool has been set with
+/// [`set_thread_pool()`].
+///
+pub(crate) fn with_parallel_runner<R>(
+  f: impl FnOnce(Option<ffi::JxlParallelRunner>, *mut core::ffi::c_void) -> R,
+) -> R {
+  // Hold a reference to the thread pool for the duration of the call in case
+  // it's replaced concurrently
+  let thread_pool = THREAD_POOL.read().unwrap().clone();
+
+  match &thread_pool {
+    Some(thread_pool) => f(
+      Some(run_on_thread_pool),
+      thread_pool as *const Arc<dyn ThreadPool> as *mut core::ffi::c_void,
+    ),
+    None => f(None, core::ptr::null_mut()),
+  }
+}
+
+/// The parallel runner function and opaque pointer to pass to libjxl for work
+/// that spans several calls into libjxl, e.g. an incremental decode. The thread
+/// pool that was set when this was created is held on to until it's dropped,
+/// so the opaque pointer stays valid even if the thread pool is replaced.
+///
+pub(crate) struct HeldParallelRunner {
+  thread_pool: Option<Box<Arc<dyn ThreadPool>>>,
+}
+
+impl HeldParallelRunner {
+  /// Holds on to the current thread pool, if one has been set with
+  /// [`set_thread_pool()`].
+  ///
+  pub fn new() -> Self {
+    Self {
+      thread_pool: THREAD_POOL.read().unwrap().clone().map(Box::new),
+    }
+  }
+
+  /// Returns the parallel runner function, which is `None` when no thread pool
+  /// has been set.
+  ///
+  pub fn runner(&self) -> Option<ffi::JxlParallelRunner> {
+    self.thread_pool.as_ref().map(|_| run_on_thread_pool as _)
+  }
+
+  /// Returns the opaque pointer to pass along with [`Self::runner()`].
+  ///
+  pub fn opaque(&self) -> *mut core::ffi::c_void {
+    match &self.thread_pool {
+      Some(thread_pool) => {
+        &**thread_pool as *const Arc<dyn ThreadPool> as *mut core::ffi::c_void
+      }
+      None => core::ptr::null_mut(),
+    }
+  }
+}
+
+/// Implements libjxl's `JxlParallelRunner` interface on top of a
+/// [`ThreadPool`].
+///
+unsafe extern "C" fn run_on_thread_pool(
+  runner_opaque: *mut core::ffi::c_void,
+  jpegxl_opaque: *mut core::ffi::c_void,
+  init: ffi::JxlParallelRunInit,
+  func: ffi::JxlParallelRunFunction,
+  start_range: u32,
+  end_range: u32,
+) -> ffi::JxlParallelRetCode {
+  if start_range > end_range {
+    return ffi::JXL_PARALLEL_RET_RUNNER_ERROR;
+  }
+
+  let thread_pool = unsafe { &*(runner_opaque as *const Arc<dyn ThreadPool>) };
+  let thread_count = thread_pool.thread_count().max(1);
+
+  let result = unsafe { init(jpegxl_opaque, thread_count) };
+  if result != ffi::JXL_PARALLEL_RET_SUCCESS {
+    return result;
+  }
+
+  // Raw pointers aren't Sync, so pass libjxl's opaque pointer to the tasks as
+  // an address
+  let jpegxl_opaque = jpegxl_opaque as usize;
+
+  let _span = crate::trace_events::span("libjxl_run")
+    .arg("tasks", end_range - start_range);
+
+  thread_pool.run(start_range..end_range, &|value, thread_id| {
+    let _span = crate::trace_events::span("libjxl_task").arg("value", value);
+
+    unsafe { func(jpegxl_opaque as *mut core::ffi::c_void, value, thread_id) }
+  });
+
+  ffi::JXL_PARALLEL_RET_SUCCESS
+}
+
+pub(crate) mod ffi {
+  pub type JxlParallelRetCode = i32;
+
+  pub const JXL_PARALLEL_RET_SUCCESS: JxlParallelRetCode = 0;
+  pub const JXL_PARALLEL_RET_RUNNER_ERROR: JxlParallelRetCode = -1;
+
+  pub type JxlParallelRunInit = unsafe extern "C" fn(
+    jpegxl_opaque: *mut core::ffi::c_void,
+    num_threads: usize,
+  ) -> JxlParallelRetCode;
+
+  pub type JxlParallelRunFunction = unsafe extern "C" fn(
+    jpegxl_opaque: *mut core::ffi::c_void,
+    value: u32,
+    thread_id: usize,
+  );
+
+  pub type JxlParallelRunner = unsafe extern "C" fn(
+    runner_opaque: *mut core::ffi::c_void,
+    jpegxl_opaque: *mut core::ffi::c_void,
+    init: JxlParallelRunInit,
+    func: JxlParallelRunFunction,
+    start_range: u32,
+    end_range: u32,
+  ) -> JxlParallelRetCode;
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  struct SequentialThreadPool;
+
+  impl ThreadPool for SequentialThreadPool {
+    fn thread_count(&self) -> usize {
+      1
+    }
+
+    fn run(
+      &self,
+      range: core::ops::Range<u32>,
+      task: &(dyn Fn(u32, usize) + Sync),
+    ) {
+      for value in range {
+        task(value, 0);
+      }
+    }
+  }
+
+  #[test]
+  fn test_run_on_thread_pool() {
+    unsafe extern "C" fn init(
+      jpegxl_opaque: *mut core::ffi::c_void,
+      num_threads: usize,
+    ) -> ffi::JxlParallelRetCode {
+      assert_eq!(num_threads, 1);
+
+      unsafe { (*(jpegxl_opaque as *mut Vec<u32>)).clear() };
+
+      ffi::JXL_PARALLEL_RET_SUCCESS
+    }
+
+    unsafe extern "C" fn func(
+      jpegxl_opaque: *mut core::ffi::c_void,
+      value: u32,
+      thread_id: usize,
+    ) {
+      assert_eq!(thread_id, 0);
+
+      unsafe { (*(jpegxl_opaque as *mut Vec<u32>)).push(value) };
+    }
+
+    let thread_pool: Arc<dyn ThreadPool> = Arc::new(SequentialThreadPool);
+    let mut values: Vec<u32> = vec![100];
+
+    let result = unsafe {
+      run_on_thread_pool(
+        &thread_pool as *const Arc<dyn ThreadPool> as *mut core::ffi::c_void,
+        &mut values as *mut Vec<u32> as *mut core::ffi::c_void,
+        init,
+        func,
+        2,
+        6,
+      )
+    };
+
+    assert_eq!(result, ffi::JXL_PARALLEL_RET_SUCCESS);
+    assert_eq!(values, vec![2, 3, 4, 5]);
+  }
+}
@@ -2,11 +2,16 @@
 use alloc::{vec, vec::Vec};
 
 use crate::{
-  GrayscalePipeline,
+  GrayscalePipeline, StandardColorPalette,
+  frame_buffer_pool::{self, PoolElement},
+  grayscale_pipeline::{GrayscaleWindowKernel, WindowKernelOutput},
   iods::{
     image_pixel_module::BitsAllocated,
     voi_lut_module::{VoiLutFunction, VoiWindow},
   },
+  row_parallel::{self, MaybeSend, MaybeSync},
+  sample_lut::LutSample,
+  sample_unpacking,
   transforms::CropRect,
 };
 
@@ -242,6 +247,12 @@ impl MonochromeImage {
     &self.data
   }
 
+  /// Consumes this monochrome image and returns its internal data.
+  ///
+  pub fn into_data(self) -> MonochromeImageData {
+    self.data
+  }
+
   /// Returns the total number of pixels in this monochrome image.
   ///
   pub fn pixel_count(&self) -> usize {
@@ -364,52 +375,79 @@ impl MonochromeImage {
   /// Converts between `MONOCHROME1` and `MONOCHROME2` internal representations.
   ///
   pub fn change_monochrome_representation(&mut self) {
+    self.change_monochrome_representation_with_threads(1);
+  }
+
+  /// The same as [`Self::change_monochrome_representation()`], but bands of
+  /// rows are converted concurrently on up to `thread_count` threads. See
+  /// [`Self::to_gray_u8_image_with_threads()`] for details.
+  ///
+  pub fn change_monochrome_representation_with_threads(
+    &mut self,
+    thread_count: usize,
+  ) {
     self.is_monochrome1 = !self.is_monochrome1;
 
+    let width = usize::from(self.width);
+
     match &mut self.data {
       MonochromeImageData::Bitmap { data, .. } => {
-        for pixel in data.iter_mut() {
-          *pixel = !*pixel;
-        }
+        row_parallel::for_each_band_mut(data, 1, thread_count, |data| {
+          for pixel in data.iter_mut() {
+            *pixel = !*pixel;
+          }
+        });
       }
 
       MonochromeImageData::I8(data) => {
-        for pixel in data.iter_mut() {
-          *pixel = (-isize::from(*pixel) - 1) as i8;
-        }
+        row_parallel::for_each_band_mut(data, width, thread_count, |data| {
+          for pixel in data.iter_mut() {
+            *pixel = (-isize::from(*pixel) - 1) as i8;
+          }
+        });
       }
 
       MonochromeImageData::U8(data) => {
         let offset = (1u16 << self.bits_stored) - 1;
-        for pixel in data.iter_mut() {
-          *pixel = (offset - u16::from(*pixel)) as u8;
-        }
+        row_parallel::for_each_band_mut(data, width, thread_count, |data| {
+          for pixel in data.iter_mut() {
+            *pixel = (offset - u16::from(*pixel)) as u8;
+          }
+        });
       }
 
       MonochromeImageData::I16(data) => {
-        for pixel in data.iter_mut() {
-          *pixel = (-i32::from(*pixel) - 1) as i16;
-        }
+        row_parallel::for_each_band_mut(data, width, thread_count, |data| {
+          for pixel in data.iter_mut() {
+            *pixel = (-i32::from(*pixel) - 1) as i16;
+          }
+        });
       }
 
       MonochromeImageData::U16(data) => {
         let offset = (1u32 << self.bits_stored) - 1;
-        for pixel in data.iter_mut() {
-          *pixel = (offset - u32::from(*pixel)) as u16;
-        }
+        row_parallel::for_each_band_mut(data, width, thread_count, |data| {
+          for pixel in data.iter_mut() {
+            *pixel = (offset - u32::from(*pixel)) as u16;
+          }
+        });
       }
 
       MonochromeImageData::I32(data) => {
-        for pixel in data.iter_mut() {
-          *pixel = (-i64::from(*pixel) - 1) as i32;
-        }
+        row_parallel::for_each_band_mut(data, width, thread_count, |data| {
+          for pixel in data.iter_mut() {
+            *pixel = (-i64::from(*pixel) - 1) as i32;
+          }
+        });
       }
 
       MonochromeImageData::U32(data) => {
         let offset = (1u64 << self.bits_stored) - 1;
-        for pixel in data.iter_mut() {
-          *pixel = (offset - u64::from(*pixel)) as u32;
-        }
+        row_parallel::for_each_band_mut(data, width, thread_count, |data| {
+          for pixel in data.iter_mut() {
+            *pixel = (offset - u64::from(*pixel)) as u32;
+          }
+        });
       }
     }
   }
@@ -417,6 +455,18 @@ impl MonochromeImage {
   /// Crops this monochrome image to the specified rectangle.
   ///
   pub fn crop(&mut self, crop_rect: &CropRect) {
+    self.crop_with_threads(crop_rect, 1);
+  }
+
+  /// The same as [`Self::crop()`], but bands of rows are copied concurrently
+  /// on up to `thread_count` threads. See
+  /// [`Self::to_gray_u8_image_with_threads()`] for details.
+  ///
+  pub fn crop_with_threads(
+    &mut self,
+    crop_rect: &CropRect,
+    thread_count: usize,
+  ) {
     let left = crop_rect.left;
     let top = crop_rect.top;
     let (height, width) = crop_rect.apply(self.height(), self.width());
@@ -426,20 +476,35 @@ impl MonochromeImage {
     }
 
     // Helper for cropping non-bitmap data
-    fn crop<T: Clone>(
+    fn crop<T: Copy + Default + MaybeSend + MaybeSync>(
       data: &mut Vec<T>,
       old_width: u16,
       left: u16,
       top: u16,
       width: u16,
       height: u16,
+      thread_count: usize,
     ) {
-      let mut new_data = Vec::with_capacity(width as usize * height as usize);
-
-      for row in top..top + height {
-        let start = row as usize * old_width as usize + left as usize;
-        let end = start + width as usize;
-        new_data.extend_from_slice(&data[start..end]);
+      let old_width = usize::from(old_width);
+      let width = usize::from(width);
+
+      let mut new_data = vec![T::default(); width * usize::from(height)];
+
+      if !new_data.is_empty() {
+        row_parallel::for_each_band_zip(
+          &data[usize::from(top) * old_width + usize::from(left)..],
+          old_width,
+          &mut new_data,
+          width,
+          thread_count,
+          |data, new_data| {
+            for (row, new_row) in
+              data.chunks(old_width).zip(new_data.chunks_exact_mut(width))
+            {
+              new_row.copy_from_slice(&row[..width]);
+            }
+          },
+        );
       }
 
       *data = new_data;
@@ -467,22 +532,22 @@ impl MonochromeImage {
         *data = new_data;
       }
       MonochromeImageData::I8(data) => {
-        crop(data, self.width, left, top, width, height)
+        crop(data, self.width, left, top, width, height, thread_count)
       }
       MonochromeImageData::U8(data) => {
-        crop(data, self.width, left, top, width, height);
+        crop(data, self.width, left, top, width, height, thread_count);
       }
       MonochromeImageData::I16(data) => {
-        crop(data, self.width, left, top, width, height);
+        crop(data, self.width, left, top, width, height, thread_count);
       }
       MonochromeImageData::U16(data) => {
-        crop(data, self.width, left, top, width, height);
+        crop(data, self.width, left, top, width, height, thread_count);
       }
       MonochromeImageData::I32(data) => {
-        crop(data, self.width, left, top, width, height);
+        crop(data, self.width, left, top, width, height, thread_count);
       }
       MonochromeImageData::U32(data) => {
-        crop(data, self.width, left, top, width, height);
+        crop(data, self.width, left, top, width, height, thread_count);
       }
     }
 
@@ -496,15 +561,39 @@ impl MonochromeImage {
   pub fn to_gray_u8_image(
     &self,
     grayscale_pipeline: &GrayscalePipeline,
+  ) -> image::GrayImage {
+    self.to_gray_u8_image_with_threads(grayscale_pipeline, 1)
+  }
+
+  /// The same as [`Self::to_gray_u8_image()`], but bands of rows are converted
+  /// concurrently on up to `thread_count` threads when the image is large
+  /// enough to benefit. A `thread_count` of zero uses one thread per CPU core.
+  ///
+  /// Threads are only used when the `parallel` feature is enabled.
+  ///
+  pub fn to_gray_u8_image_with_threads(
+    &self,
+    grayscale_pipeline: &GrayscalePipeline,
+    thread_count: usize,
   ) -> image::GrayImage {
     match &*grayscale_pipeline.output_cache_u8() {
-      Some(cache) => {
-        self.to_gray_image(|stored_value: i64| cache.get(stored_value))
-      }
+      Some(cache) => self.to_gray_image(
+        |stored_value: i64| cache.get(stored_value),
+        thread_count,
+      ),
+
+      None => match grayscale_pipeline.window_kernel() {
+        Some(kernel) => self.to_gray_image_with_kernel(&kernel, thread_count),
+
+        None => {
+          let stages = grayscale_pipeline.stages();
 
-      None => self.to_gray_image(|stored_value: i64| {
-        grayscale_pipeline.apply_u8(stored_value)
-      }),
+          self.to_gray_image(
+            |stored_value: i64| stages.apply_u8(stored_value),
+            thread_count,
+          )
+        }
+      },
     }
   }
 
@@ -514,66 +603,201 @@ impl MonochromeImage {
   pub fn to_gray_u16_image(
     &self,
     grayscale_pipeline: &GrayscalePipeline,
+  ) -> image::ImageBuffer<image::Luma<u16>, Vec<u16>> {
+    self.to_gray_u16_image_with_threads(grayscale_pipeline, 1)
+  }
+
+  /// The same as [`Self::to_gray_u16_image()`], but bands of rows are
+  /// converted concurrently on up to `thread_count` threads. See
+  /// [`Self::to_gray_u8_image_with_threads()`] for details.
+  ///
+  pub fn to_gray_u16_image_with_threads(
+    &self,
+    grayscale_pipeline: &GrayscalePipeline,
+    thread_count: usize,
   ) -> image::ImageBuffer<image::Luma<u16>, Vec<u16>> {
     match &*grayscale_pipeline.output_cache_u16() {
-      Some(cache) => {
-        self.to_gray_image(|stored_value: i64| cache.get(stored_value))
+      Some(cache) => self.to_gray_image(
+        |stored_value: i64| cache.get(stored_value),
+        thread_count,
+      ),
+
+      None => match grayscale_pipeline.window_kernel() {
+        Some(kernel) => self.to_gray_image_with_kernel(&kernel, thread_count),
+
+        None => {
+          let stages = grayscale_pipeline.stages();
+
+          self.to_gray_image(
+            |stored_value: i64| stages.apply_u16(stored_value),
+            thread_count,
+          )
+        }
+      },
+    }
+  }
+
+  /// Converts this monochrome image to an 8-bit RGB image by passing its
+  /// values through the given grayscale LUT pipeline and then the color
+  /// palette, if one is specified. Without a color palette each grayscale
+  /// value is copied to all three channels.
+  ///
+  /// Images with 8-bit and 16-bit values are converted in a single pass using
+  /// a table that combines the grayscale pipeline and color palette. The table
+  /// is held by the grayscale pipeline so that it's shared by all frames
+  /// rendered with it, and is rebuilt when its VOI window changes.
+  ///
+  /// Bands of rows are converted concurrently on up to `thread_count` threads.
+  /// See [`Self::to_gray_u8_image_with_threads()`] for details.
+  ///
+  pub fn to_rgb_u8_image_with_threads(
+    &self,
+    grayscale_pipeline: &GrayscalePipeline,
+    color_palette: Option<&StandardColorPalette>,
+    thread_count: usize,
+  ) -> image::RgbImage {
+    let rgb_pixels = match &self.data {
+      MonochromeImageData::I8(data) => self.to_rgb_u8_pixels_with_lut(
+        data,
+        grayscale_pipeline,
+        color_palette,
+        thread_count,
+      ),
+      MonochromeImageData::U8(data) => self.to_rgb_u8_pixels_with_lut(
+        data,
+        grayscale_pipeline,
+        color_palette,
+        thread_count,
+      ),
+      MonochromeImageData::I16(data) => self.to_rgb_u8_pixels_with_lut(
+        data,
+        grayscale_pipeline,
+        color_palette,
+        thread_count,
+      ),
+      MonochromeImageData::U16(data) => self.to_rgb_u8_pixels_with_lut(
+        data,
+        grayscale_pipeline,
+        color_palette,
+        thread_count,
+      ),
+      MonochromeImageData::Bitmap { .. }
+      | MonochromeImageData::I32(_)
+      | MonochromeImageData::U32(_) => None,
+    };
+
+    let rgb_pixels = rgb_pixels.unwrap_or_else(|| {
+      let gray_image =
+        self.to_gray_u8_image_with_threads(grayscale_pipeline, thread_count);
+
+      let mut rgb_pixels =
+        frame_buffer_pool::vec_with_capacity(self.pixel_count() * 3);
+
+      if let Some(color_palette) = color_palette {
+        for gray in gray_image.as_raw() {
+          rgb_pixels.extend_from_slice(&color_palette.lookup(*gray));
+        }
+      } else {
+        for gray in gray_image.as_raw() {
+          rgb_pixels.extend_from_slice(&[*gray, *gray, *gray]);
+        }
       }
 
-      None => self.to_gray_image(|stored_value: i64| {
-        grayscale_pipeline.apply_u16(stored_value)
-      }),
+      frame_buffer_pool::recycle(gray_image.into_raw());
+
+      rgb_pixels
+    });
+
+    image::RgbImage::from_raw(self.width.into(), self.height.into(), rgb_pixels)
+      .unwrap()
+  }
+
+  /// Converts 8-bit or 16-bit values to RGB pixels using the grayscale
+  /// pipeline's combined RGB lookup table. Returns `None` if there are too few
+  /// values for building the table to be worthwhile, or if the table isn't
+  /// available.
+  ///
+  fn to_rgb_u8_pixels_with_lut<S: LutSample + MaybeSync + 'static>(
+    &self,
+    data: &[S],
+    grayscale_pipeline: &GrayscalePipeline,
+    color_palette: Option<&StandardColorPalette>,
+    thread_count: usize,
+  ) -> Option<Vec<u8>> {
+    // Building a 16-bit table costs about as much as converting a quarter of
+    // its size in values one at a time
+    if data.len() < S::VALUE_COUNT / 4 {
+      return None;
     }
+
+    let monochrome1_offset =
+      self.is_monochrome1.then(|| self.monochrome1_offset());
+
+    let lut = grayscale_pipeline
+      .output_lut_rgb_u8::<S>(monochrome1_offset, color_palette)?;
+    let lut = &*lut;
+
+    let width = usize::from(self.width);
+    let mut rgb_pixels = frame_buffer_pool::zeroed_vec(data.len() * 3);
+
+    row_parallel::for_each_band_zip(
+      data,
+      width,
+      &mut rgb_pixels,
+      width * 3,
+      thread_count,
+      |data, rgb_pixels| lut.apply_interleaved(data, rgb_pixels),
+    );
+
+    Some(rgb_pixels)
   }
 
-  fn to_gray_image<T: image::Primitive>(
+  fn to_gray_image<T: image::Primitive + PoolElement + MaybeSend>(
     &self,
-    stored_value_to_gray: impl Fn(i64) -> T,
+    stored_value_to_gray: impl Fn(i64) -> T + MaybeSync,
+    thread_count: usize,
   ) -> image::ImageBuffer<image::Luma<T>, Vec<T>> {
     let gray_pixels = match &self.data {
       MonochromeImageData::Bitmap { data, is_signed } => {
-        let mut gray_pixels = Vec::with_capacity(self.pixel_count());
-
         let monochrome1_offset = self.monochrome1_offset();
 
-        for pixel in data.iter() {
-          for b in 0..8 {
-            if gray_pixels.len() == gray_pixels.capacity() {
-              break;
-            }
+        // A bitmap only has two stored values, so convert each of them to gray
+        // once and then expand the bits directly into gray values
+        let gray_values = [0, 1].map(|bit: i64| {
+          let mut value = bit;
+          if *is_signed {
+            value = -value;
+          }
+          if self.is_monochrome1 {
+            value = -value + monochrome1_offset;
+          }
 
-            let mut value = i64::from((*pixel >> b) & 1);
-            if *is_signed {
-              value = -value;
-            }
-            if self.is_monochrome1 {
-              value = -value + monochrome1_offset;
-            }
+          stored_value_to_gray(value)
+        });
 
-            gray_pixels.push(stored_value_to_gray(value));
-          }
-        }
+        let mut gray_pixels = frame_buffer_pool::zeroed_vec(self.pixel_count());
+        sample_unpacking::unpack_bits(data, gray_values, &mut gray_pixels);
 
         gray_pixels
       }
 
       MonochromeImageData::I8(data) => {
-        self.to_gray_image_internal(data, stored_value_to_gray)
+        self.to_gray_image_internal(data, stored_value_to_gray, thread_count)
       }
       MonochromeImageData::U8(data) => {
-        self.to_gray_image_internal(data, stored_value_to_gray)
+        self.to_gray_image_internal(data, stored_value_to_gray, thread_count)
       }
       MonochromeImageData::I16(data) => {
-        self.to_gray_image_internal(data, stored_value_to_gray)
+        self.to_gray_image_internal(data, stored_value_to_gray, thread_count)
       }
       MonochromeImageData::U16(data) => {
-        self.to_gray_image_internal(data, stored_value_to_gray)
+        self.to_gray_image_internal(data, stored_value_to_gray, thread_count)
       }
       MonochromeImageData::I32(data) => {
-        self.to_gray_image_internal(data, stored_value_to_gray)
+        self.to_gray_image_internal(data, stored_value_to_gray, thread_count)
       }
       MonochromeImageData::U32(data) => {
-        self.to_gray_image_internal(data, stored_value_to_gray)
+        self.to_gray_image_internal(data, stored_value_to_gray, thread_count)
       }
     };
 
@@ -588,25 +812,146 @@ impl MonochromeImage {
   fn to_gray_image_internal<T, U>(
     &self,
     data: &[T],
-    stored_value_to_gray: impl Fn(i64) -> U,
+    stored_value_to_gray: impl Fn(i64) -> U + MaybeSync,
+    thread_count: usize,
   ) -> Vec<U>
   where
-    T: Copy,
+    T: Copy + MaybeSync,
+    U: PoolElement + MaybeSend,
     i64: From<T>,
   {
-    let mut gray_pixels = Vec::with_capacity(self.pixel_count());
+    let mut gray_pixels = frame_buffer_pool::zeroed_vec(self.pixel_count());
+    let width = usize::from(self.width);
 
     if self.is_monochrome1 {
       let offset = self.monochrome1_offset();
 
-      for stored_value in data.iter() {
-        gray_pixels
-          .push(stored_value_to_gray(-i64::from(*stored_value) + offset));
-      }
+      row_parallel::for_each_band_zip(
+        data,
+        width,
+        &mut gray_pixels,
+        width,
+        thread_count,
+        |data, gray_pixels| {
+          for (gray, stored_value) in gray_pixels.iter_mut().zip(data) {
+            *gray = stored_value_to_gray(-i64::from(*stored_value) + offset);
+          }
+        },
+      );
     } else {
-      for stored_value in data.iter() {
-        gray_pixels.push(stored_value_to_gray((*stored_value).into()));
+      row_parallel::for_each_band_zip(
+        data,
+        width,
+        &mut gray_pixels,
+        width,
+        thread_count,
+        |data, gray_pixels| {
+          for (gray, stored_value) in gray_pixels.iter_mut().zip(data) {
+            *gray = stored_value_to_gray((*stored_value).into());
+          }
+        },
+      );
+    }
+
+    gray_pixels
+  }
+
+  /// Converts this monochrome image to a grayscale image using a windowing
+  /// kernel, which processes all pixels in a single vectorizable pass rather
+  /// than passing each stored value through the grayscale pipeline in turn.
+  ///
+  fn to_gray_image_with_kernel<T>(
+    &self,
+    kernel: &GrayscaleWindowKernel,
+    thread_count: usize,
+  ) -> image::ImageBuffer<image::Luma<T>, Vec<T>>
+  where
+    T: image::Primitive + PoolElement + WindowKernelOutput + MaybeSend,
+  {
+    let gray_pixels = match &self.data {
+      // Bitmaps are always small enough to be cached, so only convert them
+      // one value at a time
+      MonochromeImageData::Bitmap { .. } => {
+        return self.to_gray_image(
+          |stored_value: i64| {
+            let mut gray = [T::default()];
+            kernel.apply(&[stored_value], &mut gray, |v| v as f32);
+            gray[0]
+          },
+          thread_count,
+        );
       }
+
+      MonochromeImageData::I8(data) => {
+        self.to_gray_image_with_kernel_internal(data, kernel, thread_count)
+      }
+      MonochromeImageData::U8(data) => {
+        self.to_gray_image_with_kernel_internal(data, kernel, thread_count)
+      }
+      MonochromeImageData::I16(data) => {
+        self.to_gray_image_with_kernel_internal(data, kernel, thread_count)
+      }
+      MonochromeImageData::U16(data) => {
+        self.to_gray_image_with_kernel_internal(data, kernel, thread_count)
+      }
+      MonochromeImageData::I32(data) => {
+        self.to_gray_image_with_kernel_internal(data, kernel, thread_count)
+      }
+      MonochromeImageData::U32(data) => {
+        self.to_gray_image_with_kernel_internal(data, kernel, thread_count)
+      }
+    };
+
+    image::ImageBuffer::from_raw(
+      self.width.into(),
+      self.height.into(),
+      gray_pixels,
+    )
+    .unwrap()
+  }
+
+  fn to_gray_image_with_kernel_internal<T, U>(
+    &self,
+    data: &[T],
+    kernel: &GrayscaleWindowKernel,
+    thread_count: usize,
+  ) -> Vec<U>
+  where
+    T: Copy + MaybeSync,
+    U: PoolElement + WindowKernelOutput + MaybeSend,
+    i64: From<T>,
+  {
+    let mut gray_pixels = frame_buffer_pool::zeroed_vec(self.pixel_count());
+    let width = usize::from(self.width);
+
+    if self.is_monochrome1 {
+      let offset = self.monochrome1_offset();
+
+      row_parallel::for_each_band_zip(
+        data,
+        width,
+        &mut gray_pixels,
+        width,
+        thread_count,
+        |data, gray_pixels| {
+          kernel.apply(data, gray_pixels, |stored_value| {
+            (-i64::from(stored_value) + offset) as f32
+          });
+        },
+      );
+    } else {
+      row_parallel::for_each_band_zip(
+        data,
+        width,
+        &mut gray_pixels,
+        width,
+        thread_count,
+        |data, gray_pixels| {
+          kernel.apply(data, gray_pixels, |stored_value| {
+            i64::from(stored_value) as f32
+          });
+        },
+      );
     }
 
     gray_pixels
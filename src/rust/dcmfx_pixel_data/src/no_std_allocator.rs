@@ -3,28 +3,212 @@
 //!
 //! These are needed on no_std targets, e.g. WASM, so that the image codec
 //! libraries such as OpenJPEG can allocate memory.
+//!
+//! Codecs make many small allocations for every frame they decode, and free
+//! most of them again when the frame is done, so small allocations are served
+//! from pools of freed blocks that are grouped into power of two size classes.
+//! This avoids going through the global allocator for each of them. The memory
+//! held in the pools is capped, and can be released with
+//! [`release_pooled_memory()`].
 
 use alloc::alloc::Layout;
+use core::sync::atomic::{AtomicBool, Ordering};
 
-#[unsafe(no_mangle)]
-pub extern "C" fn malloc(size: usize) -> *mut u8 {
+/// The smallest size class, which is also the alignment of pooled blocks.
+///
+const MIN_BLOCK_SIZE: usize = 16;
+
+/// The number of size classes, with the largest holding 64 KiB blocks. Larger
+/// allocations always go to the global allocator.
+///
+const SIZE_CLASS_COUNT: usize = 13;
+
+/// The most memory that's held in freed blocks across all size classes. Blocks
+/// freed once this is reached are returned to the global allocator.
+///
+const MAX_POOLED_BYTES: usize = 16 * 1024 * 1024;
+
+/// A freed block, which holds the next freed block of its size class.
+///
+struct FreeBlock {
+  next: *mut FreeBlock,
+}
+
+struct Pools {
+  free_lists: [*mut FreeBlock; SIZE_CLASS_COUNT],
+  pooled_bytes: usize,
+}
+
+/// The pools of freed blocks, which are only accessed while `POOLS_LOCK` is
+/// held.
+///
+static mut POOLS: Pools = Pools {
+  free_lists: [core::ptr::null_mut(); SIZE_CLASS_COUNT],
+  pooled_bytes: 0,
+};
+
+static POOLS_LOCK: AtomicBool = AtomicBool::new(false);
+
+/// Runs a function with exclusive access to the pools.
+///
+fn with_pools<T>(f: impl FnOnce(&mut Pools) -> T) -> T {
+  while POOLS_LOCK
+    .compare_exchange_weak(false, true, Ordering::Acquire, Ordering::Relaxed)
+    .is_err()
+  {
+    core::hint::spin_loop();
+  }
+
+  // SAFETY: the lock gives exclusive access to the pools
+  let result = f(unsafe { &mut *core::ptr::addr_of_mut!(POOLS) });
+
+  POOLS_LOCK.store(false, Ordering::Release);
+
+  result
+}
+
+/// Returns the size class for an allocation with the given layout, or `None`
+/// if it's too large or too strictly aligned to be pooled.
+///
+fn size_class(layout: Layout) -> Option<usize> {
+  if layout.align() > MIN_BLOCK_SIZE {
+    return None;
+  }
+
+  let block_size = layout.size().max(MIN_BLOCK_SIZE).next_power_of_two();
+  let size_class = (block_size / MIN_BLOCK_SIZE).trailing_zeros() as usize;
+
+  (size_class < SIZE_CLASS_COUNT).then_some(size_class)
+}
+
+/// Returns the layout of the blocks in a size class.
+///
+fn block_layout(size_class: usize) -> Layout {
+  Layout::from_size_align(MIN_BLOCK_SIZE << size_class, MIN_BLOCK_SIZE).unwrap()
+}
+
+/// Allocates memory with the given layout, reusing a freed block of the same
+/// size class if there is one. If `zeroed` is set then the first
+/// `layout.size()` bytes are zeroed.
+///
+pub(crate) fn pool_alloc(layout: Layout, zeroed: bool) -> *mut u8 {
+  let Some(size_class) = size_class(layout) else {
+    return unsafe {
+      if zeroed {
+        alloc::alloc::alloc_zeroed(layout)
+      } else {
+        alloc::alloc::alloc(layout)
+      }
+    };
+  };
+
+  let block = with_pools(|pools| {
+    let block = pools.free_lists[size_class];
+    if !block.is_null() {
+      pools.free_lists[size_class] = unsafe { (*block).next };
+      pools.pooled_bytes -= MIN_BLOCK_SIZE << size_class;
+    }
+
+    block
+  });
+
+  if block.is_null() {
+    // Memory fresh from the global allocator is usually already zero, which
+    // the global allocator knows and so can avoid zeroing it again
+    return unsafe {
+      if zeroed {
+        alloc::alloc::alloc_zeroed(block_layout(size_class))
+      } else {
+        alloc::alloc::alloc(block_layout(size_class))
+      }
+    };
+  }
+
+  if zeroed {
+    unsafe { core::ptr::write_bytes(block as *mut u8, 0, layout.size()) };
+  }
+
+  block as *mut u8
+}
+
+/// Frees memory allocated by [`pool_alloc()`] with the same layout, keeping it
+/// for reuse if it's in a size class and the pools aren't full.
+///
+/// # Safety
+///
+/// `ptr` must have been returned by [`pool_alloc()`] with the same layout, and
+/// not already have been freed.
+///
+pub(crate) unsafe fn pool_dealloc(ptr: *mut u8, layout: Layout) {
+  let Some(size_class) = size_class(layout) else {
+    unsafe { alloc::alloc::dealloc(ptr, layout) };
+    return;
+  };
+
+  let block_size = MIN_BLOCK_SIZE << size_class;
+
+  let is_pooled = with_pools(|pools| {
+    if pools.pooled_bytes + block_size > MAX_POOLED_BYTES {
+      return false;
+    }
+
+    let block = ptr as *mut FreeBlock;
+    unsafe { (*block).next = pools.free_lists[size_class] };
+    pools.free_lists[size_class] = block;
+    pools.pooled_bytes += block_size;
+
+    true
+  });
+
+  if !is_pooled {
+    unsafe { alloc::alloc::dealloc(ptr, block_layout(size_class)) };
+  }
+}
+
+/// Returns all the freed blocks held for reuse by the codec allocation
+/// functions to the global allocator, e.g. once a batch of frames has been
+/// decoded.
+///
+pub fn release_pooled_memory() {
+  let free_lists = with_pools(|pools| {
+    pools.pooled_bytes = 0;
+    core::mem::replace(
+      &mut pools.free_lists,
+      [core::ptr::null_mut(); SIZE_CLASS_COUNT],
+    )
+  });
+
+  for (size_class, mut block) in free_lists.into_iter().enumerate() {
+    while !block.is_null() {
+      unsafe {
+        let next = (*block).next;
+        alloc::alloc::dealloc(block as *mut u8, block_layout(size_class));
+        block = next;
+      }
+    }
+  }
+}
+
+/// Allocates memory preceded by the Layout of the whole allocation, which is
+/// read back when it's freed.
+///
+fn allocate(size: usize, zeroed: bool) -> *mut u8 {
   let layout_size = ::core::mem::size_of::<Layout>();
 
   // Construct layout that has enough space for the allocation preceded by the
   // Layout instance
-  let layout = Layout::from_size_align(
-    layout_size + size,
-    ::core::mem::align_of::<usize>(),
-  )
-  .unwrap();
+  let Some(layout) = layout_size.checked_add(size).and_then(|total_size| {
+    Layout::from_size_align(total_size, ::core::mem::align_of::<usize>()).ok()
+  }) else {
+    return core::ptr::null_mut();
+  };
 
-  unsafe {
-    // Allocate
-    let ptr = alloc::alloc::alloc(layout);
-    if ptr.is_null() {
-      return ptr;
-    }
+  let ptr = pool_alloc(layout, zeroed);
+  if ptr.is_null() {
+    return ptr;
+  }
 
+  unsafe {
     // Copy layout into the initial bytes
     *(ptr as *mut Layout) = layout;
 
@@ -34,17 +218,16 @@ pub extern "C" fn malloc(size: usize) -> *mut u8 {
 }
 
 #[unsafe(no_mangle)]
-pub extern "C" fn calloc(count: usize, size: usize) -> *mut u8 {
-  let ptr = malloc(count * size);
+pub extern "C" fn malloc(size: usize) -> *mut u8 {
+  allocate(size, false)
+}
 
-  // Zero the allocated bytes
-  if !ptr.is_null() {
-    unsafe {
-      ::core::ptr::write_bytes(ptr, 0, count * size);
-    }
+#[unsafe(no_mangle)]
+pub extern "C" fn calloc(count: usize, size: usize) -> *mut u8 {
+  match count.checked_mul(size) {
+    Some(size) => allocate(size, true),
+    None => core::ptr::null_mut(),
   }
-
-  ptr
 }
 
 #[unsafe(no_mangle)]
@@ -55,25 +238,27 @@ pub extern "C" fn realloc(ptr: *mut u8, new_size: usize) -> *mut u8 {
 
   let layout_size = ::core::mem::size_of::<Layout>();
 
-  unsafe {
-    let ptr = ptr.sub(layout_size);
+  // Read current layout from the start of the allocation
+  let size = unsafe { (*(ptr.sub(layout_size) as *const Layout)).size() };
 
-    // Read current layout from the start of the allocation
-    let layout: Layout = *(ptr as *const Layout);
+  // Pooled blocks can't be resized in place, so always move to a new
+  // allocation
+  let new_ptr = malloc(new_size);
+  if new_ptr.is_null() {
+    return new_ptr;
+  }
 
-    // Perform reallocation
-    let ptr = alloc::alloc::realloc(ptr, layout, layout_size + new_size);
-    if ptr.is_null() {
-      return ptr;
-    }
+  unsafe {
+    core::ptr::copy_nonoverlapping(
+      ptr,
+      new_ptr,
+      (size - layout_size).min(new_size),
+    );
+  }
 
-    // Set new layout into the initial bytes
-    *(ptr as *mut Layout) =
-      Layout::from_size_align(new_size, layout.align()).unwrap();
+  free(ptr);
 
-    // Return pointer to the data following the layout definition
-    ptr.add(layout_size)
-  }
+  new_ptr
 }
 
 #[unsafe(no_mangle)]
@@ -90,6 +275,6 @@ pub extern "C" fn free(ptr: *mut u8) {
     // Read layout from the start of the allocation
     let layout: Layout = *(ptr as *const Layout);
 
-    alloc::alloc::dealloc(ptr, layout)
+    pool_dealloc(ptr, layout)
   }
 }
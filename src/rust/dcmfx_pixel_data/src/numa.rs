@@ -0,0 +1,147 @@
+//! Placement of threads on NUMA nodes.
+//!
+//! On machines with more than one NUMA node, e.g. dual-socket servers, work on
+//! a frame is fastest when all of it runs on one node, because memory is then
+//! allocated from, and first touched on, that node. Threads are placed on a
+//! node with [`bind_current_thread()`], which restricts them to the node's
+//! CPUs and records the node so that [`crate::worker_pool::shared()`] returns
+//! the node's worker pool when one has been set with
+//! [`crate::worker_pool::set_shared_per_node()`].
+//!
+//! The topology is read from `/sys/devices/system/node` on Linux. On other
+//! platforms there is always a single node, and binding a thread only records
+//! its node.
+
+use std::cell::Cell;
+use std::sync::LazyLock;
+
+/// The CPUs on each NUMA node, indexed by node.
+///
+static NODE_CPUS: LazyLock<Vec<Vec<usize>>> = LazyLock::new(read_node_cpus);
+
+thread_local! {
+  static CURRENT_NODE: Cell<Option<usize>> = const { Cell::new(None) };
+}
+
+/// Returns the number of NUMA nodes. This is at least one.
+///
+pub fn node_count() -> usize {
+  NODE_CPUS.len().max(1)
+}
+
+/// Returns the CPUs on the given NUMA node. This is empty if the topology
+/// isn't known.
+///
+pub fn node_cpus(node: usize) -> &'static [usize] {
+  NODE_CPUS.get(node).map_or(&[], |cpus| cpus.as_slice())
+}
+
+/// Returns the NUMA node the current thread has been bound to with
+/// [`bind_current_thread()`], if any.
+///
+pub fn current_node() -> Option<usize> {
+  CURRENT_NODE.with(|node| node.get())
+}
+
+/// Binds the current thread to the CPUs of the given NUMA node, and records
+/// the node as the current thread's node. Memory the thread first touches is
+/// then allocated on that node by the operating system.
+///
+pub fn bind_current_thread(node: usize) {
+  let node = node % node_count();
+
+  CURRENT_NODE.with(|current_node| current_node.set(Some(node)));
+
+  #[cfg(target_os = "linux")]
+  set_thread_affinity(node_cpus(node));
+}
+
+/// Reads the CPUs on each NUMA node.
+///
+#[cfg(target_os = "linux")]
+fn read_node_cpus() -> Vec<Vec<usize>> {
+  let mut node_cpus = vec![];
+
+  while let Ok(cpu_list) = std::fs::read_to_string(format!(
+    "/sys/devices/system/node/node{}/cpulist",
+    node_cpus.len()
+  )) {
+    node_cpus.push(parse_cpu_list(&cpu_list));
+  }
+
+  node_cpus
+}
+
+#[cfg(not(target_os = "linux"))]
+fn read_node_cpus() -> Vec<Vec<usize>> {
+  vec![]
+}
+
+/// Parses a CPU list in the format used by the Linux kernel, e.g.
+/// "0-7,16-23". Invalid entries are ignored.
+///
+#[cfg_attr(not(target_os = "linux"), allow(dead_code))]
+fn parse_cpu_list(cpu_list: &str) -> Vec<usize> {
+  let mut cpus = vec![];
+
+  for range in cpu_list.trim().split(',') {
+    let (start, end) = range.split_once('-').unwrap_or((range, range));
+
+    if let (Ok(start), Ok(end)) = (start.parse(), end.parse()) {
+      cpus.extend(start..=end);
+    }
+  }
+
+  cpus
+}
+
+/// Restricts the current thread to run on the given CPUs. Nothing is done if
+/// there are no CPUs.
+///
+#[cfg(target_os = "linux")]
+fn set_thread_affinity(cpus: &[usize]) {
+  // Matches the size of glibc's cpu_set_t, which holds 1024 CPUs
+  const CPU_SET_WORDS: usize = 16;
+
+  unsafe extern "C" {
+    fn sched_setaffinity(pid: i32, cpusetsize: usize, mask: *const u64) -> i32;
+  }
+
+  let mut cpu_set = [0u64; CPU_SET_WORDS];
+  for cpu in cpus.iter().filter(|cpu| **cpu < CPU_SET_WORDS * 64) {
+    cpu_set[cpu / 64] |= 1 << (cpu % 64);
+  }
+
+  if cpu_set.iter().all(|word| *word == 0) {
+    return;
+  }
+
+  // A pid of zero applies the affinity to the calling thread. Failure is
+  // ignored because the thread is then simply left unpinned.
+  unsafe {
+    sched_setaffinity(0, core::mem::size_of_val(&cpu_set), cpu_set.as_ptr());
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn parse_cpu_list_test() {
+    assert_eq!(parse_cpu_list("0-3,8,10-11\n"), vec![0, 1, 2, 3, 8, 10, 11]);
+    assert_eq!(parse_cpu_list(""), Vec::<usize>::new());
+  }
+
+  #[test]
+  fn bind_current_thread_test() {
+    std::thread::spawn(|| {
+      assert_eq!(current_node(), None);
+
+      bind_current_thread(0);
+      assert_eq!(current_node(), Some(0));
+    })
+    .join()
+    .unwrap();
+  }
+}
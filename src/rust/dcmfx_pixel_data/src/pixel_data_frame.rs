@@ -6,6 +6,8 @@ use alloc::{vec, vec::Vec};
 
 use dcmfx_core::RcByteSlice;
 
+use crate::sample_unpacking;
+
 /// A single frame of pixel data in its raw form. It is made up of a one or more
 /// slices into reference-counted `Vec<u8>` data, which avoids copying of data.
 ///
@@ -155,13 +157,7 @@ impl PixelDataFrame {
     // Correct for any bit offset by left shifting the whole buffer. This is
     // only used by 1bpp pixel data frames that have a pixel count that's not a
     // multiple of eight.
-    if self.bit_offset != 0 {
-      for i in 0..buffer.len() {
-        let next_byte = buffer.get(i + 1).unwrap_or(&0);
-        buffer[i] =
-          (buffer[i] >> self.bit_offset) | (next_byte << (8 - self.bit_offset));
-      }
-    }
+    sample_unpacking::remove_bit_offset(&mut buffer, self.bit_offset);
 
     RcByteSlice::from_vec(buffer)
   }
@@ -0,0 +1,485 @@
+//! Random access to the frames of pixel data in a data set.
+
+#[cfg(not(feature = "std"))]
+use alloc::{format, string::ToString, vec, vec::Vec};
+
+use core::ops::Range;
+
+use dcmfx_core::{DataError, DataSet, RcByteSlice, dictionary};
+
+use crate::PixelDataFrame;
+use crate::transforms::{
+  P10PixelDataFrameTransform, PixelDataFrameTransformDetails,
+};
+
+/// An index of the frames of pixel data in a data set that gives direct access
+/// to any frame without going through the frames that precede it, e.g. for cine
+/// playback or to render a single frame of a large multi-frame data set.
+///
+/// The index is built in a single pass over the pixel data items, using the
+/// Basic Offset Table or Extended Offset Table when present, and can then be
+/// kept and reused. It holds references to the pixel data and does not copy
+/// it. The frames it returns are the same as those returned by
+/// [`crate::DataSetPixelDataExtensions::get_pixel_data_frames()`].
+///
+/// When the data set was read with `dcmfx_p10::read_file_mapped()`, only the
+/// parts of the file holding the frames that are accessed are read from disk.
+/// Alternatively, [`Self::frame_byte_ranges()`] gives the location of a
+/// frame's data so that it can be read directly, e.g. with a range request to
+/// an object store.
+///
+#[derive(Clone, Debug)]
+pub struct PixelDataFrameIndex {
+  frames: FrameIndex,
+}
+
+#[derive(Clone, Debug)]
+enum FrameIndex {
+  Native {
+    data: RcByteSlice,
+    frame_size: u64,
+    frame_count: usize,
+  },
+
+  Encapsulated {
+    fragments: Vec<RcByteSlice>,
+
+    // The offset of each fragment's item, relative to the first byte of the
+    // item that follows the Basic Offset Table item
+    fragment_offsets: Vec<u64>,
+
+    frames: Vec<EncapsulatedFrame>,
+  },
+}
+
+#[derive(Clone, Debug)]
+struct EncapsulatedFrame {
+  fragments: Range<usize>,
+  length: Option<u64>,
+}
+
+impl PixelDataFrameIndex {
+  /// Builds the frame index for the *'(7FE0,0010) Pixel Data'* in a data set.
+  ///
+  pub fn from_data_set(data_set: &DataSet) -> Result<Self, DataError> {
+    let details = PixelDataFrameTransformDetails::from_data_set(data_set)?;
+    let pixel_data = data_set.get_value(dictionary::PIXEL_DATA.tag)?;
+
+    let frames = match pixel_data.encapsulated_pixel_data() {
+      Ok(items) => Self::index_encapsulated_pixel_data(&details, items)?,
+      Err(_) => Self::index_native_pixel_data(&details, pixel_data.bytes()?),
+    };
+
+    Ok(Self { frames })
+  }
+
+  fn index_native_pixel_data(
+    details: &PixelDataFrameTransformDetails,
+    data: &RcByteSlice,
+  ) -> FrameIndex {
+    let frame_size = details.native_pixel_data_frame_size();
+
+    // Only frames that are wholly present in the pixel data are indexed, and
+    // trailing padding bits are never treated as extra frames
+    let frame_count = if frame_size == 0 {
+      0
+    } else {
+      core::cmp::min(
+        details.number_of_frames as u64,
+        data.len() as u64 * 8 / frame_size,
+      ) as usize
+    };
+
+    FrameIndex::Native {
+      data: data.clone(),
+      frame_size,
+      frame_count,
+    }
+  }
+
+  fn index_encapsulated_pixel_data(
+    details: &PixelDataFrameTransformDetails,
+    items: &[RcByteSlice],
+  ) -> Result<FrameIndex, DataError> {
+    let Some((basic_offset_table, fragments)) = items.split_first() else {
+      return Ok(FrameIndex::Encapsulated {
+        fragments: Vec::new(),
+        fragment_offsets: Vec::new(),
+        frames: Vec::new(),
+      });
+    };
+
+    let offset_table = details.read_offset_table(basic_offset_table)?;
+
+    // Each item's offset includes the 8 byte item headers of the items before
+    // it
+    let mut fragment_offsets = Vec::with_capacity(fragments.len());
+    let mut offset = 0u64;
+    for fragment in fragments {
+      fragment_offsets.push(offset);
+      offset += 8 + fragment.len() as u64;
+    }
+
+    let frames = if offset_table.is_empty() {
+      // If the offset table is empty and there is more than one frame then
+      // each pixel data item is a single frame, otherwise all the items are
+      // part of the one frame
+      if details.number_of_frames > 1 {
+        (0..fragments.len())
+          .map(|i| EncapsulatedFrame {
+            fragments: i..(i + 1),
+            length: None,
+          })
+          .collect()
+      } else if fragments.is_empty() {
+        Vec::new()
+      } else {
+        vec![EncapsulatedFrame {
+          fragments: 0..fragments.len(),
+          length: None,
+        }]
+      }
+    } else {
+      // Find the item that each frame starts at, which must be an exact match
+      let frame_starts = offset_table
+        .iter()
+        .map(|(offset, _)| {
+          fragment_offsets.binary_search(offset).map_err(|_| {
+            DataError::new_value_invalid(
+              "Pixel data offset table is malformed".to_string(),
+            )
+          })
+        })
+        .collect::<Result<Vec<_>, _>>()?;
+
+      let mut frames = Vec::with_capacity(frame_starts.len());
+
+      for (i, (_, length)) in offset_table.iter().enumerate() {
+        let start = frame_starts[i];
+        let end = frame_starts.get(i + 1).copied().unwrap_or(fragments.len());
+
+        // Check that the frame is at least as long as its specified length.
+        // The frame's data is truncated to its specified length when it is
+        // retrieved.
+        if let Some(length) = *length {
+          let frame_length = fragments[start..end]
+            .iter()
+            .fold(0, |s, fragment| s + fragment.len() as u64);
+
+          if frame_length < length {
+            return Err(DataError::new_value_invalid(format!(
+              "Extended Offset Table Length value '{length}' is invalid for \
+               frame of length '{frame_length}'"
+            )));
+          }
+        }
+
+        frames.push(EncapsulatedFrame {
+          fragments: start..end,
+          length: *length,
+        });
+      }
+
+      frames
+    };
+
+    Ok(FrameIndex::Encapsulated {
+      fragments: fragments.to_vec(),
+      fragment_offsets,
+      frames,
+    })
+  }
+
+  /// Returns the number of frames in the index.
+  ///
+  pub fn len(&self) -> usize {
+    match &self.frames {
+      FrameIndex::Native { frame_count, .. } => *frame_count,
+      FrameIndex::Encapsulated { frames, .. } => frames.len(),
+    }
+  }
+
+  /// Returns whether there are no frames in the index.
+  ///
+  pub fn is_empty(&self) -> bool {
+    self.len() == 0
+  }
+
+  /// Returns the frame of pixel data at the given index, or `None` if there is
+  /// no such frame. The returned frame refers to the pixel data and no data is
+  /// copied.
+  ///
+  pub fn get_frame(&self, index: usize) -> Option<PixelDataFrame> {
+    let mut frame = PixelDataFrame::new();
+    frame.set_index(index);
+
+    match &self.frames {
+      FrameIndex::Native { data, .. } => {
+        let bit_range = self.native_frame_bit_range(index)?;
+
+        frame.set_bit_offset((bit_range.start % 8) as usize);
+        frame.push_bytes(data.slice(
+          (bit_range.start / 8) as usize,
+          bit_range.end.div_ceil(8) as usize,
+        ));
+      }
+
+      FrameIndex::Encapsulated {
+        fragments, frames, ..
+      } => {
+        let encapsulated_frame = frames.get(index)?;
+
+        for fragment in &fragments[encapsulated_frame.fragments.clone()] {
+          frame.push_bytes(fragment.clone());
+        }
+
+        // Lengths are validated when the index is built, so this can't fail
+        if let Some(length) = encapsulated_frame.length {
+          P10PixelDataFrameTransform::apply_length_to_frame(&mut frame, length)
+            .ok()?;
+        }
+      }
+    }
+
+    Some(frame)
+  }
+
+  /// Returns the byte ranges that hold the data of the frame at the given
+  /// index, or `None` if there is no such frame.
+  ///
+  /// For native pixel data there is a single range, which is relative to the
+  /// start of the *'(7FE0,0010) Pixel Data'* value. For 1bpp pixel data the
+  /// frame may start part way through the first byte of its range.
+  ///
+  /// For encapsulated pixel data there is one range per fragment, excluding
+  /// item headers, and ranges are relative to the first byte of the item that
+  /// follows the Basic Offset Table item, which is the same as the offsets in
+  /// the Basic Offset Table.
+  ///
+  pub fn frame_byte_ranges(&self, index: usize) -> Option<Vec<Range<u64>>> {
+    match &self.frames {
+      FrameIndex::Native { .. } => {
+        let bit_range = self.native_frame_bit_range(index)?;
+
+        Some(vec![(bit_range.start / 8)..bit_range.end.div_ceil(8)])
+      }
+
+      FrameIndex::Encapsulated {
+        fragments,
+        fragment_offsets,
+        frames,
+      } => {
+        let encapsulated_frame = frames.get(index)?;
+        let mut remaining_length =
+          encapsulated_frame.length.unwrap_or(u64::MAX);
+
+        let mut ranges = Vec::new();
+        for i in encapsulated_frame.fragments.clone() {
+          if remaining_length == 0 {
+            break;
+          }
+
+          let length =
+            core::cmp::min(fragments[i].len() as u64, remaining_length);
+          remaining_length -= length;
+
+          let start = fragment_offsets[i] + 8;
+          ranges.push(start..(start + length));
+        }
+
+        Some(ranges)
+      }
+    }
+  }
+
+  fn native_frame_bit_range(&self, index: usize) -> Option<Range<u64>> {
+    match &self.frames {
+      FrameIndex::Native {
+        frame_size,
+        frame_count,
+        ..
+      } if index < *frame_count => {
+        let start = index as u64 * frame_size;
+        Some(start..(start + frame_size))
+      }
+
+      _ => None,
+    }
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  use dcmfx_core::{DataElementValue, ValueRepresentation};
+
+  use crate::DataSetPixelDataExtensions;
+
+  fn new_data_set(number_of_frames: i64, bits_allocated: i64) -> DataSet {
+    let mut ds = DataSet::new();
+
+    ds.insert_int_value(&dictionary::NUMBER_OF_FRAMES, &[number_of_frames])
+      .unwrap();
+    ds.insert_int_value(&dictionary::SAMPLES_PER_PIXEL, &[1])
+      .unwrap();
+    ds.insert_string_value(
+      &dictionary::PHOTOMETRIC_INTERPRETATION,
+      &["MONOCHROME2"],
+    )
+    .unwrap();
+    ds.insert_int_value(&dictionary::ROWS, &[2]).unwrap();
+    ds.insert_int_value(&dictionary::COLUMNS, &[2]).unwrap();
+    ds.insert_int_value(&dictionary::BITS_ALLOCATED, &[bits_allocated])
+      .unwrap();
+
+    ds
+  }
+
+  fn assert_matches_frame_transform(ds: &DataSet) {
+    let index = PixelDataFrameIndex::from_data_set(ds).unwrap();
+    let frames = ds.get_pixel_data_frames().unwrap();
+
+    assert_eq!(index.len(), frames.len());
+
+    for (i, frame) in frames.iter().enumerate() {
+      let indexed_frame = index.get_frame(i).unwrap();
+
+      assert_eq!(indexed_frame.index(), Some(i));
+      assert_eq!(indexed_frame.len_bits(), frame.len_bits());
+      assert_eq!(indexed_frame.to_bytes(), frame.to_bytes());
+    }
+
+    assert!(index.get_frame(frames.len()).is_none());
+  }
+
+  #[test]
+  fn native_pixel_data() {
+    let mut ds = new_data_set(3, 8);
+    ds.insert_binary_value(
+      dictionary::PIXEL_DATA.tag,
+      ValueRepresentation::OtherByteString,
+      (0..12).collect::<Vec<u8>>().into(),
+    )
+    .unwrap();
+
+    assert_matches_frame_transform(&ds);
+
+    let index = PixelDataFrameIndex::from_data_set(&ds).unwrap();
+    assert_eq!(index.frame_byte_ranges(2), Some(vec![8..12]));
+  }
+
+  #[test]
+  fn native_1bpp_pixel_data() {
+    let mut ds = new_data_set(5, 1);
+    ds.insert_binary_value(
+      dictionary::PIXEL_DATA.tag,
+      ValueRepresentation::OtherByteString,
+      vec![0b1010_0110, 0b0101_1100, 0b1111_0001].into(),
+    )
+    .unwrap();
+
+    assert_matches_frame_transform(&ds);
+
+    let index = PixelDataFrameIndex::from_data_set(&ds).unwrap();
+    assert_eq!(index.frame_byte_ranges(3), Some(vec![1..2]));
+  }
+
+  #[test]
+  fn encapsulated_pixel_data_with_basic_offset_table() {
+    let mut ds = new_data_set(2, 8);
+    ds.insert(
+      dictionary::PIXEL_DATA.tag,
+      DataElementValue::new_encapsulated_pixel_data_unchecked(
+        ValueRepresentation::OtherByteString,
+        vec![
+          vec![0, 0, 0, 0, 0x1C, 0, 0, 0].into(),
+          vec![1; 4].into(),
+          vec![2; 8].into(),
+          vec![3; 6].into(),
+        ],
+      ),
+    );
+
+    assert_matches_frame_transform(&ds);
+
+    let index = PixelDataFrameIndex::from_data_set(&ds).unwrap();
+    assert_eq!(index.frame_byte_ranges(0), Some(vec![8..12, 20..28]));
+    assert_eq!(index.frame_byte_ranges(1), Some(vec![36..42]));
+  }
+
+  #[test]
+  fn encapsulated_pixel_data_with_extended_offset_table() {
+    let mut ds = new_data_set(2, 8);
+    ds.insert_binary_value(
+      dictionary::EXTENDED_OFFSET_TABLE.tag,
+      ValueRepresentation::OtherVeryLongString,
+      [0u64, 12]
+        .iter()
+        .flat_map(|v| v.to_le_bytes())
+        .collect::<Vec<_>>()
+        .into(),
+    )
+    .unwrap();
+    ds.insert_binary_value(
+      dictionary::EXTENDED_OFFSET_TABLE_LENGTHS.tag,
+      ValueRepresentation::OtherVeryLongString,
+      [3u64, 6]
+        .iter()
+        .flat_map(|v| v.to_le_bytes())
+        .collect::<Vec<_>>()
+        .into(),
+    )
+    .unwrap();
+    ds.insert(
+      dictionary::PIXEL_DATA.tag,
+      DataElementValue::new_encapsulated_pixel_data_unchecked(
+        ValueRepresentation::OtherByteString,
+        vec![vec![].into(), vec![1; 4].into(), vec![2; 6].into()],
+      ),
+    );
+
+    assert_matches_frame_transform(&ds);
+
+    let index = PixelDataFrameIndex::from_data_set(&ds).unwrap();
+    assert_eq!(index.get_frame(0).unwrap().to_bytes(), vec![1; 3].into());
+    assert_eq!(index.frame_byte_ranges(0), Some(vec![8..11]));
+  }
+
+  #[test]
+  fn encapsulated_pixel_data_without_offset_table() {
+    let mut ds = new_data_set(2, 8);
+    ds.insert(
+      dictionary::PIXEL_DATA.tag,
+      DataElementValue::new_encapsulated_pixel_data_unchecked(
+        ValueRepresentation::OtherByteString,
+        vec![vec![].into(), vec![1; 4].into(), vec![2; 6].into()],
+      ),
+    );
+
+    assert_matches_frame_transform(&ds);
+  }
+
+  #[test]
+  fn malformed_basic_offset_table() {
+    let mut ds = new_data_set(2, 8);
+    ds.insert(
+      dictionary::PIXEL_DATA.tag,
+      DataElementValue::new_encapsulated_pixel_data_unchecked(
+        ValueRepresentation::OtherByteString,
+        vec![
+          vec![0, 0, 0, 0, 4, 0, 0, 0].into(),
+          vec![1; 4].into(),
+          vec![2; 6].into(),
+        ],
+      ),
+    );
+
+    assert_eq!(
+      PixelDataFrameIndex::from_data_set(&ds).unwrap_err(),
+      DataError::new_value_invalid(
+        "Pixel data offset table is malformed".to_string()
+      )
+    );
+  }
+}
@@ -1,26 +1,53 @@
 #[cfg(not(feature = "std"))]
-use alloc::vec::Vec;
+use alloc::string::ToString;
 
 use dcmfx_core::{
-  DataElementTag, DataError, DataSet, DataSetPath, IodModule, TransferSyntax,
-  ValueRepresentation, dictionary, transfer_syntax,
+  DataElementTag, DataError, DataSet, DataSetPath, IodModule, Rc,
+  TransferSyntax, ValueRepresentation, dictionary, transfer_syntax,
 };
 
 use crate::{
-  ColorImage, GrayscalePipeline, MonochromeImage, PixelDataDecodeConfig,
+  ColorImage, DecodedFrame, DecodedFrameCache, DecodedFrameKey,
+  GrayscalePipeline, MonochromeImage, PixelDataDecodeConfig,
   PixelDataDecodeError, PixelDataFrame, StandardColorPalette, decode,
-  iods::ImagePixelModule,
+  frame_buffer_pool,
+  iods::{ImagePixelModule, OverlayPlaneModule},
+  transforms::CropRect,
 };
 
+#[cfg(feature = "std")]
+use crate::FrameBufferPool;
+
 /// Defines a pixel data renderer that can take a [`PixelDataFrame`] and render
 /// it into a [`MonochromeImage`], [`ColorImage`], or [`image::RgbImage`].
 ///
+/// When a shared worker pool is in use, renders that a user is waiting on
+/// should be run with [`crate::worker_pool::Priority::Interactive`] so they
+/// aren't held up by batch work on the same pool, see
+/// [`crate::worker_pool::with_priority()`].
+///
 #[derive(Clone, Debug, PartialEq)]
 pub struct PixelDataRenderer {
   pub transfer_syntax: &'static TransferSyntax,
   pub image_pixel_module: ImagePixelModule,
   pub grayscale_pipeline: GrayscalePipeline,
   pub decode_config: PixelDataDecodeConfig,
+
+  /// The number of resolution levels to skip when decoding frames, where each
+  /// level halves the width and height of rendered and decoded images. This is
+  /// intended for generating thumbnails and previews. It is only supported by
+  /// some transfer syntaxes and decoders, and others decode at full resolution,
+  /// see [`decode::decode_monochrome_reduced()`]. Defaults to zero.
+  ///
+  pub resolution_reduction: u32,
+
+  /// The area of each frame to decode, in full resolution coordinates. When
+  /// set, rendered and decoded images only contain this area, and decoders
+  /// that support it skip the parts of the frame that are outside it, see
+  /// [`decode::decode_monochrome_region()`]. Defaults to `None`, which decodes
+  /// the whole frame.
+  ///
+  pub decode_area: Option<CropRect>,
 }
 
 impl IodModule for PixelDataRenderer {
@@ -57,6 +84,8 @@ impl IodModule for PixelDataRenderer {
       image_pixel_module,
       grayscale_pipeline,
       decode_config: PixelDataDecodeConfig::default(),
+      resolution_reduction: 0,
+      decode_area: None,
     })
   }
 }
@@ -74,28 +103,574 @@ impl PixelDataRenderer {
     &self,
     frame: &mut PixelDataFrame,
     color_palette: Option<&StandardColorPalette>,
+  ) -> Result<image::RgbImage, PixelDataDecodeError> {
+    self.render_reduced_frame(frame, color_palette, self.resolution_reduction)
+  }
+
+  /// Renders a frame of pixel data in the same way as [`Self::render_frame()`]
+  /// and then draws the overlays in an Overlay Plane Module on top of it,
+  /// using [`OverlayPlaneModule::DEFAULT_COLORS`].
+  ///
+  /// Overlays are positioned relative to [`Self::decode_area`] when it is set.
+  /// They aren't drawn when [`Self::resolution_reduction`] is non-zero.
+  ///
+  pub fn render_frame_with_overlays(
+    &self,
+    frame: &mut PixelDataFrame,
+    color_palette: Option<&StandardColorPalette>,
+    overlay_plane_module: &OverlayPlaneModule,
+  ) -> Result<image::RgbImage, PixelDataDecodeError> {
+    let frame_index = frame.index().unwrap_or(0);
+    let mut image = self.render_frame(frame, color_palette)?;
+
+    if self.resolution_reduction == 0 {
+      let decode_area = self.decode_area.unwrap_or_default();
+
+      overlay_plane_module.render_to_rgb8_image_with_offset(
+        &mut image,
+        frame_index,
+        [decode_area.left.into(), decode_area.top.into()],
+      );
+    }
+
+    Ok(image)
+  }
+
+  /// Renders a frame of pixel data in the same way as [`Self::render_frame()`]
+  /// with the passed resolution reduction in place of
+  /// [`Self::resolution_reduction`].
+  ///
+  fn render_reduced_frame(
+    &self,
+    frame: &mut PixelDataFrame,
+    color_palette: Option<&StandardColorPalette>,
+    resolution_reduction: u32,
   ) -> Result<image::RgbImage, PixelDataDecodeError> {
     if self.image_pixel_module.is_monochrome() {
-      let image = decode::decode_monochrome(
+      #[cfg(all(feature = "native", feature = "std"))]
+      if resolution_reduction == 0
+        && let Some(image) =
+          self.render_monochrome_jpeg_xl_frame(frame, color_palette)
+      {
+        return image;
+      }
+
+      #[cfg(feature = "native")]
+      if let Some(image) = self.render_monochrome_lut_frame(
+        frame,
+        color_palette,
+        resolution_reduction,
+      ) {
+        return image;
+      }
+
+      let image = decode::decode_monochrome_region(
         frame,
         self.transfer_syntax,
         &self.image_pixel_module,
         &self.decode_config,
+        &self.decode_area.unwrap_or_default(),
+        resolution_reduction,
       )?;
 
-      Ok(self.render_monochrome_image(&image, color_palette))
+      let rgb_image = self.render_monochrome_image(&image, color_palette);
+      frame_buffer_pool::recycle_monochrome_image(image);
+
+      Ok(rgb_image)
     } else {
-      let image = decode::decode_color(
+      let image = decode::decode_color_region(
         frame,
         self.transfer_syntax,
         &self.image_pixel_module,
         &self.decode_config,
+        &self.decode_area.unwrap_or_default(),
+        resolution_reduction,
       )?;
 
       Ok(image.into_rgb_u8_image())
     }
   }
 
+  /// Renders a frame of pixel data in the same way as [`Self::render_frame()`],
+  /// taking its decoded stored values from the cache if they're present, and
+  /// otherwise decoding the frame and adding it to the cache. The frame is
+  /// identified by its SOP Instance UID and its index, see
+  /// [`PixelDataFrame::index()`], which defaults to zero when not set.
+  ///
+  /// Only the decode is cached, so the grayscale pipeline and color palette
+  /// can change between renders of a cached frame.
+  ///
+  pub fn render_frame_cached(
+    &self,
+    frame: &mut PixelDataFrame,
+    sop_instance_uid: &str,
+    cache: &mut DecodedFrameCache,
+    color_palette: Option<&StandardColorPalette>,
+  ) -> Result<image::RgbImage, PixelDataDecodeError> {
+    let key =
+      self.decoded_frame_key(sop_instance_uid, frame.index().unwrap_or(0));
+
+    let decoded_frame = match cache.get(&key) {
+      Some(decoded_frame) => decoded_frame,
+      None => {
+        let decoded_frame = self.decode_frame(frame)?;
+        cache.insert(key, decoded_frame.clone());
+        decoded_frame
+      }
+    };
+
+    Ok(self.render_decoded_frame(&decoded_frame, color_palette))
+  }
+
+  /// Returns the key for a frame decoded by this renderer in a
+  /// [`DecodedFrameCache`], which includes this renderer's decode settings.
+  ///
+  pub fn decoded_frame_key(
+    &self,
+    sop_instance_uid: &str,
+    frame_index: usize,
+  ) -> DecodedFrameKey {
+    DecodedFrameKey {
+      sop_instance_uid: sop_instance_uid.to_string(),
+      frame_index,
+      decode_config: self.decode_config,
+      resolution_reduction: self.resolution_reduction,
+      decode_area: self.decode_area,
+    }
+  }
+
+  /// Decodes a frame of monochrome or color pixel data into a
+  /// [`DecodedFrame`] that can be held in a [`DecodedFrameCache`].
+  ///
+  pub fn decode_frame(
+    &self,
+    frame: &mut PixelDataFrame,
+  ) -> Result<DecodedFrame, PixelDataDecodeError> {
+    if self.image_pixel_module.is_monochrome() {
+      Ok(DecodedFrame::Monochrome(Rc::new(
+        self.decode_monochrome_frame(frame)?,
+      )))
+    } else {
+      Ok(DecodedFrame::Color(Rc::new(
+        self.decode_color_frame(frame)?,
+      )))
+    }
+  }
+
+  /// Renders a [`DecodedFrame`] to an RGB 8-bit image. Monochrome frames are
+  /// rendered with [`Self::render_monochrome_image()`].
+  ///
+  pub fn render_decoded_frame(
+    &self,
+    decoded_frame: &DecodedFrame,
+    color_palette: Option<&StandardColorPalette>,
+  ) -> image::RgbImage {
+    match decoded_frame {
+      DecodedFrame::Monochrome(image) => {
+        self.render_monochrome_image(image, color_palette)
+      }
+
+      DecodedFrame::Color(image) => {
+        ColorImage::clone(image).into_rgb_u8_image()
+      }
+    }
+  }
+
+  /// Renders a thumbnail of a frame of pixel data that fits inside
+  /// `max_width` x `max_height` and preserves the frame's aspect ratio.
+  /// Frames that already fit are rendered at full size, i.e. thumbnails are
+  /// never upscaled. When [`Self::decode_area`] is set, the thumbnail is of
+  /// that area.
+  ///
+  /// The frame is decoded at the lowest resolution its data supports that is
+  /// still at least as large as the thumbnail, and the result is then resized
+  /// to the thumbnail size. JPEG 2000 and High-Throughput JPEG 2000 skip the
+  /// finest resolution levels, see [`decode::decode_monochrome_reduced()`],
+  /// 12-bit JPEG uses reduced-size IDCTs down to 1:8 scale, and when the
+  /// thumbnail is 1:8 scale or smaller JPEG Baseline 8-bit decodes only its DC
+  /// coefficients and JPEG XL decoded with libjxl stops after the DC (LF) pass.
+  /// Other transfer syntaxes are decoded at full resolution and then resized.
+  ///
+  /// [`Self::resolution_reduction`] is ignored.
+  ///
+  pub fn render_thumbnail(
+    &self,
+    frame: &mut PixelDataFrame,
+    max_width: u32,
+    max_height: u32,
+    color_palette: Option<&StandardColorPalette>,
+  ) -> Result<image::RgbImage, PixelDataDecodeError> {
+    let (height, width) = self.decode_area.unwrap_or_default().apply(
+      self.image_pixel_module.rows(),
+      self.image_pixel_module.columns(),
+    );
+    let (width, height) = (u32::from(width), u32::from(height));
+
+    let (thumbnail_width, thumbnail_height) =
+      thumbnail_size(width, height, max_width, max_height);
+
+    let resolution_reduction = thumbnail_resolution_reduction(
+      width,
+      height,
+      thumbnail_width,
+      thumbnail_height,
+    );
+
+    let image = match self.render_jpeg_xl_dc_frame(
+      frame,
+      color_palette,
+      resolution_reduction,
+    ) {
+      Some(image) => image?,
+      None => {
+        self.render_reduced_frame(frame, color_palette, resolution_reduction)?
+      }
+    };
+
+    if image.dimensions() == (thumbnail_width, thumbnail_height) {
+      return Ok(image);
+    }
+
+    Ok(image::imageops::resize(
+      &image,
+      thumbnail_width,
+      thumbnail_height,
+      image::imageops::FilterType::Triangle,
+    ))
+  }
+
+  /// Renders a frame of JPEG XL pixel data from only its DC (LF) pass, which
+  /// is 1:8 scale, when rendering a thumbnail that is at a resolution
+  /// reduction of at least three, i.e. 1:8 scale or smaller.
+  ///
+  /// Returns `None` if the frame can't be rendered this way, in which case it's
+  /// rendered at full resolution.
+  ///
+  #[cfg(all(feature = "native", feature = "std"))]
+  fn render_jpeg_xl_dc_frame(
+    &self,
+    frame: &mut PixelDataFrame,
+    color_palette: Option<&StandardColorPalette>,
+    resolution_reduction: u32,
+  ) -> Option<Result<image::RgbImage, PixelDataDecodeError>> {
+    if resolution_reduction < 3 {
+      return None;
+    }
+
+    let decode_area = self.decode_area.unwrap_or_default();
+    let thread_count = self.decode_config.thread_count;
+
+    if self.image_pixel_module.is_monochrome() {
+      let image = decode::decode_monochrome_jpeg_xl_dc(
+        frame,
+        self.transfer_syntax,
+        &self.image_pixel_module,
+        &self.decode_config,
+      )?;
+
+      Some(image.map(|mut image| {
+        image.crop_with_threads(&decode_area, thread_count);
+
+        let rgb_image = self.render_monochrome_image(&image, color_palette);
+        frame_buffer_pool::recycle_monochrome_image(image);
+
+        rgb_image
+      }))
+    } else {
+      let image = decode::decode_color_jpeg_xl_dc(
+        frame,
+        self.transfer_syntax,
+        &self.image_pixel_module,
+        &self.decode_config,
+      )?;
+
+      Some(image.map(|mut image| {
+        image.crop_with_threads(&decode_area, thread_count);
+        image.into_rgb_u8_image()
+      }))
+    }
+  }
+
+  #[cfg(not(all(feature = "native", feature = "std")))]
+  fn render_jpeg_xl_dc_frame(
+    &self,
+    _frame: &mut PixelDataFrame,
+    _color_palette: Option<&StandardColorPalette>,
+    _resolution_reduction: u32,
+  ) -> Option<Result<image::RgbImage, PixelDataDecodeError>> {
+    None
+  }
+
+  /// Renders a frame of pixel data to an RGB 8-bit image in the same way as
+  /// [`Self::render_frame()`], taking the buffers for the decoded frame and
+  /// the rendered image from the passed pool, and returning intermediate
+  /// buffers to it once they're no longer needed.
+  ///
+  /// When rendering a multi-frame image, returning each rendered image to the
+  /// pool with [`FrameBufferPool::recycle_rgb_image()`] once it has been used
+  /// means rendering later frames doesn't allocate new buffers.
+  ///
+  #[cfg(feature = "std")]
+  pub fn render_frame_with_pool(
+    &self,
+    frame: &mut PixelDataFrame,
+    color_palette: Option<&StandardColorPalette>,
+    pool: &mut FrameBufferPool,
+  ) -> Result<image::RgbImage, PixelDataDecodeError> {
+    pool.scope(|| self.render_frame(frame, color_palette))
+  }
+
+  /// Renders a frame of monochrome JPEG XL pixel data by having libjxl pass
+  /// decoded stored values straight through the grayscale pipeline and into
+  /// the output image as it decodes them. This avoids creating a
+  /// [`MonochromeImage`] and a grayscale image for the whole frame, and the
+  /// memory traffic of filling them.
+  ///
+  /// Returns `None` if the frame can't be rendered this way, in which case it's
+  /// decoded and then rendered.
+  ///
+  #[cfg(all(feature = "native", feature = "std"))]
+  fn render_monochrome_jpeg_xl_frame(
+    &self,
+    frame: &mut PixelDataFrame,
+    color_palette: Option<&StandardColorPalette>,
+  ) -> Option<Result<image::RgbImage, PixelDataDecodeError>> {
+    use decode::PixelRun;
+
+    // libjxl's worker threads can't share the grayscale pipeline, so they use
+    // a copy of its cached output values
+    let output_cache =
+      self.grayscale_pipeline.output_cache_u8().as_ref()?.clone();
+
+    let rgb_values: Vec<[u8; 3]> = (0..=255)
+      .map(|gray| match color_palette {
+        Some(color_palette) => color_palette.lookup(gray),
+        None => [gray, gray, gray],
+      })
+      .collect();
+
+    let is_monochrome1 = self
+      .image_pixel_module
+      .photometric_interpretation()
+      .is_monochrome1();
+    let monochrome1_offset =
+      if self.image_pixel_module.pixel_representation().is_signed() {
+        -1
+      } else {
+        (1i64 << self.image_pixel_module.bits_stored()) - 1
+      };
+
+    let to_rgb = |mut stored_value: i64| {
+      if is_monochrome1 {
+        stored_value = monochrome1_offset - stored_value;
+      }
+
+      rgb_values[usize::from(output_cache.get(stored_value))]
+    };
+
+    let decode_area = self.decode_area.unwrap_or_default();
+    let (height, width) = decode_area.apply(
+      self.image_pixel_module.rows(),
+      self.image_pixel_module.columns(),
+    );
+    let (width, height) = (usize::from(width), usize::from(height));
+    let left = usize::from(decode_area.left);
+    let top = usize::from(decode_area.top);
+
+    let mut pixels = frame_buffer_pool::zeroed_vec(width * height * 3);
+    let output = SharedOutput(pixels.as_mut_ptr());
+
+    let on_pixels = |x: usize, y: usize, run: PixelRun| {
+      if y < top || y >= top + height {
+        return;
+      }
+
+      let run_length = match run {
+        PixelRun::U8(values) => values.len(),
+        PixelRun::I8(values) => values.len(),
+        PixelRun::U16(values) => values.len(),
+        PixelRun::I16(values) => values.len(),
+      };
+
+      // Clip the run to the decode area
+      let start = x.max(left);
+      let end = (x + run_length).min(left + width);
+      if start >= end {
+        return;
+      }
+
+      // SAFETY: the destination is inside the output pixels, and libjxl never
+      // passes the same pixel to more than one thread
+      let destination = unsafe {
+        core::slice::from_raw_parts_mut(
+          output.get().add(((y - top) * width + start - left) * 3),
+          (end - start) * 3,
+        )
+      };
+
+      fn write_run<T: Copy>(
+        destination: &mut [u8],
+        values: &[T],
+        to_rgb: impl Fn(i64) -> [u8; 3],
+      ) where
+        i64: From<T>,
+      {
+        for (rgb, value) in destination.chunks_exact_mut(3).zip(values) {
+          rgb.copy_from_slice(&to_rgb(i64::from(*value)));
+        }
+      }
+
+      let range = start - x..end - x;
+
+      match run {
+        PixelRun::U8(values) => write_run(destination, &values[range], to_rgb),
+        PixelRun::I8(values) => write_run(destination, &values[range], to_rgb),
+        PixelRun::U16(values) => write_run(destination, &values[range], to_rgb),
+        PixelRun::I16(values) => write_run(destination, &values[range], to_rgb),
+      }
+    };
+
+    let result = decode::decode_monochrome_jpeg_xl_image_out(
+      frame,
+      self.transfer_syntax,
+      &self.image_pixel_module,
+      &self.decode_config,
+      &on_pixels,
+    )?;
+
+    Some(result.map(|_| {
+      image::RgbImage::from_raw(width as u32, height as u32, pixels).unwrap()
+    }))
+  }
+
+  /// Renders a frame of monochrome JPEG-LS or JPEG 2000 pixel data by having
+  /// the decoder write each pixel through a lookup table that maps its stored
+  /// value straight to an RGB pixel. The table combines the grayscale
+  /// pipeline, the color palette, and the conversion of MONOCHROME1 to
+  /// MONOCHROME2, so the frame is decoded and rendered in one pass into a
+  /// single buffer, without creating a [`MonochromeImage`] and a grayscale
+  /// image for the whole frame.
+  ///
+  /// Returns `None` if the frame can't be rendered this way, in which case it's
+  /// decoded and then rendered.
+  ///
+  #[cfg(feature = "native")]
+  fn render_monochrome_lut_frame(
+    &self,
+    frame: &mut PixelDataFrame,
+    color_palette: Option<&StandardColorPalette>,
+    resolution_reduction: u32,
+  ) -> Option<Result<image::RgbImage, PixelDataDecodeError>> {
+    use crate::iods::image_pixel_module::BitsAllocated;
+
+    let is_signed = self.image_pixel_module.pixel_representation().is_signed();
+
+    let monochrome1_offset = self
+      .image_pixel_module
+      .photometric_interpretation()
+      .is_monochrome1()
+      .then(|| {
+        if is_signed {
+          -1
+        } else {
+          (1i64 << self.image_pixel_module.bits_stored()) - 1
+        }
+      });
+
+    // The grayscale pipeline's combined RGB table is shared by all frames, so
+    // it's copied into the output LUT rather than rebuilt for every frame
+    let pipeline = &self.grayscale_pipeline;
+    let sample_lut = match (self.image_pixel_module.bits_allocated(), is_signed)
+    {
+      (BitsAllocated::Eight, false) => {
+        pipeline.output_lut_rgb_u8::<u8>(monochrome1_offset, color_palette)
+      }
+      (BitsAllocated::Eight, true) => {
+        pipeline.output_lut_rgb_u8::<i8>(monochrome1_offset, color_palette)
+      }
+      (BitsAllocated::Sixteen, false) => {
+        pipeline.output_lut_rgb_u8::<u16>(monochrome1_offset, color_palette)
+      }
+      (BitsAllocated::Sixteen, true) => {
+        pipeline.output_lut_rgb_u8::<i16>(monochrome1_offset, color_palette)
+      }
+      (BitsAllocated::One | BitsAllocated::ThirtyTwo, _) => None,
+    }?;
+
+    let output_lut = decode::OutputLut::from_sample_lut(&sample_lut);
+
+    let result = decode::decode_monochrome_lut(
+      frame,
+      self.transfer_syntax,
+      &self.image_pixel_module,
+      &self.decode_config,
+      &self.decode_area.unwrap_or_default(),
+      resolution_reduction,
+      &output_lut,
+    )?;
+
+    Some(result.map(|(pixels, width, height)| {
+      image::RgbImage::from_raw(width.into(), height.into(), pixels).unwrap()
+    }))
+  }
+
+  /// Renders a frame of pixel data to an RGB 8-bit image in the same way as
+  /// [`Self::render_frame()`], and also renders lower quality previews of the
+  /// frame and passes them to `on_preview` while it's being decoded. This
+  /// allows a first paint long before the full frame is available.
+  ///
+  /// Previews are only produced for JPEG XL decoded with libjxl at full
+  /// resolution, see [`decode::decode_monochrome_progressive()`]. In all
+  /// other cases no previews are rendered.
+  ///
+  pub fn render_frame_progressive(
+    &self,
+    frame: &mut PixelDataFrame,
+    color_palette: Option<&StandardColorPalette>,
+    on_preview: &mut dyn FnMut(image::RgbImage),
+  ) -> Result<image::RgbImage, PixelDataDecodeError> {
+    if !self.transfer_syntax.is_jpeg_xl() || self.resolution_reduction != 0 {
+      return self.render_frame(frame, color_palette);
+    }
+
+    let decode_area = self.decode_area.unwrap_or_default();
+
+    if self.image_pixel_module.is_monochrome() {
+      let mut image = decode::decode_monochrome_progressive(
+        frame,
+        self.transfer_syntax,
+        &self.image_pixel_module,
+        &self.decode_config,
+        &mut |mut preview| {
+          preview.crop(&decode_area);
+          on_preview(self.render_monochrome_image(&preview, color_palette));
+        },
+      )?;
+
+      image.crop(&decode_area);
+
+      let rgb_image = self.render_monochrome_image(&image, color_palette);
+      frame_buffer_pool::recycle_monochrome_image(image);
+
+      Ok(rgb_image)
+    } else {
+      let mut image = decode::decode_color_progressive(
+        frame,
+        self.transfer_syntax,
+        &self.image_pixel_module,
+        &self.decode_config,
+        &mut |mut preview| {
+          preview.crop(&decode_area);
+          on_preview(preview.into_rgb_u8_image());
+        },
+      )?;
+
+      image.crop(&decode_area);
+
+      Ok(image.into_rgb_u8_image())
+    }
+  }
+
   /// Renders a [`MonochromeImage`] to an RGB 8-bit image. The grayscale
   /// pipeline is applied, and resulting grayscale values are then expanded
   /// to RGB.
@@ -109,24 +684,11 @@ impl PixelDataRenderer {
     image: &MonochromeImage,
     color_palette: Option<&StandardColorPalette>,
   ) -> image::RgbImage {
-    let mut pixels = Vec::with_capacity(image.pixel_count() * 3);
-
-    let gray_image = image.to_gray_u8_image(&self.grayscale_pipeline);
-
-    if let Some(color_palette) = color_palette {
-      for pixel in gray_image.pixels() {
-        pixels.extend_from_slice(&color_palette.lookup(pixel.0[0]));
-      }
-    } else {
-      for pixel in gray_image.pixels() {
-        pixels.push(pixel.0[0]);
-        pixels.push(pixel.0[0]);
-        pixels.push(pixel.0[0]);
-      }
-    }
-
-    image::RgbImage::from_raw(gray_image.width(), gray_image.height(), pixels)
-      .unwrap()
+    image.to_rgb_u8_image_with_threads(
+      &self.grayscale_pipeline,
+      color_palette,
+      self.decode_config.thread_count,
+    )
   }
 
   /// Decodes a frame of monochrome pixel data into a [`MonochromeImage`]. The
@@ -137,11 +699,41 @@ impl PixelDataRenderer {
     &self,
     frame: &mut PixelDataFrame,
   ) -> Result<MonochromeImage, PixelDataDecodeError> {
-    decode::decode_monochrome(
+    decode::decode_monochrome_region(
       frame,
       self.transfer_syntax,
       &self.image_pixel_module,
       &self.decode_config,
+      &self.decode_area.unwrap_or_default(),
+      self.resolution_reduction,
+    )
+  }
+
+  /// Decodes a frame of monochrome pixel data, passing the result to
+  /// `on_stripe` as a sequence of horizontal stripes along with the index of
+  /// each stripe's first row. See [`decode::decode_monochrome_stripes()`] for
+  /// details. When a decode area is set the frame is always passed as a single
+  /// stripe.
+  ///
+  pub fn decode_monochrome_frame_stripes(
+    &self,
+    frame: &mut PixelDataFrame,
+    rows_per_stripe: u16,
+    on_stripe: &mut dyn FnMut(MonochromeImage, u16),
+  ) -> Result<(), PixelDataDecodeError> {
+    if self.decode_area.is_some() {
+      on_stripe(self.decode_monochrome_frame(frame)?, 0);
+      return Ok(());
+    }
+
+    decode::decode_monochrome_stripes(
+      frame,
+      self.transfer_syntax,
+      &self.image_pixel_module,
+      &self.decode_config,
+      self.resolution_reduction,
+      rows_per_stripe,
+      on_stripe,
     )
   }
 
@@ -151,11 +743,131 @@ impl PixelDataRenderer {
     &self,
     frame: &mut PixelDataFrame,
   ) -> Result<ColorImage, PixelDataDecodeError> {
-    decode::decode_color(
+    decode::decode_color_region(
+      frame,
+      self.transfer_syntax,
+      &self.image_pixel_module,
+      &self.decode_config,
+      &self.decode_area.unwrap_or_default(),
+      self.resolution_reduction,
+    )
+  }
+
+  /// Decodes a frame of color pixel data, passing the result to `on_stripe` as
+  /// a sequence of horizontal stripes. See
+  /// [`Self::decode_monochrome_frame_stripes()`] for details.
+  ///
+  pub fn decode_color_frame_stripes(
+    &self,
+    frame: &mut PixelDataFrame,
+    rows_per_stripe: u16,
+    on_stripe: &mut dyn FnMut(ColorImage, u16),
+  ) -> Result<(), PixelDataDecodeError> {
+    if self.decode_area.is_some() {
+      on_stripe(self.decode_color_frame(frame)?, 0);
+      return Ok(());
+    }
+
+    decode::decode_color_stripes(
       frame,
       self.transfer_syntax,
       &self.image_pixel_module,
       &self.decode_config,
+      self.resolution_reduction,
+      rows_per_stripe,
+      on_stripe,
     )
   }
 }
+
+/// Returns the size of a thumbnail of a `width` x `height` image that fits
+/// inside `max_width` x `max_height` and preserves the image's aspect ratio.
+/// Images that already fit keep their size.
+///
+fn thumbnail_size(
+  width: u32,
+  height: u32,
+  max_width: u32,
+  max_height: u32,
+) -> (u32, u32) {
+  let max_width = max_width.max(1);
+  let max_height = max_height.max(1);
+
+  if width <= max_width && height <= max_height {
+    return (width, height);
+  }
+
+  let (width, height) = (u64::from(width), u64::from(height));
+  let (max_width, max_height) = (u64::from(max_width), u64::from(max_height));
+
+  if width * max_height > height * max_width {
+    let thumbnail_height = (height * max_width + width / 2) / width;
+    (max_width as u32, thumbnail_height.max(1) as u32)
+  } else {
+    let thumbnail_width = (width * max_height + height / 2) / height;
+    (thumbnail_width.max(1) as u32, max_height as u32)
+  }
+}
+
+/// Returns the largest resolution reduction at which a `width` x `height`
+/// image is still at least as large as a `thumbnail_width` x
+/// `thumbnail_height` thumbnail, which is the cheapest resolution to decode it
+/// at without losing detail the thumbnail needs.
+///
+fn thumbnail_resolution_reduction(
+  width: u32,
+  height: u32,
+  thumbnail_width: u32,
+  thumbnail_height: u32,
+) -> u32 {
+  let mut resolution_reduction = 0;
+
+  while resolution_reduction < 16
+    && width.div_ceil(2 << resolution_reduction) >= thumbnail_width
+    && height.div_ceil(2 << resolution_reduction) >= thumbnail_height
+  {
+    resolution_reduction += 1;
+  }
+
+  resolution_reduction
+}
+
+/// Output pixels that are written to concurrently by libjxl's worker threads,
+/// with each thread writing to different pixels.
+///
+#[cfg(all(feature = "native", feature = "std"))]
+struct SharedOutput(*mut u8);
+
+#[cfg(all(feature = "native", feature = "std"))]
+unsafe impl Sync for SharedOutput {}
+
+#[cfg(all(feature = "native", feature = "std"))]
+impl SharedOutput {
+  fn get(&self) -> *mut u8 {
+    self.0
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn thumbnail_size_preserves_aspect_ratio() {
+    assert_eq!(thumbnail_size(512, 512, 128, 128), (128, 128));
+    assert_eq!(thumbnail_size(1024, 512, 128, 128), (128, 64));
+    assert_eq!(thumbnail_size(500, 1001, 100, 100), (50, 100));
+    assert_eq!(thumbnail_size(10000, 3, 100, 100), (100, 1));
+    assert_eq!(thumbnail_size(64, 48, 128, 128), (64, 48));
+  }
+
+  #[test]
+  fn thumbnail_resolution_reduction_keeps_thumbnail_detail() {
+    assert_eq!(thumbnail_resolution_reduction(512, 512, 512, 512), 0);
+    assert_eq!(thumbnail_resolution_reduction(512, 512, 256, 256), 1);
+    assert_eq!(thumbnail_resolution_reduction(512, 512, 255, 255), 1);
+    assert_eq!(thumbnail_resolution_reduction(512, 512, 64, 64), 3);
+    assert_eq!(thumbnail_resolution_reduction(513, 513, 66, 66), 2);
+    assert_eq!(thumbnail_resolution_reduction(1000, 600, 100, 60), 3);
+  }
+}
@@ -0,0 +1,353 @@
+#[cfg(not(feature = "std"))]
+use alloc::{vec, vec::Vec};
+
+use crate::{ColorImage, ColorImageData, ColorSpace};
+
+/// A YBR color image that stores its Y, Cb, and Cr samples in three separate
+/// planes. The Y plane is at the full resolution of the image, and the Cb and
+/// Cr planes may be subsampled, e.g. to half the width for YBR 4:2:2.
+///
+/// This is the form that YBR data is stored in by JPEG and JPEG 2000, and so it
+/// can be decoded into without the chroma upsampling and color conversion done
+/// when decoding into a [`ColorImage`]. It's intended for renderers that do
+/// that work themselves, e.g. in a shader.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct PlanarYbrImage {
+  width: u16,
+  height: u16,
+  chroma_width: u16,
+  chroma_height: u16,
+  data: PlanarYbrImageData,
+  bits_stored: u16,
+}
+
+#[derive(Clone, Debug, PartialEq)]
+pub enum PlanarYbrImageData {
+  U8 {
+    y: Vec<u8>,
+    cb: Vec<u8>,
+    cr: Vec<u8>,
+  },
+  U16 {
+    y: Vec<u16>,
+    cb: Vec<u16>,
+    cr: Vec<u16>,
+  },
+}
+
+impl PlanarYbrImage {
+  /// Creates a new planar YBR image with `u8` data. The Y plane holds
+  /// `width * height` samples, and the Cb and Cr planes each hold
+  /// `chroma_width * chroma_height` samples.
+  ///
+  #[allow(clippy::too_many_arguments)]
+  pub fn new_u8(
+    width: u16,
+    height: u16,
+    chroma_width: u16,
+    chroma_height: u16,
+    y: Vec<u8>,
+    cb: Vec<u8>,
+    cr: Vec<u8>,
+    bits_stored: u16,
+  ) -> Result<Self, &'static str> {
+    Self::check_plane_sizes(
+      width,
+      height,
+      chroma_width,
+      chroma_height,
+      [y.len(), cb.len(), cr.len()],
+    )?;
+
+    if bits_stored == 0 || bits_stored > 8 {
+      return Err("Planar YBR image u8 bits stored must be <= 8");
+    }
+
+    Ok(Self {
+      width,
+      height,
+      chroma_width,
+      chroma_height,
+      data: PlanarYbrImageData::U8 { y, cb, cr },
+      bits_stored,
+    })
+  }
+
+  /// Creates a new planar YBR image with `u16` data. See [`Self::new_u8()`].
+  ///
+  #[allow(clippy::too_many_arguments)]
+  pub fn new_u16(
+    width: u16,
+    height: u16,
+    chroma_width: u16,
+    chroma_height: u16,
+    y: Vec<u16>,
+    cb: Vec<u16>,
+    cr: Vec<u16>,
+    bits_stored: u16,
+  ) -> Result<Self, &'static str> {
+    Self::check_plane_sizes(
+      width,
+      height,
+      chroma_width,
+      chroma_height,
+      [y.len(), cb.len(), cr.len()],
+    )?;
+
+    if bits_stored == 0 || bits_stored > 16 {
+      return Err("Planar YBR image u16 bits stored must be <= 16");
+    }
+
+    Ok(Self {
+      width,
+      height,
+      chroma_width,
+      chroma_height,
+      data: PlanarYbrImageData::U16 { y, cb, cr },
+      bits_stored,
+    })
+  }
+
+  fn check_plane_sizes(
+    width: u16,
+    height: u16,
+    chroma_width: u16,
+    chroma_height: u16,
+    plane_sizes: [usize; 3],
+  ) -> Result<(), &'static str> {
+    if chroma_width > width || chroma_height > height {
+      return Err("Planar YBR image chroma is larger than the image");
+    }
+
+    let chroma_size = usize::from(chroma_width) * usize::from(chroma_height);
+
+    if plane_sizes
+      != [
+        usize::from(width) * usize::from(height),
+        chroma_size,
+        chroma_size,
+      ]
+    {
+      return Err("Planar YBR image plane size is incorrect");
+    }
+
+    Ok(())
+  }
+
+  /// Creates a planar YBR image from a [`ColorImage`] by splitting its samples
+  /// into planes. RGB data is first converted to YBR. Data that's YBR 4:2:2 is
+  /// given Cb and Cr planes of half the width, which average each horizontal
+  /// pair of chroma samples.
+  ///
+  /// This is used when a frame can't be decoded straight into planes.
+  /// Palette color and 32-bit images aren't supported.
+  ///
+  pub fn from_color_image(mut image: ColorImage) -> Result<Self, &'static str> {
+    let is_422 = image.color_space() == ColorSpace::Ybr { is_422: true };
+
+    image.convert_to_ybr_color_space();
+
+    let width = image.width();
+    let height = image.height();
+    let bits_stored = image.bits_stored();
+
+    let chroma_width = if is_422 { width.div_ceil(2) } else { width };
+
+    match image.into_data() {
+      ColorImageData::U8 { data, .. } => {
+        let (y, cb, cr) = split_planes(&data, width, chroma_width);
+
+        Self::new_u8(
+          width,
+          height,
+          chroma_width,
+          height,
+          y,
+          cb,
+          cr,
+          bits_stored,
+        )
+      }
+
+      ColorImageData::U16 { data, .. } => {
+        let (y, cb, cr) = split_planes(&data, width, chroma_width);
+
+        Self::new_u16(
+          width,
+          height,
+          chroma_width,
+          height,
+          y,
+          cb,
+          cr,
+          bits_stored,
+        )
+      }
+
+      _ => Err("Planar YBR image requires 8-bit or 16-bit YBR or RGB data"),
+    }
+  }
+
+  /// Returns the width in pixels of this image, which is the width of its Y
+  /// plane.
+  ///
+  pub fn width(&self) -> u16 {
+    self.width
+  }
+
+  /// Returns the height in pixels of this image, which is the height of its Y
+  /// plane.
+  ///
+  pub fn height(&self) -> u16 {
+    self.height
+  }
+
+  /// Returns the width of the Cb and Cr planes of this image.
+  ///
+  pub fn chroma_width(&self) -> u16 {
+    self.chroma_width
+  }
+
+  /// Returns the height of the Cb and Cr planes of this image.
+  ///
+  pub fn chroma_height(&self) -> u16 {
+    self.chroma_height
+  }
+
+  /// Returns whether the Cb and Cr planes of this image are subsampled as
+  /// 4:2:2, i.e. to half the width and the full height.
+  ///
+  pub fn is_422(&self) -> bool {
+    self.chroma_width < self.width && self.chroma_height == self.height
+  }
+
+  /// Returns the internal data of this image.
+  ///
+  pub fn data(&self) -> &PlanarYbrImageData {
+    &self.data
+  }
+
+  /// Consumes this image and returns its internal data.
+  ///
+  pub fn into_data(self) -> PlanarYbrImageData {
+    self.data
+  }
+
+  /// Returns the number of bits stored for each sample.
+  ///
+  pub fn bits_stored(&self) -> u16 {
+    self.bits_stored
+  }
+}
+
+/// Splits interleaved YBR samples into Y, Cb, and Cr planes. When the chroma
+/// width is less than the width then each horizontal pair of chroma samples is
+/// averaged.
+///
+fn split_planes<T>(
+  data: &[T],
+  width: u16,
+  chroma_width: u16,
+) -> (Vec<T>, Vec<T>, Vec<T>)
+where
+  T: Copy + Default + Into<u32> + TryFrom<u32>,
+{
+  let width = usize::from(width);
+  let chroma_width = usize::from(chroma_width);
+  let height = data.len() / 3 / width.max(1);
+
+  let mut y = vec![T::default(); width * height];
+  let mut cb = vec![T::default(); chroma_width * height];
+  let mut cr = vec![T::default(); chroma_width * height];
+
+  let average = |a: T, b: T| {
+    let sum = Into::<u32>::into(a) + Into::<u32>::into(b);
+    T::try_from(sum.div_ceil(2)).unwrap_or_default()
+  };
+
+  for (row, pixels) in data.chunks_exact(width.max(1) * 3).enumerate() {
+    for (sample, pixel) in
+      y[row * width..].iter_mut().zip(pixels.chunks_exact(3))
+    {
+      *sample = pixel[0];
+    }
+
+    let cb = &mut cb[row * chroma_width..(row + 1) * chroma_width];
+    let cr = &mut cr[row * chroma_width..(row + 1) * chroma_width];
+
+    if chroma_width == width {
+      for ((cb, cr), pixel) in
+        cb.iter_mut().zip(cr.iter_mut()).zip(pixels.chunks_exact(3))
+      {
+        *cb = pixel[1];
+        *cr = pixel[2];
+      }
+    } else {
+      for ((cb, cr), pixels) in
+        cb.iter_mut().zip(cr.iter_mut()).zip(pixels.chunks(6))
+      {
+        match pixels {
+          [_, cb0, cr0, _, cb1, cr1] => {
+            *cb = average(*cb0, *cb1);
+            *cr = average(*cr0, *cr1);
+          }
+          _ => {
+            *cb = pixels[1];
+            *cr = pixels[2];
+          }
+        }
+      }
+    }
+  }
+
+  (y, cb, cr)
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn from_color_image_422() {
+    let image = ColorImage::new_u8(
+      3,
+      1,
+      vec![10, 100, 200, 20, 102, 202, 30, 50, 60],
+      ColorSpace::Ybr { is_422: true },
+      8,
+    )
+    .unwrap();
+
+    let image = PlanarYbrImage::from_color_image(image).unwrap();
+
+    assert!(image.is_422());
+    assert_eq!(
+      image,
+      PlanarYbrImage::new_u8(
+        3,
+        1,
+        2,
+        1,
+        vec![10, 20, 30],
+        vec![101, 50],
+        vec![201, 60],
+        8
+      )
+      .unwrap()
+    );
+  }
+
+  #[test]
+  fn new_u8_checks_plane_sizes() {
+    assert!(
+      PlanarYbrImage::new_u8(2, 2, 1, 2, vec![0; 4], vec![0; 2], vec![0; 2], 8)
+        .is_ok()
+    );
+
+    assert!(
+      PlanarYbrImage::new_u8(2, 2, 1, 2, vec![0; 4], vec![0; 4], vec![0; 2], 8)
+        .is_err()
+    );
+  }
+}
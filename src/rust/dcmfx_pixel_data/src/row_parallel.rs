@@ -0,0 +1,277 @@
+//! Splits conversions of image data into bands of whole rows that are
+//! processed concurrently on scoped worker threads.
+//!
+//! Worker threads are only used when the `parallel` feature is enabled and the
+//! image is large enough for them to be worthwhile. Otherwise, including for
+//! `no_std` and WASM builds, the whole image is processed on the calling thread.
+
+/// Implemented for types that are [`Send`] when the `parallel` feature is
+/// enabled, and for all types otherwise. This allows the same conversion code
+/// to handle types that aren't thread-safe in `no_std` builds, e.g. because
+/// they hold an `Rc`.
+///
+#[cfg(feature = "parallel")]
+pub(crate) trait MaybeSend: Send {}
+#[cfg(feature = "parallel")]
+impl<T: Send> MaybeSend for T {}
+#[cfg(not(feature = "parallel"))]
+pub(crate) trait MaybeSend {}
+#[cfg(not(feature = "parallel"))]
+impl<T> MaybeSend for T {}
+
+/// Implemented for types that are [`Sync`] when the `parallel` feature is
+/// enabled, and for all types otherwise. See [`MaybeSend`].
+///
+#[cfg(feature = "parallel")]
+pub(crate) trait MaybeSync: Sync {}
+#[cfg(feature = "parallel")]
+impl<T: Sync> MaybeSync for T {}
+#[cfg(not(feature = "parallel"))]
+pub(crate) trait MaybeSync {}
+#[cfg(not(feature = "parallel"))]
+impl<T> MaybeSync for T {}
+
+/// The minimum number of values each worker thread is given. Images smaller
+/// than this are processed on the calling thread, as starting threads for them
+/// costs more time than it saves.
+///
+#[cfg(feature = "parallel")]
+const MIN_VALUES_PER_WORKER: usize = 1 << 18;
+
+/// Returns the number of workers to split `value_count` values in
+/// `row_count` rows across. A `thread_count` of zero uses one thread per CPU
+/// core.
+///
+#[cfg(feature = "parallel")]
+fn worker_count(
+  thread_count: usize,
+  value_count: usize,
+  row_count: usize,
+) -> usize {
+  let thread_count = if thread_count == 0 {
+    std::thread::available_parallelism().map_or(1, |n| n.get())
+  } else {
+    thread_count
+  };
+
+  thread_count
+    .min(value_count / MIN_VALUES_PER_WORKER)
+    .min(row_count)
+    .max(1)
+}
+
+/// Calls `f` on each of `parts` concurrently, one part per thread, including
+/// the calling thread. The parts run on the shared worker pool when one has
+/// been set, see [`crate::worker_pool::set_shared()`], and otherwise each part
+/// after the first is run on a new scoped thread.
+///
+#[cfg(feature = "parallel")]
+fn run_concurrently<P: Send>(parts: Vec<P>, f: &(impl Fn(P) + Sync)) {
+  if let Some(worker_pool) = crate::worker_pool::shared() {
+    let parts: Vec<std::sync::Mutex<Option<P>>> = parts
+      .into_iter()
+      .map(|part| std::sync::Mutex::new(Some(part)))
+      .collect();
+
+    worker_pool.run(0..parts.len() as u32, &|i, _| {
+      if let Some(part) = parts[i as usize].lock().unwrap().take() {
+        f(part);
+      }
+    });
+
+    return;
+  }
+
+  std::thread::scope(|scope| {
+    let mut parts = parts.into_iter();
+    let first_part = parts.next();
+
+    for part in parts {
+      scope.spawn(move || f(part));
+    }
+
+    if let Some(part) = first_part {
+      f(part);
+    }
+  });
+}
+
+/// Calls `f` on bands of whole rows of `data`, where each row has `row_size`
+/// values. The bands are processed concurrently on up to `thread_count`
+/// threads, including the calling thread.
+///
+pub(crate) fn for_each_band_mut<T: MaybeSend>(
+  data: &mut [T],
+  row_size: usize,
+  thread_count: usize,
+  f: impl Fn(&mut [T]) + MaybeSync,
+) {
+  #[cfg(feature = "parallel")]
+  {
+    let row_count = data.len().checked_div(row_size).unwrap_or(0);
+    let workers = worker_count(thread_count, data.len(), row_count);
+
+    if workers > 1 {
+      let band_size = row_count.div_ceil(workers) * row_size;
+
+      run_concurrently(data.chunks_mut(band_size).collect::<Vec<_>>(), &f);
+
+      return;
+    }
+  }
+
+  #[cfg(not(feature = "parallel"))]
+  let _ = (row_size, thread_count);
+
+  f(data);
+}
+
+/// Calls `f` on matching bands of whole rows of `input` and `output`, where
+/// each row has `input_row_size` and `output_row_size` values respectively.
+/// The bands are processed concurrently on up to `thread_count` threads,
+/// including the calling thread.
+///
+pub(crate) fn for_each_band_zip<T: MaybeSync, U: MaybeSend>(
+  input: &[T],
+  input_row_size: usize,
+  output: &mut [U],
+  output_row_size: usize,
+  thread_count: usize,
+  f: impl Fn(&[T], &mut [U]) + MaybeSync,
+) {
+  #[cfg(feature = "parallel")]
+  {
+    let row_count = output.len().checked_div(output_row_size).unwrap_or(0);
+    let workers = worker_count(thread_count, output.len(), row_count);
+
+    if workers > 1 {
+      let rows_per_band = row_count.div_ceil(workers);
+
+      let bands = input
+        .chunks(rows_per_band * input_row_size)
+        .zip(output.chunks_mut(rows_per_band * output_row_size))
+        .collect::<Vec<_>>();
+
+      run_concurrently(bands, &|(input, output)| f(input, output));
+
+      return;
+    }
+  }
+
+  #[cfg(not(feature = "parallel"))]
+  let _ = (input_row_size, output_row_size, thread_count);
+
+  f(input, output);
+}
+
+/// Calls `f` on each of `items`, where each item is roughly `values_per_item`
+/// values of work, e.g. the independent segments of a frame. The items are
+/// processed concurrently on up to `thread_count` threads, including the
+/// calling thread.
+///
+pub(crate) fn for_each_item_mut<T: MaybeSend>(
+  items: &mut [T],
+  values_per_item: usize,
+  thread_count: usize,
+  f: impl Fn(&mut T) + MaybeSync,
+) {
+  #[cfg(feature = "parallel")]
+  {
+    let workers =
+      worker_count(thread_count, items.len() * values_per_item, items.len());
+
+    if workers > 1 {
+      let items_per_worker = items.len().div_ceil(workers);
+
+      run_concurrently(
+        items.chunks_mut(items_per_worker).collect::<Vec<_>>(),
+        &|chunk| chunk.iter_mut().for_each(&f),
+      );
+
+      return;
+    }
+  }
+
+  #[cfg(not(feature = "parallel"))]
+  let _ = (values_per_item, thread_count);
+
+  items.iter_mut().for_each(f);
+}
+
+#[cfg(all(test, feature = "parallel"))]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn for_each_band_mut_covers_all_rows() {
+    let mut data = vec![0u32; 1000 * 1003];
+
+    for_each_band_mut(&mut data, 1000, 4, |band| {
+      assert_eq!(band.len() % 1000, 0);
+
+      for value in band.iter_mut() {
+        *value += 1;
+      }
+    });
+
+    assert!(data.iter().all(|value| *value == 1));
+  }
+
+  #[test]
+  fn for_each_band_zip_matches_rows() {
+    let input: Vec<u32> = (0..1000 * 1003).collect();
+    let mut output = vec![0u64; input.len() * 3];
+
+    for_each_band_zip(&input, 1000, &mut output, 3000, 4, |input, output| {
+      assert_eq!(input.len() * 3, output.len());
+
+      for (i, rgb) in input.iter().zip(output.chunks_exact_mut(3)) {
+        rgb.fill(u64::from(*i));
+      }
+    });
+
+    for (i, rgb) in output.chunks_exact(3).enumerate() {
+      assert_eq!(rgb, [i as u64; 3]);
+    }
+  }
+
+  #[test]
+  fn for_each_item_mut_visits_all_items() {
+    let mut items: Vec<(usize, usize)> = (0..15).map(|i| (i, 0)).collect();
+
+    for_each_item_mut(&mut items, MIN_VALUES_PER_WORKER, 4, |(i, value)| {
+      *value = *i * 2;
+    });
+
+    assert!(items.iter().all(|(i, value)| *value == i * 2));
+  }
+
+  #[test]
+  fn for_each_band_mut_on_shared_worker_pool() {
+    use std::sync::Arc;
+
+    crate::worker_pool::set_shared(Some(Arc::new(
+      crate::worker_pool::WorkerPool::new(3),
+    )));
+
+    let mut data = vec![0u32; 1000 * 1003];
+
+    for_each_band_mut(&mut data, 1000, 4, |band| {
+      for value in band.iter_mut() {
+        *value += 1;
+      }
+    });
+
+    crate::worker_pool::set_shared(None);
+
+    assert!(data.iter().all(|value| *value == 1));
+  }
+
+  #[test]
+  fn worker_count_limits() {
+    assert_eq!(worker_count(8, 100, 10), 1);
+    assert_eq!(worker_count(8, MIN_VALUES_PER_WORKER * 3, 1000), 3);
+    assert_eq!(worker_count(2, MIN_VALUES_PER_WORKER * 3, 1000), 2);
+    assert_eq!(worker_count(8, MIN_VALUES_PER_WORKER * 16, 4), 4);
+  }
+}
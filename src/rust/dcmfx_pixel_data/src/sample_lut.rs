@@ -0,0 +1,166 @@
+#[cfg(not(feature = "std"))]
+use alloc::vec::Vec;
+
+/// A sample type that can index a [`SampleLut`], i.e. a signed or unsigned 8-bit
+/// or 16-bit integer.
+///
+pub(crate) trait LutSample: Copy {
+  /// The number of distinct values of this sample type, which is the number of
+  /// entries in a [`SampleLut`] for it.
+  ///
+  const VALUE_COUNT: usize;
+
+  /// Returns the index of this sample's entry in a [`SampleLut`], which is its
+  /// bits.
+  ///
+  fn lut_index(self) -> usize;
+
+  /// Returns the stored value of the sample whose bits are the given index.
+  ///
+  fn stored_value(lut_index: usize) -> i64;
+}
+
+impl LutSample for u8 {
+  const VALUE_COUNT: usize = 1 << 8;
+
+  fn lut_index(self) -> usize {
+    usize::from(self)
+  }
+
+  fn stored_value(lut_index: usize) -> i64 {
+    lut_index as u8 as i64
+  }
+}
+
+impl LutSample for i8 {
+  const VALUE_COUNT: usize = 1 << 8;
+
+  fn lut_index(self) -> usize {
+    usize::from(self as u8)
+  }
+
+  fn stored_value(lut_index: usize) -> i64 {
+    lut_index as u8 as i8 as i64
+  }
+}
+
+impl LutSample for u16 {
+  const VALUE_COUNT: usize = 1 << 16;
+
+  fn lut_index(self) -> usize {
+    usize::from(self)
+  }
+
+  fn stored_value(lut_index: usize) -> i64 {
+    lut_index as u16 as i64
+  }
+}
+
+impl LutSample for i16 {
+  const VALUE_COUNT: usize = 1 << 16;
+
+  fn lut_index(self) -> usize {
+    usize::from(self as u16)
+  }
+
+  fn stored_value(lut_index: usize) -> i64 {
+    lut_index as u16 as i16 as i64
+  }
+}
+
+/// A flattened lookup table that maps every value of an 8-bit or 16-bit sample
+/// directly to its final output, e.g. a grayscale pipeline followed by a color
+/// palette compiled into a single table of RGB colors.
+///
+/// Because the table has an entry for every possible sample value, applying it
+/// is a single indexed load per sample with no range checks or clamping, and
+/// out of range stored values, such as 12-bit data with stray high bits set,
+/// are handled by whatever the conversion function returned for them when the
+/// table was built.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub(crate) struct SampleLut<T: Copy> {
+  entries: Vec<T>,
+}
+
+impl<T: Copy> SampleLut<T> {
+  /// Creates a new lookup table for samples of type `S` by passing the stored
+  /// value of every possible sample to `stored_value_to_output`.
+  ///
+  pub fn new<S: LutSample>(stored_value_to_output: impl Fn(i64) -> T) -> Self {
+    let entries = (0..S::VALUE_COUNT)
+      .map(|lut_index| stored_value_to_output(S::stored_value(lut_index)))
+      .collect();
+
+    Self { entries }
+  }
+
+  /// Returns the entries of this lookup table, indexed by the bits of each
+  /// sample.
+  ///
+  #[cfg(feature = "native")]
+  pub fn entries(&self) -> &[T] {
+    &self.entries
+  }
+
+  /// Looks up each of `samples` and writes the results to `outputs`, which
+  /// must be the same length. `S` must be the sample type this table was
+  /// created for.
+  ///
+  pub fn apply<S: LutSample>(&self, samples: &[S], outputs: &mut [T]) {
+    // Slicing the entries to the sample type's value count lets the compiler
+    // see that every sample's index is in bounds, which leaves a tight loop of
+    // loads that it's able to unroll
+    let entries = &self.entries[..S::VALUE_COUNT];
+
+    for (output, sample) in outputs.iter_mut().zip(samples) {
+      *output = entries[sample.lut_index()];
+    }
+  }
+}
+
+impl<U: Copy, const N: usize> SampleLut<[U; N]> {
+  /// The same as [`Self::apply()`], but the outputs are written to a slice of
+  /// interleaved channels, e.g. RGB pixel data, that has `N` values for each
+  /// sample.
+  ///
+  pub fn apply_interleaved<S: LutSample>(
+    &self,
+    samples: &[S],
+    outputs: &mut [U],
+  ) {
+    self.apply(samples, outputs.as_chunks_mut::<N>().0);
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn apply_signed_samples() {
+    let lut = SampleLut::new::<i8>(|stored_value| stored_value * 2);
+
+    assert_eq!(lut.entries.len(), 256);
+
+    let mut outputs = [0i64; 4];
+    lut.apply(&[0i8, 1, -1, -128], &mut outputs);
+
+    assert_eq!(outputs, [0, 2, -2, -256]);
+  }
+
+  #[test]
+  fn apply_interleaved_samples() {
+    let lut = SampleLut::new::<u16>(|stored_value| {
+      let value = stored_value.min(4095) as u16;
+      [value, value / 2, value / 4]
+    });
+
+    assert_eq!(lut.entries.len(), 65536);
+
+    let mut outputs = [0u16; 9];
+    lut.apply_interleaved(&[8u16, 4095, 65535], &mut outputs);
+
+    assert_eq!(outputs, [8, 4, 2, 4095, 2047, 1023, 4095, 2047, 1023]);
+  }
+}
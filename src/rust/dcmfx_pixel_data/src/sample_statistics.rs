@@ -0,0 +1,316 @@
+#[cfg(not(feature = "std"))]
+use alloc::{vec, vec::Vec};
+
+#[cfg(feature = "native")]
+use crate::iods::image_pixel_module::{ImagePixelModule, PixelRepresentation};
+use crate::{
+  MonochromeImage, MonochromeImageData,
+  iods::voi_lut_module::{VoiLutFunction, VoiWindow},
+};
+
+/// Statistics of the stored values of a monochrome image, i.e. their minimum
+/// and maximum, and optionally a coarse histogram. These are what's needed to
+/// set a default VOI window or run an auto-window heuristic, and are gathered
+/// while decoding by [`crate::decode::decode_monochrome_with_statistics()`]
+/// where the decoder supports it, which saves a later pass over the image.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct SampleStatistics {
+  min_max_values: Option<(i64, i64)>,
+  histogram: Option<SampleHistogram>,
+}
+
+/// A coarse histogram of the stored values of a monochrome image. There are at
+/// most 256 bins, which evenly divide the range of values allowed by the bits
+/// stored, and values outside that range are counted in the first or last bin.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct SampleHistogram {
+  first_value: i64,
+  bin_width_shift: u32,
+  counts: Vec<u32>,
+}
+
+impl SampleStatistics {
+  /// Computes the statistics of a monochrome image's stored values with a
+  /// single pass over its data.
+  ///
+  pub fn from_image(image: &MonochromeImage, include_histogram: bool) -> Self {
+    let mut histogram = include_histogram
+      .then(|| SampleHistogram::new(image.bits_stored(), image.is_signed()));
+
+    fn gather<T: Copy + Into<i64>>(
+      data: &[T],
+      histogram: &mut Option<SampleHistogram>,
+    ) -> Option<(i64, i64)> {
+      let mut min_max: Option<(i64, i64)> = None;
+
+      for value in data.iter().map(|value| (*value).into()) {
+        min_max = Some(match min_max {
+          Some((min, max)) => (min.min(value), max.max(value)),
+          None => (value, value),
+        });
+
+        if let Some(histogram) = histogram.as_mut() {
+          histogram.add(value);
+        }
+      }
+
+      min_max
+    }
+
+    let min_max_values = match image.data() {
+      MonochromeImageData::Bitmap { .. } => {
+        gather(&image.to_stored_values(), &mut histogram)
+      }
+      MonochromeImageData::I8(data) => gather(data, &mut histogram),
+      MonochromeImageData::U8(data) => gather(data, &mut histogram),
+      MonochromeImageData::I16(data) => gather(data, &mut histogram),
+      MonochromeImageData::U16(data) => gather(data, &mut histogram),
+      MonochromeImageData::I32(data) => gather(data, &mut histogram),
+      MonochromeImageData::U32(data) => gather(data, &mut histogram),
+    };
+
+    Self {
+      min_max_values,
+      histogram,
+    }
+  }
+
+  /// Returns the minimum and maximum stored values, or `None` if the image has
+  /// no pixels. These are the same as [`MonochromeImage::min_max_values()`].
+  ///
+  pub fn min_max_values(&self) -> Option<(i64, i64)> {
+    self.min_max_values
+  }
+
+  /// Returns a VOI Window that covers the full range of stored values. This is
+  /// the same as [`MonochromeImage::default_voi_window()`].
+  ///
+  pub fn default_voi_window(&self) -> Option<VoiWindow> {
+    self.min_max_values.map(|(min, max)| {
+      VoiWindow::new(
+        (max + min) as f32 * 0.5,
+        (max - min) as f32,
+        "".into(),
+        VoiLutFunction::LinearExact,
+      )
+    })
+  }
+
+  /// Returns the histogram of the stored values, if one was requested.
+  ///
+  pub fn histogram(&self) -> Option<&SampleHistogram> {
+    self.histogram.as_ref()
+  }
+}
+
+impl SampleHistogram {
+  /// Creates an empty histogram whose bins cover the range of values allowed
+  /// by the given bits stored and signedness.
+  ///
+  fn new(bits_stored: u16, is_signed: bool) -> Self {
+    let bits_stored = u32::from(bits_stored.clamp(1, 32));
+
+    let first_value = if is_signed {
+      -(1i64 << (bits_stored - 1))
+    } else {
+      0
+    };
+
+    Self {
+      first_value,
+      bin_width_shift: bits_stored.saturating_sub(8),
+      counts: vec![0; 1 << bits_stored.min(8)],
+    }
+  }
+
+  /// Returns the lowest stored value counted by the first bin.
+  ///
+  pub fn first_value(&self) -> i64 {
+    self.first_value
+  }
+
+  /// Returns the number of stored values covered by each bin.
+  ///
+  pub fn bin_width(&self) -> u64 {
+    1 << self.bin_width_shift
+  }
+
+  /// Returns the number of stored values counted in each bin.
+  ///
+  pub fn counts(&self) -> &[u32] {
+    &self.counts
+  }
+
+  /// Returns the range of stored values covered by a bin as an inclusive
+  /// lower and upper bound.
+  ///
+  pub fn bin_range(&self, index: usize) -> (i64, i64) {
+    let start = self.first_value + ((index as i64) << self.bin_width_shift);
+
+    (start, start + (1i64 << self.bin_width_shift) - 1)
+  }
+
+  fn add(&mut self, value: i64) {
+    let offset = (value - self.first_value).max(0) as u64;
+    let bin = (offset >> self.bin_width_shift) as usize;
+
+    self.counts[bin.min(self.counts.len() - 1)] += 1;
+  }
+}
+
+/// Sample statistics gathered by a native decoder as it writes its output. The
+/// layout of this struct matches `pixel_kernels_stats`.
+///
+#[cfg(feature = "native")]
+#[repr(C)]
+pub(crate) struct PixelKernelsStats {
+  min: i32,
+  max: i32,
+  histogram: *mut u32,
+  histogram_size: usize,
+  histogram_min: i32,
+  histogram_shift: u32,
+}
+
+/// Sample statistics that are passed to a native decoder to be filled in as it
+/// decodes, and that then fall back to being computed from the decoded image
+/// if the decoder didn't fill them in or they don't apply to the image.
+///
+#[cfg(feature = "native")]
+pub(crate) struct FusedSampleStatistics {
+  stats: PixelKernelsStats,
+  histogram: Option<SampleHistogram>,
+  is_valid: bool,
+}
+
+#[cfg(feature = "native")]
+impl FusedSampleStatistics {
+  /// Creates empty statistics for decoding pixel data described by the passed
+  /// Image Pixel Module.
+  ///
+  pub fn new(
+    image_pixel_module: &ImagePixelModule,
+    include_histogram: bool,
+  ) -> Self {
+    let mut histogram = include_histogram.then(|| {
+      SampleHistogram::new(
+        image_pixel_module.bits_stored(),
+        image_pixel_module.pixel_representation()
+          == PixelRepresentation::Signed,
+      )
+    });
+
+    let stats = match histogram.as_mut() {
+      Some(histogram) => PixelKernelsStats {
+        min: i32::MAX,
+        max: i32::MIN,
+        histogram: histogram.counts.as_mut_ptr(),
+        histogram_size: histogram.counts.len(),
+        histogram_min: histogram.first_value as i32,
+        histogram_shift: histogram.bin_width_shift,
+      },
+
+      None => PixelKernelsStats {
+        min: i32::MAX,
+        max: i32::MIN,
+        histogram: core::ptr::null_mut(),
+        histogram_size: 0,
+        histogram_min: 0,
+        histogram_shift: 0,
+      },
+    };
+
+    Self {
+      stats,
+      histogram,
+      is_valid: true,
+    }
+  }
+
+  /// Returns the pointer to pass to the native decoder. The histogram's
+  /// storage is on the heap, so the pointer to it stays valid if `self` moves.
+  ///
+  pub fn as_mut_ptr(&mut self) -> *mut PixelKernelsStats {
+    &mut self.stats
+  }
+
+  /// Marks the statistics as not matching the decoded image, e.g. because its
+  /// samples were altered after being decoded, so they'll be computed from the
+  /// image instead.
+  ///
+  pub fn invalidate(&mut self) {
+    self.is_valid = false;
+  }
+
+  /// Returns the final statistics for the decoded image.
+  ///
+  pub fn finish(self, image: &MonochromeImage) -> SampleStatistics {
+    // The decoder doesn't touch the statistics if it didn't gather them
+    if !self.is_valid || self.stats.min > self.stats.max {
+      return SampleStatistics::from_image(image, self.histogram.is_some());
+    }
+
+    SampleStatistics {
+      min_max_values: Some((self.stats.min.into(), self.stats.max.into())),
+      histogram: self.histogram,
+    }
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn from_image_u16() {
+    let image =
+      MonochromeImage::new_u16(4, 1, vec![0, 100, 4095, 2048], 12, false)
+        .unwrap();
+
+    let statistics = SampleStatistics::from_image(&image, true);
+
+    assert_eq!(statistics.min_max_values(), Some((0, 4095)));
+    assert_eq!(statistics.min_max_values(), image.min_max_values());
+
+    let histogram = statistics.histogram().unwrap();
+    assert_eq!(histogram.first_value(), 0);
+    assert_eq!(histogram.bin_width(), 16);
+    assert_eq!(histogram.counts().len(), 256);
+    assert_eq!(histogram.counts()[0], 1);
+    assert_eq!(histogram.counts()[6], 1);
+    assert_eq!(histogram.counts()[128], 1);
+    assert_eq!(histogram.counts()[255], 1);
+    assert_eq!(histogram.bin_range(6), (96, 111));
+  }
+
+  #[test]
+  fn from_image_i8() {
+    let image =
+      MonochromeImage::new_i8(3, 1, vec![-8, 0, 7], 4, false).unwrap();
+
+    let statistics = SampleStatistics::from_image(&image, true);
+
+    assert_eq!(statistics.min_max_values(), Some((-8, 7)));
+
+    let histogram = statistics.histogram().unwrap();
+    assert_eq!(histogram.first_value(), -8);
+    assert_eq!(histogram.bin_width(), 1);
+    assert_eq!(histogram.counts().len(), 16);
+    assert_eq!(histogram.counts()[0], 1);
+    assert_eq!(histogram.counts()[8], 1);
+    assert_eq!(histogram.counts()[15], 1);
+  }
+
+  #[test]
+  fn from_image_without_histogram() {
+    let image = MonochromeImage::new_u8(2, 1, vec![3, 9], 8, false).unwrap();
+
+    let statistics = SampleStatistics::from_image(&image, false);
+
+    assert_eq!(statistics.min_max_values(), Some((3, 9)));
+    assert_eq!(statistics.histogram(), None);
+    assert_eq!(statistics.default_voi_window(), image.default_voi_window());
+  }
+}
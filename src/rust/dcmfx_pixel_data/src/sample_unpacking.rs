@@ -0,0 +1,149 @@
+//! Kernels that unpack native pixel data: removing the bit offset of 1-bit
+//! frames, expanding 1-bit data to one value per pixel, and sign extending
+//! signed samples that have unused high bits. They are written so that the
+//! compiler vectorizes them, or, for removing a bit offset, so that they work
+//! on eight bytes at a time.
+
+/// Shifts 1-bit pixel data right by `bit_offset` bits, which must be less than
+/// eight, so that its first pixel is in the lowest bit of the first byte. The
+/// low bits of each byte are moved into the high bits of the previous byte.
+///
+pub(crate) fn remove_bit_offset(data: &mut [u8], bit_offset: usize) {
+  if bit_offset == 0 {
+    return;
+  }
+
+  let bit_offset = bit_offset as u32;
+
+  let (words, tail) = data.as_chunks_mut::<8>();
+  let tail_first_byte = tail.first().copied().unwrap_or(0);
+
+  for i in 0..words.len() {
+    let next_byte = match words.get(i + 1) {
+      Some(next_word) => next_word[0],
+      None => tail_first_byte,
+    };
+
+    let word = u64::from_le_bytes(words[i]);
+    let word =
+      (word >> bit_offset) | (u64::from(next_byte) << (64 - bit_offset));
+
+    words[i] = word.to_le_bytes();
+  }
+
+  for i in 0..tail.len() {
+    let next_byte = tail.get(i + 1).copied().unwrap_or(0);
+    tail[i] = (tail[i] >> bit_offset) | (next_byte << (8 - bit_offset));
+  }
+}
+
+/// Expands 1-bit pixel data into one value per pixel, where each pixel's value
+/// is `values[0]` if its bit is zero, and `values[1]` if it's one. `data` must
+/// hold at least one bit for each value in `output`.
+///
+pub(crate) fn unpack_bits<T: Copy>(
+  data: &[u8],
+  values: [T; 2],
+  output: &mut [T],
+) {
+  assert!(data.len() * 8 >= output.len());
+
+  let (chunks, remainder) = output.as_chunks_mut::<8>();
+
+  for (byte, chunk) in data.iter().zip(chunks.iter_mut()) {
+    for (bit, value) in chunk.iter_mut().enumerate() {
+      *value = values[usize::from((byte >> bit) & 1)];
+    }
+  }
+
+  if !remainder.is_empty() {
+    let byte = data[chunks.len()];
+
+    for (bit, value) in remainder.iter_mut().enumerate() {
+      *value = values[usize::from((byte >> bit) & 1)];
+    }
+  }
+}
+
+macro_rules! sign_extend {
+  ($name:ident, $type:ty, $size:literal) => {
+    /// Reads little endian signed samples from `data` that have `bits_stored`
+    /// bits, which must be less than the number of bits in each sample, and
+    /// sign extends them into `output`. Samples whose value is at or above
+    /// `2^(bits_stored - 1)` become negative.
+    ///
+    pub(crate) fn $name(data: &[u8], bits_stored: u16, output: &mut [$type]) {
+      let threshold: $type = 1 << (bits_stored - 1);
+
+      for (pixel, bytes) in output.iter_mut().zip(data.as_chunks::<$size>().0) {
+        let value = <$type>::from_le_bytes(*bytes);
+
+        // Subtracting the threshold twice avoids overflow
+        let adjustment = if value >= threshold { threshold } else { 0 };
+        *pixel = value - adjustment - adjustment;
+      }
+    }
+  };
+}
+
+sign_extend!(sign_extend_i8, i8, 1);
+sign_extend!(sign_extend_i16, i16, 2);
+sign_extend!(sign_extend_i32, i32, 4);
+
+#[cfg(test)]
+mod tests {
+  #[cfg(not(feature = "std"))]
+  use alloc::{vec, vec::Vec};
+
+  use super::*;
+
+  #[test]
+  fn remove_bit_offset_test() {
+    for length in [1, 7, 8, 9, 16, 23] {
+      let data: Vec<u8> = (0..length).map(|i| (i * 37 + 11) as u8).collect();
+
+      for bit_offset in 0..8 {
+        let mut shifted = data.clone();
+        remove_bit_offset(&mut shifted, bit_offset);
+
+        let expected: Vec<u8> = (0..data.len())
+          .map(|i| {
+            let next_byte = data.get(i + 1).copied().unwrap_or(0);
+            if bit_offset == 0 {
+              data[i]
+            } else {
+              (data[i] >> bit_offset) | (next_byte << (8 - bit_offset))
+            }
+          })
+          .collect();
+
+        assert_eq!(shifted, expected);
+      }
+    }
+  }
+
+  #[test]
+  fn unpack_bits_test() {
+    let mut output = vec![0u16; 11];
+    unpack_bits(&[0b1010_0110, 0b0000_0101], [10, 20], &mut output);
+
+    assert_eq!(output, [10, 20, 20, 10, 10, 20, 10, 20, 20, 10, 20]);
+  }
+
+  #[test]
+  fn sign_extend_test() {
+    let mut output = vec![0i16; 4];
+    sign_extend_i16(
+      &[0xFF, 0x0F, 0x00, 0x08, 0xFF, 0x07, 0xFF, 0xFF],
+      12,
+      &mut output,
+    );
+
+    assert_eq!(output, [-1, -2048, 2047, -1]);
+
+    let mut output = vec![0i8; 3];
+    sign_extend_i8(&[0x3F, 0x20, 0x1F], 6, &mut output);
+
+    assert_eq!(output, [-1, -32, 31]);
+  }
+}
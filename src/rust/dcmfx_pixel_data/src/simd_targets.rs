@@ -0,0 +1,188 @@
+//! Reports and limits the SIMD instruction sets that the vendored codecs select
+//! at runtime.
+//!
+//! libjxl, OpenJPH, OpenJPEG's inverse wavelet transforms, the 8-bit and
+//! 12-bit libjpeg DCTs and color conversion, and the sample conversion kernels
+//! shared by the JPEG 2000 codecs each use the widest SIMD instruction set that
+//! the CPU supports. [`set_max_simd_level()`] caps this, e.g. to keep codecs off
+//! AVX-512 on hosts where it lowers clock speeds for the rest of a mixed
+//! workload, and [`codec_simd_targets()`] reports what each codec currently
+//! uses so that a host's configuration can be verified. CharLS has no SIMD
+//! code.
+//!
+//! The cap is intended to be set once at startup, before any codec is used.
+//! OpenJPH chooses its color and wavelet transform functions the first time
+//! they're needed, and later changes to the cap don't affect them.
+
+#[cfg(not(feature = "std"))]
+use alloc::{vec, vec::Vec};
+
+use core::sync::atomic::{AtomicU8, Ordering};
+
+/// The widest SIMD instruction sets that the vendored codecs may use. The
+/// values match the `DCMFX_SIMD_LEVEL_*` constants in `codec_simd_level.h`.
+///
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq, PartialOrd, Ord)]
+pub enum MaxSimdLevel {
+  /// Only the SIMD instruction sets that every CPU of the target architecture
+  /// supports, i.e. SSE2 on x86_64 and NEON on aarch64.
+  Baseline = 0,
+
+  /// Up to AVX2 and FMA on x86_64, which excludes AVX-512. On other
+  /// architectures this is the same as [`Self::Unlimited`].
+  Avx2 = 1,
+
+  /// The widest SIMD instruction sets that the CPU supports. This is the
+  /// default.
+  #[default]
+  Unlimited = 2,
+}
+
+/// The current cap on the SIMD instruction sets used by codecs.
+///
+static MAX_SIMD_LEVEL: AtomicU8 = AtomicU8::new(MaxSimdLevel::Unlimited as u8);
+
+/// Sets the widest SIMD instruction sets that the vendored codecs may use.
+///
+/// This should be called before any codec is used, and must not be called
+/// while libjxl is in use on another thread.
+///
+pub fn set_max_simd_level(level: MaxSimdLevel) {
+  MAX_SIMD_LEVEL.store(level as u8, Ordering::Relaxed);
+
+  #[cfg(feature = "std")]
+  unsafe {
+    ffi::libjxl_apply_max_simd_level();
+  }
+}
+
+/// Returns the widest SIMD instruction sets that the vendored codecs may use,
+/// as set by [`set_max_simd_level()`].
+///
+pub fn max_simd_level() -> MaxSimdLevel {
+  match MAX_SIMD_LEVEL.load(Ordering::Relaxed) {
+    0 => MaxSimdLevel::Baseline,
+    1 => MaxSimdLevel::Avx2,
+    _ => MaxSimdLevel::Unlimited,
+  }
+}
+
+/// Returns the current SIMD level cap to the vendored codecs. See
+/// `codec_simd_level.h`.
+///
+#[unsafe(no_mangle)]
+pub extern "C" fn dcmfx_codec_max_simd_level() -> core::ffi::c_int {
+  MAX_SIMD_LEVEL.load(Ordering::Relaxed).into()
+}
+
+/// The SIMD instruction set that one of the vendored codecs uses.
+///
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct CodecSimdTarget {
+  /// The name of the codec, e.g. `"OpenJPEG"`.
+  pub codec: &'static str,
+
+  /// The name of the widest SIMD instruction set that the codec uses on this
+  /// CPU given the current [`MaxSimdLevel`], e.g. `"AVX2"`, or `"Scalar"` if
+  /// it doesn't use any.
+  pub target: &'static str,
+}
+
+/// Returns the SIMD instruction set that each of the vendored codecs uses on
+/// this CPU given the current [`MaxSimdLevel`].
+///
+pub fn codec_simd_targets() -> Vec<CodecSimdTarget> {
+  let mut targets = vec![];
+
+  #[cfg(feature = "std")]
+  targets.push(CodecSimdTarget {
+    codec: "CharLS",
+    target: "Scalar",
+  });
+
+  targets.push(CodecSimdTarget {
+    codec: "libjpeg (12-bit)",
+    target: target_name(unsafe { ffi::libjpeg_12bit_simd_target() }),
+  });
+
+  targets.push(CodecSimdTarget {
+    codec: "libjpeg (8-bit)",
+    target: target_name(unsafe { ffi::libjpeg_8bit_simd_target() }),
+  });
+
+  #[cfg(feature = "std")]
+  targets.push(CodecSimdTarget {
+    codec: "libjxl",
+    target: libjxl_simd_target(),
+  });
+
+  targets.push(CodecSimdTarget {
+    codec: "OpenJPEG",
+    target: target_name(unsafe { ffi::openjpeg_simd_target() }),
+  });
+
+  #[cfg(feature = "std")]
+  targets.push(CodecSimdTarget {
+    codec: "OpenJPH",
+    target: target_name(unsafe { ffi::openjph_simd_target() }),
+  });
+
+  targets.push(CodecSimdTarget {
+    codec: "Sample conversion",
+    target: target_name(unsafe { ffi::pixel_kernels_simd_target() }),
+  });
+
+  targets
+}
+
+/// Returns the name of the SIMD target that libjxl uses on this CPU, e.g.
+/// `"AVX2"`, `"AVX3_SPR"`, `"NEON"` or `"SVE2"`. libjxl is compiled for all the
+/// SIMD targets available on the current architecture, and the best one the CPU
+/// supports is selected at runtime.
+///
+#[cfg(feature = "std")]
+pub fn libjxl_simd_target() -> &'static str {
+  target_name(unsafe { ffi::libjxl_simd_target() })
+}
+
+/// Converts a target name returned by one of the codecs into a string.
+///
+fn target_name(name: *const core::ffi::c_char) -> &'static str {
+  unsafe { core::ffi::CStr::from_ptr(name) }
+    .to_str()
+    .unwrap_or("<invalid target>")
+}
+
+mod ffi {
+  unsafe extern "C" {
+    pub fn libjpeg_8bit_simd_target() -> *const core::ffi::c_char;
+    pub fn libjpeg_12bit_simd_target() -> *const core::ffi::c_char;
+    pub fn openjpeg_simd_target() -> *const core::ffi::c_char;
+    pub fn pixel_kernels_simd_target() -> *const core::ffi::c_char;
+
+    #[cfg(feature = "std")]
+    pub fn libjxl_simd_target() -> *const core::ffi::c_char;
+    #[cfg(feature = "std")]
+    pub fn libjxl_apply_max_simd_level();
+    #[cfg(feature = "std")]
+    pub fn openjph_simd_target() -> *const core::ffi::c_char;
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn libjxl_simd_target_is_named() {
+    assert!(!libjxl_simd_target().is_empty());
+  }
+
+  #[test]
+  fn codec_simd_targets_are_named() {
+    let targets = codec_simd_targets();
+
+    assert!(targets.iter().any(|t| t.codec == "OpenJPEG"));
+    assert!(targets.iter().all(|t| !t.target.is_empty()));
+  }
+}
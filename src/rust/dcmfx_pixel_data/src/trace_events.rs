@@ -0,0 +1,316 @@
+//! Opt-in timeline tracing of the stages of reading, transcoding, and writing
+//! pixel data, in the Chrome trace event format that can be loaded into
+//! Perfetto or `chrome://tracing`.
+//!
+//! Events are only recorded after [`set_enabled()`] has been called, and cost
+//! a single relaxed atomic load per span when they aren't. Each event records
+//! the thread it ran on and when it started and ended, so the timeline shows
+//! how work on frames is spread across threads, and where threads are idle.
+//!
+//! The following are recorded:
+//!
+//! - Each frame transcoded by
+//!   [`crate::transforms::P10PixelDataTranscodeTransform`], with its index,
+//!   dimensions, and transfer syntaxes, along with the extraction of frames
+//!   from the incoming P10 tokens.
+//!
+//! - The codec stages listed in [`crate::codec_stats::CodecStage`].
+//!
+//! - The tasks that libjxl runs on a thread pool set with
+//!   [`crate::libjxl_thread_pool::set_thread_pool()`].
+//!
+//! Applications can add their own spans, e.g. for reading and writing P10
+//! data, with [`span()`].
+
+use std::cell::Cell;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Mutex, OnceLock};
+use std::time::{Duration, Instant};
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+
+/// The time that all event timestamps are relative to.
+static EPOCH: OnceLock<Instant> = OnceLock::new();
+
+static EVENTS: Mutex<Vec<TraceEvent>> = Mutex::new(Vec::new());
+
+/// The names of the threads that have recorded events, keyed by trace thread
+/// ID.
+static THREAD_NAMES: Mutex<Vec<(u64, String)>> = Mutex::new(Vec::new());
+
+static NEXT_THREAD_ID: AtomicU64 = AtomicU64::new(1);
+
+thread_local! {
+  static THREAD_ID: Cell<u64> = const { Cell::new(0) };
+}
+
+/// Enables or disables the recording of trace events. Events that have already
+/// been recorded are kept, see [`take_events()`].
+///
+pub fn set_enabled(enabled: bool) {
+  if enabled {
+    EPOCH.get_or_init(Instant::now);
+  }
+
+  ENABLED.store(enabled, Ordering::Relaxed);
+}
+
+/// Returns whether trace events are being recorded.
+///
+#[inline]
+pub fn is_enabled() -> bool {
+  ENABLED.load(Ordering::Relaxed)
+}
+
+/// A value attached to a trace event.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub enum TraceArg {
+  U64(u64),
+  Str(&'static str),
+}
+
+impl From<u64> for TraceArg {
+  fn from(value: u64) -> Self {
+    Self::U64(value)
+  }
+}
+
+impl From<usize> for TraceArg {
+  fn from(value: usize) -> Self {
+    Self::U64(value as u64)
+  }
+}
+
+impl From<u32> for TraceArg {
+  fn from(value: u32) -> Self {
+    Self::U64(u64::from(value))
+  }
+}
+
+impl From<u16> for TraceArg {
+  fn from(value: u16) -> Self {
+    Self::U64(u64::from(value))
+  }
+}
+
+impl From<&'static str> for TraceArg {
+  fn from(value: &'static str) -> Self {
+    Self::Str(value)
+  }
+}
+
+/// A recorded span of time on a single thread.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct TraceEvent {
+  pub name: &'static str,
+
+  /// The ID of the thread the span ran on. Thread IDs are assigned in the
+  /// order that threads first record an event, starting at one.
+  pub thread_id: u64,
+
+  /// When the span started, relative to when tracing was first enabled.
+  pub start: Duration,
+
+  pub duration: Duration,
+
+  pub args: Vec<(&'static str, TraceArg)>,
+}
+
+/// A span that is recorded as a trace event when it's dropped. Created by
+/// [`span()`].
+///
+#[must_use]
+pub struct Span(Option<TraceEvent>);
+
+/// Starts a span with the given name on the current thread. Nothing is
+/// recorded if tracing isn't enabled.
+///
+pub fn span(name: &'static str) -> Span {
+  if !is_enabled() {
+    return Span(None);
+  }
+
+  let epoch = *EPOCH.get_or_init(Instant::now);
+
+  Span(Some(TraceEvent {
+    name,
+    thread_id: current_thread_id(),
+    start: epoch.elapsed(),
+    duration: Duration::ZERO,
+    args: vec![],
+  }))
+}
+
+impl Span {
+  /// Attaches a value to this span.
+  ///
+  pub fn arg(mut self, key: &'static str, value: impl Into<TraceArg>) -> Self {
+    if let Some(event) = self.0.as_mut() {
+      event.args.push((key, value.into()));
+    }
+
+    self
+  }
+}
+
+impl Drop for Span {
+  fn drop(&mut self) {
+    if let Some(mut event) = self.0.take() {
+      let epoch = *EPOCH.get_or_init(Instant::now);
+      event.duration = epoch.elapsed().saturating_sub(event.start);
+
+      EVENTS.lock().unwrap().push(event);
+    }
+  }
+}
+
+/// Returns the trace thread ID of the current thread, assigning it one and
+/// recording its name if this is the first time it's been asked for.
+///
+fn current_thread_id() -> u64 {
+  THREAD_ID.with(|thread_id| {
+    if thread_id.get() == 0 {
+      let id = NEXT_THREAD_ID.fetch_add(1, Ordering::Relaxed);
+      thread_id.set(id);
+
+      let thread = std::thread::current();
+      let name = match thread.name() {
+        Some(name) => name.to_string(),
+        None => format!("thread-{id}"),
+      };
+
+      THREAD_NAMES.lock().unwrap().push((id, name));
+    }
+
+    thread_id.get()
+  })
+}
+
+/// Removes and returns all trace events recorded so far, in the order they
+/// ended.
+///
+pub fn take_events() -> Vec<TraceEvent> {
+  core::mem::take(&mut *EVENTS.lock().unwrap())
+}
+
+/// Removes all trace events recorded so far and formats them as a Chrome
+/// trace event JSON document. Each span is a complete (`"X"`) event, and each
+/// thread is named with a metadata (`"M"`) event.
+///
+pub fn take_chrome_trace_json() -> String {
+  let events = take_events();
+  let thread_names = THREAD_NAMES.lock().unwrap().clone();
+
+  to_chrome_trace_json(&events, &thread_names)
+}
+
+fn to_chrome_trace_json(
+  events: &[TraceEvent],
+  thread_names: &[(u64, String)],
+) -> String {
+  use core::fmt::Write;
+
+  let mut entries = vec![];
+
+  for (thread_id, name) in thread_names {
+    let mut s = String::new();
+    write!(
+      s,
+      "{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{thread_id},\
+       \"args\":{{\"name\":"
+    )
+    .unwrap();
+    write_json_string(&mut s, name);
+    s.push_str("}}");
+
+    entries.push(s);
+  }
+
+  for event in events {
+    let mut s = String::from("{\"name\":");
+    write_json_string(&mut s, event.name);
+    write!(
+      s,
+      ",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3},\"dur\":{:.3}",
+      event.thread_id,
+      event.start.as_secs_f64() * 1_000_000.0,
+      event.duration.as_secs_f64() * 1_000_000.0
+    )
+    .unwrap();
+
+    if !event.args.is_empty() {
+      s.push_str(",\"args\":{");
+
+      for (i, (key, value)) in event.args.iter().enumerate() {
+        if i > 0 {
+          s.push(',');
+        }
+
+        write_json_string(&mut s, key);
+        s.push(':');
+
+        match value {
+          TraceArg::U64(value) => write!(s, "{value}").unwrap(),
+          TraceArg::Str(value) => write_json_string(&mut s, value),
+        }
+      }
+
+      s.push('}');
+    }
+
+    s.push('}');
+
+    entries.push(s);
+  }
+
+  format!("{{\"traceEvents\":[\n{}\n]}}\n", entries.join(",\n"))
+}
+
+/// Appends a string to the output as a quoted and escaped JSON string.
+///
+fn write_json_string(s: &mut String, value: &str) {
+  use core::fmt::Write;
+
+  s.push('"');
+
+  for c in value.chars() {
+    match c {
+      '"' => s.push_str("\\\""),
+      '\\' => s.push_str("\\\\"),
+      '\n' => s.push_str("\\n"),
+      c if (c as u32) < 0x20 => write!(s, "\\u{:04x}", c as u32).unwrap(),
+      c => s.push(c),
+    }
+  }
+
+  s.push('"');
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn chrome_trace_json() {
+    let events = vec![TraceEvent {
+      name: "decode",
+      thread_id: 2,
+      start: Duration::from_micros(1500),
+      duration: Duration::from_nanos(250_500),
+      args: vec![("frame", TraceArg::U64(3)), ("ts", TraceArg::Str("a\"b"))],
+    }];
+
+    assert_eq!(
+      to_chrome_trace_json(&events, &[(2, "main".to_string())]),
+      "{\"traceEvents\":[\n\
+       {\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\
+       \"args\":{\"name\":\"main\"}},\n\
+       {\"name\":\"decode\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\
+       \"ts\":1500.000,\"dur\":250.500,\
+       \"args\":{\"frame\":3,\"ts\":\"a\\\"b\"}}\n\
+       ]}\n"
+    );
+  }
+}
@@ -0,0 +1,491 @@
+//! Fast path for transcoding frames whose pixels all have the same value.
+//!
+//! Segmentations, dose maps, and some secondary captures contain many frames
+//! that are entirely zero or otherwise constant. Encoding the same constant
+//! frame always gives the same codestream, and decoding such a codestream
+//! always gives the same constant frame, so both are cached and reused rather
+//! than running the codec on every frame.
+
+use std::sync::Mutex;
+
+use dcmfx_core::{RcByteSlice, TransferSyntax};
+
+use crate::{
+  ColorImage, ColorImageData, ColorSpace, MonochromeImage, MonochromeImageData,
+  PixelDataDecodeError, PixelDataFrame,
+};
+
+/// The maximum number of constant frames held in each of the caches. Objects
+/// with constant frames usually only use a handful of distinct values.
+///
+const MAX_CACHED_FRAMES: usize = 16;
+
+/// The largest encapsulated codestream that's checked against the decode
+/// cache. Codestreams for constant frames are tiny because they compress
+/// almost perfectly, so larger codestreams aren't constant frames and are
+/// decoded as normal without being compared.
+///
+const MAX_CONSTANT_CODESTREAM_SIZE: usize = 4096;
+
+/// A decoded frame whose pixels all have the same value.
+///
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct ConstantFrame {
+  width: u16,
+  height: u16,
+  bits_stored: u16,
+  is_monochrome1: bool,
+  pixel: ConstantPixel,
+}
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+enum ConstantPixel {
+  Bitmap { value: bool, is_signed: bool },
+  MonochromeI8(i8),
+  MonochromeU8(u8),
+  MonochromeI16(i16),
+  MonochromeU16(u16),
+  MonochromeI32(i32),
+  MonochromeU32(u32),
+  ColorU8([u8; 3], ColorSpace),
+  ColorU16([u16; 3], ColorSpace),
+  ColorU32([u32; 3], ColorSpace),
+}
+
+impl ConstantFrame {
+  /// Returns the constant frame for a monochrome image if all its pixels have
+  /// the same value.
+  ///
+  pub fn from_monochrome_image(image: &MonochromeImage) -> Option<Self> {
+    let pixel = match image.data() {
+      MonochromeImageData::Bitmap { data, is_signed } => {
+        let value = is_constant_bitmap(data, image.pixel_count())?;
+        ConstantPixel::Bitmap {
+          value,
+          is_signed: *is_signed,
+        }
+      }
+      MonochromeImageData::I8(data) => {
+        ConstantPixel::MonochromeI8(constant_value::<_, 1>(data)?[0])
+      }
+      MonochromeImageData::U8(data) => {
+        ConstantPixel::MonochromeU8(constant_value::<_, 1>(data)?[0])
+      }
+      MonochromeImageData::I16(data) => {
+        ConstantPixel::MonochromeI16(constant_value::<_, 1>(data)?[0])
+      }
+      MonochromeImageData::U16(data) => {
+        ConstantPixel::MonochromeU16(constant_value::<_, 1>(data)?[0])
+      }
+      MonochromeImageData::I32(data) => {
+        ConstantPixel::MonochromeI32(constant_value::<_, 1>(data)?[0])
+      }
+      MonochromeImageData::U32(data) => {
+        ConstantPixel::MonochromeU32(constant_value::<_, 1>(data)?[0])
+      }
+    };
+
+    Some(Self {
+      width: image.width(),
+      height: image.height(),
+      bits_stored: image.bits_stored(),
+      is_monochrome1: image.is_monochrome1(),
+      pixel,
+    })
+  }
+
+  /// Returns the constant frame for a color image if all its pixels have the
+  /// same value. Palette color images are never considered constant.
+  ///
+  pub fn from_color_image(image: &ColorImage) -> Option<Self> {
+    let pixel = match image.data() {
+      ColorImageData::U8 { data, color_space } => {
+        ConstantPixel::ColorU8(constant_value(data)?, *color_space)
+      }
+      ColorImageData::U16 { data, color_space } => {
+        ConstantPixel::ColorU16(constant_value(data)?, *color_space)
+      }
+      ColorImageData::U32 { data, color_space } => {
+        ConstantPixel::ColorU32(constant_value(data)?, *color_space)
+      }
+      ColorImageData::PaletteU8 { .. } | ColorImageData::PaletteU16 { .. } => {
+        return None;
+      }
+    };
+
+    Some(Self {
+      width: image.width(),
+      height: image.height(),
+      bits_stored: image.bits_stored(),
+      is_monochrome1: false,
+      pixel,
+    })
+  }
+
+  /// Creates the monochrome image for this constant frame. Returns `None` if
+  /// this is a color frame.
+  ///
+  pub fn to_monochrome_image(&self) -> Option<MonochromeImage> {
+    let (width, height) = (self.width, self.height);
+    let pixel_count = usize::from(width) * usize::from(height);
+    let bits_stored = self.bits_stored;
+    let is_monochrome1 = self.is_monochrome1;
+
+    let image = match self.pixel {
+      ConstantPixel::Bitmap { value, is_signed } => {
+        let mut data = vec![if value { 0xFF } else { 0 }; pixel_count / 8];
+        if pixel_count % 8 != 0 {
+          data.push(if value {
+            (1 << (pixel_count % 8)) - 1
+          } else {
+            0
+          });
+        }
+
+        MonochromeImage::new_bitmap(
+          width,
+          height,
+          data,
+          is_signed,
+          is_monochrome1,
+        )
+      }
+      ConstantPixel::MonochromeI8(value) => MonochromeImage::new_i8(
+        width,
+        height,
+        vec![value; pixel_count],
+        bits_stored,
+        is_monochrome1,
+      ),
+      ConstantPixel::MonochromeU8(value) => MonochromeImage::new_u8(
+        width,
+        height,
+        vec![value; pixel_count],
+        bits_stored,
+        is_monochrome1,
+      ),
+      ConstantPixel::MonochromeI16(value) => MonochromeImage::new_i16(
+        width,
+        height,
+        vec![value; pixel_count],
+        bits_stored,
+        is_monochrome1,
+      ),
+      ConstantPixel::MonochromeU16(value) => MonochromeImage::new_u16(
+        width,
+        height,
+        vec![value; pixel_count],
+        bits_stored,
+        is_monochrome1,
+      ),
+      ConstantPixel::MonochromeI32(value) => MonochromeImage::new_i32(
+        width,
+        height,
+        vec![value; pixel_count],
+        bits_stored,
+        is_monochrome1,
+      ),
+      ConstantPixel::MonochromeU32(value) => MonochromeImage::new_u32(
+        width,
+        height,
+        vec![value; pixel_count],
+        bits_stored,
+        is_monochrome1,
+      ),
+      _ => return None,
+    };
+
+    image.ok()
+  }
+
+  /// Creates the color image for this constant frame. Returns `None` if this
+  /// is a monochrome frame.
+  ///
+  pub fn to_color_image(&self) -> Option<ColorImage> {
+    let (width, height) = (self.width, self.height);
+    let pixel_count = usize::from(width) * usize::from(height);
+    let bits_stored = self.bits_stored;
+
+    let image = match self.pixel {
+      ConstantPixel::ColorU8(value, color_space) => ColorImage::new_u8(
+        width,
+        height,
+        fill_pixels(value, pixel_count),
+        color_space,
+        bits_stored,
+      ),
+      ConstantPixel::ColorU16(value, color_space) => ColorImage::new_u16(
+        width,
+        height,
+        fill_pixels(value, pixel_count),
+        color_space,
+        bits_stored,
+      ),
+      ConstantPixel::ColorU32(value, color_space) => ColorImage::new_u32(
+        width,
+        height,
+        fill_pixels(value, pixel_count),
+        color_space,
+        bits_stored,
+      ),
+      _ => return None,
+    };
+
+    image.ok()
+  }
+}
+
+/// Caches the codestreams that constant frames encode to, and the constant
+/// frames that small codestreams decode to, for a single transcode. The
+/// transcode's Image Pixel Modules, transfer syntaxes, and codec settings
+/// don't change between frames, so they aren't part of the cache keys.
+///
+#[derive(Debug, Default)]
+pub struct ConstantFrameCache {
+  encoded_frames: Mutex<Vec<(ConstantFrame, RcByteSlice)>>,
+  decoded_frames: Mutex<Vec<(Vec<u8>, ConstantFrame)>>,
+}
+
+impl ConstantFrameCache {
+  /// Returns the codestream that the given constant frame was previously
+  /// encoded to, if any.
+  ///
+  pub fn encoded_frame(&self, frame: &ConstantFrame) -> Option<RcByteSlice> {
+    self
+      .encoded_frames
+      .lock()
+      .unwrap()
+      .iter()
+      .find(|(f, _)| f == frame)
+      .map(|(_, codestream)| codestream.clone())
+  }
+
+  /// Records the codestream that a constant frame was encoded to.
+  ///
+  pub fn insert_encoded_frame(
+    &self,
+    frame: ConstantFrame,
+    codestream: RcByteSlice,
+  ) {
+    insert_bounded(
+      &mut self.encoded_frames.lock().unwrap(),
+      (frame, codestream),
+    );
+  }
+
+  /// Decodes a monochrome frame with the given decode function, unless it's a
+  /// codestream that previously decoded to a constant frame, in which case the
+  /// constant frame is filled in directly without involving the codec.
+  ///
+  pub fn decode_monochrome(
+    &self,
+    input_frame: &mut PixelDataFrame,
+    transfer_syntax: &TransferSyntax,
+    decode: impl FnOnce(
+      &mut PixelDataFrame,
+    ) -> Result<MonochromeImage, PixelDataDecodeError>,
+  ) -> Result<MonochromeImage, PixelDataDecodeError> {
+    self.decode(
+      input_frame,
+      transfer_syntax,
+      decode,
+      ConstantFrame::from_monochrome_image,
+      ConstantFrame::to_monochrome_image,
+    )
+  }
+
+  /// Decodes a color frame with the given decode function, unless it's a
+  /// codestream that previously decoded to a constant frame, in which case the
+  /// constant frame is filled in directly without involving the codec.
+  ///
+  pub fn decode_color(
+    &self,
+    input_frame: &mut PixelDataFrame,
+    transfer_syntax: &TransferSyntax,
+    decode: impl FnOnce(
+      &mut PixelDataFrame,
+    ) -> Result<ColorImage, PixelDataDecodeError>,
+  ) -> Result<ColorImage, PixelDataDecodeError> {
+    self.decode(
+      input_frame,
+      transfer_syntax,
+      decode,
+      ConstantFrame::from_color_image,
+      ConstantFrame::to_color_image,
+    )
+  }
+
+  fn decode<T>(
+    &self,
+    input_frame: &mut PixelDataFrame,
+    transfer_syntax: &TransferSyntax,
+    decode: impl FnOnce(&mut PixelDataFrame) -> Result<T, PixelDataDecodeError>,
+    to_constant_frame: impl FnOnce(&T) -> Option<ConstantFrame>,
+    from_constant_frame: impl FnOnce(&ConstantFrame) -> Option<T>,
+  ) -> Result<T, PixelDataDecodeError> {
+    if !transfer_syntax.is_encapsulated
+      || input_frame.len() as usize > MAX_CONSTANT_CODESTREAM_SIZE
+    {
+      return decode(input_frame);
+    }
+
+    let codestream = input_frame.combine_chunks().to_vec();
+
+    let constant_frame = self
+      .decoded_frames
+      .lock()
+      .unwrap()
+      .iter()
+      .find(|(c, _)| *c == codestream)
+      .map(|(_, frame)| *frame);
+
+    if let Some(image) = constant_frame.and_then(|f| from_constant_frame(&f)) {
+      return Ok(image);
+    }
+
+    let image = decode(input_frame)?;
+
+    if let Some(constant_frame) = to_constant_frame(&image) {
+      insert_bounded(
+        &mut self.decoded_frames.lock().unwrap(),
+        (codestream, constant_frame),
+      );
+    }
+
+    Ok(image)
+  }
+}
+
+/// Adds an entry to a cache, evicting the oldest entry if the cache is full.
+///
+fn insert_bounded<T>(entries: &mut Vec<T>, entry: T) {
+  if entries.len() >= MAX_CACHED_FRAMES {
+    entries.remove(0);
+  }
+
+  entries.push(entry);
+}
+
+/// Returns the value of the first pixel if every pixel has the same value,
+/// where each pixel has `N` samples.
+///
+/// Each pixel is compared with the one before it by comparing the data with
+/// itself offset by one pixel. Slice comparisons of integers are done with
+/// `memcmp`, which is vectorized, so this runs at close to memory bandwidth
+/// and stops at the first pixel that differs.
+///
+fn constant_value<T: Copy + PartialEq, const N: usize>(
+  data: &[T],
+) -> Option<[T; N]> {
+  if data.len() < N || data.len() % N != 0 {
+    return None;
+  }
+
+  if data[N..] != data[..data.len() - N] {
+    return None;
+  }
+
+  data[..N].try_into().ok()
+}
+
+/// Returns the value of every pixel in 1bpp bitmap data if they're all the
+/// same. Unused bits in the last byte are ignored.
+///
+fn is_constant_bitmap(data: &[u8], pixel_count: usize) -> Option<bool> {
+  let value = *data.first()? & 1 == 1;
+  let fill = if value { 0xFF } else { 0 };
+
+  let (full_bytes, remainder) = data.split_at_checked(pixel_count / 8)?;
+  if full_bytes.iter().any(|b| *b != fill) {
+    return None;
+  }
+
+  let remaining_bits = pixel_count % 8;
+  if remaining_bits != 0 {
+    let mask = (1u8 << remaining_bits) - 1;
+    if remainder.first()? & mask != fill & mask {
+      return None;
+    }
+  }
+
+  Some(value)
+}
+
+/// Creates pixel data where every pixel has the given samples.
+///
+fn fill_pixels<T: Copy>(value: [T; 3], pixel_count: usize) -> Vec<T> {
+  let mut data = Vec::with_capacity(pixel_count * 3);
+  for _ in 0..pixel_count {
+    data.extend_from_slice(&value);
+  }
+
+  data
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  use dcmfx_core::transfer_syntax;
+
+  #[test]
+  fn detects_constant_frames() {
+    let image = MonochromeImage::new_u16(3, 2, vec![7; 6], 12, false).unwrap();
+    let frame = ConstantFrame::from_monochrome_image(&image).unwrap();
+    assert_eq!(frame.to_monochrome_image(), Some(image));
+
+    let image =
+      MonochromeImage::new_u16(3, 2, vec![7, 7, 7, 7, 7, 8], 12, false)
+        .unwrap();
+    assert_eq!(ConstantFrame::from_monochrome_image(&image), None);
+
+    let image =
+      MonochromeImage::new_bitmap(3, 3, vec![0xFF, 0x01], false, false)
+        .unwrap();
+    let frame = ConstantFrame::from_monochrome_image(&image).unwrap();
+    assert_eq!(frame.to_monochrome_image(), Some(image));
+
+    let image =
+      MonochromeImage::new_bitmap(3, 3, vec![0xFF, 0x00], false, false)
+        .unwrap();
+    assert_eq!(ConstantFrame::from_monochrome_image(&image), None);
+
+    let image =
+      ColorImage::new_u8(2, 2, [1, 2, 3].repeat(4), ColorSpace::Rgb, 8)
+        .unwrap();
+    let frame = ConstantFrame::from_color_image(&image).unwrap();
+    assert_eq!(frame.to_color_image(), Some(image));
+    assert_eq!(frame.to_monochrome_image(), None);
+
+    let image = ColorImage::new_u8(
+      2,
+      2,
+      vec![1, 2, 3, 1, 2, 3, 1, 2, 3, 3, 2, 1],
+      ColorSpace::Rgb,
+      8,
+    )
+    .unwrap();
+    assert_eq!(ConstantFrame::from_color_image(&image), None);
+  }
+
+  #[test]
+  fn decodes_cached_codestreams_without_the_codec() {
+    let cache = ConstantFrameCache::default();
+    let image = MonochromeImage::new_u8(4, 4, vec![0; 16], 8, false).unwrap();
+
+    let mut decode_count = 0;
+    for _ in 0..3 {
+      let mut frame = PixelDataFrame::new_from_bytes(vec![1, 2, 3]);
+      let decoded = cache
+        .decode_monochrome(&mut frame, &transfer_syntax::RLE_LOSSLESS, |_| {
+          decode_count += 1;
+          Ok(image.clone())
+        })
+        .unwrap();
+
+      assert_eq!(decoded, image);
+    }
+
+    assert_eq!(decode_count, 1);
+  }
+}
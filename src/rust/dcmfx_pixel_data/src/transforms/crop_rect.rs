@@ -10,7 +10,9 @@ use alloc::{
 /// less than or equal to zero, define the offset from the right and bottom
 /// edges respectively.
 ///
-#[derive(Clone, Copy, Debug)]
+/// The default crop rect covers the whole image.
+///
+#[derive(Clone, Copy, Debug, Default, PartialEq)]
 pub struct CropRect {
   pub left: u16,
   pub top: u16,
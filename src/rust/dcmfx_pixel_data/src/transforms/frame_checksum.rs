@@ -0,0 +1,100 @@
+//! Checksums of the samples of decoded frames, which are used to check that a
+//! transcoded frame decodes back to the stored values it was encoded from
+//! without holding on to a copy of them.
+
+use crate::{
+  ColorImage, ColorImageData, ColorSpace, MonochromeImage, MonochromeImageData,
+};
+
+/// A CRC-32 of the dimensions, sample type, color space, and samples of a
+/// decoded image. The checksum uses the CPU's carry-less multiply instructions
+/// when they're available, so it runs at close to memory bandwidth.
+///
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct FrameChecksum(u32);
+
+impl FrameChecksum {
+  /// Returns the checksum of a monochrome image's samples.
+  ///
+  pub fn from_monochrome_image(image: &MonochromeImage) -> Self {
+    let mut hasher = new_hasher(image.width(), image.height());
+
+    match image.data() {
+      MonochromeImageData::Bitmap { data, is_signed } => {
+        hasher.update(&[0, *is_signed as u8]);
+        hasher.update(data);
+      }
+      MonochromeImageData::I8(data) => {
+        hasher.update(&[1]);
+        hasher.update(bytemuck::cast_slice(data));
+      }
+      MonochromeImageData::U8(data) => {
+        hasher.update(&[2]);
+        hasher.update(data);
+      }
+      MonochromeImageData::I16(data) => {
+        hasher.update(&[3]);
+        hasher.update(bytemuck::cast_slice(data));
+      }
+      MonochromeImageData::U16(data) => {
+        hasher.update(&[4]);
+        hasher.update(bytemuck::cast_slice(data));
+      }
+      MonochromeImageData::I32(data) => {
+        hasher.update(&[5]);
+        hasher.update(bytemuck::cast_slice(data));
+      }
+      MonochromeImageData::U32(data) => {
+        hasher.update(&[6]);
+        hasher.update(bytemuck::cast_slice(data));
+      }
+    }
+
+    Self(hasher.finalize())
+  }
+
+  /// Returns the checksum of a color image's samples. The palette of palette
+  /// color images isn't included as it isn't part of the frame's data.
+  ///
+  pub fn from_color_image(image: &ColorImage) -> Self {
+    let mut hasher = new_hasher(image.width(), image.height());
+
+    let color_space_id = |color_space: &ColorSpace| match color_space {
+      ColorSpace::Rgb => 0,
+      ColorSpace::Ybr { is_422: false } => 1,
+      ColorSpace::Ybr { is_422: true } => 2,
+    };
+
+    match image.data() {
+      ColorImageData::U8 { data, color_space } => {
+        hasher.update(&[7, color_space_id(color_space)]);
+        hasher.update(data);
+      }
+      ColorImageData::U16 { data, color_space } => {
+        hasher.update(&[8, color_space_id(color_space)]);
+        hasher.update(bytemuck::cast_slice(data));
+      }
+      ColorImageData::U32 { data, color_space } => {
+        hasher.update(&[9, color_space_id(color_space)]);
+        hasher.update(bytemuck::cast_slice(data));
+      }
+      ColorImageData::PaletteU8 { data, .. } => {
+        hasher.update(&[10]);
+        hasher.update(data);
+      }
+      ColorImageData::PaletteU16 { data, .. } => {
+        hasher.update(&[11]);
+        hasher.update(bytemuck::cast_slice(data));
+      }
+    }
+
+    Self(hasher.finalize())
+  }
+}
+
+fn new_hasher(width: u16, height: u16) -> crc32fast::Hasher {
+  let mut hasher = crc32fast::Hasher::new();
+  hasher.update(&width.to_le_bytes());
+  hasher.update(&height.to_le_bytes());
+  hasher
+}
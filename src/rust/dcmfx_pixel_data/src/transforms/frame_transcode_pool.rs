@@ -0,0 +1,201 @@
+//! Pool of worker threads that transcodes frames of pixel data in parallel and
+//! returns the transcoded frames in the order they were submitted.
+
+use std::any::Any;
+use std::collections::BTreeMap;
+use std::panic::AssertUnwindSafe;
+use std::sync::{Arc, Mutex, mpsc};
+use std::thread::JoinHandle;
+
+use dcmfx_core::RcByteSlice;
+
+use crate::PixelDataFrame;
+
+/// The result of transcoding a frame on a worker thread, which is the frame's
+/// index and its transcoded data. A panic on the worker thread is passed back
+/// so it can be resumed on the thread that submitted the frame.
+///
+type WorkerResult<E> =
+  Result<Result<(usize, RcByteSlice), E>, Box<dyn Any + Send>>;
+
+/// The function that worker threads transcode frames with.
+///
+type TranscodeFrameFn<E> =
+  dyn Fn(&mut PixelDataFrame) -> Result<RcByteSlice, E> + Send + Sync;
+
+/// Transcodes frames of pixel data on a set of worker threads that live for as
+/// long as the pool does. Each worker thread handles one frame at a time, so
+/// any per-thread codec state is reused across the frames it transcodes and
+/// never shared between frames being transcoded at the same time.
+///
+/// Worker threads can be added while frames are in flight, see
+/// [`Self::add_threads()`].
+///
+pub struct FrameTranscodePool<E> {
+  job_sender: Option<mpsc::Sender<(usize, PixelDataFrame)>>,
+  job_receiver: Arc<Mutex<mpsc::Receiver<(usize, PixelDataFrame)>>>,
+  result_sender: mpsc::Sender<(usize, WorkerResult<E>)>,
+  result_receiver: mpsc::Receiver<(usize, WorkerResult<E>)>,
+  workers: Vec<JoinHandle<()>>,
+
+  transcode_frame: Arc<TranscodeFrameFn<E>>,
+  numa_node: Option<usize>,
+
+  /// The number of frames submitted to the pool.
+  submitted_count: usize,
+
+  /// The number of transcoded frames returned from the pool.
+  returned_count: usize,
+
+  /// Transcoded frames that have been received from the worker threads ahead
+  /// of an earlier frame, keyed by the order they were submitted in.
+  completed_frames: BTreeMap<usize, WorkerResult<E>>,
+}
+
+impl<E: Send + 'static> FrameTranscodePool<E> {
+  /// Creates a new pool that transcodes frames on the given number of worker
+  /// threads using the passed function. If a NUMA node is given then the
+  /// worker threads are bound to it, see
+  /// [`crate::numa::bind_current_thread()`].
+  ///
+  pub fn new<F>(
+    thread_count: usize,
+    numa_node: Option<usize>,
+    transcode_frame: F,
+  ) -> Self
+  where
+    F:
+      Fn(&mut PixelDataFrame) -> Result<RcByteSlice, E> + Send + Sync + 'static,
+  {
+    let (job_sender, job_receiver) = mpsc::channel::<(usize, PixelDataFrame)>();
+    let (result_sender, result_receiver) = mpsc::channel();
+
+    let mut pool = Self {
+      job_sender: Some(job_sender),
+      job_receiver: Arc::new(Mutex::new(job_receiver)),
+      result_sender,
+      result_receiver,
+      workers: vec![],
+      transcode_frame: Arc::new(transcode_frame),
+      numa_node,
+      submitted_count: 0,
+      returned_count: 0,
+      completed_frames: BTreeMap::new(),
+    };
+
+    pool.add_threads(thread_count.max(1));
+
+    pool
+  }
+
+  /// Returns the number of worker threads in the pool.
+  ///
+  pub fn thread_count(&self) -> usize {
+    self.workers.len()
+  }
+
+  /// Adds worker threads to the pool. They start taking frames that are
+  /// waiting for a worker thread straight away, which lets the transcode of
+  /// pixel data with many frames speed up when more threads become available
+  /// part way through.
+  ///
+  pub fn add_threads(&mut self, thread_count: usize) {
+    for _ in 0..thread_count {
+      let transcode_frame = self.transcode_frame.clone();
+      let job_receiver = self.job_receiver.clone();
+      let result_sender = self.result_sender.clone();
+      let numa_node = self.numa_node;
+
+      self.workers.push(std::thread::spawn(move || {
+        if let Some(numa_node) = numa_node {
+          crate::numa::bind_current_thread(numa_node);
+        }
+
+        loop {
+          // The lock is only held while waiting for the next job
+          let job = job_receiver.lock().unwrap().recv();
+          let Ok((sequence_number, mut frame)) = job else {
+            break;
+          };
+
+          let result = std::panic::catch_unwind(AssertUnwindSafe(|| {
+            transcode_frame(&mut frame)
+              .map(|data| (frame.index().unwrap(), data))
+          }));
+
+          if result_sender.send((sequence_number, result)).is_err() {
+            break;
+          }
+        }
+      }));
+    }
+  }
+
+  /// Returns the number of frames that have been submitted but not yet
+  /// returned by [`Self::next_frame()`].
+  ///
+  pub fn in_flight_count(&self) -> usize {
+    self.submitted_count - self.returned_count
+  }
+
+  /// Submits a frame to be transcoded on the next available worker thread.
+  ///
+  pub fn submit(&mut self, frame: PixelDataFrame) {
+    self
+      .job_sender
+      .as_ref()
+      .unwrap()
+      .send((self.submitted_count, frame))
+      .expect("Frame transcode worker threads have exited");
+
+    self.submitted_count += 1;
+  }
+
+  /// Returns the index and transcoded data of the next frame in the order
+  /// frames were submitted. If that frame is still being transcoded then this
+  /// waits for it when `wait` is true, and otherwise returns `None`. Returns
+  /// `None` when there are no frames in flight.
+  ///
+  pub fn next_frame(
+    &mut self,
+    wait: bool,
+  ) -> Option<Result<(usize, RcByteSlice), E>> {
+    if self.in_flight_count() == 0 {
+      return None;
+    }
+
+    loop {
+      if let Some(result) = self.completed_frames.remove(&self.returned_count) {
+        self.returned_count += 1;
+
+        return match result {
+          Ok(result) => Some(result),
+          Err(panic) => std::panic::resume_unwind(panic),
+        };
+      }
+
+      let (sequence_number, result) = if wait {
+        self
+          .result_receiver
+          .recv()
+          .expect("Frame transcode worker threads have exited")
+      } else {
+        self.result_receiver.try_recv().ok()?
+      };
+
+      self.completed_frames.insert(sequence_number, result);
+    }
+  }
+}
+
+impl<E> Drop for FrameTranscodePool<E> {
+  fn drop(&mut self) {
+    // Closing the job channel stops the worker threads once they finish their
+    // current frame
+    self.job_sender = None;
+
+    for worker in self.workers.drain(..) {
+      let _ = worker.join();
+    }
+  }
+}
@@ -0,0 +1,113 @@
+//! Background thread that verifies transcoded frames while the next frame is
+//! being transcoded, see
+//! [`crate::transforms::P10PixelDataTranscodeTransform::set_verify_lossless()`].
+
+use std::any::Any;
+use std::panic::AssertUnwindSafe;
+use std::sync::mpsc;
+use std::thread::JoinHandle;
+
+use crate::FrameBufferPool;
+
+/// A verification of a transcoded frame.
+///
+type VerifyFn<E> = Box<dyn FnOnce() -> Result<(), E> + Send>;
+
+/// The result of a verification. A panic on the verify thread is passed back
+/// so it can be resumed on the thread that submitted the verification.
+///
+type VerifyResult<E> = Result<Result<(), E>, Box<dyn Any + Send>>;
+
+/// Runs verifications of transcoded frames on a thread that lives for as long
+/// as this does. At most one verification is in flight at a time, which
+/// overlaps with the transcode of the frame after the one being verified
+/// without allowing verifications to fall behind and accumulate. The thread
+/// has its own [`FrameBufferPool`] that frames are decoded into.
+///
+pub struct FrameVerifyThread<E> {
+  job_sender: Option<mpsc::Sender<VerifyFn<E>>>,
+  result_receiver: mpsc::Receiver<VerifyResult<E>>,
+  worker: Option<JoinHandle<()>>,
+  is_in_flight: bool,
+}
+
+impl<E: Send + 'static> FrameVerifyThread<E> {
+  /// Creates a new verify thread.
+  ///
+  pub fn new() -> Self {
+    let (job_sender, job_receiver) = mpsc::channel::<VerifyFn<E>>();
+    let (result_sender, result_receiver) = mpsc::channel();
+
+    let worker = std::thread::spawn(move || {
+      let mut frame_buffer_pool = FrameBufferPool::default();
+
+      while let Ok(verify) = job_receiver.recv() {
+        let result = frame_buffer_pool
+          .scope(|| std::panic::catch_unwind(AssertUnwindSafe(verify)));
+
+        if result_sender.send(result).is_err() {
+          break;
+        }
+      }
+    });
+
+    Self {
+      job_sender: Some(job_sender),
+      result_receiver,
+      worker: Some(worker),
+      is_in_flight: false,
+    }
+  }
+
+  /// Submits a verification to the verify thread. If a verification is
+  /// already in flight then this first waits for it, and returns its error if
+  /// it failed.
+  ///
+  pub fn submit(
+    &mut self,
+    verify: impl FnOnce() -> Result<(), E> + Send + 'static,
+  ) -> Result<(), E> {
+    self.wait()?;
+
+    self
+      .job_sender
+      .as_ref()
+      .unwrap()
+      .send(Box::new(verify))
+      .expect("Frame verify thread has exited");
+
+    self.is_in_flight = true;
+
+    Ok(())
+  }
+
+  /// Waits for the verification in flight, if there is one, and returns its
+  /// result.
+  ///
+  pub fn wait(&mut self) -> Result<(), E> {
+    if !core::mem::take(&mut self.is_in_flight) {
+      return Ok(());
+    }
+
+    match self
+      .result_receiver
+      .recv()
+      .expect("Frame verify thread has exited")
+    {
+      Ok(result) => result,
+      Err(panic) => std::panic::resume_unwind(panic),
+    }
+  }
+}
+
+impl<E> Drop for FrameVerifyThread<E> {
+  fn drop(&mut self) {
+    // Closing the job channel stops the verify thread once it finishes its
+    // current verification
+    self.job_sender = None;
+
+    if let Some(worker) = self.worker.take() {
+      let _ = worker.join();
+    }
+  }
+}
@@ -1,12 +1,24 @@
+#[cfg(feature = "std")]
+mod constant_frame_cache;
 mod crop_rect;
+mod frame_checksum;
+#[cfg(feature = "std")]
+mod frame_transcode_pool;
+#[cfg(feature = "std")]
+mod frame_verify_thread;
+#[cfg(feature = "std")]
+mod p10_pixel_data_fan_out_transcode_transform;
 mod p10_pixel_data_frame_transform;
 mod p10_pixel_data_transcode_transform;
 
 pub use crop_rect::CropRect;
+#[cfg(feature = "std")]
+pub use p10_pixel_data_fan_out_transcode_transform::P10PixelDataFanOutTranscodeTransform;
+pub(crate) use p10_pixel_data_frame_transform::PixelDataFrameTransformDetails;
 pub use p10_pixel_data_frame_transform::{
   P10PixelDataFrameTransform, P10PixelDataFrameTransformError,
 };
 pub use p10_pixel_data_transcode_transform::{
   P10PixelDataTranscodeTransform, P10PixelDataTranscodeTransformError,
-  TranscodeImageDataFunctions,
+  TranscodeImageDataFunctions, TranscodeMemoryHighWaterMarks,
 };
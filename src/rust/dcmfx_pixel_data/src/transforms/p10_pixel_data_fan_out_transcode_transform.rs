@@ -0,0 +1,229 @@
+use std::collections::BTreeMap;
+use std::sync::{Mutex, OnceLock};
+
+use dcmfx_core::{Rc, TransferSyntax};
+use dcmfx_p10::P10Token;
+
+use crate::{
+  DecodedFrame, PixelDataDecodeConfig, PixelDataDecodeError,
+  PixelDataEncodeConfig,
+};
+
+use super::{
+  P10PixelDataTranscodeTransform, P10PixelDataTranscodeTransformError,
+  TranscodeImageDataFunctions,
+};
+
+/// This transform takes a stream of DICOM P10 tokens and transcodes its pixel
+/// data into several transfer syntaxes at once, e.g. to create HTJ2K, JPEG XL,
+/// and JPEG thumbnail copies of the same input in one pass.
+///
+/// Each frame is decoded once, by whichever target gets to it first, and the
+/// decoded stored values are handed to every target to be processed by its
+/// image data functions and then encoded. This avoids decoding every frame
+/// once per output, which is the dominant cost when the input uses a slow
+/// codec such as JPEG 2000.
+///
+/// Targets that transcode frames on worker threads, see
+/// [`P10PixelDataTranscodeTransform::set_thread_count()`], encode in parallel
+/// with each other because a frame decoded on one target's worker thread is
+/// picked up by the other targets' worker threads.
+///
+/// Targets that take a fast path that doesn't decode frames, such as 'JPEG
+/// Baseline 8-bit' to 'JPEG XL JPEG Recompression', don't use the shared
+/// decode.
+///
+pub struct P10PixelDataFanOutTranscodeTransform {
+  /// Configuration for pixel data decoding, which is shared by all targets.
+  decode_config: PixelDataDecodeConfig,
+
+  /// The transcode for each target, in the order they were added.
+  targets: Vec<P10PixelDataTranscodeTransform>,
+
+  /// Whether the first token has been added, after which targets can't be
+  /// added.
+  is_started: bool,
+}
+
+impl P10PixelDataFanOutTranscodeTransform {
+  /// Creates a new fan-out pixel data transcode transform that decodes frames
+  /// with the given decode config. Targets are then added with
+  /// [`Self::add_target()`].
+  ///
+  pub fn new(decode_config: PixelDataDecodeConfig) -> Self {
+    Self {
+      decode_config,
+      targets: vec![],
+      is_started: false,
+    }
+  }
+
+  /// Adds a target that the input is transcoded into, and returns its
+  /// transcode so that it can be further configured, e.g. with
+  /// [`P10PixelDataTranscodeTransform::set_thread_count()`].
+  ///
+  /// The tokens for this target are at the index into the result of
+  /// [`Self::add_token()`] that matches the order targets were added in.
+  ///
+  /// Targets must be added before the first token is added.
+  ///
+  pub fn add_target(
+    &mut self,
+    output_transfer_syntax: &'static TransferSyntax,
+    encode_config: PixelDataEncodeConfig,
+    image_data_functions: Option<TranscodeImageDataFunctions>,
+  ) -> &mut P10PixelDataTranscodeTransform {
+    assert!(!self.is_started, "Targets must be added before any tokens");
+
+    self.targets.push(P10PixelDataTranscodeTransform::new(
+      output_transfer_syntax,
+      self.decode_config,
+      encode_config,
+      image_data_functions,
+    ));
+
+    self.targets.last_mut().unwrap()
+  }
+
+  /// Returns the transcodes for the targets, in the order they were added.
+  ///
+  pub fn targets(&self) -> &[P10PixelDataTranscodeTransform] {
+    &self.targets
+  }
+
+  /// Adds the next token to the fan-out transcode and outputs the altered
+  /// token stream for each target, in the order targets were added. Some
+  /// internal buffering of tokens is expected.
+  ///
+  pub fn add_token(
+    &mut self,
+    token: &P10Token,
+  ) -> Result<Vec<Vec<P10Token>>, P10PixelDataTranscodeTransformError> {
+    if !self.is_started {
+      self.is_started = true;
+
+      let shared_frame_decodes =
+        Rc::new(SharedFrameDecodes::new(self.targets.len()));
+
+      for (target_index, target) in self.targets.iter_mut().enumerate() {
+        target
+          .set_shared_frame_decodes(shared_frame_decodes.clone(), target_index);
+      }
+    }
+
+    self
+      .targets
+      .iter_mut()
+      .map(|target| target.add_token(token))
+      .collect()
+  }
+}
+
+/// Frames decoded for the targets of a fan-out transcode. Each frame is held
+/// until every target has either taken it or skipped decoding it, so only the
+/// frames currently being transcoded by some target are kept in memory.
+///
+pub(super) struct SharedFrameDecodes {
+  target_count: usize,
+  frames: Mutex<BTreeMap<usize, SharedFrameDecode>>,
+}
+
+/// A single frame decoded for the targets of a fan-out transcode. The first
+/// target to take the frame decodes it, and any targets that take it while
+/// that's happening wait for the decode to complete.
+///
+struct SharedFrameDecode {
+  decoded_frame: Rc<OnceLock<Result<DecodedFrame, PixelDataDecodeError>>>,
+  is_target_done: Vec<bool>,
+}
+
+impl SharedFrameDecodes {
+  fn new(target_count: usize) -> Self {
+    Self {
+      target_count,
+      frames: Mutex::new(BTreeMap::new()),
+    }
+  }
+
+  /// Returns the decoded frame with the given index, decoding it with the
+  /// passed function if no other target has. Each target must take or skip
+  /// each frame exactly once.
+  ///
+  pub fn take(
+    &self,
+    frame_index: usize,
+    target_index: usize,
+    decode: impl FnOnce() -> Result<DecodedFrame, PixelDataDecodeError>,
+  ) -> Result<DecodedFrame, PixelDataDecodeError> {
+    self
+      .mark_target_done(frame_index, target_index)
+      .get_or_init(decode)
+      .clone()
+  }
+
+  /// Records that a target transcoded the frame with the given index without
+  /// decoding it. Each target must take or skip each frame exactly once.
+  ///
+  pub fn skip(&self, frame_index: usize, target_index: usize) {
+    self.mark_target_done(frame_index, target_index);
+  }
+
+  fn mark_target_done(
+    &self,
+    frame_index: usize,
+    target_index: usize,
+  ) -> Rc<OnceLock<Result<DecodedFrame, PixelDataDecodeError>>> {
+    let mut frames = self.frames.lock().unwrap();
+
+    let frame =
+      frames
+        .entry(frame_index)
+        .or_insert_with(|| SharedFrameDecode {
+          decoded_frame: Rc::new(OnceLock::new()),
+          is_target_done: vec![false; self.target_count],
+        });
+
+    frame.is_target_done[target_index] = true;
+
+    let decoded_frame = frame.decoded_frame.clone();
+
+    // Drop the frame once every target is done with it
+    if frame.is_target_done.iter().all(|is_done| *is_done) {
+      frames.remove(&frame_index);
+    }
+
+    decoded_frame
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  use crate::MonochromeImage;
+
+  #[test]
+  fn shared_frame_decodes_test() {
+    let shared_frame_decodes = SharedFrameDecodes::new(3);
+
+    let image = MonochromeImage::new_u8(2, 1, vec![3, 9], 8, false).unwrap();
+    let decoded_frame = DecodedFrame::Monochrome(Rc::new(image));
+
+    let decode = || Ok(decoded_frame.clone());
+    let unreachable_decode =
+      || -> Result<DecodedFrame, PixelDataDecodeError> { unreachable!() };
+
+    assert_eq!(
+      shared_frame_decodes.take(0, 1, decode),
+      Ok(decoded_frame.clone())
+    );
+    shared_frame_decodes.skip(0, 0);
+    assert_eq!(shared_frame_decodes.frames.lock().unwrap().len(), 1);
+
+    assert_eq!(
+      shared_frame_decodes.take(0, 2, unreachable_decode),
+      Ok(decoded_frame.clone())
+    );
+    assert!(shared_frame_decodes.frames.lock().unwrap().is_empty());
+  }
+}
@@ -16,8 +16,8 @@ use alloc::{
 use byteorder::ByteOrder;
 
 use dcmfx_core::{
-  DataElementValue, DataError, DataSet, DcmfxError, RcByteSlice,
-  ValueRepresentation, dictionary,
+  DataElementTag, DataElementValue, DataError, DataSet, DcmfxError,
+  RcByteSlice, ValueRepresentation, dictionary,
 };
 use dcmfx_p10::{
   P10CustomTypeTransform, P10CustomTypeTransformError, P10Error,
@@ -67,11 +67,15 @@ pub struct P10PixelDataFrameTransform {
   next_frame_index: usize,
 }
 
-type OffsetTable = VecDeque<(u64, Option<u64>)>;
+/// The offset of each frame in encapsulated pixel data, along with its length
+/// if this came from an Extended Offset Table. Offsets are relative to the
+/// first byte of the item that follows the Basic Offset Table item.
+///
+pub(crate) type OffsetTable = VecDeque<(u64, Option<u64>)>;
 
 #[derive(Clone, Debug, PartialEq)]
-struct PixelDataFrameTransformDetails {
-  number_of_frames: usize,
+pub(crate) struct PixelDataFrameTransformDetails {
+  pub(crate) number_of_frames: usize,
   rows: u16,
   columns: u16,
   bits_allocated: u16,
@@ -82,7 +86,7 @@ struct PixelDataFrameTransformDetails {
 }
 
 impl PixelDataFrameTransformDetails {
-  fn from_data_set(data_set: &DataSet) -> Result<Self, DataError> {
+  pub(crate) fn from_data_set(data_set: &DataSet) -> Result<Self, DataError> {
     let number_of_frames = data_set
       .get_int_with_default::<usize>(dictionary::NUMBER_OF_FRAMES.tag, 1)?;
 
@@ -107,6 +111,172 @@ impl PixelDataFrameTransformDetails {
         .cloned(),
     })
   }
+
+  /// Returns the size of a single frame of native pixel data in bits.
+  ///
+  pub(crate) fn native_pixel_data_frame_size(&self) -> u64 {
+    let bits_per_pixel = if self.photometric_interpretation == "YBR_FULL_422" {
+      self.bits_allocated * 2
+    } else {
+      self.bits_allocated * self.samples_per_pixel
+    };
+
+    self.rows as u64 * self.columns as u64 * bits_per_pixel as u64
+  }
+
+  /// Reads the offset table for encapsulated pixel data from the data of its
+  /// Basic Offset Table item, falling back to the Extended Offset Table when
+  /// the Basic Offset Table is empty. If neither are present then the returned
+  /// offset table is empty.
+  ///
+  pub(crate) fn read_offset_table(
+    &self,
+    basic_offset_table_data: &[u8],
+  ) -> Result<OffsetTable, DataError> {
+    let basic_offset_table = read_basic_offset_table(basic_offset_table_data)?;
+    let extended_offset_table = self.read_extended_offset_table()?;
+
+    // If the Basic Offset Table is empty then use the Extended Offset Table if
+    // present. If neither are present then there is no offset table.
+    if basic_offset_table.is_empty() {
+      Ok(extended_offset_table.unwrap_or(VecDeque::new()))
+    } else {
+      // Validate that the Extended Offset Table is empty. Ref: PS3.5 A.4.
+      if extended_offset_table.is_some() {
+        return Err(DataError::new_value_invalid(
+          "Extended Offset Table must be absent when there is a Basic Offset \
+           Table"
+            .to_string(),
+        ));
+      }
+
+      Ok(basic_offset_table)
+    }
+  }
+
+  fn read_extended_offset_table(
+    &self,
+  ) -> Result<Option<OffsetTable>, DataError> {
+    match self {
+      Self {
+        extended_offset_table: Some(extended_offset_table),
+        extended_offset_table_lengths: Some(extended_offset_table_lengths),
+        ..
+      } => {
+        // Get the value of the '(0x7FE0,0001) Extended Offset Table' data
+        // element
+        let extended_offset_table_bytes = extended_offset_table
+          .vr_bytes(&[ValueRepresentation::OtherVeryLongString])?;
+
+        if extended_offset_table_bytes.len() % 8 != 0 {
+          return Err(DataError::new_value_invalid(
+            "Extended Offset Table has invalid size".to_string(),
+          ));
+        }
+
+        let mut extended_offset_table =
+          vec![0u64; extended_offset_table_bytes.len() / 8];
+        byteorder::LittleEndian::read_u64_into(
+          extended_offset_table_bytes,
+          extended_offset_table.as_mut_slice(),
+        );
+
+        // Check that the first offset is zero
+        if *extended_offset_table.first().unwrap_or(&0) != 0 {
+          return Err(DataError::new_value_invalid(
+            "Extended Offset Table first value must be zero".to_string(),
+          ));
+        }
+
+        // Check that the offsets are sorted
+        if !extended_offset_table.is_sorted() {
+          return Err(DataError::new_value_invalid(
+            "Extended Offset Table values are not sorted".to_string(),
+          ));
+        }
+
+        // Get the value of the '(0x7FE0,0002) Extended Offset Table Lengths'
+        // data element
+        let extended_offset_table_lengths_bytes = extended_offset_table_lengths
+          .vr_bytes(&[ValueRepresentation::OtherVeryLongString])?;
+
+        if extended_offset_table_lengths_bytes.len() % 8 != 0 {
+          return Err(DataError::new_value_invalid(
+            "Extended Offset Table Lengths has invalid size".to_string(),
+          ));
+        }
+
+        let mut extended_offset_table_lengths =
+          vec![0u64; extended_offset_table_lengths_bytes.len() / 8];
+        byteorder::LittleEndian::read_u64_into(
+          extended_offset_table_lengths_bytes,
+          extended_offset_table_lengths.as_mut_slice(),
+        );
+
+        // Check the two are of the same length
+        if extended_offset_table.len() != extended_offset_table_lengths.len() {
+          return Err(DataError::new_value_invalid(
+            "Extended Offset Table and Lengths don't have the same number of \
+          items"
+              .to_string(),
+          ));
+        }
+
+        // Return the offset table
+        let mut entries = VecDeque::with_capacity(extended_offset_table.len());
+        for i in 0..extended_offset_table.len() {
+          entries.push_back((
+            extended_offset_table[i],
+            Some(extended_offset_table_lengths[i]),
+          ));
+        }
+
+        Ok(Some(entries))
+      }
+
+      _ => Ok(None),
+    }
+  }
+}
+
+fn read_basic_offset_table(
+  offset_table_data: &[u8],
+) -> Result<OffsetTable, DataError> {
+  if offset_table_data.is_empty() {
+    return Ok(VecDeque::new());
+  }
+
+  // Validate the data's length is a multiple of 4
+  if offset_table_data.len() % 4 != 0 {
+    return Err(DataError::new_value_invalid(
+      "Basic Offset Table length is not a multiple of 4".to_string(),
+    ));
+  }
+
+  // Read data into u32 values
+  let mut offsets = vec![0u32; offset_table_data.len() / 4];
+  byteorder::LittleEndian::read_u32_into(offset_table_data, &mut offsets);
+
+  // Check that the first offset is zero. Ref: PS3.5 A.4.
+  if offsets.first() != Some(&0) {
+    return Err(DataError::new_value_invalid(
+      "Basic Offset Table first value must be zero".to_string(),
+    ));
+  }
+
+  // Check that the offsets are sorted
+  if !offsets.is_sorted() {
+    return Err(DataError::new_value_invalid(
+      "Basic Offset Table values are not sorted".to_string(),
+    ));
+  }
+
+  let mut offset_table = VecDeque::new();
+  for offset in offsets {
+    offset_table.push_back((u64::from(offset), None));
+  }
+
+  Ok(offset_table)
 }
 
 /// An error that occurred in the process of extracting frames of pixel data
@@ -225,17 +395,8 @@ impl P10PixelDataFrameTransform {
 
         if self.get_number_of_frames() > 0 {
           let details = self.details.get_output().unwrap();
-
-          let bits_per_pixel =
-            if details.photometric_interpretation == "YBR_FULL_422" {
-              details.bits_allocated * 2
-            } else {
-              details.bits_allocated * details.samples_per_pixel
-            };
-
-          self.native_pixel_data_frame_size = details.rows as u64
-            * details.columns as u64
-            * bits_per_pixel as u64;
+          self.native_pixel_data_frame_size =
+            details.native_pixel_data_frame_size();
         }
 
         Ok(vec![])
@@ -322,6 +483,98 @@ impl P10PixelDataFrameTransform {
     }
   }
 
+  /// Returns the number of bytes of pixel data that have been received but not
+  /// yet emitted as part of a frame.
+  ///
+  pub fn buffered_bytes(&self) -> u64 {
+    (self.pixel_data_write_offset - self.pixel_data_read_offset) / 8
+  }
+
+  /// Returns the offset table for encapsulated pixel data, which is available
+  /// once the Basic Offset Table item has been received. Each entry is the
+  /// offset of a frame's first item relative to the first byte of the item
+  /// that follows the Basic Offset Table item, along with the frame's length if
+  /// it came from an Extended Offset Table. The offset table is empty if the
+  /// pixel data has neither.
+  ///
+  /// Entries are removed as the frames they describe are emitted, so this is
+  /// complete only until the first frame is emitted.
+  ///
+  pub fn offset_table(&self) -> Option<Vec<(u64, Option<u64>)>> {
+    if !self.is_encapsulated {
+      return None;
+    }
+
+    self
+      .offset_table
+      .as_ref()
+      .map(|offset_table| offset_table.iter().copied().collect())
+  }
+
+  /// Returns the size of a single frame of native pixel data in bits, which is
+  /// available once the header of native pixel data has been received.
+  ///
+  pub fn native_pixel_data_frame_size(&self) -> Option<u64> {
+    if self.is_encapsulated || self.native_pixel_data_frame_size == 0 {
+      return None;
+    }
+
+    Some(self.native_pixel_data_frame_size)
+  }
+
+  /// Creates a frame of encapsulated pixel data from raw bytes that start with
+  /// the header of the frame's first item, e.g. bytes retrieved directly from
+  /// a DICOM P10 file using the offset table. Items are read until the end of
+  /// the data or a sequence delimitation item is reached, and no data is
+  /// copied. If the frame's length is known from an Extended Offset Table then
+  /// it is applied to the frame.
+  ///
+  pub fn encapsulated_frame_from_bytes(
+    index: usize,
+    data: &RcByteSlice,
+    length: Option<u64>,
+  ) -> Result<PixelDataFrame, DataError> {
+    let mut frame = PixelDataFrame::new();
+    frame.set_index(index);
+
+    let mut offset = 0;
+    while offset + 8 <= data.len() {
+      let group = byteorder::LittleEndian::read_u16(&data[offset..]);
+      let element = byteorder::LittleEndian::read_u16(&data[offset + 2..]);
+      let tag = DataElementTag::new(group, element);
+
+      if tag == dictionary::SEQUENCE_DELIMITATION_ITEM.tag {
+        break;
+      }
+
+      if tag != dictionary::ITEM.tag {
+        return Err(DataError::new_value_invalid(format!(
+          "Encapsulated pixel data has invalid item tag '{tag}'"
+        )));
+      }
+
+      let item_length =
+        byteorder::LittleEndian::read_u32(&data[offset + 4..]) as usize;
+
+      offset += 8;
+
+      if offset + item_length > data.len() {
+        return Err(DataError::new_value_invalid(
+          "Encapsulated pixel data item is truncated".to_string(),
+        ));
+      }
+
+      frame.push_bytes(data.slice(offset, offset + item_length));
+      offset += item_length;
+    }
+
+    if let Some(length) = length {
+      Self::apply_length_to_frame(&mut frame, length)?;
+    }
+
+    Ok(frame)
+  }
+
   /// Consumes native pixel data for as many frames as possible and returns
   /// them.
   ///
@@ -396,7 +649,20 @@ impl P10PixelDataFrameTransform {
       // If the Basic Offset Table hasn't been read yet, read it now that the
       // first pixel data item is complete
       None => {
-        self.offset_table = Some(self.read_offset_table()?);
+        // Read Basic Offset Table data into a buffer
+        let mut offset_table_data = vec![];
+        for (data, _, is_pixel_data_item_header) in self.pixel_data.iter() {
+          if !is_pixel_data_item_header {
+            offset_table_data.extend_from_slice(data);
+          }
+        }
+
+        let offset_table = match self.details.get_output() {
+          Some(details) => details.read_offset_table(&offset_table_data)?,
+          None => read_basic_offset_table(&offset_table_data)?,
+        };
+
+        self.offset_table = Some(offset_table);
         self.pixel_data.clear();
         self.pixel_data_write_offset = 0;
         self.pixel_data_read_offset = 0;
@@ -479,161 +745,7 @@ impl P10PixelDataFrameTransform {
     }
   }
 
-  fn read_offset_table(&self) -> Result<OffsetTable, DataError> {
-    let basic_offset_table = self.read_basic_offset_table()?;
-    let extended_offset_table = self.read_extended_offset_table()?;
-
-    // If the Basic Offset Table is empty then use the Extended Offset Table if
-    // present. If neither are present then there is no offset table.
-    if basic_offset_table.is_empty() {
-      Ok(extended_offset_table.unwrap_or(VecDeque::new()))
-    } else {
-      // Validate that the Extended Offset Table is empty. Ref: PS3.5 A.4.
-      if extended_offset_table.is_some() {
-        return Err(DataError::new_value_invalid(
-          "Extended Offset Table must be absent when there is a Basic Offset \
-           Table"
-            .to_string(),
-        ));
-      }
-
-      Ok(basic_offset_table)
-    }
-  }
-
-  fn read_basic_offset_table(&self) -> Result<OffsetTable, DataError> {
-    // Read Basic Offset Table data into a buffer
-    let mut offset_table_data = vec![];
-    for (data, _, is_pixel_data_item_header) in self.pixel_data.iter() {
-      if *is_pixel_data_item_header {
-        continue;
-      }
-
-      offset_table_data.extend_from_slice(data);
-    }
-
-    if offset_table_data.is_empty() {
-      return Ok(VecDeque::new());
-    }
-
-    // Validate the data's length is a multiple of 4
-    if offset_table_data.len() % 4 != 0 {
-      return Err(DataError::new_value_invalid(
-        "Basic Offset Table length is not a multiple of 4".to_string(),
-      ));
-    }
-
-    // Read data into u32 values
-    let mut offsets = vec![0u32; offset_table_data.len() / 4];
-    byteorder::LittleEndian::read_u32_into(&offset_table_data, &mut offsets);
-
-    // Check that the first offset is zero. Ref: PS3.5 A.4.
-    if offsets.first() != Some(&0) {
-      return Err(DataError::new_value_invalid(
-        "Basic Offset Table first value must be zero".to_string(),
-      ));
-    }
-
-    // Check that the offsets are sorted
-    if !offsets.is_sorted() {
-      return Err(DataError::new_value_invalid(
-        "Basic Offset Table values are not sorted".to_string(),
-      ));
-    }
-
-    let mut offset_table = VecDeque::new();
-    for offset in offsets {
-      offset_table.push_back((u64::from(offset), None));
-    }
-
-    Ok(offset_table)
-  }
-
-  fn read_extended_offset_table(
-    &self,
-  ) -> Result<Option<OffsetTable>, DataError> {
-    match self.details.get_output() {
-      Some(PixelDataFrameTransformDetails {
-        extended_offset_table: Some(extended_offset_table),
-        extended_offset_table_lengths: Some(extended_offset_table_lengths),
-        ..
-      }) => {
-        // Get the value of the '(0x7FE0,0001) Extended Offset Table' data
-        // element
-        let extended_offset_table_bytes = extended_offset_table
-          .vr_bytes(&[ValueRepresentation::OtherVeryLongString])?;
-
-        if extended_offset_table_bytes.len() % 8 != 0 {
-          return Err(DataError::new_value_invalid(
-            "Extended Offset Table has invalid size".to_string(),
-          ));
-        }
-
-        let mut extended_offset_table =
-          vec![0u64; extended_offset_table_bytes.len() / 8];
-        byteorder::LittleEndian::read_u64_into(
-          extended_offset_table_bytes,
-          extended_offset_table.as_mut_slice(),
-        );
-
-        // Check that the first offset is zero
-        if *extended_offset_table.first().unwrap_or(&0) != 0 {
-          return Err(DataError::new_value_invalid(
-            "Extended Offset Table first value must be zero".to_string(),
-          ));
-        }
-
-        // Check that the offsets are sorted
-        if !extended_offset_table.is_sorted() {
-          return Err(DataError::new_value_invalid(
-            "Extended Offset Table values are not sorted".to_string(),
-          ));
-        }
-
-        // Get the value of the '(0x7FE0,0002) Extended Offset Table Lengths'
-        // data element
-        let extended_offset_table_lengths_bytes = extended_offset_table_lengths
-          .vr_bytes(&[ValueRepresentation::OtherVeryLongString])?;
-
-        if extended_offset_table_lengths_bytes.len() % 8 != 0 {
-          return Err(DataError::new_value_invalid(
-            "Extended Offset Table Lengths has invalid size".to_string(),
-          ));
-        }
-
-        let mut extended_offset_table_lengths =
-          vec![0u64; extended_offset_table_lengths_bytes.len() / 8];
-        byteorder::LittleEndian::read_u64_into(
-          extended_offset_table_lengths_bytes,
-          extended_offset_table_lengths.as_mut_slice(),
-        );
-
-        // Check the two are of the same length
-        if extended_offset_table.len() != extended_offset_table_lengths.len() {
-          return Err(DataError::new_value_invalid(
-            "Extended Offset Table and Lengths don't have the same number of \
-          items"
-              .to_string(),
-          ));
-        }
-
-        // Return the offset table
-        let mut entries = VecDeque::with_capacity(extended_offset_table.len());
-        for i in 0..extended_offset_table.len() {
-          entries.push_back((
-            extended_offset_table[i],
-            Some(extended_offset_table_lengths[i]),
-          ));
-        }
-
-        Ok(Some(entries))
-      }
-
-      _ => Ok(None),
-    }
-  }
-
-  fn apply_length_to_frame(
+  pub(crate) fn apply_length_to_frame(
     frame: &mut PixelDataFrame,
     frame_length: u64,
   ) -> Result<(), DataError> {
@@ -736,6 +848,43 @@ mod tests {
     );
   }
 
+  #[test]
+  fn encapsulated_frame_from_bytes() {
+    let data = RcByteSlice::from(
+      vec![
+        vec![0xFE, 0xFF, 0x00, 0xE0, 4, 0, 0, 0],
+        vec![1, 2, 3, 4],
+        vec![0xFE, 0xFF, 0x00, 0xE0, 2, 0, 0, 0],
+        vec![5, 6],
+        vec![0xFE, 0xFF, 0xDD, 0xE0, 0, 0, 0, 0],
+      ]
+      .concat(),
+    );
+
+    let mut frame =
+      P10PixelDataFrameTransform::encapsulated_frame_from_bytes(3, &data, None)
+        .unwrap();
+    assert_eq!(frame.index(), Some(3));
+    assert_eq!(frame.combine_chunks(), &[1, 2, 3, 4, 5, 6]);
+
+    let mut frame = P10PixelDataFrameTransform::encapsulated_frame_from_bytes(
+      0,
+      &data,
+      Some(5),
+    )
+    .unwrap();
+    assert_eq!(frame.combine_chunks(), &[1, 2, 3, 4, 5]);
+
+    assert!(
+      P10PixelDataFrameTransform::encapsulated_frame_from_bytes(
+        0,
+        &data.take(10),
+        None
+      )
+      .is_err()
+    );
+  }
+
   fn p10_tokens_to_frames(tokens: &[P10Token]) -> Vec<Vec<u8>> {
     let mut transform = P10PixelDataFrameTransform::new();
 
@@ -14,19 +14,40 @@ use dcmfx_core::{
 };
 use dcmfx_p10::{
   P10CustomTypeTransform, P10CustomTypeTransformError, P10Error,
-  P10FilterTransform, P10InsertTransform, P10Token,
+  P10FilterTransform, P10InsertTransform, P10Token, P10TokenTransform,
 };
 
 use crate::{
   ColorImage, MonochromeImage, P10PixelDataFrameTransform,
   P10PixelDataFrameTransformError, PixelDataDecodeConfig, PixelDataDecodeError,
   PixelDataEncodeConfig, PixelDataEncodeError, PixelDataFrame, decode, encode,
+  frame_buffer_pool,
   iods::image_pixel_module::{
     ImagePixelModule, PhotometricInterpretation, PlanarConfiguration,
   },
   transforms::CropRect,
 };
 
+#[cfg(feature = "std")]
+use super::constant_frame_cache::{ConstantFrame, ConstantFrameCache};
+use super::frame_checksum::FrameChecksum;
+#[cfg(feature = "std")]
+use super::frame_transcode_pool::FrameTranscodePool;
+#[cfg(feature = "std")]
+use super::frame_verify_thread::FrameVerifyThread;
+#[cfg(feature = "std")]
+use super::p10_pixel_data_fan_out_transcode_transform::SharedFrameDecodes;
+#[cfg(feature = "std")]
+use crate::DecodedFrame;
+#[cfg(feature = "std")]
+use crate::FrameBufferPool;
+#[cfg(feature = "std")]
+use crate::codec_stats::{CodecStage, FrameStats, time_stage};
+#[cfg(feature = "std")]
+use crate::encode::{AdaptiveEffort, TransferSyntaxSelection};
+#[cfg(not(feature = "std"))]
+use codec_stats::{CodecStage, time_stage};
+
 /// This transform takes a stream of DICOM P10 tokens and transcodes its pixel
 /// data into a different transfer syntax. This is done by decoding and encoding
 /// frames of pixel data as they stream through, as well as updating parts of
@@ -47,6 +68,10 @@ pub struct P10PixelDataTranscodeTransform {
   /// The output transfer syntax being transcoded to.
   output_transfer_syntax: &'static TransferSyntax,
 
+  /// Whether this transform only transcodes JPEG 2000 Part 1 pixel data, see
+  /// [`Self::new_high_throughput_jpeg_2000_upgrade()`].
+  is_high_throughput_jpeg_2000_upgrade: bool,
+
   /// Configuration for pixel data decoding.
   decode_config: PixelDataDecodeConfig,
 
@@ -56,7 +81,7 @@ pub struct P10PixelDataTranscodeTransform {
   /// User-provided functions that are able to alter the Image Pixel Module as
   /// well as the image data for decoded frames prior to them being encoded into
   /// the output transfer syntax.
-  image_data_functions: TranscodeImageDataFunctions,
+  image_data_functions: Rc<TranscodeImageDataFunctions>,
 
   /// Tokens buffered from the start of the transcode while waiting for the
   /// Image Pixel Module's tokens to be fully received. These tokens may then be
@@ -73,10 +98,9 @@ pub struct P10PixelDataTranscodeTransform {
   /// is received via the incoming stream of tokens.
   decoded_image_pixel_module: Option<ImagePixelModule>,
 
-  /// The Image Pixel Module for the output pixel data following encoding.
-  /// This is set once the Image Pixel Module is received via the incoming
-  /// stream of tokens.
-  output_image_pixel_module: Option<ImagePixelModule>,
+  /// Transcodes individual frames of pixel data. This is set once the Image
+  /// Pixel Module is received via the incoming stream of tokens.
+  frame_transcoder: Option<Rc<FrameTranscoder>>,
 
   /// Transform that extracts `PixelDataFrame`s from the token stream one by one
   /// as they become available.
@@ -86,6 +110,11 @@ pub struct P10PixelDataTranscodeTransform {
   /// from the main data set so it can be replaced with a transcoded one.
   pixel_data_remove_filter: P10FilterTransform,
 
+  /// Whether to check that frames encoded with a lossless transfer syntax
+  /// decode back to the stored values they were encoded from, see
+  /// [`Self::set_verify_lossless()`].
+  verify_lossless: bool,
+
   /// When transcoding to a transfer syntax that uses native pixel data, the
   /// number of bytes of pixel data still to be transcoded. This is reduced with
   /// every frame of pixel data that's emitted.
@@ -94,6 +123,126 @@ pub struct P10PixelDataTranscodeTransform {
   /// If the output transfer syntax is lossy, this is an insert transform that
   /// inserts the '(0028,2110) Lossy Image Compression' data element.
   lossy_image_compression_insert_transform: Option<P10InsertTransform>,
+
+  /// When the effort is chosen by an adaptive effort, this is an insert
+  /// transform that records the chosen effort in '(0008,2111) Derivation
+  /// Description'.
+  effort_insert_transform: Option<P10InsertTransform>,
+
+  /// Whether to write an Extended Offset Table for encapsulated pixel data,
+  /// see [`Self::set_write_extended_offset_table()`].
+  write_extended_offset_table: bool,
+
+  /// When writing an Extended Offset Table, the encoded frames that have been
+  /// transcoded so far along with their unpadded lengths. These are output
+  /// once the last frame has been transcoded.
+  extended_offset_table_frames: Vec<(RcByteSlice, u64)>,
+
+  /// The number of worker threads to transcode frames on, see
+  /// [`Self::set_thread_count()`].
+  #[cfg(feature = "std")]
+  thread_count: usize,
+
+  /// The total number of threads to share between transcoding frames on
+  /// worker threads and the codecs, see [`Self::set_thread_budget()`]. This is
+  /// cleared once it has been split up.
+  #[cfg(feature = "std")]
+  thread_budget: Option<usize>,
+
+  /// The function that returns the current thread budget, which is checked
+  /// as frames are transcoded, see [`Self::set_thread_budget_fn()`].
+  #[cfg(feature = "std")]
+  thread_budget_fn: Option<fn() -> usize>,
+
+  /// The maximum number of frames that can be in flight when transcoding on
+  /// worker threads, see [`Self::set_max_frames_in_flight()`].
+  #[cfg(feature = "std")]
+  max_frames_in_flight: usize,
+
+  /// The maximum number of bytes of frame data that can be in flight when
+  /// transcoding on worker threads, see [`Self::set_max_bytes_in_flight()`].
+  #[cfg(feature = "std")]
+  max_bytes_in_flight: usize,
+
+  /// The sizes of the frames in flight on the worker threads, in the order they
+  /// were submitted.
+  #[cfg(feature = "std")]
+  frame_sizes_in_flight: std::collections::VecDeque<usize>,
+
+  /// The NUMA node to bind the worker threads that frames are transcoded on
+  /// to, see [`Self::set_numa_node()`].
+  #[cfg(feature = "std")]
+  numa_node: Option<usize>,
+
+  /// The worker threads that frames are transcoded on. This is created when
+  /// the first frame is transcoded if more than one thread is to be used.
+  #[cfg(feature = "std")]
+  frame_transcode_pool:
+    Option<FrameTranscodePool<P10PixelDataTranscodeTransformError>>,
+
+  /// The thread that frames transcoded on this thread are verified on, see
+  /// [`Self::set_verify_lossless()`]. This is created when the first frame is
+  /// verified.
+  #[cfg(feature = "std")]
+  frame_verify_thread:
+    Option<FrameVerifyThread<P10PixelDataTranscodeTransformError>>,
+
+  /// When this transform is a target of a fan-out transcode, the frames
+  /// decoded for all of its targets along with the index of this target. See
+  /// [`super::P10PixelDataFanOutTranscodeTransform`].
+  #[cfg(feature = "std")]
+  shared_frame_decodes: Option<(Rc<SharedFrameDecodes>, usize)>,
+
+  /// The adaptive effort that chooses the encode effort, see
+  /// [`Self::set_adaptive_effort()`].
+  #[cfg(feature = "std")]
+  adaptive_effort: Option<std::sync::Arc<AdaptiveEffort>>,
+
+  /// The selection of the output transfer syntax by trial encodes, see
+  /// [`Self::set_transfer_syntax_selection()`]. This is removed once the
+  /// output transfer syntax has been selected.
+  #[cfg(feature = "std")]
+  transfer_syntax_selection: Option<TransferSyntaxSelection>,
+
+  /// The tokens held back after the Image Pixel Module until the first frame
+  /// is available to select the output transfer syntax with, along with the
+  /// frames received so far.
+  #[cfg(feature = "std")]
+  selection_token_buffer: (Vec<P10Token>, Vec<PixelDataFrame>),
+
+  /// The most memory held at once by the buffers in this transform, see
+  /// [`Self::memory_high_water_marks()`].
+  memory_high_water_marks: TranscodeMemoryHighWaterMarks,
+}
+
+/// The most memory held at once by each of the buffers in a
+/// [`P10PixelDataTranscodeTransform`], see
+/// [`P10PixelDataTranscodeTransform::memory_high_water_marks()`].
+///
+/// Sizes count the bytes of data element values and frames, and don't include
+/// the overhead of the tokens and frames that hold them.
+///
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct TranscodeMemoryHighWaterMarks {
+  /// The bytes of tokens held back until the Image Pixel Module has been
+  /// received, or until the output transfer syntax has been selected.
+  pub buffered_token_bytes: u64,
+
+  /// The bytes of pixel data received but not yet part of a complete frame.
+  pub unframed_pixel_data_bytes: u64,
+
+  /// The number of frames in flight on worker threads.
+  pub frames_in_flight: usize,
+
+  /// The bytes of frame data in flight on worker threads.
+  pub frame_bytes_in_flight: u64,
+
+  /// The bytes of transcoded frames held for an Extended Offset Table, see
+  /// [`P10PixelDataTranscodeTransform::set_write_extended_offset_table()`].
+  pub held_output_bytes: u64,
+
+  /// The bytes of tokens returned from a single call to add a token.
+  pub output_token_bytes: u64,
 }
 
 /// Holds user-provided functions that can alter the Image Pixel Module and
@@ -113,25 +262,51 @@ pub struct P10PixelDataTranscodeTransform {
 /// Note that when transcoding from 'JPEG Baseline 8-bit' to 'JPEG XL JPEG
 /// Recompression' none of these image data functions are called.
 ///
+/// [`TranscodeImageDataFunctions::lossless_crop_rect`] returns the crop rect
+/// being applied when cropping is the only change the other functions make.
+/// This allows 'JPEG Extended 12-bit' data to be cropped directly on its DCT
+/// coefficients without a lossy decode/encode cycle.
+///
 pub struct TranscodeImageDataFunctions {
   pub is_encode_decode_cycle_required: Box<IsEncodeDecodeCycleRequiredFn>,
+  pub lossless_crop_rect: Box<LosslessCropRectFn>,
   pub process_image_pixel_module: Box<ProcessImagePixelModuleFn>,
   pub process_monochrome_image: Box<ProcessImageFn<MonochromeImage>>,
   pub process_color_image: Box<ProcessImageFn<ColorImage>>,
 }
 
+// With the standard library available the image data functions are `Send` and
+// `Sync` so that frames can be transcoded on worker threads, see
+// `P10PixelDataTranscodeTransform::set_thread_count()`.
+
+#[cfg(feature = "std")]
+pub type IsEncodeDecodeCycleRequiredFn =
+  dyn Fn(&ImagePixelModule) -> bool + Send + Sync;
+#[cfg(not(feature = "std"))]
 pub type IsEncodeDecodeCycleRequiredFn = dyn Fn(&ImagePixelModule) -> bool;
 
+#[cfg(feature = "std")]
+pub type LosslessCropRectFn =
+  dyn Fn(&ImagePixelModule) -> Option<CropRect> + Send + Sync;
+#[cfg(not(feature = "std"))]
+pub type LosslessCropRectFn = dyn Fn(&ImagePixelModule) -> Option<CropRect>;
+
+#[cfg(feature = "std")]
+pub type ProcessImagePixelModuleFn =
+  dyn Fn(&mut ImagePixelModule) -> ImageDataFunctionResult + Send + Sync;
+#[cfg(not(feature = "std"))]
 pub type ProcessImagePixelModuleFn =
-  dyn Fn(
-    &mut ImagePixelModule,
-  ) -> Result<(), P10PixelDataTranscodeTransformError>;
+  dyn Fn(&mut ImagePixelModule) -> ImageDataFunctionResult;
 
+#[cfg(feature = "std")]
+pub type ProcessImageFn<T> =
+  dyn Fn(&mut T, &ImagePixelModule) -> ImageDataFunctionResult + Send + Sync;
+#[cfg(not(feature = "std"))]
 pub type ProcessImageFn<T> =
-  dyn Fn(
-    &mut T,
-    &ImagePixelModule,
-  ) -> Result<(), P10PixelDataTranscodeTransformError>;
+  dyn Fn(&mut T, &ImagePixelModule) -> ImageDataFunctionResult;
+
+pub type ImageDataFunctionResult =
+  Result<(), P10PixelDataTranscodeTransformError>;
 
 impl P10PixelDataTranscodeTransform {
   /// Creates a new pixel data transcode transform for converting a stream of
@@ -146,26 +321,316 @@ impl P10PixelDataTranscodeTransform {
     Self {
       input_transfer_syntax: &transfer_syntax::IMPLICIT_VR_LITTLE_ENDIAN,
       output_transfer_syntax,
+      is_high_throughput_jpeg_2000_upgrade: false,
       decode_config,
       encode_config,
-      image_data_functions: image_data_functions.unwrap_or_default(),
+      image_data_functions: Rc::new(image_data_functions.unwrap_or_default()),
       initial_token_buffer: Some(vec![]),
       input_image_pixel_module_transform:
         P10CustomTypeTransform::new_for_iod_module(),
       decoded_image_pixel_module: None,
-      output_image_pixel_module: None,
+      frame_transcoder: None,
       pixel_data_remove_filter: P10FilterTransform::new(Box::new(
         |tag, _vr, _length, path| {
-          !path.is_root() || tag != dictionary::PIXEL_DATA.tag
+          !path.is_root()
+            || (tag != dictionary::PIXEL_DATA.tag
+              && tag != dictionary::EXTENDED_OFFSET_TABLE.tag
+              && tag != dictionary::EXTENDED_OFFSET_TABLE_LENGTHS.tag)
         },
       )),
       p10_pixel_data_frame_transform: P10PixelDataFrameTransform::new(),
       native_pixel_data_bytes_remaining: 0,
       lossy_image_compression_insert_transform:
         Self::lossy_image_compression_insert_transform(output_transfer_syntax),
+      effort_insert_transform: None,
+      write_extended_offset_table: false,
+      verify_lossless: false,
+      extended_offset_table_frames: vec![],
+      #[cfg(feature = "std")]
+      thread_count: 1,
+      #[cfg(feature = "std")]
+      thread_budget: None,
+      #[cfg(feature = "std")]
+      thread_budget_fn: None,
+      #[cfg(feature = "std")]
+      max_frames_in_flight: 0,
+      #[cfg(feature = "std")]
+      max_bytes_in_flight: 0,
+      #[cfg(feature = "std")]
+      frame_sizes_in_flight: std::collections::VecDeque::new(),
+      #[cfg(feature = "std")]
+      numa_node: None,
+      #[cfg(feature = "std")]
+      frame_transcode_pool: None,
+      #[cfg(feature = "std")]
+      frame_verify_thread: None,
+      #[cfg(feature = "std")]
+      shared_frame_decodes: None,
+      #[cfg(feature = "std")]
+      adaptive_effort: None,
+      #[cfg(feature = "std")]
+      transfer_syntax_selection: None,
+      #[cfg(feature = "std")]
+      selection_token_buffer: (vec![], vec![]),
+      memory_high_water_marks: TranscodeMemoryHighWaterMarks::default(),
+    }
+  }
+
+  /// Creates a new pixel data transcode transform that upgrades JPEG 2000 Part
+  /// 1 pixel data to 'High-Throughput JPEG 2000 Image Compression (Lossless
+  /// Only)'. Pixel data in any other transfer syntax passes through unchanged.
+  ///
+  /// The decoded pixel data is encoded losslessly, so no further loss is
+  /// introduced. Upgrading pixel data when it's first received means later
+  /// reads can use the much faster OpenJPH decoder, see
+  /// [`crate::decode::HighThroughputJpeg2000Decoder::OpenJph`].
+  ///
+  pub fn new_high_throughput_jpeg_2000_upgrade(
+    decode_config: PixelDataDecodeConfig,
+    encode_config: PixelDataEncodeConfig,
+    image_data_functions: Option<TranscodeImageDataFunctions>,
+  ) -> Self {
+    Self {
+      is_high_throughput_jpeg_2000_upgrade: true,
+      ..Self::new(
+        &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+        decode_config,
+        encode_config,
+        image_data_functions,
+      )
     }
   }
 
+  /// Sets the number of worker threads that frames are transcoded on, which
+  /// speeds up transcoding of multi-frame pixel data. Frames are still output
+  /// in order. Each worker thread transcodes one frame at a time and lives for
+  /// as long as this transform, so codec state that's kept per thread, such as
+  /// CharLS's encoders and decoders, is reused across frames. A value of zero
+  /// uses one thread per CPU core.
+  ///
+  /// Decoders and encoders that use their own threads for a single frame
+  /// should generally be limited to one thread when this is used, see
+  /// [`PixelDataDecodeConfig::thread_count`] and
+  /// [`PixelDataEncodeConfig::set_thread_count()`].
+  ///
+  /// This must be set before the first token is added.
+  ///
+  /// Default: 1, i.e. frames are transcoded on the calling thread.
+  ///
+  #[cfg(feature = "std")]
+  pub fn set_thread_count(&mut self, thread_count: usize) {
+    self.thread_count = thread_count;
+  }
+
+  /// Sets a total number of threads to share between transcoding frames on
+  /// worker threads and the threads that decoders and encoders use for a
+  /// single frame. A value of zero uses one thread per CPU core.
+  ///
+  /// The budget is split up once the number of frames is known. Each frame
+  /// gets its own worker thread while there are more frames than threads, as
+  /// this scales better than splitting up a single frame, and any threads left
+  /// over go to the codecs. This means single-frame pixel data is transcoded
+  /// on the calling thread using codecs with the whole budget, and pixel data
+  /// with many frames is transcoded on worker threads using single-threaded
+  /// codecs.
+  ///
+  /// This overrides [`Self::set_thread_count()`] and the thread counts in the
+  /// decode and encode configs. It must be set before the first token is
+  /// added.
+  ///
+  /// Default: not set.
+  ///
+  #[cfg(feature = "std")]
+  pub fn set_thread_budget(&mut self, thread_budget: usize) {
+    self.thread_budget = Some(thread_budget);
+  }
+
+  /// Sets a function that returns the current thread budget. This works like
+  /// [`Self::set_thread_budget()`] with the value the function returns now,
+  /// and the function is then called again as frames are transcoded. When
+  /// the budget has grown enough to allow more worker threads, e.g. because
+  /// other inputs that were sharing the machine have finished, worker threads
+  /// are added so the remaining frames are spread across them. Worker threads
+  /// are never removed, and the number of threads each codec uses doesn't
+  /// change.
+  ///
+  /// It must be set before the first token is added.
+  ///
+  /// Default: not set.
+  ///
+  #[cfg(feature = "std")]
+  pub fn set_thread_budget_fn(&mut self, thread_budget_fn: fn() -> usize) {
+    self.thread_budget = Some(thread_budget_fn());
+    self.thread_budget_fn = Some(thread_budget_fn);
+  }
+
+  /// Sets the maximum number of frames that can be in flight when transcoding
+  /// frames on worker threads. This counts frames waiting for a worker thread,
+  /// being transcoded, and waiting to be output after an earlier frame, and so
+  /// caps the memory used by frames during the transcode. Adding a token
+  /// blocks when the limit is reached until the earliest frame in flight has
+  /// been transcoded.
+  ///
+  /// A value of zero allows two frames in flight per worker thread.
+  ///
+  /// Default: 0.
+  ///
+  #[cfg(feature = "std")]
+  pub fn set_max_frames_in_flight(&mut self, max_frames_in_flight: usize) {
+    self.max_frames_in_flight = max_frames_in_flight;
+  }
+
+  /// Sets the maximum number of bytes of frame data that can be in flight when
+  /// transcoding frames on worker threads. This works alongside
+  /// [`Self::set_max_frames_in_flight()`] to budget the memory used by frames
+  /// whose sizes vary, e.g. compressed frames. One frame is always allowed in
+  /// flight regardless of its size.
+  ///
+  /// Adding a token blocks while the budget is used up, which applies
+  /// backpressure to whatever is supplying tokens, e.g. a reader that is only
+  /// allowed to run a bounded distance ahead of this transform.
+  ///
+  /// A value of zero places no limit on the bytes in flight.
+  ///
+  /// Default: 0.
+  ///
+  #[cfg(feature = "std")]
+  pub fn set_max_bytes_in_flight(&mut self, max_bytes_in_flight: usize) {
+    self.max_bytes_in_flight = max_bytes_in_flight;
+  }
+
+  /// Sets the NUMA node that frames are transcoded on. Frames are then always
+  /// transcoded on worker threads bound to that node, even when only one
+  /// thread is used, so that decoding and encoding a frame, the frame buffers
+  /// it's decoded into, and the parallel work of its codecs on the node's
+  /// shared worker pool all stay on one node. See [`crate::numa`] and
+  /// [`crate::worker_pool::set_shared_per_node()`].
+  ///
+  /// This must be set before the first token is added.
+  ///
+  /// Default: not set.
+  ///
+  #[cfg(feature = "std")]
+  pub fn set_numa_node(&mut self, numa_node: usize) {
+    self.numa_node = Some(numa_node);
+  }
+
+  /// Sets whether to write an *'(7FE0,0001) Extended Offset Table'* and
+  /// *'(7FE0,0002) Extended Offset Table Lengths'* when the output transfer
+  /// syntax uses encapsulated pixel data. These allow readers to go directly to
+  /// any frame, see [`crate::PixelDataFrameIndex`], and unlike the Basic Offset
+  /// Table they aren't limited to 4 GiB of pixel data.
+  ///
+  /// The Extended Offset Table is written before the pixel data, so all
+  /// encoded frames are held in memory until the last frame has been
+  /// transcoded, and the pixel data is then output in one go.
+  ///
+  /// Any Extended Offset Table in the input is always removed because it
+  /// doesn't apply to the transcoded pixel data.
+  ///
+  /// This must be set before the first token is added.
+  ///
+  /// Default: false.
+  ///
+  pub fn set_write_extended_offset_table(
+    &mut self,
+    write_extended_offset_table: bool,
+  ) {
+    self.write_extended_offset_table = write_extended_offset_table;
+  }
+
+  /// Sets whether to check that every frame encoded with a lossless output
+  /// transfer syntax decodes back to exactly the stored values of the input
+  /// frame it was transcoded from. A CRC-32 of the input frame's decoded
+  /// samples is taken before any image processing such as color conversion
+  /// or cropping, and is compared with one of the encoded frame's decoded
+  /// samples.
+  ///
+  /// When frames are transcoded on worker threads each frame is verified on
+  /// the worker thread that encoded it, which overlaps with the encoding of
+  /// other frames. Otherwise frames are verified on a separate thread while
+  /// the next frame is transcoded.
+  ///
+  /// The cost is one extra decode of each frame, e.g. for JPEG-LS this is
+  /// around three quarters of the time taken to encode it. This is hidden by
+  /// the overlap described above when more than one CPU core is available.
+  /// The checksums themselves take well under 1% of the time.
+  ///
+  /// A frame that doesn't decode to the stored values it was transcoded from
+  /// fails the transcode with
+  /// [`P10PixelDataTranscodeTransformError::VerifyFailed`]. This includes
+  /// transcodes that deliberately change the stored values, e.g. by
+  /// converting between color spaces or cropping.
+  ///
+  /// This has no effect when the output transfer syntax is lossy, or on
+  /// frames that are passed through without being decoded and re-encoded,
+  /// such as JPEG recompressed to JPEG XL.
+  ///
+  /// This must be set before the first token is added.
+  ///
+  /// Default: false.
+  ///
+  pub fn set_verify_lossless(&mut self, verify_lossless: bool) {
+    self.verify_lossless = verify_lossless;
+  }
+
+  /// Sets an adaptive effort that chooses the effort to encode with in place
+  /// of [`PixelDataEncodeConfig::effort()`]. The effort is taken from the
+  /// adaptive effort when the Image Pixel Module has been received and is used
+  /// for all frames, the time taken to encode each frame is reported back to
+  /// it, and the chosen effort is recorded in the output in *'(0008,2111)
+  /// Derivation Description'*, replacing any existing value.
+  ///
+  /// This only has an effect when encoding into 'JPEG XL Lossless', unless
+  /// [`PixelDataEncodeConfig::jpeg_xl_fast_lossless()`] is enabled, or 'JPEG
+  /// XL', as these are the transfer syntaxes that use an effort.
+  ///
+  /// This must be set before the first token is added.
+  ///
+  /// Default: not set.
+  ///
+  #[cfg(feature = "std")]
+  pub fn set_adaptive_effort(
+    &mut self,
+    adaptive_effort: std::sync::Arc<AdaptiveEffort>,
+  ) {
+    self.adaptive_effort = Some(adaptive_effort);
+  }
+
+  /// Sets the output transfer syntax to be selected automatically from a list
+  /// of candidates by trial encoding tiles of the first frame with each of
+  /// them, see [`TransferSyntaxSelection`]. Output is held back until the
+  /// first frame has been received and the selection has been made.
+  ///
+  /// The output transfer syntax passed to [`Self::new()`] is used if there
+  /// are no frames, or if none of the candidates can encode the pixel data.
+  /// The image data functions are used with whichever transfer syntax is
+  /// selected, so they need to suit all of the candidates.
+  ///
+  /// This must be set before the first token is added.
+  ///
+  /// Default: not set.
+  ///
+  #[cfg(feature = "std")]
+  pub fn set_transfer_syntax_selection(
+    &mut self,
+    transfer_syntax_selection: TransferSyntaxSelection,
+  ) {
+    self.transfer_syntax_selection = Some(transfer_syntax_selection);
+  }
+
+  /// Makes this transform take its decoded frames from the shared decodes of
+  /// a fan-out transcode, as the target with the given index.
+  ///
+  #[cfg(feature = "std")]
+  pub(super) fn set_shared_frame_decodes(
+    &mut self,
+    shared_frame_decodes: Rc<SharedFrameDecodes>,
+    target_index: usize,
+  ) {
+    self.shared_frame_decodes = Some((shared_frame_decodes, target_index));
+  }
+
   /// Returns the input transfer syntax for this pixel data transcode
   /// transform. This is determined by the File Meta Information in the incoming
   /// DICOM P10 token stream.
@@ -175,12 +640,22 @@ impl P10PixelDataTranscodeTransform {
   }
 
   /// Returns the output transfer syntax for this pixel data transcode
-  /// transform, as specified when it was created.
+  /// transform, as specified when it was created or as selected by
+  /// [`Self::set_transfer_syntax_selection()`].
   ///
   pub fn output_transfer_syntax(&self) -> &'static TransferSyntax {
     self.output_transfer_syntax
   }
 
+  /// Returns the most memory held at once by each of the buffers in this
+  /// transform so far. This can be used to size the budgets set with
+  /// [`Self::set_max_frames_in_flight()`] and
+  /// [`Self::set_max_bytes_in_flight()`].
+  ///
+  pub fn memory_high_water_marks(&self) -> TranscodeMemoryHighWaterMarks {
+    self.memory_high_water_marks
+  }
+
   /// Whether this pixel data transcode is active. A pixel data transcode
   /// becomes inactive if its determined that the incoming token stream does not
   /// contain a valid Image Pixel Module. Such a token stream will then not be
@@ -198,17 +673,41 @@ impl P10PixelDataTranscodeTransform {
   /// an altered token stream containing the transcoded data set. Some internal
   /// buffering of tokens is expected.
   ///
+  /// [`P10TokenTransform::push_token()`] avoids cloning the token, and passes
+  /// it straight through without allocating when this transform is inactive.
+  ///
   pub fn add_token(
     &mut self,
     token: &P10Token,
+  ) -> Result<Vec<P10Token>, P10PixelDataTranscodeTransformError> {
+    self.transform_token(token.clone())
+  }
+
+  /// Adds the next token to the P10 pixel data transcode transform, taking
+  /// ownership of it so that it can be output without being cloned.
+  ///
+  fn transform_token(
+    &mut self,
+    token: P10Token,
+  ) -> Result<Vec<P10Token>, P10PixelDataTranscodeTransformError> {
+    let output_tokens = self.transform_token_inner(token)?;
+
+    self.update_memory_high_water_marks(&output_tokens);
+
+    Ok(output_tokens)
+  }
+
+  fn transform_token_inner(
+    &mut self,
+    token: P10Token,
   ) -> Result<Vec<P10Token>, P10PixelDataTranscodeTransformError> {
     if !self.is_active() {
-      return Ok(vec![token.clone()]);
+      return Ok(vec![token]);
     }
 
     // Store the input transfer syntax if one is specified in the File Meta
     // Information
-    if let P10Token::FileMetaInformation { data_set } = token
+    if let P10Token::FileMetaInformation { data_set } = &token
       && data_set.has(dictionary::TRANSFER_SYNTAX_UID.tag)
     {
       self.input_transfer_syntax = data_set
@@ -216,9 +715,25 @@ impl P10PixelDataTranscodeTransform {
         .map_err(P10PixelDataTranscodeTransformError::DataError)?;
     }
 
+    // When upgrading JPEG 2000 Part 1 pixel data, this transform becomes a
+    // no-op if the input is in any other transfer syntax
+    if let P10Token::FileMetaInformation { .. } = &token
+      && self.is_high_throughput_jpeg_2000_upgrade
+      && !matches!(
+        self.input_transfer_syntax,
+        &transfer_syntax::JPEG_2000 | &transfer_syntax::JPEG_2000_LOSSLESS_ONLY
+      )
+    {
+      let mut initial_token_buffer =
+        core::mem::take(self.initial_token_buffer.as_mut().unwrap());
+      initial_token_buffer.push(token);
+      self.initial_token_buffer = None;
+      return Ok(initial_token_buffer);
+    }
+
     // Pass the token through the transform that extracts the Image Pixel Module
     // in the incoming data set
-    match self.input_image_pixel_module_transform.add_token(token) {
+    match self.input_image_pixel_module_transform.add_token(&token) {
       Ok(()) => (),
 
       // If the Image Pixel Module couldn't be created due to a missing data
@@ -230,7 +745,7 @@ impl P10PixelDataTranscodeTransform {
       )) => {
         let mut initial_token_buffer =
           core::mem::take(self.initial_token_buffer.as_mut().unwrap());
-        initial_token_buffer.push(token.clone());
+        initial_token_buffer.push(token);
         self.initial_token_buffer = None;
         return Ok(initial_token_buffer);
       }
@@ -241,12 +756,189 @@ impl P10PixelDataTranscodeTransform {
     }
 
     // Pass the token through the pixel data frames transform, receiving any
-    // raw frames of pixel data that are now available
-    let input_frames = self
-      .p10_pixel_data_frame_transform
-      .add_token(token)
-      .map_err(map_p10_pixel_data_frame_transform_error)?;
+    // raw frames of pixel data that are now available. Only tokens that carry
+    // value bytes are traced as the rest are trivial.
+    let input_frames = {
+      #[cfg(feature = "std")]
+      let _span = matches!(token, P10Token::DataElementValueBytes { .. })
+        .then(|| crate::trace_events::span("extract_frames"));
+
+      self
+        .p10_pixel_data_frame_transform
+        .add_token(&token)
+        .map_err(map_p10_pixel_data_frame_transform_error)?
+    };
 
+    #[cfg(feature = "std")]
+    if self.transfer_syntax_selection.is_some() {
+      return self.add_token_to_selection_token_buffer(token, input_frames);
+    }
+
+    self.transcode_token(token, input_frames)
+  }
+
+  /// Updates the memory high-water marks with the current contents of this
+  /// transform's buffers, and the tokens being output.
+  ///
+  fn update_memory_high_water_marks(&mut self, output_tokens: &[P10Token]) {
+    let buffered_tokens = self.initial_token_buffer.iter().flatten();
+    #[cfg(feature = "std")]
+    let buffered_tokens =
+      buffered_tokens.chain(self.selection_token_buffer.0.iter());
+
+    let marks = &mut self.memory_high_water_marks;
+
+    marks.buffered_token_bytes = marks
+      .buffered_token_bytes
+      .max(buffered_tokens.map(token_value_bytes).sum());
+    marks.unframed_pixel_data_bytes = marks
+      .unframed_pixel_data_bytes
+      .max(self.p10_pixel_data_frame_transform.buffered_bytes());
+    marks.held_output_bytes = marks.held_output_bytes.max(
+      self
+        .extended_offset_table_frames
+        .iter()
+        .map(|(frame, _)| frame.len() as u64)
+        .sum(),
+    );
+    marks.output_token_bytes = marks
+      .output_token_bytes
+      .max(output_tokens.iter().map(token_value_bytes).sum());
+
+    #[cfg(feature = "std")]
+    {
+      marks.frames_in_flight =
+        marks.frames_in_flight.max(self.frame_sizes_in_flight.len());
+      marks.frame_bytes_in_flight = marks
+        .frame_bytes_in_flight
+        .max(self.frame_sizes_in_flight.iter().sum::<usize>() as u64);
+    }
+  }
+
+  /// Holds back tokens from the end of the Image Pixel Module until the first
+  /// frame is available, then selects the output transfer syntax by trial
+  /// encoding tiles of that frame, and transcodes the held tokens.
+  ///
+  #[cfg(feature = "std")]
+  fn add_token_to_selection_token_buffer(
+    &mut self,
+    token: P10Token,
+    input_frames: Vec<PixelDataFrame>,
+  ) -> Result<Vec<P10Token>, P10PixelDataTranscodeTransformError> {
+    let Some(image_pixel_module) =
+      self.input_image_pixel_module_transform.get_output()
+    else {
+      return self.transcode_token(token, input_frames);
+    };
+
+    let is_end = matches!(token, P10Token::End);
+
+    let (tokens, frames) = &mut self.selection_token_buffer;
+    tokens.push(token);
+    frames.extend(input_frames);
+
+    if frames.is_empty() && !is_end {
+      return Ok(vec![]);
+    }
+
+    let image_pixel_module = image_pixel_module.clone();
+    let transfer_syntax_selection =
+      self.transfer_syntax_selection.take().unwrap();
+    let (tokens, mut frames) =
+      core::mem::take(&mut self.selection_token_buffer);
+
+    if let Some(first_frame) = frames.first() {
+      self.output_transfer_syntax = self.select_output_transfer_syntax(
+        &transfer_syntax_selection,
+        &image_pixel_module,
+        first_frame.clone(),
+      )?;
+      self.lossy_image_compression_insert_transform =
+        Self::lossy_image_compression_insert_transform(
+          self.output_transfer_syntax,
+        );
+    }
+
+    // Transcode the held tokens. Frames are only ever completed by the last
+    // held token, so all the frames are transcoded along with it.
+    let mut output_tokens = vec![];
+    let last_index = tokens.len() - 1;
+    for (i, token) in tokens.into_iter().enumerate() {
+      let input_frames = if i == last_index {
+        core::mem::take(&mut frames)
+      } else {
+        vec![]
+      };
+
+      output_tokens.extend(self.transcode_token(token, input_frames)?);
+    }
+
+    Ok(output_tokens)
+  }
+
+  /// Decodes the first frame and trial encodes tiles of it with each of the
+  /// candidate transfer syntaxes, returning the one selected. If no candidate
+  /// is able to encode the frame then the output transfer syntax is
+  /// unchanged.
+  ///
+  #[cfg(feature = "std")]
+  fn select_output_transfer_syntax(
+    &self,
+    transfer_syntax_selection: &TransferSyntaxSelection,
+    image_pixel_module: &ImagePixelModule,
+    mut first_frame: PixelDataFrame,
+  ) -> Result<&'static TransferSyntax, P10PixelDataTranscodeTransformError> {
+    let mut decoded_image_pixel_module = image_pixel_module.clone();
+    decoded_image_pixel_module.set_photometric_interpretation(
+      decode::decode_photometric_interpretation(
+        image_pixel_module.photometric_interpretation(),
+        self.input_transfer_syntax,
+      )
+      .map_err(P10PixelDataTranscodeTransformError::PixelDataDecodeError)?
+      .clone(),
+    );
+
+    let transfer_syntax = if image_pixel_module.is_color() {
+      let image = decode::decode_color(
+        &mut first_frame,
+        self.input_transfer_syntax,
+        image_pixel_module,
+        &self.decode_config,
+      )
+      .map_err(P10PixelDataTranscodeTransformError::PixelDataDecodeError)?;
+
+      transfer_syntax_selection.select_for_color_image(
+        &image,
+        &decoded_image_pixel_module,
+        &self.encode_config,
+      )
+    } else {
+      let image = decode::decode_monochrome(
+        &mut first_frame,
+        self.input_transfer_syntax,
+        image_pixel_module,
+        &self.decode_config,
+      )
+      .map_err(P10PixelDataTranscodeTransformError::PixelDataDecodeError)?;
+
+      transfer_syntax_selection.select_for_monochrome_image(
+        &image,
+        &decoded_image_pixel_module,
+        &self.encode_config,
+      )
+    };
+
+    Ok(transfer_syntax.unwrap_or(self.output_transfer_syntax))
+  }
+
+  /// Transcodes the next token along with any frames of pixel data it
+  /// completed.
+  ///
+  fn transcode_token(
+    &mut self,
+    token: P10Token,
+    input_frames: Vec<PixelDataFrame>,
+  ) -> Result<Vec<P10Token>, P10PixelDataTranscodeTransformError> {
     // Buffer initial tokens until the Image Pixel Module tokens are complete,
     // and then assess its content and apply alterations as required and as
     // determined by the relevant image data function.
@@ -260,45 +952,48 @@ impl P10PixelDataTranscodeTransform {
 
     // Remove the original '(7FE0,0010) Pixel Data' data element from the
     // incoming tokens. It will be replaced with the transcoded pixel data.
+    let mut passthrough_tokens = vec![];
     for token in transformed_tokens {
       if self
         .pixel_data_remove_filter
         .add_token(&token)
         .map_err(P10PixelDataTranscodeTransformError::P10Error)?
       {
-        output_tokens.push(token);
+        passthrough_tokens.push(token);
       }
     }
 
-    // Iterate over the available pixel data frames and convert them into the
-    // target transfer syntax, appending the resulting tokens to the vector
-    for mut input_frame in input_frames {
-      let encoded_frame = self.transcode_frame(&mut input_frame)?;
+    // Tokens that pass through are never inside the pixel data, so any frames
+    // still being transcoded on worker threads have to be output first
+    #[cfg(feature = "std")]
+    if !passthrough_tokens.is_empty() {
+      while self.add_next_pooled_frame_tokens(true, &mut output_tokens)? {}
+    }
 
-      let frame_index = input_frame.index().unwrap();
+    output_tokens.extend(passthrough_tokens);
 
-      if self.output_transfer_syntax.is_encapsulated {
-        output_tokens.extend(
-          self.encapsulated_pixel_data_tokens(frame_index, encoded_frame)?,
-        );
-      } else {
-        output_tokens
-          .extend(self.native_pixel_data_tokens(frame_index, encoded_frame)?);
-      }
-    }
+    // Convert the available pixel data frames into the target transfer syntax,
+    // appending the resulting tokens to the vector
+    self.transcode_frames(input_frames, &mut output_tokens)?;
 
-    // Pass through the lossy image compression insert transform if defined
-    if let Some(lossy_image_compression_insert_transform) =
-      &mut self.lossy_image_compression_insert_transform
+    // Pass through the lossy image compression and effort insert transforms if
+    // defined
+    for insert_transform in [
+      &mut self.lossy_image_compression_insert_transform,
+      &mut self.effort_insert_transform,
+    ]
+    .into_iter()
+    .flatten()
     {
-      let mut new_tokens = vec![];
+      let mut new_tokens = Vec::with_capacity(output_tokens.len());
 
       for token in output_tokens {
-        new_tokens.extend(
-          lossy_image_compression_insert_transform
-            .add_token(&token)
-            .map_err(P10PixelDataTranscodeTransformError::P10Error)?,
-        );
+        insert_transform
+          .push_token(token, &mut |token| {
+            new_tokens.push(token);
+            Ok::<(), P10Error>(())
+          })
+          .map_err(P10PixelDataTranscodeTransformError::P10Error)?;
       }
 
       output_tokens = new_tokens;
@@ -317,11 +1012,11 @@ impl P10PixelDataTranscodeTransform {
   ///
   fn add_token_to_initial_token_buffer(
     &mut self,
-    token: &P10Token,
+    token: P10Token,
   ) -> Result<Option<Vec<P10Token>>, P10PixelDataTranscodeTransformError> {
     // If initial token buffering is complete then return the token unchanged
     let Some(initial_token_buffer) = &mut self.initial_token_buffer else {
-      return Ok(Some(vec![token.clone()]));
+      return Ok(Some(vec![token]));
     };
 
     let Some(image_pixel_module) =
@@ -329,7 +1024,7 @@ impl P10PixelDataTranscodeTransform {
     else {
       // This token is prior to the end of the Image Pixel Module, so accumulate
       // it into the initial token buffer
-      initial_token_buffer.push(token.clone());
+      initial_token_buffer.push(token);
       return Ok(None);
     };
 
@@ -347,13 +1042,45 @@ impl P10PixelDataTranscodeTransform {
         self.input_transfer_syntax,
         self.output_transfer_syntax,
         &self.encode_config,
-        &mut self.image_data_functions,
+        &self.image_data_functions,
       )?;
 
-    self.decoded_image_pixel_module = Some(decoded_image_pixel_module);
-    self.output_image_pixel_module = Some(output_image_pixel_module);
+    #[cfg(feature = "native")]
+    let lossless_crop_rect = Self::lossless_crop_rect(
+      image_pixel_module,
+      &output_image_pixel_module,
+      self.input_transfer_syntax,
+      self.output_transfer_syntax,
+      &self.image_data_functions,
+    );
 
-    tokens.push(token.clone());
+    #[cfg(feature = "std")]
+    let adaptive_effort = self.apply_adaptive_effort();
+
+    self.decoded_image_pixel_module = Some(decoded_image_pixel_module);
+    self.frame_transcoder = Some(Rc::new(FrameTranscoder {
+      input_transfer_syntax: self.input_transfer_syntax,
+      output_transfer_syntax: self.output_transfer_syntax,
+      input_image_pixel_module: image_pixel_module.clone(),
+      output_image_pixel_module,
+      decode_config: self.decode_config,
+      encode_config: self.encode_config,
+      image_data_functions: self.image_data_functions.clone(),
+      verify_lossless: self.verify_lossless
+        && self.lossy_image_compression_insert_transform.is_none(),
+      #[cfg(feature = "native")]
+      lossless_crop_rect,
+      #[cfg(feature = "std")]
+      frame_buffer_pools: std::sync::Mutex::new(vec![]),
+      #[cfg(feature = "std")]
+      shared_frame_decodes: self.shared_frame_decodes.clone(),
+      #[cfg(feature = "std")]
+      adaptive_effort,
+      #[cfg(feature = "std")]
+      constant_frames: ConstantFrameCache::default(),
+    }));
+
+    tokens.push(token);
 
     // Change the Transfer Syntax UID in the File Meta Information token
     for token in &mut tokens {
@@ -363,6 +1090,83 @@ impl P10PixelDataTranscodeTransform {
     Ok(Some(tokens))
   }
 
+  /// Takes the effort to encode with from the adaptive effort if one is set
+  /// and the output transfer syntax uses an effort, and sets up the insert of
+  /// the chosen effort into the output. Returns the adaptive effort that
+  /// encoded frames should be reported to.
+  ///
+  #[cfg(feature = "std")]
+  fn apply_adaptive_effort(
+    &mut self,
+  ) -> Option<std::sync::Arc<AdaptiveEffort>> {
+    let adaptive_effort = self.adaptive_effort.as_ref()?;
+
+    let uses_effort = match self.output_transfer_syntax {
+      &transfer_syntax::JPEG_XL_LOSSLESS => {
+        !self.encode_config.jpeg_xl_fast_lossless()
+      }
+      &transfer_syntax::JPEG_XL => true,
+      _ => false,
+    };
+
+    if !uses_effort {
+      return None;
+    }
+
+    let effort = adaptive_effort.effort();
+    self.encode_config.set_effort(effort);
+
+    let mut data_set = DataSet::new();
+    data_set.insert(
+      dictionary::DERIVATION_DESCRIPTION.tag,
+      DataElementValue::new_short_text(&format!("JPEG XL effort {effort}"))
+        .unwrap(),
+    );
+    self.effort_insert_transform = Some(P10InsertTransform::new(data_set));
+
+    Some(adaptive_effort.clone())
+  }
+
+  /// Returns the crop rect to apply directly to the DCT coefficients of each
+  /// frame when transcoding 'JPEG Extended 12-bit' to itself with a crop as
+  /// the only change. Frames are then cropped without being decoded and
+  /// re-encoded, which avoids any further loss.
+  ///
+  #[cfg(feature = "native")]
+  fn lossless_crop_rect(
+    input_image_pixel_module: &ImagePixelModule,
+    output_image_pixel_module: &ImagePixelModule,
+    input_transfer_syntax: &'static TransferSyntax,
+    output_transfer_syntax: &'static TransferSyntax,
+    image_data_functions: &TranscodeImageDataFunctions,
+  ) -> Option<CropRect> {
+    if input_transfer_syntax != &transfer_syntax::JPEG_EXTENDED_12BIT
+      || output_transfer_syntax != &transfer_syntax::JPEG_EXTENDED_12BIT
+    {
+      return None;
+    }
+
+    let crop_rect =
+      (image_data_functions.lossless_crop_rect)(input_image_pixel_module)?;
+
+    // The output Image Pixel Module must differ from the input only in its
+    // dimensions
+    let (rows, columns) = crop_rect.apply(
+      input_image_pixel_module.rows(),
+      input_image_pixel_module.columns(),
+    );
+    let mut cropped_image_pixel_module = input_image_pixel_module.clone();
+    cropped_image_pixel_module
+      .set_dimensions(rows, columns)
+      .ok()?;
+
+    if &cropped_image_pixel_module != output_image_pixel_module {
+      return None;
+    }
+
+    Some(crop_rect)
+  }
+
   /// Once the Image Pixel Module has been read, this function is called to
   /// apply any required updates to its content in the transcoded tokens, e.g.
   /// a change to the Photometric Interpretation. These changes are defined by
@@ -375,7 +1179,7 @@ impl P10PixelDataTranscodeTransform {
     input_transfer_syntax: &'static TransferSyntax,
     output_transfer_syntax: &'static TransferSyntax,
     encode_config: &PixelDataEncodeConfig,
-    image_data_functions: &mut TranscodeImageDataFunctions,
+    image_data_functions: &TranscodeImageDataFunctions,
   ) -> Result<
     (Vec<P10Token>, ImagePixelModule, ImagePixelModule),
     P10PixelDataTranscodeTransformError,
@@ -459,105 +1263,892 @@ impl P10PixelDataTranscodeTransform {
     ))
   }
 
-  /// Transcodes a single [`PixelDataFrame`] into a frame for the target
-  /// transfer syntax.
+  /// Transcodes frames of pixel data into the target transfer syntax and
+  /// appends their tokens. When frames are transcoded on worker threads, the
+  /// tokens for frames that finish transcoding later are appended by a later
+  /// call.
   ///
-  fn transcode_frame(
+  fn transcode_frames(
     &mut self,
-    input_frame: &mut PixelDataFrame,
-  ) -> Result<RcByteSlice, P10PixelDataTranscodeTransformError> {
-    // Special case for direct recompression/reconstruction of JPEG Baseline
-    // 8-bit to/from JPEG XL. This is a fast path that can be taken when a full
-    // encode/decode cycle isn't needed.
-    #[cfg(all(feature = "native", feature = "std"))]
-    if !(self.image_data_functions.is_encode_decode_cycle_required)(
-      self
-        .input_image_pixel_module_transform
-        .get_output()
-        .unwrap(),
+    input_frames: Vec<PixelDataFrame>,
+    output_tokens: &mut Vec<P10Token>,
+  ) -> Result<(), P10PixelDataTranscodeTransformError> {
+    #[cfg(feature = "std")]
+    {
+      self.apply_thread_budget();
+      self.grow_worker_threads();
+    }
+
+    #[cfg(feature = "std")]
+    if self.worker_thread_count() > 1 || self.numa_node.is_some() {
+      return self
+        .transcode_frames_on_worker_threads(input_frames, output_tokens);
+    }
+
+    for mut input_frame in input_frames {
+      let frame_index = input_frame.index().unwrap();
+
+      let frame_transcoder = self.frame_transcoder.as_ref().unwrap();
+      let (encoded_frame, unverified_frame) =
+        frame_transcoder.transcode_frame(&mut input_frame)?;
+
+      if let Some(unverified_frame) = unverified_frame {
+        self.verify_frame(encoded_frame.clone(), unverified_frame)?;
+      }
+
+      self.add_frame_tokens(frame_index, encoded_frame, output_tokens)?;
+
+      // The pixel data isn't finished until the last frame has been verified
+      #[cfg(feature = "std")]
+      if frame_index + 1
+        == self.p10_pixel_data_frame_transform.get_number_of_frames()
+        && let Some(frame_verify_thread) = self.frame_verify_thread.as_mut()
+      {
+        frame_verify_thread.wait()?;
+      }
+    }
+
+    Ok(())
+  }
+
+  /// Verifies a frame transcoded on this thread. With the standard library
+  /// this is done on the verify thread, and waits for the verification of the
+  /// previous frame to complete.
+  ///
+  fn verify_frame(
+    &mut self,
+    encoded_frame: RcByteSlice,
+    unverified_frame: UnverifiedFrame,
+  ) -> Result<(), P10PixelDataTranscodeTransformError> {
+    #[cfg(feature = "std")]
+    {
+      let frame_transcoder = self.frame_transcoder.clone().unwrap();
+
+      self
+        .frame_verify_thread
+        .get_or_insert_with(FrameVerifyThread::new)
+        .submit(move || {
+          frame_transcoder.verify_frame(&encoded_frame, &unverified_frame)
+        })
+    }
+
+    #[cfg(not(feature = "std"))]
+    self
+      .frame_transcoder
+      .as_ref()
+      .unwrap()
+      .verify_frame(&encoded_frame, &unverified_frame)
+  }
+
+  /// Splits the thread budget, if one was set, between transcoding frames on
+  /// worker threads and the codecs. This is done when the first frames are
+  /// transcoded because the number of frames is then known.
+  ///
+  #[cfg(feature = "std")]
+  fn apply_thread_budget(&mut self) {
+    let Some(thread_budget) = self.thread_budget.take() else {
+      return;
+    };
+
+    let (frame_thread_count, codec_thread_count) = split_thread_budget(
+      thread_budget,
+      self.p10_pixel_data_frame_transform.get_number_of_frames(),
+    );
+
+    self.thread_count = frame_thread_count;
+    self.decode_config.thread_count = codec_thread_count;
+    self.encode_config.set_thread_count(codec_thread_count);
+
+    // The frame transcoder isn't shared with any worker threads yet
+    if let Some(frame_transcoder) =
+      self.frame_transcoder.as_mut().and_then(Rc::get_mut)
+    {
+      frame_transcoder.decode_config.thread_count = codec_thread_count;
+      frame_transcoder
+        .encode_config
+        .set_thread_count(codec_thread_count);
+    }
+  }
+
+  /// Adds worker threads when the thread budget returned by the function set
+  /// with [`Self::set_thread_budget_fn()`] now allows more of them than are
+  /// being used.
+  ///
+  #[cfg(feature = "std")]
+  fn grow_worker_threads(&mut self) {
+    let Some(thread_budget_fn) = self.thread_budget_fn else {
+      return;
+    };
+
+    let (frame_thread_count, _) = split_thread_budget(
+      thread_budget_fn(),
+      self.p10_pixel_data_frame_transform.get_number_of_frames(),
+    );
+
+    if frame_thread_count <= self.thread_count {
+      return;
+    }
+
+    // Frames that are waiting for a worker thread are picked up by the new
+    // worker threads straight away. If there's no pool yet then it's created
+    // with the new thread count when the next frames are submitted.
+    if let Some(frame_transcode_pool) = self.frame_transcode_pool.as_mut() {
+      frame_transcode_pool
+        .add_threads(frame_thread_count - frame_transcode_pool.thread_count());
+    }
+
+    self.thread_count = frame_thread_count;
+  }
+
+  /// Returns the number of worker threads to transcode frames on.
+  ///
+  #[cfg(feature = "std")]
+  fn worker_thread_count(&self) -> usize {
+    if self.thread_count == 0 {
+      std::thread::available_parallelism().map_or(1, |n| n.get())
+    } else {
+      self.thread_count
+    }
+  }
+
+  /// Submits frames to the worker threads, waiting for the earliest frame in
+  /// flight to be transcoded whenever the in-flight limit is reached, and
+  /// appends the tokens for the frames that have been transcoded in order.
+  ///
+  #[cfg(feature = "std")]
+  fn transcode_frames_on_worker_threads(
+    &mut self,
+    input_frames: Vec<PixelDataFrame>,
+    output_tokens: &mut Vec<P10Token>,
+  ) -> Result<(), P10PixelDataTranscodeTransformError> {
+    let thread_count = self.worker_thread_count();
+    let max_frames_in_flight = if self.max_frames_in_flight == 0 {
+      thread_count * 2
+    } else {
+      self.max_frames_in_flight
+    };
+
+    if self.frame_transcode_pool.is_none() {
+      let frame_transcoder = self.frame_transcoder.clone().unwrap();
+
+      self.frame_transcode_pool = Some(FrameTranscodePool::new(
+        thread_count,
+        self.numa_node,
+        move |frame| frame_transcoder.transcode_and_verify_frame(frame),
+      ));
+    }
+
+    let number_of_frames =
+      self.p10_pixel_data_frame_transform.get_number_of_frames();
+
+    for input_frame in input_frames {
+      let frame_size = input_frame.len() as usize;
+
+      while self.is_in_flight_limit_reached(max_frames_in_flight, frame_size) {
+        self.add_next_pooled_frame_tokens(true, output_tokens)?;
+      }
+
+      let is_last_frame = input_frame.index().unwrap() + 1 == number_of_frames;
+
+      self
+        .frame_transcode_pool
+        .as_mut()
+        .unwrap()
+        .submit(input_frame);
+      self.frame_sizes_in_flight.push_back(frame_size);
+      self.update_memory_high_water_marks(&[]);
+
+      // Once the last frame is submitted, wait for all frames to complete so
+      // the pixel data is finished when this returns
+      if is_last_frame {
+        while self.add_next_pooled_frame_tokens(true, output_tokens)? {}
+      }
+    }
+
+    // Output the frames that have already been transcoded
+    while self.add_next_pooled_frame_tokens(false, output_tokens)? {}
+
+    Ok(())
+  }
+
+  /// Returns whether submitting a frame of the given size would exceed the
+  /// limits on the number of frames and bytes in flight. A frame can always
+  /// be submitted when there are no frames in flight.
+  ///
+  #[cfg(feature = "std")]
+  fn is_in_flight_limit_reached(
+    &self,
+    max_frames_in_flight: usize,
+    frame_size: usize,
+  ) -> bool {
+    let frames_in_flight = self.frame_sizes_in_flight.len();
+    if frames_in_flight == 0 {
+      return false;
+    }
+
+    if frames_in_flight >= max_frames_in_flight {
+      return true;
+    }
+
+    self.max_bytes_in_flight > 0
+      && self.frame_sizes_in_flight.iter().sum::<usize>() + frame_size
+        > self.max_bytes_in_flight
+  }
+
+  /// Appends the tokens for the next frame transcoded on the worker threads.
+  /// Returns whether there was a frame to add, which, if `wait` is false, must
+  /// have already finished transcoding.
+  ///
+  #[cfg(feature = "std")]
+  fn add_next_pooled_frame_tokens(
+    &mut self,
+    wait: bool,
+    output_tokens: &mut Vec<P10Token>,
+  ) -> Result<bool, P10PixelDataTranscodeTransformError> {
+    let Some(frame_transcode_pool) = self.frame_transcode_pool.as_mut() else {
+      return Ok(false);
+    };
+
+    let Some(result) = frame_transcode_pool.next_frame(wait) else {
+      return Ok(false);
+    };
+
+    self.frame_sizes_in_flight.pop_front();
+
+    let (frame_index, encoded_frame) = result?;
+    self.add_frame_tokens(frame_index, encoded_frame, output_tokens)?;
+
+    Ok(true)
+  }
+
+  /// Appends the DICOM P10 tokens for the next transcoded frame.
+  ///
+  fn add_frame_tokens(
+    &mut self,
+    frame_index: usize,
+    encoded_frame: RcByteSlice,
+    output_tokens: &mut Vec<P10Token>,
+  ) -> Result<(), P10PixelDataTranscodeTransformError> {
+    if self.output_transfer_syntax.is_encapsulated {
+      output_tokens.extend(
+        self.encapsulated_pixel_data_tokens(frame_index, encoded_frame)?,
+      );
+    } else {
+      output_tokens
+        .extend(self.native_pixel_data_tokens(frame_index, encoded_frame)?);
+    }
+
+    Ok(())
+  }
+
+  /// Returns the DICOM P10 tokens for the next transcoded frame of native pixel
+  /// data.
+  ///
+  fn native_pixel_data_tokens(
+    &mut self,
+    frame_index: usize,
+    encoded_frame: RcByteSlice,
+  ) -> Result<Vec<P10Token>, P10PixelDataTranscodeTransformError> {
+    // Get the Image Pixel Module. This is safe to unwrap because it must have
+    // been fully received by the time pixel data is encountered.
+    let image_pixel_module = self.decoded_image_pixel_module.as_ref().unwrap();
+
+    let vr = if u8::from(image_pixel_module.bits_allocated()) <= 8 {
+      ValueRepresentation::OtherByteString
+    } else {
+      ValueRepresentation::OtherWordString
+    };
+
+    let mut tokens = vec![];
+
+    // On the first frame, calculate the total size of the native pixel data
+    // that will be output and emit the data element header
+    if frame_index == 0 {
+      let pixel_data_value_length = (image_pixel_module.frame_size_in_bits()
+        * self.p10_pixel_data_frame_transform.get_number_of_frames() as u64)
+        .div_ceil(8);
+
+      if pixel_data_value_length > u64::from(u32::MAX - 1) {
+        return Err(P10PixelDataTranscodeTransformError::DataError(
+          DataError::new_value_length_invalid(
+            vr,
+            pixel_data_value_length,
+            "Native pixel data length exceeds 2^32 - 1".to_string(),
+          )
+          .with_path(&DataSetPath::new_with_data_element(
+            dictionary::PIXEL_DATA.tag,
+          )),
+        ));
+      }
+
+      self.native_pixel_data_bytes_remaining = pixel_data_value_length as u32;
+
+      tokens.push(P10Token::DataElementHeader {
+        tag: dictionary::PIXEL_DATA.tag,
+        vr,
+        length: self.native_pixel_data_bytes_remaining,
+        path: DataSetPath::new(),
+      });
+    }
+
+    // Check that the encoded frame doesn't exceed the number of native pixel
+    // data bytes left to emit. If this happens it likely indicates a bug in
+    // either the decoding or encoding.
+    if encoded_frame.len() > self.native_pixel_data_bytes_remaining as usize {
+      return Err(P10PixelDataTranscodeTransformError::P10Error(
+        P10Error::OtherError {
+          error_type: "Transcoded pixel data too large".to_string(),
+          details: format!(
+            "Frame {} of length {} exceeds the remaining size of the native \
+             pixel data {}",
+            frame_index,
+            encoded_frame.len(),
+            self.native_pixel_data_bytes_remaining
+          ),
+        },
+      ));
+    }
+
+    // Deduct this frame's size from the total native pixel data size
+    self.native_pixel_data_bytes_remaining -= encoded_frame.len() as u32;
+
+    tokens.push(P10Token::DataElementValueBytes {
+      tag: dictionary::PIXEL_DATA.tag,
+      vr,
+      data: encoded_frame.clone(),
+      bytes_remaining: self.native_pixel_data_bytes_remaining,
+    });
+
+    Ok(tokens)
+  }
+
+  /// Returns the DICOM P10 tokens for the next transcoded frame of encapsulated
+  /// pixel data.
+  ///
+  fn encapsulated_pixel_data_tokens(
+    &mut self,
+    frame_index: usize,
+    encoded_frame: RcByteSlice,
+  ) -> Result<Vec<P10Token>, P10PixelDataTranscodeTransformError> {
+    // Check the length of the encoded frame is a valid u32 length
+    if encoded_frame.len() > (u32::MAX - 1) as usize {
+      return Err(P10PixelDataTranscodeTransformError::DataError(
+        DataError::new_value_length_invalid(
+          ValueRepresentation::OtherByteString,
+          encoded_frame.len() as u64,
+          "Encoded frame length exceeds 2^32 - 1".to_string(),
+        )
+        .with_path(&DataSetPath::new_with_data_element(
+          dictionary::PIXEL_DATA.tag,
+        )),
+      ));
+    }
+
+    let encoded_frame_length = encoded_frame.len() as u64;
+
+    let mut encoded_frame = encoded_frame.into_vec();
+    if encoded_frame.len() & 1 == 1 {
+      encoded_frame.push(0);
+    }
+
+    let is_last_frame = frame_index + 1
+      == self.p10_pixel_data_frame_transform.get_number_of_frames();
+
+    // When writing an Extended Offset Table, hold on to the encoded frames
+    // until the last one is available
+    if self.write_extended_offset_table {
+      self
+        .extended_offset_table_frames
+        .push((encoded_frame.into(), encoded_frame_length));
+
+      if is_last_frame {
+        return Ok(self.extended_offset_table_pixel_data_tokens());
+      } else {
+        return Ok(vec![]);
+      }
+    }
+
+    let mut tokens = vec![];
+
+    // On the first frame, emit tokens for the start of the pixel data sequence
+    // as well as an empty basic offset table
+    if frame_index == 0 {
+      tokens.extend(Self::pixel_data_sequence_start_tokens());
+    }
+
+    tokens.extend(Self::pixel_data_item_tokens(
+      frame_index,
+      encoded_frame.into(),
+    ));
+
+    // On the last frame, emit a sequence delimiter
+    if is_last_frame {
+      tokens.push(P10Token::SequenceDelimiter {
+        tag: dictionary::PIXEL_DATA.tag,
+      })
+    }
+
+    Ok(tokens)
+  }
+
+  /// Returns the DICOM P10 tokens for the Extended Offset Table followed by all
+  /// the encapsulated pixel data, once every frame has been transcoded.
+  ///
+  fn extended_offset_table_pixel_data_tokens(&mut self) -> Vec<P10Token> {
+    let frames = core::mem::take(&mut self.extended_offset_table_frames);
+
+    // Offsets are to the start of each frame's item, which follows the item
+    // headers of the frames before it
+    let mut offsets = Vec::with_capacity(frames.len() * 8);
+    let mut lengths = Vec::with_capacity(frames.len() * 8);
+    let mut offset = 0u64;
+    for (encoded_frame, length) in frames.iter() {
+      offsets.extend_from_slice(&offset.to_le_bytes());
+      lengths.extend_from_slice(&length.to_le_bytes());
+
+      offset += 8 + encoded_frame.len() as u64;
+    }
+
+    let mut tokens = Vec::with_capacity(frames.len() * 2 + 8);
+
+    for (tag, data) in [
+      (dictionary::EXTENDED_OFFSET_TABLE.tag, offsets),
+      (dictionary::EXTENDED_OFFSET_TABLE_LENGTHS.tag, lengths),
+    ] {
+      tokens.push(P10Token::DataElementHeader {
+        tag,
+        vr: ValueRepresentation::OtherVeryLongString,
+        length: data.len() as u32,
+        path: DataSetPath::new_with_data_element(tag),
+      });
+      tokens.push(P10Token::DataElementValueBytes {
+        tag,
+        vr: ValueRepresentation::OtherVeryLongString,
+        data: data.into(),
+        bytes_remaining: 0,
+      });
+    }
+
+    tokens.extend(Self::pixel_data_sequence_start_tokens());
+
+    for (frame_index, (encoded_frame, _)) in frames.into_iter().enumerate() {
+      tokens.extend(Self::pixel_data_item_tokens(frame_index, encoded_frame));
+    }
+
+    tokens.push(P10Token::SequenceDelimiter {
+      tag: dictionary::PIXEL_DATA.tag,
+    });
+
+    tokens
+  }
+
+  /// Returns the DICOM P10 tokens for the start of the encapsulated pixel data
+  /// sequence, including an empty Basic Offset Table.
+  ///
+  fn pixel_data_sequence_start_tokens() -> [P10Token; 3] {
+    [
+      P10Token::SequenceStart {
+        tag: dictionary::PIXEL_DATA.tag,
+        vr: ValueRepresentation::OtherByteString,
+        path: DataSetPath::new_with_data_element(dictionary::PIXEL_DATA.tag),
+      },
+      P10Token::PixelDataItem {
+        index: 0,
+        length: 0,
+      },
+      P10Token::DataElementValueBytes {
+        tag: dictionary::ITEM.tag,
+        vr: ValueRepresentation::OtherByteString,
+        data: RcByteSlice::empty(),
+        bytes_remaining: 0,
+      },
+    ]
+  }
+
+  /// Returns the DICOM P10 tokens for the pixel data item holding an encoded
+  /// frame, which must have an even length.
+  ///
+  fn pixel_data_item_tokens(
+    frame_index: usize,
+    encoded_frame: RcByteSlice,
+  ) -> [P10Token; 2] {
+    [
+      P10Token::PixelDataItem {
+        index: frame_index,
+        length: encoded_frame.len() as u32,
+      },
+      P10Token::DataElementValueBytes {
+        tag: dictionary::ITEM.tag,
+        vr: ValueRepresentation::OtherByteString,
+        data: encoded_frame,
+        bytes_remaining: 0,
+      },
+    ]
+  }
+
+  /// If the output transfer is lossy, returns an insert transform that sets
+  /// '(0028,2110) Lossy Image Compression'.
+  ///
+  fn lossy_image_compression_insert_transform(
+    output_transfer_syntax: &'static TransferSyntax,
+  ) -> Option<P10InsertTransform> {
+    let lossy_output_transfer_syntaxes = [
+      &transfer_syntax::JPEG_BASELINE_8BIT,
+      &transfer_syntax::JPEG_EXTENDED_12BIT,
+      &transfer_syntax::JPEG_LS_LOSSY_NEAR_LOSSLESS,
+      &transfer_syntax::JPEG_2000,
+      &transfer_syntax::JPEG_2000_MULTI_COMPONENT,
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000,
+      &transfer_syntax::JPEG_XL,
+      &transfer_syntax::JPEG_XL_JPEG_RECOMPRESSION,
+    ];
+
+    if lossy_output_transfer_syntaxes.contains(&output_transfer_syntax) {
+      let mut lossy_image_compression = DataSet::new();
+      lossy_image_compression.insert(
+        dictionary::LOSSY_IMAGE_COMPRESSION.tag,
+        DataElementValue::new_code_string(&["01"]).unwrap(),
+      );
+
+      Some(P10InsertTransform::new(lossy_image_compression))
+    } else {
+      None
+    }
+  }
+}
+
+impl P10TokenTransform for P10PixelDataTranscodeTransform {
+  type Error = P10PixelDataTranscodeTransformError;
+
+  fn push_token<E: From<P10PixelDataTranscodeTransformError>>(
+    &mut self,
+    token: P10Token,
+    sink: &mut impl FnMut(P10Token) -> Result<(), E>,
+  ) -> Result<(), E> {
+    if !self.is_active() {
+      return sink(token);
+    }
+
+    for token in self.transform_token(token)? {
+      sink(token)?;
+    }
+
+    Ok(())
+  }
+}
+
+/// The details needed to verify a transcoded frame, see
+/// [`FrameTranscoder::verify_frame()`].
+///
+struct UnverifiedFrame {
+  frame_index: usize,
+  length_in_bits: u64,
+  is_color: bool,
+
+  /// The checksum of the stored values of the input frame.
+  source_checksum: FrameChecksum,
+}
+
+/// Transcodes individual frames of pixel data once the input and output Image
+/// Pixel Modules are known. This is shared with the worker threads when frames
+/// are transcoded in parallel.
+///
+struct FrameTranscoder {
+  input_transfer_syntax: &'static TransferSyntax,
+  output_transfer_syntax: &'static TransferSyntax,
+  input_image_pixel_module: ImagePixelModule,
+  output_image_pixel_module: ImagePixelModule,
+  decode_config: PixelDataDecodeConfig,
+  encode_config: PixelDataEncodeConfig,
+  image_data_functions: Rc<TranscodeImageDataFunctions>,
+
+  /// Whether to decode each encoded frame and check that it matches the stored
+  /// values of the input frame. This is only set when the output transfer
+  /// syntax is lossless.
+  verify_lossless: bool,
+
+  /// The crop to apply directly to the DCT coefficients of 'JPEG Extended
+  /// 12-bit' frames, see [`P10PixelDataTranscodeTransform::lossless_crop_rect()`].
+  #[cfg(feature = "native")]
+  lossless_crop_rect: Option<CropRect>,
+
+  /// Pools of buffers that frames are decoded into, which are reused across
+  /// frames. Each frame being transcoded checks out its own pool, so there is
+  /// one pool for each frame that's transcoded concurrently.
+  #[cfg(feature = "std")]
+  frame_buffer_pools: std::sync::Mutex<Vec<FrameBufferPool>>,
+
+  /// The frames decoded for all targets of a fan-out transcode, and the index
+  /// of this transcode's target.
+  #[cfg(feature = "std")]
+  shared_frame_decodes: Option<(Rc<SharedFrameDecodes>, usize)>,
+
+  /// The adaptive effort that the time taken to encode each frame is reported
+  /// to, see [`P10PixelDataTranscodeTransform::set_adaptive_effort()`].
+  #[cfg(feature = "std")]
+  adaptive_effort: Option<std::sync::Arc<AdaptiveEffort>>,
+
+  /// The codestreams that frames whose pixels all have the same value were
+  /// encoded to, and the constant frames that small codestreams decoded to.
+  /// These are reused so that constant frames skip the codec.
+  #[cfg(feature = "std")]
+  constant_frames: ConstantFrameCache,
+}
+
+impl FrameTranscoder {
+  /// Transcodes a single [`PixelDataFrame`] into a frame for the target
+  /// transfer syntax and then verifies it if verification is enabled.
+  ///
+  #[cfg(feature = "std")]
+  fn transcode_and_verify_frame(
+    &self,
+    input_frame: &mut PixelDataFrame,
+  ) -> Result<RcByteSlice, P10PixelDataTranscodeTransformError> {
+    let (encoded_frame, unverified_frame) =
+      self.transcode_frame(input_frame)?;
+
+    if let Some(unverified_frame) = unverified_frame {
+      self.verify_frame(&encoded_frame, &unverified_frame)?;
+    }
+
+    Ok(encoded_frame)
+  }
+
+  /// Transcodes a single [`PixelDataFrame`] into a frame for the target
+  /// transfer syntax, and records it in the codec stats if they're enabled.
+  /// When verification is enabled and the frame was encoded, the details
+  /// needed to verify it are also returned, see [`Self::verify_frame()`].
+  ///
+  fn transcode_frame(
+    &self,
+    input_frame: &mut PixelDataFrame,
+  ) -> Result<
+    (RcByteSlice, Option<UnverifiedFrame>),
+    P10PixelDataTranscodeTransformError,
+  > {
+    #[cfg(feature = "std")]
+    let frame_stats = FrameStats::start();
+    #[cfg(feature = "std")]
+    let input_frame_length = input_frame.len() as usize;
+
+    #[cfg(feature = "std")]
+    let _span = crate::trace_events::span("transcode_frame")
+      .arg("frame", input_frame.index().unwrap_or(0))
+      .arg("columns", self.input_image_pixel_module.columns())
+      .arg("rows", self.input_image_pixel_module.rows())
+      .arg("bytes_in", input_frame_length)
+      .arg("input_transfer_syntax", self.input_transfer_syntax.name)
+      .arg("output_transfer_syntax", self.output_transfer_syntax.name);
+
+    #[cfg(feature = "std")]
+    let output_frame = {
+      let mut pool = self
+        .frame_buffer_pools
+        .lock()
+        .unwrap()
+        .pop()
+        .unwrap_or_default();
+
+      let result = pool.scope(|| self.transcode_frame_data(input_frame));
+
+      self.frame_buffer_pools.lock().unwrap().push(pool);
+
+      result?
+    };
+
+    #[cfg(not(feature = "std"))]
+    let output_frame = self.transcode_frame_data(input_frame)?;
+
+    #[cfg(feature = "std")]
+    if let Some(frame_stats) = frame_stats {
+      frame_stats.finish(input_frame_length, output_frame.0.len());
+    }
+
+    Ok(output_frame)
+  }
+
+  fn transcode_frame_data(
+    &self,
+    input_frame: &mut PixelDataFrame,
+  ) -> Result<
+    (RcByteSlice, Option<UnverifiedFrame>),
+    P10PixelDataTranscodeTransformError,
+  > {
+    // Special case for direct recompression/reconstruction of JPEG Baseline
+    // 8-bit to/from JPEG XL. This is a fast path that can be taken when a full
+    // encode/decode cycle isn't needed.
+    #[cfg(all(feature = "native", feature = "std"))]
+    if !(self.image_data_functions.is_encode_decode_cycle_required)(
+      &self.input_image_pixel_module,
     ) {
       use transfer_syntax::{JPEG_BASELINE_8BIT, JPEG_XL_JPEG_RECOMPRESSION};
 
       if self.input_transfer_syntax == &JPEG_BASELINE_8BIT
         && self.output_transfer_syntax == &JPEG_XL_JPEG_RECOMPRESSION
       {
+        self.skip_shared_decode(input_frame);
+
         let jpeg_data = input_frame.combine_chunks();
-        let jpeg_xl_data =
+        let jpeg_xl_data = time_stage(CodecStage::Encode, || {
           crate::jpeg_xl_jpeg_recompression::recompress_jpeg_to_jpeg_xl(
             jpeg_data,
+            self.encode_config.thread_count(),
           )
-          .map_err(P10PixelDataTranscodeTransformError::PixelDataEncodeError)?;
+        })
+        .map_err(P10PixelDataTranscodeTransformError::PixelDataEncodeError)?;
 
-        return Ok(jpeg_xl_data.into());
+        return Ok((jpeg_xl_data.into(), None));
       }
 
       if self.input_transfer_syntax == &JPEG_XL_JPEG_RECOMPRESSION
         && self.output_transfer_syntax == &JPEG_BASELINE_8BIT
       {
+        self.skip_shared_decode(input_frame);
+
         let jpeg_xl_data = input_frame.combine_chunks();
-        let jpeg_data =
+        let jpeg_data = time_stage(CodecStage::Decode, || {
           crate::jpeg_xl_jpeg_recompression::reconstruct_jpeg_from_jpeg_xl(
             jpeg_xl_data,
+            self.decode_config.thread_count,
           )
-          .map_err(P10PixelDataTranscodeTransformError::PixelDataEncodeError)?;
+        })
+        .map_err(P10PixelDataTranscodeTransformError::PixelDataEncodeError)?;
 
-        return Ok(jpeg_data.into());
+        return Ok((jpeg_data.into(), None));
       }
     }
 
-    let image_pixel_module = self
-      .input_image_pixel_module_transform
-      .get_output()
-      .unwrap();
+    // Crop 'JPEG Extended 12-bit' frames directly on their DCT coefficients
+    // when possible. This fails when the crop isn't aligned to the JPEG's
+    // iMCUs, or when the JPEG data isn't 12-bit, in which case the frame is
+    // decoded, cropped, and re-encoded as normal.
+    #[cfg(feature = "native")]
+    if let Some(crop_rect) = &self.lossless_crop_rect {
+      let jpeg_data = input_frame.combine_chunks();
+      let result = time_stage(CodecStage::ImageProcessing, || {
+        crate::jpeg_12bit_transform::transform_jpeg_12bit(
+          jpeg_data,
+          self.input_image_pixel_module.columns(),
+          self.input_image_pixel_module.rows(),
+          crop_rect,
+          crate::jpeg_12bit_transform::Jpeg12BitTransform::None,
+        )
+      });
+
+      if let Ok(jpeg_data) = result {
+        self.skip_shared_decode(input_frame);
 
-    let output_frame = if image_pixel_module.is_color() {
+        return Ok((jpeg_data.into(), None));
+      }
+    }
+
+    let image_pixel_module = &self.input_image_pixel_module;
+
+    let (output_frame, source_checksum) = if image_pixel_module.is_color() {
       // Decode using the input Image Pixel Module
-      let mut image = crate::decode::decode_color(
-        input_frame,
-        self.input_transfer_syntax,
-        image_pixel_module,
-        &self.decode_config,
-      )
-      .map_err(P10PixelDataTranscodeTransformError::PixelDataDecodeError)?;
+      let mut image =
+        time_stage(CodecStage::Decode, || self.decode_color(input_frame))
+          .map_err(P10PixelDataTranscodeTransformError::PixelDataDecodeError)?;
+
+      // Take the checksum of the stored values before they're processed
+      let source_checksum = self.verify_lossless.then(|| {
+        time_stage(CodecStage::Verify, || {
+          FrameChecksum::from_color_image(&image)
+        })
+      });
 
       // Pass through the relevant image data function
-      (self.image_data_functions.process_color_image)(
-        &mut image,
-        self.output_image_pixel_module.as_ref().unwrap(),
-      )?;
+      time_stage(CodecStage::ImageProcessing, || {
+        (self.image_data_functions.process_color_image)(
+          &mut image,
+          &self.output_image_pixel_module,
+        )
+      })?;
+
+      // Reuse the codestream of an identical constant frame if there is one
+      #[cfg(feature = "std")]
+      let constant_frame = ConstantFrame::from_color_image(&image);
+      #[cfg(feature = "std")]
+      if let Some(frame) =
+        constant_frame.and_then(|f| self.constant_frames.encoded_frame(&f))
+      {
+        frame_buffer_pool::recycle_color_image(image);
+        return Ok((frame, None));
+      }
 
       // Encode using the output Image Pixel Module
-      crate::encode::encode_color(
-        &image,
-        self.output_image_pixel_module.as_ref().unwrap(),
-        self.output_transfer_syntax,
-        &self.encode_config,
-      )
-      .map_err(P10PixelDataTranscodeTransformError::PixelDataEncodeError)?
+      #[cfg(feature = "std")]
+      let encode_start = std::time::Instant::now();
+      let frame = time_stage(CodecStage::Encode, || {
+        crate::encode::encode_color(
+          &image,
+          &self.output_image_pixel_module,
+          self.output_transfer_syntax,
+          &self.encode_config,
+        )
+      })
+      .map_err(P10PixelDataTranscodeTransformError::PixelDataEncodeError)?;
+      #[cfg(feature = "std")]
+      self.record_encode_time(encode_start);
+
+      frame_buffer_pool::recycle_color_image(image);
+
+      #[cfg(feature = "std")]
+      if let Some(constant_frame) = constant_frame {
+        self
+          .constant_frames
+          .insert_encoded_frame(constant_frame, frame.to_bytes());
+      }
+
+      (frame, source_checksum)
     } else {
       // Decode using the input Image Pixel Module
-      let mut image = crate::decode::decode_monochrome(
-        input_frame,
-        self.input_transfer_syntax,
-        image_pixel_module,
-        &self.decode_config,
-      )
-      .map_err(P10PixelDataTranscodeTransformError::PixelDataDecodeError)?;
+      let mut image =
+        time_stage(CodecStage::Decode, || self.decode_monochrome(input_frame))
+          .map_err(P10PixelDataTranscodeTransformError::PixelDataDecodeError)?;
+
+      // Take the checksum of the stored values before they're processed
+      let source_checksum = self.verify_lossless.then(|| {
+        time_stage(CodecStage::Verify, || {
+          FrameChecksum::from_monochrome_image(&image)
+        })
+      });
 
       // Pass through the relevant image data function
-      (self.image_data_functions.process_monochrome_image)(
-        &mut image,
-        self.output_image_pixel_module.as_ref().unwrap(),
-      )?;
+      time_stage(CodecStage::ImageProcessing, || {
+        (self.image_data_functions.process_monochrome_image)(
+          &mut image,
+          &self.output_image_pixel_module,
+        )
+      })?;
+
+      // Reuse the codestream of an identical constant frame if there is one
+      #[cfg(feature = "std")]
+      let constant_frame = ConstantFrame::from_monochrome_image(&image);
+      #[cfg(feature = "std")]
+      if let Some(frame) =
+        constant_frame.and_then(|f| self.constant_frames.encoded_frame(&f))
+      {
+        frame_buffer_pool::recycle_monochrome_image(image);
+        return Ok((frame, None));
+      }
 
       // Encode using the output Image Pixel Module
-      let frame = crate::encode::encode_monochrome(
-        &image,
-        self.output_image_pixel_module.as_ref().unwrap(),
-        self.output_transfer_syntax,
-        &self.encode_config,
-      )
+      #[cfg(feature = "std")]
+      let encode_start = std::time::Instant::now();
+      let frame = time_stage(CodecStage::Encode, || {
+        crate::encode::encode_monochrome(
+          &image,
+          &self.output_image_pixel_module,
+          self.output_transfer_syntax,
+          &self.encode_config,
+        )
+      })
       .map_err(P10PixelDataTranscodeTransformError::PixelDataEncodeError)?;
+      #[cfg(feature = "std")]
+      self.record_encode_time(encode_start);
+
+      frame_buffer_pool::recycle_monochrome_image(image);
 
       // Transcoding of multi-frame data where the frames aren't a whole number
       // of bytes isn't supported. This is an extremely rare occurrence as it
@@ -574,193 +2165,212 @@ impl P10PixelDataTranscodeTransform {
         });
       }
 
-      frame
+      // Only byte-aligned frames are reused, as the above check is then never
+      // needed for them
+      #[cfg(feature = "std")]
+      if let Some(constant_frame) = constant_frame
+        && frame.len_bits() % 8 == 0
+      {
+        self
+          .constant_frames
+          .insert_encoded_frame(constant_frame, frame.to_bytes());
+      }
+
+      (frame, source_checksum)
     };
 
-    Ok(output_frame.to_bytes())
+    let unverified_frame =
+      source_checksum.map(|source_checksum| UnverifiedFrame {
+        frame_index: input_frame.index().unwrap_or(0),
+        length_in_bits: output_frame.len_bits(),
+        is_color: image_pixel_module.is_color(),
+        source_checksum,
+      });
+
+    Ok((output_frame.to_bytes(), unverified_frame))
   }
 
-  /// Returns the DICOM P10 tokens for the next transcoded frame of native pixel
-  /// data.
+  /// Reports the time taken to encode a frame to the adaptive effort, if there
+  /// is one.
   ///
-  fn native_pixel_data_tokens(
-    &mut self,
-    frame_index: usize,
-    encoded_frame: RcByteSlice,
-  ) -> Result<Vec<P10Token>, P10PixelDataTranscodeTransformError> {
-    // Get the Image Pixel Module. This is safe to unwrap because it must have
-    // been fully received by the time pixel data is encountered.
-    let image_pixel_module = self.decoded_image_pixel_module.as_ref().unwrap();
+  #[cfg(feature = "std")]
+  fn record_encode_time(&self, encode_start: std::time::Instant) {
+    if let Some(adaptive_effort) = &self.adaptive_effort {
+      adaptive_effort.record_frame(
+        self.output_image_pixel_module.pixel_count(),
+        encode_start.elapsed(),
+      );
+    }
+  }
 
-    let vr = if u8::from(image_pixel_module.bits_allocated()) <= 8 {
-      ValueRepresentation::OtherByteString
-    } else {
-      ValueRepresentation::OtherWordString
-    };
+  /// Decodes a transcoded frame using the output Image Pixel Module and checks
+  /// that the checksum of its samples matches that of the stored values of the
+  /// input frame. The frame is decoded straight from its encoded data without
+  /// copying it.
+  ///
+  fn verify_frame(
+    &self,
+    encoded_frame: &RcByteSlice,
+    unverified_frame: &UnverifiedFrame,
+  ) -> Result<(), P10PixelDataTranscodeTransformError> {
+    let mut frame = PixelDataFrame::new();
+    frame.push_bits(encoded_frame.clone(), unverified_frame.length_in_bits);
+
+    let checksum = time_stage(
+      CodecStage::Verify,
+      || -> Result<FrameChecksum, PixelDataDecodeError> {
+        if unverified_frame.is_color {
+          let image = crate::decode::decode_color(
+            &mut frame,
+            self.output_transfer_syntax,
+            &self.output_image_pixel_module,
+            &self.decode_config,
+          )?;
+
+          let checksum = FrameChecksum::from_color_image(&image);
+          frame_buffer_pool::recycle_color_image(image);
+
+          Ok(checksum)
+        } else {
+          let image = crate::decode::decode_monochrome(
+            &mut frame,
+            self.output_transfer_syntax,
+            &self.output_image_pixel_module,
+            &self.decode_config,
+          )?;
+
+          let checksum = FrameChecksum::from_monochrome_image(&image);
+          frame_buffer_pool::recycle_monochrome_image(image);
+
+          Ok(checksum)
+        }
+      },
+    )
+    .map_err(P10PixelDataTranscodeTransformError::PixelDataDecodeError)?;
 
-    let mut tokens = vec![];
+    if checksum != unverified_frame.source_checksum {
+      return Err(P10PixelDataTranscodeTransformError::VerifyFailed {
+        frame_index: unverified_frame.frame_index,
+      });
+    }
 
-    // On the first frame, calculate the total size of the native pixel data
-    // that will be output and emit the data element header
-    if frame_index == 0 {
-      let pixel_data_value_length = (image_pixel_module.frame_size_in_bits()
-        * self.p10_pixel_data_frame_transform.get_number_of_frames() as u64)
-        .div_ceil(8);
+    Ok(())
+  }
 
-      if pixel_data_value_length > u64::from(u32::MAX - 1) {
-        return Err(P10PixelDataTranscodeTransformError::DataError(
-          DataError::new_value_length_invalid(
-            vr,
-            pixel_data_value_length,
-            "Native pixel data length exceeds 2^32 - 1".to_string(),
-          )
-          .with_path(&DataSetPath::new_with_data_element(
-            dictionary::PIXEL_DATA.tag,
-          )),
-        ));
-      }
+  /// Decodes a color frame using the input Image Pixel Module. When this is a
+  /// target of a fan-out transcode the frame is only decoded if no other
+  /// target has already decoded it.
+  ///
+  fn decode_color(
+    &self,
+    input_frame: &mut PixelDataFrame,
+  ) -> Result<ColorImage, PixelDataDecodeError> {
+    let decode = |input_frame: &mut PixelDataFrame| {
+      let decode = |input_frame: &mut PixelDataFrame| {
+        crate::decode::decode_color(
+          input_frame,
+          self.input_transfer_syntax,
+          &self.input_image_pixel_module,
+          &self.decode_config,
+        )
+      };
 
-      self.native_pixel_data_bytes_remaining = pixel_data_value_length as u32;
+      #[cfg(feature = "std")]
+      return self.constant_frames.decode_color(
+        input_frame,
+        self.input_transfer_syntax,
+        decode,
+      );
 
-      tokens.push(P10Token::DataElementHeader {
-        tag: dictionary::PIXEL_DATA.tag,
-        vr,
-        length: self.native_pixel_data_bytes_remaining,
-        path: DataSetPath::new(),
-      });
-    }
+      #[cfg(not(feature = "std"))]
+      decode(input_frame)
+    };
 
-    // Check that the encoded frame doesn't exceed the number of native pixel
-    // data bytes left to emit. If this happens it likely indicates a bug in
-    // either the decoding or encoding.
-    if encoded_frame.len() > self.native_pixel_data_bytes_remaining as usize {
-      return Err(P10PixelDataTranscodeTransformError::P10Error(
-        P10Error::OtherError {
-          error_type: "Transcoded pixel data too large".to_string(),
-          details: format!(
-            "Frame {} of length {} exceeds the remaining size of the native \
-             pixel data {}",
-            frame_index,
-            encoded_frame.len(),
-            self.native_pixel_data_bytes_remaining
-          ),
-        },
-      ));
+    #[cfg(feature = "std")]
+    if let Some((shared_frame_decodes, target_index)) =
+      &self.shared_frame_decodes
+    {
+      let frame_index = input_frame.index().unwrap();
+      let decoded_frame =
+        shared_frame_decodes.take(frame_index, *target_index, || {
+          decode(input_frame).map(|image| DecodedFrame::Color(Rc::new(image)))
+        })?;
+
+      // The last target to take the frame is given it without a copy
+      return match decoded_frame {
+        DecodedFrame::Color(image) => {
+          Ok(Rc::try_unwrap(image).unwrap_or_else(|image| (*image).clone()))
+        }
+        DecodedFrame::Monochrome(_) => unreachable!(),
+      };
     }
 
-    // Deduct this frame's size from the total native pixel data size
-    self.native_pixel_data_bytes_remaining -= encoded_frame.len() as u32;
-
-    tokens.push(P10Token::DataElementValueBytes {
-      tag: dictionary::PIXEL_DATA.tag,
-      vr,
-      data: encoded_frame.clone(),
-      bytes_remaining: self.native_pixel_data_bytes_remaining,
-    });
-
-    Ok(tokens)
+    decode(input_frame)
   }
 
-  /// Returns the DICOM P10 tokens for the next transcoded frame of encapsulated
-  /// pixel data.
+  /// Decodes a monochrome frame using the input Image Pixel Module. When this
+  /// is a target of a fan-out transcode the frame is only decoded if no other
+  /// target has already decoded it.
   ///
-  fn encapsulated_pixel_data_tokens(
+  fn decode_monochrome(
     &self,
-    frame_index: usize,
-    encoded_frame: RcByteSlice,
-  ) -> Result<Vec<P10Token>, P10PixelDataTranscodeTransformError> {
-    let mut tokens = vec![];
-
-    // On the first frame, emit tokens for the start of the pixel data sequence
-    // as well as an empty basic offset table
-    if frame_index == 0 {
-      tokens.push(P10Token::SequenceStart {
-        tag: dictionary::PIXEL_DATA.tag,
-        vr: ValueRepresentation::OtherByteString,
-        path: DataSetPath::new_with_data_element(dictionary::PIXEL_DATA.tag),
-      });
-      tokens.push(P10Token::PixelDataItem {
-        index: 0,
-        length: 0,
-      });
-      tokens.push(P10Token::DataElementValueBytes {
-        tag: dictionary::ITEM.tag,
-        vr: ValueRepresentation::OtherByteString,
-        data: RcByteSlice::empty(),
-        bytes_remaining: 0,
-      });
-    }
-
-    // Check the length of the encoded frame is a valid u32 length
-    if encoded_frame.len() > (u32::MAX - 1) as usize {
-      return Err(P10PixelDataTranscodeTransformError::DataError(
-        DataError::new_value_length_invalid(
-          ValueRepresentation::OtherByteString,
-          encoded_frame.len() as u64,
-          "Encoded frame length exceeds 2^32 - 1".to_string(),
+    input_frame: &mut PixelDataFrame,
+  ) -> Result<MonochromeImage, PixelDataDecodeError> {
+    let decode = |input_frame: &mut PixelDataFrame| {
+      let decode = |input_frame: &mut PixelDataFrame| {
+        crate::decode::decode_monochrome(
+          input_frame,
+          self.input_transfer_syntax,
+          &self.input_image_pixel_module,
+          &self.decode_config,
         )
-        .with_path(&DataSetPath::new_with_data_element(
-          dictionary::PIXEL_DATA.tag,
-        )),
-      ));
-    }
-
-    let mut encoded_frame = encoded_frame.into_vec();
-    if encoded_frame.len() & 1 == 1 {
-      encoded_frame.push(0);
-    }
+      };
 
-    tokens.push(P10Token::PixelDataItem {
-      index: frame_index,
-      length: encoded_frame.len() as u32,
-    });
+      #[cfg(feature = "std")]
+      return self.constant_frames.decode_monochrome(
+        input_frame,
+        self.input_transfer_syntax,
+        decode,
+      );
 
-    tokens.push(P10Token::DataElementValueBytes {
-      tag: dictionary::ITEM.tag,
-      vr: ValueRepresentation::OtherByteString,
-      data: encoded_frame.into(),
-      bytes_remaining: 0,
-    });
+      #[cfg(not(feature = "std"))]
+      decode(input_frame)
+    };
 
-    // On the last frame, emit a sequence delimiter
-    if frame_index + 1
-      == self.p10_pixel_data_frame_transform.get_number_of_frames()
+    #[cfg(feature = "std")]
+    if let Some((shared_frame_decodes, target_index)) =
+      &self.shared_frame_decodes
     {
-      tokens.push(P10Token::SequenceDelimiter {
-        tag: dictionary::PIXEL_DATA.tag,
-      })
+      let frame_index = input_frame.index().unwrap();
+      let decoded_frame =
+        shared_frame_decodes.take(frame_index, *target_index, || {
+          decode(input_frame)
+            .map(|image| DecodedFrame::Monochrome(Rc::new(image)))
+        })?;
+
+      // The last target to take the frame is given it without a copy
+      return match decoded_frame {
+        DecodedFrame::Monochrome(image) => {
+          Ok(Rc::try_unwrap(image).unwrap_or_else(|image| (*image).clone()))
+        }
+        DecodedFrame::Color(_) => unreachable!(),
+      };
     }
 
-    Ok(tokens)
+    decode(input_frame)
   }
 
-  /// If the output transfer is lossy, returns an insert transform that sets
-  /// '(0028,2110) Lossy Image Compression'.
+  /// Records that a frame was transcoded without being decoded, so that the
+  /// other targets of a fan-out transcode don't wait on this target for it.
   ///
-  fn lossy_image_compression_insert_transform(
-    output_transfer_syntax: &'static TransferSyntax,
-  ) -> Option<P10InsertTransform> {
-    let lossy_output_transfer_syntaxes = [
-      &transfer_syntax::JPEG_BASELINE_8BIT,
-      &transfer_syntax::JPEG_EXTENDED_12BIT,
-      &transfer_syntax::JPEG_LS_LOSSY_NEAR_LOSSLESS,
-      &transfer_syntax::JPEG_2000,
-      &transfer_syntax::JPEG_2000_MULTI_COMPONENT,
-      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000,
-      &transfer_syntax::JPEG_XL,
-      &transfer_syntax::JPEG_XL_JPEG_RECOMPRESSION,
-    ];
-
-    if lossy_output_transfer_syntaxes.contains(&output_transfer_syntax) {
-      let mut lossy_image_compression = DataSet::new();
-      lossy_image_compression.insert(
-        dictionary::LOSSY_IMAGE_COMPRESSION.tag,
-        DataElementValue::new_code_string(&["01"]).unwrap(),
-      );
-
-      Some(P10InsertTransform::new(lossy_image_compression))
-    } else {
-      None
+  #[cfg(feature = "native")]
+  #[cfg_attr(not(feature = "std"), allow(unused_variables))]
+  fn skip_shared_decode(&self, input_frame: &PixelDataFrame) {
+    #[cfg(feature = "std")]
+    if let Some((shared_frame_decodes, target_index)) =
+      &self.shared_frame_decodes
+    {
+      shared_frame_decodes.skip(input_frame.index().unwrap(), *target_index);
     }
   }
 }
@@ -774,6 +2384,7 @@ pub enum P10PixelDataTranscodeTransformError {
   PixelDataDecodeError(PixelDataDecodeError),
   PixelDataEncodeError(PixelDataEncodeError),
   NotSupported { details: String },
+  VerifyFailed { frame_index: usize },
 }
 
 impl core::fmt::Display for P10PixelDataTranscodeTransformError {
@@ -786,6 +2397,11 @@ impl core::fmt::Display for P10PixelDataTranscodeTransformError {
       Self::NotSupported { details } => {
         write!(f, "Transcode not supported, details: {details}")
       }
+      Self::VerifyFailed { frame_index } => write!(
+        f,
+        "Frame {frame_index} did not decode to the stored values it was \
+         transcoded from"
+      ),
     }
   }
 }
@@ -804,10 +2420,68 @@ impl DcmfxError for P10PixelDataTranscodeTransformError {
           format!("  Details: {}", details),
         ]
       }
+      Self::VerifyFailed { frame_index } => {
+        vec![
+          format!("Pixel data transcode error {}", task_description),
+          "".to_string(),
+          format!(
+            "  Details: Frame {} did not decode to the stored values it was \
+             transcoded from",
+            frame_index
+          ),
+        ]
+      }
     }
   }
 }
 
+/// Codec stats are only collected when std is available, so without it the
+/// stages of transcoding a frame are run untimed.
+///
+#[cfg(not(feature = "std"))]
+mod codec_stats {
+  pub enum CodecStage {
+    Decode,
+    ImageProcessing,
+    Encode,
+    Verify,
+  }
+
+  pub fn time_stage<T>(_stage: CodecStage, f: impl FnOnce() -> T) -> T {
+    f()
+  }
+}
+
+/// Returns the number of bytes of data element value held by a token.
+///
+fn token_value_bytes(token: &P10Token) -> u64 {
+  match token {
+    P10Token::DataElementValueBytes { data, .. } => data.len() as u64,
+    _ => 0,
+  }
+}
+
+/// Splits a thread budget into the number of worker threads to transcode
+/// frames on and the number of threads each codec uses, see
+/// [`P10PixelDataTranscodeTransform::set_thread_budget()`].
+///
+#[cfg(feature = "std")]
+fn split_thread_budget(
+  thread_budget: usize,
+  number_of_frames: usize,
+) -> (usize, usize) {
+  let thread_budget = if thread_budget == 0 {
+    std::thread::available_parallelism().map_or(1, |n| n.get())
+  } else {
+    thread_budget
+  };
+
+  let frame_thread_count = thread_budget.min(number_of_frames).max(1);
+  let codec_thread_count = (thread_budget / frame_thread_count).max(1);
+
+  (frame_thread_count, codec_thread_count)
+}
+
 fn map_p10_custom_type_transform_error(
   e: P10CustomTypeTransformError,
 ) -> P10PixelDataTranscodeTransformError {
@@ -838,6 +2512,7 @@ impl Default for TranscodeImageDataFunctions {
   fn default() -> Self {
     Self {
       is_encode_decode_cycle_required: Box::new(|_| false),
+      lossless_crop_rect: Box::new(|_| None),
       process_image_pixel_module: Box::new(|_| Ok(())),
       process_monochrome_image: Box::new(|_, _| Ok(())),
       process_color_image: Box::new(|_, _| Ok(())),
@@ -845,6 +2520,10 @@ impl Default for TranscodeImageDataFunctions {
   }
 }
 
+#[cfg(feature = "std")]
+pub type TranscodedPhotometricInterpretationFn =
+  dyn Fn(&ImagePixelModule) -> Option<PhotometricInterpretation> + Send + Sync;
+#[cfg(not(feature = "std"))]
 pub type TranscodedPhotometricInterpretationFn =
   dyn Fn(&ImagePixelModule) -> Option<PhotometricInterpretation>;
 
@@ -882,13 +2561,15 @@ impl TranscodeImageDataFunctions {
     crop_rect: Option<CropRect>,
     is_output_quality_specified: bool,
   ) -> Self {
-    let is_encode_decode_cycle_required = {
+    // Returns whether any change other than a crop is being made that requires
+    // a decode/encode cycle
+    let is_non_crop_change_required = {
       let photometric_interpretation_monochrome =
         photometric_interpretation_monochrome.clone();
       let photometric_interpretation_color =
         photometric_interpretation_color.clone();
 
-      move |image_pixel_module: &ImagePixelModule| {
+      Rc::new(move |image_pixel_module: &ImagePixelModule| {
         // Check whether the planar configuration is being changed
         if let Some(planar_configuration) = planar_configuration
           && image_pixel_module.planar_configuration() != planar_configuration
@@ -915,11 +2596,6 @@ impl TranscodeImageDataFunctions {
           return true;
         }
 
-        // Check whether there is an active crop
-        if crop_rect.is_some() {
-          return true;
-        }
-
         // Check whether there is an active quality change being applied that
         // would require a decode/encode cycle
         if is_output_quality_specified
@@ -929,6 +2605,22 @@ impl TranscodeImageDataFunctions {
         }
 
         false
+      })
+    };
+
+    let is_encode_decode_cycle_required = {
+      let is_non_crop_change_required = is_non_crop_change_required.clone();
+
+      move |image_pixel_module: &ImagePixelModule| {
+        crop_rect.is_some() || is_non_crop_change_required(image_pixel_module)
+      }
+    };
+
+    let lossless_crop_rect = move |image_pixel_module: &ImagePixelModule| {
+      if is_non_crop_change_required(image_pixel_module) {
+        None
+      } else {
+        crop_rect
       }
     };
 
@@ -1004,6 +2696,7 @@ impl TranscodeImageDataFunctions {
               // unless the incoming data is PALETTE_COLOR
               &transfer_syntax::JPEG_2000_LOSSLESS_ONLY
               | &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY
+              | &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY
                 if !image_pixel_module
                   .photometric_interpretation()
                   .is_palette_color() =>
@@ -1138,9 +2831,24 @@ impl TranscodeImageDataFunctions {
       is_encode_decode_cycle_required: Box::new(
         is_encode_decode_cycle_required,
       ),
+      lossless_crop_rect: Box::new(lossless_crop_rect),
       process_image_pixel_module: Box::new(process_image_pixel_module),
       process_monochrome_image: Box::new(process_monochrome_image),
       process_color_image: Box::new(process_color_image),
     }
   }
 }
+
+#[cfg(all(test, feature = "std"))]
+mod tests {
+  use super::*;
+
+  #[test]
+  fn split_thread_budget_test() {
+    assert_eq!(split_thread_budget(8, 1), (1, 8));
+    assert_eq!(split_thread_budget(8, 3), (3, 2));
+    assert_eq!(split_thread_budget(8, 100), (8, 1));
+    assert_eq!(split_thread_budget(1, 100), (1, 1));
+    assert_eq!(split_thread_budget(4, 0), (1, 4));
+  }
+}
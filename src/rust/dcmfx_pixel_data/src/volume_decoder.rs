@@ -0,0 +1,532 @@
+use std::sync::Mutex;
+
+use dcmfx_core::{
+  DataElementTag, DataError, DataSet, DataSetPath, IodModule, TransferSyntax,
+  ValueRepresentation, dictionary, transfer_syntax,
+};
+
+use crate::{
+  FrameBufferPool, MonochromeImage, MonochromeImageData, PixelDataDecodeConfig,
+  PixelDataDecodeError, PixelDataFrame, decode, frame_buffer_pool,
+  iods::{ImagePixelModule, ModalityLutModule},
+};
+
+/// Decodes the frames of a volume, e.g. the slices of a CT or MR series or of
+/// an enhanced multi-frame image, into a single contiguous buffer that holds
+/// the slices one after the other. The Modality LUT is applied as each slice is
+/// written into the buffer, so the volume holds modality values such as
+/// Hounsfield Units rather than stored values.
+///
+/// Slices are decoded concurrently on up to
+/// [`PixelDataDecodeConfig::thread_count`] threads when the `parallel` feature
+/// is enabled, with each thread reusing its decode buffers across the slices it
+/// decodes, see [`FrameBufferPool`].
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct VolumeDecoder {
+  pub transfer_syntax: &'static TransferSyntax,
+  pub image_pixel_module: ImagePixelModule,
+  pub modality_lut_module: ModalityLutModule,
+  pub decode_config: PixelDataDecodeConfig,
+}
+
+impl IodModule for VolumeDecoder {
+  fn is_iod_module_data_element(
+    tag: DataElementTag,
+    vr: ValueRepresentation,
+    length: Option<u32>,
+    path: &DataSetPath,
+  ) -> bool {
+    ImagePixelModule::is_iod_module_data_element(tag, vr, length, path)
+      || ModalityLutModule::is_iod_module_data_element(tag, vr, length, path)
+  }
+
+  fn iod_module_highest_tag() -> DataElementTag {
+    ImagePixelModule::iod_module_highest_tag()
+      .max(ModalityLutModule::iod_module_highest_tag())
+  }
+
+  fn from_data_set(data_set: &DataSet) -> Result<Self, DataError> {
+    let transfer_syntax = if data_set.has(dictionary::TRANSFER_SYNTAX_UID.tag) {
+      data_set.get_transfer_syntax()?
+    } else {
+      &transfer_syntax::IMPLICIT_VR_LITTLE_ENDIAN
+    };
+
+    Ok(VolumeDecoder {
+      transfer_syntax,
+      image_pixel_module: ImagePixelModule::from_data_set(data_set)?,
+      modality_lut_module: ModalityLutModule::from_data_set(data_set)?,
+      decode_config: PixelDataDecodeConfig::default(),
+    })
+  }
+}
+
+impl VolumeDecoder {
+  /// Decodes frames of monochrome pixel data into a volume, applying this
+  /// decoder's Modality LUT to every slice. The frames must all match the
+  /// Image Pixel Module and be in the same transfer syntax, which is the case
+  /// for the frames of an enhanced multi-frame image.
+  ///
+  /// Decoding stops at the first slice that fails to decode, and its error is
+  /// returned.
+  ///
+  pub fn decode<T: VolumeSample>(
+    &self,
+    frames: &mut [PixelDataFrame],
+  ) -> Result<Volume<T>, PixelDataDecodeError> {
+    self.decode_slices(frames, |_| &self.modality_lut_module)
+  }
+
+  /// Decodes frames of monochrome pixel data into a volume in the same way as
+  /// [`Self::decode()`], but applies a separate Modality LUT to each slice.
+  /// This is for a series of single-frame images whose rescale slope and
+  /// intercept differ from one image to the next.
+  ///
+  pub fn decode_with_modality_luts<T: VolumeSample>(
+    &self,
+    frames: &mut [PixelDataFrame],
+    modality_lut_modules: &[ModalityLutModule],
+  ) -> Result<Volume<T>, PixelDataDecodeError> {
+    if modality_lut_modules.len() != frames.len() {
+      return Err(PixelDataDecodeError::DataInvalid {
+        details: format!(
+          "Volume has {} frames but {} Modality LUTs",
+          frames.len(),
+          modality_lut_modules.len()
+        ),
+      });
+    }
+
+    self.decode_slices(frames, |index| &modality_lut_modules[index])
+  }
+
+  fn decode_slices<'a, T: VolumeSample>(
+    &self,
+    frames: &mut [PixelDataFrame],
+    modality_lut_module: impl Fn(usize) -> &'a ModalityLutModule + Sync,
+  ) -> Result<Volume<T>, PixelDataDecodeError> {
+    if !self.image_pixel_module.is_monochrome() {
+      return Err(PixelDataDecodeError::ImagePixelModuleNotSupported {
+        details: format!(
+          "Volume decode not supported for photometric interpretation '{}'",
+          self.image_pixel_module.photometric_interpretation()
+        ),
+      });
+    }
+
+    let width = self.image_pixel_module.columns();
+    let height = self.image_pixel_module.rows();
+    let slice_size = usize::from(width) * usize::from(height);
+
+    let mut data = vec![T::default(); slice_size * frames.len()];
+
+    // Share the threads out between the slices being decoded at once and the
+    // decoder used for each slice
+    let (worker_count, decode_config) = self.worker_decode_config(frames.len());
+
+    let slices = Mutex::new(
+      frames
+        .iter_mut()
+        .zip(data.chunks_mut(slice_size.max(1)))
+        .enumerate(),
+    );
+    let first_error = Mutex::new(None);
+
+    let decode_worker = || {
+      FrameBufferPool::default().scope(|| {
+        while first_error.lock().unwrap().is_none() {
+          let Some((index, (frame, output))) = slices.lock().unwrap().next()
+          else {
+            break;
+          };
+
+          if let Err(e) = self.decode_slice(
+            frame,
+            modality_lut_module(index),
+            &decode_config,
+            output,
+          ) {
+            first_error.lock().unwrap().get_or_insert(e);
+          }
+        }
+      })
+    };
+
+    if worker_count > 1 {
+      std::thread::scope(|scope| {
+        for _ in 1..worker_count {
+          scope.spawn(decode_worker);
+        }
+
+        decode_worker();
+      });
+    } else {
+      decode_worker();
+    }
+
+    if let Some(e) = first_error.into_inner().unwrap() {
+      return Err(e);
+    }
+
+    Ok(Volume {
+      width,
+      height,
+      depth: frames.len(),
+      data,
+    })
+  }
+
+  /// Returns the number of slices to decode at once, and the decode config to
+  /// decode each slice with.
+  ///
+  fn worker_decode_config(
+    &self,
+    slice_count: usize,
+  ) -> (usize, PixelDataDecodeConfig) {
+    #[cfg(feature = "parallel")]
+    {
+      let thread_count = if self.decode_config.thread_count == 0 {
+        std::thread::available_parallelism().map_or(1, |n| n.get())
+      } else {
+        self.decode_config.thread_count
+      };
+
+      let worker_count = thread_count.min(slice_count).max(1);
+      if worker_count > 1 {
+        let decode_config = PixelDataDecodeConfig {
+          thread_count: (thread_count / worker_count).max(1),
+          ..self.decode_config
+        };
+
+        return (worker_count, decode_config);
+      }
+    }
+
+    #[cfg(not(feature = "parallel"))]
+    let _ = slice_count;
+
+    (1, self.decode_config)
+  }
+
+  /// Decodes a single slice and writes its modality values into the slice's
+  /// part of the volume.
+  ///
+  fn decode_slice<T: VolumeSample>(
+    &self,
+    frame: &mut PixelDataFrame,
+    modality_lut_module: &ModalityLutModule,
+    decode_config: &PixelDataDecodeConfig,
+    output: &mut [T],
+  ) -> Result<(), PixelDataDecodeError> {
+    let image = decode::decode_monochrome(
+      frame,
+      self.transfer_syntax,
+      &self.image_pixel_module,
+      decode_config,
+    )?;
+
+    if image.pixel_count() != output.len() {
+      return Err(PixelDataDecodeError::DataInvalid {
+        details: format!(
+          "Decoded slice has dimensions {}x{} but the volume has dimensions \
+           {}x{}",
+          image.width(),
+          image.height(),
+          self.image_pixel_module.columns(),
+          self.image_pixel_module.rows()
+        ),
+      });
+    }
+
+    write_modality_values(&image, modality_lut_module, output);
+
+    frame_buffer_pool::recycle_monochrome_image(image);
+
+    Ok(())
+  }
+}
+
+/// A volume of modality values decoded by a [`VolumeDecoder`]. The slices are
+/// stored one after the other, and each slice is stored row by row.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct Volume<T> {
+  width: u16,
+  height: u16,
+  depth: usize,
+  data: Vec<T>,
+}
+
+impl<T> Volume<T> {
+  /// Returns the width of each slice in the volume.
+  ///
+  pub fn width(&self) -> u16 {
+    self.width
+  }
+
+  /// Returns the height of each slice in the volume.
+  ///
+  pub fn height(&self) -> u16 {
+    self.height
+  }
+
+  /// Returns the number of slices in the volume.
+  ///
+  pub fn depth(&self) -> usize {
+    self.depth
+  }
+
+  /// Returns the modality values of the whole volume.
+  ///
+  pub fn data(&self) -> &[T] {
+    &self.data
+  }
+
+  /// Returns the modality values of a single slice of the volume.
+  ///
+  pub fn slice(&self, index: usize) -> Option<&[T]> {
+    let slice_size = usize::from(self.width) * usize::from(self.height);
+
+    self
+      .data
+      .get(index * slice_size..(index + 1) * slice_size)
+      .filter(|_| index < self.depth)
+  }
+
+  /// Consumes the volume and returns its modality values.
+  ///
+  pub fn into_data(self) -> Vec<T> {
+    self.data
+  }
+}
+
+/// A type of value that a [`VolumeDecoder`] can store modality values as.
+/// Integer types round modality values to the nearest integer, and saturate
+/// values that are outside their range.
+///
+pub trait VolumeSample: Copy + Default + Send {
+  /// Converts the output of a Modality LUT to this type.
+  ///
+  fn from_modality_value(value: f32) -> Self;
+
+  /// Converts a stored value that has no Modality LUT applied to this type.
+  ///
+  fn from_stored_value(value: i64) -> Self;
+}
+
+impl VolumeSample for f32 {
+  fn from_modality_value(value: f32) -> Self {
+    value
+  }
+
+  fn from_stored_value(value: i64) -> Self {
+    value as f32
+  }
+}
+
+impl VolumeSample for i16 {
+  fn from_modality_value(value: f32) -> Self {
+    value.round() as i16
+  }
+
+  fn from_stored_value(value: i64) -> Self {
+    value.clamp(i16::MIN.into(), i16::MAX.into()) as i16
+  }
+}
+
+impl VolumeSample for i32 {
+  fn from_modality_value(value: f32) -> Self {
+    value.round() as i32
+  }
+
+  fn from_stored_value(value: i64) -> Self {
+    value.clamp(i32::MIN.into(), i32::MAX.into()) as i32
+  }
+}
+
+/// Applies a Modality LUT to the stored values of a decoded slice and writes
+/// the results into the slice's part of the volume.
+///
+fn write_modality_values<T: VolumeSample>(
+  image: &MonochromeImage,
+  modality_lut_module: &ModalityLutModule,
+  output: &mut [T],
+) {
+  match image.data() {
+    MonochromeImageData::Bitmap { .. } => {
+      for (output, stored_value) in output.iter_mut().zip(image.stored_values())
+      {
+        *output = modality_value(modality_lut_module, stored_value);
+      }
+    }
+
+    MonochromeImageData::I8(data) => {
+      write_samples(data, modality_lut_module, output)
+    }
+    MonochromeImageData::U8(data) => {
+      write_samples(data, modality_lut_module, output)
+    }
+    MonochromeImageData::I16(data) => {
+      write_samples(data, modality_lut_module, output)
+    }
+    MonochromeImageData::U16(data) => {
+      write_samples(data, modality_lut_module, output)
+    }
+    MonochromeImageData::I32(data) => {
+      write_samples(data, modality_lut_module, output)
+    }
+    MonochromeImageData::U32(data) => {
+      write_samples(data, modality_lut_module, output)
+    }
+  }
+}
+
+/// Applies a Modality LUT to a slice's samples. The Modality LUT is matched
+/// once for the whole slice so that the loop for rescaled values is a simple
+/// multiply and add.
+///
+fn write_samples<S: Copy + Into<i64>, T: VolumeSample>(
+  samples: &[S],
+  modality_lut_module: &ModalityLutModule,
+  output: &mut [T],
+) {
+  match modality_lut_module {
+    ModalityLutModule::Rescale {
+      rescale_intercept,
+      rescale_slope,
+      ..
+    } => {
+      for (output, sample) in output.iter_mut().zip(samples) {
+        let stored_value = (*sample).into() as f32;
+        *output = T::from_modality_value(
+          rescale_intercept + rescale_slope * stored_value,
+        );
+      }
+    }
+
+    ModalityLutModule::Identity => {
+      for (output, sample) in output.iter_mut().zip(samples) {
+        *output = T::from_stored_value((*sample).into());
+      }
+    }
+
+    ModalityLutModule::LookupTable { .. } => {
+      for (output, sample) in output.iter_mut().zip(samples) {
+        *output = modality_value(modality_lut_module, (*sample).into());
+      }
+    }
+  }
+}
+
+/// Returns the modality value for a single stored value.
+///
+fn modality_value<T: VolumeSample>(
+  modality_lut_module: &ModalityLutModule,
+  stored_value: i64,
+) -> T {
+  if modality_lut_module.is_identity() {
+    T::from_stored_value(stored_value)
+  } else {
+    T::from_modality_value(
+      modality_lut_module.apply_to_stored_value(stored_value),
+    )
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  use crate::iods::{
+    image_pixel_module::{
+      BitsAllocated, PhotometricInterpretation, PixelRepresentation,
+      SamplesPerPixel,
+    },
+    modality_lut_module::ModalityLutOutputType,
+  };
+
+  fn volume_decoder(modality_lut_module: ModalityLutModule) -> VolumeDecoder {
+    VolumeDecoder {
+      transfer_syntax: &transfer_syntax::EXPLICIT_VR_LITTLE_ENDIAN,
+      image_pixel_module: ImagePixelModule::new_basic(
+        SamplesPerPixel::One,
+        PhotometricInterpretation::Monochrome2 {
+          pixel_representation: PixelRepresentation::Signed,
+        },
+        2,
+        2,
+        BitsAllocated::Sixteen,
+        16,
+      )
+      .unwrap(),
+      modality_lut_module,
+      decode_config: PixelDataDecodeConfig {
+        thread_count: 2,
+        ..PixelDataDecodeConfig::default()
+      },
+    }
+  }
+
+  fn frame(samples: [i16; 4]) -> PixelDataFrame {
+    PixelDataFrame::new_from_bytes(
+      samples.iter().flat_map(|s| s.to_le_bytes()).collect(),
+    )
+  }
+
+  #[test]
+  fn decode_applies_rescale() {
+    let decoder = volume_decoder(ModalityLutModule::Rescale {
+      rescale_intercept: -1024.0,
+      rescale_slope: 1.0,
+      rescale_type: ModalityLutOutputType::HounsfieldUnits,
+    });
+
+    let mut frames = [frame([0, 1, 2, 3]), frame([1024, 1025, 2048, -100])];
+    let volume = decoder.decode::<i16>(&mut frames).unwrap();
+
+    assert_eq!((volume.width(), volume.height(), volume.depth()), (2, 2, 2));
+    assert_eq!(volume.slice(0), Some(&[-1024, -1023, -1022, -1021][..]));
+    assert_eq!(volume.slice(1), Some(&[0, 1, 1024, -1124][..]));
+    assert_eq!(volume.slice(2), None);
+  }
+
+  #[test]
+  fn decode_with_modality_luts_applies_each_slice_rescale() {
+    let decoder = volume_decoder(ModalityLutModule::Identity);
+
+    let mut frames = [frame([0, 1, 2, 3]), frame([0, 1, 2, 3])];
+    let modality_lut_modules = [
+      ModalityLutModule::Identity,
+      ModalityLutModule::Rescale {
+        rescale_intercept: 0.5,
+        rescale_slope: 2.0,
+        rescale_type: ModalityLutOutputType::Unspecified,
+      },
+    ];
+
+    let volume = decoder
+      .decode_with_modality_luts::<f32>(&mut frames, &modality_lut_modules)
+      .unwrap();
+
+    assert_eq!(
+      volume.into_data(),
+      vec![0.0, 1.0, 2.0, 3.0, 0.5, 2.5, 4.5, 6.5]
+    );
+
+    assert!(
+      decoder
+        .decode_with_modality_luts::<f32>(&mut frames, &[])
+        .is_err()
+    );
+  }
+
+  #[test]
+  fn decode_returns_slice_error() {
+    let decoder = volume_decoder(ModalityLutModule::Identity);
+
+    let mut frames = [frame([0, 1, 2, 3]), PixelDataFrame::new()];
+
+    assert!(decoder.decode::<i16>(&mut frames).is_err());
+  }
+}
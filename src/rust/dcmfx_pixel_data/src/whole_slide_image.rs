@@ -0,0 +1,661 @@
+//! Access to the tiles of VL Whole Slide Microscopy images, which store each
+//! level of a slide's resolution pyramid as a separate multi-frame instance
+//! where every frame is one tile of the level's Total Pixel Matrix.
+
+use std::collections::HashMap;
+use std::sync::Mutex;
+
+use dcmfx_core::{DataError, DataSet, DataSetPath, IodModule, dictionary};
+
+use crate::{
+  FrameBufferPool, PixelDataDecodeConfig, PixelDataDecodeError, PixelDataFrame,
+  PixelDataFrameIndex, PixelDataRenderer, StandardColorPalette,
+  transforms::CropRect,
+};
+
+/// The layout of the tiles of one level of a whole slide image, which maps the
+/// position of a tile in the level's Total Pixel Matrix to the frame that
+/// holds it.
+///
+/// When the *'(0020,9311) Dimension Organization Type'* is `TILED_FULL`, or
+/// there are no per-frame positions, tiles are stored in row-major order and
+/// the frame for a tile is computed from its position. Otherwise the position
+/// of each frame is read from the *'(0048,021A) Plane Position (Slide)
+/// Sequence'* in its *'(5200,9230) Per-Frame Functional Groups Sequence'*
+/// item, and tiles that have no frame are missing.
+///
+/// Where there are multiple focal planes or optical paths, tiles map to the
+/// frames of the first focal plane and optical path.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub struct TileLayout {
+  total_pixel_matrix_columns: u32,
+  total_pixel_matrix_rows: u32,
+  tile_width: u16,
+  tile_height: u16,
+  sparse_tile_frames: Option<HashMap<(u32, u32), usize>>,
+}
+
+impl TileLayout {
+  /// Reads the tile layout from a whole slide image's data set. Data sets
+  /// that don't specify a Total Pixel Matrix are treated as a single tile.
+  ///
+  pub fn from_data_set(data_set: &DataSet) -> Result<Self, DataError> {
+    let tile_width = data_set.get_int::<u16>(dictionary::COLUMNS.tag)?;
+    let tile_height = data_set.get_int::<u16>(dictionary::ROWS.tag)?;
+
+    if tile_width == 0 || tile_height == 0 {
+      return Err(DataError::new_value_invalid(
+        "Tiles have zero width or height".to_string(),
+      ));
+    }
+
+    let total_pixel_matrix_columns = data_set.get_int_with_default::<u32>(
+      dictionary::TOTAL_PIXEL_MATRIX_COLUMNS.tag,
+      tile_width.into(),
+    )?;
+    let total_pixel_matrix_rows = data_set.get_int_with_default::<u32>(
+      dictionary::TOTAL_PIXEL_MATRIX_ROWS.tag,
+      tile_height.into(),
+    )?;
+
+    let is_tiled_full =
+      if data_set.has(dictionary::DIMENSION_ORGANIZATION_TYPE.tag) {
+        data_set.get_string(dictionary::DIMENSION_ORGANIZATION_TYPE.tag)?
+          == "TILED_FULL"
+      } else {
+        false
+      };
+
+    let sparse_tile_frames = if is_tiled_full
+      || !data_set.has(dictionary::PER_FRAME_FUNCTIONAL_GROUPS_SEQUENCE.tag)
+    {
+      None
+    } else {
+      Some(Self::read_sparse_tile_frames(
+        data_set,
+        tile_width,
+        tile_height,
+      )?)
+    };
+
+    Ok(Self {
+      total_pixel_matrix_columns,
+      total_pixel_matrix_rows,
+      tile_width,
+      tile_height,
+      sparse_tile_frames,
+    })
+  }
+
+  /// Reads the position of each frame from the Per-Frame Functional Groups
+  /// Sequence and returns the frame for each tile position.
+  ///
+  fn read_sparse_tile_frames(
+    data_set: &DataSet,
+    tile_width: u16,
+    tile_height: u16,
+  ) -> Result<HashMap<(u32, u32), usize>, DataError> {
+    let per_frame_functional_groups = data_set.get_sequence_items(
+      dictionary::PER_FRAME_FUNCTIONAL_GROUPS_SEQUENCE.tag,
+    )?;
+
+    let mut tile_frames = HashMap::new();
+
+    for (frame_index, functional_groups) in
+      per_frame_functional_groups.iter().enumerate()
+    {
+      let plane_position = functional_groups
+        .get_sequence_items(dictionary::PLANE_POSITION_SLIDE_SEQUENCE.tag)?
+        .first()
+        .ok_or_else(|| {
+          DataError::new_value_not_present().with_path(
+            &DataSetPath::new_with_data_element(
+              dictionary::PLANE_POSITION_SLIDE_SEQUENCE.tag,
+            ),
+          )
+        })?;
+
+      // Positions are one-based and give the top left pixel of the tile
+      let column = plane_position.get_int::<u32>(
+        dictionary::COLUMN_POSITION_IN_TOTAL_IMAGE_PIXEL_MATRIX.tag,
+      )?;
+      let row = plane_position.get_int::<u32>(
+        dictionary::ROW_POSITION_IN_TOTAL_IMAGE_PIXEL_MATRIX.tag,
+      )?;
+
+      if column == 0 || row == 0 {
+        return Err(DataError::new_value_invalid(format!(
+          "Frame {frame_index} has invalid tile position ({column}, {row})"
+        )));
+      }
+
+      let tile = (
+        (column - 1) / u32::from(tile_width),
+        (row - 1) / u32::from(tile_height),
+      );
+
+      // Frames for other focal planes and optical paths at the same position
+      // come after the first one
+      tile_frames.entry(tile).or_insert(frame_index);
+    }
+
+    Ok(tile_frames)
+  }
+
+  /// Returns the width of the level's Total Pixel Matrix.
+  ///
+  pub fn total_pixel_matrix_columns(&self) -> u32 {
+    self.total_pixel_matrix_columns
+  }
+
+  /// Returns the height of the level's Total Pixel Matrix.
+  ///
+  pub fn total_pixel_matrix_rows(&self) -> u32 {
+    self.total_pixel_matrix_rows
+  }
+
+  /// Returns the width of each tile.
+  ///
+  pub fn tile_width(&self) -> u16 {
+    self.tile_width
+  }
+
+  /// Returns the height of each tile.
+  ///
+  pub fn tile_height(&self) -> u16 {
+    self.tile_height
+  }
+
+  /// Returns the number of columns of tiles.
+  ///
+  pub fn tiles_across(&self) -> u32 {
+    self
+      .total_pixel_matrix_columns
+      .div_ceil(self.tile_width.into())
+  }
+
+  /// Returns the number of rows of tiles.
+  ///
+  pub fn tiles_down(&self) -> u32 {
+    self
+      .total_pixel_matrix_rows
+      .div_ceil(self.tile_height.into())
+  }
+
+  /// Returns the index of the frame that holds the tile at the given column
+  /// and row of tiles, or `None` if there is no such tile.
+  ///
+  pub fn frame_index(&self, tile_x: u32, tile_y: u32) -> Option<usize> {
+    if tile_x >= self.tiles_across() || tile_y >= self.tiles_down() {
+      return None;
+    }
+
+    match &self.sparse_tile_frames {
+      Some(tile_frames) => tile_frames.get(&(tile_x, tile_y)).copied(),
+      None => {
+        Some(tile_y as usize * self.tiles_across() as usize + tile_x as usize)
+      }
+    }
+  }
+
+  /// Returns the column and row of each tile that overlaps the given region of
+  /// the Total Pixel Matrix, in row-major order.
+  ///
+  pub fn tiles_in_region(
+    &self,
+    x: u32,
+    y: u32,
+    width: u32,
+    height: u32,
+  ) -> impl Iterator<Item = (u32, u32)> + use<> {
+    let tile_width = u32::from(self.tile_width);
+    let tile_height = u32::from(self.tile_height);
+
+    let right = x.saturating_add(width).min(self.total_pixel_matrix_columns);
+    let bottom = y.saturating_add(height).min(self.total_pixel_matrix_rows);
+
+    let tile_xs = (x / tile_width)..right.div_ceil(tile_width);
+    let tile_ys = (y / tile_height)..bottom.div_ceil(tile_height);
+
+    tile_ys.flat_map(move |tile_y| {
+      tile_xs.clone().map(move |tile_x| (tile_x, tile_y))
+    })
+  }
+}
+
+/// One level of a whole slide image's resolution pyramid, which gives access
+/// to its tiles without reading or decoding the rest of the level.
+///
+/// Tiles are rendered with [`Self::renderer`]. Its
+/// [`PixelDataRenderer::decode_area`] and
+/// [`PixelDataRenderer::resolution_reduction`] are ignored.
+///
+#[derive(Clone, Debug)]
+pub struct WholeSlideImageLevel {
+  pub tile_layout: TileLayout,
+  pub renderer: PixelDataRenderer,
+  pub frame_index: PixelDataFrameIndex,
+}
+
+impl WholeSlideImageLevel {
+  /// Creates a whole slide image level from the data set of one of a slide's
+  /// instances. Only the frames of the tiles that are accessed are read, see
+  /// [`PixelDataFrameIndex`].
+  ///
+  pub fn from_data_set(data_set: &DataSet) -> Result<Self, DataError> {
+    Ok(Self {
+      tile_layout: TileLayout::from_data_set(data_set)?,
+      renderer: PixelDataRenderer::from_data_set(data_set)?,
+      frame_index: PixelDataFrameIndex::from_data_set(data_set)?,
+    })
+  }
+
+  /// Returns the frame that holds the tile at the given column and row of
+  /// tiles, or `None` if there is no such tile.
+  ///
+  pub fn tile_frame(&self, tile_x: u32, tile_y: u32) -> Option<PixelDataFrame> {
+    self
+      .tile_layout
+      .frame_index(tile_x, tile_y)
+      .and_then(|index| self.frame_index.get_frame(index))
+  }
+
+  /// Renders a region of this level's Total Pixel Matrix to an RGB 8-bit
+  /// image, e.g. for the viewport of a slide viewer. Only the tiles that
+  /// overlap the region are decoded, and for tiles on the region's edge
+  /// decoders that support it only decode the visible part, see
+  /// [`PixelDataRenderer::decode_area`].
+  ///
+  /// Tiles are decoded concurrently on up to
+  /// [`PixelDataDecodeConfig::thread_count`] threads when the `parallel`
+  /// feature is enabled. Parts of the region that are outside the Total Pixel
+  /// Matrix or have no tile are white.
+  ///
+  pub fn render_region(
+    &self,
+    x: u32,
+    y: u32,
+    width: u32,
+    height: u32,
+    color_palette: Option<&StandardColorPalette>,
+  ) -> Result<image::RgbImage, PixelDataDecodeError> {
+    let tiles: Vec<_> = self
+      .tile_layout
+      .tiles_in_region(x, y, width, height)
+      .collect();
+
+    // Share the threads out between the tiles being decoded at once and the
+    // decoder used for each tile
+    let (worker_count, decode_config) =
+      worker_decode_config(&self.renderer.decode_config, tiles.len());
+
+    let output = Mutex::new(image::RgbImage::from_pixel(
+      width,
+      height,
+      image::Rgb([255, 255, 255]),
+    ));
+    let tiles = Mutex::new(tiles.into_iter());
+    let first_error = Mutex::new(None);
+
+    let render_worker = || {
+      FrameBufferPool::default().scope(|| {
+        while first_error.lock().unwrap().is_none() {
+          let Some((tile_x, tile_y)) = tiles.lock().unwrap().next() else {
+            break;
+          };
+
+          match self.render_tile_region(
+            tile_x,
+            tile_y,
+            (x, y, width, height),
+            &decode_config,
+            color_palette,
+          ) {
+            Ok(Some((image, left, top))) => {
+              copy_image(&image, &mut output.lock().unwrap(), left, top)
+            }
+
+            Ok(None) => (),
+
+            Err(e) => {
+              first_error.lock().unwrap().get_or_insert(e);
+            }
+          }
+        }
+      })
+    };
+
+    if worker_count > 1 {
+      std::thread::scope(|scope| {
+        for _ in 1..worker_count {
+          scope.spawn(render_worker);
+        }
+
+        render_worker();
+      });
+    } else {
+      render_worker();
+    }
+
+    if let Some(e) = first_error.into_inner().unwrap() {
+      return Err(e);
+    }
+
+    Ok(output.into_inner().unwrap())
+  }
+
+  /// Renders the part of a tile that's inside a region, and returns it along
+  /// with its position in the region. Returns `None` if the tile is missing.
+  ///
+  fn render_tile_region(
+    &self,
+    tile_x: u32,
+    tile_y: u32,
+    (x, y, width, height): (u32, u32, u32, u32),
+    decode_config: &PixelDataDecodeConfig,
+    color_palette: Option<&StandardColorPalette>,
+  ) -> Result<Option<(image::RgbImage, u32, u32)>, PixelDataDecodeError> {
+    let Some(mut frame) = self.tile_frame(tile_x, tile_y) else {
+      return Ok(None);
+    };
+
+    let tile_width = u32::from(self.tile_layout.tile_width);
+    let tile_height = u32::from(self.tile_layout.tile_height);
+    let tile_left = tile_x * tile_width;
+    let tile_top = tile_y * tile_height;
+
+    // The part of the tile that's inside both the region and the Total Pixel
+    // Matrix, relative to the tile. Tiles on the right and bottom edges of the
+    // Total Pixel Matrix can extend past it.
+    let left = x.max(tile_left) - tile_left;
+    let top = y.max(tile_top) - tile_top;
+    let right = x
+      .saturating_add(width)
+      .min(tile_left + tile_width)
+      .min(self.tile_layout.total_pixel_matrix_columns)
+      - tile_left;
+    let bottom = y
+      .saturating_add(height)
+      .min(tile_top + tile_height)
+      .min(self.tile_layout.total_pixel_matrix_rows)
+      - tile_top;
+
+    let renderer = PixelDataRenderer {
+      decode_config: *decode_config,
+      resolution_reduction: 0,
+      decode_area: Some(CropRect {
+        left: left as u16,
+        top: top as u16,
+        width_or_right: Some((right - left) as i32),
+        height_or_bottom: Some((bottom - top) as i32),
+      }),
+      ..self.renderer.clone()
+    };
+
+    let image = renderer.render_frame(&mut frame, color_palette)?;
+
+    Ok(Some((image, tile_left + left - x, tile_top + top - y)))
+  }
+}
+
+/// The levels of a whole slide image's resolution pyramid, ordered from the
+/// highest resolution to the lowest.
+///
+#[derive(Clone, Debug)]
+pub struct WholeSlideImage {
+  levels: Vec<WholeSlideImageLevel>,
+}
+
+impl WholeSlideImage {
+  /// Creates a whole slide image from its levels, which can be in any order.
+  ///
+  pub fn new(mut levels: Vec<WholeSlideImageLevel>) -> Self {
+    levels.sort_by_key(|level| {
+      core::cmp::Reverse(level.tile_layout.total_pixel_matrix_columns)
+    });
+
+    Self { levels }
+  }
+
+  /// Returns the levels, ordered from the highest resolution to the lowest.
+  ///
+  pub fn levels(&self) -> &[WholeSlideImageLevel] {
+    &self.levels
+  }
+
+  /// Returns the index of the lowest resolution level that still has at least
+  /// the resolution of the highest resolution level scaled down by the given
+  /// factor. This is the level to render a viewport from when it's zoomed out
+  /// by that factor.
+  ///
+  pub fn level_for_downsample(&self, downsample: f64) -> usize {
+    let Some(base_level) = self.levels.first() else {
+      return 0;
+    };
+
+    let base_columns =
+      f64::from(base_level.tile_layout.total_pixel_matrix_columns);
+
+    self
+      .levels
+      .iter()
+      .rposition(|level| {
+        let columns = f64::from(level.tile_layout.total_pixel_matrix_columns);
+        columns * downsample >= base_columns
+      })
+      .unwrap_or(0)
+  }
+
+  /// Returns the frame that holds the tile at the given column and row of
+  /// tiles in the given level, or `None` if there is no such tile.
+  ///
+  pub fn tile_frame(
+    &self,
+    level: usize,
+    tile_x: u32,
+    tile_y: u32,
+  ) -> Option<PixelDataFrame> {
+    self.levels.get(level)?.tile_frame(tile_x, tile_y)
+  }
+}
+
+/// Returns the number of tiles to decode at once, and the decode config to
+/// decode each tile with.
+///
+pub(crate) fn worker_decode_config(
+  decode_config: &PixelDataDecodeConfig,
+  tile_count: usize,
+) -> (usize, PixelDataDecodeConfig) {
+  #[cfg(feature = "parallel")]
+  {
+    let thread_count = if decode_config.thread_count == 0 {
+      std::thread::available_parallelism().map_or(1, |n| n.get())
+    } else {
+      decode_config.thread_count
+    };
+
+    let worker_count = thread_count.min(tile_count).max(1);
+    if worker_count > 1 {
+      let decode_config = PixelDataDecodeConfig {
+        thread_count: (thread_count / worker_count).max(1),
+        ..*decode_config
+      };
+
+      return (worker_count, decode_config);
+    }
+  }
+
+  #[cfg(not(feature = "parallel"))]
+  let _ = tile_count;
+
+  (1, *decode_config)
+}
+
+/// Copies an image into another image with its top left corner at the given
+/// position, clipping it to the bounds of the destination.
+///
+pub(crate) fn copy_image(
+  image: &image::RgbImage,
+  output: &mut image::RgbImage,
+  left: u32,
+  top: u32,
+) {
+  let width = image.width().min(output.width().saturating_sub(left)) as usize;
+  let height = image.height().min(output.height().saturating_sub(top));
+
+  let output_width = output.width() as usize;
+  let output_data: &mut [u8] = output;
+
+  for row in 0..height {
+    let source_start = row as usize * image.width() as usize * 3;
+    let output_start =
+      ((top + row) as usize * output_width + left as usize) * 3;
+
+    output_data[output_start..output_start + width * 3]
+      .copy_from_slice(&image.as_raw()[source_start..source_start + width * 3]);
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  use dcmfx_core::DataElementValue;
+
+  use crate::iods::{
+    ImagePixelModule,
+    image_pixel_module::{
+      BitsAllocated, PhotometricInterpretation, PlanarConfiguration,
+      SamplesPerPixel,
+    },
+  };
+
+  /// Creates a data set for a 3x3 Total Pixel Matrix of 2x2 RGB tiles, where
+  /// the red value of each pixel is its column and the green value its row.
+  ///
+  fn tiled_data_set() -> DataSet {
+    let image_pixel_module = ImagePixelModule::new_basic(
+      SamplesPerPixel::Three {
+        planar_configuration: PlanarConfiguration::Interleaved,
+      },
+      PhotometricInterpretation::Rgb,
+      2,
+      2,
+      BitsAllocated::Eight,
+      8,
+    )
+    .unwrap();
+
+    let mut pixel_data = vec![];
+    for (tile_x, tile_y) in [(0, 0), (1, 0), (0, 1), (1, 1)] {
+      for row in 0..2 {
+        for column in 0..2 {
+          pixel_data.extend([tile_x * 2 + column, tile_y * 2 + row, 0]);
+        }
+      }
+    }
+
+    let mut data_set = image_pixel_module.to_data_set().unwrap();
+    data_set.insert(
+      dictionary::NUMBER_OF_FRAMES.tag,
+      DataElementValue::new_integer_string(&[4]).unwrap(),
+    );
+    data_set.insert(
+      dictionary::TOTAL_PIXEL_MATRIX_COLUMNS.tag,
+      DataElementValue::new_unsigned_long(&[3]).unwrap(),
+    );
+    data_set.insert(
+      dictionary::TOTAL_PIXEL_MATRIX_ROWS.tag,
+      DataElementValue::new_unsigned_long(&[3]).unwrap(),
+    );
+    data_set.insert(
+      dictionary::DIMENSION_ORGANIZATION_TYPE.tag,
+      DataElementValue::new_code_string(&["TILED_FULL"]).unwrap(),
+    );
+    data_set.insert(
+      dictionary::PIXEL_DATA.tag,
+      DataElementValue::new_other_byte_string(pixel_data).unwrap(),
+    );
+
+    data_set
+  }
+
+  #[test]
+  fn tiled_full_layout() {
+    let layout = TileLayout::from_data_set(&tiled_data_set()).unwrap();
+
+    assert_eq!((layout.tiles_across(), layout.tiles_down()), (2, 2));
+    assert_eq!(layout.frame_index(0, 0), Some(0));
+    assert_eq!(layout.frame_index(1, 1), Some(3));
+    assert_eq!(layout.frame_index(2, 0), None);
+
+    assert_eq!(
+      layout.tiles_in_region(1, 0, 2, 1).collect::<Vec<_>>(),
+      vec![(0, 0), (1, 0)]
+    );
+    assert_eq!(
+      layout.tiles_in_region(2, 2, 10, 10).collect::<Vec<_>>(),
+      vec![(1, 1)]
+    );
+  }
+
+  #[test]
+  fn tiled_sparse_layout() {
+    let mut data_set = tiled_data_set();
+    data_set.delete(dictionary::DIMENSION_ORGANIZATION_TYPE.tag);
+
+    // Frames hold the tiles in column-major order, and tile (1, 1) is missing
+    let per_frame_functional_groups = [(1, 1), (1, 3), (3, 1)]
+      .iter()
+      .map(|(column, row)| {
+        let mut plane_position = DataSet::new();
+        plane_position.insert(
+          dictionary::COLUMN_POSITION_IN_TOTAL_IMAGE_PIXEL_MATRIX.tag,
+          DataElementValue::new_signed_long(&[*column]).unwrap(),
+        );
+        plane_position.insert(
+          dictionary::ROW_POSITION_IN_TOTAL_IMAGE_PIXEL_MATRIX.tag,
+          DataElementValue::new_signed_long(&[*row]).unwrap(),
+        );
+
+        let mut functional_groups = DataSet::new();
+        functional_groups.insert(
+          dictionary::PLANE_POSITION_SLIDE_SEQUENCE.tag,
+          DataElementValue::new_sequence(vec![plane_position]),
+        );
+
+        functional_groups
+      })
+      .collect();
+
+    data_set.insert(
+      dictionary::PER_FRAME_FUNCTIONAL_GROUPS_SEQUENCE.tag,
+      DataElementValue::new_sequence(per_frame_functional_groups),
+    );
+
+    let layout = TileLayout::from_data_set(&data_set).unwrap();
+
+    assert_eq!(layout.frame_index(0, 0), Some(0));
+    assert_eq!(layout.frame_index(0, 1), Some(1));
+    assert_eq!(layout.frame_index(1, 0), Some(2));
+    assert_eq!(layout.frame_index(1, 1), None);
+  }
+
+  #[test]
+  fn render_region_across_tiles() {
+    let mut level =
+      WholeSlideImageLevel::from_data_set(&tiled_data_set()).unwrap();
+    level.renderer.decode_config.thread_count = 2;
+
+    let image = level.render_region(1, 1, 3, 2, None).unwrap();
+
+    assert_eq!(image.dimensions(), (3, 2));
+    assert_eq!(image.get_pixel(0, 0).0, [1, 1, 0]);
+    assert_eq!(image.get_pixel(1, 0).0, [2, 1, 0]);
+    assert_eq!(image.get_pixel(1, 1).0, [2, 2, 0]);
+
+    // Pixels outside the Total Pixel Matrix are white
+    assert_eq!(image.get_pixel(2, 0).0, [255, 255, 255]);
+  }
+}
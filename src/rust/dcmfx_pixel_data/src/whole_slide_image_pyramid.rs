@@ -0,0 +1,602 @@
+//! Generation of the lower resolution levels of a whole slide image's
+//! resolution pyramid from a higher resolution level, where each generated
+//! level has half the width and height of the level it's generated from.
+
+use std::sync::Mutex;
+
+use dcmfx_core::{
+  DataElementValue, DataError, DataSet, DataSetPath, DcmfxError, IodModule,
+  RcByteSlice, TransferSyntax, ValueRepresentation, dictionary,
+};
+
+use crate::{
+  ColorImage, ColorSpace, FrameBufferPool, GrayscalePipeline,
+  PixelDataDecodeError, PixelDataEncodeConfig, PixelDataEncodeError,
+  PixelDataRenderer, WholeSlideImageLevel, encode,
+  iods::{
+    ImagePixelModule,
+    image_pixel_module::{
+      BitsAllocated, PhotometricInterpretation, PlanarConfiguration,
+      SamplesPerPixel,
+    },
+  },
+  whole_slide_image::{copy_image, worker_decode_config},
+};
+
+/// Generates the given number of lower resolution levels of a whole slide
+/// image's resolution pyramid, starting from the level in the passed data set.
+/// Each level is generated from the one before it, and so has half its width
+/// and height.
+///
+/// The frames of the level in the passed data set are decoded with the passed
+/// level's renderer, see [`generate_pyramid_level()`].
+///
+pub fn generate_pyramid_levels(
+  data_set: &DataSet,
+  level: &WholeSlideImageLevel,
+  level_count: usize,
+  transfer_syntax: &'static TransferSyntax,
+  encode_config: &PixelDataEncodeConfig,
+) -> Result<Vec<DataSet>, WholeSlideImagePyramidError> {
+  let mut levels: Vec<DataSet> = Vec::with_capacity(level_count);
+  let mut previous_level = level.clone();
+
+  for _ in 0..level_count {
+    let previous_data_set = levels.last().unwrap_or(data_set);
+
+    let next_data_set = generate_pyramid_level(
+      previous_data_set,
+      &previous_level,
+      transfer_syntax,
+      encode_config,
+    )?;
+
+    let mut next_level = WholeSlideImageLevel::from_data_set(&next_data_set)
+      .map_err(WholeSlideImagePyramidError::DataError)?;
+    next_level.renderer.decode_config = previous_level.renderer.decode_config;
+
+    levels.push(next_data_set);
+    previous_level = next_level;
+  }
+
+  Ok(levels)
+}
+
+/// Generates the next lower resolution level of a whole slide image's
+/// resolution pyramid from the level in the passed data set, and returns the
+/// data set for a new instance that holds it. The new level has half the width
+/// and height of the passed level, uses the same tile size, and has its tiles
+/// stored in row-major order, i.e. a `TILED_FULL` dimension organization.
+///
+/// Each tile of the new level is made from four tiles of the passed level. They
+/// are rendered to RGB 8-bit with the level's renderer, and each is then scaled
+/// down with a 2x2 box filter. Where the passed level's transfer syntax and
+/// decoder support decoding at a reduced resolution, such as JPEG 2000,
+/// High-Throughput JPEG 2000, and 12-bit JPEG, each tile is instead decoded
+/// directly at half resolution, which skips the full resolution decode and the
+/// box filter.
+/// Tiles that are missing from the passed level are white in the new level.
+///
+/// Tiles of the new level are generated and encoded concurrently on up to
+/// [`crate::PixelDataDecodeConfig::thread_count`] threads of the passed
+/// level's renderer when the `parallel` feature is enabled. Only the source
+/// tiles currently being worked on are held decoded in memory.
+///
+/// The new level is encoded as RGB 8-bit pixel data in the given transfer
+/// syntax, and its other data elements are copied from the passed data set
+/// with the following changes:
+///
+/// - The Image Pixel Module, Total Pixel Matrix, Number of Frames, and
+///   Transfer Syntax UID describe the new level.
+/// - The Per-Frame Functional Groups Sequence is removed. Only the first focal
+///   plane and optical path of the passed level are included in the new level.
+/// - Pixel Spacing in the Shared Functional Groups Sequence is doubled.
+/// - Image Type is set to `DERIVED` and `RESAMPLED`.
+///
+/// The caller is responsible for assigning the new instance its own SOP
+/// Instance UID.
+///
+pub fn generate_pyramid_level(
+  data_set: &DataSet,
+  level: &WholeSlideImageLevel,
+  transfer_syntax: &'static TransferSyntax,
+  encode_config: &PixelDataEncodeConfig,
+) -> Result<DataSet, WholeSlideImagePyramidError> {
+  let tile_layout = &level.tile_layout;
+  let tile_width = tile_layout.tile_width();
+  let tile_height = tile_layout.tile_height();
+
+  if tile_width % 2 == 1 || tile_height % 2 == 1 {
+    return Err(WholeSlideImagePyramidError::DataError(
+      DataError::new_value_invalid(format!(
+        "Tile size {tile_width}x{tile_height} must be even to generate a \
+         pyramid level"
+      )),
+    ));
+  }
+
+  let total_pixel_matrix_columns =
+    tile_layout.total_pixel_matrix_columns().div_ceil(2);
+  let total_pixel_matrix_rows =
+    tile_layout.total_pixel_matrix_rows().div_ceil(2);
+
+  let tiles_across = total_pixel_matrix_columns.div_ceil(tile_width.into());
+  let tiles_down = total_pixel_matrix_rows.div_ceil(tile_height.into());
+  let tile_count = tiles_across as usize * tiles_down as usize;
+
+  let output_image_pixel_module = encode::encode_image_pixel_module(
+    ImagePixelModule::new_basic(
+      SamplesPerPixel::Three {
+        planar_configuration: PlanarConfiguration::Interleaved,
+      },
+      PhotometricInterpretation::Rgb,
+      tile_height,
+      tile_width,
+      BitsAllocated::Eight,
+      8,
+    )
+    .map_err(WholeSlideImagePyramidError::DataError)?,
+    transfer_syntax,
+    encode_config,
+  )
+  .map_err(WholeSlideImagePyramidError::PixelDataEncodeError)?;
+
+  // Share the threads out between the tiles being generated at once and the
+  // decoder and encoder used for each tile
+  let (worker_count, decode_config) =
+    worker_decode_config(&level.renderer.decode_config, tile_count);
+
+  let mut tile_encode_config = *encode_config;
+  tile_encode_config.set_thread_count(decode_config.thread_count);
+
+  let renderer = PixelDataRenderer {
+    decode_config,
+    resolution_reduction: 1,
+    decode_area: None,
+    ..level.renderer.clone()
+  };
+
+  let tiles = Mutex::new(0..tile_count);
+  let encoded_tiles = Mutex::new(vec![RcByteSlice::empty(); tile_count]);
+  let first_error = Mutex::new(None);
+
+  let generate_worker = || {
+    FrameBufferPool::default().scope(|| {
+      while first_error.lock().unwrap().is_none() {
+        let Some(tile_index) = tiles.lock().unwrap().next() else {
+          break;
+        };
+
+        let tile_x = tile_index as u32 % tiles_across;
+        let tile_y = tile_index as u32 / tiles_across;
+
+        let result = generate_tile(level, &renderer, tile_x, tile_y)
+          .map_err(WholeSlideImagePyramidError::PixelDataDecodeError)
+          .and_then(|tile| {
+            let image = ColorImage::new_u8(
+              tile_width,
+              tile_height,
+              tile.into_raw(),
+              ColorSpace::Rgb,
+              8,
+            )
+            .map_err(|e| {
+              WholeSlideImagePyramidError::DataError(
+                DataError::new_value_invalid(e.to_string()),
+              )
+            })?;
+
+            encode::encode_color(
+              &image,
+              &output_image_pixel_module,
+              transfer_syntax,
+              &tile_encode_config,
+            )
+            .map_err(WholeSlideImagePyramidError::PixelDataEncodeError)
+          });
+
+        match result {
+          Ok(frame) => {
+            encoded_tiles.lock().unwrap()[tile_index] = frame.to_bytes()
+          }
+
+          Err(e) => {
+            first_error.lock().unwrap().get_or_insert(e);
+          }
+        }
+      }
+    })
+  };
+
+  if worker_count > 1 {
+    std::thread::scope(|scope| {
+      for _ in 1..worker_count {
+        scope.spawn(generate_worker);
+      }
+
+      generate_worker();
+    });
+  } else {
+    generate_worker();
+  }
+
+  if let Some(e) = first_error.into_inner().unwrap() {
+    return Err(e);
+  }
+
+  pyramid_level_data_set(
+    data_set,
+    &output_image_pixel_module,
+    transfer_syntax,
+    (total_pixel_matrix_columns, total_pixel_matrix_rows),
+    encoded_tiles.into_inner().unwrap(),
+  )
+  .map_err(WholeSlideImagePyramidError::DataError)
+}
+
+/// Generates the tile at the given column and row of tiles of the next lower
+/// resolution level from the four tiles of the passed level that it covers.
+///
+fn generate_tile(
+  level: &WholeSlideImageLevel,
+  renderer: &PixelDataRenderer,
+  tile_x: u32,
+  tile_y: u32,
+) -> Result<image::RgbImage, PixelDataDecodeError> {
+  let half_tile_width = u32::from(level.tile_layout.tile_width()) / 2;
+  let half_tile_height = u32::from(level.tile_layout.tile_height()) / 2;
+
+  let mut tile = image::RgbImage::from_pixel(
+    half_tile_width * 2,
+    half_tile_height * 2,
+    image::Rgb([255, 255, 255]),
+  );
+
+  for (dx, dy) in [(0, 0), (1, 0), (0, 1), (1, 1)] {
+    let Some(mut frame) = level.tile_frame(tile_x * 2 + dx, tile_y * 2 + dy)
+    else {
+      continue;
+    };
+
+    let mut image = renderer.render_frame(&mut frame, None)?;
+
+    // Decoders that don't support reduced resolution decoding return the
+    // full resolution tile, which is then scaled down here
+    if image.dimensions() != (half_tile_width, half_tile_height) {
+      image = downsample_2x2(&image);
+    }
+
+    copy_image(
+      &image,
+      &mut tile,
+      dx * half_tile_width,
+      dy * half_tile_height,
+    );
+  }
+
+  Ok(tile)
+}
+
+/// Scales an image down to half its width and height by averaging each 2x2
+/// block of pixels. The loops are written so that the compiler vectorizes
+/// them: each pair of rows is first summed into 16-bit values, and horizontal
+/// pairs of those sums are then averaged with rounding.
+///
+fn downsample_2x2(image: &image::RgbImage) -> image::RgbImage {
+  let width = image.width() / 2;
+  let height = image.height() / 2;
+
+  let input_row_length = image.width() as usize * 3;
+  let output_row_length = width as usize * 3;
+
+  let mut output = vec![0u8; output_row_length * height as usize];
+  let mut row_sums = vec![0u16; input_row_length];
+
+  for (output_row, input_rows) in output
+    .chunks_exact_mut(output_row_length)
+    .zip(image.as_raw().chunks_exact(input_row_length * 2))
+  {
+    let (top, bottom) = input_rows.split_at(input_row_length);
+
+    for ((sum, a), b) in row_sums.iter_mut().zip(top).zip(bottom) {
+      *sum = u16::from(*a) + u16::from(*b);
+    }
+
+    for (output_pixel, sums) in
+      output_row.chunks_exact_mut(3).zip(row_sums.chunks_exact(6))
+    {
+      for i in 0..3 {
+        output_pixel[i] = ((sums[i] + sums[i + 3] + 2) >> 2) as u8;
+      }
+    }
+  }
+
+  image::RgbImage::from_raw(width, height, output).unwrap()
+}
+
+/// Creates the data set for a generated pyramid level from the data set of the
+/// level it was generated from.
+///
+fn pyramid_level_data_set(
+  data_set: &DataSet,
+  image_pixel_module: &ImagePixelModule,
+  transfer_syntax: &'static TransferSyntax,
+  (total_pixel_matrix_columns, total_pixel_matrix_rows): (u32, u32),
+  encoded_tiles: Vec<RcByteSlice>,
+) -> Result<DataSet, DataError> {
+  let mut data_set = data_set.clone();
+
+  // Remove the data elements that describe the passed level's pixel data.
+  // The grayscale pipeline doesn't apply to the generated RGB pixel data.
+  data_set.retain(|tag, value| {
+    let vr = value.value_representation();
+    let path = DataSetPath::new();
+
+    !ImagePixelModule::is_iod_module_data_element(tag, vr, None, &path)
+      && (tag == dictionary::SOP_CLASS_UID.tag
+        || !GrayscalePipeline::is_iod_module_data_element(tag, vr, None, &path))
+      && tag != dictionary::PER_FRAME_FUNCTIONAL_GROUPS_SEQUENCE.tag
+  });
+
+  data_set.merge(image_pixel_module.to_data_set()?);
+
+  data_set.insert_string_value(
+    &dictionary::TRANSFER_SYNTAX_UID,
+    &[transfer_syntax.uid],
+  )?;
+  data_set.insert_int_value(
+    &dictionary::TOTAL_PIXEL_MATRIX_COLUMNS,
+    &[total_pixel_matrix_columns.into()],
+  )?;
+  data_set.insert_int_value(
+    &dictionary::TOTAL_PIXEL_MATRIX_ROWS,
+    &[total_pixel_matrix_rows.into()],
+  )?;
+  data_set.insert_int_value(
+    &dictionary::NUMBER_OF_FRAMES,
+    &[encoded_tiles.len() as i64],
+  )?;
+  data_set.insert_string_value(
+    &dictionary::DIMENSION_ORGANIZATION_TYPE,
+    &["TILED_FULL"],
+  )?;
+
+  if data_set.has(dictionary::TOTAL_PIXEL_MATRIX_FOCAL_PLANES.tag) {
+    data_set
+      .insert_int_value(&dictionary::TOTAL_PIXEL_MATRIX_FOCAL_PLANES, &[1])?;
+  }
+
+  if data_set.has(dictionary::IMAGE_TYPE.tag) {
+    let image_type = data_set.get_strings(dictionary::IMAGE_TYPE.tag)?;
+    if image_type.len() >= 4 {
+      let mut image_type: Vec<_> =
+        image_type.into_iter().map(str::to_string).collect();
+      image_type[0] = "DERIVED".to_string();
+      image_type[3] = "RESAMPLED".to_string();
+
+      let image_type: Vec<_> = image_type.iter().map(String::as_str).collect();
+      data_set.insert_string_value(&dictionary::IMAGE_TYPE, &image_type)?;
+    }
+  }
+
+  double_pixel_spacing(&mut data_set)?;
+
+  let pixel_data = if transfer_syntax.is_encapsulated {
+    let mut items = vec![RcByteSlice::empty()];
+    for tile in encoded_tiles {
+      let mut tile = tile.into_vec();
+      if tile.len() & 1 == 1 {
+        tile.push(0);
+      }
+
+      items.push(tile.into());
+    }
+
+    DataElementValue::new_encapsulated_pixel_data(
+      ValueRepresentation::OtherByteString,
+      items,
+    )?
+  } else {
+    let mut bytes = Vec::with_capacity(
+      encoded_tiles.iter().map(|tile| tile.len()).sum::<usize>() + 1,
+    );
+    for tile in encoded_tiles {
+      bytes.extend_from_slice(&tile);
+    }
+
+    if bytes.len() & 1 == 1 {
+      bytes.push(0);
+    }
+
+    DataElementValue::new_other_byte_string(bytes)?
+  };
+
+  data_set.insert(dictionary::PIXEL_DATA.tag, pixel_data);
+
+  Ok(data_set)
+}
+
+/// Doubles the Pixel Spacing in the Pixel Measures Sequence of the Shared
+/// Functional Groups Sequence, if it's present.
+///
+fn double_pixel_spacing(data_set: &mut DataSet) -> Result<(), DataError> {
+  if !data_set.has(dictionary::SHARED_FUNCTIONAL_GROUPS_SEQUENCE.tag) {
+    return Ok(());
+  }
+
+  let mut shared_functional_groups = data_set
+    .get_sequence_items(dictionary::SHARED_FUNCTIONAL_GROUPS_SEQUENCE.tag)?
+    .to_vec();
+
+  for functional_groups in shared_functional_groups.iter_mut() {
+    if !functional_groups.has(dictionary::PIXEL_MEASURES_SEQUENCE.tag) {
+      continue;
+    }
+
+    let mut pixel_measures = functional_groups
+      .get_sequence_items(dictionary::PIXEL_MEASURES_SEQUENCE.tag)?
+      .to_vec();
+
+    for pixel_measure in pixel_measures.iter_mut() {
+      if pixel_measure.has(dictionary::PIXEL_SPACING.tag) {
+        let pixel_spacing: Vec<_> = pixel_measure
+          .get_floats(dictionary::PIXEL_SPACING.tag)?
+          .iter()
+          .map(|spacing| spacing * 2.0)
+          .collect();
+
+        pixel_measure
+          .insert_float_value(&dictionary::PIXEL_SPACING, &pixel_spacing)?;
+      }
+    }
+
+    functional_groups.insert_sequence_value(
+      &dictionary::PIXEL_MEASURES_SEQUENCE,
+      pixel_measures,
+    )?;
+  }
+
+  data_set.insert_sequence_value(
+    &dictionary::SHARED_FUNCTIONAL_GROUPS_SEQUENCE,
+    shared_functional_groups,
+  )
+}
+
+/// An error that occurred generating a level of a whole slide image's
+/// resolution pyramid.
+///
+#[derive(Clone, Debug, PartialEq)]
+pub enum WholeSlideImagePyramidError {
+  DataError(DataError),
+  PixelDataDecodeError(PixelDataDecodeError),
+  PixelDataEncodeError(PixelDataEncodeError),
+}
+
+impl core::fmt::Display for WholeSlideImagePyramidError {
+  fn fmt(&self, f: &mut core::fmt::Formatter) -> core::fmt::Result {
+    match self {
+      Self::DataError(e) => e.fmt(f),
+      Self::PixelDataDecodeError(e) => e.fmt(f),
+      Self::PixelDataEncodeError(e) => e.fmt(f),
+    }
+  }
+}
+
+impl DcmfxError for WholeSlideImagePyramidError {
+  fn to_lines(&self, task_description: &str) -> Vec<String> {
+    match self {
+      Self::DataError(e) => e.to_lines(task_description),
+      Self::PixelDataDecodeError(e) => e.to_lines(task_description),
+      Self::PixelDataEncodeError(e) => e.to_lines(task_description),
+    }
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  use dcmfx_core::transfer_syntax;
+
+  #[test]
+  fn downsample_2x2_test() {
+    let image = image::RgbImage::from_raw(
+      2,
+      2,
+      vec![0, 10, 255, 1, 20, 255, 2, 30, 255, 4, 40, 254],
+    )
+    .unwrap();
+
+    let image = downsample_2x2(&image);
+
+    assert_eq!(image.dimensions(), (1, 1));
+    assert_eq!(image.get_pixel(0, 0).0, [2, 25, 255]);
+  }
+
+  #[test]
+  fn generate_pyramid_level_test() {
+    // A 6x4 Total Pixel Matrix of 2x2 tiles, where each tile is a solid color
+    // whose red value is its column and green value is its row
+    let image_pixel_module = ImagePixelModule::new_basic(
+      SamplesPerPixel::Three {
+        planar_configuration: PlanarConfiguration::Interleaved,
+      },
+      PhotometricInterpretation::Rgb,
+      2,
+      2,
+      BitsAllocated::Eight,
+      8,
+    )
+    .unwrap();
+
+    let mut pixel_data = vec![];
+    for tile_y in 0..2 {
+      for tile_x in 0..3 {
+        for _ in 0..4 {
+          pixel_data.extend([tile_x * 100, tile_y * 100, 0]);
+        }
+      }
+    }
+
+    let mut data_set = image_pixel_module.to_data_set().unwrap();
+    data_set.insert(
+      dictionary::NUMBER_OF_FRAMES.tag,
+      DataElementValue::new_integer_string(&[6]).unwrap(),
+    );
+    data_set.insert(
+      dictionary::TOTAL_PIXEL_MATRIX_COLUMNS.tag,
+      DataElementValue::new_unsigned_long(&[6]).unwrap(),
+    );
+    data_set.insert(
+      dictionary::TOTAL_PIXEL_MATRIX_ROWS.tag,
+      DataElementValue::new_unsigned_long(&[4]).unwrap(),
+    );
+    data_set.insert(
+      dictionary::PIXEL_DATA.tag,
+      DataElementValue::new_other_byte_string(pixel_data).unwrap(),
+    );
+
+    let mut level = WholeSlideImageLevel::from_data_set(&data_set).unwrap();
+    level.renderer.decode_config.thread_count = 2;
+
+    let levels = generate_pyramid_levels(
+      &data_set,
+      &level,
+      2,
+      &transfer_syntax::EXPLICIT_VR_LITTLE_ENDIAN,
+      &PixelDataEncodeConfig::default(),
+    )
+    .unwrap();
+
+    assert_eq!(levels.len(), 2);
+
+    let level = WholeSlideImageLevel::from_data_set(&levels[0]).unwrap();
+    assert_eq!(level.tile_layout.total_pixel_matrix_columns(), 3);
+    assert_eq!(level.tile_layout.total_pixel_matrix_rows(), 2);
+    assert_eq!(
+      levels[0].get_string(dictionary::DIMENSION_ORGANIZATION_TYPE.tag),
+      Ok("TILED_FULL")
+    );
+
+    let image = level.render_region(0, 0, 3, 2, None).unwrap();
+    assert_eq!(image.get_pixel(0, 0).0, [0, 0, 0]);
+    assert_eq!(image.get_pixel(1, 1).0, [100, 100, 0]);
+    assert_eq!(image.get_pixel(2, 0).0, [200, 0, 0]);
+    assert_eq!(image.get_pixel(2, 1).0, [200, 100, 0]);
+
+    // The part of the last tile past the source level's Total Pixel Matrix
+    // has no source tile, and so is white
+    let tile = generate_tile(
+      &WholeSlideImageLevel::from_data_set(&data_set).unwrap(),
+      &PixelDataRenderer::from_data_set(&data_set).unwrap(),
+      1,
+      0,
+    )
+    .unwrap();
+    assert_eq!(tile.get_pixel(1, 0).0, [255, 255, 255]);
+
+    let level = WholeSlideImageLevel::from_data_set(&levels[1]).unwrap();
+    assert_eq!(level.tile_layout.total_pixel_matrix_columns(), 2);
+    assert_eq!(level.tile_layout.total_pixel_matrix_rows(), 1);
+  }
+}
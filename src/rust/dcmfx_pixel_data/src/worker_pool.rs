@@ -0,0 +1,679 @@
+//! A fixed set of worker threads that parallel work inside decoders, encoders,
+//! and image conversions can share, so that the total number of threads stays
+//! within a budget no matter how many frames or files are being processed at
+//! once.
+//!
+//! By default, parallel work inside this crate runs on threads that are
+//! created for it, and libjxl runs on its own worker threads. Once a worker
+//! pool is set with [`set_shared()`], conversions of large images, RLE Lossless
+//! segments, and libjxl's parallel work all run on that pool instead.
+//!
+//! Work on the pool has a [`Priority`]. Interactive work, e.g. rendering a
+//! frame that a user is waiting on, is picked up by idle worker threads ahead
+//! of batch work such as background transcodes. Worker threads that are
+//! helping with batch work leave it between tasks to help with interactive
+//! work as soon as any is waiting, and the number of worker threads that help
+//! with batch work while interactive work is running can be limited with
+//! [`WorkerPool::set_batch_thread_limit()`].
+//!
+//! On machines with more than one NUMA node, a worker pool can be created for
+//! each node with [`WorkerPool::new_on_node()`] and set with
+//! [`set_shared_per_node()`]. Parallel work then runs on the pool for the node
+//! that the calling thread is bound to, see [`crate::numa`], so the work on a
+//! frame stays on the node it's being transcoded on.
+
+use std::any::Any;
+use std::cell::Cell;
+use std::collections::VecDeque;
+use std::ops::Range;
+use std::panic::AssertUnwindSafe;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Condvar, Mutex, RwLock};
+use std::thread::JoinHandle;
+
+/// The priority of work run on a worker pool.
+///
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub enum Priority {
+  /// Work that something is waiting on, such as rendering a frame for display.
+  Interactive,
+
+  /// Background work, such as transcoding. This is the default.
+  #[default]
+  Batch,
+}
+
+thread_local! {
+  static CURRENT_PRIORITY: Cell<Priority> =
+    const { Cell::new(Priority::Batch) };
+}
+
+/// Returns the priority of work started on the current thread. See
+/// [`with_priority()`].
+///
+pub fn current_priority() -> Priority {
+  CURRENT_PRIORITY.with(|priority| priority.get())
+}
+
+/// Calls `f` with the given priority applied to all work it runs on worker
+/// pools, including work run by codecs and by nested calls to
+/// [`WorkerPool::run()`] on worker threads.
+///
+pub fn with_priority<R>(priority: Priority, f: impl FnOnce() -> R) -> R {
+  struct RestorePriority(Priority);
+
+  impl Drop for RestorePriority {
+    fn drop(&mut self) {
+      CURRENT_PRIORITY.with(|priority| priority.set(self.0));
+    }
+  }
+
+  let _restore_priority = RestorePriority(
+    CURRENT_PRIORITY
+      .with(|current_priority| current_priority.replace(priority)),
+  );
+
+  f()
+}
+
+/// A fixed set of worker threads that run tasks passed to [`Self::run()`]. The
+/// thread that calls [`Self::run()`] also runs tasks, so calls can be nested,
+/// e.g. a codec can use the pool from a task that is itself running on the
+/// pool, without any risk of deadlock.
+///
+pub struct WorkerPool {
+  thread_count: usize,
+  shared: Arc<SharedState>,
+  workers: Vec<JoinHandle<()>>,
+}
+
+/// The state shared between a worker pool and its worker threads.
+///
+struct SharedState {
+  queue: Mutex<JobQueue>,
+  queue_changed: Condvar,
+
+  // The number of requests for help with interactive jobs that are in the
+  // queue, which batch jobs check between tasks without taking the lock
+  queued_interactive_count: AtomicUsize,
+
+  // The number of interactive jobs that are currently running
+  running_interactive_count: AtomicUsize,
+
+  // The number of worker threads currently helping with batch jobs, and the
+  // limit on this while interactive jobs are running
+  batch_helper_count: AtomicUsize,
+  batch_thread_limit: AtomicUsize,
+}
+
+/// Requests for worker threads to help with jobs, which are queued once for
+/// each worker thread that a job would like help from.
+///
+struct JobQueue {
+  interactive: VecDeque<Arc<Job>>,
+  batch: VecDeque<Arc<Job>>,
+  is_shutdown: bool,
+}
+
+/// The tasks for a single call to [`WorkerPool::run()`].
+///
+struct Job {
+  // The task is only valid while the job is open, see `JobState::is_open`
+  task: &'static (dyn Fn(u32, usize) + Sync),
+  priority: Priority,
+
+  next_value: AtomicU64,
+  end: u64,
+
+  state: Mutex<JobState>,
+  helpers_finished: Condvar,
+}
+
+struct JobState {
+  // Whether worker threads can still start helping with the job. Once closed,
+  // the job's task is no longer valid.
+  is_open: bool,
+
+  // The number of worker threads currently helping with the job
+  active_helper_count: usize,
+
+  // The thread ID to give the next worker thread that helps with the job. The
+  // thread that called `WorkerPool::run()` always has thread ID zero.
+  next_thread_id: usize,
+
+  // The first panic raised by a task, which is resumed on the thread that
+  // called `WorkerPool::run()`
+  panic: Option<Box<dyn Any + Send>>,
+}
+
+impl WorkerPool {
+  /// Creates a new worker pool that runs up to `thread_count` tasks at once. A
+  /// value of zero uses one thread per CPU core. Because the thread that calls
+  /// [`Self::run()`] also runs tasks, the pool creates one fewer worker thread
+  /// than this.
+  ///
+  pub fn new(thread_count: usize) -> Self {
+    Self::new_with_node(thread_count, None)
+  }
+
+  /// Creates a new worker pool whose worker threads are bound to the given
+  /// NUMA node, see [`crate::numa::bind_current_thread()`].
+  ///
+  pub fn new_on_node(thread_count: usize, node: usize) -> Self {
+    Self::new_with_node(thread_count, Some(node))
+  }
+
+  fn new_with_node(thread_count: usize, node: Option<usize>) -> Self {
+    let thread_count = if thread_count == 0 {
+      std::thread::available_parallelism().map_or(1, |n| n.get())
+    } else {
+      thread_count
+    };
+
+    let shared = Arc::new(SharedState {
+      queue: Mutex::new(JobQueue {
+        interactive: VecDeque::new(),
+        batch: VecDeque::new(),
+        is_shutdown: false,
+      }),
+      queue_changed: Condvar::new(),
+      queued_interactive_count: AtomicUsize::new(0),
+      running_interactive_count: AtomicUsize::new(0),
+      batch_helper_count: AtomicUsize::new(0),
+      batch_thread_limit: AtomicUsize::new(usize::MAX),
+    });
+
+    // The calling thread always runs tasks, so one fewer worker thread is
+    // needed for the pool to run `thread_count` tasks at once
+    let workers = (1..thread_count)
+      .map(|_| {
+        let shared = shared.clone();
+
+        std::thread::spawn(move || {
+          if let Some(node) = node {
+            crate::numa::bind_current_thread(node);
+          }
+
+          while let Some(job) = shared.next_job() {
+            job.help(&shared);
+          }
+        })
+      })
+      .collect();
+
+    Self {
+      thread_count,
+      shared,
+      workers,
+    }
+  }
+
+  /// Sets the maximum number of worker threads that help with batch work
+  /// while interactive work is running on the pool. This keeps worker threads
+  /// free to pick up interactive work immediately, at the cost of batch
+  /// throughput. By default there is no limit.
+  ///
+  /// The threads that start batch work always run it, so this doesn't stop
+  /// batch work from progressing.
+  ///
+  pub fn set_batch_thread_limit(&self, limit: Option<usize>) {
+    self
+      .shared
+      .batch_thread_limit
+      .store(limit.unwrap_or(usize::MAX), Ordering::Relaxed);
+
+    self.shared.queue_changed.notify_all();
+  }
+
+  /// Returns the maximum number of tasks this pool runs at once, which
+  /// includes the thread that calls [`Self::run()`].
+  ///
+  pub fn thread_count(&self) -> usize {
+    self.thread_count
+  }
+
+  /// Runs `task` once for every value in `range`, potentially in parallel,
+  /// and returns once they have all completed. If a task panics then the
+  /// panic is resumed on the calling thread once all running tasks have
+  /// completed.
+  ///
+  /// The second argument passed to `task` is the ID of the thread running it,
+  /// which is less than [`Self::thread_count()`] and is different for tasks
+  /// that run at the same time.
+  ///
+  /// The work has the priority of the calling thread, see [`with_priority()`].
+  ///
+  pub fn run(&self, range: Range<u32>, task: &(dyn Fn(u32, usize) + Sync)) {
+    let value_count = range.end.saturating_sub(range.start) as usize;
+    if value_count == 0 {
+      return;
+    }
+
+    // SAFETY: the job is closed before this function returns, and worker
+    // threads only call the task while helping with an open job, so the task
+    // is never called after this function returns
+    let task: &'static (dyn Fn(u32, usize) + Sync) =
+      unsafe { core::mem::transmute(task) };
+
+    let priority = current_priority();
+
+    let job = Arc::new(Job {
+      task,
+      priority,
+      next_value: AtomicU64::new(u64::from(range.start)),
+      end: u64::from(range.end),
+      state: Mutex::new(JobState {
+        is_open: true,
+        active_helper_count: 0,
+        next_thread_id: 1,
+        panic: None,
+      }),
+      helpers_finished: Condvar::new(),
+    });
+
+    if priority == Priority::Interactive {
+      self
+        .shared
+        .running_interactive_count
+        .fetch_add(1, Ordering::Relaxed);
+    }
+
+    // Ask idle worker threads for help. Worker threads that are busy pick up
+    // the request later, and do nothing if the job has been closed by then.
+    let helper_count = self.thread_count.min(value_count) - 1;
+    if helper_count > 0 {
+      self.shared.queue_job(&job, helper_count);
+    }
+
+    let result =
+      std::panic::catch_unwind(AssertUnwindSafe(|| job.work(0, &self.shared)));
+
+    // Close the job and wait for the worker threads helping with it to finish
+    let mut state = job.state.lock().unwrap();
+    state.is_open = false;
+    while state.active_helper_count > 0 {
+      state = job.helpers_finished.wait(state).unwrap();
+    }
+
+    let panic = result.err().or(state.panic.take());
+    drop(state);
+
+    // Batch work that was limited while this job ran can now resume
+    if priority == Priority::Interactive
+      && self
+        .shared
+        .running_interactive_count
+        .fetch_sub(1, Ordering::Relaxed)
+        == 1
+    {
+      self.shared.queue_changed.notify_all();
+    }
+
+    if let Some(panic) = panic {
+      std::panic::resume_unwind(panic);
+    }
+  }
+}
+
+impl Drop for WorkerPool {
+  fn drop(&mut self) {
+    self.shared.queue.lock().unwrap().is_shutdown = true;
+    self.shared.queue_changed.notify_all();
+
+    for worker in self.workers.drain(..) {
+      let _ = worker.join();
+    }
+  }
+}
+
+impl SharedState {
+  /// Queues `count` requests for worker threads to help with a job.
+  ///
+  fn queue_job(&self, job: &Arc<Job>, count: usize) {
+    let mut queue = self.queue.lock().unwrap();
+
+    match job.priority {
+      Priority::Interactive => {
+        queue.interactive.extend((0..count).map(|_| job.clone()));
+        self
+          .queued_interactive_count
+          .fetch_add(count, Ordering::Relaxed);
+      }
+
+      Priority::Batch => queue.batch.extend((0..count).map(|_| job.clone())),
+    }
+
+    drop(queue);
+
+    if count == 1 {
+      self.queue_changed.notify_one();
+    } else {
+      self.queue_changed.notify_all();
+    }
+  }
+
+  /// Waits for the next job that a worker thread should help with. Interactive
+  /// jobs are taken ahead of batch jobs, and batch jobs aren't taken while
+  /// the batch thread limit is reached. Returns `None` when the worker pool is
+  /// shut down.
+  ///
+  fn next_job(&self) -> Option<Arc<Job>> {
+    let mut queue = self.queue.lock().unwrap();
+
+    loop {
+      if queue.is_shutdown {
+        return None;
+      }
+
+      if let Some(job) = queue.interactive.pop_front() {
+        self
+          .queued_interactive_count
+          .fetch_sub(1, Ordering::Relaxed);
+        return Some(job);
+      }
+
+      if !queue.batch.is_empty() && !self.is_batch_limited() {
+        self.batch_helper_count.fetch_add(1, Ordering::Relaxed);
+        return queue.batch.pop_front();
+      }
+
+      queue = self.queue_changed.wait(queue).unwrap();
+    }
+  }
+
+  /// Returns whether worker threads have to stop helping with batch jobs
+  /// because interactive jobs are running and the batch thread limit has been
+  /// reached.
+  ///
+  fn is_batch_limited(&self) -> bool {
+    self.running_interactive_count.load(Ordering::Relaxed) > 0
+      && self.batch_helper_count.load(Ordering::Relaxed)
+        >= self.batch_thread_limit.load(Ordering::Relaxed)
+  }
+
+  /// Returns whether a worker thread helping with a batch job should stop,
+  /// either because interactive jobs are waiting for help or because the
+  /// batch thread limit has been exceeded.
+  ///
+  fn is_batch_helper_needed_elsewhere(&self) -> bool {
+    self.queued_interactive_count.load(Ordering::Relaxed) > 0
+      || self.running_interactive_count.load(Ordering::Relaxed) > 0
+        && self.batch_helper_count.load(Ordering::Relaxed)
+          > self.batch_thread_limit.load(Ordering::Relaxed)
+  }
+}
+
+impl Job {
+  /// Runs tasks for the job's values until there are none left. Worker
+  /// threads helping with a batch job stop between tasks when interactive
+  /// work needs them, leaving the rest of the job to the other threads working
+  /// on it.
+  ///
+  fn work(&self, thread_id: usize, shared: &SharedState) {
+    loop {
+      if thread_id != 0
+        && self.priority == Priority::Batch
+        && shared.is_batch_helper_needed_elsewhere()
+      {
+        break;
+      }
+
+      let value = self.next_value.fetch_add(1, Ordering::Relaxed);
+      if value >= self.end {
+        break;
+      }
+
+      (self.task)(value as u32, thread_id);
+    }
+  }
+
+  /// Called on a worker thread to help with the job if it's still open.
+  ///
+  fn help(&self, shared: &SharedState) {
+    let thread_id = {
+      let mut state = self.state.lock().unwrap();
+      if !state.is_open {
+        drop(state);
+        self.finish_helping(shared);
+        return;
+      }
+
+      state.active_helper_count += 1;
+      state.next_thread_id += 1;
+      state.next_thread_id - 1
+    };
+
+    // Nested work started by the job's tasks has the job's priority
+    let result = std::panic::catch_unwind(AssertUnwindSafe(|| {
+      with_priority(self.priority, || self.work(thread_id, shared));
+    }));
+
+    self.finish_helping(shared);
+
+    let mut state = self.state.lock().unwrap();
+
+    if let Err(panic) = result {
+      // Stop other threads from starting further tasks
+      self.next_value.store(self.end, Ordering::Relaxed);
+      state.panic.get_or_insert(panic);
+    }
+
+    state.active_helper_count -= 1;
+    self.helpers_finished.notify_all();
+  }
+
+  /// Updates the count of worker threads helping with batch jobs once a worker
+  /// thread stops helping with this job.
+  ///
+  fn finish_helping(&self, shared: &SharedState) {
+    if self.priority == Priority::Batch {
+      shared.batch_helper_count.fetch_sub(1, Ordering::Relaxed);
+
+      if shared.running_interactive_count.load(Ordering::Relaxed) > 0 {
+        shared.queue_changed.notify_one();
+      }
+    }
+  }
+}
+
+#[cfg(feature = "native")]
+impl crate::libjxl_thread_pool::ThreadPool for WorkerPool {
+  fn thread_count(&self) -> usize {
+    self.thread_count
+  }
+
+  fn run(&self, range: Range<u32>, task: &(dyn Fn(u32, usize) + Sync)) {
+    WorkerPool::run(self, range, task)
+  }
+}
+
+/// The worker pools set with [`set_shared()`] or [`set_shared_per_node()`],
+/// indexed by NUMA node.
+///
+static SHARED_WORKER_POOLS: RwLock<Vec<Arc<WorkerPool>>> =
+  RwLock::new(Vec::new());
+
+/// Sets the worker pool that all subsequent parallel work runs on, including
+/// libjxl's. Passing `None` returns to creating threads for parallel work as
+/// it's needed.
+///
+/// The number of threads used for a single image is still limited by
+/// [`crate::PixelDataDecodeConfig::thread_count`] and
+/// [`crate::PixelDataEncodeConfig::thread_count()`], except for libjxl which
+/// uses the whole pool.
+///
+pub fn set_shared(worker_pool: Option<Arc<WorkerPool>>) {
+  set_shared_per_node(worker_pool.into_iter().collect());
+}
+
+/// Sets a worker pool for each NUMA node that all subsequent parallel work
+/// runs on, including libjxl's. Work runs on the pool for the node that the
+/// calling thread is bound to, and on the first pool if the calling thread
+/// isn't bound to a node. Passing no worker pools returns to creating threads
+/// for parallel work as it's needed.
+///
+/// The worker pools are usually created with [`WorkerPool::new_on_node()`].
+///
+pub fn set_shared_per_node(worker_pools: Vec<Arc<WorkerPool>>) {
+  #[cfg(feature = "native")]
+  {
+    use crate::libjxl_thread_pool::{ThreadPool, set_thread_pool};
+
+    let thread_pool: Option<Arc<dyn ThreadPool>> = match worker_pools.len() {
+      0 => None,
+      1 => Some(worker_pools[0].clone()),
+      _ => Some(Arc::new(NodeLocalWorkerPool {
+        thread_count: worker_pools
+          .iter()
+          .map(|worker_pool| worker_pool.thread_count)
+          .max()
+          .unwrap(),
+      })),
+    };
+
+    set_thread_pool(thread_pool);
+  }
+
+  *SHARED_WORKER_POOLS.write().unwrap() = worker_pools;
+}
+
+/// Returns the shared worker pool for the NUMA node that the current thread is
+/// bound to, if shared worker pools have been set.
+///
+pub fn shared() -> Option<Arc<WorkerPool>> {
+  let worker_pools = SHARED_WORKER_POOLS.read().unwrap();
+  if worker_pools.is_empty() {
+    return None;
+  }
+
+  let node = crate::numa::current_node().unwrap_or(0);
+
+  Some(worker_pools[node % worker_pools.len()].clone())
+}
+
+/// The thread pool given to libjxl when there is a shared worker pool for each
+/// NUMA node. Each call runs on the pool returned by [`shared()`] on the
+/// calling thread.
+///
+#[cfg(feature = "native")]
+struct NodeLocalWorkerPool {
+  thread_count: usize,
+}
+
+#[cfg(feature = "native")]
+impl crate::libjxl_thread_pool::ThreadPool for NodeLocalWorkerPool {
+  fn thread_count(&self) -> usize {
+    self.thread_count
+  }
+
+  fn run(&self, range: Range<u32>, task: &(dyn Fn(u32, usize) + Sync)) {
+    match shared() {
+      Some(worker_pool) => worker_pool.run(range, task),
+      None => range.for_each(|value| task(value, 0)),
+    }
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  use super::*;
+
+  use std::sync::atomic::AtomicUsize;
+
+  #[test]
+  fn runs_every_value_once() {
+    let worker_pool = WorkerPool::new(4);
+
+    let counts: Vec<AtomicUsize> =
+      (0..100).map(|_| AtomicUsize::new(0)).collect();
+
+    worker_pool.run(10..90, &|value, thread_id| {
+      assert!(thread_id < 4);
+      counts[value as usize].fetch_add(1, Ordering::Relaxed);
+    });
+
+    for (i, count) in counts.iter().enumerate() {
+      let expected = if (10..90).contains(&i) { 1 } else { 0 };
+      assert_eq!(count.load(Ordering::Relaxed), expected);
+    }
+  }
+
+  #[test]
+  fn runs_nested_calls() {
+    let worker_pool = WorkerPool::new(2);
+    let total = AtomicUsize::new(0);
+
+    worker_pool.run(0..8, &|_, _| {
+      worker_pool.run(0..8, &|_, _| {
+        total.fetch_add(1, Ordering::Relaxed);
+      });
+    });
+
+    assert_eq!(total.load(Ordering::Relaxed), 64);
+  }
+
+  #[test]
+  fn resumes_task_panics() {
+    let worker_pool = WorkerPool::new(3);
+
+    let result = std::panic::catch_unwind(AssertUnwindSafe(|| {
+      worker_pool.run(0..100, &|value, _| {
+        if value == 50 {
+          panic!("task panicked");
+        }
+      });
+    }));
+
+    assert!(result.is_err());
+
+    // The pool is still usable after a panic
+    let total = AtomicUsize::new(0);
+    worker_pool.run(0..10, &|_, _| {
+      total.fetch_add(1, Ordering::Relaxed);
+    });
+    assert_eq!(total.load(Ordering::Relaxed), 10);
+  }
+
+  #[test]
+  fn runs_interactive_work_during_batch_work() {
+    let worker_pool = Arc::new(WorkerPool::new(4));
+    worker_pool.set_batch_thread_limit(Some(1));
+
+    let batch_total = Arc::new(AtomicUsize::new(0));
+
+    let batch_thread = {
+      let worker_pool = worker_pool.clone();
+      let batch_total = batch_total.clone();
+
+      std::thread::spawn(move || {
+        worker_pool.run(0..200, &|_, _| {
+          std::thread::sleep(std::time::Duration::from_millis(1));
+          batch_total.fetch_add(1, Ordering::Relaxed);
+        });
+      })
+    };
+
+    let interactive_total = AtomicUsize::new(0);
+    let nested_priority = Mutex::new(vec![]);
+
+    with_priority(Priority::Interactive, || {
+      worker_pool.run(0..50, &|_, _| {
+        nested_priority.lock().unwrap().push(current_priority());
+        interactive_total.fetch_add(1, Ordering::Relaxed);
+      });
+    });
+
+    assert_eq!(current_priority(), Priority::Batch);
+    assert_eq!(interactive_total.load(Ordering::Relaxed), 50);
+    assert!(
+      nested_priority
+        .lock()
+        .unwrap()
+        .iter()
+        .all(|priority| *priority == Priority::Interactive)
+    );
+
+    batch_thread.join().unwrap();
+    assert_eq!(batch_total.load(Ordering::Relaxed), 200);
+  }
+}
@@ -0,0 +1,200 @@
+//! Conversion of YBR pixels to RGB, and expansion of YBR 4:2:2 pixels so that
+//! each pixel has its own Cb and Cr values. These are shared by
+//! [`crate::ColorImage`] and the native decoder.
+//!
+//! When the `native` feature is enabled the 8-bit conversions use the SIMD
+//! kernels in pixel_kernels, which give output identical to [`ybr_to_rgb()`].
+
+/// Converts a YBR color into RGB.
+///
+pub(crate) fn ybr_to_rgb(y: f64, cb: f64, cr: f64) -> [f64; 3] {
+  let r = y + 1.402 * (cr - 0.5);
+  let g = y - 0.3441362862 * (cb - 0.5) - 0.7141362862 * (cr - 0.5);
+  let b = y + 1.772 * (cb - 0.5);
+
+  [r.clamp(0.0, 1.0), g.clamp(0.0, 1.0), b.clamp(0.0, 1.0)]
+}
+
+/// Converts 8-bit YBR pixels to RGB. Input values are scaled by
+/// `1 / input_max` and output values by `output_max`, both of which must be at
+/// most 255. `output` must be the same length as `input`.
+///
+pub(crate) fn ybr_to_rgb_u8(
+  input: &[u8],
+  output: &mut [u8],
+  input_max: u32,
+  output_max: u32,
+) {
+  assert!(input.len() == output.len());
+  assert!(input_max > 0 && input_max <= 255 && output_max <= 255);
+
+  #[cfg(feature = "native")]
+  unsafe {
+    ffi::pixel_kernels_ybr_to_rgb_u8(
+      input.as_ptr(),
+      output.as_mut_ptr(),
+      input.len() / 3,
+      input_max,
+      output_max,
+    );
+  }
+
+  #[cfg(not(feature = "native"))]
+  for (ybr, rgb) in input.chunks_exact(3).zip(output.chunks_exact_mut(3)) {
+    ybr_to_rgb_u8_pixel(ybr, rgb, input_max, output_max);
+  }
+}
+
+/// The same as [`ybr_to_rgb_u8()`], but converts the pixels in place.
+///
+pub(crate) fn ybr_to_rgb_u8_in_place(
+  data: &mut [u8],
+  input_max: u32,
+  output_max: u32,
+) {
+  assert!(input_max > 0 && input_max <= 255 && output_max <= 255);
+
+  #[cfg(feature = "native")]
+  unsafe {
+    // The kernel supports its input and output being the same
+    let data_ptr = data.as_mut_ptr();
+
+    ffi::pixel_kernels_ybr_to_rgb_u8(
+      data_ptr,
+      data_ptr,
+      data.len() / 3,
+      input_max,
+      output_max,
+    );
+  }
+
+  #[cfg(not(feature = "native"))]
+  for pixel in data.chunks_exact_mut(3) {
+    let ybr = [pixel[0], pixel[1], pixel[2]];
+    ybr_to_rgb_u8_pixel(&ybr, pixel, input_max, output_max);
+  }
+}
+
+#[cfg(not(feature = "native"))]
+fn ybr_to_rgb_u8_pixel(
+  ybr: &[u8],
+  rgb: &mut [u8],
+  input_max: u32,
+  output_max: u32,
+) {
+  let scale = 1.0 / f64::from(input_max);
+  let output_max = f64::from(output_max);
+
+  let y: f64 = ybr[0].into();
+  let cb: f64 = ybr[1].into();
+  let cr: f64 = ybr[2].into();
+
+  let [r, g, b] = ybr_to_rgb(y * scale, cb * scale, cr * scale);
+
+  rgb[0] = (r * output_max).round() as u8;
+  rgb[1] = (g * output_max).round() as u8;
+  rgb[2] = (b * output_max).round() as u8;
+}
+
+/// Expands 8-bit YBR 4:2:2 pixels, where each pair of pixels is stored as the
+/// four bytes Y0 Y1 Cb Cr, into YBR pixels that each have their own Cb and Cr
+/// values. `output` must hold three bytes for every two bytes of `input`.
+///
+pub(crate) fn upsample_ybr_422_u8(input: &[u8], output: &mut [u8]) {
+  let pair_count = input.len() / 4;
+  assert!(output.len() >= pair_count * 6);
+
+  #[cfg(feature = "native")]
+  unsafe {
+    ffi::pixel_kernels_upsample_ybr_422_u8(
+      input.as_ptr(),
+      output.as_mut_ptr(),
+      pair_count,
+    );
+  }
+
+  #[cfg(not(feature = "native"))]
+  for (ybr_422, ybr) in input.chunks_exact(4).zip(output.chunks_exact_mut(6)) {
+    let [y0, y1, cb, cr] = [ybr_422[0], ybr_422[1], ybr_422[2], ybr_422[3]];
+    ybr.copy_from_slice(&[y0, cb, cr, y1, cb, cr]);
+  }
+}
+
+#[cfg(feature = "native")]
+mod ffi {
+  unsafe extern "C" {
+    pub fn pixel_kernels_ybr_to_rgb_u8(
+      src: *const u8,
+      dst: *mut u8,
+      count: usize,
+      input_max: u32,
+      output_max: u32,
+    );
+
+    pub fn pixel_kernels_upsample_ybr_422_u8(
+      src: *const u8,
+      dst: *mut u8,
+      pair_count: usize,
+    );
+  }
+}
+
+#[cfg(test)]
+mod tests {
+  #[cfg(not(feature = "std"))]
+  use alloc::{vec, vec::Vec};
+
+  use super::*;
+
+  #[test]
+  fn ybr_to_rgb_u8_matches_ybr_to_rgb() {
+    for (input_max, output_max) in [(255, 255), (127, 255), (63, 63)] {
+      let input: Vec<u8> = (0..=255u32 * 255)
+        .flat_map(|i| {
+          [
+            (i * 7 % (input_max + 1)) as u8,
+            (i / 255 % (input_max + 1)) as u8,
+            (i % 255 % (input_max + 1)) as u8,
+          ]
+        })
+        .collect();
+
+      let mut output = vec![0; input.len()];
+      ybr_to_rgb_u8(&input, &mut output, input_max, output_max);
+
+      let mut in_place = input.clone();
+      ybr_to_rgb_u8_in_place(&mut in_place, input_max, output_max);
+      assert_eq!(in_place, output);
+
+      let scale = 1.0 / f64::from(input_max);
+      for (ybr, rgb) in input.chunks_exact(3).zip(output.chunks_exact(3)) {
+        let expected = ybr_to_rgb(
+          f64::from(ybr[0]) * scale,
+          f64::from(ybr[1]) * scale,
+          f64::from(ybr[2]) * scale,
+        )
+        .map(|v| (v * f64::from(output_max)).round() as u8);
+
+        assert_eq!(rgb, expected);
+      }
+    }
+  }
+
+  #[test]
+  fn upsample_ybr_422_u8_test() {
+    let input: Vec<u8> = (0..44).collect();
+    let mut output = vec![0; 66];
+
+    upsample_ybr_422_u8(&input, &mut output);
+
+    for (ybr_422, ybr) in input.chunks_exact(4).zip(output.chunks_exact(6)) {
+      assert_eq!(
+        ybr,
+        [
+          ybr_422[0], ybr_422[2], ybr_422[3], ybr_422[1], ybr_422[2],
+          ybr_422[3]
+        ]
+      );
+    }
+  }
+}
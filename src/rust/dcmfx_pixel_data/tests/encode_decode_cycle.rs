@@ -1,16 +1,23 @@
-use dcmfx_pixel_data::decode::{HighThroughputJpeg2000Decoder, JpegXlDecoder};
+use dcmfx_pixel_data::decode::{
+  HighThroughputJpeg2000Decoder, JpegBaselineDecoder, JpegXlDecoder,
+};
+use dcmfx_pixel_data::encode::{JpegBaselineEncoder, JpegXlEncodeProfile};
 use rand::rngs::SmallRng;
 use rand::{RngExt, SeedableRng};
 use rayon::prelude::*;
 
 use dcmfx_core::{
-  DataElementValue, DataSet, Rc, TransferSyntax, ValueRepresentation,
-  dictionary, transfer_syntax,
+  DataElementValue, DataSet, IodModule, Rc, RcByteSlice, TransferSyntax,
+  ValueRepresentation, dictionary, transfer_syntax,
 };
 
+use dcmfx_p10::{DataSetBuilder, DataSetP10Extensions};
 use dcmfx_pixel_data::{
-  ColorImage, ColorSpace, LookupTable, MonochromeImage, PixelDataDecodeConfig,
-  PixelDataEncodeConfig, decode, encode,
+  ColorImage, ColorImageData, ColorSpace, DataSetPixelDataExtensions,
+  LookupTable, MonochromeImage, MonochromeImageData,
+  P10PixelDataTranscodeTransformError, PixelDataDecodeConfig,
+  PixelDataEncodeConfig, PixelDataFrame, PixelDataFrameIndex,
+  PixelDataRenderer, PlanarYbrImageData, SampleStatistics, decode, encode,
   iods::{
     PaletteColorLookupTableModule,
     image_pixel_module::{
@@ -18,6 +25,11 @@ use dcmfx_pixel_data::{
       PixelRepresentation, PlanarConfiguration, SamplesPerPixel,
     },
   },
+  libjxl_thread_pool, standard_color_palettes,
+  transforms::{
+    CropRect, P10PixelDataFanOutTranscodeTransform,
+    P10PixelDataTranscodeTransform,
+  },
 };
 
 const RNG_SEED: u64 = 1023;
@@ -69,6 +81,189 @@ fn test_jpeg_baseline_8bit_encode_decode_cycle() {
   );
 }
 
+#[test]
+fn test_jpeg_baseline_8bit_libjpeg_encode_decode_cycle() {
+  test_encode_decode_cycle(
+    all_image_pixel_modules()
+      .into_iter()
+      .filter(|m| {
+        !m.photometric_interpretation().is_palette_color()
+          && !m.photometric_interpretation().is_ybr_full()
+          && m.bits_allocated() == BitsAllocated::Eight
+          && m.pixel_representation().is_unsigned()
+      })
+      .collect(),
+    &transfer_syntax::JPEG_BASELINE_8BIT,
+    encode_config(),
+    PixelDataDecodeConfig {
+      jpeg_baseline_decoder: JpegBaselineDecoder::LibJpeg8Bit,
+      ..PixelDataDecodeConfig::default()
+    },
+    0.01,
+    0.25,
+  );
+}
+
+#[test]
+fn test_jpeg_baseline_8bit_libjpeg_encoder_encode_decode_cycle() {
+  let mut encode_config = encode_config();
+  encode_config.set_jpeg_baseline_encoder(JpegBaselineEncoder::LibJpeg8Bit);
+
+  test_encode_decode_cycle(
+    all_image_pixel_modules()
+      .into_iter()
+      .filter(|m| {
+        !m.photometric_interpretation().is_palette_color()
+          && !m.photometric_interpretation().is_ybr_full()
+          && m.bits_allocated() == BitsAllocated::Eight
+          && m.pixel_representation().is_unsigned()
+      })
+      .collect(),
+    &transfer_syntax::JPEG_BASELINE_8BIT,
+    encode_config,
+    PixelDataDecodeConfig::default(),
+    0.01,
+    0.25,
+  );
+}
+
+#[test]
+fn test_planar_ybr_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::Three {
+      planar_configuration: PlanarConfiguration::Interleaved,
+    },
+    PhotometricInterpretation::YbrFull422,
+    48,
+    64,
+    BitsAllocated::Eight,
+    8,
+  )
+  .unwrap();
+
+  let original_image = create_color_image(&image_pixel_module);
+
+  let decode_config = PixelDataDecodeConfig {
+    jpeg_baseline_decoder: JpegBaselineDecoder::LibJpeg8Bit,
+    ..PixelDataDecodeConfig::default()
+  };
+
+  for transfer_syntax in [
+    &transfer_syntax::IMPLICIT_VR_LITTLE_ENDIAN,
+    &transfer_syntax::JPEG_BASELINE_8BIT,
+  ] {
+    let mut frame = encode::encode_color(
+      &original_image,
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config(),
+    )
+    .unwrap();
+
+    let planar_image = decode::decode_color_planar_ybr(
+      &mut frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    assert_eq!(planar_image.width(), 64);
+    assert_eq!(planar_image.height(), 48);
+    assert!(planar_image.is_422());
+
+    // The Y plane isn't resampled, so it matches the Y samples of an
+    // interleaved decode exactly
+    let decoded_image = decode::decode_color(
+      &mut frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    let (ColorImageData::U8 { data, .. }, PlanarYbrImageData::U8 { y, .. }) =
+      (decoded_image.data(), planar_image.data())
+    else {
+      panic!("Unexpected image data for {}", transfer_syntax.name);
+    };
+
+    assert!(
+      data.iter().step_by(3).eq(y.iter()),
+      "Y plane differs for {}",
+      transfer_syntax.name
+    );
+  }
+}
+
+#[test]
+fn test_color_luma_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::Three {
+      planar_configuration: PlanarConfiguration::Interleaved,
+    },
+    PhotometricInterpretation::YbrFull422,
+    48,
+    64,
+    BitsAllocated::Eight,
+    8,
+  )
+  .unwrap();
+
+  let original_image = create_color_image(&image_pixel_module);
+
+  let transfer_syntax = &transfer_syntax::JPEG_BASELINE_8BIT;
+
+  let mut frame = encode::encode_color(
+    &original_image,
+    &image_pixel_module,
+    transfer_syntax,
+    &encode_config(),
+  )
+  .unwrap();
+
+  for jpeg_baseline_decoder in [
+    JpegBaselineDecoder::LibJpeg8Bit,
+    JpegBaselineDecoder::ZuneJpeg,
+  ] {
+    let decode_config = PixelDataDecodeConfig {
+      jpeg_baseline_decoder,
+      ..PixelDataDecodeConfig::default()
+    };
+
+    let luma_image = decode::decode_color_luma(
+      &mut frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    assert!(!luma_image.is_monochrome1());
+
+    // The luma is decoded in the same way as for a full decode, so it matches
+    // the Y samples of a full decode exactly
+    let decoded_image = decode::decode_color(
+      &mut frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    let (ColorImageData::U8 { data, .. }, MonochromeImageData::U8(luma)) =
+      (decoded_image.data(), luma_image.data())
+    else {
+      panic!("Unexpected image data for {jpeg_baseline_decoder}");
+    };
+
+    assert!(
+      data.iter().step_by(3).eq(luma.iter()),
+      "Luma differs for {jpeg_baseline_decoder}"
+    );
+  }
+}
+
 #[test]
 fn test_jpeg_extended_12bit_encode_decode_cycle() {
   test_encode_decode_cycle(
@@ -89,6 +284,258 @@ fn test_jpeg_extended_12bit_encode_decode_cycle() {
   );
 }
 
+#[test]
+fn test_jpeg_extended_12bit_restart_interval_decode() {
+  let transfer_syntax = &transfer_syntax::JPEG_EXTENDED_12BIT;
+
+  let image_pixel_modules = [
+    (
+      SamplesPerPixel::One,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+    ),
+    (
+      SamplesPerPixel::Three {
+        planar_configuration: PlanarConfiguration::Interleaved,
+      },
+      PhotometricInterpretation::Rgb,
+    ),
+    (
+      SamplesPerPixel::Three {
+        planar_configuration: PlanarConfiguration::Interleaved,
+      },
+      PhotometricInterpretation::YbrFull422,
+    ),
+  ]
+  .map(|(samples_per_pixel, photometric_interpretation)| {
+    ImagePixelModule::new_basic(
+      samples_per_pixel,
+      photometric_interpretation,
+      100,
+      70,
+      BitsAllocated::Sixteen,
+      12,
+    )
+    .unwrap()
+  });
+
+  for image_pixel_module in image_pixel_modules {
+    for restart_interval in [1, 3] {
+      let mut encode_config = encode_config();
+      encode_config.set_jpeg_12bit_restart_interval(restart_interval);
+
+      // Check that decoding restart intervals concurrently gives the same
+      // result as decoding them on one thread
+      let decode = |thread_count| {
+        let decode_config = PixelDataDecodeConfig {
+          thread_count,
+          ..PixelDataDecodeConfig::default()
+        };
+
+        if image_pixel_module.is_monochrome() {
+          let mut encoded_frame = encode::encode_monochrome(
+            &create_monochrome_image(&image_pixel_module),
+            &image_pixel_module,
+            transfer_syntax,
+            &encode_config,
+          )
+          .unwrap();
+
+          decode::decode_monochrome(
+            &mut encoded_frame,
+            transfer_syntax,
+            &image_pixel_module,
+            &decode_config,
+          )
+          .unwrap()
+          .to_stored_values()
+        } else {
+          let mut encoded_frame = encode::encode_color(
+            &create_color_image(&image_pixel_module),
+            &image_pixel_module,
+            transfer_syntax,
+            &encode_config,
+          )
+          .unwrap();
+
+          let image = decode::decode_color(
+            &mut encoded_frame,
+            transfer_syntax,
+            &image_pixel_module,
+            &decode_config,
+          )
+          .unwrap();
+
+          match image.data() {
+            ColorImageData::U16 { data, .. } => {
+              data.iter().map(|v| i64::from(*v)).collect()
+            }
+            _ => panic!("Expected 16-bit color data"),
+          }
+        }
+      };
+
+      let expected = decode(1);
+      assert_eq!(decode(4), expected);
+      assert_eq!(decode(5), expected);
+    }
+  }
+}
+
+#[test]
+fn test_jpeg_extended_12bit_reduced_resolution_decode() {
+  let transfer_syntax = &transfer_syntax::JPEG_EXTENDED_12BIT;
+
+  let image_pixel_modules = [
+    (
+      SamplesPerPixel::One,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+    ),
+    (
+      SamplesPerPixel::Three {
+        planar_configuration: PlanarConfiguration::Interleaved,
+      },
+      PhotometricInterpretation::YbrFull422,
+    ),
+  ]
+  .map(|(samples_per_pixel, photometric_interpretation)| {
+    ImagePixelModule::new_basic(
+      samples_per_pixel,
+      photometric_interpretation,
+      100,
+      70,
+      BitsAllocated::Sixteen,
+      12,
+    )
+    .unwrap()
+  });
+
+  let mut encode_config = encode_config();
+  encode_config.set_jpeg_12bit_restart_interval(1);
+
+  for image_pixel_module in image_pixel_modules {
+    let mut encoded_frame = if image_pixel_module.is_monochrome() {
+      encode::encode_monochrome(
+        &create_monochrome_image(&image_pixel_module),
+        &image_pixel_module,
+        transfer_syntax,
+        &encode_config,
+      )
+    } else {
+      encode::encode_color(
+        &create_color_image(&image_pixel_module),
+        &image_pixel_module,
+        transfer_syntax,
+        &encode_config,
+      )
+    }
+    .unwrap();
+
+    // Reductions beyond three levels are decoded at 1:8
+    for (resolution_reduction, width, height) in [
+      (0, 70, 100),
+      (1, 35, 50),
+      (2, 18, 25),
+      (3, 9, 13),
+      (4, 9, 13),
+    ] {
+      // Check that decoding restart intervals concurrently gives the same
+      // result as decoding them on one thread
+      let mut decode = |thread_count| {
+        let decode_config = PixelDataDecodeConfig {
+          thread_count,
+          ..PixelDataDecodeConfig::default()
+        };
+
+        if image_pixel_module.is_monochrome() {
+          let image = decode::decode_monochrome_reduced(
+            &mut encoded_frame,
+            transfer_syntax,
+            &image_pixel_module,
+            &decode_config,
+            resolution_reduction,
+          )
+          .unwrap();
+
+          assert_eq!((image.width(), image.height()), (width, height));
+
+          image.to_stored_values()
+        } else {
+          let image = decode::decode_color_reduced(
+            &mut encoded_frame,
+            transfer_syntax,
+            &image_pixel_module,
+            &decode_config,
+            resolution_reduction,
+          )
+          .unwrap();
+
+          assert_eq!((image.width(), image.height()), (width, height));
+
+          match image.data() {
+            ColorImageData::U16 { data, .. } => {
+              data.iter().map(|v| i64::from(*v)).collect()
+            }
+            _ => panic!("Expected 16-bit color data"),
+          }
+        }
+      };
+
+      let expected = decode(1);
+      assert_eq!(decode(4), expected);
+    }
+  }
+}
+
+#[test]
+fn test_jpeg_extended_12bit_encode_of_noise_spanning_many_chunks() {
+  // Random 12-bit data compresses poorly, so this encodes to more than the
+  // size of the first output chunk and to many times the size of libjpeg's
+  // internal buffers
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    512,
+    512,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let image = create_monochrome_image(&image_pixel_module);
+
+  let mut encoded_frame = encode::encode_monochrome(
+    &image,
+    &image_pixel_module,
+    &transfer_syntax::JPEG_EXTENDED_12BIT,
+    &encode_config(),
+  )
+  .unwrap();
+
+  assert!(encoded_frame.len() > 512 * 512);
+
+  let decoded_image = decode::decode_monochrome(
+    &mut encoded_frame,
+    &transfer_syntax::JPEG_EXTENDED_12BIT,
+    &image_pixel_module,
+    &PixelDataDecodeConfig::default(),
+  )
+  .unwrap();
+
+  for (a, b) in decoded_image
+    .to_stored_values()
+    .iter()
+    .zip(image.to_stored_values())
+  {
+    assert!((a - b).abs() <= 2);
+  }
+}
+
 #[test]
 fn test_jpeg_ls_lossless_encode_decode_cycle() {
   test_encode_decode_cycle(
@@ -133,157 +580,3001 @@ fn test_jpeg_ls_near_lossless_encode_decode_cycle() {
 }
 
 #[test]
-fn test_jpeg_2000_lossless_only_encode_decode_cycle() {
-  test_encode_decode_cycle(
-    all_image_pixel_modules()
-      .into_iter()
-      .filter(|m| {
-        !m.photometric_interpretation().is_ybr_full_422()
-          && (2..=30).contains(&m.bits_stored())
-      })
-      .collect(),
-    &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
-    encode_config(),
-    PixelDataDecodeConfig::default(),
-    0.0,
-    0.0,
-  );
+fn test_jpeg_ls_restart_interval_encode_decode_cycle() {
+  for (restart_interval, thread_count) in [(1, 1), (1, 4), (16, 0)] {
+    let mut encode_config = encode_config();
+    encode_config.set_jpeg_ls_restart_interval(restart_interval);
+
+    let mut decode_config = PixelDataDecodeConfig::default();
+    decode_config.thread_count = thread_count;
+
+    test_encode_decode_cycle(
+      all_image_pixel_modules()
+        .into_iter()
+        .filter(|m| {
+          !m.photometric_interpretation().is_ybr_full_422()
+            && (m.bits_allocated() == BitsAllocated::Eight
+              || m.bits_allocated() == BitsAllocated::Sixteen)
+            && m.bits_stored() >= 2
+            && m.pixel_representation().is_unsigned()
+        })
+        .collect(),
+      &transfer_syntax::JPEG_LS_LOSSLESS,
+      encode_config,
+      decode_config,
+      0.0,
+      0.0,
+    );
+  }
+}
+
+#[test]
+fn test_jpeg_ls_region_decode() {
+  let monochrome_image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    256,
+    128,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let color_image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::Three {
+      planar_configuration: PlanarConfiguration::Interleaved,
+    },
+    PhotometricInterpretation::Rgb,
+    256,
+    128,
+    BitsAllocated::Eight,
+    8,
+  )
+  .unwrap();
+
+  let decode_area = CropRect {
+    left: 5,
+    top: 7,
+    width_or_right: Some(100),
+    height_or_bottom: Some(-10),
+  };
+
+  let transfer_syntax = &transfer_syntax::JPEG_LS_LOSSLESS;
+
+  for (restart_interval, thread_count) in [(0, 1), (16, 1), (16, 4)] {
+    let mut encode_config = encode_config();
+    encode_config.set_jpeg_ls_restart_interval(restart_interval);
+
+    let decode_config = PixelDataDecodeConfig {
+      thread_count,
+      ..PixelDataDecodeConfig::default()
+    };
+
+    // Check that a region decode matches a crop of the full monochrome image
+    let mut encoded_frame = encode::encode_monochrome(
+      &create_monochrome_image(&monochrome_image_pixel_module),
+      &monochrome_image_pixel_module,
+      transfer_syntax,
+      &encode_config,
+    )
+    .unwrap();
+
+    let mut expected_image = decode::decode_monochrome(
+      &mut encoded_frame,
+      transfer_syntax,
+      &monochrome_image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+    expected_image.crop(&decode_area);
+
+    let decoded_image = decode::decode_monochrome_region(
+      &mut encoded_frame,
+      transfer_syntax,
+      &monochrome_image_pixel_module,
+      &decode_config,
+      &decode_area,
+      0,
+    )
+    .unwrap();
+
+    assert_eq!(decoded_image.width(), 100);
+    assert_eq!(decoded_image.height(), 239);
+    assert_eq!(
+      decoded_image.to_stored_values(),
+      expected_image.to_stored_values()
+    );
+
+    // Check that a region decode matches a crop of the full color image
+    let mut encoded_frame = encode::encode_color(
+      &create_color_image(&color_image_pixel_module),
+      &color_image_pixel_module,
+      transfer_syntax,
+      &encode_config,
+    )
+    .unwrap();
+
+    let mut expected_image = decode::decode_color(
+      &mut encoded_frame,
+      transfer_syntax,
+      &color_image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+    expected_image.crop(&decode_area);
+
+    let decoded_image = decode::decode_color_region(
+      &mut encoded_frame,
+      transfer_syntax,
+      &color_image_pixel_module,
+      &decode_config,
+      &decode_area,
+      0,
+    )
+    .unwrap();
+
+    assert_eq!(decoded_image, expected_image);
+  }
+}
+
+#[test]
+fn test_jpeg_ls_color_encode_is_interleaved() {
+  for (bits_allocated, bits_stored, expected_interleave_mode) in [
+    (BitsAllocated::Eight, 8, 2),
+    (BitsAllocated::Sixteen, 12, 1),
+  ] {
+    let image_pixel_module = ImagePixelModule::new_basic(
+      SamplesPerPixel::Three {
+        planar_configuration: PlanarConfiguration::Interleaved,
+      },
+      PhotometricInterpretation::Rgb,
+      64,
+      32,
+      bits_allocated,
+      bits_stored,
+    )
+    .unwrap();
+
+    let encoded_frame = encode::encode_color(
+      &create_color_image(&image_pixel_module),
+      &image_pixel_module,
+      &transfer_syntax::JPEG_LS_LOSSLESS,
+      &encode_config(),
+    )
+    .unwrap();
+
+    // The frame has a single scan that holds all three components, with the
+    // interleave mode stored after their component selectors and the NEAR
+    // parameter
+    let data = encoded_frame.to_bytes();
+    let sos = data.windows(2).position(|w| w == [0xFF, 0xDA]).unwrap();
+    assert_eq!(data[sos + 4], 3);
+    assert_eq!(data[sos + 12], expected_interleave_mode);
+    assert_eq!(
+      data.windows(2).filter(|w| *w == [0xFF, 0xDA]).count(),
+      1,
+      "Expected a single scan"
+    );
+  }
+}
+
+#[test]
+fn test_jpeg_ls_encode_of_noise_spanning_many_chunks() {
+  // Random 16-bit data doesn't compress, so this encodes to several times the
+  // size of the chunks that CharLS's output is written in
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    512,
+    512,
+    BitsAllocated::Sixteen,
+    16,
+  )
+  .unwrap();
+
+  let image = create_monochrome_image(&image_pixel_module);
+
+  for restart_interval in [0, 1, 7] {
+    let mut encode_config = encode_config();
+    encode_config.set_jpeg_ls_restart_interval(restart_interval);
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &image,
+      &image_pixel_module,
+      &transfer_syntax::JPEG_LS_LOSSLESS,
+      &encode_config,
+    )
+    .unwrap();
+
+    assert!(encoded_frame.len() > 512 * 512 * 2);
+
+    let decoded_image = decode::decode_monochrome(
+      &mut encoded_frame,
+      &transfer_syntax::JPEG_LS_LOSSLESS,
+      &image_pixel_module,
+      &PixelDataDecodeConfig::default(),
+    )
+    .unwrap();
+
+    assert_eq!(decoded_image.to_stored_values(), image.to_stored_values());
+  }
+}
+
+#[test]
+fn test_jpeg_2000_lossless_only_encode_decode_cycle() {
+  for thread_count in [1, 4] {
+    let mut encode_config = encode_config();
+    encode_config.set_thread_count(thread_count);
+
+    let mut decode_config = PixelDataDecodeConfig::default();
+    decode_config.thread_count = thread_count;
+
+    test_encode_decode_cycle(
+      all_image_pixel_modules()
+        .into_iter()
+        .filter(|m| {
+          !m.photometric_interpretation().is_ybr_full_422()
+            && (2..=30).contains(&m.bits_stored())
+        })
+        .collect(),
+      &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
+      encode_config,
+      decode_config,
+      0.0,
+      0.0,
+    );
+  }
+}
+
+#[test]
+fn test_jpeg_2000_encode_decode_cycle() {
+  test_encode_decode_cycle(
+    all_image_pixel_modules()
+      .into_iter()
+      .filter(|m| {
+        (m.photometric_interpretation().is_monochrome()
+          || m.photometric_interpretation().is_rgb())
+          && (2..=30).contains(&m.bits_stored())
+      })
+      .collect(),
+    &transfer_syntax::JPEG_2000,
+    encode_config(),
+    PixelDataDecodeConfig::default(),
+    0.15,
+    0.1,
+  );
+}
+
+#[test]
+fn test_high_throughput_jpeg_2000_lossless_only_encode_decode_cycle() {
+  for decoder in [
+    HighThroughputJpeg2000Decoder::OpenJpeg,
+    HighThroughputJpeg2000Decoder::OpenJph,
+  ] {
+    let mut decode_config = PixelDataDecodeConfig::default();
+    decode_config.high_throughput_jpeg_2000_decoder = decoder;
+
+    test_encode_decode_cycle(
+      all_image_pixel_modules()
+        .into_iter()
+        .filter(|m| {
+          !m.photometric_interpretation().is_ybr_full_422()
+            && (2..=30).contains(&m.bits_stored())
+        })
+        .collect(),
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      encode_config(),
+      decode_config,
+      0.0,
+      0.0,
+    );
+  }
+}
+
+#[test]
+fn test_high_throughput_jpeg_2000_encode_decode_cycle() {
+  for decoder in [
+    HighThroughputJpeg2000Decoder::OpenJpeg,
+    HighThroughputJpeg2000Decoder::OpenJph,
+  ] {
+    let mut decode_config = PixelDataDecodeConfig::default();
+    decode_config.high_throughput_jpeg_2000_decoder = decoder;
+
+    test_encode_decode_cycle(
+      all_image_pixel_modules()
+        .into_iter()
+        .filter(|m| {
+          !m.photometric_interpretation().is_palette_color()
+            && !m.photometric_interpretation().is_ybr_full_422()
+            && (2..=30).contains(&m.bits_stored())
+        })
+        .collect(),
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000,
+      encode_config(),
+      decode_config,
+      0.02,
+      0.02,
+    );
+  }
+}
+
+#[test]
+fn test_high_throughput_jpeg_2000_reduced_resolution_decode() {
+  let mut decode_config = PixelDataDecodeConfig::default();
+  decode_config.high_throughput_jpeg_2000_decoder =
+    HighThroughputJpeg2000Decoder::OpenJph;
+
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    64,
+    32,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let mut encoded_frame = encode::encode_monochrome(
+    &create_monochrome_image(&image_pixel_module),
+    &image_pixel_module,
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+    &encode_config(),
+  )
+  .unwrap();
+
+  for (resolution_reduction, width, height) in [(0, 32, 64), (1, 16, 32)] {
+    let decoded_image = decode::decode_monochrome_reduced(
+      &mut encoded_frame,
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      &image_pixel_module,
+      &decode_config,
+      resolution_reduction,
+    )
+    .unwrap();
+
+    assert_eq!(decoded_image.width(), width);
+    assert_eq!(decoded_image.height(), height);
+  }
+}
+
+#[test]
+fn test_high_throughput_jpeg_2000_striped_decode() {
+  let decode_config = PixelDataDecodeConfig {
+    high_throughput_jpeg_2000_decoder: HighThroughputJpeg2000Decoder::OpenJph,
+    ..PixelDataDecodeConfig::default()
+  };
+
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Signed,
+    },
+    50,
+    20,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let transfer_syntax =
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY;
+
+  let mut encoded_frame = encode::encode_monochrome(
+    &create_monochrome_image(&image_pixel_module),
+    &image_pixel_module,
+    transfer_syntax,
+    &encode_config(),
+  )
+  .unwrap();
+
+  let expected_values = decode::decode_monochrome(
+    &mut encoded_frame,
+    transfer_syntax,
+    &image_pixel_module,
+    &decode_config,
+  )
+  .unwrap()
+  .to_stored_values();
+
+  // Decode in stripes of 16 rows, with a final stripe of 2 rows
+  let mut stripes = vec![];
+  decode::decode_monochrome_stripes(
+    &mut encoded_frame,
+    transfer_syntax,
+    &image_pixel_module,
+    &decode_config,
+    0,
+    16,
+    &mut |stripe, first_row| stripes.push((stripe, first_row)),
+  )
+  .unwrap();
+
+  assert_eq!(
+    stripes
+      .iter()
+      .map(|(stripe, first_row)| (stripe.width(), stripe.height(), *first_row))
+      .collect::<Vec<_>>(),
+    vec![(20, 16, 0), (20, 16, 16), (20, 16, 32), (20, 2, 48)]
+  );
+
+  let values: Vec<_> = stripes
+    .iter()
+    .flat_map(|(stripe, _)| stripe.to_stored_values())
+    .collect();
+
+  assert_eq!(values, expected_values);
+}
+
+#[test]
+fn test_jpeg_2000_striped_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Signed,
+    },
+    50,
+    20,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let transfer_syntax = &transfer_syntax::JPEG_2000_LOSSLESS_ONLY;
+  let decode_config = PixelDataDecodeConfig::default();
+
+  // A single tile is decoded in bands of 16 rows, and tiles of 32 rows are
+  // decoded a row of tiles at a time, which gives the same stripes
+  for tile_size in [0, 32] {
+    let mut encode_config = encode_config();
+    encode_config.set_jpeg_2000_tile_size(tile_size);
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &create_monochrome_image(&image_pixel_module),
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config,
+    )
+    .unwrap();
+
+    let expected_values = decode::decode_monochrome(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap()
+    .to_stored_values();
+
+    let mut stripes = vec![];
+    decode::decode_monochrome_stripes(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+      0,
+      16,
+      &mut |stripe, first_row| stripes.push((stripe, first_row)),
+    )
+    .unwrap();
+
+    assert_eq!(
+      stripes
+        .iter()
+        .map(|(stripe, first_row)| (
+          stripe.width(),
+          stripe.height(),
+          *first_row
+        ))
+        .collect::<Vec<_>>(),
+      vec![(20, 16, 0), (20, 16, 16), (20, 16, 32), (20, 2, 48)]
+    );
+
+    let values: Vec<_> = stripes
+      .iter()
+      .flat_map(|(stripe, _)| stripe.to_stored_values())
+      .collect();
+
+    assert_eq!(values, expected_values);
+  }
+}
+
+#[test]
+fn test_jpeg_2000_region_decoder() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::Three,
+    PhotometricInterpretation::Rgb,
+    96,
+    128,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let transfer_syntax = &transfer_syntax::JPEG_2000_LOSSLESS_ONLY;
+  let decode_config = PixelDataDecodeConfig::default();
+
+  let regions = [
+    (
+      CropRect {
+        left: 10,
+        top: 20,
+        width_or_right: Some(40),
+        height_or_bottom: Some(30),
+      },
+      0,
+    ),
+    (
+      CropRect {
+        left: 30,
+        top: 25,
+        width_or_right: Some(64),
+        height_or_bottom: Some(50),
+      },
+      0,
+    ),
+    (CropRect::default(), 1),
+    (
+      CropRect {
+        left: 70,
+        top: 0,
+        width_or_right: Some(58),
+        height_or_bottom: Some(96),
+      },
+      1,
+    ),
+    (CropRect::default(), 0),
+  ];
+
+  // A single tile reuses the one decoder, and multiple tiles are reopened for
+  // each region
+  for tile_size in [0, 32] {
+    let mut encode_config = encode_config();
+    encode_config.set_jpeg_2000_tile_size(tile_size);
+
+    let mut encoded_frame = encode::encode_color(
+      &create_color_image(&image_pixel_module),
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config,
+    )
+    .unwrap();
+
+    let mut region_decoder = decode::RegionDecoder::new(
+      encoded_frame.clone(),
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    for (decode_area, resolution_reduction) in &regions {
+      let expected_image = decode::decode_color_region(
+        &mut encoded_frame,
+        transfer_syntax,
+        &image_pixel_module,
+        &decode_config,
+        decode_area,
+        *resolution_reduction,
+      )
+      .unwrap();
+
+      let decoded_image = region_decoder
+        .decode_color(decode_area, *resolution_reduction)
+        .unwrap();
+
+      assert_eq!(decoded_image, expected_image);
+    }
+
+    // A region outside the image is an error that doesn't affect later
+    // decodes
+    assert!(
+      region_decoder
+        .decode_color(
+          &CropRect {
+            left: 200,
+            top: 0,
+            width_or_right: None,
+            height_or_bottom: None,
+          },
+          0,
+        )
+        .is_err()
+    );
+    assert!(region_decoder.decode_color(&CropRect::default(), 0).is_ok());
+  }
+}
+
+#[test]
+fn test_jpeg_2000_consecutive_frames_encode() {
+  let mut rng = SmallRng::seed_from_u64(RNG_SEED);
+
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    64,
+    48,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let smaller_image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    40,
+    48,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  // Encode frames of the same size one after another on this thread, with a
+  // frame of a different size part way through, and check that every frame
+  // decodes to its own content
+  for image_pixel_module in [
+    &image_pixel_module,
+    &image_pixel_module,
+    &smaller_image_pixel_module,
+    &image_pixel_module,
+  ] {
+    let width = image_pixel_module.columns();
+    let height = image_pixel_module.rows();
+
+    let data = (0..usize::from(width) * usize::from(height))
+      .map(|_| rng.random_range(0..4096))
+      .collect();
+    let original_image =
+      MonochromeImage::new_u16(width, height, data, 12, false).unwrap();
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &original_image,
+      image_pixel_module,
+      &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
+      &encode_config(),
+    )
+    .unwrap();
+
+    let decoded_image = decode::decode_monochrome(
+      &mut encoded_frame,
+      &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
+      image_pixel_module,
+      &PixelDataDecodeConfig::default(),
+    )
+    .unwrap();
+
+    assert_eq!(
+      decoded_image.to_stored_values(),
+      original_image.to_stored_values()
+    );
+  }
+}
+
+#[test]
+fn test_jpeg_2000_tiled_encode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    300,
+    230,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let original_image = create_monochrome_image(&image_pixel_module);
+
+  for transfer_syntax in [
+    &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
+    &transfer_syntax::JPEG_2000,
+  ] {
+    for packet_length_markers in [false, true] {
+      let mut encode_config = encode_config();
+      encode_config.set_jpeg_2000_tile_size(128);
+      encode_config.set_jpeg_2000_block_size(32);
+      encode_config.set_jpeg_2000_precinct_size(64);
+      encode_config.set_jpeg_2000_progression_order(
+        encode::Jpeg2000ProgressionOrder::Rpcl,
+      );
+      encode_config.set_jpeg_2000_packet_length_markers(packet_length_markers);
+
+      // Encode on one thread, and then with the tiles encoded concurrently
+      let mut encoded_frames = vec![];
+      for thread_count in [1, 4] {
+        encode_config.set_thread_count(thread_count);
+
+        encoded_frames.push(
+          encode::encode_monochrome(
+            &original_image,
+            &image_pixel_module,
+            transfer_syntax,
+            &encode_config,
+          )
+          .unwrap(),
+        );
+      }
+
+      // Concurrent encoding must give the same codestream as serial encoding
+      assert_eq!(encoded_frames[0].to_bytes(), encoded_frames[1].to_bytes());
+
+      let decoded_image = decode::decode_monochrome(
+        &mut encoded_frames[1],
+        transfer_syntax,
+        &image_pixel_module,
+        &PixelDataDecodeConfig::default(),
+      )
+      .unwrap();
+
+      if transfer_syntax == &transfer_syntax::JPEG_2000_LOSSLESS_ONLY {
+        assert_eq!(
+          decoded_image.to_stored_values(),
+          original_image.to_stored_values()
+        );
+      }
+    }
+  }
+}
+
+#[test]
+fn test_high_throughput_jpeg_2000_tiled_encode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    100,
+    90,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let transfer_syntax =
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY;
+
+  let original_image = create_monochrome_image(&image_pixel_module);
+
+  let mut encode_config = encode_config();
+  encode_config.set_jpeg_2000_tile_size(32);
+  encode_config.set_jpeg_2000_block_size(16);
+  encode_config.set_jpeg_2000_precinct_size(64);
+
+  // Encode on one thread, and then with the tiles encoded concurrently
+  let mut encoded_frames = vec![];
+  for thread_count in [1, 4] {
+    encode_config.set_thread_count(thread_count);
+
+    encoded_frames.push(
+      encode::encode_monochrome(
+        &original_image,
+        &image_pixel_module,
+        transfer_syntax,
+        &encode_config,
+      )
+      .unwrap(),
+    );
+  }
+
+  // Concurrent encoding must give the same codestream as serial encoding
+  assert_eq!(encoded_frames[0].to_bytes(), encoded_frames[1].to_bytes());
+
+  // Decode on one thread, and then with OpenJPH decoding the tiles
+  // concurrently
+  for (decoder, thread_count) in [
+    (HighThroughputJpeg2000Decoder::OpenJpeg, 1),
+    (HighThroughputJpeg2000Decoder::OpenJph, 1),
+    (HighThroughputJpeg2000Decoder::OpenJph, 4),
+  ] {
+    let decode_config = PixelDataDecodeConfig {
+      high_throughput_jpeg_2000_decoder: decoder,
+      thread_count,
+      ..PixelDataDecodeConfig::default()
+    };
+
+    let decoded_image = decode::decode_monochrome(
+      &mut encoded_frames[1],
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    assert_eq!(
+      decoded_image.to_stored_values(),
+      original_image.to_stored_values()
+    );
+  }
+}
+
+#[test]
+fn test_high_throughput_jpeg_2000_rpcl_partial_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    100,
+    90,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let transfer_syntax =
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_WITH_RPCL_OPTIONS_LOSSLESS_ONLY;
+
+  let original_image = create_monochrome_image(&image_pixel_module);
+
+  let mut encode_config = encode_config();
+  encode_config.set_jpeg_2000_tile_size(32);
+
+  // Encode on one thread, and then with the tiles encoded concurrently, which
+  // requires the TLM marker segments to be rebuilt when the tiles are joined
+  let mut encoded_frames = vec![];
+  for thread_count in [1, 4] {
+    encode_config.set_thread_count(thread_count);
+
+    encoded_frames.push(
+      encode::encode_monochrome(
+        &original_image,
+        &image_pixel_module,
+        transfer_syntax,
+        &encode_config,
+      )
+      .unwrap(),
+    );
+  }
+
+  assert_eq!(encoded_frames[0].to_bytes(), encoded_frames[1].to_bytes());
+
+  let decode_area = CropRect {
+    left: 40,
+    top: 35,
+    width_or_right: Some(20),
+    height_or_bottom: Some(30),
+  };
+
+  let mut expected_image = original_image.clone();
+  expected_image.crop(&decode_area);
+
+  let mut reduced_images = vec![];
+
+  for decoder in [
+    HighThroughputJpeg2000Decoder::OpenJpeg,
+    HighThroughputJpeg2000Decoder::OpenJph,
+  ] {
+    let decode_config = PixelDataDecodeConfig {
+      high_throughput_jpeg_2000_decoder: decoder,
+      ..PixelDataDecodeConfig::default()
+    };
+
+    // Decoding a region only reads the tiles that intersect it
+    let region_image = decode::decode_monochrome_region(
+      &mut encoded_frames[1],
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+      &decode_area,
+      0,
+    )
+    .unwrap();
+
+    assert_eq!(
+      region_image.to_stored_values(),
+      expected_image.to_stored_values()
+    );
+
+    // Decoding at a reduced resolution only reads the tile-parts for the
+    // resolution levels that are output
+    let reduced_image = decode::decode_monochrome_region(
+      &mut encoded_frames[1],
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+      &decode_area,
+      1,
+    )
+    .unwrap();
+
+    assert_eq!((reduced_image.width(), reduced_image.height()), (10, 15));
+
+    reduced_images.push(reduced_image.to_stored_values());
+  }
+
+  assert_eq!(reduced_images[0], reduced_images[1]);
+}
+
+#[test]
+fn test_high_throughput_jpeg_2000_multithreaded_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::Three {
+      planar_configuration: PlanarConfiguration::Interleaved,
+    },
+    PhotometricInterpretation::Rgb,
+    120,
+    200,
+    BitsAllocated::Eight,
+    8,
+  )
+  .unwrap();
+
+  let original_image = create_color_image(&image_pixel_module);
+
+  // Use small codeblocks so that each row of codeblocks has several to decode
+  let mut encode_config = encode_config();
+  encode_config.set_jpeg_2000_block_size(16);
+
+  for transfer_syntax in [
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000,
+  ] {
+    let mut encoded_frame = encode::encode_color(
+      &original_image,
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config,
+    )
+    .unwrap();
+
+    let mut decoded_images = vec![];
+    for thread_count in [1, 4] {
+      let decode_config = PixelDataDecodeConfig {
+        high_throughput_jpeg_2000_decoder:
+          HighThroughputJpeg2000Decoder::OpenJph,
+        thread_count,
+        ..PixelDataDecodeConfig::default()
+      };
+
+      decoded_images.push(
+        decode::decode_color(
+          &mut encoded_frame,
+          transfer_syntax,
+          &image_pixel_module,
+          &decode_config,
+        )
+        .unwrap(),
+      );
+    }
+
+    assert_eq!(decoded_images[0], decoded_images[1]);
+  }
+}
+
+#[test]
+fn test_jpeg_2000_decode_with_statistics() {
+  let mut encode_config = encode_config();
+  encode_config.set_jpeg_2000_tile_size(32);
+
+  for pixel_representation in
+    [PixelRepresentation::Unsigned, PixelRepresentation::Signed]
+  {
+    let image_pixel_module = ImagePixelModule::new_basic(
+      SamplesPerPixel::One,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation,
+      },
+      70,
+      90,
+      BitsAllocated::Sixteen,
+      12,
+    )
+    .unwrap();
+
+    let original_image = create_monochrome_image(&image_pixel_module);
+
+    for (transfer_syntax, decoder) in [
+      (
+        &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
+        HighThroughputJpeg2000Decoder::OpenJpeg,
+      ),
+      (
+        &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+        HighThroughputJpeg2000Decoder::OpenJph,
+      ),
+      (
+        &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+        HighThroughputJpeg2000Decoder::OpenJpeg,
+      ),
+    ] {
+      let mut frame = encode::encode_monochrome(
+        &original_image,
+        &image_pixel_module,
+        transfer_syntax,
+        &encode_config,
+      )
+      .unwrap();
+
+      for thread_count in [1, 4] {
+        let decode_config = PixelDataDecodeConfig {
+          high_throughput_jpeg_2000_decoder: decoder,
+          thread_count,
+          ..PixelDataDecodeConfig::default()
+        };
+
+        let (image, statistics) = decode::decode_monochrome_with_statistics(
+          &mut frame,
+          transfer_syntax,
+          &image_pixel_module,
+          &decode_config,
+          true,
+        )
+        .unwrap();
+
+        assert_eq!(image, original_image);
+        assert_eq!(statistics, SampleStatistics::from_image(&image, true));
+        assert_eq!(statistics.min_max_values(), image.min_max_values());
+      }
+    }
+  }
+}
+
+#[test]
+fn test_high_throughput_jpeg_2000_repeated_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    64,
+    48,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let transfer_syntax =
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY;
+
+  let decode_config = PixelDataDecodeConfig {
+    high_throughput_jpeg_2000_decoder: HighThroughputJpeg2000Decoder::OpenJph,
+    ..PixelDataDecodeConfig::default()
+  };
+
+  // Decode several frames with the same geometry on one thread, which reuses
+  // the same OpenJPH codestream for each of them. Alternating reduced and full
+  // resolution decodes checks that no state carries over between frames.
+  for _ in 0..3 {
+    let original_image = create_monochrome_image(&image_pixel_module);
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &original_image,
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config(),
+    )
+    .unwrap();
+
+    let reduced_image = decode::decode_monochrome_reduced(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+      1,
+    )
+    .unwrap();
+
+    assert_eq!((reduced_image.width(), reduced_image.height()), (24, 32));
+
+    let decoded_image = decode::decode_monochrome(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    assert_eq!(
+      decoded_image.to_stored_values(),
+      original_image.to_stored_values()
+    );
+  }
+}
+
+#[test]
+fn test_jpeg_2000_with_high_throughput_codeblocks_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::Three {
+      planar_configuration: PlanarConfiguration::Interleaved,
+    },
+    PhotometricInterpretation::Rgb,
+    40,
+    50,
+    BitsAllocated::Eight,
+    8,
+  )
+  .unwrap();
+
+  let original_image = create_color_image(&image_pixel_module);
+
+  // Encode HT codeblocks, then decode them as JPEG 2000 Part 1, which decodes
+  // them with OpenJPH when it's the configured decoder
+  let mut encoded_frame = encode::encode_color(
+    &original_image,
+    &image_pixel_module,
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+    &encode_config(),
+  )
+  .unwrap();
+
+  for decoder in [
+    HighThroughputJpeg2000Decoder::OpenJpeg,
+    HighThroughputJpeg2000Decoder::OpenJph,
+  ] {
+    let decode_config = PixelDataDecodeConfig {
+      high_throughput_jpeg_2000_decoder: decoder,
+      ..PixelDataDecodeConfig::default()
+    };
+
+    let decoded_image = decode::decode_color(
+      &mut encoded_frame,
+      &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    assert_eq!(decoded_image, original_image);
+  }
+}
+
+#[test]
+fn test_jpeg_2000_fragmented_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::Three {
+      planar_configuration: PlanarConfiguration::Interleaved,
+    },
+    PhotometricInterpretation::Rgb,
+    60,
+    70,
+    BitsAllocated::Eight,
+    8,
+  )
+  .unwrap();
+
+  let transfer_syntax = &transfer_syntax::JPEG_2000_LOSSLESS_ONLY;
+  let decode_config = PixelDataDecodeConfig::default();
+
+  let original_image = create_color_image(&image_pixel_module);
+
+  let mut encoded_frame = encode::encode_color(
+    &original_image,
+    &image_pixel_module,
+    transfer_syntax,
+    &encode_config(),
+  )
+  .unwrap();
+
+  let expected_planar_data = decode::decode_color_planar(
+    &mut encoded_frame,
+    transfer_syntax,
+    &image_pixel_module,
+    &decode_config,
+  )
+  .unwrap();
+
+  // Split the codestream into fragments, including one that splits the magic
+  // bytes at the start of the codestream
+  let data = encoded_frame.to_bytes().to_vec();
+  let split_points = [0, 1, 5, data.len() / 3, data.len() / 2, data.len()];
+
+  let mut fragmented_frame = PixelDataFrame::new();
+  for range in split_points.windows(2) {
+    fragmented_frame
+      .push_bytes(RcByteSlice::from_vec(data[range[0]..range[1]].to_vec()));
+  }
+
+  let decoded_image = decode::decode_color(
+    &mut fragmented_frame,
+    transfer_syntax,
+    &image_pixel_module,
+    &decode_config,
+  )
+  .unwrap();
+
+  assert_eq!(decoded_image, original_image);
+
+  let planar_data = decode::decode_color_planar(
+    &mut fragmented_frame,
+    transfer_syntax,
+    &image_pixel_module,
+    &decode_config,
+  )
+  .unwrap();
+
+  assert_eq!(planar_data, expected_planar_data);
+
+  // The frame is read from its fragments without combining them
+  assert_eq!(fragmented_frame.chunks().len(), 5);
+}
+
+#[test]
+fn test_fragmented_decode_without_combining() {
+  for (transfer_syntax, bits_allocated, bits_stored) in [
+    (
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      BitsAllocated::Sixteen,
+      16,
+    ),
+    (
+      &transfer_syntax::JPEG_EXTENDED_12BIT,
+      BitsAllocated::Sixteen,
+      12,
+    ),
+  ] {
+    let image_pixel_module = ImagePixelModule::new_basic(
+      SamplesPerPixel::One,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      60,
+      70,
+      bits_allocated,
+      bits_stored,
+    )
+    .unwrap();
+
+    let decode_config = PixelDataDecodeConfig::default();
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &create_monochrome_image(&image_pixel_module),
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config(),
+    )
+    .unwrap();
+
+    let expected_image = decode::decode_monochrome(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    // Split the data into fragments, including an empty one and one that
+    // splits the marker at the start of the data
+    let data = encoded_frame.to_bytes().to_vec();
+    let split_points = [0, 1, 1, data.len() / 3, data.len() / 2, data.len()];
+
+    let mut fragmented_frame = PixelDataFrame::new();
+    for range in split_points.windows(2) {
+      fragmented_frame
+        .push_bytes(RcByteSlice::from_vec(data[range[0]..range[1]].to_vec()));
+    }
+
+    let decoded_image = decode::decode_monochrome(
+      &mut fragmented_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    assert_eq!(decoded_image, expected_image, "{}", transfer_syntax.name);
+
+    let mut stripes = vec![];
+    decode::decode_monochrome_stripes(
+      &mut fragmented_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+      0,
+      16,
+      &mut |stripe, first_row| stripes.push((stripe, first_row)),
+    )
+    .unwrap();
+
+    assert!(!stripes.is_empty());
+
+    // The frame is read from its fragments without combining them
+    assert_eq!(
+      fragmented_frame.chunks().len(),
+      5,
+      "{}",
+      transfer_syntax.name
+    );
+  }
+}
+
+#[test]
+fn test_incremental_decode() {
+  for (transfer_syntax, bits_allocated, bits_stored) in [
+    (
+      &transfer_syntax::JPEG_EXTENDED_12BIT,
+      BitsAllocated::Sixteen,
+      12,
+    ),
+    (
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      BitsAllocated::Sixteen,
+      16,
+    ),
+  ] {
+    let image_pixel_module = ImagePixelModule::new_basic(
+      SamplesPerPixel::One,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      60,
+      70,
+      bits_allocated,
+      bits_stored,
+    )
+    .unwrap();
+
+    let decode_config = PixelDataDecodeConfig::default();
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &create_monochrome_image(&image_pixel_module),
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config(),
+    )
+    .unwrap();
+
+    let expected_image = decode::decode_monochrome(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    let data = encoded_frame.to_bytes().to_vec();
+
+    // Push the data in small pieces so that the decoder suspends regularly
+    let mut decoder = decode::IncrementalDecoder::new(
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+    for piece in data.chunks(7) {
+      decoder.push(RcByteSlice::from_vec(piece.to_vec())).unwrap();
+    }
+
+    assert_eq!(
+      decoder.finish_monochrome().unwrap(),
+      expected_image,
+      "{}",
+      transfer_syntax.name
+    );
+
+    // Data that ends early is an error for the decoders that decode as data
+    // arrives. OpenJPH decodes whatever part of a truncated codestream is
+    // present, so HTJ2K isn't checked.
+    if transfer_syntax != &transfer_syntax::JPEG_EXTENDED_12BIT {
+      continue;
+    }
+
+    let mut decoder = decode::IncrementalDecoder::new(
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+    decoder
+      .push(RcByteSlice::from_vec(data[..data.len() / 2].to_vec()))
+      .unwrap();
+
+    assert!(
+      decoder.finish_monochrome().is_err(),
+      "{}",
+      transfer_syntax.name
+    );
+  }
+}
+
+#[test]
+fn test_jpeg_2000_region_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    256,
+    128,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let decode_area = CropRect {
+    left: 5,
+    top: 7,
+    width_or_right: Some(100),
+    height_or_bottom: Some(-10),
+  };
+
+  for (transfer_syntax, decoder) in [
+    (
+      &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
+      HighThroughputJpeg2000Decoder::OpenJpeg,
+    ),
+    (
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      HighThroughputJpeg2000Decoder::OpenJpeg,
+    ),
+    (
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      HighThroughputJpeg2000Decoder::OpenJph,
+    ),
+  ] {
+    let decode_config = PixelDataDecodeConfig {
+      high_throughput_jpeg_2000_decoder: decoder,
+      ..PixelDataDecodeConfig::default()
+    };
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &create_monochrome_image(&image_pixel_module),
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config(),
+    )
+    .unwrap();
+
+    let mut expected_image = decode::decode_monochrome(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+    expected_image.crop(&decode_area);
+
+    // Check that a full resolution region decode matches a crop of the full
+    // image
+    let decoded_image = decode::decode_monochrome_region(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+      &decode_area,
+      0,
+    )
+    .unwrap();
+
+    assert_eq!(decoded_image.width(), 100);
+    assert_eq!(decoded_image.height(), 239);
+    assert_eq!(
+      decoded_image.to_stored_values(),
+      expected_image.to_stored_values()
+    );
+
+    // Check the dimensions of a reduced resolution region decode
+    let decoded_image = decode::decode_monochrome_region(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+      &decode_area,
+      1,
+    )
+    .unwrap();
+
+    assert_eq!(decoded_image.width(), 50);
+    assert_eq!(decoded_image.height(), 119);
+  }
+}
+
+#[test]
+fn test_jpeg_2000_packet_length_markers_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    512,
+    384,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let image = create_monochrome_image(&image_pixel_module);
+
+  let decode_area = CropRect {
+    left: 300,
+    top: 40,
+    width_or_right: Some(90),
+    height_or_bottom: Some(200),
+  };
+
+  for transfer_syntax in [
+    &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
+    &transfer_syntax::JPEG_2000,
+  ] {
+    let decode_config = PixelDataDecodeConfig::default();
+
+    let mut encoded_frames = [false, true].map(|packet_length_markers| {
+      let mut encode_config = encode_config();
+      encode_config.set_jpeg_2000_packet_length_markers(packet_length_markers);
+
+      encode::encode_monochrome(
+        &image,
+        &image_pixel_module,
+        transfer_syntax,
+        &encode_config,
+      )
+      .unwrap()
+    });
+
+    // Check that the TLM marker is in the main header, and that a PLT marker
+    // follows the SOT marker segment
+    let data = encoded_frames[1].to_bytes().to_vec();
+    let sot = data.windows(2).position(|w| w == [0xFF, 0x90]).unwrap();
+    assert!(data[..sot].windows(2).any(|w| w == [0xFF, 0x55]));
+    assert_eq!(data[sot + 12..sot + 14], [0xFF, 0x58]);
+
+    let [without_markers, with_markers] = &mut encoded_frames;
+
+    for (decode_area, resolution_reduction) in [
+      (&decode_area, 0),
+      (&decode_area, 1),
+      (&CropRect::default(), 2),
+    ] {
+      let expected_image = decode::decode_monochrome_region(
+        without_markers,
+        transfer_syntax,
+        &image_pixel_module,
+        &decode_config,
+        decode_area,
+        resolution_reduction,
+      )
+      .unwrap();
+
+      let decoded_image = decode::decode_monochrome_region(
+        with_markers,
+        transfer_syntax,
+        &image_pixel_module,
+        &decode_config,
+        decode_area,
+        resolution_reduction,
+      )
+      .unwrap();
+
+      assert_eq!(decoded_image.width(), expected_image.width());
+      assert_eq!(decoded_image.height(), expected_image.height());
+      assert_eq!(
+        decoded_image.to_stored_values(),
+        expected_image.to_stored_values()
+      );
+    }
+  }
+}
+
+#[test]
+fn test_jpeg_2000_quality_layers_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    256,
+    192,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let image = create_monochrome_image(&image_pixel_module);
+  let original_values = image.to_stored_values();
+
+  // The mean absolute difference from the original image
+  let mean_error = |decoded_image: &MonochromeImage| {
+    decoded_image
+      .to_stored_values()
+      .iter()
+      .zip(original_values.iter())
+      .map(|(a, b)| (a - b).abs() as f64)
+      .sum::<f64>()
+      / original_values.len() as f64
+  };
+
+  // The final 95 quality layer of the lossy encode is left out because it
+  // isn't lower than the encode's quality of 90
+  for (transfer_syntax, quality_layers) in [
+    (&transfer_syntax::JPEG_2000_LOSSLESS_ONLY, vec![60, 20]),
+    (&transfer_syntax::JPEG_2000, vec![20, 60, 95]),
+  ] {
+    let mut encode_config = encode_config();
+    encode_config.set_quality(90);
+    encode_config.set_jpeg_2000_quality_layers(&quality_layers);
+    assert_eq!(encode_config.jpeg_2000_quality_layers()[..2], [20, 60]);
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &image,
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config,
+    )
+    .unwrap();
+
+    // Check the number of layers in the COD marker segment
+    let data = encoded_frame.to_bytes().to_vec();
+    let cod = data.windows(2).position(|w| w == [0xFF, 0x52]).unwrap();
+    assert_eq!(data[cod + 6..cod + 8], [0, 3]);
+
+    // Decoding more quality layers must reduce the error
+    let mut errors = vec![];
+    for quality_layers in [1, 2, 0] {
+      let decode_config = PixelDataDecodeConfig {
+        jpeg_2000_quality_layers: quality_layers,
+        ..PixelDataDecodeConfig::default()
+      };
+
+      let decoded_image = decode::decode_monochrome(
+        &mut encoded_frame,
+        transfer_syntax,
+        &image_pixel_module,
+        &decode_config,
+      )
+      .unwrap();
+
+      errors.push(mean_error(&decoded_image));
+    }
+
+    assert!(errors[0] > errors[1]);
+    assert!(errors[1] > errors[2]);
+
+    if transfer_syntax == &transfer_syntax::JPEG_2000_LOSSLESS_ONLY {
+      assert_eq!(errors[2], 0.0);
+    }
+  }
+}
+
+#[test]
+fn test_jpeg_2000_coding_passes_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    256,
+    192,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let image = create_monochrome_image(&image_pixel_module);
+  let original_values = image.to_stored_values();
+
+  // The mean absolute difference from the original image
+  let mean_error = |decoded_image: &MonochromeImage| {
+    decoded_image
+      .to_stored_values()
+      .iter()
+      .zip(original_values.iter())
+      .map(|(a, b)| (a - b).abs() as f64)
+      .sum::<f64>()
+      / original_values.len() as f64
+  };
+
+  for (transfer_syntax, high_throughput_jpeg_2000_decoder) in [
+    (
+      &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
+      HighThroughputJpeg2000Decoder::OpenJph,
+    ),
+    (
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      HighThroughputJpeg2000Decoder::OpenJpeg,
+    ),
+    (
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      HighThroughputJpeg2000Decoder::OpenJph,
+    ),
+  ] {
+    let mut encoded_frame = encode::encode_monochrome(
+      &image,
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config(),
+    )
+    .unwrap();
+
+    let mut errors = vec![];
+    for coding_passes in [1, 4, 0] {
+      let decode_config = PixelDataDecodeConfig {
+        high_throughput_jpeg_2000_decoder,
+        jpeg_2000_coding_passes: coding_passes,
+        ..PixelDataDecodeConfig::default()
+      };
+
+      let decoded_image = decode::decode_monochrome(
+        &mut encoded_frame,
+        transfer_syntax,
+        &image_pixel_module,
+        &decode_config,
+      )
+      .unwrap();
+
+      errors.push(mean_error(&decoded_image));
+    }
+
+    // Decoding all coding passes is lossless
+    assert_eq!(errors[2], 0.0);
+
+    // Part 1 codestreams have many coding passes per code-block, so decoding
+    // fewer of them must increase the error. Lossless High-Throughput
+    // codestreams can have only a cleanup pass, so aren't checked for this.
+    if transfer_syntax == &transfer_syntax::JPEG_2000_LOSSLESS_ONLY {
+      assert!(errors[0] > errors[1]);
+      assert!(errors[1] > errors[2]);
+    }
+  }
+}
+
+#[test]
+fn test_jpeg_xl_lossless_encode_decode_cycle() {
+  for jpeg_xl_decoder in [JpegXlDecoder::LibJxl, JpegXlDecoder::JxlOxide] {
+    let mut decode_config = PixelDataDecodeConfig::default();
+    decode_config.jpeg_xl_decoder = jpeg_xl_decoder;
+
+    test_encode_decode_cycle(
+      all_image_pixel_modules()
+        .into_iter()
+        .filter(|m| {
+          (m.photometric_interpretation().is_monochrome()
+            || m.photometric_interpretation().is_rgb())
+            && (m.bits_allocated() == BitsAllocated::Eight
+              || m.bits_allocated() == BitsAllocated::Sixteen)
+            && m.pixel_representation().is_unsigned()
+        })
+        .collect(),
+      &transfer_syntax::JPEG_XL_LOSSLESS,
+      encode_config(),
+      decode_config,
+      0.0,
+      0.0,
+    );
+  }
+}
+
+#[test]
+fn test_jpeg_xl_fast_lossless_encode_decode_cycle() {
+  let mut encode_config = encode_config();
+  encode_config.set_effort(9);
+  encode_config.set_jpeg_xl_fast_lossless(true);
+
+  test_encode_decode_cycle(
+    all_image_pixel_modules()
+      .into_iter()
+      .filter(|m| {
+        (m.photometric_interpretation().is_monochrome()
+          || m.photometric_interpretation().is_rgb())
+          && (m.bits_allocated() == BitsAllocated::Eight
+            || m.bits_allocated() == BitsAllocated::Sixteen)
+          && m.pixel_representation().is_unsigned()
+      })
+      .collect(),
+    &transfer_syntax::JPEG_XL_LOSSLESS,
+    encode_config,
+    PixelDataDecodeConfig::default(),
+    0.0,
+    0.0,
+  );
+}
+
+#[test]
+fn test_jpeg_xl_encode_profiles_encode_decode_cycle() {
+  for profile in [
+    JpegXlEncodeProfile::FastDecode,
+    JpegXlEncodeProfile::MaxRatio,
+    JpegXlEncodeProfile::Medical,
+  ] {
+    let mut encode_config = encode_config();
+    encode_config.set_jpeg_xl_encode_profile(profile);
+
+    for (transfer_syntax, max_error) in [
+      (&transfer_syntax::JPEG_XL_LOSSLESS, 0.0),
+      (&transfer_syntax::JPEG_XL, 0.05),
+    ] {
+      test_encode_decode_cycle(
+        all_image_pixel_modules()
+          .into_iter()
+          .filter(|m| {
+            (m.photometric_interpretation().is_monochrome()
+              || m.photometric_interpretation().is_rgb())
+              && (m.bits_allocated() == BitsAllocated::Eight
+                || m.bits_allocated() == BitsAllocated::Sixteen)
+              && m.pixel_representation().is_unsigned()
+          })
+          .collect(),
+        transfer_syntax,
+        encode_config,
+        PixelDataDecodeConfig::default(),
+        max_error,
+        max_error,
+      );
+    }
+  }
+}
+
+#[test]
+fn test_jpeg_xl_preview_decode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    256,
+    192,
+    BitsAllocated::Eight,
+    8,
+  )
+  .unwrap();
+
+  let image = create_monochrome_image(&image_pixel_module);
+
+  for profile in [
+    JpegXlEncodeProfile::Balanced,
+    JpegXlEncodeProfile::FastDecode,
+  ] {
+    let mut encode_config = PixelDataEncodeConfig::default();
+    encode_config.set_quality(50);
+    encode_config.set_jpeg_xl_encode_profile(profile);
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &image,
+      &image_pixel_module,
+      &transfer_syntax::JPEG_XL,
+      &encode_config,
+    )
+    .unwrap();
+
+    let mut decoded_values = vec![];
+    for jpeg_xl_preview in [false, true] {
+      let decode_config = PixelDataDecodeConfig {
+        jpeg_xl_preview,
+        ..PixelDataDecodeConfig::default()
+      };
+
+      let decoded_image = decode::decode_monochrome(
+        &mut encoded_frame,
+        &transfer_syntax::JPEG_XL,
+        &image_pixel_module,
+        &decode_config,
+      )
+      .unwrap();
+
+      assert_eq!(decoded_image.width(), 256);
+      assert_eq!(decoded_image.height(), 192);
+
+      decoded_values.push(decoded_image.to_stored_values());
+    }
+
+    // Skipping the restoration filters changes the decoded image, except for
+    // data encoded without them
+    if profile == JpegXlEncodeProfile::FastDecode {
+      assert_eq!(decoded_values[0], decoded_values[1]);
+    } else {
+      assert_ne!(decoded_values[0], decoded_values[1]);
+    }
+  }
+}
+
+#[test]
+fn test_jpeg_xl_signed_and_32_bit_encode_decode_cycle() {
+  let decode_config = PixelDataDecodeConfig {
+    jpeg_xl_decoder: JpegXlDecoder::LibJxl,
+    ..PixelDataDecodeConfig::default()
+  };
+
+  for (transfer_syntax, max_error) in [
+    (&transfer_syntax::JPEG_XL_LOSSLESS, 0.0),
+    (&transfer_syntax::JPEG_XL, 0.05),
+  ] {
+    test_encode_decode_cycle(
+      all_image_pixel_modules()
+        .into_iter()
+        .filter(|m| {
+          m.photometric_interpretation().is_monochrome()
+            && (m.pixel_representation().is_signed()
+              || m.bits_allocated() == BitsAllocated::ThirtyTwo)
+            && m.bits_allocated() != BitsAllocated::One
+            && m.bits_stored() <= 16
+        })
+        .collect(),
+      transfer_syntax,
+      encode_config(),
+      decode_config,
+      max_error,
+      max_error,
+    );
+  }
+}
+
+#[test]
+fn test_jpeg_xl_lossless_encode_of_bits_stored() {
+  let transfer_syntax = &transfer_syntax::JPEG_XL_LOSSLESS;
+
+  let image_pixel_module = |bits_stored| {
+    ImagePixelModule::new_basic(
+      SamplesPerPixel::One,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      256,
+      256,
+      BitsAllocated::Sixteen,
+      bits_stored,
+    )
+    .unwrap()
+  };
+
+  // 12-bit data in 16-bit samples, which is encoded once with only its 12 bits
+  // stored, and once with all 16 bits
+  let image = create_monochrome_image(&image_pixel_module(12));
+
+  let decode_config = PixelDataDecodeConfig {
+    jpeg_xl_decoder: JpegXlDecoder::LibJxl,
+    ..PixelDataDecodeConfig::default()
+  };
+
+  let mut encoded_sizes = vec![];
+
+  for bits_stored in [12, 16] {
+    let image_pixel_module = image_pixel_module(bits_stored);
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &image,
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config(),
+    )
+    .unwrap();
+
+    encoded_sizes.push(encoded_frame.len());
+
+    let decoded_image = decode::decode_monochrome(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    assert_eq!(decoded_image.to_stored_values(), image.to_stored_values());
+  }
+
+  assert!(encoded_sizes[0] < encoded_sizes[1]);
+}
+
+#[test]
+fn test_jpeg_xl_lossless_encode_decode_cycle_with_thread_pool() {
+  struct RayonThreadPool;
+
+  impl libjxl_thread_pool::ThreadPool for RayonThreadPool {
+    fn thread_count(&self) -> usize {
+      rayon::current_num_threads()
+    }
+
+    fn run(
+      &self,
+      range: core::ops::Range<u32>,
+      task: &(dyn Fn(u32, usize) + Sync),
+    ) {
+      range
+        .into_par_iter()
+        .for_each(|value| task(value, rayon::current_thread_index().unwrap()));
+    }
+  }
+
+  libjxl_thread_pool::set_thread_pool(Some(std::sync::Arc::new(
+    RayonThreadPool,
+  )));
+
+  let decode_config = PixelDataDecodeConfig {
+    jpeg_xl_decoder: JpegXlDecoder::LibJxl,
+    ..PixelDataDecodeConfig::default()
+  };
+
+  test_encode_decode_cycle(
+    all_image_pixel_modules()
+      .into_iter()
+      .filter(|m| {
+        (m.photometric_interpretation().is_monochrome()
+          || m.photometric_interpretation().is_rgb())
+          && m.bits_allocated() == BitsAllocated::Eight
+          && m.pixel_representation().is_unsigned()
+      })
+      .collect(),
+    &transfer_syntax::JPEG_XL_LOSSLESS,
+    encode_config(),
+    decode_config,
+    0.0,
+    0.0,
+  );
+
+  libjxl_thread_pool::set_thread_pool(None);
+}
+
+#[test]
+fn test_jpeg_xl_encode_decode_cycle() {
+  for jpeg_xl_decoder in [JpegXlDecoder::LibJxl, JpegXlDecoder::JxlOxide] {
+    let mut decode_config = PixelDataDecodeConfig::default();
+    decode_config.jpeg_xl_decoder = jpeg_xl_decoder;
+
+    test_encode_decode_cycle(
+      all_image_pixel_modules()
+        .into_iter()
+        .filter(|m| {
+          (m.photometric_interpretation().is_monochrome()
+            || m.photometric_interpretation().is_rgb())
+            && (m.bits_allocated() == BitsAllocated::Eight
+              || m.bits_allocated() == BitsAllocated::Sixteen)
+            && m.pixel_representation().is_unsigned()
+        })
+        .collect(),
+      &transfer_syntax::JPEG_XL,
+      encode_config(),
+      decode_config,
+      0.05,
+      0.05,
+    );
+  }
+}
+
+#[test]
+fn test_jpeg_xl_progressive_decode() {
+  let transfer_syntax = &transfer_syntax::JPEG_XL;
+
+  // Signed samples are decoded through a separate buffer when progressive
+  for (pixel_representation, bits_allocated, bits_stored) in [
+    (PixelRepresentation::Unsigned, BitsAllocated::Eight, 8),
+    (PixelRepresentation::Signed, BitsAllocated::Sixteen, 12),
+  ] {
+    let image_pixel_module = ImagePixelModule::new_basic(
+      SamplesPerPixel::One,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation,
+      },
+      600,
+      700,
+      bits_allocated,
+      bits_stored,
+    )
+    .unwrap();
+
+    let mut encode_config = encode_config();
+    encode_config.set_jpeg_xl_progressive(true);
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &create_monochrome_image(&image_pixel_module),
+      &image_pixel_module,
+      transfer_syntax,
+      &encode_config,
+    )
+    .unwrap();
+
+    let decode_config = PixelDataDecodeConfig::default();
+
+    let expected_image = decode::decode_monochrome(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+    )
+    .unwrap();
+
+    let mut previews = vec![];
+    let decoded_image = decode::decode_monochrome_progressive(
+      &mut encoded_frame,
+      transfer_syntax,
+      &image_pixel_module,
+      &decode_config,
+      &mut |preview| previews.push(preview),
+    )
+    .unwrap();
+
+    assert_eq!(decoded_image, expected_image);
+
+    // A full resolution preview is made from the DC pass
+    assert_eq!(previews.len(), 1);
+    assert_eq!(previews[0].width(), expected_image.width());
+    assert_eq!(previews[0].height(), expected_image.height());
+    assert_ne!(previews[0], expected_image);
+  }
+}
+
+#[test]
+fn test_jpeg_xl_center_first_region_decode() {
+  let transfer_syntax = &transfer_syntax::JPEG_XL;
+  let decode_config = PixelDataDecodeConfig::default();
+
+  let decode_area = CropRect {
+    left: 736,
+    top: 736,
+    width_or_right: Some(64),
+    height_or_bottom: Some(64),
+  };
+
+  for (samples_per_pixel, photometric_interpretation) in [
+    (
+      SamplesPerPixel::One,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+    ),
+    (
+      SamplesPerPixel::Three {
+        planar_configuration: PlanarConfiguration::Interleaved,
+      },
+      PhotometricInterpretation::Rgb,
+    ),
+  ] {
+    let image_pixel_module = ImagePixelModule::new_basic(
+      samples_per_pixel,
+      photometric_interpretation,
+      1536,
+      1536,
+      BitsAllocated::Eight,
+      8,
+    )
+    .unwrap();
+
+    for center_first in [false, true] {
+      let mut encode_config = encode_config();
+      encode_config.set_jpeg_xl_center_first(center_first);
+
+      let encoded_image_pixel_module = encode::encode_image_pixel_module(
+        image_pixel_module.clone(),
+        transfer_syntax,
+        &encode_config,
+      )
+      .unwrap();
+
+      let mut encoded_frame = if image_pixel_module.is_monochrome() {
+        encode::encode_monochrome(
+          &create_monochrome_image(&image_pixel_module),
+          &encoded_image_pixel_module,
+          transfer_syntax,
+          &encode_config,
+        )
+      } else {
+        encode::encode_color(
+          &create_color_image(&image_pixel_module),
+          &encoded_image_pixel_module,
+          transfer_syntax,
+          &encode_config,
+        )
+      }
+      .unwrap();
+
+      // Keep only the first quarter of the data, which includes the groups
+      // in the middle of the image when they're stored centre-first
+      let data = encoded_frame.to_bytes().to_vec();
+      let mut truncated_frame =
+        PixelDataFrame::new_from_bytes(data[..data.len() / 4].to_vec());
+
+      if image_pixel_module.is_monochrome() {
+        let mut expected_image = decode::decode_monochrome(
+          &mut encoded_frame,
+          transfer_syntax,
+          &encoded_image_pixel_module,
+          &decode_config,
+        )
+        .unwrap();
+        expected_image.crop(&decode_area);
+
+        let decoded_image = decode::decode_monochrome_region(
+          &mut truncated_frame,
+          transfer_syntax,
+          &encoded_image_pixel_module,
+          &decode_config,
+          &decode_area,
+          0,
+        );
+
+        if center_first {
+          let decoded_image = decoded_image.unwrap();
+          assert_eq!(decoded_image.width(), 64);
+          assert_eq!(decoded_image.height(), 64);
+          assert_eq!(
+            decoded_image.to_stored_values(),
+            expected_image.to_stored_values()
+          );
+        } else {
+          assert!(decoded_image.is_err());
+        }
+      } else {
+        let mut expected_image = decode::decode_color(
+          &mut encoded_frame,
+          transfer_syntax,
+          &encoded_image_pixel_module,
+          &decode_config,
+        )
+        .unwrap();
+        expected_image.crop(&decode_area);
+
+        let decoded_image = decode::decode_color_region(
+          &mut truncated_frame,
+          transfer_syntax,
+          &encoded_image_pixel_module,
+          &decode_config,
+          &decode_area,
+          0,
+        );
+
+        if center_first {
+          assert_eq!(decoded_image.unwrap(), expected_image);
+        } else {
+          assert!(decoded_image.is_err());
+        }
+      }
+    }
+  }
+}
+
+#[test]
+fn test_jpeg_xl_striped_decode() {
+  let decode_config = PixelDataDecodeConfig::default();
+
+  for (transfer_syntax, samples_per_pixel, photometric_interpretation) in [
+    (
+      &transfer_syntax::JPEG_XL_LOSSLESS,
+      SamplesPerPixel::One,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+    ),
+    (
+      &transfer_syntax::JPEG_XL,
+      SamplesPerPixel::Three {
+        planar_configuration: PlanarConfiguration::Interleaved,
+      },
+      PhotometricInterpretation::Rgb,
+    ),
+  ] {
+    let image_pixel_module = ImagePixelModule::new_basic(
+      samples_per_pixel,
+      photometric_interpretation,
+      2100,
+      1024,
+      BitsAllocated::Sixteen,
+      12,
+    )
+    .unwrap();
+
+    let encoded_image_pixel_module = encode::encode_image_pixel_module(
+      image_pixel_module.clone(),
+      transfer_syntax,
+      &encode_config(),
+    )
+    .unwrap();
+
+    // Decode in stripes of 256 rows, with a final stripe of 52 rows
+    let expected_stripes: Vec<_> = (0..9)
+      .map(|i| (1024, if i == 8 { 52 } else { 256 }, i * 256))
+      .collect();
+
+    if image_pixel_module.is_monochrome() {
+      let mut encoded_frame = encode::encode_monochrome(
+        &create_monochrome_image(&image_pixel_module),
+        &encoded_image_pixel_module,
+        transfer_syntax,
+        &encode_config(),
+      )
+      .unwrap();
+
+      let expected_values = decode::decode_monochrome(
+        &mut encoded_frame,
+        transfer_syntax,
+        &encoded_image_pixel_module,
+        &decode_config,
+      )
+      .unwrap()
+      .to_stored_values();
+
+      let mut stripes = vec![];
+      decode::decode_monochrome_stripes(
+        &mut encoded_frame,
+        transfer_syntax,
+        &encoded_image_pixel_module,
+        &decode_config,
+        0,
+        256,
+        &mut |stripe, first_row| stripes.push((stripe, first_row)),
+      )
+      .unwrap();
+
+      assert_eq!(
+        stripes
+          .iter()
+          .map(|(stripe, first_row)| (
+            stripe.width(),
+            stripe.height(),
+            *first_row
+          ))
+          .collect::<Vec<_>>(),
+        expected_stripes
+      );
+
+      let values: Vec<_> = stripes
+        .iter()
+        .flat_map(|(stripe, _)| stripe.to_stored_values())
+        .collect();
+
+      assert_eq!(values, expected_values);
+    } else {
+      let mut encoded_frame = encode::encode_color(
+        &create_color_image(&image_pixel_module),
+        &encoded_image_pixel_module,
+        transfer_syntax,
+        &encode_config(),
+      )
+      .unwrap();
+
+      let expected_image = decode::decode_color(
+        &mut encoded_frame,
+        transfer_syntax,
+        &encoded_image_pixel_module,
+        &decode_config,
+      )
+      .unwrap();
+
+      let mut stripes = vec![];
+      decode::decode_color_stripes(
+        &mut encoded_frame,
+        transfer_syntax,
+        &encoded_image_pixel_module,
+        &decode_config,
+        0,
+        256,
+        &mut |stripe, first_row| stripes.push((stripe, first_row)),
+      )
+      .unwrap();
+
+      assert_eq!(
+        stripes
+          .iter()
+          .map(|(stripe, first_row)| (
+            stripe.width(),
+            stripe.height(),
+            *first_row
+          ))
+          .collect::<Vec<_>>(),
+        expected_stripes
+      );
+
+      for (stripe, first_row) in stripes {
+        let mut expected_stripe = expected_image.clone();
+        expected_stripe.crop(&CropRect {
+          left: 0,
+          top: first_row,
+          width_or_right: None,
+          height_or_bottom: Some(stripe.height().into()),
+        });
+
+        assert_eq!(stripe, expected_stripe);
+      }
+    }
+  }
+}
+
+#[test]
+fn test_jpeg_xl_render_frame() {
+  let transfer_syntax = &transfer_syntax::JPEG_XL_LOSSLESS;
+
+  for (photometric_interpretation, bits_allocated, pixel_representation) in [
+    ("MONOCHROME2", 8, 0),
+    ("MONOCHROME1", 8, 0),
+    ("MONOCHROME2", 16, 0),
+    ("MONOCHROME1", 16, 0),
+    ("MONOCHROME2", 16, 1),
+    ("MONOCHROME1", 16, 1),
+  ] {
+    let mut data_set = DataSet::new();
+    data_set
+      .insert_int_value(&dictionary::SAMPLES_PER_PIXEL, &[1])
+      .unwrap();
+    data_set
+      .insert_string_value(
+        &dictionary::PHOTOMETRIC_INTERPRETATION,
+        &[photometric_interpretation],
+      )
+      .unwrap();
+    data_set
+      .insert_int_value(&dictionary::ROWS, &[300])
+      .unwrap();
+    data_set
+      .insert_int_value(&dictionary::COLUMNS, &[270])
+      .unwrap();
+    for item in [&dictionary::BITS_ALLOCATED, &dictionary::BITS_STORED] {
+      data_set.insert_int_value(item, &[bits_allocated]).unwrap();
+    }
+    data_set
+      .insert_int_value(&dictionary::HIGH_BIT, &[bits_allocated - 1])
+      .unwrap();
+    data_set
+      .insert_int_value(
+        &dictionary::PIXEL_REPRESENTATION,
+        &[pixel_representation],
+      )
+      .unwrap();
+    data_set
+      .insert_float_value(&dictionary::WINDOW_CENTER, &[100.0])
+      .unwrap();
+    data_set
+      .insert_float_value(&dictionary::WINDOW_WIDTH, &[150.0])
+      .unwrap();
+
+    let mut renderer = PixelDataRenderer::from_data_set(&data_set).unwrap();
+    renderer.transfer_syntax = transfer_syntax;
+
+    let mut encoded_frame = encode::encode_monochrome(
+      &create_monochrome_image(&renderer.image_pixel_module),
+      &renderer.image_pixel_module,
+      transfer_syntax,
+      &encode_config(),
+    )
+    .unwrap();
+
+    for decode_area in [
+      None,
+      Some(CropRect {
+        left: 30,
+        top: 270,
+        width_or_right: Some(200),
+        height_or_bottom: None,
+      }),
+    ] {
+      renderer.decode_area = decode_area;
+
+      for color_palette in [None, Some(&standard_color_palettes::HOT_IRON)] {
+        let expected_image = renderer.render_monochrome_image(
+          &renderer
+            .decode_monochrome_frame(&mut encoded_frame)
+            .unwrap(),
+          color_palette,
+        );
+
+        assert_eq!(
+          renderer
+            .render_frame(&mut encoded_frame, color_palette)
+            .unwrap(),
+          expected_image,
+          "{photometric_interpretation} {bits_allocated} \
+           {pixel_representation}"
+        );
+      }
+    }
+  }
+}
+
+#[test]
+fn test_monochrome_lut_render_frame() {
+  for (transfer_syntax, decoder) in [
+    (
+      &transfer_syntax::JPEG_LS_LOSSLESS,
+      HighThroughputJpeg2000Decoder::OpenJph,
+    ),
+    (
+      &transfer_syntax::JPEG_2000_LOSSLESS_ONLY,
+      HighThroughputJpeg2000Decoder::OpenJpeg,
+    ),
+    (
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      HighThroughputJpeg2000Decoder::OpenJpeg,
+    ),
+    (
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      HighThroughputJpeg2000Decoder::OpenJph,
+    ),
+  ] {
+    for (photometric_interpretation, bits_allocated, pixel_representation) in [
+      ("MONOCHROME2", 8, 0),
+      ("MONOCHROME1", 8, 0),
+      ("MONOCHROME2", 16, 0),
+      ("MONOCHROME1", 16, 0),
+      ("MONOCHROME2", 16, 1),
+      ("MONOCHROME1", 16, 1),
+    ] {
+      // JPEG-LS doesn't support signed data
+      if transfer_syntax == &transfer_syntax::JPEG_LS_LOSSLESS
+        && pixel_representation == 1
+      {
+        continue;
+      }
+
+      let mut data_set = DataSet::new();
+      data_set
+        .insert_int_value(&dictionary::SAMPLES_PER_PIXEL, &[1])
+        .unwrap();
+      data_set
+        .insert_string_value(
+          &dictionary::PHOTOMETRIC_INTERPRETATION,
+          &[photometric_interpretation],
+        )
+        .unwrap();
+      data_set
+        .insert_int_value(&dictionary::ROWS, &[300])
+        .unwrap();
+      data_set
+        .insert_int_value(&dictionary::COLUMNS, &[270])
+        .unwrap();
+      for item in [&dictionary::BITS_ALLOCATED, &dictionary::BITS_STORED] {
+        data_set.insert_int_value(item, &[bits_allocated]).unwrap();
+      }
+      data_set
+        .insert_int_value(&dictionary::HIGH_BIT, &[bits_allocated - 1])
+        .unwrap();
+      data_set
+        .insert_int_value(
+          &dictionary::PIXEL_REPRESENTATION,
+          &[pixel_representation],
+        )
+        .unwrap();
+      data_set
+        .insert_float_value(&dictionary::WINDOW_CENTER, &[100.0])
+        .unwrap();
+      data_set
+        .insert_float_value(&dictionary::WINDOW_WIDTH, &[150.0])
+        .unwrap();
+
+      let mut renderer = PixelDataRenderer::from_data_set(&data_set).unwrap();
+      renderer.transfer_syntax = transfer_syntax;
+      renderer.decode_config.high_throughput_jpeg_2000_decoder = decoder;
+
+      let mut encoded_frame = encode::encode_monochrome(
+        &create_monochrome_image(&renderer.image_pixel_module),
+        &renderer.image_pixel_module,
+        transfer_syntax,
+        &encode_config(),
+      )
+      .unwrap();
+
+      for (decode_area, resolution_reduction) in [
+        (None, 0),
+        (
+          Some(CropRect {
+            left: 30,
+            top: 270,
+            width_or_right: Some(200),
+            height_or_bottom: None,
+          }),
+          0,
+        ),
+        (None, 1),
+      ] {
+        renderer.decode_area = decode_area;
+        renderer.resolution_reduction = resolution_reduction;
+
+        for color_palette in [None, Some(&standard_color_palettes::HOT_IRON)] {
+          let expected_image = renderer.render_monochrome_image(
+            &renderer
+              .decode_monochrome_frame(&mut encoded_frame)
+              .unwrap(),
+            color_palette,
+          );
+
+          assert_eq!(
+            renderer
+              .render_frame(&mut encoded_frame, color_palette)
+              .unwrap(),
+            expected_image,
+            "{} {decoder} {photometric_interpretation} {bits_allocated} \
+             {pixel_representation}",
+            transfer_syntax.name
+          );
+        }
+      }
+    }
+  }
 }
 
 #[test]
-fn test_jpeg_2000_encode_decode_cycle() {
+fn test_deflated_image_frame_encode_decode_cycle() {
   test_encode_decode_cycle(
-    all_image_pixel_modules()
-      .into_iter()
-      .filter(|m| {
-        (m.photometric_interpretation().is_monochrome()
-          || m.photometric_interpretation().is_rgb())
-          && (2..=30).contains(&m.bits_stored())
-      })
-      .collect(),
-    &transfer_syntax::JPEG_2000,
+    all_image_pixel_modules(),
+    &transfer_syntax::DEFLATED_IMAGE_FRAME_COMPRESSION,
     encode_config(),
     PixelDataDecodeConfig::default(),
-    0.15,
-    0.1,
+    0.0,
+    0.0,
   );
 }
 
 #[test]
-fn test_high_throughput_jpeg_2000_lossless_only_encode_decode_cycle() {
-  for decoder in [
-    HighThroughputJpeg2000Decoder::OpenJpeg,
-    HighThroughputJpeg2000Decoder::OpenJph,
+fn test_multithreaded_transcode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    48,
+    64,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let number_of_frames = 10;
+  let data_set = noise_data_set(&image_pixel_module, number_of_frames);
+
+  let transcode = |output_transfer_syntax,
+                   thread_count,
+                   max_frames_in_flight,
+                   max_bytes_in_flight| {
+    let mut transcode_transform =
+      new_transcode_transform(output_transfer_syntax);
+    transcode_transform.set_thread_count(thread_count);
+    transcode_transform.set_max_frames_in_flight(max_frames_in_flight);
+    transcode_transform.set_max_bytes_in_flight(max_bytes_in_flight);
+
+    (
+      transcode_data_set(&data_set, &mut transcode_transform).unwrap(),
+      transcode_transform.memory_high_water_marks(),
+    )
+  };
+
+  let frame_size = image_pixel_module.frame_size_in_bytes();
+
+  // Transcoding on worker threads outputs the same frames in the same order as
+  // transcoding them on the calling thread
+  for output_transfer_syntax in [
+    &transfer_syntax::JPEG_LS_LOSSLESS,
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+    &transfer_syntax::EXPLICIT_VR_LITTLE_ENDIAN,
   ] {
-    let mut decode_config = PixelDataDecodeConfig::default();
-    decode_config.high_throughput_jpeg_2000_decoder = decoder;
+    let (expected, _) = transcode(output_transfer_syntax, 1, 0, 0);
+    assert_eq!(
+      expected.get_pixel_data_frames().unwrap().len(),
+      number_of_frames
+    );
 
-    test_encode_decode_cycle(
-      all_image_pixel_modules()
-        .into_iter()
-        .filter(|m| {
-          !m.photometric_interpretation().is_ybr_full_422()
-            && (2..=30).contains(&m.bits_stored())
-        })
-        .collect(),
-      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
-      encode_config(),
-      decode_config,
-      0.0,
-      0.0,
+    for (thread_count, max_frames_in_flight) in [(4, 0), (3, 2), (2, 10)] {
+      let (data_set, memory_high_water_marks) = transcode(
+        output_transfer_syntax,
+        thread_count,
+        max_frames_in_flight,
+        0,
+      );
+
+      assert_eq!(data_set, expected);
+      assert!(memory_high_water_marks.frames_in_flight > 0);
+    }
+
+    // A byte budget smaller than two frames allows only one frame in flight
+    let (data_set, memory_high_water_marks) =
+      transcode(output_transfer_syntax, 4, 0, frame_size + frame_size / 2);
+
+    assert_eq!(data_set, expected);
+    assert_eq!(memory_high_water_marks.frames_in_flight, 1);
+    assert_eq!(
+      memory_high_water_marks.frame_bytes_in_flight,
+      frame_size as u64
     );
   }
 }
 
 #[test]
-fn test_high_throughput_jpeg_2000_encode_decode_cycle() {
-  for decoder in [
-    HighThroughputJpeg2000Decoder::OpenJpeg,
-    HighThroughputJpeg2000Decoder::OpenJph,
-  ] {
-    let mut decode_config = PixelDataDecodeConfig::default();
-    decode_config.high_throughput_jpeg_2000_decoder = decoder;
+fn test_fan_out_transcode() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    48,
+    64,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
 
-    test_encode_decode_cycle(
-      all_image_pixel_modules()
-        .into_iter()
-        .filter(|m| {
-          !m.photometric_interpretation().is_palette_color()
-            && !m.photometric_interpretation().is_ybr_full_422()
-            && (2..=30).contains(&m.bits_stored())
-        })
-        .collect(),
-      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000,
-      encode_config(),
-      decode_config,
-      0.02,
-      0.02,
+  let data_set = noise_data_set(&image_pixel_module, 6);
+
+  let output_transfer_syntaxes = [
+    &transfer_syntax::JPEG_LS_LOSSLESS,
+    &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+    &transfer_syntax::EXPLICIT_VR_LITTLE_ENDIAN,
+  ];
+
+  // Transcode to each output transfer syntax separately
+  let expected: Vec<DataSet> = output_transfer_syntaxes
+    .iter()
+    .map(|output_transfer_syntax| {
+      let mut transcode_transform =
+        new_transcode_transform(output_transfer_syntax);
+
+      transcode_data_set(&data_set, &mut transcode_transform).unwrap()
+    })
+    .collect();
+
+  // Transcoding to all output transfer syntaxes at once gives the same result,
+  // both on the calling thread and on worker threads
+  for thread_count in [1, 3] {
+    let mut fan_out_transform = P10PixelDataFanOutTranscodeTransform::new(
+      PixelDataDecodeConfig::default(),
     );
+    for output_transfer_syntax in output_transfer_syntaxes {
+      fan_out_transform
+        .add_target(
+          output_transfer_syntax,
+          PixelDataEncodeConfig::default(),
+          None,
+        )
+        .set_thread_count(thread_count);
+    }
+
+    let mut data_set_builders: Vec<_> = output_transfer_syntaxes
+      .iter()
+      .map(|_| DataSetBuilder::new())
+      .collect();
+
+    data_set
+      .to_p10_token_stream(&mut |token| {
+        let target_tokens = fan_out_transform.add_token(&token).unwrap();
+        for (tokens, data_set_builder) in
+          target_tokens.iter().zip(data_set_builders.iter_mut())
+        {
+          for token in tokens {
+            data_set_builder.add_token(token).unwrap();
+          }
+        }
+
+        Ok::<(), ()>(())
+      })
+      .unwrap();
+
+    let data_sets: Vec<DataSet> = data_set_builders
+      .into_iter()
+      .map(|data_set_builder| data_set_builder.final_data_set().unwrap())
+      .collect();
+
+    assert_eq!(data_sets, expected);
   }
 }
 
 #[test]
-fn test_jpeg_xl_lossless_encode_decode_cycle() {
-  for jpeg_xl_decoder in [JpegXlDecoder::LibJxl, JpegXlDecoder::JxlOxide] {
-    let mut decode_config = PixelDataDecodeConfig::default();
-    decode_config.jpeg_xl_decoder = jpeg_xl_decoder;
+fn test_transcode_with_extended_offset_table() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    16,
+    24,
+    BitsAllocated::Eight,
+    8,
+  )
+  .unwrap();
 
-    test_encode_decode_cycle(
-      all_image_pixel_modules()
-        .into_iter()
-        .filter(|m| {
-          (m.photometric_interpretation().is_monochrome()
-            || m.photometric_interpretation().is_rgb())
-            && (m.bits_allocated() == BitsAllocated::Eight
-              || m.bits_allocated() == BitsAllocated::Sixteen)
-            && m.pixel_representation().is_unsigned()
-        })
-        .collect(),
-      &transfer_syntax::JPEG_XL_LOSSLESS,
-      encode_config(),
-      decode_config,
-      0.0,
-      0.0,
+  let number_of_frames = 5;
+  let data_set = noise_data_set(&image_pixel_module, number_of_frames);
+
+  let transcode = |write_extended_offset_table, thread_count| {
+    let mut transcode_transform =
+      new_transcode_transform(&transfer_syntax::RLE_LOSSLESS);
+    transcode_transform
+      .set_write_extended_offset_table(write_extended_offset_table);
+    transcode_transform.set_thread_count(thread_count);
+
+    transcode_data_set(&data_set, &mut transcode_transform).unwrap()
+  };
+
+  let expected = transcode(false, 1);
+  assert!(!expected.has(dictionary::EXTENDED_OFFSET_TABLE.tag));
+
+  let expected_frames = expected.get_pixel_data_frames().unwrap();
+  assert_eq!(expected_frames.len(), number_of_frames);
+
+  for thread_count in [1, 3] {
+    let data_set = transcode(true, thread_count);
+    assert!(data_set.has(dictionary::EXTENDED_OFFSET_TABLE.tag));
+    assert!(data_set.has(dictionary::EXTENDED_OFFSET_TABLE_LENGTHS.tag));
+
+    // The frames read using the Extended Offset Table match the frames
+    // transcoded without one
+    assert_eq!(data_set.get_pixel_data_frames().unwrap(), expected_frames);
+
+    let frame_index = PixelDataFrameIndex::from_data_set(&data_set).unwrap();
+    assert_eq!(frame_index.len(), number_of_frames);
+    for (i, expected_frame) in expected_frames.iter().enumerate() {
+      assert_eq!(frame_index.get_frame(i).as_ref(), Some(expected_frame));
+    }
+
+    // Transcoding again doesn't carry over the input's Extended Offset Table
+    assert!(
+      !data_set
+        .transcode_pixel_data(
+          &transfer_syntax::EXPLICIT_VR_LITTLE_ENDIAN,
+          PixelDataDecodeConfig::default(),
+          PixelDataEncodeConfig::default(),
+          None,
+        )
+        .unwrap()
+        .unwrap()
+        .has(dictionary::EXTENDED_OFFSET_TABLE.tag)
     );
   }
 }
 
 #[test]
-fn test_jpeg_xl_encode_decode_cycle() {
-  for jpeg_xl_decoder in [JpegXlDecoder::LibJxl, JpegXlDecoder::JxlOxide] {
-    let mut decode_config = PixelDataDecodeConfig::default();
-    decode_config.jpeg_xl_decoder = jpeg_xl_decoder;
+fn test_transcode_with_verify_lossless() {
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    16,
+    24,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
 
-    test_encode_decode_cycle(
-      all_image_pixel_modules()
-        .into_iter()
-        .filter(|m| {
-          (m.photometric_interpretation().is_monochrome()
-            || m.photometric_interpretation().is_rgb())
-            && (m.bits_allocated() == BitsAllocated::Eight
-              || m.bits_allocated() == BitsAllocated::Sixteen)
-            && m.pixel_representation().is_unsigned()
-        })
-        .collect(),
-      &transfer_syntax::JPEG_XL,
-      encode_config(),
-      decode_config,
-      0.05,
-      0.05,
+  let number_of_frames = 4;
+  let data_set = noise_data_set(&image_pixel_module, number_of_frames);
+
+  let transcode = |data_set: &DataSet,
+                   output_transfer_syntax,
+                   verify_lossless,
+                   thread_count| {
+    let mut transcode_transform =
+      new_transcode_transform(output_transfer_syntax);
+    transcode_transform.set_verify_lossless(verify_lossless);
+    transcode_transform.set_thread_count(thread_count);
+
+    transcode_data_set(data_set, &mut transcode_transform)
+  };
+
+  let expected_frames =
+    transcode(&data_set, &transfer_syntax::RLE_LOSSLESS, false, 1)
+      .unwrap()
+      .get_pixel_data_frames()
+      .unwrap();
+  assert_eq!(expected_frames.len(), number_of_frames);
+
+  // Verifying doesn't change the transcoded frames
+  for thread_count in [1, 3] {
+    assert_eq!(
+      transcode(
+        &data_set,
+        &transfer_syntax::RLE_LOSSLESS,
+        true,
+        thread_count
+      )
+      .unwrap()
+      .get_pixel_data_frames()
+      .unwrap(),
+      expected_frames
+    );
+  }
+
+  // Pixel data that uses more bits than its Bits Stored is masked to Bits
+  // Stored by JPEG-LS, so the encoded frames don't decode to the same image
+  let mut mismatched_data_set = noise_data_set(
+    &ImagePixelModule::new_basic(
+      SamplesPerPixel::One,
+      PhotometricInterpretation::Monochrome2 {
+        pixel_representation: PixelRepresentation::Unsigned,
+      },
+      16,
+      24,
+      BitsAllocated::Sixteen,
+      16,
+    )
+    .unwrap(),
+    number_of_frames,
+  );
+  mismatched_data_set.insert(
+    dictionary::BITS_STORED.tag,
+    DataElementValue::new_unsigned_short(&[12]).unwrap(),
+  );
+  mismatched_data_set.insert(
+    dictionary::HIGH_BIT.tag,
+    DataElementValue::new_unsigned_short(&[11]).unwrap(),
+  );
+
+  for thread_count in [1, 3] {
+    assert!(
+      transcode(
+        &mismatched_data_set,
+        &transfer_syntax::JPEG_LS_LOSSLESS,
+        false,
+        thread_count
+      )
+      .is_ok()
     );
+
+    assert!(matches!(
+      transcode(
+        &mismatched_data_set,
+        &transfer_syntax::JPEG_LS_LOSSLESS,
+        true,
+        thread_count
+      ),
+      Err(P10PixelDataTranscodeTransformError::VerifyFailed { .. })
+    ));
   }
 }
 
 #[test]
-fn test_deflated_image_frame_encode_decode_cycle() {
-  test_encode_decode_cycle(
-    all_image_pixel_modules(),
-    &transfer_syntax::DEFLATED_IMAGE_FRAME_COMPRESSION,
-    encode_config(),
-    PixelDataDecodeConfig::default(),
-    0.0,
-    0.0,
-  );
+fn test_codec_stats() {
+  use dcmfx_pixel_data::codec_stats::{self, CodecStage};
+
+  let image_pixel_module = ImagePixelModule::new_basic(
+    SamplesPerPixel::One,
+    PhotometricInterpretation::Monochrome2 {
+      pixel_representation: PixelRepresentation::Unsigned,
+    },
+    48,
+    64,
+    BitsAllocated::Sixteen,
+    12,
+  )
+  .unwrap();
+
+  let data_set = noise_data_set(&image_pixel_module, 1);
+
+  codec_stats::set_enabled(true);
+
+  // Encode to HTJ2K and then decode it again with OpenJPH. Other tests may be
+  // running at the same time, so the stats are only checked for the minimum
+  // this test adds to them.
+  let htj2k_data_set = data_set
+    .transcode_pixel_data(
+      &transfer_syntax::HIGH_THROUGHPUT_JPEG_2000_LOSSLESS_ONLY,
+      PixelDataDecodeConfig::default(),
+      PixelDataEncodeConfig::default(),
+      None,
+    )
+    .unwrap()
+    .unwrap();
+
+  htj2k_data_set
+    .transcode_pixel_data(
+      &transfer_syntax::EXPLICIT_VR_LITTLE_ENDIAN,
+      PixelDataDecodeConfig {
+        high_throughput_jpeg_2000_decoder:
+          HighThroughputJpeg2000Decoder::OpenJph,
+        ..PixelDataDecodeConfig::default()
+      },
+      PixelDataEncodeConfig::default(),
+      None,
+    )
+    .unwrap()
+    .unwrap();
+
+  let stats = codec_stats::snapshot();
+
+  assert!(stats.frame_count >= 2);
+  assert!(stats.bytes_in >= image_pixel_module.frame_size_in_bytes() as u64);
+  assert!(stats.bytes_out >= image_pixel_module.frame_size_in_bytes() as u64);
+
+  for stage in [
+    CodecStage::Decode,
+    CodecStage::HeaderParse,
+    CodecStage::EntropyDecode,
+    CodecStage::Repack,
+    CodecStage::ImageProcessing,
+    CodecStage::Encode,
+  ] {
+    let stage_stats = stats.stage(stage);
+    assert!(stage_stats.count >= 1);
+    assert_eq!(stage_stats.histogram.iter().sum::<u64>(), stage_stats.count);
+  }
+
+  let prometheus = stats.to_prometheus();
+  assert!(prometheus.contains("# TYPE dcmfx_pixel_data_frames_total counter"));
+  assert!(prometheus.contains(
+    "dcmfx_pixel_data_stage_duration_seconds_bucket{stage=\"repack\",le=\"+Inf\"}"
+  ));
+
+  codec_stats::set_enabled(false);
 }
 
 fn test_encode_decode_cycle(
@@ -416,6 +3707,20 @@ fn test_color_image_encode_decode_cycle(
   assert_eq!(original_image.width(), decoded_image.width());
   assert_eq!(original_image.height(), decoded_image.height());
 
+  // Check that a planar decode matches the interleaved decode
+  let planar_data = decode::decode_color_planar(
+    &mut encoded_frame,
+    transfer_syntax,
+    &encoded_image_pixel_module,
+    &decode_config,
+  )
+  .unwrap();
+  assert_eq!(
+    planar_data,
+    planar_samples(&decoded_image),
+    "{image_pixel_module}"
+  );
+
   // Convert images to RGB f64 so their pixels can each be compared
   let original_image = original_image.to_rgb_f64_image();
   let decoded_image = decoded_image.to_rgb_f64_image();
@@ -455,6 +3760,28 @@ fn test_color_image_encode_decode_cycle(
   );
 }
 
+/// Returns the samples of a color image split into separate planes of native
+/// byte order samples.
+///
+fn planar_samples(image: &ColorImage) -> Vec<u8> {
+  fn split<T: Copy>(data: &[T], to_bytes: fn(&T) -> Vec<u8>) -> Vec<u8> {
+    (0..3)
+      .flat_map(|channel| data.iter().skip(channel).step_by(3))
+      .flat_map(to_bytes)
+      .collect()
+  }
+
+  match image.data() {
+    ColorImageData::U8 { data, .. } => split(data, |s| vec![*s]),
+    ColorImageData::U16 { data, .. } => split(data, |s| s.to_ne_bytes().into()),
+    ColorImageData::U32 { data, .. } => split(data, |s| s.to_ne_bytes().into()),
+    ColorImageData::PaletteU8 { data, .. } => data.clone(),
+    ColorImageData::PaletteU16 { data, .. } => {
+      data.iter().flat_map(|s| s.to_ne_bytes()).collect()
+    }
+  }
+}
+
 /// Returns an pixel data encode config that uses maximum quality for lossy
 /// compression so that any changes following encode and decode are minimized.
 ///
@@ -465,6 +3792,77 @@ fn encode_config() -> PixelDataEncodeConfig {
   encode_config
 }
 
+/// Creates a multi-frame data set with native pixel data of random noise that
+/// uses all the bits stored of a monochrome Image Pixel Module with 8 or 16
+/// bits allocated.
+///
+fn noise_data_set(
+  image_pixel_module: &ImagePixelModule,
+  number_of_frames: usize,
+) -> DataSet {
+  let mut rng = SmallRng::seed_from_u64(RNG_SEED);
+  let max_value = 1u32 << image_pixel_module.bits_stored();
+  let byte_count = image_pixel_module.frame_size_in_bytes() * number_of_frames;
+
+  let pixel_data = match image_pixel_module.bits_allocated() {
+    BitsAllocated::Eight => DataElementValue::new_other_byte_string(
+      (0..byte_count)
+        .map(|_| rng.random_range(0..max_value) as u8)
+        .collect(),
+    ),
+    BitsAllocated::Sixteen => DataElementValue::new_other_word_string(
+      (0..byte_count / 2)
+        .flat_map(|_| (rng.random_range(0..max_value) as u16).to_le_bytes())
+        .collect(),
+    ),
+    _ => unreachable!(),
+  }
+  .unwrap();
+
+  let mut data_set = image_pixel_module.to_data_set().unwrap();
+  data_set.insert(
+    dictionary::NUMBER_OF_FRAMES.tag,
+    DataElementValue::new_integer_string(&[number_of_frames as i32]).unwrap(),
+  );
+  data_set.insert(dictionary::PIXEL_DATA.tag, pixel_data);
+
+  data_set
+}
+
+/// Creates a pixel data transcode transform to the given transfer syntax that
+/// uses the default decode and encode configs.
+///
+fn new_transcode_transform(
+  output_transfer_syntax: &'static TransferSyntax,
+) -> P10PixelDataTranscodeTransform {
+  P10PixelDataTranscodeTransform::new(
+    output_transfer_syntax,
+    PixelDataDecodeConfig::default(),
+    PixelDataEncodeConfig::default(),
+    None,
+  )
+}
+
+/// Passes the P10 tokens of a data set through a pixel data transcode
+/// transform, and returns the resulting data set.
+///
+fn transcode_data_set(
+  data_set: &DataSet,
+  transcode_transform: &mut P10PixelDataTranscodeTransform,
+) -> Result<DataSet, P10PixelDataTranscodeTransformError> {
+  let mut data_set_builder = DataSetBuilder::new();
+
+  data_set.to_p10_token_stream(&mut |token| {
+    for token in transcode_transform.add_token(&token)? {
+      data_set_builder.add_token(&token).unwrap();
+    }
+
+    Ok(())
+  })?;
+
+  Ok(data_set_builder.final_data_set().unwrap())
+}
+
 /// Enumerates a large number of different configurations of
 /// [`ImagePixelModule`] that covers every possible combination of setups, each
 /// at a variety of different resolutions.
@@ -0,0 +1,108 @@
+// Runs the decode benchmark in `src/bench.rs` on a WASM build and prints the
+// decode throughput of each transfer syntax in the same format as the native
+// benchmark, so the two can be compared.
+//
+// To build and run on Node.js:
+//
+//   cargo build --target wasm32-unknown-unknown --no-default-features \
+//     --features dcmfx/pixel_data_native,bench --release
+//   node bench.mjs \
+//     target/wasm32-unknown-unknown/release/dcmfx_wasm_test.wasm \
+//     ../../../test/assets [iterations]
+//
+// Add `RUSTFLAGS="-C target-feature=+simd128"` to the build to benchmark WASM
+// SIMD. In a browser, import `runBenchmark()` from this module and pass it the
+// WASM module's bytes and DICOM files fetched by the page.
+
+// Runs the benchmark on each of the passed DICOM files, which are
+// `Uint8Array`s, and returns the total pixel count, time, and file count for
+// each transfer syntax.
+export async function runBenchmark(wasmBytes, dicoms, iterations = 1) {
+  const results = new Map();
+  let memory = null;
+
+  const { instance } = await WebAssembly.instantiate(wasmBytes, {
+    env: {
+      dcmfx_wasm_bench_now: () => performance.now(),
+
+      dcmfx_wasm_bench_report: (name, length, pixelCount, milliseconds) => {
+        const transferSyntax = new TextDecoder().decode(
+          new Uint8Array(memory.buffer, name, length),
+        );
+
+        const total = results.get(transferSyntax) ?? {
+          fileCount: 0,
+          pixelCount: 0,
+          milliseconds: 0,
+        };
+
+        total.fileCount += 1;
+        total.pixelCount += pixelCount;
+        total.milliseconds += milliseconds;
+
+        results.set(transferSyntax, total);
+      },
+    },
+  });
+
+  const exports = instance.exports;
+  memory = exports.memory;
+
+  for (const dicom of dicoms) {
+    const input = exports.dcmfx_wasm_bench_alloc(dicom.length);
+    new Uint8Array(memory.buffer, input, dicom.length).set(dicom);
+
+    exports.dcmfx_wasm_bench_decode(input, dicom.length, iterations);
+  }
+
+  return results;
+}
+
+// Prints benchmark results in the same format as `print_results()` in
+// `src/bench.rs`.
+export function printResults(results) {
+  console.log(
+    `${"MPixel/s".padStart(10)} ${"Files".padStart(6)}  Transfer syntax`,
+  );
+
+  for (const name of [...results.keys()].sort()) {
+    const { fileCount, pixelCount, milliseconds } = results.get(name);
+    const megapixelsPerSecond =
+      pixelCount / 1000 / Math.max(milliseconds, Number.EPSILON);
+
+    console.log(
+      `${megapixelsPerSecond.toFixed(1).padStart(10)} ` +
+        `${String(fileCount).padStart(6)}  ${name}`,
+    );
+  }
+}
+
+async function main() {
+  const fs = await import("node:fs");
+  const path = await import("node:path");
+
+  const [wasmPath, directory = "../../../test/assets", iterations = "1"] =
+    process.argv.slice(2);
+
+  const dicoms = fs
+    .readdirSync(directory, { recursive: true })
+    .filter((file) => file.endsWith(".dcm"))
+    .map((file) => fs.readFileSync(path.join(directory, file)));
+
+  const results = await runBenchmark(
+    fs.readFileSync(wasmPath),
+    dicoms,
+    Number(iterations),
+  );
+
+  printResults(results);
+}
+
+// Run main() when this module is run directly by Node.js
+if (globalThis.process?.argv?.[1] !== undefined) {
+  const { pathToFileURL } = await import("node:url");
+
+  if (import.meta.url === pathToFileURL(process.argv[1]).href) {
+    await main();
+  }
+}
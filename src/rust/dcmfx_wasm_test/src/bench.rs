@@ -0,0 +1,222 @@
+// Decode benchmarks that run the same code natively and on WASM, so that the
+// decode throughput of each transfer syntax can be compared between the two.
+// Each DICOM file's frames are decoded a number of times, and the time taken
+// is measured with a clock supplied by the caller, because WASM has no clock
+// of its own.
+//
+// On WASM the benchmark is driven by `bench.mjs`, see that file for details.
+// Natively it is run with:
+//
+//   cargo run --release -- bench ../../../test/assets [iterations]
+//
+
+#[cfg(not(feature = "std"))]
+use alloc::vec::Vec;
+
+#[cfg(all(
+  not(feature = "std"),
+  feature = "bench",
+  target_arch = "wasm32"
+))]
+use alloc::boxed::Box;
+
+use dcmfx::{core::*, p10::*, pixel_data::*};
+
+/// The result of benchmarking the decode of a single DICOM file.
+///
+pub struct BenchResult {
+  pub transfer_syntax: &'static TransferSyntax,
+  pub pixel_count: u64,
+  pub milliseconds: f64,
+}
+
+impl BenchResult {
+  /// Returns the decode throughput in megapixels per second.
+  ///
+  #[cfg(feature = "std")]
+  pub fn megapixels_per_second(&self) -> f64 {
+    self.pixel_count as f64 / 1000.0 / self.milliseconds.max(f64::EPSILON)
+  }
+}
+
+/// Decodes every frame of a DICOM file the given number of times, and returns
+/// the total number of pixels decoded and the time the decodes took. `now`
+/// returns the current time in milliseconds. Returns `None` if the file has
+/// no pixel data or its pixel data can't be decoded.
+///
+pub fn bench_dicom(
+  dicom: &[u8],
+  iterations: usize,
+  now: impl Fn() -> f64,
+) -> Option<BenchResult> {
+  let data_set = DataSet::read_p10_bytes(dicom.to_vec().into(), None).ok()?;
+  let renderer = PixelDataRenderer::from_data_set(&data_set).ok()?;
+  let mut frames: Vec<_> = data_set.get_pixel_data_frames().ok()?;
+
+  let is_monochrome = renderer.image_pixel_module.is_monochrome();
+
+  let start = now();
+
+  for _ in 0..iterations {
+    for frame in frames.iter_mut() {
+      if is_monochrome {
+        core::hint::black_box(renderer.decode_monochrome_frame(frame).ok()?);
+      } else {
+        core::hint::black_box(renderer.decode_color_frame(frame).ok()?);
+      }
+    }
+  }
+
+  let milliseconds = now() - start;
+
+  let pixel_count = renderer.image_pixel_module.pixel_count() as u64
+    * frames.len() as u64
+    * iterations as u64;
+
+  Some(BenchResult {
+    transfer_syntax: renderer.transfer_syntax,
+    pixel_count,
+    milliseconds,
+  })
+}
+
+/// Benchmarks all DICOM files in a directory and its subdirectories, and
+/// prints the decode throughput of each transfer syntax.
+///
+#[cfg(feature = "std")]
+pub fn bench_directory(directory: &std::path::Path, iterations: usize) {
+  let start = std::time::Instant::now();
+  let now = || start.elapsed().as_secs_f64() * 1000.0;
+
+  let mut results: Vec<BenchResult> = vec![];
+
+  let mut directories = vec![directory.to_path_buf()];
+  while let Some(directory) = directories.pop() {
+    let Ok(entries) = std::fs::read_dir(&directory) else {
+      continue;
+    };
+
+    for entry in entries.flatten() {
+      let path = entry.path();
+
+      if path.is_dir() {
+        directories.push(path);
+      } else if path.extension().is_some_and(|e| e == "dcm")
+        && let Ok(dicom) = std::fs::read(&path)
+        && let Some(result) = bench_dicom(&dicom, iterations, now)
+      {
+        results.push(result);
+      }
+    }
+  }
+
+  print_results(&results);
+}
+
+/// Prints the total decode throughput of each transfer syntax in a set of
+/// benchmark results. The format matches that printed by `bench.mjs`.
+///
+#[cfg(feature = "std")]
+fn print_results(results: &[BenchResult]) {
+  let mut totals: Vec<(&'static TransferSyntax, usize, BenchResult)> = vec![];
+
+  for result in results {
+    match totals
+      .iter_mut()
+      .find(|(ts, _, _)| *ts == result.transfer_syntax)
+    {
+      Some((_, file_count, total)) => {
+        *file_count += 1;
+        total.pixel_count += result.pixel_count;
+        total.milliseconds += result.milliseconds;
+      }
+
+      None => totals.push((
+        result.transfer_syntax,
+        1,
+        BenchResult {
+          transfer_syntax: result.transfer_syntax,
+          pixel_count: result.pixel_count,
+          milliseconds: result.milliseconds,
+        },
+      )),
+    }
+  }
+
+  totals.sort_by_key(|(ts, _, _)| ts.name);
+
+  println!("{:>10} {:>6}  Transfer syntax", "MPixel/s", "Files");
+  for (transfer_syntax, file_count, total) in totals {
+    println!(
+      "{:>10.1} {:>6}  {}",
+      total.megapixels_per_second(),
+      file_count,
+      transfer_syntax.name
+    );
+  }
+}
+
+#[cfg(all(feature = "bench", target_arch = "wasm32"))]
+unsafe extern "C" {
+  /// Returns the current time in milliseconds, e.g. from
+  /// `performance.now()`.
+  ///
+  fn dcmfx_wasm_bench_now() -> f64;
+
+  /// Receives the result of a call to [`dcmfx_wasm_bench_decode()`].
+  ///
+  fn dcmfx_wasm_bench_report(
+    transfer_syntax_name: *const u8,
+    transfer_syntax_name_length: usize,
+    pixel_count: f64,
+    milliseconds: f64,
+  );
+}
+
+/// Allocates memory for a DICOM file of the given size and returns a pointer
+/// to it. The host writes the file there and then passes the pointer and size
+/// to [`dcmfx_wasm_bench_decode()`], which frees the memory.
+///
+#[cfg(all(feature = "bench", target_arch = "wasm32"))]
+#[unsafe(no_mangle)]
+extern "C" fn dcmfx_wasm_bench_alloc(size: usize) -> *mut u8 {
+  let mut input = Vec::new();
+  input.resize(size, 0u8);
+
+  Box::into_raw(input.into_boxed_slice()) as *mut u8
+}
+
+/// Benchmarks the decode of a DICOM file written to memory returned by
+/// [`dcmfx_wasm_bench_alloc()`], and passes the result to the host's
+/// `dcmfx_wasm_bench_report()`. Returns zero if the file couldn't be decoded,
+/// in which case nothing is reported.
+///
+#[cfg(all(feature = "bench", target_arch = "wasm32"))]
+#[unsafe(no_mangle)]
+extern "C" fn dcmfx_wasm_bench_decode(
+  input: *mut u8,
+  size: usize,
+  iterations: usize,
+) -> i32 {
+  let input =
+    unsafe { Box::from_raw(core::ptr::slice_from_raw_parts_mut(input, size)) };
+
+  let Some(result) =
+    bench_dicom(&input, iterations, || unsafe { dcmfx_wasm_bench_now() })
+  else {
+    return 0;
+  };
+
+  let name = result.transfer_syntax.name;
+
+  unsafe {
+    dcmfx_wasm_bench_report(
+      name.as_ptr(),
+      name.len(),
+      result.pixel_count as f64,
+      result.milliseconds,
+    );
+  }
+
+  1
+}
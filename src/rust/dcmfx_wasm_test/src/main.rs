@@ -9,12 +9,17 @@
 //   wasmer target/wasm32-unknown-unknown/debug/dcmfx_wasm_test.wasm \
 //     --invoke dcmfx_wasm_test
 //
+// It also has a decode benchmark that can be run both natively and on WASM,
+// see `bench.rs`.
+//
 
 #![cfg_attr(not(feature = "std"), no_std)]
 
 #[cfg(not(feature = "std"))]
 extern crate alloc;
 
+mod bench;
+
 use dcmfx::{core::*, p10::*, pixel_data::*};
 
 const TEST_DICOMS: [(&[u8], i64); 3] = [
@@ -37,6 +42,20 @@ const TEST_DICOMS: [(&[u8], i64); 3] = [
 ];
 
 pub fn main() {
+  #[cfg(feature = "std")]
+  {
+    let args: Vec<String> = std::env::args().collect();
+
+    if args.get(1).map(String::as_str) == Some("bench") {
+      let directory =
+        args.get(2).map_or("../../../test/assets", String::as_str);
+      let iterations = args.get(3).and_then(|s| s.parse().ok()).unwrap_or(1);
+
+      bench::bench_directory(std::path::Path::new(directory), iterations);
+      return;
+    }
+  }
+
   dcmfx_wasm_test();
 }
 
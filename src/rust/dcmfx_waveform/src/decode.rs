@@ -10,6 +10,7 @@ use alloc::{
 
 use dcmfx_core::DcmfxError;
 
+use crate::ChannelDefinition;
 use crate::iods::waveform_module::WaveformSampleInterpretation;
 
 /// An error that occurred when decoding waveform sample data.
@@ -77,8 +78,7 @@ impl DcmfxError for WaveformDecodeError {
 }
 
 /// Decodes the raw stored values for every channel from channel-interleaved
-/// waveform data, indexed by channel. All channels are decoded in a single
-/// pass over the sample sets.
+/// waveform data, indexed by channel.
 ///
 pub(crate) fn decode_channel_samples(
   waveform_data: &[u8],
@@ -86,25 +86,14 @@ pub(crate) fn decode_channel_samples(
   number_of_samples: usize,
   sample_interpretation: WaveformSampleInterpretation,
 ) -> Result<Vec<Vec<i64>>, WaveformDecodeError> {
-  let bytes_per_sample = sample_interpretation.bytes_per_sample();
-  let stride = channel_count * bytes_per_sample;
-
-  let expected_length = number_of_samples.saturating_mul(stride);
-
-  if waveform_data.len() != expected_length {
-    return Err(WaveformDecodeError::DataLengthInvalid {
-      expected: expected_length,
-      actual: waveform_data.len(),
-    });
-  }
+  check_data_length(
+    waveform_data,
+    channel_count,
+    number_of_samples,
+    sample_interpretation,
+  )?;
 
-  let mut channels: Vec<Vec<i64>> = (0..channel_count)
-    .map(|_| Vec::with_capacity(number_of_samples))
-    .collect();
-
-  if channel_count == 0 {
-    return Ok(channels);
-  }
+  let mut channels = vec![vec![0i64; number_of_samples]; channel_count];
 
   // The dispatch on the sample interpretation is hoisted out of the
   // per-sample loop as this is the hot path when decoding large recordings
@@ -112,78 +101,220 @@ pub(crate) fn decode_channel_samples(
 
   match sample_interpretation {
     SI::SignedByte => {
-      decode_sample_sets(waveform_data, &mut channels, 1, |b| {
-        Ok(i64::from(b[0] as i8))
+      deinterleave(waveform_data, &mut channels, |_, b: [u8; 1]| {
+        i64::from(b[0] as i8)
       })
     }
     SI::UnsignedByte | SI::MuLawByte | SI::ALawByte => {
-      decode_sample_sets(waveform_data, &mut channels, 1, |b| {
-        Ok(i64::from(b[0]))
+      deinterleave(waveform_data, &mut channels, |_, b: [u8; 1]| {
+        i64::from(b[0])
       })
     }
 
-    SI::SignedShort => {
-      decode_sample_sets(waveform_data, &mut channels, 2, |b| {
-        Ok(i64::from(i16::from_le_bytes([b[0], b[1]])))
-      })
-    }
-    SI::UnsignedShort => {
-      decode_sample_sets(waveform_data, &mut channels, 2, |b| {
-        Ok(i64::from(u16::from_le_bytes([b[0], b[1]])))
-      })
-    }
+    SI::SignedShort => deinterleave(waveform_data, &mut channels, |_, b| {
+      i64::from(i16::from_le_bytes(b))
+    }),
+    SI::UnsignedShort => deinterleave(waveform_data, &mut channels, |_, b| {
+      i64::from(u16::from_le_bytes(b))
+    }),
 
-    SI::SignedLong => {
-      decode_sample_sets(waveform_data, &mut channels, 4, |b| {
-        Ok(i64::from(i32::from_le_bytes([b[0], b[1], b[2], b[3]])))
-      })
-    }
-    SI::UnsignedLong => {
-      decode_sample_sets(waveform_data, &mut channels, 4, |b| {
-        Ok(i64::from(u32::from_le_bytes([b[0], b[1], b[2], b[3]])))
-      })
-    }
+    SI::SignedLong => deinterleave(waveform_data, &mut channels, |_, b| {
+      i64::from(i32::from_le_bytes(b))
+    }),
+    SI::UnsignedLong => deinterleave(waveform_data, &mut channels, |_, b| {
+      i64::from(u32::from_le_bytes(b))
+    }),
 
     SI::SignedVeryLong => {
-      decode_sample_sets(waveform_data, &mut channels, 8, |b| {
-        Ok(i64::from_le_bytes(b.try_into().unwrap()))
-      })
+      deinterleave(waveform_data, &mut channels, |_, b| i64::from_le_bytes(b))
     }
+
+    // Values above i64::MAX wrap to negative values, which are then detected
+    // in a separate pass so the de-interleave loop has no early exit
     SI::UnsignedVeryLong => {
-      decode_sample_sets(waveform_data, &mut channels, 8, |b| {
-        let value = u64::from_le_bytes(b.try_into().unwrap());
+      deinterleave(waveform_data, &mut channels, |_, b| {
+        u64::from_le_bytes(b) as i64
+      });
 
-        i64::try_from(value)
-          .map_err(|_| WaveformDecodeError::SampleValueOverflow)
-      })
+      if channels.iter().flatten().any(|value| *value < 0) {
+        return Err(WaveformDecodeError::SampleValueOverflow);
+      }
     }
-  }?;
+  }
 
   Ok(channels)
 }
 
-/// Decodes channel-interleaved sample sets into per-channel sample values
-/// using the given function to decode a single sample.
+/// Decodes the values for every channel from channel-interleaved waveform
+/// data, indexed by channel, applying each channel's sensitivity, sensitivity
+/// correction factor, and baseline to the raw stored values:
+///
+/// `value = stored value × sensitivity × correction factor + baseline`
+///
+/// A missing sensitivity or correction factor is taken to be one, and a
+/// missing baseline zero. Values are in the units given by each channel's
+/// sensitivity units.
 ///
-fn decode_sample_sets(
+/// Decoding and scaling are done together in one pass over each channel's
+/// samples, so the raw stored values are never materialized.
+///
+pub(crate) fn decode_channel_values(
   waveform_data: &[u8],
-  channels: &mut [Vec<i64>],
-  bytes_per_sample: usize,
-  decode: impl Fn(&[u8]) -> Result<i64, WaveformDecodeError>,
-) -> Result<(), WaveformDecodeError> {
-  let stride = channels.len() * bytes_per_sample;
+  channels: &[ChannelDefinition],
+  number_of_samples: usize,
+  sample_interpretation: WaveformSampleInterpretation,
+) -> Result<Vec<Vec<f64>>, WaveformDecodeError> {
+  check_data_length(
+    waveform_data,
+    channels.len(),
+    number_of_samples,
+    sample_interpretation,
+  )?;
+
+  let scales: Vec<(f64, f64)> = channels
+    .iter()
+    .map(|channel| {
+      (
+        channel.sensitivity.unwrap_or(1.0)
+          * channel.sensitivity_correction_factor.unwrap_or(1.0),
+        channel.baseline.unwrap_or(0.0),
+      )
+    })
+    .collect();
 
-  for sample_set in waveform_data.chunks_exact(stride) {
-    for (channel_index, samples) in channels.iter_mut().enumerate() {
-      samples.push(decode(
-        &sample_set[channel_index * bytes_per_sample..][..bytes_per_sample],
-      )?);
+  let mut values = vec![vec![0f64; number_of_samples]; channels.len()];
+
+  use WaveformSampleInterpretation as SI;
+
+  match sample_interpretation {
+    SI::SignedByte => deinterleave(waveform_data, &mut values, |c, b| {
+      f64::from(i8::from_le_bytes(b)) * scales[c].0 + scales[c].1
+    }),
+    SI::UnsignedByte | SI::MuLawByte | SI::ALawByte => {
+      deinterleave(waveform_data, &mut values, |c, b: [u8; 1]| {
+        f64::from(b[0]) * scales[c].0 + scales[c].1
+      })
     }
+
+    SI::SignedShort => deinterleave(waveform_data, &mut values, |c, b| {
+      f64::from(i16::from_le_bytes(b)) * scales[c].0 + scales[c].1
+    }),
+    SI::UnsignedShort => deinterleave(waveform_data, &mut values, |c, b| {
+      f64::from(u16::from_le_bytes(b)) * scales[c].0 + scales[c].1
+    }),
+
+    SI::SignedLong => deinterleave(waveform_data, &mut values, |c, b| {
+      f64::from(i32::from_le_bytes(b)) * scales[c].0 + scales[c].1
+    }),
+    SI::UnsignedLong => deinterleave(waveform_data, &mut values, |c, b| {
+      f64::from(u32::from_le_bytes(b)) * scales[c].0 + scales[c].1
+    }),
+
+    SI::SignedVeryLong => deinterleave(waveform_data, &mut values, |c, b| {
+      i64::from_le_bytes(b) as f64 * scales[c].0 + scales[c].1
+    }),
+    SI::UnsignedVeryLong => deinterleave(waveform_data, &mut values, |c, b| {
+      u64::from_le_bytes(b) as f64 * scales[c].0 + scales[c].1
+    }),
+  }
+
+  Ok(values)
+}
+
+/// Checks that waveform data has the length required to hold the given number
+/// of sample sets.
+///
+fn check_data_length(
+  waveform_data: &[u8],
+  channel_count: usize,
+  number_of_samples: usize,
+  sample_interpretation: WaveformSampleInterpretation,
+) -> Result<(), WaveformDecodeError> {
+  let stride = channel_count * sample_interpretation.bytes_per_sample();
+  let expected_length = number_of_samples.saturating_mul(stride);
+
+  if waveform_data.len() != expected_length {
+    return Err(WaveformDecodeError::DataLengthInvalid {
+      expected: expected_length,
+      actual: waveform_data.len(),
+    });
   }
 
   Ok(())
 }
 
+/// The minimum number of samples each worker thread is given when
+/// de-interleaving channels concurrently. Smaller waveforms are decoded on the
+/// calling thread, as starting threads for them costs more time than it saves.
+///
+#[cfg(feature = "parallel")]
+const MIN_SAMPLES_PER_WORKER: usize = 1 << 20;
+
+/// De-interleaves channel-interleaved sample sets of `N` byte samples into the
+/// pre-sized output for each channel, using the given function to decode a
+/// single sample of a channel.
+///
+/// Each channel is extracted in its own loop over the sample sets with a fixed
+/// stride and sample offset, and no bounds checks or fallible operations in
+/// the loop body, which allows the compiler to vectorize it. With the
+/// `parallel` feature enabled, large waveforms have their channels split
+/// across worker threads.
+///
+fn deinterleave<T: Send, const N: usize>(
+  waveform_data: &[u8],
+  channels: &mut [Vec<T>],
+  decode: impl Fn(usize, [u8; N]) -> T + Sync,
+) {
+  let stride = channels.len() * N;
+  if stride == 0 {
+    return;
+  }
+
+  let deinterleave_channel = |channel_index: usize, samples: &mut [T]| {
+    let offset = channel_index * N;
+
+    for (sample, sample_set) in
+      samples.iter_mut().zip(waveform_data.chunks_exact(stride))
+    {
+      let bytes: &[u8; N] = sample_set[offset..][..N].try_into().unwrap();
+      *sample = decode(channel_index, *bytes);
+    }
+  };
+
+  #[cfg(feature = "parallel")]
+  {
+    let sample_count = waveform_data.len() / N;
+
+    let worker_count = std::thread::available_parallelism()
+      .map_or(1, |n| n.get())
+      .min(sample_count / MIN_SAMPLES_PER_WORKER)
+      .min(channels.len());
+
+    if worker_count > 1 {
+      let channels_per_worker = channels.len().div_ceil(worker_count);
+      let deinterleave_channel = &deinterleave_channel;
+
+      std::thread::scope(|scope| {
+        for (i, worker_channels) in
+          channels.chunks_mut(channels_per_worker).enumerate()
+        {
+          scope.spawn(move || {
+            for (j, samples) in worker_channels.iter_mut().enumerate() {
+              deinterleave_channel(i * channels_per_worker + j, samples);
+            }
+          });
+        }
+      });
+
+      return;
+    }
+  }
+
+  for (channel_index, samples) in channels.iter_mut().enumerate() {
+    deinterleave_channel(channel_index, samples);
+  }
+}
+
 /// Decodes a single raw stored value from little-endian bytes. The length of
 /// `bytes` must equal the sample interpretation's number of bytes per sample.
 ///
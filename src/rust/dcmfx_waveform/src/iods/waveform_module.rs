@@ -968,6 +968,47 @@ mod tests {
     );
   }
 
+  #[test]
+  fn channel_values_applies_channel_scaling() {
+    let scaled_channel = ChannelDefinition {
+      sensitivity: Some(2.5),
+      sensitivity_correction_factor: Some(2.0),
+      baseline: Some(-1.0),
+      ..test_channel()
+    };
+
+    let multiplex_group = Rc::new(
+      WaveformMultiplexGroup::new(
+        WaveformOriginality::Original,
+        2,
+        500.0,
+        None,
+        None,
+        None,
+        None,
+        None,
+        vec![test_channel(), scaled_channel],
+        WaveformBitsAllocated::Sixteen,
+        WaveformSampleInterpretation::SignedShort,
+        None,
+      )
+      .unwrap(),
+    );
+
+    let chunk = WaveformChunk::new(
+      multiplex_group,
+      0,
+      0,
+      2,
+      vec![1, 0, 4, 0, 0xFE, 0xFF, 0xFC, 0xFF].into(),
+    );
+
+    assert_eq!(
+      chunk.channel_values(),
+      Ok(vec![vec![1.0, -2.0], vec![19.0, -21.0]])
+    );
+  }
+
   #[test]
   fn to_data_set_from_data_set_round_trip() {
     let mut multiplex_group = WaveformMultiplexGroup::new(
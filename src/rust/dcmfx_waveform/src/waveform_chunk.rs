@@ -11,7 +11,8 @@ use crate::{WaveformDecodeError, WaveformMultiplexGroup, decode};
 /// consecutive whole sample sets in channel-interleaved order, along with the
 /// multiplex group the sample sets belong to.
 ///
-/// A chunk's samples are decoded using [`WaveformChunk::channel_samples()`].
+/// A chunk's samples are decoded using [`WaveformChunk::channel_samples()`],
+/// or [`WaveformChunk::channel_values()`] to also apply channel scaling.
 ///
 #[derive(Clone, Debug, PartialEq)]
 pub struct WaveformChunk {
@@ -112,4 +113,23 @@ impl WaveformChunk {
       self.multiplex_group.sample_interpretation(),
     )
   }
+
+  /// Returns the values for every channel in this chunk, indexed by channel,
+  /// with each channel's sensitivity, sensitivity correction factor, and
+  /// baseline applied to its raw stored values. A missing sensitivity or
+  /// correction factor is taken to be one, and a missing baseline zero, in
+  /// which case the values equal those returned by
+  /// [`WaveformChunk::channel_samples()`].
+  ///
+  /// Values are decoded and scaled directly from this chunk's data without
+  /// first materializing the raw stored values.
+  ///
+  pub fn channel_values(&self) -> Result<Vec<Vec<f64>>, WaveformDecodeError> {
+    decode::decode_channel_values(
+      &self.data,
+      self.multiplex_group.channels(),
+      self.number_of_samples as usize,
+      self.multiplex_group.sample_interpretation(),
+    )
+  }
 }